@@ -74,6 +74,8 @@ algo_impl2lib(ilb_algo_impl_t a)
 		return (ILB_ALG_HASH_IP_SPORT);
 	case ILB_ALG_IMPL_HASH_IP_VIP:
 		return (ILB_ALG_HASH_IP_VIP);
+	case ILB_ALG_IMPL_MAGLEV:
+		return (ILB_ALG_MAGLEV);
 	}
 	return (0);
 }
@@ -104,6 +106,8 @@ algo_lib2impl(ilb_algo_t a)
 		return (ILB_ALG_IMPL_HASH_IP_SPORT);
 	case ILB_ALG_HASH_IP_VIP:
 		return (ILB_ALG_IMPL_HASH_IP_VIP);
+	case ILB_ALG_MAGLEV:
+		return (ILB_ALG_IMPL_MAGLEV);
 	}
 	return (0);
 }
@@ -319,7 +319,8 @@ struct algo_tbl_entry {
 	{ILB_ALG_ROUNDROBIN, "ROUNDROBIN"},
 	{ILB_ALG_HASH_IP, "HASH-IP"},
 	{ILB_ALG_HASH_IP_SPORT, "HASH-IP-PORT"},
-	{ILB_ALG_HASH_IP_VIP, "HASH-IP-VIP"}
+	{ILB_ALG_HASH_IP_VIP, "HASH-IP-VIP"},
+	{ILB_ALG_MAGLEV, "MAGLEV"}
 };
 
 #define	ILBD_ALGO_TBL_SIZE (sizeof (algo_tbl) / \
@@ -54,6 +54,7 @@ ilbadm_val_type_t algo_types[] = {
 	{(int)ILB_ALG_HASH_IP, "hash-ip", "hip"},
 	{(int)ILB_ALG_HASH_IP_SPORT, "hash-ip-port", "hipp"},
 	{(int)ILB_ALG_HASH_IP_VIP, "hash-ip-vip", "hipv"},
+	{(int)ILB_ALG_MAGLEV, "maglev", "mglv"},
 	{ILBD_BAD_VAL, NULL, NULL}
 };
 
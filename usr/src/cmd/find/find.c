@@ -57,6 +57,9 @@
 #include <fnmatch.h>
 #include <langinfo.h>
 #include <ftw.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <libgen.h>
 #include <err.h>
 #include <regex.h>
@@ -73,6 +76,8 @@
 #define	REMOTE_FS		"/etc/dfs/fstypes"
 #define	N_FSTYPES		20
 #define	SHELL_MAXARGS		253	/* see doexec() for description */
+#define	PF_MAXTHREADS		64	/* limit on FIND_PREFETCH */
+#define	PF_QSIZE		(2 * PF_MAXTHREADS)	/* prefetch jobs */
 
 /*
  * This is the list of operations
@@ -220,6 +225,8 @@ static char		*getname();
 static int		readmode();
 static mode_t		getmode();
 static char		*gettail();
+static void		prefetch_init(void);
+static void		prefetch(const char *);
 
 
 static int walkflags = FTW_CHDIR|FTW_PHYS|FTW_ANYERR|FTW_NOLOOP;
@@ -249,6 +256,7 @@ static int		exec_exitcode = 0;
 static regex_t		*preg = NULL;
 static int		npreg = 0;
 static int		mindepth = -1, maxdepth = -1;
+static int		pf_nthreads;	/* see prefetch() */
 extern char		**environ;
 
 int
@@ -299,6 +307,8 @@ main(int argc, char **argv)
 		usage();
 	}
 
+	prefetch_init();
+
 	for (paths = 0; (cp = argv[paths]) != 0; ++paths) {
 		if (*cp == '-')
 			break;
@@ -839,6 +849,15 @@ struct FTW *state;
 		return (0);
 	}
 
+	/*
+	 * nftw() is about to read this directory; get the attributes of its
+	 * entries on their way.  With FTW_CHDIR, the current directory is the
+	 * parent of all but the starting point.
+	 */
+	if (type == FTW_D && pf_nthreads > 0)
+		prefetch((walkflags & FTW_CHDIR) && state->level > 0 ?
+		    name + state->base : name);
+
 	if ((maxdepth != -1 && state->level > maxdepth) ||
 	    (mindepth != -1 && state->level < mindepth))
 		return (0);
@@ -2279,3 +2298,144 @@ static char
 	}
 	return (base);
 }
+
+/*
+ * Directory prefetch.
+ *
+ * nftw() stats the entries of a directory one at a time, and on NFS or a
+ * cold ZFS pool each of those stats is a round trip to the server or the
+ * disks.  If FIND_PREFETCH is set in the environment to a number of
+ * threads, each directory handed to execute() as it is entered is also
+ * given to that many threads, each of which stats a share of the entries
+ * so that the attributes are cached by the time nftw() gets to them.  The
+ * walk itself, and so the order of the output, is unchanged.
+ *
+ * The prefetch is only a hint: a directory is skipped when the queue is
+ * full or it cannot be opened, and nothing is done under -depth, where
+ * directories are only seen after their contents.
+ */
+struct pfdir {
+	int		pd_fd;		/* the directory */
+	int		pd_refs;	/* jobs still to use pd_fd */
+};
+
+struct pfjob {
+	struct pfdir	*pj_dir;
+	int		pj_slice;	/* stat entries pj_slice mod nthreads */
+	int		pj_flags;	/* fstatat() flags */
+};
+
+static pthread_mutex_t	pf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	pf_cv = PTHREAD_COND_INITIALIZER;
+static struct pfjob	pf_queue[PF_QSIZE];
+static int		pf_head;
+static int		pf_count;
+
+/*ARGSUSED*/
+static void *
+prefetch_thread(void *arg)
+{
+	struct pfjob job;
+	struct dirent *dp;
+	struct stat sb;
+	DIR *dirp;
+	int fd, i, last;
+
+	for (;;) {
+		(void) pthread_mutex_lock(&pf_lock);
+		while (pf_count == 0)
+			(void) pthread_cond_wait(&pf_cv, &pf_lock);
+		job = pf_queue[pf_head];
+		pf_head = (pf_head + 1) % PF_QSIZE;
+		pf_count--;
+		(void) pthread_mutex_unlock(&pf_lock);
+
+		/* Each thread reads the directory through its own offset */
+		if ((fd = openat(job.pj_dir->pd_fd, ".", O_RDONLY)) >= 0) {
+			if ((dirp = fdopendir(fd)) != NULL) {
+				for (i = 0; (dp = readdir(dirp)) != NULL; i++) {
+					if (i % pf_nthreads != job.pj_slice)
+						continue;
+					(void) fstatat(job.pj_dir->pd_fd,
+					    dp->d_name, &sb, job.pj_flags);
+				}
+				(void) closedir(dirp);
+			} else {
+				(void) close(fd);
+			}
+		}
+
+		(void) pthread_mutex_lock(&pf_lock);
+		last = (--job.pj_dir->pd_refs == 0);
+		(void) pthread_mutex_unlock(&pf_lock);
+		if (last) {
+			(void) close(job.pj_dir->pd_fd);
+			free(job.pj_dir);
+		}
+	}
+	/* NOTREACHED */
+	return (NULL);
+}
+
+static void
+prefetch_init(void)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+	char *cp;
+	int i;
+
+	if ((cp = getenv("FIND_PREFETCH")) == NULL ||
+	    (pf_nthreads = atoi(cp)) <= 0) {
+		pf_nthreads = 0;
+		return;
+	}
+	if (pf_nthreads > PF_MAXTHREADS)
+		pf_nthreads = PF_MAXTHREADS;
+
+	(void) pthread_attr_init(&attr);
+	(void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < pf_nthreads; i++) {
+		if (pthread_create(&tid, &attr, prefetch_thread, NULL) != 0)
+			break;
+	}
+	(void) pthread_attr_destroy(&attr);
+
+	/* Jobs are sliced among the threads there are */
+	pf_nthreads = i;
+}
+
+static void
+prefetch(const char *path)
+{
+	struct pfdir *pd;
+	int fd, i, full;
+
+	/* Only this thread adds to the queue, so it cannot fill meanwhile */
+	(void) pthread_mutex_lock(&pf_lock);
+	full = (pf_count + pf_nthreads > PF_QSIZE);
+	(void) pthread_mutex_unlock(&pf_lock);
+	if (full)
+		return;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return;
+	if ((pd = malloc(sizeof (struct pfdir))) == NULL) {
+		(void) close(fd);
+		return;
+	}
+	pd->pd_fd = fd;
+	pd->pd_refs = pf_nthreads;
+
+	(void) pthread_mutex_lock(&pf_lock);
+	for (i = 0; i < pf_nthreads; i++) {
+		struct pfjob *pj = &pf_queue[(pf_head + pf_count) % PF_QSIZE];
+
+		pj->pj_dir = pd;
+		pj->pj_slice = i;
+		pj->pj_flags = (walkflags & FTW_PHYS) ? AT_SYMLINK_NOFOLLOW : 0;
+		pf_count++;
+	}
+	(void) pthread_cond_broadcast(&pf_cv);
+	(void) pthread_mutex_unlock(&pf_lock);
+}
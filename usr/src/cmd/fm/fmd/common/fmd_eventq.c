@@ -165,10 +165,11 @@ fmd_eventq_insert_at_head(fmd_eventq_t *eq, fmd_event_t *ep)
 			fmd_eventqstat_dispatch(eq);
 
 		fmd_list_prepend(&eq->eq_list, eqe);
-		eq->eq_size++;
+
+		if (eq->eq_size++ == 0)
+			(void) pthread_cond_broadcast(&eq->eq_cv);
 	}
 
-	(void) pthread_cond_broadcast(&eq->eq_cv);
 	(void) pthread_mutex_unlock(&eq->eq_lock);
 
 	if (!ok)
@@ -208,13 +209,17 @@ fmd_eventq_insert_at_time(fmd_eventq_t *eq, fmd_event_t *ep)
 	 * prior to any enqueued event whose time is after the timer expired.
 	 * We use a simple insertion sort for this task, as queue lengths are
 	 * typically short and events do *tend* to be received chronologically.
+	 * The sort is skipped for an event that a full queue will drop, as
+	 * otherwise every event of an ereport storm would walk the whole queue
+	 * only to be thrown away.
 	 */
-	for (oqe = fmd_list_prev(&eq->eq_list); oqe; oqe = fmd_list_prev(oqe)) {
-		if (hrt >= fmd_event_hrtime(oqe->eqe_event))
-			break; /* 'ep' is newer than the event in 'oqe' */
-	}
-
 	if ((ok = eq->eq_size < eq->eq_limit || evt != FMD_EVT_PROTOCOL) != 0) {
+		for (oqe = fmd_list_prev(&eq->eq_list); oqe != NULL;
+		    oqe = fmd_list_prev(oqe)) {
+			if (hrt >= fmd_event_hrtime(oqe->eqe_event))
+				break; /* 'ep' is newer than 'oqe' */
+		}
+
 		if (evt != FMD_EVT_CTL)
 			fmd_eventqstat_dispatch(eq);
 
@@ -222,10 +227,11 @@ fmd_eventq_insert_at_time(fmd_eventq_t *eq, fmd_event_t *ep)
 			fmd_list_prepend(&eq->eq_list, eqe);
 		else
 			fmd_list_insert_after(&eq->eq_list, oqe, eqe);
-		eq->eq_size++;
+
+		if (eq->eq_size++ == 0)
+			(void) pthread_cond_broadcast(&eq->eq_cv);
 	}
 
-	(void) pthread_cond_broadcast(&eq->eq_cv);
 	(void) pthread_mutex_unlock(&eq->eq_lock);
 
 	if (!ok)
@@ -244,6 +250,12 @@ fmd_eventq_delete(fmd_eventq_t *eq)
 top:
 	(void) pthread_mutex_lock(&eq->eq_lock);
 
+	/*
+	 * The queue has a single consumer, and it only sleeps here while the
+	 * queue is empty or suspended, so inserts need only wake it when they
+	 * make the queue non-empty; fmd_eventq_resume() and fmd_eventq_abort()
+	 * wake it for the other two cases.
+	 */
 	while (!(eq->eq_flags & FMD_EVENTQ_ABORT) &&
 	    (eq->eq_size == 0 || (eq->eq_flags & FMD_EVENTQ_SUSPEND)))
 		(void) pthread_cond_wait(&eq->eq_cv, &eq->eq_lock);
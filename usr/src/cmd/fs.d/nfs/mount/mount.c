@@ -948,6 +948,8 @@ static char *optlist[] = {
 	MNTOPT_EXEC,
 #define	OPT_NOEXEC	48
 	MNTOPT_NOEXEC,
+#define	OPT_NCONNECT	49
+	MNTOPT_NCONNECT,
 	NULL
 };
 
@@ -1188,6 +1190,15 @@ set_args(int *mntflags, struct nfs_args *args, char *fshost, struct mnttab *mnt)
 			args->flags &= ~(NFSMNT_DIRECTIO);
 			break;
 
+		case OPT_NCONNECT:
+			/*
+			 * Only checked here; the kernel takes it from the
+			 * mount option string.
+			 */
+			if (convert_int(&num, val) != 0 || num < 1)
+				goto badopt;
+			break;
+
 		case OPT_XATTR:
 		case OPT_NOXATTR:
 			/*
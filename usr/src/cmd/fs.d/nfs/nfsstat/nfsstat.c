@@ -1249,10 +1249,15 @@ mi_print(void)
 		printf(",rsize=%d,wsize=%d,retrans=%d,timeo=%d",
 		    mik.mik_curread, mik.mik_curwrite, mik.mik_retrans,
 		    mik.mik_timeo);
+		if (mik.mik_nconnect > 1)
+			printf(",nconnect=%d", mik.mik_nconnect);
 		printf("\n");
 		printf(" Attr cache:	acregmin=%d,acregmax=%d"
 		    ",acdirmin=%d,acdirmax=%d\n", mik.mik_acregmin,
 		    mik.mik_acregmax, mik.mik_acdirmin, mik.mik_acdirmax);
+		printf(" Read-ahead:	latency=%uus,rate=%" PRIu64 "KB/s"
+		    ",hits=%" PRIu64 ",misses=%" PRIu64 "\n", mik.mik_ralat,
+		    mik.mik_rarate / 1024, mik.mik_rahits, mik.mik_ramisses);
 
 		if (transport_flag) {
 			printf(" Transport:	proto=rdma, plugin=%s\n",
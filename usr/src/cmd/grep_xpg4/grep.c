@@ -62,6 +62,7 @@
 
 #define	BSIZE		512		/* Size of block for -b */
 #define	BUFSIZE		8192		/* Input buffer size */
+#define	RDBUFSIZE	(128 * 1024)	/* Initial file buffer size */
 #define	MAX_DEPTH	1000		/* how deep to recurse */
 
 #define	M_CSETSIZE	256		/* singlebyte chars */
@@ -611,6 +612,23 @@ fixpatterns(void)
 	PATTERN	*pp;
 	int	rv, fix_pattern, npatterns;
 
+	/*
+	 * Regular expressions with no special characters in them
+	 * are fixed strings.  In a singlebyte locale, search for
+	 * them the way fgrep would, which avoids running regexec()
+	 * on every line and can use BMG for a single pattern.
+	 * Patterns made by -w have "\<" and "\>" in them, so they
+	 * are never taken for fixed strings.
+	 */
+	if (!Fflag && !mblocale) {
+		for (pp = patterns; pp != NULL; pp = pp->next) {
+			if (strpbrk(pp->pattern, "\\.[]*^$+?(){}|") != NULL)
+				break;
+		}
+		if (pp == NULL)
+			Fflag++;
+	}
+
 	/*
 	 * As REG_ANCHOR flag is not supported in the current Solaris,
 	 * need to fix the specified pattern if -x is specified with
@@ -732,12 +750,7 @@ fixpatterns(void)
 static char *
 find_nl(const char *ptr, size_t len)
 {
-	while (len-- != 0) {
-		if (*ptr++ == '\n') {
-			return ((char *)--ptr);
-		}
-	}
-	return (NULL);
+	return (memchr(ptr, '\n', len));
 }
 
 /*
@@ -830,7 +843,7 @@ grep(int fd, const char *fn)
 	}
 
 	if (prntbuf == NULL) {
-		prntbuflen = BUFSIZE;
+		prntbuflen = RDBUFSIZE;
 		if ((prntbuf = malloc(prntbuflen + 1)) == NULL) {
 			(void) fprintf(stderr, gettext("%s: out of memory\n"),
 			    cmdname);
@@ -965,8 +978,11 @@ L_start_process:
 				/*
 				 * Pattern found not in the first line
 				 * of this chunk.
-				 * Discard the first line.
+				 * Discard all the lines before the one
+				 * it was found in, rather than one at a
+				 * time searching again from each.
 				 */
+				ptrend = rfind_nl(ptr, bline - ptr);
 				line_len = ptrend - ptr;
 				goto L_skip_line;
 			}
@@ -935,6 +935,28 @@ kmem_estimate_slab(uintptr_t addr, const kmem_slab_t *sp, size_t *est)
 	return (WALK_NEXT);
 }
 
+/*
+ * Returns the number of full magazines in a cache's per-lgroup depots.
+ */
+static long
+kmem_lgrp_full_total(const kmem_cache_t *cp)
+{
+	kmem_lgrp_depot_t kld;
+	long total = 0;
+	int i;
+
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		if (mdb_vread(&kld, sizeof (kld),
+		    (uintptr_t)&cp->cache_lgrp_depot[i]) == -1) {
+			mdb_warn("couldn't read lgroup depot at %p",
+			    &cp->cache_lgrp_depot[i]);
+			break;
+		}
+		total += kld.kld_full.ml_total;
+	}
+	return (total);
+}
+
 /*
  * Returns an upper bound on the number of allocated buffers in a given
  * cache.
@@ -951,7 +973,8 @@ kmem_estimate_allocated(uintptr_t addr, const kmem_cache_t *cp)
 	    (mdb_walk_cb_t)kmem_estimate_slab, &cache_est, addr);
 
 	if ((magsize = kmem_get_magsize(cp)) != 0) {
-		size_t mag_est = cp->cache_full.ml_total * magsize;
+		size_t mag_est = (cp->cache_full.ml_total +
+		    kmem_lgrp_full_total(cp)) * magsize;
 
 		if (cache_est >= mag_est) {
 			cache_est -= mag_est;
@@ -982,9 +1005,10 @@ int
 kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
     void ***maglistp, size_t *magcntp, size_t *magmaxp, int alloc_flags)
 {
-	kmem_magazine_t *kmp, *mp;
+	kmem_magazine_t *kmp, *mp = NULL;
+	kmem_lgrp_depot_t kld;
 	void **maglist = NULL;
-	int i, cpu;
+	int i, cpu, l;
 	size_t magsize, magmax, magbsize;
 	size_t magcnt = 0;
 
@@ -1003,16 +1027,17 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
 	/*
 	 * There are several places where we need to go buffer hunting:
 	 * the per-CPU loaded magazine, the per-CPU spare full magazine,
-	 * and the full magazine list in the depot.
+	 * and the full magazine lists in the depot and the lgroup depots.
 	 *
 	 * For an upper bound on the number of buffers in the magazine
-	 * layer, we have the number of magazines on the cache_full
-	 * list plus at most two magazines per CPU (the loaded and the
+	 * layer, we have the number of magazines on the full lists
+	 * plus at most two magazines per CPU (the loaded and the
 	 * spare).  Toss in 100 magazines as a fudge factor in case this
 	 * is live (the number "100" comes from the same fudge factor in
 	 * crash(1M)).
 	 */
-	magmax = (cp->cache_full.ml_total + 2 * ncpus + 100) * magsize;
+	magmax = (cp->cache_full.ml_total + kmem_lgrp_full_total(cp) +
+	    2 * ncpus + 100) * magsize;
 	magbsize = offsetof(kmem_magazine_t, mag_round[magsize]);
 
 	if (magbsize >= PAGESIZE / 2) {
@@ -1039,6 +1064,24 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
 
 	dprintf(("cache_full list done\n"));
 
+	for (l = 0; l < cp->cache_lgrp_ndepot; l++) {
+		if (mdb_vread(&kld, sizeof (kld),
+		    (uintptr_t)&cp->cache_lgrp_depot[l]) == -1) {
+			mdb_warn("couldn't read lgroup depot at %p",
+			    &cp->cache_lgrp_depot[l]);
+			goto fail;
+		}
+		for (kmp = kld.kld_full.ml_list; kmp != NULL; ) {
+			READMAG_ROUNDS(magsize);
+			kmp = mp->mag_next;
+
+			if (kmp == kld.kld_full.ml_list)
+				break; /* kld_full list loop detected */
+		}
+	}
+
+	dprintf(("lgroup depots done\n"));
+
 	/*
 	 * Now whip through the CPUs, snagging the loaded magazines
 	 * and full spares.
@@ -217,9 +217,8 @@ retry:
 	dnlc_free(); /* Free up the mdb hashed dnlc - if any */
 
 	/*
-	 * Although nc_hashsz and the location of nc_hash doesn't currently
-	 * change, it may do in the future with a more dynamic dnlc.
-	 * So always read these values afresh.
+	 * The kernel replaces nc_hash with a larger table as the dnlc
+	 * grows, so always read these values afresh.
 	 */
 	if (mdb_readvar(&nc_hashsz, "nc_hashsz") == -1) {
 		mdb_warn("failed to read nc_hashsz");
@@ -259,10 +258,10 @@ retry:
 			return (-1);
 		}
 
-		ncprev_va = head;
+		ncprev_va = 0;
 		nc_va = (uintptr_t)(nch.hash_next);
 		/* for each entry in the chain */
-		while (nc_va != head) {
+		while (nc_va != 0) {
 			/*
 			 * The size of the ncache entries varies
 			 * because the name is appended to the structure.
@@ -47,6 +47,7 @@
 #include <string.h>
 #include <umem.h>
 #include <fcntl.h>
+#include <atomic.h>
 #include "cache.h"
 #include "nscd_door.h"
 #include "nscd_log.h"
@@ -1707,13 +1708,16 @@ lookup_int(nsc_lookup_args_t *largs, int flag)
 			return (SUCCESS);
 		}
 
+		/*
+		 * Cache hits are the common case, and they are counted
+		 * atomically once db_mutex has been dropped: stats_mutex is
+		 * shared by all the databases of the context, and taking it
+		 * here would both lengthen the db_mutex hold time and make
+		 * lookups in unrelated databases (e.g. passwd by name and by
+		 * uid) serialize on it.
+		 */
 		if (NSCD_GET_STATUS((nss_pheader_t *)this_entry->buffer) ==
 		    NSS_SUCCESS) {
-			/* positive hit */
-			(void) mutex_lock(&ctx->stats_mutex);
-			ctx->stats.pos_hits++;
-			(void) mutex_unlock(&ctx->stats_mutex);
-
 			/* update response buffer */
 			if (copy_result(largs->buffer,
 			    this_entry->buffer) != NSS_SUCCESS) {
@@ -1724,15 +1728,14 @@ lookup_int(nsc_lookup_args_t *largs, int flag)
 			}
 
 			(void) mutex_unlock(&nscdb->db_mutex);
+
+			/* positive hit */
+			atomic_inc_ulong(&ctx->stats.pos_hits);
+
 			NSC_LOOKUP_LOG(DEBUG,
 			    "%s: positive entry in cache\n");
 			return (SUCCESS);
 		} else {
-			/* negative hit */
-			(void) mutex_lock(&ctx->stats_mutex);
-			ctx->stats.neg_hits++;
-			(void) mutex_unlock(&ctx->stats_mutex);
-
 			NSCD_SET_STATUS((nss_pheader_t *)largs->buffer,
 			    NSCD_GET_STATUS(this_entry->buffer),
 			    NSCD_GET_ERRNO(this_entry->buffer));
@@ -1740,6 +1743,10 @@ lookup_int(nsc_lookup_args_t *largs, int flag)
 			    NSCD_GET_HERRNO(this_entry->buffer));
 
 			(void) mutex_unlock(&nscdb->db_mutex);
+
+			/* negative hit */
+			atomic_inc_ulong(&ctx->stats.neg_hits);
+
 			NSC_LOOKUP_LOG(DEBUG,
 			    "%s: negative entry in cache\n");
 			return (NOTFOUND);
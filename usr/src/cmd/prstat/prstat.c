@@ -164,6 +164,11 @@ static list_t	projects;			/* list of projects */
 static list_t	zones;				/* list of zones */
 static list_t	lgroups;			/* list of lgroups */
 
+static int	allpsinfo_fd = -1;		/* /proc/psinfo */
+static prheader_t *allpsinfo;			/* snapshot from /proc/psinfo */
+static size_t	allpsinfo_size;			/* size of snapshot buffer */
+static long	allpsinfo_next;			/* next entry in snapshot */
+
 static volatile uint_t sigwinch = 0;
 static volatile uint_t sigtstp = 0;
 static volatile uint_t sigterm = 0;
@@ -890,10 +895,81 @@ add_lwp(psinfo_t *psinfo, lwpsinfo_t *lwpsinfo, int flags)
 	(void) memcpy(&lwp->li_info.pr_lwp, lwpsinfo, sizeof (lwpsinfo_t));
 }
 
+/*
+ * Take a snapshot of the psinfo of all processes from /proc/psinfo.
+ * Returns 0 on success, or -1 if it can't be had, in which case the
+ * caller falls back to reading /proc/<pid>/psinfo for each process.
+ */
+static int
+read_allpsinfo(void)
+{
+	ssize_t n;
+
+	if (allpsinfo_fd == -1)
+		return (-1);
+	while ((n = pread(allpsinfo_fd, allpsinfo, allpsinfo_size, 0)) ==
+	    allpsinfo_size) {
+		/* there may be more, try a larger buffer */
+		allpsinfo_size *= 2;
+		allpsinfo = Realloc(allpsinfo, allpsinfo_size);
+	}
+	if (n < (ssize_t)sizeof (prheader_t) ||
+	    allpsinfo->pr_entsize < sizeof (psinfo_t))
+		return (-1);
+	allpsinfo_next = 0;
+	return (0);
+}
+
+static int
+skip_pid(pid_t pid)
+{
+	if (pid == 0 || pid == 2 || pid == 3)
+		return (1);	/* skip sched, pageout and fsflush */
+	return (has_element(&pid_tbl, pid) == 0);
+}
+
+/*
+ * Get the psinfo of the next process of interest and return its pid, or
+ * return -1 once there are no more.  If we have a snapshot from
+ * /proc/psinfo the processes come from that; otherwise we go through
+ * the /proc directory, reading /proc/<pid>/psinfo for each process.
+ */
+static pid_t
+next_psinfo(DIR *procdir, int snapshot, psinfo_t *psinfo)
+{
+	dirent_t *direntp;
+	fds_t *fds;
+	pid_t pid;
+
+	if (snapshot) {
+		while (allpsinfo_next < allpsinfo->pr_nent) {
+			(void) memcpy(psinfo, (char *)(allpsinfo + 1) +
+			    allpsinfo_next++ * allpsinfo->pr_entsize,
+			    sizeof (psinfo_t));
+			if (!skip_pid(psinfo->pr_pid))
+				return (psinfo->pr_pid);
+		}
+		return (-1);
+	}
+
+	while ((direntp = readdir(procdir)) != NULL) {
+		if (direntp->d_name[0] == '.')	/* skip "." and ".."  */
+			continue;
+		pid = atoi(direntp->d_name);
+		if (skip_pid(pid))
+			continue;	/* check if we really want this pid */
+		fds = fds_get(pid);	/* get ptr to file descriptors */
+		if (read_procfile(&fds->fds_psinfo, direntp->d_name,
+		    "psinfo", psinfo, sizeof (psinfo_t)) == 0)
+			return (pid);
+	}
+	return (-1);
+}
+
 static void
 prstat_scandir(DIR *procdir)
 {
-	char *pidstr;
+	char pidstr[16];
 	pid_t pid;
 	id_t lwpid;
 	size_t entsz;
@@ -902,7 +978,7 @@ prstat_scandir(DIR *procdir)
 
 	fds_t *fds;
 	lwp_info_t *lwp;
-	dirent_t *direntp;
+	int snapshot;
 
 	prheader_t	header;
 	psinfo_t	psinfo;
@@ -916,20 +992,12 @@ prstat_scandir(DIR *procdir)
 	total_mem = 0;
 
 	convert_zone(&zone_tbl);
-	for (rewinddir(procdir); (direntp = readdir(procdir)); ) {
-		pidstr = direntp->d_name;
-		if (pidstr[0] == '.')	/* skip "." and ".."  */
-			continue;
-		pid = atoi(pidstr);
-		if (pid == 0 || pid == 2 || pid == 3)
-			continue;	/* skip sched, pageout and fsflush */
-		if (has_element(&pid_tbl, pid) == 0)
-			continue;	/* check if we really want this pid */
+	if (!(snapshot = (read_allpsinfo() == 0)))
+		rewinddir(procdir);
+	while ((pid = next_psinfo(procdir, snapshot, &psinfo)) != -1) {
+		(void) snprintf(pidstr, sizeof (pidstr), "%d", (int)pid);
 		fds = fds_get(pid);	/* get ptr to file descriptors */
 
-		if (read_procfile(&fds->fds_psinfo, pidstr,
-		    "psinfo", &psinfo, sizeof (psinfo_t)) != 0)
-			continue;
 		if (!has_uid(&ruid_tbl, psinfo.pr_uid) ||
 		    !has_uid(&euid_tbl, psinfo.pr_euid) ||
 		    !has_element(&prj_tbl, psinfo.pr_projid) ||
@@ -1567,6 +1635,10 @@ main(int argc, char **argv)
 		curses_on();
 	if ((procdir = opendir("/proc")) == NULL)
 		Die(gettext("cannot open /proc directory\n"));
+	if ((allpsinfo_fd = open("/proc/psinfo", O_RDONLY)) != -1) {
+		allpsinfo_size = 64 * 1024;
+		allpsinfo = Malloc(allpsinfo_size);
+	}
 	if (opts.o_outpmode & OPT_TTY) {
 		(void) printf(gettext("Please wait...\r"));
 		if (!(opts.o_outpmode & OPT_TERMCAP))
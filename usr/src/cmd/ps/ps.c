@@ -325,7 +325,8 @@ static	void	prtime(timestruc_t, int, int);
 static	void	przom(psinfo_t *);
 static	int	namencnt(char *, int, int);
 static	char	*err_string(int);
-static	int	print_proc(char *pname);
+static	int	print_proc(char *pname, psinfo_t *);
+static	prheader_t *read_allpsinfo(void);
 static	time_t	delta_secs(const timestruc_t *);
 static	int	str2id(const char *, pid_t *, long, long);
 static	int	str2uid(const char *,  uid_t *, unsigned long, unsigned long);
@@ -383,6 +384,7 @@ stdmain(int argc, char **argv)
 	size_t	size, len;
 	DIR	*dirp;
 	struct dirent *dentp;
+	prheader_t *allpsinfo;
 	pid_t	maxpid;
 	pid_t	id;
 	int	ret;
@@ -895,9 +897,28 @@ stdmain(int argc, char **argv)
 			if (i >= 1 && pid[i] == pid[i - 1])
 				continue;
 			(void) sprintf(pname, "%d", (int)pid[i]);
-			if (print_proc(pname) == 0)
+			if (print_proc(pname, NULL) == 0)
 				retcode = 0;
 		}
+	} else if ((allpsinfo = read_allpsinfo()) != NULL) {
+		/*
+		 * Look at each process in the snapshot of all of them
+		 * that /proc/psinfo gives us in a single read.
+		 */
+		char pname[12];
+		char *ptr = (char *)(allpsinfo + 1);
+		long i;
+
+		for (i = 0; i < allpsinfo->pr_nent;
+		    i++, ptr += allpsinfo->pr_entsize) {
+			/* LINTED improper alignment */
+			psinfo_t *infop = (psinfo_t *)ptr;
+
+			(void) sprintf(pname, "%d", (int)infop->pr_pid);
+			if (print_proc(pname, infop) == 0)
+				retcode = 0;
+		}
+		free(allpsinfo);
 	} else {
 		/*
 		 * Determine which processes to print info about by searching
@@ -914,7 +935,7 @@ stdmain(int argc, char **argv)
 		while (dentp = readdir(dirp)) {
 			if (dentp->d_name[0] == '.')    /* skip . and .. */
 				continue;
-			if (print_proc(dentp->d_name) == 0)
+			if (print_proc(dentp->d_name, NULL) == 0)
 				retcode = 0;
 		}
 
@@ -924,8 +945,46 @@ stdmain(int argc, char **argv)
 }
 
 
+/*
+ * Read the psinfo of every process from /proc/psinfo in one go.  Returns
+ * NULL if that can't be done, for instance because the kernel doesn't
+ * provide the file, in which case the caller scans the /proc directory.
+ */
+static prheader_t *
+read_allpsinfo(void)
+{
+	char pname[PATH_MAX];
+	prheader_t *php = NULL;
+	size_t size = 64 * 1024;
+	ssize_t prsz;
+	int fd;
+
+	(void) snprintf(pname, sizeof (pname), "%s/psinfo", procdir);
+	if ((fd = open(pname, O_RDONLY)) == -1)
+		return (NULL);
+	for (;;) {
+		php = Realloc(php, size);
+		if ((prsz = pread(fd, php, size, 0)) == -1 ||
+		    prsz < (ssize_t)size)
+			break;
+		size *= 2;	/* there may be more, try a larger buffer */
+	}
+	(void) close(fd);
+	if (prsz < (ssize_t)sizeof (prheader_t) ||
+	    php->pr_entsize < sizeof (psinfo_t)) {
+		free(php);
+		return (NULL);
+	}
+	return (php);
+}
+
+/*
+ * Print the process named by pid_name.  If infop is not NULL it is the
+ * process's psinfo from /proc/psinfo, and /proc/<pid>/psinfo is only
+ * read if we have to start over.
+ */
 int
-print_proc(char *pid_name)
+print_proc(char *pid_name, psinfo_t *infop)
 {
 	char	pname[PATH_MAX];
 	int	pdlen;
@@ -939,27 +998,33 @@ print_proc(char *pid_name)
 	if (pdlen >= sizeof (pname) - 10)
 		return (1);
 retry:
-	(void) strcpy(&pname[pdlen], "psinfo");
-	if ((procfd = open(pname, O_RDONLY)) == -1) {
-		/* Process may have exited meanwhile. */
-		return (1);
-	}
-	/*
-	 * Get the info structure for the process and close quickly.
-	 */
-	if (read(procfd, (char *)&info, sizeof (info)) < 0) {
-		int	saverr = errno;
+	if (infop != NULL) {
+		/* Use what /proc/psinfo gave us the first time round. */
+		info = *infop;
+		infop = NULL;
+	} else {
+		(void) strcpy(&pname[pdlen], "psinfo");
+		if ((procfd = open(pname, O_RDONLY)) == -1) {
+			/* Process may have exited meanwhile. */
+			return (1);
+		}
+		/*
+		 * Get the info structure for the process and close quickly.
+		 */
+		if (read(procfd, (char *)&info, sizeof (info)) < 0) {
+			int	saverr = errno;
 
+			(void) close(procfd);
+			if (saverr == EAGAIN)
+				goto retry;
+			if (saverr != ENOENT)
+				(void) fprintf(stderr,
+				    gettext("ps: read() on %s: %s\n"),
+				    pname, err_string(saverr));
+			return (1);
+		}
 		(void) close(procfd);
-		if (saverr == EAGAIN)
-			goto retry;
-		if (saverr != ENOENT)
-			(void) fprintf(stderr,
-			    gettext("ps: read() on %s: %s\n"),
-			    pname, err_string(saverr));
-		return (1);
 	}
-	(void) close(procfd);
 
 	found = 0;
 	if (info.pr_lwp.pr_state == 0)	/* can't happen? */
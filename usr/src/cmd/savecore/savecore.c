@@ -63,6 +63,13 @@
 /* minimum size for output buffering */
 #define	MINCOREBLKSIZE		(1ULL << 17)
 
+/*
+ * Stream blocks of compressed data per decompression thread.  The reader
+ * can only run this far ahead of the threads; too few and each thread
+ * waits on the dump device for its next block.
+ */
+#define	NBLOCKS_PER_THREAD	8
+
 /* create this file if metrics collection is enabled in the kernel */
 #define	METRICSFILE "METRICS.csv"
 
@@ -763,7 +770,7 @@ initstreams(int corefd, int nstreams, int maxcsize)
 		nthreads = nstreams;
 	if (nthreads < 1)
 		nthreads = 1;
-	nblocks = nthreads * 2;
+	nblocks = nthreads * NBLOCKS_PER_THREAD;
 
 	tinfo = Zalloc(nthreads * sizeof (tinfo_t));
 	endtinfo = &tinfo[nthreads];
@@ -1074,23 +1081,33 @@ bz2block(int corefd, stream_t *s, char *block, size_t blocksz)
 	}
 }
 
-/* report progress */
+/*
+ * Report progress: every percent on the terminal, and every ten percent,
+ * with the rate, when run from the boot-time service so that its log
+ * shows how far a slow save has got.
+ */
 static void
 report_progress()
 {
 	int sec, percent;
+	uint64_t mb;
 
-	if (!interactive)
+	percent = saved * 100LL / corehdr.dump_npages;
+	if (percent <= percent_done)
 		return;
 
-	percent = saved * 100LL / corehdr.dump_npages;
-	if (percent > percent_done) {
-		sec = (gethrtime() - startts) / 1000 / 1000 / 1000;
+	sec = (gethrtime() - startts) / 1000 / 1000 / 1000;
+	if (interactive) {
 		(void) printf("\r%2d:%02d %3d%% done", sec / 60, sec % 60,
 		    percent);
 		(void) fflush(stdout);
-		percent_done = percent;
+	} else if (percent / 10 > percent_done / 10) {
+		mb = PTOB((uint64_t)saved) >> 20;
+		logprint(SC_SL_NONE, "%d%% of dump saved, %llu MB in %d:%02d "
+		    "(%llu MB/s)", percent, (u_longlong_t)mb, sec / 60,
+		    sec % 60, (u_longlong_t)(sec > 0 ? mb / sec : mb));
 	}
+	percent_done = percent;
 }
 
 /* thread body */
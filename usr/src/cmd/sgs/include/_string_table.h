@@ -101,6 +101,8 @@ struct str_tbl {
 	avl_tree_t	*st_lentree;		/* AVL tree of string lengths */
 	char		*st_strbuf;		/* string buffer */
 	Str_hash	**st_hashbcks;		/* hash buckets */
+	uchar_t		*st_hashmap;		/* bitmap of hash values */
+						/*    in the buckets */
 	Str_master	*st_mstrlist;		/* list of all master strings */
 	size_t		st_fullstrsize;		/* uncompressed table size */
 	size_t		st_nextoff;		/* next available string */
@@ -108,6 +110,7 @@ struct str_tbl {
 	size_t		st_strcnt;		/* number of strings */
 	uint_t		st_hbckcnt;		/* number of buckets in */
 						/*    hashlist */
+	uint_t		st_hmapmask;		/* bits in st_hashmap - 1 */
 	uint_t		st_flags;
 };
 
@@ -119,6 +122,19 @@ struct str_tbl {
  */
 #define	HASHSEED		5381
 
+/*
+ * While the compressed table is being cooked, st_hashmap records which
+ * hash values (modulo its size) have an entry in the buckets, so that
+ * most suffixes can be ruled out without a division or a bucket walk.
+ * It is given this many bits per input string.
+ */
+#define	ST_HMAP_BITS		8
+
+#define	ST_HMAP_ISSET(stp, hv)	((stp)->st_hashmap[((hv) & \
+	(stp)->st_hmapmask) >> 3] & (1 << ((hv) & 7)))
+#define	ST_HMAP_SET(stp, hv)	((stp)->st_hashmap[((hv) & \
+	(stp)->st_hmapmask) >> 3] |= (1 << ((hv) & 7)))
+
 #ifdef __cplusplus
 }
 #endif
@@ -126,6 +126,10 @@ typedef struct _rt_elf_private {
 	Capinfo		*e_capinfo;	/* symbol capabilities information */
 	uint_t		e_capchainent;	/* size of capabilities chain entry */
 	uint_t		e_capchainsz;	/* size of capabilities chain data */
+	uint_t		*e_bloom;	/* filter of defined symbol names */
+	uint_t		e_bloommask;	/*	bits in the filter - 1 */
+	uint_t		e_bloomshift;	/*	shift for the second bit */
+	uint_t		e_bloomcnt;	/* searches made before the filter */
 } Rt_elfp;
 
 /*
@@ -163,6 +167,10 @@ typedef struct _rt_elf_private {
 #define	SUNWSYMSORTSZ(X)	(((Rt_elfp *)(X)->rt_priv)->e_sunwsymsortsz)
 #define	CAPSET(X)		(((Rt_elfp *)(X)->rt_priv)->e_capset)
 #define	CAPINFO(X)		(((Rt_elfp *)(X)->rt_priv)->e_capinfo)
+#define	BLOOM(X)		(((Rt_elfp *)(X)->rt_priv)->e_bloom)
+#define	BLOOMMASK(X)		(((Rt_elfp *)(X)->rt_priv)->e_bloommask)
+#define	BLOOMSHIFT(X)		(((Rt_elfp *)(X)->rt_priv)->e_bloomshift)
+#define	BLOOMCNT(X)		(((Rt_elfp *)(X)->rt_priv)->e_bloomcnt)
 #define	CAPCHAINENT(X)		(((Rt_elfp *)(X)->rt_priv)->e_capchainent)
 #define	CAPCHAINSZ(X)		(((Rt_elfp *)(X)->rt_priv)->e_capchainsz)
 
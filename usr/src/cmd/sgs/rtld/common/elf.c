@@ -1337,6 +1337,57 @@ elf_hash(const char *name)
 	return ((ulong_t)hval);
 }
 
+/*
+ * A symbol search through a large process visits many objects that do not
+ * define the symbol, and each such miss costs a hash bucket and chain walk
+ * through memory that is seldom in cache.  Once an object has been searched
+ * about a quarter as many times as it has symbols, build a bloom filter of
+ * the names it defines, using BLOOM_BITS bits per symbol and two bits per
+ * name: one from the elf hash itself, and one from a multiplicative hash of
+ * it.  A miss then usually costs two bit tests.
+ */
+#define	BLOOM_BITS	8
+#define	BLOOM_MULT	0x9e3779b1U
+
+#define	BLOOM_BIT(bloom, bit) \
+	((bloom)[(bit) >> 5] & (1U << ((bit) & 31)))
+#define	BLOOM_SETBIT(bloom, bit) \
+	((bloom)[(bit) >> 5] |= (1U << ((bit) & 31)))
+
+#define	BLOOM_BIT1(lmp, hash)	((uint_t)(hash) & BLOOMMASK(lmp))
+#define	BLOOM_BIT2(lmp, hash) \
+	(((uint_t)(hash) * BLOOM_MULT) >> BLOOMSHIFT(lmp))
+
+static void
+elf_bloom_build(Rt_map *lmp)
+{
+	uint_t	nsym = HASH(lmp)[1], nbits = 32, shift = 27, ndx;
+	uint_t	*bloom;
+	Sym	*sym;
+
+	while ((nbits < (nsym * BLOOM_BITS)) && (nbits < 0x80000000U)) {
+		nbits <<= 1;
+		shift--;
+	}
+	if ((bloom = calloc(nbits / 8, 1)) == NULL)
+		return;
+
+	BLOOMMASK(lmp) = nbits - 1;
+	BLOOMSHIFT(lmp) = shift;
+
+	for (ndx = 1, sym = (Sym *)SYMTAB(lmp) + 1; ndx < nsym; ndx++, sym++) {
+		ulong_t	hash;
+
+		if (sym->st_shndx == SHN_UNDEF)
+			continue;
+
+		hash = elf_hash(STRTAB(lmp) + sym->st_name);
+		BLOOM_SETBIT(bloom, BLOOM_BIT1(lmp, hash));
+		BLOOM_SETBIT(bloom, BLOOM_BIT2(lmp, hash));
+	}
+	BLOOM(lmp) = bloom;
+}
+
 /*
  * Look up a symbol.  The callers lookup information is passed in the Slookup
  * structure, and any resultant binding information is returned in the Sresult
@@ -1364,6 +1415,22 @@ elf_find_sym(Slookup *slp, Sresult *srp, uint_t *binfo, int *in_nfavl)
 	if (HASH(ilmp) == NULL)
 		return (0);
 
+	/*
+	 * The bloom filter only holds defined symbols, so it can't answer a
+	 * search for a symbol index, or for the plt[] address of a function
+	 * the executable references (see below).
+	 */
+	if (BLOOM(ilmp) == NULL) {
+		if (++BLOOMCNT(ilmp) == ((HASH(ilmp)[1] >> 2) + 1))
+			elf_bloom_build(ilmp);
+	}
+	if ((BLOOM(ilmp) != NULL) && ((slp->sl_flags & LKUP_SYMNDX) == 0) &&
+	    (((slp->sl_flags & LKUP_SPEC) == 0) ||
+	    ((FLAGS(ilmp) & FLG_RT_ISMAIN) == 0)) &&
+	    ((BLOOM_BIT(BLOOM(ilmp), BLOOM_BIT1(ilmp, hash)) == 0) ||
+	    (BLOOM_BIT(BLOOM(ilmp), BLOOM_BIT2(ilmp, hash)) == 0)))
+		return (0);
+
 	buckets = HASH(ilmp)[0];
 	/* LINTED */
 	hashoff = ((uint_t)hash % buckets) + 2;
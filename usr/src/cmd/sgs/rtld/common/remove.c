@@ -397,6 +397,9 @@ remove_so(Lm_list *lml, Rt_map *lmp, Rt_map *clmp)
 	if (CAPCHAIN(lmp))
 		free((void *)CAPCHAIN(lmp));
 
+	if (THIS_IS_ELF(lmp) && BLOOM(lmp))
+		free(BLOOM(lmp));
+
 	if (MMAPS(lmp)) {
 		if ((FLAGS(lmp) & FLG_RT_IMGALLOC) == 0)
 			unmap_obj(MMAPS(lmp), MMAPCNT(lmp));
@@ -334,6 +334,7 @@ st_destroy(Str_tbl *stp)
 		}
 		free(stp->st_hashbcks);
 	}
+	free(stp->st_hashmap);
 	free(stp);
 }
 
@@ -466,6 +467,9 @@ st_hash_insert(Str_tbl *stp, const char *str, size_t len)
 		hashval = ((hashval << 5) + hashval) +
 		    str[i];			/* h = ((h * 33) + c) */
 
+		if (ST_HMAP_ISSET(stp, hashval) == 0)
+			continue;
+
 		for (sthash = hashbcks[hashval % bckcnt];
 		    sthash; sthash = sthash->hi_next) {
 			const char	*hstr;
@@ -539,6 +543,7 @@ st_hash_insert(Str_tbl *stp, const char *str, size_t len)
 	/*
 	 * Insert string element into head of hash list
 	 */
+	ST_HMAP_SET(stp, hashval);
 	hashval = hashval % bckcnt;
 	sthash->hi_next = hashbcks[hashval];
 	hashbcks[hashval] = sthash;
@@ -561,6 +566,7 @@ st_getstrtab_sz(Str_tbl *stp)
 	if ((stp->st_flags & FLG_STTAB_COOKED) == 0) {
 		LenNode		*lnp;
 		void		*cookie;
+		uint64_t	hmapbits;
 
 		stp->st_flags |= FLG_STTAB_COOKED;
 		/*
@@ -572,6 +578,18 @@ st_getstrtab_sz(Str_tbl *stp)
 		    stp->st_hbckcnt)) == NULL)
 			return (0);
 
+		/*
+		 * And a bitmap of the hash values in use, a power of two
+		 * bits in size.
+		 */
+		hmapbits = 64;
+		while ((hmapbits < (stp->st_strcnt * ST_HMAP_BITS)) &&
+		    (hmapbits < (1ULL << 32)))
+			hmapbits <<= 1;
+		stp->st_hmapmask = (uint_t)(hmapbits - 1);
+		if ((stp->st_hashmap = calloc(hmapbits / 8, 1)) == NULL)
+			return (0);
+
 		/*
 		 * We now walk all of the strings in the list, from shortest to
 		 * longest, and insert them into the hashtable.
@@ -638,6 +656,12 @@ st_getstrtab_sz(Str_tbl *stp)
 		avl_destroy(stp->st_lentree);
 		free(stp->st_lentree);
 		stp->st_lentree = 0;
+
+		/*
+		 * The bitmap is only of use while inserting.
+		 */
+		free(stp->st_hashmap);
+		stp->st_hashmap = NULL;
 	}
 
 	assert(stp->st_strsize > 0);
@@ -659,10 +659,6 @@ object_tx_commit(rc_node_lookup_t *lp, tx_commit_data_t *data, uint32_t *gen)
 	backend_query_t *q;
 	int backend = lp->rl_backend;
 
-	ret = backend_tx_begin(backend, &tx);
-	if (ret != REP_PROTOCOL_SUCCESS)
-		return (ret);
-
 	/* Make sure the pg is up-to-date. */
 	data->txc_oldgen = *gen;
 	data->txc_backend = backend;
@@ -671,6 +667,27 @@ object_tx_commit(rc_node_lookup_t *lp, tx_commit_data_t *data, uint32_t *gen)
 	q = backend_query_alloc();
 	backend_query_add(q, "SELECT pg_gen_id FROM pg_tbl WHERE (pg_id = %d);",
 	    lp->rl_main_id);
+
+	/*
+	 * An empty transaction changes nothing, so it only needs the
+	 * generation check, and that can be made without starting (and
+	 * then rolling back) a write transaction.
+	 */
+	if (data->txc_count == 0) {
+		r = backend_run(backend, q, tx_check_genid, data);
+		backend_query_free(q);
+		if (r == REP_PROTOCOL_SUCCESS &&
+		    (r = data->txc_result) == REP_PROTOCOL_SUCCESS)
+			r = REP_PROTOCOL_DONE;
+		goto end;
+	}
+
+	ret = backend_tx_begin(backend, &tx);
+	if (ret != REP_PROTOCOL_SUCCESS) {
+		backend_query_free(q);
+		return (ret);
+	}
+
 	r = backend_tx_run(tx, q, tx_check_genid, data);
 	backend_query_free(q);
 
@@ -680,13 +697,6 @@ object_tx_commit(rc_node_lookup_t *lp, tx_commit_data_t *data, uint32_t *gen)
 		goto end;
 	}
 
-	/* If the transaction is empty, cut out early. */
-	if (data->txc_count == 0) {
-		backend_tx_rollback(tx);
-		r = REP_PROTOCOL_DONE;
-		goto end;
-	}
-
 	new_gen = backend_new_id(tx, BACKEND_ID_GENERATION);
 	if (new_gen == 0) {
 		backend_tx_rollback(tx);
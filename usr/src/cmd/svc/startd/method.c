@@ -1197,6 +1197,25 @@ retry:
 
 		(void) update_fault_count(inst, FAULT_COUNT_RESET);
 
+		/*
+		 * Log how long the instance waited for its dependencies and
+		 * how long it then took to start, so that the critical path
+		 * through a boot can be read from the log.
+		 */
+		if (info->sf_method_type == METHOD_START) {
+			hrtime_t run = gethrtime() - inst->ri_start_request;
+			hrtime_t wait = 0;
+
+			if (inst->ri_offline_time != 0 &&
+			    inst->ri_offline_time < inst->ri_start_request)
+				wait = inst->ri_start_request -
+				    inst->ri_offline_time;
+			log_framework(LOG_INFO, "%s: started in %lld ms after "
+			    "waiting %lld ms for dependencies.\n",
+			    inst->ri_i.i_fmri, run / (NANOSEC / MILLISEC),
+			    wait / (NANOSEC / MILLISEC));
+		}
+
 		goto out;
 	}
 
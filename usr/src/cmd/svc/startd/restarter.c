@@ -842,10 +842,12 @@ restarter_instance_update_states(scf_handle_t *h, restarter_inst_t *ri,
 	boolean_t rebound = B_FALSE;
 	int prev_state_online;
 	int state_online;
+	restarter_instance_state_t prev_state;
 
 	assert(MUTEX_HELD(&ri->ri_lock));
 
 	prev_state_online = instance_started(ri);
+	prev_state = ri->ri_i.i_state;
 
 retry:
 	e = _restarter_commit_states(h, &ri->ri_i, new_state, new_state_next,
@@ -888,6 +890,10 @@ retry:
 		bad_error("_restarter_commit_states", e);
 	}
 
+	if (new_state == RESTARTER_STATE_OFFLINE &&
+	    prev_state != RESTARTER_STATE_OFFLINE)
+		ri->ri_offline_time = gethrtime();
+
 	states = startd_alloc(sizeof (protocol_states_t));
 	states->ps_state = new_state;
 	states->ps_state_next = new_state_next;
@@ -1554,6 +1560,7 @@ start_instance(scf_handle_t *local_handle, restarter_inst_t *inst,
 	info->sf_method_type = METHOD_START;
 	info->sf_event_type = RERR_NONE;
 	info->sf_reason = new_reason;
+	inst->ri_start_request = gethrtime();
 	inst->ri_method_thread = startd_thread_create(method_thread, info);
 }
 
@@ -428,6 +428,14 @@ typedef struct restarter_inst {
 	hrtime_t		ri_start_time[RINST_START_TIMES];
 	uint_t			ri_start_index;	/* times started */
 
+	/*
+	 * For the start timeline: when the instance last went offline to
+	 * wait for its dependencies, and when it was last sent to its
+	 * start method.
+	 */
+	hrtime_t		ri_offline_time;
+	hrtime_t		ri_start_request;
+
 	uu_list_node_t		ri_link;
 	pthread_mutex_t		ri_lock;
 
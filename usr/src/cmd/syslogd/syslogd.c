@@ -95,6 +95,7 @@
 #include <sys/wait.h>
 #include <sys/resource.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <sys/note.h>
 #include <door.h>
 
@@ -1401,6 +1402,7 @@ logmsg(void *ap)
 				    "%p on file %p, count = %d\n",
 				    mythreadno, (void *)mp, (void *)f,
 				    f->f_queue_count);
+				f->f_stat.drops++;
 				continue;
 			}
 
@@ -1496,6 +1498,7 @@ logit(void *ap)
 		    (FLUSHMSG | LOGSYNC)) {
 			if (f->f_type != F_FILE)
 				goto out;	/* nothing to do */
+			filed_flush(f, NULL, 0);
 			(void) close(f->f_file);
 			f->f_file = open64(f->f_un.f_fname,
 			    O_WRONLY|O_APPEND|O_NOCTTY);
@@ -1517,6 +1520,7 @@ logit(void *ap)
 				DPRINT2(5, "logit(%u): got FLUSH|SYNC "
 				    "for filed %p\n", f->f_thread,
 				    (void *)f);
+				filed_flush(f, NULL, 0);
 				(void) fsync(f->f_file);
 			}
 			goto out;
@@ -1656,8 +1660,16 @@ out:
 		(void) pthread_mutex_unlock(&mp->msg_mutex);
 		if (refcnt == 0)
 			free_msg(mp);
+
+		/*
+		 * Hold on to buffered output only while there is more
+		 * queued behind it.
+		 */
+		if (f->f_queue_count == 0)
+			filed_flush(f, NULL, 0);
 	}
 	/* register our exit */
+	filed_flush(f, NULL, 0);
 
 	/*
 	 * Pull out all pending messages, if they exist.
@@ -1935,6 +1947,15 @@ writemsg(int selection, struct filed *f)
 				/* CSTYLED */
 				(void) strncpy(eomp, "\n", 2); /*lint !e669*/
 			}
+			filed_write(f, filtered, strlen(filtered));
+			if ((flags & SYNC_FILE) &&
+			    ((pri & LOG_FACMASK) >> 3) == LOG_KERN) {
+				filed_flush(f, NULL, 0);
+				if (f->f_type == F_FILE)
+					(void) fsync(f->f_file);
+			}
+			free(filtered);
+			break;
 		}
 		if (write(f->f_file, filtered, strlen(filtered)) < 0) {
 			int e = errno;
@@ -1964,9 +1985,7 @@ writemsg(int selection, struct filed *f)
 				errno = e;
 				logerror(f->f_un.f_fname);
 			}
-		} else if (flags & SYNC_FILE)
-			if (((pri & LOG_FACMASK) >> 3) == LOG_KERN)
-				(void) fsync(f->f_file);
+		}
 
 		DPRINT2(5, "writemsg(%u): freeing filtered (%p)\n",
 		    mythreadno, (void *)filtered);
@@ -1976,6 +1995,61 @@ writemsg(int selection, struct filed *f)
 	}
 }
 
+/*
+ * Messages for regular files are collected in f_wbuf, so that a burst
+ * costs the logger thread one write per buffer full rather than one per
+ * message.  logit() pushes the buffer out as soon as the file's queue
+ * runs dry, so output is only held back while more is waiting.
+ */
+static void
+filed_write(struct filed *f, const char *msg, size_t len)
+{
+	if (f->f_wlen + len <= sizeof (f->f_wbuf)) {
+		(void) memcpy(f->f_wbuf + f->f_wlen, msg, len);
+		f->f_wlen += len;
+		return;
+	}
+	filed_flush(f, msg, len);
+}
+
+/*
+ * Write out f_wbuf, followed by msg if that is given.
+ */
+static void
+filed_flush(struct filed *f, const char *msg, size_t len)
+{
+	struct iovec iov[2];
+	int iovcnt = 0;
+	int e;
+
+	if (f->f_wlen > 0) {
+		iov[iovcnt].iov_base = f->f_wbuf;
+		iov[iovcnt].iov_len = f->f_wlen;
+		iovcnt++;
+	}
+	if (len > 0) {
+		iov[iovcnt].iov_base = (char *)msg;
+		iov[iovcnt].iov_len = len;
+		iovcnt++;
+	}
+	f->f_wlen = 0;
+
+	if (iovcnt == 0 || f->f_type != F_FILE)
+		return;
+
+	if (writev(f->f_file, iov, iovcnt) >= 0)
+		return;
+
+	e = errno;
+	if ((hup_state & HUP_INPROGRESS) && f->f_type == F_UNUSED)
+		return;
+	(void) close(f->f_file);
+	f->f_type = F_UNUSED;
+	f->f_stat.errs++;
+	errno = e;
+	logerror(f->f_un.f_fname);
+}
+
 /*
  *  WALLMSG -- Write a message to the world at large
  *
@@ -3160,8 +3234,10 @@ dumpstats(int fd)
 	}
 
 	(void) fprintf(out, "\n\n\n\t\tPer File Statistics\n");
-	(void) fprintf(out, "%-24s\tTot\tDups\tNofwd\tErrs\n", "File");
-	(void) fprintf(out, "%-24s\t---\t----\t-----\t----\n", "----");
+	(void) fprintf(out, "%-24s\tTot\tDups\tNofwd\tErrs\tDrops\n",
+	    "File");
+	(void) fprintf(out, "%-24s\t---\t----\t-----\t----\t-----\n",
+	    "----");
 	for (f = Files; f < &Files[nlogs]; f++) {
 		switch (f->f_type) {
 		case F_FILE:
@@ -3190,9 +3266,9 @@ dumpstats(int fd)
 			(void) fprintf(out, "%-24s", users);
 			break;
 		}
-		(void) fprintf(out, "\t%d\t%d\t%d\t%d\n",
+		(void) fprintf(out, "\t%d\t%d\t%d\t%d\t%d\n",
 		    f->f_stat.total, f->f_stat.dups,
-		    f->f_stat.cantfwd, f->f_stat.errs);
+		    f->f_stat.cantfwd, f->f_stat.errs, f->f_stat.drops);
 	}
 	(void) fprintf(out, "\n\n");
 	if (Debug && fd == 1)
@@ -3388,6 +3464,9 @@ filed_init(struct filed *f)
 	f->f_stat.dups = 0;
 	f->f_stat.cantfwd = 0;
 	f->f_stat.errs = 0;
+	f->f_stat.drops = 0;
+
+	f->f_wlen = 0;
 
 	if (pthread_create(&f->f_thread, NULL, logit, (void *)f) != 0) {
 		logerror("pthread_create failed");
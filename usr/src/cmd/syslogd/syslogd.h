@@ -59,6 +59,7 @@ extern "C" {
 #define	UDEVSZ		(sizeof (dummy.ut_line)) /* length of login dev name */
 #define	MAXUNAMES	20		/* maximum number of user names */
 #define	Q_HIGHWATER_MARK 10000		/* max outstanding msgs per file */
+#define	WBUFSIZE	8192		/* per file write buffer */
 #define	NOPRI		0x10		/* the "no priority" priority */
 #define	LOG_MARK	(LOG_NFACILITIES << 3)	/* mark "facility" */
 
@@ -90,6 +91,7 @@ typedef struct filed_stats {
 	int	dups;			/* duplicate messages */
 	int 	cantfwd;		/* can't forward */
 	int	errs;			/* write errors */
+	int	drops;			/* dropped, queue over high water */
 } filed_stats_t;
 
 
@@ -164,6 +166,8 @@ struct filed {
 	saved_message_t f_prevmsg;	/* previous message */
 	saved_message_t f_current;	/* current message */
 	int	f_prevcount;		/* message repeat count */
+	size_t	f_wlen;			/* bytes held in f_wbuf */
+	char	f_wbuf[WBUFSIZE];	/* unwritten F_FILE messages */
 	uchar_t	f_pmask[LOG_NFACILITIES+1];	/* priority mask */
 	union {
 		char	f_uname[MAXUNAMES][SYS_NMLN + 1];
@@ -274,6 +278,8 @@ static void dumpstats(int fd);
 static void filter_string(char *orig, char *new, size_t max);
 static int openklog(char *name, int mode);
 static void writemsg(int selection, struct filed *f);
+static void filed_write(struct filed *f, const char *msg, size_t len);
+static void filed_flush(struct filed *f, const char *msg, size_t len);
 static void *writetodev(void *ap);
 static int shutdown_msg(void);
 static void server(void *, char *, size_t, door_desc_t *, uint_t);
@@ -140,6 +140,7 @@ int utimes(const char *path, const struct timeval timeval_ptr[]);
 #endif	/* BSIZE */
 
 #define	NBLOCK	20
+#define	MAXREAD	(1024 * 1024)	/* largest read of an archived file */
 #define	NAMSIZ	100
 #define	PRESIZ	155
 #define	MAXNAM	256
@@ -502,6 +503,7 @@ static char *getname(gid_t);
 static char *getgroup(gid_t);
 static int checkf(char *name, int mode, int howmuch);
 static int writetbuf(char *buffer, int n);
+static int readlen(int hint, int maxread);
 static int wantit(char *argv[], char **namep, char **dirp, char **comp,
     attr_data_t **attrinfo);
 static void append_ext_attr(char *shortname, char **secinfo, int *len);
@@ -2314,15 +2316,15 @@ putfile(char *longname, char *shortname, char *parent, attr_data_t *attrinfo,
 		 */
 		(void) sprintf(dblock.dbuf.chksum, "%07o", checksum(&dblock));
 		hint = writetbuf((char *)&dblock, 1);
-		maxread = max(min(stbuf.st_blksize, stbuf.st_size),
-		    (nblock * TBLOCK));
+		maxread = max(min(max(stbuf.st_blksize, MAXREAD),
+		    stbuf.st_size), (nblock * TBLOCK));
 		if ((bigbuf = calloc((unsigned)maxread, sizeof (char))) == 0) {
 			maxread = TBLOCK;
 			bigbuf = buf;
 		}
 
 		while (((i = (int)
-		    read(infile, bigbuf, min((hint*TBLOCK), maxread))) > 0) &&
+		    read(infile, bigbuf, readlen(hint, maxread))) > 0) &&
 		    blocks) {
 			blkcnt_t nblks;
 
@@ -5195,6 +5197,25 @@ writetbuf(char *buffer, int n)
 	return (nblock - recno);
 }
 
+/*
+ * How much of a file to read next into a buffer of maxread bytes: the hint
+ * blocks that complete the current tape record, and then as many whole
+ * records as fit.  Once the tape buffer is empty, writetbuf() writes whole
+ * records straight from the caller's buffer, so reading a file in large
+ * pieces costs no copying and far fewer system calls than reading it a
+ * record at a time.
+ */
+static int
+readlen(int hint, int maxread)
+{
+	int len = min(hint * TBLOCK, maxread);
+	int reclen = nblock * TBLOCK;
+
+	if (maxread - len >= reclen)
+		len += (maxread - len) / reclen * reclen;
+	return (len);
+}
+
 /*
  *	backtape - reposition tape after reading soft "EOF" record
  *
@@ -1270,6 +1270,10 @@ const struct ioc {
 		"zfs_cmd_t" },
 	{ (uint_t)ZFS_IOC_DESTROY_BOOKMARKS,	"ZFS_IOC_DESTROY_BOOKMARKS",
 		"zfs_cmd_t" },
+	{ (uint_t)ZFS_IOC_LIST_BATCH,		"ZFS_IOC_LIST_BATCH",
+		"zfs_cmd_t" },
+	{ (uint_t)ZFS_IOC_POOL_TRIM,		"ZFS_IOC_POOL_TRIM",
+		"zfs_cmd_t" },
 
 	/* kssl ioctls */
 	{ (uint_t)KSSL_ADD_ENTRY,		"KSSL_ADD_ENTRY",
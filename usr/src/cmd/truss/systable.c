@@ -341,8 +341,8 @@ const struct systable systable[] = {
 {"fchdir",	1, DEC, NOV, DEC},				/* 120 */
 {"readv",	3, DEC, NOV, DEC, HEX, DEC},			/* 121 */
 {"writev",	3, DEC, NOV, DEC, HEX, DEC},			/* 122 */
-{ NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
-{ NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
+{"recvmmsg",	5, DEC, NOV, DEC, HEX, DEC, HEX, HEX},		/* 123 */
+{"sendmmsg",	4, DEC, NOV, DEC, HEX, DEC, HEX},		/* 124 */
 { NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
 { NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
 {"mmapobj",	5, DEC, NOV, DEC, MOB, HEX, HEX, HEX},		/* 127 */
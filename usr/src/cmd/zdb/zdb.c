@@ -86,10 +86,12 @@ uint8_t dump_opt[256];
 typedef void object_viewer_t(objset_t *, uint64_t, void *data, size_t size);
 
 extern void dump_intent_log(zilog_t *);
+extern int zfs_pd_blks_max;
 uint64_t *zopt_object = NULL;
 int zopt_objects = 0;
 libzfs_handle_t *g_zfs;
 uint64_t max_inflight = 200;
+int zdb_threads = 0;
 
 /*
  * These libumem hooks provide a reasonable set of defaults for the allocator's
@@ -112,7 +114,8 @@ usage(void)
 {
 	(void) fprintf(stderr,
 	    "Usage: %s [-CumdibcsDvhLXFPA] [-t txg] [-e [-p path...]] "
-	    "[-U config] [-M inflight I/Os] poolname [object...]\n"
+	    "[-U config] [-M inflight I/Os] [-T threads] poolname "
+	    "[object...]\n"
 	    "       %s [-divPA] [-e -p path...] [-U config] dataset "
 	    "[object...]\n"
 	    "       %s -m [-LXFPA] [-t txg] [-e [-p path...]] [-U config] "
@@ -167,7 +170,11 @@ usage(void)
 	(void) fprintf(stderr, "        -t <txg> -- highest txg to use when "
 	    "searching for uberblocks\n");
 	(void) fprintf(stderr, "        -M <number of inflight I/Os> -- "
-	    "specify the maximum number of checksumming I/Os [default is 200]");
+	    "specify the maximum number of checksumming I/Os "
+	    "[default is 200]\n");
+	(void) fprintf(stderr, "        -T <number of threads> -- "
+	    "specify the number of threads traversing blocks for -b and -c "
+	    "[default is the number of CPUs]\n");
 	(void) fprintf(stderr, "Specify an option more than once (e.g. -bb) "
 	    "to make only that option verbose\n");
 	(void) fprintf(stderr, "Default is to dump everything non-verbosely\n");
@@ -1032,6 +1039,16 @@ snprintf_blkptr_compact(char *blkbuf, size_t buflen, const blkptr_t *bp)
 		return;
 	}
 
+	if (BP_IS_EMBEDDED(bp)) {
+		(void) snprintf(blkbuf, buflen,
+		    "EMBEDDED et=%u %llxL/%llxP B=%llu",
+		    (int)BPE_GET_ETYPE(bp),
+		    (u_longlong_t)BPE_GET_LSIZE(bp),
+		    (u_longlong_t)BPE_GET_PSIZE(bp),
+		    (u_longlong_t)bp->blk_birth);
+		return;
+	}
+
 	blkbuf[0] = '\0';
 
 	for (int i = 0; i < ndvas; i++)
@@ -1119,10 +1136,10 @@ visit_indirect(spa_t *spa, const dnode_phys_t *dnp,
 			err = visit_indirect(spa, dnp, cbp, &czb);
 			if (err)
 				break;
-			fill += cbp->blk_fill;
+			fill += BP_GET_FILL(cbp);
 		}
 		if (!err)
-			ASSERT3U(fill, ==, bp->blk_fill);
+			ASSERT3U(fill, ==, BP_GET_FILL(bp));
 		(void) arc_buf_remove_ref(buf, &buf);
 	}
 
@@ -2103,17 +2120,31 @@ static char *zdb_ot_extname[] = {
 
 #define	ZB_TOTAL	DN_MAX_LEVELS
 
+/*
+ * Progress of a block traversal, shared by all of the threads doing it.
+ */
+typedef struct zdb_progress {
+	kmutex_t	zpg_lock;	/* held by the thread printing */
+	uint64_t	zpg_start;
+	uint64_t	zpg_lastprint;
+	uint64_t	zpg_totalasize;	/* allocated bytes to traverse */
+	uint64_t	zpg_asize;	/* allocated bytes traversed so far */
+} zdb_progress_t;
+
+/*
+ * Each traversal thread accumulates its statistics in a zdb_cb_t of its
+ * own; they are summed into the first one when the traversal is done.
+ */
 typedef struct zdb_cb {
 	zdb_blkstats_t	zcb_type[ZB_TOTAL + 1][ZDB_OT_TOTAL + 1];
 	uint64_t	zcb_dedup_asize;
 	uint64_t	zcb_dedup_blocks;
-	uint64_t	zcb_start;
-	uint64_t	zcb_lastprint;
-	uint64_t	zcb_totalasize;
+	uint64_t	zcb_embedded_blocks;
 	uint64_t	zcb_errors[256];
 	int		zcb_readfails;
 	int		zcb_haderrors;
 	spa_t		*zcb_spa;
+	zdb_progress_t	*zcb_progress;
 } zdb_cb_t;
 
 static void
@@ -2161,21 +2192,29 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 
 	}
 
+	if (BP_IS_EMBEDDED(bp)) {
+		zcb->zcb_embedded_blocks++;
+		return;
+	}
+
 	if (dump_opt['L'])
 		return;
 
 	if (BP_GET_DEDUP(bp)) {
 		ddt_t *ddt;
 		ddt_entry_t *dde;
+		ddt_phys_t *ddp;
 
 		ddt = ddt_select(zcb->zcb_spa, bp);
 		ddt_enter(ddt);
 		dde = ddt_lookup(ddt, bp, B_FALSE);
 
-		if (dde == NULL) {
+		ddp = (dde != NULL) ? ddt_phys_select(dde, bp) : NULL;
+
+		if (ddp == NULL) {
+			/* not in the DDT, or its unique entry was pruned */
 			refcnt = 0;
 		} else {
-			ddt_phys_t *ddp = ddt_phys_select(dde, bp);
 			ddt_phys_decref(ddp);
 			refcnt = ddp->ddp_refcnt;
 			if (ddt_phys_total_refcnt(dde) == 0)
@@ -2233,6 +2272,7 @@ zdb_blkptr_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
     const zbookmark_t *zb, const dnode_phys_t *dnp, void *arg)
 {
 	zdb_cb_t *zcb = arg;
+	zdb_progress_t *zpg;
 	dmu_object_type_t type;
 	boolean_t is_metadata;
 
@@ -2258,7 +2298,8 @@ zdb_blkptr_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 
 	is_metadata = (BP_GET_LEVEL(bp) != 0 || DMU_OT_IS_METADATA(type));
 
-	if (dump_opt['c'] > 1 || (dump_opt['c'] && is_metadata)) {
+	if (!BP_IS_EMBEDDED(bp) &&
+	    (dump_opt['c'] > 1 || (dump_opt['c'] && is_metadata))) {
 		size_t size = BP_GET_PSIZE(bp);
 		void *data = zio_data_buf_alloc(size);
 		int flags = ZIO_FLAG_CANFAIL | ZIO_FLAG_SCRUB | ZIO_FLAG_RAW;
@@ -2279,15 +2320,23 @@ zdb_blkptr_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 
 	zcb->zcb_readfails = 0;
 
+	zpg = zcb->zcb_progress;
+	atomic_add_64(&zpg->zpg_asize, BP_GET_ASIZE(bp));
+
+	/*
+	 * Whichever thread notices that a second has passed prints the
+	 * progress; the others carry on without waiting for it.
+	 */
 	if (dump_opt['b'] < 5 && isatty(STDERR_FILENO) &&
-	    gethrtime() > zcb->zcb_lastprint + NANOSEC) {
+	    gethrtime() > zpg->zpg_lastprint + NANOSEC &&
+	    mutex_tryenter(&zpg->zpg_lock)) {
 		uint64_t now = gethrtime();
 		char buf[10];
-		uint64_t bytes = zcb->zcb_type[ZB_TOTAL][ZDB_OT_TOTAL].zb_asize;
+		uint64_t bytes = zpg->zpg_asize;
 		int kb_per_sec =
-		    1 + bytes / (1 + ((now - zcb->zcb_start) / 1000 / 1000));
-		int sec_remaining =
-		    (zcb->zcb_totalasize - bytes) / 1024 / kb_per_sec;
+		    1 + bytes / (1 + ((now - zpg->zpg_start) / 1000 / 1000));
+		int sec_remaining = bytes >= zpg->zpg_totalasize ? 0 :
+		    (zpg->zpg_totalasize - bytes) / 1024 / kb_per_sec;
 
 		zfs_nicenum(bytes, buf, sizeof (buf));
 		(void) fprintf(stderr,
@@ -2298,7 +2347,8 @@ zdb_blkptr_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 		    sec_remaining / 60 % 60,
 		    sec_remaining % 60);
 
-		zcb->zcb_lastprint = now;
+		zpg->zpg_lastprint = now;
+		mutex_exit(&zpg->zpg_lock);
 	}
 
 	return (0);
@@ -2443,13 +2493,48 @@ count_block_cb(void *arg, const blkptr_t *bp, dmu_tx_t *tx)
 	return (0);
 }
 
+/*
+ * Add the statistics gathered by one traversal thread into another's.
+ */
+static void
+zdb_cb_merge(zdb_cb_t *dst, const zdb_cb_t *src)
+{
+	for (int l = 0; l <= ZB_TOTAL; l++) {
+		for (int t = 0; t <= ZDB_OT_TOTAL; t++) {
+			zdb_blkstats_t *dzb = &dst->zcb_type[l][t];
+			const zdb_blkstats_t *szb = &src->zcb_type[l][t];
+
+			dzb->zb_asize += szb->zb_asize;
+			dzb->zb_lsize += szb->zb_lsize;
+			dzb->zb_psize += szb->zb_psize;
+			dzb->zb_count += szb->zb_count;
+			dzb->zb_gangs += szb->zb_gangs;
+			dzb->zb_ditto_samevdev += szb->zb_ditto_samevdev;
+			for (int i = 0; i < PSIZE_HISTO_SIZE; i++) {
+				dzb->zb_psize_histogram[i] +=
+				    szb->zb_psize_histogram[i];
+			}
+		}
+	}
+	dst->zcb_dedup_asize += src->zcb_dedup_asize;
+	dst->zcb_dedup_blocks += src->zcb_dedup_blocks;
+	dst->zcb_embedded_blocks += src->zcb_embedded_blocks;
+	for (int e = 0; e < 256; e++)
+		dst->zcb_errors[e] += src->zcb_errors[e];
+	dst->zcb_haderrors |= src->zcb_haderrors;
+}
+
 static int
 dump_block_stats(spa_t *spa)
 {
 	zdb_cb_t zcb = { 0 };
+	zdb_cb_t **zcbs;
+	zdb_progress_t zpg = { 0 };
 	zdb_blkstats_t *zb, *tzb;
 	uint64_t norm_alloc, norm_space, total_alloc, total_found;
 	int flags = TRAVERSE_PRE | TRAVERSE_PREFETCH_METADATA | TRAVERSE_HARD;
+	int nthreads = zdb_threads != 0 ? zdb_threads :
+	    MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
 	int leaks = 0;
 
 	(void) printf("\nTraversing all blocks %s%s%s%s%s...\n\n",
@@ -2467,6 +2552,7 @@ dump_block_stats(spa_t *spa)
 	 * it's not part of any space map) is a double allocation,
 	 * reference to a freed block, or an unclaimed log block.
 	 */
+	zcb.zcb_progress = &zpg;
 	zdb_leak_init(spa, &zcb);
 
 	/*
@@ -2487,9 +2573,25 @@ dump_block_stats(spa_t *spa)
 	if (dump_opt['c'] > 1)
 		flags |= TRAVERSE_PREFETCH_DATA;
 
-	zcb.zcb_totalasize = metaslab_class_get_alloc(spa_normal_class(spa));
-	zcb.zcb_start = zcb.zcb_lastprint = gethrtime();
-	zcb.zcb_haderrors |= traverse_pool(spa, 0, flags, zdb_blkptr_cb, &zcb);
+	/*
+	 * Datasets are shared out among nthreads threads, each counting
+	 * into its own zdb_cb_t.  Let each thread's prefetcher run further
+	 * ahead than the default, since nothing else competes for the ARC.
+	 */
+	zcbs = umem_alloc(nthreads * sizeof (zdb_cb_t *), UMEM_NOFAIL);
+	zcbs[0] = &zcb;
+	for (int t = 1; t < nthreads; t++) {
+		zcbs[t] = umem_zalloc(sizeof (zdb_cb_t), UMEM_NOFAIL);
+		zcbs[t]->zcb_spa = spa;
+		zcbs[t]->zcb_progress = &zpg;
+	}
+	zfs_pd_blks_max = MAX(zfs_pd_blks_max, 1000);
+
+	mutex_init(&zpg.zpg_lock, NULL, MUTEX_DEFAULT, NULL);
+	zpg.zpg_totalasize = metaslab_class_get_alloc(spa_normal_class(spa));
+	zpg.zpg_start = zpg.zpg_lastprint = gethrtime();
+	zcb.zcb_haderrors |= traverse_pool_mt(spa, 0, flags, zdb_blkptr_cb,
+	    (void **)zcbs, nthreads);
 
 	/*
 	 * If we've traversed the data blocks then we need to wait for those
@@ -2503,6 +2605,13 @@ dump_block_stats(spa_t *spa)
 		    ZIO_FLAG_GODFATHER);
 	}
 
+	for (int t = 1; t < nthreads; t++) {
+		zdb_cb_merge(&zcb, zcbs[t]);
+		umem_free(zcbs[t], sizeof (zdb_cb_t));
+	}
+	umem_free(zcbs, nthreads * sizeof (zdb_cb_t *));
+	mutex_destroy(&zpg.zpg_lock);
+
 	if (zcb.zcb_haderrors) {
 		(void) printf("\nError counts:\n\n");
 		(void) printf("\t%5s  %s\n", "errno", "count");
@@ -2570,6 +2679,11 @@ dump_block_stats(spa_t *spa)
 	(void) printf("\tSPA allocated: %10llu     used: %5.2f%%\n",
 	    (u_longlong_t)norm_alloc, 100.0 * norm_alloc / norm_space);
 
+	if (zcb.zcb_embedded_blocks != 0) {
+		(void) printf("\tEmbedded blocks: %llu\n",
+		    (u_longlong_t)zcb.zcb_embedded_blocks);
+	}
+
 	if (tzb->zb_ditto_samevdev != 0) {
 		(void) printf("\tDittoed blocks on same vdev: %llu\n",
 		    (longlong_t)tzb->zb_ditto_samevdev);
@@ -3286,7 +3400,8 @@ main(int argc, char **argv)
 
 	dprintf_setup(&argc, argv);
 
-	while ((c = getopt(argc, argv, "bcdhilmM:suCDRSAFLXevp:t:U:P")) != -1) {
+	while ((c = getopt(argc, argv,
+	    "bcdhilmM:suCDRSAFLXevp:t:T:U:P")) != -1) {
 		switch (c) {
 		case 'b':
 		case 'c':
@@ -3347,6 +3462,14 @@ main(int argc, char **argv)
 				usage();
 			}
 			break;
+		case 'T':
+			zdb_threads = strtol(optarg, NULL, 0);
+			if (zdb_threads <= 0) {
+				(void) fprintf(stderr, "number of traversal "
+				    "threads must be greater than 0\n");
+				usage();
+			}
+			break;
 		case 'U':
 			spa_config_path = optarg;
 			break;
@@ -58,6 +58,7 @@
 #include <sys/fxpriocntl.h>
 #include <sys/processor.h>
 #include <sys/pset.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
@@ -81,6 +82,14 @@
 #define	ZSD_PSET_UNLIMITED	UINT16_MAX
 #define	ZONESTAT_EXACCT_FILE	"/var/adm/exacct/zonestat-process"
 
+/*
+ * Cached psinfo descriptors are kept at or above ZSD_PSINFO_MINFD, leaving the
+ * low descriptors to stdio and the libraries, and ZSD_PSINFO_FDRESERVE
+ * descriptors above that are never used for the cache.
+ */
+#define	ZSD_PSINFO_MINFD	256
+#define	ZSD_PSINFO_FDRESERVE	64
+
 /*
  * zonestatd implements gathering cpu and memory utilization data for
  * running zones.  It has these components:
@@ -315,6 +324,10 @@ typedef struct zsd_zone {
  *
  * If a process is never seen in /proc, the total usage on its extended
  * accounting record will be charged to its zone.
+ *
+ * The psinfo file of each process is kept open from one sweep to the next
+ * (zspr_fd), so that a sweep costs one pread() per process rather than an
+ * open(), read() and close() of /proc/<pid>/psinfo.
  */
 typedef struct zsd_proc {
 	list_node_t	zspr_next;
@@ -323,6 +336,7 @@ typedef struct zsd_proc {
 	zoneid_t	zspr_zoneid;
 	int		zspr_sched;
 	timestruc_t	zspr_usage;
+	int		zspr_fd;	/* open psinfo file, or -1 */
 } zsd_proc_t;
 
 /* Used to track the overall resource usage of the system */
@@ -436,6 +450,8 @@ typedef struct zsd_ctl {
 	/* Info about procfs for scanning /proc */
 	struct dirent	*zsctl_procfs_dent;
 	long		zsctl_procfs_dent_size;
+	uint_t		zsctl_procfs_nfd;	/* cached psinfo fds */
+	uint_t		zsctl_procfs_maxfd;	/* limit on the above */
 	pool_value_t	*zsctl_pool_vals[3];
 
 	/* Counts on tracked entities */
@@ -2502,14 +2518,60 @@ zsd_get_proc_info(zsd_ctl_t *ctl, psinfo_t *psinfo, psetid_t *psetid,
 	proc->zspr_ppid = psinfo->pr_ppid;
 }
 
+static void
+zsd_close_psinfo(zsd_ctl_t *ctl, zsd_proc_t *proc)
+{
+	if (proc->zspr_fd >= 0) {
+		(void) close(proc->zspr_fd);
+		proc->zspr_fd = -1;
+		ctl->zsctl_procfs_nfd--;
+	}
+}
+
+/*
+ * Read the psinfo of a process, through its cached descriptor if it has one.
+ * A read through a cached descriptor fails once the process is gone, and the
+ * pid is then looked up afresh in case it has been reused.
+ */
+static int
+zsd_read_psinfo(zsd_ctl_t *ctl, pid_t pid, psinfo_t *psinfo)
+{
+	zsd_proc_t *proc = &(ctl->zsctl_proc_array[pid]);
+	char path[MAXPATHLEN];
+	int fd;
+
+	if (proc->zspr_fd >= 0) {
+		if (pread(proc->zspr_fd, psinfo, sizeof (*psinfo), 0) ==
+		    sizeof (*psinfo))
+			return (0);
+		zsd_close_psinfo(ctl, proc);
+	}
+
+	(void) snprintf(path, sizeof (path), "/proc/%d/psinfo", (int)pid);
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return (-1);
+
+	if (pread(fd, psinfo, sizeof (*psinfo), 0) != sizeof (*psinfo)) {
+		(void) close(fd);
+		return (-1);
+	}
+
+	if (ctl->zsctl_procfs_nfd < ctl->zsctl_procfs_maxfd &&
+	    (proc->zspr_fd = fcntl(fd, F_DUPFD, ZSD_PSINFO_MINFD)) >= 0)
+		ctl->zsctl_procfs_nfd++;
+	(void) close(fd);
+	return (0);
+}
+
 /*
  * Reset the known cpu usage of a process. This is done after a process
  * exits so that if the pid is recycled, data from its previous life is
  * not reused
  */
 static void
-zsd_flush_proc_info(zsd_proc_t *proc)
+zsd_flush_proc_info(zsd_ctl_t *ctl, zsd_proc_t *proc)
 {
+	zsd_close_psinfo(ctl, proc);
 	proc->zspr_usage.tv_sec = 0;
 	proc->zspr_usage.tv_nsec = 0;
 }
@@ -2620,7 +2682,7 @@ zsd_refresh_procs(zsd_ctl_t *ctl, boolean_t init)
 	DIR *dir;
 	struct dirent *dent;
 	psinfo_t psinfo;
-	int fd, ret;
+	int ret;
 	zsd_proc_t *proc, *pproc, *tmp, *next;
 	list_t pplist, plist;
 	zsd_zone_t *zone, *prev_zone;
@@ -2628,7 +2690,8 @@ zsd_refresh_procs(zsd_ctl_t *ctl, boolean_t init)
 	psetid_t psetid, prev_psetid;
 	zoneid_t zoneid, prev_zoneid;
 	zsd_pset_usage_t *usage, *prev_usage;
-	char path[MAXPATHLEN];
+	char *end;
+	long pid;
 
 	ea_object_t object;
 	ea_object_t pobject;
@@ -2668,22 +2731,13 @@ zsd_refresh_procs(zsd_ctl_t *ctl, boolean_t init)
 	/* Walk all processes and compute each zone's usage on each pset. */
 	while (readdir_r(dir, dent) != 0) {
 
-		if (strcmp(dent->d_name, ".") == 0 ||
-		    strcmp(dent->d_name, "..") == 0)
-			continue;
-
-		(void) snprintf(path, sizeof (path), "/proc/%s/psinfo",
-		    dent->d_name);
-
-		fd = open(path, O_RDONLY);
-		if (fd < 0)
+		pid = strtol(dent->d_name, &end, 10);
+		if (*end != '\0' || end == dent->d_name || pid < 0 ||
+		    pid >= ctl->zsctl_maxproc)
 			continue;
 
-		if (read(fd, &psinfo, sizeof (psinfo)) != sizeof (psinfo)) {
-			(void) close(fd);
+		if (zsd_read_psinfo(ctl, (pid_t)pid, &psinfo) != 0)
 			continue;
-		}
-		(void) close(fd);
 
 		zsd_get_proc_info(ctl, &psinfo, &psetid, &prev_psetid,
 		    &zoneid, &prev_zoneid, &delta, &sched);
@@ -2994,7 +3048,7 @@ zsd_refresh_procs(zsd_ctl_t *ctl, boolean_t init)
 
 		zsd_add_usage(ctl, usage, &delta);
 proc_done:
-		zsd_flush_proc_info(proc);
+		zsd_flush_proc_info(ctl, proc);
 
 		if (hrtime_expired == B_TRUE)
 			break;
@@ -3075,7 +3129,7 @@ proc_done:
 			}
 			zsd_mark_pset_usage_found(usage, proc->zspr_sched);
 			zsd_add_usage(ctl, usage, &proc->zspr_usage);
-			zsd_flush_proc_info(proc);
+			zsd_flush_proc_info(ctl, proc);
 			tmp = proc;
 			proc = list_next(&plist, proc);
 			list_remove(&plist, tmp);
@@ -3130,7 +3184,7 @@ proc_done:
 next:
 		tmp = proc;
 		proc = list_next(&pplist, proc);
-		zsd_flush_proc_info(tmp);
+		zsd_flush_proc_info(ctl, tmp);
 		list_link_init(&tmp->zspr_next);
 	}
 	return;
@@ -3933,6 +3987,9 @@ zsd_close(zsd_ctl_t *ctl)
 		ctl->zsctl_proc_open = 0;
 		ctl->zsctl_proc_fd = -1;
 	}
+	for (id = 0; ctl->zsctl_procfs_nfd > 0 && id < ctl->zsctl_maxproc;
+	    id++)
+		zsd_close_psinfo(ctl, &ctl->zsctl_proc_array[id]);
 	if (ctl->zsctl_pool_conf) {
 		if (ctl->zsctl_pool_status == POOL_ENABLED)
 			(void) pool_conf_close(ctl->zsctl_pool_conf);
@@ -4055,6 +4112,7 @@ zsd_open(zsd_ctl_t *ctl)
 	char path[MAXPATHLEN];
 	long pathmax;
 	struct statvfs svfs;
+	struct rlimit rl;
 	int ret;
 	int i;
 	size_t size;
@@ -4138,13 +4196,29 @@ check_exacct:
 		errno = ENOMEM;
 		goto err;
 	}
-	for (i = 0; i <= ctl->zsctl_maxproc; i++) {
+	for (i = 0; i < ctl->zsctl_maxproc; i++) {
 		list_link_init(&(ctl->zsctl_proc_array[i].zspr_next));
 		ctl->zsctl_proc_array[i].zspr_psetid = ZS_PSET_ERROR;
 		ctl->zsctl_proc_array[i].zspr_zoneid = -1;
 		ctl->zsctl_proc_array[i].zspr_usage.tv_sec = 0;
 		ctl->zsctl_proc_array[i].zspr_usage.tv_nsec = 0;
 		ctl->zsctl_proc_array[i].zspr_ppid = -1;
+		ctl->zsctl_proc_array[i].zspr_fd = -1;
+	}
+
+	/*
+	 * Raise the descriptor limit as far as allowed so that the psinfo
+	 * files of as many processes as possible can be kept open.
+	 */
+	ctl->zsctl_procfs_nfd = 0;
+	ctl->zsctl_procfs_maxfd = 0;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		(void) setrlimit(RLIMIT_NOFILE, &rl);
+		(void) getrlimit(RLIMIT_NOFILE, &rl);
+		if (rl.rlim_cur > ZSD_PSINFO_MINFD + ZSD_PSINFO_FDRESERVE)
+			ctl->zsctl_procfs_maxfd = MIN(rl.rlim_cur -
+			    ZSD_PSINFO_MINFD - ZSD_PSINFO_FDRESERVE, UINT_MAX);
 	}
 
 	list_create(&ctl->zsctl_zones, sizeof (zsd_zone_t),
@@ -79,6 +79,7 @@ static int zpool_do_replace(int, char **);
 static int zpool_do_split(int, char **);
 
 static int zpool_do_scrub(int, char **);
+static int zpool_do_trim(int, char **);
 
 static int zpool_do_import(int, char **);
 static int zpool_do_export(int, char **);
@@ -126,6 +127,7 @@ typedef enum {
 	HELP_REPLACE,
 	HELP_REMOVE,
 	HELP_SCRUB,
+	HELP_TRIM,
 	HELP_STATUS,
 	HELP_UPGRADE,
 	HELP_GET,
@@ -173,6 +175,7 @@ static zpool_command_t command_table[] = {
 	{ "split",	zpool_do_split,		HELP_SPLIT		},
 	{ NULL },
 	{ "scrub",	zpool_do_scrub,		HELP_SCRUB		},
+	{ "trim",	zpool_do_trim,		HELP_TRIM		},
 	{ NULL },
 	{ "import",	zpool_do_import,	HELP_IMPORT		},
 	{ "export",	zpool_do_export,	HELP_EXPORT		},
@@ -224,7 +227,7 @@ get_usage(zpool_help_t idx) {
 		    "[-R root] [-F [-n]]\n"
 		    "\t    <pool | id> [newpool]\n"));
 	case HELP_IOSTAT:
-		return (gettext("\tiostat [-v] [-T d|u] [pool] ... [interval "
+		return (gettext("\tiostat [-lv] [-T d|u] [pool] ... [interval "
 		    "[count]]\n"));
 	case HELP_LIST:
 		return (gettext("\tlist [-Hp] [-o property[,...]] "
@@ -242,6 +245,8 @@ get_usage(zpool_help_t idx) {
 		return (gettext("\treopen <pool>\n"));
 	case HELP_SCRUB:
 		return (gettext("\tscrub [-s] <pool> ...\n"));
+	case HELP_TRIM:
+		return (gettext("\ttrim <pool> ...\n"));
 	case HELP_STATUS:
 		return (gettext("\tstatus [-vx] [-T d|u] [pool] ... [interval "
 		    "[count]]\n"));
@@ -2143,11 +2148,19 @@ error:
 
 typedef struct iostat_cbdata {
 	boolean_t cb_verbose;
+	boolean_t cb_latency;
 	int cb_namewidth;
 	int cb_iteration;
 	zpool_list_t *cb_list;
 } iostat_cbdata_t;
 
+/*
+ * Latency mode (-l) shows the mean time i/os spent queued in each of the
+ * vdev I/O scheduler's classes, followed by the mean device service time
+ * for reads and writes.
+ */
+#define	IOSTAT_COLUMNS(cb)	((cb)->cb_latency ? 8 : 6)
+
 static void
 print_iostat_separator(iostat_cbdata_t *cb)
 {
@@ -2155,16 +2168,37 @@ print_iostat_separator(iostat_cbdata_t *cb)
 
 	for (i = 0; i < cb->cb_namewidth; i++)
 		(void) printf("-");
-	(void) printf("  -----  -----  -----  -----  -----  -----\n");
+	for (i = 0; i < IOSTAT_COLUMNS(cb); i++)
+		(void) printf("  -----");
+	(void) printf("\n");
+}
+
+/*
+ * Print a row with no statistics, e.g. the "logs" and "cache" headings.
+ */
+static void
+print_iostat_dashes(iostat_cbdata_t *cb, const char *label)
+{
+	(void) printf("%-*s", cb->cb_namewidth, label);
+	for (int i = 0; i < IOSTAT_COLUMNS(cb); i++)
+		(void) printf("      -");
+	(void) printf("\n");
 }
 
 static void
 print_iostat_header(iostat_cbdata_t *cb)
 {
-	(void) printf("%*s     capacity     operations    bandwidth\n",
-	    cb->cb_namewidth, "");
-	(void) printf("%-*s  alloc   free   read  write   read  write\n",
-	    cb->cb_namewidth, "pool");
+	if (cb->cb_latency) {
+		(void) printf("%*s               queue wait (avg)"
+		    "               disk wait\n", cb->cb_namewidth, "");
+		(void) printf("%-*s  syncr  syncw  asncr  asncw  scrub   trim"
+		    "   read  write\n", cb->cb_namewidth, "pool");
+	} else {
+		(void) printf("%*s     capacity     operations    bandwidth\n",
+		    cb->cb_namewidth, "");
+		(void) printf("%-*s  alloc   free   read  write   read"
+		    "  write\n", cb->cb_namewidth, "pool");
+	}
 	print_iostat_separator(cb);
 }
 
@@ -2180,6 +2214,123 @@ print_one_stat(uint64_t value)
 	(void) printf("  %5s", buf);
 }
 
+/*
+ * Display a single latency, given in nanoseconds, or "-" if there were no
+ * i/os to measure.
+ */
+static void
+print_one_time(uint64_t ns)
+{
+	char buf[64];
+
+	if (ns == 0)
+		(void) strlcpy(buf, "-", sizeof (buf));
+	else if (ns < 1000)
+		(void) snprintf(buf, sizeof (buf), "%lluns", (u_longlong_t)ns);
+	else if (ns < 1000000)
+		(void) snprintf(buf, sizeof (buf), "%lluus",
+		    (u_longlong_t)(ns / 1000));
+	else if (ns < 1000000000)
+		(void) snprintf(buf, sizeof (buf), "%llums",
+		    (u_longlong_t)(ns / 1000000));
+	else
+		(void) snprintf(buf, sizeof (buf), "%llus",
+		    (u_longlong_t)(ns / 1000000000));
+	(void) printf("  %5s", buf);
+}
+
+/*
+ * Classes, in vdev_queue_stat_t order: sync read, sync write, async read,
+ * async write, scrub, trim.
+ */
+#define	IOSTAT_CLASS(p)		(1 << (p))
+#define	IOSTAT_READ_CLASSES	(IOSTAT_CLASS(0) | IOSTAT_CLASS(2) | \
+	IOSTAT_CLASS(4))
+#define	IOSTAT_WRITE_CLASSES	(IOSTAT_CLASS(1) | IOSTAT_CLASS(3))
+
+/*
+ * The mean latency of the i/os added to the given classes' histograms
+ * between two samples.  Bucket b counts i/os that took [2^b, 2^(b+1)) ns,
+ * so each is weighed at its bucket's midpoint.
+ */
+static uint64_t
+histo_mean_delta(vdev_queue_stat_t *oldq, vdev_queue_stat_t *newq,
+    boolean_t disk, int classes)
+{
+	uint64_t count = 0;
+	double total = 0;
+
+	for (int p = 0; p < VDEV_QUEUE_CLASSES; p++) {
+		uint64_t *oh, *nh;
+
+		if (!(classes & IOSTAT_CLASS(p)))
+			continue;
+
+		oh = disk ? oldq->vqs_disk_histo[p] : oldq->vqs_queue_histo[p];
+		nh = disk ? newq->vqs_disk_histo[p] : newq->vqs_queue_histo[p];
+		for (int b = 0; b < VDEV_LAT_HISTO_BUCKETS; b++) {
+			uint64_t n = nh[b] - oh[b];
+
+			count += n;
+			total += n * (1.5 * (1ULL << b));
+		}
+	}
+
+	return (count == 0 ? 0 : (uint64_t)(total / count));
+}
+
+static void
+print_throughput_stats(vdev_stat_t *oldvs, vdev_stat_t *newvs, double scale)
+{
+	/* only toplevel vdevs have capacity stats */
+	if (newvs->vs_space == 0) {
+		(void) printf("      -      -");
+	} else {
+		print_one_stat(newvs->vs_alloc);
+		print_one_stat(newvs->vs_space - newvs->vs_alloc);
+	}
+
+	print_one_stat((uint64_t)(scale * (newvs->vs_ops[ZIO_TYPE_READ] -
+	    oldvs->vs_ops[ZIO_TYPE_READ])));
+
+	print_one_stat((uint64_t)(scale * (newvs->vs_ops[ZIO_TYPE_WRITE] -
+	    oldvs->vs_ops[ZIO_TYPE_WRITE])));
+
+	print_one_stat((uint64_t)(scale * (newvs->vs_bytes[ZIO_TYPE_READ] -
+	    oldvs->vs_bytes[ZIO_TYPE_READ])));
+
+	print_one_stat((uint64_t)(scale * (newvs->vs_bytes[ZIO_TYPE_WRITE] -
+	    oldvs->vs_bytes[ZIO_TYPE_WRITE])));
+}
+
+static void
+print_latency_stats(nvlist_t *oldnv, nvlist_t *newnv)
+{
+	vdev_queue_stat_t *oldq, *newq;
+	vdev_queue_stat_t zeroq = { 0 };
+	uint_t c;
+
+	if (nvlist_lookup_uint64_array(newnv, ZPOOL_CONFIG_VDEV_QUEUE_STATS,
+	    (uint64_t **)&newq, &c) != 0) {
+		for (c = 0; c < VDEV_QUEUE_CLASSES + 2; c++)
+			(void) printf("      -");
+		return;
+	}
+
+	if (oldnv == NULL || nvlist_lookup_uint64_array(oldnv,
+	    ZPOOL_CONFIG_VDEV_QUEUE_STATS, (uint64_t **)&oldq, &c) != 0)
+		oldq = &zeroq;
+
+	for (int p = 0; p < VDEV_QUEUE_CLASSES; p++) {
+		print_one_time(histo_mean_delta(oldq, newq, B_FALSE,
+		    IOSTAT_CLASS(p)));
+	}
+	print_one_time(histo_mean_delta(oldq, newq, B_TRUE,
+	    IOSTAT_READ_CLASSES));
+	print_one_time(histo_mean_delta(oldq, newq, B_TRUE,
+	    IOSTAT_WRITE_CLASSES));
+}
+
 /*
  * Print out all the statistics for the given vdev.  This can either be the
  * toplevel configuration, or called recursively.  If 'name' is NULL, then this
@@ -2220,26 +2371,12 @@ print_vdev_stats(zpool_handle_t *zhp, const char *name, nvlist_t *oldnv,
 	else
 		scale = (double)NANOSEC / tdelta;
 
-	/* only toplevel vdevs have capacity stats */
-	if (newvs->vs_space == 0) {
-		(void) printf("      -      -");
+	if (cb->cb_latency) {
+		print_latency_stats(oldnv, newnv);
 	} else {
-		print_one_stat(newvs->vs_alloc);
-		print_one_stat(newvs->vs_space - newvs->vs_alloc);
+		print_throughput_stats(oldvs, newvs, scale);
 	}
 
-	print_one_stat((uint64_t)(scale * (newvs->vs_ops[ZIO_TYPE_READ] -
-	    oldvs->vs_ops[ZIO_TYPE_READ])));
-
-	print_one_stat((uint64_t)(scale * (newvs->vs_ops[ZIO_TYPE_WRITE] -
-	    oldvs->vs_ops[ZIO_TYPE_WRITE])));
-
-	print_one_stat((uint64_t)(scale * (newvs->vs_bytes[ZIO_TYPE_READ] -
-	    oldvs->vs_bytes[ZIO_TYPE_READ])));
-
-	print_one_stat((uint64_t)(scale * (newvs->vs_bytes[ZIO_TYPE_WRITE] -
-	    oldvs->vs_bytes[ZIO_TYPE_WRITE])));
-
 	(void) printf("\n");
 
 	if (!cb->cb_verbose)
@@ -2276,8 +2413,7 @@ print_vdev_stats(zpool_handle_t *zhp, const char *name, nvlist_t *oldnv,
 	 */
 
 	if (num_logs(newnv) > 0) {
-		(void) printf("%-*s      -      -      -      -      -      "
-		    "-\n", cb->cb_namewidth, "logs");
+		print_iostat_dashes(cb, "logs");
 
 		for (c = 0; c < children; c++) {
 			uint64_t islog = B_FALSE;
@@ -2308,8 +2444,7 @@ print_vdev_stats(zpool_handle_t *zhp, const char *name, nvlist_t *oldnv,
 		return;
 
 	if (children > 0) {
-		(void) printf("%-*s      -      -      -      -      -      "
-		    "-\n", cb->cb_namewidth, "cache");
+		print_iostat_dashes(cb, "cache");
 		for (c = 0; c < children; c++) {
 			vname = zpool_vdev_name(g_zfs, zhp, newchild[c],
 			    B_FALSE);
@@ -2397,6 +2532,8 @@ get_namewidth(zpool_handle_t *zhp, void *data)
 		cb->cb_namewidth = 10;
 	if (cb->cb_namewidth > 38)
 		cb->cb_namewidth = 38;
+	if (cb->cb_latency && cb->cb_namewidth > 24)
+		cb->cb_namewidth = 24;
 
 	return (0);
 }
@@ -2484,8 +2621,9 @@ get_timestamp_arg(char c)
 }
 
 /*
- * zpool iostat [-v] [-T d|u] [pool] ... [interval [count]]
+ * zpool iostat [-lv] [-T d|u] [pool] ... [interval [count]]
  *
+ *	-l	Display average queue and disk latencies instead of throughput
  *	-v	Display statistics for individual vdevs
  *	-T	Display a timestamp in date(1) or Unix format
  *
@@ -2504,11 +2642,15 @@ zpool_do_iostat(int argc, char **argv)
 	unsigned long interval = 0, count = 0;
 	zpool_list_t *list;
 	boolean_t verbose = B_FALSE;
+	boolean_t latency = B_FALSE;
 	iostat_cbdata_t cb;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "T:v")) != -1) {
+	while ((c = getopt(argc, argv, "lT:v")) != -1) {
 		switch (c) {
+		case 'l':
+			latency = B_TRUE;
+			break;
 		case 'T':
 			get_timestamp_arg(*optarg);
 			break;
@@ -2550,6 +2692,7 @@ zpool_do_iostat(int argc, char **argv)
 	 */
 	cb.cb_list = list;
 	cb.cb_verbose = verbose;
+	cb.cb_latency = latency;
 	cb.cb_iteration = 0;
 	cb.cb_namewidth = 0;
 
@@ -3685,6 +3828,51 @@ zpool_do_scrub(int argc, char **argv)
 	return (for_each_pool(argc, argv, B_TRUE, NULL, scrub_callback, &cb));
 }
 
+/* ARGSUSED */
+static int
+trim_callback(zpool_handle_t *zhp, void *data)
+{
+	if (zpool_get_state(zhp) == POOL_STATE_UNAVAIL) {
+		(void) fprintf(stderr, gettext("cannot trim '%s': pool is "
+		    "currently unavailable\n"), zpool_get_name(zhp));
+		return (1);
+	}
+
+	return (zpool_trim(zhp) != 0);
+}
+
+/*
+ * zpool trim <pool> ...
+ *
+ * Trim all of the free space in the given pools.  The trim runs in the
+ * background; space freed later is only trimmed if autotrim is on.
+ */
+int
+zpool_do_trim(int argc, char **argv)
+{
+	int c;
+
+	/* check options */
+	while ((c = getopt(argc, argv, "")) != -1) {
+		switch (c) {
+		case '?':
+			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
+			    optopt);
+			usage(B_FALSE);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) {
+		(void) fprintf(stderr, gettext("missing pool name argument\n"));
+		usage(B_FALSE);
+	}
+
+	return (for_each_pool(argc, argv, B_TRUE, NULL, trim_callback, NULL));
+}
+
 typedef struct status_cbdata {
 	int		cb_count;
 	boolean_t	cb_allpools;
@@ -559,15 +559,18 @@ get_replication(nvlist_t *nvroot, boolean_t fatal)
 	lastrep.zprl_type = NULL;
 	for (t = 0; t < toplevels; t++) {
 		uint64_t is_log = B_FALSE;
+		uint64_t is_special = B_FALSE;
 
 		nv = top[t];
 
 		/*
-		 * For separate logs we ignore the top level vdev replication
-		 * constraints.
+		 * For separate logs and special class devices we ignore the
+		 * top level vdev replication constraints.
 		 */
 		(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_IS_LOG, &is_log);
-		if (is_log)
+		(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_IS_SPECIAL,
+		    &is_special);
+		if (is_log || is_special)
 			continue;
 
 		verify(nvlist_lookup_string(nv, ZPOOL_CONFIG_TYPE,
@@ -1147,6 +1150,12 @@ is_grouping(const char *type, int *mindev, int *maxdev)
 		return (VDEV_TYPE_L2CACHE);
 	}
 
+	if (strcmp(type, "special") == 0) {
+		if (mindev != NULL)
+			*mindev = 1;
+		return (VDEV_TYPE_SPECIAL);
+	}
+
 	return (NULL);
 }
 
@@ -1160,10 +1169,10 @@ nvlist_t *
 construct_spec(int argc, char **argv)
 {
 	nvlist_t *nvroot, *nv, **top, **spares, **l2cache;
-	int t, toplevels, mindev, maxdev, nspares, nlogs, nl2cache;
+	int t, toplevels, mindev, maxdev, nspares, nlogs, nl2cache, nspecial;
 	const char *type;
-	uint64_t is_log;
-	boolean_t seen_logs;
+	uint64_t is_log, is_special;
+	boolean_t seen_logs, seen_special;
 
 	top = NULL;
 	toplevels = 0;
@@ -1172,8 +1181,11 @@ construct_spec(int argc, char **argv)
 	nspares = 0;
 	nlogs = 0;
 	nl2cache = 0;
+	nspecial = 0;
 	is_log = B_FALSE;
 	seen_logs = B_FALSE;
+	is_special = B_FALSE;
+	seen_special = B_FALSE;
 
 	while (argc > 0) {
 		nv = NULL;
@@ -1195,6 +1207,7 @@ construct_spec(int argc, char **argv)
 					return (NULL);
 				}
 				is_log = B_FALSE;
+				is_special = B_FALSE;
 			}
 
 			if (strcmp(type, VDEV_TYPE_LOG) == 0) {
@@ -1207,6 +1220,7 @@ construct_spec(int argc, char **argv)
 				}
 				seen_logs = B_TRUE;
 				is_log = B_TRUE;
+				is_special = B_FALSE;
 				argc--;
 				argv++;
 				/*
@@ -1216,6 +1230,26 @@ construct_spec(int argc, char **argv)
 				continue;
 			}
 
+			if (strcmp(type, VDEV_TYPE_SPECIAL) == 0) {
+				if (seen_special) {
+					(void) fprintf(stderr,
+					    gettext("invalid vdev "
+					    "specification: 'special' can be "
+					    "specified only once\n"));
+					return (NULL);
+				}
+				seen_special = B_TRUE;
+				is_special = B_TRUE;
+				is_log = B_FALSE;
+				argc--;
+				argv++;
+				/*
+				 * Like a log, special is not a real
+				 * grouping device.
+				 */
+				continue;
+			}
+
 			if (strcmp(type, VDEV_TYPE_L2CACHE) == 0) {
 				if (l2cache != NULL) {
 					(void) fprintf(stderr,
@@ -1225,17 +1259,22 @@ construct_spec(int argc, char **argv)
 					return (NULL);
 				}
 				is_log = B_FALSE;
+				is_special = B_FALSE;
 			}
 
-			if (is_log) {
+			if (is_log || is_special) {
 				if (strcmp(type, VDEV_TYPE_MIRROR) != 0) {
 					(void) fprintf(stderr,
 					    gettext("invalid vdev "
-					    "specification: unsupported 'log' "
-					    "device: %s\n"), type);
+					    "specification: unsupported '%s' "
+					    "device: %s\n"),
+					    is_log ? "log" : "special", type);
 					return (NULL);
 				}
-				nlogs++;
+				if (is_log)
+					nlogs++;
+				else
+					nspecial++;
 			}
 
 			for (c = 1; c < argc; c++) {
@@ -1284,6 +1323,11 @@ construct_spec(int argc, char **argv)
 				    type) == 0);
 				verify(nvlist_add_uint64(nv,
 				    ZPOOL_CONFIG_IS_LOG, is_log) == 0);
+				if (is_special) {
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_IS_SPECIAL,
+					    is_special) == 0);
+				}
 				if (strcmp(type, VDEV_TYPE_RAIDZ) == 0) {
 					verify(nvlist_add_uint64(nv,
 					    ZPOOL_CONFIG_NPARITY,
@@ -1306,6 +1350,11 @@ construct_spec(int argc, char **argv)
 				return (NULL);
 			if (is_log)
 				nlogs++;
+			if (is_special) {
+				verify(nvlist_add_uint64(nv,
+				    ZPOOL_CONFIG_IS_SPECIAL, is_special) == 0);
+				nspecial++;
+			}
 			argc--;
 			argv++;
 		}
@@ -1330,6 +1379,12 @@ construct_spec(int argc, char **argv)
 		return (NULL);
 	}
 
+	if (seen_special && nspecial == 0) {
+		(void) fprintf(stderr, gettext("invalid vdev specification: "
+		    "special requires at least 1 device\n"));
+		return (NULL);
+	}
+
 	/*
 	 * Finally, create nvroot and add all top-level vdevs to it.
 	 */
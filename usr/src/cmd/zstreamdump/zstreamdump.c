@@ -410,6 +410,8 @@ main(int argc, char *argv[])
 				drrw->drr_toguid = BSWAP_64(drrw->drr_toguid);
 				drrw->drr_key.ddk_prop =
 				    BSWAP_64(drrw->drr_key.ddk_prop);
+				drrw->drr_compressed_size =
+				    BSWAP_64(drrw->drr_compressed_size);
 			}
 			/*
 			 * If this is verbose and/or dump output,
@@ -417,27 +419,29 @@ main(int argc, char *argv[])
 			 */
 			if (verbose) {
 				(void) printf("WRITE object = %llu type = %u "
-				    "checksum type = %u\n"
+				    "checksum type = %u compression type = %u\n"
 				    "offset = %llu length = %llu "
-				    "props = %llx\n",
+				    "compressed size = %llu props = %llx\n",
 				    (u_longlong_t)drrw->drr_object,
 				    drrw->drr_type,
 				    drrw->drr_checksumtype,
+				    drrw->drr_compressiontype,
 				    (u_longlong_t)drrw->drr_offset,
 				    (u_longlong_t)drrw->drr_length,
+				    (u_longlong_t)drrw->drr_compressed_size,
 				    (u_longlong_t)drrw->drr_key.ddk_prop);
 			}
 			/*
 			 * Read the contents of the block in from STDIN to buf
 			 */
-			(void) ssread(buf, drrw->drr_length, &zc);
+			(void) ssread(buf, DRR_WRITE_PAYLOAD_SIZE(drrw), &zc);
 			/*
 			 * If in dump mode
 			 */
 			if (dump) {
-				print_block(buf, drrw->drr_length);
+				print_block(buf, DRR_WRITE_PAYLOAD_SIZE(drrw));
 			}
-			total_write_size += drrw->drr_length;
+			total_write_size += DRR_WRITE_PAYLOAD_SIZE(drrw);
 			break;
 
 		case DRR_WRITE_BYREF:
@@ -158,6 +158,8 @@ typedef struct ztest_shared_opts {
 	uint64_t zo_time;
 	uint64_t zo_maxloops;
 	uint64_t zo_metaslab_gang_bang;
+	uint64_t zo_bench;
+	uint64_t zo_bench_ops;
 } ztest_shared_opts_t;
 
 static const ztest_shared_opts_t ztest_opts_defaults = {
@@ -179,7 +181,9 @@ static const ztest_shared_opts_t ztest_opts_defaults = {
 	.zo_init = 1,
 	.zo_time = 300,			/* 5 minutes */
 	.zo_maxloops = 50,		/* max loops during spa_freeze() */
-	.zo_metaslab_gang_bang = 32 << 10
+	.zo_metaslab_gang_bang = 32 << 10,
+	.zo_bench = 0,			/* no benchmark workloads */
+	.zo_bench_ops = 0		/* per-workload default op count */
 };
 
 extern uint64_t metaslab_gang_bang;
@@ -379,6 +383,58 @@ ztest_info_t ztest_info[] = {
 
 #define	ZTEST_FUNCS	(sizeof (ztest_info) / sizeof (ztest_info_t))
 
+/*
+ * Benchmark workloads (-b).  Instead of the randomized tests above, each
+ * selected workload runs a fixed number of operations spread evenly
+ * across the test threads, and ztest reports throughput and latency
+ * percentiles for it.  The workloads use fixed block sizes and a seeded
+ * offset generator so that runs of different builds are comparable.
+ */
+typedef struct ztest_bench_thread {
+	ztest_ds_t	*zbt_zd;
+	uint64_t	zbt_id;
+	uint64_t	zbt_object;
+	uint64_t	zbt_span;
+	uint64_t	zbt_seed;
+	uint64_t	zbt_ops;
+	uint64_t	zbt_bytes;
+	hrtime_t	*zbt_lat;
+	void		*zbt_buf;
+	size_t		zbt_bufsize;
+	struct ztest_bench *zbt_bench;
+} ztest_bench_thread_t;
+
+typedef void ztest_bench_setup_t(ztest_bench_thread_t *zbt);
+typedef uint64_t ztest_bench_op_t(ztest_bench_thread_t *zbt, uint64_t i);
+
+typedef struct ztest_bench {
+	char			*zb_name;
+	ztest_bench_setup_t	*zb_setup;	/* untimed, per thread */
+	ztest_bench_op_t	*zb_op;		/* one timed operation */
+	uint64_t		zb_blocksize;	/* file block size */
+	uint64_t		zb_iosize;	/* bytes per write */
+	uint64_t		zb_ops;		/* default total op count */
+} ztest_bench_t;
+
+static ztest_bench_setup_t ztest_bench_file_setup;
+static ztest_bench_op_t ztest_bench_randwrite;
+static ztest_bench_op_t ztest_bench_seqwrite;
+static ztest_bench_op_t ztest_bench_createunlink;
+static ztest_bench_op_t ztest_bench_snapchurn;
+
+static ztest_bench_t ztest_bench_info[] = {
+	{ "randwrite8k",	ztest_bench_file_setup,	ztest_bench_randwrite,
+	    8 << 10,	8 << 10,	20000	},
+	{ "seqwrite1m",		ztest_bench_file_setup,	ztest_bench_seqwrite,
+	    128 << 10,	1 << 20,	2000	},
+	{ "createunlink",	NULL,
+	    ztest_bench_createunlink,	0,	0,		20000	},
+	{ "snapchurn",		ztest_bench_file_setup,	ztest_bench_snapchurn,
+	    8 << 10,	8 << 10,	500	},
+};
+
+#define	ZTEST_BENCHES	(sizeof (ztest_bench_info) / sizeof (ztest_bench_t))
+
 /*
  * The following struct is used to hold a list of uncalled commit callbacks.
  * The callbacks are ordered by txg number.
@@ -544,6 +600,41 @@ nicenumtoull(const char *buf)
 	return (val);
 }
 
+/*
+ * Convert a comma-separated list of benchmark workload names into a
+ * bitmask of ztest_bench_info[] entries.
+ */
+static uint64_t
+ztest_bench_parse(const char *arg)
+{
+	char *list, *name, *last;
+	uint64_t mask = 0;
+
+	list = strdup(arg);
+	for (name = strtok_r(list, ",", &last); name != NULL;
+	    name = strtok_r(NULL, ",", &last)) {
+		int b;
+
+		if (strcmp(name, "all") == 0) {
+			mask |= (1ULL << ZTEST_BENCHES) - 1;
+			continue;
+		}
+		for (b = 0; b < ZTEST_BENCHES; b++) {
+			if (strcmp(name, ztest_bench_info[b].zb_name) == 0)
+				break;
+		}
+		if (b == ZTEST_BENCHES) {
+			(void) fprintf(stderr, "ztest: unknown benchmark "
+			    "workload: %s\n", name);
+			usage(B_FALSE);
+		}
+		mask |= 1ULL << b;
+	}
+	free(list);
+
+	return (mask);
+}
+
 static void
 usage(boolean_t requested)
 {
@@ -551,10 +642,17 @@ usage(boolean_t requested)
 
 	char nice_vdev_size[10];
 	char nice_gang_bang[10];
+	char bench_names[128] = { 0 };
 	FILE *fp = requested ? stdout : stderr;
 
 	nicenum(zo->zo_vdev_size, nice_vdev_size);
 	nicenum(zo->zo_metaslab_gang_bang, nice_gang_bang);
+	for (int b = 0; b < ZTEST_BENCHES; b++) {
+		if (b != 0)
+			(void) strlcat(bench_names, ", ", sizeof (bench_names));
+		(void) strlcat(bench_names, ztest_bench_info[b].zb_name,
+		    sizeof (bench_names));
+	}
 
 	(void) fprintf(fp, "Usage: %s\n"
 	    "\t[-v vdevs (default: %llu)]\n"
@@ -576,6 +674,9 @@ usage(boolean_t requested)
 	    "\t[-F freezeloops (default: %llu)] max loops in spa_freeze()\n"
 	    "\t[-P passtime (default: %llu sec)] time per pass\n"
 	    "\t[-B alt_ztest (default: <none>)] alternate ztest path\n"
+	    "\t[-b workload[,...]] run benchmark workloads instead of tests\n"
+	    "\t    (%s, or all)\n"
+	    "\t[-n ops] operations per benchmark workload\n"
 	    "\t[-h] (print help)\n"
 	    "",
 	    zo->zo_pool,
@@ -594,7 +695,8 @@ usage(boolean_t requested)
 	    zo->zo_dir,					/* -f */
 	    (u_longlong_t)zo->zo_time,			/* -T */
 	    (u_longlong_t)zo->zo_maxloops,		/* -F */
-	    (u_longlong_t)zo->zo_passtime);
+	    (u_longlong_t)zo->zo_passtime,
+	    bench_names);				/* -b */
 	exit(requested ? 0 : 1);
 }
 
@@ -611,7 +713,7 @@ process_options(int argc, char **argv)
 	bcopy(&ztest_opts_defaults, zo, sizeof (*zo));
 
 	while ((opt = getopt(argc, argv,
-	    "v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:hF:B:")) != EOF) {
+	    "v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:hF:B:b:n:")) != EOF) {
 		value = 0;
 		switch (opt) {
 		case 'v':
@@ -628,6 +730,7 @@ process_options(int argc, char **argv)
 		case 'T':
 		case 'P':
 		case 'F':
+		case 'n':
 			value = nicenumtoull(optarg);
 		}
 		switch (opt) {
@@ -698,6 +801,12 @@ process_options(int argc, char **argv)
 		case 'B':
 			(void) strlcpy(altdir, optarg, sizeof (altdir));
 			break;
+		case 'b':
+			zo->zo_bench = ztest_bench_parse(optarg);
+			break;
+		case 'n':
+			zo->zo_bench_ops = MAX(1, value);
+			break;
 		case 'h':
 			usage(B_TRUE);
 			break;
@@ -1342,6 +1451,13 @@ ztest_log_write(ztest_ds_t *zd, dmu_tx_t *tx, lr_write_t *lr)
 	if (zil_replaying(zd->zd_zilog, tx))
 		return;
 
+	/*
+	 * Benchmark runs must be repeatable, so always log small writes
+	 * the way an fsync-heavy workload on a pool without a slog would.
+	 */
+	if (ztest_opts.zo_bench != 0)
+		write_state = WR_COPIED;
+
 	if (lr->lr_length > ZIL_MAX_LOG_DATA)
 		write_state = WR_INDIRECT;
 
@@ -1357,7 +1473,7 @@ ztest_log_write(ztest_ds_t *zd, dmu_tx_t *tx, lr_write_t *lr)
 	}
 	itx->itx_private = zd;
 	itx->itx_wr_state = write_state;
-	itx->itx_sync = (ztest_random(8) == 0);
+	itx->itx_sync = (ztest_opts.zo_bench != 0 || ztest_random(8) == 0);
 	itx->itx_sod += (write_state == WR_NEED_COPY ? lr->lr_length : 0);
 
 	bcopy(&lr->lr_common + 1, &itx->itx_lr + 1,
@@ -1589,8 +1705,8 @@ ztest_replay_write(ztest_ds_t *zd, lr_write_t *lr, boolean_t byteswap)
 
 	dmu_tx_hold_write(tx, lr->lr_foid, offset, length);
 
-	if (ztest_random(8) == 0 && length == doi.doi_data_block_size &&
-	    P2PHASE(offset, length) == 0)
+	if (ztest_opts.zo_bench == 0 && ztest_random(8) == 0 &&
+	    length == doi.doi_data_block_size && P2PHASE(offset, length) == 0)
 		abuf = dmu_request_arcbuf(db, length);
 
 	txg = ztest_tx_assign(tx, TXG_WAIT, FTAG);
@@ -3171,7 +3287,7 @@ ztest_dataset_create(char *dsname)
 	int err = dmu_objset_create(dsname, DMU_OST_OTHER, 0,
 	    ztest_objset_create_cb, NULL);
 
-	if (err || zilset < 80)
+	if (err || zilset < 80 || ztest_opts.zo_bench != 0)
 		return (err);
 
 	if (ztest_opts.zo_verbose >= 6)
@@ -5534,6 +5650,310 @@ ztest_dataset_close(int d)
 	ztest_zd_fini(zd);
 }
 
+/*
+ * Offsets for the benchmark workloads come from a per-thread xorshift
+ * generator rather than ztest_random(), so every run of a given thread
+ * count issues exactly the same I/O pattern.
+ */
+static uint64_t
+ztest_bench_random(ztest_bench_thread_t *zbt)
+{
+	uint64_t x = zbt->zbt_seed;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	zbt->zbt_seed = x;
+
+	return (x * 2685821657736338717ULL);
+}
+
+static void
+ztest_bench_file_setup(ztest_bench_thread_t *zbt)
+{
+	ztest_bench_t *zb = zbt->zbt_bench;
+	ztest_od_t od[1];
+
+	ztest_od_init(&od[0], zbt->zbt_id, zb->zb_name, 0,
+	    DMU_OT_UINT64_OTHER, zb->zb_blocksize, 0);
+
+	if (ztest_object_init(zbt->zbt_zd, od, sizeof (od), B_TRUE) != 0)
+		fatal(0, "%s: out of space creating file", zb->zb_name);
+
+	zbt->zbt_object = od[0].od_object;
+}
+
+static void
+ztest_bench_write(ztest_bench_thread_t *zbt, uint64_t offset)
+{
+	ztest_ds_t *zd = zbt->zbt_zd;
+
+	if (ztest_write(zd, zbt->zbt_object, offset, zbt->zbt_bufsize,
+	    zbt->zbt_buf) != 0) {
+		fatal(0, "%s: out of space at offset %llu",
+		    zbt->zbt_bench->zb_name, (u_longlong_t)offset);
+	}
+}
+
+/*
+ * Random 8K writes, each followed by a zil_commit() as fsync() would do.
+ */
+/* ARGSUSED */
+static uint64_t
+ztest_bench_randwrite(ztest_bench_thread_t *zbt, uint64_t i)
+{
+	ztest_ds_t *zd = zbt->zbt_zd;
+	uint64_t blocks = zbt->zbt_span / zbt->zbt_bufsize;
+	uint64_t offset = (ztest_bench_random(zbt) % blocks) * zbt->zbt_bufsize;
+
+	(void) rw_rdlock(&zd->zd_zilog_lock);
+	ztest_bench_write(zbt, offset);
+	zil_commit(zd->zd_zilog, zbt->zbt_object);
+	(void) rw_unlock(&zd->zd_zilog_lock);
+
+	return (zbt->zbt_bufsize);
+}
+
+/*
+ * Sequential 1M asynchronous writes, wrapping around at the end of the
+ * thread's span.  The final txg sync is included in the elapsed time.
+ */
+static uint64_t
+ztest_bench_seqwrite(ztest_bench_thread_t *zbt, uint64_t i)
+{
+	ztest_ds_t *zd = zbt->zbt_zd;
+	uint64_t offset = (i * zbt->zbt_bufsize) % zbt->zbt_span;
+
+	(void) rw_rdlock(&zd->zd_zilog_lock);
+	ztest_bench_write(zbt, offset);
+	(void) rw_unlock(&zd->zd_zilog_lock);
+
+	return (zbt->zbt_bufsize);
+}
+
+/*
+ * Create an object, link it into the directory, then unlink and free it.
+ */
+static uint64_t
+ztest_bench_createunlink(ztest_bench_thread_t *zbt, uint64_t i)
+{
+	ztest_ds_t *zd = zbt->zbt_zd;
+	ztest_od_t od;
+
+	ztest_od_init(&od, zbt->zbt_id, zbt->zbt_bench->zb_name, i,
+	    DMU_OT_UINT64_OTHER, SPA_MINBLOCKSIZE, 0);
+
+	VERIFY(mutex_lock(&zd->zd_dirobj_lock) == 0);
+	if (ztest_create(zd, &od, 1) != 0 || ztest_remove(zd, &od, 1) != 0)
+		fatal(0, "%s: out of space", zbt->zbt_bench->zb_name);
+	VERIFY(mutex_unlock(&zd->zd_dirobj_lock) == 0);
+
+	return (0);
+}
+
+/*
+ * Dirty one block, then take and destroy a snapshot of the dataset.
+ */
+static uint64_t
+ztest_bench_snapchurn(ztest_bench_thread_t *zbt, uint64_t i)
+{
+	ztest_ds_t *zd = zbt->zbt_zd;
+	uint64_t offset = (i * zbt->zbt_bufsize) % zbt->zbt_span;
+
+	(void) rw_rdlock(&zd->zd_zilog_lock);
+	ztest_bench_write(zbt, offset);
+	(void) rw_unlock(&zd->zd_zilog_lock);
+
+	(void) rw_rdlock(&ztest_name_lock);
+	if (!ztest_snapshot_create(zd->zd_name, zbt->zbt_id))
+		fatal(0, "%s: out of space", zbt->zbt_bench->zb_name);
+	(void) ztest_snapshot_destroy(zd->zd_name, zbt->zbt_id);
+	(void) rw_unlock(&ztest_name_lock);
+
+	return (zbt->zbt_bufsize);
+}
+
+static void *
+ztest_bench_thread(void *arg)
+{
+	ztest_bench_thread_t *zbt = arg;
+	ztest_bench_t *zb = zbt->zbt_bench;
+
+	for (uint64_t i = 0; i < zbt->zbt_ops; i++) {
+		hrtime_t start = gethrtime();
+
+		zbt->zbt_bytes += zb->zb_op(zbt, i);
+		zbt->zbt_lat[i] = gethrtime() - start;
+	}
+
+	return (NULL);
+}
+
+static int
+ztest_bench_compare(const void *x1, const void *x2)
+{
+	const hrtime_t *a = x1;
+	const hrtime_t *b = x2;
+
+	if (*a < *b)
+		return (-1);
+	if (*a > *b)
+		return (1);
+	return (0);
+}
+
+/*
+ * Latency at the given percentile, in tenths of a percent, in usec.
+ */
+static double
+ztest_bench_lat(hrtime_t *lat, uint64_t count, int permille)
+{
+	return ((double)lat[(count - 1) * permille / 1000] /
+	    (NANOSEC / MICROSEC));
+}
+
+/*
+ * Run one workload on all threads and print its results as a single
+ * line of key=value pairs, so that runs can be collected and compared
+ * by scripts (e.g. when bisecting a performance regression).
+ */
+static void
+ztest_bench_run(ztest_bench_t *zb, uint64_t span)
+{
+	int threads = ztest_opts.zo_threads;
+	int datasets = MIN(threads, ztest_opts.zo_datasets);
+	uint64_t ops = ztest_opts.zo_bench_ops != 0 ?
+	    ztest_opts.zo_bench_ops : zb->zb_ops;
+	uint64_t per_thread = howmany(ops, threads);
+	uint64_t count = per_thread * threads;
+	uint64_t bytes = 0;
+	ztest_bench_thread_t *zbt;
+	thread_t *tid;
+	hrtime_t *lat;
+	hrtime_t elapsed;
+	double secs;
+
+	zbt = umem_zalloc(threads * sizeof (ztest_bench_thread_t),
+	    UMEM_NOFAIL);
+	tid = umem_zalloc(threads * sizeof (thread_t), UMEM_NOFAIL);
+	lat = umem_zalloc(count * sizeof (hrtime_t), UMEM_NOFAIL);
+
+	for (int t = 0; t < threads; t++) {
+		zbt[t].zbt_zd = &ztest_ds[t % datasets];
+		zbt[t].zbt_id = t;
+		zbt[t].zbt_span = P2ALIGN(span, MAX(zb->zb_iosize, 1));
+		zbt[t].zbt_seed = (t + 1) * 0x9e3779b97f4a7c15ULL;
+		zbt[t].zbt_ops = per_thread;
+		zbt[t].zbt_lat = &lat[t * per_thread];
+		zbt[t].zbt_bench = zb;
+		if (zb->zb_iosize != 0) {
+			zbt[t].zbt_bufsize = zb->zb_iosize;
+			zbt[t].zbt_buf = umem_alloc(zb->zb_iosize,
+			    UMEM_NOFAIL);
+			(void) memset(zbt[t].zbt_buf, 'a' + t % 5,
+			    zb->zb_iosize);
+		}
+		if (zb->zb_setup != NULL)
+			zb->zb_setup(&zbt[t]);
+	}
+
+	/*
+	 * Start from a quiesced pool so one workload's dirty data isn't
+	 * charged to the next.
+	 */
+	txg_wait_synced(spa_get_dsl(ztest_spa), 0);
+
+	elapsed = gethrtime();
+	for (int t = 0; t < threads; t++) {
+		VERIFY(thr_create(0, 0, ztest_bench_thread, &zbt[t],
+		    THR_BOUND, &tid[t]) == 0);
+	}
+	for (int t = 0; t < threads; t++)
+		VERIFY(thr_join(tid[t], NULL, NULL) == 0);
+	txg_wait_synced(spa_get_dsl(ztest_spa), 0);
+	elapsed = gethrtime() - elapsed;
+
+	for (int t = 0; t < threads; t++) {
+		bytes += zbt[t].zbt_bytes;
+		if (zbt[t].zbt_buf != NULL)
+			umem_free(zbt[t].zbt_buf, zbt[t].zbt_bufsize);
+	}
+
+	qsort(lat, count, sizeof (hrtime_t), ztest_bench_compare);
+	secs = (double)elapsed / NANOSEC;
+
+	(void) printf("ztest_bench workload=%s threads=%d datasets=%d "
+	    "ops=%llu bytes=%llu secs=%.3f ops_per_sec=%.1f "
+	    "mb_per_sec=%.2f lat_us_min=%.1f lat_us_p50=%.1f "
+	    "lat_us_p90=%.1f lat_us_p99=%.1f lat_us_p999=%.1f "
+	    "lat_us_max=%.1f\n",
+	    zb->zb_name, threads, datasets,
+	    (u_longlong_t)count, (u_longlong_t)bytes, secs,
+	    count / secs, bytes / secs / (1 << 20),
+	    ztest_bench_lat(lat, count, 0),
+	    ztest_bench_lat(lat, count, 500),
+	    ztest_bench_lat(lat, count, 900),
+	    ztest_bench_lat(lat, count, 990),
+	    ztest_bench_lat(lat, count, 999),
+	    ztest_bench_lat(lat, count, 1000));
+
+	umem_free(lat, count * sizeof (hrtime_t));
+	umem_free(tid, threads * sizeof (thread_t));
+	umem_free(zbt, threads * sizeof (ztest_bench_thread_t));
+}
+
+/*
+ * Open the pool and run each selected benchmark workload in turn.
+ * Unlike ztest_run(), nothing here is randomized: no fault injection,
+ * no kills, and no pool reconfiguration while the workloads run.
+ */
+static void
+ztest_bench(ztest_shared_t *zs)
+{
+	int datasets = MIN(ztest_opts.zo_threads, ztest_opts.zo_datasets);
+	uint64_t span;
+	spa_t *spa;
+
+	VERIFY(_mutex_init(&ztest_vdev_lock, USYNC_THREAD, NULL) == 0);
+	VERIFY(rwlock_init(&ztest_name_lock, USYNC_THREAD, NULL) == 0);
+
+	kernel_init(FREAD | FWRITE);
+	VERIFY0(spa_open(ztest_opts.zo_pool, &spa, FTAG));
+	ztest_spa = spa;
+
+	for (int d = 0; d < datasets; d++) {
+		if (ztest_dataset_open(d) != 0)
+			fatal(0, "out of space opening dataset %d", d);
+	}
+
+	/*
+	 * Give each thread a file span of 1/4 of its share of the pool,
+	 * leaving room for snapshots, metadata and the ZIL.
+	 */
+	span = metaslab_class_get_space(spa_normal_class(spa)) /
+	    (4 * ztest_opts.zo_threads);
+	span = MAX(P2ALIGN(span, 1 << 20), 1 << 20);
+
+	for (int b = 0; b < ZTEST_BENCHES; b++) {
+		if (ztest_opts.zo_bench & (1ULL << b))
+			ztest_bench_run(&ztest_bench_info[b], span);
+	}
+
+	for (int d = datasets - 1; d >= 0; d--)
+		ztest_dataset_close(d);
+
+	txg_wait_synced(spa_get_dsl(spa), 0);
+
+	zs->zs_alloc = metaslab_class_get_alloc(spa_normal_class(spa));
+	zs->zs_space = metaslab_class_get_space(spa_normal_class(spa));
+
+	spa_close(spa, FTAG);
+	kernel_fini();
+
+	(void) rwlock_destroy(&ztest_name_lock);
+	(void) _mutex_destroy(&ztest_vdev_lock);
+}
+
 /*
  * Kick off threads to run tests on all datasets in parallel.
  */
@@ -6102,12 +6522,20 @@ main(int argc, char **argv)
 	zs = ztest_shared;
 
 	if (fd_data_str) {
-		metaslab_gang_bang = ztest_opts.zo_metaslab_gang_bang;
-		metaslab_df_alloc_threshold =
-		    zs->zs_metaslab_df_alloc_threshold;
+		/*
+		 * Benchmarks run with the allocator's default tunables;
+		 * forced gang blocks would dominate the write workloads.
+		 */
+		if (ztest_opts.zo_bench == 0) {
+			metaslab_gang_bang = ztest_opts.zo_metaslab_gang_bang;
+			metaslab_df_alloc_threshold =
+			    zs->zs_metaslab_df_alloc_threshold;
+		}
 
 		if (zs->zs_do_init)
 			ztest_run_init();
+		else if (ztest_opts.zo_bench != 0)
+			ztest_bench(zs);
 		else
 			ztest_run(zs);
 		exit(0);
@@ -6140,6 +6568,16 @@ main(int argc, char **argv)
 	}
 	zs->zs_do_init = B_FALSE;
 
+	/*
+	 * A benchmark is a single uninterrupted pass of the newer ztest.
+	 */
+	if (ztest_opts.zo_bench != 0) {
+		VERIFY(!exec_child(cmd, NULL, B_FALSE, NULL));
+		ztest_run_zdb(ztest_opts.zo_pool);
+		umem_free(cmd, MAXNAMELEN);
+		return (0);
+	}
+
 	zs->zs_proc_start = gethrtime();
 	zs->zs_proc_stop = zs->zs_proc_start + ztest_opts.zo_time * NANOSEC;
 
@@ -42,6 +42,9 @@
  * Data should be aligned on 8-byte address boundaries for best performance.
  */
 
+BIG_CHUNK_TYPE (*big_mul_add_vec_impl)
+	(BIG_CHUNK_TYPE *r, BIG_CHUNK_TYPE *a, int len, BIG_CHUNK_TYPE digit) =
+	big_mul_add_vec;
 
 void
 big_mul_vec(BIG_CHUNK_TYPE *r, BIG_CHUNK_TYPE *a, int alen,
@@ -51,5 +54,5 @@ big_mul_vec(BIG_CHUNK_TYPE *r, BIG_CHUNK_TYPE *a, int alen,
 
 	r[alen] = big_mul_set_vec(r, a, alen, b[0]);
 	for (i = 1; i < blen; ++i)
-		r[alen + i] = big_mul_add_vec(r + i, a, alen, b[i]);
+		r[alen + i] = BIG_MUL_ADD_VEC(r + i, a, alen, b[i]);
 }
@@ -39,6 +39,11 @@ uint64_t
 big_mul_add_vec(uint64_t *r, uint64_t *a, int len, uint64_t digit)
 { return (0); }
 
+/* ARGSUSED */
+uint64_t
+big_mul_add_vec_adx(uint64_t *r, uint64_t *a, int len, uint64_t digit)
+{ return (0); }
+
 /* ARGSUSED */
 void
 big_sqr_vec(uint64_t *r, uint64_t *a, int len)
@@ -431,6 +436,77 @@ big_sqr_vec(uint64_t *r, uint64_t *a, int len)
 	SET_SIZE(big_mul_add_vec)
 
 
+/ ------------------------------------------------------------------------
+/
+/  big_mul_add_vec_adx is big_mul_add_vec for processors with the
+/  BMI2 and ADX extensions.  mulx leaves the flags alone, so adding
+/  in the high half of the previous product (adcx, carry in CF) and
+/  adding in r[i] (adox, carry in OF) form two independent carry
+/  chains.  Nothing between the first and the last add may touch
+/  either flag, so the loops count down with lea and test with jrcxz.
+/
+/ ------------------------------------------------------------------------
+
+/ uint64_t
+/ big_mul_add_vec_adx(uint64_t *r, uint64_t *a, int len, uint64_t digit)
+/
+	ENTRY(big_mul_add_vec_adx)
+	movl	%edx, %r8d		/ r8 = len
+	movq	%rcx, %rdx		/ mulx multiplies by %rdx
+	movq	%r8, %rcx
+	andl	$3, %ecx		/ rcx = len % 4
+	shrq	$2, %r8			/ r8 = len / 4
+	xorl	%r9d, %r9d		/ r9 = 0
+	xorl	%eax, %eax		/ cy = 0, CF = OF = 0
+	jrcxz	.L41
+
+.L40:					/ one digit at a time
+	mulxq	0(%rsi), %r10, %r11	/ (r11, r10) = a[0] * digit
+	adcxq	%rax, %r10		/ r10 += cy
+	adoxq	0(%rdi), %r10		/ r10 += r[0]
+	movq	%r10, 0(%rdi)		/ r[0] = r10
+	movq	%r11, %rax		/ cy = r11
+	leaq	8(%rsi), %rsi
+	leaq	8(%rdi), %rdi
+	leaq	-1(%rcx), %rcx
+	jrcxz	.L41
+	jmp	.L40
+
+.L41:
+	movq	%r8, %rcx
+	jrcxz	.L43
+
+.L42:					/ four digits at a time
+	mulxq	0(%rsi), %r10, %r11
+	adcxq	%rax, %r10
+	adoxq	0(%rdi), %r10
+	movq	%r10, 0(%rdi)
+	mulxq	8(%rsi), %r10, %rax
+	adcxq	%r11, %r10
+	adoxq	8(%rdi), %r10
+	movq	%r10, 8(%rdi)
+	mulxq	16(%rsi), %r10, %r11
+	adcxq	%rax, %r10
+	adoxq	16(%rdi), %r10
+	movq	%r10, 16(%rdi)
+	mulxq	24(%rsi), %r10, %rax
+	adcxq	%r11, %r10
+	adoxq	24(%rdi), %r10
+	movq	%r10, 24(%rdi)
+	leaq	32(%rsi), %rsi
+	leaq	32(%rdi), %rdi
+	leaq	-1(%rcx), %rcx
+	jrcxz	.L43
+	jmp	.L42
+
+.L43:
+	adcxq	%r9, %rax		/ cy += CF
+	adoxq	%r9, %rax		/ cy += OF
+	ret
+
+	SET_SIZE(big_mul_add_vec_adx)
+
+
 / void
 / big_sqr_vec(uint64_t *r, uint64_t *a, int len)
 
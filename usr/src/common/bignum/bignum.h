@@ -201,7 +201,21 @@ extern void (*big_sqr_vec_impl)
 #else /* ! HWCAP */
 
 #define	BIG_MUL_SET_VEC(r, a, len, digit) big_mul_set_vec(r, a, len, digit)
+#if defined(__amd64)
+/*
+ * big_mul_add_vec_impl becomes big_mul_add_vec_adx on processors
+ * with the BMI2 and ADX extensions; see bignum_use_adx().
+ */
+#define	BIG_MUL_ADD_VEC(r, a, len, digit) \
+	(*big_mul_add_vec_impl)(r, a, len, digit)
+
+extern BIG_CHUNK_TYPE (*big_mul_add_vec_impl)
+	(BIG_CHUNK_TYPE *r, BIG_CHUNK_TYPE *a, int len, BIG_CHUNK_TYPE digit);
+extern BIG_CHUNK_TYPE big_mul_add_vec_adx(BIG_CHUNK_TYPE *r,
+    BIG_CHUNK_TYPE *a, int len, BIG_CHUNK_TYPE d);
+#else
 #define	BIG_MUL_ADD_VEC(r, a, len, digit) big_mul_add_vec(r, a, len, digit)
+#endif
 #define	BIG_MUL_VEC(r, a, alen, b, blen) big_mul_vec(r, a, alen, b, blen)
 #define	BIG_SQR_VEC(r, a, len) big_sqr_vec(r, a, len)
 
@@ -206,6 +206,35 @@ bignum_on_intel(void)
 
 	return (cached_result);
 }
+
+/*
+ * Switch BIG_MUL_ADD_VEC() over to big_mul_add_vec_adx() if the processor
+ * has both BMI2 (for mulx) and ADX (for adcx and adox).  These are integer
+ * instructions, so the kernel needs no FPU state to use them.
+ */
+static void
+bignum_use_adx(void)
+{
+	static int	checked = 0;
+	int		adx;
+#ifndef _KERNEL
+	uint_t		ui[2] = { 0, 0 };
+#endif
+
+	if (checked)
+		return;
+#ifdef _KERNEL
+	adx = is_x86_feature(x86_featureset, X86FSET_BMI2) &&
+	    is_x86_feature(x86_featureset, X86FSET_ADX);
+#else
+	(void) getisax(ui, 2);
+	adx = (ui[1] & (AV_386_2_BMI2 | AV_386_2_ADX)) ==
+	    (AV_386_2_BMI2 | AV_386_2_ADX);
+#endif  /* _KERNEL */
+	if (adx)
+		big_mul_add_vec_impl = big_mul_add_vec_adx;
+	checked = 1;
+}
 #endif  /* __amd64 */
 
 
@@ -1675,6 +1704,7 @@ big_mont_mul(BIGNUM *ret, BIGNUM *a, BIGNUM *b, BIGNUM *n, BIG_CHUNK_TYPE n0)
 	BIG_CHUNK_TYPE	carry[BIGTMPSIZE];
 
 	if (big_cpu == BIG_CPU_UNKNOWN) {
+		bignum_use_adx();
 		big_cpu = 1 + bignum_on_intel();
 	}
 #endif	/* __amd64 */
@@ -315,6 +315,14 @@ static const elfcap_desc_t hw2_386[ELFCAP_NUM_HW2_386] = {
 	{						/* 0x00000002 */
 		AV_386_2_RDRAND, STRDESC("AV_386_2_RDRAND"),
 		STRDESC("RDRAND"), STRDESC("rdrand"),
+	},
+	{						/* 0x00000004 */
+		AV_386_2_BMI2, STRDESC("AV_386_2_BMI2"),
+		STRDESC("BMI2"), STRDESC("bmi2"),
+	},
+	{						/* 0x00000008 */
+		AV_386_2_ADX, STRDESC("AV_386_2_ADX"),
+		STRDESC("ADX"), STRDESC("adx"),
 	}
 };
 
@@ -336,6 +336,117 @@ nvp_buf_free(nvlist_t *nvl, nvpair_t *nvp)
 	nv_mem_free(priv, NVPAIR2I_NVP(nvp), nvsize);
 }
 
+/*
+ * An nvlist with unique names (NV_UNIQUE_NAME or NV_UNIQUE_NAME_TYPE)
+ * that grows to NVT_MIN_PAIRS nvpairs is indexed by a hash table of the
+ * names, so that lookups, and the remove that comes with every add,
+ * need not walk the whole list.  The table is a power of two in size
+ * and is doubled whenever the list grows past NVT_MAX_LOAD pairs per
+ * bucket.  If the table can't be allocated or grown, the list is simply
+ * searched, or the chains get longer.
+ */
+#define	NVT_MIN_PAIRS	16
+#define	NVT_MAX_LOAD	2
+
+#define	NVT_INDEXED(nvl)	\
+	((nvl)->nvl_nvflag & (NV_UNIQUE_NAME | NV_UNIQUE_NAME_TYPE))
+
+static uint32_t
+nvt_hash(const char *p)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*p != '\0') {
+		hash ^= (uchar_t)*p++;
+		hash *= 16777619U;
+	}
+	return (hash);
+}
+
+static i_nvp_t **
+nvt_bucket(nvpriv_t *priv, const char *name)
+{
+	return (&priv->nvp_hashtable[nvt_hash(name) &
+	    (priv->nvp_nbuckets - 1)]);
+}
+
+static void
+nvt_insert(nvpriv_t *priv, i_nvp_t *curr)
+{
+	i_nvp_t **bp = nvt_bucket(priv, NVP_NAME(&curr->nvi_nvp));
+
+	curr->nvi_hashnext = *bp;
+	*bp = curr;
+}
+
+static void
+nvt_remove(nvpriv_t *priv, i_nvp_t *curr)
+{
+	i_nvp_t **bp = nvt_bucket(priv, NVP_NAME(&curr->nvi_nvp));
+
+	while (*bp != curr) {
+		ASSERT(*bp != NULL);
+		bp = &(*bp)->nvi_hashnext;
+	}
+	*bp = curr->nvi_hashnext;
+	curr->nvi_hashnext = NULL;
+}
+
+/*
+ * (Re)build the index of an nvlist with nbuckets buckets.
+ */
+static void
+nvt_resize(nvpriv_t *priv, uint32_t nbuckets)
+{
+	i_nvp_t **tab;
+	i_nvp_t *curr;
+
+	if ((tab = nv_mem_zalloc(priv, nbuckets * sizeof (i_nvp_t *))) == NULL)
+		return;
+
+	if (priv->nvp_hashtable != NULL) {
+		nv_mem_free(priv, priv->nvp_hashtable,
+		    priv->nvp_nbuckets * sizeof (i_nvp_t *));
+	}
+	priv->nvp_hashtable = tab;
+	priv->nvp_nbuckets = nbuckets;
+
+	for (curr = priv->nvp_list; curr != NULL; curr = curr->nvi_next)
+		nvt_insert(priv, curr);
+}
+
+/*
+ * Find an nvpair by name, and by type unless that is DATA_TYPE_UNKNOWN.
+ */
+static nvpair_t *
+nvt_lookup(nvlist_t *nvl, const char *name, data_type_t type)
+{
+	nvpriv_t *priv = (nvpriv_t *)(uintptr_t)nvl->nvl_priv;
+	nvpair_t *nvp;
+	i_nvp_t *curr;
+
+	if (priv->nvp_hashtable != NULL) {
+		for (curr = *nvt_bucket(priv, name); curr != NULL;
+		    curr = curr->nvi_hashnext) {
+			nvp = &curr->nvi_nvp;
+
+			if (strcmp(name, NVP_NAME(nvp)) == 0 &&
+			    (type == DATA_TYPE_UNKNOWN || NVP_TYPE(nvp) == type))
+				return (nvp);
+		}
+		return (NULL);
+	}
+
+	for (curr = priv->nvp_list; curr != NULL; curr = curr->nvi_next) {
+		nvp = &curr->nvi_nvp;
+
+		if (strcmp(name, NVP_NAME(nvp)) == 0 &&
+		    (type == DATA_TYPE_UNKNOWN || NVP_TYPE(nvp) == type))
+			return (nvp);
+	}
+	return (NULL);
+}
+
 /*
  * nvp_buf_link - link a new nv pair into the nvlist.
  */
@@ -353,6 +464,16 @@ nvp_buf_link(nvlist_t *nvl, nvpair_t *nvp)
 		priv->nvp_last->nvi_next = curr;
 		priv->nvp_last = curr;
 	}
+	priv->nvp_nentries++;
+
+	if (priv->nvp_hashtable != NULL)
+		nvt_insert(priv, curr);
+
+	if (NVT_INDEXED(nvl) && priv->nvp_nentries >= NVT_MIN_PAIRS &&
+	    priv->nvp_nentries > priv->nvp_nbuckets * NVT_MAX_LOAD) {
+		nvt_resize(priv, priv->nvp_nbuckets == 0 ?
+		    NVT_MIN_PAIRS : priv->nvp_nbuckets * 2);
+	}
 }
 
 /*
@@ -370,6 +491,10 @@ nvp_buf_unlink(nvlist_t *nvl, nvpair_t *nvp)
 	if (priv->nvp_curr == curr)
 		priv->nvp_curr = curr->nvi_next;
 
+	if (priv->nvp_hashtable != NULL)
+		nvt_remove(priv, curr);
+	priv->nvp_nentries--;
+
 	if (curr == priv->nvp_list)
 		priv->nvp_list = curr->nvi_next;
 	else
@@ -574,6 +699,11 @@ nvlist_free(nvlist_t *nvl)
 		nvp_buf_free(nvl, nvp);
 	}
 
+	if (priv->nvp_hashtable != NULL) {
+		nv_mem_free(priv, priv->nvp_hashtable,
+		    priv->nvp_nbuckets * sizeof (i_nvp_t *));
+	}
+
 	if (!(priv->nvp_stat & NV_STAT_EMBEDDED))
 		nv_mem_free(priv, nvl, NV_ALIGN(sizeof (nvlist_t)));
 	else
@@ -640,13 +770,33 @@ int
 nvlist_remove_all(nvlist_t *nvl, const char *name)
 {
 	nvpriv_t *priv;
-	i_nvp_t *curr;
+	i_nvp_t *curr, **bp;
 	int error = ENOENT;
 
 	if (nvl == NULL || name == NULL ||
 	    (priv = (nvpriv_t *)(uintptr_t)nvl->nvl_priv) == NULL)
 		return (EINVAL);
 
+	if (priv->nvp_hashtable != NULL) {
+		bp = nvt_bucket(priv, name);
+		while ((curr = *bp) != NULL) {
+			nvpair_t *nvp = &curr->nvi_nvp;
+
+			if (strcmp(name, NVP_NAME(nvp)) != 0) {
+				bp = &curr->nvi_hashnext;
+				continue;
+			}
+
+			/* unlinking takes curr off the chain at *bp */
+			nvp_buf_unlink(nvl, nvp);
+			nvpair_free(nvp);
+			nvp_buf_free(nvl, nvp);
+
+			error = 0;
+		}
+		return (error);
+	}
+
 	curr = priv->nvp_list;
 	while (curr != NULL) {
 		nvpair_t *nvp = &curr->nvi_nvp;
@@ -673,14 +823,29 @@ nvlist_remove(nvlist_t *nvl, const char *name, data_type_t type)
 {
 	nvpriv_t *priv;
 	i_nvp_t *curr;
+	nvpair_t *nvp;
 
 	if (nvl == NULL || name == NULL ||
 	    (priv = (nvpriv_t *)(uintptr_t)nvl->nvl_priv) == NULL)
 		return (EINVAL);
 
+	/*
+	 * An indexed list has unique names, or names and types, so the
+	 * match the index finds is the only one.
+	 */
+	if (priv->nvp_hashtable != NULL) {
+		if ((nvp = nvt_lookup(nvl, name, type)) == NULL)
+			return (ENOENT);
+
+		nvp_buf_unlink(nvl, nvp);
+		nvpair_free(nvp);
+		nvp_buf_free(nvl, nvp);
+		return (0);
+	}
+
 	curr = priv->nvp_list;
 	while (curr != NULL) {
-		nvpair_t *nvp = &curr->nvi_nvp;
+		nvp = &curr->nvi_nvp;
 
 		if (strcmp(name, NVP_NAME(nvp)) == 0 && NVP_TYPE(nvp) == type) {
 			nvp_buf_unlink(nvl, nvp);
@@ -1324,23 +1489,16 @@ static int
 nvlist_lookup_common(nvlist_t *nvl, const char *name, data_type_t type,
     uint_t *nelem, void *data)
 {
-	nvpriv_t *priv;
 	nvpair_t *nvp;
-	i_nvp_t *curr;
 
-	if (name == NULL || nvl == NULL ||
-	    (priv = (nvpriv_t *)(uintptr_t)nvl->nvl_priv) == NULL)
+	if (name == NULL || nvl == NULL || nvl->nvl_priv == 0)
 		return (EINVAL);
 
 	if (!(nvl->nvl_nvflag & (NV_UNIQUE_NAME | NV_UNIQUE_NAME_TYPE)))
 		return (ENOTSUP);
 
-	for (curr = priv->nvp_list; curr != NULL; curr = curr->nvi_next) {
-		nvp = &curr->nvi_nvp;
-
-		if (strcmp(name, NVP_NAME(nvp)) == 0 && NVP_TYPE(nvp) == type)
-			return (nvpair_value_common(nvp, type, nelem, data));
-	}
+	if ((nvp = nvt_lookup(nvl, name, type)) != NULL)
+		return (nvpair_value_common(nvp, type, nelem, data));
 
 	return (ENOENT);
 }
@@ -1790,22 +1948,10 @@ int nvlist_lookup_nvpair_embedded_index(nvlist_t *nvl,
 boolean_t
 nvlist_exists(nvlist_t *nvl, const char *name)
 {
-	nvpriv_t *priv;
-	nvpair_t *nvp;
-	i_nvp_t *curr;
-
-	if (name == NULL || nvl == NULL ||
-	    (priv = (nvpriv_t *)(uintptr_t)nvl->nvl_priv) == NULL)
+	if (name == NULL || nvl == NULL || nvl->nvl_priv == 0)
 		return (B_FALSE);
 
-	for (curr = priv->nvp_list; curr != NULL; curr = curr->nvi_next) {
-		nvp = &curr->nvi_nvp;
-
-		if (strcmp(name, NVP_NAME(nvp)) == 0)
-			return (B_TRUE);
-	}
-
-	return (B_FALSE);
+	return (nvt_lookup(nvl, name, DATA_TYPE_UNKNOWN) != NULL);
 }
 
 int
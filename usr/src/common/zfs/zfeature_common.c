@@ -215,4 +215,26 @@ zpool_feature_init(void)
 	    "com.joyent:filesystem_limits", "filesystem_limits",
 	    "Filesystem and snapshot limits.", B_TRUE, B_FALSE, B_FALSE,
 	    filesystem_limits_deps);
+
+	static const spa_feature_t log_spacemap_deps[] = {
+	    SPA_FEATURE_SPACEMAP_HISTOGRAM,
+	    SPA_FEATURE_NONE
+	};
+	zfeature_register(SPA_FEATURE_LOG_SPACEMAP,
+	    "com.delphix:log_spacemap", "log_spacemap",
+	    "Log metaslab changes on a single spacemap and "
+	    "flush them periodically.", B_FALSE, B_FALSE, B_FALSE,
+	    log_spacemap_deps);
+	zfeature_register(SPA_FEATURE_WIDE_MICROZAP,
+	    "org.illumos:wide_microzap", "wide_microzap",
+	    "Micro ZAPs with room for names longer than 49 bytes.",
+	    B_FALSE, B_FALSE, B_FALSE, NULL);
+	zfeature_register(SPA_FEATURE_LARGE_DNODE,
+	    "org.zfsonlinux:large_dnode", "large_dnode",
+	    "Variable on-disk size of dnodes.",
+	    B_FALSE, B_FALSE, B_FALSE, NULL);
+	zfeature_register(SPA_FEATURE_EMBEDDED_DATA,
+	    "com.delphix:embedded_data", "embedded_data",
+	    "Blocks which compress very well use even less space.",
+	    B_FALSE, B_FALSE, B_TRUE, NULL);
 }
@@ -50,6 +50,10 @@ typedef enum spa_feature {
 	SPA_FEATURE_EXTENSIBLE_DATASET,
 	SPA_FEATURE_BOOKMARKS,
 	SPA_FEATURE_FS_SS_LIMIT,
+	SPA_FEATURE_LOG_SPACEMAP,
+	SPA_FEATURE_WIDE_MICROZAP,
+	SPA_FEATURE_LARGE_DNODE,
+	SPA_FEATURE_EMBEDDED_DATA,
 	SPA_FEATURES
 } spa_feature_t;
 
@@ -130,6 +130,7 @@
 #include <sys/byteorder.h>
 #include <sys/zio.h>
 #include <sys/spa.h>
+#include <zfs_fletcher.h>
 
 void
 fletcher_2_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
@@ -165,8 +166,19 @@ fletcher_2_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	ZIO_SET_CHECKSUM(zcp, a0, a1, b0, b1);
 }
 
-void
-fletcher_4_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+/*
+ * fletcher-4 is the default checksum, so it gets several implementations.
+ * The plain loop below has a serial dependency through a, b, c and d on
+ * every word.  The "superscalar" variants instead run two or four
+ * independent sets of sums over interleaved words (lane j takes words
+ * j, j + k, j + 2k, ...), which lets the CPU overlap the additions, and
+ * fold the lanes back into the serial sums at the end.  The folding is
+ * exact in 64-bit arithmetic, so every variant produces the same checksum
+ * as the plain loop.  zio_checksum_init() benchmarks the variants and
+ * selects the fastest one for fletcher_4_native() and fletcher_4_byteswap().
+ */
+static void
+fletcher_4_scalar_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
 	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
@@ -182,8 +194,8 @@ fletcher_4_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
-void
-fletcher_4_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+static void
+fletcher_4_scalar_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
 {
 	const uint32_t *ip = buf;
 	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
@@ -199,6 +211,202 @@ fletcher_4_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
 	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
 }
 
+/*
+ * Fold two lanes of sums into the serial sums and finish off the words
+ * that did not fill a whole stripe.
+ */
+static void
+fletcher_4_superscalar2_fini(const uint64_t *a, const uint64_t *b,
+    const uint64_t *c, const uint64_t *d, zio_cksum_t *zcp)
+{
+	ZIO_SET_CHECKSUM(zcp,
+	    a[0] + a[1],
+	    2 * b[0] + 2 * b[1] - a[1],
+	    4 * c[0] - b[0] + 4 * c[1] - 3 * b[1],
+	    8 * d[0] - 4 * c[0] + 8 * d[1] - 8 * c[1] + b[1]);
+}
+
+static void
+fletcher_4_superscalar4_fini(const uint64_t *a, const uint64_t *b,
+    const uint64_t *c, const uint64_t *d, zio_cksum_t *zcp)
+{
+	ZIO_SET_CHECKSUM(zcp,
+	    a[0] + a[1] + a[2] + a[3],
+	    0 - a[1] - 2 * a[2] - 3 * a[3] +
+	    4 * (b[0] + b[1] + b[2] + b[3]),
+	    a[2] + 3 * a[3] -
+	    6 * b[0] - 10 * b[1] - 14 * b[2] - 18 * b[3] +
+	    16 * (c[0] + c[1] + c[2] + c[3]),
+	    0 - a[3] +
+	    4 * b[0] + 10 * b[1] + 20 * b[2] + 34 * b[3] -
+	    48 * c[0] - 64 * c[1] - 80 * c[2] - 96 * c[3] +
+	    64 * (d[0] + d[1] + d[2] + d[3]));
+}
+
+static void
+fletcher_4_superscalar2_native(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	const uint32_t *ip = buf;
+	const uint32_t *ipend = ip + P2ALIGN(size / sizeof (uint32_t), 2);
+	uint64_t a[2], b[2], c[2], d[2];
+
+	a[0] = a[1] = b[0] = b[1] = c[0] = c[1] = d[0] = d[1] = 0;
+	for (; ip < ipend; ip += 2) {
+		a[0] += ip[0];
+		a[1] += ip[1];
+		b[0] += a[0];
+		b[1] += a[1];
+		c[0] += b[0];
+		c[1] += b[1];
+		d[0] += c[0];
+		d[1] += c[1];
+	}
+	fletcher_4_superscalar2_fini(a, b, c, d, zcp);
+	fletcher_4_incremental_native(ip,
+	    size - ((const char *)ip - (const char *)buf), zcp);
+}
+
+static void
+fletcher_4_superscalar2_byteswap(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	const uint32_t *ip = buf;
+	const uint32_t *ipend = ip + P2ALIGN(size / sizeof (uint32_t), 2);
+	uint64_t a[2], b[2], c[2], d[2];
+
+	a[0] = a[1] = b[0] = b[1] = c[0] = c[1] = d[0] = d[1] = 0;
+	for (; ip < ipend; ip += 2) {
+		a[0] += BSWAP_32(ip[0]);
+		a[1] += BSWAP_32(ip[1]);
+		b[0] += a[0];
+		b[1] += a[1];
+		c[0] += b[0];
+		c[1] += b[1];
+		d[0] += c[0];
+		d[1] += c[1];
+	}
+	fletcher_4_superscalar2_fini(a, b, c, d, zcp);
+	fletcher_4_incremental_byteswap(ip,
+	    size - ((const char *)ip - (const char *)buf), zcp);
+}
+
+static void
+fletcher_4_superscalar4_native(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	const uint32_t *ip = buf;
+	const uint32_t *ipend = ip + P2ALIGN(size / sizeof (uint32_t), 4);
+	uint64_t a[4], b[4], c[4], d[4];
+	int j;
+
+	for (j = 0; j < 4; j++)
+		a[j] = b[j] = c[j] = d[j] = 0;
+	for (; ip < ipend; ip += 4) {
+		a[0] += ip[0];
+		a[1] += ip[1];
+		a[2] += ip[2];
+		a[3] += ip[3];
+		b[0] += a[0];
+		b[1] += a[1];
+		b[2] += a[2];
+		b[3] += a[3];
+		c[0] += b[0];
+		c[1] += b[1];
+		c[2] += b[2];
+		c[3] += b[3];
+		d[0] += c[0];
+		d[1] += c[1];
+		d[2] += c[2];
+		d[3] += c[3];
+	}
+	fletcher_4_superscalar4_fini(a, b, c, d, zcp);
+	fletcher_4_incremental_native(ip,
+	    size - ((const char *)ip - (const char *)buf), zcp);
+}
+
+static void
+fletcher_4_superscalar4_byteswap(const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	const uint32_t *ip = buf;
+	const uint32_t *ipend = ip + P2ALIGN(size / sizeof (uint32_t), 4);
+	uint64_t a[4], b[4], c[4], d[4];
+	int j;
+
+	for (j = 0; j < 4; j++)
+		a[j] = b[j] = c[j] = d[j] = 0;
+	for (; ip < ipend; ip += 4) {
+		a[0] += BSWAP_32(ip[0]);
+		a[1] += BSWAP_32(ip[1]);
+		a[2] += BSWAP_32(ip[2]);
+		a[3] += BSWAP_32(ip[3]);
+		b[0] += a[0];
+		b[1] += a[1];
+		b[2] += a[2];
+		b[3] += a[3];
+		c[0] += b[0];
+		c[1] += b[1];
+		c[2] += b[2];
+		c[3] += b[3];
+		d[0] += c[0];
+		d[1] += c[1];
+		d[2] += c[2];
+		d[3] += c[3];
+	}
+	fletcher_4_superscalar4_fini(a, b, c, d, zcp);
+	fletcher_4_incremental_byteswap(ip,
+	    size - ((const char *)ip - (const char *)buf), zcp);
+}
+
+static const fletcher_4_ops_t fletcher_4_scalar_ops = {
+	fletcher_4_scalar_native, fletcher_4_scalar_byteswap, "scalar"
+};
+
+static const fletcher_4_ops_t fletcher_4_superscalar2_ops = {
+	fletcher_4_superscalar2_native, fletcher_4_superscalar2_byteswap,
+	"superscalar2"
+};
+
+static const fletcher_4_ops_t fletcher_4_superscalar4_ops = {
+	fletcher_4_superscalar4_native, fletcher_4_superscalar4_byteswap,
+	"superscalar4"
+};
+
+/* The first entry is the reference implementation. */
+const fletcher_4_ops_t *fletcher_4_impls[] = {
+	&fletcher_4_scalar_ops,
+	&fletcher_4_superscalar2_ops,
+	&fletcher_4_superscalar4_ops,
+	NULL
+};
+
+static const fletcher_4_ops_t *fletcher_4_impl = &fletcher_4_scalar_ops;
+
+void
+fletcher_4_impl_set(const fletcher_4_ops_t *ops)
+{
+	fletcher_4_impl = ops;
+}
+
+const fletcher_4_ops_t *
+fletcher_4_impl_get(void)
+{
+	return (fletcher_4_impl);
+}
+
+void
+fletcher_4_native(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_impl->fo_native(buf, size, zcp);
+}
+
+void
+fletcher_4_byteswap(const void *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_impl->fo_byteswap(buf, size, zcp);
+}
+
 void
 fletcher_4_incremental_native(const void *buf, uint64_t size,
     zio_cksum_t *zcp)
@@ -46,6 +46,20 @@ void fletcher_4_incremental_native(const void *, uint64_t,
 void fletcher_4_incremental_byteswap(const void *, uint64_t,
     zio_cksum_t *);
 
+/*
+ * fletcher-4 implementations; see zfs_fletcher.c
+ */
+
+typedef struct fletcher_4_ops {
+	void (*fo_native)(const void *, uint64_t, zio_cksum_t *);
+	void (*fo_byteswap)(const void *, uint64_t, zio_cksum_t *);
+	const char *fo_name;
+} fletcher_4_ops_t;
+
+extern const fletcher_4_ops_t *fletcher_4_impls[];
+void fletcher_4_impl_set(const fletcher_4_ops_t *);
+const fletcher_4_ops_t *fletcher_4_impl_get(void);
+
 #ifdef	__cplusplus
 }
 #endif
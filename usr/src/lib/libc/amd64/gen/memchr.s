@@ -25,30 +25,18 @@
 
 	.file	"memchr.s"
 
-/
-/ memchr(sptr, c1, n)
-/
-/ Returns the pointer in sptr at which the character c1 appears; 
-/ or NULL if not found in chars; doesn't stop at \0.
-/
-/ Fast assembly language version of the following C-program memchr
-/ which represents the `standard' for the C-library.
-/ 
-/	void *
-/	memchr(const void *sptr, int c1, size_t n)
-/	{
-/		if (n != 0) {
-/			unsigned char	c = (unsigned char)c1; 
-/			const unsigned char	*sp = sptr; 
-/
-/			do {
-/				if (*sp++ == c)
-/					return ((void *)--sp); 
-/			} while (--n != 0); 
-/		}
-/		return (NULL); 
-/	}
-/
+/*
+ * memchr(sptr, c1, n)
+ *
+ * Returns the pointer in sptr at which the character c1 appears;
+ * or NULL if not found in chars; doesn't stop at \0.
+ *
+ * Every amd64 processor has SSE2, so this compares 16 bytes at a time.
+ * The loads are all 16 byte aligned and so never cross a page boundary;
+ * the first rounds sptr down and throws away the matches before it, and
+ * a match at or beyond sptr + n is not one.  A block is only read if
+ * some of it lies within sptr[0 .. n - 1].
+ */
 
 #include "SYS.h"
 
@@ -56,64 +44,47 @@
 	.align	4
 
 	ENTRY(memchr) /* (void *s, uchar_t c, size_t n) */
-	movl	%esi, %eax	/ move "c" to %eax
-	cmpq	$4, %rdx	/ if number of bytes < 4
-	jb	.L1		/ goto .L1
-	testq	$3, %rdi	/ if %rdi not word aligned
-	jnz	.L2		/ goto .L2
-	.align	4
-.L3:
-	movl	(%rdi), %ecx	/ move 1 word from (%rdi) to %ecx
-	cmpb	%cl, %al	/ if the first byte is %al
-	je	.L4		/ goto .L4 (found)
-	cmpb	%ch, %al	/ if the second byte is %al
-	je	.L5		/ goto .L5 (found)
-	shrl	$16, %ecx	/ right shift 16-bit
-	cmpb	%cl, %al	/ if the third byte is %al
-	je	.L6		/ goto .L6 (found)
-	cmpb	%ch, %al	/ if the fourth is %al
-	je	.L7		/ goto .L7 (found)
-	subq	$4, %rdx	/ decrement number of bytes by 4
-	addq	$4, %rdi	/ next word
-	cmpq	$4, %rdx	/ if number of bytes >= 4
-	jae	.L3		/ goto .L3
-.L1:
-	cmpq	$0, %rdx	/ if number of bytes == 0
-	jz	.L8		/ goto .L8 (not found)
-	cmpb	(%rdi), %al	/ if a byte in (%rdi) is %al
-	je	.L4		/ goto .L4 (found)
-	decq	%rdx		/ decrement number of bytes by 1
-	incq	%rdi		/ next byte
-	jmp	.L1		/ goto .L1
-	.align	4
-.L8:	
-	xorl	%eax, %eax	/ not found
-	ret			/ return (0)
-	.align	4
-.L2:
-	cmpq	$0, %rdx	/ if number of bytes == 0
-	jz	.L8		/ goto .L8 (not found)
-	cmpb	(%rdi), %al	/ if a byte in (%rdi) is %al
-	je	.L4		/ goto .L4 (found)
-	incq	%rdi		/ next byte
-	decq	%rdx		/ decrement number of bytes by 1
-	testq	$3, %rdi	/ if %rdi not word aligned
-	jnz	.L2		/ goto .L2
-	cmpq	$4, %rdx	/ if number of bytes >= 4
-	jae	.L3		/ goto .L3 (word aligned)
-	jmp	.L1		/ goto .L1
-	.align	4
-.L7:
-	/ found at the fourth byte	
-	incq	%rdi
-.L6:
-	/ found at the third byte
-	incq	%rdi
-.L5:
-	/ found at the second byte	
-	incq	%rdi
-.L4:
-	/ found at the first byte	
-	movq	%rdi,%rax
-	ret			 
+	test	%rdx, %rdx		/* nothing to search? */
+	jz	.notfound
+	movd	%esi, %xmm1		/* c in all 16 bytes of %xmm1 */
+	punpcklbw %xmm1, %xmm1
+	punpcklwd %xmm1, %xmm1
+	pshufd	$0, %xmm1, %xmm1
+
+	mov	%rdi, %rcx
+	and	$15, %rcx		/* bytes of the block before s */
+	and	$-16, %rdi		/* round down to 16 byte boundary */
+	add	%rcx, %rdx		/* %rdx counts from the block start */
+	jnc	.first
+	mov	$-1, %rdx		/* n was "search everything" */
+.first:
+	movdqa	(%rdi), %xmm0
+	pcmpeqb	%xmm1, %xmm0
+	pmovmskb %xmm0, %eax
+	shr	%cl, %eax		/* drop matches before s */
+	shl	%cl, %eax
+
+	.p2align 4
+.check:
+	test	%eax, %eax		/* a match in this block? */
+	jnz	.found
+	sub	$16, %rdx		/* anything left past this block? */
+	jbe	.notfound
+	add	$16, %rdi
+	movdqa	(%rdi), %xmm0
+	pcmpeqb	%xmm1, %xmm0
+	pmovmskb %xmm0, %eax
+	jmp	.check
+
+	.p2align 4
+.found:
+	bsf	%eax, %eax		/* index of first match in block */
+	cmp	%rax, %rdx		/* beyond the end of the buffer? */
+	jbe	.notfound
+	add	%rdi, %rax
+	ret
+
+.notfound:
+	xorl	%eax, %eax		/* not found */
+	ret				/* return (0) */
 	SET_SIZE(memchr)
@@ -161,6 +161,36 @@ get_amd_cache_info(void)
 		    largest_level_cache);
 }
 
+/*
+ * get_sse_level()
+ *	Find what SSE versions the processor supports.  The cpuid leaf 1
+ *	feature bits are the same for every vendor.
+ */
+static int
+get_sse_level(void)
+{
+	int use_sse = NO_SSE;
+	struct cpuid_values cpuid_info;
+
+	__libc_get_cpuid(1, &cpuid_info, 0);
+	if (cpuid_info.ecx & CPUID_INTC_ECX_SSE4_2) {
+		use_sse |= USE_SSE4_2;
+	}
+	if (cpuid_info.ecx & CPUID_INTC_ECX_SSE4_1) {
+		use_sse |= USE_SSE4_1;
+	}
+	if (cpuid_info.ecx & CPUID_INTC_ECX_SSSE3) {
+		use_sse |= USE_SSSE3;
+	}
+	if (cpuid_info.ecx & CPUID_INTC_ECX_SSE3) {
+		use_sse |= USE_SSE3;
+	}
+	if (cpuid_info.edx & CPUID_INTC_EDX_SSE2) {
+		use_sse |= USE_SSE2;
+	}
+	return (use_sse);
+}
+
 /*
  * proc64_id()
  *	Determine cache and SSE level to use for memops and strops specific to
@@ -169,7 +199,6 @@ get_amd_cache_info(void)
 void
 __proc64id(void)
 {
-	int use_sse = NO_SSE;
 	struct cpuid_values cpuid_info;
 
 	__libc_get_cpuid(0, &cpuid_info, 0);
@@ -181,6 +210,13 @@ __proc64id(void)
 	    (cpuid_info.edx == 0x69746e65) && /* enti */
 	    (cpuid_info.ecx == 0x444d4163)) { /* cAMD */
 		get_amd_cache_info();
+
+		/*
+		 * Let the mem* and str* routines use the SSE paths here too,
+		 * leaving out USE_BSF: bsf is slow on the older parts, and
+		 * those routines have a tail that does without it.
+		 */
+		__intel_set_memops_method(get_sse_level());
 		return;
 	}
 
@@ -191,8 +227,10 @@ __proc64id(void)
 	    (cpuid_info.edx != 0x49656e69) || /* ineI */
 	    (cpuid_info.ecx != 0x6c65746e)) { /* ntel */
 		/*
-		 * Not Intel - use defaults.
+		 * Not Intel - use the default cache sizes, but every amd64
+		 * processor has at least SSE2.
 		 */
+		__intel_set_memops_method(get_sse_level());
 		return;
 	}
 
@@ -207,31 +245,11 @@ __proc64id(void)
 	if (cpuid_info.eax >= 4) {
 		get_intel_cache_info();
 
-		/*
-		 * Check what SSE versions are supported.
-		 */
-		__libc_get_cpuid(1, &cpuid_info, 0);
-		if (cpuid_info.ecx & CPUID_INTC_ECX_SSE4_2) {
-			use_sse |= USE_SSE4_2;
-		}
-		if (cpuid_info.ecx & CPUID_INTC_ECX_SSE4_1) {
-			use_sse |= USE_SSE4_1;
-		}
-		if (cpuid_info.ecx & CPUID_INTC_ECX_SSSE3) {
-			use_sse |= USE_SSSE3;
-		}
-		if (cpuid_info.ecx & CPUID_INTC_ECX_SSE3) {
-			use_sse |= USE_SSE3;
-		}
-		if (cpuid_info.edx & CPUID_INTC_EDX_SSE2) {
-			use_sse |= USE_SSE2;
-		}
-		use_sse |= USE_BSF;
-		__intel_set_memops_method(use_sse);
+		__intel_set_memops_method(get_sse_level() | USE_BSF);
 	} else {
 		__set_cache_sizes(INTEL_DFLT_L1_CACHE_SIZE,
 		    INTEL_DFLT_L2_CACHE_SIZE,
 		    INTEL_DFLT_LARGEST_CACHE_SIZE);
-		__intel_set_memops_method(use_sse);
+		__intel_set_memops_method(NO_SSE);
 	}
 }
@@ -25,46 +25,61 @@
 
 	.file	"strchr.s"
 
+/*
+ * strchr(sp, c)
+ *
+ * Returns the pointer to the first occurrence of c in the string sp, or
+ * NULL if there is none; the terminating null is part of the string.
+ *
+ * Each 16 byte block is compared against both c and the null with SSE2.
+ * The first byte that is either ends the search, and it is a match only
+ * if it is c.  The loads are 16 byte aligned, so they never touch a page
+ * the string does not reach.
+ */
+
 #include "SYS.h"
 
 	ENTRY(strchr)		/* (char *, char) */
-.loop:
-	movb	(%rdi),%dl	/ %dl = byte of string
-	cmpb	%sil,%dl	/ find it?
-	je	.found		/ yes
-	testb	%dl,%dl		/ is it null?
-	je	.notfound
+	movd	%esi, %xmm1		/* c in all 16 bytes of %xmm1 */
+	punpcklbw %xmm1, %xmm1
+	punpcklwd %xmm1, %xmm1
+	pshufd	$0, %xmm1, %xmm1
+	pxor	%xmm2, %xmm2		/* 16 null chars */
 
-	movb	1(%rdi),%dl	/ %dl = byte of string
-	cmpb	%sil,%dl	/ find it?
-	je	.found1		/ yes
-	testb	%dl,%dl		/ is it null?
-	je	.notfound
+	mov	%rdi, %rcx
+	and	$15, %rcx		/* bytes of the block before sp */
+	and	$-16, %rdi		/* round down to 16 byte boundary */
+	movdqa	(%rdi), %xmm0
+	movdqa	%xmm0, %xmm3
+	pcmpeqb	%xmm1, %xmm0		/* look for c */
+	pcmpeqb	%xmm2, %xmm3		/* and for the null */
+	por	%xmm3, %xmm0
+	pmovmskb %xmm0, %eax
+	shr	%cl, %eax		/* drop bytes before sp */
+	shl	%cl, %eax
 
-	movb	2(%rdi),%dl	/ %dl = byte of string
-	cmpb	%sil,%dl	/ find it?
-	je	.found2		/ yes
-	testb	%dl,%dl		/ is it null?
-	je	.notfound
+	.p2align 4
+.check:
+	test	%eax, %eax		/* c or null in this block? */
+	jnz	.found
+	add	$16, %rdi
+	movdqa	(%rdi), %xmm0
+	movdqa	%xmm0, %xmm3
+	pcmpeqb	%xmm1, %xmm0
+	pcmpeqb	%xmm2, %xmm3
+	por	%xmm3, %xmm0
+	pmovmskb %xmm0, %eax
+	jmp	.check
 
-	movb	3(%rdi),%dl	/ %dl = byte of string
-	cmpb	%sil,%dl	/ find it?
-	je	.found3		/ yes
-	addq	$4,%rdi
-	testb	%dl,%dl		/ is it null?
-	jne	.loop
-
-.notfound:
-	xorl	%eax,%eax	/ %rax = NULL
+	.p2align 4
+.found:
+	bsf	%eax, %eax		/* first c or null */
+	add	%rdi, %rax
+	cmpb	(%rax), %sil		/* is it c? */
+	jne	.notfound
 	ret
 
-.found3:
-	incq	%rdi
-.found2:
-	incq	%rdi
-.found1:
-	incq	%rdi
-.found:
-	movq	%rdi,%rax
+.notfound:
+	xorl	%eax,%eax	/* %rax = NULL */
 	ret
 	SET_SIZE(strchr)
@@ -39,6 +39,7 @@
 #include <thread.h>
 #include <synch.h>
 #include <errno.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include "stdiom.h"
 #include "mse.h"
@@ -46,7 +47,8 @@
 size_t
 fread(void *ptr, size_t size, size_t count, FILE *iop)
 {
-	ssize_t s;
+	ssize_t s, n;
+	ssize_t bufsz;
 	int c;
 	char *dptr = (char *)ptr;
 	rmutex_t *lk;
@@ -84,6 +86,31 @@ fread(void *ptr, size_t size, size_t count, FILE *iop)
 				dptr += iop->_cnt;
 				s -= iop->_cnt;
 			}
+			/*
+			 * If what is left would fill the buffer anyway,
+			 * read whole buffers' worth of it straight into
+			 * the caller's memory rather than copying it
+			 * through the buffer.
+			 */
+			if (iop->_base != NULL && (iop->_flag & _IOREAD) &&
+			    s >= (bufsz = _bufend(iop) - iop->_base)) {
+				iop->_ptr = iop->_base;
+				iop->_cnt = 0;
+				if (iop->_flag & (_IONBF | _IOLBF))
+					_flushlbf();
+				n = read(GET_FD(iop), dptr,
+				    (size_t)(s - s % bufsz));
+				if (n > 0) {
+					dptr += n;
+					s -= n;
+					continue;
+				}
+				if (n == 0)
+					iop->_flag |= _IOEOF;
+				else if (!cancel_active())
+					iop->_flag |= _IOERR;
+				break;
+			}
 			/*
 			 * filbuf clobbers _cnt & _ptr,
 			 * so don't waste time setting them.
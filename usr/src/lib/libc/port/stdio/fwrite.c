@@ -141,6 +141,25 @@ _fwrite_unlocked(const void *ptr, size_t size, size_t count, FILE *iop)
 		return (written / size);
 	} else while (s > 0) {
 		if (iop->_cnt < s) {
+			ssize_t bufsz = _bufend(iop) - iop->_base;
+
+			/*
+			 * With the buffer empty, write whole buffers' worth
+			 * of the rest straight from the caller's memory
+			 * rather than copying it through the buffer.
+			 */
+			if (iop->_ptr == iop->_base && s >= bufsz) {
+				n = write(GET_FD(iop), dptr,
+				    (size_t)(s - s % bufsz));
+				if (n <= 0) {
+					if (!cancel_active())
+						iop->_flag |= _IOERR;
+					break;
+				}
+				dptr += n;
+				s -= n;
+				continue;
+			}
 			if (iop->_cnt > 0) {
 				(void) memcpy(iop->_ptr, (void *)dptr,
 				    iop->_cnt);
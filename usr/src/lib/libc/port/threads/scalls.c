@@ -1071,6 +1071,17 @@ _so_recvmsg(int sock, struct msghdr *msg, int flags)
 	PERFORM(__so_recvmsg(sock, msg, flags))
 }
 
+int
+_so_recvmmsg(int sock, struct mmsghdr *vec, unsigned int vlen, int flags,
+    struct timespec *timeout)
+{
+	extern int __so_recvmmsg(int, struct mmsghdr *, unsigned int, int,
+	    struct timespec *);
+	int rv;
+
+	PERFORM(__so_recvmmsg(sock, vec, vlen, flags, timeout))
+}
+
 int
 _so_send(int sock, const void *buf, size_t len, int flags)
 {
@@ -1089,6 +1100,15 @@ _so_sendmsg(int sock, const struct msghdr *msg, int flags)
 	PERFORM(__so_sendmsg(sock, msg, flags))
 }
 
+int
+_so_sendmmsg(int sock, struct mmsghdr *vec, unsigned int vlen, int flags)
+{
+	extern int __so_sendmmsg(int, struct mmsghdr *, unsigned int, int);
+	int rv;
+
+	PERFORM(__so_sendmmsg(sock, vec, vlen, flags))
+}
+
 int
 _so_sendto(int sock, const void *buf, size_t len, int flags,
     const struct sockaddr *addr, int *addrlen)
@@ -404,6 +404,29 @@ spinners_decr(volatile uint32_t *lockword)
 	return (new);
 }
 
+/*
+ * Set the waiters byte in the mutex lock word, but only if the lock
+ * byte is also set.  Return 0 on success, -1 if the lock is not held.
+ * On success the holder is bound to see the waiters byte when it
+ * clears the lock byte, so anyone the caller puts on the mutex sleep
+ * queue, under the queue lock, will be waked by the release.
+ */
+static int
+set_waiters_if_locked(volatile uint32_t *lockword)
+{
+	uint32_t old;
+	uint32_t new;
+
+	do {
+		old = *lockword;
+		if ((old & LOCKMASK) == 0)
+			return (-1);
+		new = old | WAITERMASK;
+	} while (atomic_cas_32(lockword, old, new) != old);
+
+	return (0);
+}
+
 /*
  * Non-preemptive spin locks.  Used by queue_lock().
  * No lock statistics are gathered for these locks.
@@ -3676,9 +3699,10 @@ cond_signal(cond_t *cvp)
 	/*
 	 * Move someone from the condvar sleep queue to the mutex sleep
 	 * queue for the mutex that he will acquire on being waked up.
-	 * We can do this only if we own the mutex he will acquire.
-	 * If we do not own the mutex, or if his ul_cv_wake flag
-	 * is set, just dequeue and unpark him.
+	 * We can do this only if the mutex he will acquire is held,
+	 * by us or by anyone else, since only then is a release of the
+	 * mutex certain to wake him.  If it is not held, or if his
+	 * ul_cv_wake flag is set, just dequeue and unpark him.
 	 */
 	qp = queue_lock(cvp, CV);
 	ulwpp = queue_slot(qp, &prev, &more);
@@ -3708,7 +3732,16 @@ cond_signal(cond_t *cvp)
 	ulwp->ul_cvmutex = NULL;
 	ASSERT(mp != NULL);
 
-	if (ulwp->ul_cv_wake || !MUTEX_OWNED(mp, self)) {
+	mqp = NULL;
+	if (!ulwp->ul_cv_wake) {
+		mqp = queue_lock(mp, MX);
+		if (!MUTEX_OWNED(mp, self) &&
+		    set_waiters_if_locked(&mp->mutex_lockword) != 0) {
+			queue_unlock(mqp);
+			mqp = NULL;
+		}
+	}
+	if (mqp == NULL) {
 		/* just wake him up */
 		lwpid = ulwp->ul_lwpid;
 		no_preempt(self);
@@ -3719,7 +3752,6 @@ cond_signal(cond_t *cvp)
 		preempt(self);
 	} else {
 		/* move him to the mutex queue */
-		mqp = queue_lock(mp, MX);
 		enqueue(mqp, ulwp, 0);
 		mp->mutex_waiters = 1;
 		queue_unlock(mqp);
@@ -3792,6 +3824,7 @@ cond_broadcast(cond_t *cvp)
 	mutex_t *mp_cache = NULL;
 	queue_head_t *mqp = NULL;
 	ulwp_t *ulwp;
+	int woken = 0;
 	int nlwpid = 0;
 	int maxlwps = MAXLWPS;
 	lwpid_t buffer[MAXLWPS];
@@ -3809,9 +3842,12 @@ cond_broadcast(cond_t *cvp)
 	/*
 	 * Move everyone from the condvar sleep queue to the mutex sleep
 	 * queue for the mutex that they will acquire on being waked up.
-	 * We can do this only if we own the mutex they will acquire.
-	 * If we do not own the mutex, or if their ul_cv_wake flag
-	 * is set, just dequeue and unpark them.
+	 * We can do this if the mutex they will acquire is held, by us
+	 * or by anyone else.  If it is not held we wake the first of its
+	 * waiters and move the rest: he will acquire the mutex, and his
+	 * release of it will wake the next.  Robust mutexes are left out
+	 * of this since his acquisition may fail.  Anyone whose
+	 * ul_cv_wake flag is set is just dequeued and unparked.
 	 *
 	 * We keep track of lwpids that are to be unparked in lwpid[].
 	 * __lwp_unpark_all() is called to unpark all of them after
@@ -3836,24 +3872,30 @@ cond_broadcast(cond_t *cvp)
 		mp = ulwp->ul_cvmutex;		/* his mutex */
 		ulwp->ul_cvmutex = NULL;
 		ASSERT(mp != NULL);
-		if (ulwp->ul_cv_wake || !MUTEX_OWNED(mp, self)) {
-			/* just wake him up */
-			ulwp->ul_sleepq = NULL;
-			ulwp->ul_wchan = NULL;
-			if (nlwpid == maxlwps)
-				lwpid = alloc_lwpids(lwpid, &nlwpid, &maxlwps);
-			lwpid[nlwpid++] = ulwp->ul_lwpid;
-		} else {
-			/* move him to the mutex queue */
+		if (!ulwp->ul_cv_wake) {
 			if (mp != mp_cache) {
 				mp_cache = mp;
+				woken = 0;
 				if (mqp != NULL)
 					queue_unlock(mqp);
 				mqp = queue_lock(mp, MX);
 			}
-			enqueue(mqp, ulwp, 0);
-			mp->mutex_waiters = 1;
+			if (MUTEX_OWNED(mp, self) ||
+			    (woken && !(mp->mutex_type & LOCK_ROBUST)) ||
+			    set_waiters_if_locked(&mp->mutex_lockword) == 0) {
+				/* move him to the mutex queue */
+				enqueue(mqp, ulwp, 0);
+				mp->mutex_waiters = 1;
+				continue;
+			}
+			woken = 1;
 		}
+		/* just wake him up */
+		ulwp->ul_sleepq = NULL;
+		ulwp->ul_wchan = NULL;
+		if (nlwpid == maxlwps)
+			lwpid = alloc_lwpids(lwpid, &nlwpid, &maxlwps);
+		lwpid[nlwpid++] = ulwp->ul_lwpid;
 	}
 	if (mqp != NULL)
 		queue_unlock(mqp);
@@ -39,6 +39,7 @@
 #include <limits.h>
 
 #define	DTRACE_AHASHSIZE	32779		/* big 'ol prime */
+#define	DTRACE_AHASHLOAD	2		/* mean chain length limit */
 
 /*
  * Because qsort(3C) does not allow an argument to be passed to a comparison
@@ -428,6 +429,38 @@ dt_aggregate_aggvarid(dt_ahashent_t *ent)
 }
 
 
+/*
+ * Large aggregations would otherwise leave every snapshot walking long hash
+ * chains; once the chains average DTRACE_AHASHLOAD elements, we double the
+ * size of the table.  If we can't, we carry on with the one we have.
+ */
+static void
+dt_aggregate_hashgrow(dt_ahash_t *hash)
+{
+	size_t size = hash->dtah_size * 2 + 1, ndx;
+	dt_ahashent_t **tab, *h;
+
+	if ((tab = malloc(size * sizeof (dt_ahashent_t *))) == NULL)
+		return;
+
+	bzero(tab, size * sizeof (dt_ahashent_t *));
+
+	for (h = hash->dtah_all; h != NULL; h = h->dtahe_nextall) {
+		ndx = h->dtahe_hashval % size;
+
+		if (tab[ndx] != NULL)
+			tab[ndx]->dtahe_prev = h;
+
+		h->dtahe_prev = NULL;
+		h->dtahe_next = tab[ndx];
+		tab[ndx] = h;
+	}
+
+	free(hash->dtah_hash);
+	hash->dtah_hash = tab;
+	hash->dtah_size = size;
+}
+
 static int
 dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 {
@@ -535,10 +568,21 @@ dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 				break;
 			}
 
-			for (i = 0; i < rec->dtrd_size; i++)
-				hashval += addr[roffs + i];
+			/*
+			 * This is Bob Jenkins' "One-at-a-time" hash, as used
+			 * by the kernel for the same keys.
+			 */
+			for (i = 0; i < rec->dtrd_size; i++) {
+				hashval += (uchar_t)addr[roffs + i];
+				hashval += (hashval << 10);
+				hashval ^= (hashval >> 6);
+			}
 		}
 
+		hashval += (hashval << 3);
+		hashval ^= (hashval >> 11);
+		hashval += (hashval << 15);
+
 		ndx = hashval % hash->dtah_size;
 
 		for (h = hash->dtah_hash[ndx]; h != NULL; h = h->dtahe_next) {
@@ -570,6 +614,7 @@ dt_aggregate_snap_cpu(dtrace_hdl_t *dtp, processorid_t cpu)
 			h->dtahe_aggregate((int64_t *)&data[roffs],
 			    /* LINTED - alignment */
 			    (int64_t *)&addr[roffs], rec->dtrd_size);
+			h->dtahe_gen = agp->dtat_gen;
 
 			/*
 			 * If we're keeping per CPU data, apply the aggregating
@@ -611,6 +656,7 @@ hashnext:
 		aggdata->dtada_normal = 1;
 
 		h->dtahe_hashval = hashval;
+		h->dtahe_gen = agp->dtat_gen;
 		h->dtahe_size = size;
 		(void) dt_aggregate_aggvarid(h);
 
@@ -689,6 +735,9 @@ hashnext:
 
 		h->dtahe_nextall = hash->dtah_all;
 		hash->dtah_all = h;
+
+		if (++hash->dtah_nent > hash->dtah_size * DTRACE_AHASHLOAD)
+			dt_aggregate_hashgrow(hash);
 bufnext:
 		offs += agg->dtagd_size;
 	}
@@ -1151,6 +1200,7 @@ dt_aggwalk_rval(dtrace_hdl_t *dtp, dt_ahashent_t *h, int rval)
 		}
 
 		bzero(&data->dtada_data[rec->dtrd_offset] + offs, size);
+		h->dtahe_gen = agp->dtat_gen;
 
 		if (data->dtada_percpu == NULL)
 			break;
@@ -1216,6 +1266,14 @@ dt_aggwalk_rval(dtrace_hdl_t *dtp, dt_ahashent_t *h, int rval)
 		if (h->dtahe_nextall != NULL)
 			h->dtahe_nextall->dtahe_prevall = h->dtahe_prevall;
 
+		agp->dtat_hash.dtah_nent--;
+
+		/*
+		 * The last sorted order may now refer to this entry; it can
+		 * no longer be reused.
+		 */
+		agp->dtat_sortfunc = NULL;
+
 		/*
 		 * We're unlinked.  We can safely destroy the data.
 		 */
@@ -1515,6 +1573,113 @@ dt_aggregate_minmaxbin(dtrace_hdl_t *dtp, boolean_t clear)
 	return (0);
 }
 
+/*
+ * Sorts the nentries elements of the aggregate into sorted[], for a sorted
+ * walk.  If the last sort was in the same order and no element has been
+ * removed since, only the elements that have changed since (as tracked by
+ * dtahe_gen) are sorted, and they are then merged with the others in the
+ * order that the last sort left them in.  The comparison functions order
+ * distinct elements totally, so this gives the same order as sorting all of
+ * them -- but after a snapshot that touched few of a large aggregation's
+ * elements, it costs little more than a pass over them.  The caller must
+ * hold dt_qsort_lock.
+ */
+static void
+dt_aggregate_sort(dtrace_hdl_t *dtp, dt_ahashent_t **sorted, size_t nentries,
+    int (*sfunc)(const void *, const void *))
+{
+	dt_aggregate_t *agp = &dtp->dt_aggregate;
+	dt_ahash_t *hash = &agp->dtat_hash;
+	int rev = dt_revsort, key = dt_keysort, keypos = dt_keypos;
+	dtrace_optval_t keyposopt = dtp->dt_options[DTRACEOPT_AGGSORTKEYPOS];
+	dt_ahashent_t *h, **last = agp->dtat_sorted;
+	size_t i, j, k, nchanged = 0;
+
+	if (sfunc == NULL) {
+		/*
+		 * As in dt_aggregate_qsort(), the order is determined by the
+		 * "aggsortrev", "aggsortkey" and "aggsortkeypos" options.  If
+		 * we've been explicitly passed a sorting function, we'll use
+		 * that -- ignoring the values of these options.
+		 */
+		dt_revsort = (dtp->dt_options[DTRACEOPT_AGGSORTREV] !=
+		    DTRACEOPT_UNSET);
+		dt_keysort = (dtp->dt_options[DTRACEOPT_AGGSORTKEY] !=
+		    DTRACEOPT_UNSET);
+
+		if (keyposopt != DTRACEOPT_UNSET && keyposopt <= INT_MAX) {
+			dt_keypos = (int)keyposopt;
+		} else {
+			dt_keypos = 0;
+		}
+
+		sfunc = dt_keysort ?
+		    dt_aggregate_varkeycmp : dt_aggregate_varvalcmp;
+	}
+
+	if (last == NULL || agp->dtat_sortfunc != sfunc ||
+	    agp->dtat_sortrev != dt_revsort ||
+	    agp->dtat_sortkey != dt_keysort ||
+	    agp->dtat_sortkeypos != dt_keypos) {
+		for (h = hash->dtah_all, i = 0; h != NULL; h = h->dtahe_nextall)
+			sorted[i++] = h;
+
+		qsort(sorted, nentries, sizeof (dt_ahashent_t *), sfunc);
+		goto done;
+	}
+
+	for (h = hash->dtah_all; h != NULL; h = h->dtahe_nextall) {
+		if (h->dtahe_gen > agp->dtat_sortgen)
+			sorted[nchanged++] = h;
+	}
+
+	qsort(sorted, nchanged, sizeof (dt_ahashent_t *), sfunc);
+
+	/*
+	 * Move the changed elements to the top of sorted[] and merge them
+	 * with the unchanged ones from the bottom up; the merge can never
+	 * overtake the changed elements that remain to be merged.
+	 */
+	i = nentries - nchanged;
+	(void) memmove(&sorted[i], &sorted[0],
+	    nchanged * sizeof (dt_ahashent_t *));
+
+	for (j = 0, k = 0; k < nentries; k++) {
+		while (j < agp->dtat_nsorted &&
+		    last[j]->dtahe_gen > agp->dtat_sortgen)
+			j++;
+
+		if (j < agp->dtat_nsorted &&
+		    (i == nentries || sfunc(&last[j], &sorted[i]) <= 0)) {
+			sorted[k] = last[j++];
+		} else {
+			assert(i < nentries);
+			sorted[k] = sorted[i++];
+		}
+	}
+
+done:
+	/*
+	 * Keep a copy of the order for the next sorted walk; the caller's
+	 * array goes when its walk is done.
+	 */
+	if ((last = malloc(nentries * sizeof (dt_ahashent_t *))) != NULL)
+		bcopy(sorted, last, nentries * sizeof (dt_ahashent_t *));
+
+	free(agp->dtat_sorted);
+	agp->dtat_sorted = last;
+	agp->dtat_nsorted = nentries;
+	agp->dtat_sortfunc = sfunc;
+	agp->dtat_sortrev = dt_revsort;
+	agp->dtat_sortkey = dt_keysort;
+	agp->dtat_sortkeypos = dt_keypos;
+	agp->dtat_sortgen = agp->dtat_gen++;
+
+	dt_revsort = rev;
+	dt_keysort = key;
+	dt_keypos = keypos;
+}
+
 static int
 dt_aggregate_walk_sorted(dtrace_hdl_t *dtp,
     dtrace_aggregate_f *func, void *arg,
@@ -1550,23 +1715,8 @@ dt_aggregate_walk_sorted(dtrace_hdl_t *dtp,
 	if (sorted == NULL)
 		goto out;
 
-	for (h = hash->dtah_all, i = 0; h != NULL; h = h->dtahe_nextall)
-		sorted[i++] = h;
-
 	(void) pthread_mutex_lock(&dt_qsort_lock);
-
-	if (sfunc == NULL) {
-		dt_aggregate_qsort(dtp, sorted, nentries,
-		    sizeof (dt_ahashent_t *), NULL);
-	} else {
-		/*
-		 * If we've been explicitly passed a sorting function,
-		 * we'll use that -- ignoring the values of the "aggsortrev",
-		 * "aggsortkey" and "aggsortkeypos" options.
-		 */
-		qsort(sorted, nentries, sizeof (dt_ahashent_t *), sfunc);
-	}
-
+	dt_aggregate_sort(dtp, sorted, nentries, sfunc);
 	(void) pthread_mutex_unlock(&dt_qsort_lock);
 
 	for (i = 0; i < nentries; i++) {
@@ -2140,6 +2290,7 @@ dtrace_aggregate_clear(dtrace_hdl_t *dtp)
 		data = &h->dtahe_data;
 
 		bzero(&data->dtada_data[rec->dtrd_offset], rec->dtrd_size);
+		h->dtahe_gen = agp->dtat_gen;
 
 		if (data->dtada_percpu == NULL)
 			continue;
@@ -2181,8 +2332,13 @@ dt_aggregate_destroy(dtrace_hdl_t *dtp)
 		hash->dtah_hash = NULL;
 		hash->dtah_all = NULL;
 		hash->dtah_size = 0;
+		hash->dtah_nent = 0;
 	}
 
+	free(agp->dtat_sorted);
+	agp->dtat_sorted = NULL;
+	agp->dtat_sortfunc = NULL;
+
 	free(agp->dtat_buf.dtbd_data);
 	free(agp->dtat_cpus);
 }
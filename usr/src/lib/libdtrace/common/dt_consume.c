@@ -2661,6 +2661,195 @@ dt_get_buf(dtrace_hdl_t *dtp, int cpu, dtrace_bufdesc_t **bufp)
 	return (0);
 }
 
+/*
+ * Outside of temporal mode, the buffers of the CPUs are consumed one after
+ * the other.  So that the time the kernel takes to snapshot a buffer and
+ * copy it out isn't added to the time it takes to process the records in
+ * the last one, a helper thread retrieves the buffer of the next CPU while
+ * the caller's thread consumes the current one.  The kernel serializes
+ * snapshots anyway and the callbacks aren't expected to be reentrant, so
+ * there is just the one helper, and records are still consumed by the
+ * caller's thread and in CPU order; at most two buffers are held at once.
+ */
+typedef struct dt_prefetch {
+	dtrace_hdl_t *dtpf_hdl;		/* DTrace handle */
+	pthread_mutex_t dtpf_lock;	/* protects the fields below */
+	pthread_cond_t dtpf_cv;		/* cond for dtpf_full/done/stop */
+	int dtpf_ncpus;			/* number of CPUs to retrieve */
+	int dtpf_skip;			/* CPU not to retrieve, or -1 */
+	dtrace_bufdesc_t *dtpf_buf;	/* retrieved buffer */
+	int dtpf_cpu;			/* CPU of dtpf_buf */
+	int dtpf_err;			/* dt_get_buf() failed */
+	int dtpf_full;			/* dtpf_buf/cpu/err are valid */
+	int dtpf_done;			/* all buffers have been retrieved */
+	int dtpf_stop;			/* consumer wants no more buffers */
+} dt_prefetch_t;
+
+static void *
+dt_prefetch(void *arg)
+{
+	dt_prefetch_t *dpf = arg;
+	dtrace_bufdesc_t *buf;
+	int i, err, stop;
+
+	for (i = 0; i < dpf->dtpf_ncpus; i++) {
+		if (i == dpf->dtpf_skip)
+			continue;
+
+		(void) pthread_mutex_lock(&dpf->dtpf_lock);
+		while (dpf->dtpf_full && !dpf->dtpf_stop)
+			(void) pthread_cond_wait(&dpf->dtpf_cv, &dpf->dtpf_lock);
+		stop = dpf->dtpf_stop;
+		(void) pthread_mutex_unlock(&dpf->dtpf_lock);
+
+		if (stop)
+			return (NULL);
+
+		if ((err = dt_get_buf(dpf->dtpf_hdl, i, &buf)) == 0 &&
+		    buf == NULL)
+			continue;
+
+		(void) pthread_mutex_lock(&dpf->dtpf_lock);
+		dpf->dtpf_buf = buf;
+		dpf->dtpf_cpu = i;
+		dpf->dtpf_err = err;
+		dpf->dtpf_full = 1;
+		(void) pthread_cond_broadcast(&dpf->dtpf_cv);
+		(void) pthread_mutex_unlock(&dpf->dtpf_lock);
+
+		if (err != 0)
+			return (NULL);
+	}
+
+	(void) pthread_mutex_lock(&dpf->dtpf_lock);
+	dpf->dtpf_done = 1;
+	(void) pthread_cond_broadcast(&dpf->dtpf_cv);
+	(void) pthread_mutex_unlock(&dpf->dtpf_lock);
+
+	return (NULL);
+}
+
+/*
+ * Consumes the buffers of CPUs 0 through ncpus - 1 in turn, other than that
+ * of CPU skip (if it isn't -1).
+ */
+static int
+dt_consume_cpus(dtrace_hdl_t *dtp, FILE *fp, int ncpus, int skip,
+    dtrace_consume_probe_f *pf, dtrace_consume_rec_f *rf, void *arg)
+{
+	dt_prefetch_t dpf;
+	dtrace_bufdesc_t *buf;
+	pthread_t tid;
+	int i, rval = 0;
+
+	bzero(&dpf, sizeof (dpf));
+	dpf.dtpf_hdl = dtp;
+	dpf.dtpf_ncpus = ncpus;
+	dpf.dtpf_skip = skip;
+	(void) pthread_mutex_init(&dpf.dtpf_lock, NULL);
+	(void) pthread_cond_init(&dpf.dtpf_cv, NULL);
+
+	if (ncpus <= 1 || pthread_create(&tid, NULL, dt_prefetch, &dpf) != 0) {
+		/*
+		 * With one CPU there is nothing to overlap; if we can't
+		 * create the thread, retrieve the buffers ourselves.
+		 */
+		for (i = 0; i < ncpus && rval == 0; i++) {
+			if (i == skip)
+				continue;
+
+			if (dt_get_buf(dtp, i, &buf) != 0) {
+				rval = -1;
+				break;
+			}
+
+			if (buf == NULL)
+				continue;
+
+			dtp->dt_flow = 0;
+			dtp->dt_indent = 0;
+			dtp->dt_prefix = NULL;
+			rval = dt_consume_cpu(dtp, fp, i,
+			    buf, B_FALSE, pf, rf, arg);
+			dt_put_buf(dtp, buf);
+		}
+
+		goto out;
+	}
+
+	for (;;) {
+		(void) pthread_mutex_lock(&dpf.dtpf_lock);
+		while (!dpf.dtpf_full && !dpf.dtpf_done)
+			(void) pthread_cond_wait(&dpf.dtpf_cv, &dpf.dtpf_lock);
+
+		if (!dpf.dtpf_full) {
+			(void) pthread_mutex_unlock(&dpf.dtpf_lock);
+			break;
+		}
+
+		buf = dpf.dtpf_buf;
+		i = dpf.dtpf_cpu;
+		dpf.dtpf_full = 0;
+
+		if (dpf.dtpf_err != 0) {
+			(void) pthread_mutex_unlock(&dpf.dtpf_lock);
+			rval = -1;
+			break;
+		}
+
+		(void) pthread_cond_broadcast(&dpf.dtpf_cv);
+		(void) pthread_mutex_unlock(&dpf.dtpf_lock);
+
+		dtp->dt_flow = 0;
+		dtp->dt_indent = 0;
+		dtp->dt_prefix = NULL;
+		rval = dt_consume_cpu(dtp, fp, i, buf, B_FALSE, pf, rf, arg);
+		dt_put_buf(dtp, buf);
+
+		if (rval != 0)
+			break;
+	}
+
+	(void) pthread_mutex_lock(&dpf.dtpf_lock);
+	dpf.dtpf_stop = 1;
+	(void) pthread_cond_broadcast(&dpf.dtpf_cv);
+	(void) pthread_mutex_unlock(&dpf.dtpf_lock);
+	(void) pthread_join(tid, NULL);
+
+	/*
+	 * If we stopped early, the thread may have left a buffer behind.
+	 */
+	if (dpf.dtpf_full && dpf.dtpf_buf != NULL)
+		dt_put_buf(dtp, dpf.dtpf_buf);
+
+out:
+	(void) pthread_cond_destroy(&dpf.dtpf_cv);
+	(void) pthread_mutex_destroy(&dpf.dtpf_lock);
+
+	return (rval);
+}
+
+/*
+ * Consumes a buffer that didn't come from the kernel; see dt_ring.c.
+ */
+int
+dt_consume_buf(dtrace_hdl_t *dtp, FILE *fp, dtrace_bufdesc_t *buf,
+    dtrace_consume_probe_f *pf, dtrace_consume_rec_f *rf, void *arg)
+{
+	if (pf == NULL)
+		pf = (dtrace_consume_probe_f *)dt_nullprobe;
+
+	if (rf == NULL)
+		rf = (dtrace_consume_rec_f *)dt_nullrec;
+
+	dtp->dt_flow = 0;
+	dtp->dt_indent = 0;
+	dtp->dt_prefix = NULL;
+
+	return (dt_consume_cpu(dtp, fp, buf->dtbd_cpu,
+	    buf, B_FALSE, pf, rf, arg));
+}
+
 typedef struct dt_begin {
 	dtrace_consume_probe_f *dtbgn_probefunc;
 	dtrace_consume_rec_f *dtbgn_recfunc;
@@ -2899,6 +3088,28 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 	if (rf == NULL)
 		rf = (dtrace_consume_rec_f *)dt_nullrec;
 
+	if (dtp->dt_ring != NULL) {
+		/*
+		 * The buffers go to the ring file as they are, to be
+		 * formatted when the file is replayed.
+		 */
+		for (i = 0; i < max_ncpus; i++) {
+			dtrace_bufdesc_t *buf;
+
+			if (dt_get_buf(dtp, i, &buf) != 0)
+				return (-1);
+			if (buf == NULL)
+				continue;
+
+			rval = dt_ring_write(dtp, buf);
+			dt_put_buf(dtp, buf);
+			if (rval != 0)
+				return (rval);
+		}
+
+		return (0);
+	}
+
 	if (dtp->dt_options[DTRACEOPT_TEMPORAL] == DTRACEOPT_UNSET) {
 		/*
 		 * The output will not be in the order it was traced.  Rather,
@@ -2914,31 +3125,15 @@ dtrace_consume(dtrace_hdl_t *dtp, FILE *fp,
 		    (rval = dt_consume_begin(dtp, fp, pf, rf, arg)) != 0)
 			return (rval);
 
-		for (i = 0; i < max_ncpus; i++) {
-			dtrace_bufdesc_t *buf;
-
-			/*
-			 * If we have stopped, we want to process the CPU on
-			 * which the END probe was processed only _after_ we
-			 * have processed everything else.
-			 */
-			if (dtp->dt_stopped && (i == dtp->dt_endedon))
-				continue;
-
-			if (dt_get_buf(dtp, i, &buf) != 0)
-				return (-1);
-			if (buf == NULL)
-				continue;
+		/*
+		 * If we have stopped, we want to process the CPU on which the
+		 * END probe was processed only _after_ we have processed
+		 * everything else.
+		 */
+		if ((rval = dt_consume_cpus(dtp, fp, max_ncpus,
+		    dtp->dt_stopped ? dtp->dt_endedon : -1, pf, rf, arg)) != 0)
+			return (rval);
 
-			dtp->dt_flow = 0;
-			dtp->dt_indent = 0;
-			dtp->dt_prefix = NULL;
-			rval = dt_consume_cpu(dtp, fp, i,
-			    buf, B_FALSE, pf, rf, arg);
-			dt_put_buf(dtp, buf);
-			if (rval != 0)
-				return (rval);
-		}
 		if (dtp->dt_stopped) {
 			dtrace_bufdesc_t *buf;
 
@@ -290,6 +290,9 @@ static const struct {
 	{ DROPTAG(DTRACEDROP_SPECUNAVAIL) },
 	{ DROPTAG(DTRACEDROP_DBLERROR) },
 	{ DROPTAG(DTRACEDROP_STKSTROVERFLOW) },
+	{ DROPTAG(DTRACEDROP_AGGSCALAR) },
+	{ DROPTAG(DTRACEDROP_AGGSTRING) },
+	{ DROPTAG(DTRACEDROP_AGGSTACK) },
 	{ 0, NULL }
 };
 
@@ -383,6 +386,18 @@ static const struct {
 	    offsetof(dtrace_status_t, dtst_dblerrors),
 	    "error", " in ERROR probe enabling" },
 
+	{ DTRACEDROP_AGGSCALAR,
+	    offsetof(dtrace_status_t, dtst_aggdrops_scalar),
+	    "aggregation drop", " on integer keys" },
+
+	{ DTRACEDROP_AGGSTRING,
+	    offsetof(dtrace_status_t, dtst_aggdrops_string),
+	    "aggregation drop", " on string keys" },
+
+	{ DTRACEDROP_AGGSTACK,
+	    offsetof(dtrace_status_t, dtst_aggdrops_stack),
+	    "aggregation drop", " on stack keys" },
+
 	{ 0, 0, NULL }
 };
 
@@ -154,6 +154,7 @@ typedef struct dt_ahashent {
 	struct dt_ahashent *dtahe_prevall;	/* prev on list of all */
 	struct dt_ahashent *dtahe_nextall;	/* next on list of all */
 	uint64_t dtahe_hashval;			/* hash value */
+	uint64_t dtahe_gen;			/* generation last changed */
 	size_t dtahe_size;			/* size of data */
 	dtrace_aggdata_t dtahe_data;		/* data */
 	void (*dtahe_aggregate)(int64_t *, int64_t *, size_t); /* function */
@@ -163,6 +164,7 @@ typedef struct dt_ahash {
 	dt_ahashent_t	**dtah_hash;		/* hash table */
 	dt_ahashent_t	*dtah_all;		/* list of all elements */
 	size_t		dtah_size;		/* size of hash table */
+	size_t		dtah_nent;		/* number of elements */
 } dt_ahash_t;
 
 typedef struct dt_aggregate {
@@ -173,6 +175,14 @@ typedef struct dt_aggregate {
 	processorid_t dtat_ncpu;	/* size of dtat_cpus array */
 	processorid_t dtat_maxcpu;	/* maximum number of CPUs */
 	dt_ahash_t dtat_hash;		/* aggregate hash table */
+	uint64_t dtat_gen;		/* generation of changes */
+	dt_ahashent_t **dtat_sorted;	/* elements in last sorted order */
+	size_t dtat_nsorted;		/* number of elements in dtat_sorted */
+	uint64_t dtat_sortgen;		/* generation dtat_sorted is as of */
+	int (*dtat_sortfunc)(const void *, const void *); /* its order */
+	int dtat_sortrev;		/* dt_revsort for dtat_sorted */
+	int dtat_sortkey;		/* dt_keysort for dtat_sorted */
+	int dtat_sortkeypos;		/* dt_keypos for dtat_sorted */
 } dt_aggregate_t;
 
 typedef struct dt_print_aggdata {
@@ -254,6 +264,8 @@ struct dtrace_hdl {
 	char **dt_strdata;	/* pointer to strdata array */
 	dt_aggregate_t dt_aggregate; /* aggregate */
 	dt_pq_t *dt_bufq;	/* CPU-specific data queue */
+	struct dt_ring *dt_ring; /* ring file being written (see dt_ring.c) */
+	struct dt_ring *dt_replay; /* ring file being replayed */
 	struct dt_pfdict *dt_pfdict; /* dictionary of printf conversions */
 	dt_version_t dt_vmax;	/* optional ceiling on program API binding */
 	dtrace_attribute_t dt_amin; /* optional floor on program attributes */
@@ -530,7 +542,8 @@ enum {
 	EDT_OVERSION,		/* client is requesting deprecated version */
 	EDT_ENABLING_ERR,	/* failed to enable probe */
 	EDT_NOPROBES,		/* no probes sites for declared provider */
-	EDT_CANTLOAD		/* failed to load a module */
+	EDT_CANTLOAD,		/* failed to load a module */
+	EDT_BADRING		/* invalid ring file */
 };
 
 /*
@@ -631,6 +644,14 @@ extern void dt_format_destroy(dtrace_hdl_t *);
 extern const char *dt_strdata_lookup(dtrace_hdl_t *, int);
 extern void dt_strdata_destroy(dtrace_hdl_t *);
 
+typedef struct dt_ring dt_ring_t;
+
+extern int dt_ring_write(dtrace_hdl_t *, dtrace_bufdesc_t *);
+extern int dt_ring_ioctl(dtrace_hdl_t *, int, void *);
+extern void dt_ring_destroy(dtrace_hdl_t *);
+extern int dt_consume_buf(dtrace_hdl_t *, FILE *, dtrace_bufdesc_t *,
+    dtrace_consume_probe_f *, dtrace_consume_rec_f *, void *);
+
 extern int dt_print_quantize(dtrace_hdl_t *, FILE *,
     const void *, size_t, uint64_t);
 extern int dt_print_lquantize(dtrace_hdl_t *, FILE *,
@@ -308,6 +308,7 @@ dt_format_destroy(dtrace_hdl_t *dtp)
 
 	free(dtp->dt_formats);
 	dtp->dt_formats = NULL;
+	dtp->dt_maxformat = 0;
 }
 
 static int
@@ -473,4 +474,5 @@ dt_strdata_destroy(dtrace_hdl_t *dtp)
 
 	free(dtp->dt_strdata);
 	dtp->dt_strdata = NULL;
+	dtp->dt_maxstrdata = 0;
 }
@@ -1377,6 +1377,7 @@ dtrace_close(dtrace_hdl_t *dtp)
 	if (dtp->dt_stdout_fd != -1)
 		(void) close(dtp->dt_stdout_fd);
 
+	dt_ring_destroy(dtp);
 	dt_epid_destroy(dtp);
 	dt_aggid_destroy(dtp);
 	dt_format_destroy(dtp);
@@ -0,0 +1,694 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Ring files.  Formatting the records in the principal buffers is usually
+ * what limits how fast a consumer can keep up with its enablings.  Once a
+ * ring file has been opened with dtrace_ring_open(), dtrace_consume() no
+ * longer formats the buffers: it appends each one, as retrieved from the
+ * kernel, to a file of fixed size that is mapped into the consumer and in
+ * which, once the file is full, the oldest buffers are overwritten by the
+ * newest.  dtrace_ring_replay() later formats the contents of the file in
+ * another handle, which needn't have the kernel behind it.
+ *
+ * To do so, the file also holds the descriptions of the enabled probes that
+ * produced the records and their format strings.  These are what libdtrace
+ * asks the kernel for (with DTRACEIOC_EPROBE, DTRACEIOC_PROBES and
+ * DTRACEIOC_FORMAT) as it first meets each EPID; while replaying, dt_ioctl()
+ * answers these requests from the file instead, so that the records are
+ * consumed by the same code as they would have been live.  The descriptions
+ * are written as the writer first meets each EPID in a buffer, before the
+ * buffer itself, so that the file is complete at any point.
+ *
+ * The file begins with a header (dt_ringhdr_t), which is followed by the
+ * ring and then the descriptions, which grow at the end of the file.  Each
+ * chunk in the ring is the contents of one CPU's buffer, preceded by a
+ * dt_ringchunk_t; a chunk is never split across the end of the ring, and if
+ * one doesn't fit there, a chunk of size zero (if there is room for one)
+ * marks the end and writing continues at the start.  Each description is
+ * preceded by a dt_ringmeta_t.  Everything is kept 64-bit aligned.
+ *
+ * Aggregations are not written to the file, so printa() will print nothing
+ * when the file is replayed.
+ */
+
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <dt_impl.h>
+
+#define	DT_RING_MAGIC		0x44545247	/* "DTRG" */
+#define	DT_RING_VERSION		1
+
+typedef struct dt_ringhdr {
+	uint32_t dtrh_magic;		/* DT_RING_MAGIC */
+	uint32_t dtrh_version;		/* DT_RING_VERSION */
+	uint64_t dtrh_ringsize;		/* size of ring */
+	uint64_t dtrh_head;		/* ring offset of oldest chunk */
+	uint64_t dtrh_tail;		/* ring offset at which to write next */
+	uint64_t dtrh_metasize;		/* size of descriptions after ring */
+	uint64_t dtrh_lost;		/* buffers too big for the ring */
+} dt_ringhdr_t;
+
+typedef struct dt_ringchunk {
+	uint64_t dtrc_size;		/* size including header, or 0 at end */
+	uint64_t dtrc_timestamp;	/* dtbd_timestamp of buffer */
+	uint64_t dtrc_drops;		/* dtbd_drops of buffer */
+	uint32_t dtrc_cpu;		/* dtbd_cpu of buffer */
+	uint32_t dtrc_errors;		/* dtbd_errors of buffer */
+} dt_ringchunk_t;
+
+#define	DT_RINGMETA_EPROBE	1	/* dtrace_eprobedesc_t, by EPID */
+#define	DT_RINGMETA_PROBE	2	/* dtrace_probedesc_t, by probe ID */
+#define	DT_RINGMETA_FORMAT	3	/* format string, by format index */
+
+typedef struct dt_ringmeta {
+	uint32_t dtrm_type;		/* DT_RINGMETA_* */
+	uint32_t dtrm_id;		/* identifier of description */
+	uint64_t dtrm_size;		/* size of description */
+} dt_ringmeta_t;
+
+#define	DT_RING_ALIGN(x)	P2ROUNDUP((uint64_t)(x), sizeof (uint64_t))
+
+struct dt_ring {
+	int dtr_fd;			/* ring file */
+	void *dtr_base;			/* mapping of file */
+	size_t dtr_mapsize;		/* size of mapping */
+	dt_ringhdr_t *dtr_hdr;		/* header */
+	char *dtr_ring;			/* ring */
+	void **dtr_edesc;		/* descriptions by EPID */
+	uint_t dtr_nedesc;		/* size of dtr_edesc */
+	void **dtr_pdesc;		/* descriptions by probe ID */
+	uint_t dtr_npdesc;		/* size of dtr_pdesc */
+	void **dtr_format;		/* format strings by index */
+	uint_t dtr_nformat;		/* size of dtr_format */
+};
+
+/*
+ * Returns the slot for the specified ID in a table of descriptions, growing
+ * the table if needed, or NULL if we run out of memory.  The writer only
+ * needs to know whether each description has been written; the reader uses
+ * the slots to point into the mapping.
+ */
+static void **
+dt_ring_slot(dtrace_hdl_t *dtp, void ***tabp, uint_t *np, uint_t id)
+{
+	uint_t n = *np, nn;
+	void **tab;
+
+	if (id < n)
+		return (&(*tabp)[id]);
+
+	for (nn = n != 0 ? n : 64; nn <= id; nn <<= 1) {
+		if (nn > UINT_MAX >> 1) {
+			(void) dt_set_errno(dtp, EDT_NOMEM);
+			return (NULL);
+		}
+	}
+
+	if ((tab = dt_zalloc(dtp, nn * sizeof (void *))) == NULL)
+		return (NULL);
+
+	if (*tabp != NULL) {
+		bcopy(*tabp, tab, n * sizeof (void *));
+		dt_free(dtp, *tabp);
+	}
+
+	*tabp = tab;
+	*np = nn;
+
+	return (&tab[id]);
+}
+
+static void
+dt_ring_free(dtrace_hdl_t *dtp, dt_ring_t *rp)
+{
+	if (rp->dtr_base != NULL)
+		(void) munmap(rp->dtr_base, rp->dtr_mapsize);
+
+	if (rp->dtr_fd != -1)
+		(void) close(rp->dtr_fd);
+
+	dt_free(dtp, rp->dtr_edesc);
+	dt_free(dtp, rp->dtr_pdesc);
+	dt_free(dtp, rp->dtr_format);
+	dt_free(dtp, rp);
+}
+
+/*
+ * Appends a description to the end of the file.
+ */
+static int
+dt_ring_meta(dtrace_hdl_t *dtp, uint32_t type, uint32_t id,
+    const void *desc, size_t size)
+{
+	dt_ring_t *rp = dtp->dt_ring;
+	dt_ringhdr_t *hp = rp->dtr_hdr;
+	size_t len = sizeof (dt_ringmeta_t) + DT_RING_ALIGN(size);
+	dt_ringmeta_t *mp;
+	ssize_t rv;
+
+	if ((mp = dt_zalloc(dtp, len)) == NULL)
+		return (-1);
+
+	mp->dtrm_type = type;
+	mp->dtrm_id = id;
+	mp->dtrm_size = size;
+	bcopy(desc, mp + 1, size);
+
+	rv = pwrite(rp->dtr_fd, mp, len, sizeof (dt_ringhdr_t) +
+	    hp->dtrh_ringsize + hp->dtrh_metasize);
+	dt_free(dtp, mp);
+
+	if (rv != len)
+		return (dt_set_errno(dtp, rv == -1 ? errno : EIO));
+
+	hp->dtrh_metasize += len;
+	return (0);
+}
+
+static int
+dt_ring_format(dtrace_hdl_t *dtp, int format)
+{
+	dt_ring_t *rp = dtp->dt_ring;
+	dtrace_fmtdesc_t fmt;
+	void **slot;
+	int rval;
+
+	if ((slot = dt_ring_slot(dtp, &rp->dtr_format,
+	    &rp->dtr_nformat, format)) == NULL)
+		return (-1);
+
+	if (*slot != NULL)
+		return (0);
+
+	bzero(&fmt, sizeof (fmt));
+	fmt.dtfd_format = format;
+
+	if (dt_ioctl(dtp, DTRACEIOC_FORMAT, &fmt) == -1)
+		return (dt_set_errno(dtp, errno));
+
+	if ((fmt.dtfd_string = dt_alloc(dtp, fmt.dtfd_length)) == NULL)
+		return (-1);
+
+	if (dt_ioctl(dtp, DTRACEIOC_FORMAT, &fmt) == -1) {
+		rval = dt_set_errno(dtp, errno);
+	} else {
+		rval = dt_ring_meta(dtp, DT_RINGMETA_FORMAT, format,
+		    fmt.dtfd_string, fmt.dtfd_length);
+	}
+
+	dt_free(dtp, fmt.dtfd_string);
+
+	if (rval == 0)
+		*slot = (void *)B_TRUE;
+
+	return (rval);
+}
+
+/*
+ * Writes the descriptions of the EPIDs in the specified buffer that haven't
+ * been written yet.
+ */
+static int
+dt_ring_describe(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
+{
+	dt_ring_t *rp = dtp->dt_ring;
+	dtrace_eprobedesc_t *epd;
+	dtrace_probedesc_t *pd;
+	dtrace_epid_t id;
+	void **slot;
+	size_t offs;
+	int i;
+
+	for (offs = buf->dtbd_oldest; offs < buf->dtbd_size; ) {
+		id = *(uint32_t *)((uintptr_t)buf->dtbd_data + offs);
+
+		if (id == DTRACE_EPIDNONE) {
+			offs += sizeof (id);
+			continue;
+		}
+
+		if (dt_epid_lookup(dtp, id, &epd, &pd) != 0)
+			return (-1);
+
+		offs += epd->dtepd_size;
+
+		if ((slot = dt_ring_slot(dtp, &rp->dtr_edesc,
+		    &rp->dtr_nedesc, id)) == NULL)
+			return (-1);
+
+		if (*slot != NULL)
+			continue;
+
+		for (i = 0; i < epd->dtepd_nrecs; i++) {
+			if (epd->dtepd_rec[i].dtrd_format != 0 &&
+			    dt_ring_format(dtp,
+			    epd->dtepd_rec[i].dtrd_format) != 0)
+				return (-1);
+		}
+
+		if (dt_ring_meta(dtp, DT_RINGMETA_PROBE, pd->dtpd_id,
+		    pd, sizeof (*pd)) != 0 ||
+		    dt_ring_meta(dtp, DT_RINGMETA_EPROBE, id,
+		    epd, DTRACE_SIZEOF_EPROBEDESC(epd)) != 0)
+			return (-1);
+
+		*slot = epd;
+	}
+
+	return (0);
+}
+
+/*
+ * Moves the head of the ring past the oldest chunk.
+ */
+static void
+dt_ring_evict(dt_ringhdr_t *hp, char *ring)
+{
+	uint64_t offs = hp->dtrh_head;
+
+	offs += ((dt_ringchunk_t *)(ring + offs))->dtrc_size;
+
+	if (offs != hp->dtrh_tail &&
+	    (hp->dtrh_ringsize - offs < sizeof (dt_ringchunk_t) ||
+	    ((dt_ringchunk_t *)(ring + offs))->dtrc_size == 0))
+		offs = 0;
+
+	hp->dtrh_head = offs;
+}
+
+/*
+ * Makes room for a chunk of the specified size at the tail of the ring,
+ * which may move to the start of the ring.  The head and tail are equal
+ * only when the ring is empty, so a chunk must never fill the free space
+ * exactly unless it reaches the end of the ring.
+ */
+static void
+dt_ring_reserve(dt_ringhdr_t *hp, char *ring, uint64_t size)
+{
+	uint64_t rsize = hp->dtrh_ringsize;
+
+	assert(size < rsize);
+
+	for (;;) {
+		if (hp->dtrh_head == hp->dtrh_tail) {
+			hp->dtrh_head = hp->dtrh_tail = 0;
+			return;
+		}
+
+		if (hp->dtrh_head < hp->dtrh_tail) {
+			if (rsize - hp->dtrh_tail >= size)
+				return;
+
+			if (hp->dtrh_head == 0) {
+				dt_ring_evict(hp, ring);
+				continue;
+			}
+
+			if (rsize - hp->dtrh_tail >= sizeof (dt_ringchunk_t)) {
+				((dt_ringchunk_t *)(ring +
+				    hp->dtrh_tail))->dtrc_size = 0;
+			}
+
+			hp->dtrh_tail = 0;
+			continue;
+		}
+
+		if (hp->dtrh_head - hp->dtrh_tail > size)
+			return;
+
+		dt_ring_evict(hp, ring);
+	}
+}
+
+/*
+ * Called by dtrace_consume() for each buffer it retrieves while a ring file
+ * is open.
+ */
+int
+dt_ring_write(dtrace_hdl_t *dtp, dtrace_bufdesc_t *buf)
+{
+	dt_ring_t *rp = dtp->dt_ring;
+	dt_ringhdr_t *hp = rp->dtr_hdr;
+	uint64_t len = buf->dtbd_size - buf->dtbd_oldest;
+	uint64_t size = DT_RING_ALIGN(sizeof (dt_ringchunk_t) + len);
+	dt_ringchunk_t *cp;
+
+	if (len == 0 && buf->dtbd_drops == 0 && buf->dtbd_errors == 0)
+		return (0);
+
+	if (dt_ring_describe(dtp, buf) != 0)
+		return (-1);
+
+	if (size >= hp->dtrh_ringsize) {
+		hp->dtrh_lost++;
+		return (0);
+	}
+
+	dt_ring_reserve(hp, rp->dtr_ring, size);
+
+	cp = (dt_ringchunk_t *)(rp->dtr_ring + hp->dtrh_tail);
+	cp->dtrc_size = size;
+	cp->dtrc_timestamp = buf->dtbd_timestamp;
+	cp->dtrc_drops = buf->dtbd_drops;
+	cp->dtrc_cpu = buf->dtbd_cpu;
+	cp->dtrc_errors = buf->dtbd_errors;
+	bcopy(buf->dtbd_data + buf->dtbd_oldest, cp + 1, len);
+
+	/*
+	 * The padding reads as filler (DTRACE_EPIDNONE) when replayed.
+	 */
+	bzero((char *)(cp + 1) + len, size - sizeof (dt_ringchunk_t) - len);
+
+	hp->dtrh_tail += size;
+	return (0);
+}
+
+int
+dtrace_ring_open(dtrace_hdl_t *dtp, const char *path, size_t size)
+{
+	dt_ring_t *rp;
+	dt_ringhdr_t *hp;
+
+	size = P2ALIGN(size, sizeof (uint64_t));
+
+	if (dtp->dt_ring != NULL || dtp->dt_replay != NULL ||
+	    size < 2 * sizeof (dt_ringchunk_t))
+		return (dt_set_errno(dtp, EINVAL));
+
+	if ((rp = dt_zalloc(dtp, sizeof (dt_ring_t))) == NULL)
+		return (-1);
+
+	rp->dtr_mapsize = sizeof (dt_ringhdr_t) + size;
+
+	if ((rp->dtr_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1 ||
+	    ftruncate(rp->dtr_fd, rp->dtr_mapsize) == -1 ||
+	    (rp->dtr_base = mmap(NULL, rp->dtr_mapsize, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, rp->dtr_fd, 0)) == MAP_FAILED) {
+		int err = errno;
+
+		rp->dtr_base = NULL;
+		dt_ring_free(dtp, rp);
+		return (dt_set_errno(dtp, err));
+	}
+
+	hp = rp->dtr_hdr = rp->dtr_base;
+	rp->dtr_ring = (char *)(hp + 1);
+
+	hp->dtrh_magic = DT_RING_MAGIC;
+	hp->dtrh_version = DT_RING_VERSION;
+	hp->dtrh_ringsize = size;
+
+	dtp->dt_ring = rp;
+	return (0);
+}
+
+void
+dt_ring_destroy(dtrace_hdl_t *dtp)
+{
+	dt_ring_t *rp;
+
+	if ((rp = dtp->dt_ring) == NULL)
+		return;
+
+	(void) msync(rp->dtr_base, rp->dtr_mapsize, MS_SYNC);
+	dt_ring_free(dtp, rp);
+	dtp->dt_ring = NULL;
+}
+
+/*
+ * Answers libdtrace's requests for descriptions while a ring file is being
+ * replayed, as the kernel would have.
+ */
+int
+dt_ring_ioctl(dtrace_hdl_t *dtp, int val, void *arg)
+{
+	dt_ring_t *rp = dtp->dt_replay;
+
+	switch (val) {
+	case DTRACEIOC_EPROBE: {
+		dtrace_eprobedesc_t *epd = arg, *src;
+		int nrecs = epd->dtepd_nrecs;
+
+		if (epd->dtepd_epid >= rp->dtr_nedesc ||
+		    (src = rp->dtr_edesc[epd->dtepd_epid]) == NULL)
+			break;
+
+		bcopy(src, epd, offsetof(dtrace_eprobedesc_t, dtepd_rec[0]));
+		bcopy(src->dtepd_rec, epd->dtepd_rec,
+		    MIN(nrecs, src->dtepd_nrecs) * sizeof (dtrace_recdesc_t));
+		return (0);
+	}
+
+	case DTRACEIOC_PROBES: {
+		dtrace_probedesc_t *pd = arg;
+
+		if (pd->dtpd_id >= rp->dtr_npdesc ||
+		    rp->dtr_pdesc[pd->dtpd_id] == NULL) {
+			errno = ESRCH;
+			return (-1);
+		}
+
+		bcopy(rp->dtr_pdesc[pd->dtpd_id], pd, sizeof (*pd));
+		return (0);
+	}
+
+	case DTRACEIOC_FORMAT: {
+		dtrace_fmtdesc_t *fmt = arg;
+		const char *str;
+		int len;
+
+		if (fmt->dtfd_format <= 0 ||
+		    fmt->dtfd_format >= rp->dtr_nformat ||
+		    (str = rp->dtr_format[fmt->dtfd_format]) == NULL)
+			break;
+
+		len = strlen(str) + 1;
+
+		if (len > fmt->dtfd_length)
+			fmt->dtfd_length = len;
+		else
+			bcopy(str, fmt->dtfd_string, len);
+
+		return (0);
+	}
+	}
+
+	errno = EINVAL;
+	return (-1);
+}
+
+/*
+ * Indexes the descriptions at the end of a ring file that is to be replayed.
+ */
+static int
+dt_ring_load(dtrace_hdl_t *dtp, dt_ring_t *rp)
+{
+	dt_ringhdr_t *hp = rp->dtr_hdr;
+	char *meta = rp->dtr_ring + hp->dtrh_ringsize;
+	uint64_t offs, size;
+	dt_ringmeta_t *mp;
+	void ***tabp, **slot;
+	uint_t *np;
+	char *desc;
+
+	for (offs = 0; offs < hp->dtrh_metasize; offs += sizeof (*mp) + size) {
+		if (hp->dtrh_metasize - offs < sizeof (*mp))
+			return (dt_set_errno(dtp, EDT_BADRING));
+
+		mp = (dt_ringmeta_t *)(meta + offs);
+		desc = (char *)(mp + 1);
+		size = DT_RING_ALIGN(mp->dtrm_size);
+
+		if (mp->dtrm_size > hp->dtrh_metasize - offs - sizeof (*mp))
+			return (dt_set_errno(dtp, EDT_BADRING));
+
+		switch (mp->dtrm_type) {
+		case DT_RINGMETA_EPROBE:
+			if (mp->dtrm_size < sizeof (dtrace_eprobedesc_t) ||
+			    mp->dtrm_size < DTRACE_SIZEOF_EPROBEDESC(
+			    (dtrace_eprobedesc_t *)desc))
+				return (dt_set_errno(dtp, EDT_BADRING));
+
+			tabp = &rp->dtr_edesc;
+			np = &rp->dtr_nedesc;
+			break;
+
+		case DT_RINGMETA_PROBE:
+			if (mp->dtrm_size < sizeof (dtrace_probedesc_t))
+				return (dt_set_errno(dtp, EDT_BADRING));
+
+			tabp = &rp->dtr_pdesc;
+			np = &rp->dtr_npdesc;
+			break;
+
+		case DT_RINGMETA_FORMAT:
+			if (mp->dtrm_size == 0 ||
+			    desc[mp->dtrm_size - 1] != '\0')
+				return (dt_set_errno(dtp, EDT_BADRING));
+
+			tabp = &rp->dtr_format;
+			np = &rp->dtr_nformat;
+			break;
+
+		default:
+			continue;
+		}
+
+		if ((slot = dt_ring_slot(dtp, tabp, np, mp->dtrm_id)) == NULL)
+			return (-1);
+
+		*slot = desc;
+	}
+
+	return (0);
+}
+
+/*
+ * Consumes the contents of a ring file, from the oldest buffer to the
+ * newest, as dtrace_consume() would have consumed them.  The handle must not
+ * be tracing; it needn't have the kernel behind it (DTRACE_O_NODEV).
+ */
+int
+dtrace_ring_replay(dtrace_hdl_t *dtp, const char *path, FILE *fp,
+    dtrace_consume_probe_f *pf, dtrace_consume_rec_f *rf, void *arg)
+{
+	dtrace_bufdesc_t buf;
+	dt_ringchunk_t *cp;
+	dt_ringhdr_t *hp;
+	dt_ring_t *rp;
+	uint64_t offs, step, nbytes, len;
+	struct stat st;
+	int end, rval = -1;
+
+	if (dtp->dt_active || dtp->dt_ring != NULL || dtp->dt_replay != NULL)
+		return (dt_set_errno(dtp, EINVAL));
+
+	if ((rp = dt_zalloc(dtp, sizeof (dt_ring_t))) == NULL)
+		return (-1);
+
+	if ((rp->dtr_fd = open(path, O_RDONLY)) == -1 ||
+	    fstat(rp->dtr_fd, &st) == -1) {
+		int err = errno;
+
+		dt_ring_free(dtp, rp);
+		return (dt_set_errno(dtp, err));
+	}
+
+	if (st.st_size < sizeof (dt_ringhdr_t)) {
+		dt_ring_free(dtp, rp);
+		return (dt_set_errno(dtp, EDT_BADRING));
+	}
+
+	/*
+	 * The mapping is private and writable as the consuming code may
+	 * scribble on the buffers it is given.
+	 */
+	rp->dtr_mapsize = st.st_size;
+
+	if ((rp->dtr_base = mmap(NULL, rp->dtr_mapsize, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE, rp->dtr_fd, 0)) == MAP_FAILED) {
+		int err = errno;
+
+		rp->dtr_base = NULL;
+		dt_ring_free(dtp, rp);
+		return (dt_set_errno(dtp, err));
+	}
+
+	hp = rp->dtr_hdr = rp->dtr_base;
+	rp->dtr_ring = (char *)(hp + 1);
+
+	if (hp->dtrh_magic != DT_RING_MAGIC ||
+	    hp->dtrh_version != DT_RING_VERSION ||
+	    hp->dtrh_ringsize > st.st_size - sizeof (dt_ringhdr_t) ||
+	    hp->dtrh_metasize > st.st_size - sizeof (dt_ringhdr_t) -
+	    hp->dtrh_ringsize || hp->dtrh_head > hp->dtrh_ringsize ||
+	    hp->dtrh_tail > hp->dtrh_ringsize ||
+	    !IS_P2ALIGNED(hp->dtrh_head, sizeof (uint64_t))) {
+		dt_ring_free(dtp, rp);
+		return (dt_set_errno(dtp, EDT_BADRING));
+	}
+
+	if (dt_ring_load(dtp, rp) != 0) {
+		dt_ring_free(dtp, rp);
+		return (-1);
+	}
+
+	/*
+	 * Any descriptions we have are from another session; the ones we'll
+	 * now be given come from the file.
+	 */
+	dt_epid_destroy(dtp);
+	dt_format_destroy(dtp);
+	dt_strdata_destroy(dtp);
+	dtp->dt_replay = rp;
+
+	/*
+	 * The tail may be at the very end of the ring, so rather than look
+	 * for it we walk as far as it is from the head; a chunk that would
+	 * take us past it means the file is corrupt.
+	 */
+	if (hp->dtrh_tail >= hp->dtrh_head)
+		len = hp->dtrh_tail - hp->dtrh_head;
+	else
+		len = hp->dtrh_ringsize - hp->dtrh_head + hp->dtrh_tail;
+
+	for (offs = hp->dtrh_head, nbytes = 0; nbytes < len;
+	    offs = (offs + step) % hp->dtrh_ringsize) {
+		cp = (dt_ringchunk_t *)(rp->dtr_ring + offs);
+		end = (hp->dtrh_ringsize - offs < sizeof (dt_ringchunk_t) ||
+		    cp->dtrc_size == 0);
+		step = end ? hp->dtrh_ringsize - offs : cp->dtrc_size;
+
+		if ((!end && step < sizeof (dt_ringchunk_t)) ||
+		    step > hp->dtrh_ringsize - offs ||
+		    !IS_P2ALIGNED(step, sizeof (uint64_t)) ||
+		    (nbytes += step) > len) {
+			(void) dt_set_errno(dtp, EDT_BADRING);
+			goto out;
+		}
+
+		if (end)
+			continue;
+
+		bzero(&buf, sizeof (buf));
+		buf.dtbd_size = cp->dtrc_size - sizeof (dt_ringchunk_t);
+		buf.dtbd_cpu = cp->dtrc_cpu;
+		buf.dtbd_errors = cp->dtrc_errors;
+		buf.dtbd_drops = cp->dtrc_drops;
+		buf.dtbd_data = (caddr_t)(cp + 1);
+		buf.dtbd_timestamp = cp->dtrc_timestamp;
+
+		if (dt_consume_buf(dtp, fp, &buf, pf, rf, arg) != 0)
+			goto out;
+	}
+
+	rval = 0;
+out:
+	dt_epid_destroy(dtp);
+	dt_format_destroy(dtp);
+	dt_strdata_destroy(dtp);
+	dtp->dt_replay = NULL;
+	dt_ring_free(dtp, rp);
+
+	return (rval);
+}
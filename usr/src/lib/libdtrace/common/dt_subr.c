@@ -470,6 +470,9 @@ dt_ioctl(dtrace_hdl_t *dtp, int val, void *arg)
 {
 	const dtrace_vector_t *v = dtp->dt_vector;
 
+	if (dtp->dt_replay != NULL)
+		return (dt_ring_ioctl(dtp, val, arg));
+
 	if (v != NULL)
 		return (v->dtv_ioctl(dtp->dt_varg, val, arg));
 
@@ -203,6 +203,10 @@ typedef int dtrace_consume_rec_f(const dtrace_probedata_t *,
 extern int dtrace_consume(dtrace_hdl_t *, FILE *,
     dtrace_consume_probe_f *, dtrace_consume_rec_f *, void *);
 
+extern int dtrace_ring_open(dtrace_hdl_t *, const char *, size_t);
+extern int dtrace_ring_replay(dtrace_hdl_t *, const char *, FILE *,
+    dtrace_consume_probe_f *, dtrace_consume_rec_f *, void *);
+
 #define	DTRACE_STATUS_NONE	0	/* no status; not yet time */
 #define	DTRACE_STATUS_OKAY	1	/* status okay */
 #define	DTRACE_STATUS_EXITED	2	/* exit() was called; tracing stopped */
@@ -298,7 +302,10 @@ typedef enum {
 	DTRACEDROP_SPECBUSY,			/* spec drop due to busy */
 	DTRACEDROP_SPECUNAVAIL,			/* spec drop due to unavail */
 	DTRACEDROP_STKSTROVERFLOW,		/* stack string tab overflow */
-	DTRACEDROP_DBLERROR			/* error in ERROR probe */
+	DTRACEDROP_DBLERROR,			/* error in ERROR probe */
+	DTRACEDROP_AGGSCALAR,			/* agg drop, integer key */
+	DTRACEDROP_AGGSTRING,			/* agg drop, string key */
+	DTRACEDROP_AGGSTACK			/* agg drop, stack key */
 } dtrace_dropkind_t;
 
 typedef struct dtrace_dropdata {
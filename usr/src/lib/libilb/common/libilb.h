@@ -136,7 +136,8 @@ typedef enum {
 	ILB_ALG_ROUNDROBIN = 1,
 	ILB_ALG_HASH_IP,
 	ILB_ALG_HASH_IP_SPORT,
-	ILB_ALG_HASH_IP_VIP
+	ILB_ALG_HASH_IP_VIP,
+	ILB_ALG_MAGLEV
 } ilb_algo_t;
 
 /* Supported load balancing method */
@@ -166,6 +166,70 @@ kstat_read(kstat_ctl_t *kc, kstat_t *ksp, void *data)
 	return (kcid);
 }
 
+/*
+ * Read the data of each of the n kstats in ksps, as kstat_read(kc, ksp,
+ * NULL) would, but with as few calls into the kstat driver as possible.
+ */
+kid_t
+kstat_read_bulk(kstat_ctl_t *kc, kstat_t **ksps, uint_t n)
+{
+	kstat_bulk_t kb;
+	kstat_t *hdrs, *ksp;
+	kid_t kcid = kc->kc_chain_id;
+	uint_t i, done;
+
+	if (n == 0)
+		return (kcid);
+
+	if ((hdrs = malloc(n * sizeof (kstat_t))) == NULL)
+		return (-1);
+
+	for (i = 0; i < n; i++) {
+		ksp = ksps[i];
+		if (ksp->ks_data == NULL && ksp->ks_data_size > 0) {
+			kstat_zalloc(&ksp->ks_data, ksp->ks_data_size, 0);
+			if (ksp->ks_data == NULL) {
+				free(hdrs);
+				return (-1);
+			}
+		}
+		hdrs[i] = *ksp;
+	}
+
+	for (done = 0; done < n; done++) {
+		kb.kb_count = n - done;
+		kb.kb_done = 0;
+		kb.kb_ksp = &hdrs[done];
+		kcid = (kid_t)ioctl(kc->kc_kd, KSTAT_IOC_READ_BULK, &kb);
+
+		/*
+		 * The driver updates each header it reads, and the one it
+		 * fails on, in our copies; bring those back.
+		 */
+		for (i = done; i < n && i <= done + kb.kb_done; i++) {
+			ksps[i]->ks_ndata = hdrs[i].ks_ndata;
+			ksps[i]->ks_data_size = hdrs[i].ks_data_size;
+			ksps[i]->ks_flags = hdrs[i].ks_flags;
+			ksps[i]->ks_snaptime = hdrs[i].ks_snaptime;
+		}
+		done += kb.kb_done;
+		if (kcid != -1)
+			break;
+
+		/*
+		 * Leave the kstat that failed to kstat_read(), which knows
+		 * how to wait out EAGAIN and to grow the buffer of a
+		 * variable-size kstat.  On a kernel without the bulk ioctl
+		 * this reads every kstat in turn.
+		 */
+		if ((kcid = kstat_read(kc, ksps[done], NULL)) == -1)
+			break;
+	}
+
+	free(hdrs);
+	return (kcid);
+}
+
 kid_t
 kstat_write(kstat_ctl_t *kc, kstat_t *ksp, void *data)
 {
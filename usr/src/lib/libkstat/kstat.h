@@ -49,6 +49,7 @@ typedef struct kstat_ctl {
 extern	kstat_ctl_t	*kstat_open(void);
 extern	int		kstat_close(kstat_ctl_t *);
 extern	kid_t		kstat_read(kstat_ctl_t *, kstat_t *, void *);
+extern	kid_t		kstat_read_bulk(kstat_ctl_t *, kstat_t **, uint_t);
 extern	kid_t		kstat_write(kstat_ctl_t *, kstat_t *, void *);
 extern	kid_t		kstat_chain_update(kstat_ctl_t *);
 extern	kstat_t		*kstat_lookup(kstat_ctl_t *, char *, int, char *);
@@ -57,6 +58,7 @@ extern	void		*kstat_data_lookup(kstat_t *, char *);
 extern	kstat_ctl_t	*kstat_open();
 extern	int		kstat_close();
 extern	kid_t		kstat_read();
+extern	kid_t		kstat_read_bulk();
 extern	kid_t		kstat_write();
 extern	kid_t		kstat_chain_update();
 extern	kstat_t		*kstat_lookup();
@@ -43,6 +43,21 @@
 #include <sys/dumphdr.h>
 #include <sys/sysmacros.h>
 
+/*
+ * Translations from (as, page) to the page's offset in a crash dump are
+ * cached, since finding one walks a hash chain through the dump map --
+ * which, for a large dump, means faulting in pages scattered across
+ * gigabytes of map.  An offset of 0 caches a page that isn't in the dump.
+ */
+#define	KVM_XCACHE_SIZE		8192	/* translations cached, power of 2 */
+#define	KVM_XCACHE_EMPTY	(-1ULL)	/* not a page-aligned address */
+
+typedef struct kvm_xlate {
+	struct as	*kx_as;
+	uint64_t	kx_page;
+	offset_t	kx_off;
+} kvm_xlate_t;
+
 struct _kvmd {
 	struct dumphdr	kvm_dump;
 	char		*kvm_debug;
@@ -60,6 +75,7 @@ struct _kvmd {
 	char		kvm_namelist[MAXNAMELEN + 1];
 	boolean_t	kvm_namelist_core;
 	proc_t		kvm_proc;
+	kvm_xlate_t	*kvm_xcache;
 };
 
 #define	PREAD	(ssize_t (*)(int, void *, size_t, offset_t))pread64
@@ -192,6 +208,7 @@ kvm_close(kvm_t *kd)
 {
 	if (kd->kvm_core != NULL && kd->kvm_core != MAP_FAILED)
 		(void) munmap(kd->kvm_core, kd->kvm_coremapsize);
+	free(kd->kvm_xcache);
 	if (kd->kvm_corefd != -1)
 		(void) close(kd->kvm_corefd);
 	if (kd->kvm_kmemfd != -1)
@@ -335,6 +352,70 @@ kvm_lookup(kvm_t *kd, struct as *as, uint64_t addr)
 	return (off);
 }
 
+/*
+ * kvm_lookup(), by way of the translation cache.
+ */
+static offset_t
+kvm_xlate(kvm_t *kd, struct as *as, uint64_t addr)
+{
+	uintptr_t pageoff = addr & (kd->kvm_dump.dump_pagesize - 1);
+	uint64_t page = addr - pageoff;
+	kvm_xlate_t *kx;
+	int i;
+
+	if (kd->kvm_xcache == NULL) {
+		if ((kd->kvm_xcache = malloc(KVM_XCACHE_SIZE *
+		    sizeof (kvm_xlate_t))) == NULL)
+			return (kvm_lookup(kd, as, addr));
+		for (i = 0; i < KVM_XCACHE_SIZE; i++)
+			kd->kvm_xcache[i].kx_page = KVM_XCACHE_EMPTY;
+	}
+
+	kx = &kd->kvm_xcache[((page >> kd->kvm_dump.dump_pageshift) ^
+	    ((uintptr_t)as >> 4)) & (KVM_XCACHE_SIZE - 1)];
+
+	if (kx->kx_page != page || kx->kx_as != as) {
+		kx->kx_as = as;
+		kx->kx_page = page;
+		kx->kx_off = kvm_lookup(kd, as, page);
+	}
+
+	return (kx->kx_off != 0 ? kx->kx_off + pageoff : 0);
+}
+
+/*
+ * Before copying a read of several pages out of the mapped dump, tell
+ * the system which pages of the file we're about to touch, so that it
+ * can read them in together rather than one fault at a time.
+ */
+static void
+kvm_prefetch(kvm_t *kd, struct as *as, uint64_t addr, size_t size)
+{
+	size_t pagesize = kd->kvm_dump.dump_pagesize;
+	uint64_t end = addr + size;
+	offset_t off, start = 0, last = 0;
+
+	for (addr &= ~(uint64_t)(pagesize - 1); addr < end; addr += pagesize) {
+		if ((off = kvm_xlate(kd, as, addr)) == 0 ||
+		    off + pagesize > kd->kvm_coremapsize)
+			break;
+		if (start != 0 && off == last + pagesize) {
+			last = off;
+			continue;
+		}
+		if (start != 0) {
+			(void) madvise(kd->kvm_core + start,
+			    last + pagesize - start, MADV_WILLNEED);
+		}
+		start = last = off;
+	}
+
+	if (start != 0) {
+		(void) madvise(kd->kvm_core + start, last + pagesize - start,
+		    MADV_WILLNEED);
+	}
+}
+
 static ssize_t
 kvm_rw(kvm_t *kd, uint64_t addr, void *buf, size_t size,
 	struct as *as, ssize_t (*prw)(int, void *, size_t, offset_t))
@@ -366,11 +447,14 @@ kvm_rw(kvm_t *kd, uint64_t addr, void *buf, size_t size,
 		return (rval);
 	}
 
+	if (prw == PREAD && size > kd->kvm_dump.dump_pagesize)
+		kvm_prefetch(kd, as, addr, size);
+
 	while (resid != 0) {
 		uintptr_t pageoff = addr & (kd->kvm_dump.dump_pagesize - 1);
 		ssize_t len = MIN(resid, kd->kvm_dump.dump_pagesize - pageoff);
 
-		if ((off = kvm_lookup(kd, as, addr)) == 0)
+		if ((off = kvm_xlate(kd, as, addr)) == 0)
 			break;
 
 		if (prw == PREAD && off < kd->kvm_coremapsize)
@@ -458,7 +542,7 @@ kvm_physaddr(kvm_t *kd, struct as *as, uintptr_t addr)
 			return ((uint64_t)mem_vtop.m_pfn * getpagesize() +
 			    (addr & (getpagesize() - 1)));
 	} else {
-		if ((off = kvm_lookup(kd, as, addr)) != 0) {
+		if ((off = kvm_xlate(kd, as, addr)) != 0) {
 			long pfn_index =
 			    (u_offset_t)(off - kd->kvm_dump.dump_data) >>
 			    kd->kvm_dump.dump_pageshift;
@@ -37,6 +37,7 @@
 #include <strings.h>
 #include <sys/param.h>
 #include <sys/sysmacros.h>
+#include <sys/mman.h>
 
 /*
  * To turn on the asserts just compile -DDEBUG
@@ -62,7 +63,9 @@
  *
  * Once the thread is vectored into one of the list of caches the real
  * allocation of the memory begins. The size is determined to figure out which
- * bucket the allocation should be satisfied from. The management of free
+ * bucket the allocation should be satisfied from.  Above 16 bytes there are
+ * two buckets for each power of two, 2^^n and 3 * 2^^(n-1), so that no more
+ * than a third of a buffer is lost to rounding up. The management of free
  * buckets is done via a bitmask. A free bucket is represented by a 1. The
  * first free bit represents the first free bucket. The position of the bit,
  * represents the position of the bucket in the arena.
@@ -91,7 +94,10 @@
  * (&oversize_list), plus an oversize_t structure to further describe the block.
  *
  * The oversize list is kept as defragmented as possible by coalescing
- * freed oversized allocations with adjacent neighbors.
+ * freed oversized allocations with adjacent neighbors.  The whole pages
+ * of a large freed block are handed back to the system with
+ * madvise(MADV_FREE), so that memory the application no longer uses
+ * does not stay resident; they are faulted back in when reused.
  *
  * Addresses handed out are stored in a hash table, and are aligned on
  * MTMALLOC_MIN_ALIGN-byte boundaries at both ends. Request sizes are rounded-up
@@ -124,6 +130,7 @@ static void copy_pattern(uint32_t, void *, size_t);
 static void * verify_pattern(uint32_t, void *, size_t);
 static void reinit_cpu_list(void);
 static void reinit_cache(cache_t *);
+static void release_pages(void *, size_t);
 static void free_oversize(oversize_t *);
 static oversize_t *oversize_header_alloc(uintptr_t, size_t);
 
@@ -161,7 +168,7 @@ oversize_t *ovsz_hashtab[NUM_BUCKETS];
 #define	MAX_MTMALLOC	(SIZE_MAX - (SIZE_MAX % MTMALLOC_MIN_ALIGN) \
 			- OVSZ_HEADER_SIZE)
 
-#define	NUM_CACHES	(MAX_CACHED_SHIFT - MIN_CACHED_SHIFT + 1)
+#define	NUM_CACHES	(2 * (MAX_CACHED_SHIFT - MIN_CACHED_SHIFT) + 1)
 #define	CACHELIST_SIZE	ALIGN(NUM_CACHES * sizeof (cache_head_t), \
     CACHE_COHERENCY_UNIT)
 
@@ -176,6 +183,10 @@ oversize_t *ovsz_hashtab[NUM_BUCKETS];
 
 static long requestsize = MINSIZE; /* 9 pages per cache; tunable; 9 is min */
 
+/* freed oversize blocks at least this big have their pages released */
+static size_t release_min = 256 * 1024;
+static size_t pagesz;
+
 static uint_t cpu_mask;
 static curcpu_func curcpu;
 
@@ -391,6 +402,8 @@ free(void * ptr)
 
 		if (debugopt & MTDEBUGPATTERN)
 			copy_pattern(FREEPATTERN, ptr, big->size);
+		else
+			release_pages(ptr, big->size);
 		add_oversize(big);
 		(void) mutex_unlock(&oversize_lock);
 		return;
@@ -798,6 +811,8 @@ setup_caches(void)
 
 	new_cpu_mask = ncpus - 1;	/* create the cpu mask */
 
+	pagesz = sysconf(_SC_PAGESIZE);
+
 	/*
 	 * We now do some magic with the brk.  What we want to get in the
 	 * end is a bunch of well-aligned stuff in a big initial allocation.
@@ -999,6 +1014,7 @@ malloc_internal(size_t size, percpu_t *cpuptr)
 	cache_head_t *cachehead;
 	cache_t *thiscache, *hintcache;
 	int32_t i, n, logsz, bucket;
+	size_t bufsize;
 	uint32_t index;
 	uint32_t *freeblocks; /* not a uintptr_t on purpose */
 	caddr_t ret;
@@ -1008,7 +1024,16 @@ malloc_internal(size_t size, percpu_t *cpuptr)
 	while (size > (1 << logsz))
 		logsz++;
 
-	bucket = logsz - MIN_CACHED_SHIFT;
+	/*
+	 * Sizes up to three quarters of 1 << logsz go to the bucket
+	 * between it and the power of two below.
+	 */
+	bucket = 2 * (logsz - MIN_CACHED_SHIFT);
+	bufsize = 1 << logsz;
+	if (logsz > MIN_CACHED_SHIFT && size <= 3 << (logsz - 2)) {
+		bucket--;
+		bufsize = 3 << (logsz - 2);
+	}
 
 	(void) mutex_lock(&cpuptr->mt_parent_lock);
 
@@ -1048,7 +1073,7 @@ malloc_internal(size_t size, percpu_t *cpuptr)
 
 	if (thiscache == NULL) { /* there are no free caches */
 		int32_t thisrequest = requestsize;
-		int32_t buffer_size = (1 << logsz) + OVERHEAD;
+		int32_t buffer_size = bufsize + OVERHEAD;
 
 		thiscache = (cache_t *)morecore(thisrequest * HUNKSIZE);
 
@@ -1452,6 +1477,27 @@ verify_pattern(uint32_t pattern, void *buf_arg, size_t size)
 	return (NULL);
 }
 
+/*
+ * Let the system reclaim the whole pages of a large block that has been
+ * freed.  This must be done under oversize_lock, before the block is put
+ * back on the free list, or the pages could be discarded after another
+ * thread had allocated and written them.  Blocks freed with MTDEBUGPATTERN
+ * set keep their pages, since their contents are checked on reuse.
+ */
+static void
+release_pages(void *buf, size_t size)
+{
+	uintptr_t start, end;
+
+	if (size < release_min)
+		return;
+
+	start = ALIGN(buf, pagesz);
+	end = ((uintptr_t)buf + size) & ~(pagesz - 1);
+	if (start < end)
+		(void) madvise((caddr_t)start, end - start, MADV_FREE);
+}
+
 static void
 free_oversize(oversize_t *ovp)
 {
@@ -130,6 +130,24 @@ typedef struct map_info {	/* description of an address space mapping */
 	int map_relocate;	/* associated file_map needs to be relocated */
 } map_info_t;
 
+/*
+ * Recent address-to-symbol lookups, so that symbolizing many stacks that
+ * share frames doesn't search the symbol tables again for every frame.
+ * An entry with a NULL ac_file records a failed lookup.  The cache holds
+ * pointers into the file_info_t list and so is emptied whenever the
+ * mappings are read again or discarded.
+ */
+typedef struct addr_cache {
+	uintptr_t ac_addr;	/* address looked up (0 for an empty slot) */
+	file_info_t *ac_file;	/* file containing the symbol, or NULL */
+	GElf_Sym ac_sym;	/* symbol table entry, not relocated */
+	char	*ac_name;	/* symbol name */
+	uint_t	ac_id;		/* symbol index */
+	uint_t	ac_table;	/* PR_SYMTAB or PR_DYNSYM */
+} addr_cache_t;
+
+#define	ADDR_CACHE_SIZE		512	/* address cache size, power of 2 */
+
 typedef struct lwp_info {	/* per-lwp information from core file */
 	plist_t	lwp_list;	/* linked list */
 	lwpid_t	lwp_id;		/* lwp identifier */
@@ -222,6 +240,7 @@ struct ps_prochandle {
 	rd_agent_t *rap;	/* cookie for rtld_db */
 	map_info_t *map_exec;	/* the mapping for the executable file */
 	map_info_t *map_ldso;	/* the mapping for ld.so.1 */
+	addr_cache_t *addr_cache;	/* recent address lookups */
 	ps_ops_t ops;		/* ops-vector */
 	uintptr_t *ucaddrs;	/* ucontext-list addresses */
 	uint_t	ucnelems;	/* number of elements in the ucaddrs list */
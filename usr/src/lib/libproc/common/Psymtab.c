@@ -236,6 +236,19 @@ file_info_new(struct ps_prochandle *P, map_info_t *mptr)
 	return (fptr);
 }
 
+/*
+ * Discard the address lookup cache.  This must be done whenever the
+ * mappings or the file_info_t's it points into may have changed.
+ */
+static void
+addr_cache_flush(struct ps_prochandle *P)
+{
+	if (P->addr_cache != NULL) {
+		free(P->addr_cache);
+		P->addr_cache = NULL;
+	}
+}
+
 /*
  * Deallocation function for a file_info_t
  */
@@ -243,6 +256,7 @@ static void
 file_info_free(struct ps_prochandle *P, file_info_t *fptr)
 {
 	if (--fptr->file_ref == 0) {
+		addr_cache_flush(P);
 		list_unlink(fptr);
 		if (fptr->file_symtab.sym_elf) {
 			(void) elf_end(fptr->file_symtab.sym_elf);
@@ -466,6 +480,8 @@ Pupdate_maps(struct ps_prochandle *P)
 	if (Preadmaps(P, &Pmap, &nmap) != 0)
 		return;
 
+	addr_cache_flush(P);
+
 	if ((newmap = calloc(1, nmap * sizeof (map_info_t))) == NULL)
 		return;
 
@@ -590,6 +606,7 @@ rd_agent_t *
 Prd_agent(struct ps_prochandle *P)
 {
 	if (P->rap == NULL && P->state != PS_DEAD && P->state != PS_IDLE) {
+		addr_cache_flush(P);
 		Pupdate_maps(P);
 		if (P->num_files == 0)
 			load_static_maps(P);
@@ -2402,32 +2419,65 @@ i_Pxlookup_by_addr(
 	uint_t		i2;
 	map_info_t	*mptr;
 	file_info_t	*fptr;
+	addr_cache_t	*acp = NULL;
+	uintptr_t	off;
 
 	(void) Prd_agent(P);
 
+	/*
+	 * Stacks symbolized one after another tend to share most of their
+	 * frames, so look in the cache of recent lookups first.  Address 0
+	 * marks an empty slot and is never cached.
+	 */
+	if (addr != 0 && (P->addr_cache != NULL || (P->addr_cache =
+	    calloc(ADDR_CACHE_SIZE, sizeof (addr_cache_t))) != NULL)) {
+		acp = &P->addr_cache[((addr >> 2) ^ (addr >> 12)) &
+		    (ADDR_CACHE_SIZE - 1)];
+	}
+
+	if (acp != NULL && acp->ac_addr == addr) {
+		if ((fptr = acp->ac_file) == NULL)
+			return (-1);
+		symp = &acp->ac_sym;
+		name = acp->ac_name;
+		goto found;
+	}
+
 	if ((mptr = Paddr2mptr(P, addr)) == NULL ||	/* no such address */
 	    (fptr = build_map_symtab(P, mptr)) == NULL || /* no mapped file */
 	    fptr->file_elf == NULL)			/* not an ELF file */
-		return (-1);
+		goto notfound;
 
 	/*
 	 * Adjust the address by the load object base address in
 	 * case the address turns out to be in a shared library.
 	 */
-	addr -= fptr->file_dyn_base;
+	off = addr - fptr->file_dyn_base;
 
 	/*
 	 * Search both symbol tables, symtab first, then dynsym.
 	 */
-	if ((sym1p = sym_by_addr(&fptr->file_symtab, addr, &sym1, &i1)) != NULL)
+	if ((sym1p = sym_by_addr(&fptr->file_symtab, off, &sym1, &i1)) != NULL)
 		name1 = fptr->file_symtab.sym_strs + sym1.st_name;
-	if ((sym2p = sym_by_addr(&fptr->file_dynsym, addr, &sym2, &i2)) != NULL)
+	if ((sym2p = sym_by_addr(&fptr->file_dynsym, off, &sym2, &i2)) != NULL)
 		name2 = fptr->file_dynsym.sym_strs + sym2.st_name;
 
 	if ((symp = sym_prefer(sym1p, name1, sym2p, name2)) == NULL)
-		return (-1);
+		goto notfound;
 
 	name = (symp == sym1p) ? name1 : name2;
+
+	if (acp != NULL) {
+		acp->ac_addr = addr;
+		acp->ac_file = fptr;
+		acp->ac_sym = *symp;
+		acp->ac_name = name;
+		acp->ac_id = (symp == sym1p) ? i1 : i2;
+		acp->ac_table = (symp == sym1p) ? PR_SYMTAB : PR_DYNSYM;
+		symp = &acp->ac_sym;
+	}
+
+found:
 	if (bufsize > 0) {
 		(void) strncpy(sym_name_buffer, name, bufsize);
 		sym_name_buffer[bufsize - 1] = '\0';
@@ -2440,8 +2490,14 @@ i_Pxlookup_by_addr(
 			sip->prs_object = fptr->file_rbase;
 		else
 			sip->prs_object = fptr->file_lbase;
-		sip->prs_id = (symp == sym1p) ? i1 : i2;
-		sip->prs_table = (symp == sym1p) ? PR_SYMTAB : PR_DYNSYM;
+		if (acp != NULL) {
+			sip->prs_id = acp->ac_id;
+			sip->prs_table = acp->ac_table;
+		} else {
+			sip->prs_id = (symp == sym1p) ? i1 : i2;
+			sip->prs_table = (symp == sym1p) ?
+			    PR_SYMTAB : PR_DYNSYM;
+		}
 		sip->prs_lmid = (fptr->file_lo == NULL) ? LM_ID_BASE :
 		    fptr->file_lo->rl_lmident;
 	}
@@ -2450,6 +2506,13 @@ i_Pxlookup_by_addr(
 		symbolp->st_value += fptr->file_dyn_base;
 
 	return (0);
+
+notfound:
+	if (acp != NULL) {
+		acp->ac_addr = addr;
+		acp->ac_file = NULL;
+	}
+	return (-1);
 }
 
 int
@@ -2985,6 +3048,7 @@ Preset_maps(struct ps_prochandle *P)
 	}
 	P->map_count = P->map_alloc = 0;
 
+	addr_cache_flush(P);
 	P->info_valid = 0;
 }
 
@@ -235,8 +235,8 @@ static const char *const systable[] = {
 	"fchdir",		/* 120 */
 	"readv",		/* 121 */
 	"writev",		/* 122 */
-	NULL,			/* 123 */
-	NULL,			/* 124 */
+	"recvmmsg",		/* 123 */
+	"sendmmsg",		/* 124 */
 	NULL,			/* 125 */
 	NULL,			/* 126 */
 	"mmapobj",		/* 127 */
@@ -49,8 +49,10 @@
 #pragma weak shutdown = _shutdown
 #pragma weak recv = _recv
 #pragma weak recvfrom = _recvfrom
+#pragma weak recvmmsg = _recvmmsg
 #pragma weak recvmsg = _recvmsg
 #pragma weak send = _send
+#pragma weak sendmmsg = _sendmmsg
 #pragma weak sendmsg = _sendmsg
 #pragma weak sendto = _sendto
 #pragma weak getpeername = _getpeername
@@ -65,8 +67,10 @@ extern int _so_connect();
 extern int _so_shutdown();
 extern int _so_recv();
 extern int _so_recvfrom();
+extern int _so_recvmmsg();
 extern int _so_recvmsg();
 extern int _so_send();
+extern int _so_sendmmsg();
 extern int _so_sendmsg();
 extern int _so_sendto();
 extern int _so_getpeername();
@@ -134,6 +138,13 @@ _recvmsg(int sock, struct msghdr *msg, int flags)
 	return (_so_recvmsg(sock, msg, flags & ~MSG_XPG4_2));
 }
 
+int
+_recvmmsg(int sock, struct mmsghdr *vec, unsigned int vlen, int flags,
+    struct timespec *timeout)
+{
+	return (_so_recvmmsg(sock, vec, vlen, flags & ~MSG_XPG4_2, timeout));
+}
+
 int
 _send(int sock, char *buf, int len, int flags)
 {
@@ -146,6 +157,12 @@ _sendmsg(int sock, struct msghdr *msg, int flags)
 	return (_so_sendmsg(sock, msg, flags & ~MSG_XPG4_2));
 }
 
+int
+_sendmmsg(int sock, struct mmsghdr *vec, unsigned int vlen, int flags)
+{
+	return (_so_sendmmsg(sock, vec, vlen, flags & ~MSG_XPG4_2));
+}
+
 int
 _sendto(int sock, char *buf, int len, int flags,
 	struct sockaddr *addr, int *addrlen)
@@ -248,6 +265,19 @@ __xnet_sendmsg(int sock, const struct msghdr *msg, int flags)
 	return (_so_sendmsg(sock, msg, flags | MSG_XPG4_2));
 }
 
+int
+__xnet_recvmmsg(int sock, struct mmsghdr *vec, unsigned int vlen, int flags,
+    struct timespec *timeout)
+{
+	return (_so_recvmmsg(sock, vec, vlen, flags | MSG_XPG4_2, timeout));
+}
+
+int
+__xnet_sendmmsg(int sock, struct mmsghdr *vec, unsigned int vlen, int flags)
+{
+	return (_so_sendmmsg(sock, vec, vlen, flags | MSG_XPG4_2));
+}
+
 int
 __xnet_sendto(int sock, const void *buf, size_t len, int flags,
 	const struct sockaddr *addr, socklen_t addrlen)
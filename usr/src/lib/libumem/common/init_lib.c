@@ -34,6 +34,9 @@
 #include "vmem_base.h"
 #include <unistd.h>
 #include <dlfcn.h>
+#include <schedctl.h>
+#include <sys/schedctl.h>
+#include <stddef.h>
 
 void
 vmem_heap_init(void)
@@ -69,3 +72,22 @@ umem_get_max_ncpus(void)
 	else
 		return (1);
 }
+
+/*
+ * The CPU this thread last ran on, or failing that its thread ID.  The
+ * schedctl_t handed out is the sc_preemptctl member of the thread's
+ * sc_shared_t, which also holds the CPU.
+ */
+uint_t
+umem_get_cpuhint(void)
+{
+	schedctl_t *sc;
+	sc_shared_t *ssp;
+
+	if ((sc = schedctl_init()) == NULL)
+		return ((uint_t)thr_self());
+
+	ssp = (sc_shared_t *)((uintptr_t)sc -
+	    offsetof(sc_shared_t, sc_preemptctl));
+	return ((uint_t)ssp->sc_cpu);
+}
@@ -57,6 +57,12 @@ umem_get_max_ncpus(void)
 	return (1);
 }
 
+uint_t
+umem_get_cpuhint(void)
+{
+	return (0);
+}
+
 int
 umem_add(caddr_t base, size_t len)
 {
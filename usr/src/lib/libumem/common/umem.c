@@ -155,7 +155,14 @@
  * with either umem_cpu_mask or cp->cache_cpu_mask to find the actual "cpu" id.
  * The mechanics of this is all in the CPU(mask) macro.
  *
- * Currently, umem uses _lwp_self() as its hint.
+ * The hint is umem_get_cpuhint().  The library uses the CPU the thread last
+ * ran on, which the kernel keeps in the thread's schedctl page.  Threads
+ * sharing a CPU seldom run at the same moment, so unlike a hash of the
+ * thread ID -- which it falls back to -- this seldom has two threads
+ * contending for the same cpu cache's cc_lock.  A thread can migrate
+ * between reading the hint and taking the lock; that costs contention,
+ * not correctness.  (Per-thread caching of small malloc(3C) buffers,
+ * which needs no lock at all, is described in section 8.)
  *
  *
  * 4. The update thread
@@ -750,7 +757,7 @@ umem_log_header_t *umem_content_log;
 umem_log_header_t *umem_failure_log;
 umem_log_header_t *umem_slab_log;
 
-#define	CPUHINT()		(thr_self())
+#define	CPUHINT()		(umem_get_cpuhint())
 #define	CPUHINT_MAX()		INT_MAX
 
 #define	CPU(mask)		(umem_cpus + (CPUHINT() & (mask)))
@@ -119,6 +119,7 @@ extern void _umem_cache_free(umem_cache_t *cache, void *buffer);
  */
 extern void umem_type_init(caddr_t, size_t, size_t);
 extern int umem_get_max_ncpus(void);
+extern uint_t umem_get_cpuhint(void);
 extern void umem_process_updates(void);
 extern void umem_cache_applyall(void (*)(umem_cache_t *));
 extern void umem_cache_update(umem_cache_t *);
@@ -381,16 +381,17 @@ get_recvd_props_ioctl(zfs_handle_t *zhp)
 	return (0);
 }
 
+/*
+ * Install the given stats and properties in the handle, which takes
+ * ownership of allprops.
+ */
 static int
-put_stats_zhdl(zfs_handle_t *zhp, zfs_cmd_t *zc)
+put_stats_props(zfs_handle_t *zhp, const dmu_objset_stats_t *dds,
+    nvlist_t *allprops)
 {
-	nvlist_t *allprops, *userprops;
-
-	zhp->zfs_dmustats = zc->zc_objset_stats; /* structure assignment */
+	nvlist_t *userprops;
 
-	if (zcmd_read_dst_nvlist(zhp->zfs_hdl, zc, &allprops) != 0) {
-		return (-1);
-	}
+	zhp->zfs_dmustats = *dds; /* structure assignment */
 
 	/*
 	 * XXX Why do we store the user props separately, in addition to
@@ -410,6 +411,17 @@ put_stats_zhdl(zfs_handle_t *zhp, zfs_cmd_t *zc)
 	return (0);
 }
 
+static int
+put_stats_zhdl(zfs_handle_t *zhp, zfs_cmd_t *zc)
+{
+	nvlist_t *allprops;
+
+	if (zcmd_read_dst_nvlist(zhp->zfs_hdl, zc, &allprops) != 0)
+		return (-1);
+
+	return (put_stats_props(zhp, &zc->zc_objset_stats, allprops));
+}
+
 static int
 get_stats(zfs_handle_t *zhp)
 {
@@ -440,11 +452,8 @@ zfs_refresh_properties(zfs_handle_t *zhp)
  * zfs_iter_* to create child handles on the fly.
  */
 static int
-make_dataset_handle_common(zfs_handle_t *zhp, zfs_cmd_t *zc)
+make_dataset_handle_type(zfs_handle_t *zhp)
 {
-	if (put_stats_zhdl(zhp, zc) != 0)
-		return (-1);
-
 	/*
 	 * We've managed to open the dataset and gather statistics.  Determine
 	 * the high-level type.
@@ -471,6 +480,15 @@ make_dataset_handle_common(zfs_handle_t *zhp, zfs_cmd_t *zc)
 	return (0);
 }
 
+static int
+make_dataset_handle_common(zfs_handle_t *zhp, zfs_cmd_t *zc)
+{
+	if (put_stats_zhdl(zhp, zc) != 0)
+		return (-1);
+
+	return (make_dataset_handle_type(zhp));
+}
+
 zfs_handle_t *
 make_dataset_handle(libzfs_handle_t *hdl, const char *path)
 {
@@ -517,6 +535,45 @@ make_dataset_handle_zc(libzfs_handle_t *hdl, zfs_cmd_t *zc)
 	return (zhp);
 }
 
+/*
+ * Makes a handle from one entry of a ZFS_IOC_LIST_BATCH result.
+ */
+zfs_handle_t *
+make_dataset_handle_nvl(libzfs_handle_t *hdl, const char *name,
+    nvlist_t *entry)
+{
+	zfs_handle_t *zhp;
+	dmu_objset_stats_t *dds;
+	nvlist_t *props, *allprops;
+	uint_t len;
+
+	if (nvlist_lookup_uint8_array(entry, "stats", (uint8_t **)&dds,
+	    &len) != 0 || len != sizeof (dmu_objset_stats_t))
+		return (NULL);
+
+	if ((zhp = calloc(sizeof (zfs_handle_t), 1)) == NULL)
+		return (NULL);
+
+	zhp->zfs_hdl = hdl;
+	(void) strlcpy(zhp->zfs_name, name, sizeof (zhp->zfs_name));
+
+	if (nvlist_lookup_nvlist(entry, "props", &props) != 0)
+		props = NULL;
+	if (props != NULL ? nvlist_dup(props, &allprops, 0) != 0 :
+	    nvlist_alloc(&allprops, NV_UNIQUE_NAME, 0) != 0) {
+		(void) no_memory(hdl);
+		free(zhp);
+		return (NULL);
+	}
+
+	if (put_stats_props(zhp, dds, allprops) != 0 ||
+	    make_dataset_handle_type(zhp) != 0) {
+		zfs_close(zhp);
+		return (NULL);
+	}
+	return (zhp);
+}
+
 zfs_handle_t *
 zfs_handle_dup(zfs_handle_t *zhp_orig)
 {
@@ -1063,6 +1120,20 @@ zfs_valid_proplist(libzfs_handle_t *hdl, zfs_type_t type, nvlist_t *nvl,
 			}
 			break;
 
+		case ZFS_PROP_SPECIAL_SMALL_BLOCKS:
+			/* zero, or a power of two up to SPA_MAXBLOCKSIZE */
+			if (intval != 0 && (intval < SPA_MINBLOCKSIZE ||
+			    intval > SPA_MAXBLOCKSIZE || !ISP2(intval))) {
+				zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+				    "'%s' must be zero or a power of 2 from "
+				    "%u to %uk"), propname,
+				    (uint_t)SPA_MINBLOCKSIZE,
+				    (uint_t)SPA_MAXBLOCKSIZE >> 10);
+				(void) zfs_error(hdl, EZFS_BADPROP, errbuf);
+				goto error;
+			}
+			break;
+
 		case ZFS_PROP_MLSLABEL:
 		{
 			/*
@@ -1869,6 +1940,7 @@ get_numeric_property(zfs_handle_t *zhp, zfs_prop_t prop, zprop_source_t *src,
 	case ZFS_PROP_REFQUOTA:
 	case ZFS_PROP_RESERVATION:
 	case ZFS_PROP_REFRESERVATION:
+	case ZFS_PROP_PRIMARYCACHE_LIMIT:
 	case ZFS_PROP_FILESYSTEM_LIMIT:
 	case ZFS_PROP_SNAPSHOT_LIMIT:
 	case ZFS_PROP_FILESYSTEM_COUNT:
@@ -2254,6 +2326,7 @@ zfs_prop_get(zfs_handle_t *zhp, zfs_prop_t prop, char *propbuf, size_t proplen,
 	case ZFS_PROP_REFQUOTA:
 	case ZFS_PROP_RESERVATION:
 	case ZFS_PROP_REFRESERVATION:
+	case ZFS_PROP_PRIMARYCACHE_LIMIT:
 
 		if (get_numeric_property(zhp, prop, src, &source, &val) != 0)
 			return (-1);
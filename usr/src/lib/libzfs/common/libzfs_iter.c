@@ -57,44 +57,91 @@ zfs_iter_clones(zfs_handle_t *zhp, zfs_iter_f func, void *data)
 	return (0);
 }
 
+/*
+ * Number of datasets requested per ZFS_IOC_LIST_BATCH call.
+ */
+#define	ZFS_ITER_BATCH	256
+
+/*
+ * Iterate over the child filesystems or the snapshots of zhp, fetching
+ * them from the kernel a batch at a time.
+ */
 static int
-zfs_do_list_ioctl(zfs_handle_t *zhp, int arg, zfs_cmd_t *zc)
+zfs_iter_batch(zfs_handle_t *zhp, boolean_t snapshots, zfs_iter_f func,
+    void *data)
 {
-	int rc;
-	uint64_t	orig_cookie;
-
-	orig_cookie = zc->zc_cookie;
-top:
-	(void) strlcpy(zc->zc_name, zhp->zfs_name, sizeof (zc->zc_name));
-	rc = ioctl(zhp->zfs_hdl->libzfs_fd, arg, zc);
-
-	if (rc == -1) {
-		switch (errno) {
-		case ENOMEM:
-			/* expand nvlist memory and try again */
-			if (zcmd_expand_dst_nvlist(zhp->zfs_hdl, zc) != 0) {
-				zcmd_free_nvlists(zc);
-				return (-1);
+	libzfs_handle_t *hdl = zhp->zfs_hdl;
+	zfs_cmd_t zc = { 0 };
+	nvlist_t *args, *result, *datasets;
+	uint64_t cursor = 0;
+	boolean_t more = B_TRUE;
+	int ret = 0;
+
+	if (zcmd_alloc_dst_nvlist(hdl, &zc, 256 * 1024) != 0)
+		return (-1);
+
+	while (more && ret == 0) {
+		args = fnvlist_alloc();
+		if (snapshots)
+			fnvlist_add_boolean(args, "snapshots");
+		fnvlist_add_uint64(args, "cursor", cursor);
+		fnvlist_add_uint64(args, "count", ZFS_ITER_BATCH);
+		ret = zcmd_write_src_nvlist(hdl, &zc, args);
+		fnvlist_free(args);
+		if (ret != 0)
+			break;
+
+		(void) strlcpy(zc.zc_name, zhp->zfs_name, sizeof (zc.zc_name));
+		while (ioctl(hdl->libzfs_fd, ZFS_IOC_LIST_BATCH, &zc) != 0) {
+			if (errno == ENOMEM &&
+			    zcmd_expand_dst_nvlist(hdl, &zc) == 0)
+				continue;
+			/*
+			 * If ENOENT is returned, then the underlying dataset
+			 * has been removed since we obtained the handle.
+			 */
+			if (errno != ENOENT) {
+				ret = zfs_standard_error(hdl, errno,
+				    dgettext(TEXT_DOMAIN, snapshots ?
+				    "cannot iterate snapshots" :
+				    "cannot iterate filesystems"));
 			}
-			zc->zc_cookie = orig_cookie;
-			goto top;
-		/*
-		 * An errno value of ESRCH indicates normal completion.
-		 * If ENOENT is returned, then the underlying dataset
-		 * has been removed since we obtained the handle.
-		 */
-		case ESRCH:
-		case ENOENT:
-			rc = 1;
+			more = B_FALSE;
 			break;
-		default:
-			rc = zfs_standard_error(zhp->zfs_hdl, errno,
-			    dgettext(TEXT_DOMAIN,
-			    "cannot iterate filesystems"));
+		}
+		free((void *)(uintptr_t)zc.zc_nvlist_src);
+		zc.zc_nvlist_src = 0;
+		if (!more)
 			break;
+
+		if (zcmd_read_dst_nvlist(hdl, &zc, &result) != 0) {
+			ret = -1;
+			break;
+		}
+		more = (nvlist_lookup_uint64(result, "cursor", &cursor) == 0);
+		datasets = fnvlist_lookup_nvlist(result, "datasets");
+
+		for (nvpair_t *pair = nvlist_next_nvpair(datasets, NULL);
+		    pair != NULL && ret == 0;
+		    pair = nvlist_next_nvpair(datasets, pair)) {
+			zfs_handle_t *nzhp;
+
+			/*
+			 * Silently ignore errors, as the only plausible
+			 * explanation is that the pool has since been removed.
+			 */
+			if ((nzhp = make_dataset_handle_nvl(hdl,
+			    nvpair_name(pair), fnvpair_value_nvlist(pair))) ==
+			    NULL)
+				continue;
+
+			ret = func(nzhp, data);
 		}
+		nvlist_free(result);
 	}
-	return (rc);
+
+	zcmd_free_nvlists(&zc);
+	return (ret);
 }
 
 /*
@@ -103,34 +150,10 @@ top:
 int
 zfs_iter_filesystems(zfs_handle_t *zhp, zfs_iter_f func, void *data)
 {
-	zfs_cmd_t zc = { 0 };
-	zfs_handle_t *nzhp;
-	int ret;
-
 	if (zhp->zfs_type != ZFS_TYPE_FILESYSTEM)
 		return (0);
 
-	if (zcmd_alloc_dst_nvlist(zhp->zfs_hdl, &zc, 0) != 0)
-		return (-1);
-
-	while ((ret = zfs_do_list_ioctl(zhp, ZFS_IOC_DATASET_LIST_NEXT,
-	    &zc)) == 0) {
-		/*
-		 * Silently ignore errors, as the only plausible explanation is
-		 * that the pool has since been removed.
-		 */
-		if ((nzhp = make_dataset_handle_zc(zhp->zfs_hdl,
-		    &zc)) == NULL) {
-			continue;
-		}
-
-		if ((ret = func(nzhp, data)) != 0) {
-			zcmd_free_nvlists(&zc);
-			return (ret);
-		}
-	}
-	zcmd_free_nvlists(&zc);
-	return ((ret < 0) ? ret : 0);
+	return (zfs_iter_batch(zhp, B_FALSE, func, data));
 }
 
 /*
@@ -139,31 +162,11 @@ zfs_iter_filesystems(zfs_handle_t *zhp, zfs_iter_f func, void *data)
 int
 zfs_iter_snapshots(zfs_handle_t *zhp, zfs_iter_f func, void *data)
 {
-	zfs_cmd_t zc = { 0 };
-	zfs_handle_t *nzhp;
-	int ret;
-
 	if (zhp->zfs_type == ZFS_TYPE_SNAPSHOT ||
 	    zhp->zfs_type == ZFS_TYPE_BOOKMARK)
 		return (0);
 
-	if (zcmd_alloc_dst_nvlist(zhp->zfs_hdl, &zc, 0) != 0)
-		return (-1);
-	while ((ret = zfs_do_list_ioctl(zhp, ZFS_IOC_SNAPSHOT_LIST_NEXT,
-	    &zc)) == 0) {
-
-		if ((nzhp = make_dataset_handle_zc(zhp->zfs_hdl,
-		    &zc)) == NULL) {
-			continue;
-		}
-
-		if ((ret = func(nzhp, data)) != 0) {
-			zcmd_free_nvlists(&zc);
-			return (ret);
-		}
-	}
-	zcmd_free_nvlists(&zc);
-	return ((ret < 0) ? ret : 0);
+	return (zfs_iter_batch(zhp, B_TRUE, func, data));
 }
 
 /*
@@ -339,7 +339,11 @@ cv_timedwait_hires(kcondvar_t *cv, kmutex_t *mp, hrtime_t tim, hrtime_t res,
 	timestruc_t ts;
 	hrtime_t delta;
 
-	ASSERT(flag == 0);
+	ASSERT(flag == 0 || flag == CALLOUT_FLAG_ABSOLUTE);
+
+	/* As in the kernel, tim is relative unless CALLOUT_FLAG_ABSOLUTE */
+	if (!(flag & CALLOUT_FLAG_ABSOLUTE))
+		tim += gethrtime();
 
 top:
 	delta = tim - gethrtime();
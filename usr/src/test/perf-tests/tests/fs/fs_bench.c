@@ -0,0 +1,203 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * File system I/O benchmarks, run on a scratch file in the given
+ * directory (by default $TMPDIR, or /var/tmp):
+ *
+ *	seqwrite	write the file sequentially, then fsync() it
+ *	seqread		read the file sequentially
+ *	randwrite	write blocks at random offsets, then fsync() it
+ *	randread	read blocks at random offsets
+ *
+ * With -S, the file is opened O_DSYNC so that every write is synchronous
+ * (on ZFS, every write goes through the ZIL).  Reads are not made to miss
+ * the cache; to measure reads from disk, export and import the pool
+ * between runs.  The arg reported is "<blocksize>/sync" or
+ * "<blocksize>/async".
+ *
+ * To sweep ZFS recordsizes, run this in datasets with different
+ * recordsize properties; to measure the effect of a scrub, run it while
+ * one is going on.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../perftest.h"
+
+static const char * const fs_benches[] = {
+	"seqwrite", "seqread", "randwrite", "randread", NULL
+};
+
+static char *fs_path;
+static int fs_fd = -1;
+static boolean_t fs_written;
+static size_t fs_bsize = 128 * 1024;
+static uint64_t fs_fsize = 1024 * 1024 * 1024;
+static boolean_t fs_sync;
+static char *fs_buf;
+
+static void
+report(const char *bench, uint64_t ops, hrtime_t nsec)
+{
+	char arg[32];
+
+	(void) snprintf(arg, sizeof (arg), "%lu/%s", (ulong_t)fs_bsize,
+	    fs_sync ? "sync" : "async");
+	pt_report(bench, arg, ops, ops * fs_bsize, nsec);
+}
+
+static void
+seqwrite(boolean_t quiet)
+{
+	uint64_t nblks = fs_fsize / fs_bsize;
+	hrtime_t start;
+	uint64_t i;
+
+	start = gethrtime();
+	for (i = 0; i < nblks; i++) {
+		if (pwrite(fs_fd, fs_buf, fs_bsize, i * fs_bsize) != fs_bsize)
+			pt_fatal("write %s", fs_path);
+	}
+	if (fsync(fs_fd) != 0)
+		pt_fatal("fsync %s", fs_path);
+	if (!quiet)
+		report("seqwrite", nblks, gethrtime() - start);
+	fs_written = B_TRUE;
+}
+
+static void
+seqread(void)
+{
+	uint64_t nblks = fs_fsize / fs_bsize;
+	hrtime_t start;
+	uint64_t i;
+
+	if (!fs_written)
+		seqwrite(B_TRUE);
+	start = gethrtime();
+	for (i = 0; i < nblks; i++) {
+		if (pread(fs_fd, fs_buf, fs_bsize, i * fs_bsize) != fs_bsize)
+			pt_fatal("read %s", fs_path);
+	}
+	report("seqread", nblks, gethrtime() - start);
+}
+
+static void
+randio(boolean_t write)
+{
+	uint64_t nblks = fs_fsize / fs_bsize;
+	hrtime_t start;
+	off_t off;
+	uint64_t i;
+	ssize_t n;
+
+	if (!fs_written)
+		seqwrite(B_TRUE);
+
+	/* The same offsets every run, so that runs can be compared. */
+	srand48(1);
+	start = gethrtime();
+	for (i = 0; i < nblks; i++) {
+		off = (off_t)(((uint64_t)lrand48() << 31 | lrand48()) %
+		    nblks) * fs_bsize;
+		if (write)
+			n = pwrite(fs_fd, fs_buf, fs_bsize, off);
+		else
+			n = pread(fs_fd, fs_buf, fs_bsize, off);
+		if (n != fs_bsize)
+			pt_fatal("%s %s", write ? "write" : "read", fs_path);
+	}
+	if (write && fsync(fs_fd) != 0)
+		pt_fatal("fsync %s", fs_path);
+	report(write ? "randwrite" : "randread", nblks, gethrtime() - start);
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "Usage: %s [-S] [-b blocksize] [-d dir] "
+	    "[-s filesize]\n\t[seqwrite | seqread | randwrite | randread] ...\n",
+	    pt_progname);
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *dir;
+	uint64_t i;
+	size_t len;
+	int c;
+
+	pt_progname = argv[0];
+	if ((dir = getenv("TMPDIR")) == NULL)
+		dir = "/var/tmp";
+	while ((c = getopt(argc, argv, "b:d:s:S")) != -1) {
+		switch (c) {
+		case 'b':
+			fs_bsize = pt_number(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 's':
+			fs_fsize = pt_number(optarg);
+			break;
+		case 'S':
+			fs_sync = B_TRUE;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	pt_check_names(fs_benches, argc, argv);
+	if (fs_fsize < fs_bsize) {
+		errno = 0;
+		pt_fatal("file size is less than the block size");
+	}
+
+	/*
+	 * Fill the buffer with something that doesn't compress, so that
+	 * compression doesn't make the writes cheaper than they would be.
+	 */
+	if ((fs_buf = malloc(fs_bsize)) == NULL)
+		pt_fatal("malloc");
+	srand48(getpid());
+	for (i = 0; i < fs_bsize / sizeof (long); i++)
+		((long *)fs_buf)[i] = lrand48();
+
+	len = strlen(dir) + 32;
+	if ((fs_path = malloc(len)) == NULL)
+		pt_fatal("malloc");
+	(void) snprintf(fs_path, len, "%s/fs_bench.%d", dir, (int)getpid());
+	fs_fd = open(fs_path, O_RDWR | O_CREAT | O_EXCL |
+	    (fs_sync ? O_DSYNC : 0), 0600);
+	if (fs_fd == -1)
+		pt_fatal("open %s", fs_path);
+	(void) unlink(fs_path);
+
+	if (pt_selected("seqwrite", argc, argv))
+		seqwrite(B_FALSE);
+	if (pt_selected("seqread", argc, argv))
+		seqread();
+	if (pt_selected("randwrite", argc, argv))
+		randio(B_TRUE);
+	if (pt_selected("randread", argc, argv))
+		randio(B_FALSE);
+
+	(void) close(fs_fd);
+	return (0);
+}
@@ -0,0 +1,341 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Loopback networking benchmarks.  A child process serves as the peer,
+ * so both ends go through the full TCP or UDP stack, including the
+ * squeues.
+ *
+ *	tcp_rr		round trips of a request and a reply of the given
+ *			size over one TCP connection
+ *	tcp_stream	one-way transfer over a TCP connection, in writes
+ *			of the given size
+ *	udp_rr		round trips of a datagram of the given size
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <unistd.h>
+#include "../perftest.h"
+
+static const char * const net_benches[] = {
+	"tcp_rr", "tcp_stream", "udp_rr", NULL
+};
+
+/*
+ * Read exactly len bytes.  Returns B_FALSE on end of file.
+ */
+static boolean_t
+readn(int fd, char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			pt_fatal("read");
+		}
+		if (n == 0)
+			return (B_FALSE);
+		buf += n;
+		len -= n;
+	}
+	return (B_TRUE);
+}
+
+static void
+writen(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			pt_fatal("write");
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+static void
+wait_child(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid)
+		pt_fatal("waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errno = 0;
+		pt_fatal("peer %d failed, status 0x%x", (int)pid, status);
+	}
+}
+
+static int
+loopback_socket(int type, struct sockaddr_in *sin)
+{
+	socklen_t len = sizeof (*sin);
+	int fd;
+
+	if ((fd = socket(AF_INET, type, 0)) == -1)
+		pt_fatal("socket");
+	bzero(sin, sizeof (*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)sin, sizeof (*sin)) != 0)
+		pt_fatal("bind");
+	if (getsockname(fd, (struct sockaddr *)sin, &len) != 0)
+		pt_fatal("getsockname");
+	return (fd);
+}
+
+/*
+ * Set up a TCP connection to a child process, which runs peer() on its
+ * end and exits.
+ */
+static int
+tcp_connect(void (*peer)(int, size_t), size_t size, pid_t *pidp)
+{
+	struct sockaddr_in sin;
+	int lfd, fd, one = 1;
+	pid_t pid;
+
+	lfd = loopback_socket(SOCK_STREAM, &sin);
+	if (listen(lfd, 1) != 0)
+		pt_fatal("listen");
+
+	if ((pid = fork()) == -1)
+		pt_fatal("fork");
+	if (pid == 0) {
+		if ((fd = accept(lfd, NULL, NULL)) == -1)
+			pt_fatal("accept");
+		(void) close(lfd);
+		(void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one,
+		    sizeof (one));
+		peer(fd, size);
+		_exit(0);
+	}
+	(void) close(lfd);
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		pt_fatal("socket");
+	if (connect(fd, (struct sockaddr *)&sin, sizeof (sin)) != 0)
+		pt_fatal("connect");
+	(void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+	*pidp = pid;
+	return (fd);
+}
+
+static void
+tcp_rr_peer(int fd, size_t size)
+{
+	char *buf;
+
+	if ((buf = malloc(size)) == NULL)
+		pt_fatal("malloc");
+	while (readn(fd, buf, size))
+		writen(fd, buf, size);
+	free(buf);
+}
+
+static void
+bench_tcp_rr(uint64_t n, size_t size)
+{
+	hrtime_t start;
+	char arg[32];
+	uint64_t i;
+	char *buf;
+	pid_t pid;
+	int fd;
+
+	if ((buf = calloc(1, size)) == NULL)
+		pt_fatal("malloc");
+	fd = tcp_connect(tcp_rr_peer, size, &pid);
+
+	start = gethrtime();
+	for (i = 0; i < n; i++) {
+		writen(fd, buf, size);
+		if (!readn(fd, buf, size)) {
+			errno = 0;
+			pt_fatal("tcp_rr: unexpected end of file");
+		}
+	}
+	(void) snprintf(arg, sizeof (arg), "%lu", (ulong_t)size);
+	pt_report("tcp_rr", arg, n, 0, gethrtime() - start);
+
+	(void) close(fd);
+	wait_child(pid);
+	free(buf);
+}
+
+static void
+tcp_stream_peer(int fd, size_t size)
+{
+	char *buf;
+	ssize_t n;
+
+	if ((buf = malloc(size)) == NULL)
+		pt_fatal("malloc");
+	while ((n = read(fd, buf, size)) != 0) {
+		if (n == -1 && errno != EINTR)
+			pt_fatal("read");
+	}
+	/* Tell the sender that everything has arrived. */
+	writen(fd, buf, 1);
+	free(buf);
+}
+
+static void
+bench_tcp_stream(uint64_t n, size_t size)
+{
+	hrtime_t start;
+	char arg[32];
+	uint64_t i;
+	char *buf;
+	pid_t pid;
+	int fd;
+
+	if ((buf = calloc(1, size)) == NULL)
+		pt_fatal("malloc");
+	fd = tcp_connect(tcp_stream_peer, size, &pid);
+
+	start = gethrtime();
+	for (i = 0; i < n; i++)
+		writen(fd, buf, size);
+	if (shutdown(fd, SHUT_WR) != 0)
+		pt_fatal("shutdown");
+	if (!readn(fd, buf, 1)) {
+		errno = 0;
+		pt_fatal("tcp_stream: unexpected end of file");
+	}
+	(void) snprintf(arg, sizeof (arg), "%lu", (ulong_t)size);
+	pt_report("tcp_stream", arg, n, n * size, gethrtime() - start);
+
+	(void) close(fd);
+	wait_child(pid);
+	free(buf);
+}
+
+static void
+bench_udp_rr(uint64_t n, size_t size)
+{
+	struct sockaddr_in csin, ssin;
+	struct timeval tv;
+	hrtime_t start;
+	int cfd, sfd;
+	char arg[32];
+	uint64_t i;
+	char *buf;
+	pid_t pid;
+	ssize_t len;
+
+	if ((buf = calloc(1, size)) == NULL)
+		pt_fatal("malloc");
+	sfd = loopback_socket(SOCK_DGRAM, &ssin);
+	cfd = loopback_socket(SOCK_DGRAM, &csin);
+	if (connect(sfd, (struct sockaddr *)&csin, sizeof (csin)) != 0 ||
+	    connect(cfd, (struct sockaddr *)&ssin, sizeof (ssin)) != 0)
+		pt_fatal("connect");
+
+	/*
+	 * Datagrams are not normally lost on loopback, but don't hang if
+	 * one is.  A zero-length datagram tells the peer to exit.
+	 */
+	tv.tv_sec = 5;
+	tv.tv_usec = 0;
+	if (setsockopt(sfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv)) != 0 ||
+	    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv)) != 0)
+		pt_fatal("setsockopt");
+
+	if ((pid = fork()) == -1)
+		pt_fatal("fork");
+	if (pid == 0) {
+		(void) close(cfd);
+		while ((len = recv(sfd, buf, size, 0)) != 0) {
+			if (len == -1)
+				pt_fatal("udp_rr peer: recv");
+			if (send(sfd, buf, len, 0) != len)
+				pt_fatal("udp_rr peer: send");
+		}
+		_exit(0);
+	}
+	(void) close(sfd);
+
+	start = gethrtime();
+	for (i = 0; i < n; i++) {
+		if (send(cfd, buf, size, 0) != size)
+			pt_fatal("udp_rr: send");
+		if (recv(cfd, buf, size, 0) != size)
+			pt_fatal("udp_rr: recv");
+	}
+	(void) snprintf(arg, sizeof (arg), "%lu", (ulong_t)size);
+	pt_report("udp_rr", arg, n, 0, gethrtime() - start);
+
+	(void) send(cfd, buf, 0, 0);
+	(void) close(cfd);
+	wait_child(pid);
+	free(buf);
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "Usage: %s [-n count] [-s size] "
+	    "[tcp_rr | tcp_stream | udp_rr] ...\n", pt_progname);
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t count = 0;
+	size_t size = 0;
+	int c;
+
+	pt_progname = argv[0];
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = pt_number(optarg);
+			break;
+		case 's':
+			size = pt_number(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	pt_check_names(net_benches, argc, argv);
+
+	/* A peer that has gone away should show up as an error. */
+	(void) signal(SIGPIPE, SIG_IGN);
+
+	if (pt_selected("tcp_rr", argc, argv))
+		bench_tcp_rr(count != 0 ? count : 100000,
+		    size != 0 ? size : 1);
+	if (pt_selected("tcp_stream", argc, argv))
+		bench_tcp_stream(count != 0 ? count : 20000,
+		    size != 0 ? size : 128 * 1024);
+	if (pt_selected("udp_rr", argc, argv))
+		bench_udp_rr(count != 0 ? count : 100000,
+		    size != 0 ? size : 1);
+
+	return (0);
+}
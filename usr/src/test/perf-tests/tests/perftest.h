@@ -0,0 +1,153 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _PERFTEST_H
+#define	_PERFTEST_H
+
+/*
+ * Common code for the perf-tests benchmarks.
+ *
+ * Every benchmark prints one line per measurement, made of name=value
+ * pairs separated by spaces:
+ *
+ *	bench=tcp_rr arg=1 ops=100000 nsec=1834259301 nsec_op=18342.6
+ *
+ * arg is the parameter the measurement was taken with (a size, a thread
+ * count, ...), or "-" if there is none.  Measurements that move data
+ * also report bytes=N and mb_sec=N.  Nothing else goes to stdout, so
+ * the results of two builds can be compared by joining on bench and arg.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *pt_progname;
+
+static void
+pt_fatal(const char *fmt, ...)
+{
+	int err = errno;
+	va_list ap;
+
+	(void) fprintf(stderr, "%s: ", pt_progname);
+	va_start(ap, fmt);
+	(void) vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (err != 0)
+		(void) fprintf(stderr, ": %s", strerror(err));
+	(void) fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void
+pt_report(const char *bench, const char *arg, uint64_t ops, uint64_t bytes,
+    hrtime_t nsec)
+{
+	(void) printf("bench=%s arg=%s ops=%llu nsec=%lld nsec_op=%.1f",
+	    bench, arg, (u_longlong_t)ops, (longlong_t)nsec,
+	    ops != 0 ? (double)nsec / ops : 0.0);
+	if (bytes != 0) {
+		(void) printf(" bytes=%llu mb_sec=%.1f", (u_longlong_t)bytes,
+		    nsec != 0 ? (double)bytes * 1000 / nsec : 0.0);
+	}
+	(void) printf("\n");
+	(void) fflush(stdout);
+}
+
+/*
+ * Parse a count or a size, which may carry a k, m or g suffix.
+ */
+static uint64_t
+pt_number(const char *str)
+{
+	char *end;
+	uint64_t val;
+
+	errno = 0;
+	val = strtoull(str, &end, 0);
+	if (errno != 0 || end == str)
+		pt_fatal("bad number \"%s\"", str);
+	switch (*end) {
+	case 'g':
+	case 'G':
+		val <<= 10;
+		/* FALLTHROUGH */
+	case 'm':
+	case 'M':
+		val <<= 10;
+		/* FALLTHROUGH */
+	case 'k':
+	case 'K':
+		val <<= 10;
+		end++;
+		break;
+	}
+	if (*end != '\0' || val == 0) {
+		errno = 0;
+		pt_fatal("bad number \"%s\"", str);
+	}
+	return (val);
+}
+
+/*
+ * Return B_TRUE if benchmark name was selected on the command line, that
+ * is, if it is one of argv[0 .. argc - 1] or if there are none.
+ */
+static boolean_t
+pt_selected(const char *name, int argc, char **argv)
+{
+	int i;
+
+	if (argc == 0)
+		return (B_TRUE);
+	for (i = 0; i < argc; i++) {
+		if (strcmp(argv[i], name) == 0)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Check that every benchmark named on the command line is one of the
+ * NULL-terminated list names.
+ */
+static void
+pt_check_names(const char * const *names, int argc, char **argv)
+{
+	const char * const *np;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		for (np = names; *np != NULL; np++) {
+			if (strcmp(argv[i], *np) == 0)
+				break;
+		}
+		if (*np == NULL) {
+			errno = 0;
+			pt_fatal("unknown benchmark \"%s\"", argv[i]);
+		}
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PERFTEST_H */
@@ -0,0 +1,189 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * libumem microbenchmarks.  Each thread allocates and frees a buffer of
+ * the given size in a loop; ops is the total number of alloc/free pairs
+ * done by all threads.
+ *
+ *	malloc	malloc() and free()
+ *	cache	umem_cache_alloc() and umem_cache_free()
+ *
+ * Without a size, malloc runs over a range of sizes.  The arg reported is
+ * "<size>/<threads>".
+ */
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <umem.h>
+#include <unistd.h>
+#include "../perftest.h"
+
+static const char * const umem_benches[] = {
+	"malloc", "cache", NULL
+};
+
+static size_t malloc_sizes[] = {
+	16, 64, 256, 1024, 4096, 16384, 65536
+};
+
+typedef struct bench_arg {
+	uint64_t	ba_count;
+	size_t		ba_size;
+	umem_cache_t	*ba_cache;
+} bench_arg_t;
+
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cv = PTHREAD_COND_INITIALIZER;
+static boolean_t start_go;
+
+static void
+wait_start(void)
+{
+	(void) pthread_mutex_lock(&start_lock);
+	while (!start_go)
+		(void) pthread_cond_wait(&start_cv, &start_lock);
+	(void) pthread_mutex_unlock(&start_lock);
+}
+
+static void *
+malloc_thread(void *arg)
+{
+	bench_arg_t *ba = arg;
+	uint64_t i;
+	void *p;
+
+	wait_start();
+	for (i = 0; i < ba->ba_count; i++) {
+		if ((p = malloc(ba->ba_size)) == NULL)
+			pt_fatal("malloc");
+		/* Touch the buffer so it can't be optimized away. */
+		*(volatile char *)p = 0;
+		free(p);
+	}
+	return (NULL);
+}
+
+static void *
+cache_thread(void *arg)
+{
+	bench_arg_t *ba = arg;
+	uint64_t i;
+	void *p;
+
+	wait_start();
+	for (i = 0; i < ba->ba_count; i++) {
+		if ((p = umem_cache_alloc(ba->ba_cache, UMEM_DEFAULT)) == NULL)
+			pt_fatal("umem_cache_alloc");
+		*(volatile char *)p = 0;
+		umem_cache_free(ba->ba_cache, p);
+	}
+	return (NULL);
+}
+
+static void
+run(const char *bench, void *(*func)(void *), bench_arg_t *ba, int nthreads)
+{
+	pthread_t *tids;
+	hrtime_t start;
+	char arg[32];
+	int i, err;
+
+	if ((tids = calloc(nthreads, sizeof (pthread_t))) == NULL)
+		pt_fatal("malloc");
+	start_go = B_FALSE;
+	for (i = 0; i < nthreads; i++) {
+		if ((err = pthread_create(&tids[i], NULL, func, ba)) != 0) {
+			errno = err;
+			pt_fatal("pthread_create");
+		}
+	}
+
+	(void) pthread_mutex_lock(&start_lock);
+	start_go = B_TRUE;
+	start = gethrtime();
+	(void) pthread_cond_broadcast(&start_cv);
+	(void) pthread_mutex_unlock(&start_lock);
+
+	for (i = 0; i < nthreads; i++)
+		(void) pthread_join(tids[i], NULL);
+
+	(void) snprintf(arg, sizeof (arg), "%lu/%d", (ulong_t)ba->ba_size,
+	    nthreads);
+	pt_report(bench, arg, ba->ba_count * nthreads, 0, gethrtime() - start);
+	free(tids);
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "Usage: %s [-n count] [-s size] [-t threads] "
+	    "[malloc | cache] ...\n", pt_progname);
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	bench_arg_t ba;
+	uint64_t count = 1000000;
+	size_t size = 0;
+	int nthreads = 1;
+	int c, i;
+
+	pt_progname = argv[0];
+	while ((c = getopt(argc, argv, "n:s:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = pt_number(optarg);
+			break;
+		case 's':
+			size = pt_number(optarg);
+			break;
+		case 't':
+			nthreads = (int)pt_number(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	pt_check_names(umem_benches, argc, argv);
+
+	ba.ba_count = count;
+	ba.ba_cache = NULL;
+
+	if (pt_selected("malloc", argc, argv)) {
+		if (size != 0) {
+			ba.ba_size = size;
+			run("malloc", malloc_thread, &ba, nthreads);
+		} else {
+			for (i = 0; i < sizeof (malloc_sizes) /
+			    sizeof (malloc_sizes[0]); i++) {
+				ba.ba_size = malloc_sizes[i];
+				run("malloc", malloc_thread, &ba, nthreads);
+			}
+		}
+	}
+
+	if (pt_selected("cache", argc, argv)) {
+		ba.ba_size = size != 0 ? size : 256;
+		ba.ba_cache = umem_cache_create("umem_bench", ba.ba_size, 0,
+		    NULL, NULL, NULL, NULL, NULL, 0);
+		if (ba.ba_cache == NULL)
+			pt_fatal("umem_cache_create");
+		run("cache", cache_thread, &ba, nthreads);
+		umem_cache_destroy(ba.ba_cache);
+	}
+
+	return (0);
+}
@@ -0,0 +1,178 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Process creation and VM microbenchmarks:
+ *
+ *	fork	fork() a child that exits at once, and wait for it
+ *	spawn	posix_spawn() /bin/true and wait for it
+ *	mmap	map and unmap an anonymous segment of the given size
+ *	fault	fault in every page of a fresh anonymous segment; ops is
+ *		the number of pages faulted in
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <unistd.h>
+#include "../perftest.h"
+
+extern char **environ;
+
+static const char * const vm_benches[] = {
+	"fork", "spawn", "mmap", "fault", NULL
+};
+
+static void
+wait_child(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid)
+		pt_fatal("waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errno = 0;
+		pt_fatal("child %d failed, status 0x%x", (int)pid, status);
+	}
+}
+
+static void
+bench_fork(uint64_t n)
+{
+	hrtime_t start;
+	uint64_t i;
+	pid_t pid;
+
+	start = gethrtime();
+	for (i = 0; i < n; i++) {
+		if ((pid = fork()) == -1)
+			pt_fatal("fork");
+		if (pid == 0)
+			_exit(0);
+		wait_child(pid);
+	}
+	pt_report("fork", "-", n, 0, gethrtime() - start);
+}
+
+static void
+bench_spawn(uint64_t n)
+{
+	char *argv[] = { "true", NULL };
+	hrtime_t start;
+	uint64_t i;
+	pid_t pid;
+	int err;
+
+	start = gethrtime();
+	for (i = 0; i < n; i++) {
+		err = posix_spawn(&pid, "/bin/true", NULL, NULL, argv, environ);
+		if (err != 0) {
+			errno = err;
+			pt_fatal("posix_spawn");
+		}
+		wait_child(pid);
+	}
+	pt_report("spawn", "/bin/true", n, 0, gethrtime() - start);
+}
+
+static void
+bench_mmap(uint64_t n, size_t len)
+{
+	char arg[32];
+	hrtime_t start;
+	uint64_t i;
+	void *p;
+
+	start = gethrtime();
+	for (i = 0; i < n; i++) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (p == MAP_FAILED)
+			pt_fatal("mmap");
+		if (munmap(p, len) != 0)
+			pt_fatal("munmap");
+	}
+	(void) snprintf(arg, sizeof (arg), "%lu", (ulong_t)len);
+	pt_report("mmap", arg, n, 0, gethrtime() - start);
+}
+
+static void
+bench_fault(uint64_t n, size_t len)
+{
+	size_t pgsz = sysconf(_SC_PAGESIZE);
+	hrtime_t start, nsec = 0;
+	char arg[32];
+	uint64_t i;
+	size_t off;
+	char *p;
+
+	for (i = 0; i < n; i++) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (p == MAP_FAILED)
+			pt_fatal("mmap");
+		start = gethrtime();
+		for (off = 0; off < len; off += pgsz)
+			p[off] = 1;
+		nsec += gethrtime() - start;
+		if (munmap(p, len) != 0)
+			pt_fatal("munmap");
+	}
+	(void) snprintf(arg, sizeof (arg), "%lu", (ulong_t)len);
+	pt_report("fault", arg, n * (len / pgsz), len * n, nsec);
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "Usage: %s [-n count] [-s size] "
+	    "[fork | spawn | mmap | fault] ...\n", pt_progname);
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint64_t count = 0;
+	size_t size = 0;
+	int c;
+
+	pt_progname = argv[0];
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			count = pt_number(optarg);
+			break;
+		case 's':
+			size = pt_number(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	pt_check_names(vm_benches, argc, argv);
+
+	if (pt_selected("fork", argc, argv))
+		bench_fork(count != 0 ? count : 2000);
+	if (pt_selected("spawn", argc, argv))
+		bench_spawn(count != 0 ? count : 1000);
+	if (pt_selected("mmap", argc, argv))
+		bench_mmap(count != 0 ? count : 100000,
+		    size != 0 ? size : 1024 * 1024);
+	if (pt_selected("fault", argc, argv))
+		bench_fault(count != 0 ? count : 100,
+		    size != 0 ? size : 16 * 1024 * 1024);
+
+	return (0);
+}
@@ -825,7 +825,17 @@ kcf_free_context(kcf_context_t *kcf_ctx)
 	if (kcf_secondctx != NULL)
 		KCF_CONTEXT_REFRELE(kcf_secondctx);
 
-	if (gctx->cc_provider_private != NULL) {
+	if (gctx->cc_provider_private != NULL &&
+	    pd->pd_prov_type == CRYPTO_SW_PROVIDER) {
+		/*
+		 * A software provider does not finish unregistering
+		 * while there are holds on it, and the context has one,
+		 * so there is no need to serialize with that here on
+		 * pd_lock, which every context of the provider would
+		 * otherwise contend for.
+		 */
+		(void) KCF_PROV_FREE_CONTEXT(pd, gctx);
+	} else if (gctx->cc_provider_private != NULL) {
 		mutex_enter(&pd->pd_lock);
 		if (!KCF_IS_PROV_REMOVED(pd)) {
 			/*
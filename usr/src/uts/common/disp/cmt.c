@@ -212,6 +212,25 @@ pg_cmt_can_migrate(cpu_t *from, cpu_t *to)
 	return (0);
 }
 
+/*
+ * Account for a thread that "to" took from the run queue of "from" in the
+ * lowest level CMT PG the two CPUs have in common. Steals between CPUs that
+ * share no CMT PG are not counted here.
+ */
+void
+pg_cmt_steal(cpu_t *to, cpu_t *from)
+{
+	pg_cmt_t	*pg;
+
+	for (pg = (pg_cmt_t *)to->cpu_pg->cmt_lineage; pg != NULL;
+	    pg = pg->cmt_parent) {
+		if (bitset_in_set(&pg->cmt_cpus_actv_set, from->cpu_seqid)) {
+			atomic_inc_64(&pg->cmt_pg.pghw_steals);
+			return;
+		}
+	}
+}
+
 /*
  * CMT class specific PG allocation
  */
@@ -94,7 +94,8 @@
  * CPU usage is decayed by the caps_update() routine which is called once per
  * every clock tick. It walks lists of project caps and decays their usages by
  * one per cent. If CPU usage drops below cap levels, threads on the wait queue
- * are made runnable again, one thread per clock tick.
+ * are made runnable again: one thread for every whole CPU's worth of headroom
+ * left below the cap, and at least one, per clock tick.
  *
  * Interfaces
  * ==========
@@ -483,7 +484,12 @@ cap_walk(list_t *l, void (*cb)(cpucap_t *, int64_t))
 }
 
 /*
- * If cap limit is not reached, make one thread from wait queue runnable.
+ * If cap limit is not reached, make threads from wait queue runnable: one for
+ * each whole CPU of headroom below the cap, but at least one. Releasing a
+ * single thread per tick would leave, for example, a zone capped at 800 with
+ * 400 of headroom feeding its waiters back one per tick, so that they wait
+ * for several ticks for CPU that is available to them now.
+ *
  * The waitq_isempty check is performed without the waitq lock. If a new thread
  * is placed on the waitq right after the check, it will be picked up during the
  * next invocation of cap_poke_waitq().
@@ -498,11 +504,16 @@ cap_poke_waitq(cpucap_t *cap, int64_t gen)
 		cap->cap_above++;
 	} else {
 		waitq_t *wq = &cap->cap_waitq;
+		hrtime_t headroom = cap->cap_value - cap->cap_usage;
+		int nrun = headroom / (100 * cap_tick_cost);
 
 		cap->cap_below++;
 
-		if (!waitq_isempty(wq))
+		do {
+			if (waitq_isempty(wq))
+				break;
 			waitq_runone(wq);
+		} while (--nrun > 0);
 	}
 }
 
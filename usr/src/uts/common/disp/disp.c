@@ -55,7 +55,10 @@
 #include <sys/atomic.h>
 #include <sys/dtrace.h>
 #include <sys/sdt.h>
+#include <sys/sobject.h>
+#include <sys/kstat.h>
 #include <sys/archsystm.h>
+#include <sys/cpu.h>
 
 #include <vm/as.h>
 
@@ -101,6 +104,8 @@ int	nswapped;		/* total number of swapped threads */
 void	disp_swapped_enq(kthread_t *tp);
 static void	disp_swapped_setrun(kthread_t *tp);
 static void	cpu_resched(cpu_t *cp, pri_t tpri);
+static boolean_t disp_smt_compatible(cpu_t *cp, kthread_t *tp);
+static boolean_t disp_smt_wait(cpu_t *cp);
 
 /*
  * If this is set, only interrupt threads will cause kernel preemptions.
@@ -144,6 +149,25 @@ disp_lock_t	stop_lock;		/* lock on stopped threads */
 
 static void	cpu_dispqalloc(int numpris);
 
+/*
+ * Off-CPU accounting; see disp_offcpu_t.  Both tunables are read once,
+ * by dispinit(), and disp_offcpu_nent is rounded up to a power of two.
+ * Blocks whose stack finds no free slot within DISP_OFFCPU_PROBE slots
+ * of its hash are counted in disp_offcpu_drops and not accounted.
+ */
+int	disp_offcpu_enable = 0;
+uint_t	disp_offcpu_nent = 1024;
+uint64_t disp_offcpu_drops;
+
+#define	DISP_OFFCPU_PROBE	8
+
+static disp_offcpu_t	*disp_offcpu;
+static uint_t		disp_offcpu_mask;
+
+static void	disp_offcpu_init(void);
+static void	disp_offcpu_block(kthread_t *);
+static void	disp_offcpu_wake(kthread_t *);
+
 /*
  * This gets returned by disp_getwork/disp_getbest if we couldn't steal
  * a thread because it was sitting on its run queue for a very short
@@ -267,6 +291,9 @@ dispinit(void)
 	if (nosteal_nsec == NOSTEAL_UNINITIALIZED)
 		cmp_set_nosteal_interval();
 
+	if (disp_offcpu_enable)
+		disp_offcpu_init();
+
 	/*
 	 * Get the default class ID; this may be later modified via
 	 * dispadmin(1M).  This will load the class (normally TS) and that will
@@ -278,6 +305,107 @@ dispinit(void)
 	}
 }
 
+static void
+disp_offcpu_init(void)
+{
+	uint_t nent = disp_offcpu_nent;
+	kstat_t *ksp;
+
+	if (nent < DISP_OFFCPU_PROBE)
+		nent = DISP_OFFCPU_PROBE;
+	if (!ISP2(nent))
+		nent = 1U << highbit(nent);
+
+	disp_offcpu = kmem_zalloc(nent * sizeof (disp_offcpu_t), KM_SLEEP);
+	disp_offcpu_mask = nent - 1;
+
+	ksp = kstat_create("unix", 0, "offcpu", "misc", KSTAT_TYPE_RAW,
+	    nent * sizeof (disp_offcpu_t), KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = disp_offcpu;
+		kstat_install(ksp);
+	}
+}
+
+/*
+ * Called by swtch() for a thread that is about to block, with the thread
+ * lock held.  Finds (or claims) the slot for the thread's stack and the
+ * type of object it's blocking on, and stamps the thread with it so that
+ * disp_offcpu_wake() can charge the time when the thread is made
+ * runnable again.  Slots are claimed by compare-and-swap on the key and
+ * are never given back, so a thread's slot stays valid while it sleeps.
+ */
+static void
+disp_offcpu_block(kthread_t *t)
+{
+	pc_t pcs[DISP_OFFCPU_DEPTH + 1];
+	disp_offcpu_t *dop;
+	uint64_t key, old;
+	uint32_t sobj;
+	int depth, i;
+
+	sobj = (t->t_sobj_ops != NULL) ? SOBJ_TYPE(t->t_sobj_ops) : 0;
+
+	/* Leave out our own frame. */
+	depth = getpcstack(pcs, DISP_OFFCPU_DEPTH + 1) - 1;
+	if (depth < 0)
+		depth = 0;
+
+	key = 0xcbf29ce484222325ULL ^ sobj;
+	for (i = 0; i < depth; i++)
+		key = (key ^ pcs[i + 1]) * 0x100000001b3ULL;
+	if (key == 0)
+		key = 1;
+
+	for (i = 0; i < DISP_OFFCPU_PROBE; i++) {
+		dop = &disp_offcpu[(key + i) & disp_offcpu_mask];
+		if ((old = dop->do_key) == key)
+			break;
+		if (old != 0)
+			continue;
+		if ((old = atomic_cas_64(&dop->do_key, 0, key)) == 0) {
+			for (int j = 0; j < depth; j++)
+				dop->do_stack[j] = pcs[j + 1];
+			dop->do_sobj = sobj;
+			membar_producer();
+			dop->do_depth = depth;
+			break;
+		}
+		if (old == key)
+			break;
+	}
+
+	if (i == DISP_OFFCPU_PROBE) {
+		atomic_inc_64(&disp_offcpu_drops);
+		return;
+	}
+
+	dop->do_wchan = (uint64_t)(uintptr_t)t->t_wchan;
+	t->t_offcpu = dop;
+	t->t_offcpu_start = gethrtime_unscaled();
+}
+
+/*
+ * Called, with the thread lock held, when a thread stamped by
+ * disp_offcpu_block() is put back on a run queue.
+ */
+static void
+disp_offcpu_wake(kthread_t *t)
+{
+	disp_offcpu_t *dop = t->t_offcpu;
+	hrtime_t delta;
+	int b;
+
+	delta = gethrtime_unscaled() - t->t_offcpu_start;
+	scalehrtime(&delta);
+	t->t_offcpu = NULL;
+
+	b = MIN(highbit64(delta), DISP_OFFCPU_NHIST - 1);
+	atomic_inc_64(&dop->do_hist[b]);
+	atomic_add_64(&dop->do_time, delta);
+	atomic_inc_64(&dop->do_count);
+}
+
 /*
  * disp_add - Called with class pointer to initialize the dispatcher
  *	      for a newly loaded class.
@@ -612,6 +740,17 @@ idle()
 		while (cp->cpu_flags & CPU_QUIESCED)
 			(*idle_cpu)();
 
+		/*
+		 * If disp() left the local work alone because a sibling
+		 * is running another process on this core, spin politely
+		 * until one of them goes away.
+		 */
+		if ((cp->cpu_disp_flags & CPU_DISP_SMTWAIT) &&
+		    disp_smt_wait(cp)) {
+			SMT_PAUSE();
+			continue;
+		}
+
 		if (cp->cpu_disp->disp_nrunnable != 0) {
 			idle_exit();
 			swtch();
@@ -778,6 +917,24 @@ reschedule:
 	ASSERT(tp != NULL);
 	ASSERT(tp->t_schedflag & TS_LOAD);	/* thread must be swapped in */
 
+	/*
+	 * In a core exclusive processor set, leave the thread where it is
+	 * and run the idle thread if a sibling is busy with another process.
+	 */
+	if (!disp_smt_compatible(cpup, tp)) {
+		disp_lock_exit_high(&dp->disp_lock);
+		cpup->cpu_disp_flags |= CPU_DISP_SMTWAIT;
+		tp = cpup->cpu_idle_thread;
+		THREAD_ONPROC(tp, cpup);
+		cpup->cpu_dispthread = tp;
+		cpup->cpu_dispatch_pri = -1;
+		cpup->cpu_runrun = cpup->cpu_kprunrun = 0;
+		cpup->cpu_chosen_level = -1;
+		TRACE_1(TR_FAC_DISP, TR_DISP_END,
+		    "disp_end:tid %p", tp);
+		return (tp);
+	}
+
 	DTRACE_SCHED2(dequeue, kthread_t *, tp, disp_t *, dp);
 
 	/*
@@ -857,6 +1014,9 @@ swtch()
 	if (t->t_flag & T_INTR_THREAD)
 		cpu_intr_swtch_enter(t);
 
+	if (t->t_state == TS_SLEEP && disp_offcpu != NULL)
+		disp_offcpu_block(t);
+
 	if (t->t_intr != NULL) {
 		/*
 		 * We are an interrupt thread.  Setup and return
@@ -1148,6 +1308,104 @@ cpu_resched(cpu_t *cp, pri_t tpri)
 		poke_cpu(cp->cpu_id);
 }
 
+/*
+ * Core exclusive processor sets (PSET_COREXCL).
+ *
+ * In a processor set with this attribute the SMT siblings of a core only
+ * ever run threads of the same process at the same time, so that a
+ * latency sensitive process does not have to share the pipeline, and the
+ * caches closest to it, with somebody else's batch work. Kernel threads
+ * don't count, and may run next to anything.
+ *
+ * A thread that may not run because a sibling is busy with another process
+ * stays on its run queue and the CPU goes idle instead. If the thread has
+ * a better priority than the one running on the sibling, the sibling is
+ * preempted; it will then find our thread running and go idle itself.
+ * An idle CPU waiting for its sibling spins in the idle loop rather than
+ * halt, since nobody would wake it up when the sibling switches.
+ *
+ * The check is made without holding anything on the siblings, so two of
+ * them can still occasionally both start threads of different processes;
+ * the next time either one switches, the other will be sent away.
+ */
+#define	DISP_SMT_NEUTRAL(t)	(ttoproc(t) == &p0)
+
+/*
+ * Return the SMT (instruction pipeline) PG of the CPU, or NULL if it has
+ * none.
+ */
+static pg_cmt_t *
+disp_smt_pg(cpu_t *cp)
+{
+	pg_cmt_t	*pg = (pg_cmt_t *)cp->cpu_pg->cmt_lineage;
+
+	if (pg == NULL || ((pghw_t *)pg)->pghw_hw != PGHW_IPIPE)
+		return (NULL);
+	return (pg);
+}
+
+/*
+ * Return B_TRUE if tp may run on cp given what the siblings of cp are
+ * running.
+ */
+static boolean_t
+disp_smt_compatible(cpu_t *cp, kthread_t *tp)
+{
+	pg_cmt_t	*pg;
+	cpu_t		*ocp;
+	kthread_t	*otp;
+	pri_t		pri;
+	boolean_t	ok = B_TRUE;
+	int		i;
+
+	if (!(cp->cpu_part->cp_attr & PSET_COREXCL) || DISP_SMT_NEUTRAL(tp))
+		return (B_TRUE);
+	if ((pg = disp_smt_pg(cp)) == NULL)
+		return (B_TRUE);
+
+	pri = DISP_PRIO(tp);
+	for (i = 0; i < GROUP_SIZE(&pg->cmt_cpus_actv); i++) {
+		ocp = GROUP_ACCESS(&pg->cmt_cpus_actv, i);
+		if (ocp == cp)
+			continue;
+		otp = ocp->cpu_dispthread;
+		if (otp == ocp->cpu_idle_thread || DISP_SMT_NEUTRAL(otp) ||
+		    ttoproc(otp) == ttoproc(tp))
+			continue;
+		if (pri > ocp->cpu_dispatch_pri)
+			cpu_resched(ocp, pri);
+		else
+			ok = B_FALSE;
+	}
+
+	return (ok);
+}
+
+/*
+ * Called from the idle loop of a CPU that disp() has kept idle because of
+ * its siblings. Return B_TRUE for as long as the best local thread still
+ * may not run.
+ */
+static boolean_t
+disp_smt_wait(cpu_t *cp)
+{
+	disp_t		*dp = cp->cpu_disp;
+	kthread_t	*tp;
+	pri_t		pri;
+	boolean_t	wait = B_FALSE;
+
+	disp_lock_enter(&dp->disp_lock);
+	if ((pri = dp->disp_maxrunpri) != -1) {
+		tp = dp->disp_q[pri].dq_first;
+		wait = !disp_smt_compatible(cp, tp);
+	}
+	disp_lock_exit(&dp->disp_lock);
+
+	if (!wait)
+		cp->cpu_disp_flags &= ~CPU_DISP_SMTWAIT;
+	return (wait);
+}
+
 /*
  * setbackdq() keeps runqs balanced such that the difference in length
  * between the chosen runq and the next one is no more than RUNQ_MAX_DIFF.
@@ -1191,6 +1449,9 @@ setbackdq(kthread_t *tp)
 	ASSERT((tp->t_schedflag & TS_ALLSTART) == 0);
 	ASSERT(!thread_on_queue(tp));	/* make sure tp isn't on a runq */
 
+	if (tp->t_offcpu != NULL)
+		disp_offcpu_wake(tp);
+
 	/*
 	 * If thread is "swapped" or on the swap queue don't
 	 * queue it, but wake sched.
@@ -1380,6 +1641,9 @@ setfrontdq(kthread_t *tp)
 	ASSERT((tp->t_schedflag & TS_ALLSTART) == 0);
 	ASSERT(!thread_on_queue(tp));	/* make sure tp isn't on a runq */
 
+	if (tp->t_offcpu != NULL)
+		disp_offcpu_wake(tp);
+
 	/*
 	 * If thread is "swapped" or on the swap queue don't
 	 * queue it, but wake sched.
@@ -1889,6 +2153,53 @@ disp_ratify(kthread_t *tp, disp_t *kpq)
 	return (tp);
 }
 
+/*
+ * Look for work on the run queues of the CPUs that share hardware with cp,
+ * going up its CMT lineage one level at a time: SMT siblings first, then
+ * CPUs sharing a cache, then the rest of the chip. The CPU with the
+ * highest priority unbound thread at the first level that has any is
+ * returned, so that a thread is only moved further than it has to be when
+ * nothing closer can be found.
+ *
+ * Called with preemption disabled, which keeps the lineage from changing.
+ */
+static cpu_t *
+disp_getwork_cmt(cpu_t *cp)
+{
+	pg_cmt_t	*pg;
+	cpu_t		*ocp, *tcp;
+	pri_t		pri, maxpri;
+	hrtime_t	stealtime;
+	int		i;
+
+	for (pg = (pg_cmt_t *)cp->cpu_pg->cmt_lineage; pg != NULL;
+	    pg = pg->cmt_parent) {
+		maxpri = -1;
+		tcp = NULL;
+		for (i = 0; i < GROUP_SIZE(&pg->cmt_cpus_actv); i++) {
+			ocp = GROUP_ACCESS(&pg->cmt_cpus_actv, i);
+			if (ocp == cp || ocp->cpu_part != cp->cpu_part ||
+			    ocp->cpu_dispatch_pri == -1)
+				continue;
+			if ((ocp->cpu_disp_flags & CPU_DISP_DONTSTEAL) &&
+			    ocp->cpu_disp->disp_nrunnable == 1)
+				continue;
+			pri = ocp->cpu_disp->disp_max_unbound_pri;
+			if (pri <= maxpri)
+				continue;
+			stealtime = ocp->cpu_disp->disp_steal;
+			if (stealtime != 0 && stealtime - gethrtime() > 0)
+				continue;
+			maxpri = pri;
+			tcp = ocp;
+		}
+		if (tcp != NULL)
+			return (tcp);
+	}
+
+	return (NULL);
+}
+
 /*
  * See if there is any work on the dispatcher queue for other CPUs.
  * If there is, dequeue the best thread and return.
@@ -1923,6 +2234,13 @@ disp_getwork(cpu_t *cp)
 
 	kpreempt_disable();		/* protect the cpu_active list */
 
+	/*
+	 * Threads on the run queues of CPUs sharing a cache with this one
+	 * are the cheapest to take, so look there first.
+	 */
+	if ((tcp = disp_getwork_cmt(cp)) != NULL)
+		goto found;
+
 	/*
 	 * Try to find something to do on another CPU's run queue.
 	 * Loop through all other CPUs looking for the one with the highest
@@ -2049,6 +2367,7 @@ next_level:
 		}
 	} while (!tcp && lpl);
 
+found:
 	kpreempt_enable();
 
 	/*
@@ -2228,6 +2547,13 @@ disp_getbest(disp_t *dp)
 		 */
 		allbound = B_FALSE;
 
+		/*
+		 * Leave threads that the siblings of this CPU would not let
+		 * run for somebody else.
+		 */
+		if (tcp != NULL && !disp_smt_compatible(cp, tp))
+			continue;
+
 		/*
 		 * The thread is a candidate for stealing from its run queue. We
 		 * don't want to steal threads that became runnable just a
@@ -2307,6 +2633,26 @@ disp_getbest(disp_t *dp)
 			dp->disp_steal = now;
 	}
 
+	/*
+	 * A thread that ran recently still has its working set in the
+	 * caches of the CPU it came from. If taking it means leaving those
+	 * caches behind, prefer an unbound thread further down the queue
+	 * that has gone cold anyway and loses nothing by moving.
+	 */
+	if (tp != NULL && tcp != NULL && THREAD_HAS_CACHE_WARMTH(tp) &&
+	    !pg_cmt_can_migrate(cp, tcp)) {
+		kthread_t	*ctp;
+
+		for (ctp = tp->t_link; ctp != NULL; ctp = ctp->t_link) {
+			if (ctp->t_bound_cpu || ctp->t_weakbound_cpu)
+				continue;
+			if (!THREAD_HAS_CACHE_WARMTH(ctp)) {
+				tp = ctp;
+				break;
+			}
+		}
+	}
+
 	/*
 	 * If there were no unbound threads on this queue, find the queue
 	 * where they are and then return later. The value of
@@ -2389,6 +2735,9 @@ disp_getbest(disp_t *dp)
 
 	DTRACE_PROBE3(steal, kthread_t *, tp, cpu_t *, tcp, cpu_t *, cp);
 
+	if (tcp != NULL)
+		pg_cmt_steal(cp, tcp);
+
 	thread_onproc(tp, cp);			/* set t_state to TS_ONPROC */
 
 	/*
@@ -147,6 +147,7 @@ hrtime_t	dtrace_deadman_interval = NANOSEC;
 hrtime_t	dtrace_deadman_timeout = (hrtime_t)10 * NANOSEC;
 hrtime_t	dtrace_deadman_user = (hrtime_t)30 * NANOSEC;
 hrtime_t	dtrace_unregister_defunct_reap = (hrtime_t)60 * NANOSEC;
+int		dtrace_jit_enable = 1;
 
 /*
  * DTrace External Variables
@@ -2304,12 +2305,40 @@ dtrace_aggregate(dtrace_aggregation_t *agg, dtrace_buffer_t *dbuf,
 	if (buf->dtb_offset == 0) {
 		/*
 		 * We just kludge up approximately 1/8th of the size to be
-		 * buckets.  If this guess ends up being routinely
-		 * off-the-mark, we may need to dynamically readjust this
-		 * based on past performance.
+		 * buckets.  That suits small keys, but a buffer full of large
+		 * keys (stacks, say) holds far fewer keys than that, and the
+		 * buckets it doesn't need are space lost to data.
 		 */
 		uintptr_t hashsize = (buf->dtb_size >> 3) / sizeof (uintptr_t);
 
+		if (buf->dtb_xamot != NULL && buf->dtb_xamot_offset != 0) {
+			/*
+			 * The inactive buffer holds the previous generation
+			 * of this aggregation buffer.  Size the table for as
+			 * many keys of the average size seen there as will
+			 * fit in the buffer, so that a full buffer averages
+			 * a key per bucket.
+			 */
+			dtrace_aggbuffer_t *xagb;
+			uintptr_t nkeys, ksize;
+
+			xagb = (dtrace_aggbuffer_t *)(buf->dtb_xamot +
+			    buf->dtb_size - sizeof (dtrace_aggbuffer_t));
+			nkeys = ((uintptr_t)xagb->dtagb_hash -
+			    xagb->dtagb_free) / sizeof (dtrace_aggkey_t);
+
+			if (nkeys != 0) {
+				ksize = buf->dtb_xamot_offset / nkeys +
+				    sizeof (dtrace_aggkey_t) +
+				    sizeof (dtrace_aggkey_t *);
+				nkeys = buf->dtb_size / ksize;
+
+				if (nkeys < hashsize)
+					hashsize = MAX(nkeys,
+					    DTRACE_AGGHASHSIZE_SLEW << 4);
+			}
+		}
+
 		if ((uintptr_t)agb - hashsize * sizeof (dtrace_aggkey_t *) <
 		    (uintptr_t)tomax || hashsize == 0) {
 			/*
@@ -2440,6 +2469,7 @@ next:
 	if ((uintptr_t)tomax + offs + fsize >
 	    agb->dtagb_free - sizeof (dtrace_aggkey_t)) {
 		dtrace_buffer_drop(buf);
+		buf->dtb_aggdrops[agg->dtag_keyclass]++;
 		return;
 	}
 
@@ -5541,6 +5571,30 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 	 */
 	mstate->dtms_difo = difo;
 
+	if (difo->dtdo_jit != NULL) {
+		dtrace_jit_frame_t frame;
+
+		if (*flags & CPU_DTRACE_FAULT) {
+			opc = 0;
+			goto fault;
+		}
+
+		bzero(frame.djf_regs, sizeof (frame.djf_regs));
+		frame.djf_flags = flags;
+		frame.djf_ttop = 0;
+		frame.djf_mstate = mstate;
+		frame.djf_vstate = vstate;
+		frame.djf_state = state;
+
+		rval = ((dtrace_jit_t *)difo->dtdo_jit)(&frame);
+
+		if (!(*flags & CPU_DTRACE_FAULT))
+			return (rval);
+
+		opc = frame.djf_pc;
+		goto fault;
+	}
+
 	regs[DIF_REG_R0] = 0; 		/* %r0 is fixed at zero */
 
 	while (pc < textlen && !(*flags & CPU_DTRACE_FAULT)) {
@@ -6281,12 +6335,212 @@ dtrace_dif_emulate(dtrace_difo_t *difo, dtrace_mstate_t *mstate,
 	if (!(*flags & CPU_DTRACE_FAULT))
 		return (rval);
 
+fault:
 	mstate->dtms_fltoffs = opc * sizeof (dif_instr_t);
 	mstate->dtms_present |= DTRACE_MSTATE_FLTOFFS;
 
 	return (0);
 }
 
+/*
+ * The following are called from DIF objects translated by dtrace_dif_jit()
+ * for the instructions that the translated code does not do itself.  Each
+ * does exactly what dtrace_dif_emulate() does for the same instruction;
+ * the translated code checks for a fault after each call.
+ */
+uint64_t
+dtrace_jit_load(dtrace_jit_frame_t *f, uint_t op, uint64_t addr)
+{
+	dtrace_mstate_t *mstate = f->djf_mstate;
+	dtrace_vstate_t *vstate = f->djf_vstate;
+	uint64_t val;
+
+	switch (op) {
+	case DIF_OP_RLDSB:
+		if (!dtrace_canload(addr, 1, mstate, vstate))
+			return (0);
+		/*FALLTHROUGH*/
+	case DIF_OP_LDSB:
+		return ((int8_t)dtrace_load8(addr));
+	case DIF_OP_RLDSH:
+		if (!dtrace_canload(addr, 2, mstate, vstate))
+			return (0);
+		/*FALLTHROUGH*/
+	case DIF_OP_LDSH:
+		return ((int16_t)dtrace_load16(addr));
+	case DIF_OP_RLDSW:
+		if (!dtrace_canload(addr, 4, mstate, vstate))
+			return (0);
+		/*FALLTHROUGH*/
+	case DIF_OP_LDSW:
+		return ((int32_t)dtrace_load32(addr));
+	case DIF_OP_RLDUB:
+		if (!dtrace_canload(addr, 1, mstate, vstate))
+			return (0);
+		/*FALLTHROUGH*/
+	case DIF_OP_LDUB:
+		return (dtrace_load8(addr));
+	case DIF_OP_RLDUH:
+		if (!dtrace_canload(addr, 2, mstate, vstate))
+			return (0);
+		/*FALLTHROUGH*/
+	case DIF_OP_LDUH:
+		return (dtrace_load16(addr));
+	case DIF_OP_RLDUW:
+		if (!dtrace_canload(addr, 4, mstate, vstate))
+			return (0);
+		/*FALLTHROUGH*/
+	case DIF_OP_LDUW:
+		return (dtrace_load32(addr));
+	case DIF_OP_RLDX:
+		if (!dtrace_canload(addr, 8, mstate, vstate))
+			return (0);
+		/*FALLTHROUGH*/
+	case DIF_OP_LDX:
+		return (dtrace_load64(addr));
+	}
+
+	DTRACE_CPUFLAG_SET(CPU_DTRACE_NOFAULT);
+	switch (op) {
+	case DIF_OP_ULDSB:
+		val = (int8_t)dtrace_fuword8((void *)(uintptr_t)addr);
+		break;
+	case DIF_OP_ULDSH:
+		val = (int16_t)dtrace_fuword16((void *)(uintptr_t)addr);
+		break;
+	case DIF_OP_ULDSW:
+		val = (int32_t)dtrace_fuword32((void *)(uintptr_t)addr);
+		break;
+	case DIF_OP_ULDUB:
+		val = dtrace_fuword8((void *)(uintptr_t)addr);
+		break;
+	case DIF_OP_ULDUH:
+		val = dtrace_fuword16((void *)(uintptr_t)addr);
+		break;
+	case DIF_OP_ULDUW:
+		val = dtrace_fuword32((void *)(uintptr_t)addr);
+		break;
+	case DIF_OP_ULDX:
+	default:
+		val = dtrace_fuword64((void *)(uintptr_t)addr);
+		break;
+	}
+	DTRACE_CPUFLAG_CLEAR(CPU_DTRACE_NOFAULT);
+
+	return (val);
+}
+
+void
+dtrace_jit_store(dtrace_jit_frame_t *f, uint_t op, uint64_t addr,
+    uint64_t val)
+{
+	volatile uint16_t *flags = f->djf_flags;
+	volatile uintptr_t *illval = &cpu_core[CPU->cpu_id].cpuc_dtrace_illval;
+	size_t sz;
+
+	switch (op) {
+	case DIF_OP_STB:
+		sz = 1;
+		break;
+	case DIF_OP_STH:
+		sz = 2;
+		break;
+	case DIF_OP_STW:
+		sz = 4;
+		break;
+	case DIF_OP_STX:
+	default:
+		sz = 8;
+		break;
+	}
+
+	if (!dtrace_canstore(addr, sz, f->djf_mstate, f->djf_vstate)) {
+		*flags |= CPU_DTRACE_BADADDR;
+		*illval = addr;
+		return;
+	}
+	if (addr & (sz - 1)) {
+		*flags |= CPU_DTRACE_BADALIGN;
+		*illval = addr;
+		return;
+	}
+
+	switch (sz) {
+	case 1:
+		*((uint8_t *)(uintptr_t)addr) = (uint8_t)val;
+		break;
+	case 2:
+		*((uint16_t *)(uintptr_t)addr) = (uint16_t)val;
+		break;
+	case 4:
+		*((uint32_t *)(uintptr_t)addr) = (uint32_t)val;
+		break;
+	default:
+		*((uint64_t *)(uintptr_t)addr) = val;
+		break;
+	}
+}
+
+uint64_t
+dtrace_jit_variable(dtrace_jit_frame_t *f, uint_t id, uint64_t ndx)
+{
+	return (dtrace_dif_variable(f->djf_mstate, f->djf_state, id, ndx));
+}
+
+int64_t
+dtrace_jit_scmp(dtrace_jit_frame_t *f, uint64_t s1, uint64_t s2)
+{
+	size_t sz = f->djf_state->dts_options[DTRACEOPT_STRSIZE];
+
+	if (s1 != NULL &&
+	    !dtrace_strcanload(s1, sz, f->djf_mstate, f->djf_vstate))
+		return (0);
+	if (s2 != NULL &&
+	    !dtrace_strcanload(s2, sz, f->djf_mstate, f->djf_vstate))
+		return (0);
+
+	return (dtrace_strncmp((char *)(uintptr_t)s1,
+	    (char *)(uintptr_t)s2, sz));
+}
+
+void
+dtrace_jit_push(dtrace_jit_frame_t *f, dif_instr_t instr)
+{
+	uint64_t *regs = f->djf_regs;
+	dtrace_key_t *key = &f->djf_tupregs[f->djf_ttop];
+	uint_t r1 = DIF_INSTR_R1(instr);
+	uint_t r2 = DIF_INSTR_R2(instr);
+	uint_t rd = DIF_INSTR_RD(instr);
+
+	if (f->djf_ttop == DIF_DTR_NREGS) {
+		*f->djf_flags |= CPU_DTRACE_TUPOFLOW;
+		return;
+	}
+
+	if (DIF_INSTR_OP(instr) == DIF_OP_PUSHTV) {
+		key->dttk_size = 0;
+	} else if (r1 == DIF_TYPE_STRING) {
+		/*
+		 * As in dtrace_dif_emulate(), a zero size means the
+		 * system-wide default string size.
+		 */
+		key->dttk_size = dtrace_strlen((char *)(uintptr_t)regs[rd],
+		    regs[r2] ? regs[r2] : dtrace_strsize_default) + 1;
+	} else {
+		key->dttk_size = regs[r2];
+	}
+
+	key->dttk_value = regs[rd];
+	f->djf_ttop++;
+}
+
+void
+dtrace_jit_call(dtrace_jit_frame_t *f, uint_t subr, uint_t rd)
+{
+	dtrace_dif_subr(subr, rd, f->djf_regs, f->djf_tupregs, f->djf_ttop,
+	    f->djf_mstate, f->djf_state);
+}
+
 static void
 dtrace_action_breakpoint(dtrace_ecb_t *ecb)
 {
@@ -9859,6 +10113,10 @@ dtrace_difo_init(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 	}
 
 	dtrace_difo_chunksize(dp, vstate);
+
+	if (dtrace_jit_enable)
+		dp->dtdo_jit = dtrace_dif_jit(dp, vstate, &dp->dtdo_jitlen);
+
 	dtrace_difo_hold(dp);
 }
 
@@ -9961,6 +10219,9 @@ dtrace_difo_destroy(dtrace_difo_t *dp, dtrace_vstate_t *vstate)
 		svarp[id] = NULL;
 	}
 
+	if (dp->dtdo_jit != NULL)
+		dtrace_dif_jit_free(dp->dtdo_jit, dp->dtdo_jitlen);
+
 	kmem_free(dp->dtdo_buf, dp->dtdo_len * sizeof (dif_instr_t));
 	kmem_free(dp->dtdo_inttab, dp->dtdo_intlen * sizeof (uint64_t));
 	kmem_free(dp->dtdo_strtab, dp->dtdo_strlen);
@@ -10577,9 +10838,20 @@ success:
 	if (frec->dtrd_alignment < sizeof (dtrace_aggid_t))
 		frec->dtrd_alignment = sizeof (dtrace_aggid_t);
 
+	agg->dtag_keyclass = DTRACE_AGGKEY_SCALAR;
+
 	for (act = agg->dtag_first; act != NULL; act = act->dta_next) {
 		ASSERT(!act->dta_intuple);
 		act->dta_intuple = 1;
+
+		if (act->dta_kind == DTRACEACT_STACK ||
+		    act->dta_kind == DTRACEACT_USTACK ||
+		    act->dta_kind == DTRACEACT_JSTACK) {
+			agg->dtag_keyclass = DTRACE_AGGKEY_STACK;
+		} else if (DTRACEACT_ISSTRING(act) &&
+		    agg->dtag_keyclass == DTRACE_AGGKEY_SCALAR) {
+			agg->dtag_keyclass = DTRACE_AGGKEY_STRING;
+		}
 	}
 
 	return (&agg->dtag_action);
@@ -16619,6 +16891,7 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 
 		for (i = 0; i < NCPU; i++) {
 			dtrace_dstate_percpu_t *dcpu = &dstate->dtds_percpu[i];
+			dtrace_buffer_t *abuf = &state->dts_aggbuffer[i];
 
 			stat.dtst_dyndrops += dcpu->dtdsc_drops;
 			stat.dtst_dyndrops_dirty += dcpu->dtdsc_dirty_drops;
@@ -16629,6 +16902,13 @@ dtrace_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
 
 			nerrs += state->dts_buffer[i].dtb_errors;
 
+			stat.dtst_aggdrops_scalar +=
+			    abuf->dtb_aggdrops[DTRACE_AGGKEY_SCALAR];
+			stat.dtst_aggdrops_string +=
+			    abuf->dtb_aggdrops[DTRACE_AGGKEY_STRING];
+			stat.dtst_aggdrops_stack +=
+			    abuf->dtb_aggdrops[DTRACE_AGGKEY_STACK];
+
 			for (j = 0; j < state->dts_nspeculations; j++) {
 				dtrace_speculation_t *spec;
 				dtrace_buffer_t *buf;
@@ -24,6 +24,12 @@
  */
 
 #include <sys/sdt_impl.h>
+#include <sys/cpuvar.h>
+#include <sys/kmem.h>
+#include <sys/bitmap.h>
+#include <sys/sysmacros.h>
+#include <sys/policy.h>
+#include <sys/priv_impl.h>
 
 static dtrace_pattr_t vtrace_attr = {
 { DTRACE_STABILITY_UNSTABLE, DTRACE_STABILITY_UNSTABLE, DTRACE_CLASS_ISA },
@@ -1204,3 +1210,235 @@ sdt_getargdesc(void *arg, dtrace_id_t id, void *parg, dtrace_argdesc_t *desc)
 
 	desc->dtargd_ndx = DTRACE_ARGNONE;
 }
+
+/*
+ * The flight recorder.  When sdt_fr_enable is set as the sdt driver
+ * attaches, the probes named in sdt_fr_probes are recorded from then on,
+ * whether or not DTrace has enabled them:  each firing writes a compact
+ * record (sdt_frec_t) into a ring of sdt_fr_nrecs records for the CPU that
+ * it fired on, with no ECB processing and no DIF.  What happened in the
+ * last moments before a performance incident -- or a panic -- can then be
+ * read after the fact:  the rings are plain kernel memory, found from
+ * sdt_fr_bufs (indexed by CPU ID) in a crash dump, and on a live system
+ * SDTIOC_FRSNAP copies one out.  To record from boot, put
+ *
+ *	forceload: drv/sdt
+ *	set sdt:sdt_fr_enable = 1
+ *
+ * in /etc/system.  sdt_fr_probes is a comma-separated list of provider:name
+ * pairs, matched against every probe site, including those in modules
+ * loaded later; a module with recorded probe sites can't be unloaded, and
+ * sdt can't detach while any are recorded.
+ */
+int sdt_fr_enable = 0;
+char *sdt_fr_probes =
+	"io:start,io:done,sched:on-cpu,sched:off-cpu,tcp:state-change";
+uint_t sdt_fr_nrecs = 1024;
+
+sdt_frbuf_t **sdt_fr_bufs;
+uint32_t sdt_fr_nprobes;
+
+void
+sdt_fr_init(void)
+{
+	uint_t nrecs = sdt_fr_nrecs;
+	int i;
+
+	if (!sdt_fr_enable || sdt_fr_bufs != NULL)
+		return;
+
+	if (nrecs == 0)
+		nrecs = 1024;
+
+	if (!ISP2(nrecs))
+		nrecs = 1U << highbit(nrecs);
+
+	sdt_fr_bufs = kmem_zalloc(max_ncpus * sizeof (sdt_frbuf_t *), KM_SLEEP);
+
+	for (i = 0; i < max_ncpus; i++) {
+		sdt_fr_bufs[i] = kmem_zalloc(SDT_FRBUF_SIZE(nrecs), KM_SLEEP);
+		sdt_fr_bufs[i]->sfb_nrecs = nrecs;
+	}
+}
+
+void
+sdt_fr_fini(void)
+{
+	int i;
+
+	ASSERT(sdt_fr_nprobes == 0);
+
+	if (sdt_fr_bufs == NULL)
+		return;
+
+	for (i = 0; i < max_ncpus; i++) {
+		kmem_free(sdt_fr_bufs[i],
+		    SDT_FRBUF_SIZE(sdt_fr_bufs[i]->sfb_nrecs));
+	}
+
+	kmem_free(sdt_fr_bufs, max_ncpus * sizeof (sdt_frbuf_t *));
+	sdt_fr_bufs = NULL;
+}
+
+/*
+ * Returns non-zero if the specified probe site is to be recorded.
+ */
+int
+sdt_fr_match(sdt_probe_t *sdp)
+{
+	const char *prov = sdp->sdp_provider->sdtp_name;
+	size_t plen = strlen(prov), nlen = strlen(sdp->sdp_name);
+	const char *p, *end;
+
+	if (sdt_fr_bufs == NULL || sdt_fr_probes == NULL)
+		return (0);
+
+	for (p = sdt_fr_probes; *p != '\0'; p = *end == ',' ? end + 1 : end) {
+		if ((end = strchr(p, ',')) == NULL)
+			end = p + strlen(p);
+
+		if (end - p == plen + 1 + nlen &&
+		    strncmp(p, prov, plen) == 0 && p[plen] == ':' &&
+		    strncmp(p + plen + 1, sdp->sdp_name, nlen) == 0)
+			return (1);
+	}
+
+	return (0);
+}
+
+/*
+ * Called in probe context, with interrupts disabled.
+ */
+void
+sdt_fr_record(sdt_probe_t *sdp, uintptr_t arg0, uintptr_t arg1,
+    uintptr_t arg2)
+{
+	sdt_frbuf_t *fb = sdt_fr_bufs[CPU->cpu_id];
+	sdt_frec_t *rec;
+
+	rec = &fb->sfb_recs[fb->sfb_written & (fb->sfb_nrecs - 1)];
+	rec->sfr_time = dtrace_gethrtime();
+	rec->sfr_thread = (uintptr_t)curthread;
+	rec->sfr_id = sdp->sdp_id;
+	rec->sfr_arg[0] = arg0;
+	rec->sfr_arg[1] = arg1;
+	rec->sfr_arg[2] = arg2;
+	fb->sfb_written++;
+}
+
+typedef struct sdt_frcopy {
+	sdt_frbuf_t	*sfc_from;
+	sdt_frbuf_t	*sfc_to;
+	boolean_t	sfc_done;
+} sdt_frcopy_t;
+
+static void
+sdt_fr_copy(void *arg)
+{
+	sdt_frcopy_t *fc = arg;
+
+	bcopy(fc->sfc_from, fc->sfc_to, SDT_FRBUF_SIZE(fc->sfc_from->sfb_nrecs));
+	fc->sfc_done = B_TRUE;
+}
+
+int
+sdt_fr_ioctl(int cmd, intptr_t arg, cred_t *cr)
+{
+	if (!PRIV_POLICY_ONLY(cr, PRIV_DTRACE_KERNEL, B_FALSE))
+		return (EPERM);
+
+	switch (cmd) {
+	case SDTIOC_FRINFO: {
+		sdt_frinfo_t info;
+
+		bzero(&info, sizeof (info));
+
+		if (sdt_fr_bufs != NULL) {
+			info.sfi_ncpus = max_ncpus;
+			info.sfi_nrecs = sdt_fr_bufs[0]->sfb_nrecs;
+			info.sfi_nprobes = sdt_fr_nprobes;
+		}
+
+		if (copyout(&info, (void *)arg, sizeof (info)) != 0)
+			return (EFAULT);
+
+		return (0);
+	}
+
+	case SDTIOC_FRSNAP: {
+		sdt_frsnap_t snap;
+		sdt_frcopy_t fc;
+		sdt_frbuf_t *fb;
+		uint64_t first;
+		uint32_t n, ndx, cnt;
+		caddr_t dest;
+		size_t size;
+		int err = 0;
+
+		if (copyin((void *)arg, &snap, sizeof (snap)) != 0)
+			return (EFAULT);
+
+		if (sdt_fr_bufs == NULL)
+			return (ENXIO);
+
+		if (snap.sfs_cpu >= max_ncpus)
+			return (EINVAL);
+
+		fb = sdt_fr_bufs[snap.sfs_cpu];
+		size = SDT_FRBUF_SIZE(fb->sfb_nrecs);
+
+		/*
+		 * Records are only written with interrupts disabled on the
+		 * CPU that owns the ring, so a copy made there by cross call
+		 * is consistent.  A CPU that the cross call doesn't reach
+		 * isn't running, and its ring can be copied from here.
+		 */
+		fc.sfc_from = fb;
+		fc.sfc_to = kmem_alloc(size, KM_SLEEP);
+		fc.sfc_done = B_FALSE;
+
+		mutex_enter(&cpu_lock);
+		if (cpu_get(snap.sfs_cpu) != NULL)
+			dtrace_xcall(snap.sfs_cpu, sdt_fr_copy, &fc);
+		if (!fc.sfc_done)
+			sdt_fr_copy(&fc);
+		mutex_exit(&cpu_lock);
+
+		fb = fc.sfc_to;
+		n = MIN(MIN(fb->sfb_written, fb->sfb_nrecs), snap.sfs_nrecs);
+		first = fb->sfb_written - n;
+		dest = (caddr_t)(uintptr_t)snap.sfs_recs;
+
+		/*
+		 * The records may wrap around the end of the ring.
+		 */
+		while (n != 0 && err == 0) {
+			ndx = first & (fb->sfb_nrecs - 1);
+			cnt = MIN(n, fb->sfb_nrecs - ndx);
+
+			if (copyout(&fb->sfb_recs[ndx], dest,
+			    cnt * sizeof (sdt_frec_t)) != 0)
+				err = EFAULT;
+
+			dest += cnt * sizeof (sdt_frec_t);
+			first += cnt;
+			n -= cnt;
+		}
+
+		snap.sfs_nrecs = (dest - (caddr_t)(uintptr_t)snap.sfs_recs) /
+		    sizeof (sdt_frec_t);
+		snap.sfs_written = fb->sfb_written;
+		kmem_free(fb, size);
+
+		if (err == 0 && copyout(&snap, (void *)arg, sizeof (snap)) != 0)
+			err = EFAULT;
+
+		return (err);
+	}
+
+	default:
+		break;
+	}
+
+	return (ENOTTY);
+}
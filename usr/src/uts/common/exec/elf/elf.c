@@ -71,9 +71,10 @@ extern int at_flags;
 #define	ORIGIN_STR	"ORIGIN"
 #define	ORIGIN_STR_SIZE	6
 
-static int getelfhead(vnode_t *, cred_t *, Ehdr *, int *, int *, int *);
+static int getelfhead(vnode_t *, cred_t *, Ehdr *, int *, int *, int *,
+    caddr_t *, ssize_t *);
 static int getelfphdr(vnode_t *, cred_t *, const Ehdr *, int, caddr_t *,
-    ssize_t *);
+    ssize_t *, caddr_t, size_t);
 static int getelfshdr(vnode_t *, cred_t *, const Ehdr *, int, int, caddr_t *,
     ssize_t *, caddr_t *, ssize_t *);
 static size_t elfsize(Ehdr *, int, caddr_t, uintptr_t *);
@@ -193,9 +194,7 @@ mapexec_brand(vnode_t *vp, uarg_t *args, Ehdr *ehdr, Addr *uphdr_vaddr,
 	}
 
 	if ((error = getelfhead(vp, CRED(), ehdr, &nshdrs, &shstrndx,
-	    &nphdrs)) != 0 ||
-	    (error = getelfphdr(vp, CRED(), ehdr, nphdrs, &phdrbase,
-	    &phdrsize)) != 0) {
+	    &nphdrs, &phdrbase, &phdrsize)) != 0) {
 		uprintf("%s: Cannot read %s\n", exec_file, args->pathname);
 		return (error);
 	}
@@ -302,9 +301,7 @@ elfexec(vnode_t *vp, execa_t *uap, uarg_t *args, intpdata_t *idatap,
 	 * Obtain ELF and program header information.
 	 */
 	if ((error = getelfhead(vp, CRED(), ehdrp, &nshdrs, &shstrndx,
-	    &nphdrs)) != 0 ||
-	    (error = getelfphdr(vp, CRED(), ehdrp, nphdrs, &phdrbase,
-	    &phdrsize)) != 0)
+	    &nphdrs, &phdrbase, &phdrsize)) != 0)
 		goto out;
 
 	/*
@@ -665,9 +662,7 @@ elfexec(vnode_t *vp, execa_t *uap, uarg_t *args, intpdata_t *idatap,
 		kmem_free(phdrbase, phdrsize);
 		phdrbase = NULL;
 		if ((error = getelfhead(nvp, CRED(), ehdrp, &nshdrs,
-		    &shstrndx, &nphdrs)) != 0 ||
-		    (error = getelfphdr(nvp, CRED(), ehdrp, nphdrs, &phdrbase,
-		    &phdrsize)) != 0) {
+		    &shstrndx, &nphdrs, &phdrbase, &phdrsize)) != 0) {
 			VN_RELE(nvp);
 			uprintf("%s: Cannot read %s\n", exec_file, dlnp);
 			goto bad;
@@ -940,37 +935,61 @@ elfsize(Ehdr *ehdrp, int nphdrs, caddr_t phdrbase, uintptr_t *lddata)
 	return (len);
 }
 
+#ifdef _ELF32_COMPAT
+extern size_t elf_headsz;
+#else
 /*
- * Read in the ELF header and program header table.
+ * How much of the start of the file getelfhead() reads when the program
+ * header table is also wanted.  The table usually follows the ELF header,
+ * and can then be taken from the same read.
+ */
+size_t elf_headsz = 1024;
+#endif
+
+/*
+ * Read in the ELF header and, if phbasep is not NULL, the program header
+ * table.
  * SUSV3 requires:
  *	ENOEXEC	File format is not recognized
  *	EINVAL	Format recognized but execution not supported
  */
 static int
 getelfhead(vnode_t *vp, cred_t *credp, Ehdr *ehdr, int *nshdrs, int *shstrndx,
-    int *nphdrs)
+    int *nphdrs, caddr_t *phbasep, ssize_t *phsizep)
 {
 	int error;
 	ssize_t resid;
+	caddr_t head = (caddr_t)ehdr;
+	size_t headsz = sizeof (Ehdr);
+	size_t headlen;
+
+	if (phbasep != NULL && elf_headsz > headsz) {
+		headsz = elf_headsz;
+		head = kmem_alloc(headsz, KM_SLEEP);
+	}
 
 	/*
 	 * We got here by the first two bytes in ident,
 	 * now read the entire ELF header.
 	 */
-	if ((error = vn_rdwr(UIO_READ, vp, (caddr_t)ehdr,
-	    sizeof (Ehdr), (offset_t)0, UIO_SYSSPACE, 0,
-	    (rlim64_t)0, credp, &resid)) != 0)
-		return (error);
+	if ((error = vn_rdwr(UIO_READ, vp, head, headsz, (offset_t)0,
+	    UIO_SYSSPACE, 0, (rlim64_t)0, credp, &resid)) != 0)
+		goto out;
+	headlen = headsz - resid;
+	if (head != (caddr_t)ehdr && headlen >= sizeof (Ehdr))
+		bcopy(head, ehdr, sizeof (Ehdr));
 
 	/*
 	 * Since a separate version is compiled for handling 32-bit and
 	 * 64-bit ELF executables on a 64-bit kernel, the 64-bit version
 	 * doesn't need to be able to deal with 32-bit ELF files.
 	 */
-	if (resid != 0 ||
+	if (headlen < sizeof (Ehdr) ||
 	    ehdr->e_ident[EI_MAG2] != ELFMAG2 ||
-	    ehdr->e_ident[EI_MAG3] != ELFMAG3)
-		return (ENOEXEC);
+	    ehdr->e_ident[EI_MAG3] != ELFMAG3) {
+		error = ENOEXEC;
+		goto out;
+	}
 
 	if ((ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) ||
 #if defined(_ILP32) || defined(_ELF32_COMPAT)
@@ -979,8 +998,10 @@ getelfhead(vnode_t *vp, cred_t *credp, Ehdr *ehdr, int *nshdrs, int *shstrndx,
 	    ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
 #endif
 	    !elfheadcheck(ehdr->e_ident[EI_DATA], ehdr->e_machine,
-	    ehdr->e_flags))
-		return (EINVAL);
+	    ehdr->e_flags)) {
+		error = EINVAL;
+		goto out;
+	}
 
 	*nshdrs = ehdr->e_shnum;
 	*shstrndx = ehdr->e_shstrndx;
@@ -995,13 +1016,15 @@ getelfhead(vnode_t *vp, cred_t *credp, Ehdr *ehdr, int *nshdrs, int *shstrndx,
 	    *shstrndx == SHN_XINDEX || *nphdrs == PN_XNUM) {
 		Shdr shdr;
 
-		if (ehdr->e_shoff == 0)
-			return (EINVAL);
+		if (ehdr->e_shoff == 0) {
+			error = EINVAL;
+			goto out;
+		}
 
 		if ((error = vn_rdwr(UIO_READ, vp, (caddr_t)&shdr,
 		    sizeof (shdr), (offset_t)ehdr->e_shoff, UIO_SYSSPACE, 0,
 		    (rlim64_t)0, credp, &resid)) != 0)
-			return (error);
+			goto out;
 
 		if (*nshdrs == 0)
 			*nshdrs = shdr.sh_size;
@@ -1011,7 +1034,13 @@ getelfhead(vnode_t *vp, cred_t *credp, Ehdr *ehdr, int *nshdrs, int *shstrndx,
 			*nphdrs = shdr.sh_info;
 	}
 
-	return (0);
+	if (phbasep != NULL)
+		error = getelfphdr(vp, credp, ehdr, *nphdrs, phbasep, phsizep,
+		    head, head == (caddr_t)ehdr ? 0 : headlen);
+out:
+	if (head != (caddr_t)ehdr)
+		kmem_free(head, headsz);
+	return (error);
 }
 
 #ifdef _ELF32_COMPAT
@@ -1020,9 +1049,13 @@ extern size_t elf_nphdr_max;
 size_t elf_nphdr_max = 1000;
 #endif
 
+/*
+ * Read in the program header table, or copy it from the first headlen
+ * bytes of the file, already read into head, if it lies within them.
+ */
 static int
 getelfphdr(vnode_t *vp, cred_t *credp, const Ehdr *ehdr, int nphdrs,
-    caddr_t *phbasep, ssize_t *phsizep)
+    caddr_t *phbasep, ssize_t *phsizep, caddr_t head, size_t headlen)
 {
 	ssize_t resid, minsize;
 	int err;
@@ -1052,6 +1085,11 @@ getelfphdr(vnode_t *vp, cred_t *credp, const Ehdr *ehdr, int nphdrs,
 		*phbasep = kmem_alloc(*phsizep, KM_SLEEP);
 	}
 
+	if (ehdr->e_phoff <= headlen && *phsizep <= headlen - ehdr->e_phoff) {
+		bcopy(head + ehdr->e_phoff, *phbasep, *phsizep);
+		return (0);
+	}
+
 	if ((err = vn_rdwr(UIO_READ, vp, *phbasep, *phsizep,
 	    (offset_t)ehdr->e_phoff, UIO_SYSSPACE, 0, (rlim64_t)0,
 	    credp, &resid)) != 0) {
@@ -1485,7 +1523,7 @@ process_scns(core_content_t content, proc_t *p, cred_t *credp, vnode_t *vp,
 			continue;
 
 		if (getelfhead(mvp, credp, &ehdr, &nshdrs, &shstrndx,
-		    &nphdrs) != 0 ||
+		    &nphdrs, NULL, NULL) != 0 ||
 		    getelfshdr(mvp, credp, &ehdr, nshdrs, shstrndx,
 		    &shbase, &shsize, &shstrbase, &shstrsize) != 0)
 			continue;
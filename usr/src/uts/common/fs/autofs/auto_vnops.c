@@ -1316,7 +1316,7 @@ auto_inactive(vnode_t *vp, cred_t *cred, caller_context_t *ct)
 	rw_enter(&dfnp->fn_rwlock, RW_WRITER);
 	mutex_enter(&vp->v_lock);
 	ASSERT(vp->v_count > 0);
-	count = --vp->v_count;
+	count = atomic_dec_uint_nv(&vp->v_count);
 	mutex_exit(&vp->v_lock);
 	if (count == 0) {
 		/*
@@ -330,7 +330,7 @@ cachefs_cnode_inactive(register struct vnode *vp, cred_t *cr)
 				return (EBUSY);
 			}
 			cp->c_ipending = 0;
-			vp->v_count--;	/* release our hold from vn_rele */
+			VN_RELE_LOCKED(vp);	/* release our vn_rele hold */
 			mutex_exit(&vp->v_lock);
 			return (0);
 		}
@@ -366,7 +366,7 @@ cachefs_cnode_inactive(register struct vnode *vp, cred_t *cr)
 	ASSERT(vp->v_count > 0);
 	if (vp->v_count > 1) {
 		cp->c_ipending = 0;
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		mutex_exit(&cp->c_statelock);
 		mutex_exit(&fgp->fg_cnodelock);
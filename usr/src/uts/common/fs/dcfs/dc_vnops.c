@@ -355,7 +355,7 @@ dc_inactive(struct vnode *vp, cred_t *cr, caller_context_t *ctp)
 	mutex_enter(&dctable_lock);
 	mutex_enter(&vp->v_lock);
 	ASSERT(vp->v_count >= 1);
-	if (--vp->v_count != 0) {
+	if (atomic_dec_uint_nv(&vp->v_count) != 0) {
 		/*
 		 * Somebody accessed the dcnode before we got a chance to
 		 * remove it.  They will remove it when they do a vn_rele.
@@ -3136,12 +3136,12 @@ devname_inactive_func(struct vnode *vp, struct cred *cred,
 		}
 		VERIFY(dv->sdev_nlink == 1);
 		decr_link(dv);
-		--vp->v_count;
+		VN_RELE_LOCKED(vp);
 		rw_exit(&dv->sdev_contents);
 		mutex_exit(&vp->v_lock);
 		sdev_nodedestroy(dv, 0);
 	} else {
-		--vp->v_count;
+		VN_RELE_LOCKED(vp);
 		rw_exit(&dv->sdev_contents);
 		mutex_exit(&vp->v_lock);
 	}
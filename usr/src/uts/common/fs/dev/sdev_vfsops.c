@@ -488,7 +488,7 @@ sdev_find_mntinfo(char *mntpt)
 	mntinfo = sdev_mntinfo;
 	while (mntinfo) {
 		if (strcmp(mntpt, mntinfo->sdev_root->sdev_name) == 0) {
-			SDEVTOV(mntinfo->sdev_root)->v_count++;
+			VN_HOLD(SDEVTOV(mntinfo->sdev_root));
 			break;
 		}
 		mntinfo = mntinfo->sdev_next;
@@ -501,6 +501,6 @@ void
 sdev_mntinfo_rele(struct sdev_data *mntinfo)
 {
 	mutex_enter(&sdev_lock);
-	SDEVTOV(mntinfo->sdev_root)->v_count--;
+	atomic_dec_uint(&SDEVTOV(mntinfo->sdev_root)->v_count);
 	mutex_exit(&sdev_lock);
 }
@@ -1053,7 +1053,7 @@ devfs_inactive(struct vnode *vp, struct cred *cred, caller_context_t *ct)
 	dcmn_err2(("devfs_inactive: %s\n", dv->dv_name));
 	mutex_enter(&vp->v_lock);
 	ASSERT(vp->v_count >= 1);
-	--vp->v_count;
+	VN_RELE_LOCKED(vp);
 	destroy = (DV_STALE(dv) && vp->v_count == 0);
 	mutex_exit(&vp->v_lock);
 
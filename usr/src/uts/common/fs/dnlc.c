@@ -42,6 +42,7 @@
 #include <sys/systm.h>
 #include <sys/vfs.h>
 #include <sys/vnode.h>
+#include <sys/pathname.h>
 #include <sys/dnlc.h>
 #include <sys/kmem.h>
 #include <sys/cmn_err.h>
@@ -52,22 +53,51 @@
 #include <sys/kstat.h>
 #include <sys/atomic.h>
 #include <sys/taskq.h>
+#include <sys/smr.h>
+#include <sys/pcrwlock.h>
 
 /*
  * Directory name lookup cache.
  * Based on code originally done by Robert Elz at Melbourne.
  *
  * Names found by directory scans are retained in a cache
- * for future reference.  Each hash chain is ordered by LRU
+ * for future reference.  Each hash chain is ordered by age,
+ * newest first.
  * Cache is indexed by hash value obtained from (vp, name)
  * where the vp refers to the directory containing the name.
+ *
+ * Lookups walk the hash chains without taking any lock.  Changes to a
+ * chain are made under its hash_lock, and in an order that keeps the
+ * chain walkable at all times: an entry is fully set up before it is
+ * linked in, and an unlinked entry keeps its hash_next.  Unlinked entries
+ * are only freed once no lookup can still be looking at them (see smr.c).
+ *
+ * This only covers the entries, not the vnodes they hold; a vnode may go
+ * away as soon as the entry referring to it is unlinked and the dnlc holds
+ * are released.  So a lookup that finds its name still takes the
+ * hash_lock of the chain to put a hold on the vnode, as before, but only
+ * then, and only with mutex_tryenter() as it mustn't block while lock-free.
+ * If that fails it looks again with the lock held.
+ *
+ * The hash table grows as the cache fills.  A resize moves the entries of
+ * each bucket into the new table with the bucket locked, then marks the
+ * bucket as retired; a lookup that got hold of a retired bucket looks
+ * again in the new table.  Everything else that changes the chains holds
+ * nc_resize_lock as reader, and the resize holds it as writer.
+ *
+ * Negative entries (DNLC_NO_VNODE) are also kept on a list of their own,
+ * in the order they were entered, and are aged out with a second chance
+ * for the ones that have been looked up once there are more of them than
+ * dnlc_neg_percent of ncsize.  They are cheap to create, so otherwise a
+ * workload probing for many names that don't exist pushes useful
+ * entries out of the cache.
  */
 
 /*
  * We want to be able to identify files that are referenced only by the DNLC.
  * When adding a reference from the DNLC, call VN_HOLD_DNLC instead of VN_HOLD,
  * since multiple DNLC references should only be counted once in v_count. This
- * file contains only two(2) calls to VN_HOLD, renamed VN_HOLD_CALLER in the
+ * file contains only three(3) calls to VN_HOLD, renamed VN_HOLD_CALLER in the
  * hope that no one will mistakenly add a VN_HOLD to this file. (Unfortunately
  * it is not possible to #undef VN_HOLD and retain VN_HOLD_CALLER. Ideally a
  * Makefile rule would grep uncommented C tokens to check that VN_HOLD is
@@ -77,7 +107,7 @@
 #define	VN_HOLD_DNLC(vp)	{	\
 	mutex_enter(&(vp)->v_lock);	\
 	if ((vp)->v_count_dnlc == 0)	\
-		(vp)->v_count++;	\
+		VN_HOLD_LOCKED(vp);	\
 	(vp)->v_count_dnlc++;		\
 	mutex_exit(&(vp)->v_lock);	\
 }
@@ -87,19 +117,13 @@
 
 /*
  * Tunable nc_hashavelen is the average length desired for this chain, from
- * which the size of the nc_hash table is derived at create time.
+ * which the size of the nc_hash table is derived.  The table starts out at
+ * 1 / (1 << nc_hashinit_shift) of the size needed for ncsize entries and
+ * is doubled whenever the average chain gets twice as long as desired.
  */
 #define	NC_HASHAVELEN_DEFAULT	4
 int nc_hashavelen = NC_HASHAVELEN_DEFAULT;
-
-/*
- * NC_MOVETOFRONT is the move-to-front threshold: if the hash lookup
- * depth exceeds this value, we move the looked-up entry to the front of
- * its hash chain.  The idea is to make sure that the most frequently
- * accessed entries are found most quickly (by keeping them near the
- * front of their hash chains).
- */
-#define	NC_MOVETOFRONT	2
+uint_t nc_hashinit_shift = 3;
 
 /*
  *
@@ -124,15 +148,18 @@ int nc_hashavelen = NC_HASHAVELEN_DEFAULT;
 
 /*
  * Hash table of name cache entries for fast lookup, dynamically
- * allocated at startup.
+ * allocated at startup and replaced by a larger one as the cache grows.
+ * Lookups read nc_hashmask before nc_hash and a resize sets them in the
+ * opposite order, so a lookup never indexes past the end of the table.
  */
 nc_hash_t *nc_hash;
+static pcrwlock_t nc_resize_lock;
 
 /*
  * Rotors. Used to select entries on a round-robin basis.
  */
-static nc_hash_t *dnlc_purge_fs1_rotor;
-static nc_hash_t *dnlc_free_rotor;
+static uint_t dnlc_purge_fs1_rotor;
+static uint_t dnlc_free_rotor;
 
 /*
  * # of dnlc entries (uninitialized)
@@ -145,6 +172,8 @@ int ncsize = -1;
 volatile uint32_t dnlc_nentries = 0;	/* current num of name cache entries */
 static int nc_hashsz;			/* size of hash table */
 static int nc_hashmask;			/* size of hash table minus 1 */
+static int nc_hashsz_max;		/* size for ncsize entries */
+static int dnlc_resize_idle = 1;
 
 /*
  * The dnlc_reduce_cache() taskq queue is activated when there are
@@ -180,6 +209,19 @@ uint64_t dnlc_max_nentries_cnt = 0; /* statistic on times we failed */
 #define	DNLC_LONG_CHAIN 8
 uint_t dnlc_long_chain = DNLC_LONG_CHAIN;
 
+/*
+ * Negative entries beyond dnlc_neg_percent of ncsize are aged out by a
+ * taskq, oldest first.  dnlc_neg_list is the head of their list and is
+ * protected by dnlc_neg_lock, which is taken after the hash_lock of the
+ * entry's chain.
+ */
+uint_t dnlc_neg_percent = 10;
+static uint_t dnlc_neg_max;
+static uint_t dnlc_neg_nentries;
+static int dnlc_neg_idle = 1;
+static kmutex_t dnlc_neg_lock;
+static ncache_t dnlc_neg_list;
+
 /*
  * ncstats has been deprecated, due to the integer size of the counters
  * which can easily overflow in the dnlc.
@@ -220,6 +262,12 @@ struct nc_stats ncs = {
 	{ "dir_fini_purge",		KSTAT_DATA_UINT64 },
 	{ "dir_reclaim_last",		KSTAT_DATA_UINT64 },
 	{ "dir_reclaim_any",		KSTAT_DATA_UINT64 },
+
+	{ "lookup_locked",		KSTAT_DATA_UINT64 },
+	{ "negative_cache_aged",	KSTAT_DATA_UINT64 },
+	{ "hash_resizes",		KSTAT_DATA_UINT64 },
+	{ "path_walks",			KSTAT_DATA_UINT64 },
+	{ "path_components",		KSTAT_DATA_UINT64 },
 };
 
 static int doingcache = 1;
@@ -227,29 +275,79 @@ static int doingcache = 1;
 vnode_t negative_cache_vnode;
 
 /*
- * Insert entry at the front of the queue
+ * Insert entry at the front of the queue.  The entry must be complete
+ * before lock-free lookups can see it.
  */
 #define	nc_inshash(ncp, hp) \
 { \
 	(ncp)->hash_next = (hp)->hash_next; \
-	(ncp)->hash_prev = (ncache_t *)(hp); \
-	(hp)->hash_next->hash_prev = (ncp); \
+	(ncp)->hash_prev = NULL; \
+	membar_producer(); \
+	if ((hp)->hash_next != NULL) \
+		(hp)->hash_next->hash_prev = (ncp); \
+	else \
+		(hp)->hash_prev = (ncp); \
 	(hp)->hash_next = (ncp); \
 }
 
 /*
- * Remove entry from hash queue
+ * Insert entry at the end of the queue.
  */
-#define	nc_rmhash(ncp) \
+#define	nc_instail(ncp, hp) \
 { \
-	(ncp)->hash_prev->hash_next = (ncp)->hash_next; \
-	(ncp)->hash_next->hash_prev = (ncp)->hash_prev; \
-	(ncp)->hash_prev = NULL; \
 	(ncp)->hash_next = NULL; \
+	(ncp)->hash_prev = (hp)->hash_prev; \
+	membar_producer(); \
+	if ((hp)->hash_prev != NULL) \
+		(hp)->hash_prev->hash_next = (ncp); \
+	else \
+		(hp)->hash_next = (ncp); \
+	(hp)->hash_prev = (ncp); \
 }
 
 /*
- * Free an entry.
+ * Remove entry from hash queue.  hash_next is left alone for any lookup
+ * still walking the chain through this entry.
+ */
+#define	nc_rmhash(ncp, hp) \
+{ \
+	if ((ncp)->hash_prev != NULL) \
+		(ncp)->hash_prev->hash_next = (ncp)->hash_next; \
+	else \
+		(hp)->hash_next = (ncp)->hash_next; \
+	if ((ncp)->hash_next != NULL) \
+		(ncp)->hash_next->hash_prev = (ncp)->hash_prev; \
+	else \
+		(hp)->hash_prev = (ncp)->hash_prev; \
+	(ncp)->hash_prev = (ncp); \
+	atomic_add_32(&dnlc_nentries, -1); \
+}
+
+#define	NC_UNLINKED(ncp)	((ncp)->hash_prev == (ncp))
+#define	NC_RETIRED(hp)		((hp)->hash_prev == (ncache_t *)(hp))
+
+/*
+ * Add a negative entry to the head of the negative list, or remove it.
+ */
+#define	nc_insneg(ncp) \
+{ \
+	(ncp)->lru_next = dnlc_neg_list.lru_next; \
+	(ncp)->lru_prev = &dnlc_neg_list; \
+	dnlc_neg_list.lru_next->lru_prev = (ncp); \
+	dnlc_neg_list.lru_next = (ncp); \
+	dnlc_neg_nentries++; \
+}
+
+#define	nc_rmneg(ncp) \
+{ \
+	(ncp)->lru_prev->lru_next = (ncp)->lru_next; \
+	(ncp)->lru_next->lru_prev = (ncp)->lru_prev; \
+	(ncp)->lru_next = (ncp)->lru_prev = NULL; \
+	dnlc_neg_nentries--; \
+}
+
+/*
+ * Free an entry that was never linked into a chain.
  */
 #define	dnlc_free(ncp) \
 { \
@@ -257,6 +355,18 @@ vnode_t negative_cache_vnode;
 	atomic_add_32(&dnlc_nentries, -1); \
 }
 
+/*
+ * Update the per-filesystem counters of the directory dp.
+ */
+#define	DNLC_VFSSTAT(dp, counter) {					\
+	vfs_t *vfsp = (dp)->v_vfsp;					\
+	if (vfsp != NULL && vfsp->vfs_implp != NULL &&			\
+	    (vfsp->vfs_flag & VFS_STATS)) {				\
+		vfsp->vfs_vopstats.counter.value.ui64++;		\
+		if (vfsp->vfs_fstypevsp != NULL)			\
+			vfsp->vfs_fstypevsp->counter.value.ui64++;	\
+	}								\
+}
 
 /*
  * Cached directory info.
@@ -322,14 +432,154 @@ static dchead_t dc_head; /* anchor of cached directories */
 
 /* Prototypes */
 static ncache_t *dnlc_get(uchar_t namlen);
-static ncache_t *dnlc_search(vnode_t *dp, const char *name, uchar_t namlen,
-    int hash);
+static ncache_t *dnlc_search(nc_hash_t *hp, vnode_t *dp, const char *name,
+    uchar_t namlen, int hash);
 static void dnlc_dir_reclaim(void *unused);
 static void dnlc_dir_abort(dircache_t *dcp);
 static void dnlc_dir_adjust_fhash(dircache_t *dcp);
 static void dnlc_dir_adjust_nhash(dircache_t *dcp);
 static void do_dnlc_reduce_cache(void *);
+static void dnlc_neg_age(void *);
+static void dnlc_resize(void *);
+
+static nc_hash_t *
+dnlc_hash_alloc(int sz, int kmflag)
+{
+	nc_hash_t *hash;
+	int i;
 
+	if ((hash = kmem_zalloc(sz * sizeof (nc_hash_t), kmflag)) == NULL)
+		return (NULL);
+	for (i = 0; i < sz; i++)
+		mutex_init(&hash[i].hash_lock, NULL, MUTEX_DEFAULT, NULL);
+	return (hash);
+}
+
+static void
+dnlc_hash_free(nc_hash_t *hash, int sz)
+{
+	int i;
+
+	for (i = 0; i < sz; i++)
+		mutex_destroy(&hash[i].hash_lock);
+	kmem_free(hash, sz * sizeof (nc_hash_t));
+}
+
+/*
+ * Return the hash chain for hash, locked.  Holding the chain lock keeps
+ * a resize from moving its entries or freeing it.
+ */
+static nc_hash_t *
+dnlc_hash_enter(int hash)
+{
+	nc_hash_t *hp;
+
+	pcrw_enter(&nc_resize_lock, RW_READER);
+	hp = &nc_hash[hash & nc_hashmask];
+	mutex_enter(&hp->hash_lock);
+	pcrw_exit(&nc_resize_lock);
+	return (hp);
+}
+
+/*
+ * Return hash chain number i, locked, or NULL if there is no such chain.
+ * A resize only moves entries to chains with the same or a higher number,
+ * so scanning the chains in increasing order by number sees every entry
+ * that was in the cache when the scan started.
+ */
+static nc_hash_t *
+dnlc_hash_index_enter(int i)
+{
+	nc_hash_t *hp = NULL;
+
+	pcrw_enter(&nc_resize_lock, RW_READER);
+	if (i < nc_hashsz) {
+		hp = &nc_hash[i];
+		mutex_enter(&hp->hash_lock);
+	}
+	pcrw_exit(&nc_resize_lock);
+	return (hp);
+}
+
+/*
+ * Link a new entry into its (locked) hash chain.
+ */
+static void
+dnlc_link(ncache_t *ncp, nc_hash_t *hp)
+{
+	ASSERT(MUTEX_HELD(&hp->hash_lock));
+
+	nc_inshash(ncp, hp);
+	if (ncp->vp == DNLC_NO_VNODE) {
+		mutex_enter(&dnlc_neg_lock);
+		nc_insneg(ncp);
+		mutex_exit(&dnlc_neg_lock);
+	}
+}
+
+/*
+ * Unlink an entry from its (locked) hash chain.  The caller releases the
+ * vnodes and frees the entry with dnlc_free_list(), after a grace period.
+ */
+static void
+dnlc_unlink(ncache_t *ncp, nc_hash_t *hp)
+{
+	ASSERT(MUTEX_HELD(&hp->hash_lock));
+
+	if (ncp->vp == DNLC_NO_VNODE) {
+		mutex_enter(&dnlc_neg_lock);
+		nc_rmneg(ncp);
+		mutex_exit(&dnlc_neg_lock);
+	}
+	nc_rmhash(ncp, hp);
+}
+
+/*
+ * Free a list of unlinked entries, chained through lru_next.
+ */
+static void
+dnlc_free_list(void *arg)
+{
+	ncache_t *ncp, *next;
+
+	for (ncp = arg; ncp != NULL; ncp = next) {
+		next = ncp->lru_next;
+		kmem_free(ncp, sizeof (ncache_t) + ncp->namlen);
+	}
+}
+
+/*
+ * Free a list of unlinked entries once lock-free lookups are done with
+ * them.
+ */
+static void
+dnlc_free_deferred(ncache_t *list)
+{
+	if (list != NULL)
+		smr_call(dnlc_free_list, list);
+}
+
+/*
+ * Kick off the aging of negative entries and the growing of the hash table
+ * if an enter has made either necessary.
+ */
+static void
+dnlc_entered(void)
+{
+	if (dnlc_neg_idle && dnlc_neg_nentries > dnlc_neg_max) {
+		dnlc_neg_idle = 0;
+		if (taskq_dispatch(system_taskq, dnlc_neg_age, NULL,
+		    TQ_NOSLEEP) == NULL)
+			dnlc_neg_idle = 1;
+	}
+	if (dnlc_resize_idle && nc_hashsz < nc_hashsz_max &&
+	    dnlc_nentries > 2 * nc_hashavelen * nc_hashsz) {
+		dnlc_resize_idle = 0;
+		if (taskq_dispatch(system_taskq, dnlc_resize, NULL,
+		    TQ_NOSLEEP) == NULL)
+			dnlc_resize_idle = 1;
+	}
+}
 
 /*
  * Initialize the directory cache.
@@ -337,9 +587,7 @@ static void do_dnlc_reduce_cache(void *);
 void
 dnlc_init()
 {
-	nc_hash_t *hp;
 	kstat_t *ksp;
-	int i;
 
 	/*
 	 * Set up the size of the dnlc (ncsize) and its low water mark.
@@ -364,26 +612,22 @@ dnlc_init()
 	dnlc_max_nentries = ncsize * 2;
 	ncsize_onepercent = ncsize / 100;
 	ncsize_min_percent = ncsize_onepercent * 3;
+	dnlc_neg_max = (uint64_t)ncsize * dnlc_neg_percent / 100;
 
 	/*
 	 * Initialise the hash table.
-	 * Compute hash size rounding to the next power of two.
+	 * Compute hash size rounding to the next power of two; the table
+	 * starts out smaller and grows as the cache fills.
 	 */
-	nc_hashsz = ncsize / nc_hashavelen;
-	nc_hashsz = 1 << highbit(nc_hashsz);
+	nc_hashsz_max = 1 << highbit(ncsize / nc_hashavelen);
+	nc_hashsz = MAX(nc_hashsz_max >> nc_hashinit_shift, 1);
 	nc_hashmask = nc_hashsz - 1;
-	nc_hash = kmem_zalloc(nc_hashsz * sizeof (*nc_hash), KM_SLEEP);
-	for (i = 0; i < nc_hashsz; i++) {
-		hp = (nc_hash_t *)&nc_hash[i];
-		mutex_init(&hp->hash_lock, NULL, MUTEX_DEFAULT, NULL);
-		hp->hash_next = (ncache_t *)hp;
-		hp->hash_prev = (ncache_t *)hp;
-	}
+	nc_hash = dnlc_hash_alloc(nc_hashsz, KM_SLEEP);
+	pcrw_init(&nc_resize_lock);
 
-	/*
-	 * Initialize rotors
-	 */
-	dnlc_free_rotor = dnlc_purge_fs1_rotor = &nc_hash[0];
+	mutex_init(&dnlc_neg_lock, NULL, MUTEX_DEFAULT, NULL);
+	dnlc_neg_list.lru_next = &dnlc_neg_list;
+	dnlc_neg_list.lru_prev = &dnlc_neg_list;
 
 	/*
 	 * Set up the directory caching to use kmem_cache_alloc
@@ -428,6 +672,7 @@ dnlc_init()
 	}
 }
 
+
 /*
  * Add a name to the directory cache.
  */
@@ -460,10 +705,9 @@ dnlc_enter(vnode_t *dp, const char *name, vnode_t *vp)
 	VN_HOLD_DNLC(vp);
 	bcopy(name, ncp->name, namlen + 1); /* name and null */
 	ncp->hash = hash;
-	hp = &nc_hash[hash & nc_hashmask];
 
-	mutex_enter(&hp->hash_lock);
-	if (dnlc_search(dp, name, namlen, hash) != NULL) {
+	hp = dnlc_hash_enter(hash);
+	if (dnlc_search(hp, dp, name, namlen, hash) != NULL) {
 		mutex_exit(&hp->hash_lock);
 		ncstats.dbl_enters++;
 		ncs.ncs_dbl_enters.value.ui64++;
@@ -477,10 +721,11 @@ dnlc_enter(vnode_t *dp, const char *name, vnode_t *vp)
 	/*
 	 * Insert back into the hash chain.
 	 */
-	nc_inshash(ncp, hp);
+	dnlc_link(ncp, hp);
 	mutex_exit(&hp->hash_lock);
 	ncstats.enters++;
 	ncs.ncs_enters.value.ui64++;
+	dnlc_entered();
 	TRACE_2(TR_FAC_NFS, TR_DNLC_ENTER_END,
 	    "dnlc_enter_end:(%S) %d", "done", ncstats.enters);
 }
@@ -534,13 +779,26 @@ dnlc_update(vnode_t *dp, const char *name, vnode_t *vp)
 	VN_HOLD_DNLC(vp);
 	bcopy(name, ncp->name, namlen + 1); /* name and null */
 	ncp->hash = hash;
-	hp = &nc_hash[hash & nc_hashmask];
 
-	mutex_enter(&hp->hash_lock);
-	if ((tcp = dnlc_search(dp, name, namlen, hash)) != NULL) {
+	hp = dnlc_hash_enter(hash);
+	if ((tcp = dnlc_search(hp, dp, name, namlen, hash)) != NULL) {
 		if (tcp->vp != vp) {
+			/*
+			 * Lookups only look at vp with the chain locked,
+			 * so it can be changed in place.
+			 */
 			tvp = tcp->vp;
-			tcp->vp = vp;
+			if (tvp == DNLC_NO_VNODE || vp == DNLC_NO_VNODE) {
+				mutex_enter(&dnlc_neg_lock);
+				if (tvp == DNLC_NO_VNODE)
+					nc_rmneg(tcp);
+				tcp->vp = vp;
+				if (vp == DNLC_NO_VNODE)
+					nc_insneg(tcp);
+				mutex_exit(&dnlc_neg_lock);
+			} else {
+				tcp->vp = vp;
+			}
 			mutex_exit(&hp->hash_lock);
 			VN_RELE_DNLC(tvp);
 			ncstats.enters++;
@@ -563,10 +821,11 @@ dnlc_update(vnode_t *dp, const char *name, vnode_t *vp)
 	/*
 	 * insert the new entry, since it is not in dnlc yet
 	 */
-	nc_inshash(ncp, hp);
+	dnlc_link(ncp, hp);
 	mutex_exit(&hp->hash_lock);
 	ncstats.enters++;
 	ncs.ncs_enters.value.ui64++;
+	dnlc_entered();
 	TRACE_2(TR_FAC_NFS, TR_DNLC_ENTER_END,
 	    "dnlc_update_end:(%S) %d", "done", ncstats.enters);
 }
@@ -585,7 +844,7 @@ dnlc_lookup(vnode_t *dp, const char *name)
 	ncache_t *ncp;
 	nc_hash_t *hp;
 	vnode_t *vp;
-	int hash, depth;
+	int hash, mask;
 	uchar_t namlen;
 
 	TRACE_2(TR_FAC_NFS, TR_DNLC_LOOKUP_START,
@@ -599,64 +858,157 @@ dnlc_lookup(vnode_t *dp, const char *name)
 	}
 
 	DNLCHASH(name, dp, hash, namlen);
-	depth = 1;
-	hp = &nc_hash[hash & nc_hashmask];
-	mutex_enter(&hp->hash_lock);
-
-	for (ncp = hp->hash_next; ncp != (ncache_t *)hp;
-	    ncp = ncp->hash_next) {
-		if (ncp->hash == hash &&	/* fast signature check */
-		    ncp->dp == dp &&
-		    ncp->namlen == namlen &&
-		    bcmp(ncp->name, name, namlen) == 0) {
-			/*
-			 * Move this entry to the head of its hash chain
-			 * if it's not already close.
-			 */
-			if (depth > NC_MOVETOFRONT) {
-				ncache_t *next = ncp->hash_next;
-				ncache_t *prev = ncp->hash_prev;
-
-				prev->hash_next = next;
-				next->hash_prev = prev;
-				ncp->hash_next = next = hp->hash_next;
-				ncp->hash_prev = (ncache_t *)hp;
-				next->hash_prev = ncp;
-				hp->hash_next = ncp;
-
-				ncstats.move_to_front++;
-			}
 
-			/*
-			 * Put a hold on the vnode now so its identity
-			 * can't change before the caller has a chance to
-			 * put a hold on it.
-			 */
-			vp = ncp->vp;
-			VN_HOLD_CALLER(vp); /* VN_HOLD 1 of 2 in this file */
-			mutex_exit(&hp->hash_lock);
-			ncstats.hits++;
-			ncs.ncs_hits.value.ui64++;
-			if (vp == DNLC_NO_VNODE) {
-				ncs.ncs_neg_hits.value.ui64++;
-			}
-			TRACE_4(TR_FAC_NFS, TR_DNLC_LOOKUP_END,
-			    "dnlc_lookup_end:%S %d vp %x name %s", "hit",
-			    ncstats.hits, vp, name);
-			return (vp);
+	/*
+	 * Search the chain without locking it, and lock it only to take the
+	 * hold if the name is there.  Since we may not block here, give up
+	 * and search again the ordinary way if the lock is busy, or if the
+	 * table has been resized under us.
+	 */
+	SMR_ENTER();
+	mask = nc_hashmask;
+	membar_consumer();
+	hp = &nc_hash[hash & mask];
+	if ((ncp = dnlc_search(hp, dp, name, namlen, hash)) == NULL) {
+		SMR_EXIT();
+		goto miss;
+	}
+	if (mutex_tryenter(&hp->hash_lock)) {
+		if (!NC_RETIRED(hp) && !NC_UNLINKED(ncp)) {
+			SMR_EXIT();
+			goto hit;
 		}
-		depth++;
+		mutex_exit(&hp->hash_lock);
 	}
+	SMR_EXIT();
 
+	ncs.ncs_lookup_lock.value.ui64++;
+	hp = dnlc_hash_enter(hash);
+	if ((ncp = dnlc_search(hp, dp, name, namlen, hash)) == NULL) {
+		mutex_exit(&hp->hash_lock);
+		goto miss;
+	}
+
+hit:
+	/*
+	 * Put a hold on the vnode now so its identity can't change before
+	 * the caller has a chance to put a hold on it.  Also keep a
+	 * negative entry that is in use from being aged out.
+	 */
+	vp = ncp->vp;
+	VN_HOLD_CALLER(vp); /* VN_HOLD 1 of 3 in this file */
+	if (!(ncp->flags & NC_REFERENCED))
+		ncp->flags |= NC_REFERENCED;
 	mutex_exit(&hp->hash_lock);
+	ncstats.hits++;
+	ncs.ncs_hits.value.ui64++;
+	if (vp == DNLC_NO_VNODE) {
+		ncs.ncs_neg_hits.value.ui64++;
+	}
+	DNLC_VFSSTAT(dp, ndnlchit);
+	TRACE_4(TR_FAC_NFS, TR_DNLC_LOOKUP_END,
+	    "dnlc_lookup_end:%S %d vp %x name %s", "hit",
+	    ncstats.hits, vp, name);
+	return (vp);
+
+miss:
 	ncstats.misses++;
 	ncs.ncs_misses.value.ui64++;
+	DNLC_VFSSTAT(dp, ndnlcmiss);
 	TRACE_4(TR_FAC_NFS, TR_DNLC_LOOKUP_END,
 	    "dnlc_lookup_end:%S %d vp %x name %s", "miss", ncstats.misses,
 	    NULL, name);
 	return (NULL);
 }
 
+/*
+ * Resolve as many of the leading components of the path in pnp as the
+ * cache alone can, starting at directory dp.  On success, return a held
+ * vnode for the deepest directory reached, with pnp advanced past the
+ * components (and slashes) consumed; return NULL if not even the first
+ * component could be resolved.  The last component is always left to the
+ * caller, as are ".", "..", mount points, symbolic links and anything
+ * under a directory that its file system has not marked VSEARCHOK.
+ *
+ * The directories passed through are not held.  Instead, the lock on the
+ * chain holding the entry for a directory is kept while looking up the
+ * next name in it, which keeps the entry, and with it the cache's own hold
+ * on the directory, in place.  Since one chain lock is taken while another
+ * is held, the second is only ever tried; if it is busy we stop where we
+ * are and let the caller carry on from there.
+ */
+vnode_t *
+dnlc_lookup_path(vnode_t *dp, struct pathname *pnp)
+{
+	char name[MAXNAMELEN];
+	nc_hash_t *hp = NULL, *nhp;
+	ncache_t *ncp;
+	vnode_t *vp;
+	char *path;
+	size_t pathlen;
+	uchar_t namlen;
+	int hash, mask;
+
+	if (!doingcache)
+		return (NULL);
+
+	SMR_ENTER();
+	while (dp->v_flag & VSEARCHOK) {
+		path = pnp->pn_path;
+		pathlen = pnp->pn_pathlen;
+		if (pn_getcomponent(pnp, name) != 0)
+			break;
+		while (pnp->pn_pathlen > 0 && *pnp->pn_path == '/') {
+			pnp->pn_path++;
+			pnp->pn_pathlen--;
+		}
+		if (pnp->pn_pathlen == 0 || (name[0] == '.' &&
+		    (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))) {
+			pnp->pn_path = path;
+			pnp->pn_pathlen = pathlen;
+			break;
+		}
+
+		DNLCHASH(name, dp, hash, namlen);
+		mask = nc_hashmask;
+		membar_consumer();
+		nhp = &nc_hash[hash & mask];
+		if (nhp != hp && !mutex_tryenter(&nhp->hash_lock)) {
+			pnp->pn_path = path;
+			pnp->pn_pathlen = pathlen;
+			break;
+		}
+		if (NC_RETIRED(nhp) ||
+		    (ncp = dnlc_search(nhp, dp, name, namlen, hash)) == NULL ||
+		    (vp = ncp->vp)->v_type != VDIR ||
+		    vn_mountedvfs(vp) != NULL) {
+			if (nhp != hp)
+				mutex_exit(&nhp->hash_lock);
+			pnp->pn_path = path;
+			pnp->pn_pathlen = pathlen;
+			break;
+		}
+		if (hp != NULL && hp != nhp)
+			mutex_exit(&hp->hash_lock);
+		hp = nhp;
+		dp = vp;
+		ncs.ncs_path_comps.value.ui64++;
+	}
+	SMR_EXIT();
+
+	if (hp == NULL)
+		return (NULL);
+
+	/*
+	 * The chain lock keeps both the entry for dp and the table it is in
+	 * around until dp has a hold of its own.
+	 */
+	VN_HOLD_CALLER(dp); /* VN_HOLD 3 of 3 in this file */
+	mutex_exit(&hp->hash_lock);
+	ncs.ncs_path_walks.value.ui64++;
+	return (dp);
+}
+
 /*
  * Remove an entry in the directory name cache.
  */
@@ -671,18 +1023,18 @@ dnlc_remove(vnode_t *dp, const char *name)
 	if (!doingcache)
 		return;
 	DNLCHASH(name, dp, hash, namlen);
-	hp = &nc_hash[hash & nc_hashmask];
 
-	mutex_enter(&hp->hash_lock);
-	if (ncp = dnlc_search(dp, name, namlen, hash)) {
+	hp = dnlc_hash_enter(hash);
+	if (ncp = dnlc_search(hp, dp, name, namlen, hash)) {
 		/*
 		 * Free up the entry
 		 */
-		nc_rmhash(ncp);
+		dnlc_unlink(ncp, hp);
 		mutex_exit(&hp->hash_lock);
 		VN_RELE_DNLC(ncp->vp);
 		VN_RELE_DNLC(ncp->dp);
-		dnlc_free(ncp);
+		ncp->lru_next = NULL;
+		dnlc_free_deferred(ncp);
 		return;
 	}
 	mutex_exit(&hp->hash_lock);
@@ -696,8 +1048,9 @@ dnlc_purge()
 {
 	nc_hash_t *nch;
 	ncache_t *ncp;
+	ncache_t *freelist = NULL;
 	int index;
-	int i;
+	int i, h;
 	vnode_t *nc_rele[DNLC_MAX_RELE];
 
 	if (!doingcache)
@@ -706,19 +1059,19 @@ dnlc_purge()
 	ncstats.purges++;
 	ncs.ncs_purge_all.value.ui64++;
 
-	for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
+	for (h = 0; (nch = dnlc_hash_index_enter(h)) != NULL; h++) {
 		index = 0;
-		mutex_enter(&nch->hash_lock);
 		ncp = nch->hash_next;
-		while (ncp != (ncache_t *)nch) {
+		while (ncp != NULL) {
 			ncache_t *np;
 
 			np = ncp->hash_next;
 			nc_rele[index++] = ncp->vp;
 			nc_rele[index++] = ncp->dp;
 
-			nc_rmhash(ncp);
-			dnlc_free(ncp);
+			dnlc_unlink(ncp, nch);
+			ncp->lru_next = freelist;
+			freelist = ncp;
 			ncp = np;
 			ncs.ncs_purge_total.value.ui64++;
 			if (index == DNLC_MAX_RELE)
@@ -730,10 +1083,11 @@ dnlc_purge()
 		for (i = 0; i < index; i++) {
 			VN_RELE_DNLC(nc_rele[i]);
 		}
-		if (ncp != (ncache_t *)nch) {
-			nch--; /* Do current hash chain again */
+		if (ncp != NULL) {
+			h--; /* Do current hash chain again */
 		}
 	}
+	dnlc_free_deferred(freelist);
 }
 
 /*
@@ -745,7 +1099,8 @@ dnlc_purge_vp(vnode_t *vp)
 {
 	nc_hash_t *nch;
 	ncache_t *ncp;
-	int index;
+	ncache_t *freelist = NULL;
+	int index, h;
 	vnode_t *nc_rele[DNLC_MAX_RELE];
 
 	ASSERT(vp->v_count > 0);
@@ -759,19 +1114,19 @@ dnlc_purge_vp(vnode_t *vp)
 	ncstats.purges++;
 	ncs.ncs_purge_vp.value.ui64++;
 
-	for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
+	for (h = 0; (nch = dnlc_hash_index_enter(h)) != NULL; h++) {
 		index = 0;
-		mutex_enter(&nch->hash_lock);
 		ncp = nch->hash_next;
-		while (ncp != (ncache_t *)nch) {
+		while (ncp != NULL) {
 			ncache_t *np;
 
 			np = ncp->hash_next;
 			if (ncp->dp == vp || ncp->vp == vp) {
 				nc_rele[index++] = ncp->vp;
 				nc_rele[index++] = ncp->dp;
-				nc_rmhash(ncp);
-				dnlc_free(ncp);
+				dnlc_unlink(ncp, nch);
+				ncp->lru_next = freelist;
+				freelist = ncp;
 				ncs.ncs_purge_total.value.ui64++;
 				if (index == DNLC_MAX_RELE) {
 					ncp = np;
@@ -788,13 +1143,14 @@ dnlc_purge_vp(vnode_t *vp)
 		}
 
 		if (vp->v_count_dnlc == 0) {
-			return;
+			break;
 		}
 
-		if (ncp != (ncache_t *)nch) {
-			nch--; /* Do current hash chain again */
+		if (ncp != NULL) {
+			h--; /* Do current hash chain again */
 		}
 	}
+	dnlc_free_deferred(freelist);
 }
 
 /*
@@ -808,9 +1164,10 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 {
 	nc_hash_t *nch;
 	ncache_t *ncp;
+	ncache_t *freelist = NULL;
 	int n = 0;
 	int index;
-	int i;
+	int i, h;
 	vnode_t *nc_rele[DNLC_MAX_RELE];
 
 	if (!doingcache)
@@ -819,11 +1176,10 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 	ncstats.purges++;
 	ncs.ncs_purge_vfs.value.ui64++;
 
-	for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
+	for (h = 0; (nch = dnlc_hash_index_enter(h)) != NULL; h++) {
 		index = 0;
-		mutex_enter(&nch->hash_lock);
 		ncp = nch->hash_next;
-		while (ncp != (ncache_t *)nch) {
+		while (ncp != NULL) {
 			ncache_t *np;
 
 			np = ncp->hash_next;
@@ -834,8 +1190,9 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 				n++;
 				nc_rele[index++] = ncp->vp;
 				nc_rele[index++] = ncp->dp;
-				nc_rmhash(ncp);
-				dnlc_free(ncp);
+				dnlc_unlink(ncp, nch);
+				ncp->lru_next = freelist;
+				freelist = ncp;
 				ncs.ncs_purge_total.value.ui64++;
 				if (index == DNLC_MAX_RELE) {
 					ncp = np;
@@ -853,12 +1210,13 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 			VN_RELE_DNLC(nc_rele[i]);
 		}
 		if (count != 0 && n >= count) {
-			return (n);
+			break;
 		}
-		if (ncp != (ncache_t *)nch) {
-			nch--; /* Do current hash chain again */
+		if (ncp != NULL) {
+			h--; /* Do current hash chain again */
 		}
 	}
+	dnlc_free_deferred(freelist);
 	return (n);
 }
 
@@ -876,10 +1234,10 @@ dnlc_purge_vfsp(vfs_t *vfsp, int count)
 int
 dnlc_fs_purge1(vnodeops_t *vop)
 {
-	nc_hash_t *end;
 	nc_hash_t *hp;
 	ncache_t *ncp;
 	vnode_t *vp;
+	uint_t h, end;
 
 	if (!doingcache)
 		return (0);
@@ -889,34 +1247,36 @@ dnlc_fs_purge1(vnodeops_t *vop)
 	/*
 	 * Scan the dnlc entries looking for a likely candidate.
 	 */
-	hp = end = dnlc_purge_fs1_rotor;
+	h = end = dnlc_purge_fs1_rotor % nc_hashsz;
 
 	do {
-		if (++hp == &nc_hash[nc_hashsz])
-			hp = nc_hash;
-		dnlc_purge_fs1_rotor = hp;
-		if (hp->hash_next == (ncache_t *)hp)
+		if ((hp = dnlc_hash_index_enter(++h)) == NULL) {
+			h = 0;
+			hp = dnlc_hash_index_enter(h);
+		}
+		dnlc_purge_fs1_rotor = h;
+		if (hp->hash_next == NULL) {
+			mutex_exit(&hp->hash_lock);
 			continue;
-		mutex_enter(&hp->hash_lock);
-		for (ncp = hp->hash_prev;
-		    ncp != (ncache_t *)hp;
-		    ncp = ncp->hash_prev) {
+		}
+		for (ncp = hp->hash_prev; ncp != NULL; ncp = ncp->hash_prev) {
 			vp = ncp->vp;
 			if (!vn_has_cached_data(vp) && (vp->v_count == 1) &&
 			    vn_matchops(vp, vop))
 				break;
 		}
-		if (ncp != (ncache_t *)hp) {
-			nc_rmhash(ncp);
+		if (ncp != NULL) {
+			dnlc_unlink(ncp, hp);
 			mutex_exit(&hp->hash_lock);
 			VN_RELE_DNLC(ncp->dp);
 			VN_RELE_DNLC(vp)
-			dnlc_free(ncp);
+			ncp->lru_next = NULL;
+			dnlc_free_deferred(ncp);
 			ncs.ncs_purge_total.value.ui64++;
 			return (1);
 		}
 		mutex_exit(&hp->hash_lock);
-	} while (hp != end);
+	} while (h != end);
 	return (0);
 }
 
@@ -934,14 +1294,14 @@ dnlc_reverse_lookup(vnode_t *vp, char *buf, size_t buflen)
 	nc_hash_t *nch;
 	ncache_t *ncp;
 	vnode_t *pvp;
+	int h;
 
 	if (!doingcache)
 		return (NULL);
 
-	for (nch = nc_hash; nch < &nc_hash[nc_hashsz]; nch++) {
-		mutex_enter(&nch->hash_lock);
+	for (h = 0; (nch = dnlc_hash_index_enter(h)) != NULL; h++) {
 		ncp = nch->hash_next;
-		while (ncp != (ncache_t *)nch) {
+		while (ncp != NULL) {
 			/*
 			 * We ignore '..' entries since it can create
 			 * confusion and infinite loops.
@@ -952,7 +1312,7 @@ dnlc_reverse_lookup(vnode_t *vp, char *buf, size_t buflen)
 				bcopy(ncp->name, buf, ncp->namlen);
 				buf[ncp->namlen] = '\0';
 				pvp = ncp->dp;
-				/* VN_HOLD 2 of 2 in this file */
+				/* VN_HOLD 2 of 3 in this file */
 				VN_HOLD_CALLER(pvp);
 				mutex_exit(&nch->hash_lock);
 				return (pvp);
@@ -965,18 +1325,17 @@ dnlc_reverse_lookup(vnode_t *vp, char *buf, size_t buflen)
 	return (NULL);
 }
 /*
- * Utility routine to search for a cache entry. Return the
- * ncache entry if found, NULL otherwise.
+ * Utility routine to search a hash chain for a cache entry. Return the
+ * ncache entry if found, NULL otherwise.  Without the chain locked, this
+ * must be called from within an SMR critical section.
  */
 static ncache_t *
-dnlc_search(vnode_t *dp, const char *name, uchar_t namlen, int hash)
+dnlc_search(nc_hash_t *hp, vnode_t *dp, const char *name, uchar_t namlen,
+    int hash)
 {
-	nc_hash_t *hp;
 	ncache_t *ncp;
 
-	hp = &nc_hash[hash & nc_hashmask];
-
-	for (ncp = hp->hash_next; ncp != (ncache_t *)hp; ncp = ncp->hash_next) {
+	for (ncp = hp->hash_next; ncp != NULL; ncp = ncp->hash_next) {
 		if (ncp->hash == hash &&
 		    ncp->dp == dp &&
 		    ncp->namlen == namlen &&
@@ -1024,6 +1383,7 @@ dnlc_get(uchar_t namlen)
 		return (NULL);
 	}
 	ncp->namlen = namlen;
+	ncp->flags = 0;
 	atomic_add_32(&dnlc_nentries, 1);
 	dnlc_reduce_cache(NULL);
 	return (ncp);
@@ -1039,10 +1399,12 @@ dnlc_get(uchar_t namlen)
 static void
 do_dnlc_reduce_cache(void *reduce_percent)
 {
-	nc_hash_t *hp = dnlc_free_rotor, *start_hp = hp;
+	nc_hash_t *hp;
 	vnode_t *vp;
 	ncache_t *ncp;
+	ncache_t *freelist = NULL;
 	int cnt;
+	uint_t h = dnlc_free_rotor, start_h;
 	uint_t low_water = dnlc_nentries_low_water;
 
 	if (reduce_percent) {
@@ -1066,24 +1428,27 @@ do_dnlc_reduce_cache(void *reduce_percent)
 			low_water = dnlc_nentries - reduce_cnt;
 	}
 
+	start_h = h = h % nc_hashsz;
 	do {
 		/*
 		 * Find the first non empty hash queue without locking.
 		 * Only look at each hash queue once to avoid an infinite loop.
 		 */
+		pcrw_enter(&nc_resize_lock, RW_READER);
 		do {
-			if (++hp == &nc_hash[nc_hashsz])
-				hp = nc_hash;
-		} while (hp->hash_next == (ncache_t *)hp && hp != start_hp);
+			h = (h + 1) & nc_hashmask;
+			hp = &nc_hash[h];
+		} while (hp->hash_next == NULL && h != start_h);
 
 		/* return if all hash queues are empty. */
-		if (hp->hash_next == (ncache_t *)hp) {
-			dnlc_reduce_idle = 1;
-			return;
+		if (hp->hash_next == NULL) {
+			pcrw_exit(&nc_resize_lock);
+			break;
 		}
 
 		mutex_enter(&hp->hash_lock);
-		for (cnt = 0, ncp = hp->hash_prev; ncp != (ncache_t *)hp;
+		pcrw_exit(&nc_resize_lock);
+		for (cnt = 0, ncp = hp->hash_prev; ncp != NULL;
 		    ncp = ncp->hash_prev, cnt++) {
 			vp = ncp->vp;
 			/*
@@ -1108,7 +1473,7 @@ do_dnlc_reduce_cache(void *reduce_percent)
 			}
 		}
 		/* check for race and continue */
-		if (hp->hash_next == (ncache_t *)hp) {
+		if (hp->hash_next == NULL) {
 			mutex_exit(&hp->hash_lock);
 			continue;
 		}
@@ -1120,17 +1485,134 @@ found:
 		/*
 		 * Remove from hash chain.
 		 */
-		nc_rmhash(ncp);
+		dnlc_unlink(ncp, hp);
 		mutex_exit(&hp->hash_lock);
 		VN_RELE_DNLC(vp);
 		VN_RELE_DNLC(ncp->dp);
-		dnlc_free(ncp);
+		ncp->lru_next = freelist;
+		freelist = ncp;
 	} while (dnlc_nentries > low_water);
 
-	dnlc_free_rotor = hp;
+	dnlc_free_rotor = h;
+
+	/*
+	 * We are on a taskq and may well have been called because memory
+	 * is short, so rather than queue the entries, wait for the lookups
+	 * to finish with them here.
+	 */
+	if (freelist != NULL) {
+		smr_synchronize();
+		dnlc_free_list(freelist);
+	}
 	dnlc_reduce_idle = 1;
 }
 
+/*
+ * Taskq routine to age negative entries until there are no more than
+ * dnlc_neg_max of them.  Entries that have been looked up since they were
+ * last considered get another round.  Chains that are busy are left for
+ * later, since dnlc_neg_lock is taken after the chain locks.
+ */
+/*ARGSUSED*/
+static void
+dnlc_neg_age(void *unused)
+{
+	nc_hash_t *hp;
+	ncache_t *ncp;
+	ncache_t *freelist = NULL;
+	int index;
+	uint_t scanned;
+	boolean_t more;
+	vnode_t *nc_rele[DNLC_MAX_RELE];
+
+	do {
+		index = 0;
+		pcrw_enter(&nc_resize_lock, RW_READER);
+		mutex_enter(&dnlc_neg_lock);
+		for (scanned = 0; dnlc_neg_nentries > dnlc_neg_max &&
+		    scanned < dnlc_neg_nentries && index < DNLC_MAX_RELE;
+		    scanned++) {
+			ncp = dnlc_neg_list.lru_prev;
+			hp = &nc_hash[ncp->hash & nc_hashmask];
+			if ((ncp->flags & NC_REFERENCED) ||
+			    !mutex_tryenter(&hp->hash_lock)) {
+				ncp->flags &= ~NC_REFERENCED;
+				nc_rmneg(ncp);
+				nc_insneg(ncp);
+				continue;
+			}
+			nc_rmneg(ncp);
+			nc_rmhash(ncp, hp);
+			mutex_exit(&hp->hash_lock);
+			nc_rele[index++] = ncp->vp;
+			nc_rele[index++] = ncp->dp;
+			ncp->lru_next = freelist;
+			freelist = ncp;
+			ncs.ncs_neg_aged.value.ui64++;
+		}
+		more = (index == DNLC_MAX_RELE);
+		mutex_exit(&dnlc_neg_lock);
+		pcrw_exit(&nc_resize_lock);
+
+		/* Release holds on all the vnodes now that we have no locks */
+		while (index) {
+			VN_RELE_DNLC(nc_rele[--index]);
+		}
+	} while (more);
+
+	if (freelist != NULL) {
+		smr_synchronize();
+		dnlc_free_list(freelist);
+	}
+	dnlc_neg_idle = 1;
+}
+
+/*
+ * Taskq routine to grow the hash table once the chains have got too long.
+ * Lookups that race with us may miss an entry that is being moved, but
+ * never find the wrong one.
+ */
+/*ARGSUSED*/
+static void
+dnlc_resize(void *unused)
+{
+	nc_hash_t *ohash, *nhash, *hp;
+	ncache_t *ncp;
+	int osz, nsz, i;
+
+	nsz = 1 << highbit(dnlc_nentries / nc_hashavelen);
+	nsz = MIN(nsz, nc_hashsz_max);
+	if (nsz <= nc_hashsz ||
+	    (nhash = dnlc_hash_alloc(nsz, KM_NOSLEEP)) == NULL) {
+		dnlc_resize_idle = 1;
+		return;
+	}
+
+	pcrw_enter(&nc_resize_lock, RW_WRITER);
+	ohash = nc_hash;
+	osz = nc_hashsz;
+	for (i = 0; i < osz; i++) {
+		hp = &ohash[i];
+		mutex_enter(&hp->hash_lock);
+		while ((ncp = hp->hash_next) != NULL) {
+			hp->hash_next = ncp->hash_next;
+			nc_instail(ncp, &nhash[ncp->hash & (nsz - 1)]);
+		}
+		hp->hash_prev = (ncache_t *)hp;
+		mutex_exit(&hp->hash_lock);
+	}
+	nc_hash = nhash;
+	membar_producer();
+	nc_hashsz = nsz;
+	nc_hashmask = nsz - 1;
+	pcrw_exit(&nc_resize_lock);
+	ncs.ncs_resizes.value.ui64++;
+
+	smr_synchronize();
+	dnlc_hash_free(ohash, osz);
+	dnlc_resize_idle = 1;
+}
+
 /*
  * Directory caching routines
  * ==========================
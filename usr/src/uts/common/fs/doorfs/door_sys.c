@@ -42,6 +42,8 @@
 #include <sys/stack.h>
 #include <sys/debug.h>
 #include <sys/cpuvar.h>
+#include <sys/kstat.h>
+#include <sys/atomic.h>
 #include <sys/file.h>
 #include <sys/fcntl.h>
 #include <sys/vnode.h>
@@ -89,6 +91,23 @@ size_t	door_max_upcall_reply = 1024 * 1024;
  */
 uint_t door_max_desc = 1024;
 
+/*
+ * Statistics on finding server threads for door invocations, exported as
+ * the doorfs:0:door_servers kstat.  All but dks_depleted are updated with
+ * door_knob held, which is also the kstat's lock.
+ */
+static struct door_kstats {
+	kstat_named_t	dks_calls;	/* invocations needing a server */
+	kstat_named_t	dks_waits;	/* ... which had to wait for one */
+	kstat_named_t	dks_waittime;	/* total time spent waiting, in ns */
+	kstat_named_t	dks_depleted;	/* last free server thread taken */
+} door_kstats = {
+	{ "calls",		KSTAT_DATA_UINT64 },
+	{ "waits",		KSTAT_DATA_UINT64 },
+	{ "wait_time",		KSTAT_DATA_UINT64 },
+	{ "depleted",		KSTAT_DATA_UINT64 },
+};
+
 /*
  * Definition of a door handle, used by other kernel subsystems when
  * calling door functions.  This is really a file structure but we
@@ -154,6 +173,7 @@ _init(void)
 	};
 	extern const fs_operation_def_t door_vnodeops_template[];
 	vfsops_t *door_vfsops;
+	kstat_t *ksp;
 	major_t major;
 	int error;
 
@@ -179,6 +199,15 @@ _init(void)
 		cmn_err(CE_WARN, "door init: bad vnode ops");
 		return (error);
 	}
+
+	ksp = kstat_create("doorfs", 0, "door_servers", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (door_kstats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = &door_kstats;
+		ksp->ks_lock = &door_knob;
+		kstat_install(ksp);
+	}
 	return (mod_install(&modlinkage));
 }
 
@@ -1281,6 +1310,9 @@ door_server_dispatch(door_client_t *ct, door_node_t *dp)
 		}
 	}
 
+	if (empty_pool)
+		atomic_inc_64(&door_kstats.dks_depleted.value.ui64);
+
 	if (is_private && empty_pool) {
 		door_info_t di;
 
@@ -1812,11 +1844,13 @@ door_get_server(door_node_t *dp)
 	door_pool_t *pool;
 	door_server_t *st;
 	int signalled;
+	hrtime_t waitstart = 0;
 
 	disp_lock_t *tlp;
 	cpu_t *cp;
 
 	ASSERT(MUTEX_HELD(&door_knob));
+	door_kstats.dks_calls.value.ui64++;
 
 	if (dp->door_flags & DOOR_PRIVATE)
 		pool = &dp->door_servers;
@@ -1852,8 +1886,14 @@ door_get_server(door_node_t *dp)
 		if (server_t != NULL)
 			break;		/* we've got a live one! */
 
+		if (waitstart == 0) {
+			door_kstats.dks_waits.value.ui64++;
+			waitstart = gethrtime();
+		}
 		if (!cv_wait_sig_swap_core(&pool->dp_cv, &door_knob,
 		    &signalled)) {
+			door_kstats.dks_waittime.value.ui64 +=
+			    gethrtime() - waitstart;
 			/*
 			 * If we were signaled and the door is still
 			 * valid, pass the signal on to another waiter.
@@ -1863,6 +1903,8 @@ door_get_server(door_node_t *dp)
 			return (NULL);	/* Got a signal */
 		}
 	}
+	if (waitstart != 0)
+		door_kstats.dks_waittime.value.ui64 += gethrtime() - waitstart;
 
 	/*
 	 * We've got a thread_lock()ed thread which is still on the
@@ -185,7 +185,7 @@ door_inactive(struct vnode *vp, struct cred *cr, caller_context_t *ct)
 	 */
 	ASSERT(vp->v_count == 1);
 	if (dp->door_bound_threads > 0) {
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		return;
 	}
@@ -229,7 +229,7 @@ door_unbind_thread(door_node_t *dp)
 	ASSERT(dp->door_bound_threads > 0);
 	if (--dp->door_bound_threads == 0 && vp->v_count == 0) {
 		/* set up for inactive handling */
-		vp->v_count++;
+		VN_HOLD_LOCKED(vp);
 		do_inactive = 1;
 	}
 	mutex_exit(&vp->v_lock);
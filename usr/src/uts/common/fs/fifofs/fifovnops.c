@@ -1620,7 +1620,7 @@ fifo_inactive(vnode_t *vp, cred_t *crp, caller_context_t *ct)
 	mutex_enter(&ftable_lock);
 	mutex_enter(&vp->v_lock);
 	ASSERT(vp->v_count >= 1);
-	if (--vp->v_count != 0) {
+	if (atomic_dec_uint_nv(&vp->v_count) != 0) {
 		/*
 		 * Somebody accessed the fifo before we got a chance to
 		 * remove it.  They will remove it when they do a vn_rele.
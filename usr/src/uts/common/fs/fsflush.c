@@ -60,6 +60,15 @@
 int doiflush = 1;	/* non-zero to turn inode flushing on */
 int dopageflush = 1;	/* non-zero to turn page flushing on */
 
+/*
+ * fsflush only writes back pages belonging to file systems.  When there
+ * are none in memory at all, as on a system using only ZFS, whose data is
+ * not kept in the page cache, the scan of page_t's can be skipped.  The
+ * scan's coalescing of free pages is then skipped too; the page allocator
+ * still coalesces free pages when it needs a large page.
+ */
+int fsflush_skip_idle = 1;
+
 /*
  * To improve boot performance, don't run the inode flushing loop until
  * the specified number of seconds after boot.  To revert to the old
@@ -96,6 +105,7 @@ typedef struct {
 fsf_stat_t fsf_recent;	/* counts for most recent duty cycle */
 fsf_stat_t fsf_total;	/* total of counts */
 ulong_t fsf_cycles;	/* number of runs refelected in fsf_total */
+ulong_t fsf_skipped;	/* runs skipped for want of file system pages */
 
 /*
  * data used to determine when we can coalesce consecutive free pages
@@ -147,6 +157,11 @@ fsflush_do_pages()
 		nscan = (last_total_pages * (tune.t_fsflushr))/v.v_autoup;
 	}
 
+	if (fsflush_skip_idle && page_fs_pages() == 0) {
+		++fsf_skipped;
+		return;
+	}
+
 	if (pp == NULL)
 		pp = memsegs->pages;
 
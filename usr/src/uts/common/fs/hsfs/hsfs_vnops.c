@@ -397,13 +397,13 @@ hsfs_inactive(struct vnode *vp,
 	}
 
 	if (vp->v_count > 1 || (hp->hs_flags & HREF) == 0) {
-		vp->v_count--;	/* release hold from vn_rele */
+		VN_RELE_LOCKED(vp);	/* release hold from vn_rele */
 		mutex_exit(&vp->v_lock);
 		mutex_exit(&hp->hs_contents_lock);
 		rw_exit(&fsp->hsfs_hash_lock);
 		return;
 	}
-	vp->v_count--;	/* release hold from vn_rele */
+	VN_RELE_LOCKED(vp);	/* release hold from vn_rele */
 	if (vp->v_count == 0) {
 		/*
 		 * Free the hsnode.
@@ -658,7 +658,7 @@ freelonode(lnode_t *lp)
 
 	mutex_enter(&vp->v_lock);
 	if (vp->v_count > 1) {
-		vp->v_count--;	/* release our hold from vn_rele */
+		VN_RELE_LOCKED(vp);	/* release our hold from vn_rele */
 		mutex_exit(&vp->v_lock);
 		TABLE_LOCK_EXIT(lp->lo_vp, li);
 		return;
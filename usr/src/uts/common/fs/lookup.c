@@ -60,6 +60,9 @@
 /* Controls whether paths are stored with vnodes. */
 int vfs_vnode_path = 1;
 
+/* Controls whether leading components may be resolved from the dnlc. */
+int lookup_dnlc_walk = 1;
+
 int
 lookupname(
 	char *fnamep,
@@ -268,6 +271,19 @@ next:
 		goto bad;
 	}
 
+	/*
+	 * Skip over as many intermediate directories as the dnlc can
+	 * resolve by itself.  Callers that want the resolved path, the
+	 * case-preserved name, an audit trail or read access checks on
+	 * every directory need each component to come through here.
+	 */
+	if (lookup_dnlc_walk && rpnp == NULL && pp == NULL && !auditing &&
+	    !(flags & LOOKUP_CHECKREAD) &&
+	    (tvp = dnlc_lookup_path(vp, pnp)) != NULL) {
+		VN_RELE(vp);
+		vp = tvp;
+	}
+
 	if (rpnp && VN_CMP(vp, rootvp))
 		(void) pn_set(rpnp, "/");
 
@@ -581,7 +581,7 @@ nm_unmount(vfs_t *vfsp, int flag, cred_t *crp)
 	nameremove(nodep);
 	thisvp = NMTOV(nodep);
 	mutex_enter(&thisvp->v_lock);
-	if (thisvp->v_count-- == 1) {
+	if (atomic_dec_uint_nv(&thisvp->v_count) == 0) {
 		fp = nodep->nm_filep;
 		mutex_exit(&thisvp->v_lock);
 		vn_invalid(thisvp);
@@ -398,7 +398,7 @@ nm_inactive(vnode_t *vp, cred_t *crp, caller_context_t *ct)
 
 	mutex_enter(&vp->v_lock);
 	ASSERT(vp->v_count >= 1);
-	if (--vp->v_count != 0) {
+	if (atomic_dec_uint_nv(&vp->v_count) != 0) {
 		mutex_exit(&vp->v_lock);
 		return;
 	}
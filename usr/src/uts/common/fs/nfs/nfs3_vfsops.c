@@ -1044,6 +1044,8 @@ nfs3rootvp(vnode_t **rtvpp, vfs_t *vfsp, struct servinfo *svp,
 	if (flags & NFSMNT_INT)
 		mi->mi_flags |= MI_INT;
 	mi->mi_retrans = NFS_RETRIES;
+	mi->mi_nconnect = nfs_mount_nconnect(vfsp);
+	nfs_ra_init(&mi->mi_ra);
 	if (svp->sv_knconf->knc_semantics == NC_TPI_COTS_ORD ||
 	    svp->sv_knconf->knc_semantics == NC_TPI_COTS)
 		mi->mi_timeo = nfs3_cots_timeo;
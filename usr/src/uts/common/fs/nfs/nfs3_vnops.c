@@ -4289,6 +4289,7 @@ nfs3_bio(struct buf *bp, stable_how *stab_comm, cred_t *cr)
 	int error;
 	cred_t *cred;
 	offset_t offset;
+	hrtime_t start;
 
 	ASSERT(nfs_zone() == VTOMI(bp->b_vp)->mi_zone);
 	offset = ldbtob(bp->b_lblkno);
@@ -4308,10 +4309,13 @@ nfs3_bio(struct buf *bp, stable_how *stab_comm, cred_t *cr)
 		}
 		mutex_exit(&rp->r_statelock);
 	read_again:
+		start = gethrtime();
 		error = bp->b_error = nfs3read(bp->b_vp, bp->b_un.b_addr,
 		    offset, bp->b_bcount, &bp->b_resid, cred);
 		crfree(cred);
 		if (!error) {
+			nfs_ra_done(&VTOMI(bp->b_vp)->mi_ra, start,
+			    bp->b_bcount - bp->b_resid);
 			if (bp->b_resid) {
 				/*
 				 * Didn't get it all because we hit EOF,
@@ -4515,7 +4519,8 @@ nfs3_seek(vnode_t *vp, offset_t ooff, offset_t *noffp, caller_context_t *ct)
 }
 
 /*
- * number of nfs3_bsize blocks to read ahead.
+ * number of nfs3_bsize blocks to read ahead until the mount has measured
+ * the path to the server, see nfs_ra_depth().
  */
 static int nfs3_nra = 4;
 
@@ -4627,6 +4632,8 @@ nfs3_getapage(vnode_t *vp, u_offset_t off, size_t len, uint_t *protp,
 	int readahead;
 	int readahead_issued = 0;
 	int ra_window; /* readahead window */
+	int nra;
+	int seq = 0;
 	page_t *pagefound;
 	page_t *savepp;
 
@@ -4661,24 +4668,28 @@ reread:
 		/*
 		 * Calculate the number of readaheads to do.
 		 * a) No readaheads at offset = 0.
-		 * b) Do maximum(nfs3_nra) readaheads when the readahead
+		 * b) Do maximum(nra) readaheads when the readahead
 		 *    window is closed.
-		 * c) Do readaheads between 1 to (nfs3_nra - 1) depending
+		 * c) Do readaheads between 1 to (nra - 1) depending
 		 *    upon how far the readahead window is open or close.
 		 * d) No readaheads if rp->r_nextr is not within the scope
 		 *    of the readahead window (random i/o).
+		 * nra follows the mount's bandwidth-delay product, see
+		 * nfs_ra_depth().
 		 */
+		nra = nfs_ra_depth(&VTOMI(vp)->mi_ra, bsize, nfs3_nra);
 
 		if (off == 0)
 			readahead = 0;
 		else if (blkoff == rp->r_nextr)
-			readahead = nfs3_nra;
+			readahead = nra;
 		else if (rp->r_nextr > blkoff &&
 		    ((ra_window = (rp->r_nextr - blkoff) / bsize)
-		    <= (nfs3_nra - 1)))
-			readahead = nfs3_nra - ra_window;
+		    <= (nra - 1)))
+			readahead = nra - ra_window;
 		else
 			readahead = 0;
+		seq = (readahead > 0);
 
 		rablkoff = rp->r_nextr;
 		while (readahead > 0 && rablkoff + bsize < rp->r_size) {
@@ -4709,7 +4720,12 @@ reread:
 	}
 
 again:
-	if ((pagefound = page_exists(vp, off)) == NULL) {
+	pagefound = page_exists(vp, off);
+	if (seq) {
+		nfs_ra_account(&VTOMI(vp)->mi_ra, pagefound);
+		seq = 0;
+	}
+	if (pagefound == NULL) {
 		if (pl == NULL) {
 			(void) nfs_async_readahead(vp, blkoff, addr, seg, cr,
 			    nfs3_readahead);
@@ -2610,6 +2610,11 @@ nfs4_mnt_kstat_update(kstat_t *ksp, int rw)
 	mik->mik_curread = (uint32_t)mi->mi_curread;
 	mik->mik_curwrite = (uint32_t)mi->mi_curwrite;
 	mik->mik_retrans = mi->mi_retrans;
+	mik->mik_nconnect = mi->mi_nconnect;
+	mik->mik_ralat = (uint32_t)(mi->mi_ra.ra_lat / (NANOSEC / MICROSEC));
+	mik->mik_rarate = mi->mi_ra.ra_rate;
+	mik->mik_rahits = mi->mi_ra.ra_hits;
+	mik->mik_ramisses = mi->mi_ra.ra_misses;
 	mik->mik_timeo = mi->mi_timeo;
 	mik->mik_acregmin = HR2SEC(mi->mi_acregmin);
 	mik->mik_acregmax = HR2SEC(mi->mi_acregmax);
@@ -3106,6 +3111,7 @@ nfs_free_mi4(mntinfo4_t *mi)
 	mutex_destroy(&mi->mi_lock);
 	mutex_destroy(&mi->mi_async_lock);
 	mutex_destroy(&mi->mi_msg_list_lock);
+	nfs_ra_fini(&mi->mi_ra);
 	nfs_rw_destroy(&mi->mi_recovlock);
 	nfs_rw_destroy(&mi->mi_rename_lock);
 	nfs_rw_destroy(&mi->mi_fh_lock);
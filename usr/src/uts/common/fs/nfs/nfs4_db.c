@@ -32,6 +32,7 @@
 #include <nfs/nfs4.h>
 #include <nfs/nfs4_db_impl.h>
 #include <sys/sdt.h>
+#include <sys/smr.h>
 
 static int rfs4_reap_interval = RFS4_REAP_INTERVAL;
 
@@ -39,6 +40,7 @@ static void rfs4_dbe_reap(rfs4_table_t *, time_t, uint32_t);
 static void rfs4_dbe_destroy(rfs4_dbe_t *);
 static rfs4_dbe_t *rfs4_dbe_create(rfs4_table_t *, id_t, rfs4_entry_t);
 static void rfs4_start_reaper(rfs4_table_t *);
+static void rfs4_table_grow(rfs4_table_t *);
 
 /*
  * t_lowat - integer percentage of table entries	/etc/system only
@@ -51,6 +53,15 @@ uint32_t	t_hiwat = 75;	/* reap at t_hreap when id's in use hit 75% */
 time_t		t_lreap = 50;	/* default to 50% of table's reap interval */
 time_t		t_hreap = 10;	/* default to 10% of table's reap interval */
 
+/*
+ * A table's hash buckets are doubled whenever it holds more than two
+ * entries per bucket, up to rfs4_dbt_maxlen buckets.  The reaper tries
+ * rfs4_dbt_grow_tries times to get the table to itself before it gives
+ * up until its next round.
+ */
+uint32_t	rfs4_dbt_maxlen = 1 << 20;
+int		rfs4_dbt_grow_tries = 10;
+
 id_t
 rfs4_dbe_getid(rfs4_dbe_t *entry)
 {
@@ -72,6 +83,24 @@ rfs4_dbe_rele_nolock(rfs4_dbe_t *entry)
 	atomic_add_32(&entry->dbe_refcnt, -1);
 }
 
+/*
+ * Place a hold on an entry found without any locks, unless the reaper has
+ * already taken the table's reference away.
+ */
+static bool_t
+rfs4_dbe_tryhold(rfs4_dbe_t *entry)
+{
+	uint32_t refcnt;
+
+	do {
+		if ((refcnt = entry->dbe_refcnt) == 0)
+			return (FALSE);
+	} while (atomic_cas_32(&entry->dbe_refcnt, refcnt, refcnt + 1) !=
+	    refcnt);
+
+	return (TRUE);
+}
+
 
 uint32_t
 rfs4_dbe_refcnt(rfs4_dbe_t *entry)
@@ -265,7 +294,6 @@ rfs4_table_create(rfs4_database_t *db, char *tabname, time_t max_cache_time,
 	table = kmem_alloc(sizeof (rfs4_table_t), KM_SLEEP);
 	table->dbt_db = db;
 	rw_init(table->dbt_t_lock, NULL, RW_DEFAULT, NULL);
-	mutex_init(table->dbt_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&table->dbt_reaper_cv_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&table->dbt_reaper_wait, NULL, CV_DEFAULT, NULL);
 
@@ -357,7 +385,6 @@ rfs4_table_destroy(rfs4_database_t *db, rfs4_table_t *table)
 	}
 
 	rw_destroy(table->dbt_t_lock);
-	mutex_destroy(table->dbt_lock);
 	mutex_destroy(&table->dbt_reaper_cv_lock);
 	cv_destroy(&table->dbt_reaper_wait);
 
@@ -417,8 +444,13 @@ rfs4_index_destroy(rfs4_index_t *idx)
 	kmem_free(idx, sizeof (rfs4_index_t));
 }
 
+/*
+ * Take an entry that the reaper has claimed out of all the indices it is
+ * still linked into.  Only the reaper resizes the table, so it doesn't
+ * need dbt_t_lock for this.
+ */
 static void
-rfs4_dbe_destroy(rfs4_dbe_t *entry)
+rfs4_dbe_unlink(rfs4_dbe_t *entry)
 {
 	rfs4_index_t *idx;
 	void *key;
@@ -427,15 +459,8 @@ rfs4_dbe_destroy(rfs4_dbe_t *entry)
 	rfs4_table_t *table = entry->dbe_table;
 	rfs4_link_t *l;
 
-	NFS4_DEBUG(table->dbt_debug & DESTROY_DEBUG,
-	    (CE_NOTE, "Destroying entry %p from %s",
-	    (void*)entry, table->dbt_name));
-
-	mutex_enter(entry->dbe_lock);
 	ASSERT(entry->dbe_refcnt == 0);
-	mutex_exit(entry->dbe_lock);
 
-	/* Unlink from all indices */
 	for (idx = table->dbt_indices; idx; idx = idx->dbi_inext) {
 		l = &entry->dbe_indices[idx->dbi_tblidx];
 		/* check and see if we were ever linked in to the index */
@@ -449,6 +474,24 @@ rfs4_dbe_destroy(rfs4_dbe_t *entry)
 		ASSERT(bp->dbk_head != NULL);
 		DEQUEUE_IDX(bp, &entry->dbe_indices[idx->dbi_tblidx]);
 	}
+}
+
+/*
+ * Destroy an entry that is no longer in any index, and that no search can
+ * still be looking at.
+ */
+static void
+rfs4_dbe_destroy(rfs4_dbe_t *entry)
+{
+	rfs4_table_t *table = entry->dbe_table;
+
+	NFS4_DEBUG(table->dbt_debug & DESTROY_DEBUG,
+	    (CE_NOTE, "Destroying entry %p from %s",
+	    (void*)entry, table->dbt_name));
+
+	mutex_enter(entry->dbe_lock);
+	ASSERT(entry->dbe_refcnt == 0);
+	mutex_exit(entry->dbe_lock);
 
 	/* Destroy user data */
 	if (table->dbt_destroy)
@@ -457,9 +500,7 @@ rfs4_dbe_destroy(rfs4_dbe_t *entry)
 	if (table->dbt_id_space)
 		id_free(table->dbt_id_space, entry->dbe_id);
 
-	mutex_enter(table->dbt_lock);
-	table->dbt_count--;
-	mutex_exit(table->dbt_lock);
+	atomic_dec_32(&table->dbt_count);
 
 	/* Destroy the entry itself */
 	kmem_cache_free(table->dbt_mem_cache, entry);
@@ -509,9 +550,7 @@ rfs4_dbe_create(rfs4_table_t *table, id_t id, rfs4_entry_t data)
 		return (NULL);
 	}
 
-	mutex_enter(table->dbt_lock);
-	table->dbt_count++;
-	mutex_exit(table->dbt_lock);
+	atomic_inc_32(&table->dbt_count);
 
 	return (entry);
 }
@@ -546,6 +585,42 @@ rfs4_dbe_tabreap_adjust(rfs4_table_t *table)
 	    table->dbt_name, time_t, table->dbt_id_reap);
 }
 
+/*
+ * Look for an entry in an index without taking any locks.  A match is
+ * only returned if a hold can still be placed on it; a miss, or an entry
+ * the reaper is busy with, is left for the locked search to sort out.
+ */
+static rfs4_dbe_t *
+rfs4_dbsearch_nolock(rfs4_index_t *idx, void *key,
+    rfs4_dbsearch_type_t dbsearch_type)
+{
+	rfs4_table_t	*table = idx->dbi_table;
+	rfs4_link_t	*l;
+	rfs4_dbe_t	*entry, *found = NULL;
+	uint32_t	 len;
+
+	SMR_ENTER();
+	len = table->dbt_len;
+	membar_consumer();
+	l = idx->dbi_buckets[idx->dbi_hash(key) % len].dbk_head;
+	for (; l != NULL; l = l->next) {
+		entry = l->entry;
+		if (INVALID_ADDR(entry))
+			break;
+		if (entry->dbe_refcnt > 0 &&
+		    (entry->dbe_skipsearch == FALSE ||
+		    dbsearch_type == RFS4_DBS_INVALID) &&
+		    (*idx->dbi_compare)(entry->dbe_data, key)) {
+			if (rfs4_dbe_tryhold(entry))
+				found = entry;
+			break;
+		}
+	}
+	SMR_EXIT();
+
+	return (found);
+}
+
 rfs4_entry_t
 rfs4_dbsearch(rfs4_index_t *idx, void *key, bool_t *create, void *arg,
     rfs4_dbsearch_type_t dbsearch_type)
@@ -559,13 +634,23 @@ rfs4_dbsearch(rfs4_index_t *idx, void *key, bool_t *create, void *arg,
 	rfs4_dbe_t	*entry;
 	id_t		 id = -1;
 
-	i = HASH(idx, key);
-	bp = &idx->dbi_buckets[i];
-
 	NFS4_DEBUG(table->dbt_debug & SEARCH_DEBUG,
 	    (CE_NOTE, "Searching for key %p in table %s by %s",
 	    key, table->dbt_name, idx->dbi_keyname));
 
+	if ((entry = rfs4_dbsearch_nolock(idx, key, dbsearch_type)) != NULL) {
+		*create = FALSE;
+
+		NFS4_DEBUG((table->dbt_debug & SEARCH_DEBUG),
+		    (CE_NOTE, "Found entry %p for %p in table %s",
+		    (void *)entry, key, table->dbt_name));
+
+		return (entry->dbe_data);
+	}
+
+	rw_enter(table->dbt_t_lock, RW_READER);
+	i = HASH(idx, key);
+	bp = &idx->dbi_buckets[i];
 	rw_enter(bp->dbk_lock, RW_READER);
 retry:
 	for (l = bp->dbk_head; l; l = l->next) {
@@ -585,6 +670,7 @@ retry:
 
 			mutex_exit(l->entry->dbe_lock);
 			rw_exit(bp->dbk_lock);
+			rw_exit(table->dbt_t_lock);
 
 			*create = FALSE;
 
@@ -605,6 +691,7 @@ retry:
 		    key, table->dbt_name));
 
 		rw_exit(bp->dbk_lock);
+		rw_exit(table->dbt_t_lock);
 		if (id != -1)
 			id_free(table->dbt_id_space, id);
 		return (NULL);
@@ -612,6 +699,7 @@ retry:
 
 	if (table->dbt_id_space && id == -1) {
 		rw_exit(bp->dbk_lock);
+		rw_exit(table->dbt_t_lock);
 
 		/* get an id, ok to sleep for it here */
 		id = id_alloc(table->dbt_id_space);
@@ -621,6 +709,10 @@ retry:
 		rfs4_dbe_tabreap_adjust(table);
 		mutex_exit(&table->dbt_reaper_cv_lock);
 
+		/* the table may have been resized meanwhile */
+		rw_enter(table->dbt_t_lock, RW_READER);
+		i = HASH(idx, key);
+		bp = &idx->dbi_buckets[i];
 		rw_enter(bp->dbk_lock, RW_WRITER);
 		goto retry;
 	}
@@ -641,6 +733,7 @@ retry:
 	entry = rfs4_dbe_create(table, id, arg);
 	if (entry == NULL) {
 		rw_exit(bp->dbk_lock);
+		rw_exit(table->dbt_t_lock);
 		if (id != -1)
 			id_free(table->dbt_id_space, id);
 
@@ -655,8 +748,8 @@ retry:
 	 * reference added even though there may be multiple indices
 	 */
 	rfs4_dbe_hold(entry);
-	ENQUEUE(bp->dbk_head, &entry->dbe_indices[idx->dbi_tblidx]);
 	VALIDATE_ADDR(entry->dbe_indices[idx->dbi_tblidx].entry);
+	ENQUEUE(bp->dbk_head, &entry->dbe_indices[idx->dbi_tblidx]);
 
 	already_done = idx->dbi_tblidx;
 	rw_exit(bp->dbk_lock);
@@ -670,12 +763,20 @@ retry:
 		bp = &ip->dbi_buckets[i];
 		ENQUEUE_IDX(bp, l);
 	}
+	rw_exit(table->dbt_t_lock);
 
 	NFS4_DEBUG(
 	    table->dbt_debug & SEARCH_DEBUG || table->dbt_debug & CREATE_DEBUG,
 	    (CE_NOTE, "Entry %p created for %s = %p in table %s",
 	    (void*)entry, idx->dbi_keyname, (void*)key, table->dbt_name));
 
+	/* Get the reaper to resize the table if it has become crowded. */
+	if (table->dbt_count == 4 * table->dbt_len) {
+		mutex_enter(&table->dbt_reaper_cv_lock);
+		cv_signal(&table->dbt_reaper_wait);
+		mutex_exit(&table->dbt_reaper_cv_lock);
+	}
+
 	return (entry->dbe_data);
 }
 
@@ -698,6 +799,7 @@ rfs4_cpr_callb(void *arg, int code)
 		return (B_TRUE);
 	}
 
+	rw_enter(table->dbt_t_lock, RW_READER);
 	buckets = table->dbt_indices->dbi_buckets;
 
 	/*
@@ -715,6 +817,7 @@ rfs4_cpr_callb(void *arg, int code)
 			cp->rc_last_access = gethrestime_sec();
 		}
 	}
+	rw_exit(table->dbt_t_lock);
 
 	return (B_TRUE);
 }
@@ -732,7 +835,7 @@ rfs4_dbe_walk(rfs4_table_t *table,
     void (*callout)(rfs4_entry_t, void *),
     void *data)
 {
-	rfs4_bucket_t *buckets = table->dbt_indices->dbi_buckets, *bp;
+	rfs4_bucket_t *buckets, *bp;
 	rfs4_link_t *l;
 	rfs4_dbe_t *entry;
 	int i;
@@ -740,6 +843,9 @@ rfs4_dbe_walk(rfs4_table_t *table,
 	NFS4_DEBUG(table->dbt_debug & WALK_DEBUG,
 	    (CE_NOTE, "Walking entries in %s", table->dbt_name));
 
+	rw_enter(table->dbt_t_lock, RW_READER);
+	buckets = table->dbt_indices->dbi_buckets;
+
 	/* Walk the buckets looking for entries to release/destroy */
 	for (i = 0; i < table->dbt_len; i++) {
 		bp = &buckets[i];
@@ -752,11 +858,47 @@ rfs4_dbe_walk(rfs4_table_t *table,
 		}
 		rw_exit(bp->dbk_lock);
 	}
+	rw_exit(table->dbt_t_lock);
 
 	NFS4_DEBUG(table->dbt_debug & WALK_DEBUG,
 	    (CE_NOTE, "Walking entries complete %s", table->dbt_name));
 }
 
+/*
+ * Does a chain hold any entry that nobody but the table refers to?  The
+ * reaper is the only one to take entries out of a chain, so it can look
+ * without locking it.
+ */
+static bool_t
+rfs4_dbe_reapable(rfs4_bucket_t *bp)
+{
+	rfs4_link_t *l;
+
+	for (l = bp->dbk_head; l; l = l->next) {
+		if (l->entry->dbe_refcnt == 1)
+			return (TRUE);
+	}
+	return (FALSE);
+}
+
+/*
+ * Destroy the entries the reaper has unlinked, once no search that may
+ * have found them before can still be looking at them.
+ */
+static void
+rfs4_dbe_reap_flush(rfs4_dbe_t *dead)
+{
+	rfs4_dbe_t *next;
+
+	if (dead == NULL)
+		return;
+
+	smr_synchronize();
+	for (; dead != NULL; dead = next) {
+		next = dead->dbe_reapnext;
+		rfs4_dbe_destroy(dead);
+	}
+}
 
 static void
 rfs4_dbe_reap(rfs4_table_t *table, time_t cache_time, uint32_t desired)
@@ -764,7 +906,7 @@ rfs4_dbe_reap(rfs4_table_t *table, time_t cache_time, uint32_t desired)
 	rfs4_index_t *idx = table->dbt_indices;
 	rfs4_bucket_t *buckets = idx->dbi_buckets, *bp;
 	rfs4_link_t *l, *t;
-	rfs4_dbe_t *entry;
+	rfs4_dbe_t *entry, *dead = NULL;
 	bool_t found;
 	int i;
 	int count = 0;
@@ -776,6 +918,8 @@ rfs4_dbe_reap(rfs4_table_t *table, time_t cache_time, uint32_t desired)
 	/* Walk the buckets looking for entries to release/destroy */
 	for (i = 0; i < table->dbt_len; i++) {
 		bp = &buckets[i];
+		if (!table->dbt_reaper_shutdown && !rfs4_dbe_reapable(bp))
+			continue;
 		do {
 			found = FALSE;
 			rw_enter(bp->dbk_lock, RW_READER);
@@ -788,12 +932,19 @@ rfs4_dbe_reap(rfs4_table_t *table, time_t cache_time, uint32_t desired)
 				 */
 				if (entry->dbe_refcnt != 1)
 					continue;
+				/*
+				 * A search that found the entry without
+				 * locks may take a hold at any time, so
+				 * the last reference can only go with a
+				 * compare-and-swap.
+				 */
 				mutex_enter(entry->dbe_lock);
 				if ((entry->dbe_refcnt == 1) &&
 				    (table->dbt_reaper_shutdown ||
 				    table->dbt_expiry == NULL ||
-				    (*table->dbt_expiry)(entry->dbe_data))) {
-					entry->dbe_refcnt--;
+				    (*table->dbt_expiry)(entry->dbe_data)) &&
+				    atomic_cas_32(&entry->dbe_refcnt, 1,
+				    0) == 1) {
 					count++;
 					found = TRUE;
 				}
@@ -815,11 +966,22 @@ rfs4_dbe_reap(rfs4_table_t *table, time_t cache_time, uint32_t desired)
 						t->next = NULL;
 						t->prev = NULL;
 						INVALIDATE_ADDR(t->entry);
-						rfs4_dbe_destroy(entry);
+						rfs4_dbe_unlink(entry);
+						entry->dbe_reapnext = dead;
+						dead = entry;
 					}
 				}
 			}
 			rw_exit(bp->dbk_lock);
+
+			/*
+			 * Entries of other tables may be waiting for
+			 * these to let go of them when shutting down.
+			 */
+			if (table->dbt_reaper_shutdown) {
+				rfs4_dbe_reap_flush(dead);
+				dead = NULL;
+			}
 			/*
 			 * delay slightly if there is more work to do
 			 * with the expectation that other reaper
@@ -840,6 +1002,7 @@ rfs4_dbe_reap(rfs4_table_t *table, time_t cache_time, uint32_t desired)
 		if (!table->dbt_reaper_shutdown && desired && count >= desired)
 			break;
 	}
+	rfs4_dbe_reap_flush(dead);
 
 	NFS4_DEBUG(table->dbt_debug & REAP_DEBUG,
 	    (CE_NOTE, "Reaped %d entries older than %ld seconds in table %s",
@@ -867,6 +1030,10 @@ reaper_thread(caddr_t *arg)
 		CALLB_CPR_SAFE_END(&table->dbt_reaper_cpr_info,
 		    &table->dbt_reaper_cv_lock);
 		rfs4_dbe_reap(table, table->dbt_max_cache_time, 0);
+		if (table->dbt_count > 2 * table->dbt_len &&
+		    table->dbt_len < rfs4_dbt_maxlen &&
+		    table->dbt_reaper_shutdown == FALSE)
+			rfs4_table_grow(table);
 	} while (rc != 0 && table->dbt_reaper_shutdown == FALSE);
 
 	CALLB_CPR_EXIT(&table->dbt_reaper_cpr_info);
@@ -881,6 +1048,86 @@ reaper_thread(caddr_t *arg)
 	mutex_exit(table->dbt_db->db_lock);
 }
 
+/*
+ * Double the number of hash buckets of all of a table's indices.  Whoever
+ * uses the buckets, other than lock-free searches, holds dbt_t_lock as
+ * reader, so we need it as writer to move the entries.  We must not wait
+ * for it though: a waiting writer would hold off readers, and the create
+ * and walk callouts may well search the table they are called for while
+ * holding the lock as reader already.  So we only try, and leave the table
+ * as it is until the next round if it doesn't come free.
+ */
+static void
+rfs4_table_grow(rfs4_table_t *table)
+{
+	rfs4_index_t *idx;
+	rfs4_bucket_t **nbuckets, **obuckets, *nbp;
+	rfs4_link_t *l, *next;
+	uint32_t len, nlen, i;
+	size_t sz;
+	int tries;
+
+	len = table->dbt_len;
+	nlen = 2 * len + 1;
+	sz = table->dbt_idxcnt * sizeof (rfs4_bucket_t *);
+	nbuckets = kmem_alloc(sz, KM_SLEEP);
+	obuckets = kmem_alloc(sz, KM_SLEEP);
+	for (idx = table->dbt_indices; idx; idx = idx->dbi_inext) {
+		nbuckets[idx->dbi_tblidx] =
+		    kmem_zalloc(nlen * sizeof (rfs4_bucket_t), KM_SLEEP);
+	}
+
+	for (tries = 0; !rw_tryenter(table->dbt_t_lock, RW_WRITER); tries++) {
+		if (tries == rfs4_dbt_grow_tries) {
+			for (idx = table->dbt_indices; idx;
+			    idx = idx->dbi_inext) {
+				kmem_free(nbuckets[idx->dbi_tblidx],
+				    nlen * sizeof (rfs4_bucket_t));
+			}
+			goto out;
+		}
+		delay(1);
+	}
+
+	/*
+	 * Lock-free searches may be following the chains as we move the
+	 * entries.  They may wander into a new chain and miss, and then
+	 * search again with locks, but they can't get lost.
+	 */
+	for (idx = table->dbt_indices; idx; idx = idx->dbi_inext) {
+		obuckets[idx->dbi_tblidx] = idx->dbi_buckets;
+		nbp = nbuckets[idx->dbi_tblidx];
+		for (i = 0; i < len; i++) {
+			for (l = idx->dbi_buckets[i].dbk_head; l; l = next) {
+				next = l->next;
+				ENQUEUE(nbp[idx->dbi_hash(idx->dbi_mkkey(
+				    l->entry->dbe_data)) % nlen].dbk_head, l);
+			}
+		}
+	}
+
+	/*
+	 * A search that sees the new length must see the new buckets; one
+	 * that sees the old length only looks at the first part of them.
+	 */
+	for (idx = table->dbt_indices; idx; idx = idx->dbi_inext)
+		idx->dbi_buckets = nbuckets[idx->dbi_tblidx];
+	membar_producer();
+	table->dbt_len = nlen;
+	rw_exit(table->dbt_t_lock);
+
+	DTRACE_PROBE2(table__grow, char *, table->dbt_name, uint32_t, nlen);
+
+	smr_synchronize();
+	for (idx = table->dbt_indices; idx; idx = idx->dbi_inext) {
+		kmem_free(obuckets[idx->dbi_tblidx],
+		    len * sizeof (rfs4_bucket_t));
+	}
+out:
+	kmem_free(nbuckets, sz);
+	kmem_free(obuckets, sz);
+}
+
 static void
 rfs4_start_reaper(rfs4_table_t *table)
 {
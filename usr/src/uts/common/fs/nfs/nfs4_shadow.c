@@ -303,7 +303,7 @@ sv_inactive(vnode_t *vp)
 	mutex_enter(&vp->v_lock);
 	/* check if someone slipped in while locks were dropped */
 	if (vp->v_count > 1) {
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		mutex_exit(&rp->r_svlock);
 		return;
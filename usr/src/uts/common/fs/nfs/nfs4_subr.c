@@ -1054,6 +1054,11 @@ nfs_clget4(mntinfo4_t *mi, servinfo4_t *svp, cred_t *cr, CLIENT **newcl,
 
 	} while (error == ETIMEDOUT || error == ECONNRESET);
 
+	if (error == 0 && mi->mi_nconnect > 1) {
+		(void) CLNT_CONTROL(*newcl, CLSET_MAXCONNS,
+		    (char *)&mi->mi_nconnect);
+	}
+
 	return (error);
 }
 
@@ -2311,6 +2311,8 @@ nfs4rootvp(vnode_t **rtvpp, vfs_t *vfsp, struct servinfo4 *svp_head,
 	if (flags & NFSMNT_REFERRAL)
 		mi->mi_flags |= MI4_REFERRAL;
 	mi->mi_retrans = NFS_RETRIES;
+	mi->mi_nconnect = nfs_mount_nconnect(vfsp);
+	nfs_ra_init(&mi->mi_ra);
 	if (svp->sv_knconf->knc_semantics == NC_TPI_COTS_ORD ||
 	    svp->sv_knconf->knc_semantics == NC_TPI_COTS)
 		mi->mi_timeo = nfs4_cots_timeo;
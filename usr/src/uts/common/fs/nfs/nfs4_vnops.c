@@ -371,7 +371,8 @@ static int nfs4_lookup_neg_cache = 1;
 
 /*
  * number of pages to read ahead
- * optimized for 100 base-T.
+ * optimized for 100 base-T, until the mount has measured
+ * the path to the server, see nfs_ra_depth().
  */
 static int nfs4_nra = 4;
 
@@ -9521,6 +9522,7 @@ nfs4_bio(struct buf *bp, stable_how4 *stab_comm, cred_t *cr, bool_t readahead)
 	nfs4_open_stream_t *osp = NULL;
 	bool_t first_time = TRUE;	/* first time getting otw cred */
 	bool_t last_time = FALSE;	/* last time getting otw cred */
+	hrtime_t start;
 
 	ASSERT(nfs_zone() == VTOMI4(bp->b_vp)->mi_zone);
 
@@ -9535,11 +9537,14 @@ nfs4_bio(struct buf *bp, stable_how4 *stab_comm, cred_t *cr, bool_t readahead)
 		 */
 		cred_otw = nfs4_get_otw_cred_by_osp(rp, cr, &osp,
 		    &first_time, &last_time);
+		start = gethrtime();
 		error = bp->b_error = nfs4read(bp->b_vp, bp->b_un.b_addr,
 		    offset, bp->b_bcount, &bp->b_resid, cred_otw,
 		    readahead, NULL);
 		crfree(cred_otw);
 		if (!error) {
+			nfs_ra_done(&VTOMI4(bp->b_vp)->mi_ra, start,
+			    bp->b_bcount - bp->b_resid);
 			if (bp->b_resid) {
 				/*
 				 * Didn't get it all because we hit EOF,
@@ -9835,6 +9840,8 @@ nfs4_getapage(vnode_t *vp, u_offset_t off, size_t len, uint_t *protp,
 	int readahead;
 	int readahead_issued = 0;
 	int ra_window; /* readahead window */
+	int nra;
+	int seq = 0;
 	page_t *pagefound;
 	page_t *savepp;
 
@@ -9871,24 +9878,28 @@ reread:
 		/*
 		 * Calculate the number of readaheads to do.
 		 * a) No readaheads at offset = 0.
-		 * b) Do maximum(nfs4_nra) readaheads when the readahead
+		 * b) Do maximum(nra) readaheads when the readahead
 		 *    window is closed.
-		 * c) Do readaheads between 1 to (nfs4_nra - 1) depending
+		 * c) Do readaheads between 1 to (nra - 1) depending
 		 *    upon how far the readahead window is open or close.
 		 * d) No readaheads if rp->r_nextr is not within the scope
 		 *    of the readahead window (random i/o).
+		 * nra follows the mount's bandwidth-delay product, see
+		 * nfs_ra_depth().
 		 */
+		nra = nfs_ra_depth(&VTOMI4(vp)->mi_ra, bsize, nfs4_nra);
 
 		if (off == 0)
 			readahead = 0;
 		else if (blkoff == rp->r_nextr)
-			readahead = nfs4_nra;
+			readahead = nra;
 		else if (rp->r_nextr > blkoff &&
 		    ((ra_window = (rp->r_nextr - blkoff) / bsize)
-		    <= (nfs4_nra - 1)))
-			readahead = nfs4_nra - ra_window;
+		    <= (nra - 1)))
+			readahead = nra - ra_window;
 		else
 			readahead = 0;
+		seq = (readahead > 0);
 
 		rablkoff = rp->r_nextr;
 		while (readahead > 0 && rablkoff + bsize < rp->r_size) {
@@ -9919,7 +9930,12 @@ reread:
 	}
 
 again:
-	if ((pagefound = page_exists(vp, off)) == NULL) {
+	pagefound = page_exists(vp, off);
+	if (seq) {
+		nfs_ra_account(&VTOMI4(vp)->mi_ra, pagefound);
+		seq = 0;
+	}
+	if (pagefound == NULL) {
 		if (pl == NULL) {
 			(void) nfs4_async_readahead(vp, blkoff, addr, seg, cr,
 			    nfs4_readahead);
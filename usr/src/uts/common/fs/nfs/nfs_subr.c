@@ -52,6 +52,8 @@
 #include <sys/bitmap.h>
 #include <sys/acl.h>
 #include <sys/ddi.h>
+#include <sys/sunddi.h>
+#include <sys/mntent.h>
 #include <sys/pathname.h>
 #include <sys/flock.h>
 #include <sys/dirent.h>
@@ -536,6 +538,11 @@ acl_clget(mntinfo_t *mi, servinfo_t *svp, cred_t *cr, CLIENT **newcl,
 
 	} while (error == ETIMEDOUT || error == ECONNRESET);
 
+	if (error == 0 && mi->mi_nconnect > 1) {
+		(void) CLNT_CONTROL(*newcl, CLSET_MAXCONNS,
+		    (char *)&mi->mi_nconnect);
+	}
+
 	return (error);
 }
 
@@ -597,6 +604,11 @@ nfs_clget(mntinfo_t *mi, servinfo_t *svp, cred_t *cr, CLIENT **newcl,
 
 	} while (error == ETIMEDOUT || error == ECONNRESET);
 
+	if (error == 0 && mi->mi_nconnect > 1) {
+		(void) CLNT_CONTROL(*newcl, CLSET_MAXCONNS,
+		    (char *)&mi->mi_nconnect);
+	}
+
 	return (error);
 }
 
@@ -2489,7 +2501,7 @@ start:
 			rw_enter(&rp->r_hashq->r_lock, RW_WRITER);
 			mutex_enter(&vp->v_lock);
 			if (vp->v_count > 1) {
-				vp->v_count--;
+				VN_RELE_LOCKED(vp);
 				mutex_exit(&vp->v_lock);
 				rw_exit(&rp->r_hashq->r_lock);
 				rw_enter(&rhtp->r_lock, RW_READER);
@@ -2504,7 +2516,7 @@ start:
 
 		mutex_enter(&vp->v_lock);
 		if (vp->v_count > 1) {
-			vp->v_count--;
+			VN_RELE_LOCKED(vp);
 			mutex_exit(&vp->v_lock);
 			rw_enter(&rhtp->r_lock, RW_READER);
 			goto start;
@@ -2697,7 +2709,7 @@ rp_addfree(rnode_t *rp, cred_t *cr)
 			rw_enter(&rp->r_hashq->r_lock, RW_WRITER);
 			mutex_enter(&vp->v_lock);
 			if (vp->v_count > 1) {
-				vp->v_count--;
+				VN_RELE_LOCKED(vp);
 				mutex_exit(&vp->v_lock);
 				rw_exit(&rp->r_hashq->r_lock);
 				return;
@@ -2730,7 +2742,7 @@ rp_addfree(rnode_t *rp, cred_t *cr)
 		 */
 		mutex_enter(&vp->v_lock);
 		if (vp->v_count > 1) {
-			vp->v_count--;
+			VN_RELE_LOCKED(vp);
 			mutex_exit(&vp->v_lock);
 			return;
 		}
@@ -2752,7 +2764,7 @@ rp_addfree(rnode_t *rp, cred_t *cr)
 
 	mutex_enter(&vp->v_lock);
 	if (vp->v_count > 1) {
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		rw_exit(&rp->r_hashq->r_lock);
 		return;
@@ -4080,7 +4092,7 @@ nfs_rnode_reclaim(void)
 			rw_enter(&rp->r_hashq->r_lock, RW_WRITER);
 			mutex_enter(&vp->v_lock);
 			if (vp->v_count > 1) {
-				vp->v_count--;
+				VN_RELE_LOCKED(vp);
 				mutex_exit(&vp->v_lock);
 				rw_exit(&rp->r_hashq->r_lock);
 				mutex_enter(&rpfreelist_lock);
@@ -5019,6 +5031,117 @@ nfs_zone(void)
 	return (nfs_global_client_only != 0 ? global_zone : curproc->p_zone);
 }
 
+/*
+ * The number of connections the nconnect mount option asks for, or 0 to
+ * go with what the rpc client does by default.  The connections to a
+ * server are shared by all its mounts.
+ */
+int
+nfs_mount_nconnect(vfs_t *vfsp)
+{
+	char *val;
+	long n;
+
+	if (!vfs_optionisset(vfsp, MNTOPT_NCONNECT, &val) || val == NULL ||
+	    ddi_strtol(val, NULL, 10, &n) != 0 || n <= 1)
+		return (0);
+	return ((int)MIN(n, NFS_MAXNCONNECT));
+}
+
+/*
+ * Adaptive read-ahead.
+ *
+ * A file read sequentially only keeps the reader from waiting if there
+ * are as many blocks in flight as the server can deliver in one round
+ * trip, that is the bandwidth-delay product of the path in blocks.  A
+ * fixed depth starves a reader on a long path and reads too far ahead on
+ * a short one.  Each mount keeps a smoothed READ latency and a smoothed
+ * rate at which READ data comes in, and a sequential reader gets twice
+ * their product: the rate is measured with the read-ahead in flight, so
+ * the extra depth lets the rate climb until the link or the reader
+ * itself is the limit.  Until the first rate sample is in, the fixed
+ * per version depth is used.
+ */
+int nfs_ra_adaptive = 1;
+int nfs_ra_max = 64;			/* most blocks to read ahead */
+
+#define	NFS_RA_SAMPLE	(NANOSEC / 4)	/* length of a rate sample */
+
+void
+nfs_ra_init(nfs_rastat_t *ra)
+{
+	mutex_init(&ra->ra_lock, NULL, MUTEX_DEFAULT, NULL);
+	ra->ra_start = gethrtime();
+}
+
+void
+nfs_ra_fini(nfs_rastat_t *ra)
+{
+	mutex_destroy(&ra->ra_lock);
+}
+
+/*
+ * Account for a READ that was sent at start and returned len bytes.
+ */
+void
+nfs_ra_done(nfs_rastat_t *ra, hrtime_t start, size_t len)
+{
+	hrtime_t now = gethrtime();
+	hrtime_t lat = now - start;
+	hrtime_t span;
+	uint64_t rate;
+
+	mutex_enter(&ra->ra_lock);
+	ra->ra_lat = ra->ra_lat == 0 ? lat : (7 * ra->ra_lat + lat) / 8;
+	ra->ra_bytes += len;
+	span = now - ra->ra_start;
+	if (span >= 4 * NFS_RA_SAMPLE) {
+		/*
+		 * The mount sat idle; that says nothing about the path.
+		 */
+		ra->ra_bytes = len;
+		ra->ra_start = now;
+	} else if (span >= NFS_RA_SAMPLE) {
+		rate = ra->ra_bytes * MICROSEC / (span / (NANOSEC / MICROSEC));
+		ra->ra_rate = ra->ra_rate == 0 ? rate :
+		    (3 * ra->ra_rate + rate) / 4;
+		ra->ra_bytes = 0;
+		ra->ra_start = now;
+	}
+	mutex_exit(&ra->ra_lock);
+}
+
+/*
+ * Return the number of bsize blocks to keep read ahead of a sequential
+ * reader, nra being the fixed depth to use without measurements.  This
+ * looks at the estimates without the lock; a torn value only misjudges
+ * a single read-ahead.
+ */
+int
+nfs_ra_depth(nfs_rastat_t *ra, uint_t bsize, int nra)
+{
+	uint64_t bdp;
+
+	if (!nfs_ra_adaptive || ra->ra_rate == 0)
+		return (nra);
+
+	bdp = ra->ra_rate * (ra->ra_lat / (NANOSEC / MICROSEC)) / MICROSEC;
+	return ((int)MAX(1, MIN(2 * howmany(bdp, bsize), nfs_ra_max)));
+}
+
+/*
+ * Count a sequential reader getting to a block: a hit if the read-ahead
+ * had it ready, a miss if the reader has to wait for the server.
+ */
+void
+nfs_ra_account(nfs_rastat_t *ra, page_t *pp)
+{
+	if (pp != NULL && !page_io_locked(pp))
+		atomic_inc_64(&ra->ra_hits);
+	else
+		atomic_inc_64(&ra->ra_misses);
+}
+
 zoneid_t
 nfs_zoneid(void)
 {
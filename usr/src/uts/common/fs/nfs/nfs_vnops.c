@@ -3381,6 +3381,7 @@ nfs_bio(struct buf *bp, cred_t *cr)
 	int error;
 	cred_t *cred;
 	uint_t offset;
+	hrtime_t start;
 
 	DTRACE_IO1(start, struct buf *, bp);
 
@@ -3400,11 +3401,14 @@ nfs_bio(struct buf *bp, cred_t *cr)
 		}
 		mutex_exit(&rp->r_statelock);
 	read_again:
+		start = gethrtime();
 		error = bp->b_error = nfsread(bp->b_vp, bp->b_un.b_addr,
 		    offset, bp->b_bcount, &bp->b_resid, cred);
 
 		crfree(cred);
 		if (!error) {
+			nfs_ra_done(&VTOMI(bp->b_vp)->mi_ra, start,
+			    bp->b_bcount - bp->b_resid);
 			if (bp->b_resid) {
 				/*
 				 * Didn't get it all because we hit EOF,
@@ -3610,7 +3614,8 @@ nfs_seek(vnode_t *vp, offset_t ooff, offset_t *noffp, caller_context_t *ct)
 
 /*
  * number of NFS_MAXDATA blocks to read ahead
- * optimized for 100 base-T.
+ * optimized for 100 base-T, until the mount has measured
+ * the path to the server, see nfs_ra_depth().
  */
 static int nfs_nra = 4;
 
@@ -3723,6 +3728,8 @@ nfs_getapage(vnode_t *vp, u_offset_t off, size_t len, uint_t *protp,
 	int readahead;
 	int readahead_issued = 0;
 	int ra_window; /* readahead window */
+	int nra;
+	int seq = 0;
 	page_t *pagefound;
 
 	if (nfs_zone() != VTOMI(vp)->mi_zone)
@@ -3756,24 +3763,28 @@ reread:
 		/*
 		 * Calculate the number of readaheads to do.
 		 * a) No readaheads at offset = 0.
-		 * b) Do maximum(nfs_nra) readaheads when the readahead
+		 * b) Do maximum(nra) readaheads when the readahead
 		 *    window is closed.
-		 * c) Do readaheads between 1 to (nfs_nra - 1) depending
+		 * c) Do readaheads between 1 to (nra - 1) depending
 		 *    upon how far the readahead window is open or close.
 		 * d) No readaheads if rp->r_nextr is not within the scope
 		 *    of the readahead window (random i/o).
+		 * nra follows the mount's bandwidth-delay product, see
+		 * nfs_ra_depth().
 		 */
+		nra = nfs_ra_depth(&VTOMI(vp)->mi_ra, bsize, nfs_nra);
 
 		if (off == 0)
 			readahead = 0;
 		else if (blkoff == rp->r_nextr)
-			readahead = nfs_nra;
+			readahead = nra;
 		else if (rp->r_nextr > blkoff &&
 		    ((ra_window = (rp->r_nextr - blkoff) / bsize)
-		    <= (nfs_nra - 1)))
-			readahead = nfs_nra - ra_window;
+		    <= (nra - 1)))
+			readahead = nra - ra_window;
 		else
 			readahead = 0;
+		seq = (readahead > 0);
 
 		rablkoff = rp->r_nextr;
 		while (readahead > 0 && rablkoff + bsize < rp->r_size) {
@@ -3804,7 +3815,12 @@ reread:
 	}
 
 again:
-	if ((pagefound = page_exists(vp, off)) == NULL) {
+	pagefound = page_exists(vp, off);
+	if (seq) {
+		nfs_ra_account(&VTOMI(vp)->mi_ra, pagefound);
+		seq = 0;
+	}
+	if (pagefound == NULL) {
 		if (pl == NULL) {
 			(void) nfs_async_readahead(vp, blkoff, addr, seg, cr,
 			    nfs_readahead);
@@ -944,7 +944,7 @@ pcfs_inactive(
 	mutex_enter(&vp->v_lock);
 	ASSERT(vp->v_count >= 1);
 	if (vp->v_count > 1) {
-		vp->v_count--;  /* release our hold from vn_rele */
+		VN_RELE_LOCKED(vp);  /* release our hold from vn_rele */
 		mutex_exit(&vp->v_lock);
 		pc_unlockfs(fsp);
 		return;
@@ -89,6 +89,7 @@
  *		   The standard close(2) function closes a port.
  * port_associate() : associate a file descriptor with a port to be able to
  *		      retrieve events from that file descriptor.
+ * port_associaten(): associate a list of file descriptors with a port.
  * port_dissociate(): remove the association of a file descriptor with a port.
  * port_alert()	 : set/unset a port in alert mode
  * port_send()	 : send an event of type PORT_SOURCE_USER to a port
@@ -447,6 +448,7 @@ struct port_ksource port_ksource_tab[] = {
 static int port_getn(port_t *, port_event_t *, uint_t, uint_t *,
     port_gettimer_t *);
 static int port_sendn(int [], int [], uint_t, int, void *, uint_t *);
+static int port_associaten(port_t *, int, void *, int [], uint_t, uint_t *);
 static int port_alert(port_t *, int, int, void *);
 static int port_dispatch_event(port_t *, int, int, int, uintptr_t, void *);
 static int port_send(port_t *, int, int, void *);
@@ -656,6 +658,15 @@ portfs(int opcode, uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3,
 		}
 		break;
 	}
+	case	PORT_ASSOCIATEN:
+	{
+		error = port_associaten(pp, (int)a1, (void *)a2, (int *)a3,
+		    (uint_t)a4, (uint_t *)&r.r_val1);
+		releasef((int)a0);
+		if (error && (error != EIO))
+			return ((int64_t)set_errno(error));
+		return (r.r_vals);
+	}
 	case	PORT_SEND:
 	{
 		/* user-defined events */
@@ -1049,6 +1060,80 @@ port_sendn(int ports[], int errors[], uint_t nent, int events, void *user,
 	return (error);
 }
 
+/*
+ * The port_associaten() function is the kernel implementation of the event
+ * port API function port_associaten(3c).
+ * It associates a list of file descriptors with a port. The port itself is
+ * looked up and held only once for the whole list and the list is copied
+ * in with a single copyin(). Every entry is then handled exactly like a
+ * port_associate(3c) call; the per-fd association still acquires the fd
+ * cache lock per entry because VOP_POLL() may drop and re-acquire it.
+ * Errors are reported per entry in the errors[] list, as in port_sendn().
+ */
+static int
+port_associaten(port_t *pp, int source, void *list, int errors[],
+    uint_t nent, uint_t *nassoc)
+{
+	port_assoc_t	*alist;
+	int		*elist = NULL;
+	int		errorcnt = 0;
+	int		error = 0;
+	uint_t		count;
+	model_t		model = get_udatamodel();
+
+	if (source != PORT_SOURCE_FD)
+		return (EINVAL);
+	if (nent == 0 || nent > pp->port_max_list)
+		return (EINVAL);
+
+	alist = kmem_alloc(nent * sizeof (port_assoc_t), KM_SLEEP);
+	if (model == DATAMODEL_NATIVE) {
+		if (copyin(list, alist, nent * sizeof (port_assoc_t))) {
+			kmem_free(alist, nent * sizeof (port_assoc_t));
+			return (EFAULT);
+		}
+	}
+#ifdef	_SYSCALL32_IMPL
+	else {
+		port_assoc32_t	*alist32;
+
+		alist32 = kmem_alloc(nent * sizeof (port_assoc32_t), KM_SLEEP);
+		if (copyin(list, alist32, nent * sizeof (port_assoc32_t))) {
+			kmem_free(alist32, nent * sizeof (port_assoc32_t));
+			kmem_free(alist, nent * sizeof (port_assoc_t));
+			return (EFAULT);
+		}
+		for (count = 0; count < nent; count++) {
+			alist[count].pa_object = alist32[count].pa_object;
+			alist[count].pa_events = alist32[count].pa_events;
+			alist[count].pa_user =
+			    (void *)(uintptr_t)alist32[count].pa_user;
+		}
+		kmem_free(alist32, nent * sizeof (port_assoc32_t));
+	}
+#endif	/* _SYSCALL32_IMPL */
+
+	for (count = 0; count < nent; count++) {
+		error = port_associate_fd(pp, source, alist[count].pa_object,
+		    alist[count].pa_events, alist[count].pa_user);
+		if (error) {
+			elist = port_errorn(elist, nent, error, count);
+			errorcnt++;
+		}
+	}
+
+	error = 0;
+	if (errorcnt) {
+		error = EIO;
+		if (copyout(elist, (void *)errors, nent * sizeof (int)))
+			error = EFAULT;
+		kmem_free(elist, nent * sizeof (int));
+	}
+	*nassoc = nent - errorcnt;
+	kmem_free(alist, nent * sizeof (port_assoc_t));
+	return (error);
+}
+
 static int *
 port_errorn(int *elist, int nent, int error, int index)
 {
@@ -40,6 +40,7 @@
 
 /* local functions */
 static int	port_fd_callback(void *, int *, pid_t, int, void *);
+static void	port_fd_rearm(polldat_t *);
 static int	port_bind_pollhead(pollhead_t **, polldat_t *, short *);
 static void	port_close_sourcefd(void *, int, pid_t, int);
 static void	port_cache_insert_fd(port_fdcache_t *, polldat_t *);
@@ -73,6 +74,8 @@ static void	port_cache_insert_fd(port_fdcache_t *, polldat_t *);
  * The process which associated the fd with a port for the first time
  * becomes also the owner of the association. Only the owner of the
  * association is allowed to dissociate the fd from the port.
+ * Associations made with PORT_FD_PERSIST are re-armed here when their
+ * event is delivered (see port_fd_rearm()).
  */
 /* ARGSUSED */
 static int
@@ -104,6 +107,8 @@ port_fd_callback(void *arg, int *events, pid_t pid, int flag, void *evp)
 			}
 		}
 		*events = pdp->pd_portev->portkev_events; /* update events */
+		if (pfd->pfd_flags & PORTFD_PERSIST)
+			port_fd_rearm(pdp);
 		error = 0;
 		break;
 	case PORT_CALLBACK_DISSOCIATE:
@@ -131,6 +136,36 @@ port_fd_callback(void *arg, int *events, pid_t pid, int flag, void *evp)
 	return (error);
 }
 
+/*
+ * port_fd_rearm()
+ * Re-enable a persistent (PORT_FD_PERSIST) association while its event is
+ * being delivered. pollwakeup() cleared PORT_KEV_VALID when it submitted
+ * the event; setting it again lets the next pollwakeup() on the fd post a
+ * new event without another port_associate(3c). This makes persistent
+ * associations edge-triggered: a condition which is still pending does not
+ * generate a new event, only a new pollwakeup() does. Because the flag is
+ * set again before the event reaches the application, a wakeup which races
+ * with the retrieval is either seen by the application when it consumes
+ * the fd or posted as a new event.
+ * The event was already taken off the port queue and port_getn() holds the
+ * queue blocked, so the association can not be removed underneath us.
+ * The pc_lock must not be taken here: port_remove_fd_object() acquires it
+ * before it waits for the blocked queue.
+ */
+static void
+port_fd_rearm(polldat_t *pdp)
+{
+	port_kevent_t	*pkevp = pdp->pd_portev;
+
+	mutex_enter(&pkevp->portkev_lock);
+	if ((pkevp->portkev_flags & (PORT_KEV_VALID | PORT_KEV_DONEQ)) == 0 &&
+	    (PDTOF(pdp)->pfd_flags & PORTFD_PERSIST)) {
+		pkevp->portkev_events = 0;
+		pkevp->portkev_flags |= PORT_KEV_VALID;
+	}
+	mutex_exit(&pkevp->portkev_lock);
+}
+
 /*
  * This routine returns a pointer to a cached poll fd entry, or NULL if it
  * does not find it in the hash table.
@@ -172,6 +207,8 @@ port_cache_lookup_fp(port_fdcache_t *pcp, int fd, file_t *fp)
  * pollhead_t structure. In such a case the corresponding file system behind
  * VOP_POLL will use the pollwakeup() function to notify about existing
  * events.
+ * If PORT_FD_PERSIST is set in events the association stays enabled after
+ * each delivered event (see port_fd_rearm()).
  */
 int
 port_associate_fd(port_t *pp, int source, uintptr_t object, int events,
@@ -187,12 +224,15 @@ port_associate_fd(port_t *pp, int source, uintptr_t object, int events,
 	short		revents;
 	int		error = 0;
 	int		active;
+	int		pflags;
 
 	pcp = pp->port_queue.portq_pcp;
 	if (object > (uintptr_t)INT_MAX)
 		return (EBADFD);
 
 	fd = object;
+	pflags = (events & PORT_FD_PERSIST) ? PORTFD_PERSIST : 0;
+	events &= ~PORT_FD_PERSIST;
 
 	if ((fp = getf(fd)) == NULL)
 		return (EBADFD);
@@ -296,6 +336,7 @@ port_associate_fd(port_t *pp, int source, uintptr_t object, int events,
 	mutex_enter(&pkevp->portkev_lock);
 	pkevp->portkev_events = 0;	/* no fired events */
 	pdp->pd_events = events;	/* events associated */
+	pfd->pfd_flags = pflags;
 	/*
 	 * allow new events.
 	 */
@@ -233,9 +233,10 @@ propen(vnode_t **vpp, int flag, cred_t *cr, caller_context_t *ct)
 	prnode_t *npnp = NULL;
 
 	/*
-	 * Nothing to do for the /proc directory itself.
+	 * Nothing to do for the /proc directory itself
+	 * or for /proc/psinfo, which belongs to no process.
 	 */
-	if (type == PR_PROCDIR)
+	if (type == PR_PROCDIR || type == PR_ALLPSINFO)
 		return (0);
 
 	/*
@@ -424,9 +425,10 @@ prclose(vnode_t *vp, int flag, int count, offset_t offset, cred_t *cr,
 	user_t *up;
 
 	/*
-	 * Nothing to do for the /proc directory itself.
+	 * Nothing to do for the /proc directory itself
+	 * or for /proc/psinfo, which belongs to no process.
 	 */
-	if (type == PR_PROCDIR)
+	if (type == PR_PROCDIR || type == PR_ALLPSINFO)
 		return (0);
 
 	ASSERT(type != PR_OBJECT && type != PR_FD &&
@@ -589,11 +591,13 @@ static int pr_read_inval(), pr_read_as(), pr_read_status(),
 #if defined(__sparc)
 	pr_read_gwindows(), pr_read_asrs(),
 #endif
-	pr_read_piddir(), pr_read_pidfile(), pr_read_opagedata();
+	pr_read_piddir(), pr_read_pidfile(), pr_read_opagedata(),
+	pr_read_allpsinfo();
 
 static int (*pr_read_function[PR_NFILES])() = {
 	pr_read_inval,		/* /proc				*/
 	pr_read_inval,		/* /proc/self				*/
+	pr_read_allpsinfo,	/* /proc/psinfo				*/
 	pr_read_piddir,		/* /proc/<pid> (old /proc read())	*/
 	pr_read_as,		/* /proc/<pid>/as			*/
 	pr_read_inval,		/* /proc/<pid>/ctl			*/
@@ -869,6 +873,108 @@ pr_read_lpsinfo(prnode_t *pnp, uio_t *uiop)
 	return (error);
 }
 
+/*
+ * /proc/psinfo holds the psinfo of every process visible through this
+ * /proc, laid out like the lpsinfo file: a prheader_t followed by pr_nent
+ * entries pr_entsize bytes apart, in process table order.  It lets ps(1)
+ * and prstat(1M) take a snapshot of the system without opening and reading
+ * /proc/<pid>/psinfo for each process.  It is not listed by readdir(), so
+ * that everything in the /proc directory continues to be a process.
+ */
+static int
+pr_read_allpsinfo_common(prnode_t *pnp, uio_t *uiop, model_t model)
+{
+	extern uint_t nproc;
+	zoneid_t zoneid = VTOZONE(PTOV(pnp))->zone_id;
+	size_t hdrsize, entsize, size;
+	caddr_t buf, sp;
+	proc_t *p;
+	int slot, nent, n;
+	int error;
+
+	ASSERT(pnp->pr_type == PR_ALLPSINFO);
+
+#ifdef _SYSCALL32_IMPL
+	if (model != DATAMODEL_NATIVE) {
+		hdrsize = sizeof (prheader32_t);
+		entsize = LSPAN32(psinfo32_t);
+	} else
+#endif
+	{
+		hdrsize = sizeof (prheader_t);
+		entsize = LSPAN(psinfo_t);
+	}
+
+	/*
+	 * Leave some room for processes created while we allocate the
+	 * buffer; any more than that are left out of this snapshot.
+	 */
+	nent = nproc + 16;
+	size = hdrsize + nent * entsize;
+	buf = kmem_zalloc(size, KM_SLEEP);
+	sp = buf + hdrsize;
+
+	slot = n = 0;
+	while (slot < v.v_proc && n < nent) {
+		/*
+		 * Skip processes not visible where this /proc was mounted,
+		 * as pr_readdir_procdir() does.
+		 */
+		mutex_enter(&pidlock);
+		if ((p = pid_entry(slot)) == NULL || p->p_stat == SIDL ||
+		    (zoneid != GLOBAL_ZONEID && p->p_zone->zone_id != zoneid) ||
+		    secpolicy_basic_procinfo(CRED(), p, curproc) != 0) {
+			mutex_exit(&pidlock);
+			slot++;
+			continue;
+		}
+		mutex_enter(&p->p_lock);
+		mutex_exit(&pidlock);
+
+		/*
+		 * prgetpsinfo() may drop p->p_lock; P_PR_LOCK keeps the
+		 * process from going away meanwhile.  If someone else has
+		 * it, wait for them and then look at this slot again.
+		 */
+		if (p->p_proc_flag & P_PR_LOCK) {
+			sprwaitlock_proc(p);
+			continue;
+		}
+		sprlock_proc(p);
+#ifdef _SYSCALL32_IMPL
+		if (model != DATAMODEL_NATIVE)
+			prgetpsinfo32(p, (psinfo32_t *)sp);
+		else
+#endif
+			prgetpsinfo(p, (psinfo_t *)sp);
+		sprunlock(p);
+		sp += entsize;
+		n++;
+		slot++;
+	}
+
+#ifdef _SYSCALL32_IMPL
+	if (model != DATAMODEL_NATIVE) {
+		((prheader32_t *)buf)->pr_nent = n;
+		((prheader32_t *)buf)->pr_entsize = entsize;
+	} else
+#endif
+	{
+		((prheader_t *)buf)->pr_nent = n;
+		((prheader_t *)buf)->pr_entsize = entsize;
+	}
+
+	error = pr_uioread(buf, hdrsize + n * entsize, uiop);
+	kmem_free(buf, size);
+	return (error);
+}
+
+static int
+pr_read_allpsinfo(prnode_t *pnp, uio_t *uiop)
+{
+	return (pr_read_allpsinfo_common(pnp, uiop, DATAMODEL_NATIVE));
+}
+
 static int
 pr_read_map_common(prnode_t *pnp, uio_t *uiop, prnodetype_t type)
 {
@@ -1746,11 +1852,12 @@ static int pr_read_status_32(),
 #if defined(__sparc)
 	pr_read_gwindows_32(),
 #endif
-	pr_read_opagedata_32();
+	pr_read_opagedata_32(), pr_read_allpsinfo_32();
 
 static int (*pr_read_function_32[PR_NFILES])() = {
 	pr_read_inval,		/* /proc				*/
 	pr_read_inval,		/* /proc/self				*/
+	pr_read_allpsinfo_32,	/* /proc/psinfo				*/
 	pr_read_piddir,		/* /proc/<pid> (old /proc read())	*/
 	pr_read_as,		/* /proc/<pid>/as			*/
 	pr_read_inval,		/* /proc/<pid>/ctl			*/
@@ -1980,6 +2087,12 @@ pr_read_lpsinfo_32(prnode_t *pnp, uio_t *uiop)
 	return (error);
 }
 
+static int
+pr_read_allpsinfo_32(prnode_t *pnp, uio_t *uiop)
+{
+	return (pr_read_allpsinfo_common(pnp, uiop, DATAMODEL_ILP32));
+}
+
 static int
 pr_read_map_common_32(prnode_t *pnp, uio_t *uiop, prnodetype_t type)
 {
@@ -2891,6 +3004,20 @@ prgetattr(vnode_t *vp, vattr_t *vap, int flags, cred_t *cr,
 		return (0);
 	}
 
+	/*
+	 * /proc/psinfo has no prcommon member either
+	 */
+	if (type == PR_ALLPSINFO) {
+		vap->va_uid = 0;
+		vap->va_gid = 0;
+		vap->va_nodeid = (ino64_t)PR_ALLPSINFO;
+		gethrestime(&now);
+		vap->va_atime = vap->va_mtime = vap->va_ctime = now;
+		vap->va_nlink = 1;
+		vap->va_size = 0;
+		return (0);
+	}
+
 	p = pr_p_lock(pnp);
 	mutex_exit(&pr_pidlock);
 	if (p == NULL)
@@ -3195,6 +3322,7 @@ praccess(vnode_t *vp, int mode, int flags, cred_t *cr, caller_context_t *ct)
 
 	switch (type) {
 	case PR_PROCDIR:
+	case PR_ALLPSINFO:
 		break;
 
 	case PR_OBJECT:
@@ -3291,6 +3419,7 @@ static vnode_t *pr_lookup_notdir(), *pr_lookup_procdir(), *pr_lookup_piddir(),
 static vnode_t *(*pr_lookup_function[PR_NFILES])() = {
 	pr_lookup_procdir,	/* /proc				*/
 	pr_lookup_notdir,	/* /proc/self				*/
+	pr_lookup_notdir,	/* /proc/psinfo				*/
 	pr_lookup_piddir,	/* /proc/<pid>				*/
 	pr_lookup_notdir,	/* /proc/<pid>/as			*/
 	pr_lookup_notdir,	/* /proc/<pid>/ctl			*/
@@ -3456,6 +3585,9 @@ pr_lookup_procdir(vnode_t *dp, char *comp)
 	if (strcmp(comp, "self") == 0) {
 		pnp = prgetnode(dp, PR_SELF);
 		return (PTOV(pnp));
+	} else if (strcmp(comp, "psinfo") == 0) {
+		pnp = prgetnode(dp, PR_ALLPSINFO);
+		return (PTOV(pnp));
 	} else {
 		pid = 0;
 		while ((c = *comp++) != '\0') {
@@ -4545,6 +4677,7 @@ prgetnode(vnode_t *dp, prnodetype_t type)
 		pnp->pr_mode = 0600;	/* read-write by owner only */
 		break;
 
+	case PR_ALLPSINFO:
 	case PR_PSINFO:
 	case PR_LPSINFO:
 	case PR_LWPSINFO:
@@ -4640,6 +4773,7 @@ static int pr_readdir_notdir(), pr_readdir_procdir(), pr_readdir_piddir(),
 static int (*pr_readdir_function[PR_NFILES])() = {
 	pr_readdir_procdir,	/* /proc				*/
 	pr_readdir_notdir,	/* /proc/self				*/
+	pr_readdir_notdir,	/* /proc/psinfo				*/
 	pr_readdir_piddir,	/* /proc/<pid>				*/
 	pr_readdir_notdir,	/* /proc/<pid>/as			*/
 	pr_readdir_notdir,	/* /proc/<pid>/ctl			*/
@@ -5569,6 +5703,7 @@ prinactive(vnode_t *vp, cred_t *cr, caller_context_t *ct)
 	case PR_OBJECT:
 	case PR_FD:
 	case PR_SELF:
+	case PR_ALLPSINFO:
 	case PR_PATH:
 		/* These are not linked into the usual lists */
 		ASSERT(vp->v_count == 1);
@@ -5588,7 +5723,7 @@ prinactive(vnode_t *vp, cred_t *cr, caller_context_t *ct)
 	mutex_enter(&vp->v_lock);
 
 	if (type == PR_PROCDIR || vp->v_count > 1) {
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		if (p != NULL)
 			mutex_exit(&p->p_lock);
@@ -5921,6 +6056,12 @@ prpoll(vnode_t *vp, short events, int anyyet, short *reventsp,
 
 	ASSERT(pnp->pr_type < PR_NFILES);
 
+	/*
+	 * /proc/psinfo belongs to no process; poll it as a plain file.
+	 */
+	if (pnp->pr_type == PR_ALLPSINFO)
+		return (fs_poll(vp, events, anyyet, reventsp, phpp, ct));
+
 	/*
 	 * Support for old /proc interface.
 	 */
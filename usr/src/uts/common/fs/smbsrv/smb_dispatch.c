@@ -712,15 +712,18 @@ andx_more:
 	 * state of the session back to SMB_SESSION_STATE_NEGOTIATED
 	 * (if the current state is SMB_SESSION_STATE_OPLOCK_BREAKING).
 	 * Otherwise we let the read raw handler to deal with it.
+	 *
+	 * Every request of the session comes through here, so only take
+	 * s_lock when there is likely something to do; the state is checked
+	 * again under the lock.
 	 */
-	smb_rwx_rwenter(&session->s_lock, RW_READER);
 	if ((session->s_state == SMB_SESSION_STATE_OPLOCK_BREAKING) &&
 	    (sr->smb_com != SMB_COM_READ_RAW)) {
-		(void) smb_rwx_rwupgrade(&session->s_lock);
+		smb_rwx_rwenter(&session->s_lock, RW_WRITER);
 		if (session->s_state == SMB_SESSION_STATE_OPLOCK_BREAKING)
 			session->s_state = SMB_SESSION_STATE_NEGOTIATED;
+		smb_rwx_rwexit(&session->s_lock);
 	}
-	smb_rwx_rwexit(&session->s_lock);
 
 	sr->sr_time_start = gethrtime();
 	if ((sdrc = (*sdd->sdt_pre_op)(sr)) == SDRC_SUCCESS)
@@ -967,6 +970,13 @@ smbsr_send_reply(smb_request_t *sr)
 		smb_sign_reply(sr, NULL);
 
 	smb_server_inc_req(sr->session->s_server);
+	if (sr->sr_loan != NULL) {
+		if (smb_session_send_loan(sr->session, &sr->reply,
+		    sr->sr_loan) == 0)
+			sr->reply.chain = 0;
+		sr->sr_loan = NULL;
+		return;
+	}
 	if (smb_session_send(sr->session, 0, &sr->reply) == 0)
 		sr->reply.chain = 0;
 }
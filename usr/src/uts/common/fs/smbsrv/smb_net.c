@@ -36,6 +36,8 @@
 #include <sys/fs/dv_node.h>
 #include <sys/vnode.h>
 #include <sys/ksocket.h>
+#include <sys/stream.h>
+#include <sys/strsun.h>
 #undef mem_free /* XXX Remove this after we convert everything to kmem_alloc */
 
 #include <smbsrv/smb_vops.h>
@@ -43,6 +45,11 @@
 #include <smbsrv/smb_kproto.h>
 #include <smbsrv/smb_kstat.h>
 
+/*
+ * Most transmit buffers handed to the transport in one send.
+ */
+#define	SMB_NET_TXR_BATCH	16
+
 static	kmem_cache_t	*smb_txr_cache = NULL;
 
 /*
@@ -206,11 +213,34 @@ smb_net_txr_alloc(void)
 
 	txr = kmem_cache_alloc(smb_txr_cache, KM_SLEEP);
 	txr->tr_len = 0;
+	txr->tr_data = txr->tr_buf;
+	txr->tr_size = sizeof (txr->tr_buf);
+	txr->tr_mp = NULL;
 	bzero(&txr->tr_lnd, sizeof (txr->tr_lnd));
 	txr->tr_magic = SMB_TXREQ_MAGIC;
 	return (txr);
 }
 
+/*
+ * smb_net_txr_reserve
+ *
+ *	Make room for a message of size bytes, which only large reads
+ *	need beyond the built-in buffer.
+ */
+void
+smb_net_txr_reserve(smb_txreq_t *txr, int size)
+{
+	ASSERT(txr->tr_magic == SMB_TXREQ_MAGIC);
+	ASSERT(txr->tr_len == 0);
+
+	if (size <= txr->tr_size)
+		return;
+	if (txr->tr_data != txr->tr_buf)
+		kmem_free(txr->tr_data, txr->tr_size);
+	txr->tr_data = kmem_alloc(size, KM_SLEEP);
+	txr->tr_size = size;
+}
+
 /*
  * smb_net_txr_free
  *
@@ -222,22 +252,64 @@ smb_net_txr_free(smb_txreq_t *txr)
 	ASSERT(txr->tr_magic == SMB_TXREQ_MAGIC);
 	ASSERT(!list_link_active(&txr->tr_lnd));
 
+	if (txr->tr_data != txr->tr_buf)
+		kmem_free(txr->tr_data, txr->tr_size);
+	if (txr->tr_mp != NULL)
+		freemsg(txr->tr_mp);
 	txr->tr_magic = 0;
 	kmem_cache_free(smb_txr_cache, txr);
 }
 
+/*
+ * smb_net_txr_sendmblk
+ *
+ *	Send a transmit buffer followed by the loaned data hanging off it.
+ *	The buffer is copied into an mblk of its own, which is cheap next
+ *	to the data, and the loaned mblks go to the transport as they are;
+ *	they are freed, and the loan returned, when the transport is done
+ *	with them.
+ */
+static int
+smb_net_txr_sendmblk(ksocket_t so, struct nmsghdr *msg, smb_txreq_t *txr)
+{
+	mblk_t	*mp;
+	int	rc;
+
+	ASSERT(txr->tr_magic == SMB_TXREQ_MAGIC);
+
+	if ((mp = allocb(txr->tr_len, BPRI_MED)) == NULL)
+		return (ENOMEM);
+	bcopy(txr->tr_data, mp->b_wptr, txr->tr_len);
+	mp->b_wptr += txr->tr_len;
+	mp->b_cont = txr->tr_mp;
+	txr->tr_mp = NULL;
+
+	rc = ksocket_sendmblk(so, msg, 0, &mp, CRED());
+	if (rc != 0 && mp != NULL)
+		freemsg(mp);
+	return (rc);
+}
+
 /*
  * smb_net_txr_send
  *
  *	This routine puts the transmit buffer passed in on the wire. If another
  *	thread is already draining the transmit list, the transmit buffer is
- *	queued and the routine returns immediately.
+ *	queued and the routine returns immediately.  The draining thread
+ *	sends what has been queued meanwhile, up to SMB_NET_TXR_BATCH
+ *	buffers at a time, in a single call into the transport, so that the
+ *	replies of requests completing together leave in as few segments as
+ *	they fit in.  A buffer followed by loaned data goes on its own, as
+ *	an mblk chain.
  */
 int
 smb_net_txr_send(ksocket_t so, smb_txlst_t *txl, smb_txreq_t *txr)
 {
 	list_t		local;
+	struct nmsghdr	msg;
+	struct iovec	iov[SMB_NET_TXR_BATCH];
 	int		rc = 0;
+	int		i, n;
 	size_t		sent = 0;
 	size_t		len;
 
@@ -257,14 +329,36 @@ smb_net_txr_send(ksocket_t so, smb_txlst_t *txl, smb_txreq_t *txr)
 	while (!list_is_empty(&txl->tl_list)) {
 		list_move_tail(&local, &txl->tl_list);
 		mutex_exit(&txl->tl_mutex);
-		while ((txr = list_head(&local)) != NULL) {
-			ASSERT(txr->tr_magic == SMB_TXREQ_MAGIC);
-			list_remove(&local, txr);
-
-			len = txr->tr_len;
-			rc = ksocket_send(so, txr->tr_buf, txr->tr_len,
-			    MSG_WAITALL, &sent, CRED());
-			smb_net_txr_free(txr);
+		while (!list_is_empty(&local)) {
+			bzero(&msg, sizeof (msg));
+			len = 0;
+			sent = 0;
+			txr = list_head(&local);
+			if (txr->tr_mp != NULL) {
+				list_remove(&local, txr);
+				rc = smb_net_txr_sendmblk(so, &msg, txr);
+				smb_net_txr_free(txr);
+			} else {
+				n = 0;
+				for (; txr != NULL && txr->tr_mp == NULL &&
+				    n < SMB_NET_TXR_BATCH;
+				    txr = list_next(&local, txr)) {
+					ASSERT(txr->tr_magic == SMB_TXREQ_MAGIC);
+					iov[n].iov_base = (caddr_t)txr->tr_data;
+					iov[n].iov_len = txr->tr_len;
+					len += txr->tr_len;
+					n++;
+				}
+
+				msg.msg_iov = iov;
+				msg.msg_iovlen = n;
+				rc = ksocket_sendmsg(so, &msg, MSG_WAITALL,
+				    &sent, CRED());
+				for (i = 0; i < n; i++) {
+					smb_net_txr_free(
+					    list_remove_head(&local));
+				}
+			}
 			if ((rc == 0) && (sent == len))
 				continue;
 
@@ -22,6 +22,8 @@
  * Copyright (c) 2007, 2010, Oracle and/or its affiliates. All rights reserved.
  */
 
+#include <sys/stream.h>
+#include <sys/strsun.h>
 #include <smbsrv/smb_kproto.h>
 #include <smbsrv/smb_fsops.h>
 
@@ -39,11 +41,34 @@
 #define	SMB_CORE_READ_MAX	4432
 
 /*
- * The limit in bytes for SmbReadX.
+ * The limit in bytes for SmbReadX.  With CAP_LARGE_READX the limit is
+ * what the transport can frame: the NetBIOS session service has a 17 bit
+ * length field, direct hosted TCP a 24 bit one, which is more than we
+ * want to buffer for a single read; 1MB is what MAX_IOVEC mbuf clusters
+ * hold.  Leave room for the reply header.
  */
 #define	SMB_READX_MAX		0x10000
+#define	SMB_READX_NBT_MAX	(0x20000 - 0x400)
+#define	SMB_READX_LARGE_MAX	0x100000
+
+/*
+ * SmbReadX replies of at least this many bytes are sent straight from
+ * buffers loaned by the file system (ZFS ARC buffers), if it will loan
+ * them, instead of being copied into the reply.  Zero disables loaning.
+ */
+uint32_t smb_read_loan_min = 32 * 1024;
+
+typedef struct smb_read_loan {
+	xuio_t		rl_uio;
+	frtn_t		rl_frtn;
+	vnode_t		*rl_vp;
+	uint32_t	rl_ref;		/* mblks, plus one while building */
+} smb_read_loan_t;
 
 int smb_common_read(smb_request_t *, smb_rw_param_t *);
+static uint32_t smb_readx_max(smb_session_t *);
+static int smb_read_loan(smb_request_t *, smb_node_t *, smb_rw_param_t *,
+    size_t *);
 
 /*
  * Read bytes from a file or named pipe (SMB Core).
@@ -449,9 +474,18 @@ smb_com_read_andx(smb_request_t *sr)
 
 	sr->user_cr = smb_ofile_getcred(sr->fid_ofile);
 
-	if (param->rw_count >= SMB_READX_MAX)
+	if (param->rw_count > smb_readx_max(sr->session))
 		param->rw_count = 0;
 
+	/*
+	 * Loaned data can only go at the very end of the reply, and signing
+	 * would have to look at it.
+	 */
+	param->rw_loan = (smb_read_loan_min != 0 &&
+	    param->rw_count >= smb_read_loan_min &&
+	    param->rw_andx == 0xFF &&
+	    !(sr->session->signing.flags & SMB_SIGNING_ENABLED));
+
 	if ((rc = smb_common_read(sr, param)) != 0) {
 		smbsr_errno(sr, rc);
 		return (SDRC_ERROR);
@@ -497,9 +531,37 @@ smb_com_read_andx(smb_request_t *sr)
 		    &sr->raw_data);
 	}
 
+	if (sr->sr_loan != NULL) {
+		if (rc != 0) {
+			freemsg(sr->sr_loan);
+			sr->sr_loan = NULL;
+		} else {
+			/*
+			 * The data follows the reply rather than being in
+			 * it, so the byte count came out as zero.
+			 */
+			(void) smb_mbc_poke(&sr->reply,
+			    MBC_LENGTH(&sr->reply) - 2, "w",
+			    (uint16_t)param->rw_count);
+		}
+	}
+
 	return ((rc == 0) ? SDRC_SUCCESS : SDRC_ERROR);
 }
 
+/*
+ * The largest SmbReadX count we will satisfy on this session.
+ */
+static uint32_t
+smb_readx_max(smb_session_t *session)
+{
+	if (!(session->capabilities & CAP_LARGE_READX))
+		return (SMB_READX_MAX - 1);
+	if (session->s_local_port == IPPORT_NETBIOS_SSN)
+		return (SMB_READX_NBT_MAX);
+	return (SMB_READX_LARGE_MAX);
+}
+
 /*
  * Common function for reading files or IPC/MSRPC named pipes.  All
  * protocol read functions should lookup the fid before calling this
@@ -521,6 +583,7 @@ smb_common_read(smb_request_t *sr, smb_rw_param_t *param)
 	smb_node_t *node;
 	smb_vdb_t *vdb = &param->rw_vdb;
 	struct mbuf *top;
+	size_t nread;
 	int rc;
 
 	vdb->vdb_tag = 0;
@@ -558,6 +621,13 @@ smb_common_read(smb_request_t *sr, smb_rw_param_t *param)
 			break;
 		}
 
+		if (param->rw_loan && !smb_node_is_dir(node) &&
+		    smb_read_loan(sr, node, param, &nread) == 0) {
+			vdb->vdb_uio.uio_resid -= nread;
+			rc = 0;
+			break;
+		}
+
 		sr->raw_data.max_bytes = vdb->vdb_uio.uio_resid;
 		top = smb_mbuf_allocate(&vdb->vdb_uio);
 
@@ -598,3 +668,81 @@ smb_common_read(smb_request_t *sr, smb_rw_param_t *param)
 	mutex_exit(&sr->fid_ofile->f_mutex);
 	return (rc);
 }
+
+static void
+smb_read_loan_rele(smb_read_loan_t *rl)
+{
+	if (atomic_dec_32_nv(&rl->rl_ref) == 0) {
+		smb_vop_retzcbuf(rl->rl_vp, &rl->rl_uio);
+		VN_RELE(rl->rl_vp);
+		kmem_free(rl, sizeof (smb_read_loan_t));
+	}
+}
+
+/*
+ * Read into buffers loaned by the file system and leave them, wrapped in
+ * mblks that return the loan when freed, in sr->sr_loan to be sent after
+ * the reply.  Fails if the file system won't loan for this range, e.g.
+ * because it isn't block aligned, in which case the caller copies.
+ */
+static int
+smb_read_loan(smb_request_t *sr, smb_node_t *node, smb_rw_param_t *param,
+    size_t *nread)
+{
+	smb_read_loan_t	*rl;
+	uio_t		*uio;
+	mblk_t		*mp = NULL;
+	mblk_t		*nmp;
+	size_t		len, n;
+	int		i, rc;
+
+	ASSERT(sr->sr_loan == NULL);
+
+	rl = kmem_zalloc(sizeof (smb_read_loan_t), KM_SLEEP);
+	rl->rl_uio.xu_type = UIOTYPE_ZEROCOPY;
+	uio = &rl->rl_uio.xu_uio;
+	uio->uio_segflg = UIO_SYSSPACE;
+	uio->uio_loffset = (offset_t)param->rw_offset;
+	uio->uio_llimit = MAXOFFSET_T;
+	uio->uio_resid = param->rw_count;
+	if (smb_vop_reqzcbuf(node->vp, &rl->rl_uio, sr->user_cr) != 0) {
+		kmem_free(rl, sizeof (smb_read_loan_t));
+		return (ENOTSUP);
+	}
+	VN_HOLD(node->vp);
+	rl->rl_vp = node->vp;
+	rl->rl_ref = 1;
+	rl->rl_frtn.free_func = smb_read_loan_rele;
+	rl->rl_frtn.free_arg = (caddr_t)rl;
+
+	rc = smb_fsop_read(sr, sr->user_cr, node, uio);
+
+	len = param->rw_count - uio->uio_resid;
+	for (i = 0; rc == 0 && i < uio->uio_iovcnt && len > 0; i++) {
+		n = MIN(uio->uio_iov[i].iov_len, len);
+		nmp = esballoca((uchar_t *)uio->uio_iov[i].iov_base, n,
+		    BPRI_HI, &rl->rl_frtn);
+		if (nmp == NULL) {
+			rc = ENOMEM;
+			break;
+		}
+		nmp->b_wptr += n;
+		atomic_inc_32(&rl->rl_ref);
+		len -= n;
+		if (mp != NULL)
+			linkb(mp, nmp);
+		else
+			mp = nmp;
+	}
+
+	/* The mblks hold the loan now */
+	smb_read_loan_rele(rl);
+	if (rc != 0) {
+		freemsg(mp);
+		return (rc);
+	}
+
+	sr->sr_loan = mp;
+	*nread = (mp != NULL) ? msgdsize(mp) : 0;
+	return (0);
+}
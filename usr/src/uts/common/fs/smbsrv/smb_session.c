@@ -37,8 +37,16 @@ static volatile uint64_t smb_kids;
 
 uint32_t smb_keep_alive = SSN_KEEP_ALIVE_TIMEOUT;
 
+/*
+ * Number of requests of a session that may be in worker threads at the
+ * same time; the others wait on s_backlog.  Zero means no limit.
+ */
+uint32_t smb_session_maxinflight = 32;
+
 static void smb_session_cancel(smb_session_t *);
 static int smb_session_message(smb_session_t *);
+static int smb_session_sendv(smb_session_t *, uint8_t, mbuf_chain_t *,
+    mblk_t *);
 static int smb_session_xprt_puthdr(smb_session_t *, smb_xprt_t *,
     uint8_t *, size_t);
 static smb_user_t *smb_session_lookup_user(smb_session_t *, char *, char *);
@@ -106,9 +114,30 @@ smb_session_correct_keep_alive_values(smb_llist_t *ll, uint32_t new_keep_alive)
  */
 int
 smb_session_send(smb_session_t *session, uint8_t type, mbuf_chain_t *mbc)
+{
+	return (smb_session_sendv(session, type, mbc, NULL));
+}
+
+/*
+ * Send a session message whose data is in buffers loaned by the file
+ * system: mbc is the start of the message and mp, which is consumed, the
+ * rest.  The loaned buffers go to the transport as they are.
+ */
+int
+smb_session_send_loan(smb_session_t *session, mbuf_chain_t *mbc,
+    mblk_t *mp)
+{
+	return (smb_session_sendv(session, 0, mbc, mp));
+}
+
+static int
+smb_session_sendv(smb_session_t *session, uint8_t type, mbuf_chain_t *mbc,
+    mblk_t *mp)
 {
 	smb_txreq_t	*txr;
 	smb_xprt_t	hdr;
+	mbuf_t		*m;
+	int		len;
 	int		rc;
 
 	switch (session->s_state) {
@@ -119,16 +148,23 @@ smb_session_send(smb_session_t *session, uint8_t type, mbuf_chain_t *mbc)
 			mbc->chain = NULL;
 			mbc->flags = 0;
 		}
+		freemsg(mp);
 		return (ENOTCONN);
 	default:
 		break;
 	}
 
 	txr = smb_net_txr_alloc();
+	txr->tr_mp = mp;
 
 	if ((mbc != NULL) && (mbc->chain != NULL)) {
-		rc = mbc_moveout(mbc, (caddr_t)&txr->tr_buf[NETBIOS_HDR_SZ],
-		    sizeof (txr->tr_buf) - NETBIOS_HDR_SZ, &txr->tr_len);
+		len = NETBIOS_HDR_SZ;
+		for (m = mbc->chain; m != NULL; m = m->m_next)
+			len += m->m_len;
+		smb_net_txr_reserve(txr, len);
+
+		rc = mbc_moveout(mbc, (caddr_t)&txr->tr_data[NETBIOS_HDR_SZ],
+		    txr->tr_size - NETBIOS_HDR_SZ, &txr->tr_len);
 		if (rc != 0) {
 			smb_net_txr_free(txr);
 			return (rc);
@@ -137,8 +173,10 @@ smb_session_send(smb_session_t *session, uint8_t type, mbuf_chain_t *mbc)
 
 	hdr.xh_type = type;
 	hdr.xh_length = (uint32_t)txr->tr_len;
+	if (mp != NULL)
+		hdr.xh_length += (uint32_t)msgdsize(mp);
 
-	rc = smb_session_xprt_puthdr(session, &hdr, txr->tr_buf,
+	rc = smb_session_xprt_puthdr(session, &hdr, txr->tr_data,
 	    NETBIOS_HDR_SZ);
 
 	if (rc != 0) {
@@ -146,7 +184,8 @@ smb_session_send(smb_session_t *session, uint8_t type, mbuf_chain_t *mbc)
 		return (rc);
 	}
 	txr->tr_len += NETBIOS_HDR_SZ;
-	smb_server_add_txb(session->s_server, (int64_t)txr->tr_len);
+	smb_server_add_txb(session->s_server,
+	    (int64_t)(hdr.xh_length + NETBIOS_HDR_SZ));
 	return (smb_net_txr_send(session->sock, &session->s_txlst, txr));
 }
 
@@ -607,9 +646,7 @@ smb_session_message(smb_session_t *session)
 		}
 		sr->sr_time_submitted = gethrtime();
 		sr->sr_state = SMB_REQ_STATE_SUBMITTED;
-		smb_srqueue_waitq_enter(session->s_srqueue);
-		(void) taskq_dispatch(session->s_server->sv_worker_pool,
-		    smb_session_worker, sr, TQ_SLEEP);
+		smb_session_submit(sr);
 	}
 }
 
@@ -659,6 +696,11 @@ smb_session_create(ksocket_t new_so, uint16_t port, smb_server_t *sv,
 
 	smb_rwx_init(&session->s_lock);
 
+	mutex_init(&session->s_inflight_mutex, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&session->s_inflight_cv, NULL, CV_DEFAULT, NULL);
+	list_create(&session->s_backlog, sizeof (smb_request_t),
+	    offsetof(smb_request_t, sr_backlog_lnd));
+
 	if (new_so != NULL) {
 		if (family == AF_INET) {
 			slen = sizeof (sin);
@@ -718,6 +760,11 @@ smb_session_delete(smb_session_t *session)
 	smb_rwx_destroy(&session->s_lock);
 	smb_net_txl_destructor(&session->s_txlst);
 
+	ASSERT(session->s_inflight == 0);
+	list_destroy(&session->s_backlog);
+	cv_destroy(&session->s_inflight_cv);
+	mutex_destroy(&session->s_inflight_mutex);
+
 	while ((mbc = list_head(&session->s_oplock_brkreqs)) != NULL) {
 		SMB_MBC_VALID(mbc);
 		list_remove(&session->s_oplock_brkreqs, mbc);
@@ -758,6 +805,14 @@ smb_session_cancel(smb_session_t *session)
 	 */
 	smb_slist_wait_for_empty(&session->s_req_list);
 
+	/*
+	 * The workers may still be on their way out of the session.
+	 */
+	mutex_enter(&session->s_inflight_mutex);
+	while (session->s_inflight != 0)
+		cv_wait(&session->s_inflight_cv, &session->s_inflight_mutex);
+	mutex_exit(&session->s_inflight_mutex);
+
 	/*
 	 * At this point the reference count of the users, trees, files,
 	 * directories should be zero. It should be possible to destroy them
@@ -805,12 +860,14 @@ void
 smb_session_worker(void	*arg)
 {
 	smb_request_t	*sr;
+	smb_session_t	*session;
 	smb_srqueue_t	*srq;
 
 	sr = (smb_request_t *)arg;
 	SMB_REQ_VALID(sr);
 
-	srq = sr->session->s_srqueue;
+	session = sr->session;
+	srq = session->s_srqueue;
 	smb_srqueue_waitq_to_runq(srq);
 	sr->sr_worker = curthread;
 	mutex_enter(&sr->sr_mutex);
@@ -834,6 +891,54 @@ smb_session_worker(void	*arg)
 		break;
 	}
 	smb_srqueue_runq_exit(srq);
+
+	/*
+	 * Pass the worker on to the next request that has been waiting for
+	 * one, if any.  sr may be gone, but the session is kept around by
+	 * s_inflight.
+	 */
+	mutex_enter(&session->s_inflight_mutex);
+	if ((sr = list_remove_head(&session->s_backlog)) != NULL) {
+		mutex_exit(&session->s_inflight_mutex);
+		(void) taskq_dispatch(session->s_server->sv_worker_pool,
+		    smb_session_worker, sr, TQ_SLEEP);
+		return;
+	}
+	ASSERT(session->s_inflight > 0);
+	if (--session->s_inflight == 0)
+		cv_broadcast(&session->s_inflight_cv);
+	mutex_exit(&session->s_inflight_mutex);
+}
+
+/*
+ * Hand a request to a worker.  The requests of a session run in parallel,
+ * but only smb_session_maxinflight of them at a time, so that one busy
+ * client cannot tie up all the workers; the rest wait in arrival order
+ * for one of those to finish.  An NT_CANCEL never waits, since it may be
+ * meant for a request that is stuck, nor does a raw write, for which the
+ * receiver is waiting.
+ */
+void
+smb_session_submit(smb_request_t *sr)
+{
+	smb_session_t	*session = sr->session;
+
+	smb_srqueue_waitq_enter(session->s_srqueue);
+
+	mutex_enter(&session->s_inflight_mutex);
+	if (smb_session_maxinflight != 0 && !SMB_IS_NT_CANCEL(sr) &&
+	    !SMB_IS_WRITERAW(sr) &&
+	    (session->s_inflight >= smb_session_maxinflight ||
+	    !list_is_empty(&session->s_backlog))) {
+		list_insert_tail(&session->s_backlog, sr);
+		mutex_exit(&session->s_inflight_mutex);
+		return;
+	}
+	session->s_inflight++;
+	mutex_exit(&session->s_inflight_mutex);
+
+	(void) taskq_dispatch(session->s_server->sv_worker_pool,
+	    smb_session_worker, sr, TQ_SLEEP);
 }
 
 /*
@@ -1131,6 +1236,8 @@ smb_request_free(smb_request_t *sr)
 		m_freem(sr->reply.chain);
 	if (sr->raw_data.chain)
 		m_freem(sr->raw_data.chain);
+	if (sr->sr_loan != NULL)
+		freemsg(sr->sr_loan);
 
 	sr->sr_magic = 0;
 	cv_destroy(&sr->sr_ncr.nc_cv);
@@ -257,6 +257,27 @@ smb_vop_read(vnode_t *vp, uio_t *uiop, cred_t *cr)
 	return (error);
 }
 
+/*
+ * Ask the file system to loan the buffers for a zero-copy read of the
+ * range described by xuio; the data is then read with smb_vop_read().
+ * File systems that don't loan fail this.
+ */
+int
+smb_vop_reqzcbuf(vnode_t *vp, xuio_t *xuio, cred_t *cr)
+{
+	return (VOP_REQZCBUF(vp, UIO_READ, xuio, cr, &smb_ct));
+}
+
+/*
+ * Return loaned buffers.  This may be called from the transport once it
+ * is done with the data, so it can't use the request's credentials.
+ */
+void
+smb_vop_retzcbuf(vnode_t *vp, xuio_t *xuio)
+{
+	(void) VOP_RETZCBUF(vp, xuio, kcred, &smb_ct);
+}
+
 int
 smb_vop_write(vnode_t *vp, uio_t *uiop, int ioflag, uint32_t *lcount,
     cred_t *cr)
@@ -44,6 +44,7 @@ volatile uint64_t	nl7c_http_response_400 = 0;
 
 volatile uint64_t	nl7c_http_cond_304 = 0;
 volatile uint64_t	nl7c_http_cond_412 = 0;
+volatile uint64_t	nl7c_http_cond_206 = 0;
 
 /*
  * Some externs:
@@ -163,6 +164,10 @@ typedef struct http_s {
 	str_t		acceptlang;	/* Request Accept-Language: */
 	str_t		etag;		/* Request/Response ETag: */
 	str_t		uagent;		/* Request User-Agent: */
+	boolean_t	range;		/* Request Range: bytes= */
+	offset_t	rfirst;		/* Range first byte or -1 */
+	offset_t	rlast;		/* Range last byte or -1 */
+	str_t		ifrange;	/* Request If-Range: */
 } http_t;
 
 static kmem_cache_t *http_kmc;
@@ -967,6 +972,15 @@ static char http_resp_412[] =
 	"Date: #############################\r\n"
 	"Server: NCA/#.# (Solaris)\r\n";
 
+static char http_resp_206[] =
+	"HTTP/#.# 206 Partial Content\r\n"
+	"Date: #############################\r\n"
+	"Server: NCA/#.# (Solaris)\r\n";
+
+static char http_resp_206_range[] =
+	"Content-Range: bytes %lld-%lld/%lld\r\n"
+	"Content-Length: %lld\r\n";
+
 static uri_desc_t *
 http_mkresponse(uri_desc_t *req, uri_desc_t *res, char *proto, int sz)
 {
@@ -1107,6 +1121,152 @@ bad:
 	return (NULL);
 }
 
+/*
+ * Parse the byte-range-set text of a "Range: bytes=" request header,
+ * only a single range is supported, i.e. "first-last", "first-", or
+ * the suffix form "-len" for which *first is set to -1 and *last to len.
+ */
+
+static boolean_t
+http_range_parse(char *cp, char *ep, offset_t *first, offset_t *last)
+{
+	offset_t	n;
+
+	*first = -1;
+	*last = -1;
+	if (cp < ep && isdigit(*cp)) {
+		for (n = 0; cp < ep && isdigit(*cp); cp++) {
+			if (n > (MAXOFFSET_T - 9) / 10)
+				return (B_FALSE);
+			n = n * 10 + *cp - '0';
+		}
+		*first = n;
+	}
+	if (cp == ep || *cp++ != '-')
+		return (B_FALSE);
+	if (cp < ep && isdigit(*cp)) {
+		for (n = 0; cp < ep && isdigit(*cp); cp++) {
+			if (n > (MAXOFFSET_T - 9) / 10)
+				return (B_FALSE);
+			n = n * 10 + *cp - '0';
+		}
+		*last = n;
+	}
+	while (cp < ep && (*cp == ' ' || *cp == '\t'))
+		cp++;
+	if (cp != ep) {
+		/* Multiple ranges or junk, let the full response go */
+		return (B_FALSE);
+	}
+	if (*first == -1 && *last == -1)
+		return (B_FALSE);
+	if (*first != -1 && *last != -1 && *last < *first)
+		return (B_FALSE);
+	return (B_TRUE);
+}
+
+/*
+ * Create a 206 response uri for the request uri_desc_t *req Range: of the
+ * cached response uri_desc_t *res. The response body is shared with the
+ * cached response where it is file backed (a vnode hold and an offset),
+ * kmem backed data is copied.
+ *
+ * NULL is returned when the range can't be served from the cache, in which
+ * case the full response is sent, which is always a valid reply.
+ */
+
+static uri_desc_t *
+http_mkrange(uri_desc_t *req, uri_desc_t *res)
+{
+	http_t		*qhttp = req->scheme;
+	http_t		*shttp = res->scheme;
+	uri_desc_t	*uri;
+	uri_rd_t	*srdp, *rdp;
+	offset_t	body, first, last;
+	offset_t	pos, lo, hi, skip, n;
+	size_t		hlen;
+	char		*alloc;
+	char		proto[sizeof (http_resp_206) +
+	    sizeof (http_resp_206_range) + 4 * 20];
+	int		sz;
+
+	if (res->respclen != URI_LEN_NOVALUE || res->resplen <= 0) {
+		/* Chunked or unknown length, can't slice it */
+		return (NULL);
+	}
+	if (qhttp->ifrange.cp != NULL) {
+		/* Only an exact strong ETag match gets the range */
+		n = qhttp->ifrange.ep - qhttp->ifrange.cp;
+		if (shttp->etag.cp == NULL ||
+		    shttp->etag.ep - shttp->etag.cp != n ||
+		    bcmp(shttp->etag.cp, qhttp->ifrange.cp, n) != 0)
+			return (NULL);
+	}
+
+	body = res->resplen;
+	if (qhttp->rfirst == -1) {
+		if (qhttp->rlast == 0)
+			return (NULL);
+		first = body - MIN(qhttp->rlast, body);
+		last = body - 1;
+	} else {
+		if (qhttp->rfirst >= body)
+			return (NULL);
+		first = qhttp->rfirst;
+		if (qhttp->rlast == -1 || qhttp->rlast >= body)
+			last = body - 1;
+		else
+			last = qhttp->rlast;
+	}
+
+	/* The response header must be all in the first (kmem) rd_t */
+	srdp = &res->response;
+	if (srdp->off != -1 || res->eoh < srdp->data.kmem ||
+	    res->eoh + 2 > &srdp->data.kmem[srdp->sz])
+		return (NULL);
+	hlen = res->eoh + 2 - srdp->data.kmem;
+	if (res->count - hlen != body)
+		return (NULL);
+
+	sz = sizeof (http_resp_206) - 1;
+	bcopy(http_resp_206, proto, sz);
+	sz += snprintf(&proto[sz], sizeof (proto) - sz, http_resp_206_range,
+	    (longlong_t)first, (longlong_t)last, (longlong_t)body,
+	    (longlong_t)(last - first + 1));
+	if ((uri = http_mkresponse(req, res, proto, sz)) == NULL)
+		return (NULL);
+
+	/*
+	 * Add an rd_t to the new uri for each part of the cached response
+	 * body which overlaps the range.
+	 */
+	lo = hlen + first;
+	hi = hlen + last + 1;
+	for (pos = 0; srdp != NULL && pos < hi; srdp = srdp->next) {
+		if (pos + srdp->sz <= lo) {
+			pos += srdp->sz;
+			continue;
+		}
+		skip = lo > pos ? lo - pos : 0;
+		n = MIN(hi, pos + srdp->sz) - (pos + skip);
+		if (srdp->off == -1) {
+			alloc = kmem_alloc((size_t)n, KM_SLEEP);
+			bcopy(&srdp->data.kmem[skip], alloc, n);
+			URI_RD_ADD(uri, rdp, n, -1);
+			rdp->data.kmem = alloc;
+			atomic_add_64(&nl7c_uri_bytes, n);
+		} else {
+			URI_RD_ADD(uri, rdp, n, srdp->off + skip);
+			VN_HOLD(srdp->data.vnode);
+			rdp->data.vnode = srdp->data.vnode;
+		}
+		pos += srdp->sz;
+	}
+	atomic_add_64(&res->rhit, 1);
+
+	return (uri);
+}
+
 uri_desc_t *
 nl7c_http_cond(uri_desc_t *req, uri_desc_t *res)
 {
@@ -1150,6 +1310,20 @@ nl7c_http_cond(uri_desc_t *req, uri_desc_t *res)
 			return (uri);
 		}
 		return (res);
+	} else if (qhttp->range) {
+		/*
+		 * Request is for a byte range of the response, if it
+		 * can be satisfied from the cached response return a
+		 * 206 response uri for just the range.
+		 */
+		uri = http_mkrange(req, res);
+		if (uri != NULL) {
+			/* New response uri */
+			nl7c_http_cond_206++;
+			REF_RELE(res);
+			return (uri);
+		}
+		return (res);
 	}
 	/*
 	 * No conditional response meet or unknown type or no
@@ -1218,6 +1392,9 @@ nl7c_http_request(char **cpp, char *ep, uri_desc_t *uri, struct sonode *so)
 	http->acceptlang.cp = NULL;
 	http->etag.cp = NULL;
 	http->uagent.cp = NULL;
+	http->range = B_FALSE;
+	http->ifrange.cp = NULL;
+	http->moddate = -1;
 	http->date = -1;
 	http->expire = -1;
 	http->lastmod = -1;
@@ -1378,10 +1555,23 @@ got_version:
 					uri->conditional = B_TRUE;
 					break;
 
+				case Qhdr_If_Range:
+					http->ifrange.cp = hp;
+					http->ifrange.ep = ep;
+					break;
+
 				case Qhdr_Keep_Alive:
 					persist = B_TRUE;
 					break;
 
+				case Qhdr_Range:
+					if (http_range_parse(hp, ep,
+					    &http->rfirst, &http->rlast)) {
+						http->range = B_TRUE;
+						uri->conditional = B_TRUE;
+					}
+					break;
+
 				case Qhdr_User_Agent:
 					http->uagent.cp = hp;
 					http->uagent.ep = ep;
@@ -415,9 +415,10 @@ next:
 		while (uri != NULL) {
 			sc = *(uri->path.ep);
 			*(uri->path.ep) = 0;
-			ret = mi_mpprintf(mp, "%s: %d %d %d",
+			ret = mi_mpprintf(mp, "%s: %d %d %d %lu %lu",
 			    uri->path.cp, (int)uri->resplen,
-			    (int)uri->respclen, (int)uri->count);
+			    (int)uri->respclen, (int)uri->count,
+			    (ulong_t)uri->nhit, (ulong_t)uri->rhit);
 			*(uri->path.ep) = sc;
 			if (ret == -1) break;
 			uri = uri->hash;
@@ -898,6 +899,7 @@ nexthash:
 		}
 		mutex_exit(&uri->proclock);
 		uri->hit++;
+		uri->nhit++;
 		mutex_exit(&hp->lock);
 		rw_exit(&uri_hash_access);
 		return (uri);
@@ -924,6 +926,8 @@ add:
 	 * request URI, add it to the hash, return it.
 	 */
 	ruri->hit = 0;
+	ruri->nhit = 0;
+	ruri->rhit = 0;
 	ruri->expire = -1;
 	ruri->response.sz = 0;
 	ruri->proc = (struct sonode *)~NULL;
@@ -1554,7 +1558,7 @@ uri_segmap_t *
 uri_segmap_map(uri_rd_t *rdp, int bytes)
 {
 	uri_segmap_t	*segmap = kmem_cache_alloc(uri_segmap_kmc, KM_SLEEP);
-	int		len = MIN(rdp->sz, MAXBSIZE);
+	int		len = MIN(rdp->sz, MAXBSIZE - (rdp->off & MAXBOFFSET));
 
 	if (len > bytes)
 		len = bytes;
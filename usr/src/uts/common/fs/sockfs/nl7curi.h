@@ -125,6 +125,8 @@ typedef struct uri_rd_s {
 typedef struct uri_desc_s {
 	struct uri_desc_s *hash;	/* Hash *next */
 	uint64_t	hit;		/* Hit counter */
+	uint64_t	nhit;		/* Total hits */
+	uint64_t	rhit;		/* Range (206) hits */
 	clock_t		expire;		/* URI lbolt expires on (-1 = NEVER) */
 #ifdef notyet
 	void		*sslctx;	/* SSL context */
@@ -48,6 +48,7 @@
 #include <fs/sockfs/nl7c.h>
 #include <fs/sockfs/socktpi.h>
 #include <fs/sockfs/sodirect.h>
+#include <fs/sockfs/sockktls.h>
 #include <inet/ip.h>
 
 extern int xnet_skip_checks, xnet_check_print, xnet_truncate_print;
@@ -347,6 +348,62 @@ socket_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 	return (error);
 }
 
+/*
+ * Send a vector of messages for sendmmsg(2).  Sockets using the common
+ * sonode ops send the whole vector under one hold of the fallback lock;
+ * others fall back to one SOP_SENDMSG() per message.  On return *sentp
+ * holds the number of messages sent, counting a partially sent one, and
+ * the error, if any, is that of the message following them.
+ */
+int
+socket_sendmmsg(struct sonode *so, so_mmsg_t *mm, uint_t cnt, cred_t *cr,
+    uint_t *sentp)
+{
+	int error = 0;
+	uint_t i;
+
+	for (i = 0; i < cnt; i++) {
+		mm[i].sm_len = mm[i].sm_uio.uio_resid;
+		if (so->so_family == AF_UNIX)
+			mm[i].sm_uio.uio_extflg |= UIO_COPY_CACHED;
+		else
+			mm[i].sm_uio.uio_extflg &= ~UIO_COPY_CACHED;
+	}
+
+	if (so->so_ops == &so_sonodeops) {
+		error = so_sendmmsg(so, mm, cnt, cr, &i);
+	} else {
+		for (i = 0; i < cnt; i++) {
+			error = SOP_SENDMSG(so, &mm[i].sm_msg,
+			    &mm[i].sm_uio, cr);
+			if (error != 0)
+				break;
+		}
+	}
+
+	switch (error) {
+	default:
+		break;
+	case EINTR:
+	case ENOMEM:
+	/* EAGAIN is EWOULDBLOCK */
+	case EWOULDBLOCK:
+		/* We did a partial send */
+		if (mm[i].sm_uio.uio_resid != mm[i].sm_len) {
+			error = 0;
+			i++;
+		}
+		break;
+	case EPIPE:
+		if ((so->so_mode & SM_KERNEL) == 0)
+			tsignal(curthread, SIGPIPE);
+		break;
+	}
+	*sentp = i;
+
+	return (error);
+}
+
 int
 socket_sendmblk(struct sonode *so, struct nmsghdr *msg, int fflag,
     struct cred *cr, mblk_t **mpp)
@@ -574,6 +631,7 @@ sonode_init(struct sonode *so, struct sockparams *sp, int family,
 	so->so_error	= 0;
 	so->so_rcvtimeo	= 0;
 	so->so_sndtimeo = 0;
+	so->so_busy_poll = 0;
 	so->so_xpg_rcvbuf = 0;
 
 	ASSERT(so->so_oobmsg == NULL);
@@ -618,6 +676,7 @@ sonode_init(struct sonode *so, struct sockparams *sp, int family,
 	so->so_max_addr_len = sizeof (struct sockaddr_storage);
 
 	so->so_direct = NULL;
+	so->so_ktls = NULL;
 
 	vn_exists(vp);
 }
@@ -643,6 +702,9 @@ sonode_fini(struct sonode *so)
 	if (so->so_direct != NULL)
 		sod_sock_fini(so);
 
+	if (so->so_ktls != NULL)
+		so_ktls_fini(so);
+
 	vp = SOTOV(so);
 	vn_invalid(vp);
 
@@ -37,6 +37,16 @@ struct sonode;
 
 extern kmem_cache_t *socket_cache;
 
+/*
+ * One message of a sendmmsg(2) batch, copied in ahead of the send.
+ */
+typedef struct so_mmsg {
+	struct nmsghdr	sm_msg;
+	struct uio	sm_uio;
+	ssize_t		sm_len;			/* resid before the send */
+	struct iovec	sm_iov[MSG_MAXIOVLEN];
+} so_mmsg_t;
+
 /*
  * Socket access functions
  *
@@ -68,6 +78,8 @@ extern int socket_recvmsg(struct sonode *, struct nmsghdr *, struct uio *,
     struct cred *);
 extern int socket_sendmsg(struct sonode *, struct nmsghdr *, struct uio *,
     struct cred *);
+extern int socket_sendmmsg(struct sonode *, struct so_mmsg *, uint_t,
+    struct cred *, uint_t *);
 extern int socket_sendmblk(struct sonode *, struct nmsghdr *, int,
     struct cred *, mblk_t **);
 extern int socket_ioctl(struct sonode *, int, intptr_t, int, struct cred *,
@@ -135,6 +147,8 @@ extern int so_poll(struct sonode *, short, int, short *,
     struct pollhead **);
 extern int so_sendmsg(struct sonode *, struct nmsghdr *, struct uio *,
     struct cred *);
+extern int so_sendmmsg(struct sonode *, struct so_mmsg *, uint_t,
+    struct cred *, uint_t *);
 extern int so_sendmblk_impl(struct sonode *, struct nmsghdr *, int,
     struct cred *, mblk_t **, struct sof_instance *, boolean_t);
 extern int so_sendmblk(struct sonode *, struct nmsghdr *, int,
@@ -56,11 +56,13 @@
 
 #include <fs/sockfs/socktpi_impl.h>
 #include <fs/sockfs/sodirect.h>
+#include <fs/sockfs/sockktls.h>
 #include <sys/tihdr.h>
 #include <fs/sockfs/nl7c.h>
 
 extern int xnet_skip_checks;
 extern int xnet_check_print;
+extern uint32_t so_busy_poll_max;
 
 static void so_queue_oob(struct sonode *, mblk_t *, size_t);
 
@@ -364,8 +366,48 @@ so_accept(struct sonode *so, int fflag, struct cred *cr, struct sonode **nsop)
 	return (error);
 }
 
-int
-so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
+/*
+ * sendto(MSG_FASTOPEN) on an unconnected stream socket: hand the first
+ * chunk of data to the protocol and then connect, so that the protocol
+ * can put the data on its SYN.  A non-blocking connect finishes later,
+ * with the data queued.
+ */
+static int
+so_sendmsg_fastopen(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
+    struct cred *cr, boolean_t dontblock)
+{
+	sock_connid_t id;
+	ssize_t orig_resid;
+	mblk_t *mp;
+	int error;
+
+	orig_resid = uiop->uio_resid;
+	if ((mp = socopyinuio(uiop, so->so_proto_props.sopp_maxpsz,
+	    so->so_proto_props.sopp_wroff, so->so_proto_props.sopp_maxblk,
+	    so->so_proto_props.sopp_tail, &error)) == NULL)
+		return (error);
+
+	msg->msg_flags |= MSG_FASTOPEN;
+	error = (*so->so_downcalls->sd_send)(so->so_proto_handle, mp, msg, cr);
+	msg->msg_flags &= ~MSG_FASTOPEN;
+	if (error == 0) {
+		error = (*so->so_downcalls->sd_connect)(so->so_proto_handle,
+		    msg->msg_name, msg->msg_namelen, &id, cr);
+		if (error == EINPROGRESS)
+			error = so_wait_connected(so, dontblock, id);
+		if (error == EINPROGRESS)
+			return (0);
+	}
+	if (error != 0)
+		uiop->uio_resid = orig_resid;
+	return (error);
+}
+
+/*
+ * Send a single message.  The caller holds so_fallback_rwlock as reader.
+ */
+static int
+so_sendmsg_impl(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
     struct cred *cr)
 {
 	int error, flags;
@@ -373,8 +415,6 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 	ssize_t orig_resid;
 	mblk_t  *mp;
 
-	SO_BLOCK_FALLBACK(so, SOP_SENDMSG(so, msg, uiop, cr));
-
 	flags = msg->msg_flags;
 	error = 0;
 	dontblock = (flags & MSG_DONTWAIT) ||
@@ -384,17 +424,33 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 		/*
 		 * Old way of passing fd's is not supported
 		 */
-		SO_UNBLOCK_FALLBACK(so);
 		return (EOPNOTSUPP);
 	}
 
 	if ((so->so_mode & SM_ATOMIC) &&
 	    uiop->uio_resid > so->so_proto_props.sopp_maxpsz &&
 	    so->so_proto_props.sopp_maxpsz != -1) {
-		SO_UNBLOCK_FALLBACK(so);
 		return (EMSGSIZE);
 	}
 
+	/*
+	 * The protocol only sees MSG_FASTOPEN on the data passed down
+	 * ahead of the connect.  Where that cannot be done, as with socket
+	 * filters active, the flag is ignored.
+	 */
+	msg->msg_flags &= ~MSG_FASTOPEN;
+	if ((flags & MSG_FASTOPEN) && so->so_type == SOCK_STREAM &&
+	    msg->msg_name != NULL && so->so_filter_active == 0 &&
+	    so->so_downcalls->sd_send_uio == NULL &&
+	    !(so->so_state & (SS_ISCONNECTED | SS_ISCONNECTING)) &&
+	    uiop->uio_resid > 0) {
+		error = so_sendmsg_fastopen(so, msg, uiop, cr, dontblock);
+		if (error != 0 || uiop->uio_resid == 0 ||
+		    !(so->so_state & SS_ISCONNECTED)) {
+			return (error);
+		}
+	}
+
 	/*
 	 * For atomic sends we will only do one iteration.
 	 */
@@ -460,8 +516,12 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 					break;
 				continue;
 			}
-			error = (*so->so_downcalls->sd_send)
-			    (so->so_proto_handle, mp, msg, cr);
+			if (so->so_ktls != NULL) {
+				error = so_ktls_send(so, mp, msg, cr);
+			} else {
+				error = (*so->so_downcalls->sd_send)
+				    (so->so_proto_handle, mp, msg, cr);
+			}
 			if (error != 0) {
 				/*
 				 * The send failed. We do not have to free the
@@ -475,11 +535,68 @@ so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
 		}
 	} while (uiop->uio_resid > 0);
 
+	return (error);
+}
+
+int
+so_sendmsg(struct sonode *so, struct nmsghdr *msg, struct uio *uiop,
+    struct cred *cr)
+{
+	int error;
+
+	SO_BLOCK_FALLBACK(so, SOP_SENDMSG(so, msg, uiop, cr));
+	error = so_sendmsg_impl(so, msg, uiop, cr);
 	SO_UNBLOCK_FALLBACK(so);
 
 	return (error);
 }
 
+/*
+ * Send a vector of messages one at a time through the sonode ops; used
+ * once the socket has fallen back to TPI.
+ */
+static int
+so_sendmmsg_fallback(struct sonode *so, so_mmsg_t *mm, uint_t cnt,
+    struct cred *cr, uint_t *sentp)
+{
+	int error = 0;
+	uint_t i;
+
+	for (i = 0; i < cnt; i++) {
+		error = SOP_SENDMSG(so, &mm[i].sm_msg, &mm[i].sm_uio, cr);
+		if (error != 0)
+			break;
+	}
+	*sentp = i;
+
+	return (error);
+}
+
+/*
+ * Send a vector of messages on behalf of sendmmsg(2).  The fallback lock
+ * is taken once for the whole vector instead of once per message.  Stops
+ * at the first failure; *sentp is set to the index of the message that
+ * failed, or to cnt if all were sent.
+ */
+int
+so_sendmmsg(struct sonode *so, so_mmsg_t *mm, uint_t cnt, struct cred *cr,
+    uint_t *sentp)
+{
+	int error = 0;
+	uint_t i;
+
+	SO_BLOCK_FALLBACK(so, so_sendmmsg_fallback(so, mm, cnt, cr, sentp));
+	for (i = 0; i < cnt; i++) {
+		error = so_sendmsg_impl(so, &mm[i].sm_msg, &mm[i].sm_uio, cr);
+		if (error != 0)
+			break;
+	}
+	SO_UNBLOCK_FALLBACK(so);
+	*sentp = i;
+
+	return (error);
+}
+
 int
 so_sendmblk_impl(struct sonode *so, struct nmsghdr *msg, int fflag,
     struct cred *cr, mblk_t **mpp, sof_instance_t *fil,
@@ -555,8 +672,12 @@ so_sendmblk_impl(struct sonode *so, struct nmsghdr *msg, int fflag,
 				break;
 			continue;
 		}
-		error = (*so->so_downcalls->sd_send)
-		    (so->so_proto_handle, mp, msg, cr);
+		if (so->so_ktls != NULL) {
+			error = so_ktls_send(so, mp, msg, cr);
+		} else {
+			error = (*so->so_downcalls->sd_send)
+			    (so->so_proto_handle, mp, msg, cr);
+		}
 		if (error != 0) {
 			/*
 			 * The send failed. The protocol will free the mblks
@@ -757,6 +878,7 @@ so_getsockopt(struct sonode *so, int level, int option_name,
 					break;
 				case SO_DEBUG:
 				case SO_REUSEADDR:
+				case SO_REUSEPORT:
 				case SO_KEEPALIVE:
 				case SO_DONTROUTE:
 				case SO_BROADCAST:
@@ -846,6 +968,34 @@ so_setsockopt(struct sonode *so, int level, int option_name,
 			mutex_exit(&so->so_lock);
 			break;
 		}
+		case SO_BUSY_POLL: {
+			/*
+			 * Handled entirely by sockfs; the protocol is only
+			 * asked to poll through sd_busy_poll while spinning.
+			 */
+			int32_t usec;
+
+			if (optlen != sizeof (int32_t)) {
+				error = EINVAL;
+				goto done;
+			}
+			usec = *(int32_t *)optval;
+			if (usec < 0) {
+				error = EINVAL;
+				goto done;
+			}
+			mutex_enter(&so->so_lock);
+			so->so_busy_poll = MIN((uint32_t)usec, so_busy_poll_max);
+			mutex_exit(&so->so_lock);
+			goto done;
+		}
+		case SO_TLS_TX:
+			/*
+			 * Record framing and encryption happen in sockfs;
+			 * the protocol only ever sees ciphertext.
+			 */
+			error = so_ktls_tx_init(so, optval, optlen);
+			goto done;
 		case SO_RCVBUF:
 			/*
 			 * XXX XPG 4.2 applications retrieve SO_RCVBUF from
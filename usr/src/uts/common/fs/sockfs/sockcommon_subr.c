@@ -35,12 +35,14 @@
 #include <sys/strsubr.h>
 #include <sys/strsun.h>
 #include <sys/atomic.h>
+#include <sys/cpu.h>
 #include <sys/tihdr.h>
 
 #include <fs/sockfs/sockcommon.h>
 #include <fs/sockfs/sockfilter_impl.h>
 #include <fs/sockfs/socktpi.h>
 #include <fs/sockfs/sodirect.h>
+#include <fs/sockfs/sockktls.h>
 #include <sys/ddi.h>
 #include <inet/ip.h>
 #include <sys/time.h>
@@ -54,11 +56,48 @@ extern clock_t sock_test_timelimit;
 #define	MBLK_PULL_LEN 64
 uint32_t so_mblk_pull_len = MBLK_PULL_LEN;
 
+/* Upper bound on SO_BUSY_POLL, in microseconds */
+uint32_t so_busy_poll_max = 100000;
+
 #ifdef DEBUG
 boolean_t so_debug_length = B_FALSE;
 static boolean_t so_check_length(sonode_t *so);
 #endif
 
+/*
+ * Spin for up to so_busy_poll microseconds waiting for data to be queued,
+ * asking the protocol to poll its receive path if it knows how. Called and
+ * returns with so_lock held, though it is dropped while spinning. Returns
+ * B_TRUE if the caller should look at the socket again rather than block.
+ */
+static boolean_t
+so_busy_poll_wait(struct sonode *so)
+{
+	void (*busy_poll)(sock_lower_handle_t);
+	hrtime_t deadline;
+
+	ASSERT(MUTEX_HELD(&so->so_lock));
+
+	busy_poll = so->so_downcalls->sd_busy_poll;
+	deadline = gethrtime() +
+	    (hrtime_t)so->so_busy_poll * (NANOSEC / MICROSEC);
+	for (;;) {
+		if (so->so_rcv_head != NULL || so->so_error != 0 ||
+		    (so->so_state & (SS_CANTRCVMORE | SS_CLOSING |
+		    SS_FALLBACK_PENDING)))
+			return (B_TRUE);
+		if (gethrtime() >= deadline || issig(JUSTLOOKING))
+			return (B_FALSE);
+
+		mutex_exit(&so->so_lock);
+		if (busy_poll != NULL)
+			busy_poll(so->so_proto_handle);
+		else
+			SMT_PAUSE();
+		mutex_enter(&so->so_lock);
+	}
+}
+
 static int
 so_acceptq_dequeue_locked(struct sonode *so, boolean_t dontblock,
     struct sonode **nsop)
@@ -930,6 +969,9 @@ try_again:
 				if (so->so_rcv_head != NULL) {
 					goto again1;
 				}
+				if (so->so_busy_poll != 0 &&
+				    so_busy_poll_wait(so))
+					goto again1;
 				so->so_rcv_wakeup = B_TRUE;
 				so->so_rcv_wanted = uiop->uio_resid;
 				if (so->so_rcvtimeo == 0) {
@@ -1269,6 +1311,7 @@ socket_init_common(struct sonode *so, struct sonode *pso, int flags, cred_t *cr)
 		so->so_pgrp = pso->so_pgrp;
 		so->so_rcvtimeo = pso->so_rcvtimeo;
 		so->so_sndtimeo = pso->so_sndtimeo;
+		so->so_busy_poll = pso->so_busy_poll;
 		so->so_xpg_rcvbuf = pso->so_xpg_rcvbuf;
 		/*
 		 * Make note of the socket level options. TCP and IP level
@@ -1737,8 +1780,18 @@ socket_getopt_common(struct sonode *so, int level, int option_name,
 		}
 		return (0);
 	}
+	case SO_BUSY_POLL: {
+		socklen_t optlen = *optlenp;
+
+		if (optlen < (t_uscalar_t)sizeof (int32_t))
+			return (EINVAL);
+		*(int32_t *)optval = so->so_busy_poll;
+		*optlenp = sizeof (int32_t);
+		return (0);
+	}
 	case SO_DEBUG:
 	case SO_REUSEADDR:
+	case SO_REUSEPORT:
 	case SO_KEEPALIVE:
 	case SO_DONTROUTE:
 	case SO_BROADCAST:
@@ -2268,6 +2321,12 @@ so_tpi_fallback(struct sonode *so, struct cred *cr)
 	if (so->so_filter_active > 0)
 		return (EINVAL);
 
+	/*
+	 * Nor if sockfs is encrypting on its behalf; TPI has no kTLS path
+	 */
+	if (so->so_ktls != NULL)
+		return (EINVAL);
+
 	switch (so->so_family) {
 	case AF_INET:
 		devpath = sp->sp_smod_info->smod_fallback_devpath_v4;
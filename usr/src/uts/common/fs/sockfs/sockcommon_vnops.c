@@ -437,7 +437,7 @@ socket_vop_inactive(struct vnode *vp, struct cred *cr, caller_context_t *ct)
 	/*
 	 * Drop the temporary hold by vn_rele now
 	 */
-	if (--vp->v_count != 0) {
+	if (atomic_dec_uint_nv(&vp->v_count) != 0) {
 		mutex_exit(&vp->v_lock);
 		return;
 	}
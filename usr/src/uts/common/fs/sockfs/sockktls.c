@@ -0,0 +1,315 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Kernel TLS transmit offload.
+ *
+ * An application that has completed a TLS 1.2 handshake in user space
+ * hands the negotiated write key to the socket with SO_TLS_TX.  From then
+ * on everything written to the socket, whether through write(2) and
+ * friends or through sendfile(3EXT), is plaintext: sockfs cuts it into
+ * application_data records of at most SO_KTLS_MAXPLAIN bytes, encrypts
+ * each one with AES-GCM through KCF and passes the resulting ciphertext
+ * to the protocol.  Since the data never returns to user space for
+ * encryption, sendfile keeps its zero-copy file read; the only copy left
+ * is the one the cipher makes into the record buffer.
+ *
+ * Each record goes out as
+ *
+ *	+------+---------+--------+----------------+------------+-----+
+ *	| type | version | length | explicit nonce | ciphertext | tag |
+ *	|  1   |    2    |   2    |       8        |   length   | 16  |
+ *	+------+---------+--------+----------------+------------+-----+
+ *
+ * with the GCM IV being the 4 byte salt followed by the explicit nonce and
+ * the additional data being the record sequence number followed by the
+ * type, version and plaintext length (RFC 5288).
+ *
+ * The record sequence number is implicit in the byte stream, so records
+ * must reach the protocol in the order they were numbered; skt_lock is
+ * held from numbering until the protocol has taken the data.  An
+ * encryption failure leaves the stream unrecoverable and is sticky.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/sysmacros.h>
+#include <sys/debug.h>
+#include <sys/kmem.h>
+#include <sys/stream.h>
+#include <sys/strsun.h>
+#include <sys/socket.h>
+#include <sys/socketvar.h>
+#include <sys/crypto/common.h>
+#include <sys/crypto/api.h>
+
+#include <fs/sockfs/sockcommon.h>
+#include <fs/sockfs/sockktls.h>
+
+static void
+so_ktls_put64(uint8_t *p, uint64_t v)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static uint64_t
+so_ktls_get64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return (v);
+}
+
+static void
+so_ktls_free(so_ktls_t *skt)
+{
+	if (skt->skt_tmpl != NULL)
+		crypto_destroy_ctx_template(skt->skt_tmpl);
+	bzero(skt->skt_keybuf, sizeof (skt->skt_keybuf));
+	bzero(skt->skt_salt, sizeof (skt->skt_salt));
+	mutex_destroy(&skt->skt_lock);
+	kmem_free(skt, sizeof (*skt));
+}
+
+/*
+ * SO_TLS_TX: validate the crypto info and switch the socket into kTLS
+ * transmit mode.  The keys cannot be changed or removed afterwards.
+ */
+int
+so_ktls_tx_init(struct sonode *so, const void *optval, socklen_t optlen)
+{
+	const so_tls_crypto_info_t *ci = optval;
+	crypto_mech_type_t mt;
+	so_ktls_t *skt;
+	size_t keylen;
+	int rv;
+
+	if (optlen != sizeof (so_tls_crypto_info_t))
+		return (EINVAL);
+	if (ci->stc_version != SO_TLS_VERSION_1_2)
+		return (ENOTSUP);
+	switch (ci->stc_cipher) {
+	case SO_TLS_CIPHER_AES_GCM_128:
+		keylen = 16;
+		break;
+	case SO_TLS_CIPHER_AES_GCM_256:
+		keylen = 32;
+		break;
+	default:
+		return (ENOTSUP);
+	}
+
+	/*
+	 * Only byte stream transports that take their data as mblks will
+	 * do; records have to be framed across the whole stream.
+	 */
+	if (so->so_type != SOCK_STREAM ||
+	    (so->so_family != AF_INET && so->so_family != AF_INET6) ||
+	    so->so_downcalls->sd_send_uio != NULL)
+		return (EOPNOTSUPP);
+	if (!(so->so_state & SS_ISCONNECTED))
+		return (ENOTCONN);
+
+	if ((mt = crypto_mech2id(SUN_CKM_AES_GCM)) == CRYPTO_MECH_INVALID)
+		return (EPROTONOSUPPORT);
+
+	skt = kmem_zalloc(sizeof (*skt), KM_SLEEP);
+	mutex_init(&skt->skt_lock, NULL, MUTEX_DEFAULT, NULL);
+	skt->skt_seq = so_ktls_get64(ci->stc_rec_seq);
+	skt->skt_nonce = so_ktls_get64(ci->stc_iv);
+	bcopy(ci->stc_salt, skt->skt_salt, SO_KTLS_SALTLEN);
+	bcopy(ci->stc_key, skt->skt_keybuf, keylen);
+
+	skt->skt_mech.cm_type = mt;
+	skt->skt_key.ck_format = CRYPTO_KEY_RAW;
+	skt->skt_key.ck_data = skt->skt_keybuf;
+	skt->skt_key.ck_length = (uint_t)CRYPTO_BYTES2BITS(keylen);
+
+	/* No template just means the key is expanded for every record */
+	rv = crypto_create_ctx_template(&skt->skt_mech, &skt->skt_key,
+	    &skt->skt_tmpl, KM_SLEEP);
+	if (rv != CRYPTO_SUCCESS)
+		skt->skt_tmpl = NULL;
+
+	mutex_enter(&so->so_lock);
+	if (so->so_ktls != NULL) {
+		mutex_exit(&so->so_lock);
+		so_ktls_free(skt);
+		return (EBUSY);
+	}
+	so->so_ktls = skt;
+	mutex_exit(&so->so_lock);
+
+	return (0);
+}
+
+void
+so_ktls_fini(struct sonode *so)
+{
+	so_ktls_free(so->so_ktls);
+	so->so_ktls = NULL;
+}
+
+/*
+ * Encrypt plen bytes of the plaintext chain mp, starting at off, into a
+ * single record.  Returns the record, or NULL with *errorp set.
+ */
+static mblk_t *
+so_ktls_seal(struct sonode *so, so_ktls_t *skt, mblk_t *mp, size_t off,
+    size_t plen, int *errorp)
+{
+	CK_AES_GCM_PARAMS gcm;
+	crypto_mechanism_t mech;
+	crypto_data_t pt, ct;
+	uint8_t iv[SO_KTLS_SALTLEN + SO_KTLS_NONCELEN];
+	uint8_t aad[SO_KTLS_AADLEN];
+	size_t wroff = so->so_proto_props.sopp_wroff;
+	size_t clen = SO_KTLS_NONCELEN + plen + SO_KTLS_TAGLEN;
+	uint8_t *hdr;
+	mblk_t *rmp;
+	int rv;
+
+	ASSERT(MUTEX_HELD(&skt->skt_lock));
+	ASSERT(plen > 0 && plen <= SO_KTLS_MAXPLAIN);
+
+	if ((rmp = allocb(wroff + SO_KTLS_HDRLEN + clen, BPRI_MED)) == NULL) {
+		*errorp = ENOMEM;
+		return (NULL);
+	}
+	rmp->b_rptr += wroff;
+	hdr = rmp->b_rptr;
+	rmp->b_wptr = hdr + SO_KTLS_HDRLEN + clen;
+
+	hdr[0] = SO_KTLS_APPDATA;
+	hdr[1] = SO_TLS_VERSION_1_2 >> 8;
+	hdr[2] = SO_TLS_VERSION_1_2 & 0xff;
+	hdr[3] = (clen >> 8) & 0xff;
+	hdr[4] = clen & 0xff;
+	so_ktls_put64(hdr + SO_KTLS_HDRLEN, skt->skt_nonce);
+
+	bcopy(skt->skt_salt, iv, SO_KTLS_SALTLEN);
+	bcopy(hdr + SO_KTLS_HDRLEN, iv + SO_KTLS_SALTLEN, SO_KTLS_NONCELEN);
+
+	so_ktls_put64(aad, skt->skt_seq);
+	aad[8] = hdr[0];
+	aad[9] = hdr[1];
+	aad[10] = hdr[2];
+	aad[11] = (plen >> 8) & 0xff;
+	aad[12] = plen & 0xff;
+
+	gcm.pIv = iv;
+	gcm.ulIvLen = sizeof (iv);
+	gcm.ulIvBits = CRYPTO_BYTES2BITS(sizeof (iv));
+	gcm.pAAD = aad;
+	gcm.ulAADLen = sizeof (aad);
+	gcm.ulTagBits = CRYPTO_BYTES2BITS(SO_KTLS_TAGLEN);
+
+	mech = skt->skt_mech;
+	mech.cm_param = (caddr_t)&gcm;
+	mech.cm_param_len = sizeof (gcm);
+
+	bzero(&pt, sizeof (pt));
+	pt.cd_format = CRYPTO_DATA_MBLK;
+	pt.cd_offset = off;
+	pt.cd_length = plen;
+	pt.cd_mp = mp;
+
+	bzero(&ct, sizeof (ct));
+	ct.cd_format = CRYPTO_DATA_RAW;
+	ct.cd_length = plen + SO_KTLS_TAGLEN;
+	ct.cd_raw.iov_base = (char *)hdr + SO_KTLS_HDRLEN + SO_KTLS_NONCELEN;
+	ct.cd_raw.iov_len = plen + SO_KTLS_TAGLEN;
+
+	rv = crypto_encrypt(&mech, &pt, &skt->skt_key, skt->skt_tmpl, &ct,
+	    NULL);
+	bzero(iv, sizeof (iv));
+	if (rv != CRYPTO_SUCCESS) {
+		freeb(rmp);
+		*errorp = EIO;
+		return (NULL);
+	}
+
+	skt->skt_seq++;
+	skt->skt_nonce++;
+	return (rmp);
+}
+
+/*
+ * Replacement for sd_send on a kTLS socket.  Like sd_send, mp is consumed
+ * whether or not the send succeeds.
+ */
+int
+so_ktls_send(struct sonode *so, mblk_t *mp, struct nmsghdr *msg,
+    struct cred *cr)
+{
+	so_ktls_t *skt = so->so_ktls;
+	mblk_t *head = NULL, **tailp = &head;
+	uint64_t seq, nonce;
+	size_t off, len, plen;
+	int error = 0;
+
+	if (msg->msg_flags & MSG_OOB) {
+		freemsg(mp);
+		return (EOPNOTSUPP);
+	}
+
+	mutex_enter(&skt->skt_lock);
+	if (skt->skt_error != 0) {
+		error = skt->skt_error;
+		mutex_exit(&skt->skt_lock);
+		freemsg(mp);
+		return (error);
+	}
+
+	seq = skt->skt_seq;
+	nonce = skt->skt_nonce;
+	len = msgdsize(mp);
+	for (off = 0; off < len; off += plen) {
+		plen = MIN(len - off, SO_KTLS_MAXPLAIN);
+		if ((*tailp = so_ktls_seal(so, skt, mp, off, plen,
+		    &error)) == NULL)
+			break;
+		tailp = &(*tailp)->b_cont;
+	}
+	freemsg(mp);
+
+	if (error != 0) {
+		/*
+		 * Nothing went out, so hand the numbers back; the data is
+		 * lost just as if the protocol had failed the send.  A
+		 * cipher failure, though, will not go away by itself.
+		 */
+		freemsg(head);
+		skt->skt_seq = seq;
+		skt->skt_nonce = nonce;
+		if (error == EIO)
+			skt->skt_error = error;
+		mutex_exit(&skt->skt_lock);
+		return (error);
+	}
+
+	if (head != NULL) {
+		error = (*so->so_downcalls->sd_send)(so->so_proto_handle,
+		    head, msg, cr);
+	}
+	mutex_exit(&skt->skt_lock);
+
+	return (error);
+}
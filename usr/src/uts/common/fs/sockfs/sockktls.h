@@ -0,0 +1,60 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _SOCKFS_SOCKKTLS_H
+#define	_SOCKFS_SOCKKTLS_H
+
+/*
+ * Kernel TLS; sockfs frames and encrypts TLS records on behalf of the
+ * application once it has handed over the negotiated keys (SO_TLS_TX).
+ */
+
+#include <sys/crypto/api.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	SO_KTLS_HDRLEN		5	/* type, version, length */
+#define	SO_KTLS_NONCELEN	8	/* explicit nonce */
+#define	SO_KTLS_SALTLEN		4	/* implicit nonce */
+#define	SO_KTLS_TAGLEN		16	/* GCM authentication tag */
+#define	SO_KTLS_AADLEN		13	/* seq, type, version, length */
+#define	SO_KTLS_MAXPLAIN	16384	/* max. plaintext per record */
+#define	SO_KTLS_OVERHEAD	\
+	(SO_KTLS_HDRLEN + SO_KTLS_NONCELEN + SO_KTLS_TAGLEN)
+
+#define	SO_KTLS_APPDATA		23	/* application_data content type */
+
+typedef struct so_ktls_s {
+	kmutex_t		skt_lock;	/* orders records to proto */
+	uint64_t		skt_seq;	/* next record sequence no. */
+	uint64_t		skt_nonce;	/* next explicit nonce */
+	int			skt_error;	/* sticky encryption error */
+	crypto_mechanism_t	skt_mech;	/* CKM_AES_GCM */
+	crypto_key_t		skt_key;
+	crypto_ctx_template_t	skt_tmpl;	/* pre-expanded key */
+	uint8_t			skt_salt[SO_KTLS_SALTLEN];
+	uint8_t			skt_keybuf[32];
+} so_ktls_t;
+
+struct sonode;
+
+extern int	so_ktls_tx_init(struct sonode *, const void *, socklen_t);
+extern void	so_ktls_fini(struct sonode *);
+extern int	so_ktls_send(struct sonode *, mblk_t *, struct nmsghdr *,
+    struct cred *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SOCKFS_SOCKKTLS_H */
@@ -39,6 +39,7 @@
 #include <sys/debug.h>
 #include <sys/errno.h>
 #include <sys/time.h>
+#include <sys/timer.h>
 #include <sys/file.h>
 #include <sys/user.h>
 #include <sys/stream.h>
@@ -824,19 +825,20 @@ shutdown(int sock, int how, int version)
 }
 
 /*
- * Common receive routine.
+ * Receive a message on a held socket and copy out the address, ancillary
+ * data and flags.  The number of bytes received is returned in *lenp.
  */
-static ssize_t
-recvit(int sock,
+static int
+recvit_so(struct sonode *so,
+	file_t *fp,
 	struct nmsghdr *msg,
 	struct uio *uiop,
 	int flags,
 	socklen_t *namelenp,
 	socklen_t *controllenp,
-	int *flagsp)
+	int *flagsp,
+	ssize_t *lenp)
 {
-	struct sonode *so;
-	file_t *fp;
 	void *name;
 	socklen_t namelen;
 	void *control;
@@ -844,9 +846,6 @@ recvit(int sock,
 	ssize_t len;
 	int error;
 
-	if ((so = getsonode(sock, &error, &fp)) == NULL)
-		return (set_errno(error));
-
 	len = uiop->uio_resid;
 	uiop->uio_fmode = fp->f_flag;
 	uiop->uio_extflg = UIO_COPY_CACHED;
@@ -860,12 +859,9 @@ recvit(int sock,
 	    MSG_DONTWAIT | MSG_XPG4_2);
 
 	error = socket_recvmsg(so, msg, uiop, CRED());
-	if (error) {
-		releasef(sock);
-		return (set_errno(error));
-	}
+	if (error)
+		return (error);
 	lwp_stat_update(LWP_STAT_MSGRCV, 1);
-	releasef(sock);
 
 	error = copyout_name(name, namelen, namelenp,
 	    msg->msg_name, msg->msg_namelen);
@@ -925,7 +921,8 @@ recvit(int sock,
 		kmem_free(msg->msg_name, (size_t)msg->msg_namelen);
 	if (msg->msg_controllen != 0)
 		kmem_free(msg->msg_control, (size_t)msg->msg_controllen);
-	return (len - uiop->uio_resid);
+	*lenp = len - uiop->uio_resid;
+	return (0);
 
 err:
 	/*
@@ -939,7 +936,35 @@ err:
 		kmem_free(msg->msg_name, (size_t)msg->msg_namelen);
 	if (msg->msg_controllen != 0)
 		kmem_free(msg->msg_control, (size_t)msg->msg_controllen);
-	return (set_errno(error));
+	return (error);
+}
+
+/*
+ * Common receive routine.
+ */
+static ssize_t
+recvit(int sock,
+	struct nmsghdr *msg,
+	struct uio *uiop,
+	int flags,
+	socklen_t *namelenp,
+	socklen_t *controllenp,
+	int *flagsp)
+{
+	struct sonode *so;
+	file_t *fp;
+	ssize_t len;
+	int error;
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	error = recvit_so(so, fp, msg, uiop, flags, namelenp, controllenp,
+	    flagsp, &len);
+	releasef(sock);
+	if (error != 0)
+		return (set_errno(error));
+	return (len);
 }
 
 /*
@@ -1013,34 +1038,32 @@ recvfrom(int sock, void *buffer, size_t len, int flags,
 }
 
 /*
- * Uses the MSG_XPG4_2 flag to determine if the caller is using
- * struct omsghdr or struct nmsghdr.
+ * Copy in the message header and iovec of a recvmsg call and set up lmsg
+ * and uiop from them.  Uses the MSG_XPG4_2 flag to determine if the caller
+ * is using struct omsghdr or struct nmsghdr.  The user addresses that the
+ * name length, control length and flags are copied out to are returned
+ * through the last three arguments.
  */
-ssize_t
-recvmsg(int sock, struct nmsghdr *msg, int flags)
+static int
+recvmsg_copyin(struct nmsghdr *msg, struct nmsghdr *lmsg, struct uio *uiop,
+    struct iovec *aiov, int flags, socklen_t **namelenpp,
+    socklen_t **controllenpp, int **flagspp)
 {
 	STRUCT_DECL(nmsghdr, u_lmsg);
 	STRUCT_HANDLE(nmsghdr, umsgptr);
-	struct nmsghdr lmsg;
-	struct uio auio;
-	struct iovec aiov[MSG_MAXIOVLEN];
 	int iovcnt;
 	ssize_t len;
 	int i;
-	int *flagsp;
 	model_t	model;
 
-	dprint(1, ("recvmsg(%d, %p, %d)\n",
-	    sock, (void *)msg, flags));
-
 	model = get_udatamodel();
 	STRUCT_INIT(u_lmsg, model);
 	STRUCT_SET_HANDLE(umsgptr, model, msg);
 
 	if (flags & MSG_XPG4_2) {
 		if (copyin(msg, STRUCT_BUF(u_lmsg), STRUCT_SIZE(u_lmsg)))
-			return (set_errno(EFAULT));
-		flagsp = STRUCT_FADDR(umsgptr, msg_flags);
+			return (EFAULT);
+		*flagspp = STRUCT_FADDR(umsgptr, msg_flags);
 	} else {
 		/*
 		 * Assumes that nmsghdr and omsghdr are identically shaped
@@ -1048,9 +1071,9 @@ recvmsg(int sock, struct nmsghdr *msg, int flags)
 		 */
 		if (copyin(msg, STRUCT_BUF(u_lmsg),
 		    SIZEOF_STRUCT(omsghdr, model)))
-			return (set_errno(EFAULT));
+			return (EFAULT);
 		STRUCT_FSET(u_lmsg, msg_flags, 0);
-		flagsp = NULL;
+		*flagspp = NULL;
 	}
 
 	/*
@@ -1058,18 +1081,18 @@ recvmsg(int sock, struct nmsghdr *msg, int flags)
 	 * off msg_control and msg_name fields. This forces
 	 * us to copy the structure to its native form.
 	 */
-	lmsg.msg_name = STRUCT_FGETP(u_lmsg, msg_name);
-	lmsg.msg_namelen = STRUCT_FGET(u_lmsg, msg_namelen);
-	lmsg.msg_iov = STRUCT_FGETP(u_lmsg, msg_iov);
-	lmsg.msg_iovlen = STRUCT_FGET(u_lmsg, msg_iovlen);
-	lmsg.msg_control = STRUCT_FGETP(u_lmsg, msg_control);
-	lmsg.msg_controllen = STRUCT_FGET(u_lmsg, msg_controllen);
-	lmsg.msg_flags = STRUCT_FGET(u_lmsg, msg_flags);
+	lmsg->msg_name = STRUCT_FGETP(u_lmsg, msg_name);
+	lmsg->msg_namelen = STRUCT_FGET(u_lmsg, msg_namelen);
+	lmsg->msg_iov = STRUCT_FGETP(u_lmsg, msg_iov);
+	lmsg->msg_iovlen = STRUCT_FGET(u_lmsg, msg_iovlen);
+	lmsg->msg_control = STRUCT_FGETP(u_lmsg, msg_control);
+	lmsg->msg_controllen = STRUCT_FGET(u_lmsg, msg_controllen);
+	lmsg->msg_flags = STRUCT_FGET(u_lmsg, msg_flags);
 
-	iovcnt = lmsg.msg_iovlen;
+	iovcnt = lmsg->msg_iovlen;
 
 	if (iovcnt <= 0 || iovcnt > MSG_MAXIOVLEN) {
-		return (set_errno(EMSGSIZE));
+		return (EMSGSIZE);
 	}
 
 #ifdef _SYSCALL32_IMPL
@@ -1081,9 +1104,9 @@ recvmsg(int sock, struct nmsghdr *msg, int flags)
 		struct iovec32 aiov32[MSG_MAXIOVLEN];
 		ssize32_t count32;
 
-		if (copyin((struct iovec32 *)lmsg.msg_iov, aiov32,
+		if (copyin((struct iovec32 *)lmsg->msg_iov, aiov32,
 		    iovcnt * sizeof (struct iovec32)))
-			return (set_errno(EFAULT));
+			return (EFAULT);
 
 		count32 = 0;
 		for (i = 0; i < iovcnt; i++) {
@@ -1092,67 +1115,82 @@ recvmsg(int sock, struct nmsghdr *msg, int flags)
 			iovlen32 = aiov32[i].iov_len;
 			count32 += iovlen32;
 			if (iovlen32 < 0 || count32 < 0)
-				return (set_errno(EINVAL));
+				return (EINVAL);
 			aiov[i].iov_len = iovlen32;
 			aiov[i].iov_base =
 			    (caddr_t)(uintptr_t)aiov32[i].iov_base;
 		}
 	} else
 #endif /* _SYSCALL32_IMPL */
-	if (copyin(lmsg.msg_iov, aiov, iovcnt * sizeof (struct iovec))) {
-		return (set_errno(EFAULT));
+	if (copyin(lmsg->msg_iov, aiov, iovcnt * sizeof (struct iovec))) {
+		return (EFAULT);
 	}
 	len = 0;
 	for (i = 0; i < iovcnt; i++) {
 		ssize_t iovlen = aiov[i].iov_len;
 		len += iovlen;
 		if (iovlen < 0 || len < 0) {
-			return (set_errno(EINVAL));
+			return (EINVAL);
 		}
 	}
-	auio.uio_loffset = 0;
-	auio.uio_iov = aiov;
-	auio.uio_iovcnt = iovcnt;
-	auio.uio_resid = len;
-	auio.uio_segflg = UIO_USERSPACE;
-	auio.uio_limit = 0;
+	uiop->uio_loffset = 0;
+	uiop->uio_iov = aiov;
+	uiop->uio_iovcnt = iovcnt;
+	uiop->uio_resid = len;
+	uiop->uio_segflg = UIO_USERSPACE;
+	uiop->uio_limit = 0;
 
-	if (lmsg.msg_control != NULL &&
+	if (lmsg->msg_control != NULL &&
 	    (do_useracc == 0 ||
-	    useracc(lmsg.msg_control, lmsg.msg_controllen,
+	    useracc(lmsg->msg_control, lmsg->msg_controllen,
 	    B_WRITE) != 0)) {
-		return (set_errno(EFAULT));
+		return (EFAULT);
 	}
 
-	return (recvit(sock, &lmsg, &auio, flags,
-	    STRUCT_FADDR(umsgptr, msg_namelen),
-	    STRUCT_FADDR(umsgptr, msg_controllen), flagsp));
+	*namelenpp = STRUCT_FADDR(umsgptr, msg_namelen);
+	*controllenpp = STRUCT_FADDR(umsgptr, msg_controllen);
+	return (0);
 }
 
 /*
- * Common send function.
+ * Uses the MSG_XPG4_2 flag to determine if the caller is using
+ * struct omsghdr or struct nmsghdr.
  */
-static ssize_t
-sendit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags)
+ssize_t
+recvmsg(int sock, struct nmsghdr *msg, int flags)
 {
-	struct sonode *so;
-	file_t *fp;
-	void *name;
-	socklen_t namelen;
-	void *control;
-	socklen_t controllen;
-	ssize_t len;
+	struct nmsghdr lmsg;
+	struct uio auio;
+	struct iovec aiov[MSG_MAXIOVLEN];
+	socklen_t *namelenp, *controllenp;
+	int *flagsp;
 	int error;
 
-	if ((so = getsonode(sock, &error, &fp)) == NULL)
+	dprint(1, ("recvmsg(%d, %p, %d)\n",
+	    sock, (void *)msg, flags));
+
+	error = recvmsg_copyin(msg, &lmsg, &auio, aiov, flags, &namelenp,
+	    &controllenp, &flagsp);
+	if (error != 0)
 		return (set_errno(error));
 
-	uiop->uio_fmode = fp->f_flag;
+	return (recvit(sock, &lmsg, &auio, flags, namelenp, controllenp,
+	    flagsp));
+}
 
-	if (so->so_family == AF_UNIX)
-		uiop->uio_extflg = UIO_COPY_CACHED;
-	else
-		uiop->uio_extflg = UIO_COPY_DEFAULT;
+/*
+ * Replace the address and ancillary data pointers of an outgoing message
+ * with kernel copies.  The copies are recorded in kargs, from which
+ * sendit_free() releases them.
+ */
+static int
+sendit_copyin(struct sonode *so, struct nmsghdr *msg, struct nmsghdr *kargs)
+{
+	void *name;
+	socklen_t namelen;
+	void *control;
+	socklen_t controllen;
+	int error = 0;
 
 	/* Allocate and copyin name and control */
 	name = msg->msg_name;
@@ -1163,7 +1201,7 @@ sendit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags)
 		    (struct sockaddr *)name,
 		    &namelen, &error);
 		if (name == NULL)
-			goto done3;
+			return (error);
 		/* copyin_name null terminates addresses for AF_UNIX */
 		msg->msg_namelen = namelen;
 		msg->msg_name = name;
@@ -1196,17 +1234,57 @@ sendit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags)
 		msg->msg_controllen = controllen = 0;
 	}
 
-	len = uiop->uio_resid;
-	msg->msg_flags = flags;
+	kargs->msg_name = name;
+	kargs->msg_namelen = namelen;
+	kargs->msg_control = control;
+	kargs->msg_controllen = controllen;
+	return (0);
 
-	error = socket_sendmsg(so, msg, uiop, CRED());
 done1:
-	if (control != NULL)
-		kmem_free(control, controllen);
+	kmem_free(control, controllen);
 done2:
 	if (name != NULL)
 		kmem_free(name, namelen);
-done3:
+	return (error);
+}
+
+static void
+sendit_free(struct nmsghdr *kargs)
+{
+	if (kargs->msg_control != NULL)
+		kmem_free(kargs->msg_control, kargs->msg_controllen);
+	if (kargs->msg_name != NULL)
+		kmem_free(kargs->msg_name, kargs->msg_namelen);
+}
+
+/*
+ * Common send function.
+ */
+static ssize_t
+sendit(int sock, struct nmsghdr *msg, struct uio *uiop, int flags)
+{
+	struct sonode *so;
+	file_t *fp;
+	struct nmsghdr kargs;
+	ssize_t len;
+	int error;
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	uiop->uio_fmode = fp->f_flag;
+
+	if (so->so_family == AF_UNIX)
+		uiop->uio_extflg = UIO_COPY_CACHED;
+	else
+		uiop->uio_extflg = UIO_COPY_DEFAULT;
+
+	len = uiop->uio_resid;
+	if ((error = sendit_copyin(so, msg, &kargs)) == 0) {
+		msg->msg_flags = flags;
+		error = socket_sendmsg(so, msg, uiop, CRED());
+		sendit_free(&kargs);
+	}
 	if (error != 0) {
 		releasef(sock);
 		return (set_errno(error));
@@ -1255,30 +1333,28 @@ send(int sock, void *buffer, size_t len, int flags)
 }
 
 /*
- * Uses the MSG_XPG4_2 flag to determine if the caller is using
- * struct omsghdr or struct nmsghdr.
+ * Copy in the message header and iovec of a sendmsg call and set up lmsg
+ * and uiop from them.  Uses the MSG_XPG4_2 flag to determine if the caller
+ * is using struct omsghdr or struct nmsghdr; *flagsp is updated with any
+ * flags this implies.
  */
-ssize_t
-sendmsg(int sock, struct nmsghdr *msg, int flags)
+static int
+sendmsg_copyin(struct nmsghdr *msg, struct nmsghdr *lmsg, struct uio *uiop,
+    struct iovec *aiov, int *flagsp)
 {
-	struct nmsghdr lmsg;
 	STRUCT_DECL(nmsghdr, u_lmsg);
-	struct uio auio;
-	struct iovec aiov[MSG_MAXIOVLEN];
 	int iovcnt;
 	ssize_t len;
 	int i;
 	model_t	model;
 
-	dprint(1, ("sendmsg(%d, %p, %d)\n", sock, (void *)msg, flags));
-
 	model = get_udatamodel();
 	STRUCT_INIT(u_lmsg, model);
 
-	if (flags & MSG_XPG4_2) {
+	if (*flagsp & MSG_XPG4_2) {
 		if (copyin(msg, (char *)STRUCT_BUF(u_lmsg),
 		    STRUCT_SIZE(u_lmsg)))
-			return (set_errno(EFAULT));
+			return (EFAULT);
 	} else {
 		/*
 		 * Assumes that nmsghdr and omsghdr are identically shaped
@@ -1286,12 +1362,12 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 		 */
 		if (copyin(msg, (char *)STRUCT_BUF(u_lmsg),
 		    SIZEOF_STRUCT(omsghdr, model)))
-			return (set_errno(EFAULT));
+			return (EFAULT);
 		/*
 		 * In order to be compatible with the libsocket/sockmod
 		 * implementation we set EOR for all send* calls.
 		 */
-		flags |= MSG_EOR;
+		*flagsp |= MSG_EOR;
 	}
 
 	/*
@@ -1299,23 +1375,23 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 	 * off msg_control and msg_name fields. This forces
 	 * us to copy the structure to its native form.
 	 */
-	lmsg.msg_name = STRUCT_FGETP(u_lmsg, msg_name);
-	lmsg.msg_namelen = STRUCT_FGET(u_lmsg, msg_namelen);
-	lmsg.msg_iov = STRUCT_FGETP(u_lmsg, msg_iov);
-	lmsg.msg_iovlen = STRUCT_FGET(u_lmsg, msg_iovlen);
-	lmsg.msg_control = STRUCT_FGETP(u_lmsg, msg_control);
-	lmsg.msg_controllen = STRUCT_FGET(u_lmsg, msg_controllen);
-	lmsg.msg_flags = STRUCT_FGET(u_lmsg, msg_flags);
+	lmsg->msg_name = STRUCT_FGETP(u_lmsg, msg_name);
+	lmsg->msg_namelen = STRUCT_FGET(u_lmsg, msg_namelen);
+	lmsg->msg_iov = STRUCT_FGETP(u_lmsg, msg_iov);
+	lmsg->msg_iovlen = STRUCT_FGET(u_lmsg, msg_iovlen);
+	lmsg->msg_control = STRUCT_FGETP(u_lmsg, msg_control);
+	lmsg->msg_controllen = STRUCT_FGET(u_lmsg, msg_controllen);
+	lmsg->msg_flags = STRUCT_FGET(u_lmsg, msg_flags);
 
-	iovcnt = lmsg.msg_iovlen;
+	iovcnt = lmsg->msg_iovlen;
 
 	if (iovcnt <= 0 || iovcnt > MSG_MAXIOVLEN) {
 		/*
 		 * Unless this is XPG 4.2 we allow iovcnt == 0 to
 		 * be compatible with SunOS 4.X and 4.4BSD.
 		 */
-		if (iovcnt != 0 || (flags & MSG_XPG4_2))
-			return (set_errno(EMSGSIZE));
+		if (iovcnt != 0 || (*flagsp & MSG_XPG4_2))
+			return (EMSGSIZE);
 	}
 
 #ifdef _SYSCALL32_IMPL
@@ -1328,9 +1404,9 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 		ssize32_t count32;
 
 		if (iovcnt != 0 &&
-		    copyin((struct iovec32 *)lmsg.msg_iov, aiov32,
+		    copyin((struct iovec32 *)lmsg->msg_iov, aiov32,
 		    iovcnt * sizeof (struct iovec32)))
-			return (set_errno(EFAULT));
+			return (EFAULT);
 
 		count32 = 0;
 		for (i = 0; i < iovcnt; i++) {
@@ -1339,7 +1415,7 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 			iovlen32 = aiov32[i].iov_len;
 			count32 += iovlen32;
 			if (iovlen32 < 0 || count32 < 0)
-				return (set_errno(EINVAL));
+				return (EINVAL);
 			aiov[i].iov_len = iovlen32;
 			aiov[i].iov_base =
 			    (caddr_t)(uintptr_t)aiov32[i].iov_base;
@@ -1347,28 +1423,259 @@ sendmsg(int sock, struct nmsghdr *msg, int flags)
 	} else
 #endif /* _SYSCALL32_IMPL */
 	if (iovcnt != 0 &&
-	    copyin(lmsg.msg_iov, aiov,
+	    copyin(lmsg->msg_iov, aiov,
 	    (unsigned)iovcnt * sizeof (struct iovec))) {
-		return (set_errno(EFAULT));
+		return (EFAULT);
 	}
 	len = 0;
 	for (i = 0; i < iovcnt; i++) {
 		ssize_t iovlen = aiov[i].iov_len;
 		len += iovlen;
 		if (iovlen < 0 || len < 0) {
-			return (set_errno(EINVAL));
+			return (EINVAL);
 		}
 	}
-	auio.uio_loffset = 0;
-	auio.uio_iov = aiov;
-	auio.uio_iovcnt = iovcnt;
-	auio.uio_resid = len;
-	auio.uio_segflg = UIO_USERSPACE;
-	auio.uio_limit = 0;
+	uiop->uio_loffset = 0;
+	uiop->uio_iov = aiov;
+	uiop->uio_iovcnt = iovcnt;
+	uiop->uio_resid = len;
+	uiop->uio_segflg = UIO_USERSPACE;
+	uiop->uio_limit = 0;
+
+	return (0);
+}
+
+/*
+ * Uses the MSG_XPG4_2 flag to determine if the caller is using
+ * struct omsghdr or struct nmsghdr.
+ */
+ssize_t
+sendmsg(int sock, struct nmsghdr *msg, int flags)
+{
+	struct nmsghdr lmsg;
+	struct uio auio;
+	struct iovec aiov[MSG_MAXIOVLEN];
+	int error;
+
+	dprint(1, ("sendmsg(%d, %p, %d)\n", sock, (void *)msg, flags));
+
+	if ((error = sendmsg_copyin(msg, &lmsg, &auio, aiov, &flags)) != 0)
+		return (set_errno(error));
 
 	return (sendit(sock, &lmsg, &auio, flags));
 }
 
+/*
+ * Largest message vector accepted by sendmmsg and recvmmsg; longer
+ * vectors are truncated.  sendmmsg copies in and sends SO_MMSG_BATCH
+ * messages at a time.
+ */
+#define	SO_MMSG_MAX	1024
+#define	SO_MMSG_BATCH	64
+
+/*
+ * Return the user address of element i of an mmsghdr vector, and that of
+ * its msg_len field through lenpp.  As for sendmsg and recvmsg, MSG_XPG4_2
+ * tells whether the vector holds struct omsghdr or struct nmsghdr headers.
+ */
+static struct nmsghdr *
+mmsghdr_elem(struct mmsghdr *vec, uint_t i, model_t model, int flags,
+    uint32_t **lenpp)
+{
+	size_t size, off;
+
+#ifdef _SYSCALL32_IMPL
+	if (model == DATAMODEL_ILP32) {
+		if (flags & MSG_XPG4_2) {
+			size = sizeof (struct mmsghdr32);
+			off = offsetof(struct mmsghdr32, msg_len);
+		} else {
+			size = sizeof (struct ommsghdr32);
+			off = offsetof(struct ommsghdr32, msg_len);
+		}
+	} else
+#endif /* _SYSCALL32_IMPL */
+	if (flags & MSG_XPG4_2) {
+		size = sizeof (struct mmsghdr);
+		off = offsetof(struct mmsghdr, msg_len);
+	} else {
+		size = sizeof (struct ommsghdr);
+		off = offsetof(struct ommsghdr, msg_len);
+	}
+
+	*lenpp = (uint32_t *)((caddr_t)vec + i * size + off);
+	return ((struct nmsghdr *)((caddr_t)vec + i * size));
+}
+
+/*
+ * Send a vector of messages.  The file descriptor is looked up once, and
+ * messages are copied in and handed to the socket in batches so that the
+ * socket layer can send each batch without dropping its locks.  Returns
+ * the number of messages sent; an error is only returned if none were.
+ */
+int
+sendmmsg(int sock, struct mmsghdr *vec, uint_t vlen, int flags)
+{
+	struct sonode *so;
+	file_t *fp;
+	so_mmsg_t *mm;
+	struct nmsghdr *kargs;
+	uint32_t *lenp;
+	model_t model;
+	uint_t batch, done, cnt, sent, i;
+	int error, serror, mflags;
+
+	dprint(1, ("sendmmsg(%d, %p, %u, %d)\n",
+	    sock, (void *)vec, vlen, flags));
+
+	if (vlen > SO_MMSG_MAX)
+		vlen = SO_MMSG_MAX;
+	if (vlen == 0)
+		return (0);
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	model = get_udatamodel();
+	batch = MIN(vlen, SO_MMSG_BATCH);
+	mm = kmem_alloc(batch * sizeof (so_mmsg_t), KM_SLEEP);
+	kargs = kmem_alloc(batch * sizeof (struct nmsghdr), KM_SLEEP);
+
+	for (done = 0; done < vlen; done += sent) {
+		cnt = MIN(vlen - done, batch);
+		for (i = 0; i < cnt; i++) {
+			mflags = flags;
+			error = sendmsg_copyin(mmsghdr_elem(vec, done + i,
+			    model, flags, &lenp), &mm[i].sm_msg,
+			    &mm[i].sm_uio, mm[i].sm_iov, &mflags);
+			if (error != 0)
+				break;
+			mm[i].sm_uio.uio_fmode = fp->f_flag;
+			mm[i].sm_uio.uio_extflg = UIO_COPY_DEFAULT;
+			error = sendit_copyin(so, &mm[i].sm_msg, &kargs[i]);
+			if (error != 0)
+				break;
+			mm[i].sm_msg.msg_flags = mflags;
+		}
+
+		sent = 0;
+		if (i > 0) {
+			serror = socket_sendmmsg(so, mm, i, CRED(), &sent);
+			if (serror != 0)
+				error = serror;
+		}
+		for (cnt = 0; cnt < i; cnt++)
+			sendit_free(&kargs[cnt]);
+
+		for (cnt = 0; cnt < sent; cnt++) {
+			(void) mmsghdr_elem(vec, done + cnt, model, flags,
+			    &lenp);
+			if (suword32(lenp, (uint32_t)(mm[cnt].sm_len -
+			    mm[cnt].sm_uio.uio_resid)) != 0) {
+				error = EFAULT;
+				break;
+			}
+		}
+		if (error != 0) {
+			done += sent;
+			break;
+		}
+	}
+
+	kmem_free(kargs, batch * sizeof (struct nmsghdr));
+	kmem_free(mm, batch * sizeof (so_mmsg_t));
+	if (done != 0)
+		lwp_stat_update(LWP_STAT_MSGSND, done);
+	releasef(sock);
+
+	if (done == 0)
+		return (set_errno(error));
+	return (done);
+}
+
+/*
+ * Receive a vector of messages.  With MSG_WAITFORONE only the first
+ * message may block.  The timeout, if any, is checked after each message
+ * is received.  Returns the number of messages received; an error is only
+ * returned if none were.
+ */
+int
+recvmmsg(int sock, struct mmsghdr *vec, uint_t vlen, int flags,
+    timespec_t *timeoutp)
+{
+	struct sonode *so;
+	file_t *fp;
+	struct nmsghdr lmsg;
+	struct uio auio;
+	struct iovec aiov[MSG_MAXIOVLEN];
+	struct nmsghdr *umsg;
+	socklen_t *namelenp, *controllenp;
+	int *flagsp;
+	uint32_t *lenp;
+	timespec_t ts;
+	hrtime_t deadline = 0;
+	model_t model;
+	ssize_t len;
+	uint_t done;
+	int error;
+
+	dprint(1, ("recvmmsg(%d, %p, %u, %d, %p)\n",
+	    sock, (void *)vec, vlen, flags, (void *)timeoutp));
+
+	model = get_udatamodel();
+	if (timeoutp != NULL) {
+		if (model == DATAMODEL_NATIVE) {
+			if (copyin(timeoutp, &ts, sizeof (ts)))
+				return (set_errno(EFAULT));
+		} else {
+			timespec32_t ts32;
+
+			if (copyin(timeoutp, &ts32, sizeof (ts32)))
+				return (set_errno(EFAULT));
+			TIMESPEC32_TO_TIMESPEC(&ts, &ts32)
+		}
+
+		if (itimerspecfix(&ts))
+			return (set_errno(EINVAL));
+		deadline = gethrtime() + ts2hrt(&ts);
+	}
+
+	if (vlen > SO_MMSG_MAX)
+		vlen = SO_MMSG_MAX;
+	if (vlen == 0)
+		return (0);
+
+	if ((so = getsonode(sock, &error, &fp)) == NULL)
+		return (set_errno(error));
+
+	for (done = 0; done < vlen; ) {
+		umsg = mmsghdr_elem(vec, done, model, flags, &lenp);
+		error = recvmsg_copyin(umsg, &lmsg, &auio, aiov, flags,
+		    &namelenp, &controllenp, &flagsp);
+		if (error != 0)
+			break;
+		error = recvit_so(so, fp, &lmsg, &auio, flags & ~MSG_WAITFORONE,
+		    namelenp, controllenp, flagsp, &len);
+		if (error != 0)
+			break;
+		if (suword32(lenp, (uint32_t)len) != 0) {
+			error = EFAULT;
+			break;
+		}
+		done++;
+
+		if (flags & MSG_WAITFORONE)
+			flags |= MSG_DONTWAIT;
+		if (deadline != 0 && gethrtime() >= deadline)
+			break;
+	}
+	releasef(sock);
+
+	if (done == 0)
+		return (set_errno(error));
+	return (done);
+}
+
 ssize_t
 sendto(int sock, void *buffer, size_t len, int flags,
     struct sockaddr *name, socklen_t namelen)
@@ -2702,6 +3009,144 @@ done:
 	return (error);
 }
 
+/*
+ * Loaned file system buffers (VOP_REQZCBUF) for sendfilev().  The file
+ * system hands out its own cached buffers (for ZFS, the ARC buffers
+ * backing the file) and VOP_READ() fills in the xuio's iovecs with them
+ * instead of copying.  Each iovec becomes an esballoca'ed mblk; the
+ * buffers are given back with VOP_RETZCBUF() when the last mblk is freed,
+ * normally when TCP receives the ack.  Unlike the segmap path, a loaned
+ * buffer is detached from the file, so later writes to the file cannot
+ * change data that is still queued and there is no need to wait for the
+ * transport before returning.
+ */
+typedef struct {
+	xuio_t		snfl_uio;
+	unsigned int	snfl_ref;
+	frtn_t		snfl_frtn;
+	vnode_t		*snfl_vp;
+} snf_loan_desbinfo;
+
+int snf_loan_enable = 1;
+size_t snf_loan_maxsize = 1024 * 1024;
+
+void
+snf_loan_desbfree(snf_loan_desbinfo *snfl)
+{
+	ASSERT(snfl->snfl_ref != 0);
+	if (atomic_add_32_nv(&snfl->snfl_ref, -1) == 0) {
+		(void) VOP_RETZCBUF(snfl->snfl_vp, &snfl->snfl_uio, kcred,
+		    NULL);
+		VN_RELE(snfl->snfl_vp);
+		kmem_free(snfl, sizeof (snf_loan_desbinfo));
+	}
+}
+
+/*
+ * Send up to total_size bytes of fvp starting at fileoff using loaned
+ * buffers.  The caller holds fvp's rwlock as a reader.  We stop early,
+ * without an error, as soon as the file system declines to loan (e.g. a
+ * short tail or a file with cached pages); *count tells the caller how
+ * much was sent so it can copy the rest.
+ */
+int
+snf_loan(file_t *fp, vnode_t *fvp, u_offset_t fileoff, u_offset_t total_size,
+    ssize_t *count)
+{
+	vnode_t *vp = fp->f_vnode;
+	short fflag = fp->f_flag;
+	struct nmsghdr msg;
+	ssize_t ksize = 0;
+	int error = 0;
+
+	bzero(&msg, sizeof (msg));
+	while (total_size > 0) {
+		snf_loan_desbinfo *snfl;
+		uio_t *uiop;
+		mblk_t *mp = NULL;
+		mblk_t *nmp;
+		size_t chain_size, len;
+		int i;
+
+		if (ISSIG(curthread, JUSTLOOKING)) {
+			error = EINTR;
+			break;
+		}
+
+		snfl = kmem_zalloc(sizeof (snf_loan_desbinfo), KM_SLEEP);
+		snfl->snfl_uio.xu_type = UIOTYPE_ZEROCOPY;
+		uiop = &snfl->snfl_uio.xu_uio;
+		uiop->uio_segflg = UIO_SYSSPACE;
+		uiop->uio_loffset = fileoff;
+		uiop->uio_llimit = MAXOFFSET_T;
+		uiop->uio_resid = MIN(total_size, snf_loan_maxsize);
+		if (VOP_REQZCBUF(fvp, UIO_READ, &snfl->snfl_uio, fp->f_cred,
+		    NULL) != 0) {
+			kmem_free(snfl, sizeof (snf_loan_desbinfo));
+			break;
+		}
+		VN_HOLD(fvp);
+		snfl->snfl_vp = fvp;
+		snfl->snfl_ref = 1;
+		snfl->snfl_frtn.free_func = snf_loan_desbfree;
+		snfl->snfl_frtn.free_arg = (caddr_t)snfl;
+
+		chain_size = uiop->uio_resid;
+		error = VOP_READ(fvp, uiop, 0, fp->f_cred, NULL);
+		chain_size -= uiop->uio_resid;
+		if (error != 0 || chain_size == 0) {
+			snf_loan_desbfree(snfl);
+			break;
+		}
+
+		/* Construct the mblk chain from the loaned buffers */
+		len = chain_size;
+		for (i = 0; i < uiop->uio_iovcnt && len > 0; i++) {
+			iovec_t *iovp = &uiop->uio_iov[i];
+			size_t mblk_size = MIN(iovp->iov_len, len);
+
+			nmp = esballoca((uchar_t *)iovp->iov_base, mblk_size,
+			    BPRI_HI, &snfl->snfl_frtn);
+			if (nmp == NULL)
+				break;
+			nmp->b_wptr += mblk_size;
+			snfl->snfl_ref++;
+			len -= mblk_size;
+			if (mp != NULL)
+				linkb(mp, nmp);
+			else
+				mp = nmp;
+		}
+		chain_size -= len;
+
+		/* The mblks now hold the buffers; drop our own reference. */
+		snf_loan_desbfree(snfl);
+		if (mp == NULL) {
+			error = EAGAIN;
+			break;
+		}
+
+		error = socket_sendmblk(VTOSO(vp), &msg, fflag, CRED(), &mp);
+		if (error != 0) {
+			/*
+			 * mp contains the mblks that were not sent by
+			 * socket_sendmblk. Use its size to update *count
+			 */
+			ksize += chain_size - msgdsize(mp);
+			if (mp != NULL)
+				freemsg(mp);
+			break;
+		}
+		ksize += chain_size;
+		fileoff += chain_size;
+		total_size -= chain_size;
+	}
+	if (ksize != 0)
+		sf_stats.ss_file_loaned++;
+	*count = ksize;
+	return (error);
+}
+
 int
 snf_cache(file_t *fp, vnode_t *fvp, u_offset_t fileoff, u_offset_t size,
     uint_t maxpsz, ssize_t *count)
@@ -2903,6 +3348,25 @@ sosendfile64(file_t *fp, file_t *rfp, const struct ksendfilevec64 *sfv,
 
 	vp = fp->f_vnode;
 	stp = vp->v_stream;
+	/*
+	 * Send what the file system is willing to loan (e.g. ZFS ARC
+	 * buffers) without a copy or a page cache mapping; the rest goes
+	 * through the segmap or copy paths below.
+	 */
+	if (snf_loan_enable && vp->v_type == VSOCK &&
+	    VTOSO(vp)->so_filter_active == 0) {
+		ssize_t lcount = 0;
+
+		error = snf_loan(fp, fvp, sfv_off, (u_offset_t)sfv_len,
+		    &lcount);
+		count += lcount;
+		sfv_off += lcount;
+		sfv_len -= (ssize32_t)lcount;
+		if (error != 0 || sfv_len == 0) {
+			VOP_RWUNLOCK(fvp, V_WRITELOCK_FALSE, NULL);
+			goto out;
+		}
+	}
 	/*
 	 * When the NOWAIT flag is not set, we enable zero-copy only if the
 	 * transfer size is large enough. This prevents performance loss
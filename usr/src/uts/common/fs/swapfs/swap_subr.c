@@ -60,6 +60,15 @@ pgcnt_t swapfs_desfree = 0;
 pgcnt_t swapfs_minfree = 0;
 pgcnt_t swapfs_reserve = 0;
 
+/*
+ * swapfs_klustsize is the most that pageout writes to swap in one i/o.
+ * Pages being paged out are queued until that much is pending, and are
+ * then given consecutive swap slots and written out together.  It is at
+ * least klustsize, and at most the swap_maxcontig pages allocated from
+ * one swap device before moving on to the next.  It is set in swapinit().
+ */
+int swapfs_klustsize = 1024 * 1024;
+
 #ifdef SWAPFS_DEBUG
 int swapfs_debug;
 #endif /* SWAPFS_DEBUG */
@@ -73,6 +82,8 @@ static struct vnode **swap_vnodes;	/* ptr's to swap vnodes */
 
 static void swap_init_mem_config(void);
 
+extern int swap_maxcontig;
+
 static pgcnt_t initial_swapfs_desfree;
 static pgcnt_t initial_swapfs_minfree;
 static pgcnt_t initial_swapfs_reserve;
@@ -161,7 +172,7 @@ swapfs_recalc(pgcnt_t pgs)
 int
 swapinit(int fstype, char *name)
 {							/* reserve for mp */
-	ssize_t sw_freelist_size = klustsize / PAGESIZE * 2;
+	ssize_t sw_freelist_size;
 	int i, error;
 
 	static const fs_operation_def_t swap_vfsops[] = {
@@ -185,6 +196,13 @@ swapinit(int fstype, char *name)
 	 */
 	swap_init_mem_config();
 
+	if (swapfs_klustsize < klustsize)
+		swapfs_klustsize = klustsize;
+	if (swap_maxcontig != 0 && swapfs_klustsize > ptob(swap_maxcontig))
+		swapfs_klustsize = ptob(swap_maxcontig);
+	swapfs_klustsize = P2ALIGN(swapfs_klustsize, PAGESIZE);
+	sw_freelist_size = swapfs_klustsize / PAGESIZE * 2;
+
 	sw_ar = (struct async_reqs *)
 	    kmem_zalloc(sw_freelist_size*sizeof (struct async_reqs), KM_SLEEP);
 
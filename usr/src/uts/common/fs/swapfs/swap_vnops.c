@@ -461,7 +461,7 @@ swap_getconpage(
 
 /* Async putpage klustering stuff */
 int sw_pending_size;
-extern int klustsize;
+extern int swapfs_klustsize;
 extern struct async_reqs *sw_getreq();
 extern void sw_putreq(struct async_reqs *);
 extern void sw_putbackreq(struct async_reqs *);
@@ -542,7 +542,7 @@ swap_putpage(
 			 * now instead of queuing.
 			 */
 			if (flags == (B_ASYNC | B_FREE) &&
-			    sw_pending_size < klustsize &&
+			    sw_pending_size < swapfs_klustsize &&
 			    (arg = sw_getfree())) {
 				/*
 				 * If we are clustering, we should allow
@@ -632,7 +632,7 @@ swap_putapage(
 	 * B_ASYNC|B_FREE flags on.
 	 */
 	if (flags == (B_ASYNC | B_FREE) &&
-	    sw_pending_size < klustsize && (arg = sw_getfree())) {
+	    sw_pending_size < swapfs_klustsize && (arg = sw_getfree())) {
 
 		hat_setmod(pp);
 		page_io_unlock(pp);
@@ -675,7 +675,7 @@ swap_putapage(
 	 * pending requests, kluster.
 	 */
 	if (flags == (B_ASYNC | B_FREE))
-		swap_klustsize = klustsize;
+		swap_klustsize = swapfs_klustsize;
 	else
 		swap_klustsize = PAGESIZE;
 	se = (flags & B_FREE ? SE_EXCL : SE_SHARED);
@@ -41,6 +41,9 @@
 #include <sys/fs/tmpnode.h>
 #include <sys/fs/tmp.h>
 #include <sys/vtrace.h>
+#include <sys/kmem.h>
+#include <sys/atomic.h>
+#include <sys/taskq.h>
 
 static int tdircheckpath(struct tmpnode *, struct tmpnode *, struct cred *);
 static int tdirrename(struct tmpnode *, struct tmpnode *, struct tmpnode *,
@@ -52,13 +55,28 @@ static int tdiraddentry(struct tmpnode *, struct tmpnode *, char *,
 	enum de_op, struct tmpnode *);
 
 
+/*
+ * All directory entries of all tmpfs file systems live in one hash table,
+ * keyed by parent and name.  The table starts out at T_HASH_SIZE buckets
+ * and doubles, up to tmpfs_hash_max buckets, whenever it holds more than
+ * two entries per bucket, so that lookups in large directories stay
+ * cheap.  The buckets are protected by T_MUTEX_SIZE mutexes, chosen by
+ * the low bits of the hash; since those don't depend on the size of the
+ * table, a lookup holding the mutex for its hash sees a stable table, and
+ * growing it only has to take all of them.
+ */
 #define	T_HASH_SIZE	8192		/* must be power of 2 */
-#define	T_MUTEX_SIZE	64
+#define	T_MUTEX_SIZE	256
+
+uint_t	tmpfs_hash_max = 1 << 22;	/* must be power of 2 */
 
-static struct tdirent	*t_hashtable[T_HASH_SIZE];
+static struct tdirent	**t_hashtable;
+static uint_t		 t_hashsize;	/* protected by all t_hashmutex */
+static uint_t		 t_hashentries;
+static uint_t		 t_hashgrowing;
 static kmutex_t		 t_hashmutex[T_MUTEX_SIZE];
 
-#define	T_HASH_INDEX(a)		((a) & (T_HASH_SIZE-1))
+#define	T_HASH_INDEX(a)		((a) & (t_hashsize-1))
 #define	T_MUTEX_INDEX(a)	((a) & (T_MUTEX_SIZE-1))
 
 #define	TMPFS_HASH(tp, name, hash)				\
@@ -76,6 +94,48 @@ tmpfs_hash_init(void)
 
 	for (ix = 0; ix < T_MUTEX_SIZE; ix++)
 		mutex_init(&t_hashmutex[ix], NULL, MUTEX_DEFAULT, NULL);
+	t_hashsize = T_HASH_SIZE;
+	t_hashtable = kmem_zalloc(t_hashsize * sizeof (struct tdirent *),
+	    KM_SLEEP);
+}
+
+/*
+ * Double the hash table until there are at most two entries per bucket.
+ * Lookups and updates are held off while the entries are moved.
+ */
+/* ARGSUSED */
+static void
+tmpfs_hash_grow(void *arg)
+{
+	struct tdirent	**oldtable, **newtable;
+	struct tdirent	*t, *next;
+	uint_t		oldsize, newsize;
+	uint_t		ix;
+
+	oldsize = t_hashsize;
+	newsize = oldsize;
+	do {
+		newsize <<= 1;
+	} while (newsize < tmpfs_hash_max && t_hashentries > 2 * newsize);
+	newtable = kmem_zalloc(newsize * sizeof (struct tdirent *), KM_SLEEP);
+
+	for (ix = 0; ix < T_MUTEX_SIZE; ix++)
+		mutex_enter(&t_hashmutex[ix]);
+	oldtable = t_hashtable;
+	for (ix = 0; ix < oldsize; ix++) {
+		for (t = oldtable[ix]; t != NULL; t = next) {
+			next = t->td_link;
+			t->td_link = newtable[t->td_hash & (newsize - 1)];
+			newtable[t->td_hash & (newsize - 1)] = t;
+		}
+	}
+	t_hashtable = newtable;
+	t_hashsize = newsize;
+	for (ix = 0; ix < T_MUTEX_SIZE; ix++)
+		mutex_exit(&t_hashmutex[ix]);
+
+	kmem_free(oldtable, oldsize * sizeof (struct tdirent *));
+	t_hashgrowing = 0;
 }
 
 /*
@@ -87,15 +147,23 @@ tmpfs_hash_in(struct tdirent *t)
 	uint_t		hash;
 	struct tdirent	**prevpp;
 	kmutex_t	*t_hmtx;
+	boolean_t	grow;
 
 	TMPFS_HASH(t->td_parent, t->td_name, hash);
 	t->td_hash = hash;
-	prevpp = &t_hashtable[T_HASH_INDEX(hash)];
 	t_hmtx = &t_hashmutex[T_MUTEX_INDEX(hash)];
 	mutex_enter(t_hmtx);
+	prevpp = &t_hashtable[T_HASH_INDEX(hash)];
 	t->td_link = *prevpp;
 	*prevpp = t;
+	grow = (atomic_inc_uint_nv(&t_hashentries) > 2 * t_hashsize &&
+	    t_hashsize < tmpfs_hash_max);
 	mutex_exit(t_hmtx);
+
+	if (grow && atomic_cas_uint(&t_hashgrowing, 0, 1) == 0 &&
+	    taskq_dispatch(system_taskq, tmpfs_hash_grow, NULL,
+	    TQ_NOSLEEP) == NULL)
+		t_hashgrowing = 0;
 }
 
 /*
@@ -109,12 +177,13 @@ tmpfs_hash_out(struct tdirent *t)
 	kmutex_t	*t_hmtx;
 
 	hash = t->td_hash;
-	prevpp = &t_hashtable[T_HASH_INDEX(hash)];
 	t_hmtx = &t_hashmutex[T_MUTEX_INDEX(hash)];
 	mutex_enter(t_hmtx);
+	prevpp = &t_hashtable[T_HASH_INDEX(hash)];
 	while (*prevpp != t)
 		prevpp = &(*prevpp)->td_link;
 	*prevpp = t->td_link;
+	atomic_dec_uint(&t_hashentries);
 	mutex_exit(t_hmtx);
 }
 
@@ -104,7 +104,7 @@ tmp_resv(
  * Only called if we're freeing at least pagesize bytes
  * because anon_unresv does a btopr(delta)
  */
-static void
+void
 tmp_unresv(
 	struct tmount *tm,
 	struct tmpnode *tp,
@@ -129,6 +129,8 @@ wrtmp(
 	long tn_size_changed = 0;
 	long old_tn_size;
 	long new_tn_size;
+	u_offset_t resv_end;	/* end of the reserved part of the file */
+	u_offset_t end;
 
 	vp = TNTOV(tp);
 	ASSERT(vp->v_type == VREG);
@@ -185,6 +187,8 @@ wrtmp(
 	if (limit > MAXOFF_T)
 		limit = MAXOFF_T;
 
+	resv_end = P2ROUNDUP_TYPED(tp->tn_size, PAGESIZE, u_offset_t);
+
 	do {
 		long	offset;
 		long	delta;
@@ -212,12 +216,25 @@ wrtmp(
 		 * We always reserve in pagesize increments so
 		 * unless we're extending the file into a new page,
 		 * we don't need to call tmp_resv.
+		 *
+		 * A write that extends the file by several pages
+		 * reserves for all of them, and grows the anon array
+		 * to match, on its first pass rather than a page at a
+		 * time; whatever it doesn't use is given back at the
+		 * end.  If there isn't room for all of it, we fall
+		 * back to reserving one page at a time so as to write
+		 * as much as fits.
 		 */
-		delta = offset + bytes -
-		    P2ROUNDUP_TYPED(tp->tn_size, PAGESIZE, u_offset_t);
+		delta = offset + bytes - resv_end;
 		if (delta > 0) {
 			pagecreate = 1;
-			if (tmp_resv(tm, tp, delta, pagecreate)) {
+			end = P2ROUNDUP_TYPED(MIN(offset + uio->uio_resid,
+			    limit), PAGESIZE, u_offset_t);
+			if (end - resv_end > PAGESIZE &&
+			    tmp_resv(tm, tp, end - resv_end, pagecreate) == 0) {
+				tmpnode_growmap(tp, (ulong_t)end);
+				resv_end = end;
+			} else if (tmp_resv(tm, tp, delta, pagecreate)) {
 				/*
 				 * Log file system full in the zone that owns
 				 * the tmpfs mount, as well as in the global
@@ -240,8 +257,11 @@ wrtmp(
 				}
 				error = ENOSPC;
 				break;
+			} else {
+				tmpnode_growmap(tp, (ulong_t)offset + bytes);
+				resv_end = P2ROUNDUP_TYPED(offset + bytes,
+				    PAGESIZE, u_offset_t);
 			}
-			tmpnode_growmap(tp, (ulong_t)offset + bytes);
 		}
 		/* grow the file to the new length */
 		if (offset + bytes > tp->tn_size) {
@@ -402,6 +422,11 @@ wrtmp(
 				 */
 				(void) tmpnode_trunc(tm, tp,
 				    (ulong_t)old_tn_size);
+				/* That gave back the pages it took off. */
+				resv_end -= P2ROUNDUP_TYPED(new_tn_size,
+				    PAGESIZE, u_offset_t) -
+				    P2ROUNDUP_TYPED(old_tn_size, PAGESIZE,
+				    u_offset_t);
 			}
 		} else {
 			/*
@@ -428,6 +453,13 @@ wrtmp(
 	} while (error == 0 && uio->uio_resid > 0 && bytes != 0);
 
 out:
+	/*
+	 * Give back whatever was reserved beyond the new end of file.
+	 */
+	end = P2ROUNDUP_TYPED(tp->tn_size, PAGESIZE, u_offset_t);
+	if (resv_end > end)
+		tmp_unresv(tm, tp, (size_t)(resv_end - end));
+
 	/*
 	 * If we've already done a partial-write, terminate
 	 * the write but return no error.
@@ -1661,7 +1693,7 @@ top:
 	 * there's little to do -- just drop our hold.
 	 */
 	if (vp->v_count > 1 || tp->tn_nlink != 0) {
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		mutex_exit(&tp->tn_tlock);
 		rw_exit(&tp->tn_rwlock);
@@ -476,7 +476,7 @@ error_ret:
 		 * It remains in the cache. Put it back on the freelist.
 		 */
 		mutex_enter(&vp->v_lock);
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		ip->i_icb_lbano = 0;
 
@@ -962,7 +962,7 @@ ud_iinactive(struct ud_inode *ip, struct cred *cr)
 		return;
 	}
 	if ((vp->v_count > 1) || ((ip->i_flag & IREF) == 0)) {
-		vp->v_count--;		/* release our hold from vn_rele */
+		VN_RELE_LOCKED(vp);	/* release our hold from vn_rele */
 		mutex_exit(&vp->v_lock);
 		rw_exit(&ip->i_contents);
 		return;
@@ -1029,7 +1029,7 @@ ud_iinactive(struct ud_inode *ip, struct cred *cr)
 			 */
 			mutex_enter(&vp->v_lock);
 			if (vp->v_count > 1) {
-				vp->v_count--;
+				VN_RELE_LOCKED(vp);
 				mutex_exit(&vp->v_lock);
 				rw_exit(&ip->i_contents);
 				return;
@@ -1064,7 +1064,7 @@ tryagain:
 	if (vn_has_cached_data(vp)) {
 		mutex_exit(&ud_nino_lock);
 		mutex_enter(&vp->v_lock);
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		mutex_enter(&ip->i_tlock);
 		mutex_enter(&udf_ifree_lock);
@@ -1084,7 +1084,7 @@ tryagain:
 		if (vn_has_cached_data(vp)) {
 			cmn_err(CE_WARN, "ud_iinactive: v_pages not NULL\n");
 		}
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 
 	mutex_enter(&ip->i_tlock);
@@ -2037,11 +2037,11 @@ ud_idrop(struct ud_inode *ip)
 
 	mutex_enter(&vp->v_lock);
 	if (vp->v_count > 1) {
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		return;
 	}
-	vp->v_count = 0;
+	VN_RELE_LOCKED(vp);
 	mutex_exit(&vp->v_lock);
 
 
@@ -139,7 +139,12 @@ struct logstats logstats = {
 	{ "log_writes",			KSTAT_DATA_UINT64 },
 	{ "log_master_reads",		KSTAT_DATA_UINT64 },
 	{ "log_roll_reads",		KSTAT_DATA_UINT64 },
-	{ "log_roll_writes",		KSTAT_DATA_UINT64 }
+	{ "log_roll_writes",		KSTAT_DATA_UINT64 },
+	{ "sync_commits",		KSTAT_DATA_UINT64 },
+	{ "sync_ops",			KSTAT_DATA_UINT64 },
+	{ "sync_commit_delays",		KSTAT_DATA_UINT64 },
+	{ "commit_wait_ns",		KSTAT_DATA_UINT64 },
+	{ "commit_write_ns",		KSTAT_DATA_UINT64 }
 };
 
 int
@@ -47,6 +47,13 @@
 
 uint_t topkey; /* tsd transaction key */
 
+/*
+ * Group commit window, in microseconds.  When the last commit carried
+ * more than one sync op, the sync op that would commit the transaction
+ * waits this long for others to join it first.  Zero disables this.
+ */
+uint_t top_commit_delay = 500;
+
 /*
  * declare a delta
  */
@@ -178,13 +185,29 @@ top_issue_sync(void *arg)
  */
 
 /*ARGSUSED*/
+/*
+ * Wait for the commit in progress, or the next one, to complete.
+ * Called, and returns, with mtm_lock held.
+ */
+static void
+top_wait_commit(mt_map_t *mtm)
+{
+	ushort_t	seq = mtm->mtm_seq;
+	hrtime_t	start = gethrtime();
+
+	do {
+		cv_wait(&mtm->mtm_cv_commit, &mtm->mtm_lock);
+	} while (seq == mtm->mtm_seq);
+
+	logstats.ls_commitwait.value.ui64 += gethrtime() - start;
+}
+
 void
 top_begin_sync(ufsvfs_t *ufsvfsp, top_t topid, ulong_t size, int *error)
 {
 	ml_unit_t	*ul	= ufsvfsp->vfs_log;
 	mt_map_t	*mtm = ul->un_logmap;
 	threadtrans_t	*tp;
-	ushort_t	seq;
 
 	ASSERT(ufsvfsp->vfs_dev == ul->un_dev);
 	ASSERT(error != NULL);
@@ -218,10 +241,8 @@ top_begin_sync(ufsvfs_t *ufsvfsp, top_t topid, ulong_t size, int *error)
 		 */
 		if (((mtm->mtm_closed & (TOP_SYNC | TOP_ASYNC)) ==
 		    (TOP_SYNC | TOP_ASYNC)) || mtm->mtm_activesync) {
-			seq = mtm->mtm_seq;
-			do {
-				cv_wait(&mtm->mtm_cv_commit, &mtm->mtm_lock);
-			} while (seq == mtm->mtm_seq);
+			mtm->mtm_syncops++;
+			top_wait_commit(mtm);
 			mutex_exit(&mtm->mtm_lock);
 			*error = 1;
 			return;
@@ -237,10 +258,7 @@ top_begin_sync(ufsvfs_t *ufsvfsp, top_t topid, ulong_t size, int *error)
 			 * for the quick nfs check and if that fails
 			 * go on to start a transaction
 			 */
-			seq = mtm->mtm_seq;
-			do {
-				cv_wait(&mtm->mtm_cv_commit, &mtm->mtm_lock);
-			} while (seq == mtm->mtm_seq);
+			top_wait_commit(mtm);
 
 			/* tp is set above if T_DONTPEND */
 			if ((curthread->t_flag & T_DONTPEND) && tp &&
@@ -268,10 +286,7 @@ retry:
 		if ((size == TOP_COMMIT_SIZE) &&
 		    (((mtm->mtm_closed & (TOP_SYNC | TOP_ASYNC)) ==
 		    (TOP_SYNC | TOP_ASYNC)) || (mtm->mtm_activesync))) {
-			seq = mtm->mtm_seq;
-			do {
-				cv_wait(&mtm->mtm_cv_commit, &mtm->mtm_lock);
-			} while (seq == mtm->mtm_seq);
+			top_wait_commit(mtm);
 			mutex_exit(&mtm->mtm_lock);
 			*error = 1;
 			return;
@@ -299,10 +314,7 @@ retry:
 		 * has really occurred. We couldn't use mtm_tid
 		 * because on error that doesn't get incremented.
 		 */
-		seq = mtm->mtm_seq;
-		do {
-			cv_wait(&mtm->mtm_cv_commit, &mtm->mtm_lock);
-		} while (seq == mtm->mtm_seq);
+		top_wait_commit(mtm);
 	} else {
 		/*
 		 * if the current transaction is full; try the next one
@@ -446,16 +458,35 @@ top_end_sync(ufsvfs_t *ufsvfsp, int *ep, top_t topid, ulong_t size)
 	mt_map_t	*mtm	= ul->un_logmap;
 	mapentry_t	*cancellist;
 	uint32_t	tid;
+	hrtime_t	start;
 
 	ASSERT(ufsvfsp->vfs_dev == ul->un_dev);
 	ASSERT(((ul->un_debug & MT_TRANSACT) == 0) ||
 	    top_end_debug(ul, mtm, topid, size));
 
 	mutex_enter(&mtm->mtm_lock);
+
+	/*
+	 * Group commit: if we are the last syncop and the last commit
+	 * was shared, give other syncops a moment to join this
+	 * transaction before closing it.  Staying counted in
+	 * mtm_activesync meanwhile makes fsyncs wait for our commit
+	 * rather than start one of their own.
+	 */
+	if ((mtm->mtm_activesync == 1) && (mtm->mtm_lastsyncops > 1) &&
+	    (mtm->mtm_closed == 0) && (top_commit_delay != 0) && !panicstr) {
+		hrtime_t	delay = USEC2NSEC(top_commit_delay);
+
+		logstats.ls_syncdelays.value.ui64++;
+		(void) cv_timedwait_hires(&mtm->mtm_cv_eot, &mtm->mtm_lock,
+		    delay, delay, 0);
+	}
+
 	tid = mtm->mtm_tid;
 
 	mtm->mtm_activesync--;
 	mtm->mtm_active--;
+	mtm->mtm_syncops++;
 
 	mtm->mtm_ref = 1;
 
@@ -463,13 +494,8 @@ top_end_sync(ufsvfs_t *ufsvfsp, int *ep, top_t topid, ulong_t size)
 	 * wait for last syncop to complete
 	 */
 	if (mtm->mtm_activesync || panicstr) {
-		ushort_t seq = mtm->mtm_seq;
-
 		mtm->mtm_closed = TOP_SYNC;
-
-		do {
-			cv_wait(&mtm->mtm_cv_commit, &mtm->mtm_lock);
-		} while (seq == mtm->mtm_seq);
+		top_wait_commit(mtm);
 		mutex_exit(&mtm->mtm_lock);
 		goto out;
 	}
@@ -477,6 +503,10 @@ top_end_sync(ufsvfs_t *ufsvfsp, int *ep, top_t topid, ulong_t size)
 	 * last syncop; close current transaction to all ops
 	 */
 	mtm->mtm_closed = TOP_SYNC|TOP_ASYNC;
+	mtm->mtm_lastsyncops = mtm->mtm_syncops;
+	mtm->mtm_syncops = 0;
+	logstats.ls_synccommits.value.ui64++;
+	logstats.ls_syncops.value.ui64 += mtm->mtm_lastsyncops;
 
 	/*
 	 * wait for last asyncop to finish
@@ -521,12 +551,14 @@ top_end_sync(ufsvfs_t *ufsvfsp, int *ep, top_t topid, ulong_t size)
 	/*
 	 * asynchronously write the commit record,
 	 */
+	start = gethrtime();
 	logmap_commit(ul, tid);
 
 	/*
 	 * wait for outstanding log writes (e.g., commits) to finish
 	 */
 	ldl_waito(ul);
+	logstats.ls_commitwrite.value.ui64 += gethrtime() - start;
 
 	/*
 	 * Now that we are sure the commit has been written to the log
@@ -701,7 +701,7 @@ ufs_iinactive(struct inode *ip)
 	mutex_enter(&vp->v_lock);
 
 	if (vp->v_count > 1) {
-		vp->v_count--;  /* release our hold from vn_rele */
+		VN_RELE_LOCKED(vp);  /* release our hold from vn_rele */
 		mutex_exit(&vp->v_lock);
 		rw_exit(&ip->i_contents);
 		return;
@@ -744,7 +744,7 @@ ufs_iinactive(struct inode *ip)
 		 */
 		if (ULOCKFS_IS_NOIDEL(ITOUL(ip))) {
 			mutex_enter(&vp->v_lock);
-			vp->v_count--;
+			VN_RELE_LOCKED(vp);
 			mutex_exit(&vp->v_lock);
 			rw_exit(&ip->i_contents);
 			return;
@@ -785,7 +785,7 @@ ufs_iinactive(struct inode *ip)
 		 */
 		mutex_enter(&vp->v_lock);
 		if (vp->v_count > 1) {
-			vp->v_count--;  /* release our hold from vn_rele */
+			VN_RELE_LOCKED(vp);  /* release our hold from vn_rele */
 			mutex_exit(&vp->v_lock);
 			rw_exit(&ip->i_contents);
 			return;
@@ -679,7 +679,7 @@ ufs_idle_free(struct inode *ip)
 	/*
 	 * It must be guaranteed that v_count >= 2, otherwise
 	 * something must be wrong with this vnode already.
-	 * That is why we use v_count-- instead of VN_RELE().
+	 * That is why we use VN_RELE_LOCKED() instead of VN_RELE().
 	 * Acquire the vnode lock in case another thread is in
 	 * VN_RELE().
 	 */
@@ -689,7 +689,7 @@ ufs_idle_free(struct inode *ip)
 		cmn_err(CE_PANIC,
 		    "ufs_idle_free: vnode ref count is less than 2");
 
-	vp->v_count--;
+	VN_RELE_LOCKED(vp);
 
 	vn_has_data = (vp->v_type != VCHR && vn_has_cached_data(vp));
 	vn_modified = (ip->i_flag & (IMOD|IMODACC|IACC|ICHG|IUPD|IATTCHG));
@@ -533,6 +533,9 @@ create_vopstats_template()
 	kstat_named_init(&vsp->nreqzcbuf, "nreqzcbuf", KSTAT_DATA_UINT64);
 	/* VOP_RETZCBUF */
 	kstat_named_init(&vsp->nretzcbuf, "nretzcbuf", KSTAT_DATA_UINT64);
+	/* dnlc_lookup() */
+	kstat_named_init(&vsp->ndnlchit, "ndnlchit", KSTAT_DATA_UINT64);
+	kstat_named_init(&vsp->ndnlcmiss, "ndnlcmiss", KSTAT_DATA_UINT64);
 
 	return (vsp);
 }
@@ -815,6 +818,24 @@ done:
 	return (error);
 }
 
+/*
+ * Drop a hold on vp without v_lock, unless it may be the last one.
+ * Returns B_FALSE, with v_count untouched, in that case.
+ */
+static boolean_t
+vn_rele_notlast(vnode_t *vp)
+{
+	uint_t count, prev;
+
+	for (count = vp->v_count; count > 1; count = prev) {
+		prev = atomic_cas_uint(&vp->v_count, count, count - 1);
+		if (prev == count)
+			return (B_TRUE);
+	}
+	VERIFY(count > 0);
+	return (B_FALSE);
+}
+
 /*
  * Release a vnode.  Call VOP_INACTIVE on last reference or
  * decrement reference count.
@@ -825,18 +846,22 @@ done:
  * VOP_INACTIVE routine has a chance to destroy the vnode.
  * We can't have more than 1 thread calling VOP_INACTIVE
  * on a vnode.
+ *
+ * Only the last reference takes v_lock; see VN_HOLD().
  */
 void
 vn_rele(vnode_t *vp)
 {
-	VERIFY(vp->v_count > 0);
+	if (vn_rele_notlast(vp))
+		return;
+
 	mutex_enter(&vp->v_lock);
 	if (vp->v_count == 1) {
 		mutex_exit(&vp->v_lock);
 		VOP_INACTIVE(vp, CRED(), NULL);
 		return;
 	}
-	vp->v_count--;
+	VN_RELE_LOCKED(vp);
 	mutex_exit(&vp->v_lock);
 }
 
@@ -857,7 +882,7 @@ vn_rele_dnlc(vnode_t *vp)
 			VOP_INACTIVE(vp, CRED(), NULL);
 			return;
 		}
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 	}
 	mutex_exit(&vp->v_lock);
 }
@@ -880,7 +905,7 @@ vn_rele_stream(vnode_t *vp)
 		VOP_INACTIVE(vp, CRED(), NULL);
 		return;
 	}
-	vp->v_count--;
+	VN_RELE_LOCKED(vp);
 	mutex_exit(&vp->v_lock);
 }
 
@@ -903,7 +928,9 @@ vn_rele_inactive(vnode_t *vp)
 void
 vn_rele_async(vnode_t *vp, taskq_t *taskq)
 {
-	VERIFY(vp->v_count > 0);
+	if (vn_rele_notlast(vp))
+		return;
+
 	mutex_enter(&vp->v_lock);
 	if (vp->v_count == 1) {
 		mutex_exit(&vp->v_lock);
@@ -911,7 +938,7 @@ vn_rele_async(vnode_t *vp, taskq_t *taskq)
 		    vp, TQ_SLEEP) != NULL);
 		return;
 	}
-	vp->v_count--;
+	VN_RELE_LOCKED(vp);
 	mutex_exit(&vp->v_lock);
 }
 
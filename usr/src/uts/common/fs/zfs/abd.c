@@ -0,0 +1,521 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright (c) 2014 by Delphix. All rights reserved.
+ */
+
+/*
+ * ARC buffer data (ABD).
+ *
+ * ABDs are an abstract data structure for the ARC which can use two
+ * different ways of storing the underlying data:
+ *
+ * (a) Linear buffer.  In this case, all the data in the ABD is stored in
+ *     one contiguous buffer in memory (from a zio_[data_]buf_* kmem cache).
+ *
+ * (b) Scattered buffer.  In this case, the data in the ABD is split into
+ *     equal-sized chunks (from the abd_chunk_cache kmem_cache), with
+ *     pointers to the chunks recorded in an array at the end of the ABD
+ *     structure.
+ *
+ * Large blocks held in the ARC for a long time are the main source of
+ * kmem fragmentation: a 128K buffer pins a 128K slab even when only one of
+ * its neighbours is still live, and reaping the zio_buf_* caches rarely
+ * gives whole slabs back.  Because every chunk of a scattered ABD is the
+ * same size, one cache serves every block size, freed chunks are reused
+ * by any later allocation, and memory returned under pressure can go back
+ * to the system page by page.
+ *
+ * Consumers that need to look at the data as one buffer can borrow a
+ * linear copy with abd_borrow_buf_copy() and give it back with
+ * abd_return_buf() (or abd_return_buf_copy() if they changed it).  Code
+ * that can work a piece at a time, such as checksums, should use
+ * abd_iterate_func() instead, which avoids the copy altogether.
+ */
+
+#include <sys/abd.h>
+#include <sys/zio.h>
+#include <sys/zfs_context.h>
+
+typedef struct abd_stats {
+	kstat_named_t abdstat_struct_size;
+	kstat_named_t abdstat_scatter_cnt;
+	kstat_named_t abdstat_scatter_data_size;
+	kstat_named_t abdstat_scatter_chunk_waste;
+	kstat_named_t abdstat_linear_cnt;
+	kstat_named_t abdstat_linear_data_size;
+} abd_stats_t;
+
+static abd_stats_t abd_stats = {
+	/* Amount of memory occupied by all of the abd_t struct allocations */
+	{ "struct_size",			KSTAT_DATA_UINT64 },
+	/*
+	 * The number of scatter ABDs which are currently allocated, excluding
+	 * ABDs which don't own their data (for instance the ones which were
+	 * allocated through abd_get_from_buf()).
+	 */
+	{ "scatter_cnt",			KSTAT_DATA_UINT64 },
+	/* Amount of data stored in all scatter ABDs tracked by scatter_cnt */
+	{ "scatter_data_size",			KSTAT_DATA_UINT64 },
+	/*
+	 * The amount of space wasted at the end of the last chunk across all
+	 * scatter ABDs tracked by scatter_cnt.
+	 */
+	{ "scatter_chunk_waste",		KSTAT_DATA_UINT64 },
+	/*
+	 * The number of linear ABDs which are currently allocated, excluding
+	 * ABDs which don't own their data.
+	 */
+	{ "linear_cnt",				KSTAT_DATA_UINT64 },
+	/* Amount of data stored in all linear ABDs tracked by linear_cnt */
+	{ "linear_data_size",			KSTAT_DATA_UINT64 }
+};
+
+#define	ABDSTAT(stat)		(abd_stats.stat.value.ui64)
+#define	ABDSTAT_INCR(stat, val) \
+	atomic_add_64(&abd_stats.stat.value.ui64, (val))
+#define	ABDSTAT_BUMP(stat)	ABDSTAT_INCR(stat, 1)
+#define	ABDSTAT_BUMPDOWN(stat)	ABDSTAT_INCR(stat, -1)
+
+/*
+ * It is possible to make all future ABDs be linear by setting this to
+ * B_FALSE.  Existing scattered ABDs are unaffected.
+ */
+boolean_t zfs_abd_scatter_enabled = B_TRUE;
+
+/*
+ * The size of the chunks ABD allocates.  Because the sizes allocated from
+ * the kmem_cache can't change, this tunable can only be modified at boot.
+ */
+size_t zfs_abd_chunk_size = 4096;
+
+#ifdef _KERNEL
+extern vmem_t *zio_alloc_arena;
+#endif
+
+static kmem_cache_t *abd_chunk_cache;
+static kstat_t *abd_ksp;
+
+static void *
+abd_alloc_chunk(void)
+{
+	void *c = kmem_cache_alloc(abd_chunk_cache, KM_PUSHPAGE);
+	ASSERT3P(c, !=, NULL);
+	return (c);
+}
+
+static void
+abd_free_chunk(void *c)
+{
+	kmem_cache_free(abd_chunk_cache, c);
+}
+
+void
+abd_init(void)
+{
+	vmem_t *data_alloc_arena = NULL;
+
+#ifdef _KERNEL
+	data_alloc_arena = zio_alloc_arena;
+#endif
+
+	/*
+	 * Since ABD chunks do not appear in crash dumps, we pass KMC_NOTOUCH
+	 * so that no allocator metadata is stored with the buffers.
+	 */
+	abd_chunk_cache = kmem_cache_create("abd_chunk", zfs_abd_chunk_size, 0,
+	    NULL, NULL, NULL, NULL, data_alloc_arena, KMC_NOTOUCH);
+
+	abd_ksp = kstat_create("zfs", 0, "abdstats", "misc", KSTAT_TYPE_NAMED,
+	    sizeof (abd_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (abd_ksp != NULL) {
+		abd_ksp->ks_data = &abd_stats;
+		kstat_install(abd_ksp);
+	}
+}
+
+void
+abd_fini(void)
+{
+	if (abd_ksp != NULL) {
+		kstat_delete(abd_ksp);
+		abd_ksp = NULL;
+	}
+
+	kmem_cache_destroy(abd_chunk_cache);
+	abd_chunk_cache = NULL;
+}
+
+static size_t
+abd_chunkcnt_for_bytes(size_t size)
+{
+	return (P2ROUNDUP(size, zfs_abd_chunk_size) / zfs_abd_chunk_size);
+}
+
+static size_t
+abd_scatter_chunkcnt(abd_t *abd)
+{
+	ASSERT(!ABD_IS_LINEAR(abd));
+	return (abd_chunkcnt_for_bytes(abd->abd_size));
+}
+
+static size_t
+abd_scatter_struct_size(size_t chunkcnt)
+{
+	return (offsetof(abd_t, abd_u.abd_scatter.abd_chunks) +
+	    chunkcnt * sizeof (void *));
+}
+
+static void
+abd_verify(abd_t *abd)
+{
+	ASSERT3U(abd->abd_size, >, 0);
+	ASSERT3U(abd->abd_size, <=, SPA_MAXBLOCKSIZE);
+	ASSERT3U(abd->abd_flags, ==, abd->abd_flags & (ABD_FLAG_LINEAR |
+	    ABD_FLAG_OWNER | ABD_FLAG_META));
+	if (ABD_IS_LINEAR(abd)) {
+		ASSERT3P(abd->abd_u.abd_linear.abd_buf, !=, NULL);
+	} else {
+		ASSERT3U(abd->abd_u.abd_scatter.abd_chunk_size, ==,
+		    zfs_abd_chunk_size);
+		for (int i = 0; i < abd_scatter_chunkcnt(abd); i++) {
+			ASSERT3P(abd->abd_u.abd_scatter.abd_chunks[i], !=,
+			    NULL);
+		}
+	}
+}
+
+/*
+ * Allocate an ABD, along with its own underlying data buffers.  Use this if
+ * you don't care whether the ABD is linear or not.
+ */
+abd_t *
+abd_alloc(size_t size, boolean_t is_metadata)
+{
+	abd_t *abd;
+	size_t n, s;
+
+	if (!zfs_abd_scatter_enabled)
+		return (abd_alloc_linear(size, is_metadata));
+
+	VERIFY3U(size, <=, SPA_MAXBLOCKSIZE);
+
+	n = abd_chunkcnt_for_bytes(size);
+	s = abd_scatter_struct_size(n);
+	abd = kmem_alloc(s, KM_PUSHPAGE);
+
+	abd->abd_flags = ABD_FLAG_OWNER;
+	if (is_metadata)
+		abd->abd_flags |= ABD_FLAG_META;
+	abd->abd_size = size;
+	abd->abd_u.abd_scatter.abd_chunk_size = zfs_abd_chunk_size;
+
+	for (int i = 0; i < n; i++)
+		abd->abd_u.abd_scatter.abd_chunks[i] = abd_alloc_chunk();
+
+	ABDSTAT_BUMP(abdstat_scatter_cnt);
+	ABDSTAT_INCR(abdstat_struct_size, s);
+	ABDSTAT_INCR(abdstat_scatter_data_size, size);
+	ABDSTAT_INCR(abdstat_scatter_chunk_waste,
+	    n * zfs_abd_chunk_size - size);
+
+	return (abd);
+}
+
+static void
+abd_free_scatter(abd_t *abd)
+{
+	size_t n = abd_scatter_chunkcnt(abd);
+	size_t s = abd_scatter_struct_size(n);
+
+	for (int i = 0; i < n; i++)
+		abd_free_chunk(abd->abd_u.abd_scatter.abd_chunks[i]);
+
+	ABDSTAT_BUMPDOWN(abdstat_scatter_cnt);
+	ABDSTAT_INCR(abdstat_struct_size, -(int64_t)s);
+	ABDSTAT_INCR(abdstat_scatter_data_size, -(int64_t)abd->abd_size);
+	ABDSTAT_INCR(abdstat_scatter_chunk_waste,
+	    -(int64_t)(n * zfs_abd_chunk_size - abd->abd_size));
+
+	kmem_free(abd, s);
+}
+
+/*
+ * Allocate an ABD that must be linear, along with its own underlying data
+ * buffer.  Only use this when it would be very annoying to write your ABD
+ * consumer with a scattered ABD.
+ */
+abd_t *
+abd_alloc_linear(size_t size, boolean_t is_metadata)
+{
+	abd_t *abd = kmem_alloc(sizeof (abd_t), KM_PUSHPAGE);
+
+	VERIFY3U(size, <=, SPA_MAXBLOCKSIZE);
+
+	abd->abd_flags = ABD_FLAG_LINEAR | ABD_FLAG_OWNER;
+	abd->abd_size = size;
+	if (is_metadata) {
+		abd->abd_flags |= ABD_FLAG_META;
+		abd->abd_u.abd_linear.abd_buf = zio_buf_alloc(size);
+	} else {
+		abd->abd_u.abd_linear.abd_buf = zio_data_buf_alloc(size);
+	}
+
+	ABDSTAT_BUMP(abdstat_linear_cnt);
+	ABDSTAT_INCR(abdstat_struct_size, sizeof (abd_t));
+	ABDSTAT_INCR(abdstat_linear_data_size, size);
+
+	return (abd);
+}
+
+static void
+abd_free_linear(abd_t *abd)
+{
+	if (abd->abd_flags & ABD_FLAG_META) {
+		zio_buf_free(abd->abd_u.abd_linear.abd_buf, abd->abd_size);
+	} else {
+		zio_data_buf_free(abd->abd_u.abd_linear.abd_buf,
+		    abd->abd_size);
+	}
+
+	ABDSTAT_BUMPDOWN(abdstat_linear_cnt);
+	ABDSTAT_INCR(abdstat_struct_size, -(int64_t)sizeof (abd_t));
+	ABDSTAT_INCR(abdstat_linear_data_size, -(int64_t)abd->abd_size);
+
+	kmem_free(abd, sizeof (abd_t));
+}
+
+/*
+ * Free an ABD allocated from abd_alloc() or abd_alloc_linear().  Will not
+ * free the underlying data for an ABD from abd_get_from_buf(); use
+ * abd_put() for those instead.
+ */
+void
+abd_free(abd_t *abd)
+{
+	abd_verify(abd);
+	VERIFY(abd->abd_flags & ABD_FLAG_OWNER);
+
+	if (ABD_IS_LINEAR(abd))
+		abd_free_linear(abd);
+	else
+		abd_free_scatter(abd);
+}
+
+/*
+ * Allocate a linear ABD structure for buf.  The caller keeps ownership of
+ * buf and must release the ABD with abd_put() before freeing it.
+ */
+abd_t *
+abd_get_from_buf(void *buf, size_t size)
+{
+	abd_t *abd = kmem_alloc(sizeof (abd_t), KM_PUSHPAGE);
+
+	VERIFY3U(size, <=, SPA_MAXBLOCKSIZE);
+
+	abd->abd_flags = ABD_FLAG_LINEAR;
+	abd->abd_size = size;
+	abd->abd_u.abd_linear.abd_buf = buf;
+
+	ABDSTAT_INCR(abdstat_struct_size, sizeof (abd_t));
+
+	return (abd);
+}
+
+/*
+ * Release an ABD allocated by abd_get_from_buf().  The underlying buffer
+ * is not freed.
+ */
+void
+abd_put(abd_t *abd)
+{
+	abd_verify(abd);
+	VERIFY(!(abd->abd_flags & ABD_FLAG_OWNER));
+	ASSERT(ABD_IS_LINEAR(abd));
+
+	ABDSTAT_INCR(abdstat_struct_size, -(int64_t)sizeof (abd_t));
+
+	kmem_free(abd, sizeof (abd_t));
+}
+
+/*
+ * Get the raw buffer associated with a linear ABD.
+ */
+void *
+abd_to_buf(abd_t *abd)
+{
+	ASSERT(ABD_IS_LINEAR(abd));
+	abd_verify(abd);
+	return (abd->abd_u.abd_linear.abd_buf);
+}
+
+/*
+ * Borrow a raw buffer from an ABD without copying the contents of the ABD
+ * into the buffer.  If the ABD is scattered, this will allocate a raw
+ * buffer whose contents are undefined.  To copy over the existing data in
+ * the ABD, use abd_borrow_buf_copy() instead.
+ */
+void *
+abd_borrow_buf(abd_t *abd, size_t n)
+{
+	abd_verify(abd);
+	ASSERT3U(abd->abd_size, >=, n);
+
+	if (ABD_IS_LINEAR(abd))
+		return (abd_to_buf(abd));
+	if (abd->abd_flags & ABD_FLAG_META)
+		return (zio_buf_alloc(n));
+	return (zio_data_buf_alloc(n));
+}
+
+void *
+abd_borrow_buf_copy(abd_t *abd, size_t n)
+{
+	void *buf = abd_borrow_buf(abd, n);
+
+	if (!ABD_IS_LINEAR(abd))
+		abd_copy_to_buf(buf, abd, n);
+	return (buf);
+}
+
+/*
+ * Return a borrowed raw buffer to an ABD.  If the ABD is scattered, this
+ * will not change the contents of the ABD and will ASSERT that you didn't
+ * modify the buffer since it was borrowed.  If you want any changes you
+ * made to buf to be copied back to abd, use abd_return_buf_copy() instead.
+ */
+void
+abd_return_buf(abd_t *abd, void *buf, size_t n)
+{
+	abd_verify(abd);
+	ASSERT3U(abd->abd_size, >=, n);
+
+	if (ABD_IS_LINEAR(abd)) {
+		ASSERT3P(buf, ==, abd_to_buf(abd));
+	} else if (abd->abd_flags & ABD_FLAG_META) {
+		zio_buf_free(buf, n);
+	} else {
+		zio_data_buf_free(buf, n);
+	}
+}
+
+void
+abd_return_buf_copy(abd_t *abd, void *buf, size_t n)
+{
+	if (!ABD_IS_LINEAR(abd))
+		abd_copy_from_buf(abd, buf, n);
+	abd_return_buf(abd, buf, n);
+}
+
+/*
+ * Call func on each piece of [off, off + size) in abd, in order.  If func
+ * returns non-zero the iteration stops and that value is returned.
+ */
+int
+abd_iterate_func(abd_t *abd, size_t off, size_t size,
+    abd_iter_func_t *func, void *private)
+{
+	size_t csize, i, coff;
+	int ret = 0;
+
+	abd_verify(abd);
+	ASSERT3U(off + size, <=, abd->abd_size);
+
+	if (ABD_IS_LINEAR(abd)) {
+		if (size == 0)
+			return (0);
+		return (func((char *)abd->abd_u.abd_linear.abd_buf + off,
+		    size, private));
+	}
+
+	csize = abd->abd_u.abd_scatter.abd_chunk_size;
+	i = off / csize;
+	coff = off % csize;
+
+	while (size > 0 && ret == 0) {
+		size_t len = MIN(csize - coff, size);
+
+		ret = func((char *)abd->abd_u.abd_scatter.abd_chunks[i] + coff,
+		    len, private);
+
+		size -= len;
+		coff = 0;
+		i++;
+	}
+
+	return (ret);
+}
+
+static int
+abd_copy_to_buf_off_cb(void *buf, size_t size, void *private)
+{
+	void **bufp = private;
+
+	bcopy(buf, *bufp, size);
+	*bufp = (char *)*bufp + size;
+	return (0);
+}
+
+/*
+ * Copy abd to buf.  (off is the offset in abd.)
+ */
+void
+abd_copy_to_buf_off(void *buf, abd_t *abd, size_t off, size_t size)
+{
+	(void) abd_iterate_func(abd, off, size, abd_copy_to_buf_off_cb, &buf);
+}
+
+static int
+abd_copy_from_buf_off_cb(void *buf, size_t size, void *private)
+{
+	const void **bufp = private;
+
+	bcopy(*bufp, buf, size);
+	*bufp = (const char *)*bufp + size;
+	return (0);
+}
+
+/*
+ * Copy from buf to abd.  (off is the offset in abd.)
+ */
+void
+abd_copy_from_buf_off(abd_t *abd, const void *buf, size_t off, size_t size)
+{
+	(void) abd_iterate_func(abd, off, size, abd_copy_from_buf_off_cb,
+	    &buf);
+}
+
+/* ARGSUSED */
+static int
+abd_zero_off_cb(void *buf, size_t size, void *private)
+{
+	bzero(buf, size);
+	return (0);
+}
+
+/*
+ * Zero out [off, off + size) of abd.
+ */
+void
+abd_zero_off(abd_t *abd, size_t off, size_t size)
+{
+	(void) abd_iterate_func(abd, off, size, abd_zero_off_cb, NULL);
+}
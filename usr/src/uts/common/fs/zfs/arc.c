@@ -124,6 +124,7 @@
 #include <sys/zio.h>
 #include <sys/zio_compress.h>
 #include <sys/zfs_context.h>
+#include <sys/abd.h>
 #include <sys/arc.h>
 #include <sys/refcount.h>
 #include <sys/vdev.h>
@@ -196,11 +197,27 @@ static boolean_t arc_warm;
 uint64_t zfs_arc_max;
 uint64_t zfs_arc_min;
 uint64_t zfs_arc_meta_limit = 0;
+boolean_t zfs_arc_meta_adapt = B_TRUE;
 int zfs_arc_grow_retry = 0;
 int zfs_arc_shrink_shift = 0;
 int zfs_arc_p_min_shift = 0;
+
+/*
+ * Number of sublists per ARC state list, and of hash table locks per CPU.
+ * Both are rounded up to a power of two; zero sublists means as many as
+ * there are CPUs (but at least four).
+ */
+int zfs_arc_num_sublists = 0;
+int zfs_arc_hash_locks_per_cpu = 16;
+static int arc_sublist_cnt;
 int zfs_disable_dup_eviction = 0;
 
+/*
+ * Keep blocks that are compressed on disk in their compressed form in
+ * the ARC, and only decompress them when a consumer asks for the data.
+ */
+boolean_t zfs_compressed_arc_enabled = B_TRUE;
+
 /*
  * Note that buffers can be in one of 6 states:
  *	ARC_anon	- anonymous (discussed below)
@@ -231,13 +248,34 @@ int zfs_disable_dup_eviction = 0;
  * places.  The reason for the ARC_l2c_only state is to keep the
  * buffer header in the hash table, so that reads that hit the
  * second level ARC benefit from these fast lookups.
+ *
+ * A buffer read from a compressed block also keeps a copy of the block
+ * in its on-disk (compressed) form, b_pdata.  When the ARC evicts such
+ * a buffer it first drops just the uncompressed data, and parks the
+ * header on the clist of its ARC_mru/ARC_mfu state.  Only once
+ * eviction reaches that list is the compressed copy dropped as well and
+ * the header moved to a ghost state.  A hit on a header holding only
+ * compressed data decompresses into a fresh buffer for the caller.
+ *
+ * So that many CPUs can move buffers on and off the lists at once, the
+ * lists of each state are split into arc_sublist_cnt sublists, each with
+ * its own lock.  A header's sublist follows from its hash, so it is the
+ * same in every state and a header moving from a state to its ghost
+ * only ever needs the two sublists of one index.  Eviction walks the
+ * sublists in turn, starting from a different one on each call.
  */
 
+typedef struct arc_sublist {
+	kmutex_t asl_mtx;
+	list_t	asl_list[ARC_BUFC_NUMTYPES];	/* list of evictable buffers */
+	list_t	asl_clist[ARC_BUFC_NUMTYPES];	/* ... holding only b_pdata */
+} arc_sublist_t;
+
 typedef struct arc_state {
-	list_t	arcs_list[ARC_BUFC_NUMTYPES];	/* list of evictable buffers */
+	arc_sublist_t *arcs_sublists;	/* arc_sublist_cnt of them */
+	uint32_t arcs_evict_idx;	/* where the next eviction starts */
 	uint64_t arcs_lsize[ARC_BUFC_NUMTYPES];	/* amount of evictable data */
 	uint64_t arcs_size;	/* total amount of data in this state */
-	kmutex_t arcs_mtx;
 } arc_state_t;
 
 /* The 6 states: */
@@ -294,9 +332,19 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_hdr_size;
 	kstat_named_t arcstat_data_size;
 	kstat_named_t arcstat_other_size;
+	kstat_named_t arcstat_compressed_size;
+	kstat_named_t arcstat_uncompressed_size;
+	kstat_named_t arcstat_decompress_hits;
 	kstat_named_t arcstat_l2_hits;
 	kstat_named_t arcstat_l2_misses;
 	kstat_named_t arcstat_l2_feeds;
+	/*
+	 * Bytes of L2ARC-eligible data the ARC evicted which the feed
+	 * thread did not keep up with, and the write bandwidth last
+	 * measured on a cache device (bytes/sec).
+	 */
+	kstat_named_t arcstat_l2_feed_deficit;
+	kstat_named_t arcstat_l2_feed_bw;
 	kstat_named_t arcstat_l2_rw_clash;
 	kstat_named_t arcstat_l2_read_bytes;
 	kstat_named_t arcstat_l2_write_bytes;
@@ -316,6 +364,17 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_l2_compress_successes;
 	kstat_named_t arcstat_l2_compress_zeros;
 	kstat_named_t arcstat_l2_compress_failures;
+	kstat_named_t arcstat_l2_log_blk_writes;
+	kstat_named_t arcstat_l2_rebuild_successes;
+	kstat_named_t arcstat_l2_rebuild_unsupported;
+	kstat_named_t arcstat_l2_rebuild_io_errors;
+	kstat_named_t arcstat_l2_rebuild_cksum_errors;
+	kstat_named_t arcstat_l2_rebuild_loop_errors;
+	kstat_named_t arcstat_l2_rebuild_abort_lowmem;
+	kstat_named_t arcstat_l2_rebuild_log_blks;
+	kstat_named_t arcstat_l2_rebuild_bufs;
+	kstat_named_t arcstat_l2_rebuild_bufs_precached;
+	kstat_named_t arcstat_l2_rebuild_size;
 	kstat_named_t arcstat_memory_throttle_count;
 	kstat_named_t arcstat_duplicate_buffers;
 	kstat_named_t arcstat_duplicate_buffers_size;
@@ -323,6 +382,7 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_meta_used;
 	kstat_named_t arcstat_meta_limit;
 	kstat_named_t arcstat_meta_max;
+	kstat_named_t arcstat_meta_p;
 } arc_stats_t;
 
 static arc_stats_t arc_stats = {
@@ -360,9 +420,14 @@ static arc_stats_t arc_stats = {
 	{ "hdr_size",			KSTAT_DATA_UINT64 },
 	{ "data_size",			KSTAT_DATA_UINT64 },
 	{ "other_size",			KSTAT_DATA_UINT64 },
+	{ "compressed_size",		KSTAT_DATA_UINT64 },
+	{ "uncompressed_size",		KSTAT_DATA_UINT64 },
+	{ "decompress_hits",		KSTAT_DATA_UINT64 },
 	{ "l2_hits",			KSTAT_DATA_UINT64 },
 	{ "l2_misses",			KSTAT_DATA_UINT64 },
 	{ "l2_feeds",			KSTAT_DATA_UINT64 },
+	{ "l2_feed_deficit",		KSTAT_DATA_UINT64 },
+	{ "l2_feed_bw",			KSTAT_DATA_UINT64 },
 	{ "l2_rw_clash",		KSTAT_DATA_UINT64 },
 	{ "l2_read_bytes",		KSTAT_DATA_UINT64 },
 	{ "l2_write_bytes",		KSTAT_DATA_UINT64 },
@@ -382,13 +447,25 @@ static arc_stats_t arc_stats = {
 	{ "l2_compress_successes",	KSTAT_DATA_UINT64 },
 	{ "l2_compress_zeros",		KSTAT_DATA_UINT64 },
 	{ "l2_compress_failures",	KSTAT_DATA_UINT64 },
+	{ "l2_log_blk_writes",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_successes",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_unsupported",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_io_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_cksum_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_loop_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_abort_lowmem",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_log_blks",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs_precached",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_size",		KSTAT_DATA_UINT64 },
 	{ "memory_throttle_count",	KSTAT_DATA_UINT64 },
 	{ "duplicate_buffers",		KSTAT_DATA_UINT64 },
 	{ "duplicate_buffers_size",	KSTAT_DATA_UINT64 },
 	{ "duplicate_reads",		KSTAT_DATA_UINT64 },
 	{ "arc_meta_used",		KSTAT_DATA_UINT64 },
 	{ "arc_meta_limit",		KSTAT_DATA_UINT64 },
-	{ "arc_meta_max",		KSTAT_DATA_UINT64 }
+	{ "arc_meta_max",		KSTAT_DATA_UINT64 },
+	{ "arc_meta_p",			KSTAT_DATA_UINT64 }
 };
 
 #define	ARCSTAT(stat)	(arc_stats.stat.value.ui64)
@@ -453,14 +530,74 @@ static arc_state_t	*arc_l2c_only;
 #define	arc_meta_limit	ARCSTAT(arcstat_meta_limit) /* max size for metadata */
 #define	arc_meta_used	ARCSTAT(arcstat_meta_used) /* size of metadata */
 #define	arc_meta_max	ARCSTAT(arcstat_meta_max) /* max size of metadata */
+#define	arc_meta_p	ARCSTAT(arcstat_meta_p)	/* target size of metadata */
 
 #define	L2ARC_IS_VALID_COMPRESS(_c_) \
-	((_c_) == ZIO_COMPRESS_LZ4 || (_c_) == ZIO_COMPRESS_EMPTY)
+	((_c_) > ZIO_COMPRESS_OFF && (_c_) < ZIO_COMPRESS_FUNCTIONS)
 
 static int		arc_no_grow;	/* Don't try to grow cache size */
 static uint64_t		arc_tempreserve;
 static uint64_t		arc_loaned_bytes;
 
+/*
+ * Per-objset ARC accounting.
+ *
+ * Every open objset registers an arc_objset_t, keyed by the pool's load
+ * guid and the objset id.  Headers read or written on behalf of the
+ * objset point at it (b_aos, set once and then left alone), and it counts
+ * the bytes those headers hold in ARC_mru and ARC_mfu; it is charged
+ * wherever the state sizes are.  Usage is exported per objset as the
+ * <pool>:0:arc-objset-0x<id> kstat.
+ *
+ * An objset may also be given a limit (the primarycache_limit property).
+ * While an objset is over its limit, arc_evict() takes its buffers before
+ * anybody else's, and the reclaim thread trims it back down to the limit
+ * even when the ARC as a whole is not under pressure.
+ *
+ * The kstat also reports, for writes issued through the ARC, how many blocks
+ * compression gave up on early (see zio_compress_data()) and an estimate of
+ * the compression time that saved.
+ */
+typedef struct arc_objset_stats {
+	kstat_named_t aosstat_size;
+	kstat_named_t aosstat_data_size;
+	kstat_named_t aosstat_metadata_size;
+	kstat_named_t aosstat_limit;
+	kstat_named_t aosstat_evict_limit;
+	kstat_named_t aosstat_compress_early_abort;
+	kstat_named_t aosstat_compress_saved;
+} arc_objset_stats_t;
+
+static arc_objset_stats_t arc_objset_stats_template = {
+	{ "size",			KSTAT_DATA_UINT64 },
+	{ "data_size",			KSTAT_DATA_UINT64 },
+	{ "metadata_size",		KSTAT_DATA_UINT64 },
+	{ "limit",			KSTAT_DATA_UINT64 },
+	{ "evict_limit",		KSTAT_DATA_UINT64 },
+	{ "compress_early_abort",	KSTAT_DATA_UINT64 },
+	{ "compress_saved_ns",		KSTAT_DATA_UINT64 }
+};
+
+struct arc_objset {
+	avl_node_t		aos_node;	/* in arc_objset_tree */
+	uint64_t		aos_spa;	/* spa load guid */
+	uint64_t		aos_objset;	/* objset id */
+	uint64_t		aos_nreg;	/* registrations, under lock */
+	uint64_t		aos_refcnt;	/* registered + 1 per hdr */
+	kstat_t			*aos_ksp;
+	arc_objset_stats_t	aos_stats;
+};
+
+#define	AOSSTAT(aos, stat)	((aos)->aos_stats.stat.value.ui64)
+
+#define	AOS_OVER_LIMIT(aos)	((aos) != NULL &&			\
+	AOSSTAT(aos, aosstat_limit) != 0 &&				\
+	AOSSTAT(aos, aosstat_size) > AOSSTAT(aos, aosstat_limit))
+
+static avl_tree_t	arc_objset_tree;
+static krwlock_t	arc_objset_lock;	/* protects arc_objset_tree */
+static uint64_t		arc_objset_nlimits;	/* # of objsets with a limit */
+
 typedef struct l2arc_buf_hdr l2arc_buf_hdr_t;
 
 typedef struct arc_callback arc_callback_t;
@@ -498,6 +635,10 @@ struct arc_buf_hdr {
 	uint32_t		b_flags;
 	uint32_t		b_datacnt;
 
+	abd_t			*b_pdata;	/* on-disk form, if kept */
+	uint64_t		b_psize;
+	enum zio_compress	b_pcompress;
+
 	arc_callback_t		*b_acb;
 	kcondvar_t		b_cv;
 
@@ -516,6 +657,9 @@ struct arc_buf_hdr {
 	/* self protecting */
 	refcount_t		b_refcnt;
 
+	/* set once, under the hash lock or before hashing */
+	arc_objset_t		*b_aos;
+
 	l2arc_buf_hdr_t		*b_l2hdr;
 	list_node_t		b_l2node;
 };
@@ -524,6 +668,7 @@ static arc_buf_t *arc_eviction_list;
 static kmutex_t arc_eviction_mtx;
 static arc_buf_hdr_t arc_eviction_hdr;
 static void arc_get_data_buf(arc_buf_t *buf);
+static kmem_cbrc_t arc_hdr_move(void *, void *, size_t, void *);
 static void arc_access(arc_buf_hdr_t *buf, kmutex_t *hash_lock);
 static int arc_evict_needed(arc_buf_contents_t type);
 static void arc_evict_ghost(arc_state_t *state, uint64_t spa, int64_t bytes);
@@ -588,18 +733,20 @@ struct ht_lock {
 #endif
 };
 
-#define	BUF_LOCKS 256
+#define	BUF_LOCKS_MIN 256
 typedef struct buf_hash_table {
 	uint64_t ht_mask;
 	arc_buf_hdr_t **ht_table;
-	struct ht_lock ht_locks[BUF_LOCKS];
+	uint64_t ht_lock_mask;
+	struct ht_lock *ht_locks;
 } buf_hash_table_t;
 
 static buf_hash_table_t buf_hash_table;
 
 #define	BUF_HASH_INDEX(spa, dva, birth) \
 	(buf_hash(spa, dva, birth) & buf_hash_table.ht_mask)
-#define	BUF_HASH_LOCK_NTRY(idx) (buf_hash_table.ht_locks[idx & (BUF_LOCKS-1)])
+#define	BUF_HASH_LOCK_NTRY(idx) \
+	(buf_hash_table.ht_locks[(idx) & buf_hash_table.ht_lock_mask])
 #define	BUF_HASH_LOCK(idx)	(&(BUF_HASH_LOCK_NTRY(idx).ht_lock))
 #define	HDR_LOCK(hdr) \
 	(BUF_HASH_LOCK(BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
@@ -619,6 +766,8 @@ uint64_t zfs_crc64_table[256];
 #define	L2ARC_HEADROOM_BOOST	200
 #define	L2ARC_FEED_SECS		1		/* caching interval secs */
 #define	L2ARC_FEED_MIN_MS	200		/* min caching interval ms */
+#define	L2ARC_WRITE_BW_PCT	50		/* % of device bandwidth */
+#define	L2ARC_BW_MIN_SAMPLE	(1024 * 1024)	/* min write to measure */
 
 #define	l2arc_writes_sent	ARCSTAT(arcstat_l2_writes_sent)
 #define	l2arc_writes_done	ARCSTAT(arcstat_l2_writes_done)
@@ -632,7 +781,100 @@ uint64_t l2arc_feed_secs = L2ARC_FEED_SECS;	/* interval seconds */
 uint64_t l2arc_feed_min_ms = L2ARC_FEED_MIN_MS;	/* min interval milliseconds */
 boolean_t l2arc_noprefetch = B_TRUE;		/* don't cache prefetch bufs */
 boolean_t l2arc_feed_again = B_TRUE;		/* turbo warmup */
+boolean_t l2arc_feed_adaptive = B_TRUE;		/* size writes to the device */
+uint64_t l2arc_write_bw_pct = L2ARC_WRITE_BW_PCT; /* adaptive write share */
 boolean_t l2arc_norw = B_TRUE;			/* no reads during writes */
+boolean_t l2arc_rebuild_enabled = B_TRUE;	/* rebuild L2ARC on import */
+
+/*
+ * Persistent L2ARC on-device structures.  See the "Persistent L2ARC"
+ * block comment before l2arc_rebuild() for the theory of operation.
+ */
+#define	L2ARC_DEV_HDR_MAGIC	0x5a46534341434845LLU	/* ASCII: "ZFSCACHE" */
+#define	L2ARC_LOG_BLK_MAGIC	0x4c4f47424c4b4844LLU	/* ASCII: "LOGBLKHD" */
+#define	L2ARC_PERSIST_VERSION	1
+#define	L2ARC_LOG_BLK_SIZE	(128 * 1024)		/* 128k */
+#define	L2ARC_LOG_BLK_HEADER_LEN	128
+#define	L2ARC_LOG_BLK_ENTRIES	1023	/* (128k - 128) / 128 */
+
+/* dh_flags */
+#define	L2ARC_DEV_HDR_EVICT_FIRST	(1 << 0)	/* l2ad_first was set */
+
+/*
+ * Encoding of lbp_prop and le_prop.  Sizes are stored in units of
+ * SPA_MINBLOCKSIZE; the physical size carries no bias, since an L2ARC
+ * buffer may have been compressed down to nothing (ZIO_COMPRESS_EMPTY).
+ */
+#define	L2BLK_GET_LSIZE(field)	\
+	BF64_GET_SB((field), 0, 16, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_LSIZE(field, x)	\
+	BF64_SET_SB((field), 0, 16, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_PSIZE(field)	\
+	BF64_GET_SB((field), 16, 16, SPA_MINBLOCKSHIFT, 0)
+#define	L2BLK_SET_PSIZE(field, x)	\
+	BF64_SET_SB((field), 16, 16, SPA_MINBLOCKSHIFT, 0, x)
+#define	L2BLK_GET_COMPRESS(field)	BF64_GET((field), 32, 8)
+#define	L2BLK_SET_COMPRESS(field, x)	BF64_SET((field), 32, 8, x)
+#define	L2BLK_GET_CHECKSUM(field)	BF64_GET((field), 40, 8)
+#define	L2BLK_SET_CHECKSUM(field, x)	BF64_SET((field), 40, 8, x)
+#define	L2BLK_GET_TYPE(field)		BF64_GET((field), 48, 8)
+#define	L2BLK_SET_TYPE(field, x)	BF64_SET((field), 48, 8, x)
+#define	L2BLK_GET_L2COMPRESS(field)	BF64_GET((field), 56, 1)
+#define	L2BLK_SET_L2COMPRESS(field, x)	BF64_SET((field), 56, 1, x)
+
+/*
+ * Pointer to a log block on an L2ARC device.
+ */
+typedef struct l2arc_log_blkptr {
+	uint64_t	lbp_daddr;	/* device address of log block */
+	uint64_t	lbp_prop;	/* lsize, psize, compress, checksum */
+	zio_cksum_t	lbp_cksum;	/* checksum of physical log block */
+} l2arc_log_blkptr_t;
+
+/*
+ * The device header lives in the first block after the front vdev labels
+ * and is rewritten at the end of every feed pass which committed a log
+ * block.  It records where the write and eviction hands stood, so that
+ * on rebuild we know which parts of the device have been overwritten.
+ */
+typedef struct l2arc_dev_hdr_phys {
+	uint64_t	dh_magic;	/* L2ARC_DEV_HDR_MAGIC */
+	uint64_t	dh_version;	/* L2ARC_PERSIST_VERSION */
+	uint64_t	dh_spa_guid;	/* owning pool */
+	uint64_t	dh_vdev_guid;	/* this cache device */
+	uint64_t	dh_flags;	/* L2ARC_DEV_HDR_* */
+	uint64_t	dh_hand;	/* l2ad_hand at time of update */
+	uint64_t	dh_evict;	/* l2ad_evict at time of update */
+	l2arc_log_blkptr_t dh_start_lbp; /* most recently written log block */
+	uint64_t	dh_pad[47];	/* pad to 512 bytes */
+	zio_cksum_t	dh_self_cksum;	/* fletcher4 of the fields above */
+} l2arc_dev_hdr_phys_t;
+
+/*
+ * A single L2ARC buffer as described in a log block.  This is everything
+ * we need to reconstruct an arc_buf_hdr_t in the ARC_l2c_only state.
+ */
+typedef struct l2arc_log_ent_phys {
+	dva_t		le_dva;		/* dva of buffer */
+	uint64_t	le_birth;	/* birth txg of buffer */
+	uint64_t	le_cksum0;	/* b_cksum0 */
+	zio_cksum_t	le_freeze_cksum; /* b_freeze_cksum */
+	uint64_t	le_prop;	/* lsize, asize, compress, type */
+	uint64_t	le_daddr;	/* device address of buffer */
+	uint64_t	le_pad[6];	/* pad to 128 bytes */
+} l2arc_log_ent_phys_t;
+
+/*
+ * A log block: a backward-linked list of these, starting at the device
+ * header's dh_start_lbp, describes the contents of the whole device.
+ * Entries are stored in the order their buffers were written.
+ */
+typedef struct l2arc_log_blk_phys {
+	uint64_t	lb_magic;	/* L2ARC_LOG_BLK_MAGIC */
+	l2arc_log_blkptr_t lb_prev_lbp;	/* previously written log block */
+	uint64_t	lb_pad[9];	/* pad to L2ARC_LOG_BLK_HEADER_LEN */
+	l2arc_log_ent_phys_t lb_entries[L2ARC_LOG_BLK_ENTRIES];
+} l2arc_log_blk_phys_t;
 
 /*
  * L2ARC Internals
@@ -648,6 +890,14 @@ typedef struct l2arc_dev {
 	boolean_t		l2ad_writing;	/* currently writing */
 	list_t			*l2ad_buflist;	/* buffer list */
 	list_node_t		l2ad_node;	/* device list node */
+	l2arc_dev_hdr_phys_t	*l2ad_dev_hdr;	/* persistent device header */
+	uint64_t		l2ad_dev_hdr_asize; /* aligned hdr size */
+	l2arc_log_blk_phys_t	*l2ad_log_blk;	/* log block being filled */
+	int			l2ad_log_ent_idx; /* next entry in log block */
+	boolean_t		l2ad_rebuild;	/* rebuild pending or running */
+	boolean_t		l2ad_rebuild_began; /* rebuild thread started */
+	boolean_t		l2ad_rebuild_cancel; /* device being removed */
+	uint64_t		l2ad_write_bps;	/* measured write bandwidth */
 } l2arc_dev_t;
 
 static list_t L2ARC_dev_list;			/* device list */
@@ -684,6 +934,8 @@ struct l2arc_buf_hdr {
 	int			b_asize;
 	/* temporary buffer holder for in-flight compressed data */
 	void			*b_tmp_cdata;
+	/* b_tmp_cdata is a linear copy of the ARC's b_pdata */
+	boolean_t		b_tmp_cdata_copied;
 };
 
 typedef struct l2arc_data_free {
@@ -698,6 +950,9 @@ static kmutex_t l2arc_feed_thr_lock;
 static kcondvar_t l2arc_feed_thr_cv;
 static uint8_t l2arc_thread_exit;
 
+static kmutex_t l2arc_rebuild_thr_lock;
+static kcondvar_t l2arc_rebuild_thr_cv;
+
 static void l2arc_read_done(zio_t *zio);
 static void l2arc_hdr_stat_add(void);
 static void l2arc_hdr_stat_remove(void);
@@ -707,6 +962,11 @@ static void l2arc_decompress_zio(zio_t *zio, arc_buf_hdr_t *hdr,
     enum zio_compress c);
 static void l2arc_release_cdata_buf(arc_buf_hdr_t *ab);
 
+static uint64_t l2arc_log_blk_overhead(uint64_t write_sz);
+static boolean_t l2arc_log_blk_insert(l2arc_dev_t *dev, arc_buf_hdr_t *ab);
+static uint64_t l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio);
+static void l2arc_dev_hdr_update(l2arc_dev_t *dev, zio_t *pio);
+
 static uint64_t
 buf_hash(uint64_t spa, const dva_t *dva, uint64_t birth)
 {
@@ -844,8 +1104,10 @@ buf_fini(void)
 
 	kmem_free(buf_hash_table.ht_table,
 	    (buf_hash_table.ht_mask + 1) * sizeof (void *));
-	for (i = 0; i < BUF_LOCKS; i++)
+	for (i = 0; i <= buf_hash_table.ht_lock_mask; i++)
 		mutex_destroy(&buf_hash_table.ht_locks[i].ht_lock);
+	kmem_free(buf_hash_table.ht_locks,
+	    (buf_hash_table.ht_lock_mask + 1) * sizeof (struct ht_lock));
 	kmem_cache_destroy(hdr_cache);
 	kmem_cache_destroy(buf_cache);
 }
@@ -930,6 +1192,7 @@ buf_init(void)
 {
 	uint64_t *ct;
 	uint64_t hsize = 1ULL << 12;
+	uint64_t lsize;
 	int i, j;
 
 	/*
@@ -951,6 +1214,7 @@ retry:
 
 	hdr_cache = kmem_cache_create("arc_buf_hdr_t", sizeof (arc_buf_hdr_t),
 	    0, hdr_cons, hdr_dest, hdr_recl, NULL, NULL, 0);
+	kmem_cache_set_move(hdr_cache, arc_hdr_move);
 	buf_cache = kmem_cache_create("arc_buf_t", sizeof (arc_buf_t),
 	    0, buf_cons, buf_dest, NULL, NULL, NULL, 0);
 
@@ -958,7 +1222,20 @@ retry:
 		for (ct = zfs_crc64_table + i, *ct = i, j = 8; j > 0; j--)
 			*ct = (*ct >> 1) ^ (-(*ct & 1) & ZFS_CRC64_POLY);
 
-	for (i = 0; i < BUF_LOCKS; i++) {
+	/*
+	 * Size the lock array to the number of CPUs, so that lookups on
+	 * large machines don't all pile up on the same few locks.  There is
+	 * no point in having more locks than hash chains.
+	 */
+	lsize = MAX(BUF_LOCKS_MIN,
+	    (uint64_t)max_ncpus * MAX(zfs_arc_hash_locks_per_cpu, 1));
+	if (!ISP2(lsize))
+		lsize = 1ULL << highbit64(lsize);
+	lsize = MIN(lsize, hsize);
+	buf_hash_table.ht_lock_mask = lsize - 1;
+	buf_hash_table.ht_locks =
+	    kmem_zalloc(lsize * sizeof (struct ht_lock), KM_SLEEP);
+	for (i = 0; i < lsize; i++) {
 		mutex_init(&buf_hash_table.ht_locks[i].ht_lock,
 		    NULL, MUTEX_DEFAULT, NULL);
 	}
@@ -1107,6 +1384,414 @@ arc_buf_freeze(arc_buf_t *buf)
 
 }
 
+static int
+arc_objset_compare(const void *a, const void *b)
+{
+	const arc_objset_t *aos1 = a;
+	const arc_objset_t *aos2 = b;
+
+	if (aos1->aos_spa < aos2->aos_spa)
+		return (-1);
+	if (aos1->aos_spa > aos2->aos_spa)
+		return (1);
+	if (aos1->aos_objset < aos2->aos_objset)
+		return (-1);
+	if (aos1->aos_objset > aos2->aos_objset)
+		return (1);
+	return (0);
+}
+
+/*
+ * Find the registered arc_objset_t for an objset and take a reference on
+ * it for a header.  Returns NULL if the objset isn't open.
+ */
+static arc_objset_t *
+arc_objset_lookup(uint64_t spa, uint64_t objset)
+{
+	arc_objset_t search, *aos;
+
+	search.aos_spa = spa;
+	search.aos_objset = objset;
+
+	rw_enter(&arc_objset_lock, RW_READER);
+	aos = avl_find(&arc_objset_tree, &search, NULL);
+	if (aos != NULL)
+		atomic_inc_64(&aos->aos_refcnt);
+	rw_exit(&arc_objset_lock);
+
+	return (aos);
+}
+
+static void
+arc_objset_rele(arc_objset_t *aos)
+{
+	ASSERT3U(aos->aos_refcnt, >, 0);
+	if (atomic_dec_64_nv(&aos->aos_refcnt) == 0) {
+		ASSERT0(aos->aos_nreg);
+		ASSERT0(AOSSTAT(aos, aosstat_size));
+		kmem_free(aos, sizeof (arc_objset_t));
+	}
+}
+
+/*
+ * Charge (or credit, for negative delta) a header's objset when the amount
+ * of data it holds in state changes.  Only ARC_mru and ARC_mfu count.
+ */
+static void
+arc_objset_charge(arc_buf_hdr_t *ab, arc_state_t *state, int64_t delta)
+{
+	arc_objset_t *aos = ab->b_aos;
+	uint64_t size, limit;
+
+	if (aos == NULL || delta == 0 || (state != arc_mru && state != arc_mfu))
+		return;
+
+	size = atomic_add_64_nv(&AOSSTAT(aos, aosstat_size), delta);
+	if (ab->b_type == ARC_BUFC_METADATA)
+		atomic_add_64(&AOSSTAT(aos, aosstat_metadata_size), delta);
+	else
+		atomic_add_64(&AOSSTAT(aos, aosstat_data_size), delta);
+
+	/* let the reclaim thread know as soon as this objset goes over */
+	limit = AOSSTAT(aos, aosstat_limit);
+	if (delta > 0 && limit != 0 && size > limit && size - delta <= limit)
+		cv_signal(&arc_reclaim_thr_cv);
+}
+
+/*
+ * The total number of bytes by which objsets exceed their limits.
+ */
+static uint64_t
+arc_objset_excess(void)
+{
+	arc_objset_t *aos;
+	uint64_t excess = 0;
+
+	rw_enter(&arc_objset_lock, RW_READER);
+	for (aos = avl_first(&arc_objset_tree); aos != NULL;
+	    aos = AVL_NEXT(&arc_objset_tree, aos)) {
+		if (AOS_OVER_LIMIT(aos)) {
+			excess += AOSSTAT(aos, aosstat_size) -
+			    AOSSTAT(aos, aosstat_limit);
+		}
+	}
+	rw_exit(&arc_objset_lock);
+
+	return (excess);
+}
+
+arc_objset_t *
+arc_objset_register(spa_t *spa, uint64_t objset)
+{
+	arc_objset_t search, *aos;
+	avl_index_t where;
+	char name[KSTAT_STRLEN];
+
+	search.aos_spa = spa_load_guid(spa);
+	search.aos_objset = objset;
+
+	rw_enter(&arc_objset_lock, RW_WRITER);
+	aos = avl_find(&arc_objset_tree, &search, &where);
+	if (aos != NULL) {
+		aos->aos_nreg++;
+		rw_exit(&arc_objset_lock);
+		return (aos);
+	}
+
+	aos = kmem_zalloc(sizeof (arc_objset_t), KM_SLEEP);
+	aos->aos_spa = search.aos_spa;
+	aos->aos_objset = objset;
+	aos->aos_nreg = 1;
+	aos->aos_refcnt = 1;
+	bcopy(&arc_objset_stats_template, &aos->aos_stats,
+	    sizeof (arc_objset_stats_t));
+	avl_insert(&arc_objset_tree, aos, where);
+
+	(void) snprintf(name, sizeof (name), "arc-objset-0x%llx",
+	    (u_longlong_t)objset);
+	aos->aos_ksp = kstat_create(spa_name(spa), 0, name, "arcstats",
+	    KSTAT_TYPE_NAMED, sizeof (arc_objset_stats_t) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (aos->aos_ksp != NULL) {
+		aos->aos_ksp->ks_data = &aos->aos_stats;
+		kstat_install(aos->aos_ksp);
+	}
+	rw_exit(&arc_objset_lock);
+
+	return (aos);
+}
+
+/*
+ * Called when the objset is closed.  Headers still pointing at the
+ * arc_objset_t keep it alive, but it is no longer found by lookups and
+ * no longer has a limit.
+ */
+void
+arc_objset_unregister(arc_objset_t *aos)
+{
+	rw_enter(&arc_objset_lock, RW_WRITER);
+	ASSERT3U(aos->aos_nreg, >, 0);
+	if (--aos->aos_nreg > 0) {
+		rw_exit(&arc_objset_lock);
+		return;
+	}
+	avl_remove(&arc_objset_tree, aos);
+	if (aos->aos_ksp != NULL) {
+		kstat_delete(aos->aos_ksp);
+		aos->aos_ksp = NULL;
+	}
+	if (AOSSTAT(aos, aosstat_limit) != 0) {
+		AOSSTAT(aos, aosstat_limit) = 0;
+		arc_objset_nlimits--;
+	}
+	rw_exit(&arc_objset_lock);
+
+	arc_objset_rele(aos);
+}
+
+/*
+ * Set the objset's ARC limit in bytes; zero means no limit.
+ */
+void
+arc_objset_set_limit(arc_objset_t *aos, uint64_t limit)
+{
+	rw_enter(&arc_objset_lock, RW_WRITER);
+	if (AOSSTAT(aos, aosstat_limit) == 0 && limit != 0)
+		arc_objset_nlimits++;
+	else if (AOSSTAT(aos, aosstat_limit) != 0 && limit == 0)
+		arc_objset_nlimits--;
+	AOSSTAT(aos, aosstat_limit) = limit;
+	rw_exit(&arc_objset_lock);
+
+	if (AOS_OVER_LIMIT(aos))
+		cv_signal(&arc_reclaim_thr_cv);
+}
+
+/*
+ * The amount of data a header accounts for in a non-ghost state: one
+ * copy per buffer, plus the compressed copy if it is keeping one.
+ */
+static uint64_t
+arc_hdr_size(arc_buf_hdr_t *ab)
+{
+	uint64_t size = ab->b_size * ab->b_datacnt;
+
+	if (ab->b_pdata != NULL)
+		size += ab->b_psize;
+	return (size);
+}
+
+/*
+ * The sublist of state that a header belongs on, and that sublist's lock.
+ */
+static arc_sublist_t *
+arc_hdr_sublist(arc_state_t *state, arc_buf_hdr_t *ab)
+{
+	ASSERT(state != arc_anon);
+	ASSERT(!BUF_EMPTY(ab));
+	return (&state->arcs_sublists[buf_hash(ab->b_spa, &ab->b_dva,
+	    ab->b_birth) & (arc_sublist_cnt - 1)]);
+}
+
+#define	ARC_SUBLIST_LOCK(state, ab)	(&arc_hdr_sublist(state, ab)->asl_mtx)
+
+/*
+ * The evictable list an unreferenced header belongs on.
+ */
+static list_t *
+arc_hdr_list(arc_state_t *state, arc_buf_hdr_t *ab)
+{
+	arc_sublist_t *sl = arc_hdr_sublist(state, ab);
+
+	if (ab->b_datacnt == 0 && ab->b_pdata != NULL) {
+		ASSERT(!GHOST_STATE(state));
+		return (&sl->asl_clist[ab->b_type]);
+	}
+	return (&sl->asl_list[ab->b_type]);
+}
+
+#ifdef _KERNEL
+/*
+ * Move callback for the header cache.  After a large walk most headers
+ * are ghosts: they carry no data and are referenced only by their hash
+ * chain and their ghost list, so they can be moved under the hash lock
+ * and the sublist lock.  A header is recognized by finding it on the
+ * hash chain its identity maps to; a stale or free buffer will not be
+ * there, and a hashed header cannot change identity or be freed while
+ * we hold its hash lock.
+ */
+/* ARGSUSED */
+static kmem_cbrc_t
+arc_hdr_move(void *buf, void *newbuf, size_t size, void *arg)
+{
+	arc_buf_hdr_t *ohdr = buf, *nhdr = newbuf;
+	arc_buf_hdr_t *hdr, **hdrp;
+	arc_state_t *state;
+	kmutex_t *hash_lock, *list_lock;
+	uint64_t idx;
+
+	idx = BUF_HASH_INDEX(ohdr->b_spa, &ohdr->b_dva, ohdr->b_birth);
+	hash_lock = BUF_HASH_LOCK(idx);
+	if (!mutex_tryenter(hash_lock))
+		return (KMEM_CBRC_LATER);
+
+	for (hdrp = &buf_hash_table.ht_table[idx]; (hdr = *hdrp) != NULL;
+	    hdrp = &hdr->b_hash_next) {
+		if (hdr == ohdr)
+			break;
+	}
+	if (hdr == NULL) {
+		mutex_exit(hash_lock);
+		return (KMEM_CBRC_DONT_KNOW);
+	}
+
+	/*
+	 * Anything with data, I/O or an L2ARC copy may still turn into a
+	 * plain ghost; try it again later.
+	 */
+	state = hdr->b_state;
+	if ((state != arc_mru_ghost && state != arc_mfu_ghost) ||
+	    hdr->b_buf != NULL || hdr->b_l2hdr != NULL ||
+	    hdr->b_acb != NULL || HDR_IO_IN_PROGRESS(hdr) ||
+	    !refcount_is_zero(&hdr->b_refcnt)) {
+		mutex_exit(hash_lock);
+		return (KMEM_CBRC_LATER);
+	}
+	ASSERT0(hdr->b_datacnt);
+	ASSERT3P(hdr->b_pdata, ==, NULL);
+
+	list_lock = ARC_SUBLIST_LOCK(state, hdr);
+	mutex_enter(list_lock);
+
+	nhdr->b_dva = hdr->b_dva;
+	nhdr->b_birth = hdr->b_birth;
+	nhdr->b_cksum0 = hdr->b_cksum0;
+	nhdr->b_freeze_cksum = hdr->b_freeze_cksum;
+	nhdr->b_thawed = hdr->b_thawed;
+	nhdr->b_hash_next = hdr->b_hash_next;
+	nhdr->b_flags = hdr->b_flags;
+	nhdr->b_psize = hdr->b_psize;
+	nhdr->b_pcompress = hdr->b_pcompress;
+	nhdr->b_type = hdr->b_type;
+	nhdr->b_size = hdr->b_size;
+	nhdr->b_spa = hdr->b_spa;
+	nhdr->b_state = state;
+	nhdr->b_arc_access = hdr->b_arc_access;
+	nhdr->b_aos = hdr->b_aos;
+
+	*hdrp = nhdr;
+	list_link_replace(&hdr->b_arc_node, &nhdr->b_arc_node);
+	mutex_exit(list_lock);
+	mutex_exit(hash_lock);
+
+	/* leave the old header as arc_hdr_destroy() would have */
+	buf_discard_identity(hdr);
+	hdr->b_hash_next = NULL;
+	hdr->b_flags = 0;
+	hdr->b_freeze_cksum = NULL;
+	hdr->b_thawed = NULL;
+	hdr->b_aos = NULL;
+	hdr->b_state = arc_anon;
+
+	return (KMEM_CBRC_YES);
+}
+#endif	/* _KERNEL */
+
+/*
+ * Allocate space for the compressed copy of a block about to be read.
+ */
+static void
+arc_hdr_alloc_pdata(arc_buf_hdr_t *ab, uint64_t psize, enum zio_compress c)
+{
+	arc_state_t *state = ab->b_state;
+
+	ASSERT(MUTEX_HELD(HDR_LOCK(ab)));
+	ASSERT(HDR_IO_IN_PROGRESS(ab));
+	ASSERT(!GHOST_STATE(state));
+	ASSERT3P(ab->b_pdata, ==, NULL);
+	ASSERT3U(psize, <, ab->b_size);
+
+	if (arc_evict_needed(ab->b_type))
+		cv_signal(&arc_reclaim_thr_cv);
+
+	ab->b_pdata = abd_alloc(psize, ab->b_type == ARC_BUFC_METADATA);
+	if (ab->b_type == ARC_BUFC_METADATA) {
+		arc_space_consume(psize, ARC_SPACE_DATA);
+	} else {
+		ASSERT(ab->b_type == ARC_BUFC_DATA);
+		ARCSTAT_INCR(arcstat_data_size, psize);
+		atomic_add_64(&arc_size, psize);
+	}
+	ab->b_psize = psize;
+	ab->b_pcompress = c;
+	ARCSTAT_INCR(arcstat_compressed_size, psize);
+	ARCSTAT_INCR(arcstat_uncompressed_size, ab->b_size);
+
+	atomic_add_64(&state->arcs_size, psize);
+	arc_objset_charge(ab, state, psize);
+	if (list_link_active(&ab->b_arc_node)) {
+		ASSERT(refcount_is_zero(&ab->b_refcnt));
+		atomic_add_64(&state->arcs_lsize[ab->b_type], psize);
+	}
+}
+
+/*
+ * Free the compressed copy of a block.  The caller is responsible for
+ * the state size accounting.  An l2arc write in progress works from its
+ * own linear copy (see l2arc_write_buffers()), so this can't race it.
+ */
+static void
+arc_hdr_free_pdata(arc_buf_hdr_t *ab)
+{
+	uint64_t psize = ab->b_psize;
+
+	ASSERT(ab->b_pdata != NULL);
+
+	if (ab->b_type == ARC_BUFC_METADATA) {
+		arc_space_return(psize, ARC_SPACE_DATA);
+	} else {
+		ASSERT(ab->b_type == ARC_BUFC_DATA);
+		ARCSTAT_INCR(arcstat_data_size, -psize);
+		atomic_add_64(&arc_size, -psize);
+	}
+	ARCSTAT_INCR(arcstat_compressed_size, -psize);
+	ARCSTAT_INCR(arcstat_uncompressed_size, -ab->b_size);
+
+	abd_free(ab->b_pdata);
+	ab->b_pdata = NULL;
+	ab->b_psize = 0;
+	ab->b_pcompress = ZIO_COMPRESS_OFF;
+}
+
+/*
+ * An unreferenced header has just lost its last uncompressed buffer, but
+ * is keeping its compressed copy: move it over to the compressed list.
+ */
+static void
+arc_hdr_compressed_only(arc_buf_hdr_t *ab)
+{
+	arc_state_t *state = ab->b_state;
+
+	ASSERT(MUTEX_HELD(HDR_LOCK(ab)));
+	ASSERT0(ab->b_datacnt);
+	ASSERT3P(ab->b_buf, ==, NULL);
+	ASSERT(ab->b_pdata != NULL);
+	ASSERT(state == arc_mru || state == arc_mfu);
+
+	if (list_link_active(&ab->b_arc_node)) {
+		arc_sublist_t *sl = arc_hdr_sublist(state, ab);
+		int use_mutex = !MUTEX_HELD(&sl->asl_mtx);
+
+		ASSERT(refcount_is_zero(&ab->b_refcnt));
+		if (use_mutex)
+			mutex_enter(&sl->asl_mtx);
+		list_remove(&sl->asl_list[ab->b_type], ab);
+		list_insert_head(&sl->asl_clist[ab->b_type], ab);
+		if (use_mutex)
+			mutex_exit(&sl->asl_mtx);
+	}
+}
+
 static void
 add_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 {
@@ -1114,12 +1799,13 @@ add_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 
 	if ((refcount_add(&ab->b_refcnt, tag) == 1) &&
 	    (ab->b_state != arc_anon)) {
-		uint64_t delta = ab->b_size * ab->b_datacnt;
-		list_t *list = &ab->b_state->arcs_list[ab->b_type];
+		uint64_t delta = arc_hdr_size(ab);
+		list_t *list = arc_hdr_list(ab->b_state, ab);
+		kmutex_t *lock = ARC_SUBLIST_LOCK(ab->b_state, ab);
 		uint64_t *size = &ab->b_state->arcs_lsize[ab->b_type];
 
-		ASSERT(!MUTEX_HELD(&ab->b_state->arcs_mtx));
-		mutex_enter(&ab->b_state->arcs_mtx);
+		ASSERT(!MUTEX_HELD(lock));
+		mutex_enter(lock);
 		ASSERT(list_link_active(&ab->b_arc_node));
 		list_remove(list, ab);
 		if (GHOST_STATE(ab->b_state)) {
@@ -1130,7 +1816,7 @@ add_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 		ASSERT(delta > 0);
 		ASSERT3U(*size, >=, delta);
 		atomic_add_64(size, -delta);
-		mutex_exit(&ab->b_state->arcs_mtx);
+		mutex_exit(lock);
 		/* remove the prefetch flag if we get a reference */
 		if (ab->b_flags & ARC_PREFETCH)
 			ab->b_flags &= ~ARC_PREFETCH;
@@ -1148,22 +1834,25 @@ remove_reference(arc_buf_hdr_t *ab, kmutex_t *hash_lock, void *tag)
 
 	if (((cnt = refcount_remove(&ab->b_refcnt, tag)) == 0) &&
 	    (state != arc_anon)) {
+		arc_sublist_t *sl = arc_hdr_sublist(state, ab);
 		uint64_t *size = &state->arcs_lsize[ab->b_type];
 
-		ASSERT(!MUTEX_HELD(&state->arcs_mtx));
-		mutex_enter(&state->arcs_mtx);
+		ASSERT(!MUTEX_HELD(&sl->asl_mtx));
+		mutex_enter(&sl->asl_mtx);
 		ASSERT(!list_link_active(&ab->b_arc_node));
-		list_insert_head(&state->arcs_list[ab->b_type], ab);
+		list_insert_head(&sl->asl_list[ab->b_type], ab);
 		ASSERT(ab->b_datacnt > 0);
-		atomic_add_64(size, ab->b_size * ab->b_datacnt);
-		mutex_exit(&state->arcs_mtx);
+		atomic_add_64(size, arc_hdr_size(ab));
+		mutex_exit(&sl->asl_mtx);
 	}
 	return (cnt);
 }
 
 /*
  * Move the supplied buffer to the indicated state.  The mutex
- * for the buffer must be held by the caller.
+ * for the buffer must be held by the caller.  A compressed copy
+ * of the data does not follow the header into the anonymous or
+ * a ghost state.
  */
 static void
 arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
@@ -1171,6 +1860,8 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 	arc_state_t *old_state = ab->b_state;
 	int64_t refcnt = refcount_count(&ab->b_refcnt);
 	uint64_t from_delta, to_delta;
+	boolean_t drop_pdata = (ab->b_pdata != NULL &&
+	    (new_state == arc_anon || GHOST_STATE(new_state)));
 
 	ASSERT(MUTEX_HELD(hash_lock));
 	ASSERT3P(new_state, !=, old_state);
@@ -1178,7 +1869,9 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 	ASSERT(ab->b_datacnt == 0 || !GHOST_STATE(new_state));
 	ASSERT(ab->b_datacnt <= 1 || old_state != arc_anon);
 
-	from_delta = to_delta = ab->b_datacnt * ab->b_size;
+	from_delta = to_delta = arc_hdr_size(ab);
+	if (drop_pdata)
+		to_delta -= ab->b_psize;
 
 	/*
 	 * If this buffer is evictable, transfer it from the
@@ -1186,14 +1879,15 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 	 */
 	if (refcnt == 0) {
 		if (old_state != arc_anon) {
-			int use_mutex = !MUTEX_HELD(&old_state->arcs_mtx);
+			kmutex_t *lock = ARC_SUBLIST_LOCK(old_state, ab);
+			int use_mutex = !MUTEX_HELD(lock);
 			uint64_t *size = &old_state->arcs_lsize[ab->b_type];
 
 			if (use_mutex)
-				mutex_enter(&old_state->arcs_mtx);
+				mutex_enter(lock);
 
 			ASSERT(list_link_active(&ab->b_arc_node));
-			list_remove(&old_state->arcs_list[ab->b_type], ab);
+			list_remove(arc_hdr_list(old_state, ab), ab);
 
 			/*
 			 * If prefetching out of the ghost cache,
@@ -1208,16 +1902,23 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 			atomic_add_64(size, -from_delta);
 
 			if (use_mutex)
-				mutex_exit(&old_state->arcs_mtx);
+				mutex_exit(lock);
 		}
+	}
+
+	if (drop_pdata)
+		arc_hdr_free_pdata(ab);
+
+	if (refcnt == 0) {
 		if (new_state != arc_anon) {
-			int use_mutex = !MUTEX_HELD(&new_state->arcs_mtx);
+			kmutex_t *lock = ARC_SUBLIST_LOCK(new_state, ab);
+			int use_mutex = !MUTEX_HELD(lock);
 			uint64_t *size = &new_state->arcs_lsize[ab->b_type];
 
 			if (use_mutex)
-				mutex_enter(&new_state->arcs_mtx);
+				mutex_enter(lock);
 
-			list_insert_head(&new_state->arcs_list[ab->b_type], ab);
+			list_insert_head(arc_hdr_list(new_state, ab), ab);
 
 			/* ghost elements have a ghost size */
 			if (GHOST_STATE(new_state)) {
@@ -1228,7 +1929,7 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 			atomic_add_64(size, to_delta);
 
 			if (use_mutex)
-				mutex_exit(&new_state->arcs_mtx);
+				mutex_exit(lock);
 		}
 	}
 
@@ -1243,6 +1944,8 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *ab, kmutex_t *hash_lock)
 		ASSERT3U(old_state->arcs_size, >=, from_delta);
 		atomic_add_64(&old_state->arcs_size, -from_delta);
 	}
+	arc_objset_charge(ab, old_state, -from_delta);
+	arc_objset_charge(ab, new_state, to_delta);
 	ab->b_state = new_state;
 
 	/* adjust l2arc hdr stats */
@@ -1434,6 +2137,47 @@ arc_buf_clone(arc_buf_t *from)
 	return (buf);
 }
 
+/*
+ * Give a header which is holding only the compressed copy of its block
+ * a buffer with the uncompressed data in it.
+ */
+static arc_buf_t *
+arc_buf_decompress(arc_buf_hdr_t *hdr)
+{
+	arc_buf_t *buf;
+	void *cdata;
+
+	ASSERT(MUTEX_HELD(HDR_LOCK(hdr)));
+	ASSERT(hdr->b_state == arc_mru || hdr->b_state == arc_mfu);
+	ASSERT(!list_link_active(&hdr->b_arc_node));
+	ASSERT3P(hdr->b_buf, ==, NULL);
+	ASSERT(hdr->b_pdata != NULL);
+
+	buf = kmem_cache_alloc(buf_cache, KM_PUSHPAGE);
+	buf->b_hdr = hdr;
+	buf->b_data = NULL;
+	buf->b_efunc = NULL;
+	buf->b_private = NULL;
+	buf->b_next = NULL;
+	hdr->b_buf = buf;
+	arc_get_data_buf(buf);
+	hdr->b_datacnt = 1;
+
+	/*
+	 * This data passed its checksum on the way in and has not been
+	 * modified since; failing to decompress it means memory went bad.
+	 */
+	cdata = abd_borrow_buf_copy(hdr->b_pdata, hdr->b_psize);
+	VERIFY0(zio_decompress_data(hdr->b_pcompress, cdata,
+	    buf->b_data, hdr->b_psize, hdr->b_size));
+	abd_return_buf(hdr->b_pdata, cdata, hdr->b_psize);
+	arc_cksum_verify(buf);
+	arc_buf_watch(buf);
+	ARCSTAT_BUMP(arcstat_decompress_hits);
+
+	return (buf);
+}
+
 void
 arc_buf_add_ref(arc_buf_t *buf, void* tag)
 {
@@ -1527,6 +2271,7 @@ arc_buf_destroy(arc_buf_t *buf, boolean_t recycle, boolean_t all)
 		}
 		ASSERT3U(state->arcs_size, >=, size);
 		atomic_add_64(&state->arcs_size, -size);
+		arc_objset_charge(buf->b_hdr, state, -size);
 		buf->b_data = NULL;
 
 		/*
@@ -1620,6 +2365,11 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 			arc_buf_destroy(hdr->b_buf, FALSE, TRUE);
 		}
 	}
+	if (hdr->b_pdata != NULL) {
+		ASSERT3U(arc_anon->arcs_size, >=, hdr->b_psize);
+		atomic_add_64(&arc_anon->arcs_size, -hdr->b_psize);
+		arc_hdr_free_pdata(hdr);
+	}
 	if (hdr->b_freeze_cksum != NULL) {
 		kmem_free(hdr->b_freeze_cksum, sizeof (zio_cksum_t));
 		hdr->b_freeze_cksum = NULL;
@@ -1628,6 +2378,10 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 		kmem_free(hdr->b_thawed, 1);
 		hdr->b_thawed = NULL;
 	}
+	if (hdr->b_aos != NULL) {
+		arc_objset_rele(hdr->b_aos);
+		hdr->b_aos = NULL;
+	}
 
 	ASSERT(!list_link_active(&hdr->b_arc_node));
 	ASSERT3P(hdr->b_hash_next, ==, NULL);
@@ -1776,28 +2530,64 @@ arc_buf_eviction_needed(arc_buf_t *buf)
  * This function makes a "best effort".  It skips over any buffers
  * it can't get a hash_lock on, and so may not catch all candidates.
  * It may also return without evicting as much space as requested.
+ *
+ * While any objset is over its ARC limit, each list is first walked
+ * for buffers belonging to such objsets only.  If limit_only is set,
+ * that is the only walk made.
+ *
+ * The sublists are visited in turn, starting with a different one each
+ * call.  A large request first takes an even share from every sublist,
+ * so they all age at the same pace, then goes round once more for
+ * whatever is still missing.
  */
 static void *
-arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
-    arc_buf_contents_t type)
+arc_evict_impl(arc_state_t *state, uint64_t spa, int64_t bytes,
+    boolean_t recycle, arc_buf_contents_t type, boolean_t limit_only)
 {
 	arc_state_t *evicted_state;
 	uint64_t bytes_evicted = 0, skipped = 0, missed = 0;
+	uint64_t hdr_evicted, target;
+	int64_t share;
+	boolean_t limit_pass;
 	arc_buf_hdr_t *ab, *ab_prev = NULL;
-	list_t *list = &state->arcs_list[type];
+	arc_sublist_t *sl, *esl;
+	list_t *list;
 	kmutex_t *hash_lock;
 	boolean_t have_lock;
 	void *stolen = NULL;
 	arc_buf_hdr_t marker = { 0 };
 	int count = 0;
+	uint32_t start, idx;
+	int i = 0, rounds;
 
 	ASSERT(state == arc_mru || state == arc_mfu);
 
 	evicted_state = (state == arc_mru) ? arc_mru_ghost : arc_mfu_ghost;
 
-	mutex_enter(&state->arcs_mtx);
-	mutex_enter(&evicted_state->arcs_mtx);
+	start = atomic_inc_32_nv(&state->arcs_evict_idx);
+	if (recycle || bytes <= 0)
+		share = bytes;
+	else
+		share = MAX(bytes / arc_sublist_cnt, 1);
+	rounds = (share == bytes) ? 1 : 2;
+
+next_sublist:
+	idx = (start + i) & (arc_sublist_cnt - 1);
+	sl = &state->arcs_sublists[idx];
+	esl = &evicted_state->arcs_sublists[idx];
+	list = &sl->asl_list[type];
+	target = bytes_evicted + share;
+
+	mutex_enter(&sl->asl_mtx);
+	mutex_enter(&esl->asl_mtx);
 
+	/*
+	 * Uncompressed data is evicted first; headers which are left
+	 * holding a compressed copy move to asl_clist, which is only
+	 * evicted from once asl_list has nothing more to give.
+	 */
+	limit_pass = limit_only || (bytes > 0 && arc_objset_nlimits != 0);
+top:
 	for (ab = list_tail(list); ab; ab = ab_prev) {
 		ab_prev = list_prev(list, ab);
 		/* prefetch buffers have a minimum lifespan */
@@ -1810,7 +2600,7 @@ arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
 			continue;
 		}
 		/* "lookahead" for better eviction candidate */
-		if (recycle && ab->b_size != bytes &&
+		if (recycle && ab->b_datacnt > 0 && ab->b_size != bytes &&
 		    ab_prev && ab_prev->b_size == bytes)
 			continue;
 
@@ -1818,22 +2608,25 @@ arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
 		if (ab->b_spa == 0)
 			continue;
 
+		if (limit_pass && !AOS_OVER_LIMIT(ab->b_aos))
+			continue;
+
 		/*
 		 * It may take a long time to evict all the bufs requested.
 		 * To avoid blocking all arc activity, periodically drop
-		 * the arcs_mtx and give other threads a chance to run
-		 * before reacquiring the lock.
+		 * the sublist locks and give other threads a chance to run
+		 * before reacquiring them.
 		 *
 		 * If we are looking for a buffer to recycle, we are in
 		 * the hot code path, so don't sleep.
 		 */
 		if (!recycle && count++ > arc_evict_iterations) {
 			list_insert_after(list, ab, &marker);
-			mutex_exit(&evicted_state->arcs_mtx);
-			mutex_exit(&state->arcs_mtx);
+			mutex_exit(&esl->asl_mtx);
+			mutex_exit(&sl->asl_mtx);
 			kpreempt(KPREEMPT_SYNC);
-			mutex_enter(&state->arcs_mtx);
-			mutex_enter(&evicted_state->arcs_mtx);
+			mutex_enter(&sl->asl_mtx);
+			mutex_enter(&esl->asl_mtx);
 			ab_prev = list_prev(list, &marker);
 			list_remove(list, &marker);
 			count = 0;
@@ -1844,17 +2637,48 @@ arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
 		have_lock = MUTEX_HELD(hash_lock);
 		if (have_lock || mutex_tryenter(hash_lock)) {
 			ASSERT0(refcount_count(&ab->b_refcnt));
-			ASSERT(ab->b_datacnt > 0);
-			while (ab->b_buf) {
-				arc_buf_t *buf = ab->b_buf;
-				if (!mutex_tryenter(&buf->b_evict_lock)) {
-					missed += 1;
-					break;
+			ASSERT(ab->b_datacnt > 0 || ab->b_pdata != NULL);
+			hdr_evicted = bytes_evicted;
+
+			if (ab->b_datacnt == 0) {
+				/* all that is left is the compressed copy */
+				bytes_evicted += ab->b_psize;
+				if (limit_pass) {
+					atomic_add_64(&AOSSTAT(ab->b_aos,
+					    aosstat_evict_limit), ab->b_psize);
 				}
-				if (buf->b_data) {
-					bytes_evicted += ab->b_size;
-					if (recycle && ab->b_type == type &&
-					    ab->b_size == bytes &&
+				arc_change_state(evicted_state, ab, hash_lock);
+				ASSERT(HDR_IN_HASH_TABLE(ab));
+				ab->b_flags |= ARC_IN_HASH_TABLE;
+				DTRACE_PROBE1(arc__evict, arc_buf_hdr_t *, ab);
+				if (!have_lock)
+					mutex_exit(hash_lock);
+				if (bytes >= 0 && bytes_evicted >= target)
+					break;
+				continue;
+			}
+
+			/*
+			 * If the uncompressed data is going, but the header
+			 * stays around with its compressed copy, it may
+			 * still be written to the L2ARC later on.  That
+			 * needs a checksum of the uncompressed data, which
+			 * is how l2arc_read_done() validates a buffer.
+			 */
+			if (ab->b_pdata != NULL && l2arc_ndev != 0 &&
+			    l2arc_write_eligible(ab->b_spa, ab))
+				arc_cksum_compute(ab->b_buf, B_TRUE);
+
+			while (ab->b_buf) {
+				arc_buf_t *buf = ab->b_buf;
+				if (!mutex_tryenter(&buf->b_evict_lock)) {
+					missed += 1;
+					break;
+				}
+				if (buf->b_data) {
+					bytes_evicted += ab->b_size;
+					if (recycle && ab->b_type == type &&
+					    ab->b_size == bytes &&
 					    !HDR_L2_WRITING(ab)) {
 						stolen = buf->b_data;
 						recycle = FALSE;
@@ -1891,24 +2715,54 @@ arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
 				}
 			}
 
-			if (ab->b_datacnt == 0) {
+			if (ab->b_datacnt == 0 && ab->b_pdata != NULL) {
+				ab->b_flags &= ~ARC_BUF_AVAILABLE;
+				arc_hdr_compressed_only(ab);
+			} else if (ab->b_datacnt == 0) {
 				arc_change_state(evicted_state, ab, hash_lock);
 				ASSERT(HDR_IN_HASH_TABLE(ab));
 				ab->b_flags |= ARC_IN_HASH_TABLE;
 				ab->b_flags &= ~ARC_BUF_AVAILABLE;
 				DTRACE_PROBE1(arc__evict, arc_buf_hdr_t *, ab);
 			}
+			if (limit_pass) {
+				atomic_add_64(&AOSSTAT(ab->b_aos,
+				    aosstat_evict_limit),
+				    bytes_evicted - hdr_evicted);
+			}
 			if (!have_lock)
 				mutex_exit(hash_lock);
-			if (bytes >= 0 && bytes_evicted >= bytes)
+			if (bytes >= 0 && bytes_evicted >= target)
 				break;
 		} else {
 			missed += 1;
 		}
 	}
 
-	mutex_exit(&evicted_state->arcs_mtx);
-	mutex_exit(&state->arcs_mtx);
+	if (limit_pass && !limit_only && bytes_evicted < target) {
+		/* now anybody's buffers will do */
+		limit_pass = B_FALSE;
+		goto top;
+	}
+
+	if (list == &sl->asl_list[type] &&
+	    (bytes < 0 || bytes_evicted < target)) {
+		list = &sl->asl_clist[type];
+		limit_pass = limit_only ||
+		    (bytes > 0 && arc_objset_nlimits != 0);
+		goto top;
+	}
+
+	mutex_exit(&esl->asl_mtx);
+	mutex_exit(&sl->asl_mtx);
+
+	if ((bytes < 0 || bytes_evicted < bytes) &&
+	    ++i < rounds * arc_sublist_cnt) {
+		/* the second round goes after whatever is still missing */
+		if (i == arc_sublist_cnt)
+			share = bytes - bytes_evicted;
+		goto next_sublist;
+	}
 
 	if (bytes_evicted < bytes)
 		dprintf("only evicted %lld bytes from %x",
@@ -1930,6 +2784,36 @@ arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
 	return (stolen);
 }
 
+static void *
+arc_evict(arc_state_t *state, uint64_t spa, int64_t bytes, boolean_t recycle,
+    arc_buf_contents_t type)
+{
+	return (arc_evict_impl(state, spa, bytes, recycle, type, B_FALSE));
+}
+
+/*
+ * Bring objsets that are over their ARC limits back down to them,
+ * evicting only their buffers: data before metadata, MRU before MFU.
+ */
+static void
+arc_adjust_objsets(void)
+{
+	arc_state_t *states[] = { arc_mru, arc_mfu, arc_mru, arc_mfu };
+	arc_buf_contents_t types[] = { ARC_BUFC_DATA, ARC_BUFC_DATA,
+	    ARC_BUFC_METADATA, ARC_BUFC_METADATA };
+	uint64_t excess;
+
+	if (arc_objset_nlimits == 0)
+		return;
+
+	for (int i = 0; i < sizeof (types) / sizeof (types[0]); i++) {
+		if ((excess = arc_objset_excess()) == 0)
+			break;
+		(void) arc_evict_impl(states[i], 0, excess, FALSE, types[i],
+		    B_TRUE);
+	}
+}
+
 /*
  * Remove buffers from list until we've removed the specified number of
  * bytes.  Destroy the buffers that are removed.
@@ -1939,15 +2823,23 @@ arc_evict_ghost(arc_state_t *state, uint64_t spa, int64_t bytes)
 {
 	arc_buf_hdr_t *ab, *ab_prev;
 	arc_buf_hdr_t marker = { 0 };
-	list_t *list = &state->arcs_list[ARC_BUFC_DATA];
+	arc_sublist_t *sl;
+	list_t *list;
 	kmutex_t *hash_lock;
 	uint64_t bytes_deleted = 0;
 	uint64_t bufs_skipped = 0;
 	int count = 0;
+	uint32_t start;
+	int i = 0;
 
 	ASSERT(GHOST_STATE(state));
+
+	start = atomic_inc_32_nv(&state->arcs_evict_idx);
+next_sublist:
+	sl = &state->arcs_sublists[(start + i) & (arc_sublist_cnt - 1)];
+	list = &sl->asl_list[ARC_BUFC_DATA];
 top:
-	mutex_enter(&state->arcs_mtx);
+	mutex_enter(&sl->asl_mtx);
 	for (ab = list_tail(list); ab; ab = ab_prev) {
 		ab_prev = list_prev(list, ab);
 		if (ab->b_type > ARC_BUFC_NUMTYPES)
@@ -1967,14 +2859,14 @@ top:
 		/*
 		 * It may take a long time to evict all the bufs requested.
 		 * To avoid blocking all arc activity, periodically drop
-		 * the arcs_mtx and give other threads a chance to run
-		 * before reacquiring the lock.
+		 * the sublist lock and give other threads a chance to run
+		 * before reacquiring it.
 		 */
 		if (count++ > arc_evict_iterations) {
 			list_insert_after(list, ab, &marker);
-			mutex_exit(&state->arcs_mtx);
+			mutex_exit(&sl->asl_mtx);
 			kpreempt(KPREEMPT_SYNC);
-			mutex_enter(&state->arcs_mtx);
+			mutex_enter(&sl->asl_mtx);
 			ab_prev = list_prev(list, &marker);
 			list_remove(list, &marker);
 			count = 0;
@@ -2009,10 +2901,10 @@ top:
 			 * available, restart from where we left off.
 			 */
 			list_insert_after(list, ab, &marker);
-			mutex_exit(&state->arcs_mtx);
+			mutex_exit(&sl->asl_mtx);
 			mutex_enter(hash_lock);
 			mutex_exit(hash_lock);
-			mutex_enter(&state->arcs_mtx);
+			mutex_enter(&sl->asl_mtx);
 			ab_prev = list_prev(list, &marker);
 			list_remove(list, &marker);
 		} else {
@@ -2020,12 +2912,15 @@ top:
 		}
 
 	}
-	mutex_exit(&state->arcs_mtx);
+	mutex_exit(&sl->asl_mtx);
 
-	if (list == &state->arcs_list[ARC_BUFC_DATA] &&
-	    (bytes < 0 || bytes_deleted < bytes)) {
-		list = &state->arcs_list[ARC_BUFC_METADATA];
-		goto top;
+	if (bytes < 0 || bytes_deleted < bytes) {
+		if (list == &sl->asl_list[ARC_BUFC_DATA]) {
+			list = &sl->asl_list[ARC_BUFC_METADATA];
+			goto top;
+		}
+		if (++i < arc_sublist_cnt)
+			goto next_sublist;
 	}
 
 	if (bufs_skipped) {
@@ -2038,6 +2933,43 @@ top:
 		    (longlong_t)bytes_deleted, state);
 }
 
+/*
+ * Evict up to adjustment bytes from state, taking them first from the
+ * class of buffer (data or metadata) that is over its share of the cache
+ * as set by arc_meta_p.  The other class is only evicted from once the
+ * first is back within its share, or has nothing left to give.
+ */
+static void
+arc_adjust_state(arc_state_t *state, int64_t adjustment)
+{
+	arc_buf_contents_t types[3];
+	int64_t excess, delta;
+
+	if (arc_meta_used > arc_meta_p) {
+		types[0] = ARC_BUFC_METADATA;
+		types[1] = ARC_BUFC_DATA;
+		excess = arc_meta_used - arc_meta_p;
+	} else {
+		types[0] = ARC_BUFC_DATA;
+		types[1] = ARC_BUFC_METADATA;
+		excess = (int64_t)(arc_size - arc_meta_used) -
+		    (int64_t)(arc_c - arc_meta_p);
+	}
+	types[2] = types[0];
+
+	for (int i = 0; i < 3 && adjustment > 0; i++) {
+		if (state->arcs_lsize[types[i]] == 0)
+			continue;
+		delta = MIN(state->arcs_lsize[types[i]], adjustment);
+		if (i == 0)
+			delta = MIN(delta, MAX(excess, 0));
+		if (delta <= 0)
+			continue;
+		(void) arc_evict(state, NULL, delta, FALSE, types[i]);
+		adjustment -= delta;
+	}
+}
+
 static void
 arc_adjust(void)
 {
@@ -2051,17 +2983,7 @@ arc_adjust(void)
 	    (int64_t)(arc_anon->arcs_size + arc_mru->arcs_size + arc_meta_used -
 	    arc_p));
 
-	if (adjustment > 0 && arc_mru->arcs_lsize[ARC_BUFC_DATA] > 0) {
-		delta = MIN(arc_mru->arcs_lsize[ARC_BUFC_DATA], adjustment);
-		(void) arc_evict(arc_mru, NULL, delta, FALSE, ARC_BUFC_DATA);
-		adjustment -= delta;
-	}
-
-	if (adjustment > 0 && arc_mru->arcs_lsize[ARC_BUFC_METADATA] > 0) {
-		delta = MIN(arc_mru->arcs_lsize[ARC_BUFC_METADATA], adjustment);
-		(void) arc_evict(arc_mru, NULL, delta, FALSE,
-		    ARC_BUFC_METADATA);
-	}
+	arc_adjust_state(arc_mru, adjustment);
 
 	/*
 	 * Adjust MFU size
@@ -2069,18 +2991,7 @@ arc_adjust(void)
 
 	adjustment = arc_size - arc_c;
 
-	if (adjustment > 0 && arc_mfu->arcs_lsize[ARC_BUFC_DATA] > 0) {
-		delta = MIN(adjustment, arc_mfu->arcs_lsize[ARC_BUFC_DATA]);
-		(void) arc_evict(arc_mfu, NULL, delta, FALSE, ARC_BUFC_DATA);
-		adjustment -= delta;
-	}
-
-	if (adjustment > 0 && arc_mfu->arcs_lsize[ARC_BUFC_METADATA] > 0) {
-		int64_t delta = MIN(adjustment,
-		    arc_mfu->arcs_lsize[ARC_BUFC_METADATA]);
-		(void) arc_evict(arc_mfu, NULL, delta, FALSE,
-		    ARC_BUFC_METADATA);
-	}
+	arc_adjust_state(arc_mfu, adjustment);
 
 	/*
 	 * Adjust ghost lists
@@ -2125,6 +3036,23 @@ arc_do_user_evicts(void)
 	mutex_exit(&arc_eviction_mtx);
 }
 
+/*
+ * Are there any evictable buffers of the given type in state?  This is
+ * only a hint, as the lists are checked without their locks.
+ */
+static boolean_t
+arc_state_evictable(arc_state_t *state, arc_buf_contents_t type)
+{
+	for (int i = 0; i < arc_sublist_cnt; i++) {
+		arc_sublist_t *sl = &state->arcs_sublists[i];
+
+		if (list_head(&sl->asl_list[type]) != NULL ||
+		    list_head(&sl->asl_clist[type]) != NULL)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
 /*
  * Flush all *evictable* data from the cache for the given spa.
  * NOTE: this will not touch "active" (i.e. referenced) data.
@@ -2137,22 +3065,22 @@ arc_flush(spa_t *spa)
 	if (spa)
 		guid = spa_load_guid(spa);
 
-	while (list_head(&arc_mru->arcs_list[ARC_BUFC_DATA])) {
+	while (arc_state_evictable(arc_mru, ARC_BUFC_DATA)) {
 		(void) arc_evict(arc_mru, guid, -1, FALSE, ARC_BUFC_DATA);
 		if (spa)
 			break;
 	}
-	while (list_head(&arc_mru->arcs_list[ARC_BUFC_METADATA])) {
+	while (arc_state_evictable(arc_mru, ARC_BUFC_METADATA)) {
 		(void) arc_evict(arc_mru, guid, -1, FALSE, ARC_BUFC_METADATA);
 		if (spa)
 			break;
 	}
-	while (list_head(&arc_mfu->arcs_list[ARC_BUFC_DATA])) {
+	while (arc_state_evictable(arc_mfu, ARC_BUFC_DATA)) {
 		(void) arc_evict(arc_mfu, guid, -1, FALSE, ARC_BUFC_DATA);
 		if (spa)
 			break;
 	}
-	while (list_head(&arc_mfu->arcs_list[ARC_BUFC_METADATA])) {
+	while (arc_state_evictable(arc_mfu, ARC_BUFC_METADATA)) {
 		(void) arc_evict(arc_mfu, guid, -1, FALSE, ARC_BUFC_METADATA);
 		if (spa)
 			break;
@@ -2184,10 +3112,13 @@ arc_shrink(void)
 			arc_c = arc_c_min;
 
 		atomic_add_64(&arc_p, -(arc_p >> arc_shrink_shift));
+		atomic_add_64(&arc_meta_p, -(arc_meta_p >> arc_shrink_shift));
 		if (arc_c > arc_size)
 			arc_c = MAX(arc_size, arc_c_min);
 		if (arc_p > arc_c)
 			arc_p = (arc_c >> 1);
+		if (arc_meta_p > arc_c)
+			arc_meta_p = (arc_c >> 3);
 		ASSERT(arc_c >= arc_c_min);
 		ASSERT((int64_t)arc_p >= 0);
 	}
@@ -2315,14 +3246,19 @@ arc_kmem_reap_now(arc_reclaim_strategy_t strat)
 	if (strat == ARC_RECLAIM_AGGR)
 		arc_shrink();
 
+	/*
+	 * There are a lot of zio buf caches; queue their reaps rather than
+	 * waiting on each in turn, so that eviction isn't held up behind
+	 * the kmem taskq.
+	 */
 	for (i = 0; i < SPA_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT; i++) {
 		if (zio_buf_cache[i] != prev_cache) {
 			prev_cache = zio_buf_cache[i];
-			kmem_cache_reap_now(zio_buf_cache[i]);
+			kmem_cache_reap_soon(zio_buf_cache[i]);
 		}
 		if (zio_data_buf_cache[i] != prev_data_cache) {
 			prev_data_cache = zio_data_buf_cache[i];
-			kmem_cache_reap_now(zio_data_buf_cache[i]);
+			kmem_cache_reap_soon(zio_data_buf_cache[i]);
 		}
 	}
 	kmem_cache_reap_now(buf_cache);
@@ -2372,6 +3308,7 @@ arc_reclaim_thread(void)
 		}
 
 		arc_adjust();
+		arc_adjust_objsets();
 
 		if (arc_eviction_list != NULL)
 			arc_do_user_evicts();
@@ -2390,12 +3327,12 @@ arc_reclaim_thread(void)
 }
 
 /*
- * Adapt arc info given the number of bytes we are trying to add and
- * the state that we are comming from.  This function is only called
- * when we are adding new content to the cache.
+ * Adapt arc info given the number of bytes we are trying to add, the
+ * state that we are comming from and the type of the buffer.  This
+ * function is only called when we are adding new content to the cache.
  */
 static void
-arc_adapt(int bytes, arc_state_t *state)
+arc_adapt(int bytes, arc_state_t *state, arc_buf_contents_t type)
 {
 	int mult;
 	uint64_t arc_p_min = (arc_c >> arc_p_min_shift);
@@ -2430,6 +3367,40 @@ arc_adapt(int bytes, arc_state_t *state)
 	}
 	ASSERT((int64_t)arc_p >= 0);
 
+	/*
+	 * Adapt the target size of metadata in the same way, by which
+	 * class of buffer we just hit in the ghost lists:
+	 *	- a metadata ghost hit means we evicted metadata that was
+	 *	  still wanted, so increase the metadata target.
+	 *	- a data ghost hit increases the data share by decreasing
+	 *	  the metadata target.
+	 * The metadata target never goes past arc_meta_limit.
+	 */
+	if (zfs_arc_meta_adapt && GHOST_STATE(state)) {
+		uint64_t meta_ghost, data_ghost, meta_p_max, delta;
+
+		meta_ghost = arc_mru_ghost->arcs_lsize[ARC_BUFC_METADATA] +
+		    arc_mfu_ghost->arcs_lsize[ARC_BUFC_METADATA];
+		data_ghost = arc_mru_ghost->arcs_lsize[ARC_BUFC_DATA] +
+		    arc_mfu_ghost->arcs_lsize[ARC_BUFC_DATA];
+		meta_p_max = MIN(arc_meta_limit, arc_c - arc_p_min);
+
+		if (type == ARC_BUFC_METADATA) {
+			mult = (meta_ghost >= data_ghost || meta_ghost == 0) ?
+			    1 : (data_ghost / meta_ghost);
+			mult = MIN(mult, 10);
+
+			arc_meta_p = MIN(meta_p_max, arc_meta_p + bytes * mult);
+		} else {
+			mult = (data_ghost >= meta_ghost || data_ghost == 0) ?
+			    1 : (meta_ghost / data_ghost);
+			mult = MIN(mult, 10);
+
+			delta = MIN(bytes * mult, arc_meta_p);
+			arc_meta_p = MAX(arc_p_min, arc_meta_p - delta);
+		}
+	}
+
 	if (arc_reclaim_needed()) {
 		cv_signal(&arc_reclaim_thr_cv);
 		return;
@@ -2502,8 +3473,9 @@ arc_get_data_buf(arc_buf_t *buf)
 	arc_state_t		*state = buf->b_hdr->b_state;
 	uint64_t		size = buf->b_hdr->b_size;
 	arc_buf_contents_t	type = buf->b_hdr->b_type;
+	arc_buf_contents_t	evict_type = type;
 
-	arc_adapt(size, state);
+	arc_adapt(size, state, type);
 
 	/*
 	 * We have not yet reached cache maximum size,
@@ -2531,17 +3503,36 @@ arc_get_data_buf(arc_buf_t *buf)
 	else if (state == arc_mru_ghost)
 		state = arc_mru;
 
+	/*
+	 * Make room by evicting the same class of buffer, which lets us
+	 * recycle one, unless the other class is over its share of the
+	 * cache as set by arc_meta_p.
+	 */
+	if (type == ARC_BUFC_METADATA &&
+	    arc_meta_used < MIN(arc_meta_p, arc_meta_limit))
+		evict_type = ARC_BUFC_DATA;
+	else if (type == ARC_BUFC_DATA && arc_meta_used > arc_meta_p)
+		evict_type = ARC_BUFC_METADATA;
+
 	if (state == arc_mru || state == arc_anon) {
 		uint64_t mru_used = arc_anon->arcs_size + arc_mru->arcs_size;
-		state = (arc_mfu->arcs_lsize[type] >= size &&
+		state = (arc_mfu->arcs_lsize[evict_type] >= size &&
 		    arc_p > mru_used) ? arc_mfu : arc_mru;
 	} else {
 		/* MFU cases */
 		uint64_t mfu_space = arc_c - arc_p;
-		state =  (arc_mru->arcs_lsize[type] >= size &&
+		state =  (arc_mru->arcs_lsize[evict_type] >= size &&
 		    mfu_space > arc_mfu->arcs_size) ? arc_mru : arc_mfu;
 	}
-	if ((buf->b_data = arc_evict(state, NULL, size, TRUE, type)) == NULL) {
+	if (evict_type != type) {
+		(void) arc_evict(state, NULL, size, FALSE, evict_type);
+		buf->b_data = NULL;
+	} else {
+		buf->b_data = arc_evict(state, NULL, size, TRUE, type);
+		if (buf->b_data == NULL)
+			ARCSTAT_BUMP(arcstat_recycle_miss);
+	}
+	if (buf->b_data == NULL) {
 		if (type == ARC_BUFC_METADATA) {
 			buf->b_data = zio_buf_alloc(size);
 			arc_space_consume(size, ARC_SPACE_DATA);
@@ -2551,7 +3542,6 @@ arc_get_data_buf(arc_buf_t *buf)
 			ARCSTAT_INCR(arcstat_data_size, size);
 			atomic_add_64(&arc_size, size);
 		}
-		ARCSTAT_BUMP(arcstat_recycle_miss);
 	}
 	ASSERT(buf->b_data != NULL);
 out:
@@ -2563,6 +3553,7 @@ out:
 		arc_buf_hdr_t *hdr = buf->b_hdr;
 
 		atomic_add_64(&hdr->b_state->arcs_size, size);
+		arc_objset_charge(hdr, hdr->b_state, size);
 		if (list_link_active(&hdr->b_arc_node)) {
 			ASSERT(refcount_is_zero(&hdr->b_refcnt));
 			atomic_add_64(&hdr->b_state->arcs_lsize[type], size);
@@ -2735,6 +3726,27 @@ arc_getbuf_func(zio_t *zio, arc_buf_t *buf, void *arg)
 	}
 }
 
+/*
+ * Completion for the read of an embedded block, whose buffer is never
+ * entered into the cache.
+ */
+static void
+arc_read_embedded_done(zio_t *zio)
+{
+	arc_callback_t *acb = zio->io_private;
+	arc_buf_t *buf = acb->acb_buf;
+
+	if (BP_SHOULD_BYTESWAP(zio->io_bp) && zio->io_error == 0) {
+		dmu_object_byteswap_t bswap =
+		    DMU_OT_BYTESWAP(BP_GET_TYPE(zio->io_bp));
+		dmu_ot_byteswap[bswap].ob_func(buf->b_data,
+		    buf->b_hdr->b_size);
+	}
+
+	acb->acb_done(zio, buf, acb->acb_private);
+	kmem_free(acb, sizeof (arc_callback_t));
+}
+
 static void
 arc_read_done(zio_t *zio)
 {
@@ -2767,9 +3779,48 @@ arc_read_done(zio_t *zio)
 	if (l2arc_noprefetch && (hdr->b_flags & ARC_PREFETCH))
 		hdr->b_flags &= ~ARC_L2CACHE;
 
-	/* byteswap if necessary */
 	callback_list = hdr->b_acb;
 	ASSERT(callback_list != NULL);
+
+	/*
+	 * If this was a raw read into b_pdata, only fill in the
+	 * uncompressed buffer if one of the callers wants the data.
+	 * A plain prefetch leaves the header holding just the
+	 * compressed copy, to be decompressed on first use; unless
+	 * it is bound for the L2ARC, which needs the uncompressed
+	 * data to checksum it.  The read went into a buffer borrowed
+	 * from b_pdata, which is handed back here either way.
+	 */
+	if (hdr->b_pdata != NULL) {
+		if (zio->io_error == 0 &&
+		    zio_decompress_data(hdr->b_pcompress, zio->io_data,
+		    buf->b_data, hdr->b_psize, hdr->b_size) != 0)
+			zio->io_error = SET_ERROR(EIO);
+
+		if (zio->io_error == 0) {
+			abd_return_buf_copy(hdr->b_pdata, zio->io_data,
+			    hdr->b_psize);
+		} else {
+			abd_return_buf(hdr->b_pdata, zio->io_data,
+			    hdr->b_psize);
+		}
+		zio->io_data = NULL;
+
+		for (acb = callback_list; acb; acb = acb->acb_next) {
+			if (acb->acb_done)
+				break;
+		}
+		if (zio->io_error == 0 && acb == NULL && hash_lock != NULL &&
+		    refcount_is_zero(&hdr->b_refcnt) &&
+		    (l2arc_ndev == 0 || !HDR_L2CACHE(hdr))) {
+			arc_buf_destroy(buf, FALSE, TRUE);
+			buf = NULL;
+			if (hdr->b_state != arc_anon)
+				arc_hdr_compressed_only(hdr);
+		}
+	}
+
+	/* byteswap if necessary */
 	if (BP_SHOULD_BYTESWAP(zio->io_bp) && zio->io_error == 0) {
 		dmu_object_byteswap_t bswap =
 		    DMU_OT_BYTESWAP(BP_GET_TYPE(zio->io_bp));
@@ -2779,8 +3830,10 @@ arc_read_done(zio_t *zio)
 		func(buf->b_data, hdr->b_size);
 	}
 
-	arc_cksum_compute(buf, B_FALSE);
-	arc_buf_watch(buf);
+	if (buf != NULL) {
+		arc_cksum_compute(buf, B_FALSE);
+		arc_buf_watch(buf);
+	}
 
 	if (hash_lock && zio->io_error == 0 && hdr->b_state == arc_anon) {
 		/*
@@ -2807,7 +3860,7 @@ arc_read_done(zio_t *zio)
 	hdr->b_acb = NULL;
 	hdr->b_flags &= ~ARC_IO_IN_PROGRESS;
 	ASSERT(!HDR_BUF_AVAILABLE(hdr));
-	if (abuf == buf) {
+	if (buf != NULL && abuf == buf) {
 		ASSERT(buf->b_efunc == NULL);
 		ASSERT(hdr->b_datacnt == 1);
 		hdr->b_flags |= ARC_BUF_AVAILABLE;
@@ -2891,10 +3944,39 @@ arc_read(zio_t *pio, spa_t *spa, const blkptr_t *bp, arc_done_func_t *done,
 	zio_t *rzio;
 	uint64_t guid = spa_load_guid(spa);
 
+	/*
+	 * An embedded block carries its data in the bp, so it is never
+	 * worth caching (or prefetching).  The read decodes it into an
+	 * anonymous buffer without doing any I/O.
+	 */
+	if (BP_IS_EMBEDDED(bp)) {
+		arc_callback_t *acb;
+
+		ASSERT3U(BPE_GET_ETYPE(bp), ==, BP_EMBEDDED_TYPE_DATA);
+		if (done == NULL)
+			return (0);
+
+		buf = arc_buf_alloc(spa, BP_GET_LSIZE(bp), private,
+		    BP_GET_BUFC_TYPE(bp));
+		acb = kmem_zalloc(sizeof (arc_callback_t), KM_SLEEP);
+		acb->acb_done = done;
+		acb->acb_private = private;
+		acb->acb_buf = buf;
+
+		rzio = zio_read(pio, spa, bp, buf->b_data, BP_GET_LSIZE(bp),
+		    arc_read_embedded_done, acb, priority, zio_flags, zb);
+		if (*arc_flags & ARC_WAIT)
+			return (zio_wait(rzio));
+
+		ASSERT(*arc_flags & ARC_NOWAIT);
+		zio_nowait(rzio);
+		return (0);
+	}
+
 top:
 	hdr = buf_hash_find(guid, BP_IDENTITY(bp), BP_PHYSICAL_BIRTH(bp),
 	    &hash_lock);
-	if (hdr && hdr->b_datacnt > 0) {
+	if (hdr && (hdr->b_datacnt > 0 || hdr->b_pdata != NULL)) {
 
 		*arc_flags |= ARC_CACHED;
 
@@ -2936,15 +4018,19 @@ top:
 			/*
 			 * If this block is already in use, create a new
 			 * copy of the data so that we will be guaranteed
-			 * that arc_release() will always succeed.
+			 * that arc_release() will always succeed.  If
+			 * all we have left is the compressed copy, that
+			 * is decompressed into a new buffer.
 			 */
 			buf = hdr->b_buf;
-			ASSERT(buf);
-			ASSERT(buf->b_data);
-			if (HDR_BUF_AVAILABLE(hdr)) {
+			if (buf == NULL) {
+				buf = arc_buf_decompress(hdr);
+			} else if (HDR_BUF_AVAILABLE(hdr)) {
+				ASSERT(buf->b_data);
 				ASSERT(buf->b_efunc == NULL);
 				hdr->b_flags &= ~ARC_BUF_AVAILABLE;
 			} else {
+				ASSERT(buf->b_data);
 				buf = arc_buf_clone(buf);
 			}
 
@@ -2992,6 +4078,10 @@ top:
 				(void) arc_buf_remove_ref(buf, private);
 				goto top; /* restart the IO request */
 			}
+			if (zb != NULL) {
+				hdr->b_aos = arc_objset_lookup(hdr->b_spa,
+				    zb->zb_objset);
+			}
 			/* if this is a prefetch, we don't have a reference */
 			if (*arc_flags & ARC_PREFETCH) {
 				(void) remove_reference(hdr, hash_lock,
@@ -3029,6 +4119,10 @@ top:
 			hdr->b_buf = buf;
 			ASSERT(hdr->b_datacnt == 0);
 			hdr->b_datacnt = 1;
+			if (hdr->b_aos == NULL && zb != NULL) {
+				hdr->b_aos = arc_objset_lookup(hdr->b_spa,
+				    zb->zb_objset);
+			}
 			arc_get_data_buf(buf);
 			arc_access(hdr, hash_lock);
 		}
@@ -3157,8 +4251,28 @@ top:
 			}
 		}
 
-		rzio = zio_read(pio, spa, bp, buf->b_data, size,
-		    arc_read_done, buf, priority, zio_flags, zb);
+		/*
+		 * Blocks that are compressed on disk are read in raw, and
+		 * kept that way in b_pdata.  arc_read_done() decompresses
+		 * them into the buffer, if anybody is waiting for it.
+		 */
+		if (zfs_compressed_arc_enabled &&
+		    BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF &&
+		    BP_GET_PSIZE(bp) < size && !BP_SHOULD_BYTESWAP(bp)) {
+			hash_lock = HDR_LOCK(hdr);
+			mutex_enter(hash_lock);
+			arc_hdr_alloc_pdata(hdr, BP_GET_PSIZE(bp),
+			    BP_GET_COMPRESS(bp));
+			mutex_exit(hash_lock);
+
+			rzio = zio_read(pio, spa, bp,
+			    abd_borrow_buf(hdr->b_pdata, hdr->b_psize),
+			    hdr->b_psize, arc_read_done, buf, priority,
+			    zio_flags | ZIO_FLAG_RAW, zb);
+		} else {
+			rzio = zio_read(pio, spa, bp, buf->b_data, size,
+			    arc_read_done, buf, priority, zio_flags, zb);
+		}
 
 		if (*arc_flags & ARC_WAIT)
 			return (zio_wait(rzio));
@@ -3169,6 +4283,41 @@ top:
 	return (0);
 }
 
+/*
+ * Read a block in its on-disk form, without decompressing it, into buf,
+ * which must hold BP_GET_PSIZE(bp) bytes.  If the ARC has kept the block's
+ * on-disk copy in b_pdata that is copied out; otherwise the block is read
+ * from disk raw, and is not added to the cache.  Used by zfs send, which
+ * puts compressed blocks into the stream as they are.
+ */
+int
+arc_read_raw(spa_t *spa, const blkptr_t *bp, void *buf,
+    zio_priority_t priority, int zio_flags, const zbookmark_t *zb)
+{
+	arc_buf_hdr_t *hdr;
+	kmutex_t *hash_lock;
+	uint64_t psize = BP_GET_PSIZE(bp);
+
+	ASSERT(!BP_IS_EMBEDDED(bp));
+	ASSERT(BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF);
+
+	hdr = buf_hash_find(spa_load_guid(spa), BP_IDENTITY(bp),
+	    BP_PHYSICAL_BIRTH(bp), &hash_lock);
+	if (hdr != NULL) {
+		if (!HDR_IO_IN_PROGRESS(hdr) && hdr->b_pdata != NULL &&
+		    hdr->b_psize == psize &&
+		    (hdr->b_state == arc_mru || hdr->b_state == arc_mfu)) {
+			abd_copy_to_buf(buf, hdr->b_pdata, psize);
+			mutex_exit(hash_lock);
+			return (0);
+		}
+		mutex_exit(hash_lock);
+	}
+
+	return (zio_wait(zio_read(NULL, spa, bp, buf, psize, NULL, NULL,
+	    priority, zio_flags | ZIO_FLAG_RAW, zb)));
+}
+
 void
 arc_set_callback(arc_buf_t *buf, arc_evict_func_t *func, void *private)
 {
@@ -3261,9 +4410,14 @@ arc_buf_evict(arc_buf_t *buf)
 	ASSERT(buf->b_data != NULL);
 	arc_buf_destroy(buf, FALSE, FALSE);
 
-	if (hdr->b_datacnt == 0) {
+	if (hdr->b_datacnt == 0 && hdr->b_pdata != NULL) {
+		ASSERT(refcount_is_zero(&hdr->b_refcnt));
+		hdr->b_flags &= ~ARC_BUF_AVAILABLE;
+		arc_hdr_compressed_only(hdr);
+	} else if (hdr->b_datacnt == 0) {
 		arc_state_t *old_state = hdr->b_state;
 		arc_state_t *evicted_state;
+		kmutex_t *old_lock, *evicted_lock;
 
 		ASSERT(hdr->b_buf == NULL);
 		ASSERT(refcount_is_zero(&hdr->b_refcnt));
@@ -3271,16 +4425,19 @@ arc_buf_evict(arc_buf_t *buf)
 		evicted_state =
 		    (old_state == arc_mru) ? arc_mru_ghost : arc_mfu_ghost;
 
-		mutex_enter(&old_state->arcs_mtx);
-		mutex_enter(&evicted_state->arcs_mtx);
+		old_lock = ARC_SUBLIST_LOCK(old_state, hdr);
+		evicted_lock = ARC_SUBLIST_LOCK(evicted_state, hdr);
+
+		mutex_enter(old_lock);
+		mutex_enter(evicted_lock);
 
 		arc_change_state(evicted_state, hdr, hash_lock);
 		ASSERT(HDR_IN_HASH_TABLE(hdr));
 		hdr->b_flags |= ARC_IN_HASH_TABLE;
 		hdr->b_flags &= ~ARC_BUF_AVAILABLE;
 
-		mutex_exit(&evicted_state->arcs_mtx);
-		mutex_exit(&old_state->arcs_mtx);
+		mutex_exit(evicted_lock);
+		mutex_exit(old_lock);
 	}
 	mutex_exit(hash_lock);
 	mutex_exit(&buf->b_evict_lock);
@@ -3363,6 +4520,7 @@ arc_release(arc_buf_t *buf, void *tag)
 
 		ASSERT3U(hdr->b_state->arcs_size, >=, hdr->b_size);
 		atomic_add_64(&hdr->b_state->arcs_size, -hdr->b_size);
+		arc_objset_charge(hdr, hdr->b_state, -hdr->b_size);
 		if (refcount_is_zero(&hdr->b_refcnt)) {
 			uint64_t *size = &hdr->b_state->arcs_lsize[hdr->b_type];
 			ASSERT3U(*size, >=, hdr->b_size);
@@ -3485,6 +4643,13 @@ arc_write_ready(zio_t *zio)
 	}
 	arc_cksum_compute(buf, B_FALSE);
 	hdr->b_flags |= ARC_IO_IN_PROGRESS;
+
+	if (zio->io_compress_saved != 0 && hdr->b_aos != NULL) {
+		atomic_inc_64(&AOSSTAT(hdr->b_aos,
+		    aosstat_compress_early_abort));
+		atomic_add_64(&AOSSTAT(hdr->b_aos, aosstat_compress_saved),
+		    zio->io_compress_saved);
+	}
 }
 
 /*
@@ -3509,7 +4674,7 @@ arc_write_done(zio_t *zio)
 	ASSERT(hdr->b_acb == NULL);
 
 	if (zio->io_error == 0) {
-		if (BP_IS_HOLE(zio->io_bp)) {
+		if (BP_IS_HOLE(zio->io_bp) || BP_IS_EMBEDDED(zio->io_bp)) {
 			buf_discard_identity(hdr);
 		} else {
 			hdr->b_dva = *BP_IDENTITY(zio->io_bp);
@@ -3521,10 +4686,10 @@ arc_write_done(zio_t *zio)
 	}
 
 	/*
-	 * If the block to be written was all-zero, we may have
-	 * compressed it away.  In this case no write was performed
-	 * so there will be no dva/birth/checksum.  The buffer must
-	 * therefore remain anonymous (and uncached).
+	 * If the block to be written was all-zero or compressed enough
+	 * to be embedded in the bp, no write was performed so there
+	 * will be no dva/birth/checksum.  The buffer must therefore
+	 * remain anonymous (and uncached).
 	 */
 	if (!BUF_EMPTY(hdr)) {
 		arc_buf_hdr_t *exists;
@@ -3600,6 +4765,8 @@ arc_write(zio_t *pio, spa_t *spa, uint64_t txg,
 		hdr->b_flags |= ARC_L2CACHE;
 	if (l2arc_compress)
 		hdr->b_flags |= ARC_L2COMPRESS;
+	if (hdr->b_aos == NULL && zb != NULL)
+		hdr->b_aos = arc_objset_lookup(hdr->b_spa, zb->zb_objset);
 	callback = kmem_zalloc(sizeof (arc_write_callback_t), KM_SLEEP);
 	callback->awcb_ready = ready;
 	callback->awcb_physdone = physdone;
@@ -3711,6 +4878,41 @@ arc_tempreserve_space(uint64_t reserve, uint64_t txg)
 	return (0);
 }
 
+static void
+arc_state_init(arc_state_t *state)
+{
+	state->arcs_sublists = kmem_zalloc(arc_sublist_cnt *
+	    sizeof (arc_sublist_t), KM_SLEEP);
+	for (int i = 0; i < arc_sublist_cnt; i++) {
+		arc_sublist_t *sl = &state->arcs_sublists[i];
+
+		mutex_init(&sl->asl_mtx, NULL, MUTEX_DEFAULT, NULL);
+		for (int t = 0; t < ARC_BUFC_NUMTYPES; t++) {
+			list_create(&sl->asl_list[t], sizeof (arc_buf_hdr_t),
+			    offsetof(arc_buf_hdr_t, b_arc_node));
+			list_create(&sl->asl_clist[t], sizeof (arc_buf_hdr_t),
+			    offsetof(arc_buf_hdr_t, b_arc_node));
+		}
+	}
+}
+
+static void
+arc_state_fini(arc_state_t *state)
+{
+	for (int i = 0; i < arc_sublist_cnt; i++) {
+		arc_sublist_t *sl = &state->arcs_sublists[i];
+
+		for (int t = 0; t < ARC_BUFC_NUMTYPES; t++) {
+			list_destroy(&sl->asl_list[t]);
+			list_destroy(&sl->asl_clist[t]);
+		}
+		mutex_destroy(&sl->asl_mtx);
+	}
+	kmem_free(state->arcs_sublists, arc_sublist_cnt *
+	    sizeof (arc_sublist_t));
+	state->arcs_sublists = NULL;
+}
+
 void
 arc_init(void)
 {
@@ -3760,6 +4962,9 @@ arc_init(void)
 	if (zfs_arc_meta_limit > 0 && zfs_arc_meta_limit <= arc_c_max)
 		arc_meta_limit = zfs_arc_meta_limit;
 
+	/* start metadata off with 1/8 of the cache, and let it adapt */
+	arc_meta_p = MIN(arc_c >> 3, arc_meta_limit);
+
 	if (arc_c_min < arc_meta_limit / 2 && zfs_arc_min == 0)
 		arc_c_min = arc_meta_limit / 2;
 
@@ -3786,33 +4991,18 @@ arc_init(void)
 	arc_l2c_only = &ARC_l2c_only;
 	arc_size = 0;
 
-	mutex_init(&arc_anon->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mru->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mru_ghost->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mfu->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_mfu_ghost->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&arc_l2c_only->arcs_mtx, NULL, MUTEX_DEFAULT, NULL);
-
-	list_create(&arc_mru->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mru->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mru_ghost->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mru_ghost->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu_ghost->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_mfu_ghost->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_l2c_only->arcs_list[ARC_BUFC_METADATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
-	list_create(&arc_l2c_only->arcs_list[ARC_BUFC_DATA],
-	    sizeof (arc_buf_hdr_t), offsetof(arc_buf_hdr_t, b_arc_node));
+	if (zfs_arc_num_sublists > 0)
+		arc_sublist_cnt = zfs_arc_num_sublists;
+	else
+		arc_sublist_cnt = MAX(max_ncpus, 4);
+	if (!ISP2(arc_sublist_cnt))
+		arc_sublist_cnt = 1 << highbit64(arc_sublist_cnt);
+
+	arc_state_init(arc_mru);
+	arc_state_init(arc_mru_ghost);
+	arc_state_init(arc_mfu);
+	arc_state_init(arc_mfu_ghost);
+	arc_state_init(arc_l2c_only);
 
 	buf_init();
 
@@ -3821,6 +5011,10 @@ arc_init(void)
 	mutex_init(&arc_eviction_mtx, NULL, MUTEX_DEFAULT, NULL);
 	bzero(&arc_eviction_hdr, sizeof (arc_buf_hdr_t));
 
+	rw_init(&arc_objset_lock, NULL, RW_DEFAULT, NULL);
+	avl_create(&arc_objset_tree, arc_objset_compare,
+	    sizeof (arc_objset_t), offsetof(arc_objset_t, aos_node));
+
 	arc_ksp = kstat_create("zfs", 0, "arcstats", "misc", KSTAT_TYPE_NAMED,
 	    sizeof (arc_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
 
@@ -3870,24 +5064,16 @@ arc_fini(void)
 	}
 
 	mutex_destroy(&arc_eviction_mtx);
+	avl_destroy(&arc_objset_tree);
+	rw_destroy(&arc_objset_lock);
 	mutex_destroy(&arc_reclaim_thr_lock);
 	cv_destroy(&arc_reclaim_thr_cv);
 
-	list_destroy(&arc_mru->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mru_ghost->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mfu->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mfu_ghost->arcs_list[ARC_BUFC_METADATA]);
-	list_destroy(&arc_mru->arcs_list[ARC_BUFC_DATA]);
-	list_destroy(&arc_mru_ghost->arcs_list[ARC_BUFC_DATA]);
-	list_destroy(&arc_mfu->arcs_list[ARC_BUFC_DATA]);
-	list_destroy(&arc_mfu_ghost->arcs_list[ARC_BUFC_DATA]);
-
-	mutex_destroy(&arc_anon->arcs_mtx);
-	mutex_destroy(&arc_mru->arcs_mtx);
-	mutex_destroy(&arc_mru_ghost->arcs_mtx);
-	mutex_destroy(&arc_mfu->arcs_mtx);
-	mutex_destroy(&arc_mfu_ghost->arcs_mtx);
-	mutex_destroy(&arc_l2c_only->arcs_mtx);
+	arc_state_fini(arc_mru);
+	arc_state_fini(arc_mru_ghost);
+	arc_state_fini(arc_mfu);
+	arc_state_fini(arc_mfu_ghost);
+	arc_state_fini(arc_l2c_only);
 
 	buf_fini();
 
@@ -4001,6 +5187,14 @@ arc_fini(void)
  * there are no L2ARC reads, and no fear of degrading read performance
  * through increased writes.
  *
+ * With l2arc_feed_adaptive set, the write size is not fixed.  Each write
+ * measures the bandwidth the device delivered, and while the ARC is cold
+ * the feed writes as much as the device can take in one short feed
+ * interval.  Once warm, the feed writes enough to cover the eligible
+ * buffers the ARC evicted since the last feed, up to l2arc_write_bw_pct
+ * of the device's bandwidth.  Evicted demand that the feed did not cover
+ * is counted in the l2_feed_deficit kstat.
+ *
  * 6. Writes to the L2ARC devices are grouped and sent in-sequence, so that
  * the vdev queue can aggregate them into larger and fewer writes.  Each
  * device is written to in a rotor fashion, sweeping writes through
@@ -4012,6 +5206,10 @@ arc_fini(void)
  * 8. If an ARC buffer is written (and dirtied) which also exists in the
  * L2ARC, the now stale L2ARC buffer is immediately dropped.
  *
+ * 9. Every buffer written to an L2ARC device is also recorded in a log
+ * on that device, so that the contents of the L2ARC survive a reboot or
+ * pool export.  See "Persistent L2ARC" below.
+ *
  * The performance of the L2ARC can be tweaked by a number of tunables, which
  * may be necessary for different workloads:
  *
@@ -4025,6 +5223,13 @@ arc_fini(void)
  *				since more compressed buffers are likely to
  *				be present
  *	l2arc_feed_secs		seconds between L2ARC writing
+ *	l2arc_feed_adaptive	size each write from the measured device
+ *				bandwidth and the ARC eviction rate, with
+ *				l2arc_write_max as a floor
+ *	l2arc_write_bw_pct	share of the measured bandwidth an adaptive
+ *				write may use once the ARC is warm
+ *	l2arc_rebuild_enabled	rebuild L2ARC contents from the on-device
+ *				log when the pool is imported
  *
  * Tunables may be removed or added as future performance improvements are
  * integrated, and also may become zpool properties.
@@ -4056,10 +5261,17 @@ l2arc_write_eligible(uint64_t spa_guid, arc_buf_hdr_t *ab)
 	return (B_TRUE);
 }
 
+/*
+ * Work out how much to write to this device in the current feed.
+ * *demandp is set to the amount of L2ARC-eligible data the ARC has
+ * evicted since the previous feed, so the caller can account for
+ * whatever it does not manage to cover.
+ */
 static uint64_t
-l2arc_write_size(void)
+l2arc_write_size(l2arc_dev_t *dev, uint64_t *demandp)
 {
-	uint64_t size;
+	static uint64_t evicted_last;
+	uint64_t size, evicted, capacity;
 
 	/*
 	 * Make sure our globals have meaningful values in case the user
@@ -4076,8 +5288,53 @@ l2arc_write_size(void)
 	if (arc_warm == B_FALSE)
 		size += l2arc_write_boost;
 
-	return (size);
+	/* only the feed thread gets here, so no locking is needed */
+	evicted = ARCSTAT(arcstat_evict_l2_eligible);
+	*demandp = evicted - evicted_last;
+	evicted_last = evicted;
+
+	if (!l2arc_feed_adaptive || dev->l2ad_write_bps == 0)
+		return (size);
+
+	/*
+	 * What the device can absorb in one short feed interval.  Until
+	 * the ARC is warm there are no L2ARC reads to compete with, so
+	 * the device may have all of it.
+	 */
+	capacity = dev->l2ad_write_bps * l2arc_feed_min_ms / 1000;
+	if (arc_warm == B_FALSE)
+		size = MAX(size, capacity);
+	else
+		size = MAX(size, MIN(*demandp,
+		    capacity * MIN(l2arc_write_bw_pct, 100) / 100));
+
+	/*
+	 * Don't let one write sweep through a large part of the device;
+	 * l2arc_evict() would have to clear it all ahead of the hand.
+	 */
+	return (MAX(l2arc_write_max,
+	    MIN(size, (dev->l2ad_end - dev->l2ad_start) / 8)));
+}
+
+/*
+ * Fold the completion time of the last write into the device's write
+ * bandwidth estimate.  Small writes are dominated by latency rather than
+ * throughput and are not counted.
+ */
+static void
+l2arc_write_bw_update(l2arc_dev_t *dev, uint64_t bytes, hrtime_t delta)
+{
+	uint64_t bps;
 
+	if (bytes < L2ARC_BW_MIN_SAMPLE || delta <= 0)
+		return;
+
+	bps = bytes * MICROSEC / MAX(delta / (NANOSEC / MICROSEC), 1);
+	if (dev->l2ad_write_bps == 0)
+		dev->l2ad_write_bps = bps;
+	else
+		dev->l2ad_write_bps = (7 * dev->l2ad_write_bps + bps) / 8;
+	ARCSTAT(arcstat_l2_feed_bw) = dev->l2ad_write_bps;
 }
 
 static clock_t
@@ -4155,10 +5412,14 @@ l2arc_dev_get_next(void)
 		else if (next == first)
 			break;
 
-	} while (vdev_is_dead(next->l2ad_vdev));
+	} while (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild);
 
-	/* if we were unable to find any usable vdevs, return NULL */
-	if (vdev_is_dead(next->l2ad_vdev))
+	/*
+	 * If we were unable to find any usable vdevs, return NULL.  Devices
+	 * whose contents are still being rebuilt are left alone until
+	 * l2arc_rebuild() has restored their write hand.
+	 */
+	if (vdev_is_dead(next->l2ad_vdev) || next->l2ad_rebuild)
 		next = NULL;
 
 	l2arc_dev_last = next;
@@ -4364,37 +5625,62 @@ l2arc_read_done(zio_t *zio)
 
 /*
  * This is the list priority from which the L2ARC will search for pages to
- * cache.  This is used within loops (0..3) to cycle through lists in the
- * desired order.  This order can have a significant effect on cache
- * performance.
+ * cache.  This is used within loops (0..L2ARC_NLISTS-1) to cycle through
+ * lists in the desired order.  This order can have a significant effect on
+ * cache performance.
  *
  * Currently the metadata lists are hit first, MFU then MRU, followed by
- * the data lists.  This function returns a locked list, and also returns
- * the lock pointer.
+ * the data lists.  The lists of headers holding only compressed data
+ * come last, in the same order.  Each of these kinds is made up of one
+ * list per sublist, which are all visited before moving on to the next
+ * kind.  This function returns a locked list, and also returns the lock
+ * pointer.
  */
+#define	L2ARC_NLISTS	(8 * arc_sublist_cnt)
+
 static list_t *
 l2arc_list_locked(int list_num, kmutex_t **lock)
 {
+	arc_sublist_t *mfu, *mru;
 	list_t *list = NULL;
 
-	ASSERT(list_num >= 0 && list_num <= 3);
+	ASSERT(list_num >= 0 && list_num < L2ARC_NLISTS);
+
+	mfu = &arc_mfu->arcs_sublists[list_num % arc_sublist_cnt];
+	mru = &arc_mru->arcs_sublists[list_num % arc_sublist_cnt];
 
-	switch (list_num) {
+	switch (list_num / arc_sublist_cnt) {
 	case 0:
-		list = &arc_mfu->arcs_list[ARC_BUFC_METADATA];
-		*lock = &arc_mfu->arcs_mtx;
+		list = &mfu->asl_list[ARC_BUFC_METADATA];
+		*lock = &mfu->asl_mtx;
 		break;
 	case 1:
-		list = &arc_mru->arcs_list[ARC_BUFC_METADATA];
-		*lock = &arc_mru->arcs_mtx;
+		list = &mru->asl_list[ARC_BUFC_METADATA];
+		*lock = &mru->asl_mtx;
 		break;
 	case 2:
-		list = &arc_mfu->arcs_list[ARC_BUFC_DATA];
-		*lock = &arc_mfu->arcs_mtx;
+		list = &mfu->asl_list[ARC_BUFC_DATA];
+		*lock = &mfu->asl_mtx;
 		break;
 	case 3:
-		list = &arc_mru->arcs_list[ARC_BUFC_DATA];
-		*lock = &arc_mru->arcs_mtx;
+		list = &mru->asl_list[ARC_BUFC_DATA];
+		*lock = &mru->asl_mtx;
+		break;
+	case 4:
+		list = &mfu->asl_clist[ARC_BUFC_METADATA];
+		*lock = &mfu->asl_mtx;
+		break;
+	case 5:
+		list = &mru->asl_clist[ARC_BUFC_METADATA];
+		*lock = &mru->asl_mtx;
+		break;
+	case 6:
+		list = &mfu->asl_clist[ARC_BUFC_DATA];
+		*lock = &mfu->asl_mtx;
+		break;
+	case 7:
+		list = &mru->asl_clist[ARC_BUFC_DATA];
+		*lock = &mru->asl_mtx;
 		break;
 	}
 
@@ -4561,6 +5847,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 	zio_t *pio, *wzio;
 	uint64_t guid = spa_load_guid(spa);
 	const boolean_t do_headroom_boost = *headroom_boost;
+	hrtime_t start;
 
 	ASSERT(dev->l2ad_vdev != NULL);
 
@@ -4583,7 +5870,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 	 * Copy buffers for L2ARC writing.
 	 */
 	mutex_enter(&l2arc_buflist_mtx);
-	for (int try = 0; try <= 3; try++) {
+	for (int try = 0; try < L2ARC_NLISTS; try++) {
 		uint64_t passed_sz = 0;
 
 		list = l2arc_list_locked(try, &list_lock);
@@ -4599,7 +5886,8 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 		else
 			ab = list_tail(list);
 
-		headroom = target_sz * l2arc_headroom;
+		/* the headroom is spread across the sublists of each kind */
+		headroom = target_sz * l2arc_headroom / arc_sublist_cnt;
 		if (do_headroom_boost)
 			headroom = (headroom * l2arc_headroom_boost) / 100;
 
@@ -4635,6 +5923,16 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 				continue;
 			}
 
+			/*
+			 * Without its uncompressed data, a header can only
+			 * be written if arc_evict() left us the checksum to
+			 * validate it with on the way back.
+			 */
+			if (ab->b_buf == NULL && ab->b_freeze_cksum == NULL) {
+				mutex_exit(hash_lock);
+				continue;
+			}
+
 			if ((write_sz + ab->b_size) > target_sz) {
 				full = B_TRUE;
 				mutex_exit(hash_lock);
@@ -4672,9 +5970,26 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 			 * can't access without holding the ARC list locks
 			 * (which we want to avoid during compression/writing).
 			 */
-			l2hdr->b_compress = ZIO_COMPRESS_OFF;
-			l2hdr->b_asize = ab->b_size;
-			l2hdr->b_tmp_cdata = ab->b_buf->b_data;
+			if (ab->b_pdata != NULL) {
+				/*
+				 * We already hold the block as it is on
+				 * disk; write that out as is instead of
+				 * compressing it all over again.  b_pdata
+				 * may be scattered, and may be freed before
+				 * the write is done, so take a linear copy.
+				 */
+				l2hdr->b_compress = ab->b_pcompress;
+				l2hdr->b_asize = ab->b_psize;
+				l2hdr->b_tmp_cdata =
+				    zio_data_buf_alloc(ab->b_psize);
+				abd_copy_to_buf(l2hdr->b_tmp_cdata,
+				    ab->b_pdata, ab->b_psize);
+				l2hdr->b_tmp_cdata_copied = B_TRUE;
+			} else {
+				l2hdr->b_compress = ZIO_COMPRESS_OFF;
+				l2hdr->b_asize = ab->b_size;
+				l2hdr->b_tmp_cdata = ab->b_buf->b_data;
+			}
 
 			buf_sz = ab->b_size;
 			ab->b_l2hdr = l2hdr;
@@ -4685,8 +6000,10 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 			 * Compute and store the buffer cksum before
 			 * writing.  On debug the cksum is verified first.
 			 */
-			arc_cksum_verify(ab->b_buf);
-			arc_cksum_compute(ab->b_buf, B_TRUE);
+			if (ab->b_buf != NULL) {
+				arc_cksum_verify(ab->b_buf);
+				arc_cksum_compute(ab->b_buf, B_TRUE);
+			}
 
 			mutex_exit(hash_lock);
 
@@ -4726,7 +6043,10 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 		l2hdr = ab->b_l2hdr;
 		l2hdr->b_daddr = dev->l2ad_hand;
 
-		if ((ab->b_flags & ARC_L2COMPRESS) &&
+		if (l2hdr->b_tmp_cdata_copied) {
+			/* Already compressed, courtesy of the ARC. */
+			*headroom_boost = B_TRUE;
+		} else if ((ab->b_flags & ARC_L2COMPRESS) &&
 		    l2hdr->b_asize >= buf_compress_minsz) {
 			if (l2arc_compress_buf(l2hdr)) {
 				/*
@@ -4765,6 +6085,14 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 			write_psize += buf_p_sz;
 			dev->l2ad_hand += buf_p_sz;
 		}
+
+		/*
+		 * Record the buffer in the device's log so it can be
+		 * rebuilt after a reboot or pool import.  Full log blocks
+		 * are written out right behind the buffers they describe.
+		 */
+		if (l2arc_log_blk_insert(dev, ab))
+			write_psize += l2arc_log_blk_commit(dev, pio);
 	}
 
 	mutex_exit(&l2arc_buflist_mtx);
@@ -4780,7 +6108,8 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 	 * Bump device hand to the device start if it is approaching the end.
 	 * l2arc_evict() will already have evicted ahead for this case.
 	 */
-	if (dev->l2ad_hand >= (dev->l2ad_end - target_sz)) {
+	if (dev->l2ad_hand >= (dev->l2ad_end - target_sz -
+	    l2arc_log_blk_overhead(target_sz))) {
 		vdev_space_update(dev->l2ad_vdev,
 		    dev->l2ad_end - dev->l2ad_hand, 0, 0);
 		dev->l2ad_hand = dev->l2ad_start;
@@ -4788,8 +6117,18 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz,
 		dev->l2ad_first = B_FALSE;
 	}
 
+	/*
+	 * Record the new hand positions and newest log block in the device
+	 * header.  This goes out in the same zio tree as the buffers and log
+	 * blocks themselves; if we crash before all of them land, the
+	 * checksums will catch it at rebuild time.
+	 */
+	l2arc_dev_hdr_update(dev, pio);
+
 	dev->l2ad_writing = B_TRUE;
+	start = gethrtime();
 	(void) zio_wait(pio);
+	l2arc_write_bw_update(dev, write_asize, gethrtime() - start);
 	dev->l2ad_writing = B_FALSE;
 
 	return (write_asize);
@@ -4826,7 +6165,7 @@ l2arc_compress_buf(l2arc_buf_hdr_t *l2hdr)
 	len = l2hdr->b_asize;
 	cdata = zio_data_buf_alloc(len);
 	csize = zio_compress_data(ZIO_COMPRESS_LZ4, l2hdr->b_tmp_cdata,
-	    cdata, l2hdr->b_asize);
+	    cdata, l2hdr->b_asize, NULL);
 
 	if (csize == 0) {
 		/* zero block, indicate that there's nothing to write */
@@ -4930,7 +6269,12 @@ l2arc_release_cdata_buf(arc_buf_hdr_t *ab)
 {
 	l2arc_buf_hdr_t *l2hdr = ab->b_l2hdr;
 
-	if (l2hdr->b_compress == ZIO_COMPRESS_LZ4) {
+	if (l2hdr->b_tmp_cdata_copied) {
+		/* A copy of b_pdata, taken in l2arc_write_buffers(). */
+		ASSERT(l2hdr->b_tmp_cdata != NULL);
+		zio_data_buf_free(l2hdr->b_tmp_cdata, l2hdr->b_asize);
+		l2hdr->b_tmp_cdata_copied = B_FALSE;
+	} else if (l2hdr->b_compress == ZIO_COMPRESS_LZ4) {
 		/*
 		 * If the data was compressed, then we've allocated a
 		 * temporary buffer for it, so now we need to release it.
@@ -4951,7 +6295,7 @@ l2arc_feed_thread(void)
 	callb_cpr_t cpr;
 	l2arc_dev_t *dev;
 	spa_t *spa;
-	uint64_t size, wrote;
+	uint64_t size, wrote, demand;
 	clock_t begin, next = ddi_get_lbolt();
 	boolean_t headroom_boost = B_FALSE;
 
@@ -5014,17 +6358,20 @@ l2arc_feed_thread(void)
 
 		ARCSTAT_BUMP(arcstat_l2_feeds);
 
-		size = l2arc_write_size();
+		size = l2arc_write_size(dev, &demand);
 
 		/*
-		 * Evict L2ARC buffers that will be overwritten.
+		 * Evict L2ARC buffers that will be overwritten.  This has
+		 * to include room for any log blocks we commit along the way.
 		 */
-		l2arc_evict(dev, size, B_FALSE);
+		l2arc_evict(dev, size + l2arc_log_blk_overhead(size), B_FALSE);
 
 		/*
 		 * Write ARC buffers.
 		 */
 		wrote = l2arc_write_buffers(spa, dev, size, &headroom_boost);
+		if (demand > wrote)
+			ARCSTAT_INCR(arcstat_l2_feed_deficit, demand - wrote);
 
 		/*
 		 * Calculate interval between writes.
@@ -5063,22 +6410,38 @@ void
 l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 {
 	l2arc_dev_t *adddev;
+	spa_load_state_t load_state = spa_load_state(spa);
 
 	ASSERT(!l2arc_vdev_present(vd));
 
 	/*
-	 * Create a new l2arc device entry.
+	 * Create a new l2arc device entry.  The first block after the
+	 * front labels is reserved for the persistent device header.
 	 */
 	adddev = kmem_zalloc(sizeof (l2arc_dev_t), KM_SLEEP);
 	adddev->l2ad_spa = spa;
 	adddev->l2ad_vdev = vd;
-	adddev->l2ad_start = VDEV_LABEL_START_SIZE;
+	adddev->l2ad_dev_hdr_asize = vdev_psize_to_asize(vd,
+	    sizeof (l2arc_dev_hdr_phys_t));
+	adddev->l2ad_dev_hdr = kmem_zalloc(adddev->l2ad_dev_hdr_asize,
+	    KM_SLEEP);
+	adddev->l2ad_log_blk = kmem_zalloc(sizeof (l2arc_log_blk_phys_t),
+	    KM_SLEEP);
+	adddev->l2ad_start = VDEV_LABEL_START_SIZE + adddev->l2ad_dev_hdr_asize;
 	adddev->l2ad_end = VDEV_LABEL_START_SIZE + vdev_get_min_asize(vd);
 	adddev->l2ad_hand = adddev->l2ad_start;
 	adddev->l2ad_evict = adddev->l2ad_start;
 	adddev->l2ad_first = B_TRUE;
 	adddev->l2ad_writing = B_FALSE;
 
+	/*
+	 * If the device is being opened as part of a pool load, hold off
+	 * the feed thread until l2arc_spa_rebuild_start() has had a chance
+	 * to recover the previous contents of the device.
+	 */
+	adddev->l2ad_rebuild = l2arc_rebuild_enabled &&
+	    load_state != SPA_LOAD_NONE && load_state != SPA_LOAD_TRYIMPORT;
+
 	/*
 	 * This is a list of all ARC buffers that are still valid on the
 	 * device.
@@ -5127,12 +6490,26 @@ l2arc_remove_vdev(vdev_t *vd)
 	atomic_dec_64(&l2arc_ndev);
 	mutex_exit(&l2arc_dev_mtx);
 
+	/*
+	 * Cancel any rebuild still in progress and wait for its thread to
+	 * let go of the device.
+	 */
+	mutex_enter(&l2arc_rebuild_thr_lock);
+	if (remdev->l2ad_rebuild_began) {
+		remdev->l2ad_rebuild_cancel = B_TRUE;
+		while (remdev->l2ad_rebuild)
+			cv_wait(&l2arc_rebuild_thr_cv, &l2arc_rebuild_thr_lock);
+	}
+	mutex_exit(&l2arc_rebuild_thr_lock);
+
 	/*
 	 * Clear all buflists and ARC references.  L2ARC device flush.
 	 */
 	l2arc_evict(remdev, 0, B_TRUE);
 	list_destroy(remdev->l2ad_buflist);
 	kmem_free(remdev->l2ad_buflist, sizeof (list_t));
+	kmem_free(remdev->l2ad_log_blk, sizeof (l2arc_log_blk_phys_t));
+	kmem_free(remdev->l2ad_dev_hdr, remdev->l2ad_dev_hdr_asize);
 	kmem_free(remdev, sizeof (l2arc_dev_t));
 }
 
@@ -5146,6 +6523,8 @@ l2arc_init(void)
 
 	mutex_init(&l2arc_feed_thr_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&l2arc_feed_thr_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&l2arc_rebuild_thr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&l2arc_rebuild_thr_cv, NULL, CV_DEFAULT, NULL);
 	mutex_init(&l2arc_dev_mtx, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&l2arc_buflist_mtx, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&l2arc_free_on_write_mtx, NULL, MUTEX_DEFAULT, NULL);
@@ -5171,6 +6550,8 @@ l2arc_fini(void)
 
 	mutex_destroy(&l2arc_feed_thr_lock);
 	cv_destroy(&l2arc_feed_thr_cv);
+	mutex_destroy(&l2arc_rebuild_thr_lock);
+	cv_destroy(&l2arc_rebuild_thr_cv);
 	mutex_destroy(&l2arc_dev_mtx);
 	mutex_destroy(&l2arc_buflist_mtx);
 	mutex_destroy(&l2arc_free_on_write_mtx);
@@ -5202,3 +6583,563 @@ l2arc_stop(void)
 		cv_wait(&l2arc_feed_thr_cv, &l2arc_feed_thr_lock);
 	mutex_exit(&l2arc_feed_thr_lock);
 }
+
+/*
+ * Persistent L2ARC
+ *
+ * Rewarming a large L2ARC device at the feed rate can take hours, so the
+ * feed thread also keeps a log on each device describing the buffers it
+ * holds.  After a reboot or pool import that log is used to reconstruct
+ * ARC_l2c_only headers for everything still on the device.
+ *
+ * The log consists of a device header (l2arc_dev_hdr_phys_t) in the first
+ * block after the front vdev labels, and a chain of log blocks
+ * (l2arc_log_blk_phys_t) interleaved with the buffers on the device.  Each
+ * log block describes the L2ARC_LOG_BLK_ENTRIES buffers written just
+ * before it and points back at the log block before that:
+ *
+ *	      dh_start_lbp
+ *	    .-----------------------------------------.
+ *	    |                                         V
+ *	+-------+------+------+------+------+------+------+------+-----+
+ *	|dev hdr| bufs |  lb  | bufs |  lb  | bufs |  lb  | bufs | ... |
+ *	+-------+------+------+------+------+------+------+------+-----+
+ *	                  ^               ^ |            |
+ *	                  `---------------)-'            |
+ *	                                  `--------------'
+ *	                                    lb_prev_lbp
+ *
+ * Log blocks are LZ4 compressed and each is protected by a fletcher4
+ * checksum kept in the pointer to it.  The device header, which is
+ * rewritten at the end of every feed pass, records the device write and
+ * eviction hands at that time; on rebuild everything between them is
+ * treated as already overwritten.  Since the device is used as a ring,
+ * walking the chain backwards must carry us strictly further back around
+ * the ring from the write hand, which bounds the walk to one lap of the
+ * device and protects us against loops built out of stale log blocks.
+ *
+ * Rebuilt buffers keep the freeze checksum they had when they were
+ * written, which l2arc_read_done() already verifies on every L2ARC read.
+ * A log entry describing a buffer that has since been overwritten (e.g.
+ * because we crashed before the device header update landed) therefore
+ * simply turns into an L2ARC checksum miss and a read from the pool.
+ *
+ * Cache devices opened as part of a pool load are marked by
+ * l2arc_add_vdev() and skipped by the feed thread until the rebuild,
+ * started by l2arc_spa_rebuild_start() once spa_load() has succeeded,
+ * has finished.  Rebuilds run in their own thread so import isn't held
+ * up, and stop early if the ARC comes under memory pressure or the
+ * device is removed.
+ */
+
+/*
+ * Worst-case space taken up by the log blocks committed while writing
+ * write_sz bytes worth of buffers in a single feed pass.
+ */
+static uint64_t
+l2arc_log_blk_overhead(uint64_t write_sz)
+{
+	uint64_t nblks;
+
+	nblks = (write_sz >> SPA_MINBLOCKSHIFT) / L2ARC_LOG_BLK_ENTRIES + 1;
+	return (nblks * L2ARC_LOG_BLK_SIZE);
+}
+
+/*
+ * Add a just-written buffer to the device's open log block.  Must be
+ * called with l2arc_buflist_mtx held, which keeps the buffer's identity
+ * from being discarded by arc_release().  Returns B_TRUE if the log block
+ * is now full and needs to be committed.
+ */
+static boolean_t
+l2arc_log_blk_insert(l2arc_dev_t *dev, arc_buf_hdr_t *ab)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_buf_hdr_t *l2hdr = ab->b_l2hdr;
+	l2arc_log_ent_phys_t *le;
+
+	ASSERT(MUTEX_HELD(&l2arc_buflist_mtx));
+	ASSERT3S(dev->l2ad_log_ent_idx, <, L2ARC_LOG_BLK_ENTRIES);
+
+	le = &lb->lb_entries[dev->l2ad_log_ent_idx];
+
+	mutex_enter(&ab->b_freeze_lock);
+	if (ab->b_freeze_cksum == NULL) {
+		/* can't be verified on read back, so don't bother */
+		mutex_exit(&ab->b_freeze_lock);
+		return (B_FALSE);
+	}
+	le->le_freeze_cksum = *ab->b_freeze_cksum;
+	mutex_exit(&ab->b_freeze_lock);
+
+	le->le_dva = ab->b_dva;
+	le->le_birth = ab->b_birth;
+	le->le_cksum0 = ab->b_cksum0;
+	le->le_daddr = l2hdr->b_daddr;
+	le->le_prop = 0;
+	L2BLK_SET_LSIZE(le->le_prop, ab->b_size);
+	L2BLK_SET_PSIZE(le->le_prop, l2hdr->b_asize);
+	L2BLK_SET_COMPRESS(le->le_prop, l2hdr->b_compress);
+	L2BLK_SET_TYPE(le->le_prop, ab->b_type);
+	L2BLK_SET_L2COMPRESS(le->le_prop, (ab->b_flags & ARC_L2COMPRESS) != 0);
+
+	return (++dev->l2ad_log_ent_idx == L2ARC_LOG_BLK_ENTRIES);
+}
+
+static void
+l2arc_log_blk_write_done(zio_t *zio)
+{
+	zio_data_buf_free(zio->io_private, sizeof (l2arc_log_blk_phys_t));
+}
+
+/*
+ * Write out the device's full log block at the current write hand and
+ * chain it onto the previous one.  Returns the device space consumed.
+ */
+static uint64_t
+l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_log_blkptr_t *lbp = &dev->l2ad_dev_hdr->dh_start_lbp;
+	enum zio_compress compress = ZIO_COMPRESS_LZ4;
+	uint64_t psize, asize;
+	zio_t *wzio;
+	void *pbuf;
+
+	ASSERT3S(dev->l2ad_log_ent_idx, ==, L2ARC_LOG_BLK_ENTRIES);
+
+	lb->lb_magic = L2ARC_LOG_BLK_MAGIC;
+	lb->lb_prev_lbp = *lbp;
+
+	pbuf = zio_data_buf_alloc(sizeof (*lb));
+	psize = zio_compress_data(ZIO_COMPRESS_LZ4, lb, pbuf, sizeof (*lb),
+	    NULL);
+	ASSERT(psize != 0);	/* the magic number is never zero */
+	if (psize >= sizeof (*lb)) {
+		bcopy(lb, pbuf, sizeof (*lb));
+		psize = sizeof (*lb);
+		compress = ZIO_COMPRESS_OFF;
+	}
+	asize = vdev_psize_to_asize(dev->l2ad_vdev, psize);
+	ASSERT3U(asize, <=, sizeof (*lb));
+	if (asize > psize)
+		bzero((char *)pbuf + psize, asize - psize);
+
+	lbp->lbp_daddr = dev->l2ad_hand;
+	lbp->lbp_prop = 0;
+	L2BLK_SET_LSIZE(lbp->lbp_prop, sizeof (*lb));
+	L2BLK_SET_PSIZE(lbp->lbp_prop, asize);
+	L2BLK_SET_COMPRESS(lbp->lbp_prop, compress);
+	L2BLK_SET_CHECKSUM(lbp->lbp_prop, ZIO_CHECKSUM_FLETCHER_4);
+	fletcher_4_native(pbuf, asize, &lbp->lbp_cksum);
+
+	wzio = zio_write_phys(pio, dev->l2ad_vdev, dev->l2ad_hand, asize,
+	    pbuf, ZIO_CHECKSUM_OFF, l2arc_log_blk_write_done, pbuf,
+	    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL, B_FALSE);
+	DTRACE_PROBE2(l2arc__log__blk__write, vdev_t *, dev->l2ad_vdev,
+	    zio_t *, wzio);
+	(void) zio_nowait(wzio);
+
+	dev->l2ad_hand += asize;
+	ARCSTAT_BUMP(arcstat_l2_log_blk_writes);
+
+	bzero(lb, sizeof (*lb));
+	dev->l2ad_log_ent_idx = 0;
+
+	return (asize);
+}
+
+/*
+ * Write out the device header describing the current state of the device.
+ * The header buffer is only modified by the feed thread, which waits for
+ * this write to complete before starting its next pass.
+ */
+static void
+l2arc_dev_hdr_update(l2arc_dev_t *dev, zio_t *pio)
+{
+	l2arc_dev_hdr_phys_t *hdr = dev->l2ad_dev_hdr;
+	zio_t *wzio;
+
+	hdr->dh_magic = L2ARC_DEV_HDR_MAGIC;
+	hdr->dh_version = L2ARC_PERSIST_VERSION;
+	hdr->dh_spa_guid = spa_guid(dev->l2ad_spa);
+	hdr->dh_vdev_guid = dev->l2ad_vdev->vdev_guid;
+	hdr->dh_flags = dev->l2ad_first ? L2ARC_DEV_HDR_EVICT_FIRST : 0;
+	hdr->dh_hand = dev->l2ad_hand;
+	hdr->dh_evict = dev->l2ad_evict;
+	fletcher_4_native(hdr, offsetof(l2arc_dev_hdr_phys_t, dh_self_cksum),
+	    &hdr->dh_self_cksum);
+
+	wzio = zio_write_phys(pio, dev->l2ad_vdev, VDEV_LABEL_START_SIZE,
+	    dev->l2ad_dev_hdr_asize, hdr, ZIO_CHECKSUM_OFF, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL, B_FALSE);
+	DTRACE_PROBE2(l2arc__dev__hdr__write, vdev_t *, dev->l2ad_vdev,
+	    zio_t *, wzio);
+	(void) zio_nowait(wzio);
+}
+
+/*
+ * Returns B_TRUE if [daddr, daddr + size) on the device still holds what
+ * was written there before the device header was last updated.  The
+ * range between the write hand and the eviction hand (or the end of the
+ * device, on the first sweep) was being overwritten or was never written.
+ */
+static boolean_t
+l2arc_range_valid(const l2arc_dev_t *dev, uint64_t daddr, uint64_t size)
+{
+	uint64_t stale_end = dev->l2ad_first ? dev->l2ad_end : dev->l2ad_evict;
+
+	if (daddr < dev->l2ad_start || daddr + size > dev->l2ad_end)
+		return (B_FALSE);
+
+	return (daddr + size <= dev->l2ad_hand || daddr >= stale_end);
+}
+
+/*
+ * How far back around the device's ring daddr is from the write hand.
+ */
+static uint64_t
+l2arc_range_age(const l2arc_dev_t *dev, uint64_t daddr)
+{
+	if (daddr < dev->l2ad_hand)
+		return (dev->l2ad_hand - daddr);
+
+	return ((dev->l2ad_hand - dev->l2ad_start) + (dev->l2ad_end - daddr));
+}
+
+/*
+ * I/O to a rebuilding device must hold SCL_L2ARC as reader, like any other
+ * L2ARC read.  We can't block for it though: l2arc_remove_vdev() is called
+ * with the config lock held as writer and waits for us to notice that the
+ * rebuild has been cancelled.
+ */
+static int
+l2arc_rebuild_read(l2arc_dev_t *dev, uint64_t daddr, uint64_t size, void *buf)
+{
+	spa_t *spa = dev->l2ad_spa;
+	vdev_t *vd = dev->l2ad_vdev;
+	int err;
+
+	while (!spa_config_tryenter(spa, SCL_L2ARC, dev, RW_READER)) {
+		if (dev->l2ad_rebuild_cancel)
+			return (SET_ERROR(ECANCELED));
+		delay(1);
+	}
+
+	if (dev->l2ad_rebuild_cancel || vdev_is_dead(vd)) {
+		spa_config_exit(spa, SCL_L2ARC, dev);
+		return (SET_ERROR(ECANCELED));
+	}
+
+	err = zio_wait(zio_read_phys(NULL, vd, daddr, size, buf,
+	    ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_ASYNC_READ,
+	    ZIO_FLAG_DONT_CACHE | ZIO_FLAG_CANFAIL |
+	    ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY, B_FALSE));
+	spa_config_exit(spa, SCL_L2ARC, dev);
+
+	if (err != 0)
+		ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+
+	return (err);
+}
+
+/*
+ * Read and validate the device header.  Headers written with a different
+ * byte order are treated as unsupported; such imports start out cold.
+ */
+static int
+l2arc_dev_hdr_read(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *hdr = dev->l2ad_dev_hdr;
+	zio_cksum_t cksum;
+	int err;
+
+	err = l2arc_rebuild_read(dev, VDEV_LABEL_START_SIZE,
+	    dev->l2ad_dev_hdr_asize, hdr);
+	if (err != 0)
+		return (err);
+
+	if (hdr->dh_magic != L2ARC_DEV_HDR_MAGIC ||
+	    hdr->dh_version != L2ARC_PERSIST_VERSION ||
+	    hdr->dh_spa_guid != spa_guid(dev->l2ad_spa) ||
+	    hdr->dh_vdev_guid != dev->l2ad_vdev->vdev_guid) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	fletcher_4_native(hdr, offsetof(l2arc_dev_hdr_phys_t, dh_self_cksum),
+	    &cksum);
+	if (!ZIO_CHECKSUM_EQUAL(cksum, hdr->dh_self_cksum)) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_cksum_errors);
+		return (SET_ERROR(ECKSUM));
+	}
+
+	/* the device may have changed size since the header was written */
+	if (hdr->dh_hand < dev->l2ad_start || hdr->dh_evict < hdr->dh_hand ||
+	    hdr->dh_evict > dev->l2ad_end) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	return (0);
+}
+
+/*
+ * Read, verify and decompress the log block pointed to by lbp into lb,
+ * using pbuf (of sizeof (l2arc_log_blk_phys_t)) for the physical block.
+ */
+static int
+l2arc_log_blk_read(l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp,
+    l2arc_log_blk_phys_t *lb, void *pbuf)
+{
+	uint64_t asize = L2BLK_GET_PSIZE(lbp->lbp_prop);
+	zio_cksum_t cksum;
+	int err;
+
+	if ((err = l2arc_rebuild_read(dev, lbp->lbp_daddr, asize, pbuf)) != 0)
+		return (err);
+
+	fletcher_4_native(pbuf, asize, &cksum);
+	if (!ZIO_CHECKSUM_EQUAL(cksum, lbp->lbp_cksum)) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_cksum_errors);
+		return (SET_ERROR(ECKSUM));
+	}
+
+	switch (L2BLK_GET_COMPRESS(lbp->lbp_prop)) {
+	case ZIO_COMPRESS_OFF:
+		ASSERT3U(asize, ==, sizeof (*lb));
+		bcopy(pbuf, lb, sizeof (*lb));
+		break;
+	case ZIO_COMPRESS_LZ4:
+		if (zio_decompress_data(ZIO_COMPRESS_LZ4, pbuf, lb, asize,
+		    sizeof (*lb)) != 0) {
+			ARCSTAT_BUMP(arcstat_l2_rebuild_cksum_errors);
+			return (SET_ERROR(EIO));
+		}
+		break;
+	default:
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	if (lb->lb_magic != L2ARC_LOG_BLK_MAGIC) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	return (0);
+}
+
+static boolean_t
+l2arc_log_blkptr_valid(const l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp)
+{
+	uint64_t asize = L2BLK_GET_PSIZE(lbp->lbp_prop);
+
+	return (asize != 0 && asize <= sizeof (l2arc_log_blk_phys_t) &&
+	    L2BLK_GET_LSIZE(lbp->lbp_prop) == sizeof (l2arc_log_blk_phys_t) &&
+	    L2BLK_GET_CHECKSUM(lbp->lbp_prop) == ZIO_CHECKSUM_FLETCHER_4 &&
+	    l2arc_range_valid(dev, lbp->lbp_daddr, asize));
+}
+
+/*
+ * Reconstruct an ARC_l2c_only header from a log entry, unless the block is
+ * already known to the ARC (e.g. it was read in while we were rebuilding).
+ */
+static void
+l2arc_hdr_restore(const l2arc_log_ent_phys_t *le, l2arc_dev_t *dev,
+    uint64_t load_guid)
+{
+	arc_buf_hdr_t *hdr, *exists;
+	l2arc_buf_hdr_t *l2hdr;
+	kmutex_t *hash_lock;
+	uint64_t lsize = L2BLK_GET_LSIZE(le->le_prop);
+	uint64_t asize = L2BLK_GET_PSIZE(le->le_prop);
+	enum zio_compress compress = L2BLK_GET_COMPRESS(le->le_prop);
+	arc_buf_contents_t type = L2BLK_GET_TYPE(le->le_prop);
+
+	if (lsize > SPA_MAXBLOCKSIZE || asize > lsize ||
+	    type >= ARC_BUFC_NUMTYPES || (compress != ZIO_COMPRESS_OFF &&
+	    !L2ARC_IS_VALID_COMPRESS(compress)) ||
+	    !l2arc_range_valid(dev, le->le_daddr, asize))
+		return;
+
+	hdr = buf_hash_find(load_guid, &le->le_dva, le->le_birth, &hash_lock);
+	if (hdr != NULL) {
+		mutex_exit(hash_lock);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_bufs_precached);
+		return;
+	}
+
+	hdr = kmem_cache_alloc(hdr_cache, KM_SLEEP);
+	hdr->b_dva = le->le_dva;
+	hdr->b_birth = le->le_birth;
+	hdr->b_cksum0 = le->le_cksum0;
+	hdr->b_size = lsize;
+	hdr->b_spa = load_guid;
+	hdr->b_type = type;
+	hdr->b_buf = NULL;
+	hdr->b_datacnt = 0;
+	hdr->b_state = arc_anon;
+	hdr->b_arc_access = 0;
+	hdr->b_flags = ARC_L2CACHE;
+	if (L2BLK_GET_L2COMPRESS(le->le_prop))
+		hdr->b_flags |= ARC_L2COMPRESS;
+	hdr->b_freeze_cksum = kmem_alloc(sizeof (zio_cksum_t), KM_SLEEP);
+	*hdr->b_freeze_cksum = le->le_freeze_cksum;
+
+	l2hdr = kmem_zalloc(sizeof (l2arc_buf_hdr_t), KM_SLEEP);
+	l2hdr->b_dev = dev;
+	l2hdr->b_daddr = le->le_daddr;
+	l2hdr->b_compress = compress;
+	l2hdr->b_asize = asize;
+
+	exists = buf_hash_insert(hdr, &hash_lock);
+	if (exists != NULL) {
+		/* arc_read() beat us to it */
+		mutex_exit(hash_lock);
+		kmem_free(l2hdr, sizeof (l2arc_buf_hdr_t));
+		kmem_free(hdr->b_freeze_cksum, sizeof (zio_cksum_t));
+		hdr->b_freeze_cksum = NULL;
+		buf_discard_identity(hdr);
+		kmem_cache_free(hdr_cache, hdr);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_bufs_precached);
+		return;
+	}
+
+	/*
+	 * We walk the log from newest to oldest, so appending keeps the
+	 * buflist in the order l2arc_evict() expects.
+	 */
+	mutex_enter(&l2arc_buflist_mtx);
+	hdr->b_l2hdr = l2hdr;
+	list_insert_tail(dev->l2ad_buflist, hdr);
+	mutex_exit(&l2arc_buflist_mtx);
+
+	arc_change_state(arc_l2c_only, hdr, hash_lock);
+	mutex_exit(hash_lock);
+
+	ARCSTAT_INCR(arcstat_l2_size, lsize);
+	ARCSTAT_INCR(arcstat_l2_asize, asize);
+	ARCSTAT_BUMP(arcstat_l2_rebuild_bufs);
+	ARCSTAT_INCR(arcstat_l2_rebuild_size, lsize);
+}
+
+/*
+ * Walk the device's log and restore the headers it describes.
+ */
+static int
+l2arc_rebuild(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *hdr = dev->l2ad_dev_hdr;
+	uint64_t load_guid = spa_load_guid(dev->l2ad_spa);
+	uint64_t prev_age = 0;
+	l2arc_log_blk_phys_t *lb;
+	l2arc_log_blkptr_t lbp;
+	void *pbuf;
+	int err;
+
+	if ((err = l2arc_dev_hdr_read(dev)) != 0) {
+		/* start over with a clean log */
+		bzero(hdr, dev->l2ad_dev_hdr_asize);
+		return (err);
+	}
+
+	/*
+	 * Pick up writing where we left off.  This makes the space between
+	 * the start of the device and the write hand, and everything past
+	 * the eviction hand once the device has wrapped, allocated again.
+	 */
+	dev->l2ad_hand = hdr->dh_hand;
+	dev->l2ad_evict = hdr->dh_evict;
+	dev->l2ad_first = (hdr->dh_flags & L2ARC_DEV_HDR_EVICT_FIRST) != 0;
+	vdev_space_update(dev->l2ad_vdev, dev->l2ad_first ?
+	    dev->l2ad_hand - dev->l2ad_start :
+	    (dev->l2ad_end - dev->l2ad_start) -
+	    (dev->l2ad_evict - dev->l2ad_hand), 0, 0);
+
+	lb = kmem_alloc(sizeof (*lb), KM_SLEEP);
+	pbuf = zio_data_buf_alloc(sizeof (*lb));
+
+	for (lbp = hdr->dh_start_lbp; l2arc_log_blkptr_valid(dev, &lbp);
+	    lbp = lb->lb_prev_lbp) {
+		uint64_t age = l2arc_range_age(dev, lbp.lbp_daddr);
+
+		if (age <= prev_age) {
+			/* chain doubles back on itself; stop here */
+			ARCSTAT_BUMP(arcstat_l2_rebuild_loop_errors);
+			break;
+		}
+		prev_age = age;
+
+		if (dev->l2ad_rebuild_cancel) {
+			err = SET_ERROR(ECANCELED);
+			break;
+		}
+
+		/* restored headers are ARC memory too */
+		if (arc_reclaim_needed()) {
+			ARCSTAT_BUMP(arcstat_l2_rebuild_abort_lowmem);
+			err = SET_ERROR(ENOMEM);
+			break;
+		}
+
+		if ((err = l2arc_log_blk_read(dev, &lbp, lb, pbuf)) != 0)
+			break;
+
+		for (int i = L2ARC_LOG_BLK_ENTRIES - 1; i >= 0; i--)
+			l2arc_hdr_restore(&lb->lb_entries[i], dev, load_guid);
+
+		ARCSTAT_BUMP(arcstat_l2_rebuild_log_blks);
+	}
+
+	if (err == 0)
+		ARCSTAT_BUMP(arcstat_l2_rebuild_successes);
+
+	zio_data_buf_free(pbuf, sizeof (*lb));
+	kmem_free(lb, sizeof (*lb));
+
+	return (err);
+}
+
+static void
+l2arc_dev_rebuild_thread(l2arc_dev_t *dev)
+{
+	ASSERT(dev->l2ad_rebuild);
+
+	(void) l2arc_rebuild(dev);
+
+	mutex_enter(&l2arc_rebuild_thr_lock);
+	dev->l2ad_rebuild = B_FALSE;
+	cv_broadcast(&l2arc_rebuild_thr_cv);
+	mutex_exit(&l2arc_rebuild_thr_lock);
+
+	thread_exit();
+}
+
+/*
+ * Start rebuilding the L2ARC contents of any of this pool's cache devices
+ * that l2arc_add_vdev() marked for it.  Called at the end of a successful
+ * spa_load().
+ */
+void
+l2arc_spa_rebuild_start(spa_t *spa)
+{
+	l2arc_dev_t *dev;
+
+	ASSERT(MUTEX_HELD(&spa_namespace_lock));
+
+	mutex_enter(&l2arc_dev_mtx);
+	mutex_enter(&l2arc_rebuild_thr_lock);
+	for (dev = list_head(l2arc_dev_list); dev != NULL;
+	    dev = list_next(l2arc_dev_list, dev)) {
+		if (dev->l2ad_spa != spa || !dev->l2ad_rebuild ||
+		    dev->l2ad_rebuild_began)
+			continue;
+
+		dev->l2ad_rebuild_began = B_TRUE;
+		(void) thread_create(NULL, 0, l2arc_dev_rebuild_thread,
+		    dev, 0, &p0, TS_RUN, minclsyspri);
+	}
+	mutex_exit(&l2arc_rebuild_thr_lock);
+	mutex_exit(&l2arc_dev_mtx);
+}
@@ -51,12 +51,61 @@ uint64_t zfs_free_range_recv_miss;
 static void dbuf_destroy(dmu_buf_impl_t *db);
 static boolean_t dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
 static void dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx);
+static kmem_cbrc_t dbuf_move(void *, void *, size_t, void *);
 
 /*
  * Global data structures and functions for the dbuf cache.
  */
 static kmem_cache_t *dbuf_cache;
 
+/*
+ * Unreferenced dbufs are normally kept only as long as the ARC keeps
+ * their data, and the ARC treats them like any other evictable buffer.
+ * For hot indirect blocks that means being torn down and re-instantiated
+ * (dbuf_findbp(), a hash lookup and a copy out of the ARC) over and over.
+ *
+ * To avoid that, a dbuf whose last hold goes away keeps its ARC
+ * reference and is parked on an LRU list instead, up to a total of
+ * dbuf_cache_max_bytes.  Level 0 and indirect dbufs are kept on separate
+ * lists, and the level 0 list is always trimmed first.  A dbuf trimmed
+ * from the cache drops its ARC reference and falls back to the usual
+ * lifetime, so the ARC may still evict it (and the dbuf) later.
+ *
+ * If dbuf_cache_max_bytes is left as zero, it is set to 1 / 2^n of
+ * physical memory at startup, where n is dbuf_cache_shift.
+ */
+uint64_t dbuf_cache_max_bytes = 0;
+int dbuf_cache_shift = 6;
+
+static kmutex_t dbuf_cache_mtx;
+static list_t dbuf_cache_lists[2];		/* level 0, indirect */
+static uint64_t dbuf_cache_sizes[2];
+
+#define	DBUF_CACHE_LIST(db)	((db)->db_level == 0 ? 0 : 1)
+
+typedef struct dbuf_stats {
+	kstat_named_t dbufstat_cache_hits;
+	kstat_named_t dbufstat_cache_misses;
+	kstat_named_t dbufstat_cache_evictions;
+	kstat_named_t dbufstat_cache_size;
+	kstat_named_t dbufstat_cache_indirect_size;
+	kstat_named_t dbufstat_cache_max_bytes;
+} dbuf_stats_t;
+
+static dbuf_stats_t dbuf_stats = {
+	{ "cache_hits",			KSTAT_DATA_UINT64 },
+	{ "cache_misses",		KSTAT_DATA_UINT64 },
+	{ "cache_evictions",		KSTAT_DATA_UINT64 },
+	{ "cache_size",			KSTAT_DATA_UINT64 },
+	{ "cache_indirect_size",	KSTAT_DATA_UINT64 },
+	{ "cache_max_bytes",		KSTAT_DATA_UINT64 },
+};
+
+#define	DBUFSTAT_BUMP(stat) \
+	atomic_inc_64(&dbuf_stats.stat.value.ui64);
+
+static kstat_t *dbuf_ksp;
+
 /* ARGSUSED */
 static int
 dbuf_cons(void *vdb, void *unused, int kmflag)
@@ -245,6 +294,214 @@ dbuf_is_metadata(dmu_buf_impl_t *db)
 	}
 }
 
+/*
+ * Park an unreferenced dbuf, along with its ARC reference, in the cache.
+ */
+static void
+dbuf_cache_insert(dmu_buf_impl_t *db)
+{
+	int l = DBUF_CACHE_LIST(db);
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT(refcount_is_zero(&db->db_holds));
+	ASSERT(!list_link_active(&db->db_cache_link));
+
+	mutex_enter(&dbuf_cache_mtx);
+	list_insert_head(&dbuf_cache_lists[l], db);
+	dbuf_cache_sizes[l] += db->db.db_size;
+	mutex_exit(&dbuf_cache_mtx);
+}
+
+static void
+dbuf_cache_remove(dmu_buf_impl_t *db)
+{
+	int l = DBUF_CACHE_LIST(db);
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT(list_link_active(&db->db_cache_link));
+
+	mutex_enter(&dbuf_cache_mtx);
+	list_remove(&dbuf_cache_lists[l], db);
+	ASSERT3U(dbuf_cache_sizes[l], >=, db->db.db_size);
+	dbuf_cache_sizes[l] -= db->db.db_size;
+	mutex_exit(&dbuf_cache_mtx);
+}
+
+/*
+ * Trim the dbuf cache back down to dbuf_cache_max_bytes, taking level 0
+ * dbufs before indirect ones.  The dbuf lock is only tried, since the
+ * usual order is db_mtx before dbuf_cache_mtx; busy dbufs are passed over.
+ */
+static void
+dbuf_cache_evict(void)
+{
+	dmu_buf_impl_t *db;
+	list_t *list;
+
+	for (;;) {
+		mutex_enter(&dbuf_cache_mtx);
+		if (dbuf_cache_sizes[0] + dbuf_cache_sizes[1] <=
+		    dbuf_cache_max_bytes) {
+			mutex_exit(&dbuf_cache_mtx);
+			return;
+		}
+		list = &dbuf_cache_lists[dbuf_cache_sizes[0] != 0 ? 0 : 1];
+		for (db = list_tail(list); db != NULL;
+		    db = list_prev(list, db)) {
+			if (mutex_tryenter(&db->db_mtx))
+				break;
+		}
+		if (db == NULL) {
+			mutex_exit(&dbuf_cache_mtx);
+			return;
+		}
+		list_remove(list, db);
+		dbuf_cache_sizes[DBUF_CACHE_LIST(db)] -= db->db.db_size;
+		mutex_exit(&dbuf_cache_mtx);
+
+		ASSERT(refcount_is_zero(&db->db_holds));
+		VERIFY(!arc_buf_remove_ref(db->db_buf, db));
+		mutex_exit(&db->db_mtx);
+		DBUFSTAT_BUMP(dbufstat_cache_evictions);
+	}
+}
+
+#ifdef _KERNEL
+/*
+ * Move callback for the dbuf kmem cache.  The dbufs left behind by a
+ * large walk are the unreferenced ones parked in the dbuf cache.  Such a
+ * dbuf has no children, dirty records or user, and it is reachable only
+ * through its hash chain, its dnode's dn_dbufs list, the dbuf cache list
+ * and the b_private of the ARC buffer it holds; all of those are
+ * repointed here with the corresponding locks held.  As with the ARC
+ * headers, a dbuf is recognized by finding it on the hash chain its
+ * identity maps to.
+ *
+ * The holds a dbuf has on its dnode, its parent and its ARC buffer are
+ * tagged with its address, so nothing is moved while reference
+ * tracking is enabled.
+ */
+/* ARGSUSED */
+static kmem_cbrc_t
+dbuf_move(void *buf, void *newbuf, size_t size, void *arg)
+{
+	dmu_buf_impl_t *odb = buf, *ndb = newbuf;
+	dmu_buf_impl_t *db, **dbp;
+	dbuf_hash_table_t *h = &dbuf_hash_table;
+	kmutex_t *hash_mtx;
+	dnode_t *dn;
+	uint64_t idx;
+
+#ifdef	ZFS_DEBUG
+	if (reference_tracking_enable)
+		return (KMEM_CBRC_NO);
+#endif
+
+	idx = dbuf_hash(odb->db_objset, odb->db.db_object, odb->db_level,
+	    odb->db_blkid) & h->hash_table_mask;
+	hash_mtx = DBUF_HASH_MUTEX(h, idx);
+	mutex_enter(hash_mtx);
+	for (dbp = &h->hash_table[idx]; (db = *dbp) != NULL;
+	    dbp = &db->db_hash_next) {
+		if (db == odb)
+			break;
+	}
+	if (db == NULL) {
+		mutex_exit(hash_mtx);
+		return (KMEM_CBRC_DONT_KNOW);
+	}
+
+	if (!mutex_tryenter(&db->db_mtx)) {
+		mutex_exit(hash_mtx);
+		return (KMEM_CBRC_LATER);
+	}
+	if (!list_link_active(&db->db_cache_link) ||
+	    db->db_state != DB_CACHED || !refcount_is_zero(&db->db_holds) ||
+	    db->db_user_ptr != NULL || db->db_data_pending != NULL ||
+	    db->db_last_dirty != NULL || db->db_dnode_handle == NULL) {
+		mutex_exit(&db->db_mtx);
+		mutex_exit(hash_mtx);
+		return (KMEM_CBRC_LATER);
+	}
+	ASSERT(db->db_buf != NULL);
+	ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+
+	/*
+	 * The dbuf's hold keeps the dnode from being evicted, and dnode_move()
+	 * runs from the same taskq as we do, so the handle is ours.  The usual
+	 * order is dn_dbufs_mtx before db_mtx, hence the tryenter.
+	 */
+	DB_DNODE_ENTER(db);
+	dn = DB_DNODE(db);
+	if (!mutex_tryenter(&dn->dn_dbufs_mtx)) {
+		DB_DNODE_EXIT(db);
+		mutex_exit(&db->db_mtx);
+		mutex_exit(hash_mtx);
+		return (KMEM_CBRC_LATER);
+	}
+	mutex_enter(&dbuf_cache_mtx);
+
+	ndb->db = db->db;
+	ndb->db_objset = db->db_objset;
+	ndb->db_dnode_handle = db->db_dnode_handle;
+	ndb->db_parent = db->db_parent;
+	ndb->db_hash_next = db->db_hash_next;
+	ndb->db_blkid = db->db_blkid;
+	ndb->db_blkptr = db->db_blkptr;
+	ndb->db_level = db->db_level;
+	ndb->db_state = db->db_state;
+	ndb->db_buf = db->db_buf;
+	ndb->db_data_pending = NULL;
+	ndb->db_last_dirty = NULL;
+	ndb->db_user_ptr = NULL;
+	ndb->db_user_data_ptr_ptr = NULL;
+	ndb->db_evict_func = NULL;
+	ndb->db_immediate_evict = db->db_immediate_evict;
+	ndb->db_freed_in_flight = db->db_freed_in_flight;
+	ndb->db_dirtycnt = 0;
+
+	*dbp = ndb;
+	list_link_replace(&db->db_link, &ndb->db_link);
+	list_link_replace(&db->db_cache_link, &ndb->db_cache_link);
+	mutex_enter(&db->db_buf->b_evict_lock);
+	ASSERT3P(db->db_buf->b_private, ==, db);
+	db->db_buf->b_private = ndb;
+	mutex_exit(&db->db_buf->b_evict_lock);
+
+	mutex_exit(&dbuf_cache_mtx);
+	mutex_exit(&dn->dn_dbufs_mtx);
+	DB_DNODE_EXIT(db);
+	mutex_exit(hash_mtx);
+
+	/* leave the old dbuf as dbuf_destroy() would have */
+	db->db_hash_next = NULL;
+	db->db_dnode_handle = NULL;
+	db->db_parent = NULL;
+	db->db_blkptr = NULL;
+	db->db_buf = NULL;
+	db->db.db_data = NULL;
+	db->db_state = DB_EVICTING;
+	mutex_exit(&db->db_mtx);
+
+	return (KMEM_CBRC_YES);
+}
+#endif	/* _KERNEL */
+
+static int
+dbuf_kstat_update(kstat_t *ksp, int rw)
+{
+	dbuf_stats_t *ds = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+
+	ds->dbufstat_cache_size.value.ui64 =
+	    dbuf_cache_sizes[0] + dbuf_cache_sizes[1];
+	ds->dbufstat_cache_indirect_size.value.ui64 = dbuf_cache_sizes[1];
+	ds->dbufstat_cache_max_bytes.value.ui64 = dbuf_cache_max_bytes;
+	return (0);
+}
+
 void
 dbuf_evict(dmu_buf_impl_t *db)
 {
@@ -284,9 +541,27 @@ retry:
 	dbuf_cache = kmem_cache_create("dmu_buf_impl_t",
 	    sizeof (dmu_buf_impl_t),
 	    0, dbuf_cons, dbuf_dest, NULL, NULL, NULL, 0);
+	kmem_cache_set_move(dbuf_cache, dbuf_move);
 
 	for (i = 0; i < DBUF_MUTEXES; i++)
 		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_DEFAULT, NULL);
+
+	if (dbuf_cache_max_bytes == 0)
+		dbuf_cache_max_bytes = (physmem * PAGESIZE) >> dbuf_cache_shift;
+	mutex_init(&dbuf_cache_mtx, NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < 2; i++) {
+		list_create(&dbuf_cache_lists[i], sizeof (dmu_buf_impl_t),
+		    offsetof(dmu_buf_impl_t, db_cache_link));
+	}
+
+	dbuf_ksp = kstat_create("zfs", 0, "dbufstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dbuf_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (dbuf_ksp != NULL) {
+		dbuf_ksp->ks_data = &dbuf_stats;
+		dbuf_ksp->ks_update = dbuf_kstat_update;
+		kstat_install(dbuf_ksp);
+	}
 }
 
 void
@@ -295,6 +570,16 @@ dbuf_fini(void)
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	int i;
 
+	if (dbuf_ksp != NULL) {
+		kstat_delete(dbuf_ksp);
+		dbuf_ksp = NULL;
+	}
+	for (i = 0; i < 2; i++) {
+		ASSERT0(dbuf_cache_sizes[i]);
+		list_destroy(&dbuf_cache_lists[i]);
+	}
+	mutex_destroy(&dbuf_cache_mtx);
+
 	for (i = 0; i < DBUF_MUTEXES; i++)
 		mutex_destroy(&h->hash_mutexes[i]);
 	kmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
@@ -533,12 +818,13 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t *flags)
 
 	if (db->db_blkid == DMU_BONUS_BLKID) {
 		int bonuslen = MIN(dn->dn_bonuslen, dn->dn_phys->dn_bonuslen);
+		int max_bonuslen = DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots);
 
 		ASSERT3U(bonuslen, <=, db->db.db_size);
-		db->db.db_data = zio_buf_alloc(DN_MAX_BONUSLEN);
-		arc_space_consume(DN_MAX_BONUSLEN, ARC_SPACE_OTHER);
-		if (bonuslen < DN_MAX_BONUSLEN)
-			bzero(db->db.db_data, DN_MAX_BONUSLEN);
+		db->db.db_data = zio_buf_alloc(max_bonuslen);
+		arc_space_consume(max_bonuslen, ARC_SPACE_OTHER);
+		if (bonuslen < max_bonuslen)
+			bzero(db->db.db_data, max_bonuslen);
 		if (bonuslen)
 			bcopy(DN_BONUS(dn->dn_phys), db->db.db_data, bonuslen);
 		DB_DNODE_EXIT(db);
@@ -743,10 +1029,16 @@ dbuf_fix_old_data(dmu_buf_impl_t *db, uint64_t txg)
 	 */
 	ASSERT(dr->dr_txg >= txg - 2);
 	if (db->db_blkid == DMU_BONUS_BLKID) {
+		int max_bonuslen;
+
+		DB_DNODE_ENTER(db);
+		max_bonuslen = DN_SLOTS_TO_BONUSLEN(DB_DNODE(db)->dn_num_slots);
+		DB_DNODE_EXIT(db);
+
 		/* Note that the data bufs here are zio_bufs */
-		dr->dt.dl.dr_data = zio_buf_alloc(DN_MAX_BONUSLEN);
-		arc_space_consume(DN_MAX_BONUSLEN, ARC_SPACE_OTHER);
-		bcopy(db->db.db_data, dr->dt.dl.dr_data, DN_MAX_BONUSLEN);
+		dr->dt.dl.dr_data = zio_buf_alloc(max_bonuslen);
+		arc_space_consume(max_bonuslen, ARC_SPACE_OTHER);
+		bcopy(db->db.db_data, dr->dt.dl.dr_data, max_bonuslen);
 	} else if (refcount_count(&db->db_holds) > db->db_dirtycnt) {
 		int size = db->db.db_size;
 		arc_buf_contents_t type = DBUF_GET_BUFC_TYPE(db);
@@ -759,6 +1051,45 @@ dbuf_fix_old_data(dmu_buf_impl_t *db, uint64_t txg)
 	}
 }
 
+static void
+dbuf_free_precompressed(dbuf_dirty_record_t *dr)
+{
+	if (dr->dt.dl.dr_cdata != NULL) {
+		zio_data_buf_free(dr->dt.dl.dr_cdata, dr->dt.dl.dr_csize);
+		dr->dt.dl.dr_cdata = NULL;
+		dr->dt.dl.dr_csize = 0;
+	}
+}
+
+/*
+ * Attach a compressed copy of a level-0 block's new contents, which the
+ * caller has just filled in this txg, so that the block is written with
+ * that data rather than being compressed again.
+ */
+void
+dbuf_set_precompressed(dmu_buf_impl_t *db, enum zio_compress compress,
+    const void *cbuf, uint64_t psize, dmu_tx_t *tx)
+{
+	dbuf_dirty_record_t *dr;
+
+	ASSERT(db->db_level == 0);
+	ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+	ASSERT3U(psize, <, db->db.db_size);
+
+	mutex_enter(&db->db_mtx);
+	dr = db->db_last_dirty;
+	ASSERT(dr != NULL && dr->dr_txg == tx->tx_txg);
+	ASSERT(db->db_state == DB_CACHED);
+	if (dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN) {
+		dbuf_free_precompressed(dr);
+		dr->dt.dl.dr_cdata = zio_data_buf_alloc(psize);
+		bcopy(cbuf, dr->dt.dl.dr_cdata, psize);
+		dr->dt.dl.dr_csize = psize;
+		dr->dt.dl.dr_compress = compress;
+	}
+	mutex_exit(&db->db_mtx);
+}
+
 void
 dbuf_unoverride(dbuf_dirty_record_t *dr)
 {
@@ -770,8 +1101,13 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	ASSERT(dr->dt.dl.dr_override_state != DR_IN_DMU_SYNC);
 	ASSERT(db->db_level == 0);
 
-	if (db->db_blkid == DMU_BONUS_BLKID ||
-	    dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN)
+	if (db->db_blkid == DMU_BONUS_BLKID)
+		return;
+
+	/* a compressed copy no longer matches the buffer being modified */
+	dbuf_free_precompressed(dr);
+
+	if (dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN)
 		return;
 
 	ASSERT(db->db_data_pending != dr);
@@ -1522,13 +1858,24 @@ dbuf_clear(dmu_buf_impl_t *db)
 	ASSERT(MUTEX_HELD(&db->db_mtx));
 	ASSERT(refcount_is_zero(&db->db_holds));
 
+	if (list_link_active(&db->db_cache_link)) {
+		dbuf_cache_remove(db);
+		VERIFY(!arc_buf_remove_ref(db->db_buf, db));
+	}
+
 	dbuf_evict_user(db);
 
 	if (db->db_state == DB_CACHED) {
 		ASSERT(db->db.db_data != NULL);
 		if (db->db_blkid == DMU_BONUS_BLKID) {
-			zio_buf_free(db->db.db_data, DN_MAX_BONUSLEN);
-			arc_space_return(DN_MAX_BONUSLEN, ARC_SPACE_OTHER);
+			int max_bonuslen;
+
+			DB_DNODE_ENTER(db);
+			max_bonuslen =
+			    DN_SLOTS_TO_BONUSLEN(DB_DNODE(db)->dn_num_slots);
+			DB_DNODE_EXIT(db);
+			zio_buf_free(db->db.db_data, max_bonuslen);
+			arc_space_return(max_bonuslen, ARC_SPACE_OTHER);
 		}
 		db->db.db_data = NULL;
 		db->db_state = DB_UNCACHED;
@@ -1591,7 +1938,7 @@ dbuf_findbp(dnode_t *dn, int level, uint64_t blkid, int fail_sparse,
 		mutex_enter(&dn->dn_mtx);
 		if (dn->dn_have_spill &&
 		    (dn->dn_phys->dn_flags & DNODE_FLAG_SPILL_BLKPTR))
-			*bpp = &dn->dn_phys->dn_spill;
+			*bpp = DN_SPILL_BLKPTR(dn->dn_phys);
 		else
 			*bpp = NULL;
 		dbuf_add_ref(dn->dn_dbuf, NULL);
@@ -1673,7 +2020,7 @@ dbuf_create(dnode_t *dn, uint8_t level, uint64_t blkid,
 
 	if (blkid == DMU_BONUS_BLKID) {
 		ASSERT3P(parent, ==, dn->dn_dbuf);
-		db->db.db_size = DN_MAX_BONUSLEN -
+		db->db.db_size = DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots) -
 		    (dn->dn_nblkptr-1) * sizeof (blkptr_t);
 		ASSERT3U(db->db.db_size, >=, dn->dn_bonuslen);
 		db->db.db_offset = DMU_BONUS_BLKID;
@@ -1795,8 +2142,13 @@ dbuf_destroy(dmu_buf_impl_t *db)
 	arc_space_return(sizeof (dmu_buf_impl_t), ARC_SPACE_OTHER);
 }
 
+/*
+ * Start an asynchronous read of the given block into the ARC.  Level 0
+ * is the file's data; higher levels prefetch its indirect blocks, so
+ * that later data prefetches don't have to stop and read them.
+ */
 void
-dbuf_prefetch(dnode_t *dn, uint64_t blkid, zio_priority_t prio)
+dbuf_prefetch(dnode_t *dn, int level, uint64_t blkid, zio_priority_t prio)
 {
 	dmu_buf_impl_t *db = NULL;
 	blkptr_t *bp = NULL;
@@ -1804,11 +2156,11 @@ dbuf_prefetch(dnode_t *dn, uint64_t blkid, zio_priority_t prio)
 	ASSERT(blkid != DMU_BONUS_BLKID);
 	ASSERT(RW_LOCK_HELD(&dn->dn_struct_rwlock));
 
-	if (dnode_block_freed(dn, blkid))
+	if (level == 0 && dnode_block_freed(dn, blkid))
 		return;
 
 	/* dbuf_find() returns with db_mtx held */
-	if (db = dbuf_find(dn, 0, blkid)) {
+	if (db = dbuf_find(dn, level, blkid)) {
 		/*
 		 * This dbuf is already in the cache.  We assume that
 		 * it is already CACHED, or else about to be either
@@ -1818,14 +2170,14 @@ dbuf_prefetch(dnode_t *dn, uint64_t blkid, zio_priority_t prio)
 		return;
 	}
 
-	if (dbuf_findbp(dn, 0, blkid, TRUE, &db, &bp) == 0) {
+	if (dbuf_findbp(dn, level, blkid, TRUE, &db, &bp) == 0) {
 		if (bp && !BP_IS_HOLE(bp)) {
 			dsl_dataset_t *ds = dn->dn_objset->os_dsl_dataset;
 			uint32_t aflags = ARC_NOWAIT | ARC_PREFETCH;
 			zbookmark_t zb;
 
 			SET_BOOKMARK(&zb, ds ? ds->ds_object : DMU_META_OBJSET,
-			    dn->dn_object, 0, blkid);
+			    dn->dn_object, level, blkid);
 
 			(void) arc_read(NULL, dn->dn_objset->os_spa,
 			    bp, NULL, NULL, prio,
@@ -1874,9 +2226,15 @@ top:
 		if (err && err != ENOENT)
 			return (err);
 		db = dbuf_create(dn, level, blkid, parent, bp);
+		DBUFSTAT_BUMP(dbufstat_cache_misses);
 	}
 
-	if (db->db_buf && refcount_is_zero(&db->db_holds)) {
+	if (list_link_active(&db->db_cache_link)) {
+		/* the dbuf cache kept our ARC reference for us */
+		ASSERT(refcount_is_zero(&db->db_holds));
+		dbuf_cache_remove(db);
+		DBUFSTAT_BUMP(dbufstat_cache_hits);
+	} else if (db->db_buf && refcount_is_zero(&db->db_holds)) {
 		arc_buf_add_ref(db->db_buf, db);
 		if (db->db_buf->b_data == NULL) {
 			dbuf_clear(db);
@@ -2078,8 +2436,6 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag)
 			VERIFY(arc_buf_remove_ref(buf, db));
 			dbuf_evict(db);
 		} else {
-			VERIFY(!arc_buf_remove_ref(db->db_buf, db));
-
 			/*
 			 * A dbuf will be eligible for eviction if either the
 			 * 'primarycache' property is set or a duplicate
@@ -2094,12 +2450,22 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, void *tag)
 			 * if multiple buffers are referencing the same
 			 * block on-disk. If so, then we simply evict
 			 * ourselves.
+			 *
+			 * Otherwise the dbuf goes into the dbuf cache, still
+			 * holding its ARC reference.
 			 */
 			if (!DBUF_IS_CACHEABLE(db) ||
-			    arc_buf_eviction_needed(db->db_buf))
+			    arc_buf_eviction_needed(db->db_buf)) {
+				VERIFY(!arc_buf_remove_ref(db->db_buf, db));
 				dbuf_clear(db);
-			else
+			} else if (dbuf_cache_max_bytes == 0) {
+				VERIFY(!arc_buf_remove_ref(db->db_buf, db));
 				mutex_exit(&db->db_mtx);
+			} else {
+				dbuf_cache_insert(db);
+				mutex_exit(&db->db_mtx);
+				dbuf_cache_evict();
+			}
 		}
 	} else {
 		mutex_exit(&db->db_mtx);
@@ -2196,7 +2562,7 @@ dbuf_check_blkptr(dnode_t *dn, dmu_buf_impl_t *db)
 		return;
 
 	if (db->db_blkid == DMU_SPILL_BLKID) {
-		db->db_blkptr = &dn->dn_phys->dn_spill;
+		db->db_blkptr = DN_SPILL_BLKPTR(dn->dn_phys);
 		BP_ZERO(db->db_blkptr);
 		return;
 	}
@@ -2323,16 +2689,17 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 	 */
 	if (db->db_blkid == DMU_BONUS_BLKID) {
 		dbuf_dirty_record_t **drp;
+		int max_bonuslen = DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots);
 
 		ASSERT(*datap != NULL);
 		ASSERT0(db->db_level);
-		ASSERT3U(dn->dn_phys->dn_bonuslen, <=, DN_MAX_BONUSLEN);
+		ASSERT3U(dn->dn_phys->dn_bonuslen, <=, max_bonuslen);
 		bcopy(*datap, DN_BONUS(dn->dn_phys), dn->dn_phys->dn_bonuslen);
 		DB_DNODE_EXIT(db);
 
 		if (*datap != db->db.db_data) {
-			zio_buf_free(*datap, DN_MAX_BONUSLEN);
-			arc_space_return(DN_MAX_BONUSLEN, ARC_SPACE_OTHER);
+			zio_buf_free(*datap, max_bonuslen);
+			arc_space_return(max_bonuslen, ARC_SPACE_OTHER);
 		}
 		db->db_data_pending = NULL;
 		drp = &db->db_last_dirty;
@@ -2473,7 +2840,7 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 	if (db->db_blkid == DMU_SPILL_BLKID) {
 		ASSERT(dn->dn_phys->dn_flags & DNODE_FLAG_SPILL_BLKPTR);
 		ASSERT(!(BP_IS_HOLE(db->db_blkptr)) &&
-		    db->db_blkptr == &dn->dn_phys->dn_spill);
+		    db->db_blkptr == DN_SPILL_BLKPTR(dn->dn_phys));
 	}
 #endif
 
@@ -2486,9 +2853,9 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 
 		if (dn->dn_type == DMU_OT_DNODE) {
 			dnode_phys_t *dnp = db->db.db_data;
-			for (i = db->db.db_size >> DNODE_SHIFT; i > 0;
-			    i--, dnp++) {
-				if (dnp->dn_type != DMU_OT_NONE)
+			for (i = 0; i < db->db.db_size >> DNODE_SHIFT;
+			    i += dnp[i].dn_extra_slots + 1) {
+				if (dnp[i].dn_type != DMU_OT_NONE)
 					fill++;
 			}
 		} else {
@@ -2504,12 +2871,13 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 		for (i = db->db.db_size >> SPA_BLKPTRSHIFT; i > 0; i--, ibp++) {
 			if (BP_IS_HOLE(ibp))
 				continue;
-			fill += ibp->blk_fill;
+			fill += BP_GET_FILL(ibp);
 		}
 	}
 	DB_DNODE_EXIT(db);
 
-	bp->blk_fill = fill;
+	if (!BP_IS_EMBEDDED(bp))
+		bp->blk_fill = fill;
 
 	mutex_exit(&db->db_mtx);
 }
@@ -2592,7 +2960,7 @@ dbuf_write_done(zio_t *zio, arc_buf_t *buf, void *vdb)
 		dn = DB_DNODE(db);
 		ASSERT(dn->dn_phys->dn_flags & DNODE_FLAG_SPILL_BLKPTR);
 		ASSERT(!(BP_IS_HOLE(db->db_blkptr)) &&
-		    db->db_blkptr == &dn->dn_phys->dn_spill);
+		    db->db_blkptr == DN_SPILL_BLKPTR(dn->dn_phys));
 		DB_DNODE_EXIT(db);
 	}
 #endif
@@ -2600,6 +2968,7 @@ dbuf_write_done(zio_t *zio, arc_buf_t *buf, void *vdb)
 	if (db->db_level == 0) {
 		ASSERT(db->db_blkid != DMU_BONUS_BLKID);
 		ASSERT(dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN);
+		dbuf_free_precompressed(dr);
 		if (db->db_state != DB_NOFILL) {
 			if (dr->dt.dl.dr_data != db->db_buf)
 				VERIFY(arc_buf_remove_ref(dr->dt.dl.dr_data,
@@ -2773,5 +3142,10 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx)
 		    DBUF_IS_L2COMPRESSIBLE(db), &zp, dbuf_write_ready,
 		    dbuf_write_physdone, dbuf_write_done, db,
 		    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_MUSTSUCCEED, &zb);
+		if (db->db_level == 0 && dr->dt.dl.dr_cdata != NULL) {
+			zio_write_precompressed(dr->dr_zio,
+			    dr->dt.dl.dr_compress, dr->dt.dl.dr_cdata,
+			    dr->dt.dl.dr_csize);
+		}
 	}
 }
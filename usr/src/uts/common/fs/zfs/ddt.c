@@ -42,6 +42,36 @@
  */
 int zfs_dedup_prefetch = 1;
 
+/*
+ * Each DDT keeps an in-core bloom filter over the keys of its on-disk
+ * entries.  Once the filter holds every key, a write whose key isn't in it
+ * is known to be unique, and ddt_lookup_write() skips reading the DDT
+ * objects altogether.  The filter is built in syncing context, walking at
+ * most zfs_ddt_bloom_walk_max entries of each table per txg; entries written
+ * meanwhile are added as they are synced.  It is sized for twice the number
+ * of entries present when the build starts, and is rebuilt larger when it
+ * fills up, except that it never takes more than zfs_ddt_bloom_max_size
+ * bytes (zero allows 1/64th of physical memory).
+ */
+int zfs_ddt_bloom_enabled = 1;
+int zfs_ddt_bloom_bits_per_entry = 10;
+uint64_t zfs_ddt_bloom_walk_max = 100000;
+uint64_t zfs_ddt_bloom_max_size = 0;
+
+#define	DDT_BLOOM_HASHES	7
+#define	DDT_BLOOM_MIN_ENTRIES	(1ULL << 16)
+
+/*
+ * If non-zero, cap the number of unique entries in each DDT.  Over the cap,
+ * unique entries of blocks born more than zfs_ddt_prune_min_age txgs ago are
+ * removed, examining at most zfs_ddt_prune_max entries per txg.  A pruned
+ * block can no longer be deduplicated against; when it is freed, it has no
+ * entry to release and is freed directly.
+ */
+uint64_t zfs_ddt_unique_max = 0;
+uint64_t zfs_ddt_prune_min_age = 1000;
+uint64_t zfs_ddt_prune_max = 10000;
+
 static const ddt_ops_t *ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
 };
@@ -667,8 +697,205 @@ ddt_remove(ddt_t *ddt, ddt_entry_t *dde)
 	ddt_free(dde);
 }
 
-ddt_entry_t *
-ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
+static uint64_t
+ddt_bloom_mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return (x);
+}
+
+/*
+ * Derive the filter's probe sequence (h1 + i * h2) from the key.  The mixing
+ * step matters only for checksums that aren't cryptographically strong.
+ */
+static void
+ddt_bloom_hash(const ddt_key_t *ddk, uint64_t *h1, uint64_t *h2)
+{
+	*h1 = ddt_bloom_mix(ddk->ddk_cksum.zc_word[0] ^ ddk->ddk_prop);
+	*h2 = ddt_bloom_mix(ddk->ddk_cksum.zc_word[1]) | 1;
+}
+
+static ddt_bloom_t *
+ddt_bloom_alloc(uint64_t entries)
+{
+	ddt_bloom_t *dbf;
+	uint64_t maxbits;
+	uint64_t bpe = MAX(zfs_ddt_bloom_bits_per_entry, 1);
+
+	if (zfs_ddt_bloom_max_size != 0)
+		maxbits = zfs_ddt_bloom_max_size * NBBY;
+	else
+		maxbits = (uint64_t)physmem * PAGESIZE / 64 * NBBY;
+
+	dbf = kmem_zalloc(sizeof (ddt_bloom_t), KM_SLEEP);
+	entries = MAX(entries, DDT_BLOOM_MIN_ENTRIES);
+	dbf->dbf_nbits = 1ULL << highbit64(entries * bpe - 1);
+	dbf->dbf_capacity = dbf->dbf_nbits / bpe;
+	while (dbf->dbf_nbits > MAX(maxbits, DDT_BLOOM_MIN_ENTRIES * NBBY)) {
+		/* Too big to grow; accept a higher false positive rate. */
+		dbf->dbf_nbits >>= 1;
+		dbf->dbf_capacity = UINT64_MAX;
+	}
+	dbf->dbf_bits = kmem_zalloc(dbf->dbf_nbits / NBBY, KM_SLEEP);
+
+	return (dbf);
+}
+
+static void
+ddt_bloom_free(ddt_bloom_t *dbf)
+{
+	kmem_free(dbf->dbf_bits, dbf->dbf_nbits / NBBY);
+	kmem_free(dbf, sizeof (ddt_bloom_t));
+}
+
+static void
+ddt_bloom_insert(ddt_bloom_t *dbf, const ddt_key_t *ddk)
+{
+	uint64_t h1, h2;
+
+	ddt_bloom_hash(ddk, &h1, &h2);
+	for (int i = 0; i < DDT_BLOOM_HASHES; i++) {
+		uint64_t bit = (h1 + i * h2) & (dbf->dbf_nbits - 1);
+		dbf->dbf_bits[bit >> 6] |= 1ULL << (bit & 63);
+	}
+	dbf->dbf_count++;
+}
+
+static boolean_t
+ddt_bloom_contains(const ddt_bloom_t *dbf, const ddt_key_t *ddk)
+{
+	uint64_t h1, h2;
+
+	ddt_bloom_hash(ddk, &h1, &h2);
+	for (int i = 0; i < DDT_BLOOM_HASHES; i++) {
+		uint64_t bit = (h1 + i * h2) & (dbf->dbf_nbits - 1);
+		if (!(dbf->dbf_bits[bit >> 6] & (1ULL << (bit & 63))))
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Returns B_TRUE if the DDT definitely has no on-disk entry for this key.
+ */
+static boolean_t
+ddt_bloom_absent(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	return (ddt->ddt_bloom_ready &&
+	    !ddt_bloom_contains(ddt->ddt_bloom, ddk));
+}
+
+static void
+ddt_bloom_destroy(ddt_t *ddt)
+{
+	ddt_bloom_t *dbf = ddt->ddt_bloom;
+
+	if (dbf == NULL)
+		return;
+
+	ddt_enter(ddt);
+	ddt->ddt_bloom = NULL;
+	ddt->ddt_bloom_ready = B_FALSE;
+	ddt_exit(ddt);
+
+	ddt_bloom_free(dbf);
+}
+
+/*
+ * Called in syncing context, before the table's entries are synced: set up
+ * a filter if there isn't one, replacing it if it has filled up.  If the
+ * table has no on-disk entries, the new filter is complete already;
+ * otherwise ddt_bloom_walk() must first add every existing key.
+ */
+static void
+ddt_bloom_prepare(ddt_t *ddt)
+{
+	ddt_bloom_t *dbf;
+	uint64_t count = 0;
+
+	if (!zfs_ddt_bloom_enabled) {
+		ddt_bloom_destroy(ddt);
+		return;
+	}
+
+	if (ddt->ddt_bloom != NULL &&
+	    ddt->ddt_bloom->dbf_count > ddt->ddt_bloom->dbf_capacity)
+		ddt_bloom_destroy(ddt);
+
+	if (ddt->ddt_bloom != NULL)
+		return;
+
+	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
+			if (ddt_object_exists(ddt, type, class))
+				count += ddt_object_count(ddt, type, class);
+		}
+	}
+
+	/* Lookups in a table with no objects are free; don't bother. */
+	if (count == 0 && avl_numnodes(&ddt->ddt_tree) == 0)
+		return;
+
+	dbf = ddt_bloom_alloc(count * 2);
+
+	ddt_enter(ddt);
+	ddt->ddt_bloom = dbf;
+	ddt->ddt_bloom_ready = (count == 0);
+	bzero(&ddt->ddt_bloom_ddb, sizeof (ddt_bookmark_t));
+	ddt_exit(ddt);
+}
+
+/*
+ * Add the next batch of existing on-disk keys to an incomplete filter.
+ */
+static void
+ddt_bloom_walk(ddt_t *ddt)
+{
+	ddt_bookmark_t *ddb = &ddt->ddt_bloom_ddb;
+	ddt_entry_t dde;
+	uint64_t n = 0;
+
+	if (ddt->ddt_bloom == NULL || ddt->ddt_bloom_ready)
+		return;
+
+	while (n < zfs_ddt_bloom_walk_max) {
+		int error = ENOENT;
+
+		if (ddt_object_exists(ddt, ddb->ddb_type, ddb->ddb_class)) {
+			error = ddt_object_walk(ddt, ddb->ddb_type,
+			    ddb->ddb_class, &ddb->ddb_cursor, &dde);
+		}
+		if (error == 0) {
+			ddt_bloom_insert(ddt->ddt_bloom, &dde.dde_key);
+			n++;
+			continue;
+		}
+		if (error != ENOENT) {
+			/* Start over with a fresh filter next txg. */
+			ddt_bloom_destroy(ddt);
+			return;
+		}
+		ddb->ddb_cursor = 0;
+		if (++ddb->ddb_class < DDT_CLASSES)
+			continue;
+		ddb->ddb_class = 0;
+		if (++ddb->ddb_type < DDT_TYPES)
+			continue;
+
+		ddt_enter(ddt);
+		ddt->ddt_bloom_ready = B_TRUE;
+		ddt_exit(ddt);
+		return;
+	}
+}
+
+static ddt_entry_t *
+ddt_lookup_impl(ddt_t *ddt, const blkptr_t *bp, boolean_t add,
+    boolean_t filter)
 {
 	ddt_entry_t *dde, dde_search;
 	enum ddt_type type;
@@ -694,6 +921,14 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	if (dde->dde_loaded)
 		return (dde);
 
+	if (filter && ddt_bloom_absent(ddt, &dde->dde_key)) {
+		dde->dde_type = DDT_TYPES;
+		dde->dde_class = DDT_CLASSES;
+		dde->dde_loaded = B_TRUE;
+		ddt->ddt_bloom_unique++;
+		return (dde);
+	}
+
 	dde->dde_loading = B_TRUE;
 
 	ddt_exit(ddt);
@@ -730,6 +965,24 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	return (dde);
 }
 
+ddt_entry_t *
+ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
+{
+	return (ddt_lookup_impl(ddt, bp, add, B_FALSE));
+}
+
+/*
+ * Look up, adding if necessary, the entry for a block about to be written.
+ * Unlike ddt_lookup(), this may trust the bloom filter to establish that
+ * there's no on-disk entry.  That is only safe where a false "absent" costs
+ * a missed deduplication; frees must always find their entry.
+ */
+ddt_entry_t *
+ddt_lookup_write(ddt_t *ddt, const blkptr_t *bp)
+{
+	return (ddt_lookup_impl(ddt, bp, B_TRUE, B_TRUE));
+}
+
 void
 ddt_prefetch(spa_t *spa, const blkptr_t *bp)
 {
@@ -794,6 +1047,8 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 static void
 ddt_table_free(ddt_t *ddt)
 {
+	if (ddt->ddt_bloom != NULL)
+		ddt_bloom_free(ddt->ddt_bloom);
 	ASSERT(avl_numnodes(&ddt->ddt_tree) == 0);
 	ASSERT(avl_numnodes(&ddt->ddt_repair_tree) == 0);
 	avl_destroy(&ddt->ddt_tree);
@@ -825,6 +1080,12 @@ ddt_load(spa_t *spa)
 	if (error)
 		return (error == ENOENT ? 0 : error);
 
+	error = zap_contains(spa->spa_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_DDT_PRUNED);
+	if (error != 0 && error != ENOENT)
+		return (error);
+	spa->spa_ddt_pruned = (error == 0);
+
 	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
 		ddt_t *ddt = spa->spa_ddt[c];
 		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
@@ -866,13 +1127,20 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 	if (!BP_GET_DEDUP(bp))
 		return (B_FALSE);
 
-	if (max_class == DDT_CLASS_UNIQUE)
+	/*
+	 * Every dedup block is in the DDT unless unique entries have been
+	 * pruned from it.
+	 */
+	if (max_class == DDT_CLASS_UNIQUE && !spa->spa_ddt_pruned)
 		return (B_TRUE);
 
 	ddt = spa->spa_ddt[BP_GET_CHECKSUM(bp)];
 
 	ddt_key_fill(&dde.dde_key, bp);
 
+	if (ddt_bloom_absent(ddt, &dde.dde_key))
+		return (B_FALSE);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++)
 		for (enum ddt_class class = 0; class <= max_class; class++)
 			if (ddt_object_lookup(ddt, type, class, &dde) == 0)
@@ -1037,6 +1305,8 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 		if (!ddt_object_exists(ddt, ntype, nclass))
 			ddt_object_create(ddt, ntype, nclass, tx);
 		VERIFY(ddt_object_update(ddt, ntype, nclass, dde, tx) == 0);
+		if (ddt->ddt_bloom != NULL)
+			ddt_bloom_insert(ddt->ddt_bloom, ddk);
 
 		/*
 		 * If the class changes, the order that we scan this bp
@@ -1052,6 +1322,71 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	}
 }
 
+static boolean_t
+ddt_prune_wanted(ddt_t *ddt)
+{
+	enum ddt_type type = DDT_TYPE_CURRENT;
+
+	return (zfs_ddt_unique_max != 0 &&
+	    spa_sync_pass(ddt->ddt_spa) == 1 &&
+	    ddt_object_exists(ddt, type, DDT_CLASS_UNIQUE) &&
+	    ddt->ddt_object_stats[type][DDT_CLASS_UNIQUE].ddo_count >
+	    zfs_ddt_unique_max);
+}
+
+/*
+ * Enforce zfs_ddt_unique_max by removing unique entries of blocks born more
+ * than zfs_ddt_prune_min_age txgs ago.  The walk resumes where the previous
+ * txg's left off, so successive txgs sweep the whole class.  Called with the
+ * in-core tree already synced, so no pruned entry can be in use.
+ */
+static void
+ddt_prune_unique(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
+{
+	spa_t *spa = ddt->ddt_spa;
+	enum ddt_type type = DDT_TYPE_CURRENT;
+	enum ddt_class class = DDT_CLASS_UNIQUE;
+	ddt_entry_t dde;
+	uint64_t count, pruned = 0;
+
+	ASSERT(avl_numnodes(&ddt->ddt_tree) == 0);
+
+	count = ddt_object_count(ddt, type, class);
+
+	for (uint64_t n = 0; n < zfs_ddt_prune_max &&
+	    count - pruned > zfs_ddt_unique_max; n++) {
+		uint64_t birth = 0;
+		int error;
+
+		error = ddt_object_walk(ddt, type, class,
+		    &ddt->ddt_prune_cursor, &dde);
+		if (error != 0) {
+			ddt->ddt_prune_cursor = 0;
+			break;
+		}
+
+		for (int p = 0; p < DDT_PHYS_TYPES; p++)
+			birth = MAX(birth, dde.dde_phys[p].ddp_phys_birth);
+		if (birth + zfs_ddt_prune_min_age > txg)
+			continue;
+
+		dde.dde_type = type;
+		dde.dde_class = class;
+		ddt_stat_update(ddt, &dde, -1ULL);
+		VERIFY0(ddt_object_remove(ddt, type, class, &dde, tx));
+		pruned++;
+	}
+
+	if (pruned != 0 && !spa->spa_ddt_pruned) {
+		uint64_t one = 1;
+
+		VERIFY0(zap_update(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_DDT_PRUNED, sizeof (uint64_t), 1, &one, tx));
+		spa->spa_ddt_pruned = B_TRUE;
+	}
+	ddt->ddt_pruned += pruned;
+}
+
 static void
 ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 {
@@ -1059,7 +1394,7 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 	ddt_entry_t *dde;
 	void *cookie = NULL;
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	if (avl_numnodes(&ddt->ddt_tree) == 0 && !ddt_prune_wanted(ddt))
 		return;
 
 	ASSERT(spa->spa_uberblock.ub_version >= SPA_VERSION_DEDUP);
@@ -1075,6 +1410,9 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		ddt_free(dde);
 	}
 
+	if (ddt_prune_wanted(ddt))
+		ddt_prune_unique(ddt, tx, txg);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		uint64_t count = 0;
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
@@ -1108,7 +1446,11 @@ ddt_sync(spa_t *spa, uint64_t txg)
 		ddt_t *ddt = spa->spa_ddt[c];
 		if (ddt == NULL)
 			continue;
+		if (spa_sync_pass(spa) == 1)
+			ddt_bloom_prepare(ddt);
 		ddt_sync_table(ddt, tx, txg);
+		if (spa_sync_pass(spa) == 1)
+			ddt_bloom_walk(ddt);
 		ddt_repair_table(ddt, rio);
 	}
 
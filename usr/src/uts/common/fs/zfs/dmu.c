@@ -162,7 +162,7 @@ dmu_buf_hold(objset_t *os, uint64_t object, uint64_t offset,
 int
 dmu_bonus_max(void)
 {
-	return (DN_MAX_BONUSLEN);
+	return (DN_OLD_MAX_BONUSLEN);
 }
 
 int
@@ -367,15 +367,18 @@ dmu_spill_hold_by_bonus(dmu_buf_t *bonus, void *tag, dmu_buf_t **dbp)
  * and can induce severe lock contention when writing to several files
  * whose dnodes are in the same block.
  */
+/*
+ * Hold the buffers for a range of an object, starting reads of those
+ * that are not cached as children of the given zio.
+ */
 static int
-dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
-    int read, void *tag, int *numbufsp, dmu_buf_t ***dbpp, uint32_t flags)
+dmu_buf_hold_array_start(dnode_t *dn, uint64_t offset, uint64_t length,
+    int read, void *tag, zio_t *zio, uint32_t flags, int *numbufsp,
+    dmu_buf_t ***dbpp)
 {
 	dmu_buf_t **dbp;
 	uint64_t blkid, nblks, i;
 	uint32_t dbuf_flags;
-	int err;
-	zio_t *zio;
 
 	ASSERT(length <= DMU_MAX_ACCESS);
 
@@ -403,14 +406,12 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 	}
 	dbp = kmem_zalloc(sizeof (dmu_buf_t *) * nblks, KM_SLEEP);
 
-	zio = zio_root(dn->dn_objset->os_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
 	blkid = dbuf_whichblock(dn, offset);
 	for (i = 0; i < nblks; i++) {
 		dmu_buf_impl_t *db = dbuf_hold(dn, blkid+i, tag);
 		if (db == NULL) {
 			rw_exit(&dn->dn_struct_rwlock);
 			dmu_buf_rele_array(dbp, nblks, tag);
-			zio_nowait(zio);
 			return (SET_ERROR(EIO));
 		}
 		/* initiate async i/o */
@@ -421,29 +422,64 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 	}
 	rw_exit(&dn->dn_struct_rwlock);
 
-	/* wait for async i/o */
-	err = zio_wait(zio);
+	*numbufsp = nblks;
+	*dbpp = dbp;
+	return (0);
+}
+
+/*
+ * Once our own reads are done, some of the buffers may still be being
+ * read by someone else.  Wait for those, or if we may not wait, return
+ * EINPROGRESS if there are any.
+ */
+static int
+dmu_buf_array_wait(dmu_buf_t **dbp, int numbufs, boolean_t wait)
+{
+	int i, err = 0;
+
+	for (i = 0; i < numbufs && err == 0; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		mutex_enter(&db->db_mtx);
+		while (db->db_state == DB_READ || db->db_state == DB_FILL) {
+			if (!wait) {
+				err = SET_ERROR(EINPROGRESS);
+				break;
+			}
+			cv_wait(&db->db_changed, &db->db_mtx);
+		}
+		if (db->db_state == DB_UNCACHED)
+			err = SET_ERROR(EIO);
+		mutex_exit(&db->db_mtx);
+	}
+	return (err);
+}
+
+static int
+dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
+    int read, void *tag, int *numbufsp, dmu_buf_t ***dbpp, uint32_t flags)
+{
+	dmu_buf_t **dbp;
+	int nblks;
+	int err;
+	zio_t *zio;
+
+	zio = zio_root(dn->dn_objset->os_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	err = dmu_buf_hold_array_start(dn, offset, length, read, tag, zio,
+	    flags, &nblks, &dbp);
 	if (err) {
-		dmu_buf_rele_array(dbp, nblks, tag);
+		zio_nowait(zio);
 		return (err);
 	}
 
+	/* wait for async i/o */
+	err = zio_wait(zio);
+
 	/* wait for other io to complete */
-	if (read) {
-		for (i = 0; i < nblks; i++) {
-			dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
-			mutex_enter(&db->db_mtx);
-			while (db->db_state == DB_READ ||
-			    db->db_state == DB_FILL)
-				cv_wait(&db->db_changed, &db->db_mtx);
-			if (db->db_state == DB_UNCACHED)
-				err = SET_ERROR(EIO);
-			mutex_exit(&db->db_mtx);
-			if (err) {
-				dmu_buf_rele_array(dbp, nblks, tag);
-				return (err);
-			}
-		}
+	if (err == 0 && read)
+		err = dmu_buf_array_wait(dbp, nblks, B_TRUE);
+	if (err) {
+		dmu_buf_rele_array(dbp, nblks, tag);
+		return (err);
 	}
 
 	*numbufsp = nblks;
@@ -487,6 +523,98 @@ dmu_buf_hold_array_by_bonus(dmu_buf_t *db_fake, uint64_t offset,
 	return (err);
 }
 
+/*
+ * Asynchronous holds.  Reads of the buffers that are not cached are
+ * started and we return without waiting for them; the done callback
+ * is called once they are all in, or one has failed.  It runs in the
+ * context of the last read to complete, or on dmu_hold_taskq if a
+ * buffer was being read by someone else and we have to wait for that,
+ * and it is called before dmu_buf_hold_array_by_bonus_async() returns
+ * if all the buffers were cached.
+ */
+typedef struct dmu_hold_async {
+	dmu_buf_t		**ha_dbp;
+	int			ha_numbufs;
+	void			*ha_tag;
+	dmu_hold_done_func_t	*ha_done;
+	void			*ha_arg;
+	taskq_ent_t		ha_tqent;
+} dmu_hold_async_t;
+
+static taskq_t *dmu_hold_taskq;
+
+static void
+dmu_hold_async_finish(dmu_hold_async_t *ha, int err)
+{
+	if (err) {
+		dmu_buf_rele_array(ha->ha_dbp, ha->ha_numbufs, ha->ha_tag);
+		ha->ha_done(ha->ha_arg, err, 0, NULL);
+	} else {
+		ha->ha_done(ha->ha_arg, 0, ha->ha_numbufs, ha->ha_dbp);
+	}
+	kmem_free(ha, sizeof (dmu_hold_async_t));
+}
+
+static void
+dmu_hold_async_wait(void *arg)
+{
+	dmu_hold_async_t *ha = arg;
+
+	dmu_hold_async_finish(ha,
+	    dmu_buf_array_wait(ha->ha_dbp, ha->ha_numbufs, B_TRUE));
+}
+
+static void
+dmu_hold_async_done(zio_t *zio)
+{
+	dmu_hold_async_t *ha = zio->io_private;
+	int err = zio->io_error;
+
+	if (err == 0) {
+		err = dmu_buf_array_wait(ha->ha_dbp, ha->ha_numbufs, B_FALSE);
+		if (err == EINPROGRESS) {
+			taskq_dispatch_ent(dmu_hold_taskq, dmu_hold_async_wait,
+			    ha, 0, &ha->ha_tqent);
+			return;
+		}
+	}
+	dmu_hold_async_finish(ha, err);
+}
+
+int
+dmu_buf_hold_array_by_bonus_async(dmu_buf_t *db_fake, uint64_t offset,
+    uint64_t length, void *tag, dmu_hold_done_func_t *done, void *arg)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)db_fake;
+	dmu_hold_async_t *ha;
+	dnode_t *dn;
+	zio_t *zio;
+	int err;
+
+	ha = kmem_zalloc(sizeof (dmu_hold_async_t), KM_SLEEP);
+	ha->ha_tag = tag;
+	ha->ha_done = done;
+	ha->ha_arg = arg;
+
+	DB_DNODE_ENTER(db);
+	dn = DB_DNODE(db);
+	zio = zio_root(dn->dn_objset->os_spa, dmu_hold_async_done, ha,
+	    ZIO_FLAG_CANFAIL);
+	err = dmu_buf_hold_array_start(dn, offset, length, TRUE, tag, zio,
+	    DMU_READ_PREFETCH, &ha->ha_numbufs, &ha->ha_dbp);
+	DB_DNODE_EXIT(db);
+
+	if (err) {
+		/* don't let the root zio call back for a hold we never got */
+		zio->io_done = NULL;
+		zio_nowait(zio);
+		kmem_free(ha, sizeof (dmu_hold_async_t));
+		return (err);
+	}
+	zio_nowait(zio);
+	return (0);
+}
+
 void
 dmu_buf_rele_array(dmu_buf_t **dbp_fake, int numbufs, void *tag)
 {
@@ -532,7 +660,7 @@ dmu_prefetch(objset_t *os, uint64_t object, uint64_t offset, uint64_t len)
 
 		rw_enter(&dn->dn_struct_rwlock, RW_READER);
 		blkid = dbuf_whichblock(dn, object * sizeof (dnode_phys_t));
-		dbuf_prefetch(dn, blkid, ZIO_PRIORITY_SYNC_READ);
+		dbuf_prefetch(dn, 0, blkid, ZIO_PRIORITY_SYNC_READ);
 		rw_exit(&dn->dn_struct_rwlock);
 		return;
 	}
@@ -558,7 +686,7 @@ dmu_prefetch(objset_t *os, uint64_t object, uint64_t offset, uint64_t len)
 	if (nblks != 0) {
 		blkid = dbuf_whichblock(dn, offset);
 		for (int i = 0; i < nblks; i++)
-			dbuf_prefetch(dn, blkid + i, ZIO_PRIORITY_SYNC_READ);
+			dbuf_prefetch(dn, 0, blkid + i, ZIO_PRIORITY_SYNC_READ);
 	}
 
 	rw_exit(&dn->dn_struct_rwlock);
@@ -621,12 +749,44 @@ get_next_chunk(dnode_t *dn, uint64_t *start, uint64_t minimum)
 	return (0);
 }
 
-static int
+static /*
+ * Frees dirty no data, so the write throttle never holds back
+ * dmu_free_long_range(), and removing a large file could otherwise put
+ * millions of block frees into one txg.  Once the long frees assigned to
+ * a txg cover zfs_per_txg_dirty_frees_percent of zfs_dirty_data_max,
+ * further chunks wait for the next txg.  Zero disables the limit.
+ */
+int zfs_per_txg_dirty_frees_percent = 30;
+
+typedef struct dmu_free_long_stats {
+	kstat_named_t dfl_active;	/* long frees in progress */
+	kstat_named_t dfl_chunks;	/* chunks freed */
+	kstat_named_t dfl_bytes;	/* logical bytes freed */
+	kstat_named_t dfl_delays;	/* waits for the next txg */
+} dmu_free_long_stats_t;
+
+static dmu_free_long_stats_t dmu_free_long_stats = {
+	{ "active",	KSTAT_DATA_UINT64 },
+	{ "chunks",	KSTAT_DATA_UINT64 },
+	{ "bytes",	KSTAT_DATA_UINT64 },
+	{ "delays",	KSTAT_DATA_UINT64 }
+};
+
+static kstat_t *dmu_free_long_ksp;
+
+#define	DFLSTAT_INCR(stat, val)	\
+	atomic_add_64(&dmu_free_long_stats.stat.value.ui64, (val))
+#define	DFLSTAT_BUMP(stat)	DFLSTAT_INCR(stat, 1)
+
+int
 dmu_free_long_range_impl(objset_t *os, dnode_t *dn, uint64_t offset,
     uint64_t length)
 {
+	dsl_pool_t *dp = dmu_objset_pool(os);
 	uint64_t object_size = (dn->dn_maxblkid + 1) * dn->dn_datablksz;
-	int err;
+	uint64_t dirty_frees_limit =
+	    zfs_dirty_data_max * zfs_per_txg_dirty_frees_percent / 100;
+	int err = 0;
 
 	if (offset >= object_size)
 		return (0);
@@ -634,32 +794,53 @@ dmu_free_long_range_impl(objset_t *os, dnode_t *dn, uint64_t offset,
 	if (length == DMU_OBJECT_END || offset + length > object_size)
 		length = object_size - offset;
 
+	DFLSTAT_BUMP(dfl_active);
 	while (length != 0) {
-		uint64_t chunk_end, chunk_begin;
+		uint64_t chunk_end, chunk_begin, chunk_len, txg;
 
 		chunk_end = chunk_begin = offset + length;
 
 		/* move chunk_begin backwards to the beginning of this chunk */
 		err = get_next_chunk(dn, &chunk_begin, offset);
 		if (err)
-			return (err);
+			break;
 		ASSERT3U(chunk_begin, >=, offset);
 		ASSERT3U(chunk_begin, <=, chunk_end);
+		chunk_len = chunk_end - chunk_begin;
 
 		dmu_tx_t *tx = dmu_tx_create(os);
-		dmu_tx_hold_free(tx, dn->dn_object,
-		    chunk_begin, chunk_end - chunk_begin);
+		dmu_tx_hold_free(tx, dn->dn_object, chunk_begin, chunk_len);
 		err = dmu_tx_assign(tx, TXG_WAIT);
 		if (err) {
 			dmu_tx_abort(tx);
-			return (err);
+			break;
+		}
+		txg = dmu_tx_get_txg(tx);
+
+		mutex_enter(&dp->dp_lock);
+		if (dirty_frees_limit != 0 &&
+		    dp->dp_long_free_dirty_pertxg[txg & TXG_MASK] >=
+		    dirty_frees_limit) {
+			mutex_exit(&dp->dp_lock);
+			dmu_tx_commit(tx);
+			DFLSTAT_BUMP(dfl_delays);
+			txg_wait_open(dp, txg + 1);
+			continue;
 		}
-		dnode_free_range(dn, chunk_begin, chunk_end - chunk_begin, tx);
+		dp->dp_long_free_dirty_pertxg[txg & TXG_MASK] += chunk_len;
+		mutex_exit(&dp->dp_lock);
+
+		DTRACE_PROBE3(free__long__range, uint64_t, length,
+		    uint64_t, chunk_len, uint64_t, txg);
+		dnode_free_range(dn, chunk_begin, chunk_len, tx);
 		dmu_tx_commit(tx);
 
-		length -= chunk_end - chunk_begin;
+		DFLSTAT_BUMP(dfl_chunks);
+		DFLSTAT_INCR(dfl_bytes, chunk_len);
+		length -= chunk_len;
 	}
-	return (0);
+	DFLSTAT_INCR(dfl_active, -1);
+	return (err);
 }
 
 int
@@ -827,6 +1008,41 @@ dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	dmu_buf_rele_array(dbp, numbufs, FTAG);
 }
 
+/*
+ * Write one whole block, for which the caller also has a compressed copy
+ * (cbuf, psize bytes, compressed with compress) that decompresses to buf.
+ * The compressed copy is written to disk as it is, sparing the cost of
+ * compressing buf again.  If the range is not exactly one block, this is
+ * just dmu_write().
+ */
+void
+dmu_write_precompressed(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t size, const void *buf, uint8_t compress, const void *cbuf,
+    uint64_t psize, dmu_tx_t *tx)
+{
+	dmu_buf_t **dbp;
+	dmu_buf_t *db;
+	int numbufs;
+
+	VERIFY(0 == dmu_buf_hold_array(os, object, offset, size,
+	    FALSE, FTAG, &numbufs, &dbp));
+	db = dbp[0];
+
+	if (numbufs != 1 || db->db_offset != offset || db->db_size != size ||
+	    psize >= size) {
+		dmu_buf_rele_array(dbp, numbufs, FTAG);
+		dmu_write(os, object, offset, size, buf, tx);
+		return;
+	}
+
+	dmu_buf_will_fill(db, tx);
+	bcopy(buf, db->db_data, size);
+	dmu_buf_fill_done(db, tx);
+	dbuf_set_precompressed((dmu_buf_impl_t *)db, compress, cbuf, psize, tx);
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+}
+
 void
 dmu_prealloc(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
     dmu_tx_t *tx)
@@ -938,6 +1154,27 @@ dmu_xuio_clear(xuio_t *xuio, int i)
 	priv->bufs[i] = NULL;
 }
 
+static void
+dmu_free_long_stat_init(void)
+{
+	dmu_free_long_ksp = kstat_create("zfs", 0, "dmu_free_long", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dmu_free_long_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (dmu_free_long_ksp != NULL) {
+		dmu_free_long_ksp->ks_data = &dmu_free_long_stats;
+		kstat_install(dmu_free_long_ksp);
+	}
+}
+
+static void
+dmu_free_long_stat_fini(void)
+{
+	if (dmu_free_long_ksp != NULL) {
+		kstat_delete(dmu_free_long_ksp);
+		dmu_free_long_ksp = NULL;
+	}
+}
+
 static void
 xuio_stat_init(void)
 {
@@ -1002,19 +1239,12 @@ dmu_read_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size)
 		tocpy = (int)MIN(db->db_size - bufoff, size);
 
 		if (xuio) {
-			dmu_buf_impl_t *dbi = (dmu_buf_impl_t *)db;
-			arc_buf_t *dbuf_abuf = dbi->db_buf;
-			arc_buf_t *abuf = dbuf_loan_arcbuf(dbi);
-			err = dmu_xuio_add(xuio, abuf, bufoff, tocpy);
+			err = dmu_xuio_add(xuio, dmu_loan_arcbuf(db),
+			    bufoff, tocpy);
 			if (!err) {
 				uio->uio_resid -= tocpy;
 				uio->uio_loffset += tocpy;
 			}
-
-			if (abuf == dbuf_abuf)
-				XUIOSTAT_BUMP(xuiostat_rbuf_nocopy);
-			else
-				XUIOSTAT_BUMP(xuiostat_rbuf_copied);
 		} else {
 			err = uiomove((char *)db->db_data + bufoff, tocpy,
 			    UIO_READ, uio);
@@ -1188,6 +1418,29 @@ dmu_request_arcbuf(dmu_buf_t *handle, int size)
 	return (arc_loan_buf(db->db_objset->os_spa, size));
 }
 
+/*
+ * Loan out the arc buffer backing a held dbuf for read.  This is the read
+ * side of dmu_request_arcbuf(): if ours is the only hold and the buffer
+ * is not being modified, the buffer itself is handed over without a copy
+ * and stays cached in the ARC, otherwise a private copy is loaned.  The
+ * buffer must be given back with dmu_return_arcbuf(); the caller may drop
+ * its dbuf hold as soon as this returns.
+ */
+arc_buf_t *
+dmu_loan_arcbuf(dmu_buf_t *handle)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)handle;
+	arc_buf_t *dbuf_abuf = db->db_buf;
+	arc_buf_t *abuf;
+
+	abuf = dbuf_loan_arcbuf(db);
+	if (abuf == dbuf_abuf)
+		XUIOSTAT_BUMP(xuiostat_rbuf_nocopy);
+	else
+		XUIOSTAT_BUMP(xuiostat_rbuf_copied);
+	return (abuf);
+}
+
 /*
  * Free a loaned arc buffer.
  */
@@ -1263,7 +1516,7 @@ dmu_sync_ready(zio_t *zio, arc_buf_t *buf, void *varg)
 			 * block size still needs to be known for replay.
 			 */
 			BP_SET_LSIZE(bp, db->db_size);
-		} else {
+		} else if (!BP_IS_EMBEDDED(bp)) {
 			ASSERT(BP_GET_LEVEL(bp) == 0);
 			bp->blk_fill = 1;
 		}
@@ -1577,6 +1830,7 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	boolean_t nopwrite = B_FALSE;
 	boolean_t dedup_verify = os->os_dedup_verify;
 	int copies = os->os_copies;
+	uint32_t special_smallblk = 0;
 
 	/*
 	 * We maintain different write policies for each of the following
@@ -1651,6 +1905,13 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 		 */
 		nopwrite = (!dedup && zio_checksum_table[checksum].ci_dedup &&
 		    compress != ZIO_COMPRESS_OFF && zfs_nopwrite_enabled);
+
+		/*
+		 * Data blocks no larger than the dataset's
+		 * special_small_blocks go to the special class if the
+		 * pool has one; see spa_preferred_class().
+		 */
+		special_smallblk = os->os_special_smallblk;
 	}
 
 	zp->zp_checksum = checksum;
@@ -1661,6 +1922,7 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	zp->zp_dedup = dedup;
 	zp->zp_dedup_verify = dedup && dedup_verify;
 	zp->zp_nopwrite = nopwrite;
+	zp->zp_special_smallblk = special_smallblk;
 }
 
 int
@@ -1710,6 +1972,7 @@ dmu_object_info_from_dnode(dnode_t *dn, dmu_object_info_t *doi)
 	doi->doi_type = dn->dn_type;
 	doi->doi_bonus_type = dn->dn_bonustype;
 	doi->doi_bonus_size = dn->dn_bonuslen;
+	doi->doi_dnodesize = dn->dn_num_slots << DNODE_SHIFT;
 	doi->doi_indirection = dn->dn_nlevels;
 	doi->doi_checksum = dn->dn_checksum;
 	doi->doi_compress = dn->dn_compress;
@@ -1717,7 +1980,7 @@ dmu_object_info_from_dnode(dnode_t *dn, dmu_object_info_t *doi)
 	doi->doi_max_offset = (dn->dn_maxblkid + 1) * dn->dn_datablksz;
 	doi->doi_fill_count = 0;
 	for (int i = 0; i < dnp->dn_nblkptr; i++)
-		doi->doi_fill_count += dnp->dn_blkptr[i].blk_fill;
+		doi->doi_fill_count += BP_GET_FILL(&dnp->dn_blkptr[i]);
 
 	mutex_exit(&dn->dn_mtx);
 	rw_exit(&dn->dn_struct_rwlock);
@@ -1777,6 +2040,18 @@ dmu_object_size_from_db(dmu_buf_t *db_fake, uint32_t *blksize,
 	DB_DNODE_EXIT(db);
 }
 
+void
+dmu_object_dnsize_from_db(dmu_buf_t *db_fake, int *dnsize)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)db_fake;
+	dnode_t *dn;
+
+	DB_DNODE_ENTER(db);
+	dn = DB_DNODE(db);
+	*dnsize = dn->dn_num_slots << DNODE_SHIFT;
+	DB_DNODE_EXIT(db);
+}
+
 void
 byteswap_uint64_array(void *vbuf, size_t size)
 {
@@ -1828,23 +2103,28 @@ dmu_init(void)
 	zfs_dbgmsg_init();
 	sa_cache_init();
 	xuio_stat_init();
+	dmu_free_long_stat_init();
 	dmu_objset_init();
 	dnode_init();
 	dbuf_init();
 	zfetch_init();
 	l2arc_init();
 	arc_init();
+	dmu_hold_taskq = taskq_create("dmu_hold_taskq", 50, minclsyspri,
+	    max_ncpus, INT_MAX, TASKQ_PREPOPULATE | TASKQ_THREADS_CPU_PCT);
 }
 
 void
 dmu_fini(void)
 {
+	taskq_destroy(dmu_hold_taskq);
 	arc_fini(); /* arc depends on l2arc, so arc must go first */
 	l2arc_fini();
 	zfetch_fini();
 	dbuf_fini();
 	dnode_fini();
 	dmu_objset_fini();
+	dmu_free_long_stat_fini();
 	xuio_stat_fini();
 	sa_cache_fini();
 	zfs_dbgmsg_fini();
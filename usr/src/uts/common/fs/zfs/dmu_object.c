@@ -30,17 +30,46 @@
 #include <sys/zap.h>
 #include <sys/zfeature.h>
 
-uint64_t
-dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
-    dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx)
+/*
+ * Each CPU allocates object numbers from its own chunk of
+ * 2^dmu_object_alloc_chunk_shift dnodes (rounded to whole dnode blocks,
+ * and at most one L2 block pointer's worth), so that concurrent creates
+ * in one objset don't serialize on os_obj_lock.
+ */
+int dmu_object_alloc_chunk_shift = 7;
+
+/*
+ * Does [object, object + chunk) overlap a chunk some CPU is using?
+ */
+static boolean_t
+dmu_object_chunk_busy(objset_t *os, uint64_t object)
+{
+	uint64_t chunk = os->os_obj_chunk;
+
+	ASSERT(MUTEX_HELD(&os->os_obj_lock));
+
+	for (int i = 0; i < os->os_obj_ncpus; i++) {
+		uint64_t end = os->os_obj_cpu[i].ooc_end;
+
+		if (end != 0 && object < end && end - chunk < object + chunk)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Hand out the next free chunk of object numbers.
+ */
+static uint64_t
+dmu_object_alloc_chunk(objset_t *os, boolean_t *restarted)
 {
-	uint64_t object;
 	uint64_t L2_dnode_count = DNODES_PER_BLOCK <<
 	    (DMU_META_DNODE(os)->dn_indblkshift - SPA_BLKPTRSHIFT);
-	dnode_t *dn = NULL;
-	int restarted = B_FALSE;
+	uint64_t chunk = os->os_obj_chunk;
+	uint64_t object;
+
+	ASSERT(MUTEX_HELD(&os->os_obj_lock));
 
-	mutex_enter(&os->os_obj_lock);
 	for (;;) {
 		object = os->os_obj_next;
 		/*
@@ -51,15 +80,83 @@ dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
 		 * If we can't find one, just keep going from here.
 		 */
 		if (P2PHASE(object, L2_dnode_count) == 0) {
-			uint64_t offset = restarted ? object << DNODE_SHIFT : 0;
+			uint64_t offset = *restarted ? object << DNODE_SHIFT : 0;
 			int error = dnode_next_offset(DMU_META_DNODE(os),
 			    DNODE_FIND_HOLE,
 			    &offset, 2, DNODES_PER_BLOCK >> 2, 0);
-			restarted = B_TRUE;
+			*restarted = B_TRUE;
 			if (error == 0)
-				object = offset >> DNODE_SHIFT;
+				object = P2ALIGN(offset >> DNODE_SHIFT, chunk);
+		}
+		os->os_obj_next = object + chunk;
+
+		/*
+		 * A sparse region may include a chunk that another CPU is
+		 * still allocating from.  Skip it; since we now search
+		 * forward from os_obj_next this always makes progress.
+		 */
+		if (!dmu_object_chunk_busy(os, object))
+			return (object);
+	}
+}
+
+uint64_t
+dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
+    dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx)
+{
+	return (dmu_object_alloc_dnsize(os, ot, blocksize, bonustype, bonuslen,
+	    0, tx));
+}
+
+uint64_t
+dmu_object_alloc_dnsize(objset_t *os, dmu_object_type_t ot, int blocksize,
+    dmu_object_type_t bonustype, int bonuslen, int dnodesize, dmu_tx_t *tx)
+{
+	os_obj_cpu_t *ooc = &os->os_obj_cpu[CPU_SEQID % os->os_obj_ncpus];
+	uint64_t object, tried;
+	dnode_t *dn = NULL;
+	int dn_slots = dnodesize >> DNODE_SHIFT;
+	boolean_t restarted = B_FALSE;
+
+	if (dn_slots == 0)
+		dn_slots = DNODE_MIN_SLOTS;
+	ASSERT3S(dn_slots, >=, DNODE_MIN_SLOTS);
+	ASSERT3S(dn_slots, <=, DNODE_MAX_SLOTS);
+
+	mutex_enter(&ooc->ooc_lock);
+	for (;;) {
+		object = ooc->ooc_next;
+
+		/*
+		 * If what is left of this CPU's chunk can't hold the
+		 * dnode, get a new chunk.
+		 */
+		if (object + dn_slots > ooc->ooc_end) {
+			mutex_enter(&os->os_obj_lock);
+			if (os->os_obj_chunk == 0) {
+				uint64_t L2_dnode_count = DNODES_PER_BLOCK <<
+				    (DMU_META_DNODE(os)->dn_indblkshift -
+				    SPA_BLKPTRSHIFT);
+				os->os_obj_chunk = MIN(MAX(1ULL <<
+				    dmu_object_alloc_chunk_shift,
+				    DNODES_PER_BLOCK), L2_dnode_count);
+			}
+			object = dmu_object_alloc_chunk(os, &restarted);
+			ooc->ooc_end = object + os->os_obj_chunk;
+			mutex_exit(&os->os_obj_lock);
+			object = MAX(object, 1);	/* skip the meta-dnode */
+		}
+
+		/*
+		 * A dnode never spans two dnode blocks.  If this one would
+		 * not fit in what is left of the block, start the search
+		 * again at the beginning of the next one.
+		 */
+		if (P2PHASE(object, DNODES_PER_BLOCK) + dn_slots >
+		    DNODES_PER_BLOCK) {
+			ooc->ooc_next = P2ROUNDUP(object, DNODES_PER_BLOCK);
+			continue;
 		}
-		os->os_obj_next = ++object;
 
 		/*
 		 * XXX We should check for an i/o error here and return
@@ -68,18 +165,28 @@ dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
 		 * to do so.
 		 */
 		(void) dnode_hold_impl(os, object, DNODE_MUST_BE_FREE,
-		    FTAG, &dn);
-		if (dn)
+		    dn_slots, FTAG, &dn);
+		if (dn) {
+			ooc->ooc_next = object + dn_slots;
 			break;
+		}
 
-		if (dmu_object_next(os, &object, B_TRUE, 0) == 0)
-			os->os_obj_next = object - 1;
+		/*
+		 * Skip ahead to the next hole.  If that is past the end of
+		 * our chunk, the check above will get us a new one.
+		 */
+		tried = object;
+		if (dmu_object_next(os, &object, B_TRUE, 0) == 0 &&
+		    object > tried)
+			ooc->ooc_next = object;
+		else
+			ooc->ooc_next = tried + 1;
 	}
 
-	dnode_allocate(dn, ot, blocksize, 0, bonustype, bonuslen, tx);
+	dnode_allocate(dn, ot, blocksize, 0, bonustype, bonuslen, dn_slots, tx);
 	dnode_rele(dn, FTAG);
 
-	mutex_exit(&os->os_obj_lock);
+	mutex_exit(&ooc->ooc_lock);
 
 	dmu_tx_add_new_object(tx, os, object);
 	return (object);
@@ -88,17 +195,33 @@ dmu_object_alloc(objset_t *os, dmu_object_type_t ot, int blocksize,
 int
 dmu_object_claim(objset_t *os, uint64_t object, dmu_object_type_t ot,
     int blocksize, dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx)
+{
+	return (dmu_object_claim_dnsize(os, object, ot, blocksize, bonustype,
+	    bonuslen, 0, tx));
+}
+
+int
+dmu_object_claim_dnsize(objset_t *os, uint64_t object, dmu_object_type_t ot,
+    int blocksize, dmu_object_type_t bonustype, int bonuslen,
+    int dnodesize, dmu_tx_t *tx)
 {
 	dnode_t *dn;
+	int dn_slots = dnodesize >> DNODE_SHIFT;
 	int err;
 
+	if (dn_slots == 0)
+		dn_slots = DNODE_MIN_SLOTS;
+	ASSERT3S(dn_slots, >=, DNODE_MIN_SLOTS);
+	ASSERT3S(dn_slots, <=, DNODE_MAX_SLOTS);
+
 	if (object == DMU_META_DNODE_OBJECT && !dmu_tx_private_ok(tx))
 		return (SET_ERROR(EBADF));
 
-	err = dnode_hold_impl(os, object, DNODE_MUST_BE_FREE, FTAG, &dn);
+	err = dnode_hold_impl(os, object, DNODE_MUST_BE_FREE, dn_slots,
+	    FTAG, &dn);
 	if (err)
 		return (err);
-	dnode_allocate(dn, ot, blocksize, 0, bonustype, bonuslen, tx);
+	dnode_allocate(dn, ot, blocksize, 0, bonustype, bonuslen, dn_slots, tx);
 	dnode_rele(dn, FTAG);
 
 	dmu_tx_add_new_object(tx, os, object);
@@ -117,7 +240,7 @@ dmu_object_reclaim(objset_t *os, uint64_t object, dmu_object_type_t ot,
 	if (object == DMU_META_DNODE_OBJECT)
 		return (SET_ERROR(EBADF));
 
-	err = dnode_hold_impl(os, object, DNODE_MUST_BE_ALLOCATED,
+	err = dnode_hold_impl(os, object, DNODE_MUST_BE_ALLOCATED, 0,
 	    FTAG, &dn);
 	if (err)
 		return (err);
@@ -132,7 +255,9 @@ dmu_object_reclaim(objset_t *os, uint64_t object, dmu_object_type_t ot,
 	if (bonustype == DMU_OT_SA) {
 		nblkptr = 1;
 	} else {
-		nblkptr = 1 + ((DN_MAX_BONUSLEN - bonuslen) >> SPA_BLKPTRSHIFT);
+		nblkptr = MIN(DN_MAX_NBLKPTR, 1 +
+		    ((DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots) - bonuslen) >>
+		    SPA_BLKPTRSHIFT));
 	}
 
 	/*
@@ -171,7 +296,7 @@ dmu_object_free(objset_t *os, uint64_t object, dmu_tx_t *tx)
 
 	ASSERT(object != DMU_META_DNODE_OBJECT || dmu_tx_private_ok(tx));
 
-	err = dnode_hold_impl(os, object, DNODE_MUST_BE_ALLOCATED,
+	err = dnode_hold_impl(os, object, DNODE_MUST_BE_ALLOCATED, 0,
 	    FTAG, &dn);
 	if (err)
 		return (err);
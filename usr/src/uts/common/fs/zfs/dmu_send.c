@@ -41,6 +41,8 @@
 #include <sys/zfs_ioctl.h>
 #include <sys/zap.h>
 #include <sys/zio_checksum.h>
+#include <sys/zio_compress.h>
+#include <sys/zfeature.h>
 #include <sys/zfs_znode.h>
 #include <zfs_fletcher.h>
 #include <sys/avl.h>
@@ -49,10 +51,31 @@
 #include <sys/dmu_send.h>
 #include <sys/dsl_destroy.h>
 #include <sys/dsl_bookmark.h>
+#include <sys/bqueue.h>
 
 /* Set this tunable to TRUE to replace corrupt data with 0x2f5baddb10c */
 int zfs_send_corrupt_data = B_FALSE;
 
+/*
+ * Sending is also split in two.  A traversal thread walks the dataset,
+ * starts reads of the blocks that will be sent, and queues a record for
+ * each block; the ioctl thread takes the records off the queue in order
+ * and writes the stream.  The queue is charged the size of each block
+ * being read, so zfs_send_queue_length bounds how much data the traversal
+ * thread has in flight ahead of the writer.
+ */
+int zfs_send_queue_length = 16 * 1024 * 1024;
+
+/*
+ * Receiving is split between two threads.  The ioctl thread reads records
+ * and their payloads from the stream and verifies the stream checksum; a
+ * writer thread applies the records to the objset.  The two are connected
+ * by a queue holding at most zfs_recv_queue_length bytes of records, so
+ * reading ahead in the stream overlaps with assigning and filling the
+ * transactions for earlier records.
+ */
+int zfs_recv_queue_length = 16 * 1024 * 1024;
+
 static char *dmu_recv_tag = "dmu_recv_tag";
 static const char *recv_clone_name = "%recv";
 
@@ -167,9 +190,13 @@ dump_free(dmu_sendarg_t *dsp, uint64_t object, uint64_t offset,
 	return (0);
 }
 
+/*
+ * Write a DRR_WRITE record for a block of blksz bytes.  If psize is less
+ * than blksz, data is the block as it is on disk, still compressed.
+ */
 static int
-dump_data(dmu_sendarg_t *dsp, dmu_object_type_t type,
-    uint64_t object, uint64_t offset, int blksz, const blkptr_t *bp, void *data)
+dump_data(dmu_sendarg_t *dsp, dmu_object_type_t type, uint64_t object,
+    uint64_t offset, int blksz, int psize, const blkptr_t *bp, void *data)
 {
 	struct drr_write *drrw = &(dsp->dsa_drr->drr_u.drr_write);
 
@@ -210,10 +237,15 @@ dump_data(dmu_sendarg_t *dsp, dmu_object_type_t type,
 	DDK_SET_PSIZE(&drrw->drr_key, BP_GET_PSIZE(bp));
 	DDK_SET_COMPRESS(&drrw->drr_key, BP_GET_COMPRESS(bp));
 	drrw->drr_key.ddk_cksum = bp->blk_cksum;
+	if (psize < blksz) {
+		ASSERT(dsp->dsa_compressok);
+		drrw->drr_compressiontype = BP_GET_COMPRESS(bp);
+		drrw->drr_compressed_size = psize;
+	}
 
 	if (dump_bytes(dsp, dsp->dsa_drr, sizeof (dmu_replay_record_t)) != 0)
 		return (SET_ERROR(EINTR));
-	if (dump_bytes(dsp, data, blksz) != 0)
+	if (dump_bytes(dsp, data, psize) != 0)
 		return (SET_ERROR(EINTR));
 	return (0);
 }
@@ -321,6 +353,7 @@ dump_dnode(dmu_sendarg_t *dsp, uint64_t object, dnode_phys_t *dnp)
 	drro->drr_bonuslen = dnp->dn_bonuslen;
 	drro->drr_checksumtype = dnp->dn_checksum;
 	drro->drr_compress = dnp->dn_compress;
+	drro->drr_dn_slots = dnp->dn_extra_slots + 1;
 	drro->drr_toguid = dsp->dsa_toguid;
 
 	if (dump_bytes(dsp, dsp->dsa_drr, sizeof (dmu_replay_record_t)) != 0)
@@ -338,22 +371,123 @@ dump_dnode(dmu_sendarg_t *dsp, uint64_t object, dnode_phys_t *dnp)
 	return (0);
 }
 
-#define	BP_SPAN(dnp, level) \
-	(((uint64_t)dnp->dn_datablkszsec) << (SPA_MINBLOCKSHIFT + \
-	(level) * (dnp->dn_indblkshift - SPA_BLKPTRSHIFT)))
+#define	BP_SPAN(datablkszsec, indblkshift, level) \
+	(((uint64_t)datablkszsec) << (SPA_MINBLOCKSHIFT + \
+	(level) * (indblkshift - SPA_BLKPTRSHIFT)))
+
+/*
+ * A block visited by the traversal thread, queued for the ioctl thread.
+ * The dnode_phys_t the block belongs to is only valid in the traversal
+ * callback, so the two fields needed to compute a hole's span are copied.
+ */
+struct send_block_record {
+	boolean_t	eos_marker;	/* traversal is done */
+	blkptr_t	bp;
+	zbookmark_t	zb;
+	uint8_t		indblkshift;
+	uint16_t	datablkszsec;
+	bqueue_node_t	ln;
+};
+
+struct send_thread_arg {
+	bqueue_t	q;
+	dsl_dataset_t	*ds;		/* dataset to traverse */
+	uint64_t	fromtxg;	/* traverse blocks born after this */
+	int		flags;		/* flags for traverse_dataset() */
+	int		error_code;	/* traversal error, if any */
+	boolean_t	cancel;		/* writer failed, stop traversing */
+};
+
+/*
+ * Will do_dump() read this block?  If so the traversal thread starts
+ * reading it as soon as it is found.
+ */
+static boolean_t
+send_block_wanted(const blkptr_t *bp, const zbookmark_t *zb)
+{
+	if (BP_IS_HOLE(bp) || zb->zb_level != 0 ||
+	    BP_GET_TYPE(bp) == DMU_OT_OBJSET)
+		return (B_FALSE);
+	return (zb->zb_object == DMU_META_DNODE_OBJECT ||
+	    !DMU_OBJECT_IS_SPECIAL(zb->zb_object));
+}
 
 /* ARGSUSED */
 static int
-backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
+send_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
     const zbookmark_t *zb, const dnode_phys_t *dnp, void *arg)
 {
-	dmu_sendarg_t *dsp = arg;
-	dmu_object_type_t type = bp ? BP_GET_TYPE(bp) : DMU_OT_NONE;
-	int err = 0;
+	struct send_thread_arg *sta = arg;
+	struct send_block_record *record;
+	uint64_t record_size = sizeof (*record);
 
-	if (issig(JUSTLOOKING) && issig(FORREAL))
+	if (sta->cancel)
 		return (SET_ERROR(EINTR));
 
+	record = kmem_zalloc(sizeof (*record), KM_SLEEP);
+	record->bp = *bp;
+	record->zb = *zb;
+	if (dnp != NULL) {
+		record->indblkshift = dnp->dn_indblkshift;
+		record->datablkszsec = dnp->dn_datablkszsec;
+	}
+
+	if (send_block_wanted(bp, zb)) {
+		uint32_t aflags = ARC_NOWAIT | ARC_PREFETCH;
+
+		(void) arc_read(NULL, spa, bp, NULL, NULL,
+		    ZIO_PRIORITY_ASYNC_READ,
+		    ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE, &aflags, zb);
+		record_size += BP_GET_LSIZE(bp);
+	}
+
+	bqueue_enqueue(&sta->q, record, record_size);
+	return (0);
+}
+
+/*
+ * Traverse the dataset, queueing every block for the ioctl thread, and
+ * finish with an end-of-stream marker even if the traversal failed.
+ */
+static void
+send_traverse_thread(void *arg)
+{
+	struct send_thread_arg *sta = arg;
+	struct send_block_record *record;
+	int err;
+
+	err = traverse_dataset(sta->ds, sta->fromtxg, sta->flags,
+	    send_cb, sta);
+	if (err != EINTR)
+		sta->error_code = err;
+
+	record = kmem_zalloc(sizeof (*record), KM_SLEEP);
+	record->eos_marker = B_TRUE;
+	bqueue_enqueue(&sta->q, record, 1);
+	thread_exit();
+}
+
+static struct send_block_record *
+get_next_record(bqueue_t *q, struct send_block_record *record)
+{
+	kmem_free(record, sizeof (*record));
+	return (bqueue_dequeue(q));
+}
+
+/*
+ * Write the stream records for one block found by the traversal.
+ */
+static int
+do_dump(dmu_sendarg_t *dsp, struct send_block_record *data)
+{
+	spa_t *spa = dmu_objset_spa(dsp->dsa_os);
+	const blkptr_t *bp = &data->bp;
+	const zbookmark_t *zb = &data->zb;
+	uint8_t indblkshift = data->indblkshift;
+	uint16_t dblkszsec = data->datablkszsec;
+	dmu_object_type_t type = BP_GET_TYPE(bp);
+	int err = 0;
+
 	if (zb->zb_object != DMU_META_DNODE_OBJECT &&
 	    DMU_OBJECT_IS_SPECIAL(zb->zb_object)) {
 		return (0);
@@ -365,11 +499,11 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 		return (0);
 	} else if (BP_IS_HOLE(bp) &&
 	    zb->zb_object == DMU_META_DNODE_OBJECT) {
-		uint64_t span = BP_SPAN(dnp, zb->zb_level);
+		uint64_t span = BP_SPAN(dblkszsec, indblkshift, zb->zb_level);
 		uint64_t dnobj = (zb->zb_blkid * span) >> DNODE_SHIFT;
 		err = dump_freeobjects(dsp, dnobj, span >> DNODE_SHIFT);
 	} else if (BP_IS_HOLE(bp)) {
-		uint64_t span = BP_SPAN(dnp, zb->zb_level);
+		uint64_t span = BP_SPAN(dblkszsec, indblkshift, zb->zb_level);
 		err = dump_free(dsp, zb->zb_object, zb->zb_blkid * span, span);
 	} else if (zb->zb_level > 0 || type == DMU_OT_OBJSET) {
 		return (0);
@@ -386,7 +520,8 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 			return (SET_ERROR(EIO));
 
 		blk = abuf->b_data;
-		for (i = 0; i < blksz >> DNODE_SHIFT; i++) {
+		for (i = 0; i < blksz >> DNODE_SHIFT;
+		    i += blk[i].dn_extra_slots + 1) {
 			uint64_t dnobj = (zb->zb_blkid <<
 			    (DNODE_BLOCK_SHIFT - DNODE_SHIFT)) + i;
 			err = dump_dnode(dsp, dnobj, blk+i);
@@ -412,6 +547,32 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 		int blksz = BP_GET_LSIZE(bp);
 
 		ASSERT0(zb->zb_level);
+
+		/*
+		 * In a compressed stream, send a compressed block as it is
+		 * on disk.  A block in the other byte order is sent
+		 * decompressed, since only the decompressed data can be
+		 * byteswapped for the stream.  If the raw read fails, fall
+		 * back to reading the block normally.
+		 */
+		if (dsp->dsa_compressok && !BP_IS_EMBEDDED(bp) &&
+		    BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF &&
+		    !BP_SHOULD_BYTESWAP(bp)) {
+			int psize = BP_GET_PSIZE(bp);
+			void *cbuf = zio_data_buf_alloc(psize);
+
+			if (arc_read_raw(spa, bp, cbuf, ZIO_PRIORITY_ASYNC_READ,
+			    ZIO_FLAG_CANFAIL, zb) == 0) {
+				err = dump_data(dsp, type, zb->zb_object,
+				    zb->zb_blkid * blksz, blksz, psize, bp,
+				    cbuf);
+				zio_data_buf_free(cbuf, psize);
+				ASSERT(err == 0 || err == EINTR);
+				return (err);
+			}
+			zio_data_buf_free(cbuf, psize);
+		}
+
 		if (arc_read(NULL, spa, bp, arc_getbuf_func, &abuf,
 		    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
 		    &aflags, zb) != 0) {
@@ -430,7 +591,7 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 		}
 
 		err = dump_data(dsp, type, zb->zb_object, zb->zb_blkid * blksz,
-		    blksz, bp, abuf->b_data);
+		    blksz, blksz, bp, abuf->b_data);
 		(void) arc_buf_remove_ref(abuf, &abuf);
 	}
 
@@ -443,12 +604,14 @@ backup_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
  */
 static int
 dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *ds,
-    zfs_bookmark_phys_t *fromzb, boolean_t is_clone, int outfd,
-    vnode_t *vp, offset_t *off)
+    zfs_bookmark_phys_t *fromzb, boolean_t is_clone, boolean_t compressok,
+    int outfd, vnode_t *vp, offset_t *off)
 {
 	objset_t *os;
 	dmu_replay_record_t *drr;
 	dmu_sendarg_t *dsp;
+	struct send_thread_arg to_arg = { 0 };
+	struct send_block_record *to_data;
 	int err;
 	uint64_t fromtxg = 0;
 
@@ -480,6 +643,23 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *ds,
 	}
 #endif
 
+	if (compressok) {
+		DMU_SET_FEATUREFLAGS(drr->drr_u.drr_begin.drr_versioninfo,
+		    DMU_GET_FEATUREFLAGS(drr->drr_u.drr_begin.drr_versioninfo) |
+		    DMU_BACKUP_FEATURE_COMPRESSED);
+	}
+
+	/*
+	 * The stream may contain large dnodes only if the feature has
+	 * been activated, which it is by setting dnodesize anywhere in
+	 * the pool.
+	 */
+	if (spa_feature_is_active(dp->dp_spa, SPA_FEATURE_LARGE_DNODE)) {
+		DMU_SET_FEATUREFLAGS(drr->drr_u.drr_begin.drr_versioninfo,
+		    DMU_GET_FEATUREFLAGS(drr->drr_u.drr_begin.drr_versioninfo) |
+		    DMU_BACKUP_FEATURE_LARGE_DNODE);
+	}
+
 	drr->drr_u.drr_begin.drr_creation_time =
 	    ds->ds_phys->ds_creation_time;
 	drr->drr_u.drr_begin.drr_type = dmu_objset_type(os);
@@ -511,6 +691,7 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *ds,
 	ZIO_SET_CHECKSUM(&dsp->dsa_zc, 0, 0, 0, 0);
 	dsp->dsa_pending_op = PENDING_NONE;
 	dsp->dsa_incremental = (fromzb != NULL);
+	dsp->dsa_compressok = compressok;
 
 	mutex_enter(&ds->ds_sendstream_lock);
 	list_insert_head(&ds->ds_sendstreams, dsp);
@@ -524,8 +705,42 @@ dmu_send_impl(void *tag, dsl_pool_t *dp, dsl_dataset_t *ds,
 		goto out;
 	}
 
-	err = traverse_dataset(ds, fromtxg, TRAVERSE_PRE | TRAVERSE_PREFETCH,
-	    backup_cb, dsp);
+	/*
+	 * The traversal thread starts the data reads itself, bounded by the
+	 * queue, so only metadata is left to traverse_dataset()'s prefetcher.
+	 */
+	to_arg.ds = ds;
+	to_arg.fromtxg = fromtxg;
+	to_arg.flags = TRAVERSE_PRE | TRAVERSE_PREFETCH_METADATA;
+	bqueue_init(&to_arg.q, zfs_send_queue_length,
+	    offsetof(struct send_block_record, ln));
+	(void) thread_create(NULL, 0, send_traverse_thread, &to_arg, 0,
+	    curproc, TS_RUN, minclsyspri);
+
+	to_data = bqueue_dequeue(&to_arg.q);
+	while (!to_data->eos_marker && err == 0) {
+		if (issig(JUSTLOOKING) && issig(FORREAL)) {
+			err = SET_ERROR(EINTR);
+			break;
+		}
+		err = do_dump(dsp, to_data);
+		to_data = get_next_record(&to_arg.q, to_data);
+	}
+
+	/*
+	 * On failure, stop the traversal and drain the queue up to its
+	 * end-of-stream marker, after which the thread is gone.
+	 */
+	if (err != 0) {
+		to_arg.cancel = B_TRUE;
+		while (!to_data->eos_marker)
+			to_data = get_next_record(&to_arg.q, to_data);
+	}
+	kmem_free(to_data, sizeof (*to_data));
+	bqueue_destroy(&to_arg.q);
+
+	if (err == 0 && to_arg.error_code != 0)
+		err = to_arg.error_code;
 
 	if (dsp->dsa_pending_op != PENDING_NONE)
 		if (dump_bytes(dsp, drr, sizeof (dmu_replay_record_t)) != 0)
@@ -562,7 +777,7 @@ out:
 
 int
 dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
-    int outfd, vnode_t *vp, offset_t *off)
+    boolean_t compressok, int outfd, vnode_t *vp, offset_t *off)
 {
 	dsl_pool_t *dp;
 	dsl_dataset_t *ds;
@@ -596,10 +811,10 @@ dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
 		zb.zbm_guid = fromds->ds_phys->ds_guid;
 		is_clone = (fromds->ds_dir != ds->ds_dir);
 		dsl_dataset_rele(fromds, FTAG);
-		err = dmu_send_impl(FTAG, dp, ds, &zb, is_clone,
+		err = dmu_send_impl(FTAG, dp, ds, &zb, is_clone, compressok,
 		    outfd, vp, off);
 	} else {
-		err = dmu_send_impl(FTAG, dp, ds, NULL, B_FALSE,
+		err = dmu_send_impl(FTAG, dp, ds, NULL, B_FALSE, compressok,
 		    outfd, vp, off);
 	}
 	dsl_dataset_rele(ds, FTAG);
@@ -607,7 +822,7 @@ dmu_send_obj(const char *pool, uint64_t tosnap, uint64_t fromsnap,
 }
 
 int
-dmu_send(const char *tosnap, const char *fromsnap,
+dmu_send(const char *tosnap, const char *fromsnap, boolean_t compressok,
     int outfd, vnode_t *vp, offset_t *off)
 {
 	dsl_pool_t *dp;
@@ -674,10 +889,10 @@ dmu_send(const char *tosnap, const char *fromsnap,
 			dsl_pool_rele(dp, FTAG);
 			return (err);
 		}
-		err = dmu_send_impl(FTAG, dp, ds, &zb, is_clone,
+		err = dmu_send_impl(FTAG, dp, ds, &zb, is_clone, compressok,
 		    outfd, vp, off);
 	} else {
-		err = dmu_send_impl(FTAG, dp, ds, NULL, B_FALSE,
+		err = dmu_send_impl(FTAG, dp, ds, NULL, B_FALSE, compressok,
 		    outfd, vp, off);
 	}
 	if (owned)
@@ -866,6 +1081,13 @@ dmu_recv_begin_check(void *arg, dmu_tx_t *tx)
 		return (SET_ERROR(ENOTSUP));
 	}
 
+	/* Large dnodes can only be received if the feature is enabled */
+	if ((DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
+	    DMU_BACKUP_FEATURE_LARGE_DNODE) &&
+	    !spa_feature_is_enabled(dp->dp_spa, SPA_FEATURE_LARGE_DNODE)) {
+		return (SET_ERROR(ENOTSUP));
+	}
+
 	error = dsl_dataset_hold(dp, tofs, FTAG, &ds);
 	if (error == 0) {
 		/* target fs already exists; recv into temp clone */
@@ -1003,6 +1225,11 @@ dmu_recv_begin_sync(void *arg, dmu_tx_t *tx)
 		    newds, dsl_dataset_get_blkptr(newds), drrb->drr_type, tx);
 	}
 
+	if ((DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
+	    DMU_BACKUP_FEATURE_LARGE_DNODE) &&
+	    !spa_feature_is_active(dp->dp_spa, SPA_FEATURE_LARGE_DNODE))
+		spa_feature_incr(dp->dp_spa, SPA_FEATURE_LARGE_DNODE, tx);
+
 	drba->drba_cookie->drc_ds = newds;
 
 	spa_history_log_internal_ds(newds, "receive", tx, "");
@@ -1060,15 +1287,43 @@ dmu_recv_begin(char *tofs, char *tosnap, struct drr_begin *drrb,
 	    &drba, 5));
 }
 
+/*
+ * State of the thread reading the stream.
+ */
 struct restorearg {
 	int err;
 	boolean_t byteswap;
 	vnode_t *vp;
-	char *buf;
 	uint64_t voff;
-	int bufsize; /* amount of memory allocated for buf */
 	zio_cksum_t cksum;
-	avl_tree_t *guid_to_ds_map;
+	objset_t *os;
+	boolean_t prefetch;	/* prefetch blocks about to be overwritten */
+};
+
+/*
+ * A record read from the stream, queued for the writer thread.
+ */
+struct receive_record_arg {
+	dmu_replay_record_t header;
+	void *payload;		/* data following the record, if any */
+	int payload_size;
+	boolean_t eos_marker;	/* no more records follow */
+	bqueue_node_t node;
+};
+
+/*
+ * State of the writer thread.  rwa_err is set by the writer only, and
+ * checked by the reader so that it stops reading after a failure.
+ */
+struct receive_writer_arg {
+	objset_t *rwa_os;
+	boolean_t rwa_byteswap;
+	avl_tree_t *rwa_guid_to_ds_map;
+	bqueue_t rwa_q;
+	kmutex_t rwa_lock;
+	kcondvar_t rwa_cv;
+	boolean_t rwa_done;
+	int rwa_err;
 };
 
 typedef struct guid_map_entry {
@@ -1106,10 +1361,9 @@ free_guid_map_onexit(void *arg)
 	kmem_free(ca, sizeof (avl_tree_t));
 }
 
-static void *
-restore_read(struct restorearg *ra, int len)
+static int
+restore_read(struct restorearg *ra, int len, void *buf)
 {
-	void *rv;
 	int done = 0;
 
 	/* some things will require 8-byte alignment, so everything must */
@@ -1119,7 +1373,7 @@ restore_read(struct restorearg *ra, int len)
 		ssize_t resid;
 
 		ra->err = vn_rdwr(UIO_READ, ra->vp,
-		    (caddr_t)ra->buf + done, len - done,
+		    (caddr_t)buf + done, len - done,
 		    ra->voff, UIO_SYSSPACE, FAPPEND,
 		    RLIM64_INFINITY, CRED(), &resid);
 
@@ -1128,16 +1382,15 @@ restore_read(struct restorearg *ra, int len)
 		ra->voff += len - done - resid;
 		done = len - resid;
 		if (ra->err != 0)
-			return (NULL);
+			return (ra->err);
 	}
 
 	ASSERT3U(done, ==, len);
-	rv = ra->buf;
 	if (ra->byteswap)
-		fletcher_4_incremental_byteswap(rv, len, &ra->cksum);
+		fletcher_4_incremental_byteswap(buf, len, &ra->cksum);
 	else
-		fletcher_4_incremental_native(rv, len, &ra->cksum);
-	return (rv);
+		fletcher_4_incremental_native(buf, len, &ra->cksum);
+	return (0);
 }
 
 static void
@@ -1182,6 +1435,7 @@ backup_byteswap(dmu_replay_record_t *drr)
 		DO64(drr_write.drr_key.ddk_cksum.zc_word[2]);
 		DO64(drr_write.drr_key.ddk_cksum.zc_word[3]);
 		DO64(drr_write.drr_key.ddk_prop);
+		DO64(drr_write.drr_compressed_size);
 		break;
 	case DRR_WRITE_BYREF:
 		DO64(drr_write_byref.drr_object);
@@ -1221,11 +1475,18 @@ backup_byteswap(dmu_replay_record_t *drr)
 }
 
 static int
-restore_object(struct restorearg *ra, objset_t *os, struct drr_object *drro)
+restore_object(struct receive_writer_arg *rwa, struct drr_object *drro,
+    void *data)
 {
+	objset_t *os = rwa->rwa_os;
+	dmu_object_info_t doi;
+	int dn_slots;
 	int err;
 	dmu_tx_t *tx;
-	void *data = NULL;
+
+	/* Streams from before large dnodes leave drr_dn_slots zero. */
+	dn_slots = (drro->drr_dn_slots != 0) ?
+	    drro->drr_dn_slots : DNODE_MIN_SLOTS;
 
 	if (drro->drr_type == DMU_OT_NONE ||
 	    !DMU_OT_IS_VALID(drro->drr_type) ||
@@ -1235,34 +1496,76 @@ restore_object(struct restorearg *ra, objset_t *os, struct drr_object *drro)
 	    P2PHASE(drro->drr_blksz, SPA_MINBLOCKSIZE) ||
 	    drro->drr_blksz < SPA_MINBLOCKSIZE ||
 	    drro->drr_blksz > SPA_MAXBLOCKSIZE ||
-	    drro->drr_bonuslen > DN_MAX_BONUSLEN) {
+	    dn_slots > DNODE_MAX_SLOTS ||
+	    P2PHASE(drro->drr_object, DNODES_PER_BLOCK) + dn_slots >
+	    DNODES_PER_BLOCK ||
+	    drro->drr_bonuslen > DN_SLOTS_TO_BONUSLEN(dn_slots)) {
 		return (SET_ERROR(EINVAL));
 	}
 
-	err = dmu_object_info(os, drro->drr_object, NULL);
+	err = dmu_object_info(os, drro->drr_object, &doi);
 
 	if (err != 0 && err != ENOENT)
 		return (SET_ERROR(EINVAL));
 
-	if (drro->drr_bonuslen) {
-		data = restore_read(ra, P2ROUNDUP(drro->drr_bonuslen, 8));
-		if (ra->err != 0)
-			return (ra->err);
+	/*
+	 * The size of a dnode can't be changed in place, so an object
+	 * whose dnode size differs is freed and claimed afresh.  The free
+	 * must reach disk first: until it does, the old dnode's slots
+	 * still look allocated.
+	 */
+	if (err == 0 && doi.doi_dnodesize != (dn_slots << DNODE_SHIFT)) {
+		err = dmu_free_long_object(os, drro->drr_object);
+		if (err != 0)
+			return (SET_ERROR(EINVAL));
+		txg_wait_synced(dmu_objset_pool(os), 0);
+		err = ENOENT;
 	}
 
 	if (err == ENOENT) {
+		boolean_t freed = B_FALSE;
+
+		/*
+		 * The extra slots of a large dnode may still hold objects
+		 * the sender has since freed (the FREEOBJECTS record for
+		 * them can come later in the stream); free them now.
+		 */
+		for (uint64_t obj = drro->drr_object + 1;
+		    obj < drro->drr_object + dn_slots; obj++) {
+			if (dmu_object_info(os, obj, NULL) != 0)
+				continue;
+			err = dmu_free_long_object(os, obj);
+			if (err != 0)
+				return (SET_ERROR(EINVAL));
+			freed = B_TRUE;
+		}
+		if (freed)
+			txg_wait_synced(dmu_objset_pool(os), 0);
+
 		/* currently free, want to be allocated */
-		tx = dmu_tx_create(os);
-		dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
-		err = dmu_tx_assign(tx, TXG_WAIT);
-		if (err != 0) {
-			dmu_tx_abort(tx);
-			return (err);
+		for (int tries = 0; ; tries++) {
+			tx = dmu_tx_create(os);
+			dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+			err = dmu_tx_assign(tx, TXG_WAIT);
+			if (err != 0) {
+				dmu_tx_abort(tx);
+				return (err);
+			}
+			err = dmu_object_claim_dnsize(os, drro->drr_object,
+			    drro->drr_type, drro->drr_blksz,
+			    drro->drr_bonustype, drro->drr_bonuslen,
+			    dn_slots << DNODE_SHIFT, tx);
+			dmu_tx_commit(tx);
+
+			/*
+			 * EEXIST means a large dnode freed earlier in this
+			 * stream still covers the slot in core; once its
+			 * free has synced the claim can succeed.
+			 */
+			if (err != EEXIST || tries > 0)
+				break;
+			txg_wait_synced(dmu_objset_pool(os), 0);
 		}
-		err = dmu_object_claim(os, drro->drr_object,
-		    drro->drr_type, drro->drr_blksz,
-		    drro->drr_bonustype, drro->drr_bonuslen, tx);
-		dmu_tx_commit(tx);
 	} else {
 		/* currently allocated, want to be allocated */
 		err = dmu_object_reclaim(os, drro->drr_object,
@@ -1293,7 +1596,7 @@ restore_object(struct restorearg *ra, objset_t *os, struct drr_object *drro)
 
 		ASSERT3U(db->db_size, >=, drro->drr_bonuslen);
 		bcopy(data, db->db_data, drro->drr_bonuslen);
-		if (ra->byteswap) {
+		if (rwa->rwa_byteswap) {
 			dmu_object_byteswap_t byteswap =
 			    DMU_OT_BYTESWAP(drro->drr_bonustype);
 			dmu_ot_byteswap[byteswap].ob_func(db->db_data,
@@ -1307,9 +1610,10 @@ restore_object(struct restorearg *ra, objset_t *os, struct drr_object *drro)
 
 /* ARGSUSED */
 static int
-restore_freeobjects(struct restorearg *ra, objset_t *os,
+restore_freeobjects(struct receive_writer_arg *rwa,
     struct drr_freeobjects *drrfo)
 {
+	objset_t *os = rwa->rwa_os;
 	uint64_t obj;
 
 	if (drrfo->drr_firstobj + drrfo->drr_numobjs < drrfo->drr_firstobj)
@@ -1330,21 +1634,80 @@ restore_freeobjects(struct restorearg *ra, objset_t *os,
 	return (0);
 }
 
+/*
+ * Can this pool hold blocks compressed with c?
+ */
+static boolean_t
+restore_compress_ok(spa_t *spa, enum zio_compress c)
+{
+	if (c == ZIO_COMPRESS_LZ4)
+		return (spa_feature_is_active(spa, SPA_FEATURE_LZ4_COMPRESS));
+	if (c == ZIO_COMPRESS_ZLE)
+		return (spa_version(spa) >= SPA_VERSION_ZLE_COMPRESSION);
+	if (c >= ZIO_COMPRESS_GZIP_1 && c <= ZIO_COMPRESS_GZIP_9)
+		return (spa_version(spa) >= SPA_VERSION_GZIP_COMPRESSION);
+	return (c == ZIO_COMPRESS_LZJB);
+}
+
+/*
+ * Apply a DRR_WRITE record whose data is still compressed.  The block is
+ * decompressed to fill the dbuf, and the compressed copy is written to
+ * disk as it is, unless it has to be byteswapped or this pool can't hold
+ * blocks compressed that way, in which case the block is written like
+ * any other.
+ */
 static int
-restore_write(struct restorearg *ra, objset_t *os,
-    struct drr_write *drrw)
+restore_write_compressed(struct receive_writer_arg *rwa,
+    struct drr_write *drrw, void *cdata, dmu_tx_t *tx)
 {
-	dmu_tx_t *tx;
+	objset_t *os = rwa->rwa_os;
+	enum zio_compress compress = drrw->drr_compressiontype;
+	uint64_t psize = drrw->drr_compressed_size;
+	dmu_object_byteswap_t byteswap = DMU_OT_BYTESWAP(drrw->drr_type);
 	void *data;
+
+	data = zio_data_buf_alloc(drrw->drr_length);
+	if (zio_decompress_data(compress, cdata, data, psize,
+	    drrw->drr_length) != 0) {
+		zio_data_buf_free(data, drrw->drr_length);
+		return (SET_ERROR(EINVAL));
+	}
+
+	if (rwa->rwa_byteswap && byteswap != DMU_BSWAP_UINT8) {
+		dmu_ot_byteswap[byteswap].ob_func(data, drrw->drr_length);
+		dmu_write(os, drrw->drr_object,
+		    drrw->drr_offset, drrw->drr_length, data, tx);
+	} else if (!restore_compress_ok(dmu_objset_spa(os), compress)) {
+		dmu_write(os, drrw->drr_object,
+		    drrw->drr_offset, drrw->drr_length, data, tx);
+	} else {
+		dmu_write_precompressed(os, drrw->drr_object,
+		    drrw->drr_offset, drrw->drr_length, data, compress,
+		    cdata, psize, tx);
+	}
+
+	zio_data_buf_free(data, drrw->drr_length);
+	return (0);
+}
+
+static int
+restore_write(struct receive_writer_arg *rwa, struct drr_write *drrw,
+    void *data)
+{
+	objset_t *os = rwa->rwa_os;
+	dmu_tx_t *tx;
 	int err;
 
 	if (drrw->drr_offset + drrw->drr_length < drrw->drr_offset ||
 	    !DMU_OT_IS_VALID(drrw->drr_type))
 		return (SET_ERROR(EINVAL));
 
-	data = restore_read(ra, drrw->drr_length);
-	if (data == NULL)
-		return (ra->err);
+	if (DRR_WRITE_COMPRESSED(drrw) &&
+	    (drrw->drr_compressiontype <= ZIO_COMPRESS_OFF ||
+	    drrw->drr_compressiontype >= ZIO_COMPRESS_FUNCTIONS ||
+	    zio_compress_table[drrw->drr_compressiontype].ci_decompress ==
+	    NULL))
+		return (SET_ERROR(EINVAL));
 
 	if (dmu_object_info(os, drrw->drr_object, NULL) != 0)
 		return (SET_ERROR(EINVAL));
@@ -1358,7 +1721,12 @@ restore_write(struct restorearg *ra, objset_t *os,
 		dmu_tx_abort(tx);
 		return (err);
 	}
-	if (ra->byteswap) {
+	if (DRR_WRITE_COMPRESSED(drrw)) {
+		err = restore_write_compressed(rwa, drrw, data, tx);
+		dmu_tx_commit(tx);
+		return (err);
+	}
+	if (rwa->rwa_byteswap) {
 		dmu_object_byteswap_t byteswap =
 		    DMU_OT_BYTESWAP(drrw->drr_type);
 		dmu_ot_byteswap[byteswap].ob_func(data, drrw->drr_length);
@@ -1377,9 +1745,10 @@ restore_write(struct restorearg *ra, objset_t *os,
  * data from the stream to fulfill this write.
  */
 static int
-restore_write_byref(struct restorearg *ra, objset_t *os,
+restore_write_byref(struct receive_writer_arg *rwa,
     struct drr_write_byref *drrwbr)
 {
+	objset_t *os = rwa->rwa_os;
 	dmu_tx_t *tx;
 	int err;
 	guid_map_entry_t gmesrch;
@@ -1397,7 +1766,7 @@ restore_write_byref(struct restorearg *ra, objset_t *os,
 	 */
 	if (drrwbr->drr_toguid != drrwbr->drr_refguid) {
 		gmesrch.guid = drrwbr->drr_refguid;
-		if ((gmep = avl_find(ra->guid_to_ds_map, &gmesrch,
+		if ((gmep = avl_find(rwa->rwa_guid_to_ds_map, &gmesrch,
 		    &where)) == NULL) {
 			return (SET_ERROR(EINVAL));
 		}
@@ -1428,10 +1797,11 @@ restore_write_byref(struct restorearg *ra, objset_t *os,
 }
 
 static int
-restore_spill(struct restorearg *ra, objset_t *os, struct drr_spill *drrs)
+restore_spill(struct receive_writer_arg *rwa, struct drr_spill *drrs,
+    void *data)
 {
+	objset_t *os = rwa->rwa_os;
 	dmu_tx_t *tx;
-	void *data;
 	dmu_buf_t *db, *db_spill;
 	int err;
 
@@ -1439,10 +1809,6 @@ restore_spill(struct restorearg *ra, objset_t *os, struct drr_spill *drrs)
 	    drrs->drr_length > SPA_MAXBLOCKSIZE)
 		return (SET_ERROR(EINVAL));
 
-	data = restore_read(ra, drrs->drr_length);
-	if (data == NULL)
-		return (ra->err);
-
 	if (dmu_object_info(os, drrs->drr_object, NULL) != 0)
 		return (SET_ERROR(EINVAL));
 
@@ -1479,9 +1845,9 @@ restore_spill(struct restorearg *ra, objset_t *os, struct drr_spill *drrs)
 
 /* ARGSUSED */
 static int
-restore_free(struct restorearg *ra, objset_t *os,
-    struct drr_free *drrf)
+restore_free(struct receive_writer_arg *rwa, struct drr_free *drrf)
 {
+	objset_t *os = rwa->rwa_os;
 	int err;
 
 	if (drrf->drr_length != -1ULL &&
@@ -1496,6 +1862,147 @@ restore_free(struct restorearg *ra, objset_t *os,
 	return (err);
 }
 
+/*
+ * Apply one record; runs in the writer thread.
+ */
+static int
+receive_process_record(struct receive_writer_arg *rwa,
+    struct receive_record_arg *rrd)
+{
+	dmu_replay_record_t *drr = &rrd->header;
+
+	switch (drr->drr_type) {
+	case DRR_OBJECT:
+		return (restore_object(rwa, &drr->drr_u.drr_object,
+		    rrd->payload));
+	case DRR_FREEOBJECTS:
+		return (restore_freeobjects(rwa, &drr->drr_u.drr_freeobjects));
+	case DRR_WRITE:
+		return (restore_write(rwa, &drr->drr_u.drr_write,
+		    rrd->payload));
+	case DRR_WRITE_BYREF:
+		return (restore_write_byref(rwa, &drr->drr_u.drr_write_byref));
+	case DRR_FREE:
+		return (restore_free(rwa, &drr->drr_u.drr_free));
+	case DRR_SPILL:
+		return (restore_spill(rwa, &drr->drr_u.drr_spill,
+		    rrd->payload));
+	default:
+		return (SET_ERROR(EINVAL));
+	}
+}
+
+static void
+receive_record_free(struct receive_record_arg *rrd)
+{
+	if (rrd->payload != NULL)
+		kmem_free(rrd->payload, rrd->payload_size);
+	kmem_free(rrd, sizeof (*rrd));
+}
+
+/*
+ * Apply the queued records in order until the end-of-stream marker.  After
+ * a failure the remaining records are discarded, not applied.
+ */
+static void
+receive_writer_thread(void *arg)
+{
+	struct receive_writer_arg *rwa = arg;
+	struct receive_record_arg *rrd;
+
+	for (rrd = bqueue_dequeue(&rwa->rwa_q); !rrd->eos_marker;
+	    rrd = bqueue_dequeue(&rwa->rwa_q)) {
+		if (rwa->rwa_err == 0)
+			rwa->rwa_err = receive_process_record(rwa, rrd);
+		receive_record_free(rrd);
+	}
+	receive_record_free(rrd);
+
+	mutex_enter(&rwa->rwa_lock);
+	rwa->rwa_done = B_TRUE;
+	cv_signal(&rwa->rwa_cv);
+	mutex_exit(&rwa->rwa_lock);
+	thread_exit();
+}
+
+/*
+ * Work out how much data follows a record in the stream.  The lengths are
+ * checked here, before anything is allocated for them; the record's fields
+ * are otherwise validated when it is applied.
+ */
+static int
+receive_payload_size(dmu_replay_record_t *drr, int *sizep)
+{
+	uint64_t len = 0;
+
+	switch (drr->drr_type) {
+	case DRR_OBJECT:
+		if (drr->drr_u.drr_object.drr_bonuslen > DN_MAX_BONUSLEN)
+			return (SET_ERROR(EINVAL));
+		len = P2ROUNDUP(drr->drr_u.drr_object.drr_bonuslen, 8);
+		break;
+	case DRR_WRITE:
+		len = drr->drr_u.drr_write.drr_length;
+		if (len > SPA_MAXBLOCKSIZE || P2PHASE(len, 8) != 0)
+			return (SET_ERROR(EINVAL));
+		if (DRR_WRITE_COMPRESSED(&drr->drr_u.drr_write)) {
+			len = drr->drr_u.drr_write.drr_compressed_size;
+			if (len == 0 || len >= drr->drr_u.drr_write.drr_length)
+				return (SET_ERROR(EINVAL));
+		}
+		break;
+	case DRR_SPILL:
+		len = drr->drr_u.drr_spill.drr_length;
+		if (len < SPA_MINBLOCKSIZE || len > SPA_MAXBLOCKSIZE)
+			return (SET_ERROR(EINVAL));
+		break;
+	case DRR_FREEOBJECTS:
+	case DRR_WRITE_BYREF:
+	case DRR_FREE:
+	case DRR_END:
+		break;
+	default:
+		return (SET_ERROR(EINVAL));
+	}
+
+	*sizep = (int)len;
+	return (0);
+}
+
+/*
+ * Read the payload of a record, if it has one, and queue it for the writer.
+ */
+static int
+receive_read_record(struct restorearg *ra, struct receive_writer_arg *rwa,
+    struct receive_record_arg *rrd)
+{
+	int err;
+
+	err = receive_payload_size(&rrd->header, &rrd->payload_size);
+	if (err != 0)
+		return (err);
+
+	if (rrd->payload_size != 0) {
+		rrd->payload = kmem_alloc(rrd->payload_size, KM_SLEEP);
+		err = restore_read(ra, rrd->payload_size, rrd->payload);
+		if (err != 0)
+			return (err);
+	}
+
+	/*
+	 * Start reading the indirect blocks the write will need, so that the
+	 * writer finds them cached.
+	 */
+	if (ra->prefetch && rrd->header.drr_type == DRR_WRITE) {
+		struct drr_write *drrw = &rrd->header.drr_u.drr_write;
+		dmu_prefetch(ra->os, drrw->drr_object, drrw->drr_offset,
+		    drrw->drr_length);
+	}
+
+	bqueue_enqueue(&rwa->rwa_q, rrd, sizeof (*rrd) + rrd->payload_size);
+	return (0);
+}
+
 /* used to destroy the drc_ds on error */
 static void
 dmu_recv_cleanup_ds(dmu_recv_cookie_t *drc)
@@ -1514,7 +2021,8 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, vnode_t *vp, offset_t *voffp,
     int cleanup_fd, uint64_t *action_handlep)
 {
 	struct restorearg ra = { 0 };
-	dmu_replay_record_t *drr;
+	struct receive_writer_arg rwa = { 0 };
+	struct receive_record_arg *rrd;
 	objset_t *os;
 	zio_cksum_t pcksum;
 	int featureflags;
@@ -1523,8 +2031,6 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, vnode_t *vp, offset_t *voffp,
 	ra.cksum = drc->drc_cksum;
 	ra.vp = vp;
 	ra.voff = *voffp;
-	ra.bufsize = 1<<20;
-	ra.buf = kmem_alloc(ra.bufsize, KM_SLEEP);
 
 	/* these were verified in dmu_recv_begin */
 	ASSERT3U(DMU_GET_STREAM_HDRTYPE(drc->drc_drrb->drr_versioninfo), ==,
@@ -1555,103 +2061,105 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, vnode_t *vp, offset_t *voffp,
 		}
 
 		if (*action_handlep == 0) {
-			ra.guid_to_ds_map =
+			rwa.rwa_guid_to_ds_map =
 			    kmem_alloc(sizeof (avl_tree_t), KM_SLEEP);
-			avl_create(ra.guid_to_ds_map, guid_compare,
+			avl_create(rwa.rwa_guid_to_ds_map, guid_compare,
 			    sizeof (guid_map_entry_t),
 			    offsetof(guid_map_entry_t, avlnode));
 			ra.err = zfs_onexit_add_cb(minor,
-			    free_guid_map_onexit, ra.guid_to_ds_map,
+			    free_guid_map_onexit, rwa.rwa_guid_to_ds_map,
 			    action_handlep);
 			if (ra.err != 0)
 				goto out;
 		} else {
 			ra.err = zfs_onexit_cb_data(minor, *action_handlep,
-			    (void **)&ra.guid_to_ds_map);
+			    (void **)&rwa.rwa_guid_to_ds_map);
 			if (ra.err != 0)
 				goto out;
 		}
 
-		drc->drc_guid_to_ds_map = ra.guid_to_ds_map;
+		drc->drc_guid_to_ds_map = rwa.rwa_guid_to_ds_map;
 	}
 
 	/*
-	 * Read records and process them.
+	 * Only an incremental receive overwrites existing blocks, so only
+	 * then is there anything worth prefetching.
 	 */
-	pcksum = ra.cksum;
-	while (ra.err == 0 &&
-	    NULL != (drr = restore_read(&ra, sizeof (*drr)))) {
-		if (issig(JUSTLOOKING) && issig(FORREAL)) {
-			ra.err = SET_ERROR(EINTR);
-			goto out;
-		}
+	ra.os = os;
+	ra.prefetch = !drc->drc_newfs;
 
-		if (ra.byteswap)
-			backup_byteswap(drr);
+	rwa.rwa_os = os;
+	rwa.rwa_byteswap = drc->drc_byteswap;
+	bqueue_init(&rwa.rwa_q, zfs_recv_queue_length,
+	    offsetof(struct receive_record_arg, node));
+	mutex_init(&rwa.rwa_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&rwa.rwa_cv, NULL, CV_DEFAULT, NULL);
 
-		switch (drr->drr_type) {
-		case DRR_OBJECT:
-		{
-			/*
-			 * We need to make a copy of the record header,
-			 * because restore_{object,write} may need to
-			 * restore_read(), which will invalidate drr.
-			 */
-			struct drr_object drro = drr->drr_u.drr_object;
-			ra.err = restore_object(&ra, os, &drro);
-			break;
-		}
-		case DRR_FREEOBJECTS:
-		{
-			struct drr_freeobjects drrfo =
-			    drr->drr_u.drr_freeobjects;
-			ra.err = restore_freeobjects(&ra, os, &drrfo);
-			break;
-		}
-		case DRR_WRITE:
-		{
-			struct drr_write drrw = drr->drr_u.drr_write;
-			ra.err = restore_write(&ra, os, &drrw);
-			break;
-		}
-		case DRR_WRITE_BYREF:
-		{
-			struct drr_write_byref drrwbr =
-			    drr->drr_u.drr_write_byref;
-			ra.err = restore_write_byref(&ra, os, &drrwbr);
+	(void) thread_create(NULL, 0, receive_writer_thread, &rwa, 0, curproc,
+	    TS_RUN, minclsyspri);
+
+	/*
+	 * Read records and queue them for the writer thread, until the end
+	 * record, a read error, or a failure in the writer.
+	 */
+	for (;;) {
+		if (issig(JUSTLOOKING) && issig(FORREAL)) {
+			ra.err = SET_ERROR(EINTR);
 			break;
 		}
-		case DRR_FREE:
-		{
-			struct drr_free drrf = drr->drr_u.drr_free;
-			ra.err = restore_free(&ra, os, &drrf);
+
+		pcksum = ra.cksum;
+		rrd = kmem_zalloc(sizeof (*rrd), KM_SLEEP);
+		if (restore_read(&ra, sizeof (rrd->header),
+		    &rrd->header) != 0) {
+			kmem_free(rrd, sizeof (*rrd));
 			break;
 		}
-		case DRR_END:
-		{
-			struct drr_end drre = drr->drr_u.drr_end;
+		if (ra.byteswap)
+			backup_byteswap(&rrd->header);
+
+		if (rrd->header.drr_type == DRR_END) {
+			struct drr_end *drre = &rrd->header.drr_u.drr_end;
 			/*
 			 * We compare against the *previous* checksum
 			 * value, because the stored checksum is of
 			 * everything before the DRR_END record.
 			 */
-			if (!ZIO_CHECKSUM_EQUAL(drre.drr_checksum, pcksum))
+			if (!ZIO_CHECKSUM_EQUAL(drre->drr_checksum, pcksum))
 				ra.err = SET_ERROR(ECKSUM);
-			goto out;
-		}
-		case DRR_SPILL:
-		{
-			struct drr_spill drrs = drr->drr_u.drr_spill;
-			ra.err = restore_spill(&ra, os, &drrs);
+			kmem_free(rrd, sizeof (*rrd));
 			break;
 		}
-		default:
-			ra.err = SET_ERROR(EINVAL);
-			goto out;
+
+		ra.err = receive_read_record(&ra, &rwa, rrd);
+		if (ra.err != 0) {
+			receive_record_free(rrd);
+			break;
 		}
-		pcksum = ra.cksum;
+
+		/* rwa_err is only ever set once, so an unlocked read is ok */
+		if (rwa.rwa_err != 0)
+			break;
 	}
-	ASSERT(ra.err != 0);
+
+	/*
+	 * Let the writer drain the queue and wait for it to exit.
+	 */
+	rrd = kmem_zalloc(sizeof (*rrd), KM_SLEEP);
+	rrd->eos_marker = B_TRUE;
+	bqueue_enqueue(&rwa.rwa_q, rrd, 1);
+
+	mutex_enter(&rwa.rwa_lock);
+	while (!rwa.rwa_done)
+		cv_wait(&rwa.rwa_cv, &rwa.rwa_lock);
+	mutex_exit(&rwa.rwa_lock);
+
+	if (ra.err == 0)
+		ra.err = rwa.rwa_err;
+
+	cv_destroy(&rwa.rwa_cv);
+	mutex_destroy(&rwa.rwa_lock);
+	bqueue_destroy(&rwa.rwa_q);
 
 out:
 	if ((featureflags & DMU_BACKUP_FEATURE_DEDUP) && (cleanup_fd != -1))
@@ -1665,7 +2173,6 @@ out:
 		dmu_recv_cleanup_ds(drc);
 	}
 
-	kmem_free(ra.buf, ra.bufsize);
 	*voffp = ra.voff;
 	return (ra.err);
 }
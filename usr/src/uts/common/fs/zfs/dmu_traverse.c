@@ -321,13 +321,13 @@ traverse_visitbp(traverse_data_t *td, const dnode_phys_t *dnp,
 			return (err);
 		dnp = buf->b_data;
 
-		for (i = 0; i < epb; i++) {
+		for (i = 0; i < epb; i += dnp[i].dn_extra_slots + 1) {
 			prefetch_dnode_metadata(td, &dnp[i], zb->zb_objset,
 			    zb->zb_blkid * epb + i);
 		}
 
 		/* recursively visitbp() blocks below this */
-		for (i = 0; i < epb; i++) {
+		for (i = 0; i < epb; i += dnp[i].dn_extra_slots + 1) {
 			err = traverse_dnode(td, &dnp[i], zb->zb_objset,
 			    zb->zb_blkid * epb + i);
 			if (err != 0) {
@@ -412,7 +412,7 @@ prefetch_dnode_metadata(traverse_data_t *td, const dnode_phys_t *dnp,
 
 	if (dnp->dn_flags & DNODE_FLAG_SPILL_BLKPTR) {
 		SET_BOOKMARK(&czb, objset, object, 0, DMU_SPILL_BLKID);
-		traverse_prefetch_metadata(td, &dnp->dn_spill, &czb);
+		traverse_prefetch_metadata(td, DN_SPILL_BLKPTR(dnp), &czb);
 	}
 }
 
@@ -436,7 +436,7 @@ traverse_dnode(traverse_data_t *td, const dnode_phys_t *dnp,
 
 	if (dnp->dn_flags & DNODE_FLAG_SPILL_BLKPTR) {
 		SET_BOOKMARK(&czb, objset, object, 0, DMU_SPILL_BLKID);
-		err = traverse_visitbp(td, dnp, &dnp->dn_spill, &czb);
+		err = traverse_visitbp(td, dnp, DN_SPILL_BLKPTR(dnp), &czb);
 		if (err != 0) {
 			if (!hard)
 				return (err);
@@ -596,6 +596,35 @@ traverse_dataset_destroyed(spa_t *spa, blkptr_t *blkptr,
 	    blkptr, txg_start, resume, flags, func, arg));
 }
 
+/*
+ * Traverse the dataset whose dsl_dataset_phys_t is the bonus buffer of MOS
+ * object obj; any other kind of object is skipped.
+ */
+static int
+traverse_pool_obj(dsl_pool_t *dp, uint64_t obj, uint64_t txg_start,
+    int flags, blkptr_cb_t func, void *arg)
+{
+	dmu_object_info_t doi;
+	dsl_dataset_t *ds;
+	uint64_t txg = txg_start;
+	int err;
+
+	err = dmu_object_info(dp->dp_meta_objset, obj, &doi);
+	if (err != 0 || doi.doi_bonus_type != DMU_OT_DSL_DATASET)
+		return (err);
+
+	dsl_pool_config_enter(dp, FTAG);
+	err = dsl_dataset_hold_obj(dp, obj, FTAG, &ds);
+	dsl_pool_config_exit(dp, FTAG);
+	if (err != 0)
+		return (err);
+	if (ds->ds_phys->ds_prev_snap_txg > txg)
+		txg = ds->ds_phys->ds_prev_snap_txg;
+	err = traverse_dataset(ds, txg, flags, func, arg);
+	dsl_dataset_rele(ds, FTAG);
+	return (err);
+}
+
 /*
  * NB: pool must not be changing on-disk (eg, from zdb or sync context).
  */
@@ -618,41 +647,122 @@ traverse_pool(spa_t *spa, uint64_t txg_start, int flags,
 	/* visit each dataset */
 	for (obj = 1; err == 0 || (err != ESRCH && hard);
 	    err = dmu_object_next(mos, &obj, FALSE, txg_start)) {
-		dmu_object_info_t doi;
-
-		err = dmu_object_info(mos, obj, &doi);
+		err = traverse_pool_obj(dp, obj, txg_start, flags, func, arg);
 		if (err != 0) {
 			if (!hard)
 				return (err);
 			lasterr = err;
-			continue;
-		}
-
-		if (doi.doi_bonus_type == DMU_OT_DSL_DATASET) {
-			dsl_dataset_t *ds;
-			uint64_t txg = txg_start;
-
-			dsl_pool_config_enter(dp, FTAG);
-			err = dsl_dataset_hold_obj(dp, obj, FTAG, &ds);
-			dsl_pool_config_exit(dp, FTAG);
-			if (err != 0) {
-				if (!hard)
-					return (err);
-				lasterr = err;
-				continue;
-			}
-			if (ds->ds_phys->ds_prev_snap_txg > txg)
-				txg = ds->ds_phys->ds_prev_snap_txg;
-			err = traverse_dataset(ds, txg, flags, func, arg);
-			dsl_dataset_rele(ds, FTAG);
-			if (err != 0) {
-				if (!hard)
-					return (err);
-				lasterr = err;
-			}
 		}
 	}
 	if (err == ESRCH)
 		err = 0;
 	return (err != 0 ? err : lasterr);
 }
+
+typedef struct traverse_pool_walk {
+	dsl_pool_t	*tpw_dp;
+	uint64_t	tpw_txg_start;
+	int		tpw_flags;
+	blkptr_cb_t	*tpw_func;
+	kmutex_t	tpw_lock;
+	uint64_t	tpw_obj;	/* last MOS object handed out */
+	boolean_t	tpw_done;	/* no more objects to hand out */
+	int		tpw_err;	/* last error seen by any worker */
+} traverse_pool_walk_t;
+
+typedef struct traverse_pool_worker {
+	traverse_pool_walk_t	*tpk_walk;
+	void			*tpk_arg;
+} traverse_pool_worker_t;
+
+/*
+ * Take MOS objects from the shared cursor one at a time and traverse the
+ * ones that are datasets, until the objects run out (or, without
+ * TRAVERSE_HARD, until any worker hits an error).
+ */
+static void
+traverse_pool_worker(void *arg)
+{
+	traverse_pool_worker_t *tpk = arg;
+	traverse_pool_walk_t *tpw = tpk->tpk_walk;
+	objset_t *mos = tpw->tpw_dp->dp_meta_objset;
+	boolean_t hard = (tpw->tpw_flags & TRAVERSE_HARD);
+
+	for (;;) {
+		uint64_t obj;
+		int err;
+
+		mutex_enter(&tpw->tpw_lock);
+		if (tpw->tpw_done) {
+			mutex_exit(&tpw->tpw_lock);
+			break;
+		}
+		err = dmu_object_next(mos, &tpw->tpw_obj, FALSE,
+		    tpw->tpw_txg_start);
+		obj = tpw->tpw_obj;
+		if (err != 0) {
+			if (err != ESRCH)
+				tpw->tpw_err = err;
+			tpw->tpw_done = B_TRUE;
+			mutex_exit(&tpw->tpw_lock);
+			break;
+		}
+		mutex_exit(&tpw->tpw_lock);
+
+		err = traverse_pool_obj(tpw->tpw_dp, obj, tpw->tpw_txg_start,
+		    tpw->tpw_flags, tpw->tpw_func, tpk->tpk_arg);
+		if (err != 0) {
+			mutex_enter(&tpw->tpw_lock);
+			tpw->tpw_err = err;
+			if (!hard)
+				tpw->tpw_done = B_TRUE;
+			mutex_exit(&tpw->tpw_lock);
+		}
+	}
+}
+
+/*
+ * Like traverse_pool(), but with the datasets shared out among nthreads
+ * threads.  Each thread passes its own entry of args to func, so callers
+ * can keep per-thread state without locking; the MOS is visited first,
+ * with args[0].  Datasets are visited in no particular order.
+ *
+ * NB: pool must not be changing on-disk (eg, from zdb or sync context).
+ */
+int
+traverse_pool_mt(spa_t *spa, uint64_t txg_start, int flags,
+    blkptr_cb_t func, void **args, int nthreads)
+{
+	traverse_pool_walk_t tpw = { 0 };
+	traverse_pool_worker_t *tpk;
+	taskq_t *tq;
+	int err;
+
+	ASSERT3S(nthreads, >, 0);
+
+	err = traverse_impl(spa, NULL, 0, spa_get_rootblkptr(spa),
+	    txg_start, NULL, flags, func, args[0]);
+	if (err != 0)
+		return (err);
+
+	tpw.tpw_dp = spa_get_dsl(spa);
+	tpw.tpw_txg_start = txg_start;
+	tpw.tpw_flags = flags;
+	tpw.tpw_func = func;
+	mutex_init(&tpw.tpw_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	tpk = kmem_alloc(nthreads * sizeof (*tpk), KM_SLEEP);
+	tq = taskq_create("traverse_pool", nthreads, minclsyspri,
+	    nthreads, nthreads, TASKQ_PREPOPULATE);
+	for (int t = 0; t < nthreads; t++) {
+		tpk[t].tpk_walk = &tpw;
+		tpk[t].tpk_arg = args[t];
+		VERIFY(taskq_dispatch(tq, traverse_pool_worker,
+		    &tpk[t], TQ_SLEEP) != NULL);
+	}
+	taskq_destroy(tq);
+	kmem_free(tpk, nthreads * sizeof (*tpk));
+
+	mutex_destroy(&tpw.tpw_lock);
+	return (tpw.tpw_err);
+}
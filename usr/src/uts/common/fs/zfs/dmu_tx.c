@@ -96,6 +96,26 @@ dmu_tx_private_ok(dmu_tx_t *tx)
 	return (tx->tx_anyobj);
 }
 
+/*
+ * Return the dnode of an earlier hold on the given object in this tx,
+ * or NULL if there is none.
+ */
+static dnode_t *
+dmu_tx_find_dnode(dmu_tx_t *tx, objset_t *os, uint64_t object)
+{
+	dmu_tx_hold_t *txh;
+
+	for (txh = list_head(&tx->tx_holds); txh != NULL;
+	    txh = list_next(&tx->tx_holds, txh)) {
+		dnode_t *dn = txh->txh_dnode;
+
+		if (dn != NULL && dn->dn_objset == os &&
+		    dn->dn_object == object)
+			return (dn);
+	}
+	return (NULL);
+}
+
 static dmu_tx_hold_t *
 dmu_tx_hold_object_impl(dmu_tx_t *tx, objset_t *os, uint64_t object,
     enum dmu_tx_hold_type type, uint64_t arg1, uint64_t arg2)
@@ -105,7 +125,19 @@ dmu_tx_hold_object_impl(dmu_tx_t *tx, objset_t *os, uint64_t object,
 	int err;
 
 	if (object != DMU_NEW_OBJECT) {
-		err = dnode_hold(os, object, tx, &dn);
+		/*
+		 * Most transactions hold the same object more than once
+		 * (e.g. zfs_write() holds both the data and the SA bonus),
+		 * so take another reference on the dnode we already have
+		 * rather than looking it up in the meta-dnode again.
+		 */
+		if (tx->tx_txg == 0 &&
+		    (dn = dmu_tx_find_dnode(tx, os, object)) != NULL) {
+			VERIFY(dnode_add_ref(dn, tx));
+			err = 0;
+		} else {
+			err = dnode_hold(os, object, tx, &dn);
+		}
 		if (err) {
 			tx->tx_err = err;
 			return (NULL);
@@ -212,6 +244,49 @@ dmu_tx_count_twig(dmu_tx_hold_t *txh, dnode_t *dn, dmu_buf_impl_t *db,
 }
 
 /* ARGSUSED */
+/*
+ * Fast path for small writes.  If the write falls within a single
+ * level-0 block that is already cached and dirty, and was dirtied after
+ * the most recent snapshot, then the block and all of its indirects are
+ * dirty too and will simply be overwritten.  There is nothing to read
+ * for i/o error checking and no block pointers worth examining, so
+ * charge the overwrite of the whole chain without walking the tree.
+ * Returns B_FALSE if the caller must make the full estimate.
+ */
+static boolean_t
+dmu_tx_count_write_dirty(dmu_tx_hold_t *txh, uint64_t off, uint64_t len)
+{
+	dnode_t *dn = txh->txh_dnode;
+	dmu_buf_impl_t *db;
+	uint64_t blkid, lastblkid;
+	boolean_t dirty;
+
+	if (dn->dn_datablkshift != 0) {
+		blkid = off >> dn->dn_datablkshift;
+		lastblkid = (off + len - 1) >> dn->dn_datablkshift;
+	} else {
+		blkid = 0;
+		lastblkid = (off + len <= dn->dn_datablksz) ? 0 : 1;
+	}
+	if (blkid != lastblkid || blkid > dn->dn_maxblkid)
+		return (B_FALSE);
+
+	/* dbuf_find() returns with db_mtx held */
+	db = dbuf_find(dn, 0, blkid);
+	if (db == NULL)
+		return (B_FALSE);
+	dirty = (db->db_state == DB_CACHED && db->db_last_dirty != NULL &&
+	    db->db_last_dirty->dr_txg > txh->txh_tx->tx_lastsnap_txg);
+	mutex_exit(&db->db_mtx);
+
+	if (!dirty)
+		return (B_FALSE);
+
+	txh->txh_space_tooverwrite += dn->dn_datablksz +
+	    ((uint64_t)(dn->dn_nlevels - 1) << dn->dn_indblkshift);
+	return (B_TRUE);
+}
+
 static void
 dmu_tx_count_write(dmu_tx_hold_t *txh, uint64_t off, uint64_t len)
 {
@@ -223,6 +298,9 @@ dmu_tx_count_write(dmu_tx_hold_t *txh, uint64_t off, uint64_t len)
 	if (len == 0)
 		return;
 
+	if (dn != NULL && dmu_tx_count_write_dirty(txh, off, len))
+		return;
+
 	min_bs = SPA_MINBLOCKSHIFT;
 	max_bs = SPA_MAXBLOCKSHIFT;
 	min_ibs = DN_MIN_INDBLKSHIFT;
@@ -384,6 +462,20 @@ dmu_tx_count_dnode(dmu_tx_hold_t *txh)
 	dnode_t *mdn = DMU_META_DNODE(txh->txh_tx->tx_objset);
 	uint64_t space = mdn->dn_datablksz +
 	    ((mdn->dn_nlevels-1) << mdn->dn_indblkshift);
+	dmu_tx_hold_t *prev;
+
+	/*
+	 * The dnode's block is only dirtied once per tx, so if an earlier
+	 * hold in this tx already charged for it there is nothing to add.
+	 */
+	if (dn != NULL) {
+		for (prev = list_head(&txh->txh_tx->tx_holds); prev != txh;
+		    prev = list_next(&txh->txh_tx->tx_holds, prev)) {
+			if (prev->txh_dnode == dn && prev->txh_dnode_counted)
+				return;
+		}
+	}
+	txh->txh_dnode_counted = B_TRUE;
 
 	if (dn && dn->dn_dbuf->db_blkptr &&
 	    dsl_dataset_block_freeable(dn->dn_objset->os_dsl_dataset,
@@ -1015,6 +1107,12 @@ int zfs_delay_resolution_ns = 100 * 1000; /* 100 microseconds */
  * ensuring that the appropriate limits are set for the I/O scheduler to reach
  * optimal throughput on the backend storage, and then by changing the value
  * of zfs_delay_scale to increase the steepness of the curve.
+ *
+ * With zfs_zone_throttle set, the delay falls first on the zones that are
+ * producing the dirty data.  A transaction from a zone that has dirtied less
+ * than half of the open txg has its delay scaled down by its share, and it
+ * waits relative to its own start time rather than being queued behind the
+ * delayed transactions of the zones that are filling the txg.
  */
 static void
 dmu_tx_delay(dmu_tx_t *tx, uint64_t dirty)
@@ -1023,6 +1121,7 @@ dmu_tx_delay(dmu_tx_t *tx, uint64_t dirty)
 	uint64_t delay_min_bytes =
 	    zfs_dirty_data_max * zfs_delay_min_dirty_percent / 100;
 	hrtime_t wakeup, min_tx_time, now;
+	boolean_t queued = B_TRUE;
 
 	if (dirty <= delay_min_bytes)
 		return;
@@ -1043,14 +1142,37 @@ dmu_tx_delay(dmu_tx_t *tx, uint64_t dirty)
 
 	min_tx_time = MIN(min_tx_time, zfs_delay_max_ns);
 
+	if (zfs_zone_throttle) {
+		int slot = DP_ZONE_DIRTY_SLOT(getzoneid());
+		uint64_t txg, zdirty, tdirty;
+
+		mutex_enter(&dp->dp_lock);
+		txg = dp->dp_tx.tx_open_txg;
+		zdirty = dp->dp_zone_dirty[txg & TXG_MASK][slot];
+		tdirty = dp->dp_dirty_pertxg[txg & TXG_MASK];
+		mutex_exit(&dp->dp_lock);
+
+		if (zdirty * 2 < tdirty) {
+			min_tx_time = min_tx_time *
+			    (zdirty * 2 * 1024 / tdirty) / 1024;
+			if (now > tx->tx_start + min_tx_time)
+				return;
+			queued = B_FALSE;
+		}
+	}
+
 	DTRACE_PROBE3(delay__mintime, dmu_tx_t *, tx, uint64_t, dirty,
 	    uint64_t, min_tx_time);
 
-	mutex_enter(&dp->dp_lock);
-	wakeup = MAX(tx->tx_start + min_tx_time,
-	    dp->dp_last_wakeup + min_tx_time);
-	dp->dp_last_wakeup = wakeup;
-	mutex_exit(&dp->dp_lock);
+	if (queued) {
+		mutex_enter(&dp->dp_lock);
+		wakeup = MAX(tx->tx_start + min_tx_time,
+		    dp->dp_last_wakeup + min_tx_time);
+		dp->dp_last_wakeup = wakeup;
+		mutex_exit(&dp->dp_lock);
+	} else {
+		wakeup = tx->tx_start + min_tx_time;
+	}
 
 #ifdef _KERNEL
 	mutex_enter(&curthread->t_delay_lock);
@@ -1066,6 +1188,13 @@ dmu_tx_delay(dmu_tx_t *tx, uint64_t dirty)
 	ts.tv_nsec = delta % NANOSEC;
 	(void) nanosleep(&ts, NULL);
 #endif
+
+	/*
+	 * The tx is not assigned yet; charge the delay to the open txg,
+	 * which is where it will most likely land.
+	 */
+	spa_txg_stat_delay(dp->dp_spa, dp->dp_tx.tx_open_txg,
+	    gethrtime() - now);
 }
 
 static int
@@ -1521,7 +1650,7 @@ dmu_tx_hold_spill(dmu_tx_t *tx, uint64_t object)
 	} else {
 		blkptr_t *bp;
 
-		bp = &dn->dn_phys->dn_spill;
+		bp = DN_SPILL_BLKPTR(dn->dn_phys);
 		if (dsl_dataset_block_freeable(dn->dn_objset->os_dsl_dataset,
 		    bp, bp->blk_birth))
 			txh->txh_space_tooverwrite += SPA_MAXBLOCKSIZE;
@@ -1553,7 +1682,7 @@ dmu_tx_hold_sa_create(dmu_tx_t *tx, int attrsize)
 
 	dmu_tx_sa_registration_hold(sa, tx);
 
-	if (attrsize <= DN_MAX_BONUSLEN && !sa->sa_force_spill)
+	if (attrsize <= DN_OLD_MAX_BONUSLEN && !sa->sa_force_spill)
 		return;
 
 	(void) dmu_tx_hold_object_impl(tx, tx->tx_objset, DMU_NEW_OBJECT,
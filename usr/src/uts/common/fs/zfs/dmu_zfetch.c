@@ -50,12 +50,16 @@ uint32_t	zfetch_min_sec_reap = 2;
 uint32_t	zfetch_block_cap = 256;
 /* number of bytes in a array_read at which we stop prefetching (1Mb) */
 uint64_t	zfetch_array_rd_sz = 1024 * 1024;
+/* prefetch the indirect blocks ahead of sequential streams */
+int		zfetch_indirect_prefetch = 1;
 
 /* forward decls for static routines */
+static boolean_t	dmu_zfetch_adapt(zstream_t *, zstream_t *, int);
 static boolean_t	dmu_zfetch_colinear(zfetch_t *, zstream_t *);
 static void		dmu_zfetch_dofetch(zfetch_t *, zstream_t *);
 static uint64_t		dmu_zfetch_fetch(dnode_t *, uint64_t, uint64_t);
 static uint64_t		dmu_zfetch_fetchsz(dnode_t *, uint64_t, uint64_t);
+static void		dmu_zfetch_indirect(dnode_t *, zstream_t *, uint64_t);
 static boolean_t	dmu_zfetch_find(zfetch_t *, zstream_t *, int);
 static int		dmu_zfetch_stream_insert(zfetch_t *, zstream_t *);
 static zstream_t	*dmu_zfetch_stream_reclaim(zfetch_t *);
@@ -74,6 +78,10 @@ typedef struct zfetch_stats {
 	kstat_named_t zfetchstat_stream_resets;
 	kstat_named_t zfetchstat_stream_noresets;
 	kstat_named_t zfetchstat_bogus_streams;
+	kstat_named_t zfetchstat_stream_hits;
+	kstat_named_t zfetchstat_stream_misses;
+	kstat_named_t zfetchstat_distance_shrinks;
+	kstat_named_t zfetchstat_indirect_fetches;
 } zfetch_stats_t;
 
 static zfetch_stats_t zfetch_stats = {
@@ -88,6 +96,10 @@ static zfetch_stats_t zfetch_stats = {
 	{ "streams_resets",		KSTAT_DATA_UINT64 },
 	{ "streams_noresets",		KSTAT_DATA_UINT64 },
 	{ "bogus_streams",		KSTAT_DATA_UINT64 },
+	{ "stream_hits",		KSTAT_DATA_UINT64 },
+	{ "stream_misses",		KSTAT_DATA_UINT64 },
+	{ "distance_shrinks",		KSTAT_DATA_UINT64 },
+	{ "indirect_fetches",		KSTAT_DATA_UINT64 },
 };
 
 #define	ZFETCHSTAT_INCR(stat, val) \
@@ -97,6 +109,45 @@ static zfetch_stats_t zfetch_stats = {
 
 kstat_t		*zfetch_ksp;
 
+/*
+ * Adapt a sequential stream's prefetch distance (zst_cap) to how well it
+ * is doing.  A read that found its block already in the ARC, or on its
+ * way there, means the prefetch is keeping ahead, and the distance may
+ * grow towards zfetch_block_cap.  A read that missed means the blocks we
+ * fetched for it were evicted before anyone used them, so the distance
+ * is halved instead.  Only a stream that keeps missing at its smallest
+ * distance is reset.
+ *
+ * Returns whether the stream should be reset.
+ */
+static boolean_t
+dmu_zfetch_adapt(zstream_t *zs, zstream_t *zh, int prefetched)
+{
+	ASSERT(MUTEX_HELD(&zs->zst_lock));
+
+	if (prefetched) {
+		zs->zst_hits++;
+		ZFETCHSTAT_BUMP(zfetchstat_stream_hits);
+		zs->zst_cap = MIN(zfetch_block_cap, 2 * zs->zst_cap);
+		return (B_FALSE);
+	}
+
+	if (zs->zst_len <= 1)
+		return (B_FALSE);
+
+	zs->zst_misses++;
+	ZFETCHSTAT_BUMP(zfetchstat_stream_misses);
+	DTRACE_PROBE2(zfetch__stream__miss, zstream_t *, zs,
+	    uint64_t, zh->zst_offset);
+
+	if (zs->zst_cap > zh->zst_len) {
+		zs->zst_cap = MAX(zs->zst_cap / 2, zh->zst_len);
+		ZFETCHSTAT_BUMP(zfetchstat_distance_shrinks);
+		return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
 /*
  * Given a zfetch structure and a zstream structure, determine whether the
  * blocks to be read are part of a co-linear pair of existing prefetch
@@ -143,6 +194,8 @@ dmu_zfetch_colinear(zfetch_t *zf, zstream_t *zh)
 				    diff * z_walk->zst_direction;
 				z_walk->zst_ph_offset =
 				    zh->zst_offset + z_walk->zst_stride;
+				z_walk->zst_cap = MIN(zfetch_block_cap,
+				    2 * z_walk->zst_cap);
 				dmu_zfetch_stream_remove(zf, z_comp);
 				mutex_destroy(&z_comp->zst_lock);
 				kmem_free(z_comp, sizeof (zstream_t));
@@ -161,6 +214,8 @@ dmu_zfetch_colinear(zfetch_t *zf, zstream_t *zh)
 				    diff * z_walk->zst_direction;
 				z_walk->zst_ph_offset =
 				    zh->zst_offset + z_walk->zst_stride;
+				z_walk->zst_cap = MIN(zfetch_block_cap,
+				    2 * z_walk->zst_cap);
 				dmu_zfetch_stream_remove(zf, z_comp);
 				mutex_destroy(&z_comp->zst_lock);
 				kmem_free(z_comp, sizeof (zstream_t));
@@ -191,7 +246,6 @@ dmu_zfetch_dofetch(zfetch_t *zf, zstream_t *zs)
 	uint64_t	blocks_fetched;
 
 	zs->zst_stride = MAX((int64_t)zs->zst_stride, zs->zst_len);
-	zs->zst_cap = MIN(zfetch_block_cap, 2 * zs->zst_cap);
 
 	prefetch_tail = MAX((int64_t)zs->zst_ph_offset,
 	    (int64_t)(zs->zst_offset + zs->zst_stride));
@@ -231,6 +285,41 @@ dmu_zfetch_dofetch(zfetch_t *zf, zstream_t *zs)
 	}
 	zs->zst_ph_offset = prefetch_tail;
 	zs->zst_last = ddi_get_lbolt();
+
+	/*
+	 * Look as far again past the data we just prefetched and fetch the
+	 * indirect blocks found there, so that the next rounds of data
+	 * prefetch don't stall reading them synchronously.
+	 */
+	if (zfetch_indirect_prefetch && zs->zst_direction == ZFETCH_FORWARD &&
+	    zs->zst_stride == zs->zst_len) {
+		dmu_zfetch_indirect(zf->zf_dnode, zs,
+		    2 * prefetch_tail - zs->zst_offset);
+	}
+}
+
+/*
+ * Prefetch the level 1 indirect blocks covering the stream up to (and
+ * including) data block blkid, skipping those already issued for it.
+ */
+static void
+dmu_zfetch_indirect(dnode_t *dn, zstream_t *zs, uint64_t blkid)
+{
+	uint64_t	iblkid, last;
+	int		epbs;
+
+	if (dn->dn_nlevels < 2)
+		return;
+
+	epbs = dn->dn_indblkshift - SPA_BLKPTRSHIFT;
+	last = MIN(blkid, dn->dn_maxblkid) >> epbs;
+	iblkid = MAX(zs->zst_ind_blkid, zs->zst_offset >> epbs) + 1;
+
+	for (; iblkid <= last; iblkid++) {
+		dbuf_prefetch(dn, 1, iblkid, ZIO_PRIORITY_ASYNC_READ);
+		ZFETCHSTAT_BUMP(zfetchstat_indirect_fetches);
+		zs->zst_ind_blkid = iblkid;
+	}
 }
 
 void
@@ -291,7 +380,7 @@ dmu_zfetch_fetch(dnode_t *dn, uint64_t blkid, uint64_t nblks)
 	fetchsz = dmu_zfetch_fetchsz(dn, blkid, nblks);
 
 	for (i = 0; i < fetchsz; i++) {
-		dbuf_prefetch(dn, blkid + i, ZIO_PRIORITY_ASYNC_READ);
+		dbuf_prefetch(dn, 0, blkid + i, ZIO_PRIORITY_ASYNC_READ);
 	}
 
 	return (fetchsz);
@@ -385,14 +474,13 @@ top:
 		 */
 		if (zh->zst_offset == zs->zst_offset + zs->zst_len) {
 
-			reset = !prefetched && zs->zst_len > 1;
-
 			mutex_enter(&zs->zst_lock);
 
 			if (zh->zst_offset != zs->zst_offset + zs->zst_len) {
 				mutex_exit(&zs->zst_lock);
 				goto top;
 			}
+			reset = dmu_zfetch_adapt(zs, zh, prefetched);
 			zs->zst_len += zh->zst_len;
 			diff = zs->zst_len - zfetch_block_cap;
 			if (diff > 0) {
@@ -410,14 +498,13 @@ top:
 		} else if (zh->zst_offset == zs->zst_offset - zh->zst_len) {
 			/* backwards sequential access */
 
-			reset = !prefetched && zs->zst_len > 1;
-
 			mutex_enter(&zs->zst_lock);
 
 			if (zh->zst_offset != zs->zst_offset - zh->zst_len) {
 				mutex_exit(&zs->zst_lock);
 				goto top;
 			}
+			reset = dmu_zfetch_adapt(zs, zh, prefetched);
 
 			zs->zst_offset = zs->zst_offset > zh->zst_len ?
 			    zs->zst_offset - zh->zst_len : 0;
@@ -219,12 +219,16 @@ dnode_verify(dnode_t *dn)
 		ASSERT(DMU_OT_IS_VALID(dn->dn_type));
 		ASSERT3U(dn->dn_nblkptr, >=, 1);
 		ASSERT3U(dn->dn_nblkptr, <=, DN_MAX_NBLKPTR);
-		ASSERT3U(dn->dn_bonuslen, <=, DN_MAX_BONUSLEN);
+		ASSERT3U(dn->dn_num_slots, >=, DNODE_MIN_SLOTS);
+		ASSERT3U(dn->dn_num_slots, <=, DNODE_MAX_SLOTS);
+		ASSERT3U(dn->dn_bonuslen, <=,
+		    DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots));
 		ASSERT3U(dn->dn_datablksz, ==,
 		    dn->dn_datablkszsec << SPA_MINBLOCKSHIFT);
 		ASSERT3U(ISP2(dn->dn_datablksz), ==, dn->dn_datablkshift != 0);
 		ASSERT3U((dn->dn_nblkptr - 1) * sizeof (blkptr_t) +
-		    dn->dn_bonuslen, <=, DN_MAX_BONUSLEN);
+		    dn->dn_bonuslen, <=,
+		    DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots));
 		for (i = 0; i < TXG_SIZE; i++) {
 			ASSERT3U(dn->dn_next_nlevels[i], <=, dn->dn_nlevels);
 		}
@@ -281,7 +285,8 @@ dnode_byteswap(dnode_phys_t *dnp)
 		 * dnode buffer).
 		 */
 		int off = (dnp->dn_nblkptr-1) * sizeof (blkptr_t);
-		size_t len = DN_MAX_BONUSLEN - off;
+		size_t len =
+		    DN_SLOTS_TO_BONUSLEN(dnp->dn_extra_slots + 1) - off;
 		ASSERT(DMU_OT_IS_VALID(dnp->dn_bonustype));
 		dmu_object_byteswap_t byteswap =
 		    DMU_OT_BYTESWAP(dnp->dn_bonustype);
@@ -290,7 +295,7 @@ dnode_byteswap(dnode_phys_t *dnp)
 
 	/* Swap SPILL block if we have one */
 	if (dnp->dn_flags & DNODE_FLAG_SPILL_BLKPTR)
-		byteswap_uint64_array(&dnp->dn_spill, sizeof (blkptr_t));
+		byteswap_uint64_array(DN_SPILL_BLKPTR(dnp), sizeof (blkptr_t));
 
 }
 
@@ -303,11 +308,13 @@ dnode_buf_byteswap(void *vbuf, size_t size)
 	ASSERT3U(sizeof (dnode_phys_t), ==, (1<<DNODE_SHIFT));
 	ASSERT((size & (sizeof (dnode_phys_t)-1)) == 0);
 
+	/*
+	 * dn_extra_slots is a single byte, so it can be read after the
+	 * swap; the slots it covers belong to this dnode's bonus buffer.
+	 */
 	size >>= DNODE_SHIFT;
-	for (i = 0; i < size; i++) {
-		dnode_byteswap(buf);
-		buf++;
-	}
+	for (i = 0; i < size; i += buf[i].dn_extra_slots + 1)
+		dnode_byteswap(&buf[i]);
 }
 
 void
@@ -317,7 +324,7 @@ dnode_setbonuslen(dnode_t *dn, int newsize, dmu_tx_t *tx)
 
 	dnode_setdirty(dn, tx);
 	rw_enter(&dn->dn_struct_rwlock, RW_WRITER);
-	ASSERT3U(newsize, <=, DN_MAX_BONUSLEN -
+	ASSERT3U(newsize, <=, DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots) -
 	    (dn->dn_nblkptr-1) * sizeof (blkptr_t));
 	dn->dn_bonuslen = newsize;
 	if (newsize == 0)
@@ -390,6 +397,8 @@ dnode_create(objset_t *os, dnode_phys_t *dnp, dmu_buf_impl_t *db,
 	dn->dn_nlevels = dnp->dn_nlevels;
 	dn->dn_type = dnp->dn_type;
 	dn->dn_nblkptr = dnp->dn_nblkptr;
+	dn->dn_num_slots = (dnp->dn_type == DMU_OT_NONE) ?
+	    DNODE_MIN_SLOTS : dnp->dn_extra_slots + 1;
 	dn->dn_checksum = dnp->dn_checksum;
 	dn->dn_compress = dnp->dn_compress;
 	dn->dn_bonustype = dnp->dn_bonustype;
@@ -467,10 +476,15 @@ dnode_destroy(dnode_t *dn)
 
 void
 dnode_allocate(dnode_t *dn, dmu_object_type_t ot, int blocksize, int ibs,
-    dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx)
+    dmu_object_type_t bonustype, int bonuslen, int dn_slots, dmu_tx_t *tx)
 {
 	int i;
 
+	if (dn_slots == 0)
+		dn_slots = DNODE_MIN_SLOTS;
+	ASSERT3S(dn_slots, >=, DNODE_MIN_SLOTS);
+	ASSERT3S(dn_slots, <=, DNODE_MAX_SLOTS);
+
 	if (blocksize == 0)
 		blocksize = 1 << zfs_default_bs;
 	else if (blocksize > SPA_MAXBLOCKSIZE)
@@ -495,7 +509,7 @@ dnode_allocate(dnode_t *dn, dmu_object_type_t ot, int blocksize, int ibs,
 	    (bonustype == DMU_OT_SA && bonuslen == 0) ||
 	    (bonustype != DMU_OT_NONE && bonuslen != 0));
 	ASSERT(DMU_OT_IS_VALID(bonustype));
-	ASSERT3U(bonuslen, <=, DN_MAX_BONUSLEN);
+	ASSERT3U(bonuslen, <=, DN_SLOTS_TO_BONUSLEN(dn_slots));
 	ASSERT(dn->dn_type == DMU_OT_NONE);
 	ASSERT0(dn->dn_maxblkid);
 	ASSERT0(dn->dn_allocated_txg);
@@ -521,11 +535,13 @@ dnode_allocate(dnode_t *dn, dmu_object_type_t ot, int blocksize, int ibs,
 	dnode_setdblksz(dn, blocksize);
 	dn->dn_indblkshift = ibs;
 	dn->dn_nlevels = 1;
+	dn->dn_num_slots = dn_slots;
 	if (bonustype == DMU_OT_SA) /* Maximize bonus space for SA */
 		dn->dn_nblkptr = 1;
 	else
-		dn->dn_nblkptr = 1 +
-		    ((DN_MAX_BONUSLEN - bonuslen) >> SPA_BLKPTRSHIFT);
+		dn->dn_nblkptr = MIN(DN_MAX_NBLKPTR, 1 +
+		    ((DN_SLOTS_TO_BONUSLEN(dn_slots) - bonuslen) >>
+		    SPA_BLKPTRSHIFT));
 	dn->dn_bonustype = bonustype;
 	dn->dn_bonuslen = bonuslen;
 	dn->dn_checksum = ZIO_CHECKSUM_INHERIT;
@@ -563,7 +579,7 @@ dnode_reallocate(dnode_t *dn, dmu_object_type_t ot, int blocksize,
 	    (bonustype != DMU_OT_NONE && bonuslen != 0) ||
 	    (bonustype == DMU_OT_SA && bonuslen == 0));
 	ASSERT(DMU_OT_IS_VALID(bonustype));
-	ASSERT3U(bonuslen, <=, DN_MAX_BONUSLEN);
+	ASSERT3U(bonuslen, <=, DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots));
 
 	/* clean up any unreferenced dbufs */
 	dnode_evict_dbufs(dn);
@@ -586,7 +602,9 @@ dnode_reallocate(dnode_t *dn, dmu_object_type_t ot, int blocksize,
 	if (bonustype == DMU_OT_SA) /* Maximize bonus space for SA */
 		nblkptr = 1;
 	else
-		nblkptr = 1 + ((DN_MAX_BONUSLEN - bonuslen) >> SPA_BLKPTRSHIFT);
+		nblkptr = MIN(DN_MAX_NBLKPTR, 1 +
+		    ((DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots) - bonuslen) >>
+		    SPA_BLKPTRSHIFT));
 	if (dn->dn_bonustype != bonustype)
 		dn->dn_next_bonustype[tx->tx_txg&TXG_MASK] = bonustype;
 	if (dn->dn_nblkptr != nblkptr)
@@ -612,7 +630,8 @@ dnode_reallocate(dnode_t *dn, dmu_object_type_t ot, int blocksize,
 	/* fix up the bonus db_size */
 	if (dn->dn_bonus) {
 		dn->dn_bonus->db.db_size =
-		    DN_MAX_BONUSLEN - (dn->dn_nblkptr-1) * sizeof (blkptr_t);
+		    DN_SLOTS_TO_BONUSLEN(dn->dn_num_slots) -
+		    (dn->dn_nblkptr-1) * sizeof (blkptr_t);
 		ASSERT(dn->dn_bonuslen <= dn->dn_bonus->db.db_size);
 	}
 
@@ -652,6 +671,7 @@ dnode_move_impl(dnode_t *odn, dnode_t *ndn)
 	ndn->dn_bonuslen = odn->dn_bonuslen;
 	ndn->dn_bonustype = odn->dn_bonustype;
 	ndn->dn_nblkptr = odn->dn_nblkptr;
+	ndn->dn_num_slots = odn->dn_num_slots;
 	ndn->dn_checksum = odn->dn_checksum;
 	ndn->dn_compress = odn->dn_compress;
 	ndn->dn_nlevels = odn->dn_nlevels;
@@ -987,14 +1007,93 @@ dnode_buf_pageout(dmu_buf_t *db, void *arg)
 	    (epb - 1) * sizeof (dnode_handle_t));
 }
 
+/*
+ * Return the number of slots used by the dnode starting in slot idx of a
+ * dnode block, or 1 if that slot is free.  An in-core dnode is used in
+ * preference to the dnode_phys_t, which does not reflect a dnode
+ * allocated in open context until it is synced.
+ */
+static int
+dnode_slot_span(dnode_children_t *children, dnode_phys_t *dnp, int idx)
+{
+	dnode_handle_t *dnh = &children->dnc_children[idx];
+	dnode_t *dn;
+	int slots;
+
+	zrl_add(&dnh->dnh_zrlock);
+	dn = dnh->dnh_dnode;
+	if (dn != NULL) {
+		slots = (dn->dn_type == DMU_OT_NONE) ?
+		    DNODE_MIN_SLOTS : dn->dn_num_slots;
+	} else {
+		slots = (dnp[idx].dn_type == DMU_OT_NONE) ?
+		    DNODE_MIN_SLOTS : dnp[idx].dn_extra_slots + 1;
+	}
+	zrl_remove(&dnh->dnh_zrlock);
+	return (slots);
+}
+
+/*
+ * Is slot idx part of a multi-slot dnode that starts in an earlier slot?
+ * Such a slot holds bonus data, so it must never be mistaken for a
+ * dnode.  Dnodes never span dnode blocks, so walk from the first slot.
+ */
+static boolean_t
+dnode_slot_is_interior(dnode_children_t *children, dnode_phys_t *dnp, int idx)
+{
+	int i = 0;
+
+	while (i < idx)
+		i += dnode_slot_span(children, dnp, i);
+	return (i > idx);
+}
+
+/*
+ * Are the slots after idx that a slots-slot dnode there would cover all
+ * free?  Allocators within a dnode block are serialized (the per-CPU
+ * ooc_lock of the chunk that contains it, or the single receive or
+ * replay thread), so the answer stays valid until dnode_allocate().
+ */
+static boolean_t
+dnode_slots_free(dnode_children_t *children, dnode_phys_t *dnp, int idx,
+    int slots)
+{
+	if (idx + slots > children->dnc_count)
+		return (B_FALSE);
+
+	for (int i = idx + 1; i < idx + slots; i++) {
+		dnode_handle_t *dnh = &children->dnc_children[i];
+		dnode_t *dn;
+		boolean_t free;
+
+		zrl_add(&dnh->dnh_zrlock);
+		dn = dnh->dnh_dnode;
+		if (dn != NULL) {
+			mutex_enter(&dn->dn_mtx);
+			free = (dn->dn_type == DMU_OT_NONE &&
+			    refcount_is_zero(&dn->dn_holds));
+			mutex_exit(&dn->dn_mtx);
+		} else {
+			free = (dnp[i].dn_type == DMU_OT_NONE);
+		}
+		zrl_remove(&dnh->dnh_zrlock);
+		if (!free)
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
 /*
  * errors:
  * EINVAL - invalid object number.
  * EIO - i/o error.
  * succeeds even for free dnodes.
+ *
+ * With DNODE_MUST_BE_FREE, slots is the number of slots the caller means
+ * to allocate, all of which must be free.  It is ignored otherwise.
  */
 int
-dnode_hold_impl(objset_t *os, uint64_t object, int flag,
+dnode_hold_impl(objset_t *os, uint64_t object, int flag, int slots,
     void *tag, dnode_t **dnp)
 {
 	int epb, idx, err;
@@ -1087,7 +1186,15 @@ dnode_hold_impl(objset_t *os, uint64_t object, int flag,
 
 	dnh = &children_dnodes->dnc_children[idx];
 	zrl_add(&dnh->dnh_zrlock);
-	if ((dn = dnh->dnh_dnode) == NULL) {
+	dn = dnh->dnh_dnode;
+	if ((dn == NULL || dn->dn_type == DMU_OT_NONE) &&
+	    dnode_slot_is_interior(children_dnodes, db->db.db_data, idx)) {
+		zrl_remove(&dnh->dnh_zrlock);
+		dbuf_rele(db, FTAG);
+		return ((flag & DNODE_MUST_BE_FREE) ?
+		    SET_ERROR(EEXIST) : SET_ERROR(ENOENT));
+	}
+	if (dn == NULL) {
 		dnode_phys_t *phys = (dnode_phys_t *)db->db.db_data+idx;
 		dnode_t *winner;
 
@@ -1113,6 +1220,13 @@ dnode_hold_impl(objset_t *os, uint64_t object, int flag,
 	}
 	mutex_exit(&dn->dn_mtx);
 
+	if ((flag & DNODE_MUST_BE_FREE) && slots > DNODE_MIN_SLOTS &&
+	    !dnode_slots_free(children_dnodes, db->db.db_data, idx, slots)) {
+		zrl_remove(&dnh->dnh_zrlock);
+		dbuf_rele(db, FTAG);
+		return (SET_ERROR(EEXIST));
+	}
+
 	if (refcount_add(&dn->dn_holds, tag) == 1)
 		dbuf_add_ref(db, dnh);
 	/* Now we can rely on the hold to prevent the dnode from moving. */
@@ -1133,7 +1247,8 @@ dnode_hold_impl(objset_t *os, uint64_t object, int flag,
 int
 dnode_hold(objset_t *os, uint64_t object, void *tag, dnode_t **dnp)
 {
-	return (dnode_hold_impl(os, object, DNODE_MUST_BE_ALLOCATED, tag, dnp));
+	return (dnode_hold_impl(os, object, DNODE_MUST_BE_ALLOCATED, 0,
+	    tag, dnp));
 }
 
 /*
@@ -1785,17 +1900,27 @@ dnode_next_offset_level(dnode_t *dn, int flags, uint64_t *offset,
 		error = SET_ERROR(ESRCH);
 	} else if (lvl == 0) {
 		dnode_phys_t *dnp = data;
+		int start;
 		span = DNODE_SHIFT;
 		ASSERT(dn->dn_type == DMU_OT_DNODE);
+		ASSERT(!(flags & DNODE_FIND_BACKWARDS));
 
-		for (i = (*offset >> span) & (blkfill - 1);
-		    i >= 0 && i < blkfill; i += inc) {
-			if ((dnp[i].dn_type == DMU_OT_NONE) == hole)
+		/*
+		 * The slots after a multi-slot dnode hold its bonus data,
+		 * not dnodes, so walk the block from its first slot and
+		 * step over them rather than testing each slot's dn_type.
+		 */
+		start = (*offset >> span) & (blkfill - 1);
+		for (i = 0; i < blkfill; i += dnp[i].dn_extra_slots + 1) {
+			if (i >= start &&
+			    (dnp[i].dn_type == DMU_OT_NONE) == hole)
 				break;
-			*offset += (1ULL << span) * inc;
 		}
-		if (i < 0 || i == blkfill)
+		if (i >= blkfill) {
 			error = SET_ERROR(ESRCH);
+			i = blkfill;
+		}
+		*offset += (uint64_t)(i - start) << span;
 	} else {
 		blkptr_t *bp = data;
 		uint64_t start = *offset;
@@ -1811,8 +1936,8 @@ dnode_next_offset_level(dnode_t *dn, int flags, uint64_t *offset,
 		*offset = *offset >> span;
 		for (i = BF64_GET(*offset, 0, epbs);
 		    i >= 0 && i < epb; i += inc) {
-			if (bp[i].blk_fill >= minfill &&
-			    bp[i].blk_fill <= maxfill &&
+			if (BP_GET_FILL(&bp[i]) >= minfill &&
+			    BP_GET_FILL(&bp[i]) <= maxfill &&
 			    (hole || bp[i].blk_birth > txg))
 				break;
 			if (inc > 0 || *offset > 0)
@@ -87,6 +87,10 @@
  *
  * The delay is also calculated based on the amount of dirty data.  See the
  * comment above dmu_tx_delay() for details.
+ *
+ * Dirty space is also counted per zone for each txg (dp_zone_dirty[]), so
+ * that dmu_tx_delay() can tell the zones that are filling the open txg from
+ * those that are not.
  */
 
 /*
@@ -124,6 +128,13 @@ int zfs_delay_min_dirty_percent = 60;
  */
 uint64_t zfs_delay_scale = 1000 * 1000 * 1000 / 2000;
 
+/*
+ * If set, a transaction from a zone that has dirtied less than half of the
+ * open txg is delayed in proportion to its share, and is not queued behind
+ * the delayed transactions of the zones that are filling the txg.
+ */
+int zfs_zone_throttle = 1;
+
 
 /*
  * XXX someday maybe turn these into #defines, and you have to tune it on a
@@ -420,10 +431,14 @@ static void
 dsl_pool_sync_mos(dsl_pool_t *dp, dmu_tx_t *tx)
 {
 	zio_t *zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
+	hrtime_t start = gethrtime();
+
 	dmu_objset_sync(dp->dp_meta_objset, zio, tx);
 	VERIFY0(zio_wait(zio));
 	dprintf_bp(&dp->dp_meta_rootbp, "meta objset rootbp is %s", "");
 	spa_set_rootblkptr(dp->dp_spa, &dp->dp_meta_rootbp);
+
+	dp->dp_spa->spa_txg_syncing.sts_mos_time += gethrtime() - start;
 }
 
 static void
@@ -484,6 +499,11 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	 */
 	dsl_pool_undirty_space(dp, dp->dp_dirty_pertxg[txg & TXG_MASK], txg);
 
+	mutex_enter(&dp->dp_lock);
+	bzero(dp->dp_zone_dirty[txg & TXG_MASK],
+	    sizeof (dp->dp_zone_dirty[txg & TXG_MASK]));
+	mutex_exit(&dp->dp_lock);
+
 	/*
 	 * After the data blocks have been written (ensured by the zio_wait()
 	 * above), update the user/group space accounting.
@@ -584,6 +604,10 @@ dsl_pool_sync_done(dsl_pool_t *dp, uint64_t txg)
 		dmu_buf_rele(ds->ds_dbuf, zilog);
 	}
 	ASSERT(!dmu_objset_is_dirty(dp->dp_meta_objset, txg));
+
+	mutex_enter(&dp->dp_lock);
+	dp->dp_long_free_dirty_pertxg[txg & TXG_MASK] = 0;
+	mutex_exit(&dp->dp_lock);
 }
 
 /*
@@ -639,8 +663,11 @@ void
 dsl_pool_dirty_space(dsl_pool_t *dp, int64_t space, dmu_tx_t *tx)
 {
 	if (space > 0) {
+		int slot = DP_ZONE_DIRTY_SLOT(getzoneid());
+
 		mutex_enter(&dp->dp_lock);
 		dp->dp_dirty_pertxg[tx->tx_txg & TXG_MASK] += space;
+		dp->dp_zone_dirty[tx->tx_txg & TXG_MASK][slot] += space;
 		dsl_pool_dirty_delta(dp, space);
 		mutex_exit(&dp->dp_lock);
 	}
@@ -46,6 +46,7 @@
 #include <sys/sa.h>
 #include <sys/sa_impl.h>
 #include <sys/zfeature.h>
+#include <sys/range_tree.h>
 #ifdef _KERNEL
 #include <sys/zfs_vfsops.h>
 #endif
@@ -57,6 +58,9 @@ static scan_cb_t dsl_scan_scrub_cb;
 static scan_cb_t dsl_scan_remove_cb;
 static void dsl_scan_cancel_sync(void *, dmu_tx_t *);
 static void dsl_scan_sync_state(dsl_scan_t *, dmu_tx_t *tx);
+static void dsl_scan_queues_create(dsl_scan_t *);
+static void dsl_scan_queues_issue(dsl_scan_t *);
+static void dsl_scan_queues_destroy(dsl_scan_t *);
 
 int zfs_top_maxinflight = 32;		/* maximum I/Os per top-level */
 int zfs_resilver_delay = 2;		/* number of ticks to delay resilver */
@@ -71,6 +75,46 @@ boolean_t zfs_no_scrub_prefetch = B_FALSE; /* set to disable srub prefetching */
 enum ddt_class zfs_scrub_ddt_class_max = DDT_CLASS_DUPLICATE;
 int dsl_scan_delay_completion = B_FALSE; /* set to delay scan completion */
 
+/*
+ * Sorted scrub and resilver.  The traversal visits block pointers in
+ * logical order, which on a fragmented pool means random reads.  So rather
+ * than issuing each scrub read from dsl_scan_scrub_cb(), we queue it on the
+ * top-level vdev holding its first DVA, in an AVL tree sorted by offset,
+ * and add the space it covers to that vdev's range tree of extents.  Gaps
+ * of up to zfs_scan_max_ext_gap between queued blocks are folded into the
+ * extents, so an extent is a run that the disk can read without seeking.
+ * When the traversal stops for this txg -- its time is up, or the queues
+ * have reached 1/zfs_scan_mem_lim_fact of physical memory -- the extents
+ * are issued in ascending offset order, one extent from each vdev in turn
+ * so that all of them stay busy.
+ *
+ * All I/O queued in a txg is issued before that txg's dsl_scan_sync()
+ * returns.  The bookmark we write out therefore never gets ahead of the
+ * I/O, and a queued block cannot have been freed and its space reused
+ * before we read it.
+ */
+boolean_t zfs_scan_sorted = B_TRUE;	/* set to B_FALSE for logical order */
+uint64_t zfs_scan_max_ext_gap = 2 << 20; /* largest gap inside an extent */
+int zfs_scan_mem_lim_fact = 20;		/* physmem fraction for queued I/O */
+
+#define	DSL_SCAN_MEM_LIM	\
+	((uint64_t)physmem * PAGESIZE / zfs_scan_mem_lim_fact)
+
+typedef struct scan_io {
+	avl_node_t	sio_node;
+	uint64_t	sio_offset;	/* offset of the first DVA */
+	uint64_t	sio_asize;	/* asize of the first DVA */
+	int		sio_flags;	/* zio flags for the read */
+	blkptr_t	sio_bp;
+	zbookmark_t	sio_zb;
+} scan_io_t;
+
+typedef struct dsl_scan_io_queue {
+	kmutex_t	q_lock;
+	avl_tree_t	q_sios;		/* queued scan_io_t by offset */
+	range_tree_t	*q_exts;	/* extents covering q_sios */
+} dsl_scan_io_queue_t;
+
 #define	DSL_SCAN_IS_SCRUB_RESILVER(scn) \
 	((scn)->scn_phys.scn_func == POOL_SCAN_SCRUB || \
 	(scn)->scn_phys.scn_func == POOL_SCAN_RESILVER)
@@ -415,6 +459,7 @@ dsl_scan_check_pause(dsl_scan_t *scn, const zbookmark_t *zb)
 	if (elapsed_nanosecs / NANOSEC > zfs_txg_timeout ||
 	    (NSEC2MSEC(elapsed_nanosecs) > mintime &&
 	    txg_sync_waiting(scn->scn_dp)) ||
+	    scn->scn_bytes_pending > DSL_SCAN_MEM_LIM ||
 	    spa_shutting_down(scn->scn_dp->dp_spa)) {
 		if (zb) {
 			dprintf("pausing at bookmark %llx/%llx/%llx/%llx\n",
@@ -641,14 +686,18 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 			scn->scn_phys.scn_errors++;
 			return (err);
 		}
-		for (i = 0, cdnp = (*bufp)->b_data; i < epb; i++, cdnp++) {
+		for (i = 0, cdnp = (*bufp)->b_data; i < epb;
+		    i += cdnp->dn_extra_slots + 1,
+		    cdnp += cdnp->dn_extra_slots + 1) {
 			for (j = 0; j < cdnp->dn_nblkptr; j++) {
 				blkptr_t *cbp = &cdnp->dn_blkptr[j];
 				dsl_scan_prefetch(scn, *bufp, cbp,
 				    zb->zb_objset, zb->zb_blkid * epb + i, j);
 			}
 		}
-		for (i = 0, cdnp = (*bufp)->b_data; i < epb; i++, cdnp++) {
+		for (i = 0, cdnp = (*bufp)->b_data; i < epb;
+		    i += cdnp->dn_extra_slots + 1,
+		    cdnp += cdnp->dn_extra_slots + 1) {
 			dsl_scan_visitdnode(scn, ds, ostype,
 			    cdnp, *bufp, zb->zb_blkid * epb + i, tx);
 		}
@@ -708,7 +757,7 @@ dsl_scan_visitdnode(dsl_scan_t *scn, dsl_dataset_t *ds,
 		zbookmark_t czb;
 		SET_BOOKMARK(&czb, ds ? ds->ds_object : 0, object,
 		    0, DMU_SPILL_BLKID);
-		dsl_scan_visitbp(&dnp->dn_spill,
+		dsl_scan_visitbp(DN_SPILL_BLKPTR(dnp),
 		    &czb, dnp, buf, ds, scn, ostype, tx);
 	}
 }
@@ -1493,6 +1542,10 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		    (longlong_t)scn->scn_phys.scn_bookmark.zb_blkid);
 	}
 
+	if (DSL_SCAN_IS_SCRUB_RESILVER(scn) && zfs_scan_sorted &&
+	    !zfs_no_scrub_io)
+		dsl_scan_queues_create(scn);
+
 	scn->scn_zio_root = zio_root(dp->dp_spa, NULL,
 	    NULL, ZIO_FLAG_CANFAIL);
 	dsl_pool_config_enter(dp, FTAG);
@@ -1501,6 +1554,11 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	(void) zio_wait(scn->scn_zio_root);
 	scn->scn_zio_root = NULL;
 
+	if (scn->scn_queues != NULL) {
+		dsl_scan_queues_issue(scn);
+		dsl_scan_queues_destroy(scn);
+	}
+
 	zfs_dbgmsg("visited %llu blocks in %llums",
 	    (longlong_t)scn->scn_visited_this_txg,
 	    (longlong_t)NSEC2MSEC(gethrtime() - scn->scn_sync_start_time));
@@ -1620,17 +1678,230 @@ dsl_scan_scrub_done(zio_t *zio)
 	mutex_exit(&spa->spa_scrub_lock);
 }
 
+static void
+dsl_scan_issue_io(dsl_scan_t *scn, const blkptr_t *bp, const zbookmark_t *zb,
+    int zio_flags)
+{
+	spa_t *spa = scn->scn_dp->dp_spa;
+	size_t size = BP_GET_PSIZE(bp);
+	vdev_t *rvd = spa->spa_root_vdev;
+	uint64_t maxinflight = rvd->vdev_children * zfs_top_maxinflight;
+	int scan_delay = (zio_flags & ZIO_FLAG_SCRUB) ?
+	    zfs_scrub_delay : zfs_resilver_delay;
+	void *data = zio_data_buf_alloc(size);
+
+	mutex_enter(&spa->spa_scrub_lock);
+	while (spa->spa_scrub_inflight >= maxinflight)
+		cv_wait(&spa->spa_scrub_io_cv, &spa->spa_scrub_lock);
+	spa->spa_scrub_inflight++;
+	mutex_exit(&spa->spa_scrub_lock);
+
+	/*
+	 * If we're seeing recent (zfs_scan_idle) "important" I/Os
+	 * then throttle our workload to limit the impact of a scan.
+	 */
+	if (ddi_get_lbolt64() - spa->spa_last_io <= zfs_scan_idle)
+		delay(scan_delay);
+
+	zio_nowait(zio_read(NULL, spa, bp, data, size,
+	    dsl_scan_scrub_done, NULL, ZIO_PRIORITY_SCRUB,
+	    zio_flags, zb));
+}
+
+static int
+scan_io_compare(const void *x1, const void *x2)
+{
+	const scan_io_t *s1 = x1;
+	const scan_io_t *s2 = x2;
+
+	if (s1->sio_offset < s2->sio_offset)
+		return (-1);
+	if (s1->sio_offset > s2->sio_offset)
+		return (1);
+	return (0);
+}
+
+static void
+dsl_scan_queues_create(dsl_scan_t *scn)
+{
+	vdev_t *rvd = scn->scn_dp->dp_spa->spa_root_vdev;
+
+	ASSERT3P(scn->scn_queues, ==, NULL);
+	scn->scn_nqueues = rvd->vdev_children;
+	scn->scn_queues = kmem_zalloc(scn->scn_nqueues *
+	    sizeof (dsl_scan_io_queue_t), KM_SLEEP);
+	for (uint64_t i = 0; i < scn->scn_nqueues; i++) {
+		dsl_scan_io_queue_t *q = &scn->scn_queues[i];
+
+		mutex_init(&q->q_lock, NULL, MUTEX_DEFAULT, NULL);
+		avl_create(&q->q_sios, scan_io_compare, sizeof (scan_io_t),
+		    offsetof(scan_io_t, sio_node));
+		q->q_exts = range_tree_create(NULL, NULL, &q->q_lock);
+	}
+	scn->scn_bytes_pending = 0;
+}
+
+static void
+dsl_scan_queues_destroy(dsl_scan_t *scn)
+{
+	for (uint64_t i = 0; i < scn->scn_nqueues; i++) {
+		dsl_scan_io_queue_t *q = &scn->scn_queues[i];
+
+		ASSERT0(avl_numnodes(&q->q_sios));
+		mutex_enter(&q->q_lock);
+		range_tree_vacate(q->q_exts, NULL, NULL);
+		mutex_exit(&q->q_lock);
+		range_tree_destroy(q->q_exts);
+		avl_destroy(&q->q_sios);
+		mutex_destroy(&q->q_lock);
+	}
+	kmem_free(scn->scn_queues,
+	    scn->scn_nqueues * sizeof (dsl_scan_io_queue_t));
+	scn->scn_queues = NULL;
+	scn->scn_nqueues = 0;
+	scn->scn_bytes_pending = 0;
+}
+
+/*
+ * Queue the scrub read of bp for the issue phase.  Returns B_FALSE if
+ * the caller should issue it right away instead.
+ */
+static boolean_t
+dsl_scan_enqueue(dsl_scan_t *scn, const blkptr_t *bp, const zbookmark_t *zb,
+    int zio_flags)
+{
+	const dva_t *dva = &bp->blk_dva[0];
+	uint64_t vdevid = DVA_GET_VDEV(dva);
+	dsl_scan_io_queue_t *q;
+	scan_io_t *sio, *prev, *next;
+	avl_index_t where;
+	uint64_t start, end;
+
+	if (vdevid >= scn->scn_nqueues)
+		return (B_FALSE);
+	q = &scn->scn_queues[vdevid];
+
+	sio = kmem_alloc(sizeof (scan_io_t), KM_SLEEP);
+	sio->sio_offset = DVA_GET_OFFSET(dva);
+	sio->sio_asize = DVA_GET_ASIZE(dva);
+	sio->sio_flags = zio_flags;
+	sio->sio_bp = *bp;
+	sio->sio_zb = *zb;
+	end = sio->sio_offset + sio->sio_asize;
+
+	mutex_enter(&q->q_lock);
+	if (avl_find(&q->q_sios, sio, &where) != NULL) {
+		/* Already queued; a dedup'ed block reached a second time. */
+		mutex_exit(&q->q_lock);
+		kmem_free(sio, sizeof (scan_io_t));
+		return (B_TRUE);
+	}
+
+	/*
+	 * Live blocks never overlap, but don't trust the range tree with
+	 * it: anything that would overlap a queued block is issued as is.
+	 */
+	prev = avl_nearest(&q->q_sios, where, AVL_BEFORE);
+	next = avl_nearest(&q->q_sios, where, AVL_AFTER);
+	if ((prev != NULL &&
+	    prev->sio_offset + prev->sio_asize > sio->sio_offset) ||
+	    (next != NULL && next->sio_offset < end)) {
+		mutex_exit(&q->q_lock);
+		kmem_free(sio, sizeof (scan_io_t));
+		return (B_FALSE);
+	}
+	avl_insert(&q->q_sios, sio, where);
+
+	/*
+	 * Extent boundaries are always block boundaries, so the new block
+	 * either lies in a gap that was already folded into an extent or
+	 * is clear of every extent, as are the gaps to its neighbors.
+	 */
+	if (!range_tree_contains(q->q_exts, sio->sio_offset, sio->sio_asize)) {
+		start = sio->sio_offset;
+		if (prev != NULL && start - (prev->sio_offset +
+		    prev->sio_asize) <= zfs_scan_max_ext_gap)
+			start = prev->sio_offset + prev->sio_asize;
+		if (next != NULL && next->sio_offset - end <=
+		    zfs_scan_max_ext_gap)
+			end = next->sio_offset;
+		range_tree_add(q->q_exts, start, end - start);
+	}
+	mutex_exit(&q->q_lock);
+
+	scn->scn_bytes_pending += sizeof (scan_io_t);
+	return (B_TRUE);
+}
+
+/*
+ * Issue everything queued this txg, lowest extent first on each vdev,
+ * taking one extent from each vdev in turn.
+ */
+static void
+dsl_scan_queues_issue(dsl_scan_t *scn)
+{
+	uint64_t nexts = 0;
+	uint64_t nsios = 0;
+	boolean_t more;
+
+	do {
+		more = B_FALSE;
+		for (uint64_t i = 0; i < scn->scn_nqueues; i++) {
+			dsl_scan_io_queue_t *q = &scn->scn_queues[i];
+			scan_io_t search, *sio, *nsio;
+			range_seg_t *rs;
+			avl_index_t where;
+			uint64_t end;
+
+			mutex_enter(&q->q_lock);
+			rs = avl_first(&q->q_exts->rt_root);
+			if (rs == NULL) {
+				mutex_exit(&q->q_lock);
+				continue;
+			}
+			search.sio_offset = rs->rs_start;
+			end = rs->rs_end;
+			range_tree_remove(q->q_exts, rs->rs_start,
+			    rs->rs_end - rs->rs_start);
+
+			sio = avl_find(&q->q_sios, &search, &where);
+			if (sio == NULL)
+				sio = avl_nearest(&q->q_sios, where, AVL_AFTER);
+			while (sio != NULL && sio->sio_offset < end) {
+				nsio = AVL_NEXT(&q->q_sios, sio);
+				avl_remove(&q->q_sios, sio);
+				mutex_exit(&q->q_lock);
+
+				dsl_scan_issue_io(scn, &sio->sio_bp,
+				    &sio->sio_zb, sio->sio_flags);
+				kmem_free(sio, sizeof (scan_io_t));
+				nsios++;
+
+				mutex_enter(&q->q_lock);
+				sio = nsio;
+			}
+			mutex_exit(&q->q_lock);
+			nexts++;
+			more = B_TRUE;
+		}
+	} while (more);
+
+	scn->scn_bytes_pending = 0;
+	if (nsios != 0) {
+		zfs_dbgmsg("issued %llu sorted scan I/Os in %llu extents",
+		    (longlong_t)nsios, (longlong_t)nexts);
+	}
+}
+
 static int
 dsl_scan_scrub_cb(dsl_pool_t *dp,
     const blkptr_t *bp, const zbookmark_t *zb)
 {
 	dsl_scan_t *scn = dp->dp_scan;
-	size_t size = BP_GET_PSIZE(bp);
 	spa_t *spa = dp->dp_spa;
 	uint64_t phys_birth = BP_PHYSICAL_BIRTH(bp);
 	boolean_t needs_io;
 	int zio_flags = ZIO_FLAG_SCAN_THREAD | ZIO_FLAG_RAW | ZIO_FLAG_CANFAIL;
-	int scan_delay = 0;
 
 	if (phys_birth <= scn->scn_phys.scn_min_txg ||
 	    phys_birth >= scn->scn_phys.scn_max_txg)
@@ -1642,12 +1913,10 @@ dsl_scan_scrub_cb(dsl_pool_t *dp,
 	if (scn->scn_phys.scn_func == POOL_SCAN_SCRUB) {
 		zio_flags |= ZIO_FLAG_SCRUB;
 		needs_io = B_TRUE;
-		scan_delay = zfs_scrub_delay;
 	} else {
 		ASSERT3U(scn->scn_phys.scn_func, ==, POOL_SCAN_RESILVER);
 		zio_flags |= ZIO_FLAG_RESILVER;
 		needs_io = B_FALSE;
-		scan_delay = zfs_resilver_delay;
 	}
 
 	/* If it's an intent log block, failure is expected. */
@@ -1685,26 +1954,9 @@ dsl_scan_scrub_cb(dsl_pool_t *dp,
 	}
 
 	if (needs_io && !zfs_no_scrub_io) {
-		vdev_t *rvd = spa->spa_root_vdev;
-		uint64_t maxinflight = rvd->vdev_children * zfs_top_maxinflight;
-		void *data = zio_data_buf_alloc(size);
-
-		mutex_enter(&spa->spa_scrub_lock);
-		while (spa->spa_scrub_inflight >= maxinflight)
-			cv_wait(&spa->spa_scrub_io_cv, &spa->spa_scrub_lock);
-		spa->spa_scrub_inflight++;
-		mutex_exit(&spa->spa_scrub_lock);
-
-		/*
-		 * If we're seeing recent (zfs_scan_idle) "important" I/Os
-		 * then throttle our workload to limit the impact of a scan.
-		 */
-		if (ddi_get_lbolt64() - spa->spa_last_io <= zfs_scan_idle)
-			delay(scan_delay);
-
-		zio_nowait(zio_read(NULL, spa, bp, data, size,
-		    dsl_scan_scrub_done, NULL, ZIO_PRIORITY_SCRUB,
-		    zio_flags, zb));
+		if (scn->scn_queues == NULL ||
+		    !dsl_scan_enqueue(scn, bp, zb, zio_flags))
+			dsl_scan_issue_io(scn, bp, zb, zio_flags);
 	}
 
 	/* do not relocate this block */
@@ -32,6 +32,7 @@
 #include <sys/vdev_impl.h>
 #include <sys/zio.h>
 #include <sys/spa_impl.h>
+#include <sys/spa_log_spacemap.h>
 
 /*
  * Allow allocations to switch to gang blocks quickly. We do this to
@@ -135,11 +136,24 @@ int metaslab_preload_limit = SPA_DVAS_PER_BP;
  */
 boolean_t metaslab_preload_enabled = B_TRUE;
 
+/*
+ * Number of allocators per metaslab class, at most METASLAB_MAX_ALLOCATORS.
+ * An allocating thread uses the allocator of the CPU it is running on.
+ */
+int metaslab_allocators = 4;
+
 /*
  * Enable/disable additional weight factor for each metaslab.
  */
 boolean_t metaslab_weight_factor_enable = B_FALSE;
 
+/*
+ * Freed extents smaller than this are not worth trimming and are dropped;
+ * larger ones are trimmed in pieces of at most zfs_trim_extent_bytes_max.
+ */
+uint64_t zfs_trim_extent_bytes_min = 32ULL << 10;
+uint64_t zfs_trim_extent_bytes_max = 128ULL << 20;
+
 
 /*
  * ==========================================================================
@@ -156,6 +170,8 @@ metaslab_class_create(spa_t *spa, metaslab_ops_t *ops)
 	mc->mc_spa = spa;
 	mc->mc_rotor = NULL;
 	mc->mc_ops = ops;
+	mc->mc_allocators = MAX(1, MIN(metaslab_allocators,
+	    MIN(METASLAB_MAX_ALLOCATORS, max_ncpus)));
 
 	return (mc);
 }
@@ -164,6 +180,8 @@ void
 metaslab_class_destroy(metaslab_class_t *mc)
 {
 	ASSERT(mc->mc_rotor == NULL);
+	for (int a = 0; a < mc->mc_allocators; a++)
+		ASSERT(mc->mc_allocator[a].mca_rotor == NULL);
 	ASSERT(mc->mc_alloc == 0);
 	ASSERT(mc->mc_deferred == 0);
 	ASSERT(mc->mc_space == 0);
@@ -375,6 +393,11 @@ metaslab_group_activate(metaslab_group_t *mg)
 		mgnext->mg_prev = mg;
 	}
 	mc->mc_rotor = mg;
+
+	for (int a = 0; a < mc->mc_allocators; a++) {
+		if (mc->mc_allocator[a].mca_rotor == NULL)
+			mc->mc_allocator[a].mca_rotor = mg;
+	}
 }
 
 void
@@ -406,6 +429,15 @@ metaslab_group_passivate(metaslab_group_t *mg)
 		mgnext->mg_prev = mgprev;
 	}
 
+	for (int a = 0; a < mc->mc_allocators; a++) {
+		metaslab_class_allocator_t *mca = &mc->mc_allocator[a];
+
+		if (mca->mca_rotor == mg) {
+			mca->mca_rotor = mc->mc_rotor;
+			mca->mca_aliquot = 0;
+		}
+	}
+
 	mg->mg_prev = NULL;
 	mg->mg_next = NULL;
 }
@@ -421,11 +453,53 @@ metaslab_group_add(metaslab_group_t *mg, metaslab_t *msp)
 	mutex_exit(&mg->mg_lock);
 }
 
+/*
+ * A primary metaslab belongs to the allocator that activated it, and is
+ * that allocator's first choice in the group.  ms_allocator and
+ * mg_primaries[] are protected by mg_lock.
+ */
+static void
+metaslab_group_set_primary(metaslab_group_t *mg, metaslab_t *msp,
+    int allocator)
+{
+	metaslab_t *old;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT(msp->ms_weight & METASLAB_WEIGHT_PRIMARY);
+
+	mutex_enter(&mg->mg_lock);
+	old = mg->mg_primaries[allocator];
+	if (old != NULL && old != msp) {
+		/*
+		 * Another thread of this allocator activated a metaslab
+		 * of its own; the old one stays active but is unowned.
+		 */
+		old->ms_allocator = -1;
+	}
+	mg->mg_primaries[allocator] = msp;
+	msp->ms_allocator = allocator;
+	mutex_exit(&mg->mg_lock);
+}
+
+static void
+metaslab_group_clear_primary(metaslab_group_t *mg, metaslab_t *msp)
+{
+	ASSERT(MUTEX_HELD(&mg->mg_lock));
+
+	if (msp->ms_allocator == -1)
+		return;
+
+	ASSERT3P(mg->mg_primaries[msp->ms_allocator], ==, msp);
+	mg->mg_primaries[msp->ms_allocator] = NULL;
+	msp->ms_allocator = -1;
+}
+
 static void
 metaslab_group_remove(metaslab_group_t *mg, metaslab_t *msp)
 {
 	mutex_enter(&mg->mg_lock);
 	ASSERT(msp->ms_group == mg);
+	metaslab_group_clear_primary(mg, msp);
 	avl_remove(&mg->mg_metaslab_tree, msp);
 	msp->ms_group = NULL;
 	mutex_exit(&mg->mg_lock);
@@ -443,6 +517,8 @@ metaslab_group_sort(metaslab_group_t *mg, metaslab_t *msp, uint64_t weight)
 
 	mutex_enter(&mg->mg_lock);
 	ASSERT(msp->ms_group == mg);
+	if (!(weight & METASLAB_WEIGHT_PRIMARY))
+		metaslab_group_clear_primary(mg, msp);
 	avl_remove(&mg->mg_metaslab_tree, msp);
 	msp->ms_weight = weight;
 	avl_add(&mg->mg_metaslab_tree, msp);
@@ -620,6 +696,7 @@ metaslab_block_alloc(metaslab_t *msp, uint64_t size)
 		VERIFY0(P2PHASE(size, 1ULL << vd->vdev_ashift));
 		VERIFY3U(range_tree_space(rt) - size, <=, msp->ms_size);
 		range_tree_remove(rt, start, size);
+		range_tree_clear(msp->ms_trimtree, start, size);
 	}
 	return (start);
 }
@@ -892,6 +969,76 @@ metaslab_ops_t *zfs_metaslab_ops = &metaslab_df_ops;
  * ==========================================================================
  */
 
+/*
+ * Account for [start, start + size) changing state relative to the
+ * metaslab's space map: the parts of it found in "from" are removed from
+ * it (they now match the space map again), and the rest is added to "to".
+ */
+static void
+metaslab_unflushed_move(range_tree_t *from, range_tree_t *to,
+    uint64_t start, uint64_t size)
+{
+	avl_tree_t *t = &from->rt_root;
+	uint64_t end = start + size;
+	uint64_t off = start;
+	range_seg_t *rs, rsearch;
+	avl_index_t where;
+
+	rsearch.rs_start = start;
+	rsearch.rs_end = start + 1;
+	rs = avl_find(t, &rsearch, &where);
+	if (rs == NULL)
+		rs = avl_nearest(t, where, AVL_AFTER);
+
+	while (off < end) {
+		uint64_t seg_start, seg_end;
+		range_seg_t *next;
+
+		if (rs == NULL || rs->rs_start >= end) {
+			range_tree_add(to, off, end - off);
+			break;
+		}
+
+		seg_start = MAX(rs->rs_start, off);
+		seg_end = MIN(rs->rs_end, end);
+		if (seg_start > off)
+			range_tree_add(to, off, seg_start - off);
+
+		next = AVL_NEXT(t, rs);
+		range_tree_remove(from, seg_start, seg_end - seg_start);
+		off = seg_end;
+		rs = next;
+	}
+}
+
+static void
+metaslab_unflushed_alloc(void *arg, uint64_t start, uint64_t size)
+{
+	metaslab_t *msp = arg;
+
+	metaslab_unflushed_move(msp->ms_unflushed_frees,
+	    msp->ms_unflushed_allocs, start, size);
+}
+
+static void
+metaslab_unflushed_free(void *arg, uint64_t start, uint64_t size)
+{
+	metaslab_t *msp = arg;
+
+	metaslab_unflushed_move(msp->ms_unflushed_allocs,
+	    msp->ms_unflushed_frees, start, size);
+}
+
+/*
+ * The metaslab's allocated space, including changes that so far have
+ * only been written to the log space maps.
+ */
+static uint64_t
+metaslab_allocated_space(metaslab_t *msp)
+{
+	return (space_map_allocated(msp->ms_sm) + msp->ms_unflushed_delta);
+}
+
 /*
  * Wait for any in-progress metaslab loads to complete.
  */
@@ -931,6 +1078,11 @@ metaslab_load(metaslab_t *msp)
 	msp->ms_loading = B_FALSE;
 
 	if (msp->ms_loaded) {
+		range_tree_walk(msp->ms_unflushed_allocs,
+		    range_tree_remove, msp->ms_tree);
+		range_tree_walk(msp->ms_unflushed_frees,
+		    range_tree_add, msp->ms_tree);
+
 		for (int t = 0; t < TXG_DEFER_SIZE; t++) {
 			range_tree_walk(msp->ms_defertree[t],
 			    range_tree_remove, msp->ms_tree);
@@ -960,6 +1112,7 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg)
 	mutex_init(&msp->ms_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&msp->ms_load_cv, NULL, CV_DEFAULT, NULL);
 	msp->ms_id = id;
+	msp->ms_allocator = -1;
 	msp->ms_start = id << vd->vdev_ms_shift;
 	msp->ms_size = 1ULL << vd->vdev_ms_shift;
 
@@ -981,6 +1134,10 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg)
 	 * data fault on any attempt to use this metaslab before it's ready.
 	 */
 	msp->ms_tree = range_tree_create(&metaslab_rt_ops, msp, &msp->ms_lock);
+	msp->ms_unflushed_allocs = range_tree_create(NULL, msp, &msp->ms_lock);
+	msp->ms_unflushed_frees = range_tree_create(NULL, msp, &msp->ms_lock);
+	msp->ms_trimtree = range_tree_create(NULL, msp, &msp->ms_lock);
+	msp->ms_trimmingtree = range_tree_create(NULL, msp, &msp->ms_lock);
 	metaslab_group_add(mg, msp);
 
 	msp->ms_ops = mg->mg_class->mc_ops;
@@ -1018,17 +1175,26 @@ metaslab_fini(metaslab_t *msp)
 {
 	metaslab_group_t *mg = msp->ms_group;
 
+	spa_log_sm_clean(mg->mg_vd->vdev_spa, msp);
 	metaslab_group_remove(mg, msp);
 
 	mutex_enter(&msp->ms_lock);
 
 	VERIFY(msp->ms_group == NULL);
-	vdev_space_update(mg->mg_vd, -space_map_allocated(msp->ms_sm),
+	ASSERT(!msp->ms_trimming);
+	vdev_space_update(mg->mg_vd, -metaslab_allocated_space(msp),
 	    0, -msp->ms_size);
 	space_map_close(msp->ms_sm);
 
 	metaslab_unload(msp);
 	range_tree_destroy(msp->ms_tree);
+	range_tree_vacate(msp->ms_unflushed_allocs, NULL, NULL);
+	range_tree_vacate(msp->ms_unflushed_frees, NULL, NULL);
+	range_tree_destroy(msp->ms_unflushed_allocs);
+	range_tree_destroy(msp->ms_unflushed_frees);
+	range_tree_vacate(msp->ms_trimtree, NULL, NULL);
+	range_tree_destroy(msp->ms_trimtree);
+	range_tree_destroy(msp->ms_trimmingtree);
 
 	for (int t = 0; t < TXG_SIZE; t++) {
 		range_tree_destroy(msp->ms_alloctree[t]);
@@ -1133,7 +1299,7 @@ metaslab_weight(metaslab_t *msp)
 	/*
 	 * The baseline weight is the metaslab's free space.
 	 */
-	space = msp->ms_size - space_map_allocated(msp->ms_sm);
+	space = msp->ms_size - metaslab_allocated_space(msp);
 	weight = space;
 
 	/*
@@ -1165,7 +1331,7 @@ metaslab_weight(metaslab_t *msp)
 }
 
 static int
-metaslab_activate(metaslab_t *msp, uint64_t activation_weight)
+metaslab_activate(metaslab_t *msp, uint64_t activation_weight, int allocator)
 {
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
 
@@ -1181,6 +1347,9 @@ metaslab_activate(metaslab_t *msp, uint64_t activation_weight)
 
 		metaslab_group_sort(msp->ms_group, msp,
 		    msp->ms_weight | activation_weight);
+		if (activation_weight == METASLAB_WEIGHT_PRIMARY)
+			metaslab_group_set_primary(msp->ms_group, msp,
+			    allocator);
 	}
 	ASSERT(msp->ms_loaded);
 	ASSERT(msp->ms_weight & METASLAB_ACTIVE_MASK);
@@ -1238,8 +1407,13 @@ metaslab_group_preload(metaslab_group_t *mg)
 	 */
 	for (msp = avl_first(t); msp != NULL; msp = AVL_NEXT(t, msp)) {
 
-		/* If we have reached our preload limit then we're done */
-		if (++m > metaslab_preload_limit)
+		/*
+		 * If we have reached our preload limit then we're done.
+		 * Each allocator works on its own primary metaslab, so
+		 * keep enough loaded for all of them.
+		 */
+		if (++m > metaslab_preload_limit *
+		    mg->mg_class->mc_allocators)
 			break;
 
 		VERIFY(taskq_dispatch(mg->mg_taskq, metaslab_preload,
@@ -1281,6 +1455,13 @@ metaslab_should_condense(metaslab_t *msp)
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
 	ASSERT(msp->ms_loaded);
 
+	/*
+	 * Space being trimmed is missing from the ms_tree, so writing out
+	 * the ms_tree now would leak it.
+	 */
+	if (msp->ms_trimming)
+		return (B_FALSE);
+
 	/*
 	 * Use the ms_size_tree range tree, which is ordered by size, to
 	 * obtain the largest segment in the free tree. If the tree is empty
@@ -1386,6 +1567,81 @@ metaslab_condense(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
 	msp->ms_condensing = B_FALSE;
 }
 
+/*
+ * Should this txg's changes to the metaslab go to the log space map?
+ * Log-class metaslabs are small and few, and space maps without room
+ * for smp_flushed_txg cannot tell the log apart from their own records.
+ * A metaslab that has already been flushed in this txg keeps writing to
+ * its own space map for the remaining sync passes.
+ */
+static boolean_t
+metaslab_use_log(metaslab_t *msp, uint64_t txg)
+{
+	metaslab_group_t *mg = msp->ms_group;
+	spa_t *spa = mg->mg_vd->vdev_spa;
+
+	return (spa_log_sm_active(spa) &&
+	    mg->mg_class != spa_log_class(spa) &&
+	    msp->ms_sm != NULL &&
+	    msp->ms_sm->sm_dbuf->db_size == sizeof (space_map_phys_t) &&
+	    space_map_flushed_txg(msp->ms_sm) != txg);
+}
+
+/*
+ * Fold this txg's changes into the unflushed trees.  If log_sm is set,
+ * append them to it; otherwise flush all unflushed changes to the
+ * metaslab's own space map.
+ */
+static void
+metaslab_sync_log(metaslab_t *msp, space_map_t *log_sm, uint64_t txg,
+    dmu_tx_t *tx)
+{
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+	range_tree_t *alloctree = msp->ms_alloctree[txg & TXG_MASK];
+	range_tree_t *freetree = msp->ms_freetree[txg & TXG_MASK];
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+
+	range_tree_walk(alloctree, metaslab_unflushed_alloc, msp);
+	range_tree_walk(freetree, metaslab_unflushed_free, msp);
+
+	if (log_sm != NULL) {
+		space_map_write(log_sm, alloctree, SM_ALLOC, tx);
+		space_map_write(log_sm, freetree, SM_FREE, tx);
+		if (msp->ms_unflushed_txg == 0)
+			spa_log_sm_dirty(spa, msp, txg);
+		return;
+	}
+
+	if (msp->ms_loaded && spa_sync_pass(spa) == 1 &&
+	    metaslab_should_condense(msp)) {
+		metaslab_condense(msp, txg, tx);
+	} else {
+		space_map_write(msp->ms_sm, msp->ms_unflushed_allocs,
+		    SM_ALLOC, tx);
+		space_map_write(msp->ms_sm, msp->ms_unflushed_frees,
+		    SM_FREE, tx);
+	}
+
+	/*
+	 * The histogram is only maintained when flushing; see the
+	 * comment in metaslab_sync().
+	 */
+	if (msp->ms_loaded) {
+		space_map_histogram_clear(msp->ms_sm);
+		space_map_histogram_add(msp->ms_sm, msp->ms_tree, tx);
+		space_map_histogram_add(msp->ms_sm, msp->ms_trimmingtree, tx);
+	} else {
+		space_map_histogram_add(msp->ms_sm,
+		    msp->ms_unflushed_frees, tx);
+	}
+
+	range_tree_vacate(msp->ms_unflushed_allocs, NULL, NULL);
+	range_tree_vacate(msp->ms_unflushed_frees, NULL, NULL);
+	space_map_set_flushed_txg(msp->ms_sm, txg, tx);
+	spa_log_sm_clean(spa, msp);
+}
+
 /*
  * Write a metaslab to disk in the context of the specified transaction group.
  */
@@ -1402,6 +1658,8 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	    &msp->ms_freetree[TXG_CLEAN(txg) & TXG_MASK];
 	dmu_tx_t *tx;
 	uint64_t object = space_map_object(msp->ms_sm);
+	space_map_t *log_sm = NULL;
+	boolean_t uselog, flush;
 
 	ASSERT(!vd->vdev_ishole);
 
@@ -1417,8 +1675,14 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	ASSERT3P(*freetree, !=, NULL);
 	ASSERT3P(*freed_tree, !=, NULL);
 
+	/*
+	 * A metaslab picked by spa_log_sm_sync() must be synced even if
+	 * nothing changed in this txg, to write out its unflushed changes.
+	 */
+	flush = (msp->ms_flush_txg == txg && msp->ms_unflushed_txg != 0);
+
 	if (range_tree_space(alloctree) == 0 &&
-	    range_tree_space(*freetree) == 0)
+	    range_tree_space(*freetree) == 0 && !flush)
 		return;
 
 	/*
@@ -1433,6 +1697,10 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 
 	tx = dmu_tx_create_assigned(spa_get_dsl(spa), txg);
 
+	uselog = metaslab_use_log(msp, txg);
+	if (uselog && !flush)
+		log_sm = spa_log_sm_vdev(vd, tx);
+
 	if (msp->ms_sm == NULL) {
 		uint64_t new_object;
 
@@ -1447,17 +1715,30 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 
 	mutex_enter(&msp->ms_lock);
 
-	if (msp->ms_loaded && spa_sync_pass(spa) == 1 &&
+	if (uselog) {
+		/*
+		 * Updating the histogram would dirty the space map's bonus
+		 * buffer in every txg, which is what the log avoids, so
+		 * it is left alone until the metaslab is flushed.
+		 */
+		metaslab_sync_log(msp, log_sm, txg, tx);
+	} else if (msp->ms_loaded && spa_sync_pass(spa) == 1 &&
 	    metaslab_should_condense(msp)) {
+		ASSERT0(range_tree_space(msp->ms_unflushed_allocs));
+		ASSERT0(range_tree_space(msp->ms_unflushed_frees));
 		metaslab_condense(msp, txg, tx);
 	} else {
+		ASSERT0(range_tree_space(msp->ms_unflushed_allocs));
+		ASSERT0(range_tree_space(msp->ms_unflushed_frees));
 		space_map_write(msp->ms_sm, alloctree, SM_ALLOC, tx);
 		space_map_write(msp->ms_sm, *freetree, SM_FREE, tx);
 	}
 
 	range_tree_vacate(alloctree, NULL, NULL);
 
-	if (msp->ms_loaded) {
+	if (uselog) {
+		/* metaslab_sync_log() took care of the histogram */
+	} else if (msp->ms_loaded) {
 		/*
 		 * When the space map is loaded, we have an accruate
 		 * histogram in the range tree. This gives us an opportunity
@@ -1466,6 +1747,7 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 		 */
 		space_map_histogram_clear(msp->ms_sm);
 		space_map_histogram_add(msp->ms_sm, msp->ms_tree, tx);
+		space_map_histogram_add(msp->ms_sm, msp->ms_trimmingtree, tx);
 	} else {
 		/*
 		 * Since the space map is not loaded we simply update the
@@ -1513,7 +1795,7 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	vdev_t *vd = mg->mg_vd;
 	range_tree_t **freed_tree;
 	range_tree_t **defer_tree;
-	int64_t alloc_delta, defer_delta;
+	int64_t alloc_delta, defer_delta, unflushed_delta;
 
 	ASSERT(!vd->vdev_ishole);
 
@@ -1548,7 +1830,15 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	freed_tree = &msp->ms_freetree[TXG_CLEAN(txg) & TXG_MASK];
 	defer_tree = &msp->ms_defertree[txg % TXG_DEFER_SIZE];
 
-	alloc_delta = space_map_alloc_delta(msp->ms_sm);
+	/*
+	 * Changes that were only logged count as allocated space too; the
+	 * unflushed trees hold the difference from the space map.
+	 */
+	unflushed_delta = range_tree_space(msp->ms_unflushed_allocs) -
+	    range_tree_space(msp->ms_unflushed_frees);
+	alloc_delta = space_map_alloc_delta(msp->ms_sm) +
+	    unflushed_delta - msp->ms_unflushed_delta;
+	msp->ms_unflushed_delta = unflushed_delta;
 	defer_delta = range_tree_space(*freed_tree) -
 	    range_tree_space(*defer_tree);
 
@@ -1565,10 +1855,14 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 
 	/*
 	 * Move the frees from the defer_tree back to the free
-	 * range tree (if it's loaded). Swap the freed_tree and the
-	 * defer_tree -- this is safe to do because we've just emptied out
-	 * the defer_tree.
+	 * range tree (if it's loaded), noting them for trimming. Swap the
+	 * freed_tree and the defer_tree -- this is safe to do because we've
+	 * just emptied out the defer_tree.
 	 */
+	if (vd->vdev_spa->spa_autotrim)
+		range_tree_walk(*defer_tree, range_tree_add, msp->ms_trimtree);
+	else
+		range_tree_vacate(msp->ms_trimtree, NULL, NULL);
 	range_tree_vacate(*defer_tree,
 	    msp->ms_loaded ? range_tree_add : NULL, msp->ms_tree);
 	range_tree_swap(freed_tree, defer_tree);
@@ -1586,7 +1880,7 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 		vdev_dirty(vd, VDD_METASLAB, msp, txg + 1);
 	}
 
-	if (msp->ms_loaded && msp->ms_access_txg < txg) {
+	if (msp->ms_loaded && msp->ms_access_txg < txg && !msp->ms_trimming) {
 		for (int t = 1; t < TXG_CONCURRENT_STATES; t++) {
 			VERIFY0(range_tree_space(
 			    msp->ms_alloctree[(txg + t) & TXG_MASK]));
@@ -1601,6 +1895,122 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 
 }
 
+/*
+ * Move a range of the ms_trimtree that is worth trimming out of the
+ * ms_tree and into the ms_trimmingtree.
+ */
+static void
+metaslab_trim_take(void *arg, uint64_t start, uint64_t size)
+{
+	metaslab_t *msp = arg;
+
+	if (size < zfs_trim_extent_bytes_min ||
+	    !range_tree_contains(msp->ms_tree, start, size))
+		return;
+
+	range_tree_remove(msp->ms_tree, start, size);
+	range_tree_add(msp->ms_trimmingtree, start, size);
+}
+
+/*
+ * Trim the space collected in the metaslab's ms_trimtree, or all of its
+ * free space if full is set, and return the number of bytes trimmed.
+ * The caller must hold SCL_STATE as reader, which keeps the vdev from
+ * going away and the metaslab from being destroyed until we're done.
+ */
+uint64_t
+metaslab_trim(metaslab_t *msp, boolean_t full)
+{
+	vdev_t *vd = msp->ms_group->mg_vd;
+	spa_t *spa = vd->vdev_spa;
+	avl_tree_t *t = &msp->ms_trimmingtree->rt_root;
+	uint64_t trimmed;
+	zio_t *zio;
+
+	ASSERT(spa_config_held(spa, SCL_STATE, RW_READER));
+
+	mutex_enter(&msp->ms_lock);
+	metaslab_load_wait(msp);
+
+	if (msp->ms_trimming || msp->ms_condensing ||
+	    (!full && range_tree_space(msp->ms_trimtree) == 0) ||
+	    (!msp->ms_loaded && metaslab_load(msp) != 0)) {
+		mutex_exit(&msp->ms_lock);
+		return (0);
+	}
+
+	if (full) {
+		range_tree_vacate(msp->ms_trimtree, NULL, NULL);
+		range_tree_walk(msp->ms_tree, range_tree_add, msp->ms_trimtree);
+	}
+	range_tree_vacate(msp->ms_trimtree, metaslab_trim_take, msp);
+	trimmed = range_tree_space(msp->ms_trimmingtree);
+	if (trimmed == 0) {
+		mutex_exit(&msp->ms_lock);
+		return (0);
+	}
+	msp->ms_trimming = B_TRUE;
+	mutex_exit(&msp->ms_lock);
+
+	/*
+	 * Only this thread changes the ms_trimmingtree while ms_trimming is
+	 * set, so it can be walked without the lock.
+	 */
+	zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (range_seg_t *rs = avl_first(t); rs != NULL; rs = AVL_NEXT(t, rs)) {
+		uint64_t size;
+
+		for (uint64_t off = rs->rs_start; off < rs->rs_end;
+		    off += size) {
+			size = MIN(rs->rs_end - off, zfs_trim_extent_bytes_max);
+			zio_nowait(zio_trim(zio, spa, vd, off, size));
+		}
+	}
+	(void) zio_wait(zio);
+
+	mutex_enter(&msp->ms_lock);
+	ASSERT(msp->ms_loaded);
+	range_tree_vacate(msp->ms_trimmingtree, range_tree_add, msp->ms_tree);
+	msp->ms_trimming = B_FALSE;
+	mutex_exit(&msp->ms_lock);
+
+	return (trimmed);
+}
+
+/*
+ * Apply one record of the log space map written in txg, while the pool
+ * is being opened.
+ */
+void
+metaslab_unflushed_replay(metaslab_t *msp, maptype_t type, uint64_t offset,
+    uint64_t size, uint64_t txg)
+{
+	metaslab_group_t *mg = msp->ms_group;
+	int64_t delta;
+
+	mutex_enter(&msp->ms_lock);
+	if (type == SM_ALLOC) {
+		metaslab_unflushed_alloc(msp, offset, size);
+		if (msp->ms_loaded)
+			range_tree_remove(msp->ms_tree, offset, size);
+		range_tree_clear(msp->ms_trimtree, offset, size);
+		delta = size;
+	} else {
+		metaslab_unflushed_free(msp, offset, size);
+		if (msp->ms_loaded)
+			range_tree_add(msp->ms_tree, offset, size);
+		delta = -(int64_t)size;
+	}
+	msp->ms_unflushed_delta += delta;
+	vdev_space_update(mg->mg_vd, delta, 0, 0);
+
+	if (msp->ms_unflushed_txg == 0)
+		spa_log_sm_dirty(mg->mg_vd->vdev_spa, msp, txg);
+
+	metaslab_group_sort(mg, msp, metaslab_weight(msp));
+	mutex_exit(&msp->ms_lock);
+}
+
 void
 metaslab_sync_reassess(metaslab_group_t *mg)
 {
@@ -1629,16 +2039,75 @@ metaslab_distance(metaslab_t *msp, dva_t *dva)
 	return (0);
 }
 
+/*
+ * Walk the group's metaslabs in weight order and pick the first one that
+ * can satisfy the allocation.  When looking for a primary metaslab, the
+ * primaries of other allocators are only used if nothing else will do.
+ */
+static metaslab_t *
+metaslab_group_pick(metaslab_group_t *mg, uint64_t psize, uint64_t asize,
+    uint64_t txg, uint64_t activation_weight, uint64_t min_distance,
+    dva_t *dva, int d, int allocator)
+{
+	spa_t *spa = mg->mg_vd->vdev_spa;
+	avl_tree_t *t = &mg->mg_metaslab_tree;
+	metaslab_t *msp, *shared = NULL;
+	uint64_t target_distance;
+	int i;
+
+	ASSERT(MUTEX_HELD(&mg->mg_lock));
+
+	for (msp = avl_first(t); msp; msp = AVL_NEXT(t, msp)) {
+		if (msp->ms_weight < asize) {
+			if (shared != NULL)
+				return (shared);
+			spa_dbgmsg(spa, "%s: failed to meet weight "
+			    "requirement: vdev %llu, txg %llu, mg %p, "
+			    "msp %p, psize %llu, asize %llu, "
+			    "weight %llu", spa_name(spa),
+			    mg->mg_vd->vdev_id, txg,
+			    mg, msp, psize, asize, msp->ms_weight);
+			return (NULL);
+		}
+
+		/*
+		 * If the selected metaslab is condensing, skip it.
+		 */
+		if (msp->ms_condensing)
+			continue;
+
+		if (activation_weight == METASLAB_WEIGHT_PRIMARY) {
+			if (msp->ms_allocator != -1 &&
+			    msp->ms_allocator != allocator) {
+				if (shared == NULL)
+					shared = msp;
+				continue;
+			}
+			return (msp);
+		}
+
+		target_distance = min_distance +
+		    (metaslab_allocated_space(msp) != 0 ? 0 :
+		    min_distance >> 1);
+
+		for (i = 0; i < d; i++)
+			if (metaslab_distance(msp, &dva[i]) <
+			    target_distance)
+				break;
+		if (i == d)
+			return (msp);
+	}
+
+	return (shared);
+}
+
 static uint64_t
 metaslab_group_alloc(metaslab_group_t *mg, uint64_t psize, uint64_t asize,
-    uint64_t txg, uint64_t min_distance, dva_t *dva, int d)
+    uint64_t txg, uint64_t min_distance, dva_t *dva, int d, int allocator)
 {
-	spa_t *spa = mg->mg_vd->vdev_spa;
 	metaslab_t *msp = NULL;
 	uint64_t offset = -1ULL;
-	avl_tree_t *t = &mg->mg_metaslab_tree;
 	uint64_t activation_weight;
-	uint64_t target_distance;
 	int i;
 
 	activation_weight = METASLAB_WEIGHT_PRIMARY;
@@ -1652,40 +2121,21 @@ metaslab_group_alloc(metaslab_group_t *mg, uint64_t psize, uint64_t asize,
 	for (;;) {
 		boolean_t was_active;
 
+		/*
+		 * Most allocations are satisfied by this allocator's primary
+		 * metaslab, which we can use without walking the tree.
+		 */
 		mutex_enter(&mg->mg_lock);
-		for (msp = avl_first(t); msp; msp = AVL_NEXT(t, msp)) {
-			if (msp->ms_weight < asize) {
-				spa_dbgmsg(spa, "%s: failed to meet weight "
-				    "requirement: vdev %llu, txg %llu, mg %p, "
-				    "msp %p, psize %llu, asize %llu, "
-				    "weight %llu", spa_name(spa),
-				    mg->mg_vd->vdev_id, txg,
-				    mg, msp, psize, asize, msp->ms_weight);
-				mutex_exit(&mg->mg_lock);
-				return (-1ULL);
-			}
-
-			/*
-			 * If the selected metaslab is condensing, skip it.
-			 */
-			if (msp->ms_condensing)
-				continue;
-
-			was_active = msp->ms_weight & METASLAB_ACTIVE_MASK;
-			if (activation_weight == METASLAB_WEIGHT_PRIMARY)
-				break;
-
-			target_distance = min_distance +
-			    (space_map_allocated(msp->ms_sm) != 0 ? 0 :
-			    min_distance >> 1);
-
-			for (i = 0; i < d; i++)
-				if (metaslab_distance(msp, &dva[i]) <
-				    target_distance)
-					break;
-			if (i == d)
-				break;
+		msp = NULL;
+		if (activation_weight == METASLAB_WEIGHT_PRIMARY)
+			msp = mg->mg_primaries[allocator];
+		if (msp == NULL || msp->ms_weight < asize ||
+		    msp->ms_condensing) {
+			msp = metaslab_group_pick(mg, psize, asize, txg,
+			    activation_weight, min_distance, dva, d, allocator);
 		}
+		if (msp != NULL)
+			was_active = msp->ms_weight & METASLAB_ACTIVE_MASK;
 		mutex_exit(&mg->mg_lock);
 		if (msp == NULL)
 			return (-1ULL);
@@ -1713,7 +2163,7 @@ metaslab_group_alloc(metaslab_group_t *mg, uint64_t psize, uint64_t asize,
 			continue;
 		}
 
-		if (metaslab_activate(msp, activation_weight) != 0) {
+		if (metaslab_activate(msp, activation_weight, allocator) != 0) {
 			mutex_exit(&msp->ms_lock);
 			continue;
 		}
@@ -1751,8 +2201,9 @@ metaslab_group_alloc(metaslab_group_t *mg, uint64_t psize, uint64_t asize,
  */
 static int
 metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
-    dva_t *dva, int d, dva_t *hintdva, uint64_t txg, int flags)
+    dva_t *dva, int d, dva_t *hintdva, uint64_t txg, int flags, int allocator)
 {
+	metaslab_class_allocator_t *mca = &mc->mc_allocator[allocator];
 	metaslab_group_t *mg, *rotor;
 	vdev_t *vd;
 	int dshift = 3;
@@ -1773,7 +2224,7 @@ metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
 
 	/*
 	 * Start at the rotor and loop through all mgs until we find something.
-	 * Note that there's no locking on mc_rotor or mc_aliquot because
+	 * Note that there's no locking on mca_rotor or mca_aliquot because
 	 * nothing actually breaks if we miss a few updates -- we just won't
 	 * allocate quite as evenly.  It all balances out over time.
 	 *
@@ -1808,13 +2259,13 @@ metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
 			    mg->mg_next != NULL)
 				mg = mg->mg_next;
 		} else {
-			mg = mc->mc_rotor;
+			mg = mca->mca_rotor;
 		}
 	} else if (d != 0) {
 		vd = vdev_lookup_top(spa, DVA_GET_VDEV(&dva[d - 1]));
 		mg = vd->vdev_mg->mg_next;
 	} else {
-		mg = mc->mc_rotor;
+		mg = mca->mca_rotor;
 	}
 
 	/*
@@ -1822,7 +2273,7 @@ metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
 	 * metaslab group that has been passivated, just follow the rotor.
 	 */
 	if (mg->mg_class != mc || mg->mg_activation_count <= 0)
-		mg = mc->mc_rotor;
+		mg = mca->mca_rotor;
 
 	rotor = mg;
 top:
@@ -1885,7 +2336,7 @@ top:
 		ASSERT(P2PHASE(asize, 1ULL << vd->vdev_ashift) == 0);
 
 		offset = metaslab_group_alloc(mg, psize, asize, txg, distance,
-		    dva, d);
+		    dva, d, allocator);
 		if (offset != -1ULL) {
 			/*
 			 * If we've just selected this metaslab group,
@@ -1893,7 +2344,7 @@ top:
 			 * over- or under-used relative to the pool,
 			 * and set an allocation bias to even it out.
 			 */
-			if (mc->mc_aliquot == 0) {
+			if (mca->mca_aliquot == 0) {
 				vdev_stat_t *vs = &vd->vdev_stat;
 				int64_t vu, cu;
 
@@ -1917,10 +2368,10 @@ top:
 				    (int64_t)mg->mg_aliquot) / 100;
 			}
 
-			if (atomic_add_64_nv(&mc->mc_aliquot, asize) >=
+			if (atomic_add_64_nv(&mca->mca_aliquot, asize) >=
 			    mg->mg_aliquot + mg->mg_bias) {
-				mc->mc_rotor = mg->mg_next;
-				mc->mc_aliquot = 0;
+				mca->mca_rotor = mg->mg_next;
+				mca->mca_aliquot = 0;
 			}
 
 			DVA_SET_VDEV(&dva[d], vd->vdev_id);
@@ -1931,8 +2382,8 @@ top:
 			return (0);
 		}
 next:
-		mc->mc_rotor = mg->mg_next;
-		mc->mc_aliquot = 0;
+		mca->mca_rotor = mg->mg_next;
+		mca->mca_aliquot = 0;
 	} while ((mg = mg->mg_next) != rotor);
 
 	if (!all_zero) {
@@ -2037,7 +2488,7 @@ metaslab_claim_dva(spa_t *spa, const dva_t *dva, uint64_t txg)
 	mutex_enter(&msp->ms_lock);
 
 	if ((txg != 0 && spa_writeable(spa)) || !msp->ms_loaded)
-		error = metaslab_activate(msp, METASLAB_WEIGHT_SECONDARY);
+		error = metaslab_activate(msp, METASLAB_WEIGHT_SECONDARY, 0);
 
 	if (error == 0 && !range_tree_contains(msp->ms_tree, offset, size))
 		error = SET_ERROR(ENOENT);
@@ -2052,6 +2503,7 @@ metaslab_claim_dva(spa_t *spa, const dva_t *dva, uint64_t txg)
 	VERIFY0(P2PHASE(size, 1ULL << vd->vdev_ashift));
 	VERIFY3U(range_tree_space(msp->ms_tree) - size, <=, msp->ms_size);
 	range_tree_remove(msp->ms_tree, offset, size);
+	range_tree_clear(msp->ms_trimtree, offset, size);
 
 	if (spa_writeable(spa)) {	/* don't dirty if we're zdb(1M) */
 		if (range_tree_space(msp->ms_alloctree[txg & TXG_MASK]) == 0)
@@ -2070,6 +2522,7 @@ metaslab_alloc(spa_t *spa, metaslab_class_t *mc, uint64_t psize, blkptr_t *bp,
 {
 	dva_t *dva = bp->blk_dva;
 	dva_t *hintdva = hintbp->blk_dva;
+	int allocator;
 	int error = 0;
 
 	ASSERT(bp->blk_birth == 0);
@@ -2086,9 +2539,10 @@ metaslab_alloc(spa_t *spa, metaslab_class_t *mc, uint64_t psize, blkptr_t *bp,
 	ASSERT(BP_GET_NDVAS(bp) == 0);
 	ASSERT(hintbp == NULL || ndvas <= BP_GET_NDVAS(hintbp));
 
+	allocator = CPU_SEQID % mc->mc_allocators;
 	for (int d = 0; d < ndvas; d++) {
 		error = metaslab_alloc_dva(spa, mc, psize, dva, d, hintdva,
-		    txg, flags);
+		    txg, flags, allocator);
 		if (error != 0) {
 			for (d--; d >= 0; d--) {
 				metaslab_free_dva(spa, &dva[d], txg, B_TRUE);
@@ -286,3 +286,89 @@ rrw_tsd_destroy(void *arg)
 		    (void *)curthread, (void *)rn->rn_rrl);
 	}
 }
+
+/*
+ * A reader-mostly lock, for locks like z_teardown_lock that every vnode op
+ * takes for reader and almost nothing takes for writer.  All the readers
+ * of an rrwlock_t go through its rr_lock and its counts, so at high op
+ * rates the cache line holding them never stays anywhere for long.
+ *
+ * An rrmlock_t spreads the readers over RRM_NUM_LOCKS rrwlocks, picked by
+ * thread, so that each one only sees a fraction of the traffic; writers
+ * take all of them in order.  The lock is picked by thread rather than by
+ * CPU because a thread that migrates must still re-enter, and release,
+ * the rrwlock that knows about its earlier read holds.
+ *
+ * All the functions below are direct wrappers around the ones above.
+ */
+void
+rrm_init(rrmlock_t *rrl, boolean_t track_all)
+{
+	int i;
+
+	for (i = 0; i < RRM_NUM_LOCKS; i++)
+		rrw_init(&rrl->locks[i], track_all);
+}
+
+void
+rrm_destroy(rrmlock_t *rrl)
+{
+	int i;
+
+	for (i = 0; i < RRM_NUM_LOCKS; i++)
+		rrw_destroy(&rrl->locks[i]);
+}
+
+void
+rrm_enter(rrmlock_t *rrl, krw_t rw, void *tag)
+{
+	if (rw == RW_READER)
+		rrm_enter_read(rrl, tag);
+	else
+		rrm_enter_write(rrl);
+}
+
+/*
+ * Map the current thread to one of the locks.  Only the low 32 bits of the
+ * thread pointer are used; the division is cheaper and the high bits carry
+ * hardly any entropy anyway.
+ */
+#define	RRM_TD_LOCK()	\
+	(((uint32_t)(uintptr_t)(curthread)) % RRM_NUM_LOCKS)
+
+void
+rrm_enter_read(rrmlock_t *rrl, void *tag)
+{
+	rrw_enter_read(&rrl->locks[RRM_TD_LOCK()], tag);
+}
+
+void
+rrm_enter_write(rrmlock_t *rrl)
+{
+	int i;
+
+	for (i = 0; i < RRM_NUM_LOCKS; i++)
+		rrw_enter_write(&rrl->locks[i]);
+}
+
+void
+rrm_exit(rrmlock_t *rrl, void *tag)
+{
+	int i;
+
+	if (rrl->locks[0].rr_writer == curthread) {
+		for (i = 0; i < RRM_NUM_LOCKS; i++)
+			rrw_exit(&rrl->locks[i], tag);
+	} else {
+		rrw_exit(&rrl->locks[RRM_TD_LOCK()], tag);
+	}
+}
+
+boolean_t
+rrm_held(rrmlock_t *rrl, krw_t rw)
+{
+	if (rw == RW_WRITER)
+		return (rrw_held(&rrl->locks[0], rw));
+	else
+		return (rrw_held(&rrl->locks[RRM_TD_LOCK()], rw));
+}
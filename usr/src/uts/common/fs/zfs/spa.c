@@ -66,6 +66,7 @@
 #include <sys/dsl_scan.h>
 #include <sys/zfeature.h>
 #include <sys/dsl_destroy.h>
+#include <sys/spa_log_spacemap.h>
 
 #ifdef	_KERNEL
 #include <sys/bootprops.h>
@@ -148,10 +149,17 @@ uint_t		zio_taskq_batch_pct = 75;	/* 1 thread per cpu in pset */
 id_t		zio_taskq_psrset_bind = PS_NONE;
 boolean_t	zio_taskq_sysdc = B_TRUE;	/* use SDC scheduling class */
 uint_t		zio_taskq_basedc = 80;		/* base duty cycle */
+boolean_t	zio_taskq_percpu = B_TRUE;	/* per-CPU multi-thread taskqs */
 
 boolean_t	spa_create_process = B_TRUE;	/* no process ==> no sysdc */
 extern int	zfs_sync_pass_deferred_free;
 
+/*
+ * With autotrim on, space freed in the pool is trimmed in a background
+ * pass every zfs_trim_txg_batch txgs.
+ */
+int		zfs_trim_txg_batch = 32;
+
 /*
  * This (illegal) pool name is used when temporarily importing a spa_t in order
  * to get the vdev stats associated with the imported devices.
@@ -204,8 +212,10 @@ spa_prop_get_config(spa_t *spa, nvlist_t **nvp)
 	ASSERT(MUTEX_HELD(&spa->spa_props_lock));
 
 	if (rvd != NULL) {
-		alloc = metaslab_class_get_alloc(spa_normal_class(spa));
-		size = metaslab_class_get_space(spa_normal_class(spa));
+		alloc = metaslab_class_get_alloc(spa_normal_class(spa)) +
+		    metaslab_class_get_alloc(spa_special_class(spa));
+		size = metaslab_class_get_space(spa_normal_class(spa)) +
+		    metaslab_class_get_space(spa_special_class(spa));
 		spa_prop_add_list(*nvp, ZPOOL_PROP_NAME, spa_name(spa), 0, src);
 		spa_prop_add_list(*nvp, ZPOOL_PROP_SIZE, NULL, size, src);
 		spa_prop_add_list(*nvp, ZPOOL_PROP_ALLOCATED, NULL, alloc, src);
@@ -451,6 +461,7 @@ spa_prop_validate(spa_t *spa, nvlist_t *props)
 		case ZPOOL_PROP_AUTOREPLACE:
 		case ZPOOL_PROP_LISTSNAPS:
 		case ZPOOL_PROP_AUTOEXPAND:
+		case ZPOOL_PROP_AUTOTRIM:
 			error = nvpair_value_uint64(elem, &intval);
 			if (!error && intval > 1)
 				error = SET_ERROR(EINVAL);
@@ -859,6 +870,13 @@ spa_taskqs_init(spa_t *spa, zio_type_t t, zio_taskq_type_t q)
 		break;
 	}
 
+	/*
+	 * Taskqs with more than one thread never ran zios in order, so they
+	 * may as well spread them over per-CPU lists.
+	 */
+	if (zio_taskq_percpu && (batch || value > 1))
+		flags |= TASKQ_PERCPU;
+
 	for (uint_t i = 0; i < count; i++) {
 		taskq_t *tq;
 
@@ -1031,6 +1049,7 @@ spa_activate(spa_t *spa, int mode)
 
 	spa->spa_normal_class = metaslab_class_create(spa, zfs_metaslab_ops);
 	spa->spa_log_class = metaslab_class_create(spa, zfs_metaslab_ops);
+	spa->spa_special_class = metaslab_class_create(spa, zfs_metaslab_ops);
 
 	/* Try to create a covering process */
 	mutex_enter(&spa->spa_proc_lock);
@@ -1079,6 +1098,11 @@ spa_activate(spa_t *spa, int mode)
 	avl_create(&spa->spa_errlist_last,
 	    spa_error_entry_compare, sizeof (spa_error_entry_t),
 	    offsetof(spa_error_entry_t, se_avl));
+
+	spa->spa_trim_taskq = taskq_create("z_trim", 1, minclsyspri,
+	    1, INT_MAX, 0);
+
+	spa_log_sm_init(spa);
 }
 
 /*
@@ -1095,6 +1119,9 @@ spa_deactivate(spa_t *spa)
 
 	txg_list_destroy(&spa->spa_vdev_txg_list);
 
+	taskq_destroy(spa->spa_trim_taskq);
+	spa->spa_trim_taskq = NULL;
+
 	list_destroy(&spa->spa_config_dirty_list);
 	list_destroy(&spa->spa_state_dirty_list);
 
@@ -1110,6 +1137,9 @@ spa_deactivate(spa_t *spa)
 	metaslab_class_destroy(spa->spa_log_class);
 	spa->spa_log_class = NULL;
 
+	metaslab_class_destroy(spa->spa_special_class);
+	spa->spa_special_class = NULL;
+
 	/*
 	 * If this was part of an import or the open otherwise failed, we may
 	 * still have errors left in the queues.  Empty them just in case.
@@ -1119,6 +1149,8 @@ spa_deactivate(spa_t *spa)
 	avl_destroy(&spa->spa_errlist_scrub);
 	avl_destroy(&spa->spa_errlist_last);
 
+	spa_log_sm_fini(spa);
+
 	spa->spa_state = POOL_STATE_UNINITIALIZED;
 
 	mutex_enter(&spa->spa_proc_lock);
@@ -1217,6 +1249,15 @@ spa_unload(spa_t *spa)
 		spa->spa_sync_on = B_FALSE;
 	}
 
+	/*
+	 * Stop trimming.
+	 */
+	if (spa->spa_trim_taskq != NULL) {
+		spa->spa_trim_stop = B_TRUE;
+		taskq_wait(spa->spa_trim_taskq);
+		spa->spa_trim_stop = B_FALSE;
+	}
+
 	/*
 	 * Wait for any outstanding async I/O to complete.
 	 */
@@ -1235,6 +1276,7 @@ spa_unload(spa_t *spa)
 	if (spa->spa_root_vdev)
 		vdev_free(spa->spa_root_vdev);
 	ASSERT(spa->spa_root_vdev == NULL);
+	spa_log_sm_unload(spa);
 
 	/*
 	 * Close the dsl pool.
@@ -1827,7 +1869,7 @@ static int
 spa_load_verify_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
     const zbookmark_t *zb, const dnode_phys_t *dnp, void *arg)
 {
-	if (!BP_IS_HOLE(bp)) {
+	if (!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp)) {
 		zio_t *rio = arg;
 		size_t size = BP_GET_PSIZE(bp);
 		void *data = zio_data_buf_alloc(size);
@@ -2535,6 +2577,7 @@ spa_load_impl(spa_t *spa, uint64_t pool_guid, nvlist_t *config,
 		spa_prop_find(spa, ZPOOL_PROP_DELEGATION, &spa->spa_delegation);
 		spa_prop_find(spa, ZPOOL_PROP_FAILUREMODE, &spa->spa_failmode);
 		spa_prop_find(spa, ZPOOL_PROP_AUTOEXPAND, &spa->spa_autoexpand);
+		spa_prop_find(spa, ZPOOL_PROP_AUTOTRIM, &spa->spa_autotrim);
 		spa_prop_find(spa, ZPOOL_PROP_DEDUPDITTO,
 		    &spa->spa_dedup_ditto);
 
@@ -2566,6 +2609,13 @@ spa_load_impl(spa_t *spa, uint64_t pool_guid, nvlist_t *config,
 	 */
 	vdev_load(rvd);
 
+	/*
+	 * Replay the log space maps into the metaslabs just loaded.
+	 */
+	error = spa_ld_log_spacemaps(spa);
+	if (error != 0)
+		return (spa_vdev_err(rvd, VDEV_AUX_CORRUPT_DATA, EIO));
+
 	/*
 	 * Propagate the leaf DTLs we just loaded all the way up the tree.
 	 */
@@ -2723,6 +2773,12 @@ spa_load_impl(spa_t *spa, uint64_t pool_guid, nvlist_t *config,
 		dsl_pool_clean_tmp_userrefs(spa->spa_dsl_pool);
 	}
 
+	/*
+	 * Start rebuilding the contents of any persistent L2ARC devices.
+	 */
+	if (state != SPA_LOAD_TRYIMPORT)
+		l2arc_spa_rebuild_start(spa);
+
 	return (0);
 }
 
@@ -3587,6 +3643,7 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	spa->spa_delegation = zpool_prop_default_numeric(ZPOOL_PROP_DELEGATION);
 	spa->spa_failmode = zpool_prop_default_numeric(ZPOOL_PROP_FAILUREMODE);
 	spa->spa_autoexpand = zpool_prop_default_numeric(ZPOOL_PROP_AUTOEXPAND);
+	spa->spa_autotrim = zpool_prop_default_numeric(ZPOOL_PROP_AUTOTRIM);
 
 	if (props != NULL) {
 		spa_configfile_set(spa, props, B_FALSE);
@@ -6052,6 +6109,9 @@ spa_sync_props(void *arg, dmu_tx_t *tx)
 					spa_async_request(spa,
 					    SPA_ASYNC_AUTOEXPAND);
 				break;
+			case ZPOOL_PROP_AUTOTRIM:
+				spa->spa_autotrim = intval;
+				break;
 			case ZPOOL_PROP_DEDUPDITTO:
 				spa->spa_dedup_ditto = intval;
 				break;
@@ -6109,6 +6169,83 @@ spa_sync_upgrades(spa_t *spa, dmu_tx_t *tx)
 	rrw_exit(&dp->dp_config_rwlock, FTAG);
 }
 
+/*
+ * Trim the space freed in each metaslab since the last pass or, if full
+ * is set, all of the pool's free space.  The config lock is only held for
+ * one metaslab at a time, and spa_unload() cuts the pass short by setting
+ * spa_trim_stop.
+ */
+static void
+spa_trim_pass(spa_t *spa, boolean_t full)
+{
+	uint64_t c = 0, m = 0;
+
+	while (!spa->spa_trim_stop) {
+		vdev_t *rvd, *tvd;
+
+		spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+		rvd = spa->spa_root_vdev;
+		if (c >= rvd->vdev_children) {
+			spa_config_exit(spa, SCL_STATE, FTAG);
+			break;
+		}
+
+		tvd = rvd->vdev_child[c];
+		if (tvd->vdev_ms == NULL || m >= tvd->vdev_ms_count ||
+		    !vdev_writeable(tvd)) {
+			spa_config_exit(spa, SCL_STATE, FTAG);
+			c++;
+			m = 0;
+			continue;
+		}
+
+		(void) metaslab_trim(tvd->vdev_ms[m++], full);
+		spa_config_exit(spa, SCL_STATE, FTAG);
+	}
+}
+
+static void
+spa_autotrim_task(void *arg)
+{
+	spa_t *spa = arg;
+
+	spa_trim_pass(spa, B_FALSE);
+
+	mutex_enter(&spa->spa_trim_lock);
+	spa->spa_trim_queued = B_FALSE;
+	mutex_exit(&spa->spa_trim_lock);
+}
+
+static void
+spa_trim_task(void *arg)
+{
+	spa_trim_pass(arg, B_TRUE);
+}
+
+/*
+ * Start trimming all of the pool's free space in the background.
+ */
+void
+spa_trim(spa_t *spa)
+{
+	(void) taskq_dispatch(spa->spa_trim_taskq, spa_trim_task, spa,
+	    TQ_SLEEP);
+}
+
+/*
+ * Start an autotrim pass unless one is already queued or running.
+ */
+static void
+spa_autotrim_dispatch(spa_t *spa)
+{
+	mutex_enter(&spa->spa_trim_lock);
+	if (!spa->spa_trim_queued &&
+	    taskq_dispatch(spa->spa_trim_taskq, spa_autotrim_task, spa,
+	    TQ_NOSLEEP) != 0)
+		spa->spa_trim_queued = B_TRUE;
+	mutex_exit(&spa->spa_trim_lock);
+}
+
 /*
  * Sync the specified transaction group.  New blocks may be dirtied as
  * part of the process, so we iterate until it converges.
@@ -6122,6 +6259,8 @@ spa_sync(spa_t *spa, uint64_t txg)
 	vdev_t *rvd = spa->spa_root_vdev;
 	vdev_t *vd;
 	dmu_tx_t *tx;
+	spa_txg_stat_t *sts = &spa->spa_txg_syncing;
+	hrtime_t t;
 	int error;
 
 	VERIFY(spa_writeable(spa));
@@ -6164,6 +6303,13 @@ spa_sync(spa_t *spa, uint64_t txg)
 	VERIFY(cyclic_reprogram(spa->spa_deadman_cycid,
 	    spa->spa_sync_starttime + spa->spa_deadman_synctime));
 
+	bzero(sts, sizeof (*sts));
+	sts->sts_txg = txg;
+	sts->sts_start = spa->spa_sync_starttime;
+	mutex_enter(&dp->dp_lock);
+	sts->sts_dirty = dp->dp_dirty_pertxg[txg & TXG_MASK];
+	mutex_exit(&dp->dp_lock);
+
 	/*
 	 * If we are upgrading to SPA_VERSION_RAIDZ_DEFLATE this txg,
 	 * set spa_deflate if we have no raid-z vdevs.
@@ -6212,7 +6358,15 @@ spa_sync(spa_t *spa, uint64_t txg)
 		spa_sync_aux_dev(spa, &spa->spa_l2cache, tx,
 		    ZPOOL_CONFIG_L2CACHE, DMU_POOL_L2CACHE);
 		spa_errlog_sync(spa, txg);
+		if (pass == 1)
+			spa_log_sm_sync(spa, tx);
+
+		t = gethrtime();
 		dsl_pool_sync(dp, txg);
+		t = gethrtime() - t;
+		sts->sts_dsl_pool_time += t;
+		DTRACE_PROBE4(spa__sync__dsl__pool, spa_t *, spa,
+		    uint64_t, txg, int, pass, hrtime_t, t);
 
 		if (pass < zfs_sync_pass_deferred_free) {
 			spa_sync_frees(spa, free_bpl, tx);
@@ -6224,13 +6378,19 @@ spa_sync(spa_t *spa, uint64_t txg)
 		ddt_sync(spa, txg);
 		dsl_scan_sync(dp, tx);
 
+		t = gethrtime();
 		while (vd = txg_list_remove(&spa->spa_vdev_txg_list, txg))
 			vdev_sync(vd, txg);
+		t = gethrtime() - t;
+		sts->sts_vdev_time += t;
+		DTRACE_PROBE4(spa__sync__vdev, spa_t *, spa,
+		    uint64_t, txg, int, pass, hrtime_t, t);
 
 		if (pass == 1)
 			spa_sync_upgrades(spa, tx);
 
 	} while (dmu_objset_is_dirty(mos, txg));
+	sts->sts_passes = spa->spa_sync_pass;
 
 	/*
 	 * Rewrite the vdev configuration (which includes the uberblock)
@@ -6241,6 +6401,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 	 * config cache (see spa_vdev_add() for a complete description).
 	 * If there *are* dirty vdevs, sync the uberblock to all vdevs.
 	 */
+	t = gethrtime();
 	for (;;) {
 		/*
 		 * We hold SCL_STATE to prevent vdev open/close/etc.
@@ -6284,6 +6445,9 @@ spa_sync(spa_t *spa, uint64_t txg)
 		zio_suspend(spa, NULL);
 		zio_resume_wait(spa);
 	}
+	sts->sts_uberblock_time = gethrtime() - t;
+	DTRACE_PROBE3(spa__sync__uberblock, spa_t *, spa,
+	    uint64_t, txg, hrtime_t, sts->sts_uberblock_time);
 	dmu_tx_commit(tx);
 
 	VERIFY(cyclic_reprogram(spa->spa_deadman_cycid, CY_INFINITY));
@@ -6328,8 +6492,14 @@ spa_sync(spa_t *spa, uint64_t txg)
 
 	spa_config_exit(spa, SCL_CONFIG, FTAG);
 
+	sts->sts_sync_time = gethrtime() - sts->sts_start;
+	spa_txg_stat_record(spa, sts);
+
 	spa_handle_ignored_writes(spa);
 
+	if (spa->spa_autotrim && txg % zfs_trim_txg_batch == 0)
+		spa_autotrim_dispatch(spa);
+
 	/*
 	 * If any async tasks have been requested, kick them off.
 	 */
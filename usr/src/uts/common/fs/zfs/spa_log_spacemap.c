@@ -0,0 +1,420 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright (c) 2014 by Delphix. All rights reserved.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/dmu.h>
+#include <sys/dmu_tx.h>
+#include <sys/zap.h>
+#include <sys/zfeature.h>
+#include <sys/metaslab_impl.h>
+#include <sys/spa_impl.h>
+#include <sys/vdev_impl.h>
+#include <sys/spa_log_spacemap.h>
+
+/*
+ * Log space maps
+ *
+ * Every metaslab that is changed in a txg normally appends its allocs and
+ * frees to its own space map and rewrites the space map's bonus buffer.
+ * With a random allocation pattern that means a few small, scattered
+ * writes for every one of a large number of metaslabs in each txg, which
+ * on large pools dominates the time spent in spa_sync().
+ *
+ * When the log_spacemap feature is enabled, a metaslab that is synced
+ * instead appends its changes to a log space map shared by all metaslabs
+ * of its top-level vdev for that txg, and keeps them in memory in its
+ * ms_unflushed_allocs and ms_unflushed_frees trees.  Each txg a few of the
+ * metaslabs with the oldest unflushed changes are "flushed": their
+ * unflushed trees are written to their own space maps, which records the
+ * flush txg in the space map's bonus.  Once no metaslab has changes older
+ * than a given log, the log is destroyed.
+ *
+ * On import, the logs are replayed in txg order; entries for a metaslab
+ * whose space map was flushed in or after the log's txg are ignored.
+ *
+ * The logs are listed in the ZAP named by DMU_POOL_LOG_SPACEMAP_ZAP in the
+ * pool directory, keyed by (txg, vdev id).  A log space map covers its
+ * whole vdev, so its entries need no metaslab id.
+ */
+
+/*
+ * Every metaslab with unflushed changes is flushed within roughly this
+ * many txgs, which bounds both the number of log space maps and the
+ * amount of log that has to be replayed on import.
+ */
+uint64_t zfs_log_sm_flush_txgs = 100;
+
+static int
+spa_log_sm_compare(const void *x1, const void *x2)
+{
+	const spa_log_sm_t *s1 = x1;
+	const spa_log_sm_t *s2 = x2;
+
+	if (s1->sls_txg < s2->sls_txg)
+		return (-1);
+	if (s1->sls_txg > s2->sls_txg)
+		return (1);
+	if (s1->sls_vdev < s2->sls_vdev)
+		return (-1);
+	if (s1->sls_vdev > s2->sls_vdev)
+		return (1);
+	return (0);
+}
+
+static int
+spa_unflushed_ms_compare(const void *x1, const void *x2)
+{
+	const metaslab_t *m1 = x1;
+	const metaslab_t *m2 = x2;
+	uint64_t v1 = m1->ms_group->mg_vd->vdev_id;
+	uint64_t v2 = m2->ms_group->mg_vd->vdev_id;
+
+	if (m1->ms_unflushed_txg < m2->ms_unflushed_txg)
+		return (-1);
+	if (m1->ms_unflushed_txg > m2->ms_unflushed_txg)
+		return (1);
+	if (v1 < v2)
+		return (-1);
+	if (v1 > v2)
+		return (1);
+	if (m1->ms_id < m2->ms_id)
+		return (-1);
+	if (m1->ms_id > m2->ms_id)
+		return (1);
+	return (0);
+}
+
+void
+spa_log_sm_init(spa_t *spa)
+{
+	avl_create(&spa->spa_log_sm_tree, spa_log_sm_compare,
+	    sizeof (spa_log_sm_t), offsetof(spa_log_sm_t, sls_node));
+	avl_create(&spa->spa_unflushed_ms, spa_unflushed_ms_compare,
+	    sizeof (metaslab_t), offsetof(metaslab_t, ms_unflushed_node));
+}
+
+void
+spa_log_sm_fini(spa_t *spa)
+{
+	avl_destroy(&spa->spa_log_sm_tree);
+	avl_destroy(&spa->spa_unflushed_ms);
+}
+
+/*
+ * Forget the pool's log space maps.  Called once the vdevs (and so all
+ * metaslabs) have been freed.
+ */
+void
+spa_log_sm_unload(spa_t *spa)
+{
+	spa_log_sm_t *sls;
+	void *cookie = NULL;
+
+	mutex_enter(&spa->spa_log_sm_lock);
+	ASSERT0(avl_numnodes(&spa->spa_unflushed_ms));
+	while ((sls = avl_destroy_nodes(&spa->spa_log_sm_tree,
+	    &cookie)) != NULL)
+		kmem_free(sls, sizeof (spa_log_sm_t));
+	spa->spa_log_sm_zap = 0;
+	mutex_exit(&spa->spa_log_sm_lock);
+}
+
+boolean_t
+spa_log_sm_active(spa_t *spa)
+{
+	return (spa->spa_log_sm_zap != 0);
+}
+
+static void
+spa_log_sm_destroy(spa_t *spa, spa_log_sm_t *sls, dmu_tx_t *tx)
+{
+	objset_t *mos = spa_meta_objset(spa);
+	uint64_t key[2] = { sls->sls_txg, sls->sls_vdev };
+	space_map_t *sm = NULL;
+
+	VERIFY0(space_map_open(&sm, mos, sls->sls_sm_obj, 0, 0,
+	    SPA_MINBLOCKSHIFT, &spa->spa_log_sm_lock));
+	space_map_free(sm, tx);
+	space_map_close(sm);
+
+	VERIFY0(zap_remove_uint64(mos, spa->spa_log_sm_zap, key, 2, tx));
+}
+
+/*
+ * Called in the first sync pass of every txg, before any metaslab is
+ * synced.  Creates the log directory once the feature is enabled,
+ * destroys the logs that no metaslab depends on any more, and picks the
+ * metaslabs to flush in this txg.
+ */
+void
+spa_log_sm_sync(spa_t *spa, dmu_tx_t *tx)
+{
+	objset_t *mos = spa_meta_objset(spa);
+	uint64_t txg = dmu_tx_get_txg(tx);
+	avl_tree_t *t = &spa->spa_unflushed_ms;
+	uint64_t min_txg, nflush;
+	spa_log_sm_t *sls;
+	metaslab_t *msp;
+
+	ASSERT3U(spa_sync_pass(spa), ==, 1);
+
+	if (spa->spa_log_sm_zap == 0) {
+		if (!spa_feature_is_enabled(spa, SPA_FEATURE_LOG_SPACEMAP))
+			return;
+
+		spa->spa_log_sm_zap = zap_create_flags(mos, 0,
+		    ZAP_FLAG_HASH64 | ZAP_FLAG_UINT64_KEY,
+		    DMU_OTN_ZAP_METADATA, 12, 12, DMU_OT_NONE, 0, tx);
+		VERIFY0(zap_add(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_LOG_SPACEMAP_ZAP, sizeof (uint64_t), 1,
+		    &spa->spa_log_sm_zap, tx));
+		spa_feature_incr(spa, SPA_FEATURE_LOG_SPACEMAP, tx);
+		return;
+	}
+
+	/*
+	 * A log is needed as long as some metaslab has unflushed changes
+	 * from its txg or an earlier one.
+	 */
+	mutex_enter(&spa->spa_log_sm_lock);
+	msp = avl_first(t);
+	min_txg = (msp != NULL) ? msp->ms_unflushed_txg : txg;
+	while ((sls = avl_first(&spa->spa_log_sm_tree)) != NULL &&
+	    sls->sls_txg < min_txg) {
+		avl_remove(&spa->spa_log_sm_tree, sls);
+		mutex_exit(&spa->spa_log_sm_lock);
+		spa_log_sm_destroy(spa, sls, tx);
+		kmem_free(sls, sizeof (spa_log_sm_t));
+		mutex_enter(&spa->spa_log_sm_lock);
+	}
+
+	/*
+	 * Flush a share of the unflushed metaslabs, oldest first, so that
+	 * each one is flushed about once every zfs_log_sm_flush_txgs txgs,
+	 * plus any that have already waited longer than that.
+	 */
+	nflush = howmany(avl_numnodes(t), MAX(zfs_log_sm_flush_txgs, 1));
+	for (msp = avl_first(t); msp != NULL; msp = AVL_NEXT(t, msp)) {
+		if (nflush == 0 &&
+		    msp->ms_unflushed_txg + zfs_log_sm_flush_txgs > txg)
+			break;
+		if (nflush != 0)
+			nflush--;
+
+		msp->ms_flush_txg = txg;
+		vdev_dirty(msp->ms_group->mg_vd, VDD_METASLAB, msp, txg);
+	}
+	mutex_exit(&spa->spa_log_sm_lock);
+}
+
+/*
+ * Return the log space map for vd in this txg, creating it on first use.
+ */
+space_map_t *
+spa_log_sm_vdev(vdev_t *vd, dmu_tx_t *tx)
+{
+	spa_t *spa = vd->vdev_spa;
+	objset_t *mos = spa_meta_objset(spa);
+	uint64_t txg = dmu_tx_get_txg(tx);
+	uint64_t key[2], object;
+	spa_log_sm_t *sls;
+
+	ASSERT(spa_log_sm_active(spa));
+	ASSERT(vd == vd->vdev_top);
+
+	if (vd->vdev_log_sm != NULL)
+		return (vd->vdev_log_sm);
+
+	object = space_map_alloc(mos, tx);
+	key[0] = txg;
+	key[1] = vd->vdev_id;
+	VERIFY0(zap_add_uint64(mos, spa->spa_log_sm_zap, key, 2,
+	    sizeof (uint64_t), 1, &object, tx));
+	VERIFY0(space_map_open(&vd->vdev_log_sm, mos, object, 0,
+	    vd->vdev_ms_count << vd->vdev_ms_shift, vd->vdev_ashift,
+	    &spa->spa_log_sm_lock));
+
+	sls = kmem_zalloc(sizeof (spa_log_sm_t), KM_SLEEP);
+	sls->sls_txg = txg;
+	sls->sls_vdev = vd->vdev_id;
+	sls->sls_sm_obj = object;
+
+	mutex_enter(&spa->spa_log_sm_lock);
+	avl_add(&spa->spa_log_sm_tree, sls);
+	mutex_exit(&spa->spa_log_sm_lock);
+
+	return (vd->vdev_log_sm);
+}
+
+/*
+ * Called from vdev_sync_done(); this txg's log for vd is complete.
+ */
+void
+spa_log_sm_vdev_done(vdev_t *vd)
+{
+	space_map_close(vd->vdev_log_sm);
+	vd->vdev_log_sm = NULL;
+}
+
+/*
+ * Record that msp has changes, first logged in txg, that are not yet in
+ * its own space map.
+ */
+void
+spa_log_sm_dirty(spa_t *spa, metaslab_t *msp, uint64_t txg)
+{
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT0(msp->ms_unflushed_txg);
+	ASSERT3U(txg, !=, 0);
+
+	mutex_enter(&spa->spa_log_sm_lock);
+	msp->ms_unflushed_txg = txg;
+	avl_add(&spa->spa_unflushed_ms, msp);
+	mutex_exit(&spa->spa_log_sm_lock);
+}
+
+/*
+ * Record that msp has been flushed (or is going away).
+ */
+void
+spa_log_sm_clean(spa_t *spa, metaslab_t *msp)
+{
+	if (msp->ms_unflushed_txg == 0)
+		return;
+
+	mutex_enter(&spa->spa_log_sm_lock);
+	avl_remove(&spa->spa_unflushed_ms, msp);
+	msp->ms_unflushed_txg = 0;
+	mutex_exit(&spa->spa_log_sm_lock);
+}
+
+typedef struct spa_ld_log_sm_arg {
+	vdev_t		*slla_vd;
+	uint64_t	slla_txg;
+} spa_ld_log_sm_arg_t;
+
+static int
+spa_ld_log_sm_cb(maptype_t type, uint64_t offset, uint64_t size, void *arg)
+{
+	spa_ld_log_sm_arg_t *slla = arg;
+	vdev_t *vd = slla->slla_vd;
+	uint64_t id = offset >> vd->vdev_ms_shift;
+	metaslab_t *msp;
+
+	ASSERT3U(id, <, vd->vdev_ms_count);
+	msp = vd->vdev_ms[id];
+
+	/*
+	 * Changes from this txg and before are already in the metaslab's
+	 * own space map.
+	 */
+	if (slla->slla_txg <= space_map_flushed_txg(msp->ms_sm))
+		return (0);
+
+	metaslab_unflushed_replay(msp, type, offset, size, slla->slla_txg);
+	return (0);
+}
+
+/*
+ * Read the list of log space maps and replay them into the metaslabs'
+ * unflushed trees.  Called once the metaslabs have been loaded.
+ */
+int
+spa_ld_log_spacemaps(spa_t *spa)
+{
+	objset_t *mos = spa->spa_meta_objset;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	spa_log_sm_t *sls;
+	kmutex_t lock;
+	int error;
+
+	error = zap_lookup(mos, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_LOG_SPACEMAP_ZAP, sizeof (uint64_t), 1,
+	    &spa->spa_log_sm_zap);
+	if (error == ENOENT)
+		return (0);
+	if (error != 0)
+		return (error);
+
+	for (zap_cursor_init(&zc, mos, spa->spa_log_sm_zap);
+	    (error = zap_cursor_retrieve(&zc, &za)) == 0;
+	    zap_cursor_advance(&zc)) {
+		uint64_t *key = (uint64_t *)za.za_name;
+
+		sls = kmem_zalloc(sizeof (spa_log_sm_t), KM_SLEEP);
+		sls->sls_txg = key[0];
+		sls->sls_vdev = key[1];
+		sls->sls_sm_obj = za.za_first_integer;
+
+		mutex_enter(&spa->spa_log_sm_lock);
+		avl_add(&spa->spa_log_sm_tree, sls);
+		mutex_exit(&spa->spa_log_sm_lock);
+	}
+	zap_cursor_fini(&zc);
+	if (error != ENOENT)
+		return (error);
+	error = 0;
+
+	/*
+	 * The logs are only read here, before the pool is active, so a
+	 * private lock is enough to satisfy the space map code.
+	 */
+	mutex_init(&lock, NULL, MUTEX_DEFAULT, NULL);
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	for (sls = avl_first(&spa->spa_log_sm_tree); sls != NULL;
+	    sls = AVL_NEXT(&spa->spa_log_sm_tree, sls)) {
+		vdev_t *vd = vdev_lookup_top(spa, sls->sls_vdev);
+		spa_ld_log_sm_arg_t slla;
+		space_map_t *sm = NULL;
+
+		if (vd == NULL || vd->vdev_ishole)
+			continue;
+		if (vd->vdev_ms == NULL) {
+			error = SET_ERROR(EIO);
+			break;
+		}
+
+		error = space_map_open(&sm, mos, sls->sls_sm_obj, 0,
+		    vd->vdev_ms_count << vd->vdev_ms_shift, vd->vdev_ashift,
+		    &lock);
+		if (error != 0)
+			break;
+
+		slla.slla_vd = vd;
+		slla.slla_txg = sls->sls_txg;
+
+		mutex_enter(&lock);
+		space_map_update(sm);
+		error = space_map_iterate(sm, spa_ld_log_sm_cb, &slla);
+		mutex_exit(&lock);
+		space_map_close(sm);
+		if (error != 0)
+			break;
+	}
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+	mutex_destroy(&lock);
+
+	return (error);
+}
@@ -285,6 +285,22 @@ int zfs_deadman_enabled = -1;
  */
 int spa_asize_inflation = 24;
 
+/*
+ * Percentage of the special class kept free for metadata.  Small data
+ * blocks (see the special_small_blocks property) are only placed on the
+ * special class while its allocated space is below the remainder, so
+ * that a busy dataset can't push the pool's metadata back onto the
+ * normal class.
+ */
+int zfs_special_class_metadata_reserve_pct = 25;
+
+/*
+ * Number of synced txgs whose spa_txg_stat_t is kept, per pool, in the
+ * zfs:0:txgs_<pool> kstat.  Read when the pool is added; zero disables
+ * the history.
+ */
+int zfs_txg_history = 32;
+
 /*
  * ==========================================================================
  * SPA config locking
@@ -474,6 +490,114 @@ spa_deadman(void *arg)
 		vdev_deadman(spa->spa_root_vdev);
 }
 
+/*
+ * ==========================================================================
+ * Per-txg sync statistics
+ * ==========================================================================
+ */
+
+static int
+spa_txg_kstat_update(kstat_t *ksp, int rw)
+{
+	spa_t *spa = ksp->ks_private;
+	spa_txg_stat_t *out = ksp->ks_data;
+	int count = spa->spa_txg_stats_count;
+	uint64_t last = 0;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	ASSERT(MUTEX_HELD(&spa->spa_txg_stats_lock));
+
+	/* Copy out oldest first, starting just after the newest record. */
+	for (int i = 0; i < count; i++)
+		last = MAX(last, spa->spa_txg_stats[i].sts_txg);
+	for (int i = 0; i < count; i++)
+		out[i] = spa->spa_txg_stats[(last + 1 + i) % count];
+
+	return (0);
+}
+
+static void
+spa_txg_stats_init(spa_t *spa)
+{
+	int count = zfs_txg_history;
+	kstat_t *ksp;
+	char name[KSTAT_STRLEN];
+
+	mutex_init(&spa->spa_txg_stats_lock, NULL, MUTEX_DEFAULT, NULL);
+	if (count <= 0)
+		return;
+
+	spa->spa_txg_stats_count = count;
+	spa->spa_txg_stats = kmem_zalloc(count * sizeof (spa_txg_stat_t),
+	    KM_SLEEP);
+
+	(void) snprintf(name, sizeof (name), "txgs_%s", spa_name(spa));
+	ksp = kstat_create("zfs", 0, name, "txgs", KSTAT_TYPE_RAW,
+	    count * sizeof (spa_txg_stat_t), 0);
+	if (ksp != NULL) {
+		ksp->ks_lock = &spa->spa_txg_stats_lock;
+		ksp->ks_private = spa;
+		ksp->ks_update = spa_txg_kstat_update;
+		kstat_install(ksp);
+	}
+	spa->spa_txg_ksp = ksp;
+}
+
+static void
+spa_txg_stats_fini(spa_t *spa)
+{
+	if (spa->spa_txg_ksp != NULL) {
+		kstat_delete(spa->spa_txg_ksp);
+		spa->spa_txg_ksp = NULL;
+	}
+	if (spa->spa_txg_stats != NULL) {
+		kmem_free(spa->spa_txg_stats,
+		    spa->spa_txg_stats_count * sizeof (spa_txg_stat_t));
+		spa->spa_txg_stats = NULL;
+		spa->spa_txg_stats_count = 0;
+	}
+	mutex_destroy(&spa->spa_txg_stats_lock);
+}
+
+/*
+ * Called by spa_sync() once a txg is on disk.  The delay totals are
+ * claimed from the per-open-txg accumulators here; they are approximate,
+ * since a delayed tx is charged to the txg that was open when it started
+ * waiting.
+ */
+void
+spa_txg_stat_record(spa_t *spa, const spa_txg_stat_t *sts)
+{
+	int t = sts->sts_txg & TXG_MASK;
+	spa_txg_stat_t rec = *sts;
+
+	rec.sts_delayed = atomic_swap_64(&spa->spa_txg_delayed[t], 0);
+	rec.sts_delay_time = atomic_swap_64(&spa->spa_txg_delay_time[t], 0);
+
+	DTRACE_PROBE2(spa__txg__stat, spa_t *, spa, spa_txg_stat_t *, &rec);
+
+	if (spa->spa_txg_stats_count == 0)
+		return;
+
+	mutex_enter(&spa->spa_txg_stats_lock);
+	spa->spa_txg_stats[rec.sts_txg % spa->spa_txg_stats_count] = rec;
+	mutex_exit(&spa->spa_txg_stats_lock);
+}
+
+/*
+ * Charge a write throttle delay to the given open txg.
+ */
+void
+spa_txg_stat_delay(spa_t *spa, uint64_t txg, hrtime_t delay)
+{
+	int t = txg & TXG_MASK;
+
+	atomic_inc_64(&spa->spa_txg_delayed[t]);
+	atomic_add_64(&spa->spa_txg_delay_time[t], delay);
+}
+
 /*
  * Create an uninitialized spa_t with the given name.  Requires
  * spa_namespace_lock.  The caller must ensure that the spa_t doesn't already
@@ -501,6 +625,8 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 	mutex_init(&spa->spa_suspend_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_vdev_top_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_iokstat_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&spa->spa_log_sm_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&spa->spa_trim_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	cv_init(&spa->spa_async_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&spa->spa_proc_cv, NULL, CV_DEFAULT, NULL);
@@ -586,6 +712,8 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 		kstat_install(spa->spa_iokstat);
 	}
 
+	spa_txg_stats_init(spa);
+
 	spa->spa_debug = ((zfs_flags & ZFS_DEBUG_SPA) != 0);
 
 	/*
@@ -649,6 +777,8 @@ spa_remove(spa_t *spa)
 	kstat_delete(spa->spa_iokstat);
 	spa->spa_iokstat = NULL;
 
+	spa_txg_stats_fini(spa);
+
 	for (int t = 0; t < TXG_SIZE; t++)
 		bplist_destroy(&spa->spa_free_bplist[t]);
 
@@ -667,6 +797,8 @@ spa_remove(spa_t *spa)
 	mutex_destroy(&spa->spa_suspend_lock);
 	mutex_destroy(&spa->spa_vdev_top_lock);
 	mutex_destroy(&spa->spa_iokstat_lock);
+	mutex_destroy(&spa->spa_log_sm_lock);
+	mutex_destroy(&spa->spa_trim_lock);
 
 	kmem_free(spa, sizeof (spa_t));
 }
@@ -1024,6 +1156,7 @@ spa_vdev_config_exit(spa_t *spa, vdev_t *vd, uint64_t txg, int error, char *tag)
 	 */
 	ASSERT(metaslab_class_validate(spa_normal_class(spa)) == 0);
 	ASSERT(metaslab_class_validate(spa_log_class(spa)) == 0);
+	ASSERT(metaslab_class_validate(spa_special_class(spa)) == 0);
 
 	spa_config_exit(spa, SCL_ALL, spa);
 
@@ -1554,6 +1687,7 @@ void
 spa_update_dspace(spa_t *spa)
 {
 	spa->spa_dspace = metaslab_class_get_dspace(spa_normal_class(spa)) +
+	    metaslab_class_get_dspace(spa_special_class(spa)) +
 	    ddt_get_dedup_dspace(spa);
 }
 
@@ -1597,6 +1731,44 @@ spa_log_class(spa_t *spa)
 	return (spa->spa_log_class);
 }
 
+metaslab_class_t *
+spa_special_class(spa_t *spa)
+{
+	return (spa->spa_special_class);
+}
+
+/*
+ * Return the class a block with the given properties should be allocated
+ * from first.  Metadata (indirect blocks, dnodes, DDT and other ZAPs)
+ * goes to the special class when the pool has one; so do data blocks no
+ * larger than the dataset's special_small_blocks threshold, as long as
+ * the metadata reserve is untouched.  The caller falls back to the
+ * normal class if the special class can't satisfy the allocation.
+ */
+metaslab_class_t *
+spa_preferred_class(spa_t *spa, uint64_t size, dmu_object_type_t objtype,
+    uint_t level, uint_t special_smallblk)
+{
+	metaslab_class_t *special = spa_special_class(spa);
+	uint64_t space, limit;
+
+	if (!spa_has_special(spa))
+		return (spa_normal_class(spa));
+
+	if (level > 0 || DMU_OT_IS_METADATA(objtype))
+		return (special);
+
+	if (size > special_smallblk)
+		return (spa_normal_class(spa));
+
+	space = metaslab_class_get_space(special);
+	limit = space - space * zfs_special_class_metadata_reserve_pct / 100;
+	if (metaslab_class_get_alloc(special) >= limit)
+		return (spa_normal_class(spa));
+
+	return (special);
+}
+
 int
 spa_max_replication(spa_t *spa)
 {
@@ -1734,6 +1906,8 @@ spa_init(int mode)
 	unique_init();
 	range_tree_init();
 	zio_init();
+	zio_checksum_init();
+	zio_compress_init();
 	dmu_init();
 	zil_init();
 	vdev_cache_stat_init();
@@ -1754,6 +1928,8 @@ spa_fini(void)
 	vdev_cache_stat_fini();
 	zil_fini();
 	dmu_fini();
+	zio_compress_fini();
+	zio_checksum_fini();
 	zio_fini();
 	range_tree_fini();
 	unique_fini();
@@ -1780,6 +1956,17 @@ spa_has_slogs(spa_t *spa)
 	return (spa->spa_log_class->mc_rotor != NULL);
 }
 
+/*
+ * Return whether this pool has special class vdevs.  Like
+ * spa_has_slogs() this is only used for placement, so no locking
+ * is needed.
+ */
+boolean_t
+spa_has_special(spa_t *spa)
+{
+	return (spa->spa_special_class->mc_rotor != NULL);
+}
+
 spa_log_state_t
 spa_get_log_state(spa_t *spa)
 {
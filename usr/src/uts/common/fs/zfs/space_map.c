@@ -49,30 +49,24 @@
 int space_map_max_blksz = (1 << 12);
 
 /*
- * Load the space map disk into the specified range tree. Segments of maptype
- * are added to the range tree, other segment types are removed.
+ * Call the callback for every alloc and free record in the space map, in
+ * the order in which they were written.  Debug entries are skipped.  If
+ * the callback returns non-zero the iteration stops and that value is
+ * returned.
  *
- * Note: space_map_load() will drop sm_lock across dmu_read() calls.
+ * Note: space_map_iterate() will drop sm_lock across dmu_read() calls.
  * The caller must be OK with this.
  */
 int
-space_map_load(space_map_t *sm, range_tree_t *rt, maptype_t maptype)
+space_map_iterate(space_map_t *sm, sm_cb_t *callback, void *arg)
 {
 	uint64_t *entry, *entry_map, *entry_map_end;
-	uint64_t bufsize, size, offset, end, space;
+	uint64_t bufsize, size, offset, end;
 	int error = 0;
 
 	ASSERT(MUTEX_HELD(sm->sm_lock));
 
 	end = space_map_length(sm);
-	space = space_map_allocated(sm);
-
-	VERIFY0(range_tree_space(rt));
-
-	if (maptype == SM_FREE) {
-		range_tree_add(rt, sm->sm_start, sm->sm_size);
-		space = sm->sm_size - space;
-	}
 
 	bufsize = MAX(sm->sm_blksz, SPA_MINBLOCKSIZE);
 	entry_map = zio_buf_alloc(bufsize);
@@ -84,7 +78,7 @@ space_map_load(space_map_t *sm, range_tree_t *rt, maptype_t maptype)
 	}
 	mutex_enter(sm->sm_lock);
 
-	for (offset = 0; offset < end; offset += bufsize) {
+	for (offset = 0; offset < end && error == 0; offset += bufsize) {
 		size = MIN(end - offset, bufsize);
 		VERIFY(P2PHASE(size, sizeof (uint64_t)) == 0);
 		VERIFY(size != 0);
@@ -116,22 +110,74 @@ space_map_load(space_map_t *sm, range_tree_t *rt, maptype_t maptype)
 			VERIFY0(P2PHASE(size, 1ULL << sm->sm_shift));
 			VERIFY3U(offset, >=, sm->sm_start);
 			VERIFY3U(offset + size, <=, sm->sm_start + sm->sm_size);
-			if (SM_TYPE_DECODE(e) == maptype) {
-				VERIFY3U(range_tree_space(rt) + size, <=,
-				    sm->sm_size);
-				range_tree_add(rt, offset, size);
-			} else {
-				range_tree_remove(rt, offset, size);
-			}
+			error = callback(SM_TYPE_DECODE(e), offset, size, arg);
+			if (error != 0)
+				break;
 		}
 	}
 
+	zio_buf_free(entry_map, bufsize);
+	return (error);
+}
+
+typedef struct space_map_load_arg {
+	space_map_t	*smla_sm;
+	range_tree_t	*smla_rt;
+	maptype_t	smla_type;
+} space_map_load_arg_t;
+
+static int
+space_map_load_callback(maptype_t type, uint64_t offset, uint64_t size,
+    void *arg)
+{
+	space_map_load_arg_t *smla = arg;
+
+	if (type == smla->smla_type) {
+		VERIFY3U(range_tree_space(smla->smla_rt) + size, <=,
+		    smla->smla_sm->sm_size);
+		range_tree_add(smla->smla_rt, offset, size);
+	} else {
+		range_tree_remove(smla->smla_rt, offset, size);
+	}
+
+	return (0);
+}
+
+/*
+ * Load the space map disk into the specified range tree. Segments of maptype
+ * are added to the range tree, other segment types are removed.
+ *
+ * Note: space_map_load() will drop sm_lock across dmu_read() calls.
+ * The caller must be OK with this.
+ */
+int
+space_map_load(space_map_t *sm, range_tree_t *rt, maptype_t maptype)
+{
+	space_map_load_arg_t smla;
+	uint64_t space;
+	int error;
+
+	ASSERT(MUTEX_HELD(sm->sm_lock));
+
+	space = space_map_allocated(sm);
+
+	VERIFY0(range_tree_space(rt));
+
+	if (maptype == SM_FREE) {
+		range_tree_add(rt, sm->sm_start, sm->sm_size);
+		space = sm->sm_size - space;
+	}
+
+	smla.smla_sm = sm;
+	smla.smla_rt = rt;
+	smla.smla_type = maptype;
+	error = space_map_iterate(sm, space_map_load_callback, &smla);
+
 	if (error == 0)
 		VERIFY3U(range_tree_space(rt), ==, space);
 	else
 		range_tree_vacate(rt, NULL, NULL);
 
-	zio_buf_free(entry_map, bufsize);
 	return (error);
 }
 
@@ -504,6 +550,33 @@ space_map_truncate(space_map_t *sm, dmu_tx_t *tx)
 	sm->sm_phys->smp_alloc = 0;
 }
 
+/*
+ * Return the last txg whose changes have all been written to this space
+ * map rather than to the pool's log space maps.  Space maps created
+ * without room for it in the bonus buffer never defer their changes.
+ */
+uint64_t
+space_map_flushed_txg(space_map_t *sm)
+{
+	if (sm == NULL || sm->sm_dbuf->db_size != sizeof (space_map_phys_t))
+		return (0);
+
+	return (sm->sm_phys->smp_flushed_txg);
+}
+
+void
+space_map_set_flushed_txg(space_map_t *sm, uint64_t txg, dmu_tx_t *tx)
+{
+	ASSERT(dmu_tx_is_syncing(tx));
+	VERIFY3U(space_map_object(sm), !=, 0);
+
+	if (sm->sm_dbuf->db_size != sizeof (space_map_phys_t))
+		return;
+
+	dmu_buf_will_dirty(sm->sm_dbuf, tx);
+	sm->sm_phys->smp_flushed_txg = txg;
+}
+
 /*
  * Update the in-core space_map allocation and length values.
  */
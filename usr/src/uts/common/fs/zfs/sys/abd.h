@@ -0,0 +1,118 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright (c) 2014 by Delphix. All rights reserved.
+ */
+
+#ifndef	_SYS_ABD_H
+#define	_SYS_ABD_H
+
+#include <sys/zfs_context.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef enum abd_flags {
+	ABD_FLAG_LINEAR	= 1 << 0,	/* is buffer linear (or scattered)? */
+	ABD_FLAG_OWNER	= 1 << 1,	/* does it own its data buffers? */
+	ABD_FLAG_META	= 1 << 2	/* does this represent FS metadata? */
+} abd_flags_t;
+
+/*
+ * An ABD ("ARC buffer data") describes a buffer that is either a single
+ * linear piece of memory or a list of fixed-size chunks.  Chunks come
+ * from one kmem cache, so a large block never needs a large contiguous
+ * allocation.  Consumers must not assume linearity; use abd_to_buf() only
+ * on ABDs known to be linear, and abd_borrow_buf() everywhere else.
+ */
+typedef struct abd {
+	abd_flags_t	abd_flags;
+	uint_t		abd_size;	/* bytes of data described */
+	union {
+		struct abd_scatter {
+			uint_t	abd_chunk_size;
+			void	*abd_chunks[1];	/* actually variable-length */
+		} abd_scatter;
+		struct abd_linear {
+			void	*abd_buf;
+		} abd_linear;
+	} abd_u;
+} abd_t;
+
+typedef int abd_iter_func_t(void *, size_t, void *);
+
+extern boolean_t zfs_abd_scatter_enabled;
+
+#define	ABD_IS_LINEAR(abd)	(((abd)->abd_flags & ABD_FLAG_LINEAR) != 0)
+
+/*
+ * Allocations and deallocations
+ */
+
+abd_t *abd_alloc(size_t, boolean_t);
+abd_t *abd_alloc_linear(size_t, boolean_t);
+void abd_free(abd_t *);
+abd_t *abd_get_from_buf(void *, size_t);
+void abd_put(abd_t *);
+
+/*
+ * Conversion to and from a normal buffer
+ */
+
+void *abd_to_buf(abd_t *);
+void *abd_borrow_buf(abd_t *, size_t);
+void *abd_borrow_buf_copy(abd_t *, size_t);
+void abd_return_buf(abd_t *, void *, size_t);
+void abd_return_buf_copy(abd_t *, void *, size_t);
+
+/*
+ * ABD operations
+ */
+
+int abd_iterate_func(abd_t *, size_t, size_t, abd_iter_func_t *, void *);
+void abd_copy_to_buf_off(void *, abd_t *, size_t, size_t);
+void abd_copy_from_buf_off(abd_t *, const void *, size_t, size_t);
+void abd_zero_off(abd_t *, size_t, size_t);
+
+/*
+ * Wrappers for calls with offsets of 0
+ */
+
+#define	abd_copy_to_buf(buf, abd, size)		\
+	abd_copy_to_buf_off(buf, abd, 0, size)
+#define	abd_copy_from_buf(abd, buf, size)	\
+	abd_copy_from_buf_off(abd, buf, 0, size)
+#define	abd_zero(abd, size)			\
+	abd_zero_off(abd, 0, size)
+
+/*
+ * Module lifecycle
+ */
+
+void abd_init(void);
+void abd_fini(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_ABD_H */
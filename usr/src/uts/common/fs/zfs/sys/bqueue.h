@@ -0,0 +1,66 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright (c) 2014 by Delphix. All rights reserved.
+ */
+
+
+#ifndef	_SYS_BQUEUE_H
+#define	_SYS_BQUEUE_H
+
+#include <sys/zfs_context.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A bounded FIFO queue between one producer and one consumer thread.  Each
+ * item is charged a caller-supplied size; bqueue_enqueue() blocks while the
+ * queue holds bq_maxsize worth of items, and bqueue_dequeue() blocks while
+ * it is empty.  Items embed a bqueue_node_t at bq_node_offset.
+ */
+typedef struct bqueue {
+	list_t		bq_list;
+	kmutex_t	bq_lock;
+	kcondvar_t	bq_add_cv;
+	kcondvar_t	bq_pop_cv;
+	uint64_t	bq_size;
+	uint64_t	bq_maxsize;
+	size_t		bq_node_offset;
+} bqueue_t;
+
+typedef struct bqueue_node {
+	list_node_t	bqn_node;
+	uint64_t	bqn_size;
+} bqueue_node_t;
+
+extern void bqueue_init(bqueue_t *q, uint64_t size, size_t node_offset);
+extern void bqueue_destroy(bqueue_t *q);
+extern void bqueue_enqueue(bqueue_t *q, void *data, uint64_t item_size);
+extern void *bqueue_dequeue(bqueue_t *q);
+extern boolean_t bqueue_empty(bqueue_t *q);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_BQUEUE_H */
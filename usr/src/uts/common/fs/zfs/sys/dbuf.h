@@ -136,6 +136,16 @@ typedef struct dbuf_dirty_record {
 			override_states_t dr_override_state;
 			uint8_t dr_copies;
 			boolean_t dr_nopwrite;
+
+			/*
+			 * dr_cdata is a compressed copy of dr_data, as
+			 * received in a compressed send stream, to be
+			 * written in place of compressing dr_data again.
+			 * It is dropped if the buffer is modified again.
+			 */
+			void *dr_cdata;
+			uint64_t dr_csize;
+			enum zio_compress dr_compress;
 		} dl;
 	} dt;
 } dbuf_dirty_record_t;
@@ -219,6 +229,12 @@ typedef struct dmu_buf_impl {
 	 */
 	list_node_t db_link;
 
+	/*
+	 * Our link on the dbuf cache's LRU list while we have no holds.
+	 * Protected by both db_mtx and dbuf_cache_mtx.
+	 */
+	list_node_t db_cache_link;
+
 	/* Data which is unique to data (leaf) blocks: */
 
 	/* stuff we store for the user (see dmu_buf_set_user) */
@@ -257,7 +273,8 @@ dmu_buf_impl_t *dbuf_hold_level(struct dnode *dn, int level, uint64_t blkid,
 int dbuf_hold_impl(struct dnode *dn, uint8_t level, uint64_t blkid, int create,
     void *tag, dmu_buf_impl_t **dbp);
 
-void dbuf_prefetch(struct dnode *dn, uint64_t blkid, zio_priority_t prio);
+void dbuf_prefetch(struct dnode *dn, int level, uint64_t blkid,
+    zio_priority_t prio);
 
 void dbuf_add_ref(dmu_buf_impl_t *db, void *tag);
 uint64_t dbuf_refcount(dmu_buf_impl_t *db);
@@ -272,6 +289,8 @@ void dmu_buf_will_not_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_fill_done(dmu_buf_t *db, dmu_tx_t *tx);
 void dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx);
+void dbuf_set_precompressed(dmu_buf_impl_t *db, enum zio_compress compress,
+    const void *cbuf, uint64_t psize, dmu_tx_t *tx);
 dbuf_dirty_record_t *dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
 arc_buf_t *dbuf_loan_arcbuf(dmu_buf_impl_t *db);
 
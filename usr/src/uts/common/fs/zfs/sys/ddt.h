@@ -117,6 +117,27 @@ struct ddt_entry {
 	avl_node_t	dde_node;
 };
 
+/*
+ * In-core bloom filter over the keys of a DDT's on-disk entries.  dbf_nbits
+ * is a power of two; dbf_capacity is the number of keys it was sized for.
+ */
+typedef struct ddt_bloom {
+	uint64_t	*dbf_bits;
+	uint64_t	dbf_nbits;
+	uint64_t	dbf_capacity;
+	uint64_t	dbf_count;
+} ddt_bloom_t;
+
+/*
+ * In-core and on-disk bookmark for DDT walks
+ */
+typedef struct ddt_bookmark {
+	uint64_t	ddb_class;
+	uint64_t	ddb_type;
+	uint64_t	ddb_checksum;
+	uint64_t	ddb_cursor;
+} ddt_bookmark_t;
+
 /*
  * In-core ddt
  */
@@ -133,18 +154,14 @@ struct ddt {
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
 	ddt_object_t	ddt_object_stats[DDT_TYPES][DDT_CLASSES];
 	avl_node_t	ddt_node;
+	ddt_bloom_t	*ddt_bloom;		/* filter over on-disk keys */
+	boolean_t	ddt_bloom_ready;	/* filter holds every key */
+	ddt_bookmark_t	ddt_bloom_ddb;		/* filter build position */
+	uint64_t	ddt_bloom_unique;	/* lookups answered by filter */
+	uint64_t	ddt_prune_cursor;	/* unique class prune cursor */
+	uint64_t	ddt_pruned;		/* unique entries pruned */
 };
 
-/*
- * In-core and on-disk bookmark for DDT walks
- */
-typedef struct ddt_bookmark {
-	uint64_t	ddb_class;
-	uint64_t	ddb_type;
-	uint64_t	ddb_checksum;
-	uint64_t	ddb_cursor;
-} ddt_bookmark_t;
-
 /*
  * Ops vector to access a specific DDT object type.
  */
@@ -217,6 +234,7 @@ extern ddt_t *ddt_select(spa_t *spa, const blkptr_t *bp);
 extern void ddt_enter(ddt_t *ddt);
 extern void ddt_exit(ddt_t *ddt);
 extern ddt_entry_t *ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add);
+extern ddt_entry_t *ddt_lookup_write(ddt_t *ddt, const blkptr_t *bp);
 extern void ddt_prefetch(spa_t *spa, const blkptr_t *bp);
 extern void ddt_remove(ddt_t *ddt, ddt_entry_t *dde);
 
@@ -53,7 +53,7 @@ extern "C" {
  *
  * XXX try to improve evicting path?
  *
- * dp_config_rwlock > os_obj_lock > dn_struct_rwlock >
+ * dp_config_rwlock > ooc_lock > os_obj_lock > dn_struct_rwlock >
  * 	dn_dbufs_mtx > hash_mutexes > db_mtx > dd_lock > leafs
  *
  * dp_config_rwlock
@@ -67,16 +67,24 @@ extern "C" {
  *    	dsl_dir_rename_sync/w:
  *    	dsl_prop_changed_notify/r:
  *
- * os_obj_lock
+ * ooc_lock (per-CPU, in os_obj_cpu)
  *   must be held before:
  *   	everything except dp_config_rwlock
- *   protects os_obj_next
+ *   protects ooc_next, and the dnode slots of the CPU's chunk
+ *   held from:
+ *   	dmu_object_alloc: os_obj_lock, dn_dbufs_mtx, db_mtx, hash_mutexes,
+ *   	    dn_struct_rwlock
+ *
+ * os_obj_lock
+ *   must be held before:
+ *   	everything except dp_config_rwlock and ooc_lock
+ *   protects os_obj_next, os_obj_chunk, ooc_end
  *   held from:
  *   	dmu_object_alloc: dn_dbufs_mtx, db_mtx, hash_mutexes, dn_struct_rwlock
  *
  * dn_struct_rwlock
  *   must be held before:
- *   	everything except dp_config_rwlock and os_obj_lock
+ *   	everything except dp_config_rwlock, ooc_lock and os_obj_lock
  *   protects structure of dnode (eg. nlevels)
  *   	db_blkptr can change when syncing out change to nlevels
  *   	dn_maxblkid
@@ -294,6 +302,7 @@ typedef struct dmu_sendarg {
 	int dsa_err;
 	dmu_pendop_t dsa_pending_op;
 	boolean_t dsa_incremental;
+	boolean_t dsa_compressok;	/* send blocks as they are on disk */
 	uint64_t dsa_last_data_object;
 	uint64_t dsa_last_data_offset;
 } dmu_sendarg_t;
@@ -67,12 +67,25 @@ typedef struct objset_phys {
 	dnode_phys_t os_groupused_dnode;
 } objset_phys_t;
 
+/*
+ * Object numbers are handed out to each CPU in chunks of whole dnode
+ * blocks, so concurrent dmu_object_alloc() calls on different CPUs
+ * neither contend on os_obj_lock nor examine the same dnode block.
+ */
+typedef struct os_obj_cpu {
+	kmutex_t	ooc_lock;	/* serializes allocs from this chunk */
+	uint64_t	ooc_next;	/* next object number to try */
+	uint64_t	ooc_end;	/* end of chunk, set under os_obj_lock */
+	char		ooc_pad[40];	/* pad to a cache line */
+} os_obj_cpu_t;
+
 struct objset {
 	/* Immutable: */
 	struct dsl_dataset *os_dsl_dataset;
 	spa_t *os_spa;
 	arc_buf_t *os_phys_buf;
 	objset_phys_t *os_phys;
+	arc_objset_t *os_arc;		/* per-objset ARC accounting */
 	/*
 	 * The following "special" dnodes have no parent and are exempt from
 	 * dnode_move(), but they root their descendents in this objset using
@@ -95,6 +108,8 @@ struct objset {
 	zfs_cache_type_t os_secondary_cache;
 	zfs_sync_type_t os_sync;
 	zfs_redundant_metadata_type_t os_redundant_metadata;
+	uint64_t os_special_smallblk;
+	uint64_t os_dnodesize; /* default dnode size for new objects */
 
 	/* no lock needed: */
 	struct dmu_tx *os_synctx; /* XXX sketchy */
@@ -105,7 +120,12 @@ struct objset {
 
 	/* Protected by os_obj_lock */
 	kmutex_t os_obj_lock;
-	uint64_t os_obj_next;
+	uint64_t os_obj_next;		/* next chunk to hand out */
+	uint64_t os_obj_chunk;		/* object numbers per chunk */
+
+	/* no lock needed: */
+	int os_obj_ncpus;
+	os_obj_cpu_t *os_obj_cpu;	/* per-CPU allocation chunks */
 
 	/* Protected by os_lock */
 	kmutex_t os_lock;
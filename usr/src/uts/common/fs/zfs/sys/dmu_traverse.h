@@ -59,6 +59,8 @@ int traverse_dataset_destroyed(spa_t *spa, blkptr_t *blkptr,
     blkptr_cb_t func, void *arg);
 int traverse_pool(spa_t *spa,
     uint64_t txg_start, int flags, blkptr_cb_t func, void *arg);
+int traverse_pool_mt(spa_t *spa, uint64_t txg_start, int flags,
+    blkptr_cb_t func, void **args, int nthreads);
 
 #ifdef	__cplusplus
 }
@@ -48,6 +48,9 @@ typedef struct zstream {
 	uint64_t	zst_stride;	/* length of stride, in blocks */
 	uint64_t	zst_ph_offset;	/* prefetch offset, in blocks */
 	uint64_t	zst_cap;	/* prefetch limit (cap), in blocks */
+	uint64_t	zst_ind_blkid;	/* last indirect block prefetched */
+	uint64_t	zst_hits;	/* reads found already prefetched */
+	uint64_t	zst_misses;	/* reads the prefetch did not cover */
 	kmutex_t	zst_lock;	/* protects stream */
 	clock_t		zst_last;	/* lbolt of last prefetch */
 	avl_node_t	zst_node;	/* embed avl node here */
@@ -55,12 +55,20 @@ extern uint64_t zfs_dirty_data_sync;
 extern int zfs_dirty_data_max_percent;
 extern int zfs_delay_min_dirty_percent;
 extern uint64_t zfs_delay_scale;
+extern int zfs_zone_throttle;
 
 /* These macros are for indexing into the zfs_all_blkstats_t. */
 #define	DMU_OT_DEFERRED	DMU_OT_NONE
 #define	DMU_OT_OTHER	DMU_OT_NUMTYPES /* place holder for DMU_OT() types */
 #define	DMU_OT_TOTAL	(DMU_OT_NUMTYPES + 1)
 
+/*
+ * Number of slots in the per-txg table of dirty data by zone.  Zones are
+ * hashed into it by zone ID; zones that share a slot are counted together.
+ */
+#define	DP_ZONE_DIRTY_SLOTS	64
+#define	DP_ZONE_DIRTY_SLOT(zoneid)	((zoneid) % DP_ZONE_DIRTY_SLOTS)
+
 typedef struct zfs_blkstat {
 	uint64_t	zb_count;
 	uint64_t	zb_asize;
@@ -102,6 +110,8 @@ typedef struct dsl_pool {
 	kcondvar_t dp_spaceavail_cv;
 	uint64_t dp_dirty_pertxg[TXG_SIZE];
 	uint64_t dp_dirty_total;
+	uint64_t dp_long_free_dirty_pertxg[TXG_SIZE];
+	uint64_t dp_zone_dirty[TXG_SIZE][DP_ZONE_DIRTY_SLOTS];
 	uint64_t dp_mos_used_delta;
 	uint64_t dp_mos_compressed_delta;
 	uint64_t dp_mos_uncompressed_delta;
@@ -96,6 +96,11 @@ typedef enum dsl_scan_flags {
  *			the scan but have not yet been processed (i.e deferred
  *			frees) are accounted for.
  *
+ * scn_queues -		while a scrub or resilver traverses the pool in a
+ *			txg, the I/O it finds is sorted by offset into one
+ *			queue per top-level vdev and issued when the
+ *			traversal stops for that txg (see dsl_scan.c).
+ *
  * This structure also maintains information about deferred frees which are
  * a special kind of traversal. Deferred free can exist in either a bptree or
  * a bpobj structure. The scn_is_bptree flag will indicate the type of
@@ -118,6 +123,11 @@ typedef struct dsl_scan {
 	/* for debugging / information */
 	uint64_t scn_visited_this_txg;
 
+	/* sorted scrub/resilver I/O queued this txg, one per top-level vdev */
+	struct dsl_scan_io_queue *scn_queues;
+	uint64_t scn_nqueues;
+	uint64_t scn_bytes_pending;
+
 	dsl_scan_phys_t scn_phys;
 } dsl_scan_t;
 
@@ -54,7 +54,10 @@ void metaslab_unload(metaslab_t *msp);
 void metaslab_sync(metaslab_t *msp, uint64_t txg);
 void metaslab_sync_done(metaslab_t *msp, uint64_t txg);
 void metaslab_sync_reassess(metaslab_group_t *mg);
+void metaslab_unflushed_replay(metaslab_t *msp, maptype_t type,
+    uint64_t offset, uint64_t size, uint64_t txg);
 uint64_t metaslab_block_maxsize(metaslab_t *msp);
+uint64_t metaslab_trim(metaslab_t *msp, boolean_t full);
 
 #define	METASLAB_HINTBP_FAVOR	0x0
 #define	METASLAB_HINTBP_AVOID	0x1
@@ -41,11 +41,26 @@
 extern "C" {
 #endif
 
+/*
+ * Allocations are spread over several allocators, picked by CPU, so that
+ * concurrent allocating threads neither share a rotor position in the
+ * class nor contend for the same primary metaslab within a group.  Each
+ * allocator has its own rotor and aliquot; mc_rotor only anchors the ring
+ * of groups.
+ */
+#define	METASLAB_MAX_ALLOCATORS	8
+
+typedef struct metaslab_class_allocator {
+	metaslab_group_t	*mca_rotor;
+	uint64_t		mca_aliquot;
+} metaslab_class_allocator_t;
+
 struct metaslab_class {
 	spa_t			*mc_spa;
 	metaslab_group_t	*mc_rotor;
 	metaslab_ops_t		*mc_ops;
-	uint64_t		mc_aliquot;
+	int			mc_allocators;
+	metaslab_class_allocator_t mc_allocator[METASLAB_MAX_ALLOCATORS];
 	uint64_t		mc_alloc_groups; /* # of allocatable groups */
 	uint64_t		mc_alloc;	/* total allocated space */
 	uint64_t		mc_deferred;	/* total deferred frees */
@@ -64,6 +79,7 @@ struct metaslab_group {
 	metaslab_class_t	*mg_class;
 	vdev_t			*mg_vd;
 	taskq_t			*mg_taskq;
+	metaslab_t		*mg_primaries[METASLAB_MAX_ALLOCATORS];
 	metaslab_group_t	*mg_prev;
 	metaslab_group_t	*mg_next;
 };
@@ -125,6 +141,27 @@ struct metaslab_group {
  * representation, we rewrite it in its minimized form. If a metaslab
  * needs to condense then we must set the ms_condensing flag to ensure
  * that allocations are not performed on the metaslab that is being written.
+ *
+ * When the log_spacemap feature is active, a txg's allocs and frees are not
+ * written to each dirty metaslab's space map.  They are appended to one log
+ * space map per top-level vdev for that txg, and folded into the metaslab's
+ * ms_unflushed_allocs and ms_unflushed_frees trees, which describe how the
+ * metaslab differs from its own space map.  Every txg a few of the
+ * metaslabs with the oldest unflushed changes are flushed: both trees are
+ * written to the metaslab's space map, whose smp_flushed_txg then records
+ * which log entries no longer apply to it.  Pool import replays the log
+ * space maps to rebuild the unflushed trees.  See spa_log_spacemap.c.
+ *
+ * When the pool's autotrim property is on, space leaving the ms_defertree
+ * is also added to the ms_trimtree.  It has been free on disk for
+ * TXG_DEFER_SIZE txgs by then, so it is as safe to trim as it is to
+ * reallocate.  Allocating space removes it from the ms_trimtree again.
+ * Every so often the ms_trimtree is moved to the ms_trimmingtree and
+ * trimmed; for the duration its space is taken out of the ms_tree, so that
+ * it can't be reallocated and written before the trim has completed, and
+ * the metaslab is neither unloaded nor condensed.  Nothing here is kept
+ * on disk: after a crash, the space that was waiting to be trimmed is
+ * forgotten until the next "zpool trim".
  */
 struct metaslab {
 	kmutex_t	ms_lock;
@@ -140,7 +177,23 @@ struct metaslab {
 	range_tree_t	*ms_defertree[TXG_DEFER_SIZE];
 	range_tree_t	*ms_tree;
 
+	/*
+	 * Changes not yet written to ms_sm (see above).  The two trees
+	 * never overlap.  ms_unflushed_delta is the net allocated space
+	 * they represent that has been reflected in the vdev's stats.
+	 */
+	range_tree_t	*ms_unflushed_allocs;
+	range_tree_t	*ms_unflushed_frees;
+	int64_t		ms_unflushed_delta;
+	uint64_t	ms_unflushed_txg; /* oldest unflushed txg, or 0 */
+	uint64_t	ms_flush_txg;	/* flush requested for this txg */
+	avl_node_t	ms_unflushed_node; /* node in spa_unflushed_ms */
+
+	range_tree_t	*ms_trimtree;	/* freed space not yet trimmed */
+	range_tree_t	*ms_trimmingtree; /* space being trimmed */
+
 	boolean_t	ms_condensing;	/* condensing? */
+	boolean_t	ms_trimming;	/* trimming? */
 	boolean_t	ms_loaded;
 	boolean_t	ms_loading;
 
@@ -148,6 +201,7 @@ struct metaslab {
 	uint64_t	ms_weight;	/* weight vs. others in group	*/
 	uint64_t	ms_factor;
 	uint64_t	ms_access_txg;
+	int		ms_allocator;	/* owning allocator, or -1	*/
 
 	/*
 	 * The metaslab block allocators can optionally use a size-ordered
@@ -60,6 +60,8 @@ typedef struct refcount {
 
 /* Note: refcount_t must be initialized with refcount_create[_untracked]() */
 
+extern int reference_tracking_enable;
+
 void refcount_create(refcount_t *rc);
 void refcount_create_untracked(refcount_t *rc);
 void refcount_destroy(refcount_t *rc);
@@ -136,6 +136,7 @@ struct spa {
 	boolean_t	spa_is_initializing;	/* true while opening pool */
 	metaslab_class_t *spa_normal_class;	/* normal data class */
 	metaslab_class_t *spa_log_class;	/* intent log data class */
+	metaslab_class_t *spa_special_class;	/* metadata/small blk class */
 	uint64_t	spa_first_txg;		/* first txg after spa_open() */
 	uint64_t	spa_final_txg;		/* txg of export/destroy */
 	uint64_t	spa_freeze_txg;		/* freeze pool at this txg */
@@ -215,9 +216,15 @@ struct spa {
 	int		spa_mode;		/* FREAD | FWRITE */
 	spa_log_state_t spa_log_state;		/* log state */
 	uint64_t	spa_autoexpand;		/* lun expansion on/off */
+	uint64_t	spa_autotrim;		/* trim freed space on/off */
+	taskq_t		*spa_trim_taskq;	/* runs trim passes */
+	kmutex_t	spa_trim_lock;		/* protects spa_trim_queued */
+	boolean_t	spa_trim_queued;	/* autotrim pass queued */
+	boolean_t	spa_trim_stop;		/* abandon trim passes */
 	ddt_t		*spa_ddt[ZIO_CHECKSUM_FUNCTIONS]; /* in-core DDTs */
 	uint64_t	spa_ddt_stat_object;	/* DDT statistics */
 	uint64_t	spa_dedup_ditto;	/* dedup ditto threshold */
+	boolean_t	spa_ddt_pruned;		/* unique DDT entries pruned */
 	uint64_t	spa_dedup_checksum;	/* default dedup checksum */
 	uint64_t	spa_dspace;		/* dspace in normal class */
 	kmutex_t	spa_vdev_top_lock;	/* dueling offline/remove */
@@ -254,6 +261,29 @@ struct spa {
 
 	hrtime_t	spa_ccw_fail_time;	/* Conf cache write fail time */
 
+	/*
+	 * spa_txg_stats_lock protects the spa_txg_stats ring, indexed by
+	 * txg modulo spa_txg_stats_count, and is the kstat's ks_lock.
+	 * spa_txg_syncing is private to the sync thread; the per-txg
+	 * delay totals are updated atomically by delayed txs.
+	 */
+	kmutex_t	spa_txg_stats_lock;
+	spa_txg_stat_t	*spa_txg_stats;
+	int		spa_txg_stats_count;
+	struct kstat	*spa_txg_ksp;
+	spa_txg_stat_t	spa_txg_syncing;	/* txg being synced */
+	uint64_t	spa_txg_delayed[TXG_SIZE];
+	uint64_t	spa_txg_delay_time[TXG_SIZE];
+
+	/*
+	 * spa_log_sm_lock protects the log space map tree and the tree of
+	 * metaslabs with unflushed changes; see spa_log_spacemap.c.
+	 */
+	kmutex_t	spa_log_sm_lock;
+	uint64_t	spa_log_sm_zap;		/* (txg, vdev) -> log sm obj */
+	avl_tree_t	spa_log_sm_tree;	/* log sms by txg */
+	avl_tree_t	spa_unflushed_ms;	/* metaslabs by unflushed txg */
+
 	/*
 	 * spa_refcount & spa_config_lock must be the last elements
 	 * because refcount_t changes size based on compilation options.
@@ -0,0 +1,67 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright (c) 2014 by Delphix. All rights reserved.
+ */
+
+#ifndef _SYS_SPA_LOG_SPACEMAP_H
+#define	_SYS_SPA_LOG_SPACEMAP_H
+
+#include <sys/avl.h>
+#include <sys/spa.h>
+#include <sys/space_map.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * In-core description of one log space map: the allocs and frees that
+ * one top-level vdev's metaslabs logged in one txg.  The on-disk list is
+ * the ZAP named by DMU_POOL_LOG_SPACEMAP_ZAP, keyed by (txg, vdev id).
+ */
+typedef struct spa_log_sm {
+	uint64_t	sls_txg;	/* txg the log was written in */
+	uint64_t	sls_vdev;	/* top-level vdev id */
+	uint64_t	sls_sm_obj;	/* space map object */
+	avl_node_t	sls_node;	/* node in spa_log_sm_tree */
+} spa_log_sm_t;
+
+extern uint64_t zfs_log_sm_flush_txgs;
+
+extern void spa_log_sm_init(spa_t *spa);
+extern void spa_log_sm_fini(spa_t *spa);
+extern void spa_log_sm_unload(spa_t *spa);
+extern int spa_ld_log_spacemaps(spa_t *spa);
+
+extern boolean_t spa_log_sm_active(spa_t *spa);
+extern void spa_log_sm_sync(spa_t *spa, dmu_tx_t *tx);
+extern space_map_t *spa_log_sm_vdev(vdev_t *vd, dmu_tx_t *tx);
+extern void spa_log_sm_vdev_done(vdev_t *vd);
+
+extern void spa_log_sm_dirty(spa_t *spa, metaslab_t *msp, uint64_t txg);
+extern void spa_log_sm_clean(spa_t *spa, metaslab_t *msp);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_SPA_LOG_SPACEMAP_H */
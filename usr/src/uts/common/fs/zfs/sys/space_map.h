@@ -60,7 +60,8 @@ typedef struct space_map_phys {
 	uint64_t	smp_object;	/* on-disk space map object */
 	uint64_t	smp_objsize;	/* size of the object */
 	uint64_t	smp_alloc;	/* space allocated from the map */
-	uint64_t	smp_pad[5];	/* reserved */
+	uint64_t	smp_flushed_txg; /* changes not in the log space maps */
+	uint64_t	smp_pad[4];	/* reserved */
 
 	/*
 	 * The smp_histogram maintains a histogram of free regions. Each
@@ -146,7 +147,11 @@ typedef enum {
  */
 #define	SPACE_MAP_INITIAL_BLOCKSIZE	(1ULL << 12)
 
+typedef int (sm_cb_t)(maptype_t type, uint64_t offset, uint64_t size,
+    void *arg);
+
 int space_map_load(space_map_t *sm, range_tree_t *rt, maptype_t maptype);
+int space_map_iterate(space_map_t *sm, sm_cb_t *callback, void *arg);
 
 void space_map_histogram_clear(space_map_t *sm);
 void space_map_histogram_add(space_map_t *sm, range_tree_t *rt,
@@ -157,6 +162,8 @@ void space_map_update(space_map_t *sm);
 uint64_t space_map_object(space_map_t *sm);
 uint64_t space_map_allocated(space_map_t *sm);
 uint64_t space_map_length(space_map_t *sm);
+uint64_t space_map_flushed_txg(space_map_t *sm);
+void space_map_set_flushed_txg(space_map_t *sm, uint64_t txg, dmu_tx_t *tx);
 
 void space_map_write(space_map_t *sm, range_tree_t *rt, maptype_t maptype,
     dmu_tx_t *tx);
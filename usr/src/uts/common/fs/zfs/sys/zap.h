@@ -134,6 +134,9 @@ uint64_t zap_create(objset_t *ds, dmu_object_type_t ot,
     dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx);
 uint64_t zap_create_norm(objset_t *ds, int normflags, dmu_object_type_t ot,
     dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx);
+uint64_t zap_create_norm_dnsize(objset_t *ds, int normflags,
+    dmu_object_type_t ot, dmu_object_type_t bonustype, int bonuslen,
+    int dnodesize, dmu_tx_t *tx);
 uint64_t zap_create_flags(objset_t *os, int normflags, zap_flags_t flags,
     dmu_object_type_t ot, int leaf_blockshift, int indirect_blockshift,
     dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx);
@@ -155,6 +158,9 @@ int zap_create_claim(objset_t *ds, uint64_t obj, dmu_object_type_t ot,
 int zap_create_claim_norm(objset_t *ds, uint64_t obj,
     int normflags, dmu_object_type_t ot,
     dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx);
+int zap_create_claim_norm_dnsize(objset_t *ds, uint64_t obj,
+    int normflags, dmu_object_type_t ot,
+    dmu_object_type_t bonustype, int bonuslen, int dnodesize, dmu_tx_t *tx);
 
 /*
  * The zapobj passed in must be a valid ZAP object for all of the
@@ -210,6 +216,18 @@ int zap_lookup_norm(objset_t *ds, uint64_t zapobj, const char *name,
     uint64_t integer_size, uint64_t num_integers, void *buf,
     matchtype_t mt, char *realname, int rn_len,
     boolean_t *normalization_conflictp);
+/*
+ * Look up a batch of names in one zap object.  The value for names[i] is
+ * stored at bufs + i * integer_size * num_integers, and the result of
+ * that lookup (as zap_lookup_norm() would return it) in errors[i].  For
+ * fat zaps the leaf blocks for all of the names are prefetched before
+ * any lookup is done, so a cold batch costs one round of parallel reads
+ * rather than one read per name.  Returns nonzero only if the zap object
+ * itself could not be accessed, in which case errors[] is not filled in.
+ */
+int zap_lookup_multi(objset_t *os, uint64_t zapobj, const char **names,
+    int count, matchtype_t mt, uint64_t integer_size, uint64_t num_integers,
+    void *bufs, int *errors);
 int zap_lookup_uint64(objset_t *os, uint64_t zapobj, const uint64_t *key,
     int key_numints, uint64_t integer_size, uint64_t num_integers, void *buf);
 int zap_contains(objset_t *ds, uint64_t zapobj, const char *name);
@@ -42,6 +42,8 @@ extern int fzap_default_block_shift;
 
 #define	MZAP_ENT_LEN		64
 #define	MZAP_NAME_LEN		(MZAP_ENT_LEN - 8 - 4 - 2)
+#define	MZAP_ENT_SHIFT		6	/* log2(MZAP_ENT_LEN) */
+#define	MZAP_WIDE_MAX_SHIFT	9	/* wide entries are at most 512 bytes */
 #define	MZAP_MAX_BLKSHIFT	SPA_MAXBLOCKSHIFT
 #define	MZAP_MAX_BLKSZ		(1 << MZAP_MAX_BLKSHIFT)
 
@@ -54,11 +56,19 @@ typedef struct mzap_ent_phys {
 	char mze_name[MZAP_NAME_LEN];
 } mzap_ent_phys_t;
 
+/*
+ * A ZBT_MICRO block is an array of MZAP_ENT_LEN-byte chunks, the first
+ * of which holds this header.  A ZBT_MICRO_WIDE block (feature
+ * wide_microzap) has the same layout with chunks of 1 << mz_entshift
+ * bytes, so that names up to MZE_NAME_LEN() can stay in the micro zap;
+ * mze_name then runs past its declared size to the end of the chunk.
+ */
 typedef struct mzap_phys {
-	uint64_t mz_block_type;	/* ZBT_MICRO */
+	uint64_t mz_block_type;	/* ZBT_MICRO or ZBT_MICRO_WIDE */
 	uint64_t mz_salt;
 	uint64_t mz_normflags;
-	uint64_t mz_pad[5];
+	uint64_t mz_entshift;	/* ZBT_MICRO_WIDE only */
+	uint64_t mz_pad[4];
 	mzap_ent_phys_t mz_chunk[1];
 	/* actually variable size depending on block size */
 } mzap_phys_t;
@@ -70,8 +80,12 @@ typedef struct mzap_ent {
 	uint32_t mze_cd; /* copy from mze_phys->mze_cd */
 } mzap_ent_t;
 
-#define	MZE_PHYS(zap, mze) \
-	(&(zap)->zap_m.zap_phys->mz_chunk[(mze)->mze_chunkid])
+#define	MZE_PHYS_CHUNK(zap, chunkid) \
+	((mzap_ent_phys_t *)((char *)(zap)->zap_m.zap_phys + \
+	(((chunkid) + 1) << (zap)->zap_m.zap_entshift)))
+#define	MZE_PHYS(zap, mze)	MZE_PHYS_CHUNK(zap, (mze)->mze_chunkid)
+#define	MZE_NAME_LEN(zap) \
+	((1 << (zap)->zap_m.zap_entshift) - MZAP_ENT_LEN + MZAP_NAME_LEN)
 
 /*
  * The (fat) zap is stored in one object. It is an array of
@@ -91,6 +105,7 @@ struct zap_leaf;
 #define	ZBT_LEAF		((1ULL << 63) + 0)
 #define	ZBT_HEADER		((1ULL << 63) + 1)
 #define	ZBT_MICRO		((1ULL << 63) + 3)
+#define	ZBT_MICRO_WIDE		((1ULL << 63) + 4)
 /* any other values are ptrtbl blocks */
 
 /*
@@ -164,6 +179,7 @@ typedef struct zap {
 			int16_t zap_num_entries;
 			int16_t zap_num_chunks;
 			int16_t zap_alloc_next;
+			int zap_entshift;
 			avl_tree_t zap_avl;
 		} zap_micro;
 	} zap_u;
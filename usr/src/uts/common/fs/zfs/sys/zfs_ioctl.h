@@ -82,12 +82,15 @@ typedef enum drr_headertype {
 #define	DMU_BACKUP_FEATURE_DEDUP	(0x1)
 #define	DMU_BACKUP_FEATURE_DEDUPPROPS	(0x2)
 #define	DMU_BACKUP_FEATURE_SA_SPILL	(0x4)
+#define	DMU_BACKUP_FEATURE_COMPRESSED	(0x8)
+#define	DMU_BACKUP_FEATURE_LARGE_DNODE	(0x10)
 
 /*
  * Mask of all supported backup features
  */
 #define	DMU_BACKUP_FEATURE_MASK	(DMU_BACKUP_FEATURE_DEDUP | \
-		DMU_BACKUP_FEATURE_DEDUPPROPS | DMU_BACKUP_FEATURE_SA_SPILL)
+		DMU_BACKUP_FEATURE_DEDUPPROPS | DMU_BACKUP_FEATURE_SA_SPILL | \
+		DMU_BACKUP_FEATURE_COMPRESSED | DMU_BACKUP_FEATURE_LARGE_DNODE)
 
 /* Are all features in the given flag word currently supported? */
 #define	DMU_STREAM_SUPPORTED(x)	(!((x) & ~DMU_BACKUP_FEATURE_MASK))
@@ -122,6 +125,16 @@ typedef enum drr_headertype {
 
 #define	DRR_IS_DEDUP_CAPABLE(flags)	((flags) & DRR_CHECKSUM_DEDUP)
 
+/*
+ * In a stream with DMU_BACKUP_FEATURE_COMPRESSED, a DRR_WRITE record may
+ * carry its block as it is on disk: drr_compressed_size bytes, compressed
+ * with drr_compressiontype, which decompress to drr_length bytes.
+ */
+#define	DRR_WRITE_COMPRESSED(drrw)	((drrw)->drr_compressiontype != 0)
+#define	DRR_WRITE_PAYLOAD_SIZE(drrw) \
+	(DRR_WRITE_COMPRESSED(drrw) ? (drrw)->drr_compressed_size : \
+	(drrw)->drr_length)
+
 /*
  * zfs ioctl command structure
  */
@@ -155,7 +168,8 @@ typedef struct dmu_replay_record {
 			uint32_t drr_bonuslen;
 			uint8_t drr_checksumtype;
 			uint8_t drr_compress;
-			uint8_t drr_pad[6];
+			uint8_t drr_dn_slots;	/* 0 in old streams */
+			uint8_t drr_pad[5];
 			uint64_t drr_toguid;
 			/* bonus content follows */
 		} drr_object;
@@ -173,8 +187,10 @@ typedef struct dmu_replay_record {
 			uint64_t drr_toguid;
 			uint8_t drr_checksumtype;
 			uint8_t drr_checksumflags;
-			uint8_t drr_pad2[6];
+			uint8_t drr_compressiontype;
+			uint8_t drr_pad2[5];
 			ddt_key_t drr_key; /* deduplication key */
+			uint64_t drr_compressed_size;
 			/* content follows */
 		} drr_write;
 		struct drr_free {
@@ -316,6 +332,7 @@ typedef struct zfs_cmd {
 	uint64_t	zc_fromobj;
 	uint64_t	zc_createtxg;
 	zfs_stat_t	zc_stat;
+	uint64_t	zc_flags;
 } zfs_cmd_t;
 
 typedef struct zfs_useracct {
@@ -330,6 +347,9 @@ typedef struct zfs_useracct {
 
 #define	ZPOOL_EXPORT_AFTER_SPLIT 0x1
 
+/* zc_flags for ZFS_IOC_SEND */
+#define	ZFS_SEND_COMPRESS	0x1
+
 #ifdef _KERNEL
 
 typedef struct zfs_creat {
@@ -128,6 +128,7 @@ typedef enum zil_create {
 /*
  * Intent log transaction types and record structures
  */
+#define	TX_COMMIT		0	/* Commit marker (no on-disk state) */
 #define	TX_CREATE		1	/* Create file */
 #define	TX_MKDIR		2	/* Make directory */
 #define	TX_MKXATTR		3	/* Make XATTR directory */
@@ -226,6 +227,16 @@ typedef struct {
 	/* for creates with xvattr data, the name follows the xvattr info */
 } lr_create_t;
 
+/*
+ * Object numbers need at most 48 bits, so the top byte of a create
+ * record's lr_foid holds the number of dnode slots the object uses, less
+ * one.  Records written before large dnodes have zero there, which
+ * decodes as a single slot.
+ */
+#define	LR_FOID_GET_SLOTS(oid)		(BF64_GET((oid), 56, 8) + 1)
+#define	LR_FOID_SET_SLOTS(oid, x)	BF64_SET((oid), 56, 8, (x) - 1)
+#define	LR_FOID_GET_OBJ(oid)		BF64_GET((oid), 0, 56)
+
 /*
  * FUID ACL record will be an array of ACEs from the original ACL.
  * If this array includes ephemeral IDs, the record will also include
@@ -35,6 +35,23 @@
 extern "C" {
 #endif
 
+/*
+ * Possible states of a log write buffer.  An lwb starts out CLOSED: its
+ * block is allocated but no zio exists yet.  The first itx committed to
+ * it creates its zios and moves it to OPENED, where it keeps accepting
+ * itxs.  Once its write is issued it is ISSUED, and it becomes DONE when
+ * both the write and the cache flushes it depends on have completed.
+ * Transitions are made under zl_lock; CLOSED -> OPENED -> ISSUED also
+ * require zl_issuer_lock, so an issuer can examine lwb_state without
+ * taking zl_lock as long as it doesn't care about ISSUED vs DONE.
+ */
+typedef enum {
+	LWB_STATE_CLOSED,
+	LWB_STATE_OPENED,
+	LWB_STATE_ISSUED,
+	LWB_STATE_DONE
+} lwb_state_t;
+
 /*
  * Log write buffer.
  */
@@ -43,13 +60,33 @@ typedef struct lwb {
 	blkptr_t	lwb_blk;	/* on disk address of this log blk */
 	int		lwb_nused;	/* # used bytes in buffer */
 	int		lwb_sz;		/* size of block and buffer */
+	lwb_state_t	lwb_state;	/* the state of this lwb */
 	char		*lwb_buf;	/* log write buffer */
-	zio_t		*lwb_zio;	/* zio for this buffer */
+	zio_t		*lwb_write_zio;	/* zio for the lwb buffer */
+	zio_t		*lwb_root_zio;	/* root zio for lwb write and flushes */
 	dmu_tx_t	*lwb_tx;	/* tx for log block allocation */
 	uint64_t	lwb_max_txg;	/* highest txg in this lwb */
+	hrtime_t	lwb_issued_timestamp; /* when was the lwb issued? */
 	list_node_t	lwb_node;	/* zilog->zl_lwb_list linkage */
+	list_t		lwb_waiters;	/* list of zil_commit_waiter's */
 } lwb_t;
 
+/*
+ * One of these is allocated by each thread calling zil_commit().  It is
+ * attached to a TX_COMMIT itx placed on the itx list behind everything
+ * the caller needs on stable storage; when that itx is committed the
+ * waiter is linked to the lwb holding it, and it is signalled once that
+ * lwb (and so every lwb before it) is DONE.
+ */
+typedef struct zil_commit_waiter {
+	kcondvar_t	zcw_cv;		/* signalled when "done" */
+	kmutex_t	zcw_lock;	/* protects fields of this struct */
+	list_node_t	zcw_node;	/* linkage in lwb_t:lwb_waiters */
+	lwb_t		*zcw_lwb;	/* back pointer to lwb when linked */
+	boolean_t	zcw_done;	/* B_TRUE when "done", else B_FALSE */
+	int		zcw_zio_error;	/* contains the zio io_error value */
+} zil_commit_waiter_t;
+
 /*
  * Intent log transaction lists
  */
@@ -73,8 +110,9 @@ typedef struct itx_async_node {
 } itx_async_node_t;
 
 /*
- * Vdev flushing: during a zil_commit(), we build up an AVL tree of the vdevs
- * we've touched so we know which ones need a write cache flush at the end.
+ * Vdev flushing: as log blocks and the data they reference are written, we
+ * build up an AVL tree of the vdevs we've touched so we know which ones need
+ * a write cache flush once the log block write completes.
  */
 typedef struct zil_vdev_node {
 	uint64_t	zv_vdev;	/* vdev to be flushed */
@@ -93,20 +131,18 @@ struct zilog {
 	const zil_header_t *zl_header;	/* log header buffer */
 	objset_t	*zl_os;		/* object set we're logging */
 	zil_get_data_t	*zl_get_data;	/* callback to get object content */
-	zio_t		*zl_root_zio;	/* log writer root zio */
 	uint64_t	zl_lr_seq;	/* on-disk log record sequence number */
 	uint64_t	zl_commit_lr_seq; /* last committed on-disk lr seq */
 	uint64_t	zl_destroy_txg;	/* txg of last zil_destroy() */
 	uint64_t	zl_replayed_seq[TXG_SIZE]; /* last replayed rec seq */
 	uint64_t	zl_replaying_seq; /* current replay seq number */
 	uint32_t	zl_suspend;	/* log suspend count */
-	kcondvar_t	zl_cv_writer;	/* log writer thread completion */
+	kmutex_t	zl_issuer_lock;	/* single writer, per ZIL, at a time */
 	kcondvar_t	zl_cv_suspend;	/* log suspend completion */
 	uint8_t		zl_suspending;	/* log is currently suspending */
 	uint8_t		zl_keep_first;	/* keep first log block in destroy */
 	uint8_t		zl_replay;	/* replaying records while set */
 	uint8_t		zl_stop_sync;	/* for debugging */
-	uint8_t		zl_writer;	/* boolean: write setup in progress */
 	uint8_t		zl_logbias;	/* latency or throughput */
 	uint8_t		zl_sync;	/* synchronous or asynchronous */
 	int		zl_parse_error;	/* last zil_parse() error */
@@ -114,16 +150,15 @@ struct zilog {
 	uint64_t	zl_parse_lr_seq; /* highest lr seq on last parse */
 	uint64_t	zl_parse_blk_count; /* number of blocks parsed */
 	uint64_t	zl_parse_lr_count; /* number of log records parsed */
-	uint64_t	zl_next_batch;	/* next batch number */
-	uint64_t	zl_com_batch;	/* committed batch number */
-	kcondvar_t	zl_cv_batch[2];	/* batch condition variables */
+	lwb_t		*zl_last_lwb_opened; /* most recent lwb opened */
+	hrtime_t	zl_last_lwb_latency; /* last lwb write + flush time */
 	itxg_t		zl_itxg[TXG_SIZE]; /* intent log txg chains */
 	list_t		zl_itx_commit_list; /* itx list to be committed */
 	uint64_t	zl_itx_list_sz;	/* total size of records on list */
 	uint64_t	zl_cur_used;	/* current commit log size used */
 	list_t		zl_lwb_list;	/* in-flight log write list */
 	kmutex_t	zl_vdev_lock;	/* protects zl_vdev_tree */
-	avl_tree_t	zl_vdev_tree;	/* vdevs to flush in zil_commit() */
+	avl_tree_t	zl_vdev_tree;	/* vdevs to flush after lwb writes */
 	taskq_t		*zl_clean_taskq; /* runs lwb and itx clean tasks */
 	avl_tree_t	zl_bp_tree;	/* track bps during log parse */
 	clock_t		zl_replay_time;	/* lbolt of when replay started */
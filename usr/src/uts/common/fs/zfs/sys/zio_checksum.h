@@ -67,6 +67,8 @@ extern void zio_checksum_compute(zio_t *zio, enum zio_checksum checksum,
     void *data, uint64_t size);
 extern int zio_checksum_error(zio_t *zio, zio_bad_cksum_t *out);
 extern enum zio_checksum spa_dedup_checksum(spa_t *spa);
+extern void zio_checksum_init(void);
+extern void zio_checksum_fini(void);
 
 #ifdef	__cplusplus
 }
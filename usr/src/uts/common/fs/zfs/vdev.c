@@ -37,6 +37,7 @@
 #include <sys/metaslab_impl.h>
 #include <sys/space_map.h>
 #include <sys/space_reftree.h>
+#include <sys/spa_log_spacemap.h>
 #include <sys/zio.h>
 #include <sys/zap.h>
 #include <sys/fs/zfs.h>
@@ -345,7 +346,7 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 {
 	vdev_ops_t *ops;
 	char *type;
-	uint64_t guid = 0, islog, nparity;
+	uint64_t guid = 0, islog, isspecial, nparity;
 	vdev_t *vd;
 
 	ASSERT(spa_config_held(spa, SCL_ALL, RW_WRITER) == SCL_ALL);
@@ -394,6 +395,15 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	if (islog && spa_version(spa) < SPA_VERSION_SLOGS)
 		return (SET_ERROR(ENOTSUP));
 
+	/*
+	 * Determine whether we're a special class vdev, which holds the
+	 * pool's metadata and small blocks.  A vdev can't be both.
+	 */
+	isspecial = 0;
+	(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_IS_SPECIAL, &isspecial);
+	if (islog && isspecial)
+		return (SET_ERROR(EINVAL));
+
 	if (ops == &vdev_hole_ops && spa_version(spa) < SPA_VERSION_HOLES)
 		return (SET_ERROR(ENOTSUP));
 
@@ -436,6 +446,7 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	vd = vdev_alloc_common(spa, id, guid, ops);
 
 	vd->vdev_islog = islog;
+	vd->vdev_isspecial = isspecial;
 	vd->vdev_nparity = nparity;
 
 	if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &vd->vdev_path) == 0)
@@ -494,8 +505,9 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 		    alloctype == VDEV_ALLOC_ADD ||
 		    alloctype == VDEV_ALLOC_SPLIT ||
 		    alloctype == VDEV_ALLOC_ROOTPOOL);
-		vd->vdev_mg = metaslab_group_create(islog ?
-		    spa_log_class(spa) : spa_normal_class(spa), vd);
+		vd->vdev_mg = metaslab_group_create(islog ? spa_log_class(spa) :
+		    isspecial ? spa_special_class(spa) : spa_normal_class(spa),
+		    vd);
 	}
 
 	/*
@@ -709,6 +721,9 @@ vdev_top_transfer(vdev_t *svd, vdev_t *tvd)
 
 	tvd->vdev_islog = svd->vdev_islog;
 	svd->vdev_islog = 0;
+
+	tvd->vdev_isspecial = svd->vdev_isspecial;
+	svd->vdev_isspecial = 0;
 }
 
 static void
@@ -2038,14 +2053,20 @@ vdev_resilver_needed(vdev_t *vd, uint64_t *minp, uint64_t *maxp)
 	return (needed);
 }
 
-void
-vdev_load(vdev_t *vd)
+/*
+ * Load the metaslabs and DTLs of a vdev tree, noting failures in
+ * vdev_load_failed.  Top-level vdevs share no state here beyond what
+ * is locked, so vdev_load() runs this for each of them in parallel.
+ */
+static void
+vdev_load_tree(void *arg)
 {
-	/*
-	 * Recursively load all children.
-	 */
+	vdev_t *vd = arg;
+
 	for (int c = 0; c < vd->vdev_children; c++)
-		vdev_load(vd->vdev_child[c]);
+		vdev_load_tree(vd->vdev_child[c]);
+
+	vd->vdev_load_failed = B_FALSE;
 
 	/*
 	 * If this is a top-level vdev, initialize its metaslabs.
@@ -2053,15 +2074,55 @@ vdev_load(vdev_t *vd)
 	if (vd == vd->vdev_top && !vd->vdev_ishole &&
 	    (vd->vdev_ashift == 0 || vd->vdev_asize == 0 ||
 	    vdev_metaslab_init(vd, 0) != 0))
-		vdev_set_state(vd, B_FALSE, VDEV_STATE_CANT_OPEN,
-		    VDEV_AUX_CORRUPT_DATA);
+		vd->vdev_load_failed = B_TRUE;
 
 	/*
 	 * If this is a leaf vdev, load its DTL.
 	 */
 	if (vd->vdev_ops->vdev_op_leaf && vdev_dtl_load(vd) != 0)
+		vd->vdev_load_failed = B_TRUE;
+}
+
+/*
+ * Mark the vdevs that failed to load, children first.  State changes
+ * propagate up the tree, so this is done in a single thread.
+ */
+static void
+vdev_load_done(vdev_t *vd)
+{
+	for (int c = 0; c < vd->vdev_children; c++)
+		vdev_load_done(vd->vdev_child[c]);
+
+	if (vd->vdev_load_failed) {
 		vdev_set_state(vd, B_FALSE, VDEV_STATE_CANT_OPEN,
 		    VDEV_AUX_CORRUPT_DATA);
+		vd->vdev_load_failed = B_FALSE;
+	}
+}
+
+void
+vdev_load(vdev_t *vd)
+{
+	int children = vd->vdev_children;
+
+	/*
+	 * The root vdev has nothing of its own to load; hand each of its
+	 * top-level children to a thread of their own.
+	 */
+	if (vd == vd->vdev_spa->spa_root_vdev && children > 1) {
+		taskq_t *tq = taskq_create("vdev_load", children,
+		    minclsyspri, children, children, TASKQ_PREPOPULATE);
+
+		for (int c = 0; c < children; c++)
+			VERIFY(taskq_dispatch(tq, vdev_load_tree,
+			    vd->vdev_child[c], TQ_SLEEP) != NULL);
+		taskq_destroy(tq);
+		vd->vdev_load_failed = B_FALSE;
+	} else {
+		vdev_load_tree(vd);
+	}
+
+	vdev_load_done(vd);
 }
 
 /*
@@ -2149,6 +2210,8 @@ vdev_sync_done(vdev_t *vd, uint64_t txg)
 	while (msp = txg_list_remove(&vd->vdev_ms_list, TXG_CLEAN(txg)))
 		metaslab_sync_done(msp, txg);
 
+	spa_log_sm_vdev_done(vd);
+
 	if (reassess)
 		metaslab_sync_reassess(vd->vdev_mg);
 }
@@ -2808,7 +2871,7 @@ vdev_space_update(vdev_t *vd, int64_t alloc_delta, int64_t defer_delta,
 	vd->vdev_stat.vs_dspace += dspace_delta;
 	mutex_exit(&vd->vdev_stat_lock);
 
-	if (mc == spa_normal_class(spa)) {
+	if (mc == spa_normal_class(spa) || mc == spa_special_class(spa)) {
 		mutex_enter(&rvd->vdev_stat_lock);
 		rvd->vdev_stat.vs_alloc += alloc_delta;
 		rvd->vdev_stat.vs_space += space_delta;
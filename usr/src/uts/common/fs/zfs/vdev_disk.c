@@ -578,6 +578,7 @@ skip_open:
 	 * try again.
 	 */
 	vd->vdev_nowritecache = B_FALSE;
+	vd->vdev_notrim = B_FALSE;
 
 	return (0);
 }
@@ -715,6 +716,35 @@ vdev_disk_ioctl_done(void *zio_arg, int error)
 	zio_interrupt(zio);
 }
 
+/*
+ * Issue a DKIOCFREE.  Drivers carry it out synchronously, so this runs
+ * from a taskq rather than the thread that started the zio.
+ */
+static void
+vdev_disk_trim(void *arg)
+{
+	zio_t *zio = arg;
+	vdev_t *vd = zio->io_vd;
+	vdev_disk_t *dvd = vd->vdev_tsd;
+	dkioc_free_t df;
+	int error;
+
+	df.df_flags = 0;
+	df.df_reserved = 0;
+	df.df_start = zio->io_offset;
+	df.df_length = zio->io_size;
+
+	error = ldi_ioctl(dvd->vd_lh, DKIOCFREE, (intptr_t)&df, FKIOCTL,
+	    kcred, NULL);
+	if (error == ENOTSUP || error == ENOTTY) {
+		/* As for DKIOCFLUSHWRITECACHE, don't try again. */
+		vd->vdev_notrim = B_TRUE;
+	}
+	zio->io_error = error;
+
+	zio_interrupt(zio);
+}
+
 static int
 vdev_disk_io_start(zio_t *zio)
 {
@@ -786,6 +816,18 @@ vdev_disk_io_start(zio_t *zio)
 
 			break;
 
+		case DKIOCFREE:
+
+			if (vd->vdev_notrim) {
+				zio->io_error = SET_ERROR(ENOTSUP);
+				break;
+			}
+
+			VERIFY3U(taskq_dispatch(system_taskq, vdev_disk_trim,
+			    zio, TQ_SLEEP), !=, 0);
+
+			return (ZIO_PIPELINE_STOP);
+
 		default:
 			zio->io_error = SET_ERROR(ENOTSUP);
 		}
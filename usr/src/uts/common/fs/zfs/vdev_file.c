@@ -118,6 +118,9 @@ skip_open:
 	*max_psize = *psize = vattr.va_size;
 	*ashift = SPA_MINBLOCKSHIFT;
 
+	/* There is no way to free the blocks behind part of a file. */
+	vd->vdev_notrim = B_TRUE;
+
 	return (0);
 }
 
@@ -278,6 +278,9 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 		fnvlist_add_uint64(nv, ZPOOL_CONFIG_ASIZE,
 		    vd->vdev_asize);
 		fnvlist_add_uint64(nv, ZPOOL_CONFIG_IS_LOG, vd->vdev_islog);
+		if (vd->vdev_isspecial)
+			fnvlist_add_uint64(nv, ZPOOL_CONFIG_IS_SPECIAL,
+			    vd->vdev_isspecial);
 		if (vd->vdev_removing)
 			fnvlist_add_uint64(nv, ZPOOL_CONFIG_REMOVING,
 			    vd->vdev_removing);
@@ -293,12 +296,19 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 
 	if (getstats) {
 		vdev_stat_t vs;
+		vdev_queue_stat_t *vqs;
 		pool_scan_stat_t ps;
 
 		vdev_get_stats(vd, &vs);
 		fnvlist_add_uint64_array(nv, ZPOOL_CONFIG_VDEV_STATS,
 		    (uint64_t *)&vs, sizeof (vs) / sizeof (uint64_t));
 
+		vqs = kmem_alloc(sizeof (*vqs), KM_SLEEP);
+		vdev_queue_get_stats(vd, vqs);
+		fnvlist_add_uint64_array(nv, ZPOOL_CONFIG_VDEV_QUEUE_STATS,
+		    (uint64_t *)vqs, sizeof (*vqs) / sizeof (uint64_t));
+		kmem_free(vqs, sizeof (*vqs));
+
 		/* provide either current or previous scan information */
 		if (spa_scan_get_stats(spa, &ps) == 0) {
 			fnvlist_add_uint64_array(nv,
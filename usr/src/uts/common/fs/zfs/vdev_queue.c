@@ -40,9 +40,9 @@
  *
  * ZFS issues I/O operations to leaf vdevs to satisfy and complete zios.  The
  * I/O scheduler determines when and in what order those operations are
- * issued.  The I/O scheduler divides operations into five I/O classes
+ * issued.  The I/O scheduler divides operations into six I/O classes
  * prioritized in the following order: sync read, sync write, async read,
- * async write, and scrub/resilver.  Each queue defines the minimum and
+ * async write, scrub/resilver, and trim.  Each queue defines the minimum and
  * maximum number of concurrent operations that may be issued to the device.
  * In addition, the device has an aggregate maximum. Note that the sum of the
  * per-queue minimums must not exceed the aggregate maximum, and if the
@@ -145,6 +145,8 @@ uint32_t zfs_vdev_async_write_min_active = 1;
 uint32_t zfs_vdev_async_write_max_active = 10;
 uint32_t zfs_vdev_scrub_min_active = 1;
 uint32_t zfs_vdev_scrub_max_active = 2;
+uint32_t zfs_vdev_trim_min_active = 1;
+uint32_t zfs_vdev_trim_max_active = 2;
 
 /*
  * When the pool has less than zfs_vdev_async_write_active_min_dirty_percent
@@ -161,6 +163,12 @@ int zfs_vdev_async_write_active_max_dirty_percent = 60;
  * For read I/Os, we also aggregate across small adjacency gaps; for writes
  * we include spans of optional I/Os to aid aggregation at the disk even when
  * they aren't able to help us aggregate at this level.
+ *
+ * Read gaps are bridged by reading the hole into the aggregate buffer and
+ * discarding it.  Write gaps are never padded: the queue can't tell whether
+ * a hole is free, and it may hold live blocks from earlier txgs or blocks
+ * freed in a recent txg that rewind still depends on.  Only optional I/Os,
+ * whose contents the issuer has declared disposable, may fill a write gap.
  */
 int zfs_vdev_aggregation_limit = SPA_MAXBLOCKSIZE;
 int zfs_vdev_read_gap_limit = 32 << 10;
@@ -204,11 +212,74 @@ vdev_queue_timestamp_compare(const void *x1, const void *x2)
 	return (0);
 }
 
+/*
+ * Record an i/o latency in a power-of-two nanosecond histogram.
+ */
+static void
+vdev_queue_histo_add(uint64_t *histo, hrtime_t delta)
+{
+	int b = delta > 0 ? highbit64(delta) - 1 : 0;
+
+	histo[MIN(b, VDEV_LAT_HISTO_BUCKETS - 1)]++;
+}
+
+static void
+vdev_queue_stat_add(vdev_t *vd, vdev_queue_stat_t *vqs)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+
+	if (!vd->vdev_ops->vdev_op_leaf) {
+		for (int c = 0; c < vd->vdev_children; c++)
+			vdev_queue_stat_add(vd->vdev_child[c], vqs);
+		return;
+	}
+
+	mutex_enter(&vq->vq_lock);
+	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
+		vdev_queue_class_t *vqc = &vq->vq_class[p];
+
+		vqs->vqs_active[p] += vqc->vqc_active;
+		vqs->vqs_pending[p] += avl_numnodes(&vqc->vqc_queued_tree);
+		for (int b = 0; b < VDEV_LAT_HISTO_BUCKETS; b++) {
+			vqs->vqs_queue_histo[p][b] += vqc->vqc_queue_histo[b];
+			vqs->vqs_disk_histo[p][b] += vqc->vqc_disk_histo[b];
+		}
+	}
+	mutex_exit(&vq->vq_lock);
+}
+
+/*
+ * Get the scheduler statistics for a vdev; for interior vdevs, the sum
+ * over their leaves.
+ */
+void
+vdev_queue_get_stats(vdev_t *vd, vdev_queue_stat_t *vqs)
+{
+	bzero(vqs, sizeof (*vqs));
+	vdev_queue_stat_add(vd, vqs);
+}
+
+static int
+vdev_queue_kstat_update(kstat_t *ksp, int rw)
+{
+	vdev_t *vd = ksp->ks_private;
+	vdev_queue_stat_t *vqs = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+
+	vdev_queue_get_stats(vd, vqs);
+	return (0);
+}
+
 void
 vdev_queue_init(vdev_t *vd)
 {
 	vdev_queue_t *vq = &vd->vdev_queue;
 
+	/* vdev_queue_stat_t mirrors the queueable priorities */
+	ASSERT3U(VDEV_QUEUE_CLASSES, ==, ZIO_PRIORITY_NUM_QUEUEABLE);
+
 	mutex_init(&vq->vq_lock, NULL, MUTEX_DEFAULT, NULL);
 	vq->vq_vdev = vd;
 
@@ -229,6 +300,24 @@ vdev_queue_init(vdev_t *vd)
 		    vdev_queue_offset_compare,
 		    sizeof (zio_t), offsetof(struct zio, io_queue_node));
 	}
+
+	/*
+	 * Leaf vdevs export their scheduler statistics as a raw kstat,
+	 * zfs:0:vq_<guid>, holding a vdev_queue_stat_t.
+	 */
+	if (vd->vdev_ops->vdev_op_leaf) {
+		char name[KSTAT_STRLEN];
+
+		(void) snprintf(name, sizeof (name), "vq_%llx",
+		    (u_longlong_t)vd->vdev_guid);
+		vq->vq_ksp = kstat_create("zfs", 0, name, "vdev_queue",
+		    KSTAT_TYPE_RAW, sizeof (vdev_queue_stat_t), 0);
+		if (vq->vq_ksp != NULL) {
+			vq->vq_ksp->ks_private = vd;
+			vq->vq_ksp->ks_update = vdev_queue_kstat_update;
+			kstat_install(vq->vq_ksp);
+		}
+	}
 }
 
 void
@@ -236,6 +325,11 @@ vdev_queue_fini(vdev_t *vd)
 {
 	vdev_queue_t *vq = &vd->vdev_queue;
 
+	if (vq->vq_ksp != NULL) {
+		kstat_delete(vq->vq_ksp);
+		vq->vq_ksp = NULL;
+	}
+
 	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++)
 		avl_destroy(&vq->vq_class[p].vqc_queued_tree);
 	avl_destroy(&vq->vq_active_tree);
@@ -261,8 +355,13 @@ static void
 vdev_queue_io_remove(vdev_queue_t *vq, zio_t *zio)
 {
 	spa_t *spa = zio->io_spa;
+	vdev_queue_class_t *vqc;
+
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
-	avl_remove(&vq->vq_class[zio->io_priority].vqc_queued_tree, zio);
+	vqc = &vq->vq_class[zio->io_priority];
+	avl_remove(&vqc->vqc_queued_tree, zio);
+	vdev_queue_histo_add(vqc->vqc_queue_histo,
+	    gethrtime() - zio->io_timestamp);
 
 	mutex_enter(&spa->spa_iokstat_lock);
 	ASSERT3U(spa->spa_queue_stats[zio->io_priority].spa_queued, >, 0);
@@ -280,6 +379,7 @@ vdev_queue_pending_add(vdev_queue_t *vq, zio_t *zio)
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	vq->vq_class[zio->io_priority].vqc_active++;
 	avl_add(&vq->vq_active_tree, zio);
+	zio->io_dispatched = gethrtime();
 
 	mutex_enter(&spa->spa_iokstat_lock);
 	spa->spa_queue_stats[zio->io_priority].spa_active++;
@@ -296,6 +396,8 @@ vdev_queue_pending_remove(vdev_queue_t *vq, zio_t *zio)
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	vq->vq_class[zio->io_priority].vqc_active--;
 	avl_remove(&vq->vq_active_tree, zio);
+	vdev_queue_histo_add(vq->vq_class[zio->io_priority].vqc_disk_histo,
+	    gethrtime() - zio->io_dispatched);
 
 	mutex_enter(&spa->spa_iokstat_lock);
 	ASSERT3U(spa->spa_queue_stats[zio->io_priority].spa_active, >, 0);
@@ -343,6 +445,8 @@ vdev_queue_class_min_active(zio_priority_t p)
 		return (zfs_vdev_async_write_min_active);
 	case ZIO_PRIORITY_SCRUB:
 		return (zfs_vdev_scrub_min_active);
+	case ZIO_PRIORITY_TRIM:
+		return (zfs_vdev_trim_min_active);
 	default:
 		panic("invalid priority %u", p);
 		return (0);
@@ -394,6 +498,8 @@ vdev_queue_class_max_active(spa_t *spa, zio_priority_t p)
 		    spa->spa_dsl_pool->dp_dirty_total));
 	case ZIO_PRIORITY_SCRUB:
 		return (zfs_vdev_scrub_max_active);
+	case ZIO_PRIORITY_TRIM:
+		return (zfs_vdev_trim_max_active);
 	default:
 		panic("invalid priority %u", p);
 		return (0);
@@ -671,11 +777,14 @@ vdev_queue_io(zio_t *zio)
 		    zio->io_priority != ZIO_PRIORITY_ASYNC_READ &&
 		    zio->io_priority != ZIO_PRIORITY_SCRUB)
 			zio->io_priority = ZIO_PRIORITY_ASYNC_READ;
-	} else {
-		ASSERT(zio->io_type == ZIO_TYPE_WRITE);
+	} else if (zio->io_type == ZIO_TYPE_WRITE) {
 		if (zio->io_priority != ZIO_PRIORITY_SYNC_WRITE &&
 		    zio->io_priority != ZIO_PRIORITY_ASYNC_WRITE)
 			zio->io_priority = ZIO_PRIORITY_ASYNC_WRITE;
+	} else {
+		ASSERT(zio->io_type == ZIO_TYPE_IOCTL &&
+		    zio->io_cmd == DKIOCFREE);
+		zio->io_priority = ZIO_PRIORITY_TRIM;
 	}
 
 	zio->io_flags |= ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE;
@@ -165,6 +165,14 @@ typedef struct raidz_map {
  */
 int vdev_raidz_default_to_general;
 
+/*
+ * Reconstruction multiplies every byte of a column by a constant.  By
+ * default this is done with a 256-entry product table built once per
+ * constant (see vdev_raidz_mul_table()); clear this to fall back to a
+ * log/exp lookup per byte.
+ */
+int vdev_raidz_mul_tables = 1;
+
 /* Powers of 2 in the Galois field defined above. */
 static const uint8_t vdev_raidz_pow2[256] = {
 	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
@@ -257,6 +265,32 @@ vdev_raidz_exp2(uint_t a, int exp)
 	return (vdev_raidz_pow2[exp]);
 }
 
+/*
+ * Build the table of products c * x for every byte x.  Multiplication
+ * distributes over addition (XOR), so the product of a byte is the XOR of
+ * the products of its two nibbles; we compute those 32 products and
+ * combine them, the same split that vector shuffle implementations use.
+ */
+static void
+vdev_raidz_mul_table(uint8_t c, uint8_t *tbl)
+{
+	uint8_t lo[16], hi[16];
+	int i, exp;
+
+	if (c == 0) {
+		bzero(tbl, 256);
+		return;
+	}
+
+	exp = vdev_raidz_log2[c];
+	for (i = 0; i < 16; i++) {
+		lo[i] = vdev_raidz_exp2(i, exp);
+		hi[i] = vdev_raidz_exp2(i << 4, exp);
+	}
+	for (i = 0; i < 256; i++)
+		tbl[i] = lo[i & 0xf] ^ hi[i >> 4];
+}
+
 static void
 vdev_raidz_map_free(raidz_map_t *rm)
 {
@@ -832,6 +866,20 @@ vdev_raidz_reconstruct_q(raidz_map_t *rm, int *tgts, int ntgts)
 	dst = rm->rm_col[x].rc_data;
 	exp = 255 - (rm->rm_cols - 1 - x);
 
+	if (vdev_raidz_mul_tables) {
+		uint8_t *tbl = kmem_alloc(256, KM_SLEEP);
+
+		vdev_raidz_mul_table(vdev_raidz_pow2[exp], tbl);
+		for (i = 0; i < xcount; i++, dst++, src++) {
+			*dst ^= *src;
+			for (j = 0, b = (uint8_t *)dst; j < 8; j++, b++) {
+				*b = tbl[*b];
+			}
+		}
+		kmem_free(tbl, 256);
+		return (1 << VDEV_RAIDZ_Q);
+	}
+
 	for (i = 0; i < xcount; i++, dst++, src++) {
 		*dst ^= *src;
 		for (j = 0, b = (uint8_t *)dst; j < 8; j++, b++) {
@@ -911,12 +959,29 @@ vdev_raidz_reconstruct_pq(raidz_map_t *rm, int *tgts, int ntgts)
 	aexp = vdev_raidz_log2[vdev_raidz_exp2(a, tmp)];
 	bexp = vdev_raidz_log2[vdev_raidz_exp2(b, tmp)];
 
-	for (i = 0; i < xsize; i++, p++, q++, pxy++, qxy++, xd++, yd++) {
-		*xd = vdev_raidz_exp2(*p ^ *pxy, aexp) ^
-		    vdev_raidz_exp2(*q ^ *qxy, bexp);
+	if (vdev_raidz_mul_tables) {
+		uint8_t *atbl = kmem_alloc(2 * 256, KM_SLEEP);
+		uint8_t *btbl = atbl + 256;
+
+		vdev_raidz_mul_table(vdev_raidz_pow2[aexp], atbl);
+		vdev_raidz_mul_table(vdev_raidz_pow2[bexp], btbl);
+		for (i = 0; i < xsize; i++, p++, q++, pxy++, qxy++, xd++,
+		    yd++) {
+			*xd = atbl[*p ^ *pxy] ^ btbl[*q ^ *qxy];
+
+			if (i < ysize)
+				*yd = *p ^ *pxy ^ *xd;
+		}
+		kmem_free(atbl, 2 * 256);
+	} else {
+		for (i = 0; i < xsize; i++, p++, q++, pxy++, qxy++, xd++,
+		    yd++) {
+			*xd = vdev_raidz_exp2(*p ^ *pxy, aexp) ^
+			    vdev_raidz_exp2(*q ^ *qxy, bexp);
 
-		if (i < ysize)
-			*yd = *p ^ *pxy ^ *xd;
+			if (i < ysize)
+				*yd = *p ^ *pxy ^ *xd;
+		}
 	}
 
 	zio_buf_free(rm->rm_col[VDEV_RAIDZ_P].rc_data,
@@ -1221,15 +1286,18 @@ vdev_raidz_matrix_reconstruct(raidz_map_t *rm, int n, int nmissing,
 	uint8_t val;
 	int ll;
 	uint8_t *invlog[VDEV_RAIDZ_MAXPARITY];
+	uint8_t *mul[VDEV_RAIDZ_MAXPARITY];
 	uint8_t *p, *pp;
 	size_t psize;
 
-	psize = sizeof (invlog[0][0]) * n * nmissing;
+	psize = sizeof (invlog[0][0]) * (n + 256) * nmissing;
 	p = kmem_alloc(psize, KM_SLEEP);
 
 	for (pp = p, i = 0; i < nmissing; i++) {
 		invlog[i] = pp;
 		pp += n;
+		mul[i] = pp;
+		pp += 256;
 	}
 
 	for (i = 0; i < nmissing; i++) {
@@ -1257,6 +1325,24 @@ vdev_raidz_matrix_reconstruct(raidz_map_t *rm, int n, int nmissing,
 
 		ASSERT(ccount >= rm->rm_col[missing[0]].rc_size || i > 0);
 
+		if (vdev_raidz_mul_tables) {
+			for (cc = 0; cc < nmissing; cc++) {
+				uint8_t *tbl = mul[cc];
+				uint8_t *d = dst[cc];
+				uint64_t count = MIN(ccount, dcount[cc]);
+
+				vdev_raidz_mul_table(invrows[cc][i], tbl);
+				if (i == 0) {
+					for (x = 0; x < count; x++)
+						d[x] = tbl[src[x]];
+				} else {
+					for (x = 0; x < count; x++)
+						d[x] ^= tbl[src[x]];
+				}
+			}
+			continue;
+		}
+
 		for (x = 0; x < ccount; x++, src++) {
 			if (*src != 0)
 				log = vdev_raidz_log2[*src];
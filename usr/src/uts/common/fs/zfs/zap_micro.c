@@ -33,6 +33,10 @@
 #include <sys/zap_leaf.h>
 #include <sys/avl.h>
 #include <sys/arc.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_pool.h>
+#include <sys/dsl_synctask.h>
+#include <sys/zfeature.h>
 
 #ifdef _KERNEL
 #include <sys/sunddi.h>
@@ -218,16 +222,20 @@ zap_name_alloc_uint64(zap_t *zap, const uint64_t *key, int numints)
 static void
 mzap_byteswap(mzap_phys_t *buf, size_t size)
 {
-	int i, max;
+	int i, max, shift = MZAP_ENT_SHIFT;
 	buf->mz_block_type = BSWAP_64(buf->mz_block_type);
 	buf->mz_salt = BSWAP_64(buf->mz_salt);
 	buf->mz_normflags = BSWAP_64(buf->mz_normflags);
-	max = (size / MZAP_ENT_LEN) - 1;
+	if (buf->mz_block_type == ZBT_MICRO_WIDE) {
+		buf->mz_entshift = BSWAP_64(buf->mz_entshift);
+		shift = buf->mz_entshift;
+	}
+	max = (size >> shift) - 1;
 	for (i = 0; i < max; i++) {
-		buf->mz_chunk[i].mze_value =
-		    BSWAP_64(buf->mz_chunk[i].mze_value);
-		buf->mz_chunk[i].mze_cd =
-		    BSWAP_32(buf->mz_chunk[i].mze_cd);
+		mzap_ent_phys_t *mze =
+		    (mzap_ent_phys_t *)((char *)buf + ((i + 1) << shift));
+		mze->mze_value = BSWAP_64(mze->mze_value);
+		mze->mze_cd = BSWAP_32(mze->mze_cd);
 	}
 }
 
@@ -238,7 +246,9 @@ zap_byteswap(void *buf, size_t size)
 
 	block_type = *(uint64_t *)buf;
 
-	if (block_type == ZBT_MICRO || block_type == BSWAP_64(ZBT_MICRO)) {
+	if (block_type == ZBT_MICRO || block_type == BSWAP_64(ZBT_MICRO) ||
+	    block_type == ZBT_MICRO_WIDE ||
+	    block_type == BSWAP_64(ZBT_MICRO_WIDE)) {
 		/* ASSERT(magic == ZAP_LEAF_MAGIC); */
 		mzap_byteswap(buf, size);
 	} else {
@@ -372,7 +382,8 @@ mzap_open(objset_t *os, uint64_t obj, dmu_buf_t *db)
 	zap->zap_object = obj;
 	zap->zap_dbuf = db;
 
-	if (*(uint64_t *)db->db_data != ZBT_MICRO) {
+	if (*(uint64_t *)db->db_data != ZBT_MICRO &&
+	    *(uint64_t *)db->db_data != ZBT_MICRO_WIDE) {
 		mutex_init(&zap->zap_f.zap_num_entries_mtx, 0, 0, 0);
 		zap->zap_f.zap_block_shift = highbit64(db->db_size) - 1;
 	} else {
@@ -398,13 +409,22 @@ mzap_open(objset_t *os, uint64_t obj, dmu_buf_t *db)
 	if (zap->zap_ismicro) {
 		zap->zap_salt = zap->zap_m.zap_phys->mz_salt;
 		zap->zap_normflags = zap->zap_m.zap_phys->mz_normflags;
-		zap->zap_m.zap_num_chunks = db->db_size / MZAP_ENT_LEN - 1;
+		if (zap->zap_m.zap_phys->mz_block_type == ZBT_MICRO_WIDE) {
+			zap->zap_m.zap_entshift =
+			    zap->zap_m.zap_phys->mz_entshift;
+			ASSERT3U(zap->zap_m.zap_entshift, >, MZAP_ENT_SHIFT);
+			ASSERT3U(zap->zap_m.zap_entshift, <=,
+			    MZAP_WIDE_MAX_SHIFT);
+		} else {
+			zap->zap_m.zap_entshift = MZAP_ENT_SHIFT;
+		}
+		zap->zap_m.zap_num_chunks =
+		    (db->db_size >> zap->zap_m.zap_entshift) - 1;
 		avl_create(&zap->zap_m.zap_avl, mze_compare,
 		    sizeof (mzap_ent_t), offsetof(mzap_ent_t, mze_node));
 
 		for (i = 0; i < zap->zap_m.zap_num_chunks; i++) {
-			mzap_ent_phys_t *mze =
-			    &zap->zap_m.zap_phys->mz_chunk[i];
+			mzap_ent_phys_t *mze = MZE_PHYS_CHUNK(zap, i);
 			if (mze->mze_name[0]) {
 				zap_name_t *zn;
 
@@ -508,7 +528,7 @@ zap_lockdir(objset_t *os, uint64_t obj, dmu_tx_t *tx,
 		err = dmu_object_set_blocksize(os, obj, newsz, 0, tx);
 		ASSERT0(err);
 		zap->zap_m.zap_num_chunks =
-		    db->db_size / MZAP_ENT_LEN - 1;
+		    (db->db_size >> zap->zap_m.zap_entshift) - 1;
 	}
 
 	*zapp = zap;
@@ -526,7 +546,7 @@ static int
 mzap_upgrade(zap_t **zapp, dmu_tx_t *tx, zap_flags_t flags)
 {
 	mzap_phys_t *mzp;
-	int i, sz, nchunks;
+	int i, sz, nchunks, shift;
 	int err = 0;
 	zap_t *zap = *zapp;
 
@@ -536,6 +556,7 @@ mzap_upgrade(zap_t **zapp, dmu_tx_t *tx, zap_flags_t flags)
 	mzp = kmem_alloc(sz, KM_SLEEP);
 	bcopy(zap->zap_dbuf->db_data, mzp, sz);
 	nchunks = zap->zap_m.zap_num_chunks;
+	shift = zap->zap_m.zap_entshift;
 
 	if (!flags) {
 		err = dmu_object_set_blocksize(zap->zap_objset, zap->zap_object,
@@ -554,7 +575,8 @@ mzap_upgrade(zap_t **zapp, dmu_tx_t *tx, zap_flags_t flags)
 	fzap_upgrade(zap, tx, flags);
 
 	for (i = 0; i < nchunks; i++) {
-		mzap_ent_phys_t *mze = &mzp->mz_chunk[i];
+		mzap_ent_phys_t *mze =
+		    (mzap_ent_phys_t *)((char *)mzp + ((i + 1) << shift));
 		zap_name_t *zn;
 		if (mze->mze_name[0] == 0)
 			continue;
@@ -572,6 +594,119 @@ mzap_upgrade(zap_t **zapp, dmu_tx_t *tx, zap_flags_t flags)
 	return (err);
 }
 
+/*
+ * Wide micro zaps are gated by a feature that, like lz4_compress, stays
+ * active once any has been written.  From open context the activation
+ * is done by a sync task in the same txg as the widened block.
+ */
+static void
+mzap_widen_activate_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+
+	if (!spa_feature_is_active(spa, SPA_FEATURE_WIDE_MICROZAP))
+		spa_feature_incr(spa, SPA_FEATURE_WIDE_MICROZAP, tx);
+}
+
+/*
+ * Rewrite a micro zap with entries wide enough for a namelen-byte name,
+ * so that it need not be upgraded to a fat zap.  Fails (leaving the zap
+ * unchanged) if the wide_microzap feature is not enabled, if the name
+ * is too long for the widest entry, or if the entries would no longer
+ * fit in one block; the caller then upgrades as it always has.
+ */
+static int
+mzap_widen(zap_t *zap, int namelen, dmu_tx_t *tx)
+{
+	objset_t *os = zap->zap_objset;
+	spa_t *spa = dmu_objset_spa(os);
+	mzap_phys_t *mzp, *newmzp;
+	int i, sz, newsz, nchunks, shift, newshift, n;
+	int err;
+
+	ASSERT(zap->zap_ismicro);
+	ASSERT(RW_WRITE_HELD(&zap->zap_rwlock));
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_WIDE_MICROZAP) ||
+	    namelen >= ZAP_MAXNAMELEN)
+		return (SET_ERROR(ENOTSUP));
+
+	shift = zap->zap_m.zap_entshift;
+	for (newshift = shift + 1; newshift <= MZAP_WIDE_MAX_SHIFT;
+	    newshift++) {
+		if (namelen < (1 << newshift) - MZAP_ENT_LEN + MZAP_NAME_LEN)
+			break;
+	}
+	if (newshift > MZAP_WIDE_MAX_SHIFT)
+		return (SET_ERROR(ENOTSUP));
+
+	/* Room for the header, the existing entries, and the new one. */
+	sz = zap->zap_dbuf->db_size;
+	newsz = P2ROUNDUP((zap->zap_m.zap_num_entries + 2) << newshift,
+	    SPA_MINBLOCKSIZE);
+	newsz = MAX(newsz, sz);
+	if (newsz > MZAP_MAX_BLKSZ)
+		return (SET_ERROR(EFBIG));
+
+	mzp = kmem_alloc(sz, KM_SLEEP);
+	bcopy(zap->zap_dbuf->db_data, mzp, sz);
+	nchunks = zap->zap_m.zap_num_chunks;
+
+	err = dmu_object_set_blocksize(os, zap->zap_object, newsz, 0, tx);
+	if (err) {
+		kmem_free(mzp, sz);
+		return (err);
+	}
+
+	dprintf("widening obj=%llu to %u-byte entries\n",
+	    zap->zap_object, 1 << newshift);
+
+	mze_destroy(zap);
+	newmzp = zap->zap_m.zap_phys;
+	bzero(newmzp, zap->zap_dbuf->db_size);
+	newmzp->mz_block_type = ZBT_MICRO_WIDE;
+	newmzp->mz_salt = mzp->mz_salt;
+	newmzp->mz_normflags = mzp->mz_normflags;
+	newmzp->mz_entshift = newshift;
+
+	zap->zap_m.zap_entshift = newshift;
+	zap->zap_m.zap_num_chunks = (zap->zap_dbuf->db_size >> newshift) - 1;
+	avl_create(&zap->zap_m.zap_avl, mze_compare,
+	    sizeof (mzap_ent_t), offsetof(mzap_ent_t, mze_node));
+
+	n = 0;
+	for (i = 0; i < nchunks; i++) {
+		mzap_ent_phys_t *mze =
+		    (mzap_ent_phys_t *)((char *)mzp + ((i + 1) << shift));
+		mzap_ent_phys_t *newmze;
+		zap_name_t *zn;
+
+		if (mze->mze_name[0] == 0)
+			continue;
+		newmze = MZE_PHYS_CHUNK(zap, n);
+		newmze->mze_value = mze->mze_value;
+		newmze->mze_cd = mze->mze_cd;
+		(void) strcpy(newmze->mze_name, mze->mze_name);
+		zn = zap_name_alloc(zap, newmze->mze_name, MT_EXACT);
+		mze_insert(zap, n, zn->zn_hash);
+		zap_name_free(zn);
+		n++;
+	}
+	ASSERT3U(n, ==, zap->zap_m.zap_num_entries);
+	zap->zap_m.zap_alloc_next = n;
+	kmem_free(mzp, sz);
+
+	if (!spa_feature_is_active(spa, SPA_FEATURE_WIDE_MICROZAP)) {
+		if (dmu_tx_is_syncing(tx)) {
+			mzap_widen_activate_sync(NULL, tx);
+		} else {
+			dsl_sync_task_nowait(dmu_objset_pool(os),
+			    mzap_widen_activate_sync, NULL, 0, tx);
+		}
+	}
+	return (0);
+}
+
 void
 mzap_create_impl(objset_t *os, uint64_t obj, int normflags, zap_flags_t flags,
     dmu_tx_t *tx)
@@ -618,10 +753,20 @@ int
 zap_create_claim_norm(objset_t *os, uint64_t obj, int normflags,
     dmu_object_type_t ot,
     dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx)
+{
+	return (zap_create_claim_norm_dnsize(os, obj, normflags, ot,
+	    bonustype, bonuslen, 0, tx));
+}
+
+int
+zap_create_claim_norm_dnsize(objset_t *os, uint64_t obj, int normflags,
+    dmu_object_type_t ot, dmu_object_type_t bonustype, int bonuslen,
+    int dnodesize, dmu_tx_t *tx)
 {
 	int err;
 
-	err = dmu_object_claim(os, obj, ot, 0, bonustype, bonuslen, tx);
+	err = dmu_object_claim_dnsize(os, obj, ot, 0, bonustype, bonuslen,
+	    dnodesize, tx);
 	if (err != 0)
 		return (err);
 	mzap_create_impl(os, obj, normflags, 0, tx);
@@ -639,7 +784,16 @@ uint64_t
 zap_create_norm(objset_t *os, int normflags, dmu_object_type_t ot,
     dmu_object_type_t bonustype, int bonuslen, dmu_tx_t *tx)
 {
-	uint64_t obj = dmu_object_alloc(os, ot, 0, bonustype, bonuslen, tx);
+	return (zap_create_norm_dnsize(os, normflags, ot, bonustype,
+	    bonuslen, 0, tx));
+}
+
+uint64_t
+zap_create_norm_dnsize(objset_t *os, int normflags, dmu_object_type_t ot,
+    dmu_object_type_t bonustype, int bonuslen, int dnodesize, dmu_tx_t *tx)
+{
+	uint64_t obj = dmu_object_alloc_dnsize(os, ot, 0, bonustype, bonuslen,
+	    dnodesize, tx);
 
 	mzap_create_impl(os, obj, normflags, 0, tx);
 	return (obj);
@@ -763,25 +917,13 @@ zap_lookup(objset_t *os, uint64_t zapobj, const char *name,
 	    num_integers, buf, MT_EXACT, NULL, 0, NULL));
 }
 
-int
-zap_lookup_norm(objset_t *os, uint64_t zapobj, const char *name,
+static int
+zap_lookup_impl(zap_t *zap, zap_name_t *zn,
     uint64_t integer_size, uint64_t num_integers, void *buf,
-    matchtype_t mt, char *realname, int rn_len,
-    boolean_t *ncp)
+    char *realname, int rn_len, boolean_t *ncp)
 {
-	zap_t *zap;
-	int err;
 	mzap_ent_t *mze;
-	zap_name_t *zn;
-
-	err = zap_lockdir(os, zapobj, NULL, RW_READER, TRUE, FALSE, &zap);
-	if (err)
-		return (err);
-	zn = zap_name_alloc(zap, name, mt);
-	if (zn == NULL) {
-		zap_unlockdir(zap);
-		return (SET_ERROR(ENOTSUP));
-	}
+	int err = 0;
 
 	if (!zap->zap_ismicro) {
 		err = fzap_lookup(zn, integer_size, num_integers, buf,
@@ -807,11 +949,140 @@ zap_lookup_norm(objset_t *os, uint64_t zapobj, const char *name,
 			}
 		}
 	}
+	return (err);
+}
+
+int
+zap_lookup_norm(objset_t *os, uint64_t zapobj, const char *name,
+    uint64_t integer_size, uint64_t num_integers, void *buf,
+    matchtype_t mt, char *realname, int rn_len,
+    boolean_t *ncp)
+{
+	zap_t *zap;
+	int err;
+	zap_name_t *zn;
+
+	err = zap_lockdir(os, zapobj, NULL, RW_READER, TRUE, FALSE, &zap);
+	if (err)
+		return (err);
+	zn = zap_name_alloc(zap, name, mt);
+	if (zn == NULL) {
+		zap_unlockdir(zap);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	err = zap_lookup_impl(zap, zn, integer_size, num_integers, buf,
+	    realname, rn_len, ncp);
 	zap_name_free(zn);
 	zap_unlockdir(zap);
 	return (err);
 }
 
+typedef struct zap_multi_ent {
+	zap_name_t	*zme_zn;
+	int		zme_idx;	/* index into the caller's names[] */
+	avl_node_t	zme_node;
+} zap_multi_ent_t;
+
+static int
+zap_multi_compare(const void *a, const void *b)
+{
+	const zap_multi_ent_t *zme1 = a;
+	const zap_multi_ent_t *zme2 = b;
+
+	if (zme1->zme_zn->zn_hash < zme2->zme_zn->zn_hash)
+		return (-1);
+	if (zme1->zme_zn->zn_hash > zme2->zme_zn->zn_hash)
+		return (1);
+	if (zme1->zme_idx < zme2->zme_idx)
+		return (-1);
+	if (zme1->zme_idx > zme2->zme_idx)
+		return (1);
+	return (0);
+}
+
+/*
+ * Issue prefetches for the leaf blocks that the given names hash to.
+ * Walking the names in hash order visits the pointer table in order, so
+ * names that share a leaf are adjacent and each leaf is prefetched once.
+ */
+static void
+fzap_prefetch_multi(zap_t *zap, zap_name_t **zns, int count)
+{
+	zap_multi_ent_t *zmes, *zme;
+	avl_tree_t tree;
+	void *cookie = NULL;
+	uint64_t lastidx = 0;
+	boolean_t first = B_TRUE;
+	int shift = zap->zap_f.zap_phys->zap_ptrtbl.zt_shift;
+
+	zmes = kmem_alloc(count * sizeof (zap_multi_ent_t), KM_SLEEP);
+	avl_create(&tree, zap_multi_compare, sizeof (zap_multi_ent_t),
+	    offsetof(zap_multi_ent_t, zme_node));
+	for (int i = 0; i < count; i++) {
+		if (zns[i] == NULL)
+			continue;
+		zmes[i].zme_zn = zns[i];
+		zmes[i].zme_idx = i;
+		avl_add(&tree, &zmes[i]);
+	}
+
+	for (zme = avl_first(&tree); zme != NULL;
+	    zme = AVL_NEXT(&tree, zme)) {
+		uint64_t idx = ZAP_HASH_IDX(zme->zme_zn->zn_hash, shift);
+
+		if (!first && idx == lastidx)
+			continue;
+		fzap_prefetch(zme->zme_zn);
+		lastidx = idx;
+		first = B_FALSE;
+	}
+
+	while (avl_destroy_nodes(&tree, &cookie) != NULL)
+		continue;
+	avl_destroy(&tree);
+	kmem_free(zmes, count * sizeof (zap_multi_ent_t));
+}
+
+int
+zap_lookup_multi(objset_t *os, uint64_t zapobj, const char **names,
+    int count, matchtype_t mt, uint64_t integer_size,
+    uint64_t num_integers, void *bufs, int *errors)
+{
+	zap_t *zap;
+	zap_name_t **zns;
+	uint64_t bufsize = integer_size * num_integers;
+	int err;
+
+	if (count <= 0)
+		return (0);
+
+	err = zap_lockdir(os, zapobj, NULL, RW_READER, TRUE, FALSE, &zap);
+	if (err)
+		return (err);
+
+	zns = kmem_alloc(count * sizeof (zap_name_t *), KM_SLEEP);
+	for (int i = 0; i < count; i++)
+		zns[i] = zap_name_alloc(zap, names[i], mt);
+
+	if (!zap->zap_ismicro)
+		fzap_prefetch_multi(zap, zns, count);
+
+	for (int i = 0; i < count; i++) {
+		if (zns[i] == NULL) {
+			errors[i] = SET_ERROR(ENOTSUP);
+			continue;
+		}
+		errors[i] = zap_lookup_impl(zap, zns[i], integer_size,
+		    num_integers, (char *)bufs + i * bufsize, NULL, 0, NULL);
+		zap_name_free(zns[i]);
+	}
+
+	kmem_free(zns, count * sizeof (zap_name_t *));
+	zap_unlockdir(zap);
+	return (0);
+}
+
 int
 zap_prefetch_uint64(objset_t *os, uint64_t zapobj, const uint64_t *key,
     int key_numints)
@@ -938,7 +1209,7 @@ mzap_addent(zap_name_t *zn, uint64_t value)
 
 #ifdef ZFS_DEBUG
 	for (i = 0; i < zap->zap_m.zap_num_chunks; i++) {
-		mzap_ent_phys_t *mze = &zap->zap_m.zap_phys->mz_chunk[i];
+		mzap_ent_phys_t *mze = MZE_PHYS_CHUNK(zap, i);
 		ASSERT(strcmp(zn->zn_key_orig, mze->mze_name) != 0);
 	}
 #endif
@@ -949,7 +1220,7 @@ mzap_addent(zap_name_t *zn, uint64_t value)
 
 again:
 	for (i = start; i < zap->zap_m.zap_num_chunks; i++) {
-		mzap_ent_phys_t *mze = &zap->zap_m.zap_phys->mz_chunk[i];
+		mzap_ent_phys_t *mze = MZE_PHYS_CHUNK(zap, i);
 		if (mze->mze_name[0] == 0) {
 			mze->mze_value = value;
 			mze->mze_cd = cd;
@@ -989,11 +1260,14 @@ zap_add(objset_t *os, uint64_t zapobj, const char *key,
 		zap_unlockdir(zap);
 		return (SET_ERROR(ENOTSUP));
 	}
+	if (zap->zap_ismicro && integer_size == 8 && num_integers == 1 &&
+	    strlen(key) >= MZE_NAME_LEN(zap))
+		(void) mzap_widen(zap, strlen(key), tx);
 	if (!zap->zap_ismicro) {
 		err = fzap_add(zn, integer_size, num_integers, val, tx);
 		zap = zn->zn_zap;	/* fzap_add() may change zap */
 	} else if (integer_size != 8 || num_integers != 1 ||
-	    strlen(key) >= MZAP_NAME_LEN) {
+	    strlen(key) >= MZE_NAME_LEN(zap)) {
 		err = mzap_upgrade(&zn->zn_zap, tx, 0);
 		if (err == 0)
 			err = fzap_add(zn, integer_size, num_integers, val, tx);
@@ -1066,11 +1340,14 @@ zap_update(objset_t *os, uint64_t zapobj, const char *name,
 		zap_unlockdir(zap);
 		return (SET_ERROR(ENOTSUP));
 	}
+	if (zap->zap_ismicro && integer_size == 8 && num_integers == 1 &&
+	    strlen(name) >= MZE_NAME_LEN(zap))
+		(void) mzap_widen(zap, strlen(name), tx);
 	if (!zap->zap_ismicro) {
 		err = fzap_update(zn, integer_size, num_integers, val, tx);
 		zap = zn->zn_zap;	/* fzap_update() may change zap */
 	} else if (integer_size != 8 || num_integers != 1 ||
-	    strlen(name) >= MZAP_NAME_LEN) {
+	    strlen(name) >= MZE_NAME_LEN(zap)) {
 		dprintf("upgrading obj %llu: intsz=%u numint=%llu name=%s\n",
 		    zapobj, integer_size, num_integers, name);
 		err = mzap_upgrade(&zn->zn_zap, tx, 0);
@@ -1150,8 +1427,8 @@ zap_remove_norm(objset_t *os, uint64_t zapobj, const char *name,
 			err = SET_ERROR(ENOENT);
 		} else {
 			zap->zap_m.zap_num_entries--;
-			bzero(&zap->zap_m.zap_phys->mz_chunk[mze->mze_chunkid],
-			    sizeof (mzap_ent_phys_t));
+			bzero(MZE_PHYS(zap, mze),
+			    1 << zap->zap_m.zap_entshift);
 			mze_remove(zap, mze);
 		}
 	}
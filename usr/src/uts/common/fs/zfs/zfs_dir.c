@@ -98,6 +98,33 @@ zfs_match_find(zfsvfs_t *zfsvfs, znode_t *dzp, char *name, boolean_t exact,
 	return (error);
 }
 
+/*
+ * Resolve a batch of names in dzp to object numbers with one zap call,
+ * so that a cold fat-zap directory has all of the needed leaf blocks
+ * read in parallel.  Either zoids[i] or errors[i] is set for each name;
+ * the return value is nonzero only if the directory itself could not be
+ * read.  Normalizing file systems match as zfs_match_find() does for a
+ * non-exact lookup; the matched real names are not returned.
+ */
+int
+zfs_dirlook_multi(znode_t *dzp, const char **names, int count,
+    uint64_t *zoids, int *errors)
+{
+	zfsvfs_t *zfsvfs = dzp->z_zfsvfs;
+	int error;
+
+	error = zap_lookup_multi(zfsvfs->z_os, dzp->z_id, names, count,
+	    zfsvfs->z_norm ? MT_FIRST : MT_EXACT, 8, 1, zoids, errors);
+	if (error != 0)
+		return (error);
+
+	for (int i = 0; i < count; i++) {
+		if (errors[i] == 0)
+			zoids[i] = ZFS_DIRENT_OBJ(zoids[i]);
+	}
+	return (0);
+}
+
 /*
  * Lock a directory entry.  A dirlock on <dzp, name> protects that name
  * in dzp's directory zap object.  As long as you hold a dirlock, you can
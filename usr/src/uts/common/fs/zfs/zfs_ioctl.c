@@ -1419,7 +1419,7 @@ zfsvfs_hold(const char *name, void *tag, zfsvfs_t **zfvp, boolean_t writer)
 	if (getzfsvfs(name, zfvp) != 0)
 		error = zfsvfs_create(name, zfvp);
 	if (error == 0) {
-		rrw_enter(&(*zfvp)->z_teardown_lock, (writer) ? RW_WRITER :
+		rrm_enter(&(*zfvp)->z_teardown_lock, (writer) ? RW_WRITER :
 		    RW_READER, tag);
 		if ((*zfvp)->z_unmounted) {
 			/*
@@ -1427,7 +1427,7 @@ zfsvfs_hold(const char *name, void *tag, zfsvfs_t **zfvp, boolean_t writer)
 			 * thread should be just about to disassociate the
 			 * objset from the zfsvfs.
 			 */
-			rrw_exit(&(*zfvp)->z_teardown_lock, tag);
+			rrm_exit(&(*zfvp)->z_teardown_lock, tag);
 			return (SET_ERROR(EBUSY));
 		}
 	}
@@ -1437,7 +1437,7 @@ zfsvfs_hold(const char *name, void *tag, zfsvfs_t **zfvp, boolean_t writer)
 static void
 zfsvfs_rele(zfsvfs_t *zfsvfs, void *tag)
 {
-	rrw_exit(&zfsvfs->z_teardown_lock, tag);
+	rrm_exit(&zfsvfs->z_teardown_lock, tag);
 
 	if (zfsvfs->z_vfs) {
 		VFS_RELE(zfsvfs->z_vfs);
@@ -1759,6 +1759,27 @@ zfs_ioc_pool_reguid(zfs_cmd_t *zc)
 	return (error);
 }
 
+/*
+ * inputs:
+ * zc_name		name of the pool
+ *
+ * Starts trimming all free space in the pool; the trim runs in the
+ * background.
+ */
+static int
+zfs_ioc_pool_trim(zfs_cmd_t *zc)
+{
+	spa_t *spa;
+	int error;
+
+	error = spa_open(zc->zc_name, &spa, FTAG);
+	if (error == 0) {
+		spa_trim(spa);
+		spa_close(spa, FTAG);
+	}
+	return (error);
+}
+
 static int
 zfs_ioc_dsobj_to_dsname(zfs_cmd_t *zc)
 {
@@ -2261,6 +2282,197 @@ top:
 	return (error);
 }
 
+/*
+ * Most entries one ZFS_IOC_LIST_BATCH call will return.  Each batch is
+ * gathered under a single hold of the pool configuration.
+ */
+int zfs_list_batch_max = 1024;
+
+/*
+ * Add the batch list entry for one dataset: its dmu_objset_stats_t, and
+ * the properties named in "props" (all of them if props is NULL, none if
+ * it is empty).
+ */
+static int
+zfs_list_batch_add(objset_t *os, const char *name, nvlist_t *props,
+    nvlist_t *datasets)
+{
+	dmu_objset_stats_t dds;
+	nvlist_t *entry, *allprops;
+	int error;
+
+	dmu_objset_fast_stat(os, &dds);
+
+	entry = fnvlist_alloc();
+	fnvlist_add_uint8_array(entry, "stats", (uint8_t *)&dds, sizeof (dds));
+
+	if (props != NULL && nvlist_empty(props)) {
+		fnvlist_add_nvlist(datasets, name, entry);
+		fnvlist_free(entry);
+		return (0);
+	}
+
+	if ((error = dsl_prop_get_all(os, &allprops)) != 0) {
+		fnvlist_free(entry);
+		return (error);
+	}
+	dmu_objset_stats(os, allprops);
+	/* See zfs_ioc_objset_stats_impl() for why this is a workaround. */
+	if (!dds.dds_inconsistent && dmu_objset_type(os) == DMU_OST_ZVOL) {
+		error = zvol_get_stats(os, allprops);
+		if (error == EIO) {
+			nvlist_free(allprops);
+			fnvlist_free(entry);
+			return (error);
+		}
+		VERIFY0(error);
+	}
+
+	if (props != NULL) {
+		nvlist_t *wanted = fnvlist_alloc();
+
+		for (nvpair_t *pair = nvlist_next_nvpair(allprops, NULL);
+		    pair != NULL; pair = nvlist_next_nvpair(allprops, pair)) {
+			if (nvlist_exists(props, nvpair_name(pair)))
+				fnvlist_add_nvpair(wanted, pair);
+		}
+		nvlist_free(allprops);
+		allprops = wanted;
+	}
+
+	fnvlist_add_nvlist(entry, "props", allprops);
+	fnvlist_add_nvlist(datasets, name, entry);
+	nvlist_free(allprops);
+	fnvlist_free(entry);
+	return (0);
+}
+
+/*
+ * List many children (or snapshots) of a filesystem in one call.
+ *
+ * innvl: {
+ *     "snapshots" (optional; list fsname's snapshots, not its children)
+ *     "cursor" -> uint64 (optional; from a previous call's outnvl)
+ *     "count" -> uint64 (optional; at most zfs_list_batch_max)
+ *     "props" -> { property 1, property 2, ... } (optional)
+ * }
+ *
+ * outnvl: {
+ *     "datasets" -> {
+ *         name 1 -> { "stats" -> dmu_objset_stats_t, "props" -> { ... } },
+ *         name 2 -> { ... }
+ *     }
+ *     "cursor" -> uint64 (absent once the list is exhausted)
+ * }
+ *
+ * Property values are as returned by ZFS_IOC_OBJSET_STATS.  If "props"
+ * is given, only the named properties are returned; if it is empty,
+ * "props" is omitted from each entry.
+ */
+static int
+zfs_ioc_list_batch(const char *fsname, nvlist_t *innvl, nvlist_t *outnvl)
+{
+	boolean_t snapshots = nvlist_exists(innvl, "snapshots");
+	uint64_t cursor = 0;
+	uint64_t count = zfs_list_batch_max;
+	nvlist_t *props = NULL;
+	nvlist_t *datasets;
+	objset_t *os;
+	char name[MAXNAMELEN];
+	size_t len;
+	int error;
+
+	(void) nvlist_lookup_uint64(innvl, "cursor", &cursor);
+	(void) nvlist_lookup_uint64(innvl, "count", &count);
+	(void) nvlist_lookup_nvlist(innvl, "props", &props);
+	if (count == 0)
+		return (SET_ERROR(EINVAL));
+	count = MIN(count, zfs_list_batch_max);
+
+	if ((error = dmu_objset_hold(fsname, FTAG, &os)) != 0)
+		return (error);
+	if (dmu_objset_is_snapshot(os)) {
+		dmu_objset_rele(os, FTAG);
+		return (SET_ERROR(EINVAL));
+	}
+
+	datasets = fnvlist_alloc();
+
+	/*
+	 * A dataset name of maximum length can have no children or
+	 * snapshots.
+	 */
+	(void) strlcpy(name, fsname, sizeof (name));
+	if (strlcat(name, snapshots ? "@" : "/", sizeof (name)) >=
+	    sizeof (name)) {
+		dmu_objset_rele(os, FTAG);
+		fnvlist_add_nvlist(outnvl, "datasets", datasets);
+		fnvlist_free(datasets);
+		return (0);
+	}
+	len = strlen(name);
+
+	while (count > 0) {
+		objset_t *cos;
+		uint64_t obj;
+
+		name[len] = '\0';
+		if (snapshots) {
+			error = dmu_snapshot_list_next(os, sizeof (name) - len,
+			    name + len, &obj, &cursor, NULL);
+		} else {
+			error = dmu_dir_list_next(os, sizeof (name) - len,
+			    name + len, NULL, &cursor);
+		}
+		if (error != 0)
+			break;
+		if (dataset_name_hidden(name))
+			continue;
+
+		if (snapshots) {
+			dsl_dataset_t *ds;
+
+			error = dsl_dataset_hold_obj(dmu_objset_pool(os), obj,
+			    FTAG, &ds);
+			if (error == 0) {
+				error = dmu_objset_from_ds(ds, &cos);
+				if (error == 0) {
+					error = zfs_list_batch_add(cos, name,
+					    props, datasets);
+				}
+				dsl_dataset_rele(ds, FTAG);
+			}
+		} else {
+			error = dmu_objset_hold(name, FTAG, &cos);
+			if (error == 0) {
+				error = zfs_list_batch_add(cos, name, props,
+				    datasets);
+				dmu_objset_rele(cos, FTAG);
+			}
+		}
+
+		/* We lost a race with destroy; go on to the next one. */
+		if (error == ENOENT) {
+			error = 0;
+			continue;
+		}
+		if (error != 0)
+			break;
+		count--;
+	}
+	dmu_objset_rele(os, FTAG);
+
+	if (error == 0)
+		fnvlist_add_uint64(outnvl, "cursor", cursor);
+	else if (error == ENOENT)
+		error = 0;	/* end of the list */
+
+	if (error == 0)
+		fnvlist_add_nvlist(outnvl, "datasets", datasets);
+	fnvlist_free(datasets);
+	return (error);
+}
+
 /*
  * inputs:
  * zc_name		name of filesystem
@@ -2483,6 +2695,33 @@ zfs_prop_set_special(const char *dsname, zprop_source_t source,
 		err = -1;
 		break;
 	}
+	case ZFS_PROP_DNODESIZE:
+	{
+		if (intval != ZFS_DNSIZE_LEGACY) {
+			spa_t *spa;
+
+			if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+				return (err);
+
+			/*
+			 * Any dnode size other than legacy activates the
+			 * feature, since new objects may now be created
+			 * with large dnodes.
+			 */
+			if (!spa_feature_is_active(spa,
+			    SPA_FEATURE_LARGE_DNODE)) {
+				if ((err = zfs_prop_activate_feature(spa,
+				    SPA_FEATURE_LARGE_DNODE)) != 0) {
+					spa_close(spa, FTAG);
+					return (err);
+				}
+			}
+
+			spa_close(spa, FTAG);
+		}
+		err = -1;
+		break;
+	}
 
 	default:
 		err = -1;
@@ -3849,6 +4088,31 @@ zfs_check_settable(const char *dsname, nvpair_t *pair, cred_t *cr)
 			return (SET_ERROR(ENOTSUP));
 		break;
 
+	case ZFS_PROP_DNODESIZE:
+		if (nvpair_type(pair) == DATA_TYPE_UINT64 &&
+		    nvpair_value_uint64(pair, &intval) == 0 &&
+		    intval != ZFS_DNSIZE_LEGACY) {
+			spa_t *spa;
+
+			if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+				return (err);
+
+			if (!spa_feature_is_enabled(spa,
+			    SPA_FEATURE_LARGE_DNODE)) {
+				spa_close(spa, FTAG);
+				return (SET_ERROR(ENOTSUP));
+			}
+			spa_close(spa, FTAG);
+
+			/*
+			 * The boot loader only understands 512-byte
+			 * dnodes, so keep them on bootable datasets.
+			 */
+			if (zfs_is_bootfs(dsname))
+				return (SET_ERROR(ERANGE));
+		}
+		break;
+
 	case ZFS_PROP_DEDUP:
 		if (zfs_earlier_version(dsname, SPA_VERSION_DEDUP))
 			return (SET_ERROR(ENOTSUP));
@@ -4275,6 +4539,8 @@ out:
  * zc_fromobj	objsetid of incremental fromsnap (may be zero)
  * zc_guid	if set, estimate size of stream only.  zc_cookie is ignored.
  *		output size in zc_objset_type.
+ * zc_flags	ZFS_SEND_COMPRESS to send compressed blocks as they are on
+ *		disk
  *
  * outputs:
  * zc_objset_type	estimated size, if zc_guid is set
@@ -4345,7 +4611,8 @@ zfs_ioc_send(zfs_cmd_t *zc)
 
 		off = fp->f_offset;
 		error = dmu_send_obj(zc->zc_name, zc->zc_sendobj,
-		    zc->zc_fromobj, zc->zc_cookie, fp->f_vnode, &off);
+		    zc->zc_fromobj, (zc->zc_flags & ZFS_SEND_COMPRESS) != 0,
+		    zc->zc_cookie, fp->f_vnode, &off);
 
 		if (VOP_SEEK(fp->f_vnode, fp->f_offset, &off, NULL) == 0)
 			fp->f_offset = off;
@@ -5247,6 +5514,9 @@ zfs_ioc_space_snaps(const char *lastsnap, nvlist_t *innvl, nvlist_t *outnvl)
  * innvl: {
  *     "fd" -> file descriptor to write stream to (int32)
  *     (optional) "fromsnap" -> full snap name to send an incremental from
+ *     (optional) "compressok" -> (value ignored)
+ *         presence indicates compressed blocks may be sent as they are
+ *         on disk, without decompressing them
  * }
  *
  * outnvl is unused
@@ -5259,6 +5529,7 @@ zfs_ioc_send_new(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 	offset_t off;
 	char *fromname = NULL;
 	int fd;
+	boolean_t compressok;
 
 	error = nvlist_lookup_int32(innvl, "fd", &fd);
 	if (error != 0)
@@ -5266,12 +5537,14 @@ zfs_ioc_send_new(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 
 	(void) nvlist_lookup_string(innvl, "fromsnap", &fromname);
 
+	compressok = nvlist_exists(innvl, "compressok");
+
 	file_t *fp = getf(fd);
 	if (fp == NULL)
 		return (SET_ERROR(EBADF));
 
 	off = fp->f_offset;
-	error = dmu_send(snapname, fromname, fd, fp->f_vnode, &off);
+	error = dmu_send(snapname, fromname, compressok, fd, fp->f_vnode, &off);
 
 	if (VOP_SEEK(fp->f_vnode, fp->f_offset, &off, NULL) == 0)
 		fp->f_offset = off;
@@ -5500,6 +5773,10 @@ zfs_ioctl_init(void)
 	    POOL_NAME,
 	    POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY, B_TRUE, B_TRUE);
 
+	zfs_ioctl_register("list_batch", ZFS_IOC_LIST_BATCH,
+	    zfs_ioc_list_batch, zfs_secpolicy_read, DATASET_NAME,
+	    POOL_CHECK_SUSPENDED, B_FALSE, B_FALSE);
+
 	/* IOCTLS that use the legacy function signature */
 
 	zfs_ioctl_register_legacy(ZFS_IOC_POOL_FREEZE, zfs_ioc_pool_freeze,
@@ -5531,6 +5808,8 @@ zfs_ioctl_init(void)
 	    zfs_ioc_vdev_split);
 	zfs_ioctl_register_pool_modify(ZFS_IOC_POOL_REGUID,
 	    zfs_ioc_pool_reguid);
+	zfs_ioctl_register_pool_modify(ZFS_IOC_POOL_TRIM,
+	    zfs_ioc_pool_trim);
 
 	zfs_ioctl_register_pool_meta(ZFS_IOC_POOL_CONFIGS,
 	    zfs_ioc_pool_configs, zfs_secpolicy_none);
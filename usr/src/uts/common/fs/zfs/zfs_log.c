@@ -45,6 +45,7 @@
 #include <sys/zfs_fuid.h>
 #include <sys/ddi.h>
 #include <sys/dsl_dataset.h>
+#include <sys/dnode.h>
 
 /*
  * These zfs_log_* functions must be called within a dmu tx, in one
@@ -210,6 +211,22 @@ zfs_log_fuid_domains(zfs_fuid_info_t *fuidp, void *start)
 	return (start);
 }
 
+/*
+ * Object id to log for a newly created znode, with its dnode slot count
+ * encoded above the object number so that replay can allocate a dnode
+ * of the same size.
+ */
+static uint64_t
+zfs_log_create_foid(znode_t *zp)
+{
+	uint64_t foid = zp->z_id;
+	int dnodesize;
+
+	dmu_object_dnsize_from_db(sa_get_db(zp->z_sa_hdl), &dnodesize);
+	LR_FOID_SET_SLOTS(foid, dnodesize >> DNODE_SHIFT);
+	return (foid);
+}
+
 /*
  * Handles TX_CREATE, TX_CREATE_ATTR, TX_MKDIR, TX_MKDIR_ATTR and
  * TK_MKXATTR transactions.
@@ -277,7 +294,7 @@ zfs_log_create(zilog_t *zilog, dmu_tx_t *tx, uint64_t txtype,
 
 	lr = (lr_create_t *)&itx->itx_lr;
 	lr->lr_doid = dzp->z_id;
-	lr->lr_foid = zp->z_id;
+	lr->lr_foid = zfs_log_create_foid(zp);
 	lr->lr_mode = zp->z_mode;
 	if (!IS_EPHEMERAL(zp->z_uid)) {
 		lr->lr_uid = (uint64_t)zp->z_uid;
@@ -403,7 +420,7 @@ zfs_log_symlink(zilog_t *zilog, dmu_tx_t *tx, uint64_t txtype,
 	itx = zil_itx_create(txtype, sizeof (*lr) + namesize + linksize);
 	lr = (lr_create_t *)&itx->itx_lr;
 	lr->lr_doid = dzp->z_id;
-	lr->lr_foid = zp->z_id;
+	lr->lr_foid = zfs_log_create_foid(zp);
 	lr->lr_uid = zp->z_uid;
 	lr->lr_gid = zp->z_gid;
 	lr->lr_mode = zp->z_mode;
@@ -49,6 +49,10 @@
  * The (hopefully) usual case is of no overlaps or contention for
  * locks. On entry to zfs_lock_range() a rl_t is allocated; the tree
  * searched that finds no overlap, and *this* rl_t is placed in the tree.
+ * The ranges in the tree never overlap one another, so the last entry
+ * covers the highest offsets; a range starting at or past its end (the
+ * pattern of threads extending a file with disjoint writes) is added
+ * after it without searching the tree at all.
  *
  * Overlaps/Reference counting/Proxy locks
  * ---------------------------------------
@@ -97,6 +101,27 @@
 
 #include <sys/zfs_rlock.h>
 
+/*
+ * If the range lies entirely beyond every range in the tree, add it at
+ * the tail and return B_TRUE.
+ */
+static boolean_t
+zfs_range_add_tail(avl_tree_t *tree, rl_t *new)
+{
+	rl_t *last = avl_last(tree);
+
+	if (last == NULL) {
+		avl_add(tree, new);
+		return (B_TRUE);
+	}
+	if (last->r_off + last->r_len <= new->r_off &&
+	    last->r_off < new->r_off) {
+		avl_insert_here(tree, new, last, AVL_AFTER);
+		return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
 /*
  * Check if a write lock can be grabbed, or wait and recheck until available.
  */
@@ -144,11 +169,11 @@ zfs_range_lock_writer(znode_t *zp, rl_t *new)
 		}
 
 		/*
-		 * First check for the usual case of no locks
+		 * First check for the usual cases of no locks, or none
+		 * at or beyond this range.
 		 */
-		if (avl_numnodes(tree) == 0) {
+		if (zfs_range_add_tail(tree, new)) {
 			new->r_type = RL_WRITER; /* convert to writer */
-			avl_add(tree, new);
 			return;
 		}
 
@@ -444,11 +469,10 @@ zfs_range_lock(znode_t *zp, uint64_t off, uint64_t len, rl_type_t type)
 	mutex_enter(&zp->z_range_lock);
 	if (type == RL_READER) {
 		/*
-		 * First check for the usual case of no locks
+		 * First check for the usual cases of no locks, or none
+		 * at or beyond this range.
 		 */
-		if (avl_numnodes(&zp->z_range_avl) == 0)
-			avl_add(&zp->z_range_avl, new);
-		else
+		if (!zfs_range_add_tail(&zp->z_range_avl, new))
 			zfs_range_lock_reader(zp, new);
 	} else
 		zfs_range_lock_writer(zp, new); /* RL_WRITER or RL_APPEND */
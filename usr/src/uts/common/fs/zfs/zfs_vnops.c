@@ -1746,7 +1746,7 @@ top:
 			ASSERT0(error);
 		}
 		mutex_enter(&vp->v_lock);
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		ASSERT0(vp->v_count);
 		mutex_exit(&vp->v_lock);
 		mutex_exit(&zp->z_lock);
@@ -1768,8 +1768,21 @@ out:
 
 	zfs_dirent_unlock(dl);
 
-	if (!delete_now)
-		VN_RELE(vp);
+	/*
+	 * A file too big to delete within this tx is already on the
+	 * unlinked set; if ours is the last hold, release it from the
+	 * pool's taskq so that its (throttled) free happens in the
+	 * background rather than in the caller's unlink().
+	 */
+	if (!delete_now) {
+		if (error == 0 && unlinked && toobig) {
+			dsl_pool_t *dp = dmu_objset_pool(zfsvfs->z_os);
+
+			VN_RELE_ASYNC(vp, dsl_pool_vnrele_taskq(dp));
+		} else {
+			VN_RELE(vp);
+		}
+	}
 	if (xzp)
 		VN_RELE(ZTOV(xzp));
 
@@ -4324,7 +4337,7 @@ zfs_inactive(vnode_t *vp, cred_t *cr, caller_context_t *ct)
 		mutex_enter(&zp->z_lock);
 		mutex_enter(&vp->v_lock);
 		ASSERT(vp->v_count == 1);
-		vp->v_count = 0;
+		VN_RELE_LOCKED(vp);
 		mutex_exit(&vp->v_lock);
 		mutex_exit(&zp->z_lock);
 		rw_exit(&zfsvfs->z_teardown_inactive_lock);
@@ -5107,16 +5120,25 @@ zfs_retzcbuf(vnode_t *vp, xuio_t *xuio, cred_t *cr, caller_context_t *ct)
 
 	ASSERT(xuio->xu_type == UIOTYPE_ZEROCOPY);
 
+	/*
+	 * A read that failed or hit EOF before zfs_read() set up the
+	 * xuio has nothing to give back.
+	 */
+	if (XUIO_XUZC_PRIV(xuio) == NULL) {
+		ASSERT(ioflag == UIO_READ);
+		return (0);
+	}
+
 	i = dmu_xuio_cnt(xuio);
 	while (i-- > 0) {
 		abuf = dmu_xuio_arcbuf(xuio, i);
 		/*
-		 * if abuf == NULL, it must be a write buffer
-		 * that has been returned in zfs_write().
+		 * if abuf == NULL, it must be a write buffer that has
+		 * been returned in zfs_write(), or the tail of a read
+		 * that stopped short.
 		 */
 		if (abuf)
 			dmu_return_arcbuf(abuf);
-		ASSERT(abuf || ioflag == UIO_WRITE);
 	}
 
 	dmu_xuio_fini(xuio);
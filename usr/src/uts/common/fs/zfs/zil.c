@@ -77,7 +77,16 @@ int zil_replay_disable = 0;
  */
 boolean_t zfs_nocacheflush = B_FALSE;
 
+/*
+ * A zil_commit() caller whose itxs landed in an lwb that hasn't been issued
+ * yet waits this percentage of the last lwb's write latency for more itxs
+ * to fill it before issuing it itself.  Larger values trade fsync latency
+ * for fewer, fuller log blocks.
+ */
+int zfs_commit_timeout_pct = 5;
+
 static kmem_cache_t *zil_lwb_cache;
+static kmem_cache_t *zil_zcw_cache;
 
 static void zil_async_to_sync(zilog_t *zilog, uint64_t foid);
 
@@ -439,8 +448,11 @@ zil_alloc_lwb(zilog_t *zilog, blkptr_t *bp, uint64_t txg)
 	lwb->lwb_blk = *bp;
 	lwb->lwb_buf = zio_buf_alloc(BP_GET_LSIZE(bp));
 	lwb->lwb_max_txg = txg;
-	lwb->lwb_zio = NULL;
+	lwb->lwb_state = LWB_STATE_CLOSED;
+	lwb->lwb_write_zio = NULL;
+	lwb->lwb_root_zio = NULL;
 	lwb->lwb_tx = NULL;
+	lwb->lwb_issued_timestamp = 0;
 	if (BP_GET_CHECKSUM(bp) == ZIO_CHECKSUM_ZILOG2) {
 		lwb->lwb_nused = sizeof (zil_chain_t);
 		lwb->lwb_sz = BP_GET_LSIZE(bp);
@@ -456,6 +468,26 @@ zil_alloc_lwb(zilog_t *zilog, blkptr_t *bp, uint64_t txg)
 	return (lwb);
 }
 
+static void
+zil_free_lwb(zilog_t *zilog, lwb_t *lwb)
+{
+	ASSERT(MUTEX_HELD(&zilog->zl_lock));
+	ASSERT(list_is_empty(&lwb->lwb_waiters));
+	ASSERT3P(lwb->lwb_write_zio, ==, NULL);
+	ASSERT3P(lwb->lwb_root_zio, ==, NULL);
+	ASSERT(lwb->lwb_state == LWB_STATE_CLOSED ||
+	    lwb->lwb_state == LWB_STATE_DONE);
+
+	/*
+	 * Clear the zilog's reference so a later lwb doesn't try to chain
+	 * its zio onto this (soon to be free'd) one.
+	 */
+	if (zilog->zl_last_lwb_opened == lwb)
+		zilog->zl_last_lwb_opened = NULL;
+
+	kmem_cache_free(zil_lwb_cache, lwb);
+}
+
 /*
  * Called when we create in-memory log transactions so that we know
  * to cleanup the itxs at the end of spa_sync().
@@ -600,7 +632,7 @@ zil_destroy(zilog_t *zilog, boolean_t keep_first)
 			if (lwb->lwb_buf != NULL)
 				zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
 			zio_free_zil(zilog->zl_spa, txg, &lwb->lwb_blk);
-			kmem_cache_free(zil_lwb_cache, lwb);
+			zil_free_lwb(zilog, lwb);
 		}
 	} else if (!keep_first) {
 		zil_destroy_sync(zilog, tx);
@@ -758,12 +790,9 @@ zil_add_block(zilog_t *zilog, const blkptr_t *bp)
 	if (zfs_nocacheflush)
 		return;
 
-	ASSERT(zilog->zl_writer);
-
 	/*
-	 * Even though we're zl_writer, we still need a lock because the
-	 * zl_get_data() callbacks may have dmu_sync() done callbacks
-	 * that will run concurrently.
+	 * The zl_get_data() callbacks may have dmu_sync() done callbacks
+	 * that run concurrently with each other and with lwb completion.
 	 */
 	mutex_enter(&zilog->zl_vdev_lock);
 	for (i = 0; i < ndvas; i++) {
@@ -778,52 +807,116 @@ zil_add_block(zilog_t *zilog, const blkptr_t *bp)
 }
 
 static void
-zil_flush_vdevs(zilog_t *zilog)
+zil_commit_waiter_skip(zil_commit_waiter_t *zcw)
 {
-	spa_t *spa = zilog->zl_spa;
-	avl_tree_t *t = &zilog->zl_vdev_tree;
-	void *cookie = NULL;
-	zil_vdev_node_t *zv;
-	zio_t *zio;
+	mutex_enter(&zcw->zcw_lock);
+	ASSERT(!zcw->zcw_done);
+	zcw->zcw_done = B_TRUE;
+	cv_broadcast(&zcw->zcw_cv);
+	mutex_exit(&zcw->zcw_lock);
+}
+
+/*
+ * Attach a commit waiter to an lwb; it's signalled from
+ * zil_lwb_flush_vdevs_done() once that lwb is on stable storage.
+ */
+static void
+zil_commit_waiter_link_lwb(zil_commit_waiter_t *zcw, lwb_t *lwb)
+{
+	ASSERT(MUTEX_HELD(&lwb->lwb_zilog->zl_lock));
+	ASSERT(lwb->lwb_state == LWB_STATE_OPENED ||
+	    lwb->lwb_state == LWB_STATE_ISSUED);
+
+	mutex_enter(&zcw->zcw_lock);
+	ASSERT(!list_link_active(&zcw->zcw_node));
+	ASSERT3P(zcw->zcw_lwb, ==, NULL);
+	list_insert_tail(&lwb->lwb_waiters, zcw);
+	zcw->zcw_lwb = lwb;
+	mutex_exit(&zcw->zcw_lock);
+}
+
+/*
+ * Called when an lwb's root zio completes.  By then the log block has been
+ * written, the vdevs it depends on have been flushed, and (through the zio
+ * dependency chain built in zil_lwb_write_open()) every earlier lwb has
+ * completed too, so its waiters can be released.
+ */
+static void
+zil_lwb_flush_vdevs_done(zio_t *zio)
+{
+	lwb_t *lwb = zio->io_private;
+	zilog_t *zilog = lwb->lwb_zilog;
+	dmu_tx_t *tx = lwb->lwb_tx;
+	zil_commit_waiter_t *zcw;
 
-	ASSERT(zilog->zl_writer);
+	spa_config_exit(zilog->zl_spa, SCL_STATE, lwb);
+
+	mutex_enter(&zilog->zl_lock);
 
 	/*
-	 * We don't need zl_vdev_lock here because we're the zl_writer,
-	 * and all zl_get_data() callbacks are done.
+	 * Ensure the lwb buffer pointer is cleared before releasing
+	 * the txg. If we have had an allocation failure and
+	 * the txg is waiting to sync then we want want zil_sync()
+	 * to remove the lwb so that it's not picked up as the next new
+	 * one in zil_process_commit_list(). zil_sync() will only remove
+	 * the lwb if lwb_buf is null.
 	 */
-	if (avl_numnodes(t) == 0)
-		return;
+	lwb->lwb_buf = NULL;
+	lwb->lwb_tx = NULL;
 
-	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	ASSERT3U(lwb->lwb_issued_timestamp, >, 0);
+	zilog->zl_last_lwb_latency = gethrtime() - lwb->lwb_issued_timestamp;
 
-	zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	lwb->lwb_root_zio = NULL;
+	lwb->lwb_state = LWB_STATE_DONE;
 
-	while ((zv = avl_destroy_nodes(t, &cookie)) != NULL) {
-		vdev_t *vd = vdev_lookup_top(spa, zv->zv_vdev);
-		if (vd != NULL)
-			zio_flush(zio, vd);
-		kmem_free(zv, sizeof (*zv));
+	/*
+	 * Remember the highest committed log sequence number for ztest.
+	 * We only update this value when all the log writes succeeded,
+	 * because ztest wants to ASSERT that it got the whole log chain.
+	 * Errors propagate down the chain of root zios, so a clean
+	 * completion of the last lwb opened means every lwb made it.
+	 */
+	if (zilog->zl_last_lwb_opened == lwb && zio->io_error == 0)
+		zilog->zl_commit_lr_seq = zilog->zl_lr_seq;
+
+	while ((zcw = list_head(&lwb->lwb_waiters)) != NULL) {
+		mutex_enter(&zcw->zcw_lock);
+		list_remove(&lwb->lwb_waiters, zcw);
+		ASSERT3P(zcw->zcw_lwb, ==, lwb);
+		zcw->zcw_lwb = NULL;
+		zcw->zcw_zio_error = zio->io_error;
+		ASSERT(!zcw->zcw_done);
+		zcw->zcw_done = B_TRUE;
+		cv_broadcast(&zcw->zcw_cv);
+		mutex_exit(&zcw->zcw_lock);
 	}
 
+	mutex_exit(&zilog->zl_lock);
+
 	/*
-	 * Wait for all the flushes to complete.  Not all devices actually
-	 * support the DKIOCFLUSHWRITECACHE ioctl, so it's OK if it fails.
+	 * Now that we've written this log block, we have a stable pointer
+	 * to the next block in the chain, so it's OK to let the txg in
+	 * which we allocated the next block sync.
 	 */
-	(void) zio_wait(zio);
-
-	spa_config_exit(spa, SCL_STATE, FTAG);
+	dmu_tx_commit(tx);
 }
 
 /*
- * Function called when a log block write completes
+ * Function called when a log block write completes.  The write's done
+ * callback runs before its parent (the lwb's root zio) can complete, so
+ * the cache flushes issued here are children of the root zio and the
+ * lwb isn't DONE until they've finished.
  */
 static void
 zil_lwb_write_done(zio_t *zio)
 {
 	lwb_t *lwb = zio->io_private;
 	zilog_t *zilog = lwb->lwb_zilog;
-	dmu_tx_t *tx = lwb->lwb_tx;
+	spa_t *spa = zio->io_spa;
+	avl_tree_t *t = &zilog->zl_vdev_tree;
+	void *cookie = NULL;
+	zil_vdev_node_t *zv;
 
 	ASSERT(BP_GET_COMPRESS(zio->io_bp) == ZIO_COMPRESS_OFF);
 	ASSERT(BP_GET_TYPE(zio->io_bp) == DMU_OT_INTENT_LOG);
@@ -833,50 +926,87 @@ zil_lwb_write_done(zio_t *zio)
 	ASSERT(!BP_IS_HOLE(zio->io_bp));
 	ASSERT(zio->io_bp->blk_fill == 0);
 
-	/*
-	 * Ensure the lwb buffer pointer is cleared before releasing
-	 * the txg. If we have had an allocation failure and
-	 * the txg is waiting to sync then we want want zil_sync()
-	 * to remove the lwb so that it's not picked up as the next new
-	 * one in zil_commit_writer(). zil_sync() will only remove
-	 * the lwb if lwb_buf is null.
-	 */
 	zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
+
 	mutex_enter(&zilog->zl_lock);
-	lwb->lwb_buf = NULL;
-	lwb->lwb_tx = NULL;
+	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_ISSUED);
+	lwb->lwb_write_zio = NULL;
 	mutex_exit(&zilog->zl_lock);
 
+	if (zio->io_error == 0)
+		zil_add_block(zilog, &lwb->lwb_blk);
+
 	/*
-	 * Now that we've written this log block, we have a stable pointer
-	 * to the next block in the chain, so it's OK to let the txg in
-	 * which we allocated the next block sync.
+	 * Flush every vdev written since the last flush.  That includes this
+	 * log block and the dmu_sync() blocks it references, whose done
+	 * callbacks have already run since they are children of this zio.
+	 * It may also include vdevs touched on behalf of a later lwb; that's
+	 * fine, since the later lwb can't complete before this one does.
+	 * If the write failed there's no point flushing: the error reaches
+	 * the root zio, and from there every later lwb and its waiters.
 	 */
-	dmu_tx_commit(tx);
+	mutex_enter(&zilog->zl_vdev_lock);
+	while ((zv = avl_destroy_nodes(t, &cookie)) != NULL) {
+		if (zio->io_error == 0) {
+			vdev_t *vd = vdev_lookup_top(spa, zv->zv_vdev);
+			if (vd != NULL)
+				zio_flush(lwb->lwb_root_zio, vd);
+		}
+		kmem_free(zv, sizeof (*zv));
+	}
+	mutex_exit(&zilog->zl_vdev_lock);
 }
 
 /*
- * Initialize the io for a log block.
+ * Create the zios for a log block the first time something is committed
+ * to it, moving it from CLOSED to OPENED.
  */
 static void
-zil_lwb_write_init(zilog_t *zilog, lwb_t *lwb)
+zil_lwb_write_open(zilog_t *zilog, lwb_t *lwb)
 {
 	zbookmark_t zb;
+	lwb_t *last_lwb_opened;
+
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+	EQUIV(lwb->lwb_root_zio == NULL, lwb->lwb_state == LWB_STATE_CLOSED);
+	EQUIV(lwb->lwb_root_zio != NULL, lwb->lwb_state == LWB_STATE_OPENED);
+
+	if (lwb->lwb_root_zio != NULL)
+		return;
 
 	SET_BOOKMARK(&zb, lwb->lwb_blk.blk_cksum.zc_word[ZIL_ZC_OBJSET],
 	    ZB_ZIL_OBJECT, ZB_ZIL_LEVEL,
 	    lwb->lwb_blk.blk_cksum.zc_word[ZIL_ZC_SEQ]);
 
-	if (zilog->zl_root_zio == NULL) {
-		zilog->zl_root_zio = zio_root(zilog->zl_spa, NULL, NULL,
-		    ZIO_FLAG_CANFAIL);
-	}
-	if (lwb->lwb_zio == NULL) {
-		lwb->lwb_zio = zio_rewrite(zilog->zl_root_zio, zilog->zl_spa,
-		    0, &lwb->lwb_blk, lwb->lwb_buf, BP_GET_LSIZE(&lwb->lwb_blk),
-		    zil_lwb_write_done, lwb, ZIO_PRIORITY_SYNC_WRITE,
-		    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE, &zb);
+	lwb->lwb_root_zio = zio_root(zilog->zl_spa,
+	    zil_lwb_flush_vdevs_done, lwb, ZIO_FLAG_CANFAIL);
+	lwb->lwb_write_zio = zio_rewrite(lwb->lwb_root_zio, zilog->zl_spa,
+	    0, &lwb->lwb_blk, lwb->lwb_buf, BP_GET_LSIZE(&lwb->lwb_blk),
+	    zil_lwb_write_done, lwb, ZIO_PRIORITY_SYNC_WRITE,
+	    ZIO_FLAG_CANFAIL, &zb);
+
+	mutex_enter(&zilog->zl_lock);
+	lwb->lwb_state = LWB_STATE_OPENED;
+
+	/*
+	 * Make this lwb's root zio a parent of the previous lwb's, so it
+	 * can't complete (and release its waiters) until the previous one
+	 * has.  Several lwbs may be in flight at once, but they complete in
+	 * the order they were opened, as the log chain requires.  The check
+	 * of lwb_state is done under zl_lock, which the previous lwb's done
+	 * callback takes before its root zio can be free'd.
+	 */
+	last_lwb_opened = zilog->zl_last_lwb_opened;
+	if (last_lwb_opened != NULL &&
+	    last_lwb_opened->lwb_state != LWB_STATE_DONE) {
+		ASSERT(last_lwb_opened->lwb_state == LWB_STATE_OPENED ||
+		    last_lwb_opened->lwb_state == LWB_STATE_ISSUED);
+		ASSERT3P(last_lwb_opened->lwb_root_zio, !=, NULL);
+		zio_add_child(lwb->lwb_root_zio,
+		    last_lwb_opened->lwb_root_zio);
 	}
+	zilog->zl_last_lwb_opened = lwb;
+	mutex_exit(&zilog->zl_lock);
 }
 
 /*
@@ -905,10 +1035,10 @@ uint64_t zil_slog_limit = 1024 * 1024;
 
 /*
  * Start a log block write and advance to the next log block.
- * Calls are serialized.
+ * Calls are serialized by zl_issuer_lock.
  */
 static lwb_t *
-zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
+zil_lwb_write_issue(zilog_t *zilog, lwb_t *lwb)
 {
 	lwb_t *nlwb = NULL;
 	zil_chain_t *zilc;
@@ -919,6 +1049,9 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	uint64_t zil_blksz, wsz;
 	int i, error;
 
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+	ASSERT3S(lwb->lwb_state, ==, LWB_STATE_OPENED);
+
 	if (BP_GET_CHECKSUM(&lwb->lwb_blk) == ZIO_CHECKSUM_ZILOG2) {
 		zilc = (zil_chain_t *)lwb->lwb_buf;
 		bp = &zilc->zc_next_blk;
@@ -934,7 +1067,8 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	 * before writing it in order to establish the log chain.
 	 * Note that if the allocation of nlwb synced before we wrote
 	 * the block that points at it (lwb), we'd leak it if we crashed.
-	 * Therefore, we don't do dmu_tx_commit() until zil_lwb_write_done().
+	 * Therefore, we don't do dmu_tx_commit() until the lwb is done; see
+	 * zil_lwb_flush_vdevs_done().
 	 * We dirty the dataset to ensure that zil_sync() will be called
 	 * to clean up in the event of allocation failure or I/O failure.
 	 */
@@ -985,16 +1119,13 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 		 * Allocate a new log write buffer (lwb).
 		 */
 		nlwb = zil_alloc_lwb(zilog, bp, txg);
-
-		/* Record the block for later vdev flushing */
-		zil_add_block(zilog, &lwb->lwb_blk);
 	}
 
 	if (BP_GET_CHECKSUM(&lwb->lwb_blk) == ZIO_CHECKSUM_ZILOG2) {
 		/* For Slim ZIL only write what is used. */
 		wsz = P2ROUNDUP_TYPED(lwb->lwb_nused, ZIL_MIN_BLKSZ, uint64_t);
 		ASSERT3U(wsz, <=, lwb->lwb_sz);
-		zio_shrink(lwb->lwb_zio, wsz);
+		zio_shrink(lwb->lwb_write_zio, wsz);
 
 	} else {
 		wsz = lwb->lwb_sz;
@@ -1009,7 +1140,20 @@ zil_lwb_write_start(zilog_t *zilog, lwb_t *lwb)
 	 */
 	bzero(lwb->lwb_buf + lwb->lwb_nused, wsz - lwb->lwb_nused);
 
-	zio_nowait(lwb->lwb_zio); /* Kick off the write for the old log block */
+	/*
+	 * The vdevs in zl_vdev_tree are looked up and flushed from
+	 * zil_lwb_write_done(); keep the config stable until the lwb is done.
+	 */
+	spa_config_enter(spa, SCL_STATE, lwb, RW_READER);
+
+	mutex_enter(&zilog->zl_lock);
+	lwb->lwb_issued_timestamp = gethrtime();
+	lwb->lwb_state = LWB_STATE_ISSUED;
+	mutex_exit(&zilog->zl_lock);
+
+	/* Kick off the write for the old log block */
+	zio_nowait(lwb->lwb_root_zio);
+	zio_nowait(lwb->lwb_write_zio);
 
 	/*
 	 * If there was an allocation failure then nlwb will be null which
@@ -1028,29 +1172,40 @@ zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 	uint64_t reclen = lrc->lrc_reclen;
 	uint64_t dlen = 0;
 
-	if (lwb == NULL)
-		return (NULL);
-
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
 	ASSERT(lwb->lwb_buf != NULL);
 	ASSERT(zilog_is_dirty(zilog) ||
 	    spa_freeze_txg(zilog->zl_spa) != UINT64_MAX);
 
+	zil_lwb_write_open(zilog, lwb);
+
+	/*
+	 * A commit itx has no log record; it only marks the point in the
+	 * itx stream that a zil_commit() caller is waiting for.  Hand its
+	 * waiter to this lwb, which signals it when the lwb is done.
+	 */
+	if (lrc->lrc_txtype == TX_COMMIT) {
+		mutex_enter(&zilog->zl_lock);
+		zil_commit_waiter_link_lwb(itx->itx_private, lwb);
+		itx->itx_private = NULL;
+		mutex_exit(&zilog->zl_lock);
+		return (lwb);
+	}
+
 	if (lrc->lrc_txtype == TX_WRITE && itx->itx_wr_state == WR_NEED_COPY)
 		dlen = P2ROUNDUP_TYPED(
 		    lrw->lr_length, sizeof (uint64_t), uint64_t);
 
 	zilog->zl_cur_used += (reclen + dlen);
 
-	zil_lwb_write_init(zilog, lwb);
-
 	/*
 	 * If this record won't fit in the current log block, start a new one.
 	 */
 	if (lwb->lwb_nused + reclen + dlen > lwb->lwb_sz) {
-		lwb = zil_lwb_write_start(zilog, lwb);
+		lwb = zil_lwb_write_issue(zilog, lwb);
 		if (lwb == NULL)
 			return (NULL);
-		zil_lwb_write_init(zilog, lwb);
+		zil_lwb_write_open(zilog, lwb);
 		ASSERT(LWB_EMPTY(lwb));
 		if (lwb->lwb_nused + reclen + dlen > lwb->lwb_sz) {
 			txg_wait_synced(zilog->zl_dmu_pool, txg);
@@ -1082,7 +1237,7 @@ zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 				dbuf = NULL;
 			}
 			error = zilog->zl_get_data(
-			    itx->itx_private, lrw, dbuf, lwb->lwb_zio);
+			    itx->itx_private, lrw, dbuf, lwb->lwb_write_zio);
 			if (error == EIO) {
 				txg_wait_synced(zilog->zl_dmu_pool, txg);
 				return (lwb);
@@ -1101,7 +1256,7 @@ zil_lwb_commit(zilog_t *zilog, itx_t *itx, lwb_t *lwb)
 	 * equal to the itx sequence number because not all transactions
 	 * are synchronous, and sometimes spa_sync() gets there first.
 	 */
-	lrc->lrc_seq = ++zilog->zl_lr_seq; /* we are single threaded */
+	lrc->lrc_seq = ++zilog->zl_lr_seq; /* under zl_issuer_lock */
 	lwb->lwb_nused += reclen + dlen;
 	lwb->lwb_max_txg = MAX(lwb->lwb_max_txg, txg);
 	ASSERT3U(lwb->lwb_nused, <=, lwb->lwb_sz);
@@ -1148,6 +1303,15 @@ zil_itxg_clean(itxs_t *itxs)
 
 	list = &itxs->i_sync_list;
 	while ((itx = list_head(list)) != NULL) {
+		/*
+		 * A commit itx normally leaves through zil_lwb_commit(), but
+		 * its txg can sync (and be cleaned) before the committing
+		 * thread gets to it, e.g. if zil_create() or a stalled writer
+		 * waited for a txg.  Everything it was waiting for is on disk
+		 * then, so release the waiter here.
+		 */
+		if (itx->itx_lr.lrc_txtype == TX_COMMIT)
+			zil_commit_waiter_skip(itx->itx_private);
 		list_remove(list, itx);
 		kmem_free(itx, offsetof(itx_t, itx_lr) +
 		    itx->itx_lr.lrc_reclen);
@@ -1436,78 +1600,343 @@ zil_async_to_sync(zilog_t *zilog, uint64_t foid)
 	}
 }
 
+/*
+ * Commit itxs at the head of the commit list have nothing to write; if
+ * the last lwb opened is already done (or there is none), everything
+ * before them is on stable storage and their waiters can be released
+ * right away, otherwise they just wait on that lwb.
+ */
 static void
-zil_commit_writer(zilog_t *zilog)
+zil_prune_commit_list(zilog_t *zilog)
 {
-	uint64_t txg;
 	itx_t *itx;
-	lwb_t *lwb;
-	spa_t *spa = zilog->zl_spa;
-	int error = 0;
 
-	ASSERT(zilog->zl_root_zio == NULL);
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
 
-	mutex_exit(&zilog->zl_lock);
+	while ((itx = list_head(&zilog->zl_itx_commit_list)) != NULL) {
+		lwb_t *last_lwb;
+
+		if (itx->itx_lr.lrc_txtype != TX_COMMIT)
+			break;
+
+		mutex_enter(&zilog->zl_lock);
+		last_lwb = zilog->zl_last_lwb_opened;
+		if (last_lwb == NULL ||
+		    last_lwb->lwb_state == LWB_STATE_DONE) {
+			zil_commit_waiter_skip(itx->itx_private);
+		} else {
+			zil_commit_waiter_link_lwb(itx->itx_private, last_lwb);
+			itx->itx_private = NULL;
+		}
+		mutex_exit(&zilog->zl_lock);
+
+		list_remove(&zilog->zl_itx_commit_list, itx);
+		zil_itx_destroy(itx);
+	}
+}
+
+/*
+ * If we failed to allocate the next log block, the on-disk chain ends at
+ * the last lwb issued, so nothing more can be written to the log until
+ * spa_sync() has caught up: wait for the txg holding all of the issued
+ * lwbs (which zil_sync() then frees) before letting anyone open a new
+ * chain.  zl_issuer_lock is held, so no other thread can issue meanwhile.
+ */
+static void
+zil_commit_writer_stall(zilog_t *zilog)
+{
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
+	txg_wait_synced(zilog->zl_dmu_pool, 0);
+	ASSERT3P(list_tail(&zilog->zl_lwb_list), ==, NULL);
+}
+
+/*
+ * Write the itxs on zl_itx_commit_list into lwbs, issuing each lwb as it
+ * fills.  The last lwb is deliberately left open: if more commits follow
+ * shortly, their itxs fill it before it's written, and if not, the
+ * waiter's timeout in zil_commit_waiter() issues it.
+ */
+static void
+zil_process_commit_list(zilog_t *zilog)
+{
+	spa_t *spa = zilog->zl_spa;
+	list_t nolwb_waiters;
+	zil_commit_waiter_t *zcw;
+	lwb_t *lwb;
+	itx_t *itx;
 
-	zil_get_commit_list(zilog);
+	ASSERT(MUTEX_HELD(&zilog->zl_issuer_lock));
 
 	/*
 	 * Return if there's nothing to commit before we dirty the fs by
 	 * calling zil_create().
 	 */
-	if (list_head(&zilog->zl_itx_commit_list) == NULL) {
-		mutex_enter(&zilog->zl_lock);
+	if (list_head(&zilog->zl_itx_commit_list) == NULL)
 		return;
-	}
 
-	if (zilog->zl_suspend) {
-		lwb = NULL;
+	list_create(&nolwb_waiters, sizeof (zil_commit_waiter_t),
+	    offsetof(zil_commit_waiter_t, zcw_node));
+
+	lwb = list_tail(&zilog->zl_lwb_list);
+	if (lwb == NULL) {
+		lwb = zil_create(zilog);
 	} else {
-		lwb = list_tail(&zilog->zl_lwb_list);
-		if (lwb == NULL)
-			lwb = zil_create(zilog);
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_ISSUED);
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_DONE);
 	}
 
 	DTRACE_PROBE1(zil__cw1, zilog_t *, zilog);
-	while (itx = list_head(&zilog->zl_itx_commit_list)) {
-		txg = itx->itx_lr.lrc_txg;
+	while ((itx = list_head(&zilog->zl_itx_commit_list)) != NULL) {
+		lr_t *lrc = &itx->itx_lr;
+		uint64_t txg = lrc->lrc_txg;
+
 		ASSERT(txg);
 
-		if (txg > spa_last_synced_txg(spa) || txg > spa_freeze_txg(spa))
-			lwb = zil_lwb_commit(zilog, itx, lwb);
+		if (txg > spa_last_synced_txg(spa) ||
+		    txg > spa_freeze_txg(spa)) {
+			if (lwb != NULL) {
+				lwb = zil_lwb_commit(zilog, itx, lwb);
+			} else if (lrc->lrc_txtype == TX_COMMIT) {
+				zcw = itx->itx_private;
+				mutex_enter(&zcw->zcw_lock);
+				list_insert_tail(&nolwb_waiters, zcw);
+				mutex_exit(&zcw->zcw_lock);
+			}
+		} else if (lrc->lrc_txtype == TX_COMMIT) {
+			/*
+			 * The txg this commit itx was assigned to has
+			 * already synced, and with it everything its waiter
+			 * cares about, so there's no lwb to wait for.
+			 */
+			zil_commit_waiter_skip(itx->itx_private);
+		}
+
 		list_remove(&zilog->zl_itx_commit_list, itx);
-		kmem_free(itx, offsetof(itx_t, itx_lr)
-		    + itx->itx_lr.lrc_reclen);
+		zil_itx_destroy(itx);
 	}
 	DTRACE_PROBE1(zil__cw2, zilog_t *, zilog);
 
-	/* write the last block out */
-	if (lwb != NULL && lwb->lwb_zio != NULL)
-		lwb = zil_lwb_write_start(zilog, lwb);
+	if (lwb == NULL) {
+		/*
+		 * We couldn't allocate a log block, so fall back to
+		 * txg_wait_synced(); the waiters whose commit itxs found no
+		 * lwb have to be released here since no lwb will do it.
+		 */
+		zil_commit_writer_stall(zilog);
+
+		while ((zcw = list_head(&nolwb_waiters)) != NULL) {
+			list_remove(&nolwb_waiters, zcw);
+			zil_commit_waiter_skip(zcw);
+		}
+	} else {
+		ASSERT(list_is_empty(&nolwb_waiters));
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_ISSUED);
+		ASSERT3S(lwb->lwb_state, !=, LWB_STATE_DONE);
+	}
 
-	zilog->zl_cur_used = 0;
+	list_destroy(&nolwb_waiters);
+}
+
+static void
+zil_commit_writer(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	boolean_t processed;
+
+	ASSERT(!MUTEX_HELD(&zilog->zl_lock));
+	ASSERT(spa_writeable(zilog->zl_spa));
+
+	mutex_enter(&zilog->zl_issuer_lock);
 
 	/*
-	 * Wait if necessary for the log blocks to be on stable storage.
+	 * Another thread may have committed our waiter's itx while we were
+	 * waiting for zl_issuer_lock; if so there's nothing left for us to
+	 * do, and not walking the itx lists keeps the lock hold time short.
 	 */
-	if (zilog->zl_root_zio) {
-		error = zio_wait(zilog->zl_root_zio);
-		zilog->zl_root_zio = NULL;
-		zil_flush_vdevs(zilog);
+	mutex_enter(&zcw->zcw_lock);
+	processed = (zcw->zcw_lwb != NULL || zcw->zcw_done);
+	mutex_exit(&zcw->zcw_lock);
+
+	if (!processed) {
+		zil_get_commit_list(zilog);
+		zil_prune_commit_list(zilog);
+		zil_process_commit_list(zilog);
 	}
 
-	if (error || lwb == NULL)
-		txg_wait_synced(zilog->zl_dmu_pool, 0);
+	mutex_exit(&zilog->zl_issuer_lock);
+}
 
-	mutex_enter(&zilog->zl_lock);
+/*
+ * The waiter's lwb is still open and nobody filled it within the timeout,
+ * so issue it ourselves.  Called with zcw_lock held, which we have to drop
+ * to take zl_issuer_lock in the right order.
+ */
+static void
+zil_commit_waiter_timeout(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	lwb_t *lwb = zcw->zcw_lwb;
+	lwb_t *nlwb;
+
+	ASSERT(MUTEX_HELD(&zcw->zcw_lock));
+	ASSERT(!MUTEX_HELD(&zilog->zl_issuer_lock));
+	ASSERT(!zcw->zcw_done);
+	ASSERT3P(lwb, !=, NULL);
+
+	if (lwb->lwb_state != LWB_STATE_OPENED)
+		return;
+
+	mutex_exit(&zcw->zcw_lock);
+	mutex_enter(&zilog->zl_issuer_lock);
+	mutex_enter(&zcw->zcw_lock);
 
 	/*
-	 * Remember the highest committed log sequence number for ztest.
-	 * We only update this value when all the log writes succeeded,
-	 * because ztest wants to ASSERT that it got the whole log chain.
+	 * Once the waiter is done its lwb may already have been free'd, and
+	 * if the lwb was issued while we dropped the lock there's nothing
+	 * left to do.  lwb_state can't move past OPENED without
+	 * zl_issuer_lock, which we now hold.
 	 */
-	if (error == 0 && lwb != NULL)
-		zilog->zl_commit_lr_seq = zilog->zl_lr_seq;
+	if (zcw->zcw_done || lwb->lwb_state != LWB_STATE_OPENED) {
+		mutex_exit(&zilog->zl_issuer_lock);
+		return;
+	}
+	ASSERT3P(lwb, ==, zcw->zcw_lwb);
+
+	nlwb = zil_lwb_write_issue(zilog, lwb);
+
+	/*
+	 * The lwb wasn't filled before the timeout, so it was bigger than
+	 * the current commit rate needs; restart the size accounting that
+	 * picks the next block size.
+	 */
+	zilog->zl_cur_used = 0;
+
+	if (nlwb == NULL) {
+		/*
+		 * zil_lwb_flush_vdevs_done() needs our zcw_lock to signal
+		 * us, so drop it while the txg syncs.
+		 */
+		mutex_exit(&zcw->zcw_lock);
+		zil_commit_writer_stall(zilog);
+		mutex_enter(&zcw->zcw_lock);
+	}
+
+	mutex_exit(&zilog->zl_issuer_lock);
+}
+
+/*
+ * Wait for the waiter's commit itx to reach stable storage.  While its
+ * lwb is still open we only sleep for a fraction of the last lwb's
+ * latency, giving other committers a chance to add to it; after that we
+ * issue it and wait for it to complete.
+ */
+static void
+zil_commit_waiter(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	hrtime_t pct = MAX(zfs_commit_timeout_pct, 1);
+	hrtime_t wakeup;
+	boolean_t timedout = B_FALSE;
+
+	ASSERT(!MUTEX_HELD(&zilog->zl_lock));
+	ASSERT(!MUTEX_HELD(&zilog->zl_issuer_lock));
+
+	mutex_enter(&zcw->zcw_lock);
+
+	wakeup = gethrtime() + (zilog->zl_last_lwb_latency * pct) / 100;
+
+	while (!zcw->zcw_done) {
+		lwb_t *lwb = zcw->zcw_lwb;
+
+		/*
+		 * The lwb is usually set here, but it can still be NULL if
+		 * our commit itx's txg synced before it was committed and
+		 * zil_itxg_clean() hasn't released us yet.
+		 */
+		IMPLY(lwb != NULL, lwb->lwb_state != LWB_STATE_CLOSED);
+
+		if (lwb != NULL && lwb->lwb_state == LWB_STATE_OPENED &&
+		    !timedout) {
+			if (cv_timedwait_hires(&zcw->zcw_cv, &zcw->zcw_lock,
+			    wakeup, NANOSEC / MICROSEC,
+			    CALLOUT_FLAG_ABSOLUTE) != -1 || zcw->zcw_done)
+				continue;
+
+			timedout = B_TRUE;
+			zil_commit_waiter_timeout(zilog, zcw);
+		} else {
+			cv_wait(&zcw->zcw_cv, &zcw->zcw_lock);
+		}
+	}
+
+	mutex_exit(&zcw->zcw_lock);
+}
+
+static zil_commit_waiter_t *
+zil_alloc_commit_waiter(void)
+{
+	zil_commit_waiter_t *zcw = kmem_cache_alloc(zil_zcw_cache, KM_SLEEP);
+
+	cv_init(&zcw->zcw_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&zcw->zcw_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_link_init(&zcw->zcw_node);
+	zcw->zcw_lwb = NULL;
+	zcw->zcw_done = B_FALSE;
+	zcw->zcw_zio_error = 0;
+
+	return (zcw);
+}
+
+static void
+zil_free_commit_waiter(zil_commit_waiter_t *zcw)
+{
+	ASSERT(!list_link_active(&zcw->zcw_node));
+	ASSERT3P(zcw->zcw_lwb, ==, NULL);
+	ASSERT(zcw->zcw_done);
+	mutex_destroy(&zcw->zcw_lock);
+	cv_destroy(&zcw->zcw_cv);
+	kmem_cache_free(zil_zcw_cache, zcw);
+}
+
+/*
+ * Queue a commit itx for the waiter behind everything already on the
+ * sync lists, in the currently open txg.
+ */
+static void
+zil_commit_itx_assign(zilog_t *zilog, zil_commit_waiter_t *zcw)
+{
+	dmu_tx_t *tx = dmu_tx_create(zilog->zl_os);
+	itx_t *itx;
+
+	VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+
+	itx = zil_itx_create(TX_COMMIT, sizeof (lr_t));
+	itx->itx_sync = B_TRUE;
+	itx->itx_private = zcw;
+
+	zil_itx_assign(zilog, itx, tx);
+
+	dmu_tx_commit(tx);
+}
+
+static void
+zil_commit_impl(zilog_t *zilog, uint64_t foid)
+{
+	zil_commit_waiter_t *zcw;
+
+	/* move the async itxs for the foid to the sync queues */
+	zil_async_to_sync(zilog, foid);
+
+	zcw = zil_alloc_commit_waiter();
+	zil_commit_itx_assign(zilog, zcw);
+	zil_commit_writer(zilog, zcw);
+	zil_commit_waiter(zilog, zcw);
+
+	/*
+	 * If writing the log blocks we were waiting on failed, fall back
+	 * to spa_sync() to get our data onto stable storage.
+	 */
+	if (zcw->zcw_zio_error != 0)
+		txg_wait_synced(zilog->zl_dmu_pool, 0);
+
+	zil_free_commit_waiter(zcw);
 }
 
 /*
@@ -1515,57 +1944,39 @@ zil_commit_writer(zilog_t *zilog)
  * If foid is 0 push out all transactions, otherwise push only those
  * for that object or might reference that object.
  *
- * itxs are committed in batches. In a heavily stressed zil there will be
- * a commit writer thread who is writing out a bunch of itxs to the log
- * for a set of committing threads (cthreads) in the same batch as the writer.
- * Those cthreads are all waiting on the same cv for that batch.
- *
- * There will also be a different and growing batch of threads that are
- * waiting to commit (qthreads). When the committing batch completes
- * a transition occurs such that the cthreads exit and the qthreads become
- * cthreads. One of the new cthreads becomes the writer thread for the
- * batch. Any new threads arriving become new qthreads.
- *
- * Only 2 condition variables are needed and there's no transition
- * between the two cvs needed. They just flip-flop between qthreads
- * and cthreads.
- *
- * Using this scheme we can efficiently wakeup up only those threads
- * that have been committed.
+ * Each caller queues a TX_COMMIT itx behind the itxs it needs and then
+ * waits only for the lwb that itx ends up in, rather than for a whole
+ * batch.  Whichever thread holds zl_issuer_lock writes out every itx on
+ * the sync lists, including other callers' commit itxs, so concurrent
+ * committers naturally share lwbs; issued lwbs are written in parallel
+ * and complete in order.  The last lwb is left open briefly (see
+ * zfs_commit_timeout_pct) so that itxs arriving within a fraction of
+ * the log device's latency are batched into it.
  */
 void
 zil_commit(zilog_t *zilog, uint64_t foid)
 {
-	uint64_t mybatch;
-
 	if (zilog->zl_sync == ZFS_SYNC_DISABLED)
 		return;
 
-	/* move the async itxs for the foid to the sync queues */
-	zil_async_to_sync(zilog, foid);
+	/*
+	 * Nothing can be pending on a pool that isn't writeable, and we
+	 * mustn't try to assign a tx for the commit itx.
+	 */
+	if (!spa_writeable(zilog->zl_spa))
+		return;
 
-	mutex_enter(&zilog->zl_lock);
-	mybatch = zilog->zl_next_batch;
-	while (zilog->zl_writer) {
-		cv_wait(&zilog->zl_cv_batch[mybatch & 1], &zilog->zl_lock);
-		if (mybatch <= zilog->zl_com_batch) {
-			mutex_exit(&zilog->zl_lock);
-			return;
-		}
+	/*
+	 * While the log is suspended we can't write lwbs (and mustn't
+	 * dirty the log with a commit itx); txg_wait_synced() gives the
+	 * same guarantee.
+	 */
+	if (zilog->zl_suspend > 0) {
+		txg_wait_synced(zilog->zl_dmu_pool, 0);
+		return;
 	}
 
-	zilog->zl_next_batch++;
-	zilog->zl_writer = B_TRUE;
-	zil_commit_writer(zilog);
-	zilog->zl_com_batch = mybatch;
-	zilog->zl_writer = B_FALSE;
-	mutex_exit(&zilog->zl_lock);
-
-	/* wake up one thread to become the next writer */
-	cv_signal(&zilog->zl_cv_batch[(mybatch+1) & 1]);
-
-	/* wake up all threads waiting for this batch to be committed */
-	cv_broadcast(&zilog->zl_cv_batch[mybatch & 1]);
+	zil_commit_impl(zilog, foid);
 }
 
 /*
@@ -1625,7 +2036,7 @@ zil_sync(zilog_t *zilog, dmu_tx_t *tx)
 			break;
 		list_remove(&zilog->zl_lwb_list, lwb);
 		zio_free_zil(spa, txg, &lwb->lwb_blk);
-		kmem_cache_free(zil_lwb_cache, lwb);
+		zil_free_lwb(zilog, lwb);
 
 		/*
 		 * If we don't have anything left in the lwb list then
@@ -1639,16 +2050,40 @@ zil_sync(zilog_t *zilog, dmu_tx_t *tx)
 	mutex_exit(&zilog->zl_lock);
 }
 
+/*ARGSUSED*/
+static int
+zil_lwb_cons(void *vbuf, void *unused, int kmflag)
+{
+	lwb_t *lwb = vbuf;
+
+	list_create(&lwb->lwb_waiters, sizeof (zil_commit_waiter_t),
+	    offsetof(zil_commit_waiter_t, zcw_node));
+	return (0);
+}
+
+/*ARGSUSED*/
+static void
+zil_lwb_dest(void *vbuf, void *unused)
+{
+	lwb_t *lwb = vbuf;
+
+	list_destroy(&lwb->lwb_waiters);
+}
+
 void
 zil_init(void)
 {
 	zil_lwb_cache = kmem_cache_create("zil_lwb_cache",
-	    sizeof (struct lwb), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	    sizeof (struct lwb), 0, zil_lwb_cons, zil_lwb_dest, NULL, NULL,
+	    NULL, 0);
+	zil_zcw_cache = kmem_cache_create("zil_zcw_cache",
+	    sizeof (zil_commit_waiter_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 }
 
 void
 zil_fini(void)
 {
+	kmem_cache_destroy(zil_zcw_cache);
 	kmem_cache_destroy(zil_lwb_cache);
 }
 
@@ -1678,9 +2113,9 @@ zil_alloc(objset_t *os, zil_header_t *zh_phys)
 	zilog->zl_destroy_txg = TXG_INITIAL - 1;
 	zilog->zl_logbias = dmu_objset_logbias(os);
 	zilog->zl_sync = dmu_objset_syncprop(os);
-	zilog->zl_next_batch = 1;
 
 	mutex_init(&zilog->zl_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&zilog->zl_issuer_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	for (int i = 0; i < TXG_SIZE; i++) {
 		mutex_init(&zilog->zl_itxg[i].itxg_lock, NULL,
@@ -1698,10 +2133,7 @@ zil_alloc(objset_t *os, zil_header_t *zh_phys)
 	avl_create(&zilog->zl_vdev_tree, zil_vdev_compare,
 	    sizeof (zil_vdev_node_t), offsetof(zil_vdev_node_t, zv_node));
 
-	cv_init(&zilog->zl_cv_writer, NULL, CV_DEFAULT, NULL);
 	cv_init(&zilog->zl_cv_suspend, NULL, CV_DEFAULT, NULL);
-	cv_init(&zilog->zl_cv_batch[0], NULL, CV_DEFAULT, NULL);
-	cv_init(&zilog->zl_cv_batch[1], NULL, CV_DEFAULT, NULL);
 
 	return (zilog);
 }
@@ -1737,11 +2169,9 @@ zil_free(zilog_t *zilog)
 	}
 
 	mutex_destroy(&zilog->zl_lock);
+	mutex_destroy(&zilog->zl_issuer_lock);
 
-	cv_destroy(&zilog->zl_cv_writer);
 	cv_destroy(&zilog->zl_cv_suspend);
-	cv_destroy(&zilog->zl_cv_batch[0]);
-	cv_destroy(&zilog->zl_cv_batch[1]);
 
 	kmem_free(zilog, sizeof (zilog_t));
 }
@@ -1802,9 +2232,10 @@ zil_close(zilog_t *zilog)
 	lwb = list_head(&zilog->zl_lwb_list);
 	if (lwb != NULL) {
 		ASSERT(lwb == list_tail(&zilog->zl_lwb_list));
+		ASSERT3S(lwb->lwb_state, ==, LWB_STATE_CLOSED);
 		list_remove(&zilog->zl_lwb_list, lwb);
 		zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
-		kmem_cache_free(zil_lwb_cache, lwb);
+		zil_free_lwb(zilog, lwb);
 	}
 	mutex_exit(&zilog->zl_lock);
 }
@@ -1906,7 +2337,14 @@ zil_suspend(const char *osname, void **cookiep)
 	zilog->zl_suspending = B_TRUE;
 	mutex_exit(&zilog->zl_lock);
 
-	zil_commit(zilog, 0);
+	/*
+	 * zl_suspend is already set, so zil_commit() would only wait for a
+	 * txg sync, which doesn't wait for lwbs that are opened or issued.
+	 * Commit them directly, then let spa_sync() migrate their contents
+	 * into the pool before the log is destroyed.
+	 */
+	zil_commit_impl(zilog, 0);
+	txg_wait_synced(zilog->zl_dmu_pool, 0);
 
 	zil_destroy(zilog, B_FALSE);
 
@@ -34,6 +34,8 @@
 #include <sys/zio_compress.h>
 #include <sys/zio_checksum.h>
 #include <sys/dmu_objset.h>
+#include <sys/abd.h>
+#include <sys/blkptr.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
 #include <sys/zfeature.h>
@@ -143,7 +145,8 @@ zio_init(void)
 			char name[36];
 			(void) sprintf(name, "zio_buf_%lu", (ulong_t)size);
 			zio_buf_cache[c] = kmem_cache_create(name, size,
-			    align, NULL, NULL, NULL, NULL, NULL, cflags);
+			    align, NULL, NULL, NULL, NULL, NULL,
+			    cflags | KMC_FASTREAP);
 
 			/*
 			 * Since zio_data bufs do not appear in crash dumps, we
@@ -153,7 +156,7 @@ zio_init(void)
 			(void) sprintf(name, "zio_data_buf_%lu", (ulong_t)size);
 			zio_data_buf_cache[c] = kmem_cache_create(name, size,
 			    align, NULL, NULL, NULL, NULL, data_alloc_arena,
-			    cflags | KMC_NOTOUCH);
+			    cflags | KMC_NOTOUCH | KMC_FASTREAP);
 		}
 	}
 
@@ -167,6 +170,7 @@ zio_init(void)
 			zio_data_buf_cache[c - 1] = zio_data_buf_cache[c];
 	}
 
+	abd_init();
 	zio_inject_init();
 }
 
@@ -194,6 +198,7 @@ zio_fini(void)
 	kmem_cache_destroy(zio_link_cache);
 	kmem_cache_destroy(zio_cache);
 
+	abd_fini();
 	zio_inject_fini();
 }
 
@@ -673,9 +678,38 @@ zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite)
 	zio->io_bp_override = bp;
 }
 
+/*
+ * Supply the write's data already compressed, as received in a compressed
+ * send stream, so that zio_write_bp_init() need not compress it again.
+ * The caller keeps ownership of data, which must remain valid until the
+ * write is done, and must decompress to exactly the zio's io_data.
+ */
+void
+zio_write_precompressed(zio_t *zio, enum zio_compress compress, void *data,
+    uint64_t psize)
+{
+	ASSERT(zio->io_type == ZIO_TYPE_WRITE);
+	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
+	ASSERT(zio->io_stage == ZIO_STAGE_OPEN);
+	ASSERT(compress > ZIO_COMPRESS_OFF &&
+	    compress < ZIO_COMPRESS_FUNCTIONS);
+	ASSERT3U(psize, <, zio->io_size);
+
+	zio->io_precompressed = data;
+	zio->io_precompressed_size = psize;
+	zio->io_precompress = compress;
+}
+
 void
 zio_free(spa_t *spa, uint64_t txg, const blkptr_t *bp)
 {
+	/*
+	 * An embedded block has no space allocated to it, so there is
+	 * nothing to free.
+	 */
+	if (BP_IS_EMBEDDED(bp))
+		return;
+
 	metaslab_check_free(spa, bp);
 
 	/*
@@ -700,13 +734,16 @@ zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	zio_t *zio;
 	enum zio_stage stage = ZIO_FREE_PIPELINE;
 
-	dprintf_bp(bp, "freeing in txg %llu, pass %u",
-	    (longlong_t)txg, spa->spa_sync_pass);
-
 	ASSERT(!BP_IS_HOLE(bp));
 	ASSERT(spa_syncing_txg(spa) == txg);
 	ASSERT(spa_sync_pass(spa) < zfs_sync_pass_deferred_free);
 
+	if (BP_IS_EMBEDDED(bp))
+		return (zio_null(pio, spa, NULL, NULL, NULL, 0));
+
+	dprintf_bp(bp, "freeing in txg %llu, pass %u",
+	    (longlong_t)txg, spa->spa_sync_pass);
+
 	metaslab_check_free(spa, bp);
 	arc_freed(spa, bp);
 
@@ -732,6 +769,9 @@ zio_claim(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 {
 	zio_t *zio;
 
+	if (BP_IS_EMBEDDED(bp))
+		return (zio_null(pio, spa, NULL, NULL, NULL, 0));
+
 	/*
 	 * A claim is an allocation of a specific block.  Claims are needed
 	 * to support immediate writes in the intent log.  The issue is that
@@ -779,6 +819,69 @@ zio_ioctl(zio_t *pio, spa_t *spa, vdev_t *vd, int cmd,
 	return (zio);
 }
 
+/*
+ * Trim the range [offset, offset + size) of vd, which is given in vd's own
+ * address space: issue a DKIOCFREE to each leaf below vd for the part of
+ * the range that the leaf stores.  The range must be free; callers are
+ * responsible for keeping it from being reallocated until the trim is
+ * done.  Trims are advisory, so errors are not propagated.
+ */
+zio_t *
+zio_trim(zio_t *pio, spa_t *spa, vdev_t *vd, uint64_t offset, uint64_t size)
+{
+	enum zio_flag flags = ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE |
+	    ZIO_FLAG_DONT_RETRY | ZIO_FLAG_DONT_CACHE |
+	    ZIO_FLAG_DONT_AGGREGATE;
+	zio_t *zio;
+
+	ASSERT(P2PHASE(offset, 1ULL << vd->vdev_top->vdev_ashift) == 0);
+	ASSERT(P2PHASE(size, 1ULL << vd->vdev_top->vdev_ashift) == 0);
+
+	if (vd->vdev_children == 0) {
+		if (vd->vdev_notrim || !vdev_writeable(vd))
+			return (zio_null(pio, spa, NULL, NULL, NULL, flags));
+
+		zio = zio_create(pio, spa, 0, NULL, NULL, size, NULL, NULL,
+		    ZIO_TYPE_IOCTL, ZIO_PRIORITY_TRIM, flags, vd,
+		    offset + VDEV_LABEL_START_SIZE, NULL, ZIO_STAGE_OPEN,
+		    ZIO_TRIM_PIPELINE);
+		zio->io_cmd = DKIOCFREE;
+		return (zio);
+	}
+
+	zio = zio_null(pio, spa, NULL, NULL, NULL, flags);
+
+	if (vd->vdev_ops == &vdev_raidz_ops) {
+		/*
+		 * RAID-Z lays sector b of its address space out on child
+		 * (b % dcols) at child sector (b / dcols), so each child's
+		 * share of a contiguous range is itself contiguous.
+		 */
+		uint64_t ashift = vd->vdev_top->vdev_ashift;
+		uint64_t dcols = vd->vdev_children;
+		uint64_t b = offset >> ashift;
+		uint64_t e = (offset + size) >> ashift;
+
+		for (uint64_t c = 0; c < dcols; c++) {
+			uint64_t cb = (b + dcols - 1 - c) / dcols;
+			uint64_t ce = (e + dcols - 1 - c) / dcols;
+
+			if (ce > cb) {
+				zio_nowait(zio_trim(zio, spa, vd->vdev_child[c],
+				    cb << ashift, (ce - cb) << ashift));
+			}
+		}
+	} else {
+		/* Mirrors, spares and replacing vdevs: same range on all. */
+		for (int c = 0; c < vd->vdev_children; c++) {
+			zio_nowait(zio_trim(zio, spa, vd->vdev_child[c],
+			    offset, size));
+		}
+	}
+
+	return (zio);
+}
+
 zio_t *
 zio_read_phys(zio_t *pio, vdev_t *vd, uint64_t offset, uint64_t size,
     void *data, int checksum, zio_done_func_t *done, void *private,
@@ -938,12 +1041,24 @@ zio_read_bp_init(zio_t *zio)
 	if (BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF &&
 	    zio->io_child_type == ZIO_CHILD_LOGICAL &&
 	    !(zio->io_flags & ZIO_FLAG_RAW)) {
-		uint64_t psize = BP_GET_PSIZE(bp);
+		uint64_t psize =
+		    BP_IS_EMBEDDED(bp) ? BPE_GET_PSIZE(bp) : BP_GET_PSIZE(bp);
 		void *cbuf = zio_buf_alloc(psize);
 
 		zio_push_transform(zio, cbuf, psize, psize, zio_decompress);
 	}
 
+	/*
+	 * An embedded block's data is in the bp itself; copy it out and
+	 * skip straight to the interlock stages.
+	 */
+	if (BP_IS_EMBEDDED(bp) && BPE_GET_ETYPE(bp) == BP_EMBEDDED_TYPE_DATA) {
+		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
+		decode_embedded_bp_compressed(bp, zio->io_data);
+	} else {
+		ASSERT(!BP_IS_EMBEDDED(bp));
+	}
+
 	if (!DMU_OT_IS_METADATA(BP_GET_TYPE(bp)) && BP_GET_LEVEL(bp) == 0)
 		zio->io_flags |= ZIO_FLAG_DONT_CACHE;
 
@@ -1035,13 +1150,24 @@ zio_write_bp_init(zio_t *zio)
 			compress = ZIO_COMPRESS_OFF;
 
 		/* Make sure someone doesn't change their mind on overwrites */
-		ASSERT(MIN(zp->zp_copies + BP_IS_GANG(bp),
+		ASSERT(BP_IS_EMBEDDED(bp) || MIN(zp->zp_copies + BP_IS_GANG(bp),
 		    spa_max_replication(spa)) == BP_GET_NDVAS(bp));
 	}
 
-	if (compress != ZIO_COMPRESS_OFF) {
+	if (zio->io_precompressed != NULL && compress != ZIO_COMPRESS_OFF) {
+		/*
+		 * The data came to us compressed; use it as it is, with
+		 * whatever algorithm it was compressed by.  If compression
+		 * is off for this write, the caller's uncompressed io_data
+		 * is written instead.
+		 */
+		compress = zio->io_precompress;
+		psize = zio->io_precompressed_size;
+		zio_push_transform(zio, zio->io_precompressed, psize, 0, NULL);
+	} else if (compress != ZIO_COMPRESS_OFF) {
 		void *cbuf = zio_buf_alloc(lsize);
-		psize = zio_compress_data(compress, zio->io_data, cbuf, lsize);
+		psize = zio_compress_data(compress, zio->io_data, cbuf, lsize,
+		    &zio->io_compress_saved);
 		if (psize == 0 || psize == lsize) {
 			compress = ZIO_COMPRESS_OFF;
 			zio_buf_free(cbuf, lsize);
@@ -1051,6 +1177,27 @@ zio_write_bp_init(zio_t *zio)
 		}
 	}
 
+	/*
+	 * A level-0 block that compresses small enough to fit in the bp
+	 * is stored there, and needs neither an allocation nor any I/O.
+	 * Block types whose fill count is meaningful are excluded, since
+	 * an embedded bp has no room for it.
+	 */
+	if (compress != ZIO_COMPRESS_OFF && psize <= BPE_PAYLOAD_SIZE &&
+	    !zp->zp_dedup && zp->zp_level == 0 &&
+	    !DMU_OT_HAS_FILL(zp->zp_type) &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_EMBEDDED_DATA)) {
+		encode_embedded_bp_compressed(bp,
+		    zio->io_data, compress, lsize, psize);
+		BPE_SET_ETYPE(bp, BP_EMBEDDED_TYPE_DATA);
+		BP_SET_TYPE(bp, zp->zp_type);
+		BP_SET_LEVEL(bp, zp->zp_level);
+		bp->blk_birth = zio->io_txg;
+		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
+		ASSERT(spa_feature_is_active(spa, SPA_FEATURE_EMBEDDED_DATA));
+		return (ZIO_PIPELINE_CONTINUE);
+	}
+
 	/*
 	 * The final pass of spa_sync() must be all rewrites, but the first
 	 * few passes offer a trade-off: allocating blocks defers convergence,
@@ -1809,6 +1956,7 @@ zio_write_gang_block(zio_t *pio)
 		zp.zp_dedup = B_FALSE;
 		zp.zp_dedup_verify = B_FALSE;
 		zp.zp_nopwrite = B_FALSE;
+		zp.zp_special_smallblk = 0;
 
 		zio_nowait(zio_write(zio, spa, txg, &gbh->zg_blkptr[g],
 		    (char *)pio->io_data + (pio->io_size - resid), lsize, &zp,
@@ -2139,7 +2287,7 @@ zio_ddt_write(zio_t *zio)
 	ASSERT(BP_IS_HOLE(bp) || zio->io_bp_override);
 
 	ddt_enter(ddt);
-	dde = ddt_lookup(ddt, bp, B_TRUE);
+	dde = ddt_lookup_write(ddt, bp);
 	ddp = &dde->dde_phys[p];
 
 	if (zp->zp_dedup_verify && zio_ddt_collision(zio, ddt, dde)) {
@@ -2246,9 +2394,24 @@ zio_ddt_free(zio_t *zio)
 	ddt_enter(ddt);
 	freedde = dde = ddt_lookup(ddt, bp, B_TRUE);
 	ddp = ddt_phys_select(dde, bp);
-	ddt_phys_decref(ddp);
+	if (ddp != NULL)
+		ddt_phys_decref(ddp);
 	ddt_exit(ddt);
 
+	/*
+	 * A dedup block with no matching entry had its unique entry pruned
+	 * (see zfs_ddt_unique_max), so nothing else refers to it and we can
+	 * free it as an ordinary block.
+	 */
+	if (ddp == NULL) {
+		blkptr_t blk = *bp;
+
+		ASSERT(spa->spa_ddt_pruned);
+		BP_SET_DEDUP(&blk, 0);
+		zio_nowait(zio_free_sync(zio, spa, zio->io_txg, &blk,
+		    ZIO_DDT_CHILD_FLAGS(zio)));
+	}
+
 	return (ZIO_PIPELINE_CONTINUE);
 }
 
@@ -2261,7 +2424,7 @@ static int
 zio_dva_allocate(zio_t *zio)
 {
 	spa_t *spa = zio->io_spa;
-	metaslab_class_t *mc = spa_normal_class(spa);
+	metaslab_class_t *mc;
 	blkptr_t *bp = zio->io_bp;
 	int error;
 	int flags = 0;
@@ -2285,9 +2448,22 @@ zio_dva_allocate(zio_t *zio)
 	flags |= (zio->io_flags & ZIO_FLAG_NODATA) ? METASLAB_GANG_AVOID : 0;
 	flags |= (zio->io_flags & ZIO_FLAG_GANG_CHILD) ?
 	    METASLAB_GANG_CHILD : 0;
+
+	mc = spa_preferred_class(spa, zio->io_size, zio->io_prop.zp_type,
+	    zio->io_prop.zp_level, zio->io_prop.zp_special_smallblk);
 	error = metaslab_alloc(spa, mc, zio->io_size, bp,
 	    zio->io_prop.zp_copies, zio->io_txg, NULL, flags);
 
+	/*
+	 * If the special class is full, fall back to the normal class
+	 * before resorting to a gang block.
+	 */
+	if (error == ENOSPC && mc != spa_normal_class(spa)) {
+		mc = spa_normal_class(spa);
+		error = metaslab_alloc(spa, mc, zio->io_size, bp,
+		    zio->io_prop.zp_copies, zio->io_txg, NULL, flags);
+	}
+
 	if (error) {
 		spa_dbgmsg(spa, "%s: metaslab allocation failure: zio %p, "
 		    "size %llu, error %d", spa_name(spa), zio, zio->io_size,
@@ -2483,7 +2659,8 @@ zio_vdev_io_start(zio_t *zio)
 	}
 
 	if (vd->vdev_ops->vdev_op_leaf &&
-	    (zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE)) {
+	    (zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE ||
+	    (zio->io_type == ZIO_TYPE_IOCTL && zio->io_cmd == DKIOCFREE))) {
 
 		if (zio->io_type == ZIO_TYPE_READ && vdev_cache_read(zio))
 			return (ZIO_PIPELINE_CONTINUE);
@@ -2511,7 +2688,9 @@ zio_vdev_io_done(zio_t *zio)
 	if (zio_wait_for_children(zio, ZIO_CHILD_VDEV, ZIO_WAIT_DONE))
 		return (ZIO_PIPELINE_STOP);
 
-	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
+	ASSERT(zio->io_type == ZIO_TYPE_READ ||
+	    zio->io_type == ZIO_TYPE_WRITE ||
+	    (zio->io_type == ZIO_TYPE_IOCTL && zio->io_cmd == DKIOCFREE));
 
 	if (vd != NULL && vd->vdev_ops->vdev_op_leaf) {
 
@@ -2527,10 +2706,11 @@ zio_vdev_io_done(zio_t *zio)
 		if (zio_injection_enabled && zio->io_error == 0)
 			zio->io_error = zio_handle_label_injection(zio, EIO);
 
+		/* A failed trim says nothing about the device's health. */
 		if (zio->io_error) {
 			if (!vdev_accessible(vd, zio)) {
 				zio->io_error = SET_ERROR(ENXIO);
-			} else {
+			} else if (zio->io_type != ZIO_TYPE_IOCTL) {
 				unexpected_error = B_TRUE;
 			}
 		}
@@ -275,3 +275,120 @@ zio_checksum_error(zio_t *zio, zio_bad_cksum_t *info)
 
 	return (0);
 }
+
+/*
+ * fletcher-4 has several implementations (see zfs_fletcher.c).  At load
+ * time each one is checked against the reference implementation, timed
+ * on a maximum-sized block, and the fastest is installed.  The measured
+ * throughput of each, in bytes per second, and the name of the one in use
+ * are in the zfs:0:fletcher_4_bench kstat.  Setting zfs_fletcher_4_impl
+ * to an index into fletcher_4_impls[] overrides the choice.
+ */
+int zfs_fletcher_4_impl = -1;
+int zfs_fletcher_4_bench_loops = 16;
+
+#define	FLETCHER_4_BENCH_SIZE	SPA_MAXBLOCKSIZE
+#define	FLETCHER_4_IMPLS_MAX	8
+
+static kstat_t *fletcher_4_ksp;
+
+static struct {
+	kstat_named_t	fb_selected;
+	kstat_named_t	fb_impl[FLETCHER_4_IMPLS_MAX];
+} fletcher_4_bench_stats = {
+	{ "selected",	KSTAT_DATA_CHAR }
+};
+
+static boolean_t
+fletcher_4_verify(const fletcher_4_ops_t *ops, const void *buf,
+    uint64_t size)
+{
+	const fletcher_4_ops_t *ref = fletcher_4_impls[0];
+	zio_cksum_t expected, actual;
+
+	ref->fo_native(buf, size, &expected);
+	ops->fo_native(buf, size, &actual);
+	if (!ZIO_CHECKSUM_EQUAL(expected, actual))
+		return (B_FALSE);
+
+	ref->fo_byteswap(buf, size, &expected);
+	ops->fo_byteswap(buf, size, &actual);
+	return (ZIO_CHECKSUM_EQUAL(expected, actual));
+}
+
+void
+zio_checksum_init(void)
+{
+	const fletcher_4_ops_t *fastest = fletcher_4_impls[0];
+	uint64_t fastest_bps = 0;
+	uint32_t *buf;
+	int nimpls, i;
+
+	for (nimpls = 0; nimpls < FLETCHER_4_IMPLS_MAX &&
+	    fletcher_4_impls[nimpls] != NULL; nimpls++)
+		continue;
+
+	buf = kmem_alloc(FLETCHER_4_BENCH_SIZE, KM_SLEEP);
+	for (i = 0; i < FLETCHER_4_BENCH_SIZE / sizeof (uint32_t); i++)
+		buf[i] = i * 0x9e3779b1U;
+
+	for (i = 0; i < nimpls; i++) {
+		const fletcher_4_ops_t *ops = fletcher_4_impls[i];
+		kstat_named_t *kn = &fletcher_4_bench_stats.fb_impl[i];
+		zio_cksum_t zc;
+		hrtime_t start, elapsed;
+		uint64_t bps;
+		int l;
+
+		(void) strlcpy(kn->name, ops->fo_name, KSTAT_STRLEN);
+		kn->data_type = KSTAT_DATA_UINT64;
+		kn->value.ui64 = 0;
+
+		/* Try a length that leaves a partial stripe, too. */
+		if (!fletcher_4_verify(ops, buf, FLETCHER_4_BENCH_SIZE) ||
+		    !fletcher_4_verify(ops, buf,
+		    FLETCHER_4_BENCH_SIZE - 3 * sizeof (uint32_t))) {
+			cmn_err(CE_WARN, "fletcher-4 implementation '%s' "
+			    "gives wrong results; not using it", ops->fo_name);
+			continue;
+		}
+
+		start = gethrtime();
+		for (l = 0; l < zfs_fletcher_4_bench_loops; l++)
+			ops->fo_native(buf, FLETCHER_4_BENCH_SIZE, &zc);
+		elapsed = MAX(gethrtime() - start, 1);
+
+		bps = (uint64_t)zfs_fletcher_4_bench_loops *
+		    FLETCHER_4_BENCH_SIZE * NANOSEC / elapsed;
+		kn->value.ui64 = bps;
+		if (bps > fastest_bps) {
+			fastest = ops;
+			fastest_bps = bps;
+		}
+	}
+	kmem_free(buf, FLETCHER_4_BENCH_SIZE);
+
+	if (zfs_fletcher_4_impl >= 0 && zfs_fletcher_4_impl < nimpls)
+		fastest = fletcher_4_impls[zfs_fletcher_4_impl];
+	fletcher_4_impl_set(fastest);
+	(void) strlcpy(fletcher_4_bench_stats.fb_selected.value.c,
+	    fastest->fo_name,
+	    sizeof (fletcher_4_bench_stats.fb_selected.value.c));
+
+	fletcher_4_ksp = kstat_create("zfs", 0, "fletcher_4_bench", "misc",
+	    KSTAT_TYPE_NAMED, 1 + nimpls, KSTAT_FLAG_VIRTUAL);
+	if (fletcher_4_ksp != NULL) {
+		fletcher_4_ksp->ks_data = &fletcher_4_bench_stats;
+		kstat_install(fletcher_4_ksp);
+	}
+}
+
+void
+zio_checksum_fini(void)
+{
+	if (fletcher_4_ksp != NULL) {
+		kstat_delete(fletcher_4_ksp);
+		fletcher_4_ksp = NULL;
+	}
+	fletcher_4_impl_set(fletcher_4_impls[0]);
+}
@@ -60,6 +60,80 @@ zio_compress_info_t zio_compress_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{lz4_compress,		lz4_decompress,		0,	"lz4"},
 };
 
+/*
+ * Per-algorithm statistics, one zfs:0:compress_<algorithm> kstat each: the
+ * blocks handed to the compressor and decompressor, the bytes consumed and
+ * produced, and the time spent, from which ratio and throughput follow.
+ * Blocks found to be all zeroes never reach the compressor and aren't
+ * counted.
+ */
+typedef struct zio_compress_stats {
+	kstat_named_t	zcs_compress;
+	kstat_named_t	zcs_compress_bytes_in;
+	kstat_named_t	zcs_compress_bytes_out;
+	kstat_named_t	zcs_compress_time;
+	kstat_named_t	zcs_compress_fail;
+	kstat_named_t	zcs_early_abort;
+	kstat_named_t	zcs_early_abort_saved;
+	kstat_named_t	zcs_decompress;
+	kstat_named_t	zcs_decompress_bytes_in;
+	kstat_named_t	zcs_decompress_bytes_out;
+	kstat_named_t	zcs_decompress_time;
+} zio_compress_stats_t;
+
+static zio_compress_stats_t zio_compress_stats_template = {
+	{ "compress",			KSTAT_DATA_UINT64 },
+	{ "compress_bytes_in",		KSTAT_DATA_UINT64 },
+	{ "compress_bytes_out",		KSTAT_DATA_UINT64 },
+	{ "compress_time_ns",		KSTAT_DATA_UINT64 },
+	{ "compress_fail",		KSTAT_DATA_UINT64 },
+	{ "early_abort",		KSTAT_DATA_UINT64 },
+	{ "early_abort_saved_ns",	KSTAT_DATA_UINT64 },
+	{ "decompress",			KSTAT_DATA_UINT64 },
+	{ "decompress_bytes_in",	KSTAT_DATA_UINT64 },
+	{ "decompress_bytes_out",	KSTAT_DATA_UINT64 },
+	{ "decompress_time_ns",		KSTAT_DATA_UINT64 },
+};
+
+static zio_compress_stats_t *zio_compress_stats[ZIO_COMPRESS_FUNCTIONS];
+static kstat_t *zio_compress_ksp[ZIO_COMPRESS_FUNCTIONS];
+
+#define	ZCS_ADD(zcs, stat, val) \
+	atomic_add_64(&(zcs)->stat.value.ui64, (val))
+
+/*
+ * Early abort.  Before compressing a block of at least
+ * zfs_compress_sample_min_size bytes, compress ZIO_COMPRESS_SAMPLES samples
+ * of zfs_compress_sample_size bytes taken from its start, middle and end.
+ * If none of the samples shrinks by at least 1/16th, the block as a whole is
+ * very unlikely to shrink by the 12.5% we require, so we store it
+ * uncompressed without running the compressor over the rest of it.  ZLE is
+ * cheaper than the probe and is never sampled.
+ */
+int zfs_compress_early_abort = 1;
+uint64_t zfs_compress_sample_size = 4096;
+uint64_t zfs_compress_sample_min_size = 32768;
+
+#define	ZIO_COMPRESS_SAMPLES	3
+
+static boolean_t
+zio_compress_probe(zio_compress_info_t *ci, void *src, void *dst,
+    size_t s_len, size_t len)
+{
+	size_t d_len = len - (len >> 4);
+
+	for (int i = 0; i < ZIO_COMPRESS_SAMPLES; i++) {
+		size_t off = P2ALIGN((s_len - len) * i /
+		    (ZIO_COMPRESS_SAMPLES - 1), sizeof (uint64_t));
+
+		if (ci->ci_compress((char *)src + off, dst, len, d_len,
+		    ci->ci_level) <= d_len)
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
 enum zio_compress
 zio_compress_select(enum zio_compress child, enum zio_compress parent)
 {
@@ -76,16 +150,29 @@ zio_compress_select(enum zio_compress child, enum zio_compress parent)
 	return (child);
 }
 
+/*
+ * Compress s_len bytes at src into dst, which must have room for s_len
+ * bytes.  Returns the compressed size, s_len if the block didn't compress
+ * well enough to be worth it, or 0 if it is all zeroes.  If savedp isn't
+ * NULL, it is set to an estimate of the compression time avoided by early
+ * abort, or to 0 if the block wasn't skipped.
+ */
 size_t
-zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len)
+zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len,
+    hrtime_t *savedp)
 {
 	uint64_t *word, *word_end;
-	size_t c_len, d_len, r_len;
+	size_t c_len, d_len, r_len, len;
 	zio_compress_info_t *ci = &zio_compress_table[c];
+	zio_compress_stats_t *zcs;
+	hrtime_t start;
 
 	ASSERT((uint_t)c < ZIO_COMPRESS_FUNCTIONS);
 	ASSERT((uint_t)c == ZIO_COMPRESS_EMPTY || ci->ci_compress != NULL);
 
+	if (savedp != NULL)
+		*savedp = 0;
+
 	/*
 	 * If the data is all zeroes, we don't even need to allocate
 	 * a block for it.  We indicate this by returning zero size.
@@ -106,8 +193,40 @@ zio_compress_data(enum zio_compress c, void *src, void *dst, size_t s_len)
 	if (d_len == 0)
 		return (s_len);
 
+	zcs = zio_compress_stats[c];
+	start = gethrtime();
+
+	len = zfs_compress_sample_size;
+	if (zfs_compress_early_abort && c != ZIO_COMPRESS_ZLE &&
+	    len >= SPA_MINBLOCKSIZE && s_len >= zfs_compress_sample_min_size &&
+	    s_len >= len * ZIO_COMPRESS_SAMPLES &&
+	    !zio_compress_probe(ci, src, dst, s_len, len)) {
+		hrtime_t elapsed = gethrtime() - start;
+		hrtime_t saved = MAX(elapsed * s_len /
+		    (len * ZIO_COMPRESS_SAMPLES) - elapsed, 1);
+
+		if (zcs != NULL) {
+			ZCS_ADD(zcs, zcs_early_abort, 1);
+			ZCS_ADD(zcs, zcs_early_abort_saved, saved);
+			ZCS_ADD(zcs, zcs_compress_time, elapsed);
+		}
+		if (savedp != NULL)
+			*savedp = saved;
+		return (s_len);
+	}
+
 	c_len = ci->ci_compress(src, dst, s_len, d_len, ci->ci_level);
 
+	if (zcs != NULL) {
+		ZCS_ADD(zcs, zcs_compress, 1);
+		ZCS_ADD(zcs, zcs_compress_bytes_in, s_len);
+		ZCS_ADD(zcs, zcs_compress_time, gethrtime() - start);
+		if (c_len > d_len)
+			ZCS_ADD(zcs, zcs_compress_fail, 1);
+		else
+			ZCS_ADD(zcs, zcs_compress_bytes_out, c_len);
+	}
+
 	if (c_len > d_len)
 		return (s_len);
 
@@ -132,9 +251,68 @@ zio_decompress_data(enum zio_compress c, void *src, void *dst,
     size_t s_len, size_t d_len)
 {
 	zio_compress_info_t *ci = &zio_compress_table[c];
+	zio_compress_stats_t *zcs;
+	hrtime_t start;
+	int error;
 
 	if ((uint_t)c >= ZIO_COMPRESS_FUNCTIONS || ci->ci_decompress == NULL)
 		return (SET_ERROR(EINVAL));
 
-	return (ci->ci_decompress(src, dst, s_len, d_len, ci->ci_level));
+	start = gethrtime();
+	error = ci->ci_decompress(src, dst, s_len, d_len, ci->ci_level);
+
+	if ((zcs = zio_compress_stats[c]) != NULL) {
+		ZCS_ADD(zcs, zcs_decompress, 1);
+		ZCS_ADD(zcs, zcs_decompress_bytes_in, s_len);
+		ZCS_ADD(zcs, zcs_decompress_bytes_out, d_len);
+		ZCS_ADD(zcs, zcs_decompress_time, gethrtime() - start);
+	}
+
+	return (error);
+}
+
+void
+zio_compress_init(void)
+{
+	for (enum zio_compress c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		zio_compress_info_t *ci = &zio_compress_table[c];
+		zio_compress_stats_t *zcs;
+		char name[KSTAT_STRLEN];
+		kstat_t *ksp;
+
+		if (ci->ci_compress == NULL)
+			continue;
+
+		zcs = kmem_alloc(sizeof (zio_compress_stats_t), KM_SLEEP);
+		bcopy(&zio_compress_stats_template, zcs,
+		    sizeof (zio_compress_stats_t));
+		zio_compress_stats[c] = zcs;
+
+		(void) snprintf(name, sizeof (name), "compress_%s",
+		    ci->ci_name);
+		ksp = kstat_create("zfs", 0, name, "misc", KSTAT_TYPE_NAMED,
+		    sizeof (zio_compress_stats_t) / sizeof (kstat_named_t),
+		    KSTAT_FLAG_VIRTUAL);
+		if (ksp != NULL) {
+			ksp->ks_data = zcs;
+			kstat_install(ksp);
+		}
+		zio_compress_ksp[c] = ksp;
+	}
+}
+
+void
+zio_compress_fini(void)
+{
+	for (enum zio_compress c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		if (zio_compress_ksp[c] != NULL) {
+			kstat_delete(zio_compress_ksp[c]);
+			zio_compress_ksp[c] = NULL;
+		}
+		if (zio_compress_stats[c] != NULL) {
+			kmem_free(zio_compress_stats[c],
+			    sizeof (zio_compress_stats_t));
+			zio_compress_stats[c] = NULL;
+		}
+	}
 }
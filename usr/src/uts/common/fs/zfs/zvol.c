@@ -127,8 +127,23 @@ typedef struct zvol_state {
 	list_t		zv_extents;	/* List of extents for dump */
 	znode_t		zv_znode;	/* for range locking */
 	dmu_buf_t	*zv_dbuf;	/* bonus handle */
+	taskq_t		*zv_taskq;	/* strategy taskq, while open */
+	kmutex_t	zv_io_lock;	/* protects the fields below */
+	kcondvar_t	zv_io_cv;	/* signalled as requests finish */
+	uint32_t	zv_inflight;	/* dispatched, not yet biodone */
+	boolean_t	zv_committing;	/* a task is in zil_commit() */
+	list_t		zv_commit_list;	/* sync writes awaiting commit */
 } zvol_state_t;
 
+/*
+ * A buf handed to the zvol taskq.
+ */
+typedef struct zvol_req {
+	zvol_state_t	*zr_zv;
+	buf_t		*zr_bp;
+	list_node_t	zr_node;	/* on zv_commit_list */
+} zvol_req_t;
+
 /*
  * zvol specific flags
  */
@@ -142,6 +157,17 @@ typedef struct zvol_state {
  */
 int zvol_maxphys = DMU_MAX_ACCESS/2;
 
+/*
+ * zvol_strategy() hands each buf to a per-volume taskq of
+ * zvol_taskq_nthreads threads (read at first open; zero does the I/O in
+ * the caller's context as before), and blocks once zvol_max_inflight
+ * bufs are outstanding on the volume.  Synchronous writes that finish
+ * while another thread is in zil_commit() are gathered and committed
+ * together by that thread.
+ */
+int zvol_taskq_nthreads = 8;
+int zvol_max_inflight = 256;
+
 extern int zfs_set_prop_nvlist(const char *, zprop_source_t,
     nvlist_t *, nvlist_t *);
 static int zvol_remove_zv(zvol_state_t *);
@@ -537,6 +563,10 @@ zvol_create_minor(const char *name)
 	    sizeof (rl_t), offsetof(rl_t, r_node));
 	list_create(&zv->zv_extents, sizeof (zvol_extent_t),
 	    offsetof(zvol_extent_t, ze_node));
+	mutex_init(&zv->zv_io_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zv->zv_io_cv, NULL, CV_DEFAULT, NULL);
+	list_create(&zv->zv_commit_list, sizeof (zvol_req_t),
+	    offsetof(zvol_req_t, zr_node));
 	/* get and cache the blocksize */
 	error = dmu_object_info(os, ZVOL_OBJ, &doi);
 	ASSERT(error == 0);
@@ -579,6 +609,9 @@ zvol_remove_zv(zvol_state_t *zv)
 
 	avl_destroy(&zv->zv_znode.z_range_avl);
 	mutex_destroy(&zv->zv_znode.z_range_lock);
+	list_destroy(&zv->zv_commit_list);
+	cv_destroy(&zv->zv_io_cv);
+	mutex_destroy(&zv->zv_io_lock);
 
 	kmem_free(zv, sizeof (zvol_state_t));
 
@@ -635,6 +668,15 @@ zvol_first_open(zvol_state_t *zv)
 	zvol_size_changed(zv, volsize);
 	zv->zv_zilog = zil_open(os, zvol_get_data);
 
+	if (zvol_taskq_nthreads > 0) {
+		char name[MAXNAMELEN];
+
+		(void) snprintf(name, sizeof (name), "zvol_%u", zv->zv_minor);
+		zv->zv_taskq = taskq_create(name, zvol_taskq_nthreads,
+		    minclsyspri, zvol_taskq_nthreads, INT_MAX,
+		    TASKQ_PREPOPULATE);
+	}
+
 	VERIFY(dsl_prop_get_integer(zv->zv_name, "readonly", &readonly,
 	    NULL) == 0);
 	if (readonly || dmu_objset_is_snapshot(os) ||
@@ -648,6 +690,14 @@ zvol_first_open(zvol_state_t *zv)
 void
 zvol_last_close(zvol_state_t *zv)
 {
+	/* Wait for any dispatched I/O before tearing down the ZIL. */
+	if (zv->zv_taskq != NULL) {
+		taskq_destroy(zv->zv_taskq);
+		zv->zv_taskq = NULL;
+	}
+	ASSERT0(zv->zv_inflight);
+	ASSERT(list_is_empty(&zv->zv_commit_list));
+
 	zil_close(zv->zv_zilog);
 	zv->zv_zilog = NULL;
 
@@ -1200,11 +1250,74 @@ zvol_dumpio(zvol_state_t *zv, void *addr, uint64_t offset, uint64_t size,
 	return (error);
 }
 
-int
-zvol_strategy(buf_t *bp)
+/*
+ * Complete a buf and, if it came through the taskq, release its slot.
+ */
+static void
+zvol_done(zvol_state_t *zv, buf_t *bp, zvol_req_t *zr)
+{
+	biodone(bp);
+	if (zr == NULL)
+		return;
+
+	kmem_free(zr, sizeof (zvol_req_t));
+	mutex_enter(&zv->zv_io_lock);
+	ASSERT(zv->zv_inflight > 0);
+	zv->zv_inflight--;
+	cv_signal(&zv->zv_io_cv);
+	mutex_exit(&zv->zv_io_lock);
+}
+
+/*
+ * Finish a synchronous write whose log record has been assigned.  If no
+ * other thread is committing, commit this write and everything queued
+ * behind it with as few zil_commit() calls as possible; otherwise leave
+ * it for the thread that is.
+ */
+static void
+zvol_commit(zvol_state_t *zv, buf_t *bp, zvol_req_t *zr)
+{
+	list_t done;
+
+	if (zr == NULL) {
+		zil_commit(zv->zv_zilog, ZVOL_OBJ);
+		zvol_done(zv, bp, NULL);
+		return;
+	}
+
+	list_create(&done, sizeof (zvol_req_t), offsetof(zvol_req_t, zr_node));
+
+	mutex_enter(&zv->zv_io_lock);
+	list_insert_tail(&zv->zv_commit_list, zr);
+	if (zv->zv_committing) {
+		mutex_exit(&zv->zv_io_lock);
+		list_destroy(&done);
+		return;
+	}
+	zv->zv_committing = B_TRUE;
+	while (!list_is_empty(&zv->zv_commit_list)) {
+		list_move_tail(&done, &zv->zv_commit_list);
+		mutex_exit(&zv->zv_io_lock);
+
+		zil_commit(zv->zv_zilog, ZVOL_OBJ);
+		while ((zr = list_remove_head(&done)) != NULL)
+			zvol_done(zv, zr->zr_bp, zr);
+
+		mutex_enter(&zv->zv_io_lock);
+	}
+	zv->zv_committing = B_FALSE;
+	mutex_exit(&zv->zv_io_lock);
+
+	list_destroy(&done);
+}
+
+/*
+ * Do the I/O for a buf that zvol_strategy() has validated.  zr is the
+ * taskq request, or NULL if we are in the caller's context.
+ */
+static void
+zvol_strategy_impl(zvol_state_t *zv, buf_t *bp, zvol_req_t *zr)
 {
-	zfs_soft_state_t *zs = NULL;
-	zvol_state_t *zv;
 	uint64_t off, volsize;
 	size_t resid;
 	char *addr;
@@ -1215,46 +1328,15 @@ zvol_strategy(buf_t *bp)
 	boolean_t is_dumpified;
 	boolean_t sync;
 
-	if (getminor(bp->b_edev) == 0) {
-		error = SET_ERROR(EINVAL);
-	} else {
-		zs = ddi_get_soft_state(zfsdev_state, getminor(bp->b_edev));
-		if (zs == NULL)
-			error = SET_ERROR(ENXIO);
-		else if (zs->zss_type != ZSST_ZVOL)
-			error = SET_ERROR(EINVAL);
-	}
-
-	if (error) {
-		bioerror(bp, error);
-		biodone(bp);
-		return (0);
-	}
-
-	zv = zs->zss_data;
-
-	if (!(bp->b_flags & B_READ) && (zv->zv_flags & ZVOL_RDONLY)) {
-		bioerror(bp, EROFS);
-		biodone(bp);
-		return (0);
-	}
-
 	off = ldbtob(bp->b_blkno);
 	volsize = zv->zv_volsize;
 
 	os = zv->zv_objset;
 	ASSERT(os != NULL);
 
-	bp_mapin(bp);
 	addr = bp->b_un.b_addr;
 	resid = bp->b_bcount;
 
-	if (resid > 0 && (off < 0 || off >= volsize)) {
-		bioerror(bp, EIO);
-		biodone(bp);
-		return (0);
-	}
-
 	is_dumpified = zv->zv_flags & ZVOL_DUMPIFIED;
 	sync = ((!(bp->b_flags & B_ASYNC) &&
 	    !(zv->zv_flags & ZVOL_WCE)) ||
@@ -1305,8 +1387,83 @@ zvol_strategy(buf_t *bp)
 		bioerror(bp, off > volsize ? EINVAL : error);
 
 	if (sync)
-		zil_commit(zv->zv_zilog, ZVOL_OBJ);
-	biodone(bp);
+		zvol_commit(zv, bp, zr);
+	else
+		zvol_done(zv, bp, zr);
+}
+
+static void
+zvol_strategy_task(void *arg)
+{
+	zvol_req_t *zr = arg;
+
+	zvol_strategy_impl(zr->zr_zv, zr->zr_bp, zr);
+}
+
+int
+zvol_strategy(buf_t *bp)
+{
+	zfs_soft_state_t *zs = NULL;
+	zvol_state_t *zv;
+	zvol_req_t *zr;
+	uint64_t off;
+	int error = 0;
+
+	if (getminor(bp->b_edev) == 0) {
+		error = SET_ERROR(EINVAL);
+	} else {
+		zs = ddi_get_soft_state(zfsdev_state, getminor(bp->b_edev));
+		if (zs == NULL)
+			error = SET_ERROR(ENXIO);
+		else if (zs->zss_type != ZSST_ZVOL)
+			error = SET_ERROR(EINVAL);
+	}
+
+	if (error) {
+		bioerror(bp, error);
+		biodone(bp);
+		return (0);
+	}
+
+	zv = zs->zss_data;
+
+	if (!(bp->b_flags & B_READ) && (zv->zv_flags & ZVOL_RDONLY)) {
+		bioerror(bp, EROFS);
+		biodone(bp);
+		return (0);
+	}
+
+	off = ldbtob(bp->b_blkno);
+	ASSERT(zv->zv_objset != NULL);
+
+	bp_mapin(bp);
+
+	if (bp->b_bcount > 0 && (off < 0 || off >= zv->zv_volsize)) {
+		bioerror(bp, EIO);
+		biodone(bp);
+		return (0);
+	}
+
+	/*
+	 * Dump I/O stays in the caller's context: it runs below the DMU
+	 * and must not depend on taskq threads.
+	 */
+	if (zv->zv_taskq == NULL || (zv->zv_flags & ZVOL_DUMPIFIED)) {
+		zvol_strategy_impl(zv, bp, NULL);
+		return (0);
+	}
+
+	mutex_enter(&zv->zv_io_lock);
+	while (zvol_max_inflight > 0 && zv->zv_inflight >= zvol_max_inflight)
+		cv_wait(&zv->zv_io_cv, &zv->zv_io_lock);
+	zv->zv_inflight++;
+	mutex_exit(&zv->zv_io_lock);
+
+	zr = kmem_alloc(sizeof (zvol_req_t), KM_SLEEP);
+	zr->zr_zv = zv;
+	zr->zr_bp = bp;
+	list_link_init(&zr->zr_node);
+	(void) taskq_dispatch(zv->zv_taskq, zvol_strategy_task, zr, TQ_SLEEP);
 
 	return (0);
 }
@@ -0,0 +1,108 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef	_INET_CC_H
+#define	_INET_CC_H
+
+/*
+ * TCP congestion control module interface.
+ *
+ * TCP keeps the congestion state it has always kept (tcp_cwnd,
+ * tcp_cwnd_ssthresh, tcp_cwnd_cnt, fast recovery and the ECN CWR logic) and
+ * asks a congestion control algorithm how that state should change at the
+ * points where the standard algorithms differ: when new data is acked, when
+ * congestion is signalled, and when fast recovery ends.
+ *
+ * "newreno" is built into TCP and is always available.  Other algorithms
+ * are kernel modules which call tcp_cc_register() from their _init()
+ * routine and tcp_cc_unregister() from _fini().  The latter fails with
+ * EBUSY while any connection, or any stack's default setting, still refers
+ * to the algorithm, which keeps the module loaded.
+ *
+ * All callbacks are made from the connection's squeue, so an algorithm
+ * needs no locking for its per-connection state.  That state lives in the
+ * tcp_t itself (tcp_cc_data, CC_DATA_SIZE bytes, zeroed before ca_init is
+ * called), so attaching an algorithm never allocates memory.
+ */
+
+#include <sys/types.h>
+#include <sys/list.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	CC_ALGO_NAME_MAX	16	/* including the terminating NUL */
+#define	CC_DATA_SIZE		64	/* per-connection private state */
+
+/*
+ * Congestion signals passed to ca_cong_signal.
+ *
+ * CC_NDUPACK	Fast retransmit after tcps_dupack_fast_retransmit duplicate
+ *		ACKs.  Set tcp_cwnd_ssthresh and tcp_cwnd; TCP inflates
+ *		tcp_cwnd by the duplicate ACKs already received afterwards.
+ * CC_ECN	An ACK carried ECE.  Set tcp_cwnd_ssthresh and tcp_cwnd.
+ *		TCP makes this call at most once per window of data.
+ * CC_RTO	Retransmission timeout.  Set tcp_cwnd_ssthresh only; TCP
+ *		collapses tcp_cwnd to one MSS itself.
+ */
+typedef enum cc_signal {
+	CC_NDUPACK,
+	CC_ECN,
+	CC_RTO
+} cc_signal_t;
+
+struct tcp_s;
+
+typedef struct cc_algo {
+	char	ca_name[CC_ALGO_NAME_MAX];
+	uint_t	ca_flags;
+
+	/* Reset private state; called when attached to a connection. */
+	void	(*ca_init)(struct tcp_s *);
+	/*
+	 * New data was acked and the ACK did not carry ECE.  Grow
+	 * tcp_cwnd, never beyond tcp_cwnd_max.
+	 */
+	void	(*ca_ack_received)(struct tcp_s *, uint32_t);
+	void	(*ca_cong_signal)(struct tcp_s *, cc_signal_t);
+	/* Fast recovery has ended; the whole recovery window is acked. */
+	void	(*ca_post_recovery)(struct tcp_s *);
+	/*
+	 * Optional.  Called for every acceptable ACK on an ECN capable
+	 * connection, before any other callback for that ACK, with the
+	 * ACK's sequence number, the bytes it acked and whether it
+	 * carried ECE.
+	 */
+	void	(*ca_ecn_ack)(struct tcp_s *, uint32_t, uint32_t, boolean_t);
+
+	/* Framework private */
+	list_node_t	ca_link;
+	uint32_t	ca_refcnt;
+} cc_algo_t;
+
+/* ca_flags */
+#define	CC_F_ECN_PERSEG	0x01	/* receiver echoes CE per segment */
+
+#ifdef _KERNEL
+
+extern cc_algo_t	tcp_cc_newreno;
+
+extern int	tcp_cc_register(cc_algo_t *);
+extern int	tcp_cc_unregister(cc_algo_t *);
+
+#endif	/* _KERNEL */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _INET_CC_H */
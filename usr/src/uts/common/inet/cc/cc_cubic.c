@@ -0,0 +1,256 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * CUBIC congestion control (RFC 8312).
+ *
+ * After a reduction the window grows as a cubic function of the time since
+ * the reduction: quickly back towards the window at which loss last
+ * occurred (W_max), slowly around it, and quickly again beyond it.  Growth
+ * therefore depends on elapsed time rather than on the number of ACKs, which
+ * is what lets a long fat pipe refill in seconds instead of minutes.
+ *
+ * Everything is done in integer arithmetic: time in milliseconds, windows
+ * in bytes, and the constants scaled by 2^CUBIC_SHIFT.  Slow start and the
+ * end of fast recovery are as for NewReno.
+ */
+
+#include <sys/types.h>
+#include <sys/systm.h>
+#include <sys/time.h>
+#include <sys/modctl.h>
+#include <sys/sunddi.h>
+#include <sys/debug.h>
+#include <inet/tcp.h>
+#include <inet/cc.h>
+
+#define	CUBIC_SHIFT	10
+#define	CUBIC_ONE	(1 << CUBIC_SHIFT)
+#define	CUBIC_BETA	717	/* multiplicative decrease, 0.7 */
+#define	CUBIC_C		410	/* scaling constant, 0.4 */
+/* Reno-friendly additive increase per RTT, 3 * (1 - beta) / (1 + beta) */
+#define	CUBIC_ALPHA	541
+
+/* Bound on |t - K| in ms, so that its cube fits in 64 bits. */
+#define	CUBIC_MAX_DELTA	(1 << 20)
+
+typedef struct cubic {
+	int64_t		c_epoch;	/* ms; start of growth, 0 if none */
+	uint32_t	c_wmax;		/* window before the last reduction */
+	uint32_t	c_origin;	/* window at the plateau of the cubic */
+	uint32_t	c_k;		/* ms from c_epoch to reach c_origin */
+	uint32_t	c_west;		/* window standard TCP would have */
+	uint32_t	c_acked;	/* growth owed, less than one MSS */
+} cubic_t;
+
+CTASSERT(sizeof (cubic_t) <= CC_DATA_SIZE);
+
+#define	CUBIC(tcp)	((cubic_t *)(tcp)->tcp_cc_data)
+
+/*
+ * Integer cube root, rounded down.
+ */
+static uint32_t
+cubic_cbrt(uint64_t x)
+{
+	uint64_t	y = 0, b;
+	int		s;
+
+	for (s = 63; s >= 0; s -= 3) {
+		y += y;
+		b = 3 * y * (y + 1) + 1;
+		if ((x >> s) >= b) {
+			x -= b << s;
+			y++;
+		}
+	}
+	return ((uint32_t)y);
+}
+
+/*
+ * K, the time in ms the cubic takes to climb back 'gap' bytes:
+ * K^3 = gap / C, with gap in segments and K in seconds.
+ */
+static uint32_t
+cubic_k(uint32_t gap, uint32_t mss)
+{
+	uint64_t	segs = ((uint64_t)gap << CUBIC_SHIFT) / mss;
+
+	return (cubic_cbrt(segs * 1000000000ULL / CUBIC_C));
+}
+
+/*
+ * W(t) = C * (t - K)^3 + origin, in bytes, for t in ms since the epoch.
+ */
+static uint32_t
+cubic_window(cubic_t *c, int64_t t, uint32_t mss, uint32_t max)
+{
+	int64_t		delta = t - c->c_k;
+	int64_t		off;
+
+	delta = MIN(MAX(delta, -CUBIC_MAX_DELTA), CUBIC_MAX_DELTA);
+	off = delta * delta * delta / 1000;
+	off = off * CUBIC_C / 1000000 * mss / CUBIC_ONE;
+	off += c->c_origin;
+	return ((uint32_t)MIN(MAX(off, mss), max));
+}
+
+static void
+cubic_ack_received(tcp_t *tcp, uint32_t bytes_acked)
+{
+	cubic_t		*c = CUBIC(tcp);
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	cwnd = tcp->tcp_cwnd;
+	uint32_t	target;
+	uint64_t	inc;
+	int64_t		now;
+
+	if (cwnd < tcp->tcp_cwnd_ssthresh) {
+		tcp->tcp_cwnd = MIN(cwnd + mss, tcp->tcp_cwnd_max);
+		return;
+	}
+
+	now = MAX(TICK_TO_MSEC(ddi_get_lbolt64()), 1);
+	if (c->c_epoch == 0) {
+		c->c_epoch = now;
+		c->c_acked = 0;
+		c->c_west = cwnd;
+		if (cwnd < c->c_wmax) {
+			c->c_origin = c->c_wmax;
+			c->c_k = cubic_k(c->c_wmax - cwnd, mss);
+		} else {
+			c->c_origin = cwnd;
+			c->c_k = 0;
+		}
+	}
+
+	/* Aim for where the curve will be one RTT from now. */
+	target = cubic_window(c, now - c->c_epoch + (tcp->tcp_rtt_sa >> 3),
+	    mss, tcp->tcp_cwnd_max);
+
+	/* Never grow more slowly than standard TCP would. */
+	c->c_west += ((uint64_t)CUBIC_ALPHA * mss * bytes_acked / cwnd) >>
+	    CUBIC_SHIFT;
+	if (target < c->c_west)
+		target = MIN(c->c_west, tcp->tcp_cwnd_max);
+
+	if (target > cwnd) {
+		/* Reach target in an RTT, but at most 1.5 times cwnd. */
+		inc = (uint64_t)(target - cwnd) * bytes_acked / cwnd;
+		inc = MIN(inc, bytes_acked / 2);
+	} else {
+		/* On the plateau; probe by one MSS every 100 RTTs. */
+		inc = bytes_acked / 100;
+	}
+
+	/* Grow in whole segments, see newreno_ack_received(). */
+	c->c_acked += inc;
+	if (c->c_acked >= mss) {
+		inc = c->c_acked - c->c_acked % mss;
+		c->c_acked -= inc;
+		tcp->tcp_cwnd = MIN(cwnd + inc, tcp->tcp_cwnd_max);
+	}
+}
+
+static void
+cubic_cong_signal(tcp_t *tcp, cc_signal_t sig)
+{
+	cubic_t		*c = CUBIC(tcp);
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	flight = tcp->tcp_snxt - tcp->tcp_suna;
+	uint32_t	npkt;
+
+	c->c_epoch = 0;
+
+	switch (sig) {
+	case CC_NDUPACK:
+	case CC_ECN:
+		/*
+		 * Fast convergence: if we lost before getting back to the
+		 * previous W_max, a new flow is probably competing for the
+		 * path, so give up some more room.
+		 */
+		if (flight < c->c_wmax) {
+			c->c_wmax = ((uint64_t)flight *
+			    (CUBIC_ONE + CUBIC_BETA)) >> (CUBIC_SHIFT + 1);
+		} else {
+			c->c_wmax = flight;
+		}
+		npkt = (((uint64_t)flight * CUBIC_BETA) >> CUBIC_SHIFT) / mss;
+		tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
+		tcp->tcp_cwnd = npkt * mss;
+		break;
+	case CC_RTO:
+		if (tcp->tcp_timer_backoff) {
+			flight = tcp->tcp_cwnd_ssthresh;
+		} else {
+			c->c_wmax = flight;
+		}
+		npkt = (((uint64_t)flight * CUBIC_BETA) >> CUBIC_SHIFT) / mss;
+		tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
+		break;
+	}
+}
+
+static void
+cubic_post_recovery(tcp_t *tcp)
+{
+	tcp_cc_newreno.ca_post_recovery(tcp);
+}
+
+static cc_algo_t cubic_algo = {
+	.ca_name =		"cubic",
+	.ca_ack_received =	cubic_ack_received,
+	.ca_cong_signal =	cubic_cong_signal,
+	.ca_post_recovery =	cubic_post_recovery,
+};
+
+static struct modlmisc modlmisc = {
+	&mod_miscops,
+	"TCP CUBIC congestion control"
+};
+
+static struct modlinkage modlinkage = {
+	MODREV_1,
+	&modlmisc,
+	NULL
+};
+
+int
+_init(void)
+{
+	int	err;
+
+	if ((err = tcp_cc_register(&cubic_algo)) != 0)
+		return (err);
+	if ((err = mod_install(&modlinkage)) != 0)
+		(void) tcp_cc_unregister(&cubic_algo);
+	return (err);
+}
+
+int
+_fini(void)
+{
+	int	err;
+
+	/* Fails while any connection or stack default uses CUBIC. */
+	if ((err = tcp_cc_unregister(&cubic_algo)) != 0)
+		return (err);
+	if ((err = mod_remove(&modlinkage)) != 0)
+		VERIFY0(tcp_cc_register(&cubic_algo));
+	return (err);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&modlinkage, modinfop));
+}
@@ -0,0 +1,175 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Data Center TCP (RFC 8257).
+ *
+ * DCTCP is for networks whose switches mark packets with ECN CE as soon as
+ * a queue exceeds a small threshold.  Instead of halving the window on any
+ * mark, the sender keeps a moving average, alpha, of the fraction of bytes
+ * that were marked in each window of data, and on a mark shrinks the window
+ * by alpha / 2.  Light congestion then costs little throughput while the
+ * queues stay short.
+ *
+ * For the sender to learn what fraction was marked the receiver must echo
+ * CE on exactly the segments that carried it, which CC_F_ECN_PERSEG asks
+ * TCP to do; both ends must therefore use DCTCP.  Connections that did not
+ * negotiate ECN, and loss, are handled as NewReno would.
+ */
+
+#include <sys/types.h>
+#include <sys/systm.h>
+#include <sys/modctl.h>
+#include <sys/sunddi.h>
+#include <sys/debug.h>
+#include <inet/tcp.h>
+#include <inet/cc.h>
+
+#define	DCTCP_SHIFT	10
+#define	DCTCP_ALPHA_MAX	(1 << DCTCP_SHIFT)
+
+/* Weight of a new sample in alpha is 1 / 2^dctcp_g_shift (RFC 8257 g). */
+uint_t	dctcp_g_shift = 4;
+
+typedef struct dctcp {
+	uint32_t	d_alpha;	/* fraction marked, << DCTCP_SHIFT */
+	uint32_t	d_acked;	/* bytes acked in this window */
+	uint32_t	d_marked;	/* ... of which acked with ECE */
+	uint32_t	d_wnd_end;	/* sequence number ending the window */
+	boolean_t	d_started;	/* d_wnd_end is valid */
+} dctcp_t;
+
+CTASSERT(sizeof (dctcp_t) <= CC_DATA_SIZE);
+
+#define	DCTCP(tcp)	((dctcp_t *)(tcp)->tcp_cc_data)
+
+static void
+dctcp_init(tcp_t *tcp)
+{
+	/* Start out as cautious as NewReno until we have measured. */
+	DCTCP(tcp)->d_alpha = DCTCP_ALPHA_MAX;
+}
+
+/*
+ * Once per window of data, fold the fraction of bytes that were marked
+ * into alpha.
+ */
+static void
+dctcp_ecn_ack(tcp_t *tcp, uint32_t seg_ack, uint32_t bytes_acked,
+    boolean_t ece)
+{
+	dctcp_t		*d = DCTCP(tcp);
+	uint32_t	frac;
+
+	d->d_acked += bytes_acked;
+	if (ece)
+		d->d_marked += bytes_acked;
+
+	if (!d->d_started) {
+		d->d_started = B_TRUE;
+		d->d_wnd_end = tcp->tcp_snxt;
+		return;
+	}
+	if (SEQ_LT(seg_ack, d->d_wnd_end))
+		return;
+
+	if (d->d_acked != 0) {
+		frac = ((uint64_t)d->d_marked << DCTCP_SHIFT) / d->d_acked;
+		d->d_alpha = d->d_alpha - (d->d_alpha >> dctcp_g_shift) +
+		    (frac >> dctcp_g_shift);
+	}
+	d->d_acked = 0;
+	d->d_marked = 0;
+	d->d_wnd_end = tcp->tcp_snxt;
+}
+
+static void
+dctcp_cong_signal(tcp_t *tcp, cc_signal_t sig)
+{
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	cwnd = tcp->tcp_cwnd;
+	uint32_t	npkt;
+
+	if (sig != CC_ECN) {
+		tcp_cc_newreno.ca_cong_signal(tcp, sig);
+		return;
+	}
+
+	/* cwnd = cwnd * (1 - alpha / 2), in whole segments. */
+	cwnd -= ((uint64_t)cwnd * DCTCP(tcp)->d_alpha) >> (DCTCP_SHIFT + 1);
+	npkt = MAX(cwnd / mss, 2);
+	tcp->tcp_cwnd_ssthresh = npkt * mss;
+	tcp->tcp_cwnd = npkt * mss;
+}
+
+static void
+dctcp_ack_received(tcp_t *tcp, uint32_t bytes_acked)
+{
+	tcp_cc_newreno.ca_ack_received(tcp, bytes_acked);
+}
+
+static void
+dctcp_post_recovery(tcp_t *tcp)
+{
+	tcp_cc_newreno.ca_post_recovery(tcp);
+}
+
+static cc_algo_t dctcp_algo = {
+	.ca_name =		"dctcp",
+	.ca_flags =		CC_F_ECN_PERSEG,
+	.ca_init =		dctcp_init,
+	.ca_ack_received =	dctcp_ack_received,
+	.ca_cong_signal =	dctcp_cong_signal,
+	.ca_post_recovery =	dctcp_post_recovery,
+	.ca_ecn_ack =		dctcp_ecn_ack,
+};
+
+static struct modlmisc modlmisc = {
+	&mod_miscops,
+	"TCP DCTCP congestion control"
+};
+
+static struct modlinkage modlinkage = {
+	MODREV_1,
+	&modlmisc,
+	NULL
+};
+
+int
+_init(void)
+{
+	int	err;
+
+	if ((err = tcp_cc_register(&dctcp_algo)) != 0)
+		return (err);
+	if ((err = mod_install(&modlinkage)) != 0)
+		(void) tcp_cc_unregister(&dctcp_algo);
+	return (err);
+}
+
+int
+_fini(void)
+{
+	int	err;
+
+	/* Fails while any connection or stack default uses DCTCP. */
+	if ((err = tcp_cc_unregister(&dctcp_algo)) != 0)
+		return (err);
+	if ((err = mod_remove(&modlinkage)) != 0)
+		VERIFY0(tcp_cc_register(&dctcp_algo));
+	return (err);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&modlinkage, modinfop));
+}
@@ -61,7 +61,8 @@ typedef enum {
 	ILB_ALG_IMPL_ROUNDROBIN = 1,
 	ILB_ALG_IMPL_HASH_IP,
 	ILB_ALG_IMPL_HASH_IP_SPORT,
-	ILB_ALG_IMPL_HASH_IP_VIP
+	ILB_ALG_IMPL_HASH_IP_VIP,
+	ILB_ALG_IMPL_MAGLEV
 } ilb_algo_impl_t;
 
 /* Supported load balancing method */
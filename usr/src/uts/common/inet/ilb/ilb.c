@@ -725,6 +725,13 @@ ilb_rule_add(ilb_stack_t *ilbs, zoneid_t zoneid, const ilb_rule_cmd_t *cmd)
 		}
 		rule->ir_alg_type = cmd->algo;
 		break;
+	case ILB_ALG_IMPL_MAGLEV:
+		if ((rule->ir_alg = ilb_alg_maglev_init(rule, NULL)) == NULL) {
+			ret = ENOMEM;
+			goto error;
+		}
+		rule->ir_alg_type = ILB_ALG_IMPL_MAGLEV;
+		break;
 	default:
 		ret = EINVAL;
 		goto error;
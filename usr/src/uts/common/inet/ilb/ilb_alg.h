@@ -35,6 +35,7 @@ extern "C" {
 /* Load balance algorithms initialization routines. */
 ilb_alg_data_t *ilb_alg_rr_init(ilb_rule_t *, void *);
 ilb_alg_data_t *ilb_alg_hash_init(ilb_rule_t *, const void *);
+ilb_alg_data_t *ilb_alg_maglev_init(ilb_rule_t *, void *);
 
 
 #ifdef __cplusplus
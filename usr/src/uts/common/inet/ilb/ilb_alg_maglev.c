@@ -0,0 +1,395 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Maglev consistent hashing load balance algorithm.
+ *
+ * The hash algorithms in ilb_alg_hash.c take the flow hash modulo the
+ * number of servers, so adding or removing one server moves almost every
+ * client to a different back end.  Here each server instead gets its own
+ * permutation of the slots of a prime sized lookup table, derived from its
+ * address, and the servers take turns claiming their next preferred free
+ * slot until the table is full.  A flow is mapped by indexing the table
+ * with the hash of its 4-tuple.  When a server comes or goes, only the
+ * slots it owned, plus a small number of others, change hands, and every
+ * server still ends up with close to 1/n of the table.
+ *
+ * Since the mapping is a pure function of the 4-tuple and the server set,
+ * every packet of a flow picks the same server without any per flow state.
+ * A DSR rule using this algorithm therefore keeps no conn entries at all
+ * and survives an ILB restart, or being spread over several ILB hosts,
+ * without breaking established connections.
+ */
+
+#include <sys/types.h>
+#include <sys/errno.h>
+#include <sys/kmem.h>
+#include <sys/rwlock.h>
+#include <sys/crc32.h>
+#include <netinet/in.h>
+#include <inet/ip.h>
+#include <inet/ip6.h>
+
+#include <inet/ilb.h>
+#include "ilb_impl.h"
+#include "ilb_alg.h"
+
+/* Default lookup table size, must be a prime. */
+#define	MAGLEV_TBL_SIZE		65537
+
+#define	MAGLEV_EMPTY		0xffff
+#define	MAGLEV_MAX_SERVERS	MAGLEV_EMPTY
+#define	INIT_MAGLEV_SRV_SIZE	10
+
+/*
+ * Lookup table size used for new Maglev rules.  It should be a prime well
+ * above 100 times the number of servers in a rule; a value which is not a
+ * prime is ignored.
+ */
+uint32_t ilb_maglev_tbl_size = MAGLEV_TBL_SIZE;
+
+typedef struct {
+	ilb_server_t	*server;
+	boolean_t	enabled;
+	uint32_t	offset;		/* First slot in the permutation */
+	uint32_t	skip;		/* Step through the permutation */
+} maglev_server_t;
+
+/*
+ * mg_srv holds all servers, enabled or not, in the order they were added.
+ * mg_tbl maps each slot to an index into mg_srv and only ever refers to
+ * enabled servers.  mg_pos is scratch space for maglev_populate(), kept
+ * as large as mg_srv so that rebuilding the table cannot fail.
+ */
+typedef struct maglev_s {
+	krwlock_t	mg_lock;
+	size_t		mg_nsrv;		/* # of servers */
+	size_t		mg_nenabled;		/* # of enabled servers */
+	size_t		mg_srv_size;		/* Size of mg_srv and mg_pos */
+	maglev_server_t	*mg_srv;
+	uint32_t	*mg_pos;
+	uint32_t	mg_tbl_size;
+	uint16_t	*mg_tbl;
+} maglev_t;
+
+typedef struct {
+	in6_addr_t	saddr;
+	in6_addr_t	daddr;
+	in_port_t	sport;
+	in_port_t	dport;
+} maglev_key_t;
+
+static void maglev_fini(ilb_alg_data_t **);
+
+static boolean_t
+maglev_isprime(uint32_t n)
+{
+	uint32_t d;
+
+	if (n < 3 || (n & 1) == 0)
+		return (B_FALSE);
+	for (d = 3; d <= n / d; d += 2) {
+		if (n % d == 0)
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/* Final mix of MurmurHash3, to decorrelate skip from offset. */
+static uint32_t
+maglev_mix(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return (h);
+}
+
+/*
+ * Rebuild the lookup table from the enabled servers.  As the table size
+ * is a prime, every skip is coprime to it and each server's permutation
+ * visits every slot, so the inner loop always finds a free one.
+ */
+static void
+maglev_populate(maglev_t *mg)
+{
+	uint32_t m = mg->mg_tbl_size;
+	uint32_t filled = 0;
+	uint32_t c;
+	size_t i;
+
+	ASSERT(RW_WRITE_HELD(&mg->mg_lock));
+
+	if (mg->mg_nenabled == 0)
+		return;
+
+	for (c = 0; c < m; c++)
+		mg->mg_tbl[c] = MAGLEV_EMPTY;
+	for (i = 0; i < mg->mg_nsrv; i++)
+		mg->mg_pos[i] = mg->mg_srv[i].offset;
+
+	for (;;) {
+		for (i = 0; i < mg->mg_nsrv; i++) {
+			maglev_server_t *ms = &mg->mg_srv[i];
+
+			if (!ms->enabled)
+				continue;
+			c = mg->mg_pos[i];
+			while (mg->mg_tbl[c] != MAGLEV_EMPTY) {
+				if ((c += ms->skip) >= m)
+					c -= m;
+			}
+			mg->mg_tbl[c] = (uint16_t)i;
+			if ((c += ms->skip) >= m)
+				c -= m;
+			mg->mg_pos[i] = c;
+			if (++filled == m)
+				return;
+		}
+	}
+}
+
+static boolean_t
+maglev_lb(in6_addr_t *saddr, in_port_t sport, in6_addr_t *daddr,
+    in_port_t dport, void *alg_data, ilb_server_t **ret_server)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_key_t key;
+	uint32_t h;
+
+	ASSERT(ret_server != NULL);
+	*ret_server = NULL;
+
+	bzero(&key, sizeof (key));
+	key.saddr = *saddr;
+	key.daddr = *daddr;
+	key.sport = sport;
+	key.dport = dport;
+	CRC32(h, &key, sizeof (key), -1U, crc32_table);
+
+	rw_enter(&mg->mg_lock, RW_READER);
+	if (mg->mg_nenabled == 0) {
+		rw_exit(&mg->mg_lock);
+		return (B_FALSE);
+	}
+	*ret_server = mg->mg_srv[mg->mg_tbl[h % mg->mg_tbl_size]].server;
+	rw_exit(&mg->mg_lock);
+	return (B_TRUE);
+}
+
+static int
+maglev_grow(maglev_t *mg)
+{
+	maglev_server_t *srv;
+	uint32_t *pos;
+	size_t size = mg->mg_srv_size + INIT_MAGLEV_SRV_SIZE;
+
+	if ((srv = kmem_zalloc(sizeof (maglev_server_t) * size,
+	    KM_NOSLEEP)) == NULL) {
+		return (ENOMEM);
+	}
+	if ((pos = kmem_zalloc(sizeof (uint32_t) * size, KM_NOSLEEP)) ==
+	    NULL) {
+		kmem_free(srv, sizeof (maglev_server_t) * size);
+		return (ENOMEM);
+	}
+	bcopy(mg->mg_srv, srv, sizeof (maglev_server_t) * mg->mg_nsrv);
+	kmem_free(mg->mg_srv, sizeof (maglev_server_t) * mg->mg_srv_size);
+	kmem_free(mg->mg_pos, sizeof (uint32_t) * mg->mg_srv_size);
+	mg->mg_srv = srv;
+	mg->mg_pos = pos;
+	mg->mg_srv_size = size;
+	return (0);
+}
+
+static maglev_server_t *
+maglev_find(maglev_t *mg, ilb_server_t *host)
+{
+	size_t i;
+
+	for (i = 0; i < mg->mg_nsrv; i++) {
+		if (mg->mg_srv[i].server == host)
+			return (&mg->mg_srv[i]);
+	}
+	return (NULL);
+}
+
+static int
+maglev_server_add(ilb_server_t *host, void *alg_data)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_server_t *ms;
+	uint32_t h;
+
+	rw_enter(&mg->mg_lock, RW_WRITER);
+
+	if (mg->mg_nsrv == MAGLEV_MAX_SERVERS) {
+		rw_exit(&mg->mg_lock);
+		return (ENOSPC);
+	}
+	if (mg->mg_nsrv == mg->mg_srv_size && maglev_grow(mg) != 0) {
+		rw_exit(&mg->mg_lock);
+		return (ENOMEM);
+	}
+
+	ms = &mg->mg_srv[mg->mg_nsrv++];
+	ms->server = host;
+	ms->enabled = host->iser_enabled;
+	CRC32(h, &host->iser_addr_v6, sizeof (in6_addr_t), -1U, crc32_table);
+	ms->offset = h % mg->mg_tbl_size;
+	ms->skip = maglev_mix(h) % (mg->mg_tbl_size - 1) + 1;
+
+	if (ms->enabled) {
+		mg->mg_nenabled++;
+		maglev_populate(mg);
+	}
+
+	rw_exit(&mg->mg_lock);
+	ILB_SERVER_REFHOLD(host);
+	return (0);
+}
+
+static int
+maglev_server_del(ilb_server_t *host, void *alg_data)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_server_t *ms;
+	boolean_t enabled;
+	size_t i;
+
+	rw_enter(&mg->mg_lock, RW_WRITER);
+
+	if ((ms = maglev_find(mg, host)) == NULL) {
+		rw_exit(&mg->mg_lock);
+		return (EINVAL);
+	}
+	enabled = ms->enabled;
+
+	/* Keep the order, it decides who wins contended slots. */
+	for (i = ms - mg->mg_srv; i < mg->mg_nsrv - 1; i++)
+		mg->mg_srv[i] = mg->mg_srv[i + 1];
+	mg->mg_nsrv--;
+	bzero(&mg->mg_srv[mg->mg_nsrv], sizeof (maglev_server_t));
+
+	/* The indices have shifted, so rebuild even for a disabled one. */
+	if (enabled)
+		mg->mg_nenabled--;
+	maglev_populate(mg);
+
+	rw_exit(&mg->mg_lock);
+	ILB_SERVER_REFRELE(host);
+	return (0);
+}
+
+static int
+maglev_server_toggle(ilb_server_t *host, void *alg_data, boolean_t enable)
+{
+	maglev_t *mg = (maglev_t *)alg_data;
+	maglev_server_t *ms;
+
+	rw_enter(&mg->mg_lock, RW_WRITER);
+
+	if ((ms = maglev_find(mg, host)) == NULL) {
+		rw_exit(&mg->mg_lock);
+		return (EINVAL);
+	}
+	if (ms->enabled == enable) {
+		rw_exit(&mg->mg_lock);
+		return (0);
+	}
+
+	ms->enabled = enable;
+	if (enable)
+		mg->mg_nenabled++;
+	else
+		mg->mg_nenabled--;
+	maglev_populate(mg);
+
+	rw_exit(&mg->mg_lock);
+	return (0);
+}
+
+static int
+maglev_server_enable(ilb_server_t *host, void *alg_data)
+{
+	return (maglev_server_toggle(host, alg_data, B_TRUE));
+}
+
+static int
+maglev_server_disable(ilb_server_t *host, void *alg_data)
+{
+	return (maglev_server_toggle(host, alg_data, B_FALSE));
+}
+
+/* ARGSUSED */
+ilb_alg_data_t *
+ilb_alg_maglev_init(ilb_rule_t *rule, void *arg)
+{
+	ilb_alg_data_t	*alg;
+	maglev_t	*mg;
+	uint32_t	m;
+
+	m = ilb_maglev_tbl_size;
+	if (!maglev_isprime(m))
+		m = MAGLEV_TBL_SIZE;
+
+	if ((alg = kmem_alloc(sizeof (ilb_alg_data_t), KM_NOSLEEP)) == NULL)
+		return (NULL);
+	if ((mg = kmem_zalloc(sizeof (maglev_t), KM_NOSLEEP)) == NULL) {
+		kmem_free(alg, sizeof (ilb_alg_data_t));
+		return (NULL);
+	}
+	if ((mg->mg_tbl = kmem_alloc(sizeof (uint16_t) * m, KM_NOSLEEP)) ==
+	    NULL) {
+		kmem_free(mg, sizeof (maglev_t));
+		kmem_free(alg, sizeof (ilb_alg_data_t));
+		return (NULL);
+	}
+	mg->mg_tbl_size = m;
+	if (maglev_grow(mg) != 0) {
+		kmem_free(mg->mg_tbl, sizeof (uint16_t) * m);
+		kmem_free(mg, sizeof (maglev_t));
+		kmem_free(alg, sizeof (ilb_alg_data_t));
+		return (NULL);
+	}
+	rw_init(&mg->mg_lock, NULL, RW_DEFAULT, NULL);
+
+	alg->ilb_alg_lb = maglev_lb;
+	alg->ilb_alg_server_del = maglev_server_del;
+	alg->ilb_alg_server_add = maglev_server_add;
+	alg->ilb_alg_server_enable = maglev_server_enable;
+	alg->ilb_alg_server_disable = maglev_server_disable;
+	alg->ilb_alg_fini = maglev_fini;
+	alg->ilb_alg_data = mg;
+
+	return (alg);
+}
+
+static void
+maglev_fini(ilb_alg_data_t **alg)
+{
+	maglev_t	*mg;
+	size_t		i;
+
+	mg = (*alg)->ilb_alg_data;
+	for (i = 0; i < mg->mg_nsrv; i++)
+		ILB_SERVER_REFRELE(mg->mg_srv[i].server);
+
+	rw_destroy(&mg->mg_lock);
+	kmem_free(mg->mg_srv, sizeof (maglev_server_t) * mg->mg_srv_size);
+	kmem_free(mg->mg_pos, sizeof (uint32_t) * mg->mg_srv_size);
+	kmem_free(mg->mg_tbl, sizeof (uint16_t) * mg->mg_tbl_size);
+	kmem_free(mg, sizeof (maglev_t));
+	kmem_free(*alg, sizeof (ilb_alg_data_t));
+	*alg = NULL;
+}
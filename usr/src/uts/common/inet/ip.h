@@ -1745,7 +1745,7 @@ typedef struct ill_s {
 	in6_addr_t	ill_dest_token;	/* Destination IPv6 interface id */
 	uint_t		ill_token_length;
 	uint32_t	ill_xmit_count;		/* ndp max multicast xmits */
-	mib2_ipIfStatsEntry_t	*ill_ip_mib;	/* ver indep. interface mib */
+	mib2_ipIfStatsEntry_t	**ill_ip_mib_cpu; /* per-CPU interface mibs */
 	mib2_ipv6IfIcmpEntry_t	*ill_icmp6_mib;	/* Per interface mib */
 
 	phyint_t		*ill_phyint;
@@ -1827,6 +1827,18 @@ typedef struct ill_s {
 	multiphysaddr_t *ill_mphysaddr_list;
 } ill_t;
 
+/*
+ * The version independent interface mib is updated for every packet, so
+ * each CPU bumps its own copy rather than bouncing one cache line between
+ * CPUs.  There are ip_mib_cpu_mask + 1 copies; CPUs past that share.  The
+ * static (non-counter) fields live in the first copy only, and readers
+ * must use ill_ip_mib_sum() to get the interface totals.
+ */
+#define	ill_ip_mib	ill_ip_mib_cpu[CPU->cpu_seqid & ip_mib_cpu_mask]
+#define	IP_MIB_CPU_MAX	64	/* Upper bound on per-CPU mib copies */
+
+extern uint_t ip_mib_cpu_mask;
+
 /*
  * ILL_FREE_OK() means that there are no incoming pointer references
  * to the ill.
@@ -2445,6 +2457,7 @@ struct dce_s {
 	struct dce_s	*dce_next;
 	struct dce_s	**dce_ptpn;
 	struct dcb_s	*dce_bucket;
+	struct dce_s	*dce_reap_next;	/* Unlinked, awaiting dce_reap() */
 
 	union {
 		in6_addr_t	dceu_v6addr;
@@ -2458,6 +2471,7 @@ struct dce_s {
 	kmutex_t	dce_lock;
 	uint_t		dce_refcnt;
 	uint64_t	dce_last_change_time;	/* Path MTU. In seconds */
+	uint64_t	dce_last_use_time;	/* Last lookup. In seconds */
 
 	ip_stack_t	*dce_ipst;	/* Does not have a netstack_hold */
 };
@@ -3644,11 +3658,13 @@ struct ill_dld_capab_s {
  * IP squeues exports
  */
 extern boolean_t 	ip_squeue_fanout;
+extern boolean_t	ip_squeue_follow_app;
 
 #define	IP_SQUEUE_GET(hint) ip_squeue_random(hint)
 
 extern void ip_squeue_init(void (*)(squeue_t *));
 extern squeue_t	*ip_squeue_random(uint_t);
+extern squeue_t	*ip_squeue_curcpu(void);
 extern squeue_t *ip_squeue_get(ill_rx_ring_t *);
 extern squeue_t *ip_squeue_getfree(pri_t);
 extern int ip_squeue_cpu_move(squeue_t *, processorid_t);
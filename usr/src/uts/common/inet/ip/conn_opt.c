@@ -619,6 +619,9 @@ conn_opt_get(conn_opt_arg_t *coa, t_scalar_t level, t_scalar_t name,
 		case SO_REUSEADDR:
 			*i1 = connp->conn_reuseaddr ? SO_REUSEADDR : 0;
 			break;	/* goto sizeof (int) option return */
+		case SO_REUSEPORT:
+			*i1 = connp->conn_reuseport;
+			break;	/* goto sizeof (int) option return */
 		case SO_TYPE:
 			*i1 = connp->conn_so_type;
 			break;	/* goto sizeof (int) option return */
@@ -1100,6 +1103,9 @@ conn_opt_set_socket(conn_opt_arg_t *coa, t_scalar_t name, uint_t inlen,
 	case SO_REUSEADDR:
 		connp->conn_reuseaddr = onoff;
 		break;
+	case SO_REUSEPORT:
+		connp->conn_reuseport = onoff;
+		break;
 	case SO_DONTROUTE:
 		if (onoff)
 			ixa->ixa_flags |= IXAF_DONTROUTE;
@@ -2932,5 +2938,6 @@ conn_inherit_parent(conn_t *lconnp, conn_t *econnp)
 	econnp->conn_broadcast = lconnp->conn_broadcast;
 	econnp->conn_useloopback = lconnp->conn_useloopback;
 	econnp->conn_reuseaddr = lconnp->conn_reuseaddr;
+	econnp->conn_reuseport = lconnp->conn_reuseport;
 	return (0);
 }
@@ -137,6 +137,12 @@ int ip_squeue_enter = IP_SQUEUE_ENTER;	/* Setable in /etc/system */
 
 int ip_squeue_flag;
 
+/*
+ * Number of per-CPU copies of each interface ip mib, less one.  Sized at
+ * load time from the CPU count; see ill_ip_mib in ip.h.
+ */
+uint_t ip_mib_cpu_mask;
+
 /*
  * Setable in /etc/system
  */
@@ -639,6 +645,13 @@ void (*cl_inet_idlesa)(netstackid_t, uint8_t, uint32_t, sa_family_t,
  */
 boolean_t	ip_squeue_fanout = 0;
 
+/*
+ * If set, TCP puts passive connections on the default squeue of the CPU
+ * where the application last accepted from the listener, rather than on
+ * the squeue of the ring the SYN arrived on.
+ */
+boolean_t	ip_squeue_follow_app = B_FALSE;
+
 /*
  * Maximum dups allowed per packet.
  */
@@ -4349,6 +4362,11 @@ ip_stack_shutdown(netstackid_t stackid, void *arg)
 	printf("ip_stack_shutdown(%p, stack %d)\n", (void *)ipst, stackid);
 #endif
 
+	/*
+	 * The compressed forwarding tables hold IREs; drop them first.
+	 */
+	ip_fib_stack_shutdown(ipst);
+
 	/*
 	 * Perform cleanup for special interfaces (loopback and IPMP).
 	 */
@@ -4451,6 +4469,7 @@ ip_stack_fini(netstackid_t stackid, void *arg)
 	}
 
 	ip_ire_fini(ipst);
+	ip_fib_stack_fini(ipst);
 	ip6_asp_free(ipst);
 	conn_drain_fini(ipst);
 	ipcl_destroy(ipst);
@@ -4514,8 +4533,14 @@ ip_thread_exit(void *phash)
 void
 ip_ddi_init(void)
 {
+	uint_t n;
+
 	ip_squeue_flag = ip_squeue_switch(ip_squeue_enter);
 
+	for (n = 1; n < MAX(ncpus, boot_ncpus) && n < IP_MIB_CPU_MAX; n <<= 1)
+		;
+	ip_mib_cpu_mask = n - 1;
+
 	/*
 	 * For IP and TCP the minor numbers should start from 2 since we have 4
 	 * initial devices: ip, ip6, tcp, tcp6.
@@ -4622,6 +4647,7 @@ ip_stack_init(netstackid_t stackid, netstack_t *ns)
 
 	ipcl_init(ipst);
 	ip_ire_init(ipst);
+	ip_fib_stack_init(ipst);
 	ip6_asp_init(ipst);
 	ipif_init(ipst);
 	conn_drain_init(ipst);
@@ -9813,6 +9839,7 @@ ip_snmp_get_mib2_ip_traffic_stats(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst,
 	ill_walk_context_t	ctx;
 	mblk_t			*mp_tail = NULL;
 	mib2_ipIfStatsEntry_t	global_ip_mib;
+	mib2_ipIfStatsEntry_t	ill_mib;
 	mib2_ipAddrEntry_t	mae;
 
 	/*
@@ -9861,20 +9888,20 @@ ip_snmp_get_mib2_ip_traffic_stats(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst,
 	rw_enter(&ipst->ips_ill_g_lock, RW_READER);
 	ill = ILL_START_WALK_V4(&ctx, ipst);
 	for (; ill != NULL; ill = ill_next(&ctx, ill)) {
-		ill->ill_ip_mib->ipIfStatsIfIndex =
+		ill->ill_ip_mib_cpu[0]->ipIfStatsIfIndex =
 		    ill->ill_phyint->phyint_ifindex;
-		SET_MIB(ill->ill_ip_mib->ipIfStatsForwarding,
+		SET_MIB(ill->ill_ip_mib_cpu[0]->ipIfStatsForwarding,
 		    (ipst->ips_ip_forwarding ? 1 : 2));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsDefaultTTL,
+		SET_MIB(ill->ill_ip_mib_cpu[0]->ipIfStatsDefaultTTL,
 		    (uint32_t)ipst->ips_ip_def_ttl);
 
-		ip_mib2_add_ip_stats(&global_ip_mib, ill->ill_ip_mib);
+		ill_ip_mib_sum(ill, &ill_mib);
+		ip_mib2_add_ip_stats(&global_ip_mib, &ill_mib);
 		if (!snmp_append_data2(mpctl->b_cont, &mp_tail,
-		    (char *)ill->ill_ip_mib,
-		    (int)sizeof (*ill->ill_ip_mib))) {
+		    (char *)&ill_mib, (int)sizeof (ill_mib))) {
 			ip1dbg(("ip_snmp_get_mib2_ip_traffic_stats: "
 			    "failed to allocate %u bytes\n",
-			    (uint_t)sizeof (*ill->ill_ip_mib)));
+			    (uint_t)sizeof (ill_mib)));
 		}
 	}
 	rw_exit(&ipst->ips_ill_g_lock);
@@ -10713,6 +10740,7 @@ ip_snmp_get_mib2_ip6(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst,
 	ill_walk_context_t	ctx;
 	mblk_t			*mp_tail = NULL;
 	mib2_ipv6AddrEntry_t	mae6;
+	mib2_ipIfStatsEntry_t	ill_mib;
 	mib2_ipIfStatsEntry_t	*ise;
 	size_t			ise_size, iae_size;
 
@@ -10787,31 +10815,32 @@ ip_snmp_get_mib2_ip6(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst,
 	rw_enter(&ipst->ips_ill_g_lock, RW_READER);
 	ill = ILL_START_WALK_V6(&ctx, ipst);
 	for (; ill != NULL; ill = ill_next(&ctx, ill)) {
-		ill->ill_ip_mib->ipIfStatsIfIndex =
+		ill->ill_ip_mib_cpu[0]->ipIfStatsIfIndex =
 		    ill->ill_phyint->phyint_ifindex;
-		SET_MIB(ill->ill_ip_mib->ipIfStatsForwarding,
+		SET_MIB(ill->ill_ip_mib_cpu[0]->ipIfStatsForwarding,
 		    ipst->ips_ipv6_forwarding ? 1 : 2);
-		SET_MIB(ill->ill_ip_mib->ipIfStatsDefaultHopLimit,
+		SET_MIB(ill->ill_ip_mib_cpu[0]->ipIfStatsDefaultHopLimit,
 		    ill->ill_max_hops);
+		ill_ip_mib_sum(ill, &ill_mib);
 
 		/*
 		 * Synchronize 64- and 32-bit counters
 		 */
-		SYNC32_MIB(ill->ill_ip_mib, ipIfStatsInReceives,
+		SYNC32_MIB(&ill_mib, ipIfStatsInReceives,
 		    ipIfStatsHCInReceives);
-		SYNC32_MIB(ill->ill_ip_mib, ipIfStatsInDelivers,
+		SYNC32_MIB(&ill_mib, ipIfStatsInDelivers,
 		    ipIfStatsHCInDelivers);
-		SYNC32_MIB(ill->ill_ip_mib, ipIfStatsOutRequests,
+		SYNC32_MIB(&ill_mib, ipIfStatsOutRequests,
 		    ipIfStatsHCOutRequests);
-		SYNC32_MIB(ill->ill_ip_mib, ipIfStatsOutForwDatagrams,
+		SYNC32_MIB(&ill_mib, ipIfStatsOutForwDatagrams,
 		    ipIfStatsHCOutForwDatagrams);
-		SYNC32_MIB(ill->ill_ip_mib, ipIfStatsOutMcastPkts,
+		SYNC32_MIB(&ill_mib, ipIfStatsOutMcastPkts,
 		    ipIfStatsHCOutMcastPkts);
-		SYNC32_MIB(ill->ill_ip_mib, ipIfStatsInMcastPkts,
+		SYNC32_MIB(&ill_mib, ipIfStatsInMcastPkts,
 		    ipIfStatsHCInMcastPkts);
 
 		if (!snmp_append_data2(mpctl->b_cont, &mp_tail,
-		    (char *)ill->ill_ip_mib, (int)ise_size)) {
+		    (char *)&ill_mib, (int)ise_size)) {
 			ip1dbg(("ip_snmp_get_mib2_ip6: failed to allocate "
 			"%u bytes\n", (uint_t)ise_size));
 		} else if (legacy_req) {
@@ -13921,6 +13950,10 @@ ip_kstat2_init(netstackid_t stackid, ip_stat_t *ip_statisticsp)
 		{ "ip_nce_reclaim_deleted",	KSTAT_DATA_UINT64 },
 		{ "ip_dce_reclaim_calls",	KSTAT_DATA_UINT64 },
 		{ "ip_dce_reclaim_deleted",	KSTAT_DATA_UINT64 },
+		{ "ip_dce_resizes",		KSTAT_DATA_UINT64 },
+		{ "ip_dce_entries",		KSTAT_DATA_UINT64 },
+		{ "ip_dce_buckets",		KSTAT_DATA_UINT64 },
+		{ "ip_dce_chain_max",		KSTAT_DATA_UINT64 },
 		{ "ip_tcp_in_full_hw_cksum_err",	KSTAT_DATA_UINT64 },
 		{ "ip_tcp_in_part_hw_cksum_err",	KSTAT_DATA_UINT64 },
 		{ "ip_tcp_in_sw_cksum_err",		KSTAT_DATA_UINT64 },
@@ -14053,6 +14086,7 @@ ip_kstat_update(kstat_t *kp, int rw)
 	mib2_ipIfStatsEntry_t ipmib;
 	ill_walk_context_t ctx;
 	ill_t *ill;
+	uint_t i;
 	netstackid_t	stackid = (zoneid_t)(uintptr_t)kp->ks_private;
 	netstack_t	*ns;
 	ip_stack_t	*ipst;
@@ -14076,8 +14110,10 @@ ip_kstat_update(kstat_t *kp, int rw)
 	bcopy(&ipst->ips_ip_mib, &ipmib, sizeof (ipmib));
 	rw_enter(&ipst->ips_ill_g_lock, RW_READER);
 	ill = ILL_START_WALK_V4(&ctx, ipst);
-	for (; ill != NULL; ill = ill_next(&ctx, ill))
-		ip_mib2_add_ip_stats(&ipmib, ill->ill_ip_mib);
+	for (; ill != NULL; ill = ill_next(&ctx, ill)) {
+		for (i = 0; i <= ip_mib_cpu_mask; i++)
+			ip_mib2_add_ip_stats(&ipmib, ill->ill_ip_mib_cpu[i]);
+	}
 	rw_exit(&ipst->ips_ill_g_lock);
 
 	ipkp->forwarding.value.ui32 =		ipmib.ipIfStatsForwarding;
@@ -488,6 +488,7 @@ ire_add_v6(ire_t *ire)
 		ASSERT(ire->ire_ill->ill_ire_cnt != 0);	/* Wraparound */
 	}
 	ire_atomic_end(irb_ptr, ire);
+	ip_fib_changed(ire);
 
 	/* Make any caching of the IREs be notified or updated */
 	ire_flush_cache_v6(ire, IRE_FLUSH_ADD);
@@ -547,11 +548,11 @@ ire_delete_v6(ire_t *ire)
 	/*
 	 * Make sure ire_generation increases from ire_flush_cache happen
 	 * after any lookup/reader has read ire_generation.
-	 * Since the rw_enter makes us wait until any lookup/reader has
+	 * Since the pcrw_enter makes us wait until any lookup/reader has
 	 * completed we can exit the lock immediately.
 	 */
-	rw_enter(&ipst->ips_ip6_ire_head_lock, RW_WRITER);
-	rw_exit(&ipst->ips_ip6_ire_head_lock);
+	pcrw_enter(&ipst->ips_ip6_ire_head_lock, RW_WRITER);
+	pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 
 	ASSERT(ire->ire_refcnt >= 1);
 	ASSERT(ire->ire_ipversion == IPV6_VERSION);
@@ -615,7 +616,7 @@ ire_flush_cache_v6(ire_t *ire, int flag)
 	 * either the old ire and old generation number, or a new ire and new
 	 * generation number.
 	 */
-	rw_enter(&ipst->ips_ip6_ire_head_lock, RW_WRITER);
+	pcrw_enter(&ipst->ips_ip6_ire_head_lock, RW_WRITER);
 
 	/*
 	 * If a route was just added, we need to notify everybody that
@@ -629,7 +630,7 @@ ire_flush_cache_v6(ire_t *ire, int flag)
 
 	/* Adding a default can't otherwise provide a better route */
 	if (ire->ire_type == IRE_DEFAULT && flag == IRE_FLUSH_ADD) {
-		rw_exit(&ipst->ips_ip6_ire_head_lock);
+		pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 		return;
 	}
 
@@ -673,7 +674,7 @@ ire_flush_cache_v6(ire_t *ire, int flag)
 		}
 		break;
 	}
-	rw_exit(&ipst->ips_ip6_ire_head_lock);
+	pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 }
 
 /*
@@ -882,9 +883,9 @@ ire_gateway_ok_zone_v6(const in6_addr_t *gateway, zoneid_t zoneid, ill_t *ill,
 	uint_t	match_flags;
 
 	if (lock_held)
-		ASSERT(RW_READ_HELD(&ipst->ips_ip6_ire_head_lock));
+		ASSERT(PCRW_READ_HELD(&ipst->ips_ip6_ire_head_lock));
 	else
-		rw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
+		pcrw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
 
 	match_flags = MATCH_IRE_TYPE | MATCH_IRE_SECATTR;
 	if (ill != NULL)
@@ -895,7 +896,7 @@ ire_gateway_ok_zone_v6(const in6_addr_t *gateway, zoneid_t zoneid, ill_t *ill,
 	    ipst);
 
 	if (!lock_held)
-		rw_exit(&ipst->ips_ip6_ire_head_lock);
+		pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 	if (ire != NULL) {
 		ire_refrele(ire);
 		return (B_TRUE);
@@ -934,11 +935,11 @@ ire_ftable_lookup_v6(const in6_addr_t *addr, const in6_addr_t *mask,
 	if ((flags & (MATCH_IRE_ILL|MATCH_IRE_SRC_ILL)) && (ill == NULL))
 		return (NULL);
 
-	rw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
+	pcrw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
 	ire = ire_ftable_lookup_impl_v6(addr, mask, gateway, type, ill, zoneid,
 	    tsl, flags, ipst);
 	if (ire == NULL) {
-		rw_exit(&ipst->ips_ip6_ire_head_lock);
+		pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 		return (NULL);
 	}
 
@@ -988,7 +989,7 @@ done:
 	if (generationp != NULL)
 		*generationp = ire->ire_generation;
 
-	rw_exit(&ipst->ips_ip6_ire_head_lock);
+	pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 
 	/*
 	 * For shared-IP zones we need additional checks to what was
@@ -1024,7 +1025,7 @@ ire_ftable_lookup_impl_v6(const in6_addr_t *addr, const in6_addr_t *mask,
 	ire_t *ire = NULL;
 	int i;
 
-	ASSERT(RW_LOCK_HELD(&ipst->ips_ip6_ire_head_lock));
+	ASSERT(PCRW_LOCK_HELD(&ipst->ips_ip6_ire_head_lock));
 
 	/*
 	 * If the mask is known, the lookup
@@ -1120,6 +1121,19 @@ ire_ftable_lookup_simple_v6(const in6_addr_t *addr, uint32_t xmit_hint,
 {
 	ire_t	*ire;
 
+	/* As in ire_ftable_lookup_simple_v4() */
+	if ((ire = ip_fib_lookup_v6(addr, ipst)) != NULL) {
+		if (ire->ire_bucket->irb_ire_cnt == 1 ||
+		    ipst->ips_ip_ecmp_behavior == 0 ||
+		    (ipst->ips_ip_ecmp_behavior == 1 &&
+		    !IS_DEFAULT_ROUTE_V6(ire))) {
+			if (generationp != NULL)
+				*generationp = ire->ire_generation;
+			return (ire);
+		}
+		ire_refrele(ire);
+	}
+
 	ire = ire_ftable_lookup_v6(addr, NULL, NULL, 0, NULL, ALL_ZONES, NULL,
 	    MATCH_IRE_DSTONLY, xmit_hint, ipst, generationp);
 	if (ire == NULL) {
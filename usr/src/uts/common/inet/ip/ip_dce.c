@@ -35,6 +35,8 @@
 #include <sys/debug.h>
 #include <sys/atomic.h>
 #include <sys/callb.h>
+#include <sys/cpuvar.h>
+#include <sys/bitmap.h>
 #define	_SUN_TPI_VERSION 2
 #include <sys/tihdr.h>
 
@@ -92,6 +94,33 @@
  * link-locals are not globally unique.
  */
 
+/*
+ * The per-address DCEs live in one hash table per address family.  Each
+ * table starts out with ip_dce_hash_size buckets and the reclaim worker
+ * doubles it, up to ip_dce_hash_max buckets, whenever the average chain has
+ * grown longer than ip_dce_hash_load.
+ *
+ * dce_lookup_v4() and dce_lookup_v6() normally walk the chain without taking
+ * dcb_lock:
+ *  - A lookup announces itself in its CPU's dce_cpu_t, with preemption
+ *    disabled. An unlinked DCE keeps its dce_next, and the reference held
+ *    by the hash list is only dropped by dce_reap() once it has seen every
+ *    CPU outside a lookup. Hence whatever a lookup can reach stays around.
+ *  - A new DCE is initialized before it is linked in at the head.
+ *  - The resize moves the DCEs to the new table with all the bucket locks
+ *    of the old table held, and dct_seq of the old table is odd while it
+ *    does so. A lookup which finds nothing and sees dct_seq change under it
+ *    looks again with the bucket locked.
+ * Everything else locks the bucket and then checks that the table was not
+ * replaced while it waited. Replaced tables are kept on dct_retired until
+ * the stack goes away, since a thread may still be about to enter one of
+ * their locks.
+ *
+ * The reclaim worker deletes the least recently used DCEs first, where a
+ * DCE is used when a lookup finds it. DCEs with a path MTU age four times
+ * slower than the others.
+ */
+
 /*
  * Hash bucket structure for DCEs
  */
@@ -101,10 +130,30 @@ typedef struct dcb_s {
 	dce_t		*dcb_dce;
 } dcb_t;
 
+/*
+ * Hash table structure for DCEs
+ */
+typedef struct dct_s {
+	uint_t		dct_size;	/* Number of buckets, a power of two */
+	volatile uint_t	dct_seq;	/* Odd while being resized */
+	dcb_t		*dct_bucket;
+	struct dct_s	*dct_retired;	/* Table this one replaced */
+} dct_t;
+
+/*
+ * Lock-free lookups in progress on each CPU, padded to keep each counter in
+ * a cache line of its own.
+ */
+typedef struct dce_cpu_s {
+	volatile uint_t	dcc_active;
+	char		dcc_pad[64 - sizeof (uint_t)];
+} dce_cpu_t;
+
 static void	dce_delete_locked(dcb_t *, dce_t *);
 static void	dce_make_condemned(dce_t *);
 
 static kmem_cache_t *dce_cache;
+static dce_cpu_t *dce_cpu;
 static kthread_t *dce_reclaim_thread;
 static kmutex_t dce_reclaim_lock;
 static kcondvar_t dce_reclaim_cv;
@@ -113,26 +162,263 @@ static int dce_reclaim_shutdown;
 /* Global so it can be tuned in /etc/system. This must be a power of two. */
 uint_t ip_dce_hash_size = 1024;
 
+/* The largest the hash tables may grow. This must be a power of two. */
+uint_t ip_dce_hash_max = 1 << 20;
+
+/* Grow a hash table once its average chain is longer than this. */
+uint_t ip_dce_hash_load = 4;
+
 /* The time in seconds between executions of the IP DCE reclaim worker. */
 uint_t ip_dce_reclaim_interval = 60;
 
 /* The factor of the DCE threshold at which to start hard reclaims */
 uint_t ip_dce_reclaim_threshold_hard = 2;
 
-/* Operates on a uint64_t */
-#define	RANDOM_HASH(p) ((p) ^ ((p)>>16) ^ ((p)>>32) ^ ((p)>>48))
+/* Values for ips_dce_reclaim_needed */
+#define	DCE_RECLAIM_CHAIN	0x1	/* A chain is over the threshold */
+#define	DCE_RECLAIM_MEMORY	0x2	/* The system is low on memory */
+
+/* Number of log2 age classes used to pick the DCEs to reclaim */
+#define	DCE_AGE_CLASSES		32
+
+static dce_cpu_t *
+dce_read_enter(void)
+{
+	dce_cpu_t	*dcc;
+
+	kpreempt_disable();
+	dcc = &dce_cpu[CPU->cpu_seqid];
+	atomic_inc_uint(&dcc->dcc_active);
+	membar_enter();
+	return (dcc);
+}
+
+static void
+dce_read_exit(dce_cpu_t *dcc)
+{
+	membar_exit();
+	atomic_dec_uint(&dcc->dcc_active);
+	kpreempt_enable();
+}
 
 /*
- * Reclaim a fraction of dce's in the dcb.
- * For now we have a higher probability to delete DCEs without DCE_PMTU.
+ * Wait for the lock-free lookups which may still see the DCEs we unlinked.
  */
 static void
-dcb_reclaim(dcb_t *dcb, ip_stack_t *ipst, uint_t fraction)
+dce_sync(void)
+{
+	int	i;
+
+	membar_enter();
+	for (i = 0; i < max_ncpus; i++) {
+		while (dce_cpu[i].dcc_active != 0)
+			delay(1);
+	}
+}
+
+/*
+ * Drop the hash list reference on the DCEs unlinked since the last call.
+ */
+static void
+dce_reap(ip_stack_t *ipst)
+{
+	dce_t	*dce, *nextdce;
+
+	mutex_enter(&ipst->ips_dce_reap_lock);
+	dce = ipst->ips_dce_reap;
+	ipst->ips_dce_reap = NULL;
+	mutex_exit(&ipst->ips_dce_reap_lock);
+	if (dce == NULL)
+		return;
+
+	dce_sync();
+	for (; dce != NULL; dce = nextdce) {
+		nextdce = dce->dce_reap_next;
+		dce->dce_reap_next = NULL;
+		dce_refrele(dce);
+	}
+}
+
+static dct_t *
+dce_table_alloc(uint_t size, int kmflag)
+{
+	dct_t	*dct;
+	uint_t	i;
+
+	if ((dct = kmem_zalloc(sizeof (dct_t), kmflag)) == NULL)
+		return (NULL);
+	dct->dct_bucket = kmem_zalloc(size * sizeof (dcb_t), kmflag);
+	if (dct->dct_bucket == NULL) {
+		kmem_free(dct, sizeof (dct_t));
+		return (NULL);
+	}
+	dct->dct_size = size;
+	for (i = 0; i < size; i++)
+		rw_init(&dct->dct_bucket[i].dcb_lock, NULL, RW_DEFAULT, NULL);
+	return (dct);
+}
+
+/* Free a table and the tables it replaced */
+static void
+dce_table_free(dct_t *dct)
+{
+	dct_t	*retired;
+	uint_t	i;
+
+	for (; dct != NULL; dct = retired) {
+		retired = dct->dct_retired;
+		for (i = 0; i < dct->dct_size; i++)
+			rw_destroy(&dct->dct_bucket[i].dcb_lock);
+		kmem_free(dct->dct_bucket, dct->dct_size * sizeof (dcb_t));
+		kmem_free(dct, sizeof (dct_t));
+	}
+}
+
+/*
+ * Returns the number of DCEs in the table, and the longest chain in *maxp.
+ * The counts are not locked and may be slightly stale.
+ */
+static uint64_t
+dce_table_count(dct_t *dct, uint_t *maxp)
+{
+	uint64_t	total = 0;
+	uint_t		i, cnt;
+
+	*maxp = 0;
+	for (i = 0; i < dct->dct_size; i++) {
+		cnt = dct->dct_bucket[i].dcb_cnt;
+		total += cnt;
+		if (cnt > *maxp)
+			*maxp = cnt;
+	}
+	return (total);
+}
+
+/*
+ * Lock the bucket for the address in the current IPv4 table.
+ */
+static dcb_t *
+dcb_enter_v4(ipaddr_t dst, ip_stack_t *ipst, krw_t rw)
+{
+	dct_t	*dct;
+	dcb_t	*dcb;
+
+	for (;;) {
+		dct = ipst->ips_dce_table_v4;
+		dcb = &dct->dct_bucket[IRE_ADDR_HASH(dst, dct->dct_size)];
+		rw_enter(&dcb->dcb_lock, rw);
+		if (dct == ipst->ips_dce_table_v4)
+			return (dcb);
+		rw_exit(&dcb->dcb_lock);
+	}
+}
+
+/*
+ * Lock the bucket for the address in the current IPv6 table.
+ */
+static dcb_t *
+dcb_enter_v6(const in6_addr_t *dst, ip_stack_t *ipst, krw_t rw)
+{
+	dct_t	*dct;
+	dcb_t	*dcb;
+
+	for (;;) {
+		dct = ipst->ips_dce_table_v6;
+		dcb = &dct->dct_bucket[IRE_ADDR_HASH_V6(*dst, dct->dct_size)];
+		rw_enter(&dcb->dcb_lock, rw);
+		if (dct == ipst->ips_dce_table_v6)
+			return (dcb);
+		rw_exit(&dcb->dcb_lock);
+	}
+}
+
+/*
+ * Double the size of a table whose average chain is longer than
+ * ip_dce_hash_load. Returns B_TRUE if it did.
+ */
+static boolean_t
+dce_table_grow(ip_stack_t *ipst, boolean_t isv6)
+{
+	dct_t	**dctp, *odct, *ndct;
+	dcb_t	*odcb, *ndcb;
+	dce_t	*dce, *nextdce;
+	uint_t	i, size, hash, maxchain;
+
+	ASSERT(MUTEX_HELD(&ipst->ips_dce_resize_lock));
+
+	dctp = isv6 ? &ipst->ips_dce_table_v6 : &ipst->ips_dce_table_v4;
+	odct = *dctp;
+	size = odct->dct_size * 2;
+	if (size > ip_dce_hash_max || dce_table_count(odct, &maxchain) <=
+	    (uint64_t)odct->dct_size * ip_dce_hash_load)
+		return (B_FALSE);
+	if ((ndct = dce_table_alloc(size, KM_NOSLEEP)) == NULL)
+		return (B_FALSE);
+
+	for (i = 0; i < odct->dct_size; i++)
+		rw_enter(&odct->dct_bucket[i].dcb_lock, RW_WRITER);
+	odct->dct_seq++;
+	membar_producer();
+
+	for (i = 0; i < odct->dct_size; i++) {
+		odcb = &odct->dct_bucket[i];
+		for (dce = odcb->dcb_dce; dce != NULL; dce = nextdce) {
+			nextdce = dce->dce_next;
+			if (isv6)
+				hash = IRE_ADDR_HASH_V6(dce->dce_v6addr, size);
+			else
+				hash = IRE_ADDR_HASH(dce->dce_v4addr, size);
+			ndcb = &ndct->dct_bucket[hash];
+			if (ndcb->dcb_dce != NULL)
+				ndcb->dcb_dce->dce_ptpn = &dce->dce_next;
+			dce->dce_next = ndcb->dcb_dce;
+			dce->dce_ptpn = &ndcb->dcb_dce;
+			dce->dce_bucket = ndcb;
+			ndcb->dcb_dce = dce;
+			ndcb->dcb_cnt++;
+		}
+		odcb->dcb_dce = NULL;
+		odcb->dcb_cnt = 0;
+	}
+
+	ndct->dct_retired = odct;
+	membar_producer();
+	*dctp = ndct;
+	membar_producer();
+	odct->dct_seq++;
+	for (i = 0; i < odct->dct_size; i++)
+		rw_exit(&odct->dct_bucket[i].dcb_lock);
+
+	IP_STAT(ipst, ip_dce_resizes);
+	return (B_TRUE);
+}
+
+/*
+ * The age class of a DCE is the number of bits in the seconds since it was
+ * last used.
+ */
+static uint_t
+dce_age_class(dce_t *dce, uint64_t now)
+{
+	uint64_t	idle;
+	uint_t		class;
+
+	if (dce->dce_last_use_time >= now)
+		return (0);
+	idle = now - dce->dce_last_use_time;
+	if (dce->dce_flags & DCEF_PMTU)
+		idle >>= 2;
+	class = highbit64(idle);
+	return (MIN(class, DCE_AGE_CLASSES - 1));
+}
+
+/*
+ * Reclaim the DCEs in the dcb whose age class is at least cutoff.
+ */
+static void
+dcb_reclaim(dcb_t *dcb, ip_stack_t *ipst, uint_t cutoff, uint64_t now)
 {
-	uint_t	fraction_pmtu = fraction*4;
-	uint_t	hash;
 	dce_t	*dce, *nextdce;
-	hrtime_t seed = gethrtime();
 	uint_t	retained = 0;
 	uint_t	max = ipst->ips_ip_dce_reclaim_threshold;
 
@@ -153,47 +439,103 @@ dcb_reclaim(dcb_t *dcb, ip_stack_t *ipst, uint_t fraction)
 			mutex_exit(&dce->dce_lock);
 		}
 
-		if (max == 0 || retained < max) {
-			hash = RANDOM_HASH((uint64_t)((uintptr_t)dce | seed));
-
-			if (dce->dce_flags & DCEF_PMTU) {
-				if (hash % fraction_pmtu != 0) {
-					retained++;
-					continue;
-				}
-			} else {
-				if (hash % fraction != 0) {
-					retained++;
-					continue;
-				}
-			}
+		if ((max == 0 || retained < max) &&
+		    dce_age_class(dce, now) < cutoff) {
+			retained++;
+			continue;
 		}
 
 		IP_STAT(ipst, ip_dce_reclaim_deleted);
 		dce_delete_locked(dcb, dce);
-		dce_refrele(dce);
 	}
 	rw_exit(&dcb->dcb_lock);
 }
 
 /*
- * kmem_cache callback to free up memory.
- *
+ * Reclaim the least recently used fraction of the DCEs in a table. The
+ * DCEs are counted by age class first, and then all DCEs in the classes
+ * which together make up that fraction are deleted. DCEs used within the
+ * last second are only deleted to enforce the hard limit on chains.
  */
 static void
-ip_dce_reclaim_stack(ip_stack_t *ipst)
+dce_table_reclaim(ip_stack_t *ipst, boolean_t isv6, uint_t fraction)
 {
-	int	i;
+	dct_t		*dct;
+	dcb_t		*dcb;
+	dce_t		*dce;
+	uint64_t	ages[DCE_AGE_CLASSES];
+	uint64_t	now, total = 0, want;
+	uint_t		i, cutoff;
 
-	IP_STAT(ipst, ip_dce_reclaim_calls);
-	for (i = 0; i < ipst->ips_dce_hashsize; i++) {
-		dcb_reclaim(&ipst->ips_dce_hash_v4[i], ipst,
-		    ipst->ips_ip_dce_reclaim_fraction);
+	ASSERT(MUTEX_HELD(&ipst->ips_dce_resize_lock));
 
-		dcb_reclaim(&ipst->ips_dce_hash_v6[i], ipst,
-		    ipst->ips_ip_dce_reclaim_fraction);
+	dct = isv6 ? ipst->ips_dce_table_v6 : ipst->ips_dce_table_v4;
+	now = TICK_TO_SEC(ddi_get_lbolt64());
+	bzero(ages, sizeof (ages));
+	for (i = 0; i < dct->dct_size; i++) {
+		dcb = &dct->dct_bucket[i];
+		rw_enter(&dcb->dcb_lock, RW_READER);
+		for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
+			ages[dce_age_class(dce, now)]++;
+			total++;
+		}
+		rw_exit(&dcb->dcb_lock);
 	}
 
+	want = (fraction == 0) ? 0 : total / fraction;
+	for (cutoff = DCE_AGE_CLASSES; cutoff > 1 && want > 0; cutoff--)
+		want -= MIN(want, ages[cutoff - 1]);
+
+	for (i = 0; i < dct->dct_size; i++)
+		dcb_reclaim(&dct->dct_bucket[i], ipst, cutoff, now);
+}
+
+/*
+ * Update the DCE kstats, which show how the hash tables are doing.
+ */
+static void
+dce_update_stats(ip_stack_t *ipst)
+{
+	ip_stat_t	*ips = &ipst->ips_ip_statistics;
+	uint64_t	total;
+	uint_t		max4, max6;
+
+	total = dce_table_count(ipst->ips_dce_table_v4, &max4);
+	total += dce_table_count(ipst->ips_dce_table_v6, &max6);
+	ips->ip_dce_entries.value.ui64 = total;
+	ips->ip_dce_buckets.value.ui64 = ipst->ips_dce_table_v4->dct_size +
+	    ipst->ips_dce_table_v6->dct_size;
+	ips->ip_dce_chain_max.value.ui64 = MAX(max4, max6);
+}
+
+/*
+ * Grow the hash tables as needed, and reclaim DCEs if the chains got too
+ * long or the system is short of memory. A chain which is too long is only
+ * a reason to reclaim if its table could not be grown.
+ */
+static void
+ip_dce_reclaim_stack(ip_stack_t *ipst, uint_t why)
+{
+	uint_t		fraction = ipst->ips_ip_dce_reclaim_fraction;
+	boolean_t	grew_v4, grew_v6;
+
+	mutex_enter(&ipst->ips_dce_resize_lock);
+	grew_v4 = dce_table_grow(ipst, B_FALSE);
+	grew_v6 = dce_table_grow(ipst, B_TRUE);
+	if (why != 0) {
+		IP_STAT(ipst, ip_dce_reclaim_calls);
+		if (why != DCE_RECLAIM_CHAIN || !grew_v4)
+			dce_table_reclaim(ipst, B_FALSE, fraction);
+		if (why != DCE_RECLAIM_CHAIN || !grew_v6)
+			dce_table_reclaim(ipst, B_TRUE, fraction);
+	}
+	dce_update_stats(ipst);
+	mutex_exit(&ipst->ips_dce_resize_lock);
+
+	dce_reap(ipst);
+	if (why == 0)
+		return;
+
 	/*
 	 * Walk all CONNs that can have a reference on an ire, nce or dce.
 	 * Get them to update any stale references to drop any refholds they
@@ -203,9 +545,10 @@ ip_dce_reclaim_stack(ip_stack_t *ipst)
 }
 
 /*
- * Called by dce_reclaim_worker() below, and no one else.  Typically this will
- * mean that the number of entries in the hash buckets has exceeded a tunable
- * threshold.
+ * Called by dce_reclaim_worker() below, and no one else.  The worker runs
+ * every ip_dce_reclaim_interval seconds, and sooner when the number of
+ * entries in a hash bucket has exceeded a tunable threshold or the system
+ * is low on memory.
  */
 static void
 ip_dce_reclaim(void)
@@ -226,13 +569,41 @@ ip_dce_reclaim(void)
 			netstack_rele(ns);
 			continue;
 		}
-		if (atomic_swap_uint(&ipst->ips_dce_reclaim_needed, 0) != 0)
-			ip_dce_reclaim_stack(ipst);
+		ip_dce_reclaim_stack(ipst,
+		    atomic_swap_uint(&ipst->ips_dce_reclaim_needed, 0));
 		netstack_rele(ns);
 	}
 	netstack_next_fini(&nh);
 }
 
+/*
+ * Called by the memory allocator subsystem directly, when the system
+ * is running low on memory. Reclaiming has to wait for lock-free lookups,
+ * so it is left to the worker.
+ */
+/* ARGSUSED */
+static void
+dce_cache_reclaim(void *arg)
+{
+	netstack_handle_t nh;
+	netstack_t *ns;
+	ip_stack_t *ipst;
+
+	netstack_next_init(&nh);
+	while ((ns = netstack_next(&nh)) != NULL) {
+		if ((ipst = ns->netstack_ip) != NULL) {
+			atomic_or_uint(&ipst->ips_dce_reclaim_needed,
+			    DCE_RECLAIM_MEMORY);
+		}
+		netstack_rele(ns);
+	}
+	netstack_next_fini(&nh);
+
+	mutex_enter(&dce_reclaim_lock);
+	cv_signal(&dce_reclaim_cv);
+	mutex_exit(&dce_reclaim_lock);
+}
+
 /* ARGSUSED */
 static void
 dce_reclaim_worker(void *arg)
@@ -270,7 +641,8 @@ void
 dce_g_init(void)
 {
 	dce_cache = kmem_cache_create("dce_cache",
-	    sizeof (dce_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	    sizeof (dce_t), 0, NULL, NULL, dce_cache_reclaim, NULL, NULL, 0);
+	dce_cpu = kmem_zalloc(max_ncpus * sizeof (dce_cpu_t), KM_SLEEP);
 
 	mutex_init(&dce_reclaim_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&dce_reclaim_cv, NULL, CV_DEFAULT, NULL);
@@ -292,6 +664,8 @@ dce_g_destroy(void)
 	cv_destroy(&dce_reclaim_cv);
 	mutex_destroy(&dce_reclaim_lock);
 
+	kmem_free(dce_cpu, max_ncpus * sizeof (dce_cpu_t));
+	dce_cpu = NULL;
 	kmem_cache_destroy(dce_cache);
 }
 
@@ -301,8 +675,6 @@ dce_g_destroy(void)
 void
 dce_stack_init(ip_stack_t *ipst)
 {
-	int	i;
-
 	ipst->ips_dce_default = kmem_cache_alloc(dce_cache, KM_SLEEP);
 	bzero(ipst->ips_dce_default, sizeof (dce_t));
 	ipst->ips_dce_default->dce_flags = DCEF_DEFAULT;
@@ -313,34 +685,22 @@ dce_stack_init(ip_stack_t *ipst)
 	ipst->ips_dce_default->dce_ipst = ipst;
 
 	/* This must be a power of two since we are using IRE_ADDR_HASH macro */
-	ipst->ips_dce_hashsize = ip_dce_hash_size;
-	ipst->ips_dce_hash_v4 = kmem_zalloc(ipst->ips_dce_hashsize *
-	    sizeof (dcb_t), KM_SLEEP);
-	ipst->ips_dce_hash_v6 = kmem_zalloc(ipst->ips_dce_hashsize *
-	    sizeof (dcb_t), KM_SLEEP);
-	for (i = 0; i < ipst->ips_dce_hashsize; i++) {
-		rw_init(&ipst->ips_dce_hash_v4[i].dcb_lock, NULL, RW_DEFAULT,
-		    NULL);
-		rw_init(&ipst->ips_dce_hash_v6[i].dcb_lock, NULL, RW_DEFAULT,
-		    NULL);
-	}
+	ipst->ips_dce_table_v4 = dce_table_alloc(ip_dce_hash_size, KM_SLEEP);
+	ipst->ips_dce_table_v6 = dce_table_alloc(ip_dce_hash_size, KM_SLEEP);
+	mutex_init(&ipst->ips_dce_resize_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&ipst->ips_dce_reap_lock, NULL, MUTEX_DEFAULT, NULL);
 }
 
 void
 dce_stack_destroy(ip_stack_t *ipst)
 {
-	int i;
-	for (i = 0; i < ipst->ips_dce_hashsize; i++) {
-		rw_destroy(&ipst->ips_dce_hash_v4[i].dcb_lock);
-		rw_destroy(&ipst->ips_dce_hash_v6[i].dcb_lock);
-	}
-	kmem_free(ipst->ips_dce_hash_v4,
-	    ipst->ips_dce_hashsize * sizeof (dcb_t));
-	ipst->ips_dce_hash_v4 = NULL;
-	kmem_free(ipst->ips_dce_hash_v6,
-	    ipst->ips_dce_hashsize * sizeof (dcb_t));
-	ipst->ips_dce_hash_v6 = NULL;
-	ipst->ips_dce_hashsize = 0;
+	dce_reap(ipst);
+	mutex_destroy(&ipst->ips_dce_reap_lock);
+	mutex_destroy(&ipst->ips_dce_resize_lock);
+	dce_table_free(ipst->ips_dce_table_v4);
+	ipst->ips_dce_table_v4 = NULL;
+	dce_table_free(ipst->ips_dce_table_v6);
+	ipst->ips_dce_table_v6 = NULL;
 
 	ASSERT(ipst->ips_dce_default->dce_refcnt == 1);
 	kmem_cache_free(dce_cache, ipst->ips_dce_default);
@@ -397,6 +757,31 @@ dce_lookup_pkt(mblk_t *mp, ip_xmit_attr_t *ixa, uint_t *generationp)
 	}
 }
 
+/*
+ * Hold a DCE found by a lookup, unless it has been condemned, and note
+ * that it has been used.
+ */
+static boolean_t
+dce_lookup_hold(dce_t *dce, uint_t *generationp)
+{
+	uint_t		generation;
+	uint64_t	now;
+
+	dce_refhold(dce);
+	generation = dce->dce_generation;
+	if (generation == DCE_GENERATION_CONDEMNED) {
+		dce_refrele(dce);
+		return (B_FALSE);
+	}
+	if (generationp != NULL)
+		*generationp = generation;
+
+	now = TICK_TO_SEC(ddi_get_lbolt64());
+	if (dce->dce_last_use_time != now)
+		dce->dce_last_use_time = now;
+	return (B_TRUE);
+}
+
 /*
  * Used by callers that need to cache e.g., the datapath
  * Returns the generation number in the last argument.
@@ -404,36 +789,49 @@ dce_lookup_pkt(mblk_t *mp, ip_xmit_attr_t *ixa, uint_t *generationp)
 dce_t *
 dce_lookup_v4(ipaddr_t dst, ip_stack_t *ipst, uint_t *generationp)
 {
-	uint_t		hash;
+	dce_cpu_t	*dcc;
+	dct_t		*dct;
 	dcb_t		*dcb;
 	dce_t		*dce;
+	uint_t		seq;
 
 	/* Set *generationp before dropping the lock(s) that allow additions */
 	if (generationp != NULL)
 		*generationp = ipst->ips_dce_default->dce_generation;
 
-	hash = IRE_ADDR_HASH(dst, ipst->ips_dce_hashsize);
-	dcb = &ipst->ips_dce_hash_v4[hash];
-	rw_enter(&dcb->dcb_lock, RW_READER);
-	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
-		if (dce->dce_v4addr == dst) {
-			mutex_enter(&dce->dce_lock);
-			if (!DCE_IS_CONDEMNED(dce)) {
-				dce_refhold(dce);
-				if (generationp != NULL)
-					*generationp = dce->dce_generation;
-				mutex_exit(&dce->dce_lock);
-				rw_exit(&dcb->dcb_lock);
+	dcc = dce_read_enter();
+	dct = ipst->ips_dce_table_v4;
+	seq = dct->dct_seq;
+	membar_consumer();
+	if (!(seq & 1)) {
+		dcb = &dct->dct_bucket[IRE_ADDR_HASH(dst, dct->dct_size)];
+		for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
+			if (dce->dce_v4addr == dst &&
+			    dce_lookup_hold(dce, generationp)) {
+				dce_read_exit(dcc);
 				return (dce);
 			}
-			mutex_exit(&dce->dce_lock);
+		}
+		membar_consumer();
+		if (dct->dct_seq == seq) {
+			dce_read_exit(dcc);
+			return (dce_get_default(ipst));
+		}
+	}
+	dce_read_exit(dcc);
+
+	/* The table is being resized; look again with the bucket locked */
+	dcb = dcb_enter_v4(dst, ipst, RW_READER);
+	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
+		if (dce->dce_v4addr == dst &&
+		    dce_lookup_hold(dce, generationp)) {
+			rw_exit(&dcb->dcb_lock);
+			return (dce);
 		}
 	}
 	rw_exit(&dcb->dcb_lock);
 	/* Not found */
-	dce = ipst->ips_dce_default;
-	dce_refhold(dce);
-	return (dce);
+	return (dce_get_default(ipst));
 }
 
 /*
@@ -445,37 +843,51 @@ dce_t *
 dce_lookup_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst,
     uint_t *generationp)
 {
-	uint_t		hash;
+	dce_cpu_t	*dcc;
+	dct_t		*dct;
 	dcb_t		*dcb;
 	dce_t		*dce;
+	uint_t		seq;
 
 	/* Set *generationp before dropping the lock(s) that allow additions */
 	if (generationp != NULL)
 		*generationp = ipst->ips_dce_default->dce_generation;
 
-	hash = IRE_ADDR_HASH_V6(*dst, ipst->ips_dce_hashsize);
-	dcb = &ipst->ips_dce_hash_v6[hash];
-	rw_enter(&dcb->dcb_lock, RW_READER);
-	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
-		if (IN6_ARE_ADDR_EQUAL(&dce->dce_v6addr, dst) &&
-		    dce->dce_ifindex == ifindex) {
-			mutex_enter(&dce->dce_lock);
-			if (!DCE_IS_CONDEMNED(dce)) {
-				dce_refhold(dce);
-				if (generationp != NULL)
-					*generationp = dce->dce_generation;
-				mutex_exit(&dce->dce_lock);
-				rw_exit(&dcb->dcb_lock);
+	dcc = dce_read_enter();
+	dct = ipst->ips_dce_table_v6;
+	seq = dct->dct_seq;
+	membar_consumer();
+	if (!(seq & 1)) {
+		dcb = &dct->dct_bucket[IRE_ADDR_HASH_V6(*dst, dct->dct_size)];
+		for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
+			if (IN6_ARE_ADDR_EQUAL(&dce->dce_v6addr, dst) &&
+			    dce->dce_ifindex == ifindex &&
+			    dce_lookup_hold(dce, generationp)) {
+				dce_read_exit(dcc);
 				return (dce);
 			}
-			mutex_exit(&dce->dce_lock);
+		}
+		membar_consumer();
+		if (dct->dct_seq == seq) {
+			dce_read_exit(dcc);
+			return (dce_get_default(ipst));
+		}
+	}
+	dce_read_exit(dcc);
+
+	/* The table is being resized; look again with the bucket locked */
+	dcb = dcb_enter_v6(dst, ipst, RW_READER);
+	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
+		if (IN6_ARE_ADDR_EQUAL(&dce->dce_v6addr, dst) &&
+		    dce->dce_ifindex == ifindex &&
+		    dce_lookup_hold(dce, generationp)) {
+			rw_exit(&dcb->dcb_lock);
+			return (dce);
 		}
 	}
 	rw_exit(&dcb->dcb_lock);
 	/* Not found */
-	dce = ipst->ips_dce_default;
-	dce_refhold(dce);
-	return (dce);
+	return (dce_get_default(ipst));
 }
 
 /*
@@ -487,29 +899,23 @@ dce_lookup_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst,
 dce_t *
 dce_lookup_and_add_v4(ipaddr_t dst, ip_stack_t *ipst)
 {
-	uint_t		hash;
 	dcb_t		*dcb;
 	dce_t		*dce;
 
-	hash = IRE_ADDR_HASH(dst, ipst->ips_dce_hashsize);
-	dcb = &ipst->ips_dce_hash_v4[hash];
+	dcb = dcb_enter_v4(dst, ipst, RW_WRITER);
 	/*
 	 * Assuming that we get fairly even distribution across all of the
-	 * buckets, once one bucket is overly full, prune the whole cache.
+	 * buckets, once one bucket is overly full, grow or prune the whole
+	 * cache.
 	 */
-	if (dcb->dcb_cnt > ipst->ips_ip_dce_reclaim_threshold)
-		atomic_or_uint(&ipst->ips_dce_reclaim_needed, 1);
-	rw_enter(&dcb->dcb_lock, RW_WRITER);
+	if (dcb->dcb_cnt > ipst->ips_ip_dce_reclaim_threshold) {
+		atomic_or_uint(&ipst->ips_dce_reclaim_needed,
+		    DCE_RECLAIM_CHAIN);
+	}
 	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
-		if (dce->dce_v4addr == dst) {
-			mutex_enter(&dce->dce_lock);
-			if (!DCE_IS_CONDEMNED(dce)) {
-				dce_refhold(dce);
-				mutex_exit(&dce->dce_lock);
-				rw_exit(&dcb->dcb_lock);
-				return (dce);
-			}
-			mutex_exit(&dce->dce_lock);
+		if (dce->dce_v4addr == dst && dce_lookup_hold(dce, NULL)) {
+			rw_exit(&dcb->dcb_lock);
+			return (dce);
 		}
 	}
 	dce = kmem_cache_alloc(dce_cache, KM_NOSLEEP);
@@ -523,6 +929,7 @@ dce_lookup_and_add_v4(ipaddr_t dst, ip_stack_t *ipst)
 	dce->dce_generation = DCE_GENERATION_INITIAL;
 	dce->dce_ipversion = IPV4_VERSION;
 	dce->dce_last_change_time = TICK_TO_SEC(ddi_get_lbolt64());
+	dce->dce_last_use_time = dce->dce_last_change_time;
 	dce_refhold(dce);	/* For the hash list */
 
 	/* Link into list */
@@ -530,6 +937,7 @@ dce_lookup_and_add_v4(ipaddr_t dst, ip_stack_t *ipst)
 		dcb->dcb_dce->dce_ptpn = &dce->dce_next;
 	dce->dce_next = dcb->dcb_dce;
 	dce->dce_ptpn = &dcb->dcb_dce;
+	membar_producer();	/* For lock-free lookups */
 	dcb->dcb_dce = dce;
 	dce->dce_bucket = dcb;
 	atomic_add_32(&dcb->dcb_cnt, 1);
@@ -553,33 +961,28 @@ dce_lookup_and_add_v4(ipaddr_t dst, ip_stack_t *ipst)
 dce_t *
 dce_lookup_and_add_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst)
 {
-	uint_t		hash;
 	dcb_t		*dcb;
 	dce_t		*dce;
 
 	/* We should not create entries for link-locals w/o an ifindex */
 	ASSERT(!(IN6_IS_ADDR_LINKSCOPE(dst)) || ifindex != 0);
 
-	hash = IRE_ADDR_HASH_V6(*dst, ipst->ips_dce_hashsize);
-	dcb = &ipst->ips_dce_hash_v6[hash];
+	dcb = dcb_enter_v6(dst, ipst, RW_WRITER);
 	/*
 	 * Assuming that we get fairly even distribution across all of the
-	 * buckets, once one bucket is overly full, prune the whole cache.
+	 * buckets, once one bucket is overly full, grow or prune the whole
+	 * cache.
 	 */
-	if (dcb->dcb_cnt > ipst->ips_ip_dce_reclaim_threshold)
-		atomic_or_uint(&ipst->ips_dce_reclaim_needed, 1);
-	rw_enter(&dcb->dcb_lock, RW_WRITER);
+	if (dcb->dcb_cnt > ipst->ips_ip_dce_reclaim_threshold) {
+		atomic_or_uint(&ipst->ips_dce_reclaim_needed,
+		    DCE_RECLAIM_CHAIN);
+	}
 	for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
 		if (IN6_ARE_ADDR_EQUAL(&dce->dce_v6addr, dst) &&
-		    dce->dce_ifindex == ifindex) {
-			mutex_enter(&dce->dce_lock);
-			if (!DCE_IS_CONDEMNED(dce)) {
-				dce_refhold(dce);
-				mutex_exit(&dce->dce_lock);
-				rw_exit(&dcb->dcb_lock);
-				return (dce);
-			}
-			mutex_exit(&dce->dce_lock);
+		    dce->dce_ifindex == ifindex &&
+		    dce_lookup_hold(dce, NULL)) {
+			rw_exit(&dcb->dcb_lock);
+			return (dce);
 		}
 	}
 
@@ -595,6 +998,7 @@ dce_lookup_and_add_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst)
 	dce->dce_generation = DCE_GENERATION_INITIAL;
 	dce->dce_ipversion = IPV6_VERSION;
 	dce->dce_last_change_time = TICK_TO_SEC(ddi_get_lbolt64());
+	dce->dce_last_use_time = dce->dce_last_change_time;
 	dce_refhold(dce);	/* For the hash list */
 
 	/* Link into list */
@@ -602,6 +1006,7 @@ dce_lookup_and_add_v6(const in6_addr_t *dst, uint_t ifindex, ip_stack_t *ipst)
 		dcb->dcb_dce->dce_ptpn = &dce->dce_next;
 	dce->dce_next = dcb->dcb_dce;
 	dce->dce_ptpn = &dcb->dcb_dce;
+	membar_producer();	/* For lock-free lookups */
 	dcb->dcb_dce = dce;
 	dce->dce_bucket = dcb;
 	atomic_add_32(&dcb->dcb_cnt, 1);
@@ -761,14 +1166,14 @@ void
 dce_increment_all_generations(boolean_t isv6, ip_stack_t *ipst)
 {
 	int		i;
+	dct_t		*dct;
 	dcb_t		*dcb;
 	dce_t		*dce;
 
-	for (i = 0; i < ipst->ips_dce_hashsize; i++) {
-		if (isv6)
-			dcb = &ipst->ips_dce_hash_v6[i];
-		else
-			dcb = &ipst->ips_dce_hash_v4[i];
+	mutex_enter(&ipst->ips_dce_resize_lock);
+	dct = isv6 ? ipst->ips_dce_table_v6 : ipst->ips_dce_table_v4;
+	for (i = 0; i < dct->dct_size; i++) {
+		dcb = &dct->dct_bucket[i];
 		rw_enter(&dcb->dcb_lock, RW_WRITER);
 		for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
 			if (DCE_IS_CONDEMNED(dce))
@@ -777,24 +1182,31 @@ dce_increment_all_generations(boolean_t isv6, ip_stack_t *ipst)
 		}
 		rw_exit(&dcb->dcb_lock);
 	}
+	mutex_exit(&ipst->ips_dce_resize_lock);
 	dce_increment_generation(ipst->ips_dce_default);
 }
 
 /*
- * Caller needs to do a dce_refrele since we can't do the
- * dce_refrele under dcb_lock.
+ * Lock-free lookups may still be looking at the DCE, so dce_next is left
+ * alone and the hash list reference is dropped later by dce_reap().
  */
 static void
 dce_delete_locked(dcb_t *dcb, dce_t *dce)
 {
+	ip_stack_t	*ipst = dce->dce_ipst;
+
 	dce->dce_bucket = NULL;
 	*dce->dce_ptpn = dce->dce_next;
 	if (dce->dce_next != NULL)
 		dce->dce_next->dce_ptpn = dce->dce_ptpn;
 	dce->dce_ptpn = NULL;
-	dce->dce_next = NULL;
 	atomic_add_32(&dcb->dcb_cnt, -1);
 	dce_make_condemned(dce);
+
+	mutex_enter(&ipst->ips_dce_reap_lock);
+	dce->dce_reap_next = ipst->ips_dce_reap;
+	ipst->ips_dce_reap = dce;
+	mutex_exit(&ipst->ips_dce_reap_lock);
 }
 
 static void
@@ -805,6 +1217,7 @@ dce_inactive(dce_t *dce)
 	ASSERT(!(dce->dce_flags & DCEF_DEFAULT));
 	ASSERT(dce->dce_ptpn == NULL);
 	ASSERT(dce->dce_bucket == NULL);
+	ASSERT(dce->dce_reap_next == NULL);
 
 	/* Count how many condemned dces for kmem_cache callback */
 	if (DCE_IS_CONDEMNED(dce))
@@ -853,6 +1266,7 @@ ip_snmp_get_mib2_ip_dce(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst)
 	dest_cache_entry_t	dest_cache;
 	mblk_t			*mp_tail = NULL;
 	dce_t			*dce;
+	dct_t			*dct;
 	dcb_t			*dcb;
 	int			i;
 	uint64_t		current_time;
@@ -870,8 +1284,10 @@ ip_snmp_get_mib2_ip_dce(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst)
 	optp->level = MIB2_IP;
 	optp->name = EXPER_IP_DCE;
 
-	for (i = 0; i < ipst->ips_dce_hashsize; i++) {
-		dcb = &ipst->ips_dce_hash_v4[i];
+	mutex_enter(&ipst->ips_dce_resize_lock);
+	dct = ipst->ips_dce_table_v4;
+	for (i = 0; i < dct->dct_size; i++) {
+		dcb = &dct->dct_bucket[i];
 		rw_enter(&dcb->dcb_lock, RW_READER);
 		for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
 			dest_cache.DestIpv4Address = dce->dce_v4addr;
@@ -893,6 +1309,7 @@ ip_snmp_get_mib2_ip_dce(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst)
 		}
 		rw_exit(&dcb->dcb_lock);
 	}
+	mutex_exit(&ipst->ips_dce_resize_lock);
 	optp->len = (t_uscalar_t)msgdsize(mpctl->b_cont);
 	ip3dbg(("ip_snmp_get: level %d, name %d, len %d\n",
 	    (int)optp->level, (int)optp->name, (int)optp->len));
@@ -912,8 +1329,10 @@ ip_snmp_get_mib2_ip_dce(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst)
 	optp->level = MIB2_IP6;
 	optp->name = EXPER_IP_DCE;
 
-	for (i = 0; i < ipst->ips_dce_hashsize; i++) {
-		dcb = &ipst->ips_dce_hash_v6[i];
+	mutex_enter(&ipst->ips_dce_resize_lock);
+	dct = ipst->ips_dce_table_v6;
+	for (i = 0; i < dct->dct_size; i++) {
+		dcb = &dct->dct_bucket[i];
 		rw_enter(&dcb->dcb_lock, RW_READER);
 		for (dce = dcb->dcb_dce; dce != NULL; dce = dce->dce_next) {
 			dest_cache.DestIpv6Address = dce->dce_v6addr;
@@ -938,6 +1357,7 @@ ip_snmp_get_mib2_ip_dce(queue_t *q, mblk_t *mpctl, ip_stack_t *ipst)
 		}
 		rw_exit(&dcb->dcb_lock);
 	}
+	mutex_exit(&ipst->ips_dce_resize_lock);
 	optp->len = (t_uscalar_t)msgdsize(mpctl->b_cont);
 	ip3dbg(("ip_snmp_get: level %d, name %d, len %d\n",
 	    (int)optp->level, (int)optp->name, (int)optp->len));
@@ -955,20 +1375,22 @@ void
 dce_cleanup(uint_t ifindex, ip_stack_t *ipst)
 {
 	uint_t	i;
+	dct_t	*dct;
 	dcb_t	*dcb;
 	dce_t	*dce, *nextdce;
 
-	for (i = 0; i < ipst->ips_dce_hashsize; i++) {
-		dcb = &ipst->ips_dce_hash_v6[i];
+	mutex_enter(&ipst->ips_dce_resize_lock);
+	dct = ipst->ips_dce_table_v6;
+	for (i = 0; i < dct->dct_size; i++) {
+		dcb = &dct->dct_bucket[i];
 		rw_enter(&dcb->dcb_lock, RW_WRITER);
 
 		for (dce = dcb->dcb_dce; dce != NULL; dce = nextdce) {
 			nextdce = dce->dce_next;
-			if (dce->dce_ifindex == ifindex) {
+			if (dce->dce_ifindex == ifindex)
 				dce_delete_locked(dcb, dce);
-				dce_refrele(dce);
-			}
 		}
 		rw_exit(&dcb->dcb_lock);
 	}
+	mutex_exit(&ipst->ips_dce_resize_lock);
 }
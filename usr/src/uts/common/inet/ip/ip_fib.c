@@ -0,0 +1,674 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Compressed forwarding tables.
+ *
+ * The IPv4 forwarding table is a radix tree and the IPv6 one a hash table
+ * per prefix length; both are searched under a table wide lock.  With a
+ * full Internet routing table a lookup costs several cache misses, so for
+ * large tables we also keep a read-only multibit trie that answers the
+ * destination-only lookups done by ire_ftable_lookup_simple_v4/v6(), i.e.
+ * by ip_input() when forwarding.
+ *
+ * The trie is indexed by the top 16 bits of the address and then by each
+ * following byte, so an IPv4 lookup visits at most three entries and an
+ * IPv6 lookup at most fifteen.  Prefixes are pushed down to the leaves,
+ * hence there is no backtracking.  Below the first level each node of 256
+ * entries is stored as the runs of identical entries it is made of: a
+ * 256 bit map marks the entries starting a new run and the run values are
+ * kept packed in fib_runs.  Finding an entry is a popcount of the map.
+ *
+ * A leaf refers to the IRE the lookup in the main table would return
+ * first; the trie holds a reference on each such IRE.  Some results still
+ * have to come from the main table: ECMP, IRE_INTERFACE routes (which may
+ * need an IRE_IF_CLONE created) and prefixes that have an IRE_IF_CLONE.
+ * The lookup functions return NULL in those cases as well as when there
+ * is no route, and the caller falls back to the normal lookup.
+ *
+ * The trie is never modified.  ip_fib_changed() is called whenever an IRE
+ * is added to or deleted from the forwarding table.  It marks the first
+ * level entries the prefix covers as dirty, which sends lookups for those
+ * addresses to the main table, and schedules a rebuild of the trie.  The
+ * rebuild runs from a taskq ip_fib_rebuild_ms after the first change, so
+ * that a burst of changes costs a single rebuild, and the new trie
+ * replaces the old one in a single pointer store.
+ *
+ * Lookups take no locks; they run as SMR read-side critical sections, and
+ * having replaced a trie the rebuild waits out a grace period before
+ * freeing the old one.
+ *
+ * Stacks with fewer than ip_fib_min_routes routes do not get a trie.
+ */
+
+#include <sys/types.h>
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/cpuvar.h>
+#include <sys/disp.h>
+#include <sys/bitmap.h>
+#include <sys/atomic.h>
+#include <sys/taskq.h>
+#include <sys/smr.h>
+#include <sys/ddi.h>
+#include <sys/sunddi.h>
+#include <util/qsort.h>
+
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/ip6.h>
+#include <inet/ip_ire.h>
+
+/* Setable in /etc/system */
+uint_t	ip_fib_min_routes = 1024;	/* Smallest table to build a trie for */
+uint_t	ip_fib_rebuild_ms = 500;	/* Delay from change to rebuild */
+
+#define	IPFIB_TOP_BITS	16
+#define	IPFIB_TOP_SIZE	(1 << IPFIB_TOP_BITS)
+#define	IPFIB_LEVELS	((IPV6_ABITS - IPFIB_TOP_BITS) / NBBY + 1)
+
+/*
+ * An entry either refers to a node of the next level (IPFIB_NODE set) or
+ * is a leaf.  Leaf 0 is no route, IPFIB_SLOW means that the main table
+ * must be used and any other leaf n refers to fib_ires[n - 1].
+ */
+#define	IPFIB_NODE	0x80000000u
+#define	IPFIB_SLOW	0x7fffffffu
+
+typedef struct ipfib_node {
+	uint64_t	fn_runs[4];	/* Entries that start a new run */
+	uint32_t	fn_base;	/* Index of the first run in fib_runs */
+	uint8_t		fn_rank[4];	/* Runs starting before each word */
+} ipfib_node_t;
+
+typedef struct ip_fib {
+	uint32_t	*fib_top;	/* The IPFIB_TOP_SIZE first entries */
+	ulong_t		*fib_dirty;	/* Changed since the build */
+	ipfib_node_t	*fib_nodes;
+	uint_t		fib_nnodes;
+	uint_t		fib_maxnodes;
+	uint32_t	*fib_runs;
+	uint_t		fib_nruns;
+	uint_t		fib_maxruns;
+	ire_t		**fib_ires;
+	uint_t		fib_nires;
+	uint_t		fib_maxires;
+} ip_fib_t;
+
+/* ips_fib_flags */
+#define	IPFIB_DIRTY_V4	0x01	/* IPv4 trie needs a rebuild */
+#define	IPFIB_DIRTY_V6	0x02	/* IPv6 trie needs a rebuild */
+#define	IPFIB_RUNNING	0x04	/* ip_fib_rebuild() dispatched */
+#define	IPFIB_SHUTDOWN	0x08	/* Stack going away */
+
+/* A route collected from the main table while building */
+typedef struct ipfib_pfx {
+	uint8_t		fp_addr[IPV6_ADDR_LEN];
+	uint_t		fp_len;
+	uint_t		fp_seq;		/* Order in the walk, then the leaf */
+	ire_t		*fp_ire;
+} ipfib_pfx_t;
+
+typedef struct ipfib_build {
+	ip_fib_t	*fb_fib;
+	boolean_t	fb_isv6;
+	boolean_t	fb_nomem;
+	ipfib_pfx_t	*fb_pfx;
+	uint_t		fb_npfx;
+	uint_t		fb_maxpfx;
+	uint32_t	fb_ent[IPFIB_LEVELS][256];
+} ipfib_build_t;
+
+static void	ip_fib_timer(void *);
+
+static uint_t
+ip_fib_popcount(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return ((uint_t)((x * 0x0101010101010101ULL) >> 56));
+}
+
+static uint_t
+ip_fib_top_index(const uint8_t *addr)
+{
+	return ((addr[0] << NBBY) | addr[1]);
+}
+
+/*
+ * Index of the entry for addr in the node at the given level, level 0
+ * being fib_top.
+ */
+static uint_t
+ip_fib_index(const uint8_t *addr, uint_t level)
+{
+	return (level == 0 ? ip_fib_top_index(addr) : addr[level + 1]);
+}
+
+/* Address bits consumed once the given level has been looked at. */
+static uint_t
+ip_fib_level_bits(uint_t level)
+{
+	return (IPFIB_TOP_BITS + level * NBBY);
+}
+
+static uint32_t
+ip_fib_walk(const ip_fib_t *fib, const uint8_t *addr)
+{
+	const ipfib_node_t *fn;
+	uint32_t e;
+	uint64_t runs;
+	uint_t i, b, w;
+
+	e = fib->fib_top[ip_fib_top_index(addr)];
+	for (i = 2; e & IPFIB_NODE; i++) {
+		fn = &fib->fib_nodes[e & ~IPFIB_NODE];
+		b = addr[i];
+		w = b >> 6;
+		/* The runs starting at or before entry b of this word */
+		runs = fn->fn_runs[w] & ((2ULL << (b & 63)) - 1);
+		e = fib->fib_runs[fn->fn_base + fn->fn_rank[w] +
+		    ip_fib_popcount(runs) - 1];
+	}
+	return (e);
+}
+
+static ire_t *
+ip_fib_lookup(ip_fib_t **fibp, const uint8_t *addr)
+{
+	ip_fib_t	*fib;
+	ire_t		*ire = NULL;
+	uint32_t	e;
+
+	SMR_ENTER();
+	fib = *fibp;
+	if (fib == NULL || BT_TEST(fib->fib_dirty, ip_fib_top_index(addr)))
+		goto done;
+	e = ip_fib_walk(fib, addr);
+	if (e == 0 || e == IPFIB_SLOW)
+		goto done;
+	ire = fib->fib_ires[e - 1];
+	if (IRE_IS_CONDEMNED(ire) || (ire->ire_type & IRE_INTERFACE))
+		ire = NULL;
+	else
+		ire_refhold(ire);
+done:
+	SMR_EXIT();
+	return (ire);
+}
+
+/*
+ * Return a held IRE for the longest match of addr, or NULL if the caller
+ * has to do the lookup in the forwarding table.
+ */
+ire_t *
+ip_fib_lookup_v4(ipaddr_t addr, ip_stack_t *ipst)
+{
+	return (ip_fib_lookup(&ipst->ips_fib_v4, (uint8_t *)&addr));
+}
+
+ire_t *
+ip_fib_lookup_v6(const in6_addr_t *addr, ip_stack_t *ipst)
+{
+	return (ip_fib_lookup(&ipst->ips_fib_v6, (uint8_t *)addr));
+}
+
+static void
+ip_fib_free(ip_fib_t *fib)
+{
+	uint_t i;
+
+	for (i = 0; i < fib->fib_nires; i++)
+		ire_refrele_notr(fib->fib_ires[i]);
+	if (fib->fib_ires != NULL) {
+		kmem_free(fib->fib_ires,
+		    fib->fib_maxires * sizeof (ire_t *));
+	}
+	if (fib->fib_runs != NULL)
+		kmem_free(fib->fib_runs, fib->fib_maxruns * sizeof (uint32_t));
+	if (fib->fib_nodes != NULL) {
+		kmem_free(fib->fib_nodes,
+		    fib->fib_maxnodes * sizeof (ipfib_node_t));
+	}
+	if (fib->fib_top != NULL)
+		kmem_free(fib->fib_top, IPFIB_TOP_SIZE * sizeof (uint32_t));
+	kmem_free(fib->fib_dirty, BT_SIZEOFMAP(IPFIB_TOP_SIZE));
+	kmem_free(fib, sizeof (*fib));
+}
+
+/*
+ * Called by ire_walk_v4/v6() for each IRE in the forwarding table.
+ */
+static void
+ip_fib_collect(ire_t *ire, char *arg)
+{
+	ipfib_build_t	*fb = (ipfib_build_t *)arg;
+	ipfib_pfx_t	*fp;
+
+	if (fb->fb_nomem || IRE_IS_CONDEMNED(ire))
+		return;
+	/* ire_ftable_lookup_simple_v6() does not return these */
+	if (fb->fb_isv6 && ire->ire_testhidden)
+		return;
+
+	if (fb->fb_npfx == fb->fb_maxpfx) {
+		uint_t max = MAX(fb->fb_maxpfx * 2, ip_fib_min_routes);
+
+		fp = kmem_alloc(max * sizeof (*fp), KM_NOSLEEP);
+		if (fp == NULL) {
+			fb->fb_nomem = B_TRUE;
+			return;
+		}
+		if (fb->fb_pfx != NULL) {
+			bcopy(fb->fb_pfx, fp, fb->fb_npfx * sizeof (*fp));
+			kmem_free(fb->fb_pfx, fb->fb_maxpfx * sizeof (*fp));
+		}
+		fb->fb_pfx = fp;
+		fb->fb_maxpfx = max;
+	}
+
+	fp = &fb->fb_pfx[fb->fb_npfx];
+	bzero(fp->fp_addr, sizeof (fp->fp_addr));
+	if (fb->fb_isv6) {
+		bcopy(&ire->ire_addr_v6, fp->fp_addr, IPV6_ADDR_LEN);
+		fp->fp_len = ip_mask_to_plen_v6(&ire->ire_mask_v6);
+	} else {
+		bcopy(&ire->ire_addr, fp->fp_addr, IP_ADDR_LEN);
+		fp->fp_len = ip_mask_to_plen(ire->ire_mask);
+	}
+	fp->fp_seq = fb->fb_npfx++;
+	fp->fp_ire = ire;
+	ire_refhold_notr(ire);
+}
+
+/*
+ * Sort by address and then by prefix length, which puts a prefix before
+ * all of the longer prefixes it covers.  Routes to the same prefix stay
+ * in the order the walk found them.
+ */
+static int
+ip_fib_pfx_cmp(const void *a1, const void *a2)
+{
+	const ipfib_pfx_t *p1 = a1;
+	const ipfib_pfx_t *p2 = a2;
+	int c;
+
+	if ((c = memcmp(p1->fp_addr, p2->fp_addr, IPV6_ADDR_LEN)) != 0)
+		return (c);
+	if (p1->fp_len != p2->fp_len)
+		return (p1->fp_len < p2->fp_len ? -1 : 1);
+	if (p1->fp_seq != p2->fp_seq)
+		return (p1->fp_seq < p2->fp_seq ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Reduce the sorted routes to one per prefix and turn fp_seq into the
+ * prefix's leaf.  The first route found is the one a lookup returns.
+ */
+static void
+ip_fib_leaves(ipfib_build_t *fb)
+{
+	ip_fib_t	*fib = fb->fb_fib;
+	ipfib_pfx_t	*fp, *fp1;
+	boolean_t	slow;
+	uint_t		i, j, n;
+
+	fib->fib_maxires = fb->fb_npfx;
+	fib->fib_ires = kmem_alloc(fib->fib_maxires * sizeof (ire_t *),
+	    KM_SLEEP);
+
+	for (i = 0, n = 0; i < fb->fb_npfx; i = j) {
+		fp = &fb->fb_pfx[i];
+		slow = B_FALSE;
+		for (j = i; j < fb->fb_npfx; j++) {
+			fp1 = &fb->fb_pfx[j];
+			if (fp1->fp_len != fp->fp_len ||
+			    bcmp(fp1->fp_addr, fp->fp_addr, IPV6_ADDR_LEN) != 0)
+				break;
+			if (fp1->fp_ire->ire_type & IRE_IF_CLONE)
+				slow = B_TRUE;
+			if (j != i)
+				ire_refrele_notr(fp1->fp_ire);
+		}
+		if (slow) {
+			ire_refrele_notr(fp->fp_ire);
+			fp->fp_seq = IPFIB_SLOW;
+		} else {
+			fib->fib_ires[fib->fib_nires++] = fp->fp_ire;
+			fp->fp_seq = fib->fib_nires;
+		}
+		fp->fp_ire = NULL;
+		fb->fb_pfx[n++] = *fp;
+	}
+	fb->fb_npfx = n;
+}
+
+/*
+ * Store the 256 entries of a node, returning the entry referring to it.
+ */
+static uint32_t
+ip_fib_node_add(ip_fib_t *fib, const uint32_t *ent)
+{
+	ipfib_node_t	*fn;
+	uint_t		i, nruns, max;
+	void		*p;
+
+	for (i = 1, nruns = 1; i < 256; i++) {
+		if (ent[i] != ent[i - 1])
+			nruns++;
+	}
+	if (nruns == 1)
+		return (ent[0]);
+
+	if (fib->fib_nnodes == fib->fib_maxnodes) {
+		max = MAX(fib->fib_maxnodes * 2, 64);
+		p = kmem_alloc(max * sizeof (ipfib_node_t), KM_SLEEP);
+		if (fib->fib_nodes != NULL) {
+			bcopy(fib->fib_nodes, p,
+			    fib->fib_nnodes * sizeof (ipfib_node_t));
+			kmem_free(fib->fib_nodes,
+			    fib->fib_maxnodes * sizeof (ipfib_node_t));
+		}
+		fib->fib_nodes = p;
+		fib->fib_maxnodes = max;
+	}
+	while (fib->fib_nruns + nruns > fib->fib_maxruns) {
+		max = MAX(fib->fib_maxruns * 2, 1024);
+		p = kmem_alloc(max * sizeof (uint32_t), KM_SLEEP);
+		if (fib->fib_runs != NULL) {
+			bcopy(fib->fib_runs, p,
+			    fib->fib_nruns * sizeof (uint32_t));
+			kmem_free(fib->fib_runs,
+			    fib->fib_maxruns * sizeof (uint32_t));
+		}
+		fib->fib_runs = p;
+		fib->fib_maxruns = max;
+	}
+
+	fn = &fib->fib_nodes[fib->fib_nnodes];
+	bzero(fn, sizeof (*fn));
+	fn->fn_base = fib->fib_nruns;
+	for (i = 0, nruns = 0; i < 256; i++) {
+		if ((i & 63) == 0)
+			fn->fn_rank[i >> 6] = nruns;
+		if (i == 0 || ent[i] != ent[i - 1]) {
+			fn->fn_runs[i >> 6] |= 1ULL << (i & 63);
+			fib->fib_runs[fib->fib_nruns + nruns++] = ent[i];
+		}
+	}
+	fib->fib_nruns += nruns;
+	return (IPFIB_NODE | fib->fib_nnodes++);
+}
+
+/*
+ * Fill in the entries of a node at the given level from the prefixes
+ * fb_pfx[lo, hi), all of which lie under that node.  ent[] starts out
+ * holding the leaf for the prefix covering the whole node.  Since the
+ * prefixes are sorted a prefix is always applied before those it covers.
+ */
+static void
+ip_fib_fill(ipfib_build_t *fb, uint_t level, uint_t lo, uint_t hi,
+    uint32_t *ent)
+{
+	ipfib_pfx_t	*fp;
+	uint32_t	*cent;
+	uint_t		bits = ip_fib_level_bits(level);
+	uint_t		i, j, idx, n;
+
+	for (i = lo; i < hi; i = j) {
+		fp = &fb->fb_pfx[i];
+		idx = ip_fib_index(fp->fp_addr, level);
+		if (fp->fp_len <= bits) {
+			/* Ends at this level; covers 2^(bits - len) entries */
+			n = 1 << (bits - fp->fp_len);
+			ASSERT((idx & (n - 1)) == 0);
+			for (j = idx; j < idx + n; j++) {
+				ASSERT(!(ent[j] & IPFIB_NODE));
+				ent[j] = fp->fp_seq;
+			}
+			j = i + 1;
+			continue;
+		}
+
+		/* Longer prefixes go in a node of the next level */
+		for (j = i + 1; j < hi; j++) {
+			if (ip_fib_index(fb->fb_pfx[j].fp_addr, level) != idx)
+				break;
+			ASSERT(fb->fb_pfx[j].fp_len > bits);
+		}
+		cent = fb->fb_ent[level + 1];
+		for (n = 0; n < 256; n++)
+			cent[n] = ent[idx];
+		ip_fib_fill(fb, level + 1, i, j, cent);
+		ent[idx] = ip_fib_node_add(fb->fb_fib, cent);
+	}
+}
+
+/*
+ * Build a new trie for one address family and put it in place of the
+ * current one.
+ */
+static void
+ip_fib_rebuild_af(ip_stack_t *ipst, boolean_t isv6)
+{
+	ip_fib_t	**fibp, **newp;
+	ip_fib_t	*fib, *ofib;
+	ipfib_build_t	*fb;
+	uint_t		i;
+
+	fibp = isv6 ? &ipst->ips_fib_v6 : &ipst->ips_fib_v4;
+	newp = isv6 ? &ipst->ips_fib_new_v6 : &ipst->ips_fib_new_v4;
+
+	/*
+	 * Changes made from here on mark the new trie's dirty map as well,
+	 * in case the walk below misses them.
+	 */
+	fib = kmem_zalloc(sizeof (*fib), KM_SLEEP);
+	fib->fib_dirty = kmem_zalloc(BT_SIZEOFMAP(IPFIB_TOP_SIZE), KM_SLEEP);
+	mutex_enter(&ipst->ips_fib_lock);
+	*newp = fib;
+	mutex_exit(&ipst->ips_fib_lock);
+
+	fb = kmem_zalloc(sizeof (*fb), KM_SLEEP);
+	fb->fb_fib = fib;
+	fb->fb_isv6 = isv6;
+	if (isv6)
+		ire_walk_v6(ip_fib_collect, fb, ALL_ZONES, ipst);
+	else
+		ire_walk_v4(ip_fib_collect, fb, ALL_ZONES, ipst);
+
+	if (fb->fb_nomem || fb->fb_npfx < ip_fib_min_routes) {
+		for (i = 0; i < fb->fb_npfx; i++)
+			ire_refrele_notr(fb->fb_pfx[i].fp_ire);
+		mutex_enter(&ipst->ips_fib_lock);
+		*newp = NULL;
+		/* Out of memory; ip_fib_rebuild() tries again later */
+		if (fb->fb_nomem)
+			ipst->ips_fib_flags |= isv6 ? IPFIB_DIRTY_V6 :
+			    IPFIB_DIRTY_V4;
+		mutex_exit(&ipst->ips_fib_lock);
+		ip_fib_free(fib);
+		fib = NULL;
+	} else {
+		qsort(fb->fb_pfx, fb->fb_npfx, sizeof (ipfib_pfx_t),
+		    ip_fib_pfx_cmp);
+		ip_fib_leaves(fb);
+		fib->fib_top = kmem_zalloc(IPFIB_TOP_SIZE * sizeof (uint32_t),
+		    KM_SLEEP);
+		ip_fib_fill(fb, 0, 0, fb->fb_npfx, fib->fib_top);
+		membar_producer();
+	}
+	if (fb->fb_pfx != NULL)
+		kmem_free(fb->fb_pfx, fb->fb_maxpfx * sizeof (ipfib_pfx_t));
+	kmem_free(fb, sizeof (*fb));
+
+	mutex_enter(&ipst->ips_fib_lock);
+	ofib = *fibp;
+	*fibp = fib;
+	*newp = NULL;
+	mutex_exit(&ipst->ips_fib_lock);
+
+	if (ofib != NULL) {
+		smr_synchronize();
+		ip_fib_free(ofib);
+	}
+}
+
+static void
+ip_fib_rebuild(void *arg)
+{
+	ip_stack_t	*ipst = arg;
+	uint_t		flags;
+
+	mutex_enter(&ipst->ips_fib_lock);
+	flags = ipst->ips_fib_flags;
+	ipst->ips_fib_flags &= ~(IPFIB_DIRTY_V4 | IPFIB_DIRTY_V6);
+	mutex_exit(&ipst->ips_fib_lock);
+
+	if (flags & IPFIB_DIRTY_V4)
+		ip_fib_rebuild_af(ipst, B_FALSE);
+	if (flags & IPFIB_DIRTY_V6)
+		ip_fib_rebuild_af(ipst, B_TRUE);
+
+	mutex_enter(&ipst->ips_fib_lock);
+	ipst->ips_fib_flags &= ~IPFIB_RUNNING;
+	if ((ipst->ips_fib_flags & (IPFIB_DIRTY_V4 | IPFIB_DIRTY_V6)) &&
+	    !(ipst->ips_fib_flags & IPFIB_SHUTDOWN) &&
+	    ipst->ips_fib_tid == 0) {
+		ipst->ips_fib_tid = timeout(ip_fib_timer, ipst,
+		    MSEC_TO_TICK(ip_fib_rebuild_ms));
+	}
+	cv_broadcast(&ipst->ips_fib_cv);
+	mutex_exit(&ipst->ips_fib_lock);
+}
+
+static void
+ip_fib_timer(void *arg)
+{
+	ip_stack_t *ipst = arg;
+
+	mutex_enter(&ipst->ips_fib_lock);
+	ipst->ips_fib_tid = 0;
+	if (!(ipst->ips_fib_flags & IPFIB_SHUTDOWN)) {
+		if (taskq_dispatch(system_taskq, ip_fib_rebuild, ipst,
+		    TQ_NOSLEEP) != NULL) {
+			ipst->ips_fib_flags |= IPFIB_RUNNING;
+		} else {
+			ipst->ips_fib_tid = timeout(ip_fib_timer, ipst,
+			    MSEC_TO_TICK(ip_fib_rebuild_ms));
+		}
+	}
+	mutex_exit(&ipst->ips_fib_lock);
+}
+
+static void
+ip_fib_mark(ip_fib_t *fib, uint_t idx, uint_t n)
+{
+	uint_t i;
+
+	if (fib == NULL)
+		return;
+	for (i = idx; i < idx + n; i++)
+		BT_SET(fib->fib_dirty, i);
+}
+
+/*
+ * Called when an IRE is added to or removed from the forwarding table.
+ * Addresses under the IRE's prefix are looked up in the forwarding table
+ * until the next rebuild.
+ */
+void
+ip_fib_changed(ire_t *ire)
+{
+	ip_stack_t	*ipst = ire->ire_ipst;
+	boolean_t	isv6 = (ire->ire_ipversion == IPV6_VERSION);
+	const uint8_t	*addr;
+	uint_t		plen, idx, n;
+
+	if (isv6) {
+		addr = (uint8_t *)&ire->ire_addr_v6;
+		plen = ip_mask_to_plen_v6(&ire->ire_mask_v6);
+	} else {
+		addr = (uint8_t *)&ire->ire_addr;
+		plen = ip_mask_to_plen(ire->ire_mask);
+	}
+	idx = ip_fib_top_index(addr);
+	n = plen >= IPFIB_TOP_BITS ? 1 : 1 << (IPFIB_TOP_BITS - plen);
+	idx &= ~(n - 1);
+
+	mutex_enter(&ipst->ips_fib_lock);
+	if (isv6) {
+		ip_fib_mark(ipst->ips_fib_v6, idx, n);
+		ip_fib_mark(ipst->ips_fib_new_v6, idx, n);
+		ipst->ips_fib_flags |= IPFIB_DIRTY_V6;
+	} else {
+		ip_fib_mark(ipst->ips_fib_v4, idx, n);
+		ip_fib_mark(ipst->ips_fib_new_v4, idx, n);
+		ipst->ips_fib_flags |= IPFIB_DIRTY_V4;
+	}
+	if (ipst->ips_fib_tid == 0 &&
+	    !(ipst->ips_fib_flags & (IPFIB_RUNNING | IPFIB_SHUTDOWN))) {
+		ipst->ips_fib_tid = timeout(ip_fib_timer, ipst,
+		    MSEC_TO_TICK(ip_fib_rebuild_ms));
+	}
+	mutex_exit(&ipst->ips_fib_lock);
+}
+
+void
+ip_fib_stack_init(ip_stack_t *ipst)
+{
+	mutex_init(&ipst->ips_fib_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&ipst->ips_fib_cv, NULL, CV_DEFAULT, NULL);
+}
+
+/*
+ * Free the tries, which hold IREs, and stop building new ones.  Lookups
+ * and changes may still come in until ip_fib_stack_fini().
+ */
+void
+ip_fib_stack_shutdown(ip_stack_t *ipst)
+{
+	timeout_id_t	tid;
+	ip_fib_t	*fib4, *fib6;
+
+	mutex_enter(&ipst->ips_fib_lock);
+	ipst->ips_fib_flags |= IPFIB_SHUTDOWN;
+	tid = ipst->ips_fib_tid;
+	ipst->ips_fib_tid = 0;
+	mutex_exit(&ipst->ips_fib_lock);
+	if (tid != 0)
+		(void) untimeout(tid);
+
+	mutex_enter(&ipst->ips_fib_lock);
+	while (ipst->ips_fib_flags & IPFIB_RUNNING)
+		cv_wait(&ipst->ips_fib_cv, &ipst->ips_fib_lock);
+	fib4 = ipst->ips_fib_v4;
+	fib6 = ipst->ips_fib_v6;
+	ipst->ips_fib_v4 = NULL;
+	ipst->ips_fib_v6 = NULL;
+	mutex_exit(&ipst->ips_fib_lock);
+
+	smr_synchronize();
+	if (fib4 != NULL)
+		ip_fib_free(fib4);
+	if (fib6 != NULL)
+		ip_fib_free(fib6);
+}
+
+void
+ip_fib_stack_fini(ip_stack_t *ipst)
+{
+	ASSERT(ipst->ips_fib_v4 == NULL && ipst->ips_fib_v6 == NULL);
+	cv_destroy(&ipst->ips_fib_cv);
+	mutex_destroy(&ipst->ips_fib_lock);
+}
@@ -227,6 +227,22 @@ ire_ftable_lookup_simple_v4(ipaddr_t addr, uint32_t xmit_hint, ip_stack_t *ipst,
 	struct rt_entry *rt;
 	irb_t *irb;
 
+	/*
+	 * Try the compressed table first.  It leaves ECMP to the code
+	 * below.
+	 */
+	if ((ire = ip_fib_lookup_v4(addr, ipst)) != NULL) {
+		if (ire->ire_bucket->irb_ire_cnt == 1 ||
+		    ipst->ips_ip_ecmp_behavior == 0 ||
+		    (ipst->ips_ip_ecmp_behavior == 1 &&
+		    !IS_DEFAULT_ROUTE(ire))) {
+			if (generationp != NULL)
+				*generationp = ire->ire_generation;
+			return (ire);
+		}
+		ire_refrele(ire);
+	}
+
 	rdst.rt_sin_len = sizeof (rdst);
 	rdst.rt_sin_family = AF_INET;
 	rdst.rt_sin_addr.s_addr = addr;
@@ -920,9 +936,9 @@ ire_round_robin(irb_t *irb_ptr, ire_ftable_args_t *margs, uint_t hash,
 				irb_refrele(irb_ptr);
 				RADIX_NODE_HEAD_RLOCK(ipst->ips_ip_ftable);
 			} else {
-				rw_exit(&ipst->ips_ip6_ire_head_lock);
+				pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 				irb_refrele(irb_ptr);
-				rw_enter(&ipst->ips_ip6_ire_head_lock,
+				pcrw_enter(&ipst->ips_ip6_ire_head_lock,
 				    RW_READER);
 			}
 			return (ire);
@@ -956,9 +972,9 @@ next_ire_skip:
 		irb_refrele(irb_ptr);
 		RADIX_NODE_HEAD_RLOCK(ipst->ips_ip_ftable);
 	} else {
-		rw_exit(&ipst->ips_ip6_ire_head_lock);
+		pcrw_exit(&ipst->ips_ip6_ire_head_lock);
 		irb_refrele(irb_ptr);
-		rw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
+		pcrw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
 	}
 	return (maybe_ire);
 }
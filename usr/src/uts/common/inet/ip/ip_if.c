@@ -178,6 +178,7 @@ static void	ill_dl_down(ill_t *ill);
 static void	ill_down(ill_t *ill);
 static void	ill_down_ipifs(ill_t *, boolean_t);
 static void	ill_free_mib(ill_t *ill);
+static void	ill_ip_mib_free(ill_t *ill);
 static void	ill_glist_delete(ill_t *);
 static void	ill_phyint_reinit(ill_t *ill);
 static void	ill_set_nce_router_flags(ill_t *, boolean_t);
@@ -306,45 +307,57 @@ uint_t	ill_no_arena = 12;	/* Setable in /etc/system */
 static boolean_t
 ill_allocate_mibs(ill_t *ill)
 {
+	mib2_ipIfStatsEntry_t *mib;
+	uint_t ncpu = ip_mib_cpu_mask + 1;
+	uint_t i;
+
 	/* Already allocated? */
-	if (ill->ill_ip_mib != NULL) {
+	if (ill->ill_ip_mib_cpu != NULL) {
 		if (ill->ill_isv6)
 			ASSERT(ill->ill_icmp6_mib != NULL);
 		return (B_TRUE);
 	}
 
-	ill->ill_ip_mib = kmem_zalloc(sizeof (*ill->ill_ip_mib),
+	ill->ill_ip_mib_cpu = kmem_zalloc(ncpu * sizeof (*ill->ill_ip_mib_cpu),
 	    KM_NOSLEEP);
-	if (ill->ill_ip_mib == NULL) {
+	if (ill->ill_ip_mib_cpu == NULL)
+		return (B_FALSE);
+	mib = kmem_zalloc(ncpu * sizeof (*mib), KM_NOSLEEP);
+	if (mib == NULL) {
+		kmem_free(ill->ill_ip_mib_cpu,
+		    ncpu * sizeof (*ill->ill_ip_mib_cpu));
+		ill->ill_ip_mib_cpu = NULL;
 		return (B_FALSE);
 	}
+	for (i = 0; i < ncpu; i++)
+		ill->ill_ip_mib_cpu[i] = &mib[i];
 
-	/* Setup static information */
-	SET_MIB(ill->ill_ip_mib->ipIfStatsEntrySize,
+	/* Setup static information; kept in the first copy only */
+	SET_MIB(mib->ipIfStatsEntrySize,
 	    sizeof (mib2_ipIfStatsEntry_t));
 	if (ill->ill_isv6) {
-		ill->ill_ip_mib->ipIfStatsIPVersion = MIB2_INETADDRESSTYPE_ipv6;
-		SET_MIB(ill->ill_ip_mib->ipIfStatsAddrEntrySize,
+		mib->ipIfStatsIPVersion = MIB2_INETADDRESSTYPE_ipv6;
+		SET_MIB(mib->ipIfStatsAddrEntrySize,
 		    sizeof (mib2_ipv6AddrEntry_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsRouteEntrySize,
+		SET_MIB(mib->ipIfStatsRouteEntrySize,
 		    sizeof (mib2_ipv6RouteEntry_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsNetToMediaEntrySize,
+		SET_MIB(mib->ipIfStatsNetToMediaEntrySize,
 		    sizeof (mib2_ipv6NetToMediaEntry_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsMemberEntrySize,
+		SET_MIB(mib->ipIfStatsMemberEntrySize,
 		    sizeof (ipv6_member_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsGroupSourceEntrySize,
+		SET_MIB(mib->ipIfStatsGroupSourceEntrySize,
 		    sizeof (ipv6_grpsrc_t));
 	} else {
-		ill->ill_ip_mib->ipIfStatsIPVersion = MIB2_INETADDRESSTYPE_ipv4;
-		SET_MIB(ill->ill_ip_mib->ipIfStatsAddrEntrySize,
+		mib->ipIfStatsIPVersion = MIB2_INETADDRESSTYPE_ipv4;
+		SET_MIB(mib->ipIfStatsAddrEntrySize,
 		    sizeof (mib2_ipAddrEntry_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsRouteEntrySize,
+		SET_MIB(mib->ipIfStatsRouteEntrySize,
 		    sizeof (mib2_ipRouteEntry_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsNetToMediaEntrySize,
+		SET_MIB(mib->ipIfStatsNetToMediaEntrySize,
 		    sizeof (mib2_ipNetToMediaEntry_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsMemberEntrySize,
+		SET_MIB(mib->ipIfStatsMemberEntrySize,
 		    sizeof (ip_member_t));
-		SET_MIB(ill->ill_ip_mib->ipIfStatsGroupSourceEntrySize,
+		SET_MIB(mib->ipIfStatsGroupSourceEntrySize,
 		    sizeof (ip_grpsrc_t));
 
 		/*
@@ -357,8 +370,7 @@ ill_allocate_mibs(ill_t *ill)
 	ill->ill_icmp6_mib = kmem_zalloc(sizeof (*ill->ill_icmp6_mib),
 	    KM_NOSLEEP);
 	if (ill->ill_icmp6_mib == NULL) {
-		kmem_free(ill->ill_ip_mib, sizeof (*ill->ill_ip_mib));
-		ill->ill_ip_mib = NULL;
+		ill_ip_mib_free(ill);
 		return (B_FALSE);
 	}
 	/* static icmp info */
@@ -643,27 +655,53 @@ ill_delete_tail(ill_t *ill)
 	ill->ill_ipst = NULL;
 }
 
+/*
+ * Sum the per-CPU copies of the interface ip mib into `mib'.  Callers
+ * are expected to keep the ill from being freed for the duration.
+ */
+void
+ill_ip_mib_sum(ill_t *ill, mib2_ipIfStatsEntry_t *mib)
+{
+	uint_t i;
+
+	bcopy(ill->ill_ip_mib_cpu[0], mib, sizeof (*mib));
+	for (i = 1; i <= ip_mib_cpu_mask; i++)
+		ip_mib2_add_ip_stats(mib, ill->ill_ip_mib_cpu[i]);
+}
+
+static void
+ill_ip_mib_free(ill_t *ill)
+{
+	uint_t ncpu = ip_mib_cpu_mask + 1;
+
+	kmem_free(ill->ill_ip_mib_cpu[0],
+	    ncpu * sizeof (*ill->ill_ip_mib_cpu[0]));
+	kmem_free(ill->ill_ip_mib_cpu, ncpu * sizeof (*ill->ill_ip_mib_cpu));
+	ill->ill_ip_mib_cpu = NULL;
+}
+
 static void
 ill_free_mib(ill_t *ill)
 {
 	ip_stack_t *ipst = ill->ill_ipst;
+	uint_t i;
 
 	/*
 	 * MIB statistics must not be lost, so when an interface
 	 * goes away the counter values will be added to the global
 	 * MIBs.
 	 */
-	if (ill->ill_ip_mib != NULL) {
-		if (ill->ill_isv6) {
-			ip_mib2_add_ip_stats(&ipst->ips_ip6_mib,
-			    ill->ill_ip_mib);
-		} else {
-			ip_mib2_add_ip_stats(&ipst->ips_ip_mib,
-			    ill->ill_ip_mib);
+	if (ill->ill_ip_mib_cpu != NULL) {
+		for (i = 0; i <= ip_mib_cpu_mask; i++) {
+			if (ill->ill_isv6) {
+				ip_mib2_add_ip_stats(&ipst->ips_ip6_mib,
+				    ill->ill_ip_mib_cpu[i]);
+			} else {
+				ip_mib2_add_ip_stats(&ipst->ips_ip_mib,
+				    ill->ill_ip_mib_cpu[i]);
+			}
 		}
-
-		kmem_free(ill->ill_ip_mib, sizeof (*ill->ill_ip_mib));
-		ill->ill_ip_mib = NULL;
+		ill_ip_mib_free(ill);
 	}
 	if (ill->ill_icmp6_mib != NULL) {
 		ip_mib2_add_icmp6_stats(&ipst->ips_icmp6_mib,
@@ -16727,7 +16765,8 @@ ill_phyint_reinit(ill_t *ill)
 	 * Now that the phyint's ifindex has been assigned, complete the
 	 * remaining
 	 */
-	ill->ill_ip_mib->ipIfStatsIfIndex = ill->ill_phyint->phyint_ifindex;
+	ill->ill_ip_mib_cpu[0]->ipIfStatsIfIndex =
+	    ill->ill_phyint->phyint_ifindex;
 	if (ill->ill_isv6) {
 		ill->ill_icmp6_mib->ipv6IfIcmpIfIndex =
 		    ill->ill_phyint->phyint_ifindex;
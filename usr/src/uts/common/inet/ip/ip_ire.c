@@ -1350,6 +1350,7 @@ ire_add_v4(ire_t *ire)
 	}
 
 	ire_atomic_end(irb_ptr, ire);
+	ip_fib_changed(ire);
 
 	/* Make any caching of the IREs be notified or updated */
 	ire_flush_cache_v4(ire, IRE_FLUSH_ADD);
@@ -1541,6 +1542,7 @@ ire_delete(ire_t *ire)
 
 		irb->irb_ire_cnt--;
 		ire_make_condemned(ire);
+		ip_fib_changed(ire);
 	}
 
 	if (irb->irb_refcnt != 0) {
@@ -2340,7 +2342,7 @@ ip_ire_init(ip_stack_t *ipst)
 	ASSERT(error == 0);
 	ipst->ips_ire_blackhole_v6 = ire;
 
-	rw_init(&ipst->ips_ip6_ire_head_lock, NULL, RW_DEFAULT, NULL);
+	pcrw_init(&ipst->ips_ip6_ire_head_lock);
 	rw_init(&ipst->ips_ire_dep_lock, NULL, RW_DEFAULT, NULL);
 }
 
@@ -2386,7 +2388,7 @@ ip_ire_fini(ip_stack_t *ipst)
 	ipst->ips_ip_ftable = NULL;
 
 	rw_destroy(&ipst->ips_ire_dep_lock);
-	rw_destroy(&ipst->ips_ip6_ire_head_lock);
+	pcrw_destroy(&ipst->ips_ip6_ire_head_lock);
 
 	mutex_destroy(&ipst->ips_ire_ft_init_lock);
 
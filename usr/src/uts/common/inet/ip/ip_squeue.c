@@ -102,6 +102,12 @@
  * ip_squeue_fanout can be accessed and changed using ndd on /dev/tcp or
  * /dev/ip.
  *
+ * ip_squeue_follow_app: if 1, a passive TCP connection is assigned to the
+ * default squeue of the CPU on which the application last called accept()
+ * on its listener, found with ip_squeue_curcpu(), instead of to the squeue
+ * of the receive ring. This keeps the inbound processing of a connection
+ * on the CPU the application reads it on.
+ *
  * ip_squeue_worker_wait: global value for the sq_wait field for all squeues *
  * created. This is the time squeue code waits before waking up the worker
  * thread after queuing a request.
@@ -385,6 +391,24 @@ ip_squeue_random(uint_t index)
 	return (sq);
 }
 
+/*
+ * Get the default squeue of the current CPU, or NULL if the CPU has no
+ * squeue set. Since squeues are never destroyed the caller may keep the
+ * pointer; it is only a hint of where the caller was running.
+ */
+squeue_t *
+ip_squeue_curcpu(void)
+{
+	squeue_set_t *sqs;
+	squeue_t *sq = NULL;
+
+	mutex_enter(&sqset_lock);
+	if ((sqs = CPU->cpu_squeue_set) != NULL)
+		sq = sqs->sqs_default;
+	mutex_exit(&sqset_lock);
+	return (sq);
+}
+
 /*
  * Move squeue from its current set to newset. Not used for default squeues.
  * Bind or unbind the worker thread as appropriate.
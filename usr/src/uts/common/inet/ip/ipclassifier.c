@@ -1514,6 +1514,44 @@ ipcl_conn_insert_v6(conn_t *connp)
 	return (ret);
 }
 
+/*
+ * 'connp' is the first listener in its bind fanout bucket that matches an
+ * incoming connection request.  If it was bound with SO_REUSEPORT, choose
+ * among all the listeners in its group.  Prefer one whose squeue is the
+ * one the packet arrived on, so the connection is set up on the CPU
+ * that took the packet.  Otherwise pick one by a hash of the 4-tuple, so
+ * connections spread evenly and a flow always maps to the same listener.
+ */
+static conn_t *
+ipcl_reuseport_select(conn_t *connp, uint32_t hash, ip_recv_attr_t *ira)
+{
+	conn_t	*tconnp;
+	uint_t	count = 0;
+
+	ASSERT(MUTEX_HELD(&connp->conn_fanout->connf_lock));
+
+	if (!connp->conn_reuseport)
+		return (connp);
+
+	for (tconnp = connp; tconnp != NULL; tconnp = tconnp->conn_next) {
+		if (!IPCL_REUSEPORT_MATCH(connp, tconnp))
+			continue;
+		if (ira->ira_sqp != NULL && tconnp->conn_sqp == ira->ira_sqp &&
+		    (tconnp->conn_flags & IPCL_FULLY_BOUND))
+			return (tconnp);
+		count++;
+	}
+	if (count <= 1)
+		return (connp);
+
+	hash = (hash * 0x9e3779b1) >> 8;
+	count = hash % count;
+	for (tconnp = connp; ; tconnp = tconnp->conn_next) {
+		if (IPCL_REUSEPORT_MATCH(connp, tconnp) && count-- == 0)
+			return (tconnp);
+	}
+}
+
 /*
  * v4 packet classifying function. looks up the fanout table to
  * find the conn, the packet belongs to. returns the conn with
@@ -1589,6 +1627,11 @@ ipcl_classify_v4(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 				break;
 		}
 
+		if (connp != NULL) {
+			connp = ipcl_reuseport_select(connp,
+			    ipha->ipha_src ^ ports, ira);
+		}
+
 		/*
 		 * If the matching connection is SLP on a private address, then
 		 * the label on the packet must match the local zone's label.
@@ -1733,6 +1776,12 @@ ipcl_classify_v6(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 				break;
 		}
 
+		if (connp != NULL) {
+			connp = ipcl_reuseport_select(connp,
+			    ip6h->ip6_src.s6_addr32[0] ^
+			    ip6h->ip6_src.s6_addr32[3] ^ ports, ira);
+		}
+
 		if (connp != NULL && (ira->ira_flags & IRAF_SYSTEM_LABELED) &&
 		    !tsol_receive_local(mp, &ip6h->ip6_dst, IPV6_VERSION,
 		    ira, connp)) {
@@ -94,6 +94,7 @@ static	ipsecespparam_t	lcl_param_arr[] = {
 	{ 0,	1,		0,	"ipsecesp_log_unknown_spi"},
 	{ 0,	2,		1,	"ipsecesp_padding_check"},
 	{ 0,	600,		20,	"ipsecesp_nat_keepalive_interval"},
+	{ 0,	1,		1,	"ipsecesp_inline_combined"},
 };
 #define	ipsecesp_debug	ipsecesp_params[0].ipsecesp_param_value
 #define	ipsecesp_age_interval ipsecesp_params[1].ipsecesp_param_value
@@ -121,6 +122,8 @@ static	ipsecespparam_t	lcl_param_arr[] = {
 #define	ipsecesp_padding_check	\
 	ipsecesp_params[13].ipsecesp_param_value
 /* For ipsecesp_nat_keepalive_interval, see ipsecesp.h. */
+#define	ipsecesp_inline_combined	\
+	ipsecesp_params[15].ipsecesp_param_value
 
 #define	esp0dbg(a)	printf a
 /* NOTE:  != 0 instead of > 0 so lint doesn't complain. */
@@ -1051,6 +1054,16 @@ esp_set_usetime(ipsa_t *assoc, boolean_t inbound)
 	netstack_t		*ns = assoc->ipsa_netstack;
 	ipsecesp_stack_t	*espstack = ns->netstack_ipsecesp;
 
+	/*
+	 * Use times have a granularity of a second, so once the SA has
+	 * been stamped this second there is nothing to do.  This keeps
+	 * packets of a busy SA, which may be processed on many CPUs at
+	 * once, from all taking the SA and peer bucket locks.
+	 */
+	if (assoc->ipsa_usetime != 0 &&
+	    assoc->ipsa_lastuse == gethrestime_sec())
+		return;
+
 	/* No peer?  No problem! */
 	if (!assoc->ipsa_haspeer) {
 		sadb_set_usetime(assoc);
@@ -2031,6 +2044,17 @@ esp_crypto_failed(mblk_t *data_mp, boolean_t is_inbound, int kef_rc,
 	(_cr)->cr_callback_arg = (_mp);				\
 	(_cr)->cr_callback_func = (_callback)
 
+/*
+ * Queueing a request costs more than AES-GCM or CCM take to process a
+ * packet on a CPU with AES instructions, so unless told otherwise let
+ * a software provider run combined mode requests inline.  Hardware
+ * providers still get them queued.
+ */
+#define	ESP_INLINE_COMBINED(_cr, _assoc, _espstack)			\
+	if (((_assoc)->ipsa_flags & IPSA_F_COMBINED) &&			\
+	    (_espstack)->ipsecesp_inline_combined != 0)			\
+		(_cr)->cr_flag &= ~CRYPTO_ALWAYS_QUEUE
+
 #define	ESP_INIT_CRYPTO_MAC(mac, icvlen, icvbuf) {			\
 	(mac)->cd_format = CRYPTO_DATA_RAW;				\
 	(mac)->cd_offset = 0;						\
@@ -2133,6 +2157,7 @@ esp_submit_req_inbound(mblk_t *esp_mp, ip_recv_attr_t *ira,
 		linkb(mp, esp_mp);
 		callrp = &call_req;
 		ESP_INIT_CALLREQ(callrp, mp, esp_kcf_callback_inbound);
+		ESP_INLINE_COMBINED(callrp, assoc, espstack);
 	} else {
 		/*
 		 * If we know we are going to do sync then ipsec_crypto_t
@@ -2463,6 +2488,7 @@ esp_submit_req_outbound(mblk_t *data_mp, ip_xmit_attr_t *ixa, ipsa_t *assoc,
 		linkb(mp, data_mp);
 		callrp = &call_req;
 		ESP_INIT_CALLREQ(callrp, mp, esp_kcf_callback_outbound);
+		ESP_INLINE_COMBINED(callrp, assoc, espstack);
 	} else {
 		/*
 		 * If we know we are going to do sync then ipsec_crypto_t
@@ -39,6 +39,7 @@
 #include <sys/atomic.h>
 #include <sys/socket.h>
 #include <sys/sysmacros.h>
+#include <sys/cpuvar.h>
 #include <sys/crypto/common.h>
 #include <sys/crypto/api.h>
 #include <sys/zone.h>
@@ -3895,6 +3896,16 @@ sadb_age_bytes(queue_t *pfkey_q, ipsa_t *assoc, uint64_t bytes,
 	boolean_t rc = B_TRUE;
 	uint64_t newtotal;
 
+	/*
+	 * Without byte lifetimes there is nothing to check, so don't
+	 * serialize every packet of the SA on ipsa_lock.  A lifetime being
+	 * set concurrently may cost the count a few packets' worth.
+	 */
+	if (assoc->ipsa_hardbyteslt == 0 && assoc->ipsa_softbyteslt == 0) {
+		atomic_add_64(&assoc->ipsa_bytes, bytes);
+		return (B_TRUE);
+	}
+
 	mutex_enter(&assoc->ipsa_lock);
 	newtotal = assoc->ipsa_bytes + bytes;
 	if (assoc->ipsa_hardbyteslt != 0 &&
@@ -152,6 +152,7 @@ enum ip_resolver_action {
 
 extern	int	ill_add_ires(ill_t *);
 extern	void	ill_delete_ires(ill_t *);
+extern	void	ill_ip_mib_sum(ill_t *, mib2_ipIfStatsEntry_t *);
 extern	void	ill_dlpi_done(ill_t *, t_uscalar_t);
 extern	boolean_t ill_dlpi_pending(ill_t *, t_uscalar_t);
 extern	void	ill_dlpi_dispatch(ill_t *, mblk_t *);
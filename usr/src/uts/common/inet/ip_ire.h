@@ -186,6 +186,13 @@ extern	ire_t	*ire_ftable_lookup_simple_v4(ipaddr_t, uint32_t, ip_stack_t *,
 extern	ire_t	*ire_ftable_lookup_simple_v6(const in6_addr_t *, uint32_t,
     ip_stack_t *, uint_t *);
 
+extern	void	ip_fib_stack_init(ip_stack_t *);
+extern	void	ip_fib_stack_shutdown(ip_stack_t *);
+extern	void	ip_fib_stack_fini(ip_stack_t *);
+extern	void	ip_fib_changed(ire_t *);
+extern	ire_t	*ip_fib_lookup_v4(ipaddr_t, ip_stack_t *);
+extern	ire_t	*ip_fib_lookup_v6(const in6_addr_t *, ip_stack_t *);
+
 extern boolean_t ire_gateway_ok_zone_v4(ipaddr_t, zoneid_t, ill_t *,
     const ts_label_t *, ip_stack_t *, boolean_t);
 extern boolean_t ire_gateway_ok_zone_v6(const in6_addr_t *, zoneid_t, ill_t *,
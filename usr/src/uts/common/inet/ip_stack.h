@@ -37,6 +37,7 @@ extern "C" {
 
 #ifdef _KERNEL
 #include <sys/list.h>
+#include <sys/pcrwlock.h>
 
 
 /*
@@ -66,6 +67,10 @@ typedef struct ip_stat {
 	kstat_named_t   ip_nce_reclaim_deleted;
 	kstat_named_t   ip_dce_reclaim_calls;
 	kstat_named_t   ip_dce_reclaim_deleted;
+	kstat_named_t	ip_dce_resizes;
+	kstat_named_t	ip_dce_entries;
+	kstat_named_t	ip_dce_buckets;
+	kstat_named_t	ip_dce_chain_max;
 	kstat_named_t	ip_tcp_in_full_hw_cksum_err;
 	kstat_named_t	ip_tcp_in_part_hw_cksum_err;
 	kstat_named_t	ip_tcp_in_sw_cksum_err;
@@ -239,7 +244,17 @@ struct ip_stack {
 	 * to prevent adds and deletes while we are doing a ftable_lookup
 	 * and extracting the ire_generation.
 	 */
-	krwlock_t	ips_ip6_ire_head_lock;
+	pcrwlock_t	ips_ip6_ire_head_lock;
+
+	/* Compressed forwarding tables, see ip_fib.c */
+	kmutex_t	ips_fib_lock;
+	kcondvar_t	ips_fib_cv;
+	uint_t		ips_fib_flags;
+	timeout_id_t	ips_fib_tid;
+	struct ip_fib	*ips_fib_v4;
+	struct ip_fib	*ips_fib_v6;
+	struct ip_fib	*ips_fib_new_v4;	/* Being built */
+	struct ip_fib	*ips_fib_new_v6;
 
 	uint32_t	ips_ip6_ftable_hash_size;
 
@@ -261,10 +276,12 @@ struct ip_stack {
 
 	/* Destination Cache Entries */
 	struct dce_s	*ips_dce_default;
-	uint_t		ips_dce_hashsize;
-	struct dcb_s	*ips_dce_hash_v4;
-	struct dcb_s	*ips_dce_hash_v6;
+	struct dct_s	*ips_dce_table_v4;
+	struct dct_s	*ips_dce_table_v6;
 	uint_t		ips_dce_reclaim_needed;
+	kmutex_t	ips_dce_resize_lock;	/* Resizes and table walks */
+	kmutex_t	ips_dce_reap_lock;
+	struct dce_s	*ips_dce_reap;		/* Unlinked DCEs to release */
 
 	/* pending binds */
 	mblk_t		*ips_ip6_asp_pending_ops;
@@ -293,7 +293,8 @@ struct conn_s {
 		conn_ipv6_recvpathmtu : 1,	/* IPV6_RECVPATHMTU */
 		conn_mcbc_bind : 1,		/* Bound to multi/broadcast */
 
-		conn_pad_to_bit_31 : 12;
+		conn_reuseport : 1,		/* SO_REUSEPORT state */
+		conn_pad_to_bit_31 : 11;
 
 	boolean_t	conn_blocked;		/* conn is flow-controlled */
 
@@ -601,6 +602,19 @@ struct connf_s {
 		(IN6_ARE_ADDR_EQUAL(&(connp)->conn_laddr_v6, &(laddr)) || \
 		IN6_IS_ADDR_UNSPECIFIED(&(connp)->conn_laddr_v6)))
 
+/*
+ * Is conn2 in the same SO_REUSEPORT group as conn1, i.e. bound with
+ * SO_REUSEPORT to the same protocol, address, port and zone?
+ */
+#define	IPCL_REUSEPORT_MATCH(conn1, conn2)				\
+	((conn2)->conn_reuseport &&					\
+		(conn1)->conn_proto == (conn2)->conn_proto &&		\
+		(conn1)->conn_lport == (conn2)->conn_lport &&		\
+		(conn1)->conn_zoneid == (conn2)->conn_zoneid &&		\
+		(conn1)->conn_ipversion == (conn2)->conn_ipversion &&	\
+		IN6_ARE_ADDR_EQUAL(&(conn1)->conn_laddr_v6,		\
+		&(conn2)->conn_laddr_v6))
+
 /*
  * We compare conn_laddr since it captures both connected and a bind to
  * a multicast or broadcast address.
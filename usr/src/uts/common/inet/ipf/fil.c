@@ -41,6 +41,9 @@
 #if defined(_KERNEL)
 # include <sys/systm.h>
 # include <sys/file.h>
+# if defined(sun)
+#  include <sys/cpuvar.h>
+# endif
 #else
 # include <stdio.h>
 # include <string.h>
@@ -188,11 +191,30 @@ int	fr_features = 0
 
 #define	IPF_BUMP(x)	(x)++	
 
+#if defined(_KERNEL) && SOLARIS
+# define	FR_STATSLOT()	(CPU->cpu_seqid & (FR_NSTATS - 1))
+#else
+# define	FR_STATSLOT()	0
+#endif
+
+/*
+ * Continue a rule scan at the skip step target of fr.  Only valid while
+ * the rules are being taken one at a time (no "skip" rule is pending).
+ */
+#define	FR_SKIPSTEP(fr, i, fnext, rulen)		\
+	if ((fr)->fr_skipset != 0) {			\
+		(fnext) = (fr)->fr_skip[(i)];		\
+		(rulen) += (fr)->fr_skipn[(i)];		\
+	}
+
 static	INLINE int	fr_ipfcheck __P((fr_info_t *, frentry_t *, int));
 static	INLINE int	fr_ipfcheck __P((fr_info_t *, frentry_t *, int));
 static	int		fr_portcheck __P((frpcmp_t *, u_short *));
 static	int		frflushlist __P((int, minor_t, int *, frentry_t **,
 					 ipf_stack_t *));
+static	INLINE void	fr_bumpstats __P((frentry_t *, fr_info_t *));
+static	void		fr_foldstats __P((frentry_t *, frentry_t *));
+static	void		fr_skipsteps __P((frentry_t *));
 static	ipfunc_t	fr_findfunc __P((ipfunc_t));
 static	frentry_t	*fr_firewall __P((fr_info_t *, u_32_t *));
 static	int		fr_funcinit __P((frentry_t *fr, ipf_stack_t *));
@@ -1836,6 +1858,146 @@ int portcmp;
 }
 
 
+/* ------------------------------------------------------------------------ */
+/* Function:    fr_skipsame                                                 */
+/* Returns:     int - 1 == rules share the attribute, 0 == they do not      */
+/* Parameters:  i(I)  - which skip step (FR_SKIP_*)                         */
+/*              fr(I) - rule at the start of a run                          */
+/*              fn(I) - candidate rule following it                         */
+/*                                                                          */
+/* Two rules share an attribute only if a packet that fails the check of   */
+/* that attribute in fr is certain to fail the same check in fn.  Rules     */
+/* for which the attribute is a wildcard never share it with anything.      */
+/* ------------------------------------------------------------------------ */
+static int fr_skipsame(i, fr, fn)
+int i;
+frentry_t *fr, *fn;
+{
+	switch (i)
+	{
+	case FR_SKIP_IFP :
+		/*
+		 * The interface pointer is resolved from the name alone,
+		 * so rules naming the same interface always agree on it.
+		 */
+		if (fr->fr_ifname[0] == '\0' || fr->fr_v != fn->fr_v)
+			return 0;
+		return !strncmp(fr->fr_ifname, fn->fr_ifname, LIFNAMSIZ);
+	case FR_SKIP_PROTO :
+		if ((fr->fr_type & ~FR_T_BUILTIN) != FR_T_IPF ||
+		    (fn->fr_type & ~FR_T_BUILTIN) != FR_T_IPF)
+			return 0;
+		if (fr->fr_mproto == 0)
+			return 0;
+		return (fr->fr_mproto == fn->fr_mproto &&
+			fr->fr_proto == fn->fr_proto);
+	case FR_SKIP_DPORT :
+		if ((fr->fr_type & ~FR_T_BUILTIN) != FR_T_IPF ||
+		    (fn->fr_type & ~FR_T_BUILTIN) != FR_T_IPF)
+			return 0;
+		if (fr->fr_dcmp != FR_EQUAL)
+			return 0;
+		return (fn->fr_dcmp == FR_EQUAL &&
+			fr->fr_dport == fn->fr_dport);
+	default :
+		return 0;
+	}
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Function:    fr_skipsteps                                                */
+/* Returns:     Nil                                                         */
+/* Parameters:  list(I) - first rule of a rule list                         */
+/* Write Locks: ipf_mutex                                                   */
+/*                                                                          */
+/* (Re)compute the skip steps for every rule in a list.  For each attribute */
+/* the list is cut into runs of consecutive rules sharing it; each rule in  */
+/* a run is pointed at the first rule after the run.  Must be called every  */
+/* time a rule is added to or removed from a list that fr_scanlist walks.   */
+/* ------------------------------------------------------------------------ */
+static void fr_skipsteps(list)
+frentry_t *list;
+{
+	frentry_t *fr, *fn, *head;
+	u_int len;
+	int i;
+
+	for (i = 0; i < FR_SKIP_MAX; i++) {
+		for (head = list; head != NULL; head = fn) {
+			len = 1;
+			for (fn = head->fr_next; fn != NULL; fn = fn->fr_next) {
+				if (!fr_skipsame(i, head, fn))
+					break;
+				len++;
+			}
+			for (fr = head; fr != fn; fr = fr->fr_next) {
+				fr->fr_skip[i] = fn;
+				fr->fr_skipn[i] = --len;
+			}
+		}
+	}
+
+	for (fr = list; fr != NULL; fr = fr->fr_next)
+		fr->fr_skipset = 1;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Function:    fr_bumpstats                                                */
+/* Returns:     Nil                                                         */
+/* Parameters:  fr(I)  - pointer to rule that matched                       */
+/*              fin(I) - pointer to packet information                      */
+/*                                                                          */
+/* Count a packet against a rule, in this CPU's slot where there are slots. */
+/* ------------------------------------------------------------------------ */
+static INLINE void fr_bumpstats(fr, fin)
+frentry_t *fr;
+fr_info_t *fin;
+{
+	frstat_t *fs;
+
+	if ((fs = fr->fr_stats) != NULL) {
+		fs += FR_STATSLOT();
+		IPF_BUMP(fs->fs_hits);
+		fs->fs_bytes += (U_QUAD_T)fin->fin_plen;
+	} else {
+		IPF_BUMP(fr->fr_hits);
+		fr->fr_bytes += (U_QUAD_T)fin->fin_plen;
+	}
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Function:    fr_foldstats                                                */
+/* Returns:     Nil                                                         */
+/* Parameters:  fr(I)  - pointer to rule in the kernel                      */
+/*              dst(O) - copy of fr to be handed out                        */
+/*                                                                          */
+/* Sum the per-CPU counters of fr into the fr_hits/fr_bytes of its copy and */
+/* clear the kernel-only fields that have no meaning outside.               */
+/* ------------------------------------------------------------------------ */
+static void fr_foldstats(fr, dst)
+frentry_t *fr, *dst;
+{
+	frstat_t *fs;
+	int i;
+
+	dst->fr_hits = fr->fr_hits;
+	dst->fr_bytes = fr->fr_bytes;
+	if ((fs = fr->fr_stats) != NULL) {
+		for (i = 0; i < FR_NSTATS; i++, fs++) {
+			dst->fr_hits += fs->fs_hits;
+			dst->fr_bytes += fs->fs_bytes;
+		}
+	}
+	dst->fr_stats = NULL;
+	bzero((char *)dst->fr_skip, sizeof(dst->fr_skip));
+	bzero((char *)dst->fr_skipn, sizeof(dst->fr_skipn));
+	dst->fr_skipset = 0;
+}
+
+
 /* ------------------------------------------------------------------------ */
 /* Function:    fr_scanlist                                                 */
 /* Returns:     int - result flags of scanning filter list                  */
@@ -1900,8 +2062,10 @@ u_32_t pass;
 		 * check that we are working for the right interface
 		 */
 #ifdef	_KERNEL
-		if (fr->fr_ifa && fr->fr_ifa != fin->fin_ifp)
+		if (fr->fr_ifa && fr->fr_ifa != fin->fin_ifp) {
+			FR_SKIPSTEP(fr, FR_SKIP_IFP, fnext, rulen);
 			continue;
+		}
 #else
 		if (opts & (OPT_VERBOSE|OPT_DEBUG))
 			printf("\n");
@@ -1910,8 +2074,10 @@ u_32_t pass;
 				  FR_ISACCOUNT(pass) ? 'A' :
 				  FR_ISAUTH(pass) ? 'a' :
 				  (pass & FR_NOMATCH) ? 'n' :'b'));
-		if (fr->fr_ifa && fr->fr_ifa != fin->fin_ifp)
+		if (fr->fr_ifa && fr->fr_ifa != fin->fin_ifp) {
+			FR_SKIPSTEP(fr, FR_SKIP_IFP, fnext, rulen);
 			continue;
+		}
 		FR_VERBOSE((":i"));
 #endif
 
@@ -1919,6 +2085,20 @@ u_32_t pass;
 		{
 		case FR_T_IPF :
 		case FR_T_IPF|FR_T_BUILTIN :
+			/*
+			 * Check the attributes with skip steps first, so a
+			 * miss can take the whole run of rules with it.
+			 */
+			if ((fr->fr_mproto != 0) &&
+			    ((fin->fin_p & fr->fr_mproto) != fr->fr_proto)) {
+				FR_SKIPSTEP(fr, FR_SKIP_PROTO, fnext, rulen);
+				continue;
+			}
+			if ((fr->fr_dcmp == FR_EQUAL) &&
+			    (!portcmp || (fin->fin_dport != fr->fr_dport))) {
+				FR_SKIPSTEP(fr, FR_SKIP_DPORT, fnext, rulen);
+				continue;
+			}
 			if (fr_ipfcheck(fin, fr, portcmp))
 				continue;
 			break;
@@ -1978,8 +2158,7 @@ u_32_t pass;
 		 * If the function pointer is bad, just make like we ignore
 		 * it, except for increasing the hit counter.
 		 */
-		IPF_BUMP(fr->fr_hits);
-		fr->fr_bytes += (U_QUAD_T)fin->fin_plen;
+		fr_bumpstats(fr, fin);
 		if ((passt & FR_CALLNOW) != 0) {
 			if ((fr->fr_func != NULL) &&
 			    (fr->fr_func != (ipfunc_t)-1)) {
@@ -2170,8 +2349,7 @@ u_32_t *passp;
 		IPF_BUMP(ifs->ifs_frstats[out].fr_chit);
 
 		if ((fr = fin->fin_fr) != NULL) {
-			IPF_BUMP(fr->fr_hits);
-			fr->fr_bytes += (U_QUAD_T)fin->fin_plen;
+			fr_bumpstats(fr, fin);
 			pass = fr->fr_flags;
 		}
 	} else {
@@ -3515,8 +3693,8 @@ int *nfreedp;
 frentry_t **listp;
 ipf_stack_t *ifs;
 {
+	frentry_t *fp, **flist = listp;
 	int freed = 0;
-	frentry_t *fp;
 
 	while ((fp = *listp) != NULL) {
 		if ((fp->fr_type & FR_T_BUILTIN) ||
@@ -3539,6 +3717,7 @@ ipf_stack_t *ifs;
 		if (fr_derefrule(&fp, ifs) == 0)
 			freed++;
 	}
+	fr_skipsteps(*flist);
 	*nfreedp += freed;
 	return freed;
 }
@@ -4380,7 +4559,7 @@ int set, makecopy;
 caddr_t data;
 ipf_stack_t *ifs;
 {
-	frentry_t frd, *fp, *f, **fprev, **ftail;
+	frentry_t frd, *fp, *f, **fprev, **ftail, **flist;
 	int error = 0, in, v;
 	void *ptr, *uptr;
 	u_int *p, *pp;
@@ -4397,6 +4576,8 @@ ipf_stack_t *ifs;
 			return EINVAL;
 		fp->fr_ref = 0;
 		fp->fr_flags |= FR_COPIED;
+		fp->fr_stats = NULL;
+		fp->fr_skipset = 0;
 	} else {
 		fp = (frentry_t *)data;
 		if ((fp->fr_type & FR_T_BUILTIN) == 0)
@@ -4489,6 +4670,7 @@ ipf_stack_t *ifs;
 			return ESRCH;
 		fprev = &fg->fg_start;
 	}
+	flist = fprev;
 
 	ftail = fprev;
 	for (f = *ftail; (f = *ftail) != NULL; ftail = &f->fr_next) {
@@ -4672,6 +4854,7 @@ ipf_stack_t *ifs;
 			 * copied out into user space.
 			 */
 			bcopy((char *)f, (char *)fp, sizeof(*f));
+			fr_foldstats(f, fp);
 
 			/*
 			 * When we copy this rule back out, set the data
@@ -4687,6 +4870,10 @@ ipf_stack_t *ifs;
 				if (error == 0) {
 					f->fr_hits = 0;
 					f->fr_bytes = 0;
+					if (f->fr_stats != NULL)
+						bzero((char *)f->fr_stats,
+						    FR_NSTATS *
+						    sizeof(*f->fr_stats));
 				}
 			}
 		}
@@ -4778,6 +4965,7 @@ ipf_stack_t *ifs;
 			fr_fixskip(ftail, f, -1);
 			*ftail = f->fr_next;
 			f->fr_next = NULL;
+			fr_skipsteps(*flist);
 			(void)fr_derefrule(&f, ifs);
 		}
 	} else {
@@ -4809,8 +4997,14 @@ ipf_stack_t *ifs;
 				f->fr_hits = 0;
 				if (makecopy != 0)
 					f->fr_ref = 1;
+				KMALLOCS(f->fr_stats, frstat_t *,
+					 FR_NSTATS * sizeof(*f->fr_stats));
+				if (f->fr_stats != NULL)
+					bzero((char *)f->fr_stats,
+					      FR_NSTATS * sizeof(*f->fr_stats));
 				f->fr_next = *ftail;
 				*ftail = f;
+				fr_skipsteps(*flist);
 				if (req == (ioctlcmd_t)SIOCINIFR ||
 				    req == (ioctlcmd_t)SIOCINAFR)
 					fr_fixskip(ftail, f, 1);
@@ -5012,6 +5206,10 @@ ipf_stack_t *ifs;
 		if (fr->fr_dsize) {
 			KFREES(fr->fr_data, fr->fr_dsize);
 		}
+		if (fr->fr_stats != NULL) {
+			KFREES(fr->fr_stats, FR_NSTATS * sizeof(*fr->fr_stats));
+			fr->fr_stats = NULL;
+		}
 		if ((fr->fr_flags & FR_COPIED) != 0) {
 			KFREE(fr);
 			return 0;
@@ -6240,6 +6438,8 @@ ipftuneable_t lcl_ipf_tuneables[] = {
 			0,	IPFT_WRDISABLED },
 	{ { NULL }, "fr_state_maxbucket_reset",	0, 1,
 			0, IPFT_WRDISABLED },
+	{ { NULL },	"fr_state_grow",	0,	1,
+			0,		0 },
 	{ { NULL },	"ipstate_logging",	0,	1,
 			0,	0 },
 	{ { NULL },	"state_flush_level_hi",	1,	100,
@@ -6352,6 +6552,7 @@ static void ipftuneable_setdefs(ipf_stack_t *ifs)
 	ifs->ifs_fr_statemax = IPSTATE_MAX;
 	ifs->ifs_fr_statesize = IPSTATE_SIZE;
 	ifs->ifs_fr_state_maxbucket_reset = 1;
+	ifs->ifs_fr_state_grow = 1;
 	ifs->ifs_state_flush_level_hi = ST_FLUSH_HI;
 	ifs->ifs_state_flush_level_lo = ST_FLUSH_LO;
 
@@ -6434,6 +6635,7 @@ ipftuneable_alloc(ipf_stack_t *ifs)
     TUNE_SET(ifs, "fr_state_lock", ifs_fr_state_lock);
     TUNE_SET(ifs, "fr_state_maxbucket", ifs_fr_state_maxbucket);
     TUNE_SET(ifs, "fr_state_maxbucket_reset", ifs_fr_state_maxbucket_reset);
+    TUNE_SET(ifs, "fr_state_grow", ifs_fr_state_grow);
     TUNE_SET(ifs, "ipstate_logging", ifs_ipstate_logging);
     TUNE_SET(ifs, "fr_nat_lock", ifs_fr_nat_lock);
     TUNE_SET(ifs, "ipf_nattable_sz", ifs_ipf_nattable_sz);
@@ -7208,7 +7410,7 @@ ipftoken_t *t;
 void *ptr;
 ipf_stack_t *ifs;
 {
-	frentry_t *fr, *next, zero;
+	frentry_t *fr, *next, zero, copy;
 	int error, out, count;
 	ipfruleiter_t it;
 	frgroup_t *fg;
@@ -7305,7 +7507,9 @@ ipf_stack_t *ifs;
 		/*
 		 * Copy out data and clean up references and token as needed.
 		 */
-		error = COPYOUT(next, dst, sizeof(*next));
+		bcopy((char *)next, (char *)&copy, sizeof(copy));
+		fr_foldstats(next, &copy);
+		error = COPYOUT(&copy, dst, sizeof(copy));
 		if (error != 0)
 			error = EFAULT;
 		if (t->ipt_data == NULL) {
@@ -214,6 +214,8 @@ u_32_t *passp;
 					bcopy((char *)fra->fra_info.fin_fr,
 					      (char *)fr, sizeof(*fr));
 					fr->fr_grp = NULL;
+					fr->fr_stats = NULL;
+					fr->fr_skipset = 0;
 					fr->fr_ifa = fin->fin_ifp;
 					fr->fr_func = NULL;
 					fr->fr_ref = 1;
@@ -798,6 +800,8 @@ ipf_stack_t *ifs;
 			WRITE_ENTER(&ifs->ifs_ipf_auth);
 			fae->fae_age = ifs->ifs_fr_defaultauthage;
 			fae->fae_fr.fr_hits = 0;
+			fae->fae_fr.fr_stats = NULL;
+			fae->fae_fr.fr_skipset = 0;
 			fae->fae_fr.fr_next = *frptr;
 			fae->fae_ref = 1;
 			*frptr = &fae->fae_fr;
@@ -124,6 +124,7 @@ static int fr_state_flush __P((int, int, ipf_stack_t *));
 static ips_stat_t *fr_statetstats __P((ipf_stack_t *));
 static int fr_state_remove __P((caddr_t, ipf_stack_t *));
 static void fr_ipsmove __P((ipstate_t *, u_int, ipf_stack_t *));
+static void fr_stategrow __P((ipf_stack_t *));
 static int fr_tcpstate __P((fr_info_t *, tcphdr_t *, ipstate_t *));
 static int fr_tcpoptions __P((fr_info_t *, tcphdr_t *, tcpdata_t *));
 static ipstate_t *fr_stclone __P((fr_info_t *, tcphdr_t *, ipstate_t *));
@@ -827,10 +828,11 @@ ipf_stack_t *ifs;
 	}
 
 	/*
-	 * If we could trust is_hv, then the modulous would not be needed, but
-	 * when running with IPFILTER_SYNC, this stops bad values.
+	 * The bucket is worked out again from the unreduced hash here, rather
+	 * than trusting is_hv: the table may have grown since the caller
+	 * looked, and with IPFILTER_SYNC is_hv can come from anywhere.
 	 */
-	hv = is->is_hv % ifs->ifs_fr_statesize;
+	hv = DOUBLE_HASH(is->is_rawhv, ifs);
 	is->is_hv = hv;
 
 	/*
@@ -1392,17 +1394,18 @@ u_int flags;
 	default :
 		break;
 	}
-	hv = DOUBLE_HASH(hv, ifs);
-	is->is_hv = hv;
+	is->is_rawhv = hv;
 	is->is_rule = fr;
 	is->is_flags = flags & IS_INHERITED;
 
 	/*
-	 * Look for identical state.
+	 * Look for identical state.  The table may be grown by
+	 * fr_timeoutstate(), so it can only be looked at with ipf_state held.
 	 */
-	for (is = ifs->ifs_ips_table[is->is_hv % ifs->ifs_fr_statesize];
-	     is != NULL;
-	     is = is->is_hnext) {
+	READ_ENTER(&ifs->ifs_ipf_state);
+	hv = DOUBLE_HASH(hv, ifs);
+	is->is_hv = hv;
+	for (is = ifs->ifs_ips_table[hv]; is != NULL; is = is->is_hnext) {
 		if (fr_matchstates(&ips, is) == 1)
 			break;
 	}
@@ -1411,13 +1414,17 @@ u_int flags;
 	 * we've found a matching state -> state already exists,
 	 * we are not going to add a duplicate record.
 	 */
-	if (is != NULL)
+	if (is != NULL) {
+		RWLOCK_EXIT(&ifs->ifs_ipf_state);
 		return NULL;
+	}
 
 	if (ifs->ifs_ips_stats.iss_bucketlen[hv] >= ifs->ifs_fr_state_maxbucket) {
+		RWLOCK_EXIT(&ifs->ifs_ipf_state);
 		ATOMIC_INCL(ifs->ifs_ips_stats.iss_bucketfull);
 		return NULL;
 	}
+	RWLOCK_EXIT(&ifs->ifs_ipf_state);
 	KMALLOC(is, ipstate_t *);
 	if (is == NULL) {
 		ATOMIC_INCL(ifs->ifs_ips_stats.iss_nomem);
@@ -2496,9 +2503,8 @@ fr_info_t *fin;
 		dst.in4 = oip->ip_dst;
 		hv += dst.in4.s_addr;
 		hv += icmp->icmp_id;
-		hv = DOUBLE_HASH(hv, ifs);
-
 		READ_ENTER(&ifs->ifs_ipf_state);
+		hv = DOUBLE_HASH(hv, ifs);
 		for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 			isp = &is->is_hnext;
 			if ((is->is_p != pr) || (is->is_v != 4))
@@ -2552,9 +2558,8 @@ fr_info_t *fin;
 	hv += dst.in4.s_addr;
 	hv += dport;
 	hv += sport;
-	hv = DOUBLE_HASH(hv, ifs);
-
 	READ_ENTER(&ifs->ifs_ipf_state);
+	hv = DOUBLE_HASH(hv, ifs);
 	for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 		isp = &is->is_hnext;
 		/*
@@ -2634,6 +2639,7 @@ ipf_stack_t *ifs;
 	 * ...and put the hash in the new one.
 	 */
 	hvm = DOUBLE_HASH(hv, ifs);
+	is->is_rawhv = hv;
 	is->is_hv = hvm;
 	isp = &ifs->ifs_ips_table[hvm];
 	if (*isp)
@@ -2647,6 +2653,97 @@ ipf_stack_t *ifs;
 }
 
 
+/* ------------------------------------------------------------------------ */
+/* Function:    fr_stategrow                                                */
+/* Returns:     Nil                                                         */
+/* Parameters:  ifs - ipf stack instance                                    */
+/* Write Locks: ipf_state                                                   */
+/*                                                                          */
+/* Roughly double the size of the state hash table, up to fr_statemax       */
+/* buckets, and rehash every entry in it.  Each entry carries the hash it   */
+/* was filed under before the table size was applied (is_rawhv), so nothing */
+/* has to be worked out from the packet again.  If the memory cannot be had */
+/* the table just stays as it is.                                           */
+/* ------------------------------------------------------------------------ */
+static void fr_stategrow(ifs)
+ipf_stack_t *ifs;
+{
+	ipstate_t **table, **otable, **isp, *is;
+	u_long *seed, *oseed, *bucketlen, *obucketlen;
+	int size, osize, i;
+	u_int hv;
+
+	osize = ifs->ifs_fr_statesize;
+	size = MIN(osize * 2 + 1, ifs->ifs_fr_statemax);
+	if (size <= osize)
+		return;
+
+	KMALLOCS(table, ipstate_t **, size * sizeof(*table));
+	KMALLOCS(seed, u_long *, size * sizeof(*seed));
+	KMALLOCS(bucketlen, u_long *, size * sizeof(*bucketlen));
+	if (table == NULL || seed == NULL || bucketlen == NULL) {
+		if (table != NULL)
+			KFREES(table, size * sizeof(*table));
+		if (seed != NULL)
+			KFREES(seed, size * sizeof(*seed));
+		if (bucketlen != NULL)
+			KFREES(bucketlen, size * sizeof(*bucketlen));
+		ATOMIC_INCL(ifs->ifs_ips_stats.iss_nomem);
+		return;
+	}
+	bzero((char *)table, size * sizeof(*table));
+	bzero((char *)bucketlen, size * sizeof(*bucketlen));
+
+	otable = ifs->ifs_ips_table;
+	oseed = ifs->ifs_ips_seed;
+	obucketlen = ifs->ifs_ips_stats.iss_bucketlen;
+	for (i = 0; i < size; i++) {
+#if !defined(NEED_LOCAL_RAND) && defined(_KERNEL)
+		seed[i] = ipf_random();
+#else
+		seed[i] = oseed[i % osize] ^ ((u_long)i * 0x5a5aa5a5);
+#endif
+	}
+
+	ifs->ifs_ips_table = table;
+	ifs->ifs_ips_seed = seed;
+	ifs->ifs_ips_stats.iss_bucketlen = bucketlen;
+	ifs->ifs_ips_stats.iss_inuse = 0;
+	ifs->ifs_fr_statesize = size;
+
+	/*
+	 * Entries that have already been taken out of the hash table are
+	 * still on ips_list until their last reference goes; leave them be.
+	 */
+	for (is = ifs->ifs_ips_list; is != NULL; is = is->is_next) {
+		if (is->is_phnext == NULL)
+			continue;
+		hv = DOUBLE_HASH(is->is_rawhv, ifs);
+		is->is_hv = hv;
+		isp = &table[hv];
+		if (*isp != NULL)
+			(*isp)->is_phnext = &is->is_hnext;
+		else
+			ifs->ifs_ips_stats.iss_inuse++;
+		bucketlen[hv]++;
+		is->is_phnext = isp;
+		is->is_hnext = *isp;
+		*isp = is;
+	}
+
+	if (ifs->ifs_fr_state_maxbucket_reset == 1) {
+		ifs->ifs_fr_state_maxbucket = 0;
+		for (i = size; i > 0; i >>= 1)
+			ifs->ifs_fr_state_maxbucket++;
+		ifs->ifs_fr_state_maxbucket *= 2;
+	}
+
+	KFREES(otable, osize * sizeof(*otable));
+	KFREES(oseed, osize * sizeof(*oseed));
+	KFREES(obucketlen, osize * sizeof(*obucketlen));
+}
+
+
 /* ------------------------------------------------------------------------ */
 /* Function:    fr_stlookup                                                 */
 /* Returns:     ipstate_t* - NULL == no matching state found,               */
@@ -2787,8 +2884,8 @@ icmp6again:
 		if (v == 4) {
 			hv += ic->icmp_id;
 		}
-		hv = DOUBLE_HASH(hv, ifs);
 		READ_ENTER(&ifs->ifs_ipf_state);
+		hv = DOUBLE_HASH(hv, ifs);
 		for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 			isp = &is->is_hnext;
 			if ((is->is_p != pr) || (is->is_v != v))
@@ -2888,8 +2985,8 @@ retry_tcpudp:
 #endif
 	default :
 		ifqp = NULL;
-		hvm = DOUBLE_HASH(hv, ifs);
 		READ_ENTER(&ifs->ifs_ipf_state);
+		hvm = DOUBLE_HASH(hv, ifs);
 		for (isp = &ifs->ifs_ips_table[hvm]; ((is = *isp) != NULL); ) {
 			isp = &is->is_hnext;
 			if ((is->is_p != pr) || (is->is_v != v))
@@ -3459,6 +3556,15 @@ ipf_stack_t *ifs;
 		(void) fr_state_flush(FLUSH_TABLE_EXTRA, 0, ifs);
 		ifs->ifs_fr_state_doflush = 0;
 	}
+
+	/*
+	 * Keep the average chain no longer than one entry while the number
+	 * of states allowed keeps growing past the table size.
+	 */
+	if (ifs->ifs_fr_state_grow != 0 &&
+	    ifs->ifs_ips_num > ifs->ifs_fr_statesize &&
+	    ifs->ifs_fr_statesize < ifs->ifs_fr_statemax)
+		fr_stategrow(ifs);
 	RWLOCK_EXIT(&ifs->ifs_ipf_state);
 	SPL_X(s);
 }
@@ -4092,9 +4198,8 @@ fr_info_t *fin;
 		hv += dst.in4.s_addr;
 		hv += oic->icmp6_id;
 		hv += oic->icmp6_seq;
-		hv = DOUBLE_HASH(hv, ifs);
-
 		READ_ENTER(&ifs->ifs_ipf_state);
+		hv = DOUBLE_HASH(hv, ifs);
 		for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 			ic = &is->is_icmp;
 			isp = &is->is_hnext;
@@ -4145,9 +4250,8 @@ fr_info_t *fin;
 		hv += sport;
 	} else
 		tcp = NULL;
-	hv = DOUBLE_HASH(hv, ifs);
-
 	READ_ENTER(&ifs->ifs_ipf_state);
+	hv = DOUBLE_HASH(hv, ifs);
 	for (isp = &ifs->ifs_ips_table[hv]; ((is = *isp) != NULL); ) {
 		isp = &is->is_hnext;
 		/*
@@ -548,6 +548,31 @@ typedef	struct	fripf	{
 
 typedef	struct	frentry	* (* frentfunc_t) __P((fr_info_t *));
 
+/*
+ * Per-rule hit counters are spread over FR_NSTATS cache line sized slots,
+ * picked by CPU, so that rules matched on many CPUs at once do not bounce
+ * a single line around.  fr_hits/fr_bytes are the sum when read out.
+ */
+#define	FR_NSTATS	8	/* power of 2 */
+
+typedef	struct	frstat	{
+	U_QUAD_T	fs_hits;
+	U_QUAD_T	fs_bytes;
+	char		fs_pad[64 - 2 * sizeof(U_QUAD_T)];
+} frstat_t;
+
+/*
+ * Skip steps: for each rule, the next rule in the same list that differs
+ * in one of these attributes and how many rules lie in between.  A rule
+ * that fails to match on an attribute means none of the following rules
+ * sharing its value can match either, so fr_scanlist jumps straight past
+ * them (cf. pf(4)).
+ */
+#define	FR_SKIP_IFP	0	/* same fr_ifname (and IP version) */
+#define	FR_SKIP_PROTO	1	/* same protocol and mask */
+#define	FR_SKIP_DPORT	2	/* same "port =" destination port */
+#define	FR_SKIP_MAX	3
+
 typedef	struct	frentry {
 	ipfmutex_t	fr_lock;
 	struct	frentry	*fr_next;
@@ -571,6 +596,14 @@ typedef	struct	frentry {
 	struct timeval	fr_lastpkt;
 	int		fr_curpps;
 
+	/*
+	 * Kernel-only, rebuilt whenever the list this rule is on changes
+	 */
+	frstat_t	*fr_stats;		/* FR_NSTATS slots */
+	struct	frentry	*fr_skip[FR_SKIP_MAX];	/* skip step targets */
+	u_int		fr_skipn[FR_SKIP_MAX];	/* # of rules skipped */
+	int		fr_skipset;		/* fr_skip[] is valid */
+
 	union	{
 		void		*fru_data;
 		caddr_t		fru_caddr;
@@ -60,7 +60,8 @@ typedef struct ipstate {
 	u_int	is_pass;
 	u_char	is_p;			/* Protocol */
 	u_char	is_v;
-	u_32_t	is_hv;
+	u_32_t	is_hv;			/* bucket in ips_table */
+	u_32_t	is_rawhv;		/* hash before DOUBLE_HASH */
 	u_32_t	is_tag;
 	u_32_t	is_opt[2];		/* packet options set */
 					/* in both directions */
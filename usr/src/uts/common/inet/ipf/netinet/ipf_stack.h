@@ -274,6 +274,7 @@ struct ipf_stack {
 	int			ifs_fr_state_lock;
 	int			ifs_fr_state_maxbucket;
 	int			ifs_fr_state_maxbucket_reset;
+	int			ifs_fr_state_grow;
 	int			ifs_fr_state_init;
 	int			ifs_fr_enable_active;
 	ipftq_t			ifs_ips_tqtqb[IPF_TCP_NSTATES];
@@ -373,6 +373,8 @@ sctp_disconnect(sctp_t *sctp)
 			    connp->conn_lingertime * hz;
 
 			mutex_enter(&sctp->sctp_lock);
+			if (sctp->sctp_sendq != NULL)
+				sctp_process_sendq(sctp);
 			sctp->sctp_running = B_FALSE;
 			while (sctp->sctp_state >= SCTPS_ESTABLISHED &&
 			    sctp->sctp_client_errno == 0) {
@@ -2020,6 +2022,7 @@ sctp_conn_cache_destructor(void *buf, void *cdrarg)
 	ASSERT(sctp->sctp_xmit_tail == NULL);
 	ASSERT(sctp->sctp_xmit_unsent == NULL);
 	ASSERT(sctp->sctp_xmit_unsent_tail == NULL);
+	ASSERT(sctp->sctp_sendq == NULL);
 
 	ASSERT(sctp->sctp_ostrcntrs == NULL);
 
@@ -651,6 +651,8 @@ typedef struct sctp_s {
 	kmutex_t	sctp_lock;
 	kcondvar_t	sctp_cv;
 	boolean_t	sctp_running;
+	mblk_t		*sctp_sendq;	/* Handed off by sctp_sendmsg() */
+	mblk_t		*sctp_sendq_tail;
 
 #define	sctp_ulpd	sctp_connp->conn_upper_handle
 #define	sctp_upcalls	sctp_connp->conn_upcalls
@@ -1103,6 +1105,7 @@ extern int	sctp_process_cookie(sctp_t *, sctp_chunk_hdr_t *, mblk_t *,
 		    ip_recv_attr_t *);
 extern void	sctp_process_err(sctp_t *);
 extern void	sctp_process_heartbeat(sctp_t *, sctp_chunk_hdr_t *);
+extern void	sctp_process_sendq(sctp_t *);
 extern void	sctp_process_timer(sctp_t *);
 
 extern void	sctp_redo_faddr_srcs(sctp_t *);
@@ -1190,15 +1193,24 @@ extern void	(*cl_sctp_check_addrs)(sa_family_t, in_port_t, uchar_t **,
 	mutex_exit(&(sctp)->sctp_lock);				\
 }
 
-/* Wake up recvq taskq */
-#define	WAKE_SCTP(sctp)				\
-{						\
-	mutex_enter(&(sctp)->sctp_lock);	\
-	if ((sctp)->sctp_timer_mp != NULL)	\
-		sctp_process_timer(sctp);	\
-	(sctp)->sctp_running = B_FALSE;		\
-	cv_broadcast(&(sctp)->sctp_cv);		\
-	mutex_exit(&(sctp)->sctp_lock);		\
+/*
+ * Wake up recvq taskq.  Both handlers drop sctp_lock, so more work can
+ * be handed to us meanwhile; sctp_sendq must be empty once we stop
+ * running.
+ */
+#define	WAKE_SCTP(sctp)					\
+{							\
+	mutex_enter(&(sctp)->sctp_lock);		\
+	while ((sctp)->sctp_sendq != NULL ||		\
+	    (sctp)->sctp_timer_mp != NULL) {		\
+		if ((sctp)->sctp_sendq != NULL)		\
+			sctp_process_sendq(sctp);	\
+		if ((sctp)->sctp_timer_mp != NULL)	\
+			sctp_process_timer(sctp);	\
+	}						\
+	(sctp)->sctp_running = B_FALSE;			\
+	cv_broadcast(&(sctp)->sctp_cv);			\
+	mutex_exit(&(sctp)->sctp_lock);			\
 }
 
 #ifdef	__cplusplus
@@ -80,6 +80,7 @@
 
 static struct kmem_cache	*sctp_kmem_ftsn_set_cache;
 static mblk_t			*sctp_chunkify(sctp_t *, int, int, int);
+static int			sctp_sendmsg_queue(sctp_t *, mblk_t *);
 
 #ifdef	DEBUG
 static boolean_t	sctp_verify_chain(mblk_t *, mblk_t *);
@@ -140,7 +141,6 @@ sctp_sendmsg(sctp_t *sctp, mblk_t *mp, int flags)
 	sctp_msg_hdr_t	*sctp_msg_hdr;
 	uint32_t	msg_len = 0;
 	uint32_t	timetolive = sctp->sctp_def_timetolive;
-	conn_t		*connp = sctp->sctp_connp;
 
 	ASSERT(DB_TYPE(mproto) == M_PROTO);
 
@@ -234,15 +234,6 @@ sctp_sendmsg(sctp_t *sctp, mblk_t *mp, int flags)
 	if (mp == NULL)
 		goto done;
 
-	RUN_SCTP(sctp);
-
-	/* Reject any new data requests if we are shutting down */
-	if (sctp->sctp_state > SCTPS_ESTABLISHED ||
-	    (sctp->sctp_connp->conn_state_flags & CONN_CLOSING)) {
-		error = EPIPE;
-		goto unlock_done;
-	}
-
 	/* Re-use the mproto to store relevant info. */
 	ASSERT(MBLKSIZE(mproto) >= sizeof (*sctp_msg_hdr));
 
@@ -264,21 +255,73 @@ sctp_sendmsg(sctp_t *sctp, mblk_t *mp, int flags)
 	/* User requested specific destination */
 	SCTP_SET_CHUNK_DEST(mproto, fp);
 
+	/*
+	 * If another thread has the association running, hand the message
+	 * to it instead of waiting for it to finish: the running thread
+	 * queues everything handed off on its way out and sends it in one
+	 * go, bundling chunks from all the writers.  Messages for a given
+	 * destination address are not handed off, as the faddr might go
+	 * away in the meantime.
+	 */
+	mutex_enter(&sctp->sctp_lock);
+	if (sctp->sctp_running && fp == NULL &&
+	    sctp->sctp_state == SCTPS_ESTABLISHED) {
+		if (sctp->sctp_sendq == NULL)
+			sctp->sctp_sendq = mproto;
+		else
+			sctp->sctp_sendq_tail->b_next = mproto;
+		sctp->sctp_sendq_tail = mproto;
+		mutex_exit(&sctp->sctp_lock);
+		return (0);
+	}
+	while (sctp->sctp_running)
+		cv_wait(&sctp->sctp_cv, &sctp->sctp_lock);
+	sctp->sctp_running = B_TRUE;
+	mutex_exit(&sctp->sctp_lock);
+
+	error = sctp_sendmsg_queue(sctp, mproto);
+	if (error == 0 && sctp->sctp_state == SCTPS_ESTABLISHED)
+		sctp_output(sctp, UINT_MAX);
+	WAKE_SCTP(sctp);
+	return (error);
+done2:
+	WAKE_SCTP(sctp);
+	return (0);
+done:
+	return (error);
+}
+
+/*
+ * Put a message built by sctp_sendmsg() on the unsent list.  On failure
+ * the message is left to the caller.
+ */
+static int
+sctp_sendmsg_queue(sctp_t *sctp, mblk_t *mproto)
+{
+	sctp_msg_hdr_t	*sctp_msg_hdr = (sctp_msg_hdr_t *)mproto->b_rptr;
+	conn_t		*connp = sctp->sctp_connp;
+
+	ASSERT(sctp->sctp_running);
+
+	/* Reject any new data requests if we are shutting down */
+	if (sctp->sctp_state > SCTPS_ESTABLISHED ||
+	    (connp->conn_state_flags & CONN_CLOSING)) {
+		return (EPIPE);
+	}
+
 	if (sctp->sctp_state >= SCTPS_COOKIE_ECHOED &&
-	    sid >= sctp->sctp_num_ostr) {
+	    sctp_msg_hdr->smh_sid >= sctp->sctp_num_ostr) {
 		/* Send sendfail event */
 		sctp_sendfail_event(sctp, dupmsg(mproto), SCTP_ERR_BAD_SID,
 		    B_FALSE);
-		error = EINVAL;
-		goto unlock_done;
+		return (EINVAL);
 	}
 
 	/* no data */
-	if (msg_len == 0) {
+	if (sctp_msg_hdr->smh_msglen == 0) {
 		sctp_sendfail_event(sctp, dupmsg(mproto),
 		    SCTP_ERR_NO_USR_DATA, B_FALSE);
-		error = EINVAL;
-		goto unlock_done;
+		return (EINVAL);
 	}
 
 	/* Add it to the unsent list */
@@ -288,7 +331,7 @@ sctp_sendmsg(sctp_t *sctp, mblk_t *mp, int flags)
 		sctp->sctp_xmit_unsent_tail->b_next = mproto;
 		sctp->sctp_xmit_unsent_tail = mproto;
 	}
-	sctp->sctp_unsent += msg_len;
+	sctp->sctp_unsent += sctp_msg_hdr->smh_msglen;
 	BUMP_LOCAL(sctp->sctp_msgcount);
 	/*
 	 * Notify sockfs if the tx queue is full.
@@ -297,15 +340,45 @@ sctp_sendmsg(sctp_t *sctp, mblk_t *mp, int flags)
 		sctp->sctp_txq_full = 1;
 		sctp->sctp_ulp_txq_full(sctp->sctp_ulpd, B_TRUE);
 	}
-	if (sctp->sctp_state == SCTPS_ESTABLISHED)
-		sctp_output(sctp, UINT_MAX);
-done2:
-	WAKE_SCTP(sctp);
 	return (0);
-unlock_done:
-	WAKE_SCTP(sctp);
-done:
-	return (error);
+}
+
+/*
+ * Queue the messages other threads handed off while we had the sctp
+ * running and send them.  Like sctp_process_timer(), called from
+ * WAKE_SCTP() with sctp_lock held; the lock is dropped while working.
+ * The sender was already told the message went out, so one that can
+ * no longer be queued is reported through a send failure event.
+ */
+void
+sctp_process_sendq(sctp_t *sctp)
+{
+	mblk_t	*mp;
+	mblk_t	*nmp;
+
+	ASSERT(sctp->sctp_running);
+	ASSERT(MUTEX_HELD(&sctp->sctp_lock));
+	while ((mp = sctp->sctp_sendq) != NULL) {
+		sctp->sctp_sendq = sctp->sctp_sendq_tail = NULL;
+		mutex_exit(&sctp->sctp_lock);
+		for (; mp != NULL; mp = nmp) {
+			nmp = mp->b_next;
+			mp->b_next = NULL;
+			switch (sctp_sendmsg_queue(sctp, mp)) {
+			case 0:
+				break;
+			case EPIPE:
+				sctp_sendfail_event(sctp, mp, 0, B_FALSE);
+				break;
+			default:
+				freemsg(mp);
+				break;
+			}
+		}
+		if (sctp->sctp_state == SCTPS_ESTABLISHED)
+			sctp_output(sctp, UINT_MAX);
+		mutex_enter(&sctp->sctp_lock);
+	}
 }
 
 /*
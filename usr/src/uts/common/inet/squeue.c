@@ -1526,3 +1526,85 @@ squeue_synch_exit(conn_t *connp)
 		mutex_exit(&sqp->sq_lock);
 	}
 }
+
+/*
+ * Busy poll the receive ring bound to an squeue on behalf of an application
+ * thread that is spinning for data (SO_BUSY_POLL). If the squeue is idle and
+ * poll capable, take it over the same way the poll thread would: blank the
+ * ring, pull whatever it has, and drain the result in the calling thread.
+ * Interrupts are re-enabled before returning. Returns B_TRUE if any packets
+ * were picked up from the ring; B_FALSE if there were none or the squeue
+ * was busy, in which case the caller simply keeps waiting.
+ */
+boolean_t
+squeue_busy_poll(squeue_t *sqp)
+{
+	ill_rx_ring_t	*sq_rx_ring;
+	mblk_t		*head, *tail, *mp;
+	uint32_t	cnt;
+	hrtime_t	now;
+
+	mutex_enter(&sqp->sq_lock);
+	if ((sqp->sq_state & (SQS_PROC | SQS_POLL_CAPAB | SQS_POLLING |
+	    SQS_WORKER_THR_CONTROL | SQS_POLL_THR_CONTROL |
+	    SQS_POLL_THR_QUIESCED)) != SQS_POLL_CAPAB) {
+		mutex_exit(&sqp->sq_lock);
+		return (B_FALSE);
+	}
+
+	sq_rx_ring = sqp->sq_rx_ring;
+	sqp->sq_state |= SQS_PROC;
+	sqp->sq_run = curthread;
+	/* LINTED: constant in conditional context */
+	SQS_POLLING_ON(sqp, B_TRUE, sq_rx_ring);
+	if (!(sqp->sq_state & SQS_POLLING)) {
+		/*
+		 * The soft ring is busy delivering packets, which will
+		 * reach the squeue on their own.
+		 */
+		sqp->sq_state &= ~SQS_PROC;
+		sqp->sq_run = NULL;
+		if (sqp->sq_first != NULL)
+			cv_signal(&sqp->sq_worker_cv);
+		mutex_exit(&sqp->sq_lock);
+		return (B_FALSE);
+	}
+
+	/*
+	 * Keep the poll thread from being signalled while the ring is
+	 * being emptied from here.
+	 */
+	sqp->sq_state |= SQS_GET_PKTS;
+	mutex_exit(&sqp->sq_lock);
+
+	head = sq_rx_ring->rr_rx(sq_rx_ring->rr_rx_handle, MAX_BYTES_TO_PICKUP);
+	mp = NULL;
+	if (head != NULL) {
+		mp = sq_rx_ring->rr_ip_accept(sq_rx_ring->rr_ill, sq_rx_ring,
+		    sqp, head, &tail, &cnt);
+	}
+
+	mutex_enter(&sqp->sq_lock);
+	sqp->sq_state &= ~SQS_GET_PKTS;
+	if (mp != NULL)
+		ENQUEUE_CHAIN(sqp, mp, tail, cnt);
+
+	if (sqp->sq_first != NULL) {
+		/*
+		 * squeue_drain() turns polling off and drops SQS_PROC for
+		 * us, or hands the rest over to the worker.
+		 */
+		now = gethrtime();
+		sqp->sq_drain(sqp, SQS_USER, now + squeue_drain_ns);
+	} else {
+		sqp->sq_state &= ~SQS_PROC;
+		/* LINTED: constant in conditional context */
+		SQS_POLLING_OFF(sqp, B_TRUE, sq_rx_ring);
+	}
+	sqp->sq_run = NULL;
+	if (sqp->sq_state & SQS_WORKER_THR_CONTROL)
+		cv_signal(&sqp->sq_worker_cv);
+	mutex_exit(&sqp->sq_lock);
+
+	return (mp != NULL);
+}
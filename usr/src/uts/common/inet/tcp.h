@@ -45,6 +45,7 @@ extern "C" {
 #include <inet/mib2.h>
 #include <inet/tcp_stack.h>
 #include <inet/tcp_sack.h>
+#include <inet/cc.h>
 
 /* TCP states */
 #define	TCPS_CLOSED		-6
@@ -280,6 +281,8 @@ typedef struct tcp_s {
 
 	uint32_t tcp_cwnd_ssthresh;	/* Congestion window */
 	uint32_t tcp_cwnd_max;
+	cc_algo_t *tcp_cc_algo;		/* Congestion control algorithm */
+	uint64_t tcp_cc_data[CC_DATA_SIZE / sizeof (uint64_t)];
 	uint32_t tcp_csuna;		/* Clear (no rexmits in window) suna */
 
 	clock_t	tcp_rtt_sa;		/* Round trip smoothed average */
@@ -487,12 +490,32 @@ typedef struct tcp_s {
 	/* For connection counting. */
 	struct tcp_listen_cnt_s	*tcp_listen_cnt;
 
+	/* Listener: squeue of the CPU of the last accept(), see tcp_accept() */
+	squeue_t		*tcp_accept_sqp;
+
 	/* Segment reassembly timer. */
 	timeout_id_t		tcp_reass_tid;
 
 	/* FIN-WAIT-2 flush timeout */
 	uint32_t		tcp_fin_wait_2_flush_interval;
 
+	/* Pacing, see tcp_pace_rate() */
+	uint32_t		tcp_pace_max;	/* cap, bytes/sec; 0 if none */
+	hrtime_t		tcp_pace_next;	/* when more may be sent */
+	timeout_id_t		tcp_pace_tid;
+
+	/* TCP Fast Open, see tcp_fastopen.c */
+	uint32_t		tcp_tfo_flags;
+	mblk_t			*tcp_tfo_mp;	/* data held for the SYN */
+
+	/* Tail loss probe and time based loss detection, see tcp_tlp_arm() */
+	timeout_id_t		tcp_tlp_tid;
+	boolean_t		tcp_tlp_out;	/* a probe is unanswered */
+	boolean_t		tcp_tlp_rexmit;	/* ... and it was a rexmit */
+	uint32_t		tcp_tlp_high;	/* tcp_snxt when probed */
+	clock_t			tcp_xmit_lbolt;	/* when new data last sent */
+	clock_t			tcp_dlvr_xmit_ts; /* sent time of sack'ed */
+
 #ifdef DEBUG
 	pc_t			tcmp_stk[15];
 #endif
@@ -1294,6 +1294,9 @@ tcp_closei_local(tcp_t *tcp)
 	/* Stop all the timers */
 	tcp_timers_stop(tcp);
 
+	if (tcp->tcp_tfo_flags & TCP_TFO_PENDING)
+		tcp_fastopen_done(tcp);
+
 	if (tcp->tcp_state == TCPS_LISTEN) {
 		if (tcp->tcp_ip_addr_cache) {
 			kmem_free((void *)tcp->tcp_ip_addr_cache,
@@ -1364,6 +1367,7 @@ tcp_free(tcp_t *tcp)
 
 	tcp_close_mpp(&tcp->tcp_xmit_head);
 	tcp_close_mpp(&tcp->tcp_reass_head);
+	tcp_close_mpp(&tcp->tcp_tfo_mp);
 	if (tcp->tcp_rcv_list != NULL) {
 		/* Free b_next chain */
 		tcp_close_mpp(&tcp->tcp_rcv_list);
@@ -1390,6 +1394,8 @@ tcp_free(tcp_t *tcp)
 	TCP_NOTSACK_REMOVE_ALL(tcp->tcp_notsack_list, tcp);
 	bzero(&tcp->tcp_sack_info, sizeof (tcp_sack_info_t));
 
+	tcp_cc_detach(tcp);
+
 	if (tcp->tcp_hopopts != NULL) {
 		mi_free(tcp->tcp_hopopts);
 		tcp->tcp_hopopts = NULL;
@@ -1630,6 +1636,10 @@ tcp_connect_ipv4(tcp_t *tcp, ipaddr_t *dstaddrp, in_port_t dstport,
 	    connp->conn_fport == connp->conn_lport)
 		return (-TBADADDR);
 
+	/* The 4-tuple may still be in TIME_WAIT. */
+	if ((error = tcp_time_wait_connect(tcp)) != 0)
+		return (error);
+
 	tcp->tcp_state = TCPS_SYN_SENT;
 
 	return (ipcl_conn_insert_v4(connp));
@@ -1726,6 +1736,10 @@ tcp_connect_ipv6(tcp_t *tcp, in6_addr_t *dstaddrp, in_port_t dstport,
 	    connp->conn_fport == connp->conn_lport)
 		return (-TBADADDR);
 
+	/* The 4-tuple may still be in TIME_WAIT. */
+	if ((error = tcp_time_wait_connect(tcp)) != 0)
+		return (error);
+
 	tcp->tcp_state = TCPS_SYN_SENT;
 
 	return (ipcl_conn_insert_v6(connp));
@@ -1922,6 +1936,7 @@ tcp_reinit(tcp_t *tcp)
 	tcp->tcp_obsegs = 0;
 
 	tcp_close_mpp(&tcp->tcp_xmit_head);
+	tcp_close_mpp(&tcp->tcp_tfo_mp);
 	if (tcp->tcp_snd_zcopy_aware)
 		tcp_zcopy_notify(tcp);
 	tcp->tcp_xmit_last = tcp->tcp_xmit_tail = NULL;
@@ -2181,6 +2196,17 @@ tcp_reinit_values(tcp)
 
 	DONTCARE(tcp->tcp_cwnd_ssthresh); /* Init in tcp_set_destination */
 	DONTCARE(tcp->tcp_cwnd_max);		/* Init in tcp_init_values */
+	DONTCARE(tcp->tcp_cc_algo);		/* Init in tcp_init_values */
+	DONTCARE(tcp->tcp_cc_data);		/* Init in tcp_init_values */
+	DONTCARE(tcp->tcp_pace_max);		/* Init in tcp_init_values */
+	tcp->tcp_pace_next = 0;
+	ASSERT(tcp->tcp_tfo_mp == NULL);
+	tcp->tcp_tfo_flags = 0;
+	tcp->tcp_tlp_out = B_FALSE;
+	tcp->tcp_tlp_rexmit = B_FALSE;
+	tcp->tcp_tlp_high = 0;
+	tcp->tcp_xmit_lbolt = 0;
+	tcp->tcp_dlvr_xmit_ts = 0;
 	tcp->tcp_csuna = 0;
 
 	tcp->tcp_rto = 0;			/* Displayed in MIB */
@@ -2321,6 +2347,8 @@ tcp_reinit_values(tcp)
 
 	ASSERT(tcp->tcp_listen_cnt == NULL);
 	ASSERT(tcp->tcp_reass_tid == 0);
+	ASSERT(tcp->tcp_pace_tid == 0);
+	ASSERT(tcp->tcp_tlp_tid == 0);
 
 #undef	DONTCARE
 #undef	PRESERVE
@@ -2365,6 +2393,8 @@ tcp_init_values(tcp_t *tcp, tcp_t *parent)
 		tcp->tcp_ka_cnt = 0;
 		tcp->tcp_ka_rinterval = 0;
 
+		tcp->tcp_pace_max = 0;
+
 		/*
 		 * Default value of tcp_init_cwnd is 0, so no need to set here
 		 * if parent is NULL.  But we need to inherit it from parent.
@@ -2395,7 +2425,13 @@ tcp_init_values(tcp_t *tcp, tcp_t *parent)
 		tcp->tcp_ka_rinterval = parent->tcp_ka_rinterval;
 
 		tcp->tcp_init_cwnd = parent->tcp_init_cwnd;
+
+		tcp->tcp_pace_max = parent->tcp_pace_max;
 	}
+	tcp->tcp_pace_next = 0;
+	tcp->tcp_tfo_flags = 0;
+	tcp->tcp_tlp_out = B_FALSE;
+	tcp->tcp_dlvr_xmit_ts = 0;
 
 	/*
 	 * Initialize tcp_rtt_sa and tcp_rtt_sd so that the calculated RTO
@@ -2417,6 +2453,7 @@ tcp_init_values(tcp_t *tcp, tcp_t *parent)
 	tcp->tcp_cwnd_max = tcps->tcps_cwnd_max_;
 	tcp->tcp_cwnd_ssthresh = TCP_MAX_LARGEWIN;
 	tcp->tcp_snd_burst = TCP_CWND_INFINITE;
+	tcp_cc_attach(tcp, parent);
 
 	tcp->tcp_maxpsz_multiplier = tcps->tcps_maxpsz_multiplier;
 
@@ -3713,6 +3750,9 @@ tcp_ddi_g_init(void)
 
 	tcp_squeue_flag = tcp_squeue_switch(tcp_squeue_wput);
 
+	tcp_cc_g_init();
+	tcp_time_wait_g_init();
+
 	/*
 	 * We want to be informed each time a stack is created or
 	 * destroyed in the kernel, so we can maintain the
@@ -3834,6 +3874,10 @@ tcp_stack_init(netstackid_t stackid, netstack_t *ns)
 	list_create(&tcps->tcps_listener_conf, sizeof (tcp_listener_t),
 	    offsetof(tcp_listener_t, tl_link));
 
+	tcp_cc_stack_init(tcps);
+	tcp_time_wait_stack_init(tcps);
+	tcp_fastopen_stack_init(tcps);
+
 	return (tcps);
 }
 
@@ -3853,6 +3897,9 @@ tcp_ddi_g_destroy(void)
 	kmem_cache_destroy(tcp_notsack_blk_cache);
 
 	netstack_unregister(NS_TCP);
+
+	tcp_cc_g_destroy();
+	tcp_time_wait_g_destroy();
 }
 
 /*
@@ -3882,6 +3929,9 @@ tcp_stack_fini(netstackid_t stackid, void *arg)
 	mutex_destroy(&tcps->tcps_reclaim_lock);
 
 	tcp_listener_conf_cleanup(tcps);
+	tcp_cc_stack_fini(tcps);
+	tcp_time_wait_stack_fini(tcps);
+	tcp_fastopen_stack_fini(tcps);
 
 	for (i = 0; i < tcps->tcps_sc_cnt; i++)
 		kmem_free(tcps->tcps_sc[i], sizeof (tcp_stats_cpu_t));
@@ -4274,8 +4324,13 @@ tcp_do_connect(conn_t *connp, const struct sockaddr *sa, socklen_t len,
 	    int32_t, TCPS_BOUND);
 
 	TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
-	syn_mp = tcp_xmit_mp(tcp, NULL, 0, NULL, NULL,
-	    tcp->tcp_iss, B_FALSE, NULL, B_FALSE);
+	if (tcp->tcp_tfo_mp != NULL) {
+		/* sendmsg(MSG_FASTOPEN) left data for the SYN */
+		syn_mp = tcp_fastopen_connect(tcp);
+	} else {
+		syn_mp = tcp_xmit_mp(tcp, NULL, 0, NULL, NULL,
+		    tcp->tcp_iss, B_FALSE, NULL, B_FALSE);
+	}
 	if (syn_mp != NULL) {
 		/*
 		 * We must bump the generation before sending the syn
@@ -4392,6 +4447,7 @@ do_listen:
 			tcp->tcp_eager_prev_drop_q0 = tcp;
 			tcp->tcp_second_ctimer_threshold =
 			    tcps->tcps_ip_abort_linterval;
+			tcp->tcp_accept_sqp = NULL;
 		}
 	}
 
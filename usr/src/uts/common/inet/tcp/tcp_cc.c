@@ -0,0 +1,322 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * TCP congestion control framework.  See <inet/cc.h> for the interface
+ * offered to congestion control modules.
+ *
+ * Registered algorithms are kept on tcp_cc_list.  Every connection holds a
+ * reference on its algorithm, as does every TCP stack on its default
+ * algorithm (tcps_cc_default, the "congestion_control" property).
+ * References are taken with tcp_cc_lock held as reader, so that
+ * tcp_cc_unregister(), which needs it as writer, sees a stable count.
+ * They are dropped without the lock.
+ */
+
+#include <sys/types.h>
+#include <sys/systm.h>
+#include <sys/ctype.h>
+#include <sys/list.h>
+#include <sys/rwlock.h>
+#include <sys/atomic.h>
+#include <sys/modctl.h>
+#include <sys/sunddi.h>
+#include <inet/ip.h>
+#include <inet/tcp_impl.h>
+#include <inet/cc.h>
+
+static krwlock_t	tcp_cc_lock;
+static list_t		tcp_cc_list;
+
+/*
+ * NewReno (RFC 5681, RFC 6582).  This is what TCP has always done and is
+ * the default for every stack.
+ */
+/* ARGSUSED */
+static void
+newreno_ack_received(tcp_t *tcp, uint32_t bytes_acked)
+{
+	uint32_t	cwnd = tcp->tcp_cwnd;
+	uint32_t	add = tcp->tcp_mss;
+
+	if (cwnd >= tcp->tcp_cwnd_ssthresh) {
+		/*
+		 * This is to prevent an increase of less than 1 MSS of
+		 * tcp_cwnd.  With partial increase, tcp_wput_data()
+		 * may send out tinygrams in order to preserve mblk
+		 * boundaries.
+		 *
+		 * By initializing tcp_cwnd_cnt to new tcp_cwnd and
+		 * decrementing it by 1 MSS for every ACKs, tcp_cwnd is
+		 * increased by 1 MSS for every RTTs.
+		 */
+		if (tcp->tcp_cwnd_cnt <= 0) {
+			tcp->tcp_cwnd_cnt = cwnd + add;
+		} else {
+			tcp->tcp_cwnd_cnt -= add;
+			add = 0;
+		}
+	}
+	tcp->tcp_cwnd = MIN(cwnd + add, tcp->tcp_cwnd_max);
+}
+
+static void
+newreno_cong_signal(tcp_t *tcp, cc_signal_t sig)
+{
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	npkt;
+
+	switch (sig) {
+	case CC_NDUPACK:
+	case CC_ECN:
+		/* Half of the data in flight, in whole segments. */
+		npkt = ((tcp->tcp_snxt - tcp->tcp_suna) >> 1) / mss;
+		tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
+		tcp->tcp_cwnd = npkt * mss;
+		break;
+	case CC_RTO:
+		/*
+		 * A repeated timeout halves the previous ssthresh rather
+		 * than the amount outstanding.
+		 */
+		npkt = ((tcp->tcp_timer_backoff ? tcp->tcp_cwnd_ssthresh :
+		    tcp->tcp_snxt - tcp->tcp_suna) >> 1) / mss;
+		tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
+		break;
+	}
+}
+
+static void
+newreno_post_recovery(tcp_t *tcp)
+{
+	/* Restore the orig tcp_cwnd_ssthresh after fast retransmit phase. */
+	if (tcp->tcp_cwnd > tcp->tcp_cwnd_ssthresh)
+		tcp->tcp_cwnd = tcp->tcp_cwnd_ssthresh;
+}
+
+cc_algo_t tcp_cc_newreno = {
+	.ca_name =		"newreno",
+	.ca_ack_received =	newreno_ack_received,
+	.ca_cong_signal =	newreno_cong_signal,
+	.ca_post_recovery =	newreno_post_recovery,
+};
+
+static cc_algo_t *
+tcp_cc_lookup(const char *name)
+{
+	cc_algo_t	*algo;
+
+	ASSERT(RW_LOCK_HELD(&tcp_cc_lock));
+
+	for (algo = list_head(&tcp_cc_list); algo != NULL;
+	    algo = list_next(&tcp_cc_list, algo)) {
+		if (strcmp(algo->ca_name, name) == 0)
+			return (algo);
+	}
+	return (NULL);
+}
+
+int
+tcp_cc_register(cc_algo_t *algo)
+{
+	if (algo->ca_name[0] == '\0' || algo->ca_ack_received == NULL ||
+	    algo->ca_cong_signal == NULL || algo->ca_post_recovery == NULL)
+		return (EINVAL);
+
+	rw_enter(&tcp_cc_lock, RW_WRITER);
+	if (tcp_cc_lookup(algo->ca_name) != NULL) {
+		rw_exit(&tcp_cc_lock);
+		return (EEXIST);
+	}
+	algo->ca_refcnt = 0;
+	list_insert_tail(&tcp_cc_list, algo);
+	rw_exit(&tcp_cc_lock);
+	return (0);
+}
+
+int
+tcp_cc_unregister(cc_algo_t *algo)
+{
+	rw_enter(&tcp_cc_lock, RW_WRITER);
+	if (algo->ca_refcnt != 0) {
+		rw_exit(&tcp_cc_lock);
+		return (EBUSY);
+	}
+	list_remove(&tcp_cc_list, algo);
+	rw_exit(&tcp_cc_lock);
+	return (0);
+}
+
+void
+tcp_cc_g_init(void)
+{
+	rw_init(&tcp_cc_lock, NULL, RW_DEFAULT, NULL);
+	list_create(&tcp_cc_list, sizeof (cc_algo_t),
+	    offsetof(cc_algo_t, ca_link));
+	VERIFY0(tcp_cc_register(&tcp_cc_newreno));
+}
+
+void
+tcp_cc_g_destroy(void)
+{
+	VERIFY0(tcp_cc_unregister(&tcp_cc_newreno));
+	list_destroy(&tcp_cc_list);
+	rw_destroy(&tcp_cc_lock);
+}
+
+void
+tcp_cc_stack_init(tcp_stack_t *tcps)
+{
+	rw_enter(&tcp_cc_lock, RW_READER);
+	tcps->tcps_cc_default = &tcp_cc_newreno;
+	atomic_inc_32(&tcp_cc_newreno.ca_refcnt);
+	rw_exit(&tcp_cc_lock);
+}
+
+void
+tcp_cc_stack_fini(tcp_stack_t *tcps)
+{
+	atomic_dec_32(&tcps->tcps_cc_default->ca_refcnt);
+	tcps->tcps_cc_default = NULL;
+}
+
+/*
+ * Switch the connection to 'algo', on which the caller holds a reference
+ * for us.
+ */
+static void
+tcp_cc_start(tcp_t *tcp, cc_algo_t *algo)
+{
+	tcp_cc_detach(tcp);
+	tcp->tcp_cc_algo = algo;
+	bzero(tcp->tcp_cc_data, sizeof (tcp->tcp_cc_data));
+	if (algo->ca_init != NULL)
+		algo->ca_init(tcp);
+}
+
+/*
+ * Give a new connection its congestion control algorithm: the listener's
+ * for an eager, the stack default otherwise.
+ */
+void
+tcp_cc_attach(tcp_t *tcp, tcp_t *parent)
+{
+	cc_algo_t	*algo;
+
+	if (parent != NULL) {
+		/* The listener's own reference keeps the algorithm around. */
+		algo = parent->tcp_cc_algo;
+		atomic_inc_32(&algo->ca_refcnt);
+	} else {
+		rw_enter(&tcp_cc_lock, RW_READER);
+		algo = tcp->tcp_tcps->tcps_cc_default;
+		atomic_inc_32(&algo->ca_refcnt);
+		rw_exit(&tcp_cc_lock);
+	}
+	tcp_cc_start(tcp, algo);
+}
+
+void
+tcp_cc_detach(tcp_t *tcp)
+{
+	cc_algo_t	*algo;
+
+	if ((algo = tcp->tcp_cc_algo) != NULL) {
+		tcp->tcp_cc_algo = NULL;
+		atomic_dec_32(&algo->ca_refcnt);
+	}
+}
+
+/*
+ * TCP_CONGESTION.  This runs in the connection's squeue, where we cannot
+ * wait for a module to load, so only algorithms that are already
+ * registered can be chosen.  Setting the stack default loads the module.
+ */
+int
+tcp_cc_set(tcp_t *tcp, const char *name)
+{
+	cc_algo_t	*algo;
+
+	rw_enter(&tcp_cc_lock, RW_READER);
+	if ((algo = tcp_cc_lookup(name)) == NULL) {
+		rw_exit(&tcp_cc_lock);
+		return (ENOENT);
+	}
+	atomic_inc_32(&algo->ca_refcnt);
+	rw_exit(&tcp_cc_lock);
+
+	tcp_cc_start(tcp, algo);
+	return (0);
+}
+
+/*
+ * Set the stack's default algorithm, loading misc/cc_<name> if no
+ * algorithm of that name is registered yet.
+ */
+int
+tcp_cc_set_default(tcp_stack_t *tcps, const char *name)
+{
+	char		modname[MODMAXNAMELEN];
+	cc_algo_t	*algo, *old;
+	const char	*cp;
+
+	if (*name == '\0' || strlen(name) >= CC_ALGO_NAME_MAX)
+		return (EINVAL);
+	for (cp = name; *cp != '\0'; cp++) {
+		if (!ISALNUM(*cp) && *cp != '_')
+			return (EINVAL);
+	}
+
+	rw_enter(&tcp_cc_lock, RW_WRITER);
+	if ((algo = tcp_cc_lookup(name)) == NULL) {
+		rw_exit(&tcp_cc_lock);
+		(void) snprintf(modname, sizeof (modname), "cc_%s", name);
+		if (modload("misc", modname) == -1)
+			return (ENOENT);
+		rw_enter(&tcp_cc_lock, RW_WRITER);
+		if ((algo = tcp_cc_lookup(name)) == NULL) {
+			rw_exit(&tcp_cc_lock);
+			return (ENOENT);
+		}
+	}
+	atomic_inc_32(&algo->ca_refcnt);
+	old = tcps->tcps_cc_default;
+	tcps->tcps_cc_default = algo;
+	atomic_dec_32(&old->ca_refcnt);
+	rw_exit(&tcp_cc_lock);
+	return (0);
+}
+
+/*
+ * Format the name of the stack's default algorithm, or with 'all' set the
+ * names of all registered algorithms, into 'buf'.
+ */
+int
+tcp_cc_get_names(tcp_stack_t *tcps, boolean_t all, char *buf, uint_t bufsize)
+{
+	cc_algo_t	*algo;
+	size_t		len = 0;
+
+	rw_enter(&tcp_cc_lock, RW_READER);
+	if (!all) {
+		len = snprintf(buf, bufsize, "%s",
+		    tcps->tcps_cc_default->ca_name);
+	} else {
+		for (algo = list_head(&tcp_cc_list);
+		    algo != NULL && len < bufsize;
+		    algo = list_next(&tcp_cc_list, algo)) {
+			len += snprintf(buf + len, bufsize - len, "%s%s",
+			    len == 0 ? "" : ",", algo->ca_name);
+		}
+	}
+	rw_exit(&tcp_cc_lock);
+	return (len >= bufsize ? ENOBUFS : 0);
+}
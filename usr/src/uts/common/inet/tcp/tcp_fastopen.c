@@ -0,0 +1,426 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * TCP Fast Open (RFC 7413).
+ *
+ * A server hands out a cookie, an MD5 hash of the client's address and a
+ * per stack secret, to any client asking for one in its SYN.  A client
+ * that holds a cookie for a server may put data on its SYN, and the
+ * server passes that data up without waiting for the handshake to
+ * complete.
+ *
+ * Server side.  The "_fastopen" property must have TCP_TFO_SERVER set and
+ * the listener must have the TCP_FASTOPEN option on.  When the SYN carries
+ * a valid cookie and data, tcp_input_listener() acks the data in the
+ * SYN-ACK and tcp_fastopen_accept() hands the eager to the socket while
+ * it is still in SYN_RCVD (TCP_TFO_EARLY).  The accept may thus complete
+ * before the handshake does; anything written in the meantime is queued
+ * by tcp_wput_data() until the final ACK.  The number of such eagers is
+ * limited per stack by "_fastopen_max_pending".
+ *
+ * Client side.  sendto(MSG_FASTOPEN) on an unconnected socket stashes the
+ * data in tcp_tfo_mp and then connects, see so_sendmsg_fastopen().
+ * tcp_fastopen_connect() queues the data and, given a cached cookie for
+ * the peer, puts the first segment on the SYN (TCP_TFO_DATA).  If the
+ * peer acks only the SYN, or the SYN has to be retransmitted,
+ * tcp_fastopen_rewind() puts the data back to be sent as usual.
+ */
+
+#include <sys/types.h>
+#include <sys/systm.h>
+#include <sys/strsun.h>
+#include <sys/atomic.h>
+#include <sys/random.h>
+#include <sys/md5.h>
+#include <sys/squeue_impl.h>
+#include <sys/squeue.h>
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/tcp.h>
+#include <inet/tcp_impl.h>
+
+/*
+ * The client's cache of cookies, direct mapped on the peer's address.
+ */
+typedef struct tcp_tfo_cache_s {
+	in6_addr_t	tc_faddr;
+	uint8_t		tc_len;
+	uchar_t		tc_cookie[TCP_TFO_COOKIE_MAX];
+} tcp_tfo_cache_t;
+
+#define	TCP_TFO_CACHE_SIZE	256
+#define	TCP_TFO_CACHE_HASH(a)						\
+	(((a)->s6_addr32[0] ^ (a)->s6_addr32[1] ^ (a)->s6_addr32[2] ^	\
+	(a)->s6_addr32[3]) % TCP_TFO_CACHE_SIZE)
+
+#define	TCP_TFO_SECRET_LEN	16
+
+void
+tcp_fastopen_stack_init(tcp_stack_t *tcps)
+{
+	uchar_t	secret[TCP_TFO_SECRET_LEN];
+
+	(void) random_get_pseudo_bytes(secret, sizeof (secret));
+	MD5Init(&tcps->tcps_tfo_key);
+	MD5Update(&tcps->tcps_tfo_key, secret, sizeof (secret));
+	bzero(secret, sizeof (secret));
+
+	mutex_init(&tcps->tcps_tfo_lock, NULL, MUTEX_DEFAULT, NULL);
+	tcps->tcps_tfo_cache = kmem_zalloc(TCP_TFO_CACHE_SIZE *
+	    sizeof (tcp_tfo_cache_t), KM_SLEEP);
+	tcps->tcps_tfo_pending = 0;
+}
+
+void
+tcp_fastopen_stack_fini(tcp_stack_t *tcps)
+{
+	ASSERT(tcps->tcps_tfo_pending == 0);
+	kmem_free(tcps->tcps_tfo_cache,
+	    TCP_TFO_CACHE_SIZE * sizeof (tcp_tfo_cache_t));
+	tcps->tcps_tfo_cache = NULL;
+	mutex_destroy(&tcps->tcps_tfo_lock);
+	bzero(&tcps->tcps_tfo_key, sizeof (tcps->tcps_tfo_key));
+}
+
+/*
+ * The cookie we give to, and expect from, the peer of tcp.
+ */
+static void
+tcp_fastopen_cookie(tcp_t *tcp, uchar_t *cookie)
+{
+	MD5_CTX		context;
+	uint32_t	answer[4];
+
+	context = tcp->tcp_tcps->tcps_tfo_key;
+	MD5Update(&context, (uchar_t *)&tcp->tcp_connp->conn_faddr_v6,
+	    sizeof (in6_addr_t));
+	MD5Final((uchar_t *)answer, &context);
+	bcopy(answer, cookie, TCP_TFO_COOKIE_LEN);
+}
+
+static uint_t
+tcp_fastopen_cache_get(tcp_t *tcp, uchar_t *cookie)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	in6_addr_t	*faddr = &tcp->tcp_connp->conn_faddr_v6;
+	tcp_tfo_cache_t	*tc;
+	uint_t		len = 0;
+
+	tc = &tcps->tcps_tfo_cache[TCP_TFO_CACHE_HASH(faddr)];
+	mutex_enter(&tcps->tcps_tfo_lock);
+	if (tc->tc_len != 0 && IN6_ARE_ADDR_EQUAL(&tc->tc_faddr, faddr)) {
+		len = tc->tc_len;
+		bcopy(tc->tc_cookie, cookie, len);
+	}
+	mutex_exit(&tcps->tcps_tfo_lock);
+	return (len);
+}
+
+static void
+tcp_fastopen_cache_set(tcp_t *tcp, const uchar_t *cookie, uint_t len)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	in6_addr_t	*faddr = &tcp->tcp_connp->conn_faddr_v6;
+	tcp_tfo_cache_t	*tc;
+
+	ASSERT(len <= TCP_TFO_COOKIE_MAX);
+	tc = &tcps->tcps_tfo_cache[TCP_TFO_CACHE_HASH(faddr)];
+	mutex_enter(&tcps->tcps_tfo_lock);
+	tc->tc_faddr = *faddr;
+	tc->tc_len = (uint8_t)len;
+	bcopy(cookie, tc->tc_cookie, len);
+	mutex_exit(&tcps->tcps_tfo_lock);
+}
+
+/*
+ * Called from tcp_process_options() for a SYN carrying the Fast Open
+ * option.  A client remembers the cookie it is given.  A server checks
+ * the cookie it is shown, and arranges to send a new one in the SYN-ACK
+ * if it is missing or wrong.
+ */
+void
+tcp_fastopen_option(tcp_t *tcp, tcp_opt_t *tcpopt)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	uint_t		len = tcpopt->tcp_opt_tfo_len;
+	uchar_t		cookie[TCP_TFO_COOKIE_LEN];
+
+	if (tcp->tcp_state == TCPS_SYN_SENT) {
+		if ((tcp->tcp_tfo_flags & TCP_TFO_CLIENT) && len != 0)
+			tcp_fastopen_cache_set(tcp, tcpopt->tcp_opt_tfo_cookie,
+			    len);
+		return;
+	}
+	if (!(tcp->tcp_tfo_flags & TCP_TFO_SERVER))
+		return;
+
+	if (len == TCP_TFO_COOKIE_LEN) {
+		tcp_fastopen_cookie(tcp, cookie);
+		if (bcmp(cookie, tcpopt->tcp_opt_tfo_cookie, len) == 0) {
+			tcp->tcp_tfo_flags |= TCP_TFO_COOKIE_OK;
+			return;
+		}
+	}
+	tcp->tcp_tfo_flags |= TCP_TFO_REQ;
+	if (len == 0)
+		TCP_STAT(tcps, tcp_fastopen_cookie_req);
+	else
+		TCP_STAT(tcps, tcp_fastopen_cookie_bad);
+}
+
+/*
+ * Write the Fast Open option for a SYN or SYN-ACK at wptr, padded with
+ * leading NOPs to a 4 byte boundary, and return its length.  The option
+ * fits in what is left of the 40 bytes after MSS, SACK, timestamps and
+ * window scale.
+ */
+int
+tcp_fastopen_syn_opt(tcp_t *tcp, uchar_t *wptr)
+{
+	uchar_t	cookie[TCP_TFO_COOKIE_MAX];
+	uint_t	len;
+	uint_t	pad;
+	uint_t	i;
+
+	if (tcp->tcp_state == TCPS_SYN_SENT) {
+		/* An empty option asks for a cookie. */
+		if (!(tcp->tcp_tfo_flags & TCP_TFO_CLIENT))
+			return (0);
+		len = tcp_fastopen_cache_get(tcp, cookie);
+	} else if (tcp->tcp_tfo_flags & TCP_TFO_REQ) {
+		tcp_fastopen_cookie(tcp, cookie);
+		len = TCP_TFO_COOKIE_LEN;
+	} else {
+		return (0);
+	}
+
+	pad = (4 - ((2 + len) & 3)) & 3;
+	for (i = 0; i < pad; i++)
+		*wptr++ = TCPOPT_NOP;
+	wptr[0] = TCPOPT_FASTOPEN;
+	wptr[1] = (uchar_t)(2 + len);
+	bcopy(cookie, wptr + 2, len);
+	return (pad + 2 + len);
+}
+
+/*
+ * Called by tcp_input_listener() for a SYN with a valid cookie.  If the
+ * SYN carries data the eager can take, keep a copy in tcp_tfo_mp for
+ * tcp_fastopen_accept() and ack it in the SYN-ACK.  Otherwise the data is
+ * left for the client to send again.
+ */
+void
+tcp_fastopen_syn_data(tcp_t *eager, mblk_t *mp, tcpha_t *tcpha,
+    uint_t ip_hdr_len)
+{
+	tcp_stack_t	*tcps = eager->tcp_tcps;
+	uint_t		hdr_len = ip_hdr_len + TCP_HDR_LENGTH(tcpha);
+	mblk_t		*data;
+	mblk_t		*mp1;
+	int		len;
+
+	ASSERT(eager->tcp_tfo_mp == NULL);
+	len = msgdsize(mp) - hdr_len;
+	if (len <= 0 || (tcpha->tha_flags & (TH_FIN | TH_URG)) ||
+	    len > eager->tcp_rwnd)
+		return;
+
+	if (atomic_inc_32_nv(&tcps->tcps_tfo_pending) >
+	    tcps->tcps_fastopen_max_pending) {
+		atomic_dec_32(&tcps->tcps_tfo_pending);
+		TCP_STAT(tcps, tcp_fastopen_pending_drop);
+		return;
+	}
+	if ((data = dupmsg(mp)) == NULL) {
+		atomic_dec_32(&tcps->tcps_tfo_pending);
+		return;
+	}
+	ASSERT(MBLKL(data) >= hdr_len);
+	data->b_rptr += hdr_len;
+	if (data->b_rptr == data->b_wptr) {
+		mp1 = data->b_cont;
+		freeb(data);
+		data = mp1;
+	}
+
+	eager->tcp_tfo_flags |= TCP_TFO_PENDING;
+	eager->tcp_tfo_mp = data;
+	eager->tcp_rnxt += len;
+	eager->tcp_tcpha->tha_ack = htonl(eager->tcp_rnxt);
+	TCP_STAT(tcps, tcp_fastopen_syn_data);
+}
+
+/*
+ * Drop an eager from the count of those passed up before the handshake.
+ */
+void
+tcp_fastopen_done(tcp_t *tcp)
+{
+	ASSERT(tcp->tcp_tfo_flags & TCP_TFO_PENDING);
+	tcp->tcp_tfo_flags &= ~TCP_TFO_PENDING;
+	atomic_dec_32(&tcp->tcp_tcps->tcps_tfo_pending);
+}
+
+/*
+ * Used in place of tcp_send_synack() on the eager's squeue when the SYN
+ * carried data: tell the socket about the new connection, hand it the
+ * data and then send the SYN-ACK.  This mirrors what tcp_input_data()
+ * does on the final ACK for a non-STREAMS listener.
+ */
+/* ARGSUSED2 */
+void
+tcp_fastopen_accept(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
+{
+	conn_t		*econnp = (conn_t *)arg;
+	tcp_t		*eager = econnp->conn_tcp;
+	mblk_t		*data = eager->tcp_tfo_mp;
+	ip_recv_attr_t	iras;
+	boolean_t	push = B_TRUE;
+	int		error;
+	int		len;
+
+	eager->tcp_tfo_mp = NULL;
+	/* Guard against a RST or the listener closing while queued */
+	if (eager->tcp_state != TCPS_SYN_RCVD || data == NULL ||
+	    eager->tcp_listener == NULL) {
+		freemsg(data);
+		tcp_send_synack(arg, mp, arg2, dummy);
+		return;
+	}
+
+	bzero(&iras, sizeof (iras));
+	iras.ira_cpid = NOPID;
+
+	/* Dropped by tcp_accept(), just as for an established eager */
+	CONN_INC_REF(econnp);
+	eager->tcp_tfo_flags |= TCP_TFO_EARLY;
+	if (!tcp_newconn_notify(eager, &iras)) {
+		eager->tcp_tfo_flags &= ~TCP_TFO_EARLY;
+		freemsg(data);
+		freemsg(mp);
+		CONN_DEC_REF(econnp);
+		ASSERT(TCP_IS_DETACHED(eager));
+		(void) tcp_close_detached(eager);
+		return;
+	}
+
+	len = msgdsize(data);
+	if ((*econnp->conn_upcalls->su_recv)(econnp->conn_upper_handle,
+	    data, len, 0, &error, &push) <= 0) {
+		ASSERT(error != EOPNOTSUPP);
+		if (error == ENOSPC)
+			eager->tcp_rwnd -= len;
+	}
+
+	tcp_send_synack(arg, mp, arg2, dummy);
+}
+
+/*
+ * Called by tcp_sendmsg() for MSG_FASTOPEN data written before the
+ * connect.  The data is held until tcp_do_connect() builds the SYN.
+ */
+int
+tcp_fastopen_stash(conn_t *connp, mblk_t *mp)
+{
+	tcp_t	*tcp = connp->conn_tcp;
+	int	error = 0;
+
+	if (squeue_synch_enter(connp, NULL) != 0) {
+		freemsg(mp);
+		return (ENOSR);
+	}
+	if (tcp->tcp_state != TCPS_IDLE && tcp->tcp_state != TCPS_BOUND) {
+		/* Lost a race with connect() */
+		freemsg(mp);
+		error = EALREADY;
+	} else if (tcp->tcp_tfo_mp == NULL) {
+		tcp->tcp_tfo_mp = mp;
+	} else {
+		linkb(tcp->tcp_tfo_mp, mp);
+	}
+	squeue_synch_exit(connp);
+	return (error);
+}
+
+/*
+ * Called by tcp_do_connect() in place of building a plain SYN when data
+ * was stashed.  The data is queued for transmission; tcp_cwnd is still 0
+ * so tcp_wput_data() sends nothing.  With a cookie for the peer, as much
+ * of the first segment as fits goes on the SYN.
+ */
+mblk_t *
+tcp_fastopen_connect(tcp_t *tcp)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	conn_t		*connp = tcp->tcp_connp;
+	mblk_t		*mp = tcp->tcp_tfo_mp;
+	mblk_t		*syn_mp;
+	uchar_t		cookie[TCP_TFO_COOKIE_MAX];
+	uint32_t	len = 0;
+	int32_t		max;
+
+	ASSERT(tcp->tcp_state == TCPS_SYN_SENT);
+	tcp->tcp_tfo_mp = NULL;
+	tcp_wput_data(tcp, mp, B_FALSE);
+
+	/* Loopback connections are fused, Fast Open gains nothing there. */
+	if ((tcps->tcps_fastopen & TCP_TFO_CLIENT) && !tcp->tcp_loopback) {
+		tcp->tcp_tfo_flags |= TCP_TFO_CLIENT;
+		if (tcp->tcp_unsent > 0 &&
+		    tcp_fastopen_cache_get(tcp, cookie) != 0) {
+			/* tcp_mss has not had the headers taken off yet */
+			max = tcp->tcp_mss - connp->conn_ht_iphc_len -
+			    TCP_MAX_TCP_OPTIONS_LENGTH;
+			max = MIN(max, connp->conn_ipversion == IPV4_VERSION ?
+			    tcps->tcps_mss_def_ipv4 : tcps->tcps_mss_def_ipv6);
+			if (max > 0)
+				len = MIN(tcp->tcp_xmit_tail_unsent, max);
+		}
+	}
+
+	syn_mp = tcp_xmit_mp(tcp, len != 0 ? tcp->tcp_xmit_head : NULL, len,
+	    NULL, NULL, tcp->tcp_iss, B_FALSE, &len, B_FALSE);
+	if (syn_mp != NULL && len != 0) {
+		mp = tcp->tcp_xmit_head;
+		ASSERT(mp == tcp->tcp_xmit_tail);
+		mp->b_prev = (mblk_t *)(uintptr_t)LBOLT_FASTPATH;
+		mp->b_next = (mblk_t *)(uintptr_t)(tcp->tcp_iss + 1);
+		tcp->tcp_xmit_tail_unsent -= len;
+		tcp->tcp_unsent -= len;
+		tcp->tcp_snxt += len;
+		tcp->tcp_tfo_flags |= TCP_TFO_DATA;
+		TCP_STAT(tcps, tcp_fastopen_client_data);
+	}
+	return (syn_mp);
+}
+
+/*
+ * The data on our SYN was not acked, or the SYN is to be retransmitted:
+ * put the data back on the unsent part of the queue.
+ */
+void
+tcp_fastopen_rewind(tcp_t *tcp)
+{
+	uint32_t	len = tcp->tcp_snxt - (tcp->tcp_iss + 1);
+	mblk_t		*mp = tcp->tcp_xmit_head;
+
+	ASSERT(tcp->tcp_tfo_flags & TCP_TFO_DATA);
+	ASSERT(mp != NULL && mp == tcp->tcp_xmit_tail);
+	tcp->tcp_tfo_flags &= ~TCP_TFO_DATA;
+
+	tcp->tcp_snxt -= len;
+	tcp->tcp_unsent += len;
+	tcp->tcp_xmit_tail_unsent += len;
+	mp->b_prev = NULL;
+	mp->b_next = NULL;
+	TCP_STAT(tcp->tcp_tcps, tcp_fastopen_client_rewind);
+}
@@ -69,6 +69,7 @@
 #define	TCP_OPT_TSTAMP_PRESENT	4
 #define	TCP_OPT_SACK_OK_PRESENT	8
 #define	TCP_OPT_SACK_PRESENT	16
+#define	TCP_OPT_TFO_PRESENT	32
 
 /*
  *  PAWS needs a timer for 24 days.  This is the number of ticks in 24 days
@@ -172,6 +173,7 @@ static mblk_t	*tcp_input_add_ancillary(tcp_t *, mblk_t *, ip_pkt_t *,
 static void	tcp_input_listener(void *, mblk_t *, void *, ip_recv_attr_t *);
 static int	tcp_parse_options(tcpha_t *, tcp_opt_t *);
 static void	tcp_process_options(tcp_t *, tcpha_t *);
+static uint_t	tcp_rack_ack(tcp_t *, boolean_t);
 static mblk_t	*tcp_reass(tcp_t *, mblk_t *, uint32_t);
 static void	tcp_reass_elim_overlap(tcp_t *, mblk_t *);
 static void	tcp_rsrv_input(void *, mblk_t *, void *, ip_recv_attr_t *);
@@ -314,7 +316,8 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
 				tcp_notsack_update(&(tcp->tcp_notsack_list),
 				    tcp->tcp_suna, tcp->tcp_snxt,
 				    &(tcp->tcp_num_notsack_blk),
-				    &(tcp->tcp_cnt_notsack_list));
+				    &(tcp->tcp_cnt_notsack_list),
+				    tcp->tcp_xmit_lbolt);
 
 				/*
 				 * Make sure tcp_notsack_list is not NULL.
@@ -329,6 +332,8 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
 			}
 
 			while (sack_len > 0) {
+				clock_t	ts;
+
 				if (up + 8 > endp) {
 					up = endp;
 					break;
@@ -350,10 +355,13 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
 				    SEQ_GT(sack_end, tcp->tcp_snxt)) {
 					continue;
 				}
-				tcp_notsack_insert(&(tcp->tcp_notsack_list),
+				ts = tcp_notsack_insert(
+				    &(tcp->tcp_notsack_list),
 				    sack_begin, sack_end,
 				    &(tcp->tcp_num_notsack_blk),
 				    &(tcp->tcp_cnt_notsack_list));
+				if (ts > tcp->tcp_dlvr_xmit_ts)
+					tcp->tcp_dlvr_xmit_ts = ts;
 				if (SEQ_GT(sack_end, tcp->tcp_fack)) {
 					tcp->tcp_fack = sack_end;
 				}
@@ -374,6 +382,20 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
 			up += TCPOPT_TSTAMP_LEN;
 			continue;
 
+		case TCPOPT_FASTOPEN:
+			/* Either a cookie request or a cookie. */
+			if (len < 2 || len < (int)up[1] || (up[1] != 2 &&
+			    (up[1] < 2 + TCP_TFO_COOKIE_MIN ||
+			    up[1] > 2 + TCP_TFO_COOKIE_MAX || (up[1] & 1))))
+				break;
+
+			tcpopt->tcp_opt_tfo_cookie = up + 2;
+			tcpopt->tcp_opt_tfo_len = up[1] - 2;
+			found |= TCP_OPT_TFO_PRESENT;
+
+			up += up[1];
+			continue;
+
 		default:
 			if (len <= 1 || len < (int)up[1] || up[1] == 0)
 				break;
@@ -508,6 +530,10 @@ tcp_process_options(tcp_t *tcp, tcpha_t *tcpha)
 		tcp->tcp_snd_sack_ok = B_FALSE;
 	}
 
+	/* Process the Fast Open option. */
+	if ((options & TCP_OPT_TFO_PRESENT) && tcp->tcp_tfo_flags != 0)
+		tcp_fastopen_option(tcp, &tcpopt);
+
 	/*
 	 * Now we know the exact TCP/IP header length, subtract
 	 * that from tcp_mss to get our side's MSS.
@@ -684,6 +710,83 @@ tcp_reass_elim_overlap(tcp_t *tcp, mblk_t *mp)
 		tcp->tcp_reass_tail = mp;
 }
 
+/*
+ * Enter SACK based fast recovery because tcp_rack_detect() found a hole
+ * lost, much as tcp_input_data() does on the third dup ACK.
+ */
+void
+tcp_rack_recover(tcp_t *tcp)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+
+	ASSERT(tcp->tcp_snd_sack_ok && tcp->tcp_notsack_list != NULL);
+
+	if (!tcp->tcp_cwr)
+		TCP_CC_CONG_SIGNAL(tcp, CC_NDUPACK);
+	if (tcp->tcp_ecn_ok) {
+		tcp->tcp_cwr = B_TRUE;
+		tcp->tcp_cwr_snd_max = tcp->tcp_snxt;
+		tcp->tcp_ecn_cwr_sent = B_FALSE;
+	}
+	if ((tcp->tcp_valid_bits & TCP_FSS_VALID) && (tcp->tcp_unsent == 0))
+		tcp->tcp_rexmit_max = tcp->tcp_fss;
+	else
+		tcp->tcp_rexmit_max = tcp->tcp_snxt;
+	tcp->tcp_snd_burst = TCP_CWND_SS;
+	tcp->tcp_pipe = tcp->tcp_snxt - tcp->tcp_fack;
+	tcp->tcp_sack_snxt = tcp->tcp_suna;
+	tcp->tcp_dupack_cnt = tcps->tcps_dupack_fast_retransmit;
+}
+
+/*
+ * Called for an ACK while there is data in flight or a tail loss probe
+ * pending.  new_ack is B_TRUE if the ACK moved tcp_suna.  Runs time based
+ * loss detection, settles an answered probe and keeps the probe timer
+ * going.  Returns flags for tcp_input_data().
+ */
+static uint_t
+tcp_rack_ack(tcp_t *tcp, boolean_t new_ack)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	uint_t		flags = 0;
+	clock_t		wait = 0;
+	boolean_t	recovery;
+
+	recovery = tcp->tcp_rexmit ||
+	    tcp->tcp_dupack_cnt >= tcps->tcps_dupack_fast_retransmit;
+
+	if (tcp->tcp_tlp_out && SEQ_GEQ(tcp->tcp_suna, tcp->tcp_tlp_high)) {
+		tcp->tcp_tlp_out = B_FALSE;
+		/*
+		 * A retransmitted probe repaired the tail.  Without DSACK
+		 * there is no telling whether the original was lost or
+		 * merely late, so take it as a loss, as RFC 8985 does.
+		 */
+		if (tcp->tcp_tlp_rexmit && !recovery) {
+			TCP_CC_CONG_SIGNAL(tcp, CC_NDUPACK);
+			TCP_CC_POST_RECOVERY(tcp);
+			TCP_STAT(tcps, tcp_tlp_recovered);
+		}
+	}
+	if (tcp->tcp_suna == tcp->tcp_snxt) {
+		if (tcp->tcp_tlp_tid != 0) {
+			(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_tlp_tid);
+			tcp->tcp_tlp_tid = 0;
+		}
+		return (0);
+	}
+
+	if (tcp->tcp_snd_sack_ok && tcp->tcp_notsack_list != NULL &&
+	    !tcp->tcp_rexmit && tcp_rack_detect(tcp, &wait)) {
+		if (!recovery)
+			tcp_rack_recover(tcp);
+		flags |= TH_NEED_SACK_REXMIT;
+	}
+	if (new_ack || wait != 0)
+		tcp_tlp_arm(tcp, wait);
+	return (flags);
+}
+
 /*
  * This function does PAWS protection check. Returns B_TRUE if the
  * segment passes the PAWS test, else returns B_FALSE.
@@ -1328,6 +1431,7 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	mblk_t		*tpi_mp;
 	uint_t		ifindex = ira->ira_ruifindex;
 	boolean_t	tlc_set = B_FALSE;
+	sqproc_t	synack_proc;
 
 	ip_hdr_len = ira->ira_ip_hdr_length;
 	tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
@@ -1352,6 +1456,13 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		return;
 	}
 
+	/*
+	 * A SYN for the 4-tuple of a compact TIME_WAIT entry is only let
+	 * through if it is for a new incarnation of the connection.
+	 */
+	if (tcp_time_wait_input(mp, ira, ipst))
+		return;
+
 	if (listener->tcp_state != TCPS_LISTEN)
 		goto error2;
 
@@ -1455,6 +1566,13 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	 */
 	ASSERT(ira->ira_sqp != NULL);
 	new_sqp = ira->ira_sqp;
+	/*
+	 * Unless the application should do the inbound processing of its
+	 * connections where it runs. Then use the squeue of the CPU it last
+	 * accepted on.
+	 */
+	if (ip_squeue_follow_app && listener->tcp_accept_sqp != NULL)
+		new_sqp = listener->tcp_accept_sqp;
 
 	econnp = (conn_t *)tcp_get_conn(arg2, tcps);
 	if (econnp == NULL)
@@ -1662,6 +1780,18 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		goto error3;
 	}
 
+	/*
+	 * Fast Open needs the early su_newconn upcall, so it is only
+	 * offered to non-STREAMS listeners.  Loopback connections are
+	 * fused, and labeled systems want the full handshake.
+	 */
+	if ((listener->tcp_tfo_flags & TCP_TFO_LISTEN) &&
+	    (tcps->tcps_fastopen & TCP_TFO_SERVER) &&
+	    IPCL_IS_NONSTR(lconnp) && !eager->tcp_loopback &&
+	    !is_system_labeled()) {
+		eager->tcp_tfo_flags |= TCP_TFO_SERVER;
+	}
+
 	/* Process all TCP options. */
 	tcp_process_options(eager, tcpha);
 
@@ -1757,6 +1887,8 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	eager->tcp_rack = seg_seq;
 	eager->tcp_rnxt = seg_seq + 1;
 	eager->tcp_tcpha->tha_ack = htonl(eager->tcp_rnxt);
+	if (eager->tcp_tfo_flags & TCP_TFO_COOKIE_OK)
+		tcp_fastopen_syn_data(eager, mp, tcpha, ip_hdr_len);
 	TCPS_BUMP_MIB(tcps, tcpPassiveOpens);
 	eager->tcp_state = TCPS_SYN_RCVD;
 	DTRACE_TCP6(state__change, void, NULL, ip_xmit_attr_t *,
@@ -1804,6 +1936,10 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 
 	TCP_TIMER_RESTART(eager, eager->tcp_rto);
 
+	/* Decide before the eager can be seen by anyone else. */
+	synack_proc = (eager->tcp_tfo_mp != NULL) ? tcp_fastopen_accept :
+	    tcp_send_synack;
+
 	/*
 	 * Insert the eager in its own perimeter now. We are ready to deal
 	 * with any packets on eager.
@@ -1815,9 +1951,14 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	freemsg(mp);
 	/*
 	 * Send the SYN-ACK. Use the right squeue so that conn_ixa is
-	 * only used by one thread at a time.
+	 * only used by one thread at a time.  If the SYN carried data we
+	 * can accept, the connection is passed up first.
 	 */
-	if (econnp->conn_sqp == lconnp->conn_sqp) {
+	if (econnp->conn_sqp == lconnp->conn_sqp &&
+	    synack_proc == tcp_fastopen_accept) {
+		tcp_fastopen_accept(econnp, mp1, NULL, NULL);
+		CONN_DEC_REF(econnp);
+	} else if (econnp->conn_sqp == lconnp->conn_sqp) {
 		DTRACE_TCP5(send, mblk_t *, NULL, ip_xmit_attr_t *,
 		    econnp->conn_ixa, __dtrace_tcp_void_ip_t *, mp1->b_rptr,
 		    tcp_t *, eager, __dtrace_tcp_tcph_t *,
@@ -1825,7 +1966,7 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		(void) conn_ip_output(mp1, econnp->conn_ixa);
 		CONN_DEC_REF(econnp);
 	} else {
-		SQUEUE_ENTER_ONE(econnp->conn_sqp, mp1, tcp_send_synack,
+		SQUEUE_ENTER_ONE(econnp->conn_sqp, mp1, synack_proc,
 		    econnp, NULL, SQ_PROCESS, SQTAG_TCP_SEND_SYNACK);
 	}
 	return;
@@ -2374,8 +2515,6 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	ip_pkt_t	ipp;
 	boolean_t	ofo_seg = B_FALSE; /* Out of order segment */
 	uint32_t	cwnd;
-	uint32_t	add;
-	int		npkt;
 	int		mss;
 	conn_t		*connp = (conn_t *)arg;
 	squeue_t	*sqp = (squeue_t *)arg2;
@@ -2533,9 +2672,9 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		if (flags & TH_ACK) {
 			/*
 			 * Note that our stack cannot send data before a
-			 * connection is established, therefore the
-			 * following check is valid.  Otherwise, it has
-			 * to be changed.
+			 * connection is established, except on a Fast Open
+			 * SYN, therefore the following check is valid.
+			 * Otherwise, it has to be changed.
 			 */
 			if (SEQ_LEQ(seg_ack, tcp->tcp_iss) ||
 			    SEQ_GT(seg_ack, tcp->tcp_snxt)) {
@@ -2546,7 +2685,8 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 				    tcp, seg_ack, 0, TH_RST);
 				return;
 			}
-			ASSERT(tcp->tcp_suna + 1 == seg_ack);
+			ASSERT(tcp->tcp_suna + 1 == seg_ack ||
+			    (tcp->tcp_tfo_flags & TCP_TFO_DATA));
 		}
 		if (flags & TH_RST) {
 			if (flags & TH_ACK) {
@@ -2634,6 +2774,17 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 			tcp->tcp_suna = tcp->tcp_iss + 1;
 			tcp->tcp_valid_bits &= ~TCP_ISS_VALID;
 
+			/*
+			 * If the peer did not take the data on our Fast
+			 * Open SYN, it is sent again as ordinary data.
+			 */
+			if (tcp->tcp_tfo_flags & TCP_TFO_DATA) {
+				if (seg_ack == tcp->tcp_suna)
+					tcp_fastopen_rewind(tcp);
+				else
+					tcp->tcp_tfo_flags &= ~TCP_TFO_DATA;
+			}
+
 			/*
 			 * If SYN was retransmitted, need to reset all
 			 * retransmission info.  This is because this
@@ -2704,7 +2855,8 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 				 * final ACK triggers the passive side to
 				 * perform fusion in ESTABLISHED state.
 				 */
-				if ((ack_mp = tcp_ack_mp(tcp)) != NULL) {
+				if (tcp->tcp_xmit_head == NULL &&
+				    (ack_mp = tcp_ack_mp(tcp)) != NULL) {
 					if (tcp->tcp_ack_tid != 0) {
 						(void) TCP_TIMER_CANCEL(tcp,
 						    tcp->tcp_ack_tid);
@@ -2736,7 +2888,8 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 				}
 				/*
 				 * Forget fusion; we need to handle more
-				 * complex cases below.  Send the deferred
+				 * complex cases below, such as data queued
+				 * by a Fast Open connect.  Send the deferred
 				 * T_CONN_CON message upstream and proceed
 				 * as usual.  Mark this tcp as not capable
 				 * of fusion.
@@ -2763,12 +2916,14 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 			 * yes, set the transmit flag.  Then check to see
 			 * if received data processing needs to be done.
 			 * If not, go straight to xmit_check.  This short
-			 * cut is OK as we don't support T/TCP.
+			 * cut is OK unless the SYN-ACK also acked data
+			 * sent on a Fast Open SYN.
 			 */
 			if (tcp->tcp_unsent)
 				flags |= TH_XMIT_NEEDED;
 
-			if (seg_len == 0 && !(flags & TH_URG)) {
+			if (seg_len == 0 && !(flags & TH_URG) &&
+			    seg_ack == tcp->tcp_suna) {
 				freemsg(mp);
 				goto xmit_check;
 			}
@@ -2781,6 +2936,8 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		DTRACE_TCP6(state__change, void, NULL, ip_xmit_attr_t *,
 		    connp->conn_ixa, void_ip_t *, NULL, tcp_t *, tcp,
 		    tcph_t *, NULL, int32_t, TCPS_SYN_SENT);
+		if (tcp->tcp_tfo_flags & TCP_TFO_DATA)
+			tcp_fastopen_rewind(tcp);
 		mp1 = tcp_xmit_mp(tcp, tcp->tcp_xmit_head, tcp->tcp_mss,
 		    NULL, NULL, tcp->tcp_iss, B_FALSE, NULL, B_FALSE);
 		if (mp1 != NULL) {
@@ -3196,27 +3353,42 @@ ok:;
 	 * Therefore the check should be done here.
 	 */
 	if (tcp->tcp_ecn_ok) {
-		if (flags & TH_CWR) {
-			tcp->tcp_ecn_echo_on = B_FALSE;
-		}
-		/*
-		 * Note that both ECN_CE and CWR can be set in the
-		 * same segment.  In this case, we once again turn
-		 * on ECN_ECHO.
-		 */
+		boolean_t ce;
+
 		if (connp->conn_ipversion == IPV4_VERSION) {
 			uchar_t tos = ((ipha_t *)rptr)->ipha_type_of_service;
 
-			if ((tos & IPH_ECN_CE) == IPH_ECN_CE) {
-				tcp->tcp_ecn_echo_on = B_TRUE;
-			}
+			ce = ((tos & IPH_ECN_CE) == IPH_ECN_CE);
 		} else {
 			uint32_t vcf = ((ip6_t *)rptr)->ip6_vcf;
 
-			if ((vcf & htonl(IPH_ECN_CE << 20)) ==
-			    htonl(IPH_ECN_CE << 20)) {
-				tcp->tcp_ecn_echo_on = B_TRUE;
+			ce = ((vcf & htonl(IPH_ECN_CE << 20)) ==
+			    htonl(IPH_ECN_CE << 20));
+		}
+
+		if (tcp->tcp_cc_algo->ca_flags & CC_F_ECN_PERSEG) {
+			/*
+			 * The sender's algorithm needs to know how much
+			 * of the data was marked (e.g. DCTCP), so ECN_ECHO
+			 * follows the CE bit of each segment instead of
+			 * staying on until CWR.  ACK a change right away
+			 * so that delayed ACKs do not blur where it was.
+			 */
+			if (ce != tcp->tcp_ecn_echo_on) {
+				tcp->tcp_ecn_echo_on = ce;
+				flags |= TH_ACK_NEEDED;
 			}
+		} else {
+			if (flags & TH_CWR) {
+				tcp->tcp_ecn_echo_on = B_FALSE;
+			}
+			/*
+			 * Note that both ECN_CE and CWR can be set in the
+			 * same segment.  In this case, we once again turn
+			 * on ECN_ECHO.
+			 */
+			if (ce)
+				tcp->tcp_ecn_echo_on = B_TRUE;
 		}
 	}
 
@@ -3717,6 +3889,15 @@ process_ack:
 			DTRACE_TCP5(connect__established, mblk_t *, NULL,
 			    ip_xmit_attr_t *, connp->conn_ixa, void_ip_t *,
 			    iphdr, tcp_t *, tcp, tcph_t *, tcpha);
+		} else if (tcp->tcp_tfo_flags & TCP_TFO_EARLY) {
+			/*
+			 * The socket was told about this connection when
+			 * its Fast Open SYN arrived, see
+			 * tcp_fastopen_accept().
+			 */
+			DTRACE_TCP5(accept__established, mlbk_t *, NULL,
+			    ip_xmit_attr_t *, connp->conn_ixa, void_ip_t *,
+			    iphdr, tcp_t *, tcp, tcph_t *, tcpha);
 		} else if (IPCL_IS_NONSTR(connp)) {
 			/*
 			 * 3-way handshake has completed, so notify socket
@@ -3824,6 +4005,8 @@ process_ack:
 			    iphdr, tcp_t *, tcp, tcph_t *, tcpha);
 		}
 		TCPS_CONN_INC(tcps);
+		if (tcp->tcp_tfo_flags & TCP_TFO_PENDING)
+			tcp_fastopen_done(tcp);
 
 		tcp->tcp_suna = tcp->tcp_iss + 1;	/* One for the SYN */
 		bytes_acked--;
@@ -3885,16 +4068,18 @@ process_ack:
 	 */
 	if (tcp->tcp_cwr && SEQ_GT(seg_ack, tcp->tcp_cwr_snd_max))
 		tcp->tcp_cwr = B_FALSE;
+	if (tcp->tcp_ecn_ok && tcp->tcp_cc_algo->ca_ecn_ack != NULL) {
+		tcp->tcp_cc_algo->ca_ecn_ack(tcp, seg_ack, bytes_acked,
+		    (flags & TH_ECE) != 0);
+	}
 	if (tcp->tcp_ecn_ok && (flags & TH_ECE)) {
 		if (!tcp->tcp_cwr) {
-			npkt = ((tcp->tcp_snxt - tcp->tcp_suna) >> 1) / mss;
-			tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
-			tcp->tcp_cwnd = npkt * mss;
+			TCP_CC_CONG_SIGNAL(tcp, CC_ECN);
 			/*
 			 * If the cwnd is 0, use the timer to clock out
 			 * new segments.  This is required by the ECN spec.
 			 */
-			if (npkt == 0) {
+			if (tcp->tcp_cwnd == 0) {
 				TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
 				/*
 				 * This makes sure that when the ACK comes
@@ -3979,12 +4164,9 @@ process_ack:
 				 * dropped (due to congestion.)
 				 */
 				if (!tcp->tcp_cwr) {
-					npkt = ((tcp->tcp_snxt -
-					    tcp->tcp_suna) >> 1) / mss;
-					tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) *
+					TCP_CC_CONG_SIGNAL(tcp, CC_NDUPACK);
+					tcp->tcp_cwnd += tcp->tcp_dupack_cnt *
 					    mss;
-					tcp->tcp_cwnd = (npkt +
-					    tcp->tcp_dupack_cnt) * mss;
 				}
 				if (tcp->tcp_ecn_ok) {
 					tcp->tcp_cwr = B_TRUE;
@@ -4208,13 +4390,7 @@ process_ack:
 		ASSERT(tcp->tcp_rexmit == B_FALSE);
 		if (SEQ_GEQ(seg_ack, tcp->tcp_rexmit_max)) {
 			tcp->tcp_dupack_cnt = 0;
-			/*
-			 * Restore the orig tcp_cwnd_ssthresh after
-			 * fast retransmit phase.
-			 */
-			if (tcp->tcp_cwnd > tcp->tcp_cwnd_ssthresh) {
-				tcp->tcp_cwnd = tcp->tcp_cwnd_ssthresh;
-			}
+			TCP_CC_POST_RECOVERY(tcp);
 			tcp->tcp_rexmit_max = seg_ack;
 			tcp->tcp_cwnd_cnt = 0;
 			tcp->tcp_snd_burst = tcp->tcp_localnet ?
@@ -4310,30 +4486,8 @@ process_ack:
 	 * congestion experience bit is not set, increase the tcp_cwnd as
 	 * usual.
 	 */
-	if (!tcp->tcp_ecn_ok || !(flags & TH_ECE)) {
-		cwnd = tcp->tcp_cwnd;
-		add = mss;
-
-		if (cwnd >= tcp->tcp_cwnd_ssthresh) {
-			/*
-			 * This is to prevent an increase of less than 1 MSS of
-			 * tcp_cwnd.  With partial increase, tcp_wput_data()
-			 * may send out tinygrams in order to preserve mblk
-			 * boundaries.
-			 *
-			 * By initializing tcp_cwnd_cnt to new tcp_cwnd and
-			 * decrementing it by 1 MSS for every ACKs, tcp_cwnd is
-			 * increased by 1 MSS for every RTTs.
-			 */
-			if (tcp->tcp_cwnd_cnt <= 0) {
-				tcp->tcp_cwnd_cnt = cwnd + add;
-			} else {
-				tcp->tcp_cwnd_cnt -= add;
-				add = 0;
-			}
-		}
-		tcp->tcp_cwnd = MIN(cwnd + add, tcp->tcp_cwnd_max);
-	}
+	if (!tcp->tcp_ecn_ok || !(flags & TH_ECE))
+		TCP_CC_ACK_RECEIVED(tcp, bytes_acked);
 
 	/* See if the latest urgent data has been acknowledged */
 	if ((tcp->tcp_valid_bits & TCP_URG_VALID) &&
@@ -4497,6 +4651,14 @@ fin_acked:
 pre_swnd_update:
 	tcp->tcp_xmit_head = mp1;
 swnd_update:
+	/*
+	 * Loss detection and the tail loss probe.  As below, the ACK is
+	 * new if it is past tcp_swl2.
+	 */
+	if (tcp->tcp_suna != tcp->tcp_snxt || tcp->tcp_tlp_out ||
+	    tcp->tcp_tlp_tid != 0)
+		flags |= tcp_rack_ack(tcp, SEQ_LT(tcp->tcp_swl2, seg_ack));
+
 	/*
 	 * The following check is different from most other implementations.
 	 * For bi-directional transfer, when segments are dropped, the
@@ -4665,7 +4827,11 @@ est:
 	}
 update_ack:
 	tcpha = tcp->tcp_tcpha;
-	tcp->tcp_rack_cnt++;
+	/*
+	 * Count full-sized segments, so that a segment coalesced by receive
+	 * offload is acked as promptly as the segments it was made from.
+	 */
+	tcp->tcp_rack_cnt += MAX(seg_len / mss, 1);
 	{
 		uint32_t cur_max;
 
@@ -5655,11 +5821,7 @@ noticmpv4:
 			 * Reduce the sending rate as if we got a
 			 * retransmit timeout
 			 */
-			uint32_t npkt;
-
-			npkt = ((tcp->tcp_snxt - tcp->tcp_suna) >> 1) /
-			    tcp->tcp_mss;
-			tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * tcp->tcp_mss;
+			TCP_CC_CONG_SIGNAL(tcp, CC_RTO);
 			tcp->tcp_cwnd = tcp->tcp_mss;
 			tcp->tcp_cwnd_cnt = 0;
 		}
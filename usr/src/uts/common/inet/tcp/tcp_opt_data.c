@@ -63,6 +63,7 @@ opdes_t	tcp_opt_arr[] = {
 	},
 { SO_BROADCAST,	SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 { SO_REUSEADDR, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ SO_REUSEPORT, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 { SO_OOBINLINE, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 { SO_TYPE,	SOL_SOCKET, OA_R, OA_R, OP_NP, 0, sizeof (int), 0 },
 { SO_SNDBUF,	SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
@@ -74,6 +75,8 @@ opdes_t	tcp_opt_arr[] = {
 { SO_DGRAM_ERRIND, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0
 	},
 { SO_SND_COPYAVOID, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ SO_MAX_PACING_RATE, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int),
+	0 },
 { SO_ANON_MLP, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int),
 	0 },
 { SO_MAC_EXEMPT, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int),
@@ -139,6 +142,11 @@ opdes_t	tcp_opt_arr[] = {
 
 { TCP_LINGER2, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 
+{ TCP_CONGESTION, IPPROTO_TCP, OA_RW, OA_RW, OP_NP,
+	(OP_VARLEN|OP_NODEFAULT), CC_ALGO_NAME_MAX, -1 /* not initialized */ },
+
+{ TCP_FASTOPEN, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+
 { IP_OPTIONS,	IPPROTO_IP, OA_RW, OA_RW, OP_NP,
 	(OP_VARLEN|OP_NODEFAULT),
 	IP_MAX_OPT_LENGTH + IP_ADDR_LEN, -1 /* not initialized */ },
@@ -381,6 +389,10 @@ tcp_opt_get(conn_t *connp, int level, int name, uchar_t *ptr)
 		case SO_ACCEPTCONN:
 			*i1 = (tcp->tcp_state == TCPS_LISTEN);
 			return (sizeof (int));
+		case SO_MAX_PACING_RATE:
+			*(uint32_t *)i1 = (tcp->tcp_pace_max == 0) ?
+			    UINT32_MAX : tcp->tcp_pace_max;
+			return (sizeof (int));
 		}
 		break;
 	case IPPROTO_TCP:
@@ -446,6 +458,14 @@ tcp_opt_get(conn_t *connp, int level, int name, uchar_t *ptr)
 		case TCP_LINGER2:
 			*i1 = tcp->tcp_fin_wait_2_flush_interval / SECONDS;
 			return (sizeof (int));
+		case TCP_CONGESTION:
+			/* Caller ensures enough space */
+			(void) strlcpy((char *)ptr, tcp->tcp_cc_algo->ca_name,
+			    CC_ALGO_NAME_MAX);
+			return (strlen((char *)ptr) + 1);
+		case TCP_FASTOPEN:
+			*i1 = (tcp->tcp_tfo_flags & TCP_TFO_LISTEN) != 0;
+			return (sizeof (int));
 		}
 		break;
 	case IPPROTO_IP:
@@ -653,6 +673,14 @@ tcp_opt_set(conn_t *connp, uint_t optset_context, int level, int name,
 			}
 			*outlenp = inlen;
 			return (0);
+		case SO_MAX_PACING_RATE:
+			/* Bytes per second; ~0 turns the limit off. */
+			if (!checkonly) {
+				tcp->tcp_pace_max = (*(uint32_t *)i1 ==
+				    UINT32_MAX) ? 0 : *(uint32_t *)i1;
+			}
+			*outlenp = inlen;
+			return (0);
 		}
 		break;
 	case IPPROTO_TCP:
@@ -948,6 +976,33 @@ tcp_opt_set(conn_t *connp, uint_t optset_context, int level, int name,
 			}
 			tcp->tcp_fin_wait_2_flush_interval = *i1 * SECONDS;
 			break;
+		case TCP_CONGESTION: {
+			char name[CC_ALGO_NAME_MAX];
+
+			/* The name need not be NUL terminated. */
+			if (inlen == 0 || inlen > CC_ALGO_NAME_MAX) {
+				*outlenp = 0;
+				return (EINVAL);
+			}
+			bcopy(invalp, name, inlen);
+			name[MIN(inlen, CC_ALGO_NAME_MAX - 1)] = '\0';
+			if (checkonly)
+				break;
+			if ((reterr = tcp_cc_set(tcp, name)) != 0) {
+				*outlenp = 0;
+				return (reterr);
+			}
+			break;
+		}
+		case TCP_FASTOPEN:
+			/* Takes effect for SYNs the listener receives */
+			if (checkonly)
+				break;
+			if (onoff)
+				tcp->tcp_tfo_flags |= TCP_TFO_LISTEN;
+			else
+				tcp->tcp_tfo_flags &= ~TCP_TFO_LISTEN;
+			break;
 		default:
 			break;
 		}
@@ -196,6 +196,86 @@ tcp_wput(queue_t *q, mblk_t *mp)
 	    NULL, tcp_squeue_flag, SQTAG_TCP_WPUT_OTHER);
 }
 
+/*
+ * Pacing.  Instead of sending all that the windows allow at once, a paced
+ * connection sends a quantum of about TCP_PACE_QUANTUM worth of data at
+ * its pacing rate, and spaces the quanta out so that the average is the
+ * rate; tcp_pace_timer() comes back for the rest.  Bursts of a whole cwnd
+ * overflow shallow switch buffers, and the losses that follow are what
+ * keeps long, fast connections from reaching their rate.
+ *
+ * When the _pacing property is set the rate is twice cwnd per smoothed RTT
+ * in slow start, and 1.2 times that afterwards, so that cwnd can still
+ * grow.  SO_MAX_PACING_RATE caps the rate, and also paces a connection on
+ * its own.  Only new data is paced; retransmissions go out at once.
+ */
+#define	TCP_PACE_QUANTUM	((hrtime_t)1 * (NANOSEC / MILLISEC))
+
+static uint64_t
+tcp_pace_rate(tcp_t *tcp)
+{
+	uint64_t	rate = tcp->tcp_pace_max;
+	uint64_t	cwnd_rate;
+
+	/* tcp_rtt_sa is in ms, scaled by 8, and not valid until sampled. */
+	if (tcp->tcp_tcps->tcps_pacing && tcp->tcp_rtt_update != 0 &&
+	    tcp->tcp_rtt_sa != 0) {
+		cwnd_rate = (uint64_t)tcp->tcp_cwnd * MILLISEC * 8 /
+		    tcp->tcp_rtt_sa;
+		if (tcp->tcp_cwnd < tcp->tcp_cwnd_ssthresh)
+			cwnd_rate *= 2;
+		else
+			cwnd_rate = cwnd_rate * 6 / 5;
+		if (rate == 0 || cwnd_rate < rate)
+			rate = cwnd_rate;
+	}
+	return (rate);
+}
+
+/*
+ * Limit what tcp_wput_data() may send now to one quantum.  Returns B_FALSE
+ * if it is too early to send anything, after making sure that the pacing
+ * timer will call back.
+ */
+static boolean_t
+tcp_pace_limit(tcp_t *tcp, uint64_t rate, int mss, int *usable)
+{
+	hrtime_t	now = gethrtime();
+	int		quantum;
+
+	if (now < tcp->tcp_pace_next) {
+		if (tcp->tcp_pace_tid == 0) {
+			tcp->tcp_pace_tid = tcp_timeout_ns(tcp->tcp_connp,
+			    tcp_pace_timer, tcp->tcp_pace_next - now);
+		}
+		return (B_FALSE);
+	}
+
+	quantum = (int)MIN(rate * TCP_PACE_QUANTUM / NANOSEC, INT_MAX);
+	quantum = MAX(quantum - quantum % mss, 2 * mss);
+	if (*usable > quantum)
+		*usable = quantum;
+	return (B_TRUE);
+}
+
+/*
+ * Account for 'sent' bytes at the pacing rate, and call back for more
+ * if the data is not all sent.
+ */
+static void
+tcp_pace_sent(tcp_t *tcp, uint64_t rate, uint32_t sent)
+{
+	hrtime_t	now = gethrtime();
+
+	/* Credit is not saved up while the connection is idle. */
+	tcp->tcp_pace_next = MAX(tcp->tcp_pace_next, now) +
+	    (hrtime_t)sent * NANOSEC / rate;
+	if (tcp->tcp_unsent > 0 && tcp->tcp_pace_tid == 0) {
+		tcp->tcp_pace_tid = tcp_timeout_ns(tcp->tcp_connp,
+		    tcp_pace_timer, tcp->tcp_pace_next - now);
+	}
+}
+
 /*
  * The TCP normal data output path.
  * NOTE: the logic of the fast path is duplicated from this function.
@@ -219,6 +299,7 @@ tcp_wput_data(tcp_t *tcp, mblk_t *mp, boolean_t urgent)
 	tcp_stack_t	*tcps = tcp->tcp_tcps;
 	conn_t		*connp = tcp->tcp_connp;
 	clock_t		now = LBOLT_FASTPATH;
+	uint64_t	pace_rate = 0;
 
 	tcpstate = tcp->tcp_state;
 	if (mp == NULL) {
@@ -497,6 +578,10 @@ data_null:
 		usable = (usable / mss) * mss;
 	}
 
+	if (TCP_PACED(tcp) && (pace_rate = tcp_pace_rate(tcp)) != 0 &&
+	    !tcp_pace_limit(tcp, pace_rate, mss, &usable))
+		goto done;
+
 	/* Update the latest receive window size in TCP header. */
 	tcp->tcp_tcpha->tha_win = htons(tcp->tcp_rwnd >> tcp->tcp_rcv_ws);
 
@@ -521,6 +606,7 @@ done:;
 	tcp->tcp_xmit_tail_unsent = tail_unsent;
 	len = tcp->tcp_snxt - snxt;
 	if (len) {
+		tcp->tcp_xmit_lbolt = now;
 		/*
 		 * If new data was sent, need to update the notsack
 		 * list, which is, afterall, data blocks that have
@@ -533,7 +619,7 @@ done:;
 			tcp_notsack_update(&(tcp->tcp_notsack_list),
 			    tcp->tcp_snxt, snxt,
 			    &(tcp->tcp_num_notsack_blk),
-			    &(tcp->tcp_cnt_notsack_list));
+			    &(tcp->tcp_cnt_notsack_list), now);
 		}
 		tcp->tcp_snxt = snxt + tcp->tcp_fin_sent;
 		tcp->tcp_rack = tcp->tcp_rnxt;
@@ -541,6 +627,8 @@ done:;
 		if ((snxt + len) == tcp->tcp_suna) {
 			TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
 		}
+		if (tcp->tcp_tlp_tid == 0)
+			tcp_tlp_arm(tcp, 0);
 	} else if (snxt == tcp->tcp_suna && tcp->tcp_swnd == 0) {
 		/*
 		 * Didn't send anything. Make sure the timer is running
@@ -550,6 +638,8 @@ done:;
 	}
 	/* Note that len is the amount we just sent but with a negative sign */
 	tcp->tcp_unsent += len;
+	if (pace_rate != 0 && len != 0)
+		tcp_pace_sent(tcp, pace_rate, -len);
 	mutex_enter(&tcp->tcp_non_sq_lock);
 	if (tcp->tcp_flow_stopped) {
 		if (TCP_UNSENT_BYTES(tcp) <= connp->conn_sndlowat) {
@@ -1142,6 +1232,7 @@ tcp_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 	 *   4. data in mblk
 	 *   5. len <= mss
 	 *   6. no tcp_valid bits
+	 *   7. not paced
 	 */
 	if ((tcp->tcp_unsent != 0) ||
 	    (tcp->tcp_cork) ||
@@ -1149,7 +1240,8 @@ tcp_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 	    (tcp->tcp_state != TCPS_ESTABLISHED) ||
 	    (len == 0) ||
 	    (len > mss) ||
-	    (tcp->tcp_valid_bits != 0)) {
+	    (tcp->tcp_valid_bits != 0) ||
+	    TCP_PACED(tcp)) {
 		tcp_wput_data(tcp, mp, B_FALSE);
 		return;
 	}
@@ -1249,6 +1341,9 @@ tcp_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 
 	tcp->tcp_snxt = snxt + len;
 	tcp->tcp_rack = tcp->tcp_rnxt;
+	tcp->tcp_xmit_lbolt = now;
+	if (tcp->tcp_tlp_tid == 0)
+		tcp_tlp_arm(tcp, 0);
 
 	if ((mp1 = dupb(mp)) == 0)
 		goto no_memory;
@@ -2751,6 +2846,10 @@ tcp_xmit_listeners_reset(mblk_t *mp, ip_recv_attr_t *ira, ip_stack_t *ipst,
 		return;
 	}
 
+	/* It may be for a connection whose TIME_WAIT state was compacted. */
+	if (tcp_time_wait_input(mp, ira, ipst))
+		return;
+
 	rptr = mp->b_rptr;
 
 	tcpha = (tcpha_t *)&rptr[ip_hdr_len];
@@ -2963,6 +3062,13 @@ tcp_xmit_mp_aux_iss(tcp_t *tcp, conn_t *connp, tcpha_t *tcpha, mblk_t *mp,
 		tcpha->tha_offset_and_reserved += (1 << 4);
 	}
 
+	if (tcp->tcp_tfo_flags != 0) {
+		/* The option is padded to a whole number of words. */
+		u1 = tcp_fastopen_syn_opt(tcp, wptr);
+		wptr += u1;
+		tcpha->tha_offset_and_reserved += (u1 >> 2) << 4;
+	}
+
 	mp->b_wptr = wptr;
 	u1 = (int)(mp->b_wptr - mp->b_rptr);
 	/*
@@ -3402,8 +3508,10 @@ tcp_sack_rexmit(tcp_t *tcp, uint_t *flags)
 
 		/*
 		 * Update the send timestamp to avoid false retransmission.
+		 * The notsack blk's is for tcp_rack_detect().
 		 */
 		snxt_mp->b_prev = (mblk_t *)ddi_get_lbolt();
+		notsack_blk->xmit_ts = ddi_get_lbolt();
 
 		TCPS_BUMP_MIB(tcps, tcpRetransSegs);
 		TCPS_UPDATE_MIB(tcps, tcpRetransBytes, seg_len);
@@ -3530,6 +3638,111 @@ tcp_rexmit_after_error(tcp_t *tcp)
 	tcp_ss_rexmit(tcp);
 }
 
+/*
+ * Arm the tail loss probe timer (RFC 8985 section 7) for the data in
+ * flight.  The probe timeout is two smoothed RTTs, plus the peer's delayed
+ * ACK time when only one segment is out, but no more than the RTO.  One
+ * probe is allowed per tail, and none during recovery.  wait, if not 0, is
+ * when tcp_rack_detect() wants another look, and the timer goes off then
+ * if that is sooner.
+ */
+void
+tcp_tlp_arm(tcp_t *tcp, clock_t wait)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	clock_t		pto = 0;
+
+	if (tcps->tcps_tlp && tcp->tcp_snd_sack_ok && !tcp->tcp_tlp_out &&
+	    tcp->tcp_state >= TCPS_ESTABLISHED && tcp->tcp_rtt_sa != 0 &&
+	    !tcp->tcp_rexmit && tcp->tcp_zero_win_probe == 0 &&
+	    tcp->tcp_dupack_cnt < tcps->tcps_dupack_fast_retransmit) {
+		/* tcp_rtt_sa is 8 times the smoothed RTT */
+		pto = tcp->tcp_rtt_sa >> 2;
+		if (tcp->tcp_snxt - tcp->tcp_suna <= tcp->tcp_mss) {
+			pto += tcp->tcp_localnet ?
+			    tcps->tcps_local_dack_interval :
+			    tcps->tcps_deferred_ack_interval;
+		}
+		pto = MAX(pto, TCP_TLP_MIN);
+		pto = MIN(pto, tcp->tcp_rto);
+	}
+	if (wait != 0 && (pto == 0 || wait < pto))
+		pto = wait;
+
+	if (tcp->tcp_tlp_tid != 0) {
+		(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_tlp_tid);
+		tcp->tcp_tlp_tid = 0;
+	}
+	if (pto != 0)
+		tcp->tcp_tlp_tid = TCP_TIMER(tcp, tcp_tlp_timer, pto);
+}
+
+/*
+ * Send a tail loss probe: a segment of new data if the windows allow one,
+ * otherwise the last segment again.  The ACK for it carries SACK info
+ * about the whole tail, so a loss there is repaired by fast recovery
+ * instead of the retransmission timer, which takes over from here.
+ */
+void
+tcp_tlp_send(tcp_t *tcp)
+{
+	uint32_t	snxt = tcp->tcp_snxt;
+	uint32_t	cwnd;
+	uint32_t	begin, end;
+	uint32_t	seg_len;
+	int32_t		off;
+	mblk_t		*snxt_mp, *xmit_mp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+
+	if (tcp->tcp_unsent > 0 && tcp->tcp_swnd != 0) {
+		/* Let the congestion window admit one more segment. */
+		cwnd = tcp->tcp_cwnd;
+		tcp->tcp_cwnd = snxt - tcp->tcp_suna + tcp->tcp_mss;
+		tcp_wput_data(tcp, NULL, B_FALSE);
+		tcp->tcp_cwnd = cwnd;
+	}
+
+	tcp->tcp_tlp_rexmit = (tcp->tcp_snxt == snxt);
+	if (tcp->tcp_tlp_rexmit) {
+		/* A lone FIN is left to the retransmission timer. */
+		if ((tcp->tcp_valid_bits & TCP_FSS_VALID) && tcp->tcp_fin_sent)
+			end = tcp->tcp_fss;
+		else
+			end = snxt;
+		if (!SEQ_GT(end, tcp->tcp_suna))
+			return;
+		seg_len = end - tcp->tcp_suna;
+		if (seg_len > tcp->tcp_mss)
+			seg_len = tcp->tcp_mss;
+		begin = end - seg_len;
+
+		snxt_mp = tcp_get_seg_mp(tcp, begin, &off);
+		if (snxt_mp == NULL)
+			return;
+		xmit_mp = tcp_xmit_mp(tcp, snxt_mp, seg_len, &off, NULL,
+		    begin, B_TRUE, &seg_len, B_TRUE);
+		if (xmit_mp == NULL)
+			return;
+
+		/* Make sure no new RTT samples will be taken. */
+		tcp->tcp_csuna = tcp->tcp_snxt;
+		tcp_send_data(tcp, xmit_mp);
+		snxt_mp->b_prev = (mblk_t *)ddi_get_lbolt();
+		TCPS_BUMP_MIB(tcps, tcpRetransSegs);
+		TCPS_UPDATE_MIB(tcps, tcpRetransBytes, seg_len);
+	}
+
+	tcp->tcp_tlp_out = B_TRUE;
+	tcp->tcp_tlp_high = tcp->tcp_snxt;
+	TCP_STAT(tcps, tcp_tlp_probe);
+	/* tcp_wput_data() may have armed the probe timer again. */
+	if (tcp->tcp_tlp_tid != 0) {
+		(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_tlp_tid);
+		tcp->tcp_tlp_tid = 0;
+	}
+	TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
+}
+
 /*
  * tcp_get_seg_mp() is called to get the pointer to a segment in the
  * send queue which starts at the given sequence number. If the given
@@ -33,6 +33,8 @@
 #include <inet/common.h>
 #include <inet/ip.h>
 #include <inet/tcp.h>
+#include <inet/tcp_impl.h>
+#include <sys/sunddi.h>
 
 /* kmem cache for notsack_blk_t */
 kmem_cache_t	*tcp_notsack_blk_cache;
@@ -187,16 +189,22 @@ tcp_sack_remove(sack_blk_t *head, tcp_seq end, int32_t *num)
  *	int32_t *num: (referenced) total num of notsack'ed blk on the list.
  *	uint32_t *sum: (referenced) total num of bytes of all the notsack'ed
  *		blks.
+ *
+ * Return:
+ *	The latest send time of the blks the SACK info covers, 0 if it covers
+ *	nothing on the list.  This is an upper bound on when the newly
+ *	sack'ed data was sent, see tcp_rack_detect().
  */
-void
+clock_t
 tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
     int32_t *num, uint32_t *sum)
 {
 	notsack_blk_t *prev, *tmp, *new;
 	uint32_t tmp_sum, tmp_num;
+	clock_t ts;
 
 	if (*head == NULL) {
-		return;
+		return (0);
 	}
 
 	tmp = *head;
@@ -213,7 +221,7 @@ tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 	 * is not updated.
 	 */
 	if (tmp == NULL) {
-		return;
+		return (0);
 	}
 
 	/*
@@ -221,9 +229,10 @@ tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 	 * the list anymore.
 	 */
 	if (SEQ_LEQ(end, tmp->begin)) {
-		return;
+		return (0);
 	}
 
+	ts = tmp->xmit_ts;
 	/* The SACK info covers up to this blk.  So just check for this blk. */
 	if (SEQ_LEQ(end, tmp->end)) {
 		/*
@@ -239,7 +248,7 @@ tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 			(*num)--;
 			*sum -= tmp->end - tmp->begin;
 			kmem_cache_free(tcp_notsack_blk_cache, tmp);
-			return;
+			return (ts);
 		}
 		/* This blk is partially covered. */
 		if (SEQ_GEQ(begin, tmp->begin)) {
@@ -256,12 +265,13 @@ tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 				if ((new = kmem_cache_alloc(
 				    tcp_notsack_blk_cache, KM_NOSLEEP)) ==
 				    NULL) {
-					return;
+					return (0);
 				}
 				new->end = tmp->end;
 				new->begin = end;
 				new->next = tmp->next;
 				new->sack_cnt = 0;
+				new->xmit_ts = tmp->xmit_ts;
 				tmp->end = begin;
 				tmp->next = new;
 				(tmp->sack_cnt)++;
@@ -272,7 +282,7 @@ tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 			*sum -= end - tmp->begin;
 			tmp->begin = end;
 		}
-		return;
+		return (ts);
 	}
 
 	/* Need to check for coverage of this blk and later blks. */
@@ -291,6 +301,8 @@ tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 		if (SEQ_GT(tmp->begin, end)) {
 			break;
 		} else {
+			if (tmp->xmit_ts > ts)
+				ts = tmp->xmit_ts;
 			/* Is the blk completely or partially covered? */
 			if (SEQ_LEQ(tmp->end, end)) {
 				tmp_num--;
@@ -319,6 +331,7 @@ tcp_notsack_insert(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 	}
 	*num = tmp_num;
 	*sum = tmp_sum;
+	return (ts);
 }
 
 
@@ -387,9 +400,10 @@ tcp_notsack_remove(notsack_blk_t **head, tcp_seq end, int32_t *num,
  *	int32_t *num: (referenced) total num of notsack'ed blks.
  *	uint32_t *sum: (referenced) total num of bytes of all the notsack'ed
  *		blks.
+ *	clock_t ts: when the new data was sent.
  */
 void tcp_notsack_update(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
-    int32_t *num, uint32_t *sum)
+    int32_t *num, uint32_t *sum, clock_t ts)
 {
 	notsack_blk_t *tmp;
 
@@ -404,6 +418,7 @@ void tcp_notsack_update(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 		tmp->end = end;
 		tmp->next = NULL;
 		tmp->sack_cnt = 0;
+		tmp->xmit_ts = ts;
 		*head = tmp;
 		*num = 1;
 		*sum = end - begin;
@@ -423,6 +438,7 @@ void tcp_notsack_update(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 	if (SEQ_GEQ(tmp->end, begin)) {
 		*sum += end - tmp->end;
 		tmp->end = end;
+		tmp->xmit_ts = ts;
 	} else {
 		/* No.  Need to create a new notsack blk. */
 		tmp->next = kmem_cache_alloc(tcp_notsack_blk_cache, KM_NOSLEEP);
@@ -432,8 +448,69 @@ void tcp_notsack_update(notsack_blk_t **head, tcp_seq begin, tcp_seq end,
 			tmp->end = end;
 			tmp->next = NULL;
 			tmp->sack_cnt = 0;
+			tmp->xmit_ts = ts;
 			(*num)++;
 			*sum += end - begin;
 		}
 	}
 }
+
+/*
+ * RACK style time based loss detection (RFC 8985) on the notsack list.  A
+ * hole is lost once data sent no earlier than it has been sack'ed and the
+ * hole has been out for an RTT plus a reordering window of a quarter RTT.
+ * The dup ACK threshold cannot see a tail too short to draw three dup ACKs
+ * or a retransmission that is itself lost; this can.
+ *
+ * A lost hole gets its sack_cnt raised to the threshold, or, if it was
+ * already retransmitted in this recovery, tcp_sack_snxt is wound back to
+ * it, so that tcp_sack_rexmit() sends it.  The send times kept on the list
+ * are upper bounds, which errs on the side of waiting longer.
+ *
+ * Returns B_TRUE if a hole was found lost.  *wait is set to the millisec
+ * until the next hole would be, 0 if none is pending.
+ */
+boolean_t
+tcp_rack_detect(tcp_t *tcp, clock_t *wait)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	notsack_blk_t	*blk;
+	clock_t		now, srtt, thres, elapsed;
+	uint32_t	dupthres = tcps->tcps_dupack_fast_retransmit;
+	boolean_t	recovery = tcp->tcp_dupack_cnt >= dupthres;
+	boolean_t	lost = B_FALSE;
+
+	*wait = 0;
+	if (!tcps->tcps_rack || tcp->tcp_rtt_sa == 0)
+		return (B_FALSE);
+
+	srtt = tcp->tcp_rtt_sa >> 3;
+	thres = srtt + (srtt >> 2);
+	now = ddi_get_lbolt();
+	for (blk = tcp->tcp_notsack_list; blk != NULL; blk = blk->next) {
+		/* Nothing above tcp_fack has been sack'ed yet. */
+		if (SEQ_GT(blk->end, tcp->tcp_fack))
+			break;
+		if (blk->xmit_ts == 0 || blk->xmit_ts > tcp->tcp_dlvr_xmit_ts)
+			continue;
+		/* Already marked, and not yet retransmitted. */
+		if (recovery && blk->sack_cnt >= dupthres &&
+		    SEQ_GEQ(blk->begin, tcp->tcp_sack_snxt))
+			continue;
+
+		elapsed = TICK_TO_MSEC(now - blk->xmit_ts);
+		if (elapsed < thres) {
+			if (*wait == 0 || thres - elapsed < *wait)
+				*wait = thres - elapsed;
+			continue;
+		}
+		/* The retransmission is lost as well. */
+		if (recovery && SEQ_LT(blk->begin, tcp->tcp_sack_snxt))
+			tcp->tcp_sack_snxt = blk->begin;
+		if (blk->sack_cnt < dupthres)
+			blk->sack_cnt = dupthres;
+		TCP_STAT(tcps, tcp_rack_lost);
+		lost = B_TRUE;
+	}
+	return (lost);
+}
@@ -69,6 +69,7 @@ static void	tcp_clr_flowctrl(sock_lower_handle_t);
 static int	tcp_ioctl(sock_lower_handle_t, int, intptr_t, int, int32_t *,
 		    cred_t *);
 static int	tcp_close(sock_lower_handle_t, int, cred_t *);
+static void	tcp_busy_poll(sock_lower_handle_t);
 
 sock_downcalls_t sock_tcp_downcalls = {
 	tcp_activate,
@@ -88,6 +89,7 @@ sock_downcalls_t sock_tcp_downcalls = {
 	tcp_clr_flowctrl,
 	tcp_ioctl,
 	tcp_close,
+	tcp_busy_poll,
 };
 
 /* ARGSUSED */
@@ -181,6 +183,10 @@ tcp_accept(sock_lower_handle_t lproto_handle,
 	 */
 	ASSERT(econnp->conn_ref >= 2);
 
+	/* Remember where the application runs, see tcp_input_listener() */
+	if (ip_squeue_follow_app)
+		listener->tcp_accept_sqp = ip_squeue_curcpu();
+
 	mutex_enter(&listener->tcp_eager_lock);
 	/*
 	 * Non-STREAMS listeners never defer the notification of new
@@ -191,6 +197,10 @@ tcp_accept(sock_lower_handle_t lproto_handle,
 	mutex_exit(&listener->tcp_eager_lock);
 	CONN_DEC_REF(listener->tcp_connp);
 
+	/* A Fast Open eager may be accepted before the handshake is done. */
+	if (eager->tcp_state == TCPS_SYN_RCVD &&
+	    (eager->tcp_tfo_flags & TCP_TFO_EARLY))
+		return (0);
 	return ((eager->tcp_state < TCPS_ESTABLISHED) ? ECONNABORTED : 0);
 }
 
@@ -299,6 +309,8 @@ tcp_connect(sock_lower_handle_t proto_handle, const struct sockaddr *sa,
 	 * TCP supports quick connect, so no need to do an implicit bind
 	 */
 	error = tcp_do_connect(connp, sa, len, cr, curproc->p_pid);
+	if (error != 0)
+		tcp_close_mpp(&connp->conn_tcp->tcp_tfo_mp);
 	if (error == 0) {
 		*id = connp->conn_tcp->tcp_connid;
 	} else if (error < 0) {
@@ -503,7 +515,18 @@ tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct nmsghdr *msg,
 		ASSERT(tcp != NULL);
 
 		tcpstate = tcp->tcp_state;
-		if (tcpstate < TCPS_ESTABLISHED) {
+		if ((msg->msg_flags & MSG_FASTOPEN) &&
+		    (tcpstate == TCPS_IDLE || tcpstate == TCPS_BOUND)) {
+			/* Held for the SYN, see so_sendmsg_fastopen() */
+			return (tcp_fastopen_stash(connp, mp));
+		}
+		/*
+		 * An eager passed up early by Fast Open may be written to
+		 * in SYN_RCVD; the data is queued until it is established.
+		 */
+		if (tcpstate < TCPS_ESTABLISHED &&
+		    (tcpstate != TCPS_SYN_RCVD ||
+		    !(tcp->tcp_tfo_flags & TCP_TFO_EARLY))) {
 			freemsg(mp);
 			/*
 			 * We return ENOTCONN if the endpoint is trying to
@@ -749,6 +772,18 @@ tcp_close(sock_lower_handle_t proto_handle, int flags, cred_t *cr)
 	return (EINPROGRESS);
 }
 
+/*
+ * SO_BUSY_POLL: poll the receive ring feeding this connection's squeue, if
+ * there is one, so that data is processed in the spinning thread.
+ */
+static void
+tcp_busy_poll(sock_lower_handle_t proto_handle)
+{
+	conn_t *connp = (conn_t *)proto_handle;
+
+	(void) squeue_busy_poll(connp->conn_sqp);
+}
+
 /* ARGSUSED */
 sock_lower_handle_t
 tcp_create(int family, int type, int proto, sock_downcalls_t **sock_downcalls,
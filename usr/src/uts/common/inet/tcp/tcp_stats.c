@@ -728,6 +728,15 @@ tcp_kstat2_init(netstackid_t stackid)
 		{ "tcp_rst_unsent",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_reclaim_cnt",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_reass_timeout",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_cookie_req",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_cookie_bad",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_syn_data",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_pending_drop",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_client_data",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_client_rewind",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_rack_lost",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_tlp_probe",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_tlp_recovered",		KSTAT_DATA_UINT64, 0 },
 #ifdef TCP_DEBUG_COUNTER
 		{ "tcp_time_wait",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_rput_time_wait",		KSTAT_DATA_UINT64, 0 },
@@ -935,6 +944,15 @@ tcp_clr_stats(tcp_stat_t *stats)
 	stats->tcp_rst_unsent.value.ui64 = 0;
 	stats->tcp_reclaim_cnt.value.ui64 = 0;
 	stats->tcp_reass_timeout.value.ui64 = 0;
+	stats->tcp_fastopen_cookie_req.value.ui64 = 0;
+	stats->tcp_fastopen_cookie_bad.value.ui64 = 0;
+	stats->tcp_fastopen_syn_data.value.ui64 = 0;
+	stats->tcp_fastopen_pending_drop.value.ui64 = 0;
+	stats->tcp_fastopen_client_data.value.ui64 = 0;
+	stats->tcp_fastopen_client_rewind.value.ui64 = 0;
+	stats->tcp_rack_lost.value.ui64 = 0;
+	stats->tcp_tlp_probe.value.ui64 = 0;
+	stats->tcp_tlp_recovered.value.ui64 = 0;
 
 #ifdef TCP_DEBUG_COUNTER
 	stats->tcp_time_wait.value.ui64 = 0;
@@ -1031,6 +1049,24 @@ tcp_add_stats(tcp_stat_counter_t *from, tcp_stat_t *to)
 	    from->tcp_reclaim_cnt;
 	to->tcp_reass_timeout.value.ui64 +=
 	    from->tcp_reass_timeout;
+	to->tcp_fastopen_cookie_req.value.ui64 +=
+	    from->tcp_fastopen_cookie_req;
+	to->tcp_fastopen_cookie_bad.value.ui64 +=
+	    from->tcp_fastopen_cookie_bad;
+	to->tcp_fastopen_syn_data.value.ui64 +=
+	    from->tcp_fastopen_syn_data;
+	to->tcp_fastopen_pending_drop.value.ui64 +=
+	    from->tcp_fastopen_pending_drop;
+	to->tcp_fastopen_client_data.value.ui64 +=
+	    from->tcp_fastopen_client_data;
+	to->tcp_fastopen_client_rewind.value.ui64 +=
+	    from->tcp_fastopen_client_rewind;
+	to->tcp_rack_lost.value.ui64 +=
+	    from->tcp_rack_lost;
+	to->tcp_tlp_probe.value.ui64 +=
+	    from->tcp_tlp_probe;
+	to->tcp_tlp_recovered.value.ui64 +=
+	    from->tcp_tlp_recovered;
 
 #ifdef TCP_DEBUG_COUNTER
 	to->tcp_time_wait.value.ui64 +=
@@ -29,25 +29,110 @@
  * refer to the time wait handling comments in tcp_impl.h.
  */
 
+/*
+ * Compact TIME_WAIT state.
+ *
+ * All a connection in TIME_WAIT still has to do is answer the few segments
+ * that can arrive for it, and for that it needs its 4-tuple, the next
+ * sequence numbers in each direction and the peer's last timestamp.
+ * Keeping the whole conn_t and tcp_t around for tcps_time_wait_interval
+ * just for that limits how many short connections a busy server can close
+ * per second.  So tcp_time_wait_collector() copies those fields of each
+ * detached TIME_WAIT connection into a small tcp_tw_t and frees the
+ * connection the next time it runs, at most TCP_TIME_WAIT_COMPACT_DELAY
+ * after the connection was put on the time wait list, instead of when the
+ * interval is over.
+ *
+ * A stack's tcp_tw_t's are hashed on their 4-tuple in tcps_tw_hash, which
+ * tcp_time_wait_input() searches for segments that classified to no
+ * connection.  They are also kept on a timing wheel, tcps_tw_wheel, of
+ * TCP_TW_WHEEL_SIZE slots of one second each, indexed by expiry time.
+ * tcp_tw_wheel_run() runs once a second while the stack has any entries,
+ * and frees those in the slots whose second has passed.  An entry that is
+ * due in a later turn of the wheel, or whose expiry was pushed back by a
+ * retransmitted FIN, is moved to the slot for its expiry instead.
+ *
+ * Only tcp_tw_wheel_run() frees entries.  Anyone else ending an entry early
+ * takes it off the hash under the bucket lock and leaves it on the wheel.
+ * The bucket lock is taken before a slot lock, and tcps_tw_lock before
+ * either.
+ */
+
 #include <sys/types.h>
 #include <sys/strsun.h>
 #include <sys/squeue_impl.h>
 #include <sys/squeue.h>
 #include <sys/callo.h>
+#include <sys/strsubr.h>
+#include <sys/atomic.h>
 
 #include <inet/common.h>
 #include <inet/ip.h>
+#include <inet/ip6.h>
+#include <inet/ipsec_impl.h>
 #include <inet/tcp.h>
 #include <inet/tcp_impl.h>
 #include <inet/tcp_cluster.h>
 
+typedef struct tcp_tw_head_s {
+	kmutex_t	th_lock;
+	struct tcp_tw_s	*th_head;
+} tcp_tw_head_t;
+
+typedef struct tcp_tw_s {
+	struct tcp_tw_s	*tw_hnext;	/* hash chain, under th_lock */
+	struct tcp_tw_s	*tw_wnext;	/* wheel slot, under th_lock */
+	tcp_tw_head_t	*tw_bucket;	/* hash bucket */
+	in6_addr_t	tw_laddr;	/* v4-mapped for IPv4 */
+	in6_addr_t	tw_faddr;
+	uint32_t	tw_ports;	/* as conn_ports */
+	uint32_t	tw_snxt;
+	uint32_t	tw_rnxt;
+	uint32_t	tw_rwnd;
+	uint32_t	tw_ts_recent;
+	int64_t		tw_expire;	/* lbolt64 */
+	uint8_t		tw_rcv_ws;
+	uint8_t		tw_flags;
+} tcp_tw_t;
+
+/* tw_flags, under the bucket lock */
+#define	TW_HASHED	0x01	/* on the hash, i.e. still live */
+#define	TW_TS_OK	0x02	/* timestamps were negotiated */
+
+#define	TCP_TW_WHEEL_SIZE	64	/* must be a power of 2 */
+
+/* Second whose slot an entry expiring at lbolt64 t goes in. */
+#define	TCP_TW_SEC(t)		(((t) + hz - 1) / hz)
+#define	TCP_TW_SLOT(tcps, sec)						\
+	(&(tcps)->tcps_tw_wheel[(sec) & (TCP_TW_WHEEL_SIZE - 1)])
+#define	TCP_TW_HASH(tcps, faddr, ports)					\
+	(&(tcps)->tcps_tw_hash[((faddr) ^ ((faddr) >> 16) ^ (ports) ^	\
+	((ports) >> 8)) & ((tcps)->tcps_tw_hash_size - 1)])
+
+/* Set to B_FALSE to keep the full connection for the whole interval. */
+boolean_t	tcp_time_wait_compact = B_TRUE;
+
+/* Buckets in each stack's hash of compact entries, a power of 2. */
+uint_t		tcp_time_wait_hash_size = 16384;
+
+static kmem_cache_t	*tcp_tw_cache;
+
 static void	tcp_timewait_close(void *, mblk_t *, void *, ip_recv_attr_t *);
+static void	tcp_time_wait_iss(tcp_stack_t *, uint32_t, uint32_t,
+		    const in6_addr_t *, const in6_addr_t *);
+static boolean_t tcp_tw_create(tcp_t *);
+static void	tcp_tw_kill(tcp_stack_t *, const in6_addr_t *,
+		    const in6_addr_t *, uint32_t);
+static void	tcp_tw_wheel_run(void *);
 
 /*
  * TCP_TIME_WAIT_DELAY governs how often the time_wait_collector runs.
- * Running it every 5 seconds seems to give the best results.
+ * Running it every 5 seconds seems to give the best results.  When
+ * connections are compacted it runs every TCP_TIME_WAIT_COMPACT_DELAY
+ * instead, so that they are not held for long.
  */
 #define	TCP_TIME_WAIT_DELAY ((hrtime_t)5 * NANOSEC)
+#define	TCP_TIME_WAIT_COMPACT_DELAY ((hrtime_t)1 * NANOSEC)
 
 /*
  * Remove a connection from the list of detached TIME_WAIT connections.
@@ -164,12 +249,16 @@ tcp_time_wait_append(tcp_t *tcp)
 		 * a timer is needed.
 		 */
 		if (tcp_time_wait->tcp_time_wait_tid == 0) {
+			hrtime_t firetime;
+
+			firetime = tcp_time_wait_compact ?
+			    TCP_TIME_WAIT_COMPACT_DELAY :
+			    (hrtime_t)(tcps->tcps_time_wait_interval + 1) *
+			    MICROSEC;
 			tcp_time_wait->tcp_time_wait_tid =
 			    timeout_generic(CALLOUT_NORMAL,
-			    tcp_time_wait_collector, sqp,
-			    (hrtime_t)(tcps->tcps_time_wait_interval + 1) *
-			    MICROSEC, CALLOUT_TCP_RESOLUTION,
-			    CALLOUT_FLAG_ROUNDUP);
+			    tcp_time_wait_collector, sqp, firetime,
+			    CALLOUT_TCP_RESOLUTION, CALLOUT_FLAG_ROUNDUP);
 		}
 	} else {
 		/*
@@ -223,7 +312,8 @@ tcp_timewait_close(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 }
 
 /*
- * Blows away all tcps whose TIME_WAIT has expired. List traversal
+ * Blows away all tcps whose TIME_WAIT has expired, and, when compacting,
+ * those that have been replaced by a tcp_tw_t. List traversal
  * is done forwards from the head.
  * This walks all stack instances since
  * tcp_time_wait remains global across all stacks.
@@ -275,7 +365,8 @@ tcp_time_wait_collector(void *arg)
 		 * lbolt64 should not wrap around in practice...  So we can
 		 * do a direct comparison.
 		 */
-		if (now < tcp->tcp_time_wait_expire)
+		if (now < tcp->tcp_time_wait_expire &&
+		    (!tcp_time_wait_compact || !tcp_tw_create(tcp)))
 			break;
 
 		removed = tcp_time_wait_remove(tcp, tcp_time_wait);
@@ -416,9 +507,14 @@ tcp_time_wait_collector(void *arg)
 	    tcp_time_wait->tcp_time_wait_tid == 0) {
 		hrtime_t firetime;
 
-		firetime = TICK_TO_NSEC(tcp->tcp_time_wait_expire - now);
-		/* This ensures that we won't wake up too often. */
-		firetime = MAX(TCP_TIME_WAIT_DELAY, firetime);
+		if (tcp_time_wait_compact) {
+			firetime = TCP_TIME_WAIT_COMPACT_DELAY;
+		} else {
+			firetime = TICK_TO_NSEC(tcp->tcp_time_wait_expire -
+			    now);
+			/* This ensures that we won't wake up too often. */
+			firetime = MAX(TCP_TIME_WAIT_DELAY, firetime);
+		}
 		tcp_time_wait->tcp_time_wait_tid =
 		    timeout_generic(CALLOUT_NORMAL, tcp_time_wait_collector,
 		    sqp, firetime, CALLOUT_TCP_RESOLUTION,
@@ -509,67 +605,18 @@ tcp_time_wait_processing(tcp_t *tcp, mblk_t *mp, uint32_t seg_seq,
 	}
 
 	if ((flags & TH_SYN) && gap > 0 && rgap < 0) {
+		in6_addr_t	laddr = connp->conn_laddr_v6;
+		in6_addr_t	faddr = connp->conn_faddr_v6;
+		uint32_t	ports = connp->conn_ports;
+		ip_stack_t	*ipst = tcps->tcps_netstack->netstack_ip;
+
 		/*
-		 * Make sure that when we accept the connection, pick
-		 * an ISS greater than (tcp_snxt + tcp_iss_incr/2) for the
-		 * old connection.
-		 *
-		 * The next ISS generated is equal to tcp_iss_incr_extra
-		 * + tcp_iss_incr/2 + other components depending on the
-		 * value of tcp_strong_iss.  We pre-calculate the new
-		 * ISS here and compare with tcp_snxt to determine if
-		 * we need to make adjustment to tcp_iss_incr_extra.
-		 *
-		 * The above calculation is ugly and is a
-		 * waste of CPU cycles...
+		 * Make sure that when we accept the connection, we pick an
+		 * ISS greater than (tcp_snxt + tcp_iss_incr/2) for the old
+		 * connection.
 		 */
-		uint32_t new_iss = tcps->tcps_iss_incr_extra;
-		int32_t adj;
-		ip_stack_t *ipst = tcps->tcps_netstack->netstack_ip;
-
-		switch (tcps->tcps_strong_iss) {
-		case 2: {
-			/* Add time and MD5 components. */
-			uint32_t answer[4];
-			struct {
-				uint32_t ports;
-				in6_addr_t src;
-				in6_addr_t dst;
-			} arg;
-			MD5_CTX context;
-
-			mutex_enter(&tcps->tcps_iss_key_lock);
-			context = tcps->tcps_iss_key;
-			mutex_exit(&tcps->tcps_iss_key_lock);
-			arg.ports = connp->conn_ports;
-			/* We use MAPPED addresses in tcp_iss_init */
-			arg.src = connp->conn_laddr_v6;
-			arg.dst = connp->conn_faddr_v6;
-			MD5Update(&context, (uchar_t *)&arg,
-			    sizeof (arg));
-			MD5Final((uchar_t *)answer, &context);
-			answer[0] ^= answer[1] ^ answer[2] ^ answer[3];
-			new_iss += (gethrtime() >> ISS_NSEC_SHT) + answer[0];
-			break;
-		}
-		case 1:
-			/* Add time component and min random (i.e. 1). */
-			new_iss += (gethrtime() >> ISS_NSEC_SHT) + 1;
-			break;
-		default:
-			/* Add only time component. */
-			new_iss += (uint32_t)gethrestime_sec() *
-			    tcps->tcps_iss_incr;
-			break;
-		}
-		if ((adj = (int32_t)(tcp->tcp_snxt - new_iss)) > 0) {
-			/*
-			 * New ISS not guaranteed to be tcp_iss_incr/2
-			 * ahead of the current tcp_snxt, so add the
-			 * difference to tcp_iss_incr_extra.
-			 */
-			tcps->tcps_iss_incr_extra += adj;
-		}
+		tcp_time_wait_iss(tcps, tcp->tcp_snxt, ports, &laddr, &faddr);
+
 		/*
 		 * If tcp_clean_death() can not perform the task now,
 		 * drop the SYN packet and let the other side re-xmit.
@@ -578,6 +625,7 @@ tcp_time_wait_processing(tcp_t *tcp, mblk_t *mp, uint32_t seg_seq,
 		 */
 		if (tcp_clean_death(tcp, 0) == -1)
 			goto done;
+		tcp_tw_kill(tcps, &laddr, &faddr, ports);
 		nconnp = ipcl_classify(mp, ira, ipst);
 		if (nconnp != NULL) {
 			TCP_STAT(tcps, tcp_time_wait_syn_success);
@@ -628,7 +676,12 @@ tcp_time_wait_processing(tcp_t *tcp, mblk_t *mp, uint32_t seg_seq,
 		TCPS_UPDATE_MIB(tcps, tcpInDataInorderBytes, seg_len);
 	}
 	if (flags & TH_RST) {
-		(void) tcp_clean_death(tcp, 0);
+		in6_addr_t	laddr = connp->conn_laddr_v6;
+		in6_addr_t	faddr = connp->conn_faddr_v6;
+		uint32_t	ports = connp->conn_ports;
+
+		if (tcp_clean_death(tcp, 0) == 0)
+			tcp_tw_kill(tcps, &laddr, &faddr, ports);
 		goto done;
 	}
 	if (flags & TH_SYN) {
@@ -662,3 +715,667 @@ process_ack:
 done:
 	freemsg(mp);
 }
+
+/*
+ * Make sure that the ISS of a new connection that takes over the 4-tuple of
+ * one in TIME_WAIT, whose next sequence number was snxt, is greater than
+ * snxt + tcp_iss_incr/2.
+ *
+ * The next ISS generated is equal to tcp_iss_incr_extra + tcp_iss_incr/2 +
+ * other components depending on the value of tcp_strong_iss.  We
+ * pre-calculate the new ISS here and compare with snxt to determine if we
+ * need to make adjustment to tcp_iss_incr_extra.
+ *
+ * The above calculation is ugly and is a waste of CPU cycles...
+ */
+static void
+tcp_time_wait_iss(tcp_stack_t *tcps, uint32_t snxt, uint32_t ports,
+    const in6_addr_t *laddr, const in6_addr_t *faddr)
+{
+	uint32_t new_iss = tcps->tcps_iss_incr_extra;
+	int32_t adj;
+
+	switch (tcps->tcps_strong_iss) {
+	case 2: {
+		/* Add time and MD5 components. */
+		uint32_t answer[4];
+		struct {
+			uint32_t ports;
+			in6_addr_t src;
+			in6_addr_t dst;
+		} arg;
+		MD5_CTX context;
+
+		mutex_enter(&tcps->tcps_iss_key_lock);
+		context = tcps->tcps_iss_key;
+		mutex_exit(&tcps->tcps_iss_key_lock);
+		arg.ports = ports;
+		/* We use MAPPED addresses in tcp_iss_init */
+		arg.src = *laddr;
+		arg.dst = *faddr;
+		MD5Update(&context, (uchar_t *)&arg, sizeof (arg));
+		MD5Final((uchar_t *)answer, &context);
+		answer[0] ^= answer[1] ^ answer[2] ^ answer[3];
+		new_iss += (gethrtime() >> ISS_NSEC_SHT) + answer[0];
+		break;
+	}
+	case 1:
+		/* Add time component and min random (i.e. 1). */
+		new_iss += (gethrtime() >> ISS_NSEC_SHT) + 1;
+		break;
+	default:
+		/* Add only time component. */
+		new_iss += (uint32_t)gethrestime_sec() * tcps->tcps_iss_incr;
+		break;
+	}
+	if ((adj = (int32_t)(snxt - new_iss)) > 0) {
+		/*
+		 * New ISS not guaranteed to be tcp_iss_incr/2
+		 * ahead of the current snxt, so add the
+		 * difference to tcp_iss_incr_extra.
+		 */
+		tcps->tcps_iss_incr_extra += adj;
+	}
+}
+
+/*
+ * Find the live entry for a 4-tuple in a locked hash bucket.
+ */
+static tcp_tw_t *
+tcp_tw_lookup(tcp_tw_head_t *bucket, const in6_addr_t *laddr,
+    const in6_addr_t *faddr, uint32_t ports)
+{
+	tcp_tw_t	*tw;
+
+	ASSERT(MUTEX_HELD(&bucket->th_lock));
+	for (tw = bucket->th_head; tw != NULL; tw = tw->tw_hnext) {
+		if (tw->tw_ports == ports &&
+		    IN6_ARE_ADDR_EQUAL(&tw->tw_faddr, faddr) &&
+		    IN6_ARE_ADDR_EQUAL(&tw->tw_laddr, laddr))
+			return (tw);
+	}
+	return (NULL);
+}
+
+/*
+ * Take an entry off its hash chain, ending it.  tcp_tw_wheel_run() frees
+ * it when it next comes across it.
+ */
+static void
+tcp_tw_unhash(tcp_tw_t *tw)
+{
+	tcp_tw_head_t	*bucket = tw->tw_bucket;
+	tcp_tw_t	**twp;
+
+	ASSERT(MUTEX_HELD(&bucket->th_lock));
+	ASSERT(tw->tw_flags & TW_HASHED);
+	for (twp = &bucket->th_head; *twp != tw; twp = &(*twp)->tw_hnext)
+		ASSERT(*twp != NULL);
+	*twp = tw->tw_hnext;
+	tw->tw_hnext = NULL;
+	tw->tw_flags &= ~TW_HASHED;
+}
+
+static void
+tcp_tw_kill(tcp_stack_t *tcps, const in6_addr_t *laddr,
+    const in6_addr_t *faddr, uint32_t ports)
+{
+	tcp_tw_head_t	*bucket;
+	tcp_tw_t	*tw;
+
+	if (tcps->tcps_tw_count == 0)
+		return;
+
+	bucket = TCP_TW_HASH(tcps, V4_PART_OF_V6((*faddr)), ports);
+	mutex_enter(&bucket->th_lock);
+	if ((tw = tcp_tw_lookup(bucket, laddr, faddr, ports)) != NULL)
+		tcp_tw_unhash(tw);
+	mutex_exit(&bucket->th_lock);
+}
+
+/*
+ * Put an entry on the wheel slot for its expiry time, and start the wheel
+ * if it is not turning.
+ */
+static void
+tcp_tw_schedule(tcp_stack_t *tcps, tcp_tw_t *tw, int64_t expire)
+{
+	tcp_tw_head_t	*slot;
+	int64_t		sec;
+
+	mutex_enter(&tcps->tcps_tw_lock);
+	/* A slot that has already been run this turn would be a turn late. */
+	sec = MAX(TCP_TW_SEC(expire), tcps->tcps_tw_now + 1);
+	slot = TCP_TW_SLOT(tcps, sec);
+	mutex_enter(&slot->th_lock);
+	tw->tw_wnext = slot->th_head;
+	slot->th_head = tw;
+	mutex_exit(&slot->th_lock);
+
+	if (tcps->tcps_tw_tid == 0 && !tcps->tcps_tw_closing)
+		tcps->tcps_tw_tid = timeout(tcp_tw_wheel_run, tcps, hz);
+	mutex_exit(&tcps->tcps_tw_lock);
+}
+
+/*
+ * Replace a detached TIME_WAIT connection with a tcp_tw_t.  Called by
+ * tcp_time_wait_collector(), which then frees the connection.  Returns
+ * B_FALSE if no memory could be had, in which case the connection has to
+ * stay.
+ */
+static boolean_t
+tcp_tw_create(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	tcp_tw_head_t	*bucket;
+	tcp_tw_t	*tw, *otw;
+
+	ASSERT(TCP_IS_DETACHED(tcp));
+	ASSERT(tcp->tcp_state == TCPS_TIME_WAIT);
+
+	if ((tw = kmem_cache_alloc(tcp_tw_cache, KM_NOSLEEP)) == NULL)
+		return (B_FALSE);
+
+	tw->tw_wnext = NULL;
+	tw->tw_laddr = connp->conn_laddr_v6;
+	tw->tw_faddr = connp->conn_faddr_v6;
+	tw->tw_ports = connp->conn_ports;
+	tw->tw_snxt = tcp->tcp_snxt;
+	tw->tw_rnxt = tcp->tcp_rnxt;
+	tw->tw_rwnd = tcp->tcp_rwnd;
+	tw->tw_rcv_ws = tcp->tcp_rcv_ws;
+	tw->tw_ts_recent = tcp->tcp_ts_recent;
+	tw->tw_expire = tcp->tcp_time_wait_expire;
+	tw->tw_flags = TW_HASHED;
+	if (tcp->tcp_snd_ts_ok)
+		tw->tw_flags |= TW_TS_OK;
+
+	bucket = TCP_TW_HASH(tcps, V4_PART_OF_V6(tw->tw_faddr), tw->tw_ports);
+	tw->tw_bucket = bucket;
+	mutex_enter(&bucket->th_lock);
+	otw = tcp_tw_lookup(bucket, &tw->tw_laddr, &tw->tw_faddr,
+	    tw->tw_ports);
+	if (otw != NULL)
+		tcp_tw_unhash(otw);
+	tw->tw_hnext = bucket->th_head;
+	bucket->th_head = tw;
+	mutex_exit(&bucket->th_lock);
+
+	atomic_inc_32(&tcps->tcps_tw_count);
+	tcp_tw_schedule(tcps, tw, tcp->tcp_time_wait_expire);
+	return (B_TRUE);
+}
+
+/*
+ * Free the entries of one wheel slot that have expired or were ended, and
+ * move the others to the slots for their expiry.
+ */
+static void
+tcp_tw_slot_run(tcp_stack_t *tcps, tcp_tw_head_t *slot, int64_t now)
+{
+	tcp_tw_head_t	*bucket, *nslot;
+	tcp_tw_t	*tw, *next;
+
+	mutex_enter(&slot->th_lock);
+	tw = slot->th_head;
+	slot->th_head = NULL;
+	mutex_exit(&slot->th_lock);
+
+	for (; tw != NULL; tw = next) {
+		next = tw->tw_wnext;
+		bucket = tw->tw_bucket;
+
+		mutex_enter(&bucket->th_lock);
+		if ((tw->tw_flags & TW_HASHED) && now < tw->tw_expire) {
+			/* Expiry is past the slot just being run. */
+			nslot = TCP_TW_SLOT(tcps, TCP_TW_SEC(tw->tw_expire));
+			mutex_enter(&nslot->th_lock);
+			tw->tw_wnext = nslot->th_head;
+			nslot->th_head = tw;
+			mutex_exit(&nslot->th_lock);
+			mutex_exit(&bucket->th_lock);
+			continue;
+		}
+		if (tw->tw_flags & TW_HASHED)
+			tcp_tw_unhash(tw);
+		mutex_exit(&bucket->th_lock);
+
+		kmem_cache_free(tcp_tw_cache, tw);
+		atomic_dec_32(&tcps->tcps_tw_count);
+	}
+}
+
+/*
+ * Turn the wheel: run every slot whose second has come since the last
+ * run.  Reschedules itself while the stack has any entries.
+ */
+static void
+tcp_tw_wheel_run(void *arg)
+{
+	tcp_stack_t	*tcps = arg;
+	int64_t		now = ddi_get_lbolt64();
+	int64_t		sec, last;
+
+	mutex_enter(&tcps->tcps_tw_lock);
+	last = tcps->tcps_tw_now;
+	sec = now / hz;
+	tcps->tcps_tw_now = MAX(sec, last);
+	mutex_exit(&tcps->tcps_tw_lock);
+
+	/* After a long pause each slot is still only worth one run. */
+	last = MAX(last, sec - TCP_TW_WHEEL_SIZE);
+	while (++last <= sec)
+		tcp_tw_slot_run(tcps, TCP_TW_SLOT(tcps, last), now);
+
+	/*
+	 * tcps_tw_tid is only cleared here, so that tcp_time_wait_stack_fini()
+	 * can wait for a run in progress with untimeout().
+	 */
+	mutex_enter(&tcps->tcps_tw_lock);
+	if (tcps->tcps_tw_count != 0 && !tcps->tcps_tw_closing)
+		tcps->tcps_tw_tid = timeout(tcp_tw_wheel_run, tcps, hz);
+	else
+		tcps->tcps_tw_tid = 0;
+	mutex_exit(&tcps->tcps_tw_lock);
+}
+
+/*
+ * Find the timestamp value in a segment's options, if there is one.
+ */
+static boolean_t
+tcp_tw_tsval(tcpha_t *tcpha, uint32_t *tsval)
+{
+	uchar_t		*up = (uchar_t *)tcpha + TCP_MIN_HEADER_LENGTH;
+	uchar_t		*endp = (uchar_t *)tcpha + TCP_HDR_LENGTH(tcpha);
+
+	while (up < endp) {
+		switch (*up) {
+		case TCPOPT_EOL:
+			return (B_FALSE);
+		case TCPOPT_NOP:
+			up++;
+			continue;
+		case TCPOPT_TSTAMP:
+			if (endp - up < TCPOPT_TSTAMP_LEN ||
+			    up[1] != TCPOPT_TSTAMP_LEN)
+				return (B_FALSE);
+			*tsval = BE32_TO_U32(up + 2);
+			return (B_TRUE);
+		default:
+			if (endp - up < 2 || up[1] < 2)
+				return (B_FALSE);
+			up += up[1];
+			continue;
+		}
+	}
+	return (B_FALSE);
+}
+
+/*
+ * ACK a segment for a compact TIME_WAIT entry, tw being a copy of the
+ * entry.  The reply is built in mp as tcp_xmit_early_reset() does.
+ */
+static void
+tcp_tw_xmit(mblk_t *mp, tcp_tw_t *tw, ip_recv_attr_t *ira, ip_stack_t *ipst)
+{
+	tcp_stack_t	*tcps = ipst->ips_netstack->netstack_tcp;
+	uint_t		ip_hdr_len = ira->ira_ip_hdr_length;
+	uint_t		tcp_hdr_len = TCP_MIN_HEADER_LENGTH;
+	ipha_t		*ipha = NULL;
+	ip6_t		*ip6h = NULL;
+	tcpha_t		*tcpha;
+	ip_xmit_attr_t	ixas;
+	mblk_t		*mp1;
+	ipaddr_t	v4addr;
+	in6_addr_t	v6addr;
+	in_port_t	port;
+	ushort_t	len;
+	int		i;
+
+	if (tw->tw_flags & TW_TS_OK)
+		tcp_hdr_len += TCPOPT_REAL_TS_LEN;
+
+	if (DB_REF(mp) != 1 ||
+	    mp->b_datap->db_lim - mp->b_rptr < ip_hdr_len + tcp_hdr_len) {
+		mp1 = allocb(ip_hdr_len + tcp_hdr_len, BPRI_MED);
+		if (mp1 == NULL) {
+			freemsg(mp);
+			return;
+		}
+		bcopy(mp->b_rptr, mp1->b_rptr,
+		    ip_hdr_len + TCP_MIN_HEADER_LENGTH);
+		freemsg(mp);
+		mp = mp1;
+	} else if (mp->b_cont != NULL) {
+		freemsg(mp->b_cont);
+		mp->b_cont = NULL;
+	}
+	DB_CKSUMFLAGS(mp) = 0;
+
+	bzero(&ixas, sizeof (ixas));
+	ixas.ixa_flags = IXAF_SET_ULP_CKSUM | IXAF_VERIFY_SOURCE;
+	ixas.ixa_protocol = IPPROTO_TCP;
+	ixas.ixa_zoneid = ira->ira_zoneid;
+	ixas.ixa_ipst = ipst;
+	ixas.ixa_cred = kcred;
+	ixas.ixa_cpid = NOPID;
+
+	/* As in tcp_xmit_early_reset(), replace all IP options with EOL. */
+	if (IPH_HDR_VERSION(mp->b_rptr) == IPV4_VERSION) {
+		ipha = (ipha_t *)mp->b_rptr;
+		for (i = IP_SIMPLE_HDR_LENGTH; i < (int)ip_hdr_len; i++)
+			mp->b_rptr[i] = IPOPT_EOL;
+	} else {
+		ip6h = (ip6_t *)mp->b_rptr;
+
+		/* Remove any extension headers assuming partial overlay */
+		if (ip_hdr_len > IPV6_HDR_LEN) {
+			uint8_t *to;
+
+			to = mp->b_rptr + ip_hdr_len - IPV6_HDR_LEN;
+			ovbcopy(ip6h, to, IPV6_HDR_LEN);
+			mp->b_rptr += ip_hdr_len - IPV6_HDR_LEN;
+			ip_hdr_len = IPV6_HDR_LEN;
+			ip6h = (ip6_t *)mp->b_rptr;
+			ip6h->ip6_nxt = IPPROTO_TCP;
+		}
+	}
+	tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
+	len = ip_hdr_len + tcp_hdr_len;
+	mp->b_wptr = &mp->b_rptr[len];
+	if (ipha != NULL) {
+		ipha->ipha_length = htons(len);
+		v4addr = ipha->ipha_src;
+		ipha->ipha_src = ipha->ipha_dst;
+		ipha->ipha_dst = v4addr;
+		ipha->ipha_ident = 0;
+		ipha->ipha_ttl = (uchar_t)tcps->tcps_ipv4_ttl;
+		ixas.ixa_flags |= IXAF_IS_IPV4;
+		ixas.ixa_ip_hdr_length = ip_hdr_len;
+	} else {
+		ip6h->ip6_plen = htons(len - IPV6_HDR_LEN);
+		v6addr = ip6h->ip6_src;
+		ip6h->ip6_src = ip6h->ip6_dst;
+		ip6h->ip6_dst = v6addr;
+		ip6h->ip6_hops = (uchar_t)tcps->tcps_ipv6_hoplimit;
+		if (IN6_IS_ADDR_LINKSCOPE(&ip6h->ip6_dst)) {
+			ixas.ixa_flags |= IXAF_SCOPEID_SET;
+			ixas.ixa_scopeid = ira->ira_ruifindex;
+		}
+		ixas.ixa_ip_hdr_length = IPV6_HDR_LEN;
+	}
+	ixas.ixa_pktlen = len;
+
+	port = tcpha->tha_fport;
+	tcpha->tha_fport = tcpha->tha_lport;
+	tcpha->tha_lport = port;
+	tcpha->tha_seq = htonl(tw->tw_snxt);
+	tcpha->tha_ack = htonl(tw->tw_rnxt);
+	tcpha->tha_offset_and_reserved = (tcp_hdr_len >> 2) << 4;
+	tcpha->tha_flags = TH_ACK;
+	tcpha->tha_win = htons(tw->tw_rwnd >> tw->tw_rcv_ws);
+	tcpha->tha_sum = htons(tcp_hdr_len);
+	tcpha->tha_urp = 0;
+	if (tw->tw_flags & TW_TS_OK) {
+		uchar_t	*up = (uchar_t *)tcpha + TCP_MIN_HEADER_LENGTH;
+
+		up[0] = TCPOPT_NOP;
+		up[1] = TCPOPT_NOP;
+		up[2] = TCPOPT_TSTAMP;
+		up[3] = TCPOPT_TSTAMP_LEN;
+		U32_TO_BE32((uint32_t)LBOLT_FASTPATH, up + 4);
+		U32_TO_BE32(tw->tw_ts_recent, up + 8);
+	}
+	TCPS_BUMP_MIB(tcps, tcpOutAck);
+	TCPS_BUMP_MIB(tcps, tcpOutControl);
+
+	ixas.ixa_tsl = ira->ira_tsl;	/* Behave as a multi-level responder */
+
+	if (ira->ira_flags & IRAF_IPSEC_SECURE) {
+		/* Answer the way the segment was protected. */
+		if (!ipsec_in_to_out(ira, &ixas, mp, ipha, ip6h)) {
+			BUMP_MIB(&ipst->ips_ip_mib, ipIfStatsOutDiscards);
+			/* Note: mp already consumed and ip_drop_packet done */
+			goto done;
+		}
+	} else {
+		ixas.ixa_flags |= IXAF_NO_IPSEC;
+	}
+
+	DTRACE_TCP5(send, mblk_t *, NULL, ip_xmit_attr_t *, &ixas,
+	    __dtrace_tcp_void_ip_t *, mp->b_rptr, tcp_t *, NULL,
+	    __dtrace_tcp_tcph_t *, tcpha);
+
+	(void) ip_output_simple(mp, &ixas);
+done:
+	ixa_cleanup(&ixas);
+}
+
+/*
+ * Handle a segment that matched no connection, in case it is for one that
+ * has been replaced by a compact TIME_WAIT entry.  Returns B_TRUE if it
+ * was, in which case mp has been consumed.  This follows
+ * tcp_time_wait_processing(), but a SYN is let through to a listener when
+ * its timestamp, or without timestamps its sequence number, shows it to
+ * belong to a new incarnation of the connection (RFC 6191).
+ */
+boolean_t
+tcp_time_wait_input(mblk_t *mp, ip_recv_attr_t *ira, ip_stack_t *ipst)
+{
+	tcp_stack_t	*tcps = ipst->ips_netstack->netstack_tcp;
+	uint_t		ip_hdr_len = ira->ira_ip_hdr_length;
+	tcp_tw_head_t	*bucket;
+	tcp_tw_t	*tw, tws;
+	tcpha_t		*tcpha;
+	in6_addr_t	laddr, faddr;
+	uint32_t	ports, seg_seq, seg_ack, tsval;
+	int		seg_len;
+	uint_t		flags;
+	boolean_t	ts;
+
+	if (tcps->tcps_tw_count == 0)
+		return (B_FALSE);
+
+	if (IPH_HDR_VERSION(mp->b_rptr) == IPV4_VERSION) {
+		ipha_t	*ipha = (ipha_t *)mp->b_rptr;
+
+		IN6_IPADDR_TO_V4MAPPED(ipha->ipha_dst, &laddr);
+		IN6_IPADDR_TO_V4MAPPED(ipha->ipha_src, &faddr);
+	} else {
+		ip6_t	*ip6h = (ip6_t *)mp->b_rptr;
+
+		laddr = ip6h->ip6_dst;
+		faddr = ip6h->ip6_src;
+	}
+	tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
+	/* Source then destination port, the same layout as conn_ports. */
+	ports = *(uint32_t *)tcpha;
+
+	bucket = TCP_TW_HASH(tcps, V4_PART_OF_V6(faddr), ports);
+	mutex_enter(&bucket->th_lock);
+	if ((tw = tcp_tw_lookup(bucket, &laddr, &faddr, ports)) == NULL) {
+		mutex_exit(&bucket->th_lock);
+		return (B_FALSE);
+	}
+
+	flags = tcpha->tha_flags;
+	seg_seq = ntohl(tcpha->tha_seq);
+	seg_ack = ntohl(tcpha->tha_ack);
+	seg_len = msgdsize(mp) - (TCP_HDR_LENGTH(tcpha) + ip_hdr_len);
+	ts = (tw->tw_flags & TW_TS_OK) && tcp_tw_tsval(tcpha, &tsval);
+
+	if (flags & TH_RST) {
+		/* An in-window RST ends TIME_WAIT early. */
+		if (SEQ_GEQ(seg_seq, tw->tw_rnxt) &&
+		    SEQ_LT(seg_seq, tw->tw_rnxt + tw->tw_rwnd))
+			tcp_tw_unhash(tw);
+		mutex_exit(&bucket->th_lock);
+		freemsg(mp);
+		return (B_TRUE);
+	}
+
+	if (flags & TH_SYN) {
+		if (ts ? TSTMP_LT(tw->tw_ts_recent, tsval) :
+		    SEQ_GT(seg_seq, tw->tw_rnxt)) {
+			tws = *tw;
+			tcp_tw_unhash(tw);
+			mutex_exit(&bucket->th_lock);
+			tcp_time_wait_iss(tcps, tws.tw_snxt, tws.tw_ports,
+			    &tws.tw_laddr, &tws.tw_faddr);
+			TCP_STAT(tcps, tcp_time_wait_syn_success);
+			return (B_FALSE);
+		}
+		goto ack;
+	}
+
+	/* PAWS, an old duplicate */
+	if (ts && TSTMP_LT(tsval, tw->tw_ts_recent))
+		goto ack;
+
+	if ((flags & TH_FIN) && seg_seq + seg_len + 1 == tw->tw_rnxt) {
+		/*
+		 * When TCP receives a duplicate FIN in TIME_WAIT state,
+		 * restart the 2 MSL timer.  See page 73 in RFC 793.
+		 */
+		tw->tw_expire = ddi_get_lbolt64() +
+		    MSEC_TO_TICK(tcps->tcps_time_wait_interval);
+		goto ack;
+	}
+
+	if (ts && TSTMP_GEQ(tsval, tw->tw_ts_recent) &&
+	    SEQ_LEQ(seg_seq, tw->tw_rnxt))
+		tw->tw_ts_recent = tsval;
+
+	/* Nothing to answer to a bare ACK of what we have sent. */
+	if (seg_len == 0 && !(flags & TH_FIN) && seg_seq == tw->tw_rnxt &&
+	    (!(flags & TH_ACK) || SEQ_LEQ(seg_ack, tw->tw_snxt))) {
+		mutex_exit(&bucket->th_lock);
+		freemsg(mp);
+		return (B_TRUE);
+	}
+ack:
+	tws = *tw;
+	mutex_exit(&bucket->th_lock);
+	tcp_tw_xmit(mp, &tws, ira, ipst);
+	return (B_TRUE);
+}
+
+/*
+ * Called by connect before a connection is added to the classifier.  The
+ * 4-tuple of a compact TIME_WAIT entry is taken over if the entry used
+ * timestamps, which keep old duplicates apart from the new connection
+ * (RFC 6191); otherwise the 4-tuple is still in use.
+ */
+int
+tcp_time_wait_connect(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	tcp_tw_head_t	*bucket;
+	tcp_tw_t	*tw;
+	uint32_t	snxt;
+
+	if (tcps->tcps_tw_count == 0)
+		return (0);
+
+	bucket = TCP_TW_HASH(tcps, V4_PART_OF_V6(connp->conn_faddr_v6),
+	    connp->conn_ports);
+	mutex_enter(&bucket->th_lock);
+	tw = tcp_tw_lookup(bucket, &connp->conn_laddr_v6,
+	    &connp->conn_faddr_v6, connp->conn_ports);
+	if (tw == NULL) {
+		mutex_exit(&bucket->th_lock);
+		return (0);
+	}
+	if (!(tw->tw_flags & TW_TS_OK)) {
+		mutex_exit(&bucket->th_lock);
+		return (EADDRINUSE);
+	}
+	snxt = tw->tw_snxt;
+	tcp_tw_unhash(tw);
+	mutex_exit(&bucket->th_lock);
+
+	tcp_time_wait_iss(tcps, snxt, connp->conn_ports,
+	    &connp->conn_laddr_v6, &connp->conn_faddr_v6);
+	return (0);
+}
+
+void
+tcp_time_wait_g_init(void)
+{
+	tcp_tw_cache = kmem_cache_create("tcp_tw_cache", sizeof (tcp_tw_t), 0,
+	    NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+tcp_time_wait_g_destroy(void)
+{
+	kmem_cache_destroy(tcp_tw_cache);
+}
+
+void
+tcp_time_wait_stack_init(tcp_stack_t *tcps)
+{
+	uint_t	i;
+
+	tcps->tcps_tw_hash_size = tcp_time_wait_hash_size;
+	if (!ISP2(tcps->tcps_tw_hash_size) || tcps->tcps_tw_hash_size == 0)
+		tcps->tcps_tw_hash_size = 16384;
+	tcps->tcps_tw_hash = kmem_zalloc(tcps->tcps_tw_hash_size *
+	    sizeof (tcp_tw_head_t), KM_SLEEP);
+	for (i = 0; i < tcps->tcps_tw_hash_size; i++) {
+		mutex_init(&tcps->tcps_tw_hash[i].th_lock, NULL,
+		    MUTEX_DEFAULT, NULL);
+	}
+
+	tcps->tcps_tw_wheel = kmem_zalloc(TCP_TW_WHEEL_SIZE *
+	    sizeof (tcp_tw_head_t), KM_SLEEP);
+	for (i = 0; i < TCP_TW_WHEEL_SIZE; i++) {
+		mutex_init(&tcps->tcps_tw_wheel[i].th_lock, NULL,
+		    MUTEX_DEFAULT, NULL);
+	}
+
+	mutex_init(&tcps->tcps_tw_lock, NULL, MUTEX_DEFAULT, NULL);
+	tcps->tcps_tw_now = ddi_get_lbolt64() / hz;
+}
+
+/*
+ * By now the stack has no connections left to add entries, so once the
+ * wheel has stopped all entries can be freed.
+ */
+void
+tcp_time_wait_stack_fini(tcp_stack_t *tcps)
+{
+	timeout_id_t	tid;
+	tcp_tw_t	*tw;
+	uint_t		i;
+
+	mutex_enter(&tcps->tcps_tw_lock);
+	tcps->tcps_tw_closing = B_TRUE;
+	tid = tcps->tcps_tw_tid;
+	mutex_exit(&tcps->tcps_tw_lock);
+	if (tid != 0)
+		(void) untimeout(tid);
+
+	for (i = 0; i < TCP_TW_WHEEL_SIZE; i++) {
+		while ((tw = tcps->tcps_tw_wheel[i].th_head) != NULL) {
+			tcps->tcps_tw_wheel[i].th_head = tw->tw_wnext;
+			kmem_cache_free(tcp_tw_cache, tw);
+			tcps->tcps_tw_count--;
+		}
+		mutex_destroy(&tcps->tcps_tw_wheel[i].th_lock);
+	}
+	ASSERT(tcps->tcps_tw_count == 0);
+	kmem_free(tcps->tcps_tw_wheel, TCP_TW_WHEEL_SIZE *
+	    sizeof (tcp_tw_head_t));
+	tcps->tcps_tw_wheel = NULL;
+
+	for (i = 0; i < tcps->tcps_tw_hash_size; i++)
+		mutex_destroy(&tcps->tcps_tw_hash[i].th_lock);
+	kmem_free(tcps->tcps_tw_hash, tcps->tcps_tw_hash_size *
+	    sizeof (tcp_tw_head_t));
+	tcps->tcps_tw_hash = NULL;
+
+	mutex_destroy(&tcps->tcps_tw_lock);
+}
@@ -127,12 +127,36 @@ static void	tcp_ip_notify(tcp_t *);
 static void	tcp_timer_callback(void *);
 static void	tcp_timer_free(tcp_t *, mblk_t *);
 static void	tcp_timer_handler(void *, mblk_t *, void *, ip_recv_attr_t *);
+static timeout_id_t tcp_timeout_common(conn_t *, void (*)(void *), hrtime_t,
+		    hrtime_t);
+
+/*
+ * Pacing timers are too short for CALLOUT_TCP_RESOLUTION.
+ */
+#define	TCP_PACE_RESOLUTION	((hrtime_t)100 * MICROSEC)
 
 /*
  * tim is in millisec.
  */
 timeout_id_t
 tcp_timeout(conn_t *connp, void (*f)(void *), hrtime_t tim)
+{
+	return (tcp_timeout_common(connp, f, tim * MICROSEC,
+	    CALLOUT_TCP_RESOLUTION));
+}
+
+/*
+ * As tcp_timeout(), but tim is in nanosec and the timer is more precise.
+ */
+timeout_id_t
+tcp_timeout_ns(conn_t *connp, void (*f)(void *), hrtime_t tim)
+{
+	return (tcp_timeout_common(connp, f, tim, TCP_PACE_RESOLUTION));
+}
+
+static timeout_id_t
+tcp_timeout_common(conn_t *connp, void (*f)(void *), hrtime_t tim,
+    hrtime_t resolution)
 {
 	mblk_t *mp;
 	tcp_timer_t *tcpt;
@@ -165,7 +189,7 @@ tcp_timeout(conn_t *connp, void (*f)(void *), hrtime_t tim)
 	 * early before they have a chance to be cancelled.
 	 */
 	tcpt->tcpt_tid = timeout_generic(CALLOUT_NORMAL, tcp_timer_callback, mp,
-	    tim * MICROSEC, CALLOUT_TCP_RESOLUTION, CALLOUT_FLAG_ROUNDUP);
+	    tim, resolution, CALLOUT_FLAG_ROUNDUP);
 	VERIFY(!(tcpt->tcpt_tid & CALLOUT_ID_FREE));
 
 	return ((timeout_id_t)mp);
@@ -394,6 +418,14 @@ tcp_timers_stop(tcp_t *tcp)
 		(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_reass_tid);
 		tcp->tcp_reass_tid = 0;
 	}
+	if (tcp->tcp_pace_tid != 0) {
+		(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_pace_tid);
+		tcp->tcp_pace_tid = 0;
+	}
+	if (tcp->tcp_tlp_tid != 0) {
+		(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_tlp_tid);
+		tcp->tcp_tlp_tid = 0;
+	}
 }
 
 /*
@@ -550,6 +582,63 @@ tcp_push_timer(void *arg)
 		tcp_xmit_ctl(NULL, tcp, tcp->tcp_snxt, tcp->tcp_rnxt, TH_ACK);
 }
 
+/*
+ * Pacing timer: a paced connection may send its next quantum, see
+ * tcp_pace_rate().
+ */
+void
+tcp_pace_timer(void *arg)
+{
+	conn_t	*connp = (conn_t *)arg;
+	tcp_t	*tcp = connp->conn_tcp;
+
+	tcp->tcp_pace_tid = 0;
+
+	if (tcp->tcp_state >= TCPS_ESTABLISHED && tcp->tcp_unsent > 0)
+		tcp_wput_data(tcp, NULL, B_FALSE);
+}
+
+/*
+ * Tail loss probe timer, see tcp_tlp_arm().  Time based loss detection
+ * goes first: a hole it finds lost is repaired by fast recovery at once,
+ * and one which is not lost yet is looked at again later.  Failing both,
+ * probe the tail.
+ */
+void
+tcp_tlp_timer(void *arg)
+{
+	conn_t		*connp = (conn_t *)arg;
+	tcp_t		*tcp = connp->conn_tcp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	uint_t		flags = 0;
+	clock_t		wait = 0;
+
+	tcp->tcp_tlp_tid = 0;
+
+	if (tcp->tcp_state < TCPS_ESTABLISHED || tcp->tcp_fused ||
+	    tcp->tcp_suna == tcp->tcp_snxt || tcp->tcp_rexmit)
+		return;
+
+	if (tcp->tcp_snd_sack_ok && tcp->tcp_notsack_list != NULL) {
+		if (tcp_rack_detect(tcp, &wait)) {
+			if (tcp->tcp_dupack_cnt <
+			    tcps->tcps_dupack_fast_retransmit)
+				tcp_rack_recover(tcp);
+			tcp_sack_rexmit(tcp, &flags);
+			if ((flags & TH_XMIT_NEEDED) && tcp->tcp_unsent > 0)
+				tcp_wput_data(tcp, NULL, B_FALSE);
+			return;
+		}
+		if (wait != 0) {
+			tcp_tlp_arm(tcp, wait);
+			return;
+		}
+	}
+	if (!tcp->tcp_tlp_out &&
+	    tcp->tcp_dupack_cnt < tcps->tcps_dupack_fast_retransmit)
+		tcp_tlp_send(tcp);
+}
+
 /*
  * This function handles delayed ACK timeout.
  */
@@ -665,6 +754,14 @@ tcp_timer(void *arg)
 	case TCPS_SYN_RCVD: {
 		tcp_t	*listener = tcp->tcp_listener;
 
+		/*
+		 * A Fast Open eager has already been moved to the accept
+		 * queue, so it is no longer one of the listener's q0
+		 * eagers to account for or drop.
+		 */
+		if (tcp->tcp_tfo_flags & TCP_TFO_EARLY)
+			listener = NULL;
+
 		if (tcp->tcp_syn_rcvd_timeout == 0 && (listener != NULL)) {
 			/* it's our first timeout */
 			tcp->tcp_syn_rcvd_timeout = 1;
@@ -797,16 +894,8 @@ tcp_timer(void *arg)
 				 * should then be cleared) or this is a
 				 * timeout for a retransmitted segment.
 				 */
-				uint32_t npkt;
-
-				if (!tcp->tcp_cwr || tcp->tcp_rexmit) {
-					npkt = ((tcp->tcp_timer_backoff ?
-					    tcp->tcp_cwnd_ssthresh :
-					    tcp->tcp_snxt -
-					    tcp->tcp_suna) >> 1) / tcp->tcp_mss;
-					tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) *
-					    tcp->tcp_mss;
-				}
+				if (!tcp->tcp_cwr || tcp->tcp_rexmit)
+					TCP_CC_CONG_SIGNAL(tcp, CC_RTO);
 				tcp->tcp_cwnd = tcp->tcp_mss;
 				tcp->tcp_cwnd_cnt = 0;
 				if (tcp->tcp_ecn_ok) {
@@ -1052,13 +1141,21 @@ timer_rexmit:
 	 * restart the timer with a correct value.
 	 */
 	tcp->tcp_set_timer = 1;
+	if (tcp->tcp_tfo_flags & TCP_TFO_DATA)
+		tcp_fastopen_rewind(tcp);
 	mss = tcp->tcp_snxt - tcp->tcp_suna;
 	if (mss > tcp->tcp_mss)
 		mss = tcp->tcp_mss;
 	if (mss > tcp->tcp_swnd && tcp->tcp_swnd != 0)
 		mss = tcp->tcp_swnd;
 
-	if ((mp = tcp->tcp_xmit_head) != NULL)
+	/*
+	 * A retransmitted SYN or SYN-ACK carries no data; anything queued
+	 * (a Fast Open write, say) goes out once the connection is up.
+	 */
+	if (tcp->tcp_state < TCPS_ESTABLISHED)
+		mp = NULL;
+	else if ((mp = tcp->tcp_xmit_head) != NULL)
 		mp->b_prev = (mblk_t *)ddi_get_lbolt();
 	mp = tcp_xmit_mp(tcp, mp, mss, NULL, NULL, tcp->tcp_suna, B_TRUE, &mss,
 	    B_TRUE);
@@ -1080,6 +1177,13 @@ timer_rexmit:
 	tcp->tcp_rexmit = B_TRUE;
 	tcp->tcp_dupack_cnt = 0;
 
+	/* Any tail loss probe has been overtaken. */
+	tcp->tcp_tlp_out = B_FALSE;
+	if (tcp->tcp_tlp_tid != 0) {
+		(void) TCP_TIMER_CANCEL(tcp, tcp->tcp_tlp_tid);
+		tcp->tcp_tlp_tid = 0;
+	}
+
 	/*
 	 * Remove all rexmit SACK blk to start from fresh.
 	 */
@@ -183,6 +183,48 @@ tcp_listener_conf_del(netstack_t *stack, cred_t *cr, mod_prop_info_t *pinfo,
 	return (ESRCH);
 }
 
+/*
+ * Set the congestion control algorithm used by new connections.
+ */
+/* ARGSUSED */
+static int
+tcp_cc_default_set(netstack_t *stack, cred_t *cr, mod_prop_info_t *pinfo,
+    const char *ifname, const void *pval, uint_t flags)
+{
+	int	err;
+
+	if (flags & MOD_PROP_DEFAULT)
+		pval = tcp_cc_newreno.ca_name;
+	/* ENOENT would be reported as an unknown property. */
+	if ((err = tcp_cc_set_default(stack->netstack_tcp, pval)) == ENOENT)
+		err = EINVAL;
+	return (err);
+}
+
+/*
+ * The possible values are the algorithms currently registered; loading
+ * another congestion control module adds to them.
+ */
+/* ARGSUSED */
+static int
+tcp_cc_default_get(netstack_t *stack, mod_prop_info_t *pinfo,
+    const char *ifname, void *pval, uint_t psize, uint_t flags)
+{
+	bzero(pval, psize);
+	if (flags & MOD_PROP_PERM) {
+		if (snprintf(pval, psize, "%u", MOD_PROP_PERM_RW) >= psize)
+			return (ENOBUFS);
+		return (0);
+	}
+	if (flags & MOD_PROP_DEFAULT) {
+		if (strlcpy(pval, tcp_cc_newreno.ca_name, psize) >= psize)
+			return (ENOBUFS);
+		return (0);
+	}
+	return (tcp_cc_get_names(stack->netstack_tcp,
+	    (flags & MOD_PROP_POSSIBLE) != 0, pval, psize));
+}
+
 static int
 tcp_set_buf_prop(netstack_t *stack, cred_t *cr, mod_prop_info_t *pinfo,
     const char *ifname, const void *pval, uint_t flags)
@@ -530,6 +572,29 @@ mod_prop_info_t tcp_propinfo_tbl[] = {
 	    {1, ISS_INCR, ISS_INCR},
 	    {ISS_INCR} },
 
+	{ "congestion_control", MOD_PROTO_TCP,
+	    tcp_cc_default_set, tcp_cc_default_get, {0}, {0} },
+
+	{ "_pacing", MOD_PROTO_TCP,
+	    mod_set_boolean, mod_get_boolean,
+	    {B_FALSE}, {B_FALSE} },
+
+	{ "_fastopen", MOD_PROTO_TCP,
+	    mod_set_uint32, mod_get_uint32,
+	    {0, 3, 1}, {1} },
+
+	{ "_fastopen_max_pending", MOD_PROTO_TCP,
+	    mod_set_uint32, mod_get_uint32,
+	    {0, 65536, 1024}, {1024} },
+
+	{ "_tlp", MOD_PROTO_TCP,
+	    mod_set_boolean, mod_get_boolean,
+	    {B_TRUE}, {B_TRUE} },
+
+	{ "_rack", MOD_PROTO_TCP,
+	    mod_set_boolean, mod_get_boolean,
+	    {B_TRUE}, {B_TRUE} },
+
 	{ "?", MOD_PROTO_TCP, NULL, mod_get_allprop, {0}, {0} },
 
 	{ NULL, 0, NULL, NULL, {0}, {0} }
@@ -123,6 +123,36 @@ extern kmem_cache_t *tcp_timercache;
 #define	TCP_TIMER_CANCEL(tcp, id)	\
 	tcp_timeout_cancel(tcp->tcp_connp, id)
 
+/*
+ * A connection is paced if the stack paces all connections or if it has
+ * SO_MAX_PACING_RATE set, see tcp_pace_rate().
+ */
+#define	TCP_PACED(tcp)	\
+	((tcp)->tcp_pace_max != 0 || (tcp)->tcp_tcps->tcps_pacing)
+
+/*
+ * TCP Fast Open (RFC 7413), see tcp_fastopen.c.  The "_fastopen" property
+ * is a mask of TCP_TFO_CLIENT and TCP_TFO_SERVER.  The rest are kept in
+ * tcp_tfo_flags.
+ */
+#define	TCP_TFO_CLIENT		0x01	/* connect may send data on SYN */
+#define	TCP_TFO_SERVER		0x02	/* may accept data on SYN */
+#define	TCP_TFO_LISTEN		0x04	/* TCP_FASTOPEN set on listener */
+#define	TCP_TFO_REQ		0x08	/* send a cookie on our SYN */
+#define	TCP_TFO_COOKIE_OK	0x10	/* eager: peer's cookie is valid */
+#define	TCP_TFO_PENDING		0x20	/* eager: in tcps_tfo_pending */
+#define	TCP_TFO_EARLY		0x40	/* eager: passed up in SYN_RCVD */
+#define	TCP_TFO_DATA		0x80	/* client: our SYN carried data */
+
+#define	TCP_TFO_COOKIE_LEN	8	/* the cookies we hand out */
+#define	TCP_TFO_COOKIE_MIN	4	/* RFC 7413 limits */
+#define	TCP_TFO_COOKIE_MAX	16
+
+/*
+ * Floor of the tail loss probe timeout in millisec, see tcp_tlp_arm().
+ */
+#define	TCP_TLP_MIN		10
+
 /*
  * To restart the TCP retransmission timer.  intvl is in millisec.
  */
@@ -159,6 +189,10 @@ extern kmem_cache_t *tcp_timercache;
  * and conn_netstack.
  * The tcp_t's that are added to tcp_free_list are disassociated and
  * have NULL tcp_tcps and conn_netstack pointers.
+ *
+ * Unless tcp_time_wait_compact is turned off, a connection does not stay
+ * on the list for the whole interval: the collector replaces it with a
+ * much smaller per stack tcp_tw_t, see tcp_time_wait.c.
  */
 typedef struct tcp_squeue_priv_s {
 	kmutex_t	tcp_time_wait_lock;
@@ -279,6 +313,16 @@ typedef struct tcp_squeue_priv_s {
 	else						\
 		(tcp)->tcp_rto = (rto);
 
+/*
+ * Calls into the connection's congestion control algorithm, see <inet/cc.h>.
+ */
+#define	TCP_CC_ACK_RECEIVED(tcp, acked) \
+	(tcp)->tcp_cc_algo->ca_ack_received((tcp), (acked))
+#define	TCP_CC_CONG_SIGNAL(tcp, sig) \
+	(tcp)->tcp_cc_algo->ca_cong_signal((tcp), (sig))
+#define	TCP_CC_POST_RECOVERY(tcp) \
+	(tcp)->tcp_cc_algo->ca_post_recovery(tcp)
+
 /*
  * TCP options struct returned from tcp_parse_options.
  */
@@ -287,6 +331,8 @@ typedef struct tcp_opt_s {
 	uint32_t	tcp_opt_wscale;
 	uint32_t	tcp_opt_ts_val;
 	uint32_t	tcp_opt_ts_ecr;
+	uchar_t		*tcp_opt_tfo_cookie;
+	uint_t		tcp_opt_tfo_len;
 	tcp_t		*tcp;
 } tcp_opt_t;
 
@@ -538,6 +584,11 @@ extern uint32_t tcp_early_abort;
 #define	tcps_dev_flow_ctl		tcps_propinfo_tbl[58].prop_cur_bval
 #define	tcps_reass_timeout		tcps_propinfo_tbl[59].prop_cur_uval
 #define	tcps_iss_incr			tcps_propinfo_tbl[65].prop_cur_uval
+#define	tcps_pacing			tcps_propinfo_tbl[67].prop_cur_bval
+#define	tcps_fastopen			tcps_propinfo_tbl[68].prop_cur_uval
+#define	tcps_fastopen_max_pending	tcps_propinfo_tbl[69].prop_cur_uval
+#define	tcps_tlp			tcps_propinfo_tbl[70].prop_cur_bval
+#define	tcps_rack			tcps_propinfo_tbl[71].prop_cur_bval
 
 extern struct qinit tcp_rinitv4, tcp_rinitv6;
 extern boolean_t do_tcp_fusion;
@@ -603,6 +654,34 @@ extern boolean_t	tcp_zcopy_check(tcp_t *);
 extern void	tcp_zcopy_notify(tcp_t *);
 extern void	tcp_get_proto_props(tcp_t *, struct sock_proto_props *);
 
+/*
+ * Congestion control related functions in tcp_cc.c.
+ */
+extern void	tcp_cc_g_init(void);
+extern void	tcp_cc_g_destroy(void);
+extern void	tcp_cc_stack_init(tcp_stack_t *);
+extern void	tcp_cc_stack_fini(tcp_stack_t *);
+extern void	tcp_cc_attach(tcp_t *, tcp_t *);
+extern void	tcp_cc_detach(tcp_t *);
+extern int	tcp_cc_set(tcp_t *, const char *);
+extern int	tcp_cc_set_default(tcp_stack_t *, const char *);
+extern int	tcp_cc_get_names(tcp_stack_t *, boolean_t, char *, uint_t);
+
+/*
+ * TCP Fast Open related functions in tcp_fastopen.c.
+ */
+extern void	tcp_fastopen_stack_init(tcp_stack_t *);
+extern void	tcp_fastopen_stack_fini(tcp_stack_t *);
+extern void	tcp_fastopen_option(tcp_t *, tcp_opt_t *);
+extern int	tcp_fastopen_syn_opt(tcp_t *, uchar_t *);
+extern void	tcp_fastopen_syn_data(tcp_t *, mblk_t *, tcpha_t *, uint_t);
+extern void	tcp_fastopen_accept(void *, mblk_t *, void *,
+		    ip_recv_attr_t *);
+extern void	tcp_fastopen_done(tcp_t *);
+extern int	tcp_fastopen_stash(conn_t *, mblk_t *);
+extern mblk_t	*tcp_fastopen_connect(tcp_t *);
+extern void	tcp_fastopen_rewind(tcp_t *);
+
 /*
  * Bind related functions in tcp_bind.c
  */
@@ -640,6 +719,8 @@ extern void	tcp_send_data(tcp_t *, mblk_t *);
 extern void	tcp_send_synack(void *, mblk_t *, void *, ip_recv_attr_t *);
 extern void	tcp_shutdown_output(void *, mblk_t *, void *, ip_recv_attr_t *);
 extern void	tcp_ss_rexmit(tcp_t *);
+extern void	tcp_tlp_arm(tcp_t *, clock_t);
+extern void	tcp_tlp_send(tcp_t *);
 extern void	tcp_update_xmit_tail(tcp_t *, uint32_t);
 extern void	tcp_wput(queue_t *, mblk_t *);
 extern void	tcp_wput_data(tcp_t *, mblk_t *, boolean_t);
@@ -659,6 +740,7 @@ extern void	tcp_input_data(void *, mblk_t *, void *, ip_recv_attr_t *);
 extern void	tcp_input_listener_unbound(void *, mblk_t *, void *,
 		    ip_recv_attr_t *);
 extern boolean_t	tcp_paws_check(tcp_t *, tcpha_t *, tcp_opt_t *);
+extern void	tcp_rack_recover(tcp_t *);
 extern uint_t	tcp_rcv_drain(tcp_t *);
 extern void	tcp_rcv_enqueue(tcp_t *, mblk_t *, uint_t, cred_t *);
 extern boolean_t	tcp_verifyicmp(conn_t *, void *, icmph_t *, icmp6_t *,
@@ -671,20 +753,28 @@ extern int	tcp_fallback(sock_lower_handle_t, queue_t *, boolean_t,
 		    so_proto_quiesced_cb_t, sock_quiesce_arg_t *);
 extern boolean_t tcp_newconn_notify(tcp_t *, ip_recv_attr_t *);
 
+/*
+ * SACK related functions in tcp_sack.c.
+ */
+extern boolean_t	tcp_rack_detect(tcp_t *, clock_t *);
+
 /*
  * Timer related functions in tcp_timers.c.
  */
 extern void	tcp_ack_timer(void *);
 extern void	tcp_close_linger_timeout(void *);
 extern void	tcp_keepalive_timer(void *);
+extern void	tcp_pace_timer(void *);
 extern void	tcp_push_timer(void *);
 extern void	tcp_reass_timer(void *);
 extern mblk_t	*tcp_timermp_alloc(int);
 extern void	tcp_timermp_free(tcp_t *);
 extern timeout_id_t tcp_timeout(conn_t *, void (*)(void *), hrtime_t);
+extern timeout_id_t tcp_timeout_ns(conn_t *, void (*)(void *), hrtime_t);
 extern clock_t	tcp_timeout_cancel(conn_t *, timeout_id_t);
 extern void	tcp_timer(void *arg);
 extern void	tcp_timers_stop(tcp_t *);
+extern void	tcp_tlp_timer(void *);
 
 /*
  * TCP TPI related functions in tcp_tpi.c.
@@ -727,6 +817,13 @@ extern void		tcp_time_wait_collector(void *);
 extern boolean_t	tcp_time_wait_remove(tcp_t *, tcp_squeue_priv_t *);
 extern void		tcp_time_wait_processing(tcp_t *, mblk_t *, uint32_t,
 			    uint32_t, int, tcpha_t *, ip_recv_attr_t *);
+extern boolean_t	tcp_time_wait_input(mblk_t *, ip_recv_attr_t *,
+			    ip_stack_t *);
+extern int		tcp_time_wait_connect(tcp_t *);
+extern void		tcp_time_wait_g_init(void);
+extern void		tcp_time_wait_g_destroy(void);
+extern void		tcp_time_wait_stack_init(tcp_stack_t *);
+extern void		tcp_time_wait_stack_fini(tcp_stack_t *);
 
 /*
  * Misc functions in tcp_misc.c.
@@ -46,6 +46,7 @@ typedef struct notsack_blk
 	tcp_seq			begin;
 	tcp_seq			end;
 	uint32_t		sack_cnt; /* Dup SACK count */
+	clock_t			xmit_ts;  /* lbolt when last sent, or 0 */
 } notsack_blk_t;
 
 
@@ -70,12 +71,12 @@ typedef struct
 
 extern void tcp_sack_insert(sack_blk_t *, tcp_seq, tcp_seq, int32_t *);
 extern void tcp_sack_remove(sack_blk_t *, tcp_seq, int32_t *);
-extern void tcp_notsack_insert(notsack_blk_t **, tcp_seq, tcp_seq,
+extern clock_t tcp_notsack_insert(notsack_blk_t **, tcp_seq, tcp_seq,
     int32_t *, uint32_t *);
 extern void tcp_notsack_remove(notsack_blk_t **, tcp_seq, int32_t *,
     uint32_t *);
 extern void tcp_notsack_update(notsack_blk_t **, tcp_seq, tcp_seq,
-    int32_t *, uint32_t *);
+    int32_t *, uint32_t *, clock_t);
 
 /* Defined in tcp_sack.c */
 extern kmem_cache_t	*tcp_notsack_blk_cache;
@@ -114,6 +114,36 @@ struct tcp_stack {
 	kmutex_t	tcps_listener_conf_lock;
 	list_t		tcps_listener_conf;
 
+	/*
+	 * Congestion control algorithm given to new connections.  Holds a
+	 * reference on the algorithm; protected by tcp_cc_lock.
+	 */
+	struct cc_algo	*tcps_cc_default;
+
+	/*
+	 * Compact TIME_WAIT entries, see tcp_time_wait.c.  tcps_tw_lock
+	 * protects tcps_tw_tid, tcps_tw_now and tcps_tw_closing;
+	 * tcps_tw_count is updated atomically.
+	 */
+	struct tcp_tw_head_s	*tcps_tw_hash;
+	uint_t		tcps_tw_hash_size;
+	struct tcp_tw_head_s	*tcps_tw_wheel;
+	kmutex_t	tcps_tw_lock;
+	timeout_id_t	tcps_tw_tid;
+	int64_t		tcps_tw_now;	/* last second the wheel ran */
+	boolean_t	tcps_tw_closing;
+	uint32_t	tcps_tw_count;
+
+	/*
+	 * TCP Fast Open, see tcp_fastopen.c.  tcps_tfo_key is set up once
+	 * and then only read.  tcps_tfo_lock protects the client's cookie
+	 * cache; tcps_tfo_pending is updated atomically.
+	 */
+	MD5_CTX		tcps_tfo_key;
+	kmutex_t	tcps_tfo_lock;
+	struct tcp_tfo_cache_s	*tcps_tfo_cache;
+	uint32_t	tcps_tfo_pending;
+
 	/*
 	 * Per CPU stats
 	 *
@@ -121,6 +121,15 @@ typedef struct tcp_stat {
 	kstat_named_t	tcp_rst_unsent;
 	kstat_named_t	tcp_reclaim_cnt;
 	kstat_named_t	tcp_reass_timeout;
+	kstat_named_t	tcp_fastopen_cookie_req;
+	kstat_named_t	tcp_fastopen_cookie_bad;
+	kstat_named_t	tcp_fastopen_syn_data;
+	kstat_named_t	tcp_fastopen_pending_drop;
+	kstat_named_t	tcp_fastopen_client_data;
+	kstat_named_t	tcp_fastopen_client_rewind;
+	kstat_named_t	tcp_rack_lost;
+	kstat_named_t	tcp_tlp_probe;
+	kstat_named_t	tcp_tlp_recovered;
 #ifdef TCP_DEBUG_COUNTER
 	kstat_named_t	tcp_time_wait;
 	kstat_named_t	tcp_rput_time_wait;
@@ -177,6 +186,15 @@ typedef struct tcp_stat_counter_s {
 	uint64_t	tcp_rst_unsent;
 	uint64_t	tcp_reclaim_cnt;
 	uint64_t	tcp_reass_timeout;
+	uint64_t	tcp_fastopen_cookie_req;
+	uint64_t	tcp_fastopen_cookie_bad;
+	uint64_t	tcp_fastopen_syn_data;
+	uint64_t	tcp_fastopen_pending_drop;
+	uint64_t	tcp_fastopen_client_data;
+	uint64_t	tcp_fastopen_client_rewind;
+	uint64_t	tcp_rack_lost;
+	uint64_t	tcp_tlp_probe;
+	uint64_t	tcp_tlp_recovered;
 #ifdef TCP_DEBUG_COUNTER
 	uint64_t	tcp_time_wait;
 	uint64_t	tcp_rput_time_wait;
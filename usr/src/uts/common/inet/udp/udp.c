@@ -158,6 +158,7 @@ int		udp_opt_set(conn_t *connp, uint_t optset_context,
 		    void *thisdg_attrs, cred_t *cr);
 int		udp_opt_get(conn_t *connp, int level, int name,
 		    uchar_t *ptr);
+static int	udp_conn_ip_output(conn_t *, mblk_t *, ip_xmit_attr_t *);
 static int	udp_output_connected(conn_t *connp, mblk_t *mp, cred_t *cr,
 		    pid_t pid);
 static int	udp_output_lastdst(conn_t *connp, mblk_t *mp, cred_t *cr,
@@ -1582,6 +1583,11 @@ udp_opt_get(conn_t *connp, t_scalar_t level, t_scalar_t name,
 			*i1 = udp->udp_rcvhdr ? 1 : 0;
 			mutex_exit(&connp->conn_lock);
 			return (sizeof (int));
+		case UDP_SEGMENT:
+			mutex_enter(&connp->conn_lock);
+			*i1 = udp->udp_segsz;
+			mutex_exit(&connp->conn_lock);
+			return (sizeof (int));
 		}
 	}
 	mutex_enter(&connp->conn_lock);
@@ -1717,6 +1723,19 @@ udp_do_opt_set(conn_opt_arg_t *coa, int level, int name,
 			udp->udp_rcvhdr = onoff;
 			mutex_exit(&connp->conn_lock);
 			return (0);
+		case UDP_SEGMENT:
+			/*
+			 * The segment size is the UDP payload of each
+			 * datagram; zero turns segmentation off.
+			 */
+			if (*i1 < 0 || *i1 > IP_MAXPACKET - UDPH_SIZE)
+				return (EINVAL);
+			if (!checkonly) {
+				mutex_enter(&connp->conn_lock);
+				udp->udp_segsz = (uint16_t)*i1;
+				mutex_exit(&connp->conn_lock);
+			}
+			return (0);
 		}
 		break;
 	}
@@ -2856,7 +2875,7 @@ udp_output_ancillary(conn_t *connp, sin_t *sin, sin6_t *sin6, mblk_t *mp,
 	    void_ip_t *, mp->b_rptr, udp_t *, udp, udpha_t *,
 	    &mp->b_rptr[ixa->ixa_ip_hdr_length]);
 
-	error = conn_ip_output(mp, ixa);
+	error = udp_conn_ip_output(connp, mp, ixa);
 	/* No udpOutErrors if an error since IP increases its error counter */
 	switch (error) {
 	case 0:
@@ -2896,6 +2915,137 @@ done:
 	return (error);
 }
 
+/*
+ * Return a chain of dupb()s covering len bytes, starting off bytes into mp.
+ */
+static mblk_t *
+udp_dup_range(mblk_t *mp, uint_t off, uint_t len)
+{
+	mblk_t	*head = NULL;
+	mblk_t	**tailp = &head;
+	mblk_t	*dmp;
+	uint_t	n;
+
+	while (off >= MBLKL(mp)) {
+		off -= MBLKL(mp);
+		mp = mp->b_cont;
+	}
+	while (len > 0) {
+		ASSERT(mp != NULL);
+		n = MIN(MBLKL(mp) - off, len);
+		if (n != 0) {
+			if ((dmp = dupb(mp)) == NULL) {
+				freemsg(head);
+				return (NULL);
+			}
+			dmp->b_rptr += off;
+			dmp->b_wptr = dmp->b_rptr + n;
+			*tailp = dmp;
+			tailp = &dmp->b_cont;
+			len -= n;
+		}
+		off = 0;
+		mp = mp->b_cont;
+	}
+	return (head);
+}
+
+/*
+ * Pass a datagram with its IP and UDP headers in place to IP.  When
+ * UDP_SEGMENT is set and the payload exceeds the segment size, the
+ * datagram is split here into datagrams of that size.  Each one gets a
+ * copy of the headers and shares the payload through dupb(), so the copyin,
+ * route lookup and header construction are done once for the whole send.
+ * IP fills in the ident and finishes the checksum of each datagram.
+ */
+static int
+udp_conn_ip_output(conn_t *connp, mblk_t *mp, ip_xmit_attr_t *ixa)
+{
+	udp_t		*udp = connp->conn_udp;
+	udp_stack_t	*us = udp->udp_us;
+	uint_t		segsz = udp->udp_segsz;
+	uint_t		ip_hdr_length = ixa->ixa_ip_hdr_length;
+	uint_t		hdrlen, paylen, seglen, ulen, off;
+	uint16_t	ulen0, cksum0;
+	uint32_t	cksum;
+	udpha_t		*udpha;
+	mblk_t		*nmp;
+	int		error = 0;
+	int		serror;
+
+	hdrlen = ip_hdr_length + UDPH_SIZE;
+	if (udp->udp_nat_t_endpoint)
+		hdrlen += sizeof (uint32_t);
+	if (segsz == 0 || ixa->ixa_pktlen <= hdrlen + segsz)
+		return (conn_ip_output(mp, ixa));
+
+	/* The prepend routines leave all the headers in the first mblk */
+	ASSERT(MBLKL(mp) >= hdrlen);
+	UDP_STAT(us, udp_out_segmented);
+
+	udpha = (udpha_t *)(mp->b_rptr + ip_hdr_length);
+	ulen0 = ntohs(udpha->uha_length);
+	cksum0 = ntohs(udpha->uha_checksum);
+	paylen = ixa->ixa_pktlen - hdrlen;
+
+	for (off = 0; off < paylen; off += seglen) {
+		seglen = MIN(segsz, paylen - off);
+		nmp = allocb(hdrlen + us->us_wroff_extra, BPRI_MED);
+		if (nmp == NULL) {
+			error = ENOMEM;
+			break;
+		}
+		nmp->b_rptr += us->us_wroff_extra;
+		nmp->b_wptr = nmp->b_rptr + hdrlen;
+		bcopy(mp->b_rptr, nmp->b_rptr, hdrlen);
+		if ((nmp->b_cont = udp_dup_range(mp, hdrlen + off,
+		    seglen)) == NULL) {
+			freeb(nmp);
+			error = ENOMEM;
+			break;
+		}
+
+		ulen = hdrlen - ip_hdr_length + seglen;
+		udpha = (udpha_t *)(nmp->b_rptr + ip_hdr_length);
+		udpha->uha_length = htons(ulen);
+		if (cksum0 != 0) {
+			/*
+			 * uha_checksum carries the pseudo header sum for IP;
+			 * swap the original length in it for ours.
+			 */
+			cksum = cksum0 + (~ulen0 & 0xFFFF) + ulen;
+			cksum = (cksum >> 16) + (cksum & 0xFFFF);
+			cksum = (cksum >> 16) + (cksum & 0xFFFF);
+			udpha->uha_checksum = htons(cksum);
+		}
+		ixa->ixa_pktlen = hdrlen + seglen;
+		if (ixa->ixa_flags & IXAF_IS_IPV4) {
+			((ipha_t *)nmp->b_rptr)->ipha_length =
+			    htons(ixa->ixa_pktlen);
+		} else {
+			((ip6_t *)nmp->b_rptr)->ip6_plen =
+			    htons(ixa->ixa_pktlen - IPV6_HDR_LEN);
+		}
+
+		/* The caller counted the first datagram */
+		if (off != 0)
+			UDPS_BUMP_MIB(us, udpHCOutDatagrams);
+
+		serror = conn_ip_output(nmp, ixa);
+		if (serror == EWOULDBLOCK) {
+			/* Sent, but flow controlled; finish the send */
+			error = serror;
+		} else if (serror != 0) {
+			error = serror;
+			break;
+		}
+	}
+	if (error == ENOMEM)
+		UDPS_BUMP_MIB(us, udpOutErrors);
+	freemsg(mp);
+	return (error);
+}
+
 /*
  * Handle sending an M_DATA for a connected socket.
  * Handles both IPv4 and IPv6.
@@ -3010,7 +3160,7 @@ udp_output_connected(conn_t *connp, mblk_t *mp, cred_t *cr, pid_t pid)
 	    void_ip_t *, mp->b_rptr, udp_t *, udp, udpha_t *,
 	    &mp->b_rptr[ixa->ixa_ip_hdr_length]);
 
-	error = conn_ip_output(mp, ixa);
+	error = udp_conn_ip_output(connp, mp, ixa);
 	/* No udpOutErrors if an error since IP increases its error counter */
 	switch (error) {
 	case 0:
@@ -3140,7 +3290,7 @@ udp_output_lastdst(conn_t *connp, mblk_t *mp, cred_t *cr, pid_t pid,
 	    void_ip_t *, mp->b_rptr, udp_t *, udp, udpha_t *,
 	    &mp->b_rptr[ixa->ixa_ip_hdr_length]);
 
-	error = conn_ip_output(mp, ixa);
+	error = udp_conn_ip_output(connp, mp, ixa);
 	/* No udpOutErrors if an error since IP increases its error counter */
 	switch (error) {
 	case 0:
@@ -3949,7 +4099,7 @@ udp_output_newdst(conn_t *connp, mblk_t *data_mp, sin_t *sin, sin6_t *sin6,
 	    void_ip_t *, data_mp->b_rptr, udp_t *, udp, udpha_t *,
 	    &data_mp->b_rptr[ixa->ixa_ip_hdr_length]);
 
-	error = conn_ip_output(data_mp, ixa);
+	error = udp_conn_ip_output(connp, data_mp, ixa);
 	/* No udpOutErrors if an error since IP increases its error counter */
 	switch (error) {
 	case 0:
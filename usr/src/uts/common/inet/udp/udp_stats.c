@@ -396,6 +396,7 @@ udp_kstat2_init(netstackid_t stackid)
 		{ "udp_out_err_notconn",	KSTAT_DATA_UINT64 },
 		{ "udp_out_err_output",		KSTAT_DATA_UINT64 },
 		{ "udp_out_err_tudr",		KSTAT_DATA_UINT64 },
+		{ "udp_out_segmented",		KSTAT_DATA_UINT64 },
 #ifdef DEBUG
 		{ "udp_data_conn",		KSTAT_DATA_UINT64 },
 		{ "udp_data_notconn",		KSTAT_DATA_UINT64 },
@@ -443,6 +444,7 @@ udp_add_stats(udp_stat_counter_t *from, udp_stat_t *to)
 	to->udp_out_err_notconn.value.ui64 += from->udp_out_err_notconn;
 	to->udp_out_err_output.value.ui64 += from->udp_out_err_output;
 	to->udp_out_err_tudr.value.ui64 += from->udp_out_err_tudr;
+	to->udp_out_segmented.value.ui64 += from->udp_out_segmented;
 #ifdef DEBUG
 	to->udp_data_conn.value.ui64 += from->udp_data_conn;
 	to->udp_data_notconn.value.ui64 += from->udp_data_notconn;
@@ -465,6 +467,7 @@ udp_clr_stats(udp_stat_t *stats)
 	stats->udp_out_err_notconn.value.ui64 = 0;
 	stats->udp_out_err_output.value.ui64 = 0;
 	stats->udp_out_err_tudr.value.ui64 = 0;
+	stats->udp_out_segmented.value.ui64 = 0;
 #ifdef DEBUG
 	stats->udp_data_conn.value.ui64 = 0;
 	stats->udp_data_notconn.value.ui64 = 0;
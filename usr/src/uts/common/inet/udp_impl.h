@@ -77,6 +77,7 @@ typedef struct udp_stat {			/* Class "net" kstats */
 	kstat_named_t	udp_out_err_notconn;
 	kstat_named_t	udp_out_err_output;
 	kstat_named_t	udp_out_err_tudr;
+	kstat_named_t	udp_out_segmented;
 #ifdef DEBUG
 	kstat_named_t	udp_data_conn;
 	kstat_named_t	udp_data_notconn;
@@ -98,6 +99,7 @@ typedef struct {
 	uint64_t	udp_out_err_notconn;
 	uint64_t	udp_out_err_output;
 	uint64_t	udp_out_err_tudr;
+	uint64_t	udp_out_segmented;
 #ifdef DEBUG
 	uint64_t	udp_data_conn;
 	uint64_t	udp_data_notconn;
@@ -181,6 +183,8 @@ typedef	struct udp_s {
 
 		udp_pad_to_bit_31 : 29;
 
+	uint16_t	udp_segsz;	/* UDP_SEGMENT payload size, or 0 */
+
 	/* Following 2 fields protected by the uf_lock */
 	struct udp_s	*udp_bind_hash; /* Bind hash chain */
 	struct udp_s	**udp_ptpbhn; /* Pointer to previous bind hash next. */
@@ -112,6 +112,7 @@ aggr_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 		aggr_dip = dip;
 		aggr_port_init();
 		aggr_grp_init();
+		aggr_send_init();
 		aggr_lacp_init();
 		return (DDI_SUCCESS);
 
@@ -135,6 +136,7 @@ aggr_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
 		aggr_dip = NULL;
 		aggr_port_fini();
 		aggr_grp_fini();
+		aggr_send_fini();
 		aggr_lacp_fini();
 		aggr_ioc_fini();
 		return (DDI_SUCCESS);
@@ -173,7 +173,6 @@ aggr_grp_constructor(void *buf, void *arg, int kmflag)
 	bzero(grp, sizeof (*grp));
 	mutex_init(&grp->lg_lacp_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&grp->lg_lacp_cv, NULL, CV_DEFAULT, NULL);
-	rw_init(&grp->lg_tx_lock, NULL, RW_DRIVER, NULL);
 	mutex_init(&grp->lg_port_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&grp->lg_port_cv, NULL, CV_DEFAULT, NULL);
 	mutex_init(&grp->lg_tx_flowctl_lock, NULL, MUTEX_DEFAULT, NULL);
@@ -188,16 +187,12 @@ aggr_grp_destructor(void *buf, void *arg)
 {
 	aggr_grp_t *grp = buf;
 
-	if (grp->lg_tx_ports != NULL) {
-		kmem_free(grp->lg_tx_ports,
-		    grp->lg_tx_ports_size * sizeof (aggr_port_t *));
-	}
+	ASSERT(grp->lg_tx_ports == NULL);
 
 	mutex_destroy(&grp->lg_lacp_lock);
 	cv_destroy(&grp->lg_lacp_cv);
 	mutex_destroy(&grp->lg_port_lock);
 	cv_destroy(&grp->lg_port_cv);
-	rw_destroy(&grp->lg_tx_lock);
 	mutex_destroy(&grp->lg_tx_flowctl_lock);
 	cv_destroy(&grp->lg_tx_flowctl_cv);
 }
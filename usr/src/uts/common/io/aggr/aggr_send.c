@@ -37,6 +37,9 @@
 #include <sys/strsun.h>
 #include <sys/strsubr.h>
 #include <sys/dlpi.h>
+#include <sys/atomic.h>
+#include <sys/cpuvar.h>
+#include <sys/disp.h>
 
 #include <inet/common.h>
 #include <inet/led.h>
@@ -48,6 +51,59 @@
 #include <sys/aggr.h>
 #include <sys/aggr_impl.h>
 
+/*
+ * aggr_find_tx_ring() runs for every packet chain sent on every CPU, so it
+ * doesn't take a group lock to look at the Tx ports.  Instead it announces
+ * itself in its CPU's counter, with preemption disabled, and reads the
+ * group's current aggr_tx_ports_t.  The port set only changes under the
+ * mac perimeter, which publishes a new aggr_tx_ports_t and waits until no
+ * CPU is in aggr_find_tx_ring() before freeing the old one.
+ */
+typedef struct aggr_tx_cpu_s {
+	volatile uint_t	atc_active;
+	char		atc_pad[64 - sizeof (uint_t)];
+} aggr_tx_cpu_t;
+
+static aggr_tx_cpu_t *aggr_tx_cpu;
+
+void
+aggr_send_init(void)
+{
+	aggr_tx_cpu = kmem_zalloc(max_ncpus * sizeof (aggr_tx_cpu_t),
+	    KM_SLEEP);
+}
+
+void
+aggr_send_fini(void)
+{
+	kmem_free(aggr_tx_cpu, max_ncpus * sizeof (aggr_tx_cpu_t));
+	aggr_tx_cpu = NULL;
+}
+
+/*
+ * Publish a new set of Tx ports for the group and free the old one once
+ * aggr_find_tx_ring() can no longer be looking at it.
+ */
+static void
+aggr_send_set_ports(aggr_grp_t *grp, aggr_tx_ports_t *ports)
+{
+	aggr_tx_ports_t *oports = grp->lg_tx_ports;
+	int i;
+
+	membar_producer();
+	grp->lg_tx_ports = ports;
+	grp->lg_ntx_ports = (ports != NULL) ? ports->atp_nports : 0;
+	if (oports == NULL)
+		return;
+
+	membar_enter();
+	for (i = 0; i < max_ncpus; i++) {
+		while (aggr_tx_cpu[i].atc_active != 0)
+			delay(1);
+	}
+	kmem_free(oports, AGGR_TX_PORTS_SIZE(oports->atp_nports));
+}
+
 /*
  * Update the TX load balancing policy of the specified group.
  */
@@ -80,21 +136,29 @@ mblk_t *
 aggr_find_tx_ring(void *arg, mblk_t *mp, uintptr_t hint, mac_ring_handle_t *rh)
 {
 	aggr_grp_t *grp = arg;
+	aggr_tx_ports_t *ports;
+	aggr_tx_cpu_t *atc;
 	aggr_port_t *port;
 	uint64_t hash;
 
-	rw_enter(&grp->lg_tx_lock, RW_READER);
-	if (grp->lg_ntx_ports == 0) {
+	kpreempt_disable();
+	atc = &aggr_tx_cpu[CPU->cpu_seqid];
+	atomic_inc_uint(&atc->atc_active);
+	membar_enter();
+
+	if ((ports = grp->lg_tx_ports) == NULL) {
 		/*
 		 * We could have returned from aggr_m_start() before
 		 * the ports were actually attached. Drop the chain.
 		 */
-		rw_exit(&grp->lg_tx_lock);
+		membar_exit();
+		atomic_dec_uint(&atc->atc_active);
+		kpreempt_enable();
 		freemsgchain(mp);
 		return (NULL);
 	}
 	hash = mac_pkt_hash(DL_ETHER, mp, grp->lg_mac_tx_policy, B_TRUE);
-	port = grp->lg_tx_ports[hash % grp->lg_ntx_ports];
+	port = ports->atp_ports[hash % ports->atp_nports];
 
 	/*
 	 * Use hash as the hint so to direct traffic to
@@ -114,7 +178,10 @@ aggr_find_tx_ring(void *arg, mblk_t *mp, uintptr_t hint, mac_ring_handle_t *rh)
 	} else {
 		*rh = port->lp_pseudo_tx_rings[0];
 	}
-	rw_exit(&grp->lg_tx_lock);
+
+	membar_exit();
+	atomic_dec_uint(&atc->atc_active);
+	kpreempt_enable();
 
 	return (mp);
 }
@@ -235,6 +302,8 @@ void
 aggr_send_port_enable(aggr_port_t *port)
 {
 	aggr_grp_t *grp = port->lp_grp;
+	aggr_tx_ports_t *oports, *ports;
+	uint_t n;
 
 	ASSERT(MAC_PERIM_HELD(grp->lg_mh));
 
@@ -247,31 +316,14 @@ aggr_send_port_enable(aggr_port_t *port)
 	/*
 	 * Add to group's array of tx ports.
 	 */
-	rw_enter(&grp->lg_tx_lock, RW_WRITER);
-	if (grp->lg_tx_ports_size < grp->lg_ntx_ports+1) {
-		/* current array too small */
-		aggr_port_t **new_ports;
-		uint_t new_size;
-
-		new_size = grp->lg_ntx_ports+1;
-		new_ports = kmem_zalloc(new_size * sizeof (aggr_port_t *),
-		    KM_SLEEP);
-
-		if (grp->lg_tx_ports_size > 0) {
-			ASSERT(grp->lg_tx_ports != NULL);
-			bcopy(grp->lg_tx_ports, new_ports,
-			    grp->lg_ntx_ports * sizeof (aggr_port_t *));
-			kmem_free(grp->lg_tx_ports,
-			    grp->lg_tx_ports_size * sizeof (aggr_port_t *));
-		}
-
-		grp->lg_tx_ports = new_ports;
-		grp->lg_tx_ports_size = new_size;
-	}
-
-	grp->lg_tx_ports[grp->lg_ntx_ports++] = port;
-	port->lp_tx_idx = grp->lg_ntx_ports-1;
-	rw_exit(&grp->lg_tx_lock);
+	oports = grp->lg_tx_ports;
+	n = (oports != NULL) ? oports->atp_nports : 0;
+	ports = kmem_alloc(AGGR_TX_PORTS_SIZE(n + 1), KM_SLEEP);
+	if (n > 0)
+		bcopy(oports->atp_ports, ports->atp_ports, n * sizeof (port));
+	ports->atp_ports[n] = port;
+	ports->atp_nports = n + 1;
+	aggr_send_set_ports(grp, ports);
 
 	port->lp_tx_enabled = B_TRUE;
 }
@@ -282,8 +334,9 @@ aggr_send_port_enable(aggr_port_t *port)
 void
 aggr_send_port_disable(aggr_port_t *port)
 {
-	uint_t idx, ntx;
 	aggr_grp_t *grp = port->lp_grp;
+	aggr_tx_ports_t *oports, *ports;
+	uint_t i, n;
 
 	ASSERT(MAC_PERIM_HELD(grp->lg_mh));
 	ASSERT(MAC_PERIM_HELD(port->lp_mh));
@@ -293,27 +346,23 @@ aggr_send_port_disable(aggr_port_t *port)
 		return;
 	}
 
-	rw_enter(&grp->lg_tx_lock, RW_WRITER);
-	idx = port->lp_tx_idx;
-	ntx = grp->lg_ntx_ports;
-	ASSERT(idx < ntx);
-
 	/* remove from array of attached ports */
-	if (idx == (ntx - 1)) {
-		grp->lg_tx_ports[idx] = NULL;
+	oports = grp->lg_tx_ports;
+	ASSERT(oports != NULL);
+	if (oports->atp_nports == 1) {
+		ASSERT(oports->atp_ports[0] == port);
+		ports = NULL;
 	} else {
-		/* not the last entry, replace with last one */
-		aggr_port_t *victim;
-
-		victim = grp->lg_tx_ports[ntx - 1];
-		grp->lg_tx_ports[ntx - 1] = NULL;
-		victim->lp_tx_idx = idx;
-		grp->lg_tx_ports[idx] = victim;
+		ports = kmem_alloc(AGGR_TX_PORTS_SIZE(oports->atp_nports - 1),
+		    KM_SLEEP);
+		for (i = 0, n = 0; i < oports->atp_nports; i++) {
+			if (oports->atp_ports[i] != port)
+				ports->atp_ports[n++] = oports->atp_ports[i];
+		}
+		ASSERT(n == oports->atp_nports - 1);
+		ports->atp_nports = n;
 	}
-
-	port->lp_tx_idx = 0;
-	grp->lg_ntx_ports--;
-	rw_exit(&grp->lg_tx_lock);
+	aggr_send_set_ports(grp, ports);
 
 	port->lp_tx_enabled = B_FALSE;
 }
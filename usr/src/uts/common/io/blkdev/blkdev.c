@@ -49,6 +49,7 @@
 #include <sys/ddi.h>
 #include <sys/sunddi.h>
 #include <sys/note.h>
+#include <sys/cpuvar.h>
 #include <sys/blkdev.h>
 
 #define	BD_MAXPART	64
@@ -58,11 +59,27 @@
 typedef struct bd bd_t;
 typedef struct bd_xfer_impl bd_xfer_impl_t;
 
+/*
+ * Transfers wait and run on one of d_qcount queues, each with a lock of
+ * its own, picked by the CPU they are submitted on, so that CPUs issuing
+ * I/O to the same device don't contend with each other.  Each queue
+ * stands for one submission queue of the driver, which learns the one to
+ * use from x_qnum, and may have up to d_qsize transfers running.  The
+ * queue's statistics are folded into the device kstat when it is read.
+ */
+typedef struct bd_queue {
+	kmutex_t	q_iomutex;
+	uint32_t	q_qactive;
+	list_t		q_runq;
+	list_t		q_waitq;
+	kstat_io_t	q_kstat;
+} bd_queue_t;
+
 struct bd {
 	void		*d_private;
 	dev_info_t	*d_dip;
 	kmutex_t	d_ocmutex;
-	kmutex_t	d_iomutex;
+	kmutex_t	d_ksmutex;
 	kmutex_t	d_statemutex;
 	kcondvar_t	d_statecv;
 	enum dkio_state	d_state;
@@ -71,18 +88,16 @@ struct bd {
 	uint64_t	d_open_excl;	/* bit mask indexed by partition */
 	uint64_t	d_open_reg[OTYPCNT];		/* bit mask */
 
+	uint32_t	d_qcount;
 	uint32_t	d_qsize;
-	uint32_t	d_qactive;
+	bd_queue_t	*d_queues;
 	uint32_t	d_maxxfer;
 	uint32_t	d_blkshift;
 	uint64_t	d_numblks;
 	ddi_devid_t	d_devid;
 
 	kmem_cache_t	*d_cache;
-	list_t		d_runq;
-	list_t		d_waitq;
 	kstat_t		*d_ksp;
-	kstat_io_t	*d_kiop;
 
 	boolean_t	d_rdonly;
 	boolean_t	d_ssd;
@@ -110,6 +125,7 @@ struct bd_xfer_impl {
 	bd_xfer_t	i_public;
 	list_node_t	i_linkage;
 	bd_t		*i_bd;
+	bd_queue_t	*i_queue;
 	buf_t		*i_bp;
 	uint_t		i_num_win;
 	uint_t		i_cur_win;
@@ -127,6 +143,7 @@ struct bd_xfer_impl {
 #define	i_nblks		i_public.x_nblks
 #define	i_blkno		i_public.x_blkno
 #define	i_flags		i_public.x_flags
+#define	i_qnum		i_public.x_qnum
 
 
 /*
@@ -154,12 +171,16 @@ static int bd_tg_rdwr(dev_info_t *, uchar_t, void *, diskaddr_t, size_t,
 static int bd_tg_getinfo(dev_info_t *, int, void *, void *);
 static int bd_xfer_ctor(void *, void *, int);
 static void bd_xfer_dtor(void *, void *);
-static void bd_sched(bd_t *);
+static void bd_queues_init(bd_t *);
+static void bd_queues_fini(bd_t *);
+static int bd_kstat_update(kstat_t *, int);
+static void bd_sched(bd_t *, bd_queue_t *);
 static void bd_submit(bd_t *, bd_xfer_impl_t *);
 static void bd_runq_exit(bd_xfer_impl_t *, int);
 static void bd_update_state(bd_t *);
 static int bd_check_state(bd_t *, enum dkio_state *);
 static int bd_flush_write_cache(bd_t *, struct dk_callback *);
+static int bd_free_space(bd_t *, minor_t, dkioc_free_t *);
 
 struct cmlb_tg_ops bd_tg_ops = {
 	TG_DK_OPS_VERSION_1,
@@ -362,15 +383,22 @@ bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	hdl->h_bd = bd;
 	ddi_set_driver_private(dip, bd);
 
-	mutex_init(&bd->d_iomutex, NULL, MUTEX_DRIVER, NULL);
+	bzero(&drive, sizeof (drive));
+	bd->d_ops.o_drive_info(bd->d_private, &drive);
+	bd->d_qsize = drive.d_qsize;
+	bd->d_qcount = drive.d_qcount;
+	bd->d_removable = drive.d_removable;
+	bd->d_hotpluggable = drive.d_hotpluggable;
+
+	if (drive.d_maxxfer && drive.d_maxxfer < bd->d_maxxfer)
+		bd->d_maxxfer = drive.d_maxxfer;
+
+	mutex_init(&bd->d_ksmutex, NULL, MUTEX_DRIVER, NULL);
 	mutex_init(&bd->d_ocmutex, NULL, MUTEX_DRIVER, NULL);
 	mutex_init(&bd->d_statemutex, NULL, MUTEX_DRIVER, NULL);
 	cv_init(&bd->d_statecv, NULL, CV_DRIVER, NULL);
 
-	list_create(&bd->d_waitq, sizeof (bd_xfer_impl_t),
-	    offsetof(struct bd_xfer_impl, i_linkage));
-	list_create(&bd->d_runq, sizeof (bd_xfer_impl_t),
-	    offsetof(struct bd_xfer_impl, i_linkage));
+	bd_queues_init(bd);
 
 	bd->d_cache = kmem_cache_create(kcache, sizeof (bd_xfer_impl_t), 8,
 	    bd_xfer_ctor, bd_xfer_dtor, NULL, bd, NULL, 0);
@@ -378,32 +406,16 @@ bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	bd->d_ksp = kstat_create(ddi_driver_name(dip), inst, NULL, "disk",
 	    KSTAT_TYPE_IO, 1, KSTAT_FLAG_PERSISTENT);
 	if (bd->d_ksp != NULL) {
-		bd->d_ksp->ks_lock = &bd->d_iomutex;
+		bd->d_ksp->ks_lock = &bd->d_ksmutex;
+		bd->d_ksp->ks_update = bd_kstat_update;
+		bd->d_ksp->ks_private = bd;
 		kstat_install(bd->d_ksp);
-		bd->d_kiop = bd->d_ksp->ks_data;
-	} else {
-		/*
-		 * Even if we cannot create the kstat, we create a
-		 * scratch kstat.  The reason for this is to ensure
-		 * that we can update the kstat all of the time,
-		 * without adding an extra branch instruction.
-		 */
-		bd->d_kiop = kmem_zalloc(sizeof (kstat_io_t), KM_SLEEP);
 	}
 
 	cmlb_alloc_handle(&bd->d_cmlbh);
 
 	bd->d_state = DKIO_NONE;
 
-	bzero(&drive, sizeof (drive));
-	bd->d_ops.o_drive_info(bd->d_private, &drive);
-	bd->d_qsize = drive.d_qsize;
-	bd->d_removable = drive.d_removable;
-	bd->d_hotpluggable = drive.d_hotpluggable;
-
-	if (drive.d_maxxfer && drive.d_maxxfer < bd->d_maxxfer)
-		bd->d_maxxfer = drive.d_maxxfer;
-
 
 	rv = cmlb_attach(dip, &bd_tg_ops, DTYPE_DIRECT,
 	    bd->d_removable, bd->d_hotpluggable,
@@ -411,19 +423,16 @@ bd_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
 	    CMLB_FAKE_LABEL_ONE_PARTITION, bd->d_cmlbh, 0);
 	if (rv != 0) {
 		cmlb_free_handle(&bd->d_cmlbh);
-		kmem_cache_destroy(bd->d_cache);
-		mutex_destroy(&bd->d_iomutex);
-		mutex_destroy(&bd->d_ocmutex);
-		mutex_destroy(&bd->d_statemutex);
-		cv_destroy(&bd->d_statecv);
-		list_destroy(&bd->d_waitq);
-		list_destroy(&bd->d_runq);
 		if (bd->d_ksp != NULL) {
 			kstat_delete(bd->d_ksp);
 			bd->d_ksp = NULL;
-		} else {
-			kmem_free(bd->d_kiop, sizeof (kstat_io_t));
 		}
+		kmem_cache_destroy(bd->d_cache);
+		bd_queues_fini(bd);
+		mutex_destroy(&bd->d_ksmutex);
+		mutex_destroy(&bd->d_ocmutex);
+		mutex_destroy(&bd->d_statemutex);
+		cv_destroy(&bd->d_statecv);
 		ddi_soft_state_free(bd_state, inst);
 		return (DDI_FAILURE);
 	}
@@ -479,24 +488,97 @@ bd_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
 	if (bd->d_ksp != NULL) {
 		kstat_delete(bd->d_ksp);
 		bd->d_ksp = NULL;
-	} else {
-		kmem_free(bd->d_kiop, sizeof (kstat_io_t));
 	}
 	cmlb_detach(bd->d_cmlbh, 0);
 	cmlb_free_handle(&bd->d_cmlbh);
 	if (bd->d_devid)
 		ddi_devid_free(bd->d_devid);
 	kmem_cache_destroy(bd->d_cache);
-	mutex_destroy(&bd->d_iomutex);
+	bd_queues_fini(bd);
+	mutex_destroy(&bd->d_ksmutex);
 	mutex_destroy(&bd->d_ocmutex);
 	mutex_destroy(&bd->d_statemutex);
 	cv_destroy(&bd->d_statecv);
-	list_destroy(&bd->d_waitq);
-	list_destroy(&bd->d_runq);
 	ddi_soft_state_free(bd_state, ddi_get_instance(dip));
 	return (DDI_SUCCESS);
 }
 
+static void
+bd_queues_init(bd_t *bd)
+{
+	bd_queue_t	*q;
+	uint32_t	i;
+
+	/*
+	 * Queues beyond one per CPU would never be used.
+	 */
+	bd->d_qcount = MAX(1, MIN(bd->d_qcount, max_ncpus));
+	bd->d_queues = kmem_zalloc(bd->d_qcount * sizeof (bd_queue_t),
+	    KM_SLEEP);
+
+	for (i = 0; i < bd->d_qcount; i++) {
+		q = &bd->d_queues[i];
+		mutex_init(&q->q_iomutex, NULL, MUTEX_DRIVER, NULL);
+		list_create(&q->q_waitq, sizeof (bd_xfer_impl_t),
+		    offsetof(struct bd_xfer_impl, i_linkage));
+		list_create(&q->q_runq, sizeof (bd_xfer_impl_t),
+		    offsetof(struct bd_xfer_impl, i_linkage));
+	}
+}
+
+static void
+bd_queues_fini(bd_t *bd)
+{
+	bd_queue_t	*q;
+	uint32_t	i;
+
+	for (i = 0; i < bd->d_qcount; i++) {
+		q = &bd->d_queues[i];
+		ASSERT(q->q_qactive == 0);
+		list_destroy(&q->q_waitq);
+		list_destroy(&q->q_runq);
+		mutex_destroy(&q->q_iomutex);
+	}
+	kmem_free(bd->d_queues, bd->d_qcount * sizeof (bd_queue_t));
+	bd->d_queues = NULL;
+}
+
+/*
+ * Add up the statistics of all queues.  The device counts as busy, or as
+ * having something waiting, for as long as any one queue does.
+ */
+static int
+bd_kstat_update(kstat_t *ksp, int rw)
+{
+	bd_t		*bd = ksp->ks_private;
+	kstat_io_t	*kio = ksp->ks_data;
+	kstat_io_t	*qkio;
+	uint32_t	i;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	bzero(kio, sizeof (*kio));
+	for (i = 0; i < bd->d_qcount; i++) {
+		mutex_enter(&bd->d_queues[i].q_iomutex);
+		qkio = &bd->d_queues[i].q_kstat;
+		kio->nread += qkio->nread;
+		kio->nwritten += qkio->nwritten;
+		kio->reads += qkio->reads;
+		kio->writes += qkio->writes;
+		kio->wlentime += qkio->wlentime;
+		kio->rlentime += qkio->rlentime;
+		kio->wcnt += qkio->wcnt;
+		kio->rcnt += qkio->rcnt;
+		kio->wtime = MAX(kio->wtime, qkio->wtime);
+		kio->rtime = MAX(kio->rtime, qkio->rtime);
+		kio->wlastupdate = MAX(kio->wlastupdate, qkio->wlastupdate);
+		kio->rlastupdate = MAX(kio->rlastupdate, qkio->rlastupdate);
+		mutex_exit(&bd->d_queues[i].q_iomutex);
+	}
+	return (0);
+}
+
 static int
 bd_xfer_ctor(void *buf, void *arg, int kmflag)
 {
@@ -565,6 +647,7 @@ bd_xfer_alloc(bd_t *bd, struct buf *bp, int (*func)(void *, bd_xfer_t *),
 	xi->i_bp = bp;
 	xi->i_func = func;
 	xi->i_blkno = bp->b_lblkno;
+	xi->i_flags = 0;
 
 	if (bp->b_bcount == 0) {
 		xi->i_len = 0;
@@ -1149,6 +1232,14 @@ bd_ioctl(dev_t dev, int cmd, intptr_t arg, int flag, cred_t *credp, int *rvalp)
 		rv = bd_flush_write_cache(bd, dkc);
 		return (rv);
 	}
+	case DKIOCFREE: {
+		dkioc_free_t	df;
+
+		if (ddi_copyin(ptr, &df, sizeof (df), flag)) {
+			return (EFAULT);
+		}
+		return (bd_free_space(bd, part, &df));
+	}
 
 	default:
 		break;
@@ -1279,20 +1370,45 @@ bd_tg_getinfo(dev_info_t *dip, int cmd, void *arg, void *tg_cookie)
 }
 
 
-static void
-bd_sched(bd_t *bd)
+/*
+ * Move the next waiting transfer to the run queue, if there is room.
+ */
+static bd_xfer_impl_t *
+bd_sched_next(bd_t *bd, bd_queue_t *q)
 {
 	bd_xfer_impl_t	*xi;
+
+	ASSERT(MUTEX_HELD(&q->q_iomutex));
+
+	if (q->q_qactive >= bd->d_qsize ||
+	    (xi = list_remove_head(&q->q_waitq)) == NULL)
+		return (NULL);
+	q->q_qactive++;
+	kstat_waitq_to_runq(&q->q_kstat);
+	list_insert_tail(&q->q_runq, xi);
+	return (xi);
+}
+
+static void
+bd_sched(bd_t *bd, bd_queue_t *q)
+{
+	bd_xfer_impl_t	*xi, *next;
 	struct buf	*bp;
 	int		rv;
 
-	mutex_enter(&bd->d_iomutex);
+	mutex_enter(&q->q_iomutex);
 
-	while ((bd->d_qactive < bd->d_qsize) &&
-	    ((xi = list_remove_head(&bd->d_waitq)) != NULL)) {
-		bd->d_qactive++;
-		kstat_waitq_to_runq(bd->d_kiop);
-		list_insert_tail(&bd->d_runq, xi);
+	/*
+	 * The transfer after the one being submitted is claimed first, so
+	 * that it is certain to follow and the driver can be told so with
+	 * BD_XFER_MORE.
+	 */
+	xi = bd_sched_next(bd, q);
+	while (xi != NULL) {
+		if ((next = bd_sched_next(bd, q)) != NULL)
+			xi->i_flags |= BD_XFER_MORE;
+		else
+			xi->i_flags &= ~BD_XFER_MORE;
 
 		/*
 		 * Submit the job to the driver.  We drop the I/O mutex
@@ -1300,60 +1416,67 @@ bd_sched(bd_t *bd)
 		 * completion routine calls back into us synchronously.
 		 */
 
-		mutex_exit(&bd->d_iomutex);
+		mutex_exit(&q->q_iomutex);
 
 		rv = xi->i_func(bd->d_private, &xi->i_public);
 		if (rv != 0) {
+			mutex_enter(&q->q_iomutex);
+			q->q_qactive--;
+			kstat_runq_exit(&q->q_kstat);
+			list_remove(&q->q_runq, xi);
+			mutex_exit(&q->q_iomutex);
+
 			bp = xi->i_bp;
 			bd_xfer_free(xi);
 			bioerror(bp, rv);
 			biodone(bp);
-
-			mutex_enter(&bd->d_iomutex);
-			bd->d_qactive--;
-			kstat_runq_exit(bd->d_kiop);
-			list_remove(&bd->d_runq, xi);
-		} else {
-			mutex_enter(&bd->d_iomutex);
 		}
+		mutex_enter(&q->q_iomutex);
+		xi = (next != NULL) ? next : bd_sched_next(bd, q);
 	}
 
-	mutex_exit(&bd->d_iomutex);
+	mutex_exit(&q->q_iomutex);
 }
 
 static void
 bd_submit(bd_t *bd, bd_xfer_impl_t *xi)
 {
-	mutex_enter(&bd->d_iomutex);
-	list_insert_tail(&bd->d_waitq, xi);
-	kstat_waitq_enter(bd->d_kiop);
-	mutex_exit(&bd->d_iomutex);
+	bd_queue_t	*q;
+
+	xi->i_qnum = CPU->cpu_seqid % bd->d_qcount;
+	xi->i_queue = q = &bd->d_queues[xi->i_qnum];
 
-	bd_sched(bd);
+	mutex_enter(&q->q_iomutex);
+	list_insert_tail(&q->q_waitq, xi);
+	kstat_waitq_enter(&q->q_kstat);
+	mutex_exit(&q->q_iomutex);
+
+	bd_sched(bd, q);
 }
 
 static void
 bd_runq_exit(bd_xfer_impl_t *xi, int err)
 {
-	bd_t	*bd = xi->i_bd;
-	buf_t	*bp = xi->i_bp;
-
-	mutex_enter(&bd->d_iomutex);
-	bd->d_qactive--;
-	kstat_runq_exit(bd->d_kiop);
-	list_remove(&bd->d_runq, xi);
-	mutex_exit(&bd->d_iomutex);
+	bd_t		*bd = xi->i_bd;
+	bd_queue_t	*q = xi->i_queue;
+	buf_t		*bp = xi->i_bp;
 
+	mutex_enter(&q->q_iomutex);
+	q->q_qactive--;
+	kstat_runq_exit(&q->q_kstat);
+	list_remove(&q->q_runq, xi);
 	if (err == 0) {
 		if (bp->b_flags & B_READ) {
-			bd->d_kiop->reads++;
-			bd->d_kiop->nread += (bp->b_bcount - xi->i_resid);
+			q->q_kstat.reads++;
+			q->q_kstat.nread += (bp->b_bcount - xi->i_resid);
 		} else {
-			bd->d_kiop->writes++;
-			bd->d_kiop->nwritten += (bp->b_bcount - xi->i_resid);
+			q->q_kstat.writes++;
+			q->q_kstat.nwritten += (bp->b_bcount - xi->i_resid);
 		}
 	}
-	bd_sched(bd);
+	mutex_exit(&q->q_iomutex);
+
+	bd_sched(bd, q);
 }
 
 static void
@@ -1509,6 +1632,63 @@ bd_flush_write_cache(bd_t *bd, struct dk_callback *dkc)
 	return (rv);
 }
 
+/*
+ * Tell the device that the blocks in the range (in bytes, relative to the
+ * partition) no longer hold data, e.g. an NVMe deallocate.  Only whole
+ * blocks within the range are freed.  The free is done synchronously.
+ */
+static int
+bd_free_space(bd_t *bd, minor_t part, dkioc_free_t *df)
+{
+	diskaddr_t	pstart;
+	diskaddr_t	psize;
+	diskaddr_t	start;
+	diskaddr_t	end;
+	uint32_t	shift;
+	buf_t		*bp;
+	bd_xfer_impl_t	*xi;
+	int		rv;
+
+	if (bd->d_ops.o_version < BD_OPS_VERSION_1 ||
+	    bd->d_ops.o_free_space == NULL) {
+		return (ENOTSUP);
+	}
+	if (cmlb_partinfo(bd->d_cmlbh, part, &psize, &pstart, NULL, NULL,
+	    0)) {
+		return (ENXIO);
+	}
+
+	shift = bd->d_blkshift;
+	start = P2ROUNDUP(df->df_start, 1ULL << shift) >> shift;
+	end = (df->df_start + df->df_length) >> shift;
+	if (df->df_start + df->df_length < df->df_start || end > psize) {
+		return (EINVAL);
+	}
+	if (start >= end) {
+		return (0);
+	}
+
+	bp = getrbuf(KM_SLEEP);
+	bp->b_resid = 0;
+	bp->b_bcount = 0;
+
+	xi = bd_xfer_alloc(bd, bp, bd->d_ops.o_free_space, KM_SLEEP);
+	if (xi == NULL) {
+		rv = geterror(bp);
+		freerbuf(bp);
+		return (rv);
+	}
+	xi->i_blkno = pstart + start;
+	xi->i_nblks = end - start;
+
+	bd_submit(bd, xi);
+	(void) biowait(bp);
+	rv = geterror(bp);
+	freerbuf(bp);
+
+	return (rv);
+}
+
 /*
  * Nexus support.
  */
@@ -1695,6 +1875,7 @@ bd_xfer_done(bd_xfer_t *xfer, int err)
 	}
 	xi->i_len = len;
 	xi->i_nblks = len >> xi->i_blkshift;
+	xi->i_flags &= ~BD_XFER_MORE;
 
 	/* Submit next window to hardware. */
 	rv = xi->i_func(bd->d_private, &xi->i_public);
@@ -75,6 +75,9 @@
 #include <sys/file.h>
 #include <sys/sysmacros.h>
 #include <sys/zone.h>
+#include <sys/atomic.h>
+#include <sys/mman.h>
+#include <sys/sunddi.h>
 
 #include <sys/socket.h>
 #include <sys/errno.h>
@@ -100,6 +103,13 @@
 #define	mtod(_v, _t)	(_t)((_v)->b_rptr)
 #define	M_LEN(_m)	((_m)->b_wptr - (_m)->b_rptr)
 
+/*
+ * In zero-copy mode each buffer pointer points just past its header.
+ */
+#define	BPF_ZBUF_HDR(_b)	\
+	((struct bpf_zbuf_header *)((caddr_t)(_b) - \
+	sizeof (struct bpf_zbuf_header)))
+
 /*
  * 4096 is too small for FDDI frames. 8192 is too small for gigabit Ethernet
  * jumbos (circa 9k), ATM, or Intel gig/10gig ethernet jumbos (16k).
@@ -113,6 +123,10 @@ typedef void *(*cp_fn_t)(void *, const void *, size_t);
  */
 int bpf_bufsize = BPF_BUFSIZE;
 int bpf_maxbufsize = (16 * 1024 * 1024);
+/*
+ * Limit on the packet space in a BIOCSRING capture ring.
+ */
+size_t bpf_maxringsize = (64 * 1024 * 1024);
 static mod_hash_t *bpf_hash = NULL;
 
 /*
@@ -137,6 +151,8 @@ static kstat_t *bpf_ksp;
  */
 LIST_HEAD(, bpf_d) bpf_list;
 
+extern dev_info_t *bpf_dev_info;
+
 static int	bpf_allocbufs(struct bpf_d *);
 static void	bpf_clear_timeout(struct bpf_d *);
 static void	bpf_deliver(struct bpf_d *, cp_fn_t,
@@ -150,8 +166,14 @@ static int	bpf_setif(struct bpf_d *, char *, int);
 static void	bpf_timed_out(void *);
 static inline void
 		bpf_wakeup(struct bpf_d *);
-static void	catchpacket(struct bpf_d *, uchar_t *, uint_t, uint_t,
+static int	catchpacket(struct bpf_d *, uchar_t *, uint_t, uint_t,
 		    cp_fn_t, struct timeval *);
+static int	catchring(struct bpf_d *, uchar_t *, uint_t, uint_t,
+		    cp_fn_t, struct timeval *);
+static int	bpf_setring(struct bpf_d *, struct bpf_ring_req *);
+static int	bpf_setzbuf(struct bpf_d *, struct bpf_zbuf *);
+static void	bpf_zbuf_handover(struct bpf_d *);
+static void	bpf_zbuf_reclaim(struct bpf_d *);
 static void	reset_d(struct bpf_d *);
 static int	bpf_getdltlist(struct bpf_d *, struct bpf_dltlist *);
 static int	bpf_setdlt(struct bpf_d *, void *);
@@ -421,6 +443,8 @@ bpfilterattach(void)
 
 	LIST_INIT(&bpf_list);
 
+	bpf_jit_init();
+
 	return (0);
 }
 
@@ -443,6 +467,8 @@ bpfilterdetach(void)
 	cv_destroy(&bpf_dlt_waiter);
 	mutex_destroy(&bpf_mtx);
 
+	bpf_jit_fini();
+
 	return (0);
 }
 
@@ -587,6 +613,12 @@ bpfread(dev_t dev, struct uio *uio, cred_t *cred)
 	if ((d->bd_fmode & FREAD) == 0)
 		return (EBADF);
 
+	/*
+	 * Packets are handed over in mapped memory instead, if set up.
+	 */
+	if (d->bd_ring != NULL || d->bd_zbuf)
+		return (EINVAL);
+
 	/*
 	 * Restrict application to use a buffer the same size as
 	 * the kernel buffers.
@@ -688,14 +720,20 @@ static void
 bpf_timed_out(void *arg)
 {
 	struct bpf_d *d = arg;
+	int wakeup = 0;
 
 	mutex_enter(&d->bd_lock);
 	if (d->bd_state == BPF_WAITING) {
 		d->bd_state = BPF_TIMED_OUT;
-		if (d->bd_slen != 0)
+		if (d->bd_slen != 0) {
 			cv_signal(&d->bd_wait);
+			wakeup = 1;
+		}
 	}
 	mutex_exit(&d->bd_lock);
+
+	if (wakeup)
+		pollwakeup(&d->bd_poll, POLLIN | POLLRDNORM);
 }
 
 
@@ -793,13 +831,17 @@ done:
 static void
 reset_d(struct bpf_d *d)
 {
-	if (d->bd_hbuf) {
+	/*
+	 * A zero-copy hold buffer belongs to the reader until it is
+	 * acknowledged.
+	 */
+	if (d->bd_hbuf && !d->bd_zbuf) {
 		/* Free the hold buffer. */
 		d->bd_fbuf = d->bd_hbuf;
 		d->bd_hbuf = 0;
+		d->bd_hlen = 0;
 	}
 	d->bd_slen = 0;
-	d->bd_hlen = 0;
 	d->bd_rcount = 0;
 	d->bd_dcount = 0;
 	d->bd_ccount = 0;
@@ -821,6 +863,9 @@ reset_d(struct bpf_d *d)
  *  BIOCVERSION		Get filter language version.
  *  BIOCGHDRCMPLT	Get "header already complete" flag.
  *  BIOCSHDRCMPLT	Set "header already complete" flag.
+ *  BIOCSRING		Capture into a ring to be mapped with mmap(2).
+ *  BIOCSZBUF		Use zero-copy buffers to be mapped with mmap(2).
+ *  BIOCROTZBUF		Hand over the zero-copy store buffer early.
  */
 /* ARGSUSED */
 int
@@ -883,7 +928,7 @@ bpfioctl(dev_t dev, int cmd, intptr_t addr, int mode, cred_t *cred, int *rval)
 		}
 
 		mutex_enter(&d->bd_lock);
-		if (d->bd_bif != 0) {
+		if (d->bd_bif != 0 || d->bd_zbuf) {
 			error = EINVAL;
 		} else {
 			if (size > bpf_maxbufsize)
@@ -899,6 +944,62 @@ bpfioctl(dev_t dev, int cmd, intptr_t addr, int mode, cred_t *cred, int *rval)
 			error = copyout(&size, (void *)addr, sizeof (size));
 		break;
 
+	/*
+	 * Set up a shared memory capture ring.
+	 */
+	case BIOCSRING:
+		{
+			struct bpf_ring_req req;
+
+			if (ddi_copyin((void *)addr, &req, sizeof (req),
+			    mode) != 0) {
+				error = EFAULT;
+				break;
+			}
+			error = bpf_setring(d, &req);
+			if (error == 0 && ddi_copyout(&req, (void *)addr,
+			    sizeof (req), mode) != 0)
+				error = EFAULT;
+			break;
+		}
+
+	/*
+	 * Switch to zero-copy buffers.
+	 */
+	case BIOCSZBUF:
+		{
+			struct bpf_zbuf zb;
+
+			if (ddi_copyin((void *)addr, &zb, sizeof (zb),
+			    mode) != 0) {
+				error = EFAULT;
+				break;
+			}
+			error = bpf_setzbuf(d, &zb);
+			if (error == 0 && ddi_copyout(&zb, (void *)addr,
+			    sizeof (zb), mode) != 0)
+				error = EFAULT;
+			break;
+		}
+
+	/*
+	 * Hand a partially filled zero-copy store buffer to the reader,
+	 * as a read(2) in immediate mode or after a timeout would.
+	 */
+	case BIOCROTZBUF:
+		mutex_enter(&d->bd_lock);
+		if (!d->bd_zbuf) {
+			error = EINVAL;
+		} else {
+			bpf_zbuf_reclaim(d);
+			if (d->bd_hbuf == 0 && d->bd_slen != 0) {
+				ROTATE_BUFFERS(d);
+				bpf_zbuf_handover(d);
+			}
+		}
+		mutex_exit(&d->bd_lock);
+		break;
+
 	/*
 	 * Set link layer read filter.
 	 */
@@ -1251,8 +1352,9 @@ int
 bpf_setf(struct bpf_d *d, struct bpf_program *fp)
 {
 	struct bpf_insn *fcode, *old;
+	bpf_jit_filter_t jit, oldjit;
 	uint_t flen, size;
-	size_t oldsize;
+	size_t oldsize, jitsize, oldjitsize;
 
 	if (fp->bf_insns == 0) {
 		if (fp->bf_len != 0)
@@ -1260,12 +1362,18 @@ bpf_setf(struct bpf_d *d, struct bpf_program *fp)
 		mutex_enter(&d->bd_lock);
 		old = d->bd_filter;
 		oldsize = d->bd_filter_size;
+		oldjit = d->bd_jit;
+		oldjitsize = d->bd_jit_size;
 		d->bd_filter = 0;
 		d->bd_filter_size = 0;
+		d->bd_jit = NULL;
+		d->bd_jit_size = 0;
 		reset_d(d);
 		mutex_exit(&d->bd_lock);
 		if (old != 0)
 			kmem_free(old, oldsize);
+		if (oldjit != NULL)
+			bpf_jit_free(oldjit, oldjitsize);
 		return (0);
 	}
 	flen = fp->bf_len;
@@ -1278,15 +1386,24 @@ bpf_setf(struct bpf_d *d, struct bpf_program *fp)
 		return (EFAULT);
 
 	if (bpf_validate(fcode, (int)flen)) {
+		jitsize = 0;
+		jit = bpf_jit_compile(fcode, flen, &jitsize);
+
 		mutex_enter(&d->bd_lock);
 		old = d->bd_filter;
 		oldsize = d->bd_filter_size;
+		oldjit = d->bd_jit;
+		oldjitsize = d->bd_jit_size;
 		d->bd_filter = fcode;
 		d->bd_filter_size = size;
+		d->bd_jit = jit;
+		d->bd_jit_size = jitsize;
 		reset_d(d);
 		mutex_exit(&d->bd_lock);
 		if (old != 0)
 			kmem_free(old, oldsize);
+		if (oldjit != NULL)
+			bpf_jit_free(oldjit, oldjitsize);
 
 		return (0);
 	}
@@ -1345,7 +1462,7 @@ bpf_setif(struct bpf_d *d, char *ifname, int namesize)
 	d->bd_inuse = -1;
 	mutex_exit(&d->bd_lock);
 
-	if (d->bd_sbuf == 0)
+	if (d->bd_sbuf == 0 && d->bd_ring == NULL)
 		error = bpf_allocbufs(d);
 
 	if (error == 0) {
@@ -1415,7 +1532,17 @@ bpfchpoll(dev_t dev, short events, int anyyet, short *reventsp,
 		 * An imitation of the FIONREAD ioctl code.
 		 */
 		mutex_enter(&d->bd_lock);
-		if (d->bd_hlen != 0 ||
+		if (d->bd_zbuf)
+			bpf_zbuf_reclaim(d);
+		if (d->bd_ring != NULL) {
+			if (d->bd_ring_head != d->bd_ring->br_tail) {
+				*reventsp |= events & (POLLIN | POLLRDNORM);
+			} else {
+				*reventsp = 0;
+				if (!anyyet)
+					*phpp = &d->bd_poll;
+			}
+		} else if (d->bd_hlen != 0 ||
 		    ((d->bd_immediate || d->bd_state == BPF_TIMED_OUT) &&
 		    d->bd_slen != 0)) {
 			*reventsp |= events & (POLLIN | POLLRDNORM);
@@ -1482,6 +1609,7 @@ bpf_deliver(struct bpf_d *d, cp_fn_t cpfn, void *marg, uint_t pktlen,
 {
 	struct timeval tv;
 	uint_t slen;
+	int wakeup = 0;
 
 	if (!d->bd_seesent && issent)
 		return;
@@ -1491,16 +1619,28 @@ bpf_deliver(struct bpf_d *d, cp_fn_t cpfn, void *marg, uint_t pktlen,
 	 * is important to protect even the outer ones.
 	 */
 	mutex_enter(&d->bd_lock);
-	slen = bpf_filter(d->bd_filter, marg, pktlen, buflen);
+	/*
+	 * Compiled filters only handle packets in a single buffer.
+	 */
+	if (d->bd_jit != NULL && buflen != 0)
+		slen = d->bd_jit(marg, pktlen, buflen);
+	else
+		slen = bpf_filter(d->bd_filter, marg, pktlen, buflen);
 	DTRACE_PROBE5(bpf__packet, struct bpf_if *, d->bd_bif,
 	    struct bpf_d *, d, void *, marg, uint_t, pktlen, uint_t, slen);
 	d->bd_rcount++;
 	ks_stats.kp_receive.value.ui64++;
 	if (slen != 0) {
 		uniqtime(&tv);
-		catchpacket(d, marg, pktlen, slen, cpfn, &tv);
+		if (d->bd_ring != NULL)
+			wakeup = catchring(d, marg, pktlen, slen, cpfn, &tv);
+		else
+			wakeup = catchpacket(d, marg, pktlen, slen, cpfn, &tv);
 	}
 	mutex_exit(&d->bd_lock);
+
+	if (wakeup)
+		pollwakeup(&d->bd_poll, POLLIN | POLLRDNORM);
 }
 
 /*
@@ -1559,7 +1699,7 @@ bpf_itap(void *arg, mblk_t *m, boolean_t issent, uint_t length)
  * bpf_mcpy is passed in to copy mbuf chains.  In the latter case,
  * pkt is really an mbuf.
  */
-static void
+static int
 catchpacket(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
     cp_fn_t cpfn, struct timeval *tv)
 {
@@ -1590,6 +1730,8 @@ catchpacket(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
 		 * Rotate the buffers if we can, then wakeup any
 		 * pending reads.
 		 */
+		if (d->bd_zbuf)
+			bpf_zbuf_reclaim(d);
 		if (d->bd_fbuf == 0) {
 			/*
 			 * We haven't completed the previous read yet,
@@ -1597,9 +1739,11 @@ catchpacket(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
 			 */
 			++d->bd_dcount;
 			ks_stats.kp_dropped.value.ui64++;
-			return;
+			return (0);
 		}
 		ROTATE_BUFFERS(d);
+		if (d->bd_zbuf)
+			bpf_zbuf_handover(d);
 		do_wakeup = 1;
 		curlen = 0;
 	} else if (d->bd_immediate || d->bd_state == BPF_TIMED_OUT) {
@@ -1632,6 +1776,95 @@ catchpacket(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
 	 */
 	if (do_wakeup)
 		bpf_wakeup(d);
+	return (do_wakeup);
+}
+
+/*
+ * Give the hold buffer, just rotated out of the store slot, to the reader
+ * of a zero-copy descriptor.  The length has to be visible before the new
+ * generation number.
+ */
+static void
+bpf_zbuf_handover(struct bpf_d *d)
+{
+	struct bpf_zbuf_header *zh = BPF_ZBUF_HDR(d->bd_hbuf);
+
+	ASSERT(MUTEX_HELD(&d->bd_lock));
+	zh->bzh_kernel_len = d->bd_hlen;
+	membar_producer();
+	zh->bzh_kernel_gen++;
+}
+
+/*
+ * Take the zero-copy hold buffer back as the free buffer once the reader
+ * has acknowledged it by catching bzh_user_gen up with bzh_kernel_gen.
+ */
+static void
+bpf_zbuf_reclaim(struct bpf_d *d)
+{
+	struct bpf_zbuf_header *zh;
+
+	ASSERT(MUTEX_HELD(&d->bd_lock));
+	if (d->bd_hbuf == 0)
+		return;
+	zh = BPF_ZBUF_HDR(d->bd_hbuf);
+	if (zh->bzh_user_gen != zh->bzh_kernel_gen)
+		return;
+	membar_consumer();
+	d->bd_fbuf = d->bd_hbuf;
+	d->bd_hbuf = 0;
+	d->bd_hlen = 0;
+}
+
+/*
+ * The BIOCSRING flavour of catchpacket(): copy the packet into the next
+ * free slot of the shared ring and publish it by advancing br_head.  Only
+ * the reader's br_tail is taken from the ring; everything else comes from
+ * the copies in the descriptor.  Returns 1 if the ring was empty, in which
+ * case the reader may be waiting in poll(2).
+ */
+static int
+catchring(struct bpf_d *d, uchar_t *pkt, uint_t pktlen, uint_t snaplen,
+    cp_fn_t cpfn, struct timeval *tv)
+{
+	struct bpf_ring *ring = d->bd_ring;
+	struct bpf_hdr *hp;
+	uint32_t head, tail;
+	int totlen;
+	int hdrlen = d->bd_hdrlen;
+
+	++d->bd_ccount;
+	ks_stats.kp_capture.value.ui64++;
+
+	head = d->bd_ring_head;
+	tail = ring->br_tail;
+	if (head - tail >= d->bd_ring_nslots) {
+		++d->bd_dcount;
+		ks_stats.kp_dropped.value.ui64++;
+		ring->br_drops = (uint32_t)d->bd_dcount;
+		return (0);
+	}
+
+	totlen = hdrlen + min(snaplen, pktlen);
+	if (totlen > (int)d->bd_ring_slotsize)
+		totlen = d->bd_ring_slotsize;
+
+	hp = (struct bpf_hdr *)((char *)ring + d->bd_ring_slotoff +
+	    (size_t)(head & (d->bd_ring_nslots - 1)) * d->bd_ring_slotsize);
+	hp->bh_tstamp.tv_sec = tv->tv_sec;
+	hp->bh_tstamp.tv_usec = tv->tv_usec;
+	hp->bh_datalen = pktlen;
+	hp->bh_hdrlen = (uint16_t)hdrlen;
+	(*cpfn)((uchar_t *)hp + hdrlen, pkt,
+	    (hp->bh_caplen = totlen - hdrlen));
+
+	/*
+	 * The slot must be visible before the reader can see the new head.
+	 */
+	membar_producer();
+	ring->br_head = d->bd_ring_head = head + 1;
+
+	return (head == tail);
 }
 
 /*
@@ -1665,7 +1898,7 @@ bpf_freed(struct bpf_d *d)
 	 * At this point the descriptor has been detached from its
 	 * interface and it yet hasn't been marked free.
 	 */
-	if (d->bd_sbuf != 0) {
+	if (d->bd_sbuf != 0 && !d->bd_zbuf) {
 		kmem_free(d->bd_sbuf, d->bd_bufsize);
 		if (d->bd_hbuf != 0)
 			kmem_free(d->bd_hbuf, d->bd_bufsize);
@@ -1674,6 +1907,135 @@ bpf_freed(struct bpf_d *d)
 	}
 	if (d->bd_filter)
 		kmem_free(d->bd_filter, d->bd_filter_size);
+	if (d->bd_jit != NULL)
+		bpf_jit_free(d->bd_jit, d->bd_jit_size);
+	if (d->bd_map_cookie != NULL)
+		ddi_umem_free(d->bd_map_cookie);
+}
+
+/*
+ * Allocate the shared memory capture ring for BIOCSRING.  This has to be
+ * done before an interface is attached, and only once: the ring stays
+ * until the descriptor is closed, which cannot happen while it is mapped.
+ */
+static int
+bpf_setring(struct bpf_d *d, struct bpf_ring_req *req)
+{
+	ddi_umem_cookie_t cookie;
+	struct bpf_ring *ring;
+	uint32_t nslots, slotsize, slotoff;
+	size_t size;
+
+	nslots = req->brr_nslots;
+	if (nslots == 0 || !ISP2(nslots))
+		return (EINVAL);
+	if (req->brr_slotsize < BPF_MINBUFSIZE ||
+	    req->brr_slotsize > bpf_maxbufsize)
+		return (EINVAL);
+	slotsize = BPF_WORDALIGN(req->brr_slotsize);
+	if ((uint64_t)nslots * slotsize > bpf_maxringsize)
+		return (ENOBUFS);
+
+	slotoff = P2ROUNDUP(sizeof (struct bpf_ring), 64);
+	size = ptob(btopr(slotoff + (size_t)nslots * slotsize));
+	ring = ddi_umem_alloc(size, DDI_UMEM_SLEEP, &cookie);
+
+	mutex_enter(&d->bd_lock);
+	if (d->bd_bif != 0 || d->bd_ring != NULL || d->bd_sbuf != 0) {
+		mutex_exit(&d->bd_lock);
+		ddi_umem_free(cookie);
+		return (EINVAL);
+	}
+	ring->br_nslots = nslots;
+	ring->br_slotsize = slotsize;
+	ring->br_slotoff = slotoff;
+	d->bd_ring_nslots = nslots;
+	d->bd_ring_slotsize = slotsize;
+	d->bd_ring_slotoff = slotoff;
+	d->bd_ring_head = 0;
+	d->bd_map_size = size;
+	d->bd_map_cookie = cookie;
+	d->bd_ring = ring;
+	mutex_exit(&d->bd_lock);
+
+	req->brr_nslots = nslots;
+	req->brr_slotsize = slotsize;
+	req->brr_mapsize = size;
+	return (0);
+}
+
+/*
+ * Set up zero-copy buffers for BIOCSZBUF.  Like BIOCSBLEN this has to
+ * happen before an interface is attached; the store and free buffers are
+ * carved out of memory the reader maps, rather than allocated on attach.
+ */
+static int
+bpf_setzbuf(struct bpf_d *d, struct bpf_zbuf *zb)
+{
+	ddi_umem_cookie_t cookie;
+	caddr_t base;
+	uint32_t buflen;
+	size_t half;
+
+	if (zb->bz_buflen < BPF_MINBUFSIZE || zb->bz_buflen > bpf_maxbufsize)
+		return (EINVAL);
+	buflen = BPF_WORDALIGN(zb->bz_buflen);
+	half = ptob(btopr(sizeof (struct bpf_zbuf_header) + buflen));
+	base = ddi_umem_alloc(2 * half, DDI_UMEM_SLEEP, &cookie);
+
+	mutex_enter(&d->bd_lock);
+	if (d->bd_bif != 0 || d->bd_sbuf != 0 || d->bd_ring != NULL) {
+		mutex_exit(&d->bd_lock);
+		ddi_umem_free(cookie);
+		return (EINVAL);
+	}
+	d->bd_sbuf = base + sizeof (struct bpf_zbuf_header);
+	d->bd_fbuf = base + half + sizeof (struct bpf_zbuf_header);
+	d->bd_hbuf = 0;
+	d->bd_slen = 0;
+	d->bd_hlen = 0;
+	d->bd_bufsize = buflen;
+	d->bd_zbuf = 1;
+	d->bd_map_size = 2 * half;
+	d->bd_map_cookie = cookie;
+	mutex_exit(&d->bd_lock);
+
+	zb->bz_buflen = buflen;
+	zb->bz_buf1off = half;
+	zb->bz_mapsize = 2 * half;
+	return (0);
+}
+
+/*
+ * Map the BIOCSRING capture ring or the BIOCSZBUF buffers into the
+ * reader's address space.
+ */
+/* ARGSUSED */
+int
+bpfdevmap(dev_t dev, devmap_cookie_t dhp, offset_t off, size_t len,
+    size_t *maplen, uint_t model)
+{
+	struct bpf_d *d = bpf_dev_get(getminor(dev));
+	int error = 0;
+
+	if ((d->bd_fmode & FREAD) == 0)
+		return (EBADF);
+
+	mutex_enter(&d->bd_lock);
+	if (d->bd_map_cookie == NULL) {
+		error = ENXIO;
+	} else if (off < 0 || off + len > d->bd_map_size) {
+		error = EINVAL;
+	} else if (devmap_umem_setup(dhp, bpf_dev_info, NULL,
+	    d->bd_map_cookie, off, len, PROT_READ | PROT_WRITE | PROT_USER,
+	    DEVMAP_DEFAULTS, NULL) != 0) {
+		error = ENXIO;
+	}
+	mutex_exit(&d->bd_lock);
+
+	if (error == 0)
+		*maplen = len;
+	return (error);
 }
 
 /*
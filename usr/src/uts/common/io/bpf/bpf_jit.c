@@ -0,0 +1,517 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Just-in-time compiler for BPF filter programs.
+ *
+ * bpf_setf() hands each program that passed bpf_validate() to
+ * bpf_jit_compile(), which translates it into native code with the same
+ * semantics as bpf_filter() for packets held in a single buffer, i.e. when
+ * buflen is not 0.  Packets spread over an mblk chain, and programs that
+ * could not be compiled, are still run by the interpreter.  Setting
+ * bpf_jit_enable to 0 stops new programs from being compiled.
+ *
+ * Code is generated in two passes over the program.  Every branch is
+ * emitted with a 32-bit displacement, so the size of the code for each
+ * instruction does not depend on where it lands; the first pass only
+ * records the offset of each instruction and the second one writes the
+ * code out.  The code is written into pages from bpf_jit_arena, which are
+ * then made read-only and executable, so no page is ever writable and
+ * executable at the same time.
+ *
+ * On amd64 the generated function is called as
+ *
+ *	uint_t filter(uchar_t *pkt, uint_t wirelen, uint_t buflen);
+ *
+ * and keeps A in %eax, X in %r8d, buflen in %r10 and the (zeroed) scratch
+ * memory words on the stack.  %ecx and %edx are used for temporaries.  Only
+ * caller-saved registers are used, so there is no register save area.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/sysmacros.h>
+#include <sys/debug.h>
+#include <sys/kmem.h>
+#include <sys/vmem.h>
+#include <sys/mman.h>
+#include <sys/sdt.h>
+#include <vm/hat.h>
+#include <vm/as.h>
+#include <vm/seg_kmem.h>
+
+#include <net/bpf.h>
+
+/*
+ * Set to 0 to run all new filter programs in the interpreter.
+ */
+int bpf_jit_enable = 1;
+
+#if defined(__amd64)
+
+static vmem_t *bpf_jit_arena;
+
+typedef struct bpf_jit_state {
+	uint8_t		*bjs_buf;	/* NULL in the sizing pass */
+	size_t		bjs_off;	/* current code offset */
+	size_t		*bjs_addrs;	/* code offset of each instruction */
+	size_t		bjs_fail;	/* offset of the reject stub */
+	boolean_t	bjs_mem;	/* uses the scratch memory words */
+} bpf_jit_state_t;
+
+/* Second byte of the two byte forms of jcc */
+#define	JIT_JA		0x87
+#define	JIT_JAE		0x83
+#define	JIT_JE		0x84
+#define	JIT_JNE		0x85
+#define	JIT_JBE		0x86
+#define	JIT_JB		0x82
+#define	JIT_JMP		0x00
+
+static void
+jit_emit(bpf_jit_state_t *s, const uint8_t *code, size_t len)
+{
+	if (s->bjs_buf != NULL)
+		bcopy(code, s->bjs_buf + s->bjs_off, len);
+	s->bjs_off += len;
+}
+
+#define	EMIT(s, ...)	{						\
+	const uint8_t __c[] = { __VA_ARGS__ };				\
+	jit_emit((s), __c, sizeof (__c));				\
+}
+
+static void
+jit_imm32(bpf_jit_state_t *s, uint32_t v)
+{
+	EMIT(s, v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, v >> 24);
+}
+
+/*
+ * Emit a jmp, or a jcc when op is not JIT_JMP, to the given code offset.
+ * Offsets of later instructions are only known in the second pass.
+ */
+static void
+jit_jump(bpf_jit_state_t *s, uint8_t op, size_t target)
+{
+	if (op == JIT_JMP) {
+		EMIT(s, 0xe9);
+	} else {
+		EMIT(s, 0x0f, op);
+	}
+	jit_imm32(s, s->bjs_buf == NULL ? 0 :
+	    (uint32_t)(target - (s->bjs_off + sizeof (uint32_t))));
+}
+
+static void
+jit_ret(bpf_jit_state_t *s)
+{
+	if (s->bjs_mem)
+		EMIT(s, 0x48, 0x83, 0xc4, BPF_MEMWORDS * 4);	/* add rsp */
+	EMIT(s, 0xc3);						/* ret */
+}
+
+/*
+ * With the offset into the packet in %ecx (zero extended), reject the
+ * packet unless size bytes from there are in the buffer.  As in the
+ * interpreter the end of the load is computed in 64 bits.
+ */
+static void
+jit_ldcheck(bpf_jit_state_t *s, uint8_t size)
+{
+	EMIT(s, 0x48, 0x8d, 0x51, size);	/* lea size(%rcx), %rdx */
+	EMIT(s, 0x4c, 0x39, 0xd2);		/* cmp %r10, %rdx */
+	jit_jump(s, JIT_JA, s->bjs_fail);
+}
+
+/*
+ * Load the packet offset of an absolute or indirect load into %ecx.
+ */
+static void
+jit_ldoff(bpf_jit_state_t *s, struct bpf_insn *p)
+{
+	if (BPF_MODE(p->code) == BPF_IND) {
+		EMIT(s, 0x44, 0x89, 0xc1);	/* mov %r8d, %ecx */
+		if (p->k != 0) {
+			EMIT(s, 0x81, 0xc1);	/* add $k, %ecx */
+			jit_imm32(s, p->k);
+		}
+	} else {
+		EMIT(s, 0xb9);			/* mov $k, %ecx */
+		jit_imm32(s, p->k);
+	}
+}
+
+/*
+ * Emit the two way branch of a conditional jump, after the flags have
+ * been set for the condition op.
+ */
+static void
+jit_branch(bpf_jit_state_t *s, struct bpf_insn *p, uint_t i, uint8_t op,
+    uint8_t nop)
+{
+	size_t t = s->bjs_addrs[i + 1 + p->jt];
+	size_t f = s->bjs_addrs[i + 1 + p->jf];
+
+	if (p->jt == p->jf) {
+		if (p->jt != 0)
+			jit_jump(s, JIT_JMP, t);
+	} else if (p->jt == 0) {
+		jit_jump(s, nop, f);
+	} else {
+		jit_jump(s, op, t);
+		if (p->jf != 0)
+			jit_jump(s, JIT_JMP, f);
+	}
+}
+
+static void
+jit_pass(bpf_jit_state_t *s, struct bpf_insn *prog, uint_t len)
+{
+	struct bpf_insn *p;
+	uint_t i;
+
+	s->bjs_off = 0;
+
+	EMIT(s, 0x41, 0x89, 0xd2);		/* mov %edx, %r10d */
+	EMIT(s, 0x31, 0xc0);			/* xor %eax, %eax */
+	EMIT(s, 0x45, 0x31, 0xc0);		/* xor %r8d, %r8d */
+	/*
+	 * The scratch words are zeroed so that a program which loads one it
+	 * never stored cannot read stale kernel stack.
+	 */
+	if (s->bjs_mem) {
+		for (i = 0; i < BPF_MEMWORDS / 2; i++)
+			EMIT(s, 0x50);			/* push %rax */
+	}
+
+	for (i = 0; i < len; i++) {
+		p = &prog[i];
+		s->bjs_addrs[i] = s->bjs_off;
+
+		switch (p->code) {
+		default:
+			jit_jump(s, JIT_JMP, s->bjs_fail);
+			break;
+
+		case BPF_RET|BPF_K:
+			EMIT(s, 0xb8);			/* mov $k, %eax */
+			jit_imm32(s, p->k);
+			jit_ret(s);
+			break;
+
+		case BPF_RET|BPF_A:
+			jit_ret(s);
+			break;
+
+		case BPF_LD|BPF_W|BPF_ABS:
+		case BPF_LD|BPF_W|BPF_IND:
+			jit_ldoff(s, p);
+			jit_ldcheck(s, sizeof (int32_t));
+			EMIT(s, 0x8b, 0x04, 0x0f);	/* mov (%rdi,%rcx) */
+			EMIT(s, 0x0f, 0xc8);		/* bswap %eax */
+			break;
+
+		case BPF_LD|BPF_H|BPF_ABS:
+		case BPF_LD|BPF_H|BPF_IND:
+			jit_ldoff(s, p);
+			jit_ldcheck(s, sizeof (int16_t));
+			EMIT(s, 0x0f, 0xb7, 0x04, 0x0f); /* movzwl */
+			EMIT(s, 0x66, 0xc1, 0xc0, 0x08); /* rol $8, %ax */
+			break;
+
+		case BPF_LD|BPF_B|BPF_ABS:
+		case BPF_LD|BPF_B|BPF_IND:
+			jit_ldoff(s, p);
+			jit_ldcheck(s, sizeof (int8_t));
+			EMIT(s, 0x0f, 0xb6, 0x04, 0x0f); /* movzbl */
+			break;
+
+		case BPF_LDX|BPF_MSH|BPF_B:
+			EMIT(s, 0xb9);			/* mov $k, %ecx */
+			jit_imm32(s, p->k);
+			jit_ldcheck(s, sizeof (int8_t));
+			EMIT(s, 0x44, 0x0f, 0xb6, 0x04, 0x0f); /* movzbl */
+			EMIT(s, 0x41, 0x83, 0xe0, 0x0f); /* and $0xf, %r8d */
+			EMIT(s, 0x41, 0xc1, 0xe0, 0x02); /* shl $2, %r8d */
+			break;
+
+		case BPF_LD|BPF_W|BPF_LEN:
+			EMIT(s, 0x89, 0xf0);		/* mov %esi, %eax */
+			break;
+
+		case BPF_LDX|BPF_W|BPF_LEN:
+			EMIT(s, 0x41, 0x89, 0xf0);	/* mov %esi, %r8d */
+			break;
+
+		case BPF_LD|BPF_IMM:
+			EMIT(s, 0xb8);			/* mov $k, %eax */
+			jit_imm32(s, p->k);
+			break;
+
+		case BPF_LDX|BPF_IMM:
+			EMIT(s, 0x41, 0xb8);		/* mov $k, %r8d */
+			jit_imm32(s, p->k);
+			break;
+
+		case BPF_LD|BPF_MEM:
+			EMIT(s, 0x8b, 0x44, 0x24, p->k * 4);
+			break;
+
+		case BPF_LDX|BPF_MEM:
+			EMIT(s, 0x44, 0x8b, 0x44, 0x24, p->k * 4);
+			break;
+
+		case BPF_ST:
+			EMIT(s, 0x89, 0x44, 0x24, p->k * 4);
+			break;
+
+		case BPF_STX:
+			EMIT(s, 0x44, 0x89, 0x44, 0x24, p->k * 4);
+			break;
+
+		case BPF_JMP|BPF_JA:
+			if (p->k != 0) {
+				jit_jump(s, JIT_JMP,
+				    s->bjs_addrs[i + 1 + p->k]);
+			}
+			break;
+
+		case BPF_JMP|BPF_JGT|BPF_K:
+		case BPF_JMP|BPF_JGE|BPF_K:
+		case BPF_JMP|BPF_JEQ|BPF_K:
+			EMIT(s, 0x3d);			/* cmp $k, %eax */
+			jit_imm32(s, p->k);
+			goto cond;
+
+		case BPF_JMP|BPF_JSET|BPF_K:
+			EMIT(s, 0xa9);			/* test $k, %eax */
+			jit_imm32(s, p->k);
+			goto cond;
+
+		case BPF_JMP|BPF_JGT|BPF_X:
+		case BPF_JMP|BPF_JGE|BPF_X:
+		case BPF_JMP|BPF_JEQ|BPF_X:
+			EMIT(s, 0x44, 0x39, 0xc0);	/* cmp %r8d, %eax */
+			goto cond;
+
+		case BPF_JMP|BPF_JSET|BPF_X:
+			EMIT(s, 0x44, 0x85, 0xc0);	/* test %r8d, %eax */
+		cond:
+			switch (BPF_OP(p->code)) {
+			case BPF_JGT:
+				jit_branch(s, p, i, JIT_JA, JIT_JBE);
+				break;
+			case BPF_JGE:
+				jit_branch(s, p, i, JIT_JAE, JIT_JB);
+				break;
+			case BPF_JEQ:
+				jit_branch(s, p, i, JIT_JE, JIT_JNE);
+				break;
+			case BPF_JSET:
+				jit_branch(s, p, i, JIT_JNE, JIT_JE);
+				break;
+			}
+			break;
+
+		case BPF_ALU|BPF_ADD|BPF_X:
+			EMIT(s, 0x44, 0x01, 0xc0);	/* add %r8d, %eax */
+			break;
+
+		case BPF_ALU|BPF_SUB|BPF_X:
+			EMIT(s, 0x44, 0x29, 0xc0);	/* sub %r8d, %eax */
+			break;
+
+		case BPF_ALU|BPF_MUL|BPF_X:
+			EMIT(s, 0x41, 0x0f, 0xaf, 0xc0); /* imul %r8d, %eax */
+			break;
+
+		case BPF_ALU|BPF_DIV|BPF_X:
+			EMIT(s, 0x45, 0x85, 0xc0);	/* test %r8d, %r8d */
+			jit_jump(s, JIT_JE, s->bjs_fail);
+			EMIT(s, 0x31, 0xd2);		/* xor %edx, %edx */
+			EMIT(s, 0x41, 0xf7, 0xf0);	/* div %r8d */
+			break;
+
+		case BPF_ALU|BPF_AND|BPF_X:
+			EMIT(s, 0x44, 0x21, 0xc0);	/* and %r8d, %eax */
+			break;
+
+		case BPF_ALU|BPF_OR|BPF_X:
+			EMIT(s, 0x44, 0x09, 0xc0);	/* or %r8d, %eax */
+			break;
+
+		case BPF_ALU|BPF_LSH|BPF_X:
+			EMIT(s, 0x44, 0x89, 0xc1);	/* mov %r8d, %ecx */
+			EMIT(s, 0xd3, 0xe0);		/* shl %cl, %eax */
+			break;
+
+		case BPF_ALU|BPF_RSH|BPF_X:
+			EMIT(s, 0x44, 0x89, 0xc1);	/* mov %r8d, %ecx */
+			EMIT(s, 0xd3, 0xe8);		/* shr %cl, %eax */
+			break;
+
+		case BPF_ALU|BPF_ADD|BPF_K:
+			EMIT(s, 0x05);			/* add $k, %eax */
+			jit_imm32(s, p->k);
+			break;
+
+		case BPF_ALU|BPF_SUB|BPF_K:
+			EMIT(s, 0x2d);			/* sub $k, %eax */
+			jit_imm32(s, p->k);
+			break;
+
+		case BPF_ALU|BPF_MUL|BPF_K:
+			EMIT(s, 0x69, 0xc0);		/* imul $k, %eax */
+			jit_imm32(s, p->k);
+			break;
+
+		case BPF_ALU|BPF_DIV|BPF_K:
+			EMIT(s, 0xb9);			/* mov $k, %ecx */
+			jit_imm32(s, p->k);
+			EMIT(s, 0x31, 0xd2);		/* xor %edx, %edx */
+			EMIT(s, 0xf7, 0xf1);		/* div %ecx */
+			break;
+
+		case BPF_ALU|BPF_AND|BPF_K:
+			EMIT(s, 0x25);			/* and $k, %eax */
+			jit_imm32(s, p->k);
+			break;
+
+		case BPF_ALU|BPF_OR|BPF_K:
+			EMIT(s, 0x0d);			/* or $k, %eax */
+			jit_imm32(s, p->k);
+			break;
+
+		case BPF_ALU|BPF_LSH|BPF_K:
+			EMIT(s, 0xc1, 0xe0, p->k & 0xff); /* shl $k, %eax */
+			break;
+
+		case BPF_ALU|BPF_RSH|BPF_K:
+			EMIT(s, 0xc1, 0xe8, p->k & 0xff); /* shr $k, %eax */
+			break;
+
+		case BPF_ALU|BPF_NEG:
+			EMIT(s, 0xf7, 0xd8);		/* neg %eax */
+			break;
+
+		case BPF_MISC|BPF_TAX:
+			EMIT(s, 0x41, 0x89, 0xc0);	/* mov %eax, %r8d */
+			break;
+
+		case BPF_MISC|BPF_TXA:
+			EMIT(s, 0x44, 0x89, 0xc0);	/* mov %r8d, %eax */
+			break;
+		}
+	}
+
+	/*
+	 * The reject stub: failed packet loads, division by zero and
+	 * unknown instructions all end up here and return 0.
+	 */
+	s->bjs_fail = s->bjs_off;
+	EMIT(s, 0x31, 0xc0);			/* xor %eax, %eax */
+	jit_ret(s);
+}
+
+/*
+ * Compile a validated filter program.  Returns NULL if the JIT is
+ * disabled; the caller then keeps using bpf_filter().
+ */
+bpf_jit_filter_t
+bpf_jit_compile(struct bpf_insn *prog, uint_t len, size_t *sizep)
+{
+	bpf_jit_state_t s;
+	size_t codelen, size;
+	uint_t i;
+
+	if (!bpf_jit_enable || bpf_jit_arena == NULL || len == 0)
+		return (NULL);
+
+	bzero(&s, sizeof (s));
+	for (i = 0; i < len; i++) {
+		switch (prog[i].code) {
+		case BPF_LD|BPF_MEM:
+		case BPF_LDX|BPF_MEM:
+		case BPF_ST:
+		case BPF_STX:
+			s.bjs_mem = B_TRUE;
+			break;
+		}
+	}
+	s.bjs_addrs = kmem_zalloc((len + 1) * sizeof (size_t), KM_SLEEP);
+
+	jit_pass(&s, prog, len);
+	codelen = s.bjs_off;
+	size = P2ROUNDUP(codelen, PAGESIZE);
+
+	s.bjs_buf = vmem_alloc(bpf_jit_arena, size, VM_SLEEP);
+	jit_pass(&s, prog, len);
+	VERIFY3U(s.bjs_off, ==, codelen);
+	(void) memset(s.bjs_buf + codelen, 0xcc, size - codelen); /* int3 */
+	kmem_free(s.bjs_addrs, (len + 1) * sizeof (size_t));
+
+	hat_chgprot(kas.a_hat, (caddr_t)s.bjs_buf, size, PROT_READ | PROT_EXEC);
+
+	DTRACE_PROBE3(bpf__jit__compile, struct bpf_insn *, prog,
+	    uint_t, len, size_t, codelen);
+	*sizep = size;
+	return ((bpf_jit_filter_t)s.bjs_buf);
+}
+
+void
+bpf_jit_free(bpf_jit_filter_t code, size_t size)
+{
+	hat_chgprot(kas.a_hat, (caddr_t)code, size, PROT_READ | PROT_WRITE);
+	vmem_free(bpf_jit_arena, (void *)code, size);
+}
+
+void
+bpf_jit_init(void)
+{
+	bpf_jit_arena = vmem_create("bpf_jit", NULL, 0, PAGESIZE,
+	    segkmem_alloc, segkmem_free, heaptext_arena, 0, VM_SLEEP);
+}
+
+void
+bpf_jit_fini(void)
+{
+	vmem_destroy(bpf_jit_arena);
+	bpf_jit_arena = NULL;
+}
+
+#else	/* __amd64 */
+
+/* ARGSUSED */
+bpf_jit_filter_t
+bpf_jit_compile(struct bpf_insn *prog, uint_t len, size_t *sizep)
+{
+	return (NULL);
+}
+
+/* ARGSUSED */
+void
+bpf_jit_free(bpf_jit_filter_t code, size_t size)
+{
+}
+
+void
+bpf_jit_init(void)
+{
+}
+
+void
+bpf_jit_fini(void)
+{
+}
+
+#endif	/* __amd64 */
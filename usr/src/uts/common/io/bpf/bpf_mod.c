@@ -47,6 +47,8 @@ extern	int	bpfread(dev_t dev, struct uio *uio_p, cred_t *cred_p);
 extern	int	bpfwrite(dev_t dev, struct uio *uio, cred_t *cred);
 extern	int	bpfchpoll(dev_t, short, int, short *, struct pollhead **);
 extern	int	bpfioctl(dev_t, int, intptr_t, int, cred_t *, int *);
+extern	int	bpfdevmap(dev_t, devmap_cookie_t, offset_t, size_t, size_t *,
+		    uint_t);
 extern	int	bpfilterattach(void);
 extern	int	bpfilterdetach(void);
 
@@ -77,7 +79,7 @@ static struct cb_ops bpf_cb_ops = {
 	bpfread,
 	bpfwrite,	/* write */
 	bpfioctl,	/* ioctl */
-	nodev,		/* devmap */
+	bpfdevmap,	/* devmap */
 	nodev,		/* mmap */
 	nodev,		/* segmap */
 	bpfchpoll,	/* poll */
@@ -108,7 +110,7 @@ static struct modldrv bpfmod = {
 };
 static struct modlinkage modlink1 = { MODREV_1, &bpfmod, NULL };
 
-static dev_info_t *bpf_dev_info = NULL;
+dev_info_t *bpf_dev_info = NULL;
 static net_instance_t *bpf_inst = NULL;
 
 int
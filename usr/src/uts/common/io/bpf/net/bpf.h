@@ -116,6 +116,67 @@ struct bpf_version {
 #define	BPF_MAJOR_VERSION 1
 #define	BPF_MINOR_VERSION 1
 
+/*
+ * Structure for BIOCSZBUF.  Asks for two zero-copy buffers able to hold
+ * bz_buflen bytes of packets each.  They are mapped with mmap(2), at
+ * offset 0, for bz_mapsize bytes; the first buffer starts at the beginning
+ * of the mapping and the second bz_buf1off bytes in.
+ */
+struct bpf_zbuf {
+	uint32_t bz_buflen;
+	uint32_t bz_pad;
+	uint64_t bz_buf1off;
+	uint64_t bz_mapsize;
+};
+
+/*
+ * Header at the start of each zero-copy buffer, followed by packets laid
+ * out as in a read(2) buffer.  The kernel hands a full buffer to the
+ * reader by setting bzh_kernel_len and then advancing bzh_kernel_gen;
+ * the reader owns the buffer until it sets bzh_user_gen to bzh_kernel_gen
+ * again.  poll(2) reports POLLIN when a buffer has been handed over, or,
+ * in immediate mode or after the read timeout, when packets are waiting
+ * to be handed over by BIOCROTZBUF.
+ */
+struct bpf_zbuf_header {
+	volatile uint32_t bzh_kernel_gen;
+	volatile uint32_t bzh_kernel_len;
+	volatile uint32_t bzh_user_gen;
+	uint32_t bzh_pad[5];
+};
+
+/*
+ * Structure for BIOCSRING.  Asks for a capture ring of brr_nslots slots
+ * (a power of 2) of brr_slotsize bytes each, and returns the length to
+ * pass to mmap(2), at offset 0, to map it.
+ */
+struct bpf_ring_req {
+	uint32_t brr_nslots;
+	uint32_t brr_slotsize;
+	uint64_t brr_mapsize;
+};
+
+/*
+ * Header at the start of a mapped capture ring.  br_head and br_tail are
+ * free running slot counters: the kernel fills slot br_head and then
+ * advances it, the reader consumes slot br_tail and then advances it.
+ * Slot n is found br_slotoff + (n % br_nslots) * br_slotsize bytes from
+ * the start of the ring and begins with a struct bpf_hdr, as in a read(2)
+ * buffer.  The ring is empty when the two counters are equal; poll(2)
+ * reports POLLIN when it is not.
+ */
+struct bpf_ring {
+	uint32_t br_nslots;		/* number of slots */
+	uint32_t br_slotsize;		/* bytes per slot */
+	uint32_t br_slotoff;		/* offset of slot 0 */
+	volatile uint32_t br_drops;	/* packets dropped, ring full */
+	uint32_t br_pad1[12];
+	volatile uint32_t br_head;	/* written by the kernel */
+	uint32_t br_pad2[15];
+	volatile uint32_t br_tail;	/* written by the reader */
+	uint32_t br_pad3[15];
+};
+
 /*
  * BPF ioctls
  *
@@ -147,6 +208,9 @@ struct bpf_version {
 #define	BIOCSSEESENT	 _IOW('B', 121, uint_t)
 #define	BIOCSRTIMEOUT	 _IOW('B', 122, struct timeval)
 #define	BIOCGRTIMEOUT	 _IOR('B', 123, struct timeval)
+#define	BIOCSRING	_IOWR('B', 124, struct bpf_ring_req)
+#define	BIOCSZBUF	_IOWR('B', 125, struct bpf_zbuf)
+#define	BIOCROTZBUF	  _IO('B', 126)
 /*
  */
 #define	BIOCSETF32	 _IOW('B', 103, struct bpf_program32)
@@ -280,6 +344,7 @@ struct bpf_dltlist32 {
 #include <sys/dls_impl.h>
 
 typedef void (*bpf_itap_fn_t)(void *, mblk_t *, boolean_t, uint_t);
+typedef uint_t (*bpf_jit_filter_t)(uchar_t *, uint_t, uint_t);
 
 extern void	bpfattach(uintptr_t, int, zoneid_t, int);
 extern void	bpfdetach(uintptr_t);
@@ -288,6 +353,12 @@ extern void	bpf_itap(void *, mblk_t *, boolean_t, uint_t);
 extern void	bpf_mtap(void *, mac_resource_handle_t, mblk_t *, boolean_t);
 extern int	bpf_validate(struct bpf_insn *, int);
 
+extern int	bpf_jit_enable;
+extern bpf_jit_filter_t bpf_jit_compile(struct bpf_insn *, uint_t, size_t *);
+extern void	bpf_jit_free(bpf_jit_filter_t, size_t);
+extern void	bpf_jit_init(void);
+extern void	bpf_jit_fini(void);
+
 #endif /* _KERNEL */
 
 /*
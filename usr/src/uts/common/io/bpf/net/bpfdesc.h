@@ -49,6 +49,7 @@
 #include <sys/mutex.h>
 #include <sys/condvar.h>
 #include <sys/queue.h>
+#include <sys/ddidevmap.h>
 
 /*
  * Access to "layer 2" networking is provided through each such provider
@@ -135,6 +136,8 @@ struct bpf_d {
 	ulong_t		bd_rtout;	/* Read timeout in 'ticks' */
 	struct bpf_insn *bd_filter; 	/* filter code */
 	size_t		bd_filter_size;
+	bpf_jit_filter_t bd_jit;	/* compiled bd_filter, if any */
+	size_t		bd_jit_size;
 	ulong_t		bd_rcount;	/* number of packets received */
 	ulong_t		bd_dcount;	/* number of packets dropped */
 	ulong_t		bd_ccount;	/* number of packets captured */
@@ -177,6 +180,29 @@ struct bpf_d {
 	 * be kept across changing DLT or network interface.
 	 */
 	int		bd_promisc_flags;
+	/*
+	 * Memory shared with the reader through mmap(2), holding either a
+	 * capture ring or the zero-copy store and free buffers.
+	 */
+	ddi_umem_cookie_t bd_map_cookie;
+	size_t		bd_map_size;	/* mapped length */
+	/*
+	 * Set by BIOCSZBUF: the store/hold/free buffers live in the mapped
+	 * memory, each behind a struct bpf_zbuf_header, and the hold buffer
+	 * is handed to the reader in place instead of being read(2).
+	 */
+	int		bd_zbuf;
+	/*
+	 * Shared memory capture ring (BIOCSRING).  When present it replaces
+	 * the store/hold/free buffers.  The geometry and producer index are
+	 * kept here as well, since the reader can scribble on the copies
+	 * in the ring itself.
+	 */
+	struct bpf_ring	*bd_ring;
+	uint32_t	bd_ring_nslots;
+	uint32_t	bd_ring_slotsize;
+	uint32_t	bd_ring_slotoff;
+	uint32_t	bd_ring_head;
 };
 
 
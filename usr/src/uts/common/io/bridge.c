@@ -83,7 +83,9 @@
  *
  *   Bridge instances have lists of links and an AVL tree of forwarding
  *   entries.  Each of these structures holds one reference on the bridge
- *   instance.  These lists and tree are protected by bi_rwlock.
+ *   instance.  These lists and tree are protected by bi_rwlock.  The
+ *   forwarding entries are also hashed in bi_fwdhash, and each bucket there
+ *   is protected by its own bfb_lock, which is taken after bi_rwlock.
  *
  * bridge_stream_t
  *   Bridge streams are allocated by stream_alloc() and freed by stream_free().
@@ -109,9 +111,10 @@
  *
  * bridge_fwd_t
  *   Bridge forwarding entries are allocated by bridge_recv_cb() and freed by
- *   fwd_free().  The bi_fwd AVL tree holds one reference to the entry.  Unlike
- *   other data structures, the reference is dropped when the entry is removed
- *   from the tree by fwd_delete(), and the BFF_INTREE flag is removed.  Each
+ *   fwd_free().  The bi_fwd AVL tree holds one reference to the entry, which
+ *   covers the entry's place in bi_fwdhash as well.  Unlike other data
+ *   structures, the reference is dropped when the entry is removed from the
+ *   tree by fwd_delete(), and the BFF_INTREE flag is removed.  Each
  *   thread that's forwarding a packet to a known destination holds a reference
  *   to a forwarding entry.
  *
@@ -686,11 +689,19 @@ fwd_compare(const void *addr1, const void *addr2)
 static void
 inst_free(bridge_inst_t *bip)
 {
+	int i;
+
 	ASSERT(bip->bi_mac == NULL);
 	rw_destroy(&bip->bi_rwlock);
 	list_destroy(&bip->bi_links);
 	cv_destroy(&bip->bi_linkwait);
 	avl_destroy(&bip->bi_fwd);
+	for (i = 0; i < BRIDGE_FWD_HASHSZ; i++) {
+		ASSERT(bip->bi_fwdhash[i].bfb_head == NULL);
+		rw_destroy(&bip->bi_fwdhash[i].bfb_lock);
+	}
+	kmem_free(bip->bi_fwdhash,
+	    BRIDGE_FWD_HASHSZ * sizeof (bridge_fwd_bucket_t));
 	if (bip->bi_ksp != NULL)
 		kstat_delete(bip->bi_ksp);
 	kmem_free(bip, sizeof (*bip));
@@ -700,6 +711,7 @@ static bridge_inst_t *
 inst_alloc(const char *bridge)
 {
 	bridge_inst_t *bip;
+	int i;
 
 	bip = kmem_zalloc(sizeof (*bip), KM_SLEEP);
 	bip->bi_refs = 1;
@@ -710,6 +722,10 @@ inst_alloc(const char *bridge)
 	cv_init(&bip->bi_linkwait, NULL, CV_DRIVER, NULL);
 	avl_create(&bip->bi_fwd, fwd_compare, sizeof (bridge_fwd_t),
 	    offsetof(bridge_fwd_t, bf_node));
+	bip->bi_fwdhash = kmem_zalloc(
+	    BRIDGE_FWD_HASHSZ * sizeof (bridge_fwd_bucket_t), KM_SLEEP);
+	for (i = 0; i < BRIDGE_FWD_HASHSZ; i++)
+		rw_init(&bip->bi_fwdhash[i].bfb_lock, NULL, RW_DRIVER, NULL);
 	return (bip);
 }
 
@@ -908,26 +924,78 @@ fwd_alloc(const uint8_t *addr, uint_t nlinks, uint16_t nick)
 	return (bfp);
 }
 
+/*
+ * Add an entry to both the AVL tree and the hash.  The entry must be
+ * complete, including the table reference, as lookups may find it as soon
+ * as it's in the hash.
+ */
+static void
+fwd_table_insert(bridge_inst_t *bip, bridge_fwd_t *bfp, avl_index_t idx)
+{
+	bridge_fwd_bucket_t *bfb = &bip->bi_fwdhash[
+	    BRIDGE_FWD_HASH(bfp->bf_dest)];
+
+	ASSERT(RW_WRITE_HELD(&bip->bi_rwlock));
+	avl_insert(&bip->bi_fwd, bfp, idx);
+	rw_enter(&bfb->bfb_lock, RW_WRITER);
+	bfp->bf_hnext = bfb->bfb_head;
+	bfb->bfb_head = bfp;
+	rw_exit(&bfb->bfb_lock);
+}
+
+static void
+fwd_table_remove(bridge_inst_t *bip, bridge_fwd_t *bfp)
+{
+	bridge_fwd_bucket_t *bfb = &bip->bi_fwdhash[
+	    BRIDGE_FWD_HASH(bfp->bf_dest)];
+	bridge_fwd_t **bfpp;
+
+	ASSERT(RW_WRITE_HELD(&bip->bi_rwlock));
+	avl_remove(&bip->bi_fwd, bfp);
+	rw_enter(&bfb->bfb_lock, RW_WRITER);
+	for (bfpp = &bfb->bfb_head; *bfpp != bfp; bfpp = &(*bfpp)->bf_hnext)
+		ASSERT(*bfpp != NULL);
+	*bfpp = bfp->bf_hnext;
+	rw_exit(&bfb->bfb_lock);
+	bfp->bf_hnext = NULL;
+}
+
+/*
+ * Look through a hash bucket for the entry for an address, either the
+ * normal one or, if 'flags' is BFF_VLANLOCAL, the IVL one for the VLAN.
+ */
+static bridge_fwd_t *
+fwd_hash_find(bridge_fwd_bucket_t *bfb, const uint8_t *addr, uint_t flags,
+    uint16_t vlanid)
+{
+	bridge_fwd_t *bfp;
+
+	ASSERT(RW_LOCK_HELD(&bfb->bfb_lock));
+	for (bfp = bfb->bfb_head; bfp != NULL; bfp = bfp->bf_hnext) {
+		if (bcmp(bfp->bf_dest, addr, ETHERADDRL) == 0 &&
+		    (bfp->bf_flags & BFF_VLANLOCAL) == flags &&
+		    (flags == 0 || bfp->bf_vlanid == vlanid))
+			break;
+	}
+	return (bfp);
+}
+
 static bridge_fwd_t *
 fwd_find(bridge_inst_t *bip, const uint8_t *addr, uint16_t vlanid)
 {
+	bridge_fwd_bucket_t *bfb = &bip->bi_fwdhash[BRIDGE_FWD_HASH(addr)];
 	bridge_fwd_t *bfp, *vbfp;
-	bridge_fwd_t match;
 
-	bcopy(addr, match.bf_dest, ETHERADDRL);
-	match.bf_flags = 0;
-	rw_enter(&bip->bi_rwlock, RW_READER);
-	if ((bfp = avl_find(&bip->bi_fwd, &match, NULL)) != NULL) {
+	rw_enter(&bfb->bfb_lock, RW_READER);
+	if ((bfp = fwd_hash_find(bfb, addr, 0, 0)) != NULL) {
 		if (bfp->bf_vlanid != vlanid && bfp->bf_vcnt > 0) {
-			match.bf_vlanid = vlanid;
-			match.bf_flags = BFF_VLANLOCAL;
-			vbfp = avl_find(&bip->bi_fwd, &match, NULL);
+			vbfp = fwd_hash_find(bfb, addr, BFF_VLANLOCAL, vlanid);
 			if (vbfp != NULL)
 				bfp = vbfp;
 		}
 		atomic_inc_uint(&bfp->bf_refs);
 	}
-	rw_exit(&bip->bi_rwlock);
+	rw_exit(&bfb->bfb_lock);
 	return (bfp);
 }
 
@@ -965,7 +1033,7 @@ fwd_delete(bridge_fwd_t *bfp)
 		rw_enter(&bip->bi_rwlock, RW_WRITER);
 		/* Another thread could beat us to this */
 		if (bfp->bf_flags & BFF_INTREE) {
-			avl_remove(&bip->bi_fwd, bfp);
+			fwd_table_remove(bip, bfp);
 			bfp->bf_flags &= ~BFF_INTREE;
 			if (bfp->bf_flags & BFF_VLANLOCAL) {
 				bfp->bf_flags &= ~BFF_VLANLOCAL;
@@ -991,9 +1059,9 @@ fwd_insert(bridge_inst_t *bip, bridge_fwd_t *bfp)
 	if (!(bip->bi_flags & BIF_SHUTDOWN) &&
 	    avl_numnodes(&bip->bi_fwd) < bip->bi_tablemax &&
 	    avl_find(&bip->bi_fwd, bfp, &idx) == NULL) {
-		avl_insert(&bip->bi_fwd, bfp, idx);
 		bfp->bf_flags |= BFF_INTREE;
 		atomic_inc_uint(&bfp->bf_refs);	/* avl entry */
+		fwd_table_insert(bip, bfp, idx);
 		retv = B_TRUE;
 	} else {
 		retv = B_FALSE;
@@ -1046,7 +1114,7 @@ fwd_update_local(bridge_link_t *blp, const uint8_t *oldaddr,
 		}
 		/* If no more links, then remove and free up */
 		if (bfp->bf_nlinks == 0) {
-			avl_remove(&bip->bi_fwd, bfp);
+			fwd_table_remove(bip, bfp);
 			bfp->bf_flags &= ~BFF_INTREE;
 		} else {
 			bfp = NULL;
@@ -1082,7 +1150,7 @@ no_old_addr:
 		    RBRIDGE_NICKNAME_NONE);
 		if (bfnew != NULL) {
 			KIINCR(bki_count);
-			avl_remove(&bip->bi_fwd, bfp);
+			fwd_table_remove(bip, bfp);
 			bfp->bf_flags &= ~BFF_INTREE;
 			bfnew->bf_nlinks = bfp->bf_nlinks;
 			bcopy(bfp->bf_links, bfnew->bf_links,
@@ -1101,9 +1169,9 @@ no_old_addr:
 
 		if (bfnew != bfp) {
 			/* local addresses are not subject to table limits */
-			avl_insert(&bip->bi_fwd, bfnew, idx);
 			bfnew->bf_flags |= (BFF_INTREE | BFF_LOCALADDR);
 			atomic_inc_uint(&bfnew->bf_refs);	/* avl entry */
+			fwd_table_insert(bip, bfnew, idx);
 		}
 	}
 	rw_exit(&bip->bi_rwlock);
@@ -1193,7 +1261,7 @@ link_shutdown(void *arg)
 				bfp->bf_links[i] = bfp->bf_links[i + 1];
 		} else {
 			ASSERT(bfp->bf_flags & BFF_INTREE);
-			avl_remove(&bip->bi_fwd, bfp);
+			fwd_table_remove(bip, bfp);
 			bfp->bf_flags &= ~BFF_INTREE;
 			avl_add(&fwd_scavenge, bfp);
 		}
@@ -1407,9 +1475,12 @@ bridge_timer(void *arg)
 	int err;
 	datalink_id_t tmpid;
 	avl_tree_t fwd_scavenge;
-	clock_t age_limit;
+	clock_t age_limit, now;
 	uint32_t ldecay;
 
+#define	FWD_EXPIRED(bfp)	(!((bfp)->bf_flags & BFF_LOCALADDR) && \
+	(now - (bfp)->bf_lastheard) > age_limit)
+
 	avl_create(&fwd_scavenge, fwd_compare, sizeof (bridge_fwd_t),
 	    offsetof(bridge_fwd_t, bf_node));
 	mutex_enter(&inst_lock);
@@ -1417,7 +1488,13 @@ bridge_timer(void *arg)
 	    bip = list_next(&inst_list, bip)) {
 		if (bip->bi_flags & BIF_SHUTDOWN)
 			continue;
-		rw_enter(&bip->bi_rwlock, RW_WRITER);
+		/*
+		 * Look for expired entries as a reader, so that learning
+		 * isn't held off while we walk the table, and become a
+		 * writer only once there's something to remove.  The
+		 * bi_tshift state is used only by this timer.
+		 */
+		rw_enter(&bip->bi_rwlock, RW_READER);
 		/* compute scaled maximum age based on table limit */
 		if (avl_numnodes(&bip->bi_fwd) > bip->bi_tablemax)
 			bip->bi_tshift++;
@@ -1428,13 +1505,22 @@ bridge_timer(void *arg)
 				bip->bi_tshift--;
 			age_limit = 1;
 		}
-		bfnext = avl_first(&bip->bi_fwd);
-		while ((bfp = bfnext) != NULL) {
+		now = ddi_get_lbolt();
+		for (bfp = avl_first(&bip->bi_fwd); bfp != NULL;
+		    bfp = AVL_NEXT(&bip->bi_fwd, bfp)) {
+			if (FWD_EXPIRED(bfp))
+				break;
+		}
+		if (bfp != NULL && !rw_tryupgrade(&bip->bi_rwlock)) {
+			rw_exit(&bip->bi_rwlock);
+			rw_enter(&bip->bi_rwlock, RW_WRITER);
+			bfp = avl_first(&bip->bi_fwd);
+		}
+		for (; bfp != NULL; bfp = bfnext) {
 			bfnext = AVL_NEXT(&bip->bi_fwd, bfp);
-			if (!(bfp->bf_flags & BFF_LOCALADDR) &&
-			    (ddi_get_lbolt() - bfp->bf_lastheard) > age_limit) {
+			if (FWD_EXPIRED(bfp)) {
 				ASSERT(bfp->bf_flags & BFF_INTREE);
-				avl_remove(&bip->bi_fwd, bfp);
+				fwd_table_remove(bip, bfp);
 				bfp->bf_flags &= ~BFF_INTREE;
 				avl_add(&fwd_scavenge, bfp);
 			}
@@ -1458,6 +1544,7 @@ bridge_timer(void *arg)
 	}
 	mutex_exit(&inst_lock);
 	avl_destroy(&fwd_scavenge);
+#undef	FWD_EXPIRED
 
 	/*
 	 * Scan the bridge_mac_t entries and try to free up the ones that are
@@ -1604,7 +1691,11 @@ bridge_learn(bridge_link_t *blp, const uint8_t *saddr, uint16_t ingress_nick,
 		if (bfp->bf_trill_nick == ingress_nick) {
 			for (i = 0; i < bfp->bf_nlinks; i++) {
 				if (bfp->bf_links[i] == blp) {
-					bfp->bf_lastheard = ddi_get_lbolt();
+					clock_t now = ddi_get_lbolt();
+
+					/* don't dirty the entry needlessly */
+					if (bfp->bf_lastheard != now)
+						bfp->bf_lastheard = now;
 					fwd_unref(bfp);
 					return;
 				}
@@ -1968,6 +2059,7 @@ bridge_forward(bridge_link_t *blp, mac_header_info_t *hdr_info, mblk_t *mp,
 			}
 
 			KIINCR(bki_forwards);
+			KLINCR(bkl_forwards);
 			/*
 			 * No need to bump up the link reference count, as
 			 * the forwarding entry itself holds a reference to
@@ -2078,10 +2170,13 @@ bridge_forward(bridge_link_t *blp, mac_header_info_t *hdr_info, mblk_t *mp,
 				continue;
 			}
 
-			if (hdr_info->mhi_dsttype == MAC_ADDRTYPE_UNICAST)
+			if (hdr_info->mhi_dsttype == MAC_ADDRTYPE_UNICAST) {
 				KIINCR(bki_unknown);
-			else
+				KLINCR(bkl_unknown);
+			} else {
 				KIINCR(bki_mbcast);
+				KLINCR(bkl_mbcast);
+			}
 			KLPINCR(blpsend, bkl_xmit);
 			if ((mpcopy = copymsg(mpsend)) != NULL)
 				mac_rx_common(blpsend->bl_mh, NULL, mpcopy);
@@ -2667,7 +2762,7 @@ bridge_trill_flush(bridge_link_t *blp, uint16_t vlan, boolean_t dotrill)
 				continue;
 		}
 		ASSERT(bfp->bf_flags & BFF_INTREE);
-		avl_remove(&bip->bi_fwd, bfp);
+		fwd_table_remove(bip, bfp);
 		bfp->bf_flags &= ~BFF_INTREE;
 		avl_add(&fwd_scavenge, bfp);
 	}
@@ -3271,7 +3366,7 @@ bridge_ioctl(queue_t *wq, mblk_t *mp)
 					continue;
 			}
 			ASSERT(bfp->bf_flags & BFF_INTREE);
-			avl_remove(&bip->bi_fwd, bfp);
+			fwd_table_remove(bip, bfp);
 			bfp->bf_flags &= ~BFF_INTREE;
 			avl_add(&fwd_scavenge, bfp);
 		}
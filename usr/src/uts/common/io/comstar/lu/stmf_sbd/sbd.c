@@ -1403,6 +1403,40 @@ do_unmap_setup(sbd_lu_t *sl)
 	sl->sl_flags |= SL_UNMAP_ENABLED;
 }
 
+static void
+sbd_create_kstat(sbd_lu_t *sl)
+{
+	char ks_nm[KSTAT_STRLEN];
+	sbd_lu_kstat_t *sk = &sl->sl_kstat_data;
+	uint8_t *p = &sl->sl_device_id[4];
+	int i;
+
+	(void) snprintf(ks_nm, sizeof (ks_nm), "sbd_lu_%"PRIxPTR"",
+	    (uintptr_t)sl);
+	if ((sl->sl_kstat = kstat_create("stmf_sbd", 0, ks_nm, "misc",
+	    KSTAT_TYPE_NAMED, sizeof (sbd_lu_kstat_t) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL)) == NULL) {
+		cmn_err(CE_WARN, "sbd: kstat_create lu failed");
+		return;
+	}
+
+	kstat_named_init(&sk->sk_guid, "lun-guid", KSTAT_DATA_STRING);
+	kstat_named_init(&sk->sk_reads_active, "reads_active",
+	    KSTAT_DATA_UINT64);
+	kstat_named_init(&sk->sk_writes_active, "writes_active",
+	    KSTAT_DATA_UINT64);
+	kstat_named_init(&sk->sk_zvol_async_reads, "zvol_async_reads",
+	    KSTAT_DATA_UINT64);
+
+	for (i = 0; i < 16; i++)
+		(void) sprintf(&sl->sl_kstat_guid[i * 2], "%02x", p[i]);
+	kstat_named_setstr(&sk->sk_guid, sl->sl_kstat_guid);
+
+	sl->sl_kstat->ks_data = sk;
+	sl->sl_kstat->ks_data_size += strlen(sl->sl_kstat_guid) + 1;
+	kstat_install(sl->sl_kstat);
+}
+
 int
 sbd_populate_and_register_lu(sbd_lu_t *sl, uint32_t *err_ret)
 {
@@ -1439,6 +1473,7 @@ sbd_populate_and_register_lu(sbd_lu_t *sl, uint32_t *err_ret)
 	lu->lu_dbuf_xfer_done = sbd_dbuf_xfer_done;
 	lu->lu_send_status_done = sbd_send_status_done;
 	lu->lu_task_free = sbd_task_free;
+	lu->lu_task_poll = sbd_task_poll;
 	lu->lu_abort = sbd_abort;
 	lu->lu_dbuf_free = sbd_dbuf_free;
 	lu->lu_ctl = sbd_ctl;
@@ -1453,6 +1488,7 @@ sbd_populate_and_register_lu(sbd_lu_t *sl, uint32_t *err_ret)
 		}
 		return (EIO);
 	}
+	sbd_create_kstat(sl);
 
 	*err_ret = 0;
 	return (0);
@@ -1693,6 +1729,9 @@ sbd_close_delete_lu(sbd_lu_t *sl, int ret)
 
 	if (sl->sl_flags & SL_LINKED)
 		sbd_unlink_lu(sl);
+	if (sl->sl_kstat != NULL)
+		kstat_delete(sl->sl_kstat);
+	mutex_destroy(&sl->sl_zvol_rd_lock);
 	mutex_destroy(&sl->sl_metadata_lock);
 	mutex_destroy(&sl->sl_lock);
 	rw_destroy(&sl->sl_pgr->pgr_lock);
@@ -1778,6 +1817,7 @@ sbd_create_register_lu(sbd_create_and_reg_lu_t *slu, int struct_sz,
 	rw_init(&sl->sl_pgr->pgr_lock, NULL, RW_DRIVER, NULL);
 	mutex_init(&sl->sl_lock, NULL, MUTEX_DRIVER, NULL);
 	mutex_init(&sl->sl_metadata_lock, NULL, MUTEX_DRIVER, NULL);
+	mutex_init(&sl->sl_zvol_rd_lock, NULL, MUTEX_DRIVER, NULL);
 	rw_init(&sl->sl_access_state_lock, NULL, RW_DRIVER, NULL);
 	p = ((char *)sl) + sizeof (sbd_lu_t) + sizeof (sbd_pgr_t);
 	sl->sl_data_filename = p;
@@ -2168,6 +2208,7 @@ sbd_create_standby_lu(sbd_create_standby_lu_t *slu, uint32_t *err_ret)
 	rw_init(&sl->sl_pgr->pgr_lock, NULL, RW_DRIVER, NULL);
 	mutex_init(&sl->sl_lock, NULL, MUTEX_DRIVER, NULL);
 	mutex_init(&sl->sl_metadata_lock, NULL, MUTEX_DRIVER, NULL);
+	mutex_init(&sl->sl_zvol_rd_lock, NULL, MUTEX_DRIVER, NULL);
 	rw_init(&sl->sl_access_state_lock, NULL, RW_DRIVER, NULL);
 
 	sl->sl_trans_op = SL_OP_CREATE_REGISTER_LU;
@@ -2310,6 +2351,7 @@ sbd_import_lu(sbd_import_lu_t *ilu, int struct_sz, uint32_t *err_ret,
 		rw_init(&sl->sl_access_state_lock, NULL, RW_DRIVER, NULL);
 		mutex_init(&sl->sl_lock, NULL, MUTEX_DRIVER, NULL);
 		mutex_init(&sl->sl_metadata_lock, NULL, MUTEX_DRIVER, NULL);
+		mutex_init(&sl->sl_zvol_rd_lock, NULL, MUTEX_DRIVER, NULL);
 		sl->sl_trans_op = SL_OP_IMPORT_LU;
 	} else {
 		*err_ret = SBD_RET_META_FILE_LOOKUP_FAILED;
@@ -3031,9 +3073,11 @@ sbd_data_read(sbd_lu_t *sl, struct scsi_task *task,
 		rw_exit(&sl->sl_access_state_lock);
 		return (SBD_FAILURE);
 	}
+	SBD_KSTAT_INC(sl, sk_reads_active);
 	ret = vn_rdwr(UIO_READ, sl->sl_data_vp, (caddr_t)buf, (ssize_t)size,
 	    (offset_t)offset, UIO_SYSSPACE, 0, RLIM64_INFINITY, CRED(),
 	    &resid);
+	SBD_KSTAT_DEC(sl, sk_reads_active);
 	rw_exit(&sl->sl_access_state_lock);
 
 	DTRACE_PROBE6(backing__store__read__end, sbd_lu_t *, sl,
@@ -3087,9 +3131,11 @@ sbd_data_write(sbd_lu_t *sl, struct scsi_task *task,
 		rw_exit(&sl->sl_access_state_lock);
 		return (SBD_FAILURE);
 	}
+	SBD_KSTAT_INC(sl, sk_writes_active);
 	ret = vn_rdwr(UIO_WRITE, sl->sl_data_vp, (caddr_t)buf, (ssize_t)size,
 	    (offset_t)offset, UIO_SYSSPACE, ioflag, RLIM64_INFINITY, CRED(),
 	    &resid);
+	SBD_KSTAT_DEC(sl, sk_writes_active);
 	rw_exit(&sl->sl_access_state_lock);
 
 	DTRACE_PROBE6(backing__store__write__end, sbd_lu_t *, sl,
@@ -206,6 +206,11 @@ typedef struct sbd_cmd {
 	uint32_t	len;		/* len left */
 	uint32_t	current_ro;	/* running relative offset */
 	uint8_t		*trans_data;	/* Any transient data */
+	/* asynchronous zvol reads, see sbd_do_sgl_read_xfer() */
+	uint8_t		nreads;		/* started and not yet collected */
+	uint32_t	rd_ro;		/* next offset for the port */
+	struct stmf_data_buf *rd_done;	/* finished, sl_zvol_rd_lock */
+	struct stmf_data_buf *rd_parked; /* waiting for their turn */
 } sbd_cmd_t;
 
 /*
@@ -272,6 +277,12 @@ typedef struct sbd_zvol_io {
 	void 		*zvio_dbp;	/* array of dmu buffers */
 	void		*zvio_abp;	/* array of arc buffers */
 	uio_t		*zvio_uio;	/* for copy operations */
+	/* ZVIO_ASYNC reads */
+	void		*zvio_rl;	/* range lock */
+	int		zvio_err;	/* result of the read */
+	void		(*zvio_done)(struct stmf_data_buf *);
+	struct scsi_task *zvio_task;
+	struct stmf_data_buf *zvio_next;
 } sbd_zvol_io_t;
 
 #define	ZVIO_DEFAULT	0
@@ -286,6 +297,8 @@ typedef struct sbd_zvol_io {
 int sbd_zvol_get_volume_params(sbd_lu_t *sl);
 uint32_t sbd_zvol_numsegs(sbd_lu_t *sl, uint64_t off, uint32_t len);
 int sbd_zvol_alloc_read_bufs(sbd_lu_t *sl, stmf_data_buf_t *dbuf);
+int sbd_zvol_alloc_read_bufs_async(sbd_lu_t *sl, stmf_data_buf_t *dbuf,
+    void (*done)(stmf_data_buf_t *));
 void sbd_zvol_rele_read_bufs(sbd_lu_t *sl, stmf_data_buf_t *dbuf);
 int sbd_zvol_alloc_write_bufs(sbd_lu_t *sl, stmf_data_buf_t *dbuf);
 void sbd_zvol_rele_write_bufs_abort(sbd_lu_t *sl, stmf_data_buf_t *dbuf);
@@ -298,6 +311,7 @@ void sbd_new_task(struct scsi_task *task, struct stmf_data_buf *initial_dbuf);
 void sbd_dbuf_xfer_done(struct scsi_task *task, struct stmf_data_buf *dbuf);
 void sbd_send_status_done(struct scsi_task *task);
 void sbd_task_free(struct scsi_task *task);
+void sbd_task_poll(struct scsi_task *task);
 stmf_status_t sbd_abort(struct stmf_lu *lu, int abort_cmd, void *arg,
 							uint32_t flags);
 void sbd_dbuf_free(struct scsi_task *task, struct stmf_data_buf *dbuf);
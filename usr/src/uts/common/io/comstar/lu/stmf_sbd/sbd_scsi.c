@@ -201,10 +201,234 @@ sbd_do_read_xfer(struct scsi_task *task, sbd_cmd_t *scmd,
  * 4 - only write on
  */
 int sbd_zcopy = 1;	/* enable zcopy read & write path */
+int sbd_zvol_async_read = 1;	/* don't wait for zvol reads in the worker */
 uint32_t sbd_max_xfer_len = 0;		/* Valid if non-zero */
 uint32_t sbd_1st_xfer_len = 0;		/* Valid if non-zero */
 uint32_t sbd_copy_threshold = 0;		/* Valid if non-zero */
 
+/*
+ * Hand a dbuf filled from the zvol to the port provider.  The dbuf is
+ * not counted in scmd->nbufs on entry.  Returns 0 once the port provider
+ * has it, EAGAIN if it cannot take it just now, in which case the dbuf
+ * and its dmu buffers are still ours, or ECANCELED if the task is being
+ * aborted, the dbuf then being cleaned up with the task.
+ */
+static int
+sbd_sgl_read_xfer_start(struct scsi_task *task, sbd_cmd_t *scmd,
+    stmf_data_buf_t *dbuf)
+{
+	sbd_zvol_io_t *zvio = dbuf->db_lu_private;
+	stmf_status_t xstat;
+
+	/*
+	 * Allow PP to do setup
+	 */
+	xstat = stmf_setup_dbuf(task, dbuf, 0);
+	if (xstat != STMF_SUCCESS) {
+		/*
+		 * This could happen if the driver cannot get the
+		 * DDI resources it needs for this request.
+		 */
+		return (EAGAIN);
+	}
+	/*
+	 * dbuf is now queued on task
+	 */
+	scmd->nbufs++;
+
+	/* XXX leave this in for FW? */
+	DTRACE_PROBE4(sbd__xfer, struct scsi_task *, task,
+	    struct stmf_data_buf *, dbuf, uint64_t, zvio->zvio_offset,
+	    uint32_t, dbuf->db_data_size);
+	/*
+	 * Do not pass STMF_IOF_LU_DONE so that the zvol
+	 * state can be released in the completion callback.
+	 */
+	xstat = stmf_xfer_data(task, dbuf, 0);
+	switch (xstat) {
+	case STMF_SUCCESS:
+		break;
+	case STMF_BUSY:
+		/*
+		 * The dbuf is queued on the task, but unknown
+		 * to the PP, thus no completion will occur.
+		 */
+		stmf_teardown_dbuf(task, dbuf);
+		scmd->nbufs--;
+		return (EAGAIN);
+	case STMF_ABORTED:
+		/*
+		 * Completion from task_done will cleanup
+		 */
+		scmd->flags &= ~SBD_SCSI_CMD_ACTIVE;
+		return (ECANCELED);
+	}
+	return (0);
+}
+
+/*
+ * Asynchronous zvol reads.
+ *
+ * With sbd_zvol_async_read set, sbd_do_sgl_read_xfer() starts the reads
+ * for a command's dbufs and returns without waiting for them, leaving
+ * the worker free for other tasks.  Each read completes in
+ * sbd_sgl_read_done(), which queues its dbuf on scmd->rd_done and asks
+ * for the task's worker to call sbd_task_poll().  That sorts the dbufs
+ * into scmd->rd_parked and hands them to the port provider in offset
+ * order, as some port providers need the data of a command in order,
+ * and the last dbuf carries the status.  A read counts in scmd->nbufs
+ * from the time it is started, and in scmd->nreads until it has been
+ * picked up from rd_done.
+ */
+static void
+sbd_sgl_read_discard(sbd_lu_t *sl, sbd_cmd_t *scmd, stmf_data_buf_t *dbuf)
+{
+	sbd_zvol_io_t *zvio = dbuf->db_lu_private;
+
+	if (zvio->zvio_err == 0)
+		sbd_zvol_rele_read_bufs(sl, dbuf);
+	stmf_free(dbuf);
+	scmd->nbufs--;
+}
+
+/*
+ * Called from a zio completion thread, or from within
+ * sbd_zvol_alloc_read_bufs_async() if the data was cached.  The poll
+ * is asked for under sl_zvol_rd_lock, so the worker cannot pick the
+ * dbuf up, and finish the task, before it has been.
+ */
+static void
+sbd_sgl_read_done(stmf_data_buf_t *dbuf)
+{
+	sbd_zvol_io_t *zvio = dbuf->db_lu_private;
+	scsi_task_t *task = zvio->zvio_task;
+	sbd_cmd_t *scmd = (sbd_cmd_t *)task->task_lu_private;
+	sbd_lu_t *sl = (sbd_lu_t *)task->task_lu->lu_provider_private;
+
+	SBD_KSTAT_DEC(sl, sk_reads_active);
+	DTRACE_PROBE6(backing__store__read__end, sbd_lu_t *, sl,
+	    uint8_t *, NULL, uint64_t, dbuf->db_data_size,
+	    uint64_t, zvio->zvio_offset, int, zvio->zvio_err,
+	    scsi_task_t *, task);
+
+	mutex_enter(&sl->sl_zvol_rd_lock);
+	zvio->zvio_next = scmd->rd_done;
+	scmd->rd_done = dbuf;
+	if (stmf_task_poll_lu(task, STMF_POLL_NOW) != STMF_SUCCESS) {
+		/*
+		 * The task's command stack is full, which its few dbufs
+		 * should never do.  The abort picks the read up.
+		 */
+		stmf_abort(STMF_QUEUE_TASK_ABORT, task, STMF_ALLOC_FAILURE,
+		    NULL);
+	}
+	mutex_exit(&sl->sl_zvol_rd_lock);
+}
+
+/*
+ * Move the finished reads from rd_done to rd_parked, in offset order.
+ */
+static void
+sbd_sgl_read_gather(sbd_lu_t *sl, sbd_cmd_t *scmd)
+{
+	stmf_data_buf_t *dbuf, *next, **dpp;
+	sbd_zvol_io_t *zvio;
+
+	mutex_enter(&sl->sl_zvol_rd_lock);
+	dbuf = scmd->rd_done;
+	scmd->rd_done = NULL;
+	mutex_exit(&sl->sl_zvol_rd_lock);
+
+	for (; dbuf != NULL; dbuf = next) {
+		zvio = dbuf->db_lu_private;
+		next = zvio->zvio_next;
+		ASSERT(scmd->nreads > 0);
+		scmd->nreads--;
+
+		dpp = &scmd->rd_parked;
+		while (*dpp != NULL && (*dpp)->db_relative_offset <
+		    dbuf->db_relative_offset) {
+			dpp = &((sbd_zvol_io_t *)
+			    (*dpp)->db_lu_private)->zvio_next;
+		}
+		zvio->zvio_next = *dpp;
+		*dpp = dbuf;
+	}
+}
+
+/*
+ * Pass the parked reads on to the port provider, as far as they are in
+ * order, or drop them if the command has failed.
+ */
+static void
+sbd_sgl_read_parked(struct scsi_task *task, sbd_cmd_t *scmd)
+{
+	sbd_lu_t *sl = (sbd_lu_t *)task->task_lu->lu_provider_private;
+	stmf_data_buf_t *dbuf, *d;
+	sbd_zvol_io_t *zvio;
+	uint32_t size;
+	int ret, nparked;
+
+	while ((dbuf = scmd->rd_parked) != NULL) {
+		zvio = dbuf->db_lu_private;
+		if (zvio->zvio_err != 0 || (scmd->flags &
+		    (SBD_SCSI_CMD_ACTIVE | SBD_SCSI_CMD_XFER_FAIL)) !=
+		    SBD_SCSI_CMD_ACTIVE) {
+			/*
+			 * This read or the command has failed: drop it.
+			 * Whoever drops the last dbuf finishes up.
+			 */
+			scmd->rd_parked = zvio->zvio_next;
+			if (zvio->zvio_err != 0)
+				scmd->flags |= SBD_SCSI_CMD_XFER_FAIL;
+			sbd_sgl_read_discard(sl, scmd, dbuf);
+			if (scmd->nbufs == 0) {
+				rw_exit(&sl->sl_access_state_lock);
+				if (scmd->flags & SBD_SCSI_CMD_ACTIVE) {
+					scmd->flags &= ~SBD_SCSI_CMD_ACTIVE;
+					stmf_scsilib_send_status(task,
+					    STATUS_CHECK, STMF_SAA_READ_ERROR);
+				}
+			}
+			continue;
+		}
+		if (dbuf->db_relative_offset != scmd->rd_ro)
+			return;		/* wait for the one before it */
+
+		scmd->rd_parked = zvio->zvio_next;
+		scmd->nbufs--;
+		size = dbuf->db_data_size;
+		ret = sbd_sgl_read_xfer_start(task, scmd, dbuf);
+		if (ret == 0) {
+			scmd->rd_ro += size;
+			continue;
+		}
+		if (ret == ECANCELED)
+			return;		/* sbd_abort() drops the rest */
+
+		/*
+		 * Put it back.  If reads are in progress, or dbufs are
+		 * with the port provider, their completion will retry;
+		 * otherwise give up on the command.
+		 */
+		scmd->nbufs++;
+		zvio->zvio_next = scmd->rd_parked;
+		scmd->rd_parked = dbuf;
+		nparked = 0;
+		for (d = dbuf; d != NULL;
+		    d = ((sbd_zvol_io_t *)d->db_lu_private)->zvio_next)
+			nparked++;
+		if (scmd->nbufs > nparked)
+			return;
+		scmd->flags &= ~SBD_SCSI_CMD_ACTIVE;
+		if (scmd->rd_ro == 0)
+			stmf_scsilib_send_status(task, STATUS_QFULL, 0);
+		else
+			stmf_scsilib_send_status(task, STATUS_CHECK,
+			    STMF_SAA_READ_ERROR);
+	}
+}
+
 static void
 sbd_do_sgl_read_xfer(struct scsi_task *task, sbd_cmd_t *scmd, int first_xfer)
 {
@@ -213,7 +437,6 @@ sbd_do_sgl_read_xfer(struct scsi_task *task, sbd_cmd_t *scmd, int first_xfer)
 	int ret, final_xfer;
 	uint64_t offset;
 	uint32_t xfer_len, max_len, first_len;
-	stmf_status_t xstat;
 	stmf_data_buf_t *dbuf;
 	uint_t nblks;
 	uint64_t blksize = sl->sl_blksize;
@@ -327,7 +550,8 @@ sbd_do_sgl_read_xfer(struct scsi_task *task, sbd_cmd_t *scmd, int first_xfer)
 		zvio = dbuf->db_lu_private;
 		/* Need absolute offset for zvol access */
 		zvio->zvio_offset = offset;
-		zvio->zvio_flags = ZVIO_SYNC;
+		zvio->zvio_flags = sbd_zvol_async_read ? ZVIO_ASYNC : ZVIO_SYNC;
+		zvio->zvio_task = task;
 
 		/*
 		 * Accounting for start of read.
@@ -336,12 +560,21 @@ sbd_do_sgl_read_xfer(struct scsi_task *task, sbd_cmd_t *scmd, int first_xfer)
 		DTRACE_PROBE5(backing__store__read__start, sbd_lu_t *, sl,
 		    uint8_t *, NULL, uint64_t, xfer_len,
 		    uint64_t, offset, scsi_task_t *, task);
+		SBD_KSTAT_INC(sl, sk_reads_active);
 
-		ret = sbd_zvol_alloc_read_bufs(sl, dbuf);
+		if (zvio->zvio_flags & ZVIO_ASYNC) {
+			ret = sbd_zvol_alloc_read_bufs_async(sl, dbuf,
+			    sbd_sgl_read_done);
+		} else {
+			ret = sbd_zvol_alloc_read_bufs(sl, dbuf);
+		}
 
-		DTRACE_PROBE6(backing__store__read__end, sbd_lu_t *, sl,
-		    uint8_t *, NULL, uint64_t, xfer_len,
-		    uint64_t, offset, int, ret, scsi_task_t *, task);
+		if (ret != 0 || (zvio->zvio_flags & ZVIO_SYNC)) {
+			SBD_KSTAT_DEC(sl, sk_reads_active);
+			DTRACE_PROBE6(backing__store__read__end, sbd_lu_t *, sl,
+			    uint8_t *, NULL, uint64_t, xfer_len,
+			    uint64_t, offset, int, ret, scsi_task_t *, task);
+		}
 
 		if (ret != 0) {
 			/*
@@ -361,83 +594,38 @@ sbd_do_sgl_read_xfer(struct scsi_task *task, sbd_cmd_t *scmd, int first_xfer)
 			return;
 		}
 
-
-		/*
-		 * Allow PP to do setup
-		 */
-		xstat = stmf_setup_dbuf(task, dbuf, 0);
-		if (xstat != STMF_SUCCESS) {
+		if (zvio->zvio_flags & ZVIO_ASYNC) {
 			/*
-			 * This could happen if the driver cannot get the
-			 * DDI resources it needs for this request.
-			 * If other dbufs are queued, try again when the next
-			 * one completes, otherwise give up.
+			 * The dbuf goes to the port provider from
+			 * sbd_task_poll() once the data is in.
 			 */
-			sbd_zvol_rele_read_bufs(sl, dbuf);
-			stmf_free(dbuf);
-			if (scmd->nbufs > 0) {
-				/* completion of previous dbuf will retry */
+			SBD_KSTAT_INC(sl, sk_zvol_async_reads);
+			scmd->nreads++;
+			scmd->nbufs++;
+		} else {
+			ret = sbd_sgl_read_xfer_start(task, scmd, dbuf);
+			if (ret == ECANCELED)
 				return;
-			}
-			/*
-			 * Done with this command.
-			 */
-			scmd->flags &= ~SBD_SCSI_CMD_ACTIVE;
-			if (first_xfer)
-				stmf_scsilib_send_status(task, STATUS_QFULL, 0);
-			else
-				stmf_scsilib_send_status(task, STATUS_CHECK,
-				    STMF_SAA_READ_ERROR);
-			rw_exit(&sl->sl_access_state_lock);
-			return;
-		}
-		/*
-		 * dbuf is now queued on task
-		 */
-		scmd->nbufs++;
-
-		/* XXX leave this in for FW? */
-		DTRACE_PROBE4(sbd__xfer, struct scsi_task *, task,
-		    struct stmf_data_buf *, dbuf, uint64_t, offset,
-		    uint32_t, xfer_len);
-		/*
-		 * Do not pass STMF_IOF_LU_DONE so that the zvol
-		 * state can be released in the completion callback.
-		 */
-		xstat = stmf_xfer_data(task, dbuf, 0);
-		switch (xstat) {
-		case STMF_SUCCESS:
-			break;
-		case STMF_BUSY:
-			/*
-			 * The dbuf is queued on the task, but unknown
-			 * to the PP, thus no completion will occur.
-			 */
-			sbd_zvol_rele_read_bufs(sl, dbuf);
-			stmf_teardown_dbuf(task, dbuf);
-			stmf_free(dbuf);
-			scmd->nbufs--;
-			if (scmd->nbufs > 0) {
-				/* completion of previous dbuf will retry */
+			if (ret != 0) {
+				sbd_zvol_rele_read_bufs(sl, dbuf);
+				stmf_free(dbuf);
+				if (scmd->nbufs > 0) {
+					/* the next completion will retry */
+					return;
+				}
+				/*
+				 * Done with this command.
+				 */
+				scmd->flags &= ~SBD_SCSI_CMD_ACTIVE;
+				if (first_xfer)
+					stmf_scsilib_send_status(task,
+					    STATUS_QFULL, 0);
+				else
+					stmf_scsilib_send_status(task,
+					    STATUS_CHECK, STMF_SAA_READ_ERROR);
+				rw_exit(&sl->sl_access_state_lock);
 				return;
 			}
-			/*
-			 * Done with this command.
-			 */
-			rw_exit(&sl->sl_access_state_lock);
-			scmd->flags &= ~SBD_SCSI_CMD_ACTIVE;
-			if (first_xfer)
-				stmf_scsilib_send_status(task, STATUS_QFULL, 0);
-			else
-				stmf_scsilib_send_status(task, STATUS_CHECK,
-				    STMF_SAA_READ_ERROR);
-			return;
-		case STMF_ABORTED:
-			/*
-			 * Completion from task_done will cleanup
-			 */
-			scmd->flags &= ~SBD_SCSI_CMD_ACTIVE;
-			return;
 		}
 		/*
 		 * Update the xfer progress.
@@ -446,6 +634,9 @@ sbd_do_sgl_read_xfer(struct scsi_task *task, sbd_cmd_t *scmd, int first_xfer)
 		scmd->len -= xfer_len;
 		scmd->current_ro += xfer_len;
 	}
+
+	if (scmd->rd_parked != NULL)
+		sbd_sgl_read_parked(task, scmd);
 }
 
 void
@@ -633,7 +824,9 @@ sbd_handle_sgl_write_xfer_completion(struct scsi_task *task, sbd_cmd_t *scmd,
 		else
 			zvio->zvio_flags = 0;
 		/* write the data */
+		SBD_KSTAT_INC(sl, sk_writes_active);
 		ret = sbd_zvol_rele_write_bufs(sl, dbuf);
+		SBD_KSTAT_DEC(sl, sk_writes_active);
 	}
 
 	DTRACE_PROBE6(backing__store__write__end, sbd_lu_t *, sl,
@@ -770,7 +963,9 @@ sbd_copy_rdwr(scsi_task_t *task, uint64_t laddr, stmf_data_buf_t *dbuf,
 		    scsi_task_t *, task);
 
 		/* Fetch the data */
+		SBD_KSTAT_INC(sl, sk_reads_active);
 		ret = sbd_zvol_copy_read(sl, &uio);
+		SBD_KSTAT_DEC(sl, sk_reads_active);
 
 		DTRACE_PROBE6(backing__store__read__end, sbd_lu_t *, sl,
 		    uint8_t *, NULL, uint64_t, len, uint64_t, laddr, int, ret,
@@ -784,7 +979,9 @@ sbd_copy_rdwr(scsi_task_t *task, uint64_t laddr, stmf_data_buf_t *dbuf,
 
 		flags = (commit) ? ZVIO_COMMIT : 0;
 		/* Write the data */
+		SBD_KSTAT_INC(sl, sk_writes_active);
 		ret = sbd_zvol_copy_write(sl, &uio, flags);
+		SBD_KSTAT_DEC(sl, sk_writes_active);
 
 		DTRACE_PROBE6(backing__store__write__end, sbd_lu_t *, sl,
 		    uint8_t *, NULL, uint64_t, len, uint64_t, laddr, int, ret,
@@ -941,6 +1138,10 @@ sbd_handle_read(struct scsi_task *task, struct stmf_data_buf *initial_dbuf)
 		scmd->addr = laddr;
 		scmd->len = len;
 		scmd->current_ro = 0;
+		scmd->nreads = 0;
+		scmd->rd_ro = 0;
+		scmd->rd_done = NULL;
+		scmd->rd_parked = NULL;
 
 		/*
 		 * Kick-off the read.
@@ -999,6 +1200,9 @@ sbd_handle_read(struct scsi_task *task, struct stmf_data_buf *initial_dbuf)
 	scmd->addr = laddr;
 	scmd->len = len;
 	scmd->current_ro = 0;
+	scmd->nreads = 0;
+	scmd->rd_done = NULL;
+	scmd->rd_parked = NULL;
 
 	sbd_do_read_xfer(task, scmd, dbuf);
 }
@@ -3507,6 +3711,41 @@ sbd_task_free(struct scsi_task *task)
 	}
 }
 
+/*
+ * Called by the task's worker after sbd_sgl_read_done() asked for it.
+ */
+void
+sbd_task_poll(struct scsi_task *task)
+{
+	sbd_lu_t *sl = (sbd_lu_t *)task->task_lu->lu_provider_private;
+	sbd_cmd_t *scmd = (sbd_cmd_t *)task->task_lu_private;
+
+	if (scmd == NULL || scmd->cmd_type != SBD_CMD_SCSI_READ)
+		return;
+	sbd_sgl_read_gather(sl, scmd);
+	sbd_sgl_read_parked(task, scmd);
+}
+
+/*
+ * Drop the finished asynchronous zvol reads of a task being aborted.
+ * Returns the number still in progress.
+ */
+static int
+sbd_sgl_read_abort(sbd_lu_t *sl, sbd_cmd_t *scmd)
+{
+	stmf_data_buf_t *dbuf;
+
+	sbd_sgl_read_gather(sl, scmd);
+	while ((dbuf = scmd->rd_parked) != NULL) {
+		scmd->rd_parked =
+		    ((sbd_zvol_io_t *)dbuf->db_lu_private)->zvio_next;
+		sbd_sgl_read_discard(sl, scmd, dbuf);
+		if (scmd->nbufs == 0)
+			rw_exit(&sl->sl_access_state_lock);
+	}
+	return (scmd->nreads);
+}
+
 /*
  * Aborts are synchronus w.r.t. I/O AND
  * All the I/O which SBD does is synchronous AND
@@ -3514,6 +3753,9 @@ sbd_task_free(struct scsi_task *task)
  *   IT MEANS
  * If this function is called, we are doing nothing with this task
  * inside of sbd module.
+ *
+ * The exception is asynchronous zvol reads: while any of the task's
+ * are in progress we return STMF_BUSY, and stmf calls us again later.
  */
 /* ARGSUSED */
 stmf_status_t
@@ -3537,6 +3779,9 @@ sbd_abort(struct stmf_lu *lu, int abort_cmd, void *arg, uint32_t flags)
 	if (task->task_lu_private) {
 		sbd_cmd_t *scmd = (sbd_cmd_t *)task->task_lu_private;
 
+		if (scmd->cmd_type == SBD_CMD_SCSI_READ &&
+		    sbd_sgl_read_abort(sl, scmd) != 0)
+			return (STMF_BUSY);
 		if (scmd->flags & SBD_SCSI_CMD_ACTIVE) {
 			if (scmd->flags & SBD_SCSI_CMD_TRANS_DATA) {
 				kmem_free(scmd->trans_data,
@@ -59,6 +59,7 @@
  *
  * FUNCTIONS
  *    dmu_buf_hold_array_by_bonus()
+ *    dmu_buf_hold_array_by_bonus_async()
  *    dmu_buf_rele_array()
  *
  *    dmu_request_arc_buf()
@@ -141,13 +142,49 @@ sbd_zvol_numsegs(sbd_lu_t *sl, uint64_t off, uint32_t len)
 	return ((uint32_t)numsegs);
 }
 
+static void *RDTAG = "sbd_zvol_read";
+
+/*
+ * Fill in db_sglist from the dmu_buf_t array.
+ */
+static void
+sbd_zvol_fill_read_sgl(stmf_data_buf_t *dbuf, int numbufs, dmu_buf_t **dbpp)
+{
+	sbd_zvol_io_t	*zvio = dbuf->db_lu_private;
+	uint64_t 	len = dbuf->db_data_size;
+	uint64_t 	offset = zvio->zvio_offset;
+	dmu_buf_t	*dbp;
+	int		i;
+	stmf_sglist_ent_t *sgl;
+	uint64_t	odiff, seglen;
+
+	zvio->zvio_dbp = dbpp;
+	/* make sure db_sglist is large enough */
+	if (dbuf->db_sglist_length != numbufs) {
+		cmn_err(CE_PANIC, "wrong size sglist: dbuf %d != %d\n",
+		    dbuf->db_sglist_length, numbufs);
+	}
+
+	sgl = &dbuf->db_sglist[0];
+	for (i = 0; i < numbufs; i++) {
+		dbp = dbpp[i];
+		odiff =  offset - dbp->db_offset;
+		ASSERT(odiff == 0 || i == 0);
+		sgl->seg_addr = (uint8_t *)dbp->db_data + odiff;
+		seglen = MIN(len, dbp->db_size - odiff);
+		sgl->seg_length = (uint32_t)seglen;
+		offset += seglen;
+		len -= seglen;
+		sgl++;
+	}
+	ASSERT(len == 0);
+}
+
 /*
  * Return an array of dmu_buf_t pointers for the requested range.
  * The dmu buffers are either in cache or read in synchronously.
  * Fill in the dbuf sglist from the dmu_buf_t array.
  */
-static void *RDTAG = "sbd_zvol_read";
-
 int
 sbd_zvol_alloc_read_bufs(sbd_lu_t *sl, stmf_data_buf_t *dbuf)
 {
@@ -156,7 +193,7 @@ sbd_zvol_alloc_read_bufs(sbd_lu_t *sl, stmf_data_buf_t *dbuf)
 	int 		numbufs, error;
 	uint64_t 	len = dbuf->db_data_size;
 	uint64_t 	offset = zvio->zvio_offset;
-	dmu_buf_t	**dbpp, *dbp;
+	dmu_buf_t	**dbpp;
 
 	/* Make sure request is reasonable */
 	if (len > sl->sl_max_xfer_len)
@@ -178,35 +215,59 @@ sbd_zvol_alloc_read_bufs(sbd_lu_t *sl, stmf_data_buf_t *dbuf)
 	if (error == ECKSUM)
 		error = EIO;
 
-	if (error == 0) {
-		/*
-		 * Fill in db_sglist from the dmu_buf_t array.
-		 */
-		int		i;
-		stmf_sglist_ent_t *sgl;
-		uint64_t	odiff, seglen;
-
-		zvio->zvio_dbp = dbpp;
-		/* make sure db_sglist is large enough */
-		if (dbuf->db_sglist_length != numbufs) {
-			cmn_err(CE_PANIC, "wrong size sglist: dbuf %d != %d\n",
-			    dbuf->db_sglist_length, numbufs);
-		}
+	if (error == 0)
+		sbd_zvol_fill_read_sgl(dbuf, numbufs, dbpp);
+	return (error);
+}
 
-		sgl = &dbuf->db_sglist[0];
-		for (i = 0; i < numbufs; i++) {
-			dbp = dbpp[i];
-			odiff =  offset - dbp->db_offset;
-			ASSERT(odiff == 0 || i == 0);
-			sgl->seg_addr = (uint8_t *)dbp->db_data + odiff;
-			seglen = MIN(len, dbp->db_size - odiff);
-			sgl->seg_length = (uint32_t)seglen;
-			offset += seglen;
-			len -= seglen;
-			sgl++;
-		}
-		ASSERT(len == 0);
+static void
+sbd_zvol_read_done(void *arg, int error, int numbufs, dmu_buf_t **dbpp)
+{
+	stmf_data_buf_t	*dbuf = arg;
+	sbd_zvol_io_t	*zvio = dbuf->db_lu_private;
+
+	zfs_range_unlock(zvio->zvio_rl);
+
+	if (error == ECKSUM)
+		error = EIO;
+	if (error == 0)
+		sbd_zvol_fill_read_sgl(dbuf, numbufs, dbpp);
+	zvio->zvio_err = error;
+	zvio->zvio_done(dbuf);
+}
+
+/*
+ * As sbd_zvol_alloc_read_bufs(), but do not wait for the dmu buffers
+ * to be read in.  If this returns 0, done is called with the dbuf, and
+ * the result in zvio_err, once they are in; that may be from a zio
+ * completion thread, or before we return if they were all cached.
+ * The range lock is held until then.
+ */
+int
+sbd_zvol_alloc_read_bufs_async(sbd_lu_t *sl, stmf_data_buf_t *dbuf,
+    void (*done)(stmf_data_buf_t *))
+{
+	sbd_zvol_io_t	*zvio = dbuf->db_lu_private;
+	uint64_t 	len = dbuf->db_data_size;
+	uint64_t 	offset = zvio->zvio_offset;
+	int		error;
+
+	/* Make sure request is reasonable */
+	if (len > sl->sl_max_xfer_len)
+		return (E2BIG);
+	if (offset + len  > zvol_get_volume_size(sl->sl_zvol_minor_hdl))
+		return (EIO);
+
+	zvio->zvio_done = done;
+	zvio->zvio_rl = zfs_range_lock(sl->sl_zvol_rl_hdl, offset, len,
+	    RL_READER);
 
+	error = dmu_buf_hold_array_by_bonus_async(sl->sl_zvol_bonus_hdl,
+	    offset, len, RDTAG, sbd_zvol_read_done, dbuf);
+	if (error != 0) {
+		zfs_range_unlock(zvio->zvio_rl);
+		if (error == ECKSUM)
+			error = EIO;
 	}
 	return (error);
 }
@@ -179,6 +179,21 @@ typedef struct sbd_lu_info_1_1 {
 
 struct sbd_it_data;
 
+/*
+ * Per-LU backing store statistics, the "sbd_lu_<addr>" kstat.
+ */
+typedef struct sbd_lu_kstat {
+	kstat_named_t	sk_guid;
+	kstat_named_t	sk_reads_active;	/* backing store reads */
+	kstat_named_t	sk_writes_active;	/* backing store writes */
+	kstat_named_t	sk_zvol_async_reads;	/* zvol reads not waited on */
+} sbd_lu_kstat_t;
+
+#define	SBD_KSTAT_INC(sl, f)	\
+	atomic_inc_64(&(sl)->sl_kstat_data.f.value.ui64)
+#define	SBD_KSTAT_DEC(sl, f)	\
+	atomic_dec_64(&(sl)->sl_kstat_data.f.value.ui64)
+
 typedef struct sbd_lu {
 	struct sbd_lu	*sl_next;
 	stmf_lu_t	*sl_lu;
@@ -244,6 +259,13 @@ typedef struct sbd_lu {
 	struct sbd_it_data	*sl_it_list;
 	struct sbd_pgr		*sl_pgr;
 	uint64_t	sl_rs_owner_session_id;
+
+	/* zvol reads that have finished, per task; see sbd_scsi.c */
+	kmutex_t	sl_zvol_rd_lock;
+
+	kstat_t		*sl_kstat;
+	sbd_lu_kstat_t	sl_kstat_data;
+	char		sl_kstat_guid[33];
 } sbd_lu_t;
 
 /*
@@ -291,6 +313,7 @@ void sbd_new_task(struct scsi_task *task, struct stmf_data_buf *initial_dbuf);
 void sbd_dbuf_xfer_done(struct scsi_task *task, struct stmf_data_buf *dbuf);
 void sbd_send_status_done(struct scsi_task *task);
 void sbd_task_free(struct scsi_task *task);
+void sbd_task_poll(struct scsi_task *task);
 stmf_status_t sbd_abort(struct stmf_lu *lu, int abort_cmd, void *arg,
     uint32_t flags);
 void sbd_ctl(struct stmf_lu *lu, int cmd, void *arg);
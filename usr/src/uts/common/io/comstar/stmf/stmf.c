@@ -5075,7 +5075,9 @@ stmf_task_poll_lu(scsi_task_t *task, uint32_t timeout)
 		}
 	}
 	itask->itask_cmd_stack[itask->itask_ncmds++] = ITASK_CMD_POLL_LU;
-	if (timeout == ITASK_DEFAULT_POLL_TIMEOUT) {
+	if (timeout == STMF_POLL_NOW) {
+		itask->itask_poll_timeout = ddi_get_lbolt();
+	} else if (timeout == ITASK_DEFAULT_POLL_TIMEOUT) {
 		itask->itask_poll_timeout = ddi_get_lbolt() + 1;
 	} else {
 		clock_t t = drv_usectohz(timeout * 1000);
@@ -5123,7 +5125,9 @@ stmf_task_poll_lport(scsi_task_t *task, uint32_t timeout)
 		}
 	}
 	itask->itask_cmd_stack[itask->itask_ncmds++] = ITASK_CMD_POLL_LPORT;
-	if (timeout == ITASK_DEFAULT_POLL_TIMEOUT) {
+	if (timeout == STMF_POLL_NOW) {
+		itask->itask_poll_timeout = ddi_get_lbolt();
+	} else if (timeout == ITASK_DEFAULT_POLL_TIMEOUT) {
 		itask->itask_poll_timeout = ddi_get_lbolt() + 1;
 	} else {
 		clock_t t = drv_usectohz(timeout * 1000);
@@ -226,11 +226,20 @@ dpinfo(dev_info_t *dip, ddi_info_cmd_t infocmd, void *arg, void **result)
 
 /*
  * dp_pcache_poll has similar logic to pcache_poll() in poll.c. The major
- * differences are: (1) /dev/poll requires scanning the bitmap starting at
- * where it was stopped last time, instead of always starting from 0,
- * (2) since user may not have cleaned up the cached fds when they are
- * closed, some polldats in cache may refer to closed or reused fds. We
- * need to check for those cases.
+ * differences are: (1) /dev/poll does not scan the bitmap; it walks the
+ * ready list of the pollcache, which holds only the fds that have been
+ * cached since the last DP_POLL or notified by pollwakeup(), so the work
+ * done is proportional to the number of ready fds rather than to the size
+ * of the fd space, (2) since user may not have cleaned up the cached fds
+ * when they are closed, some polldats in cache may refer to closed or
+ * reused fds. We need to check for those cases.
+ *
+ * Every examined entry is moved to the tail of the ready list, and only
+ * the entries that were on the list on entry are examined, so that fds
+ * which stay ready can not starve the others. An entry leaves the list
+ * when VOP_POLL reports no events and the driver gave us a pollhead to
+ * wait on (it is put back by pollwakeup()), when it is reported for a
+ * POLLET fd, or when a POLLONESHOT fd is disarmed.
  *
  * NOTE: Upon closing an fd, automatic poll cache cleanup is done for
  *	 poll(2) caches but NOT for /dev/poll caches. So expect some
@@ -239,17 +248,16 @@ dpinfo(dev_info_t *dip, ddi_info_cmd_t infocmd, void *arg, void **result)
 static int
 dp_pcache_poll(pollfd_t *pfdp, pollcache_t *pcp, nfds_t nfds, int *fdcntp)
 {
-	int		start, ostart, end;
+	int		nready;
 	int		fdcnt, fd;
-	boolean_t	done;
 	file_t		*fp;
 	short		revent;
-	boolean_t	no_wrap;
 	pollhead_t	*php;
 	polldat_t	*pdp;
 	int		error = 0;
 
 	ASSERT(MUTEX_HELD(&pcp->pc_lock));
+	ASSERT(pcp->pc_flag & PC_RDYLIST);
 	if (pcp->pc_bitmap == NULL) {
 		/*
 		 * No Need to search because no poll fd
@@ -257,172 +265,146 @@ dp_pcache_poll(pollfd_t *pfdp, pollcache_t *pcp, nfds_t nfds, int *fdcntp)
 		 */
 		return (error);
 	}
-retry:
-	start = ostart = pcp->pc_mapstart;
-	end = pcp->pc_mapend;
-	php = NULL;
-
-	if (start == 0) {
-		/*
-		 * started from every begining, no need to wrap around.
-		 */
-		no_wrap = B_TRUE;
-	} else {
-		no_wrap = B_FALSE;
-	}
-	done = B_FALSE;
 	fdcnt = 0;
-	while ((fdcnt < nfds) && !done) {
+	nready = pcp->pc_nready;
+	while ((fdcnt < nfds) && (nready-- > 0)) {
+		pdp = list_remove_head(&pcp->pc_rdylist);
+		ASSERT(pdp != NULL);
+		list_insert_tail(&pcp->pc_rdylist, pdp);
+		fd = pdp->pd_fd;
+repoll:
 		php = NULL;
 		revent = 0;
+		ASSERT(pdp->pd_pcache == pcp);
+		if (pdp->pd_fp == NULL) {
+			/*
+			 * The fd is POLLREMOVed or was never validly
+			 * cached. This fd is logically no longer cached.
+			 */
+			pcache_unready(pcp, pdp);
+			continue;
+		}
+		if ((pdp->pd_events & ~POLLDPFLAGS) == 0 &&
+		    (pdp->pd_events & POLLONESHOT)) {
+			/*
+			 * A POLLONESHOT fd that already reported its
+			 * event stays quiet until it is written again.
+			 */
+			pcache_unready(pcp, pdp);
+			continue;
+		}
+		if ((fp = getf(fd)) == NULL) {
+			/*
+			 * The fd has been closed, but user has not
+			 * done a POLLREMOVE on this fd yet. Instead
+			 * of cleaning it here implicitly, we return
+			 * POLLNVAL. This is consistent with poll(2)
+			 * polling a closed fd. Hope this will remind
+			 * user to do a POLLREMOVE.
+			 */
+			pfdp[fdcnt].fd = fd;
+			pfdp[fdcnt].revents = POLLNVAL;
+			fdcnt++;
+			continue;
+		}
+		if (fp != pdp->pd_fp) {
+			/*
+			 * user is polling on a cached fd which was
+			 * closed and then reused. Unfortunately
+			 * there is no good way to inform user.
+			 * If the file struct is also reused, we
+			 * may not be able to detect the fd reuse
+			 * at all.  As long as this does not
+			 * cause system failure and/or memory leak,
+			 * we will play along. Man page states if
+			 * user does not clean up closed fds, polling
+			 * results will be indeterministic.
+			 *
+			 * XXX - perhaps log the detection of fd
+			 *	 reuse?
+			 */
+			pdp->pd_fp = fp;
+		}
 		/*
-		 * Examine the bit map in a circular fashion
-		 * to avoid starvation. Always resume from
-		 * last stop. Scan till end of the map. Then
-		 * wrap around.
+		 * XXX - pollrelock() logic needs to know which
+		 * which pollcache lock to grab. It'd be a
+		 * cleaner solution if we could pass pcp as
+		 * an arguement in VOP_POLL interface instead
+		 * of implicitly passing it using thread_t
+		 * struct. On the other hand, changing VOP_POLL
+		 * interface will require all driver/file system
+		 * poll routine to change. May want to revisit
+		 * the tradeoff later.
 		 */
-		fd = bt_getlowbit(pcp->pc_bitmap, start, end);
-		ASSERT(fd <= end);
-		if (fd >= 0) {
-			if (fd == end) {
-				if (no_wrap) {
-					done = B_TRUE;
-				} else {
-					start = 0;
-					end = ostart - 1;
-					no_wrap = B_TRUE;
-				}
-			} else {
-				start = fd + 1;
-			}
-			pdp = pcache_lookup_fd(pcp, fd);
-repoll:
-			ASSERT(pdp != NULL);
-			ASSERT(pdp->pd_fd == fd);
-			if (pdp->pd_fp == NULL) {
-				/*
-				 * The fd is POLLREMOVed. This fd is
-				 * logically no longer cached. So move
-				 * on to the next one.
-				 */
-				continue;
-			}
-			if ((fp = getf(fd)) == NULL) {
+		curthread->t_pollcache = pcp;
+		error = VOP_POLL(fp->f_vnode, pdp->pd_events & ~POLLDPFLAGS,
+		    0, &revent, &php, NULL);
+		curthread->t_pollcache = NULL;
+		releasef(fd);
+		if (error != 0) {
+			break;
+		}
+		/*
+		 * layered devices (e.g. console driver)
+		 * may change the vnode and thus the pollhead
+		 * pointer out from underneath us.
+		 */
+		if (php != NULL && pdp->pd_php != NULL &&
+		    php != pdp->pd_php) {
+			pollhead_delete(pdp->pd_php, pdp);
+			pdp->pd_php = php;
+			pollhead_insert(php, pdp);
+			goto repoll;
+		}
+
+		if (revent != 0) {
+			pfdp[fdcnt].fd = fd;
+			pfdp[fdcnt].events = pdp->pd_events;
+			pfdp[fdcnt].revents = revent;
+			fdcnt++;
+			if (pdp->pd_events & POLLONESHOT) {
 				/*
-				 * The fd has been closed, but user has not
-				 * done a POLLREMOVE on this fd yet. Instead
-				 * of cleaning it here implicitly, we return
-				 * POLLNVAL. This is consistent with poll(2)
-				 * polling a closed fd. Hope this will remind
-				 * user to do a POLLREMOVE.
+				 * Disarm the fd; a write to /dev/poll
+				 * re-arms it with new events.
 				 */
-				pfdp[fdcnt].fd = fd;
-				pfdp[fdcnt].revents = POLLNVAL;
-				fdcnt++;
-				continue;
-			}
-			if (fp != pdp->pd_fp) {
+				pdp->pd_events &= POLLDPFLAGS;
+				pcache_unready(pcp, pdp);
+			} else if ((pdp->pd_events & POLLET) &&
+			    (pdp->pd_php != NULL) &&
+			    ((pcp->pc_flag & T_POLLWAKE) == 0)) {
 				/*
-				 * user is polling on a cached fd which was
-				 * closed and then reused. Unfortunately
-				 * there is no good way to inform user.
-				 * If the file struct is also reused, we
-				 * may not be able to detect the fd reuse
-				 * at all.  As long as this does not
-				 * cause system failure and/or memory leak,
-				 * we will play along. Man page states if
-				 * user does not clean up closed fds, polling
-				 * results will be indeterministic.
-				 *
-				 * XXX - perhaps log the detection of fd
-				 *	 reuse?
+				 * Edge-triggered: report the fd again
+				 * only after the next pollwakeup().
 				 */
-				pdp->pd_fp = fp;
+				pcache_unready(pcp, pdp);
 			}
+		} else if (php != NULL) {
 			/*
-			 * XXX - pollrelock() logic needs to know which
-			 * which pollcache lock to grab. It'd be a
-			 * cleaner solution if we could pass pcp as
-			 * an arguement in VOP_POLL interface instead
-			 * of implicitly passing it using thread_t
-			 * struct. On the other hand, changing VOP_POLL
-			 * interface will require all driver/file system
-			 * poll routine to change. May want to revisit
-			 * the tradeoff later.
+			 * We take an fd off the ready list if the
+			 * driver returns a poll head ptr, which is
+			 * expected in the case of 0 revents. Some
+			 * buggy driver may return NULL php pointer
+			 * with 0 revents. In this case, we just treat
+			 * the driver as "noncachable" and leave the
+			 * fd on the ready list.
 			 */
-			curthread->t_pollcache = pcp;
-			error = VOP_POLL(fp->f_vnode, pdp->pd_events, 0,
-			    &revent, &php, NULL);
-			curthread->t_pollcache = NULL;
-			releasef(fd);
-			if (error != 0) {
-				break;
+			if ((pdp->pd_php != NULL) &&
+			    ((pcp->pc_flag & T_POLLWAKE) == 0)) {
+				pcache_unready(pcp, pdp);
 			}
-			/*
-			 * layered devices (e.g. console driver)
-			 * may change the vnode and thus the pollhead
-			 * pointer out from underneath us.
-			 */
-			if (php != NULL && pdp->pd_php != NULL &&
-			    php != pdp->pd_php) {
-				pollhead_delete(pdp->pd_php, pdp);
-				pdp->pd_php = php;
+			if (pdp->pd_php == NULL) {
 				pollhead_insert(php, pdp);
+				pdp->pd_php = php;
 				/*
-				 * The bit should still be set.
-				 */
-				ASSERT(BT_TEST(pcp->pc_bitmap, fd));
-				goto retry;
-			}
-
-			if (revent != 0) {
-				pfdp[fdcnt].fd = fd;
-				pfdp[fdcnt].events = pdp->pd_events;
-				pfdp[fdcnt].revents = revent;
-				fdcnt++;
-			} else if (php != NULL) {
-				/*
-				 * We clear a bit or cache a poll fd if
-				 * the driver returns a poll head ptr,
-				 * which is expected in the case of 0
-				 * revents. Some buggy driver may return
-				 * NULL php pointer with 0 revents. In
-				 * this case, we just treat the driver as
-				 * "noncachable" and not clearing the bit
-				 * in bitmap.
+				 * An event of interest may have
+				 * arrived between the VOP_POLL() and
+				 * the pollhead_insert(); check again.
 				 */
-				if ((pdp->pd_php != NULL) &&
-				    ((pcp->pc_flag & T_POLLWAKE) == 0)) {
-					BT_CLEAR(pcp->pc_bitmap, fd);
-				}
-				if (pdp->pd_php == NULL) {
-					pollhead_insert(php, pdp);
-					pdp->pd_php = php;
-					/*
-					 * An event of interest may have
-					 * arrived between the VOP_POLL() and
-					 * the pollhead_insert(); check again.
-					 */
-					goto repoll;
-				}
-			}
-		} else {
-			/*
-			 * No bit set in the range. Check for wrap around.
-			 */
-			if (!no_wrap) {
-				start = 0;
-				end = ostart - 1;
-				no_wrap = B_TRUE;
-			} else {
-				done = B_TRUE;
+				goto repoll;
 			}
 		}
 	}
 
-	if (!done) {
-		pcp->pc_mapstart = start;
-	}
 	ASSERT(*fdcntp == 0);
 	*fdcntp = fdcnt;
 	return (error);
@@ -478,6 +460,9 @@ dpopen(dev_t *devp, int flag, int otyp, cred_t *credp)
 	pcp = pcache_alloc();
 	dpep->dpe_pcache = pcp;
 	pcp->pc_pid = curproc->p_pid;
+	list_create(&pcp->pc_rdylist, sizeof (polldat_t),
+	    offsetof(polldat_t, pd_rdynode));
+	pcp->pc_flag = PC_RDYLIST;
 	*devp = makedevice(getmajor(*devp), minordev);  /* clone the driver */
 	mutex_enter(&devpoll_lock);
 	ASSERT(minordev < dptblsize);
@@ -600,7 +585,7 @@ dpwrite(dev_t dev, struct uio *uiop, cred_t *credp)
 				 * the bit in bitmap to force DP_POLL ioctl
 				 * to examine it.
 				 */
-				BT_SET(pcp->pc_bitmap, fd);
+				pcache_ready(pcp, pdp);
 				pdp->pd_events |= pfdp->events;
 				continue;
 			}
@@ -632,8 +617,9 @@ dpwrite(dev_t dev, struct uio *uiop, cred_t *credp)
 			 * the tradeoff later.
 			 */
 			curthread->t_pollcache = pcp;
-			error = VOP_POLL(fp->f_vnode, pfdp->events, 0,
-			    &pfdp->revents, &php, NULL);
+			error = VOP_POLL(fp->f_vnode,
+			    pfdp->events & ~POLLDPFLAGS, 0, &pfdp->revents,
+			    &php, NULL);
 			curthread->t_pollcache = NULL;
 			/*
 			 * We always set the bit when this fd is cached;
@@ -642,7 +628,7 @@ dpwrite(dev_t dev, struct uio *uiop, cred_t *credp)
 			 * DP_POLL.  We also attempt a pollhead_insert();
 			 * if it's not possible, we'll do it in dpioctl().
 			 */
-			BT_SET(pcp->pc_bitmap, fd);
+			pcache_ready(pcp, pdp);
 			if (error != 0) {
 				releasef(fd);
 				break;
@@ -676,7 +662,7 @@ dpwrite(dev_t dev, struct uio *uiop, cred_t *credp)
 				pollhead_delete(pdp->pd_php, pdp);
 				pdp->pd_php = NULL;
 			}
-			BT_CLEAR(pcp->pc_bitmap, fd);
+			pcache_unready(pcp, pdp);
 		}
 	}
 	mutex_exit(&pcp->pc_lock);
@@ -804,7 +790,7 @@ dpioctl(dev_t dev, int cmd, intptr_t arg, int mode, cred_t *credp, int *rvalp)
 
 		mutex_enter(&pcp->pc_lock);
 		for (;;) {
-			pcp->pc_flag = 0;
+			pcp->pc_flag &= ~T_POLLWAKE;
 			error = dp_pcache_poll(ps->ps_dpbuf, pcp, nfds, &fdcnt);
 			if (fdcnt > 0 || error != 0)
 				break;
@@ -74,14 +74,17 @@ static void idm_so_conn_connect_common(idm_conn_t *ic);
 static void idm_set_ini_preconnect_options(idm_so_conn_t *sc,
     boolean_t boot_conn);
 static void idm_set_postconnect_options(ksocket_t so);
-static idm_status_t idm_i_so_tx(idm_pdu_t *pdu);
+static void idm_so_tx_batch_add(idm_so_tx_batch_t *tb, idm_pdu_t *pdu);
+static idm_status_t idm_so_tx_batch_flush(idm_conn_t *ic,
+    idm_so_tx_batch_t *tb);
 
 static idm_status_t idm_sorecvdata(idm_conn_t *ic, idm_pdu_t *pdu);
 static void idm_so_send_rtt_data(idm_conn_t *ic, idm_task_t *idt,
     idm_buf_t *idb, uint32_t offset, uint32_t length);
 static void idm_so_send_rtt_data_done(idm_task_t *idt, idm_buf_t *idb);
 static idm_status_t idm_so_send_buf_region(idm_task_t *idt,
-    idm_buf_t *idb, uint32_t buf_region_offset, uint32_t buf_region_length);
+    idm_buf_t *idb, uint32_t buf_region_offset, uint32_t buf_region_length,
+    idm_so_tx_batch_t *tb);
 
 static uint32_t idm_fill_iov(idm_pdu_t *pdu, idm_buf_t *idb,
     uint32_t ro, uint32_t dlength);
@@ -168,6 +171,14 @@ kmutex_t	idm_so_timed_socket_mutex;
 int32_t idm_so_sndbuf = IDM_SNDBUF_SIZE;
 int32_t idm_so_rcvbuf = IDM_RCVBUF_SIZE;
 
+/*
+ * Largest number of PDUs the TX thread puts in one send, at most
+ * IDM_SO_TX_BATCH.  Setting it to 1 sends every PDU on its own.
+ */
+int idm_so_tx_batch = IDM_SO_TX_BATCH;
+
+static const uint8_t idm_so_pad[ISCSI_PAD_WORD_LEN] = { 0 };
+
 /*
  * idm_so_init()
  * Sockets transport initialization
@@ -2132,8 +2143,7 @@ idm_sorx_thread(void *arg)
  *
  * This is the implementation of idm_transport_ops_t's it_tx_pdu entry
  * point.  By definition, it is supposed to be fast.  So, simply queue
- * the entry and return.  The real work is done by idm_i_so_tx() via
- * idm_sotx_thread().
+ * the entry and return.  The real work is done by idm_sotx_thread().
  */
 
 static void
@@ -2155,36 +2165,36 @@ idm_so_tx(idm_conn_t *ic, idm_pdu_t *pdu)
 	mutex_exit(&so_conn->ic_tx_mutex);
 }
 
-static idm_status_t
-idm_i_so_tx(idm_pdu_t *pdu)
+/*
+ * Add a PDU to the TX batch, computing its digests now.  The PDU is
+ * completed once the batch has been flushed.
+ */
+static void
+idm_so_tx_batch_add(idm_so_tx_batch_t *tb, idm_pdu_t *pdu)
 {
 	idm_conn_t	*ic = pdu->isp_ic;
-	idm_status_t	status = IDM_STATUS_SUCCESS;
-	uint8_t		pad[ISCSI_PAD_WORD_LEN];
+	iovec_t		*iov = &tb->tb_iov[tb->tb_iovlen];
+	uint32_t	*hdr_digest_crc = &tb->tb_hdr_crc[tb->tb_npdu];
+	uint32_t	*data_digest_crc = &tb->tb_data_crc[tb->tb_npdu];
 	int		pad_len;
-	uint32_t	hdr_digest_crc;
-	uint32_t	data_digest_crc = 0;
-	int		total_len = 0;
 	int		iovlen = 0;
-	struct iovec	iov[6];
-	idm_so_conn_t	*so_conn;
 
-	so_conn = ic->ic_transport_private;
+	ASSERT(tb->tb_npdu < IDM_SO_TX_BATCH);
 
 	/* Setup BHS */
 	iov[iovlen].iov_base	= (caddr_t)pdu->isp_hdr;
 	iov[iovlen].iov_len	= pdu->isp_hdrlen;
-	total_len		+= iov[iovlen].iov_len;
+	tb->tb_len		+= iov[iovlen].iov_len;
 	iovlen++;
 
 	/* Setup header digest */
 	if (((pdu->isp_flags & IDM_PDU_LOGIN_TX) == 0) &&
 	    (ic->ic_conn_flags & IDM_CONN_HEADER_DIGEST)) {
-		hdr_digest_crc = idm_crc32c(pdu->isp_hdr, pdu->isp_hdrlen);
+		*hdr_digest_crc = idm_crc32c(pdu->isp_hdr, pdu->isp_hdrlen);
 
-		iov[iovlen].iov_base	= (caddr_t)&hdr_digest_crc;
-		iov[iovlen].iov_len	= sizeof (hdr_digest_crc);
-		total_len		+= iov[iovlen].iov_len;
+		iov[iovlen].iov_base	= (caddr_t)hdr_digest_crc;
+		iov[iovlen].iov_len	= sizeof (*hdr_digest_crc);
+		tb->tb_len		+= iov[iovlen].iov_len;
 		iovlen++;
 	}
 
@@ -2222,7 +2232,7 @@ idm_i_so_tx(idm_pdu_t *pdu)
 
 		iov[iovlen].iov_base = (caddr_t)pdu->isp_data;
 		iov[iovlen].iov_len  = pdu->isp_datalen;
-		total_len += iov[iovlen].iov_len;
+		tb->tb_len += iov[iovlen].iov_len;
 		iovlen++;
 	}
 
@@ -2232,10 +2242,9 @@ idm_i_so_tx(idm_pdu_t *pdu)
 	    (ISCSI_PAD_WORD_LEN - 1));
 
 	if (pad_len) {
-		bzero(pad, sizeof (pad));
-		iov[iovlen].iov_base = (void *)&pad;
+		iov[iovlen].iov_base = (caddr_t)idm_so_pad;
 		iov[iovlen].iov_len  = pad_len;
-		total_len		+= iov[iovlen].iov_len;
+		tb->tb_len		+= iov[iovlen].iov_len;
 		iovlen++;
 	}
 
@@ -2250,37 +2259,72 @@ idm_i_so_tx(idm_pdu_t *pdu)
 		 * RFC3720/10.2.3: A zero-length Data Segment also
 		 * implies a zero-length data digest.
 		 */
+		*data_digest_crc = 0;
 		if (pdu->isp_datalen) {
-			data_digest_crc = idm_crc32c(pdu->isp_data,
+			*data_digest_crc = idm_crc32c(pdu->isp_data,
 			    pdu->isp_datalen);
 		}
 		if (pad_len) {
-			data_digest_crc = idm_crc32c_continued(&pad,
-			    pad_len, data_digest_crc);
+			*data_digest_crc = idm_crc32c_continued(
+			    (void *)idm_so_pad, pad_len, *data_digest_crc);
 		}
 
-		iov[iovlen].iov_base	= (caddr_t)&data_digest_crc;
-		iov[iovlen].iov_len	= sizeof (data_digest_crc);
-		total_len		+= iov[iovlen].iov_len;
+		iov[iovlen].iov_base	= (caddr_t)data_digest_crc;
+		iov[iovlen].iov_len	= sizeof (*data_digest_crc);
+		tb->tb_len		+= iov[iovlen].iov_len;
 		iovlen++;
 	}
 
-	/* Transmit the PDU */
-	if (idm_iov_sosend(so_conn->ic_so, &iov[0], iovlen,
-	    total_len) != 0) {
+	ASSERT(iovlen <= IDM_SO_TX_PDU_IOVLEN);
+	tb->tb_iovlen += iovlen;
+	tb->tb_pdu[tb->tb_npdu++] = pdu;
+}
+
+/*
+ * The batch is full when it holds idm_so_tx_batch PDUs.
+ */
+static boolean_t
+idm_so_tx_batch_full(idm_so_tx_batch_t *tb)
+{
+	int	max = MIN(MAX(idm_so_tx_batch, 1), IDM_SO_TX_BATCH);
+
+	return (tb->tb_npdu >= max);
+}
+
+/*
+ * Send every PDU in the TX batch with one call to the socket and
+ * complete them.
+ */
+static idm_status_t
+idm_so_tx_batch_flush(idm_conn_t *ic, idm_so_tx_batch_t *tb)
+{
+	idm_so_conn_t	*so_conn = ic->ic_transport_private;
+	idm_status_t	status = IDM_STATUS_SUCCESS;
+	int		i;
+
+	if (tb->tb_npdu == 0)
+		return (IDM_STATUS_SUCCESS);
+
+	/* Transmit the PDUs */
+	if (idm_iov_sosend(so_conn->ic_so, &tb->tb_iov[0], tb->tb_iovlen,
+	    tb->tb_len) != 0) {
 		/* Set error status */
 		IDM_CONN_LOG(CE_WARN,
-		    "idm_so_tx: failed to transmit the PDU, so: %p ic: %p "
-		    "data: %p", (void *) so_conn->ic_so, (void *) ic,
-		    (void *) pdu->isp_data);
+		    "idm_so_tx: failed to transmit %d PDUs, so: %p ic: %p",
+		    tb->tb_npdu, (void *) so_conn->ic_so, (void *) ic);
 		status = IDM_STATUS_IO;
 	}
 
 	/*
-	 * Success does not mean that the PDU actually reached the
-	 * remote node since it could get dropped along the way.
+	 * Success does not mean that the PDUs actually reached the
+	 * remote node since they could get dropped along the way.
 	 */
-	idm_pdu_complete(pdu, status);
+	for (i = 0; i < tb->tb_npdu; i++)
+		idm_pdu_complete(tb->tb_pdu[i], status);
+
+	tb->tb_npdu = 0;
+	tb->tb_iovlen = 0;
+	tb->tb_len = 0;
 
 	return (status);
 }
@@ -2556,13 +2600,21 @@ idm_so_send_rtt_data_done(idm_task_t *idt, idm_buf_t *idb)
 	idm_buf_free(idb);
 }
 
+/*
+ * Send a region of a buffer as Data PDUs, sending them in batches with
+ * whatever other PDUs the TX thread had already gathered.  Everything
+ * has been sent by the time this returns, so the caller is free to let
+ * go of the buffer.
+ */
 static idm_status_t
 idm_so_send_buf_region(idm_task_t *idt, idm_buf_t *idb,
-    uint32_t buf_region_offset, uint32_t buf_region_length)
+    uint32_t buf_region_offset, uint32_t buf_region_length,
+    idm_so_tx_batch_t *tb)
 {
 	idm_conn_t		*ic;
 	uint32_t		max_dataseglen;
 	size_t			remainder, chunk;
+	size_t			unsent = 0;
 	uint32_t		data_offset = buf_region_offset;
 	iscsi_data_hdr_t	*bhs;
 	idm_pdu_t		*pdu;
@@ -2579,6 +2631,9 @@ idm_so_send_buf_region(idm_task_t *idt, idm_buf_t *idb,
 		if (idt->idt_state != TASK_ACTIVE) {
 			ASSERT((idt->idt_state != TASK_IDLE) &&
 			    (idt->idt_state != TASK_COMPLETE));
+			mutex_exit(&idt->idt_mutex);
+			(void) idm_so_tx_batch_flush(ic, tb);
+			mutex_enter(&idt->idt_mutex);
 			return (IDM_STATUS_ABORTED);
 		}
 
@@ -2644,24 +2699,27 @@ idm_so_send_buf_region(idm_task_t *idt, idm_buf_t *idb,
 		}
 
 		/*
-		 * Now that we're done working with idt_exp_datasn,
-		 * idt->idt_state and idb->idb_bufoffset we can release
-		 * the task lock -- don't want to hold it across the
-		 * call to idm_i_so_tx since we could block.
+		 * Add the PDU to the batch; there is already implicit
+		 * ordering as only the TX thread sends.  Once the batch
+		 * is full or the region is done, we are done working
+		 * with idt_exp_datasn, idt->idt_state and
+		 * idb->idb_bufoffset for now and can release the task
+		 * lock -- don't want to hold it across the send since
+		 * we could block.
 		 */
-		mutex_exit(&idt->idt_mutex);
+		idm_so_tx_batch_add(tb, pdu);
+		unsent += chunk;
+		if (remainder != 0 && !idm_so_tx_batch_full(tb))
+			continue;
 
-		/*
-		 * Transmit the PDU.  Call the internal routine directly
-		 * as there is already implicit ordering.
-		 */
-		if ((tx_status = idm_i_so_tx(pdu)) != IDM_STATUS_SUCCESS) {
-			mutex_enter(&idt->idt_mutex);
+		mutex_exit(&idt->idt_mutex);
+		tx_status = idm_so_tx_batch_flush(ic, tb);
+		mutex_enter(&idt->idt_mutex);
+		if (tx_status != IDM_STATUS_SUCCESS)
 			return (tx_status);
-		}
 
-		mutex_enter(&idt->idt_mutex);
-		idt->idt_tx_bytes += chunk;
+		idt->idt_tx_bytes += unsent;
+		unsent = 0;
 	}
 
 	return (IDM_STATUS_SUCCESS);
@@ -2747,7 +2805,9 @@ idm_sorx_addl_pdu_cb(idm_pdu_t *pdu, idm_status_t status)
 
 /*
  * This thread is only active when I/O is queued for transmit
- * because the socket is busy.
+ * because the socket is busy.  PDUs taken off the queue are gathered
+ * into a batch that is sent when the queue runs dry or the batch
+ * fills up.
  */
 void
 idm_sotx_thread(void *arg)
@@ -2756,8 +2816,12 @@ idm_sotx_thread(void *arg)
 	idm_tx_obj_t	*object, *next;
 	idm_so_conn_t	*so_conn;
 	idm_status_t	status = IDM_STATUS_SUCCESS;
+	idm_so_tx_batch_t *tb;
+	boolean_t	more;
+	int		i;
 
 	idm_conn_hold(ic);
+	tb = kmem_zalloc(sizeof (*tb), KM_SLEEP);
 
 	mutex_enter(&ic->ic_mutex);
 	so_conn = ic->ic_transport_private;
@@ -2781,6 +2845,7 @@ idm_sotx_thread(void *arg)
 
 		object = (idm_tx_obj_t *)list_head(&so_conn->ic_tx_list);
 		list_remove(&so_conn->ic_tx_list, object);
+		more = !list_is_empty(&so_conn->ic_tx_list);
 		mutex_exit(&so_conn->ic_tx_mutex);
 
 		switch (object->idm_tx_obj_magic) {
@@ -2793,7 +2858,9 @@ idm_sotx_thread(void *arg)
 				/* No IDM task */
 				(ic->ic_conn_ops.icb_update_statsn)(NULL, pdu);
 			}
-			status = idm_i_so_tx((idm_pdu_t *)object);
+			idm_so_tx_batch_add(tb, pdu);
+			if (!more || idm_so_tx_batch_full(tb))
+				status = idm_so_tx_batch_flush(ic, tb);
 			break;
 		}
 		case IDM_BUF_MAGIC: {
@@ -2805,7 +2872,9 @@ idm_sotx_thread(void *arg)
 
 			mutex_enter(&idt->idt_mutex);
 			status = idm_so_send_buf_region(idt,
-			    idb, 0, idb->idb_xfer_len);
+			    idb, 0, idb->idb_xfer_len, tb);
+			if (status == IDM_STATUS_SUCCESS && !more)
+				status = idm_so_tx_batch_flush(ic, tb);
 
 			/*
 			 * TX thread owns the buffer so we expect it to
@@ -2852,6 +2921,10 @@ idm_sotx_thread(void *arg)
 	 */
 
 tx_bail:
+	for (i = 0; i < tb->tb_npdu; i++)
+		idm_pdu_complete(tb->tb_pdu[i], IDM_STATUS_ABORTED);
+	kmem_free(tb, sizeof (*tb));
+
 	object = (idm_tx_obj_t *)list_head(&so_conn->ic_tx_list);
 
 	while (object != NULL) {
@@ -709,6 +709,7 @@ ixgbe_set_priv_prop(ixgbe_t *ixgbe, const char *pr_name,
 			err = EINVAL;
 		else {
 			ixgbe->intr_throttling[0] = (uint32_t)result;
+			ixgbe->intr_adaptive = B_FALSE;
 
 			/*
 			 * 82599 and X540 require the interrupt throttling
@@ -3233,6 +3233,13 @@ ixgbe_get_conf(ixgbe_t *ixgbe)
 	if (hw->mac.type == ixgbe_mac_82599EB || hw->mac.type == ixgbe_mac_X540)
 		ixgbe->intr_throttling[0] = ixgbe->intr_throttling[0] & 0xFF8;
 
+	/*
+	 * Unless a fixed rate was configured, let the mac layer adapt the
+	 * interrupt throttling rate to the load (see ixgbe_rx_ring_itr()).
+	 */
+	ixgbe->intr_adaptive = !ddi_prop_exists(DDI_DEV_T_ANY, ixgbe->dip,
+	    DDI_PROP_DONTPASS, PROP_INTR_THROTTLING);
+
 	hw->allow_unsupported_sfp = ixgbe_get_prop(ixgbe,
 	    PROP_ALLOW_UNSUPPORTED_SFP, 0, 1, DEFAULT_ALLOW_UNSUPPORTED_SFP);
 }
@@ -5599,6 +5606,9 @@ ixgbe_fill_ring(void *arg, mac_ring_type_t rtype, const int group_index,
 		infop->mri_stop = NULL;
 		infop->mri_poll = ixgbe_ring_rx_poll;
 		infop->mri_stat = ixgbe_rx_ring_stat;
+		if (ixgbe->hw.mac.type == ixgbe_mac_82599EB ||
+		    ixgbe->hw.mac.type == ixgbe_mac_X540)
+			infop->mri_itr = ixgbe_rx_ring_itr;
 
 		mintr->mi_handle = (mac_intr_handle_t)rx_ring;
 		mintr->mi_enable = ixgbe_rx_ring_intr_enable;
@@ -5755,6 +5765,36 @@ ixgbe_rx_ring_intr_disable(mac_intr_handle_t intrh)
 	return (0);
 }
 
+/*
+ * Set the interrupt throttling of the vector serving the specified rx ring
+ * to the interval, in microseconds, asked for by the mac layer.  Other
+ * rings sharing the vector follow along.  This is called from the ring's
+ * interrupt path, so it only does the register write.
+ */
+void
+ixgbe_rx_ring_itr(mac_ring_driver_t rh, uint_t usecs)
+{
+	ixgbe_rx_ring_t *rx_ring = (ixgbe_rx_ring_t *)rh;
+	ixgbe_t *ixgbe = rx_ring->ixgbe;
+	int v_idx = rx_ring->intr_vector;
+	uint32_t itr;
+
+	if (!ixgbe->intr_adaptive ||
+	    (ixgbe->ixgbe_state & (IXGBE_SUSPENDED | IXGBE_ERROR)) != 0)
+		return;
+
+	/*
+	 * On 82599 and X540 the interval is in bits 11:3 of EITR, in units
+	 * of 2 microseconds.
+	 */
+	itr = (usecs / 2) << 3;
+	itr = MAX(itr, ixgbe->capab->min_intr_throttle);
+	itr = MIN(itr, ixgbe->capab->max_intr_throttle) & 0xFF8;
+
+	ixgbe->intr_throttling[v_idx] = itr;
+	IXGBE_WRITE_REG(&ixgbe->hw, IXGBE_EITR(v_idx), itr);
+}
+
 /*
  * Add a mac address.
  */
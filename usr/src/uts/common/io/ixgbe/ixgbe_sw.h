@@ -689,6 +689,7 @@ typedef struct ixgbe {
 	uint32_t		rx_copy_thresh; /* Rx copy threshold */
 	uint32_t		rx_limit_per_intr; /* Rx pkts per interrupt */
 	uint32_t		intr_throttling[MAX_INTR_VECTOR];
+	boolean_t		intr_adaptive;	/* mac adapts throttling */
 	uint32_t		intr_force;
 	int			fm_capabilities; /* FMA capabilities */
 
@@ -850,6 +851,7 @@ void ixgbe_fill_group(void *arg, mac_ring_type_t, const int,
     mac_group_info_t *, mac_group_handle_t);
 int ixgbe_rx_ring_intr_enable(mac_intr_handle_t);
 int ixgbe_rx_ring_intr_disable(mac_intr_handle_t);
+void ixgbe_rx_ring_itr(mac_ring_driver_t, uint_t);
 
 /*
  * Function prototypes in ixgbe_gld.c
@@ -627,6 +627,62 @@ write_kstat_data(int *rvalp, void *user_ksp, int flag, cred_t *cred)
 	return (error);
 }
 
+static int
+read_kstat_bulk(int *rvalp, void *user_kb, int flag)
+{
+	kstat_bulk_t kb;
+#ifdef _MULTI_DATAMODEL
+	kstat_bulk32_t kb32;
+#endif
+	size_t kssize;
+	caddr_t uksp;
+	uint_t i;
+	int error = 0;
+
+	switch (ddi_model_convert_from(flag & FMODELS)) {
+#ifdef _MULTI_DATAMODEL
+	case DDI_MODEL_ILP32:
+		if (copyin(user_kb, &kb32, sizeof (kstat_bulk32_t)) != 0)
+			return (EFAULT);
+		kb.kb_count = kb32.kb_count;
+		kb.kb_ksp = (kstat_t *)(uintptr_t)kb32.kb_ksp;
+		kssize = sizeof (kstat32_t);
+		break;
+#endif
+	default:
+	case DDI_MODEL_NONE:
+		if (copyin(user_kb, &kb, sizeof (kstat_bulk_t)) != 0)
+			return (EFAULT);
+		kssize = sizeof (kstat_t);
+	}
+
+	*rvalp = kstat_chain_id;
+	uksp = (caddr_t)kb.kb_ksp;
+	for (i = 0; i < kb.kb_count; i++, uksp += kssize) {
+		if ((error = read_kstat_data(rvalp, uksp, flag)) != 0)
+			break;
+	}
+
+	switch (ddi_model_convert_from(flag & FMODELS)) {
+#ifdef _MULTI_DATAMODEL
+	case DDI_MODEL_ILP32:
+		kb32.kb_done = i;
+		if (copyout(&kb32, user_kb, sizeof (kstat_bulk32_t)) != 0 &&
+		    error == 0)
+			error = EFAULT;
+		break;
+#endif
+	default:
+	case DDI_MODEL_NONE:
+		kb.kb_done = i;
+		if (copyout(&kb, user_kb, sizeof (kstat_bulk_t)) != 0 &&
+		    error == 0)
+			error = EFAULT;
+	}
+
+	return (error);
+}
+
 /*ARGSUSED*/
 static int
 kstat_ioctl(dev_t dev, int cmd, intptr_t data, int flag, cred_t *cr, int *rvalp)
@@ -647,6 +703,10 @@ kstat_ioctl(dev_t dev, int cmd, intptr_t data, int flag, cred_t *cr, int *rvalp)
 		rc = write_kstat_data(rvalp, (void *)data, flag, cr);
 		break;
 
+	case KSTAT_IOC_READ_BULK:
+		rc = read_kstat_bulk(rvalp, (void *)data, flag);
+		break;
+
 	default:
 		/* invalid request */
 		rc = EINVAL;
@@ -735,6 +735,9 @@ ldtermopen(queue_t *q, dev_t *devp, int oflag, int sflag, cred_t *crp)
 
 	qprocson(q);
 
+	/* Per-CPU putnext() locks; input and output contend otherwise. */
+	create_putlocks(q, 1);
+
 	/*
 	 * Find out if the module below us does canonicalization; if
 	 * so, we won't do it ourselves.
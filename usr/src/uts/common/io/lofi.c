@@ -121,6 +121,7 @@
 #include <sys/fdio.h>
 #include <sys/open.h>
 #include <sys/disp.h>
+#include <sys/vmsystm.h>
 #include <vm/seg_map.h>
 #include <sys/ddi.h>
 #include <sys/sunddi.h>
@@ -188,16 +189,18 @@ const char lofi_crypto_magic[6] = LOFI_CRYPTO_MAGIC;
  * when accessing small parts of a segment's data, we cache and reuse
  * the uncompressed segment's data.
  *
- * A single cached segment is sufficient to avoid lots of duplicate
- * segment decompress operations. A small cache size also reduces the
- * memory footprint.
+ * Every segment that is decompressed is cached, so that images read by
+ * many consumers at once, or read in requests that span segments, are
+ * not decompressed over and over.  The cache only grows while memory
+ * is plentiful; once freemem drops below lotsfree, entries are reused
+ * and the cache is trimmed back to a single segment.
  *
  * lofi_max_comp_cache is the maximum number of decompressed data segments
  * cached for each compressed lofi image. It can be set to 0 to disable
  * caching.
  */
 
-uint32_t lofi_max_comp_cache = 1;
+uint32_t lofi_max_comp_cache = 16;
 
 static int gzip_decompress(void *src, size_t srclen, void *dst,
 	size_t *destlen, int level);
@@ -914,7 +917,15 @@ lofi_add_comp_data(struct lofi_state *lsp, uint64_t seg_index,
 
 	ASSERT(MUTEX_HELD(&lsp->ls_comp_cache_lock));
 
-	while (lsp->ls_comp_cache_count > lofi_max_comp_cache) {
+	/*
+	 * Another thread may have decompressed the same segment
+	 * meanwhile; keep only one copy.
+	 */
+	if (lofi_find_comp_data(lsp, seg_index) != NULL)
+		return (NULL);
+
+	while (lsp->ls_comp_cache_count > lofi_max_comp_cache ||
+	    (freemem < lotsfree && lsp->ls_comp_cache_count > 1)) {
 		lc = list_remove_tail(&lsp->ls_comp_cache);
 		ASSERT(lc != NULL);
 		kmem_free(lc->lc_data, lsp->ls_uncomp_seg_sz);
@@ -937,7 +948,8 @@ lofi_add_comp_data(struct lofi_state *lsp, uint64_t seg_index,
 	 * The cache element for the new decompressed segment data is
 	 * added to the head of the list.
 	 */
-	if (lsp->ls_comp_cache_count < lofi_max_comp_cache) {
+	if (lsp->ls_comp_cache_count < lofi_max_comp_cache &&
+	    (lsp->ls_comp_cache_count == 0 || freemem >= lotsfree)) {
 		lc = kmem_alloc(sizeof (struct lofi_comp_cache), KM_SLEEP);
 		lc->lc_data = NULL;
 		list_insert_head(&lsp->ls_comp_cache, lc);
@@ -1066,7 +1078,6 @@ lofi_strategy_task(void *arg)
 		size_t oblkcount;
 		ulong_t seglen;
 		uint64_t sblkno, eblkno, cmpbytes;
-		uint64_t uncompressed_seg_index;
 		struct lofi_comp_cache *lc;
 		offset_t sblkoff, eblkoff;
 		u_offset_t salign, ealign;
@@ -1236,6 +1247,14 @@ lofi_strategy_task(void *arg)
 			cmpbytes = lsp->ls_comp_seg_index[i + 1] -
 			    lsp->ls_comp_seg_index[i];
 
+			/*
+			 * Determine how much uncompressed data we
+			 * have to copy
+			 */
+			xfersize = lsp->ls_uncomp_seg_sz - sblkoff;
+			if (i == eblkno)
+				xfersize -= (lsp->ls_uncomp_seg_sz - eblkoff);
+
 			/*
 			 * The first byte in a compressed segment is a flag
 			 * that indicates whether this segment is compressed
@@ -1252,32 +1271,50 @@ lofi_strategy_task(void *arg)
 			 */
 			if (*cmpbuf == UNCOMPRESSED) {
 				useg = cmpbuf + SEGHDR;
-			} else {
-				if (uncompressed_seg == NULL)
-					uncompressed_seg =
-					    kmem_alloc(lsp->ls_uncomp_seg_sz,
-					    KM_SLEEP);
-				useg = uncompressed_seg;
-				uncompressed_seg_index = i;
-
-				if (li->l_decompress((cmpbuf + SEGHDR),
-				    (cmpbytes - SEGHDR), uncompressed_seg,
-				    &seglen, li->l_level) != 0) {
-					error = EIO;
-					goto done;
-				}
+				bcopy((useg + sblkoff), bufaddr, xfersize);
+				goto next;
 			}
 
 			/*
-			 * Determine how much uncompressed data we
-			 * have to copy and copy it
+			 * Segments of a request that spans several may
+			 * already be in the cache.
 			 */
-			xfersize = lsp->ls_uncomp_seg_sz - sblkoff;
-			if (i == eblkno)
-				xfersize -= (lsp->ls_uncomp_seg_sz - eblkoff);
+			mutex_enter(&lsp->ls_comp_cache_lock);
+			if ((lc = lofi_find_comp_data(lsp, i)) != NULL) {
+				bcopy(lc->lc_data + sblkoff, bufaddr,
+				    xfersize);
+				mutex_exit(&lsp->ls_comp_cache_lock);
+				goto next;
+			}
+			mutex_exit(&lsp->ls_comp_cache_lock);
+
+			if (uncompressed_seg == NULL)
+				uncompressed_seg =
+				    kmem_alloc(lsp->ls_uncomp_seg_sz,
+				    KM_SLEEP);
+			useg = uncompressed_seg;
+
+			if (li->l_decompress((cmpbuf + SEGHDR),
+			    (cmpbytes - SEGHDR), uncompressed_seg,
+			    &seglen, li->l_level) != 0) {
+				error = EIO;
+				goto done;
+			}
 
 			bcopy((useg + sblkoff), bufaddr, xfersize);
 
+			/*
+			 * Cache the decompressed segment.  In case the
+			 * data was added to (and is referenced by) the
+			 * cache, make sure we don't reuse or free it here.
+			 */
+			mutex_enter(&lsp->ls_comp_cache_lock);
+			if (lofi_add_comp_data(lsp, i, uncompressed_seg) !=
+			    NULL)
+				uncompressed_seg = NULL;
+			mutex_exit(&lsp->ls_comp_cache_lock);
+next:
+
 			cmpbuf += cmpbytes;
 			bufaddr += xfersize;
 			bp->b_resid -= xfersize;
@@ -1287,27 +1324,6 @@ lofi_strategy_task(void *arg)
 				break;
 		} /* decompress compressed blocks ends */
 
-		/*
-		 * Skip to done if there is no uncompressed data to cache
-		 */
-		if (uncompressed_seg == NULL)
-			goto done;
-
-		/*
-		 * Add the data for the last decompressed segment to
-		 * the cache.
-		 *
-		 * In case the uncompressed segment data was added to (and
-		 * is referenced by) the cache, make sure we don't free it
-		 * here.
-		 */
-		mutex_enter(&lsp->ls_comp_cache_lock);
-		if ((lc = lofi_add_comp_data(lsp, uncompressed_seg_index,
-		    uncompressed_seg)) != NULL) {
-			uncompressed_seg = NULL;
-		}
-		mutex_exit(&lsp->ls_comp_cache_lock);
-
 done:
 		if (compressed_seg != NULL) {
 			mutex_enter(&lsp->ls_comp_bufs_lock);
@@ -357,6 +357,17 @@ static kmutex_t		i_mactype_lock;
 int mac_tx_percpu_cnt;
 int mac_tx_percpu_cnt_max = 128;
 
+/*
+ * mac_tx_client_nrings
+ *
+ * Number of Tx rings given to a client that is reserving an exclusive Tx
+ * group on a NIC with dynamic ring grouping without having asked for a
+ * particular number of rings, for example a VNIC with no txrings property.
+ * Fewer are used if the default group can't spare that many.  With more
+ * than one ring the client's Tx SRS fans out across them.
+ */
+uint_t mac_tx_client_nrings = 4;
+
 /*
  * Call back functions for the bridge module.  These are guaranteed to be valid
  * when holding a reference on a link or when holding mip->mi_bridge_lock and
@@ -6823,7 +6834,11 @@ mac_reserve_tx_group(mac_client_impl_t *mcip, boolean_t move)
 	if (isprimary && !need_exclgrp)
 		return (NULL);
 
-	nrings = (mrp->mrp_mask & MRP_TX_RINGS) != 0 ? mrp->mrp_ntxrings : 1;
+	if ((mrp->mrp_mask & MRP_TX_RINGS) != 0) {
+		nrings = mrp->mrp_ntxrings;
+	} else {
+		nrings = MAX(1, MIN((int)mac_tx_client_nrings, defnrings));
+	}
 	for (i = 0; i <  mip->mi_tx_group_count; i++) {
 		grp = &mip->mi_tx_groups[i];
 		if ((grp->mrg_state == MAC_GROUP_STATE_RESERVED) ||
@@ -25,6 +25,7 @@
 #include <sys/types.h>
 #include <sys/callb.h>
 #include <sys/cpupart.h>
+#include <sys/lgrp.h>
 #include <sys/pool.h>
 #include <sys/pool_pset.h>
 #include <sys/sdt.h>
@@ -148,11 +149,20 @@ static krwlock_t mac_srs_g_lock;
 boolean_t mac_srs_thread_bind = B_TRUE;
 
 /*
- * Whether Rx/Tx interrupts should be re-targeted. Disabled by default.
+ * Whether Rx/Tx interrupts should be re-targeted. Rx interrupts are, so
+ * that each ring's interrupt is taken on the CPU its poll thread runs on.
  * dladm command would override this.
  */
 boolean_t mac_tx_intr_retarget = B_FALSE;
-boolean_t mac_rx_intr_retarget = B_FALSE;
+boolean_t mac_rx_intr_retarget = B_TRUE;
+
+/*
+ * Whether the CPUs handling a hardware Rx ring (its interrupt, poll and
+ * worker threads, and the soft rings and squeues on top) are all chosen
+ * from one lgroup, so that the packets stay in the caches and memory of
+ * one node from the interrupt up to the protocol.
+ */
+boolean_t mac_rx_ring_lgrp_local = B_TRUE;
 
 /*
  * If cpu bindings are specified by user, then Tx SRS and its soft
@@ -524,34 +534,112 @@ mac_srs_poll_state_change(mac_soft_ring_set_t *mac_srs,
 
 /* CPU RECONFIGURATION AND FANOUT COMPUTATION ROUTINES */
 
+/*
+ * The CPU the last MAC kernel thread was bound to; the search for the
+ * next one starts after it.
+ */
+static cpu_t	*mac_bind_cpu = NULL;
+
 /*
  * Return the next CPU to be used to bind a MAC kernel thread.
  * If a cpupart is specified, the cpu chosen must be from that
- * cpu partition.
+ * cpu partition. If lgrp is not LGRP_NONE, the cpu is from that
+ * lgroup if there is one to be had there.
  */
 static processorid_t
-mac_next_bind_cpu(cpupart_t *cpupart)
+mac_next_bind_cpu_lgrp(cpupart_t *cpupart, lgrp_id_t lgrp)
 {
-	static cpu_t		*cp = NULL;
-	cpu_t			*cp_start;
+	cpu_t			*cp, *cp_start;
 
 	ASSERT(MUTEX_HELD(&cpu_lock));
 
-	if (cp == NULL)
-		cp = cpu_list;
+	if (mac_bind_cpu == NULL)
+		mac_bind_cpu = cpu_list;
 
-	cp = cp->cpu_next_onln;
+	cp = mac_bind_cpu->cpu_next_onln;
 	cp_start = cp;
 
 	do {
-		if ((cpupart == NULL) || (cp->cpu_part == cpupart))
+		if ((cpupart == NULL || cp->cpu_part == cpupart) &&
+		    (lgrp == LGRP_NONE || cp->cpu_lpl->lpl_lgrpid == lgrp)) {
+			mac_bind_cpu = cp;
 			return (cp->cpu_id);
+		}
 
 	} while ((cp = cp->cpu_next_onln) != cp_start);
 
+	if (lgrp != LGRP_NONE)
+		return (mac_next_bind_cpu_lgrp(cpupart, LGRP_NONE));
+
 	return (NULL);
 }
 
+static processorid_t
+mac_next_bind_cpu(cpupart_t *cpupart)
+{
+	return (mac_next_bind_cpu_lgrp(cpupart, LGRP_NONE));
+}
+
+/*
+ * Return the number of hardware Rx rings whose poll thread, and so
+ * usually interrupt, is bound to cp.
+ */
+static uint_t
+mac_cpu_rx_rings(cpu_t *cp)
+{
+	mac_soft_ring_set_t	*mac_srs;
+	uint_t			n = 0;
+
+	rw_enter(&mac_srs_g_lock, RW_READER);
+	for (mac_srs = mac_srs_g_list; mac_srs != NULL;
+	    mac_srs = mac_srs->srs_next) {
+		if ((mac_srs->srs_type & SRST_TX) == 0 &&
+		    mac_srs->srs_ring != NULL &&
+		    mac_srs->srs_poll_cpuid == cp->cpu_id)
+			n++;
+	}
+	rw_exit(&mac_srs_g_lock);
+
+	return (n);
+}
+
+/*
+ * Return the CPU to take the interrupts of a hardware Rx ring and run its
+ * poll thread: of the CPUs mac_next_bind_cpu() would hand out next, the
+ * one the fewest other rings are bound to.
+ */
+static processorid_t
+mac_next_rx_ring_cpu(cpupart_t *cpupart)
+{
+	cpu_t		*cp, *cp_start, *best = NULL;
+	uint_t		n, best_n = UINT_MAX;
+
+	ASSERT(MUTEX_HELD(&cpu_lock));
+
+	if (mac_bind_cpu == NULL)
+		mac_bind_cpu = cpu_list;
+
+	cp = mac_bind_cpu->cpu_next_onln;
+	cp_start = cp;
+
+	do {
+		if (cpupart != NULL && cp->cpu_part != cpupart)
+			continue;
+		if ((n = mac_cpu_rx_rings(cp)) < best_n) {
+			best = cp;
+			best_n = n;
+			if (n == 0)
+				break;
+		}
+	} while ((cp = cp->cpu_next_onln) != cp_start);
+
+	if (best == NULL)
+		return (NULL);
+
+	mac_bind_cpu = best;
+	return (best->cpu_id);
+}
+
 /* ARGSUSED */
 static int
 mac_srs_cpu_setup(cpu_setup_t what, int id, void *arg)
@@ -1070,7 +1158,9 @@ static void
 mac_flow_cpu_init(flow_entry_t *flent, cpupart_t *cpupart)
 {
 	mac_soft_ring_set_t *rx_srs;
-	processorid_t cpuid;
+	processorid_t cpuid, pollid;
+	cpu_t *cp;
+	lgrp_id_t lgrp;
 	int i, j, k, srs_cnt, nscpus, maxcpus, soft_ring_cnt = 0;
 	mac_cpus_t *srs_cpu;
 	mac_resource_props_t *emrp = &flent->fe_effective_props;
@@ -1109,12 +1199,22 @@ mac_flow_cpu_init(flow_entry_t *flent, cpupart_t *cpupart)
 		srs_cpu->mc_ncpus = soft_ring_cnt;
 		srs_cpu->mc_rx_fanout_cnt = soft_ring_cnt;
 		mutex_enter(&cpu_lock);
+
+		/*
+		 * Place the ring's interrupt and poll thread first, away
+		 * from other rings, and keep the rest in the same lgroup.
+		 */
+		pollid = mac_next_rx_ring_cpu(cpupart);
+		lgrp = LGRP_NONE;
+		if (mac_rx_ring_lgrp_local && (cp = cpu_get(pollid)) != NULL)
+			lgrp = cp->cpu_lpl->lpl_lgrpid;
+
 		for (j = 0; j < soft_ring_cnt; j++) {
-			cpuid = mac_next_bind_cpu(cpupart);
+			cpuid = mac_next_bind_cpu_lgrp(cpupart, lgrp);
 			srs_cpu->mc_cpus[j] = cpuid;
 			srs_cpu->mc_rx_fanout_cpus[j] = cpuid;
 		}
-		cpuid = mac_next_bind_cpu(cpupart);
+		cpuid = pollid;
 		srs_cpu->mc_rx_pollid = cpuid;
 		srs_cpu->mc_rx_intr_cpu = (mac_rx_intr_retarget ?
 		    srs_cpu->mc_rx_pollid : -1);
@@ -1122,7 +1222,7 @@ mac_flow_cpu_init(flow_entry_t *flent, cpupart_t *cpupart)
 		srs_cpu->mc_ncpus++;
 		srs_cpu->mc_cpus[j++] = cpuid;
 		if (!mac_latency_optimize) {
-			cpuid = mac_next_bind_cpu(cpupart);
+			cpuid = mac_next_bind_cpu_lgrp(cpupart, lgrp);
 			srs_cpu->mc_ncpus++;
 			srs_cpu->mc_cpus[j++] = cpuid;
 		}
@@ -190,6 +190,17 @@ mac_tx_mode_t mac_tx_mode_list[] = {
  */
 boolean_t mac_latency_optimize = B_TRUE;
 
+/*
+ * mac_tx_fanout_l4hash
+ *
+ * When a single packet is sent with a fanout hint in SRS_TX_FANOUT mode,
+ * pick the Tx ring from a hash of its L4 tuple rather than from the hint.
+ * The hint is derived from a conn_t address and spreads poorly over a
+ * small number of rings, while the tuple hash is just as stable for the
+ * life of a connection.
+ */
+boolean_t mac_tx_fanout_l4hash = B_TRUE;
+
 /*
  * MAC_RX_SRS_ENQUEUE_CHAIN and MAC_TX_SRS_ENQUEUE_CHAIN
  *
@@ -2324,6 +2335,67 @@ mac_rx_srs_subflow_process(void *arg, mac_resource_handle_t srs,
 	}
 }
 
+/*
+ * Adaptive interrupt moderation.
+ *
+ * For a hardware Rx ring whose driver supplies mri_itr, the SRS counts
+ * the interrupts and packets delivered by mac_rx_srs_process(). At the
+ * end of each period of mac_rx_itr_period ticks it looks at the packets
+ * per interrupt and at the backlog queued in the SRS and its soft rings.
+ * Many packets per interrupt or a backlog mean the CPU is busy, so the
+ * interval between interrupts is doubled to coalesce more. A few packets
+ * per interrupt with nothing queued means interrupts are cheap, so the
+ * interval is halved to cut latency. The interval stays within
+ * [mac_rx_itr_min, mac_rx_itr_max] microseconds.
+ *
+ * The counters are only updated from the ring's interrupt path, which
+ * the driver serializes, so they are kept without a lock.
+ */
+boolean_t mac_rx_itr_enable = B_TRUE;
+clock_t mac_rx_itr_period = 1;
+uint_t mac_rx_itr_min = 0;
+uint_t mac_rx_itr_max = 200;
+uint_t mac_rx_itr_init = 50;
+uint_t mac_rx_itr_pkts_low = 4;
+uint_t mac_rx_itr_pkts_high = 32;
+
+static void
+mac_rx_srs_itr(mac_soft_ring_set_t *mac_srs, int count)
+{
+	mac_srs_rx_t	*srs_rx = &mac_srs->srs_rx;
+	mac_ring_t	*ring = mac_srs->srs_ring;
+	clock_t		now = ddi_get_lbolt();
+	uint_t		ppi, itr;
+
+	if (srs_rx->sr_itr_start == 0) {
+		srs_rx->sr_itr = mac_rx_itr_init;
+		srs_rx->sr_itr_start = now;
+	}
+	srs_rx->sr_itr_intrs++;
+	srs_rx->sr_itr_pkts += count;
+	if (now - srs_rx->sr_itr_start < mac_rx_itr_period)
+		return;
+
+	ppi = srs_rx->sr_itr_pkts / srs_rx->sr_itr_intrs;
+	itr = srs_rx->sr_itr;
+	if (ppi >= mac_rx_itr_pkts_high ||
+	    srs_rx->sr_poll_pkt_cnt >= mac_rx_itr_pkts_high) {
+		itr = MIN(MAX(itr * 2, 8), mac_rx_itr_max);
+	} else if (ppi <= mac_rx_itr_pkts_low && srs_rx->sr_poll_pkt_cnt == 0) {
+		itr = MAX(itr / 2, mac_rx_itr_min);
+	}
+	srs_rx->sr_itr_intrs = 0;
+	srs_rx->sr_itr_pkts = 0;
+	srs_rx->sr_itr_start = now;
+
+	if (itr != srs_rx->sr_itr) {
+		DTRACE_PROBE4(mac__rx__itr, mac_soft_ring_set_t *, mac_srs,
+		    uint_t, ppi, uint_t, srs_rx->sr_itr, uint_t, itr);
+		srs_rx->sr_itr = itr;
+		ring->mr_info.mri_itr(ring->mr_driver, itr);
+	}
+}
+
 /*
  * mac_rx_srs_process
  *
@@ -2359,6 +2431,10 @@ mac_rx_srs_process(void *arg, mac_resource_handle_t srs, mblk_t *mp_chain,
 		mp = mp->b_next;
 	}
 
+	if (!loopback && mac_rx_itr_enable && mac_srs->srs_ring != NULL &&
+	    mac_srs->srs_ring->mr_info.mri_itr != NULL)
+		mac_rx_srs_itr(mac_srs, count);
+
 	mutex_enter(&mac_srs->srs_lock);
 
 	if (loopback) {
@@ -2850,9 +2926,18 @@ mac_tx_fanout_mode(mac_soft_ring_set_t *mac_srs, mblk_t *mp_chain,
 	if (fanout_hint != 0) {
 		/*
 		 * The hint is specified by the caller, simply pass the
-		 * whole chain to the soft ring.
+		 * whole chain to the soft ring. A lone packet is hashed
+		 * on its L4 tuple, which falls back to the hint if the
+		 * headers can't be parsed.
 		 */
-		hash = HASH_HINT(fanout_hint);
+		hash = 0;
+		if (mac_tx_fanout_l4hash && mp_chain->b_next == NULL) {
+			hash = mac_pkt_hash(
+			    mac_srs->srs_mcip->mci_mip->mi_info.mi_media,
+			    mp_chain, MAC_PKT_HASH_L4, B_TRUE);
+		}
+		if (hash == 0)
+			hash = HASH_HINT(fanout_hint);
 		MAC_TX_SOFT_RING_PROCESS(mp_chain);
 	} else {
 		mblk_t *last_mp, *cur_mp, *sub_chain;
@@ -78,6 +78,9 @@
 #include <sys/strsubr.h>
 #include <sys/strsun.h>
 #include <sys/vlan.h>
+#include <sys/pattr.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp_seq.h>
 #include <inet/ipsec_impl.h>
 #include <inet/ip_impl.h>
 #include <inet/sadb.h>
@@ -337,6 +340,291 @@ mac_soft_ring_fire(void *arg)
 	mutex_exit(&ringp->s_ring_lock);
 }
 
+/*
+ * Software large receive offload.
+ *
+ * Before a chain of packets is handed up from a TCP soft ring, in-order
+ * data segments of the same connection are coalesced into one packet: the
+ * first segment keeps its IP and TCP headers, the payload of each following
+ * segment is linked behind it with b_cont, and the headers are updated to
+ * describe the whole.  IP and TCP then do their per-packet work once for up
+ * to mac_soft_ring_lro_max_segs segments, which matters for the many NIC
+ * drivers that have no hardware LRO.
+ *
+ * Only plain data segments are merged: IPv4 without options or
+ * fragmentation, TCP with ACK and possibly PSH set, no TCP option other
+ * than a timestamp, the same TOS byte (so ECN CE marks are never merged
+ * away) and a checksum the hardware has verified.  The merged packet gets
+ * a correct TCP checksum, computed from those of its segments.  A segment
+ * that does not follow on in sequence, or any other packet of the
+ * connection, ends the merge, so every connection still sees its packets
+ * in their original order.
+ *
+ * Merged packets are larger than the link MTU, so a system that forwards
+ * IPv4 traffic should set mac_soft_ring_lro_enable to B_FALSE.
+ */
+boolean_t	mac_soft_ring_lro_enable = B_TRUE;
+uint_t		mac_soft_ring_lro_max_segs = 32;
+
+#define	MAC_LRO_FLOWS		8	/* connections merged at a time */
+#define	MAC_LRO_TS_HDR_LEN	(sizeof (struct tcphdr) + 12)
+#define	MAC_LRO_TS_OPT		((TCPOPT_NOP << 24) | (TCPOPT_NOP << 16) | \
+	(TCPOPT_TSTAMP << 8) | 10)
+
+typedef struct mac_lro_flow_s {
+	mblk_t		*lf_head;	/* merged packet, NULL if slot free */
+	mblk_t		*lf_tail;	/* last mblk of lf_head */
+	uint32_t	lf_seq;		/* next expected sequence number */
+	uint32_t	lf_sum;		/* one's complement sum of payload */
+	uint_t		lf_len;		/* payload length */
+	uint_t		lf_segs;	/* number of segments merged */
+} mac_lro_flow_t;
+
+static uint32_t
+mac_lro_sum(const void *buf, uint_t len)
+{
+	const uint16_t	*wp = buf;
+	uint32_t	sum = 0;
+
+	for (len >>= 1; len > 0; len--)
+		sum += *wp++;
+	return (sum);
+}
+
+static uint16_t
+mac_lro_fold(uint32_t sum)
+{
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return ((uint16_t)sum);
+}
+
+/*
+ * One's complement sum of the TCP pseudo-header and TCP header.
+ */
+static uint32_t
+mac_lro_hdr_sum(ipha_t *ipha, struct tcphdr *tcph, uint_t hlen, uint_t len)
+{
+	return (mac_lro_sum(&ipha->ipha_src, 2 * sizeof (ipaddr_t)) +
+	    htons(IPPROTO_TCP) + htons(hlen + len) + mac_lro_sum(tcph, hlen));
+}
+
+/*
+ * If mp is an IPv4 TCP packet whose IP and TCP headers are in the first
+ * mblk, return its TCP header, else NULL.
+ */
+static struct tcphdr *
+mac_lro_tcph(mblk_t *mp)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	struct tcphdr	*tcph;
+
+	if (MBLKL(mp) < IP_SIMPLE_HDR_LENGTH + sizeof (struct tcphdr) ||
+	    ipha->ipha_version_and_hdr_length != IP_SIMPLE_HDR_VERSION ||
+	    ipha->ipha_protocol != IPPROTO_TCP)
+		return (NULL);
+	tcph = (struct tcphdr *)&ipha[1];
+	if (MBLKL(mp) < IP_SIMPLE_HDR_LENGTH + (tcph->th_off << 2))
+		return (NULL);
+	return (tcph);
+}
+
+/*
+ * Return the payload length of a segment that may be merged, or 0.
+ */
+static uint_t
+mac_lro_eligible(mblk_t *mp, ipha_t *ipha, struct tcphdr *tcph)
+{
+	uint_t	hlen = tcph->th_off << 2;
+	uint_t	len = ntohs(ipha->ipha_length);
+
+	if (mp->b_cont != NULL || MBLKL(mp) != len ||
+	    !(DB_CKSUMFLAGS(mp) & HCK_FULLCKSUM_OK) ||
+	    (ntohs(ipha->ipha_fragment_offset_and_flags) &
+	    (IPH_MF | IPH_OFFSET)) != 0 ||
+	    (tcph->th_flags & ~TH_PUSH) != TH_ACK)
+		return (0);
+	if (hlen != sizeof (struct tcphdr) && (hlen != MAC_LRO_TS_HDR_LEN ||
+	    *(uint32_t *)&tcph[1] != htonl(MAC_LRO_TS_OPT)))
+		return (0);
+	if (len <= IP_SIMPLE_HDR_LENGTH + hlen)
+		return (0);
+	return (len - IP_SIMPLE_HDR_LENGTH - hlen);
+}
+
+static mac_lro_flow_t *
+mac_lro_lookup(mac_lro_flow_t *flows, ipha_t *ipha, struct tcphdr *tcph)
+{
+	mac_lro_flow_t	*lf;
+	ipha_t		*lipha;
+
+	for (lf = flows; lf < &flows[MAC_LRO_FLOWS]; lf++) {
+		if (lf->lf_head == NULL)
+			continue;
+		lipha = (ipha_t *)lf->lf_head->b_rptr;
+		if (lipha->ipha_src == ipha->ipha_src &&
+		    lipha->ipha_dst == ipha->ipha_dst &&
+		    *(uint32_t *)&lipha[1] == *(uint32_t *)tcph)
+			return (lf);
+	}
+	return (NULL);
+}
+
+static void
+mac_lro_start(mac_lro_flow_t *lf, mblk_t *mp, uint_t len)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	struct tcphdr	*tcph = (struct tcphdr *)&ipha[1];
+
+	lf->lf_head = lf->lf_tail = mp;
+	lf->lf_seq = ntohl(tcph->th_seq) + len;
+	lf->lf_sum = (uint16_t)~mac_lro_fold(mac_lro_hdr_sum(ipha, tcph,
+	    tcph->th_off << 2, len));
+	lf->lf_len = len;
+	lf->lf_segs = 1;
+}
+
+/*
+ * Append the payload of mp, a segment of lf's connection with 'len' bytes
+ * of data, to lf's packet.  Return B_FALSE if it cannot be merged.
+ */
+static boolean_t
+mac_lro_merge(mac_lro_flow_t *lf, mblk_t *mp, uint_t len)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	struct tcphdr	*tcph = (struct tcphdr *)&ipha[1];
+	ipha_t		*lipha = (ipha_t *)lf->lf_head->b_rptr;
+	struct tcphdr	*ltcph = (struct tcphdr *)&lipha[1];
+	uint_t		hlen = tcph->th_off << 2;
+	uint32_t	*ts, *lts;
+	uint16_t	sum;
+
+	if (ipha->ipha_type_of_service != lipha->ipha_type_of_service ||
+	    tcph->th_off != ltcph->th_off ||
+	    ntohl(tcph->th_seq) != lf->lf_seq ||
+	    SEQ_LT(ntohl(tcph->th_ack), ntohl(ltcph->th_ack)) ||
+	    lf->lf_segs >= mac_soft_ring_lro_max_segs ||
+	    IP_SIMPLE_HDR_LENGTH + hlen + lf->lf_len + len > IP_MAXPACKET)
+		return (B_FALSE);
+
+	if (hlen == MAC_LRO_TS_HDR_LEN) {
+		/* NOP, NOP, kind, length, TSval, TSecr */
+		ts = (uint32_t *)&tcph[1];
+		lts = (uint32_t *)&ltcph[1];
+		if (SEQ_LT(ntohl(ts[1]), ntohl(lts[1])))
+			return (B_FALSE);
+		lts[1] = ts[1];
+		lts[2] = ts[2];
+	}
+
+	/*
+	 * The payload's contribution to the checksum is byte swapped if it
+	 * starts at an odd offset in the merged packet.
+	 */
+	sum = ~mac_lro_fold(mac_lro_hdr_sum(ipha, tcph, hlen, len));
+	if (lf->lf_len & 1)
+		sum = (sum << 8) | (sum >> 8);
+	lf->lf_sum += sum;
+
+	ltcph->th_ack = tcph->th_ack;
+	ltcph->th_win = tcph->th_win;
+	ltcph->th_flags |= tcph->th_flags;
+
+	mp->b_rptr += IP_SIMPLE_HDR_LENGTH + hlen;
+	lf->lf_tail->b_cont = mp;
+	lf->lf_tail = mp;
+	lf->lf_seq += len;
+	lf->lf_len += len;
+	lf->lf_segs++;
+	return (B_TRUE);
+}
+
+/*
+ * Finish lf's packet, which is already on the outgoing chain, and free the
+ * slot.
+ */
+static void
+mac_lro_flush(mac_lro_flow_t *lf, uint_t *pktsp)
+{
+	ipha_t		*ipha = (ipha_t *)lf->lf_head->b_rptr;
+	struct tcphdr	*tcph = (struct tcphdr *)&ipha[1];
+	uint_t		hlen = tcph->th_off << 2;
+
+	if (lf->lf_segs > 1) {
+		ipha->ipha_length = htons(IP_SIMPLE_HDR_LENGTH + hlen +
+		    lf->lf_len);
+		ipha->ipha_hdr_checksum = 0;
+		ipha->ipha_hdr_checksum = (uint16_t)ip_csum_hdr(ipha);
+		tcph->th_sum = 0;
+		tcph->th_sum = ~mac_lro_fold(mac_lro_hdr_sum(ipha, tcph, hlen,
+		    lf->lf_len) + lf->lf_sum);
+		(*pktsp)++;
+	}
+	lf->lf_head = NULL;
+}
+
+/*
+ * Coalesce the segments of 'chain', a chain of packets from a TCP soft
+ * ring, and return the resulting chain.  The number of merged packets made
+ * and of segments they absorbed are added to *pktsp and *segsp.
+ */
+static mblk_t *
+mac_rx_soft_ring_lro(mblk_t *chain, uint_t *pktsp, uint_t *segsp)
+{
+	mac_lro_flow_t	flows[MAC_LRO_FLOWS], *lf;
+	mblk_t		*head = NULL, *tail = NULL;
+	mblk_t		*mp;
+	struct tcphdr	*tcph;
+	uint_t		len, victim = 0;
+
+	bzero(flows, sizeof (flows));
+	while (chain != NULL) {
+		mp = chain;
+		chain = mp->b_next;
+		mp->b_next = NULL;
+
+		if ((tcph = mac_lro_tcph(mp)) == NULL)
+			goto deliver;
+
+		len = mac_lro_eligible(mp, (ipha_t *)mp->b_rptr, tcph);
+		lf = mac_lro_lookup(flows, (ipha_t *)mp->b_rptr, tcph);
+		if (lf != NULL) {
+			if (len != 0 && mac_lro_merge(lf, mp, len)) {
+				(*segsp)++;
+				if (tcph->th_flags & TH_PUSH)
+					mac_lro_flush(lf, pktsp);
+				continue;
+			}
+			mac_lro_flush(lf, pktsp);
+		}
+		if (len == 0 || (tcph->th_flags & TH_PUSH))
+			goto deliver;
+
+		for (lf = flows; lf < &flows[MAC_LRO_FLOWS]; lf++) {
+			if (lf->lf_head == NULL)
+				break;
+		}
+		if (lf == &flows[MAC_LRO_FLOWS]) {
+			lf = &flows[victim];
+			victim = (victim + 1) % MAC_LRO_FLOWS;
+			mac_lro_flush(lf, pktsp);
+		}
+		mac_lro_start(lf, mp, len);
+deliver:
+		if (head == NULL)
+			head = mp;
+		else
+			tail->b_next = mp;
+		tail = mp;
+	}
+
+	for (lf = flows; lf < &flows[MAC_LRO_FLOWS]; lf++) {
+		if (lf->lf_head != NULL)
+			mac_lro_flush(lf, pktsp);
+	}
+	return (head);
+}
+
 /*
  * mac_rx_soft_ring_drain
  *
@@ -357,6 +645,7 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 	mac_direct_rx_t	proc;
 	size_t		sz;
 	int		cnt;
+	uint_t		lro_pkts, lro_segs;
 	mac_soft_ring_set_t	*mac_srs = ringp->s_ring_set;
 
 	ringp->s_ring_run = curthread;
@@ -388,6 +677,11 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 			tid = 0;
 		}
 
+		lro_pkts = lro_segs = 0;
+		if ((ringp->s_ring_type & ST_RING_TCP) && cnt > 1 &&
+		    mac_soft_ring_lro_enable)
+			mp = mac_rx_soft_ring_lro(mp, &lro_pkts, &lro_segs);
+
 		(*proc)(arg1, arg2, mp, NULL);
 
 		/*
@@ -402,6 +696,8 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 		mutex_enter(&mac_srs->srs_lock);
 		MAC_UPDATE_SRS_COUNT_LOCKED(mac_srs, cnt);
 		MAC_UPDATE_SRS_SIZE_LOCKED(mac_srs, sz);
+		ringp->s_ring_lro_pkts += lro_pkts;
+		ringp->s_ring_lro_segs += lro_segs;
 		mutex_exit(&mac_srs->srs_lock);
 
 		mutex_enter(&ringp->s_ring_lock);
@@ -541,6 +837,7 @@ mac_soft_ring_poll(mac_soft_ring_t *ringp, int bytes_to_pickup)
 	mblk_t	*mp;
 	size_t	sz = 0;
 	int	cnt = 0;
+	uint_t	lro_pkts = 0, lro_segs = 0;
 	mac_soft_ring_set_t	*mac_srs = ringp->s_ring_set;
 
 	ASSERT(mac_srs != NULL);
@@ -580,6 +877,11 @@ mac_soft_ring_poll(mac_soft_ring_t *ringp, int bytes_to_pickup)
 	}
 
 	mutex_exit(&ringp->s_ring_lock);
+
+	if ((ringp->s_ring_type & ST_RING_TCP) && head->b_next != NULL &&
+	    mac_soft_ring_lro_enable)
+		head = mac_rx_soft_ring_lro(head, &lro_pkts, &lro_segs);
+
 	/*
 	 * Update the shared count and size counters so
 	 * that SRS has a accurate idea of queued packets.
@@ -587,6 +889,8 @@ mac_soft_ring_poll(mac_soft_ring_t *ringp, int bytes_to_pickup)
 	mutex_enter(&mac_srs->srs_lock);
 	MAC_UPDATE_SRS_COUNT_LOCKED(mac_srs, cnt);
 	MAC_UPDATE_SRS_SIZE_LOCKED(mac_srs, sz);
+	ringp->s_ring_lro_pkts += lro_pkts;
+	ringp->s_ring_lro_segs += lro_segs;
 	mutex_exit(&mac_srs->srs_lock);
 	return (head);
 }
@@ -64,7 +64,11 @@ enum mac_stat {
 	MAC_STAT_MULTIRCVBYTES,
 	MAC_STAT_BRDCSTRCVBYTES,
 	MAC_STAT_MULTIXMTBYTES,
-	MAC_STAT_BRDCSTXMTBYTES
+	MAC_STAT_BRDCSTXMTBYTES,
+	MAC_STAT_LROPKTS,
+	MAC_STAT_LROSEGS,
+	MAC_STAT_INTRCPU,
+	MAC_STAT_POLLCPU
 };
 
 static mac_stat_info_t	i_mac_si[] = {
@@ -170,7 +174,9 @@ static mac_stat_info_t  i_mac_rx_hwlane_si[] = {
 	{ MAC_STAT_RXSDROPS,	"rxsdrops",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_CHU10,	"chainunder10",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_CH10T50,	"chain10to50",	KSTAT_DATA_UINT64,	0},
-	{ MAC_STAT_CHO50,	"chainover50",	KSTAT_DATA_UINT64,	0}
+	{ MAC_STAT_CHO50,	"chainover50",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_INTRCPU,	"intrcpu",	KSTAT_DATA_INT32,	0},
+	{ MAC_STAT_POLLCPU,	"pollcpu",	KSTAT_DATA_INT32,	0}
 };
 #define	MAC_RX_HWLANE_NKSTAT \
 	(sizeof (i_mac_rx_hwlane_si) / sizeof (mac_stat_info_t))
@@ -235,6 +241,8 @@ static mac_stat_info_t  i_mac_tx_hwlane_si[] = {
 static mac_stat_info_t  i_mac_rx_fanout_si[] = {
 	{ MAC_STAT_RBYTES,	"rbytes",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_IPACKETS,	"ipackets",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_LROPKTS,	"lropkts",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_LROSEGS,	"lrosegs",	KSTAT_DATA_UINT64,	0},
 };
 #define	MAC_RX_FANOUT_NKSTAT \
 	(sizeof (i_mac_rx_fanout_si) / sizeof (mac_stat_info_t))
@@ -369,6 +377,9 @@ i_mac_stat_update(kstat_t *ksp, int rw, uint64_t (*fn)(void *, uint_t),
 		case KSTAT_DATA_UINT32:
 			knp->value.ui32 = (uint32_t)val;
 			break;
+		case KSTAT_DATA_INT32:
+			knp->value.i32 = (int32_t)val;
+			break;
 		default:
 			ASSERT(B_FALSE);
 			break;
@@ -642,6 +653,13 @@ i_mac_rx_hwlane_stat_get(void *handle, uint_t stat)
 	case MAC_STAT_CHO50:
 		return (mac_rx_stat->mrs_chaincntover50);
 
+	/* Where the ring's interrupt and poll thread went, or -1 */
+	case MAC_STAT_INTRCPU:
+		return ((uint64_t)(int64_t)mac_srs->srs_cpu.mc_rx_intr_cpu);
+
+	case MAC_STAT_POLLCPU:
+		return ((uint64_t)(int64_t)mac_srs->srs_poll_cpuid);
+
 	default:
 		return (0);
 	}
@@ -901,6 +919,15 @@ i_mac_rx_fanout_stat_get(void *handle, uint_t stat)
 		    (oth_ringp->s_ring_total_inpkt);
 		break;
 
+	/* Only TCP soft rings coalesce */
+	case MAC_STAT_LROPKTS:
+		val = tcp_ringp->s_ring_lro_pkts;
+		break;
+
+	case MAC_STAT_LROSEGS:
+		val = tcp_ringp->s_ring_lro_segs;
+		break;
+
 	default:
 		val = 0;
 		break;
@@ -0,0 +1,1232 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * NVM Express driver.
+ *
+ * Each active namespace of the controller is attached to blkdev as a disk
+ * of its own.  blkdev does the labelling, the partitioning and the
+ * queueing; what is left here is to get the transfers it hands us to the
+ * controller and back.
+ *
+ * Queues
+ *
+ * At attach we ask the controller for one I/O queue pair (submission
+ * queue plus the completion queue it posts to) per CPU, up to
+ * nvme_max_ioq, and report as many submission queues to blkdev.  blkdev
+ * puts a transfer submitted on CPU n on queue n % nioq, and every queue
+ * pair has locks of its own, so CPUs issuing I/O to the same device don't
+ * get in each other's way.  Each completion queue is tied to an interrupt
+ * vector, (queue % nintrs), and with MSI-X we ask for a vector per queue,
+ * so that with irqs targeted at the CPUs feeding the queue, completions
+ * are handled where the I/O was issued.  With plain MSI or fixed
+ * interrupts all queues share one vector, which still works but is not
+ * where this driver shines.
+ *
+ * Commands
+ *
+ * Every queue pair has as many command slots as its queues have entries;
+ * blkdev never has more than d_qsize (entries - 1) transfers running on a
+ * queue, so neither a slot nor a submission queue entry is ever wanted
+ * while none is free.  The index of the slot is the command identifier.
+ * Each slot comes with a page that holds the PRP list of a transfer with
+ * more than two DMA cookies, or the ranges of a deallocate.  The DMA
+ * attributes given to blkdev make every cookie a single PRP entry: none
+ * crosses a page, and only the first may start within one.
+ *
+ * Admin commands are only issued while attaching and detaching, one at a
+ * time, and are polled for.
+ *
+ * Deallocate
+ *
+ * When the controller has Dataset Management, blkdev's o_free_space is
+ * wired to a DSM deallocate, which is what a DKIOCFREE from ZFS ends up
+ * as.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/sysmacros.h>
+#include <sys/errno.h>
+#include <sys/kmem.h>
+#include <sys/cmn_err.h>
+#include <sys/conf.h>
+#include <sys/devops.h>
+#include <sys/modctl.h>
+#include <sys/cpuvar.h>
+#include <sys/atomic.h>
+#include <sys/ddi.h>
+#include <sys/sunddi.h>
+#include <sys/pci.h>
+#include <sys/blkdev.h>
+
+#include "nvme_reg.h"
+#include "nvme_var.h"
+
+/* Tunables */
+int nvme_max_ioq = 64;			/* I/O queue pairs */
+int nvme_io_queue_len = 1024;		/* entries per I/O queue */
+int nvme_admin_queue_len = 32;
+uint32_t nvme_max_xfer = 1024 * 1024;
+
+#define	NVME_ADMIN_TIMEOUT	5000	/* ms */
+#define	NVME_POLL_TIMEOUT	30000	/* ms, for polled (dump) I/O */
+
+static void *nvme_state;
+
+static ddi_device_acc_attr_t nvme_reg_acc_attr = {
+	DDI_DEVICE_ATTR_V0,
+	DDI_STRUCTURE_LE_ACC,
+	DDI_STRICTORDER_ACC
+};
+
+static ddi_device_acc_attr_t nvme_mem_acc_attr = {
+	DDI_DEVICE_ATTR_V0,
+	DDI_STRUCTURE_LE_ACC,
+	DDI_STRICTORDER_ACC
+};
+
+/* Queues, identify data, PRP lists: one page-aligned piece */
+static ddi_dma_attr_t nvme_mem_dma_attr = {
+	DMA_ATTR_V0,			/* dma_attr_version */
+	0,				/* dma_attr_addr_lo */
+	0xFFFFFFFFFFFFFFFFull,		/* dma_attr_addr_hi */
+	0xFFFFFFFFull,			/* dma_attr_count_max */
+	0,				/* dma_attr_align, set in attach */
+	1,				/* dma_attr_burstsizes */
+	1,				/* dma_attr_minxfer */
+	0xFFFFFFFFull,			/* dma_attr_maxxfer */
+	0xFFFFFFFFFFFFFFFFull,		/* dma_attr_seg */
+	1,				/* dma_attr_sgllen */
+	1,				/* dma_attr_granular */
+	0				/* dma_attr_flags */
+};
+
+static int nvme_attach(dev_info_t *, ddi_attach_cmd_t);
+static int nvme_detach(dev_info_t *, ddi_detach_cmd_t);
+static int nvme_quiesce(dev_info_t *);
+
+static void nvme_bd_driveinfo(void *, bd_drive_t *);
+static int nvme_bd_mediainfo(void *, bd_media_t *);
+static int nvme_bd_devid(void *, dev_info_t *, ddi_devid_t *);
+static int nvme_bd_sync(void *, bd_xfer_t *);
+static int nvme_bd_read(void *, bd_xfer_t *);
+static int nvme_bd_write(void *, bd_xfer_t *);
+static int nvme_bd_free_space(void *, bd_xfer_t *);
+
+static bd_ops_t nvme_bd_ops = {
+	BD_OPS_VERSION_1,
+	nvme_bd_driveinfo,
+	nvme_bd_mediainfo,
+	nvme_bd_devid,
+	nvme_bd_sync,
+	nvme_bd_read,
+	nvme_bd_write,
+	nvme_bd_free_space,
+};
+
+static struct dev_ops nvme_dev_ops = {
+	DEVO_REV,		/* devo_rev */
+	0,			/* refcnt */
+	ddi_no_info,		/* getinfo */
+	nulldev,		/* identify */
+	nulldev,		/* probe */
+	nvme_attach,		/* attach */
+	nvme_detach,		/* detach */
+	nodev,			/* reset */
+	NULL,			/* driver operations */
+	NULL,			/* bus operations */
+	NULL,			/* power */
+	nvme_quiesce,		/* quiesce */
+};
+
+static struct modldrv nvme_modldrv = {
+	&mod_driverops,
+	"NVM Express",
+	&nvme_dev_ops,
+};
+
+static struct modlinkage nvme_modlinkage = {
+	MODREV_1, { &nvme_modldrv, NULL }
+};
+
+/*
+ * Register access
+ */
+static uint32_t
+nvme_get32(nvme_t *n, uintptr_t reg)
+{
+	return (ddi_get32(n->n_regh, (uint32_t *)(n->n_regs + reg)));
+}
+
+static void
+nvme_put32(nvme_t *n, uintptr_t reg, uint32_t val)
+{
+	ddi_put32(n->n_regh, (uint32_t *)(n->n_regs + reg), val);
+}
+
+static uint64_t
+nvme_get64(nvme_t *n, uintptr_t reg)
+{
+	return (ddi_get64(n->n_regh, (uint64_t *)(n->n_regs + reg)));
+}
+
+static void
+nvme_put64(nvme_t *n, uintptr_t reg, uint64_t val)
+{
+	ddi_put64(n->n_regh, (uint64_t *)(n->n_regs + reg), val);
+}
+
+/*
+ * DMA memory
+ */
+static int
+nvme_dma_alloc(nvme_t *n, nvme_dma_t *nd, size_t len, uint_t flags)
+{
+	ddi_dma_attr_t		attr = nvme_mem_dma_attr;
+	ddi_dma_cookie_t	cookie;
+	size_t			real;
+	uint_t			ncookies;
+
+	attr.dma_attr_align = n->n_pagesize;
+
+	bzero(nd, sizeof (*nd));
+	if (ddi_dma_alloc_handle(n->n_dip, &attr, DDI_DMA_SLEEP, NULL,
+	    &nd->nd_dmah) != DDI_SUCCESS)
+		return (DDI_FAILURE);
+	if (ddi_dma_mem_alloc(nd->nd_dmah, len, &nvme_mem_acc_attr,
+	    DDI_DMA_CONSISTENT, DDI_DMA_SLEEP, NULL, &nd->nd_kaddr, &real,
+	    &nd->nd_acch) != DDI_SUCCESS) {
+		ddi_dma_free_handle(&nd->nd_dmah);
+		return (DDI_FAILURE);
+	}
+	bzero(nd->nd_kaddr, real);
+	if (ddi_dma_addr_bind_handle(nd->nd_dmah, NULL, nd->nd_kaddr, real,
+	    flags | DDI_DMA_CONSISTENT, DDI_DMA_SLEEP, NULL, &cookie,
+	    &ncookies) != DDI_DMA_MAPPED) {
+		ddi_dma_mem_free(&nd->nd_acch);
+		ddi_dma_free_handle(&nd->nd_dmah);
+		return (DDI_FAILURE);
+	}
+	ASSERT(ncookies == 1);
+	nd->nd_paddr = cookie.dmac_laddress;
+	nd->nd_len = real;
+	return (DDI_SUCCESS);
+}
+
+static void
+nvme_dma_free(nvme_dma_t *nd)
+{
+	if (nd->nd_dmah == NULL)
+		return;
+	(void) ddi_dma_unbind_handle(nd->nd_dmah);
+	ddi_dma_mem_free(&nd->nd_acch);
+	ddi_dma_free_handle(&nd->nd_dmah);
+	nd->nd_dmah = NULL;
+}
+
+/*
+ * Queue pairs
+ */
+static void
+nvme_qpair_free(nvme_qpair_t *qp)
+{
+	uint_t	i;
+
+	if (qp->qp_cmds != NULL) {
+		for (i = 0; i < qp->qp_nentry; i++)
+			nvme_dma_free(&qp->qp_cmds[i].nc_page);
+		kmem_free(qp->qp_cmds, qp->qp_nentry * sizeof (nvme_cmd_t));
+	}
+	nvme_dma_free(&qp->qp_sqdma);
+	nvme_dma_free(&qp->qp_cqdma);
+	mutex_destroy(&qp->qp_sqlock);
+	mutex_destroy(&qp->qp_cqlock);
+	kmem_free(qp, sizeof (nvme_qpair_t));
+}
+
+static nvme_qpair_t *
+nvme_qpair_alloc(nvme_t *n, uint16_t qid, uint16_t nentry, uint_t vector)
+{
+	nvme_qpair_t	*qp;
+	uint_t		i;
+
+	qp = kmem_zalloc(sizeof (nvme_qpair_t), KM_SLEEP);
+	qp->qp_nvme = n;
+	qp->qp_id = qid;
+	qp->qp_nentry = nentry;
+	qp->qp_vector = vector;
+	qp->qp_phase = 1;
+	qp->qp_sqdb = NVME_REG_SQTDBL + (2 * qid) * n->n_dstrd;
+	qp->qp_cqdb = NVME_REG_SQTDBL + (2 * qid + 1) * n->n_dstrd;
+	mutex_init(&qp->qp_sqlock, NULL, MUTEX_DRIVER,
+	    DDI_INTR_PRI(n->n_intr_pri));
+	mutex_init(&qp->qp_cqlock, NULL, MUTEX_DRIVER,
+	    DDI_INTR_PRI(n->n_intr_pri));
+
+	if (nvme_dma_alloc(n, &qp->qp_sqdma, nentry * sizeof (nvme_sqe_t),
+	    DDI_DMA_WRITE) != DDI_SUCCESS ||
+	    nvme_dma_alloc(n, &qp->qp_cqdma, nentry * sizeof (nvme_cqe_t),
+	    DDI_DMA_READ) != DDI_SUCCESS) {
+		nvme_qpair_free(qp);
+		return (NULL);
+	}
+	qp->qp_sq = (nvme_sqe_t *)qp->qp_sqdma.nd_kaddr;
+	qp->qp_cq = (nvme_cqe_t *)qp->qp_cqdma.nd_kaddr;
+
+	qp->qp_cmds = kmem_zalloc(nentry * sizeof (nvme_cmd_t), KM_SLEEP);
+	for (i = 0; i < nentry; i++) {
+		if (nvme_dma_alloc(n, &qp->qp_cmds[i].nc_page, n->n_pagesize,
+		    DDI_DMA_WRITE) != DDI_SUCCESS) {
+			nvme_qpair_free(qp);
+			return (NULL);
+		}
+	}
+	return (qp);
+}
+
+/*
+ * Take a free command slot.  See the block comment for why there is one.
+ */
+static nvme_cmd_t *
+nvme_cmd_get(nvme_qpair_t *qp, uint16_t *cidp)
+{
+	nvme_cmd_t	*cmd;
+	uint16_t	cid;
+
+	ASSERT(MUTEX_HELD(&qp->qp_sqlock));
+
+	for (;;) {
+		cid = qp->qp_nextcid;
+		qp->qp_nextcid = (cid + 1) % qp->qp_nentry;
+		cmd = &qp->qp_cmds[cid];
+		if (!cmd->nc_busy)
+			break;
+	}
+	cmd->nc_busy = B_TRUE;
+	cmd->nc_done = B_FALSE;
+	*cidp = cid;
+	return (cmd);
+}
+
+static void
+nvme_submit(nvme_qpair_t *qp, nvme_sqe_t *sqe)
+{
+	nvme_t	*n = qp->qp_nvme;
+
+	ASSERT(MUTEX_HELD(&qp->qp_sqlock));
+
+	bcopy(sqe, &qp->qp_sq[qp->qp_sqtail], sizeof (nvme_sqe_t));
+	(void) ddi_dma_sync(qp->qp_sqdma.nd_dmah,
+	    qp->qp_sqtail * sizeof (nvme_sqe_t), sizeof (nvme_sqe_t),
+	    DDI_DMA_SYNC_FORDEV);
+	qp->qp_sqtail = (qp->qp_sqtail + 1) % qp->qp_nentry;
+	nvme_put32(n, qp->qp_sqdb, qp->qp_sqtail);
+}
+
+static int
+nvme_status_errno(uint16_t status)
+{
+	if (NVME_CQE_SCT(status) == NVME_SCT_GENERIC) {
+		switch (NVME_CQE_SC(status)) {
+		case NVME_SC_SUCCESS:
+			return (0);
+		case NVME_SC_LBA_RANGE:
+		case NVME_SC_CAP_EXCEEDED:
+			return (EINVAL);
+		case NVME_SC_NS_NOT_READY:
+			return (EAGAIN);
+		default:
+			return (EIO);
+		}
+	}
+	if (NVME_CQE_SCT(status) == NVME_SCT_MEDIA &&
+	    NVME_CQE_SC(status) == NVME_SC_WRITE_PROTECT)
+		return (EROFS);
+	return (EIO);
+}
+
+#define	NVME_CQ_BATCH	32
+
+/*
+ * Reap the completion queue.  Transfers are handed back to blkdev after
+ * the queue lock has been dropped, as blkdev may submit the next window
+ * of a transfer, or the next transfer, from bd_xfer_done().  Returns the
+ * number of entries consumed.
+ */
+static uint_t
+nvme_process_cq(nvme_qpair_t *qp)
+{
+	nvme_t		*n = qp->qp_nvme;
+	bd_xfer_t	*xfers[NVME_CQ_BATCH];
+	int		errs[NVME_CQ_BATCH];
+	nvme_cqe_t	*cqe;
+	nvme_cmd_t	*cmd;
+	uint_t		total = 0;
+	uint_t		nx, i;
+
+	do {
+		nx = 0;
+		mutex_enter(&qp->qp_cqlock);
+		while (nx < NVME_CQ_BATCH) {
+			(void) ddi_dma_sync(qp->qp_cqdma.nd_dmah,
+			    qp->qp_cqhead * sizeof (nvme_cqe_t),
+			    sizeof (nvme_cqe_t), DDI_DMA_SYNC_FORKERNEL);
+			cqe = &qp->qp_cq[qp->qp_cqhead];
+			if (NVME_CQE_PHASE(cqe->cqe_status) != qp->qp_phase)
+				break;
+
+			if (cqe->cqe_cid >= qp->qp_nentry) {
+				dev_err(n->n_dip, CE_WARN, "!queue %u: "
+				    "completion for bad command id %u",
+				    qp->qp_id, cqe->cqe_cid);
+			} else {
+				cmd = &qp->qp_cmds[cqe->cqe_cid];
+				ASSERT(cmd->nc_busy);
+				if (cmd->nc_xfer != NULL) {
+					xfers[nx] = cmd->nc_xfer;
+					errs[nx] = nvme_status_errno(
+					    cqe->cqe_status);
+					nx++;
+					cmd->nc_xfer = NULL;
+					membar_producer();
+					cmd->nc_busy = B_FALSE;
+				} else {
+					/* Admin; the issuer frees the slot */
+					cmd->nc_status = cqe->cqe_status;
+					cmd->nc_dw0 = cqe->cqe_dw0;
+					membar_producer();
+					cmd->nc_done = B_TRUE;
+				}
+			}
+
+			if (++qp->qp_cqhead == qp->qp_nentry) {
+				qp->qp_cqhead = 0;
+				qp->qp_phase ^= 1;
+			}
+			total++;
+		}
+		if (total != 0)
+			nvme_put32(n, qp->qp_cqdb, qp->qp_cqhead);
+		mutex_exit(&qp->qp_cqlock);
+
+		for (i = 0; i < nx; i++)
+			bd_xfer_done(xfers[i], errs[i]);
+	} while (nx == NVME_CQ_BATCH);
+
+	return (total);
+}
+
+static uint_t
+nvme_intr(caddr_t arg1, caddr_t arg2)
+{
+	nvme_t		*n = (nvme_t *)arg1;
+	uint_t		vector = (uint_t)(uintptr_t)arg2;
+	uint_t		claimed = 0;
+	uint_t		i;
+
+	if (vector == 0 && n->n_adminq != NULL)
+		claimed += nvme_process_cq(n->n_adminq);
+	for (i = vector; i < n->n_nioq; i += n->n_intr_cnt)
+		claimed += nvme_process_cq(n->n_ioq[i]);
+
+	return (claimed != 0 ? DDI_INTR_CLAIMED : DDI_INTR_UNCLAIMED);
+}
+
+/*
+ * Run an admin command to completion.  Returns an errno, and the
+ * command specific result in *dw0.
+ */
+static int
+nvme_admin_cmd(nvme_t *n, nvme_sqe_t *sqe, uint32_t *dw0)
+{
+	nvme_qpair_t	*qp = n->n_adminq;
+	nvme_cmd_t	*cmd;
+	uint16_t	cid;
+	uint16_t	status;
+	int		ms;
+
+	mutex_enter(&qp->qp_sqlock);
+	cmd = nvme_cmd_get(qp, &cid);
+	cmd->nc_xfer = NULL;
+	sqe->sqe_cdw0 |= NVME_SQE_CDW0(0, cid);
+	nvme_submit(qp, sqe);
+	mutex_exit(&qp->qp_sqlock);
+
+	for (ms = 0; ms < NVME_ADMIN_TIMEOUT; ms++) {
+		(void) nvme_process_cq(qp);
+		if (cmd->nc_done)
+			break;
+		drv_usecwait(1000);
+	}
+	if (!cmd->nc_done) {
+		/* The slot stays busy, lest the answer turn up later */
+		dev_err(n->n_dip, CE_WARN, "!admin command 0x%x timed out",
+		    sqe->sqe_cdw0 & 0xff);
+		return (ETIMEDOUT);
+	}
+	membar_consumer();
+	status = cmd->nc_status;
+	if (dw0 != NULL)
+		*dw0 = cmd->nc_dw0;
+	cmd->nc_busy = B_FALSE;
+
+	if (NVME_CQE_SCT(status) != NVME_SCT_GENERIC ||
+	    NVME_CQE_SC(status) != NVME_SC_SUCCESS) {
+		dev_err(n->n_dip, CE_WARN, "!admin command 0x%x failed: "
+		    "type %u status 0x%x", sqe->sqe_cdw0 & 0xff,
+		    NVME_CQE_SCT(status), NVME_CQE_SC(status));
+		return (EIO);
+	}
+	return (0);
+}
+
+static int
+nvme_identify(nvme_t *n, uint32_t nsid, uint32_t cns, void *buf)
+{
+	nvme_dma_t	nd;
+	nvme_sqe_t	sqe;
+	int		rv;
+
+	if (nvme_dma_alloc(n, &nd, NVME_IDENTIFY_SIZE, DDI_DMA_READ) !=
+	    DDI_SUCCESS)
+		return (ENOMEM);
+
+	bzero(&sqe, sizeof (sqe));
+	sqe.sqe_cdw0 = NVME_SQE_CDW0(NVME_OPC_IDENTIFY, 0);
+	sqe.sqe_nsid = nsid;
+	sqe.sqe_prp1 = nd.nd_paddr;
+	if (n->n_pagesize < NVME_IDENTIFY_SIZE)
+		sqe.sqe_prp2 = nd.nd_paddr + n->n_pagesize;
+	sqe.sqe_cdw10 = cns;
+
+	if ((rv = nvme_admin_cmd(n, &sqe, NULL)) == 0) {
+		(void) ddi_dma_sync(nd.nd_dmah, 0, NVME_IDENTIFY_SIZE,
+		    DDI_DMA_SYNC_FORKERNEL);
+		bcopy(nd.nd_kaddr, buf, NVME_IDENTIFY_SIZE);
+	}
+	nvme_dma_free(&nd);
+	return (rv);
+}
+
+static int
+nvme_create_ioq(nvme_t *n, nvme_qpair_t *qp)
+{
+	nvme_sqe_t	sqe;
+	int		rv;
+
+	bzero(&sqe, sizeof (sqe));
+	sqe.sqe_cdw0 = NVME_SQE_CDW0(NVME_OPC_CREATE_CQ, 0);
+	sqe.sqe_prp1 = qp->qp_cqdma.nd_paddr;
+	sqe.sqe_cdw10 = ((uint32_t)(qp->qp_nentry - 1) << 16) | qp->qp_id;
+	sqe.sqe_cdw11 = (qp->qp_vector << 16) | NVME_CREATE_CQ_IEN |
+	    NVME_CREATE_Q_PC;
+	if ((rv = nvme_admin_cmd(n, &sqe, NULL)) != 0)
+		return (rv);
+
+	bzero(&sqe, sizeof (sqe));
+	sqe.sqe_cdw0 = NVME_SQE_CDW0(NVME_OPC_CREATE_SQ, 0);
+	sqe.sqe_prp1 = qp->qp_sqdma.nd_paddr;
+	sqe.sqe_cdw10 = ((uint32_t)(qp->qp_nentry - 1) << 16) | qp->qp_id;
+	sqe.sqe_cdw11 = ((uint32_t)qp->qp_id << 16) | NVME_CREATE_Q_PC;
+	return (nvme_admin_cmd(n, &sqe, NULL));
+}
+
+/*
+ * Controller enable and disable
+ */
+static int
+nvme_wait_ready(nvme_t *n, boolean_t ready)
+{
+	clock_t	deadline = ddi_get_lbolt() + n->n_timeout;
+	uint32_t csts;
+
+	for (;;) {
+		csts = nvme_get32(n, NVME_REG_CSTS);
+		if (csts == 0xffffffff)
+			return (ENXIO);
+		if (((csts & NVME_CSTS_RDY) != 0) == ready)
+			return (0);
+		if (ddi_get_lbolt() > deadline)
+			return (ETIMEDOUT);
+		delay(drv_usectohz(10000));
+	}
+}
+
+static int
+nvme_disable(nvme_t *n)
+{
+	uint32_t	cc;
+
+	cc = nvme_get32(n, NVME_REG_CC);
+	if ((cc & NVME_CC_EN) == 0)
+		return (nvme_wait_ready(n, B_FALSE));
+	nvme_put32(n, NVME_REG_CC, cc & ~NVME_CC_EN);
+	return (nvme_wait_ready(n, B_FALSE));
+}
+
+static int
+nvme_enable(nvme_t *n)
+{
+	nvme_qpair_t	*qp = n->n_adminq;
+
+	nvme_put32(n, NVME_REG_AQA, NVME_AQA(qp->qp_nentry, qp->qp_nentry));
+	nvme_put64(n, NVME_REG_ASQ, qp->qp_sqdma.nd_paddr);
+	nvme_put64(n, NVME_REG_ACQ, qp->qp_cqdma.nd_paddr);
+	nvme_put32(n, NVME_REG_CC, NVME_CC_EN | NVME_CC_CSS_NVM |
+	    NVME_CC_MPS(n->n_pageshift) | NVME_CC_AMS_RR |
+	    NVME_CC_IOSQES(NVME_SQE_SHIFT) | NVME_CC_IOCQES(NVME_CQE_SHIFT));
+	return (nvme_wait_ready(n, B_TRUE));
+}
+
+/*
+ * Tell the controller we are going away, so that it can put its cache
+ * and metadata in order.
+ */
+static void
+nvme_shutdown(nvme_t *n, boolean_t wait)
+{
+	clock_t		deadline = ddi_get_lbolt() + n->n_timeout;
+	uint32_t	cc;
+
+	cc = nvme_get32(n, NVME_REG_CC) & ~NVME_CC_SHN_MASK;
+	nvme_put32(n, NVME_REG_CC, cc | NVME_CC_SHN_NORMAL);
+	if (!wait)
+		return;
+	while ((nvme_get32(n, NVME_REG_CSTS) & NVME_CSTS_SHST_MASK) !=
+	    NVME_CSTS_SHST_DONE) {
+		if (ddi_get_lbolt() > deadline) {
+			dev_err(n->n_dip, CE_WARN, "!shutdown timed out");
+			break;
+		}
+		delay(drv_usectohz(10000));
+	}
+}
+
+/*
+ * Interrupts.  We want a vector for each I/O queue, which only MSI-X can
+ * give us; otherwise all queues make do with one.
+ */
+static void
+nvme_release_interrupts(nvme_t *n)
+{
+	int	i;
+
+	if (n->n_intrs == NULL)
+		return;
+	for (i = 0; i < n->n_intr_cnt; i++) {
+		(void) ddi_intr_remove_handler(n->n_intrs[i]);
+		(void) ddi_intr_free(n->n_intrs[i]);
+	}
+	kmem_free(n->n_intrs, n->n_intr_cnt * sizeof (ddi_intr_handle_t));
+	n->n_intrs = NULL;
+	n->n_intr_cnt = 0;
+}
+
+static int
+nvme_setup_interrupts(nvme_t *n, int type, int want)
+{
+	int	navail, count, actual;
+	int	i;
+
+	if (ddi_intr_get_nintrs(n->n_dip, type, &count) != DDI_SUCCESS ||
+	    ddi_intr_get_navail(n->n_dip, type, &navail) != DDI_SUCCESS)
+		return (DDI_FAILURE);
+	count = MIN(MIN(count, navail), want);
+	if (count < 1)
+		return (DDI_FAILURE);
+
+	n->n_intrs = kmem_zalloc(count * sizeof (ddi_intr_handle_t),
+	    KM_SLEEP);
+	if (ddi_intr_alloc(n->n_dip, n->n_intrs, type, 0, count, &actual,
+	    DDI_INTR_ALLOC_NORMAL) != DDI_SUCCESS) {
+		kmem_free(n->n_intrs, count * sizeof (ddi_intr_handle_t));
+		n->n_intrs = NULL;
+		return (DDI_FAILURE);
+	}
+	if (actual < count) {
+		/* Keep the array sized to what we got, for the free */
+		ddi_intr_handle_t *h = kmem_alloc(actual *
+		    sizeof (ddi_intr_handle_t), KM_SLEEP);
+
+		bcopy(n->n_intrs, h, actual * sizeof (ddi_intr_handle_t));
+		kmem_free(n->n_intrs, count * sizeof (ddi_intr_handle_t));
+		n->n_intrs = h;
+	}
+	n->n_intr_type = type;
+	n->n_intr_cnt = actual;
+
+	if (ddi_intr_get_pri(n->n_intrs[0], &n->n_intr_pri) != DDI_SUCCESS ||
+	    ddi_intr_get_cap(n->n_intrs[0], &n->n_intr_cap) != DDI_SUCCESS)
+		goto fail;
+
+	for (i = 0; i < actual; i++) {
+		if (ddi_intr_add_handler(n->n_intrs[i], nvme_intr,
+		    (caddr_t)n, (caddr_t)(uintptr_t)i) != DDI_SUCCESS)
+			goto fail;
+	}
+	return (DDI_SUCCESS);
+
+fail:
+	nvme_release_interrupts(n);
+	return (DDI_FAILURE);
+}
+
+static int
+nvme_enable_interrupts(nvme_t *n)
+{
+	int	i;
+
+	if (n->n_intr_cap & DDI_INTR_FLAG_BLOCK)
+		return (ddi_intr_block_enable(n->n_intrs, n->n_intr_cnt));
+	for (i = 0; i < n->n_intr_cnt; i++) {
+		if (ddi_intr_enable(n->n_intrs[i]) != DDI_SUCCESS)
+			return (DDI_FAILURE);
+	}
+	return (DDI_SUCCESS);
+}
+
+static void
+nvme_disable_interrupts(nvme_t *n)
+{
+	int	i;
+
+	if (n->n_intr_cap & DDI_INTR_FLAG_BLOCK) {
+		(void) ddi_intr_block_disable(n->n_intrs, n->n_intr_cnt);
+		return;
+	}
+	for (i = 0; i < n->n_intr_cnt; i++)
+		(void) ddi_intr_disable(n->n_intrs[i]);
+}
+
+/*
+ * Ask for the I/O queues and create them.
+ */
+static int
+nvme_setup_ioq(nvme_t *n)
+{
+	nvme_sqe_t	sqe;
+	uint32_t	dw0;
+	uint_t		want, i;
+	uint16_t	nentry;
+	int		rv;
+
+	want = MIN(MAX(nvme_max_ioq, 1), ncpus);
+
+	bzero(&sqe, sizeof (sqe));
+	sqe.sqe_cdw0 = NVME_SQE_CDW0(NVME_OPC_SET_FEATURES, 0);
+	sqe.sqe_cdw10 = NVME_FEAT_NQUEUES;
+	sqe.sqe_cdw11 = ((want - 1) << 16) | (want - 1);
+	if ((rv = nvme_admin_cmd(n, &sqe, &dw0)) != 0)
+		return (rv);
+	want = MIN(want, (dw0 & 0xffff) + 1);
+	want = MIN(want, (dw0 >> 16) + 1);
+
+	nentry = MIN(NVME_CAP_MQES(n->n_cap) + 1, nvme_io_queue_len);
+	n->n_ioq = kmem_zalloc(want * sizeof (nvme_qpair_t *), KM_SLEEP);
+	for (i = 0; i < want; i++) {
+		n->n_ioq[i] = nvme_qpair_alloc(n, i + 1, nentry,
+		    i % n->n_intr_cnt);
+		if (n->n_ioq[i] == NULL)
+			break;
+		if ((rv = nvme_create_ioq(n, n->n_ioq[i])) != 0) {
+			nvme_qpair_free(n->n_ioq[i]);
+			n->n_ioq[i] = NULL;
+			break;
+		}
+	}
+	if (i == 0) {
+		kmem_free(n->n_ioq, want * sizeof (nvme_qpair_t *));
+		n->n_ioq = NULL;
+		return (rv != 0 ? rv : ENOMEM);
+	}
+	/* Make do with the queues we got; the rest of the array is unused */
+	n->n_nioq = i;
+	return (0);
+}
+
+/*
+ * blkdev entry points
+ */
+static void
+nvme_bd_driveinfo(void *arg, bd_drive_t *drive)
+{
+	nvme_ns_t	*ns = arg;
+	nvme_t		*n = ns->ns_nvme;
+
+	drive->d_qsize = n->n_ioq[0]->qp_nentry - 1;
+	drive->d_qcount = n->n_nioq;
+	drive->d_maxxfer = n->n_maxxfer;
+	drive->d_removable = B_FALSE;
+	drive->d_hotpluggable = B_FALSE;
+	drive->d_target = ns->ns_id;
+	drive->d_lun = -1;
+}
+
+static int
+nvme_bd_mediainfo(void *arg, bd_media_t *media)
+{
+	nvme_ns_t	*ns = arg;
+
+	media->m_nblks = ns->ns_nblks;
+	media->m_blksize = 1U << ns->ns_blkshift;
+	media->m_readonly = B_FALSE;
+	media->m_solidstate = B_TRUE;
+	return (0);
+}
+
+static int
+nvme_bd_devid(void *arg, dev_info_t *dip, ddi_devid_t *devid)
+{
+	nvme_ns_t	*ns = arg;
+	nvme_t		*n = ns->ns_nvme;
+	char		id[sizeof (n->n_idctl->id_model) +
+	    sizeof (n->n_idctl->id_serial) + 16];
+	int		len;
+
+	len = snprintf(id, sizeof (id), "%.*s_%.*s_%u",
+	    (int)sizeof (n->n_idctl->id_model), n->n_idctl->id_model,
+	    (int)sizeof (n->n_idctl->id_serial), n->n_idctl->id_serial,
+	    ns->ns_id);
+	return (ddi_devid_init(dip, DEVID_ATA_SERIAL, MIN(len,
+	    sizeof (id) - 1), id, devid));
+}
+
+/*
+ * Fill in the PRPs of a read or write.  Each DMA cookie is one PRP entry
+ * (see the block comment); beyond two they go into the slot's page.
+ */
+static void
+nvme_fill_prp(nvme_t *n, nvme_cmd_t *cmd, bd_xfer_t *xfer, nvme_sqe_t *sqe)
+{
+	ddi_dma_cookie_t	c;
+	uint64_t		*prp;
+	uint_t			i;
+
+	sqe->sqe_prp1 = xfer->x_dmac.dmac_laddress;
+	if (xfer->x_ndmac == 1)
+		return;
+	ddi_dma_nextcookie(xfer->x_dmah, &c);
+	if (xfer->x_ndmac == 2) {
+		sqe->sqe_prp2 = c.dmac_laddress;
+		return;
+	}
+
+	ASSERT(xfer->x_ndmac - 1 <= n->n_pagesize / sizeof (uint64_t));
+	prp = (uint64_t *)cmd->nc_page.nd_kaddr;
+	for (i = 1; i < xfer->x_ndmac; i++) {
+		if (i > 1)
+			ddi_dma_nextcookie(xfer->x_dmah, &c);
+		prp[i - 1] = LE_64(c.dmac_laddress);
+	}
+	(void) ddi_dma_sync(cmd->nc_page.nd_dmah, 0,
+	    (xfer->x_ndmac - 1) * sizeof (uint64_t), DDI_DMA_SYNC_FORDEV);
+	sqe->sqe_prp2 = cmd->nc_page.nd_paddr;
+}
+
+/*
+ * Fill in the ranges of a deallocate.
+ */
+static int
+nvme_fill_dsm(nvme_cmd_t *cmd, bd_xfer_t *xfer, nvme_sqe_t *sqe)
+{
+	nvme_dsm_range_t	*dr;
+	uint64_t		blkno = xfer->x_blkno;
+	uint64_t		left = xfer->x_nblks;
+	uint32_t		nlb;
+	uint_t			nr;
+
+	dr = (nvme_dsm_range_t *)cmd->nc_page.nd_kaddr;
+	for (nr = 0; left > 0; nr++) {
+		if (nr == NVME_DSM_MAXRANGES)
+			return (EINVAL);
+		nlb = (uint32_t)MIN(left, UINT32_MAX);
+		dr[nr].dr_attr = 0;
+		dr[nr].dr_nlb = LE_32(nlb);
+		dr[nr].dr_slba = LE_64(blkno);
+		blkno += nlb;
+		left -= nlb;
+	}
+	(void) ddi_dma_sync(cmd->nc_page.nd_dmah, 0,
+	    nr * sizeof (nvme_dsm_range_t), DDI_DMA_SYNC_FORDEV);
+
+	sqe->sqe_prp1 = cmd->nc_page.nd_paddr;
+	sqe->sqe_cdw10 = nr - 1;
+	sqe->sqe_cdw11 = NVME_DSM_AD;
+	return (0);
+}
+
+static int
+nvme_bd_cmd(nvme_ns_t *ns, bd_xfer_t *xfer, uint8_t opc)
+{
+	nvme_t		*n = ns->ns_nvme;
+	nvme_qpair_t	*qp = n->n_ioq[xfer->x_qnum % n->n_nioq];
+	nvme_cmd_t	*cmd;
+	nvme_sqe_t	sqe;
+	uint16_t	cid;
+	int		ms, rv;
+
+	bzero(&sqe, sizeof (sqe));
+	sqe.sqe_nsid = ns->ns_id;
+
+	mutex_enter(&qp->qp_sqlock);
+	cmd = nvme_cmd_get(qp, &cid);
+	sqe.sqe_cdw0 = NVME_SQE_CDW0(opc, cid);
+
+	switch (opc) {
+	case NVME_OPC_READ:
+	case NVME_OPC_WRITE:
+		ASSERT(xfer->x_nblks > 0 && xfer->x_nblks <= 0x10000);
+		sqe.sqe_cdw10 = (uint32_t)xfer->x_blkno;
+		sqe.sqe_cdw11 = (uint32_t)(xfer->x_blkno >> 32);
+		sqe.sqe_cdw12 = (uint32_t)(xfer->x_nblks - 1);
+		nvme_fill_prp(n, cmd, xfer, &sqe);
+		break;
+	case NVME_OPC_DSM:
+		if ((rv = nvme_fill_dsm(cmd, xfer, &sqe)) != 0) {
+			cmd->nc_busy = B_FALSE;
+			mutex_exit(&qp->qp_sqlock);
+			return (rv);
+		}
+		break;
+	default:
+		break;
+	}
+
+	cmd->nc_xfer = xfer;
+	nvme_submit(qp, &sqe);
+	mutex_exit(&qp->qp_sqlock);
+
+	if ((xfer->x_flags & BD_XFER_POLL) == 0)
+		return (0);
+
+	/*
+	 * Dump: no interrupts, so reap the queue until our transfer has
+	 * been handed back.
+	 */
+	for (ms = 0; ms < NVME_POLL_TIMEOUT; ms++) {
+		(void) nvme_process_cq(qp);
+		if (cmd->nc_xfer != xfer)
+			return (0);
+		drv_usecwait(1000);
+	}
+	return (ETIMEDOUT);
+}
+
+static int
+nvme_bd_read(void *arg, bd_xfer_t *xfer)
+{
+	return (nvme_bd_cmd(arg, xfer, NVME_OPC_READ));
+}
+
+static int
+nvme_bd_write(void *arg, bd_xfer_t *xfer)
+{
+	return (nvme_bd_cmd(arg, xfer, NVME_OPC_WRITE));
+}
+
+static int
+nvme_bd_sync(void *arg, bd_xfer_t *xfer)
+{
+	nvme_ns_t	*ns = arg;
+
+	/* Without a volatile write cache there is nothing to flush */
+	if (!ns->ns_nvme->n_vwc) {
+		bd_xfer_done(xfer, 0);
+		return (0);
+	}
+	return (nvme_bd_cmd(arg, xfer, NVME_OPC_FLUSH));
+}
+
+static int
+nvme_bd_free_space(void *arg, bd_xfer_t *xfer)
+{
+	nvme_ns_t	*ns = arg;
+
+	if (!ns->ns_nvme->n_dsm)
+		return (ENOTSUP);
+	return (nvme_bd_cmd(arg, xfer, NVME_OPC_DSM));
+}
+
+/*
+ * Namespaces
+ */
+static void
+nvme_ns_setup(nvme_t *n, nvme_idns_t *idns)
+{
+	nvme_ns_t	*ns;
+	uint32_t	lbaf;
+	uint32_t	i;
+
+	for (i = 0; i < n->n_nns; i++) {
+		ns = &n->n_ns[i];
+		ns->ns_nvme = n;
+		ns->ns_id = i + 1;
+
+		if (nvme_identify(n, ns->ns_id, NVME_IDENTIFY_NS, idns) != 0)
+			continue;
+		if (idns->ns_nsze == 0)
+			continue;	/* inactive */
+
+		lbaf = idns->ns_lbaf[NVME_FLBAS_FMT(idns->ns_flbas)];
+		if (NVME_LBAF_MS(lbaf) != 0 || NVME_LBAF_LBADS(lbaf) < 9 ||
+		    (1U << NVME_LBAF_LBADS(lbaf)) > n->n_maxxfer) {
+			dev_err(n->n_dip, CE_NOTE, "!namespace %u: "
+			    "unsupported format (block shift %u, metadata %u)",
+			    ns->ns_id, NVME_LBAF_LBADS(lbaf),
+			    NVME_LBAF_MS(lbaf));
+			continue;
+		}
+		ns->ns_nblks = idns->ns_nsze;
+		ns->ns_blkshift = NVME_LBAF_LBADS(lbaf);
+
+		ns->ns_bdh = bd_alloc_handle(ns, &nvme_bd_ops,
+		    &n->n_bd_dma_attr, KM_SLEEP);
+		if (bd_attach_handle(n->n_dip, ns->ns_bdh) != DDI_SUCCESS) {
+			dev_err(n->n_dip, CE_WARN,
+			    "!namespace %u: failed to attach blkdev",
+			    ns->ns_id);
+			bd_free_handle(ns->ns_bdh);
+			ns->ns_bdh = NULL;
+		}
+	}
+}
+
+static void
+nvme_teardown(nvme_t *n)
+{
+	uint_t	i;
+
+	if (n->n_ns != NULL) {
+		kmem_free(n->n_ns, n->n_nns * sizeof (nvme_ns_t));
+		n->n_ns = NULL;
+	}
+	if (n->n_intrs != NULL)
+		nvme_disable_interrupts(n);
+	if (n->n_regh != NULL) {
+		if (n->n_adminq != NULL)
+			nvme_shutdown(n, B_TRUE);
+		(void) nvme_disable(n);
+	}
+	if (n->n_ioq != NULL) {
+		for (i = 0; i < n->n_nioq; i++)
+			nvme_qpair_free(n->n_ioq[i]);
+		kmem_free(n->n_ioq, n->n_nioq * sizeof (nvme_qpair_t *));
+		n->n_ioq = NULL;
+	}
+	if (n->n_adminq != NULL) {
+		nvme_qpair_free(n->n_adminq);
+		n->n_adminq = NULL;
+	}
+	nvme_release_interrupts(n);
+	if (n->n_idctl != NULL) {
+		kmem_free(n->n_idctl, sizeof (nvme_idctl_t));
+		n->n_idctl = NULL;
+	}
+	if (n->n_regh != NULL) {
+		ddi_regs_map_free(&n->n_regh);
+		n->n_regh = NULL;
+	}
+}
+
+static int
+nvme_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
+{
+	nvme_t		*n;
+	nvme_idns_t	*idns;
+	uint_t		mdts;
+	int		inst = ddi_get_instance(dip);
+
+	switch (cmd) {
+	case DDI_ATTACH:
+		break;
+	case DDI_RESUME:
+	default:
+		return (DDI_FAILURE);
+	}
+
+	if (ddi_soft_state_zalloc(nvme_state, inst) != DDI_SUCCESS)
+		return (DDI_FAILURE);
+	n = ddi_get_soft_state(nvme_state, inst);
+	n->n_dip = dip;
+	ddi_set_driver_private(dip, n);
+
+	if (ddi_regs_map_setup(dip, 1, &n->n_regs, 0, 0, &nvme_reg_acc_attr,
+	    &n->n_regh) != DDI_SUCCESS) {
+		dev_err(dip, CE_WARN, "!failed to map registers");
+		n->n_regh = NULL;
+		goto fail;
+	}
+
+	n->n_cap = nvme_get64(n, NVME_REG_CAP);
+	if ((NVME_CAP_CSS(n->n_cap) & NVME_CAP_CSS_NVM) == 0) {
+		dev_err(dip, CE_WARN, "!NVM command set not supported");
+		goto fail;
+	}
+	n->n_pageshift = MAX(PAGESHIFT, 12 + NVME_CAP_MPSMIN(n->n_cap));
+	if (n->n_pageshift > 12 + NVME_CAP_MPSMAX(n->n_cap)) {
+		dev_err(dip, CE_WARN, "!no usable memory page size");
+		goto fail;
+	}
+	n->n_pagesize = 1UL << n->n_pageshift;
+	n->n_dstrd = 4 << NVME_CAP_DSTRD(n->n_cap);
+	n->n_timeout = drv_usectohz(MAX(NVME_CAP_TO(n->n_cap), 1) * 500000);
+
+	if (nvme_disable(n) != 0) {
+		dev_err(dip, CE_WARN, "!controller does not reset");
+		goto fail;
+	}
+
+	if (nvme_setup_interrupts(n, DDI_INTR_TYPE_MSIX,
+	    MIN(MAX(nvme_max_ioq, 1), ncpus)) != DDI_SUCCESS &&
+	    nvme_setup_interrupts(n, DDI_INTR_TYPE_MSI, 1) != DDI_SUCCESS &&
+	    nvme_setup_interrupts(n, DDI_INTR_TYPE_FIXED, 1) !=
+	    DDI_SUCCESS) {
+		dev_err(dip, CE_WARN, "!failed to set up interrupts");
+		goto fail;
+	}
+
+	n->n_adminq = nvme_qpair_alloc(n, 0,
+	    MIN(NVME_CAP_MQES(n->n_cap) + 1, nvme_admin_queue_len), 0);
+	if (n->n_adminq == NULL || nvme_enable(n) != 0) {
+		dev_err(dip, CE_WARN, "!failed to enable controller");
+		goto fail;
+	}
+
+	n->n_idctl = kmem_zalloc(sizeof (nvme_idctl_t), KM_SLEEP);
+	if (nvme_identify(n, 0, NVME_IDENTIFY_CTRL, n->n_idctl) != 0) {
+		dev_err(dip, CE_WARN, "!failed to identify controller");
+		goto fail;
+	}
+	n->n_vwc = (n->n_idctl->id_vwc & NVME_VWC_PRESENT) != 0;
+	n->n_dsm = (n->n_idctl->id_oncs & NVME_ONCS_DSM) != 0;
+	n->n_nns = n->n_idctl->id_nn;
+
+	/*
+	 * The largest transfer is bounded by the controller, by what one
+	 * page of PRP entries can describe and by NLB being 16 bits.
+	 */
+	n->n_maxxfer = MIN(nvme_max_xfer,
+	    (n->n_pagesize / sizeof (uint64_t)) * n->n_pagesize);
+	mdts = n->n_idctl->id_mdts;
+	if (mdts != 0 && mdts + n->n_pageshift < 32)
+		n->n_maxxfer = MIN(n->n_maxxfer, n->n_pagesize << mdts);
+	n->n_maxxfer = MIN(n->n_maxxfer, 0x10000 << 9);
+
+	n->n_bd_dma_attr = nvme_mem_dma_attr;
+	n->n_bd_dma_attr.dma_attr_align = sizeof (uint32_t);
+	n->n_bd_dma_attr.dma_attr_maxxfer = n->n_maxxfer;
+	n->n_bd_dma_attr.dma_attr_seg = n->n_pagesize - 1;
+	n->n_bd_dma_attr.dma_attr_sgllen = n->n_maxxfer / n->n_pagesize + 1;
+
+	if (nvme_setup_ioq(n) != 0) {
+		dev_err(dip, CE_WARN, "!failed to create I/O queues");
+		goto fail;
+	}
+
+	if (nvme_enable_interrupts(n) != DDI_SUCCESS) {
+		dev_err(dip, CE_WARN, "!failed to enable interrupts");
+		goto fail;
+	}
+
+	n->n_ns = kmem_zalloc(n->n_nns * sizeof (nvme_ns_t), KM_SLEEP);
+	idns = kmem_zalloc(sizeof (nvme_idns_t), KM_SLEEP);
+	nvme_ns_setup(n, idns);
+	kmem_free(idns, sizeof (nvme_idns_t));
+
+	dev_err(dip, CE_CONT, "?%.*s: %u I/O queues, %d %s interrupts\n",
+	    (int)sizeof (n->n_idctl->id_model), n->n_idctl->id_model,
+	    n->n_nioq, n->n_intr_cnt,
+	    n->n_intr_type == DDI_INTR_TYPE_MSIX ? "MSI-X" :
+	    n->n_intr_type == DDI_INTR_TYPE_MSI ? "MSI" : "fixed");
+	ddi_report_dev(dip);
+	return (DDI_SUCCESS);
+
+fail:
+	nvme_teardown(n);
+	ddi_soft_state_free(nvme_state, inst);
+	return (DDI_FAILURE);
+}
+
+static int
+nvme_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
+{
+	nvme_t		*n = ddi_get_driver_private(dip);
+	nvme_ns_t	*ns;
+	uint32_t	i;
+
+	if (cmd != DDI_DETACH)
+		return (DDI_FAILURE);
+
+	for (i = 0; i < n->n_nns; i++) {
+		ns = &n->n_ns[i];
+		if (ns->ns_bdh == NULL)
+			continue;
+		if (bd_detach_handle(ns->ns_bdh) != DDI_SUCCESS)
+			return (DDI_FAILURE);
+		bd_free_handle(ns->ns_bdh);
+		ns->ns_bdh = NULL;
+	}
+
+	nvme_teardown(n);
+	ddi_soft_state_free(nvme_state, ddi_get_instance(dip));
+	return (DDI_SUCCESS);
+}
+
+/*
+ * Fast reboot: stop the controller from touching memory, without
+ * waiting for anything.
+ */
+static int
+nvme_quiesce(dev_info_t *dip)
+{
+	nvme_t	*n = ddi_get_driver_private(dip);
+
+	if (n == NULL || n->n_regh == NULL)
+		return (DDI_SUCCESS);
+	nvme_shutdown(n, B_FALSE);
+	nvme_put32(n, NVME_REG_CC,
+	    nvme_get32(n, NVME_REG_CC) & ~NVME_CC_EN);
+	return (DDI_SUCCESS);
+}
+
+int
+_init(void)
+{
+	int	rv;
+
+	if ((rv = ddi_soft_state_init(&nvme_state, sizeof (nvme_t), 1)) != 0)
+		return (rv);
+	bd_mod_init(&nvme_dev_ops);
+	if ((rv = mod_install(&nvme_modlinkage)) != 0) {
+		bd_mod_fini(&nvme_dev_ops);
+		ddi_soft_state_fini(&nvme_state);
+	}
+	return (rv);
+}
+
+int
+_fini(void)
+{
+	int	rv;
+
+	if ((rv = mod_remove(&nvme_modlinkage)) == 0) {
+		bd_mod_fini(&nvme_dev_ops);
+		ddi_soft_state_fini(&nvme_state);
+	}
+	return (rv);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&nvme_modlinkage, modinfop));
+}
@@ -0,0 +1,217 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _NVME_REG_H
+#define	_NVME_REG_H
+
+/*
+ * NVM Express registers, commands and data structures, as far as the
+ * nvme driver uses them.  See the NVM Express 1.0e specification.
+ */
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Controller registers
+ */
+#define	NVME_REG_CAP	0x0000		/* Controller Capabilities (64) */
+#define	NVME_REG_VS	0x0008		/* Version */
+#define	NVME_REG_INTMS	0x000c		/* Interrupt Mask Set */
+#define	NVME_REG_INTMC	0x0010		/* Interrupt Mask Clear */
+#define	NVME_REG_CC	0x0014		/* Controller Configuration */
+#define	NVME_REG_CSTS	0x001c		/* Controller Status */
+#define	NVME_REG_AQA	0x0024		/* Admin Queue Attributes */
+#define	NVME_REG_ASQ	0x0028		/* Admin Submission Queue (64) */
+#define	NVME_REG_ACQ	0x0030		/* Admin Completion Queue (64) */
+#define	NVME_REG_SQTDBL	0x1000		/* first doorbell */
+
+#define	NVME_CAP_MQES(cap)	((cap) & 0xffff)	/* entries - 1 */
+#define	NVME_CAP_CQR(cap)	(((cap) >> 16) & 0x1)
+#define	NVME_CAP_TO(cap)	(((cap) >> 24) & 0xff)	/* 500ms units */
+#define	NVME_CAP_DSTRD(cap)	(((cap) >> 32) & 0xf)
+#define	NVME_CAP_CSS(cap)	(((cap) >> 37) & 0xff)
+#define	NVME_CAP_MPSMIN(cap)	(((cap) >> 48) & 0xf)
+#define	NVME_CAP_MPSMAX(cap)	(((cap) >> 52) & 0xf)
+
+#define	NVME_CAP_CSS_NVM	0x1
+
+#define	NVME_CC_EN		(1U << 0)
+#define	NVME_CC_CSS_NVM		(0U << 4)
+#define	NVME_CC_MPS(shift)	(((shift) - 12) << 7)
+#define	NVME_CC_AMS_RR		(0U << 11)
+#define	NVME_CC_SHN_NORMAL	(1U << 14)
+#define	NVME_CC_SHN_MASK	(3U << 14)
+#define	NVME_CC_IOSQES(shift)	((shift) << 16)
+#define	NVME_CC_IOCQES(shift)	((shift) << 20)
+
+#define	NVME_CSTS_RDY		(1U << 0)
+#define	NVME_CSTS_CFS		(1U << 1)
+#define	NVME_CSTS_SHST_MASK	(3U << 2)
+#define	NVME_CSTS_SHST_DONE	(2U << 2)
+
+#define	NVME_AQA(sqs, cqs)	((((cqs) - 1) << 16) | ((sqs) - 1))
+
+/*
+ * Submission queue entry
+ */
+typedef struct nvme_sqe {
+	uint32_t	sqe_cdw0;	/* opcode, fuse, command id */
+	uint32_t	sqe_nsid;
+	uint32_t	sqe_cdw2;
+	uint32_t	sqe_cdw3;
+	uint64_t	sqe_mptr;
+	uint64_t	sqe_prp1;
+	uint64_t	sqe_prp2;
+	uint32_t	sqe_cdw10;
+	uint32_t	sqe_cdw11;
+	uint32_t	sqe_cdw12;
+	uint32_t	sqe_cdw13;
+	uint32_t	sqe_cdw14;
+	uint32_t	sqe_cdw15;
+} nvme_sqe_t;
+
+#define	NVME_SQE_SHIFT		6
+#define	NVME_SQE_CDW0(opc, cid)	((uint32_t)(opc) | ((uint32_t)(cid) << 16))
+
+/*
+ * Completion queue entry
+ */
+typedef struct nvme_cqe {
+	uint32_t	cqe_dw0;	/* command specific */
+	uint32_t	cqe_rsvd;
+	uint16_t	cqe_sqhd;	/* submission queue head */
+	uint16_t	cqe_sqid;
+	uint16_t	cqe_cid;
+	uint16_t	cqe_status;	/* phase, status code and type */
+} nvme_cqe_t;
+
+#define	NVME_CQE_SHIFT		4
+#define	NVME_CQE_PHASE(st)	((st) & 0x1)
+#define	NVME_CQE_SC(st)		(((st) >> 1) & 0xff)
+#define	NVME_CQE_SCT(st)	(((st) >> 9) & 0x7)
+#define	NVME_CQE_DNR(st)	(((st) >> 15) & 0x1)
+
+#define	NVME_SCT_GENERIC	0
+#define	NVME_SCT_MEDIA		2
+
+#define	NVME_SC_SUCCESS		0x00
+#define	NVME_SC_LBA_RANGE	0x80
+#define	NVME_SC_CAP_EXCEEDED	0x81
+#define	NVME_SC_NS_NOT_READY	0x82
+
+#define	NVME_SC_WRITE_FAULT	0x80
+#define	NVME_SC_UNRECOVERED	0x81
+#define	NVME_SC_WRITE_PROTECT	0x86
+
+/*
+ * Admin commands
+ */
+#define	NVME_OPC_DELETE_SQ	0x00
+#define	NVME_OPC_CREATE_SQ	0x01
+#define	NVME_OPC_DELETE_CQ	0x04
+#define	NVME_OPC_CREATE_CQ	0x05
+#define	NVME_OPC_IDENTIFY	0x06
+#define	NVME_OPC_SET_FEATURES	0x09
+
+#define	NVME_IDENTIFY_NS	0
+#define	NVME_IDENTIFY_CTRL	1
+
+#define	NVME_FEAT_NQUEUES	0x07
+
+#define	NVME_CREATE_Q_PC	(1U << 0)	/* physically contiguous */
+#define	NVME_CREATE_CQ_IEN	(1U << 1)	/* interrupts enabled */
+
+/*
+ * NVM commands
+ */
+#define	NVME_OPC_FLUSH		0x00
+#define	NVME_OPC_WRITE		0x01
+#define	NVME_OPC_READ		0x02
+#define	NVME_OPC_DSM		0x09
+
+#define	NVME_DSM_AD		(1U << 2)	/* attribute: deallocate */
+#define	NVME_DSM_MAXRANGES	256
+
+typedef struct nvme_dsm_range {
+	uint32_t	dr_attr;
+	uint32_t	dr_nlb;
+	uint64_t	dr_slba;
+} nvme_dsm_range_t;
+
+/*
+ * Identify Controller data, of which we only look at a few fields
+ */
+typedef struct nvme_idctl {
+	uint16_t	id_vid;
+	uint16_t	id_ssvid;
+	char		id_serial[20];
+	char		id_model[40];
+	char		id_fwrev[8];
+	uint8_t		id_rab;
+	uint8_t		id_oui[3];
+	uint8_t		id_mic;
+	uint8_t		id_mdts;	/* max transfer, 2^n min pages */
+	uint8_t		id_rsvd1[178];
+	uint16_t	id_oacs;
+	uint8_t		id_acl;
+	uint8_t		id_aerl;
+	uint8_t		id_frmw;
+	uint8_t		id_lpa;
+	uint8_t		id_elpe;
+	uint8_t		id_npss;
+	uint8_t		id_rsvd2[248];
+	uint8_t		id_sqes;
+	uint8_t		id_cqes;
+	uint8_t		id_rsvd3[2];
+	uint32_t	id_nn;		/* number of namespaces */
+	uint16_t	id_oncs;	/* optional NVM commands */
+	uint16_t	id_fuses;
+	uint8_t		id_fna;
+	uint8_t		id_vwc;		/* volatile write cache */
+	uint8_t		id_rsvd4[3570];
+} nvme_idctl_t;
+
+#define	NVME_ONCS_DSM		(1U << 2)
+#define	NVME_VWC_PRESENT	(1U << 0)
+
+/*
+ * Identify Namespace data
+ */
+typedef struct nvme_idns {
+	uint64_t	ns_nsze;	/* size, in blocks */
+	uint64_t	ns_ncap;
+	uint64_t	ns_nuse;
+	uint8_t		ns_nsfeat;
+	uint8_t		ns_nlbaf;	/* number of LBA formats - 1 */
+	uint8_t		ns_flbas;	/* LBA format in use */
+	uint8_t		ns_mc;
+	uint8_t		ns_dpc;
+	uint8_t		ns_dps;
+	uint8_t		ns_rsvd1[98];
+	uint32_t	ns_lbaf[16];	/* LBA formats */
+	uint8_t		ns_rsvd2[3904];
+} nvme_idns_t;
+
+#define	NVME_FLBAS_FMT(flbas)	((flbas) & 0xf)
+#define	NVME_LBAF_MS(lbaf)	((lbaf) & 0xffff)
+#define	NVME_LBAF_LBADS(lbaf)	(((lbaf) >> 16) & 0xff)
+
+#define	NVME_IDENTIFY_SIZE	4096
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _NVME_REG_H */
@@ -0,0 +1,127 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _NVME_VAR_H
+#define	_NVME_VAR_H
+
+#include <sys/types.h>
+#include <sys/ksynch.h>
+#include <sys/sunddi.h>
+#include <sys/blkdev.h>
+
+#include "nvme_reg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nvme nvme_t;
+typedef struct nvme_qpair nvme_qpair_t;
+
+/*
+ * DMA memory: queues, identify data and PRP lists.
+ */
+typedef struct nvme_dma {
+	ddi_dma_handle_t	nd_dmah;
+	ddi_acc_handle_t	nd_acch;
+	caddr_t			nd_kaddr;
+	uint64_t		nd_paddr;
+	size_t			nd_len;
+} nvme_dma_t;
+
+/*
+ * A command slot.  Its index in the queue pair is the command identifier,
+ * and it comes with a page for the PRP list or the DSM ranges.
+ */
+typedef struct nvme_cmd {
+	bd_xfer_t		*nc_xfer;	/* NULL for admin commands */
+	boolean_t		nc_busy;
+	boolean_t		nc_done;
+	uint16_t		nc_status;
+	uint32_t		nc_dw0;
+	nvme_dma_t		nc_page;
+} nvme_cmd_t;
+
+/*
+ * A submission queue and the completion queue it posts to.  Queue pair 0
+ * is the admin queue; I/O queue pair n (n > 0) is blkdev queue n - 1 and
+ * is serviced by interrupt vector (n - 1) % nintrs.
+ */
+struct nvme_qpair {
+	nvme_t			*qp_nvme;
+	uint16_t		qp_id;
+	uint16_t		qp_nentry;	/* entries in each queue */
+	uint_t			qp_vector;
+
+	kmutex_t		qp_sqlock;
+	nvme_dma_t		qp_sqdma;
+	nvme_sqe_t		*qp_sq;
+	uint16_t		qp_sqtail;
+	uint16_t		qp_sqhead;	/* as last reported */
+	uint16_t		qp_nextcid;
+	nvme_cmd_t		*qp_cmds;	/* qp_nentry slots */
+	uintptr_t		qp_sqdb;
+
+	kmutex_t		qp_cqlock;
+	nvme_dma_t		qp_cqdma;
+	nvme_cqe_t		*qp_cq;
+	uint16_t		qp_cqhead;
+	uint16_t		qp_phase;
+	uintptr_t		qp_cqdb;
+};
+
+/*
+ * A namespace, attached to blkdev as a disk of its own.
+ */
+typedef struct nvme_ns {
+	nvme_t			*ns_nvme;
+	uint32_t		ns_id;
+	uint64_t		ns_nblks;
+	uint32_t		ns_blkshift;
+	bd_handle_t		ns_bdh;
+} nvme_ns_t;
+
+struct nvme {
+	dev_info_t		*n_dip;
+	ddi_acc_handle_t	n_regh;
+	caddr_t			n_regs;
+	uint64_t		n_cap;
+	uint_t			n_dstrd;	/* doorbell stride, bytes */
+	clock_t			n_timeout;	/* for enable/disable, ticks */
+	size_t			n_pagesize;
+	uint_t			n_pageshift;
+	uint32_t		n_maxxfer;
+
+	ddi_intr_handle_t	*n_intrs;
+	int			n_intr_type;
+	int			n_intr_cnt;
+	uint_t			n_intr_pri;
+	int			n_intr_cap;
+
+	nvme_qpair_t		*n_adminq;
+	nvme_qpair_t		**n_ioq;	/* n_nioq I/O queue pairs */
+	uint_t			n_nioq;
+
+	nvme_idctl_t		*n_idctl;
+	boolean_t		n_vwc;		/* volatile write cache */
+	boolean_t		n_dsm;		/* deallocate supported */
+
+	uint32_t		n_nns;
+	nvme_ns_t		*n_ns;
+
+	ddi_dma_attr_t		n_bd_dma_attr;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _NVME_VAR_H */
@@ -158,6 +158,7 @@ static	char *sd_config_list		= "sd-config-list";
 #define	sd_max_throttle			ssd_max_throttle
 #define	sd_min_throttle			ssd_min_throttle
 #define	sd_rot_delay			ssd_rot_delay
+#define	sd_fastpath_enable		ssd_fastpath_enable
 
 #define	sd_retry_on_reservation_conflict	\
 					ssd_retry_on_reservation_conflict
@@ -240,6 +241,12 @@ int sd_min_throttle			= SD_MIN_THROTTLE;
 int sd_rot_delay			= 4; /* Default 4ms Rotation delay */
 int sd_qfull_throttle_enable		= TRUE;
 
+/*
+ * Let buf IO to solid state devices skip the wait queue when nothing is
+ * waiting; see sd_start_fastpath().
+ */
+int sd_fastpath_enable			= 1;
+
 int sd_retry_on_reservation_conflict	= 1;
 int sd_reinstate_resv_delay		= SD_REINSTATE_RESV_DELAY;
 _NOTE(SCHEME_PROTECTS_DATA("safe sharing", sd_reinstate_resv_delay))
@@ -971,6 +978,7 @@ static int sd_pm_idletime = 1;
 #define	sd_add_buf_to_waitq		ssd_add_buf_to_waitq
 #define	sdintr				ssdintr
 #define	sd_start_cmds			ssd_start_cmds
+#define	sd_start_fastpath		ssd_start_fastpath
 #define	sd_send_scsi_cmd		ssd_send_scsi_cmd
 #define	sd_bioclone_alloc		ssd_bioclone_alloc
 #define	sd_bioclone_free		ssd_bioclone_free
@@ -1378,6 +1386,7 @@ static void sd_pm_idletimeout_handler(void *arg);
 static void sd_add_buf_to_waitq(struct sd_lun *un, struct buf *bp);
 static void sdintr(struct scsi_pkt *pktp);
 static void sd_start_cmds(struct sd_lun *un, struct buf *immed_bp);
+static boolean_t sd_start_fastpath(struct sd_lun *un, struct buf *bp);
 
 static int sd_send_scsi_cmd(dev_t dev, struct uscsi_cmd *incmd, int flag,
 	enum uio_seg dataspace, int path_flag);
@@ -13560,6 +13569,12 @@ sd_core_iostart(int index, struct sd_lun *un, struct buf *bp)
 		 * with error recovery actions which we don't want to retry.
 		 */
 		sd_start_cmds(un, bp);
+	} else if (sd_fastpath_enable && un->un_f_is_solid_state &&
+	    SD_IS_BUFIO(xp) && sd_start_fastpath(un, bp)) {
+		/*
+		 * Solid state device with nothing waiting -- the command
+		 * has gone straight to the HBA (or been queued for retry).
+		 */
 	} else {
 		/*
 		 * Normal command -- add it to the wait queue, then start
@@ -14759,6 +14774,102 @@ insert:
 }
 
 
+/*
+ *    Function: sd_start_fastpath
+ *
+ * Description: Transport a buf IO straight from sd_core_iostart(),
+ *		without going through the wait queue.  This is used for
+ *		solid state devices, where sorting is off and the wait
+ *		queue only adds latency, but only while the wait queue
+ *		is empty and nothing else (throttle, retry, START_STOP,
+ *		priority command, state change) holds up new commands.
+ *
+ *		If the HBA does not accept the command it is put at the
+ *		head of the wait queue, with its scsi_pkt, and the usual
+ *		sd_start_cmds() processing takes over.
+ *
+ *   Arguments: un - pointer to the unit (soft state) struct for the target.
+ *		bp - ptr to the buf to transport.
+ *
+ * Return Code: TRUE if the buf was taken care of, FALSE if the caller
+ *		has to queue it the usual way.
+ *
+ *     Context: Kernel thread context.  SD_MUTEX is held, and dropped
+ *		while the scsi_pkt is set up and transported.
+ */
+
+static boolean_t
+sd_start_fastpath(struct sd_lun *un, struct buf *bp)
+{
+	struct sd_xbuf	*xp;
+	struct scsi_pkt	*pktp;
+	int		rval;
+
+	ASSERT(mutex_owned(SD_MUTEX(un)));
+
+	if ((un->un_waitq_headp != NULL) ||
+	    (un->un_ncmds_in_transport >= un->un_throttle) ||
+	    (un->un_retry_bp != NULL) ||
+	    (un->un_startstop_timeid != NULL) ||
+	    (un->un_direct_priority_timeid != NULL) ||
+	    (un->un_state != SD_STATE_NORMAL) || ddi_in_panic()) {
+		return (FALSE);
+	}
+
+	xp = SD_GET_XBUF(bp);
+	ASSERT(xp->xb_pktp == NULL);
+
+	/* Hold the transport slot while SD_MUTEX is dropped */
+	un->un_ncmds_in_transport++;
+
+	switch (sd_initpkt_for_buf(bp, &pktp)) {
+	case SD_PKT_ALLOC_SUCCESS:
+		xp->xb_pktp = pktp;
+		break;
+
+	case SD_PKT_ALLOC_FAILURE:
+		/* Queue it; sdrunout will restart the wait queue */
+		un->un_ncmds_in_transport--;
+		return (FALSE);
+
+	default:
+		/* As in sd_start_cmds(), these are fatal for the buf */
+		un->un_ncmds_in_transport--;
+		sd_return_failed_command_no_restart(un, bp, EIO);
+		return (TRUE);
+	}
+
+	SD_UPDATE_KSTATS(un, kstat_runq_enter, bp);
+
+	DTRACE_PROBE1(scsi__transport__dispatch, struct buf *, bp);
+
+	mutex_exit(SD_MUTEX(un));
+	rval = scsi_transport(pktp);
+	mutex_enter(SD_MUTEX(un));
+
+	if (rval == TRAN_ACCEPT) {
+		un->un_tran_fatal_count = 0;
+		return (TRUE);
+	}
+
+	SD_TRACE(SD_LOG_IO_CORE | SD_LOG_ERROR, un,
+	    "sd_start_fastpath: scsi_transport() returned %d\n", rval);
+
+	un->un_ncmds_in_transport--;
+	ASSERT(un->un_ncmds_in_transport >= 0);
+	SD_UPDATE_KSTATS(un, kstat_runq_back_to_waitq, bp);
+
+	bp->av_forw = un->un_waitq_headp;
+	un->un_waitq_headp = bp;
+	if (un->un_waitq_tailp == NULL) {
+		un->un_waitq_tailp = bp;
+	}
+	sd_start_cmds(un, NULL);
+
+	return (TRUE);
+}
+
+
 /*
  *    Function: sd_start_cmds
  *
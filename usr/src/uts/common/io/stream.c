@@ -388,7 +388,7 @@ streams_msg_init(void)
 		(void) sprintf(name, "streams_dblk_%ld", size);
 		cp = kmem_cache_create(name, tot_size, DBLK_CACHE_ALIGN,
 		    dblk_constructor, dblk_destructor, NULL, (void *)(size),
-		    NULL, dblk_kmem_flags);
+		    NULL, dblk_kmem_flags | KMC_FASTREAP);
 
 		while (lastsize <= size) {
 			dblk_cache[(lastsize - 1) >> DBLK_SIZE_SHIFT] = cp;
@@ -4048,11 +4048,11 @@ isuioq(queue_t *q)
 		return (STREAM(q)->sd_struiowrq == q);
 }
 
-#if defined(__sparc)
+/*
+ * Putlocks used to be off on x86, where machines had few CPUs.  They still
+ * are on machines with fewer than min_n_ciputctrl CPUs.
+ */
 int disable_putlocks = 0;
-#else
-int disable_putlocks = 1;
-#endif
 
 /*
  * called by create_putlock.
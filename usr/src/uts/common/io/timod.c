@@ -384,6 +384,14 @@ timodopen(
 	/* Must be done before tpi_findprov and _ILP32 q_next walk below */
 	qprocson(q);
 
+	/*
+	 * Let putnext() through this stream use per-CPU locks rather than
+	 * sd_lock, so that the read and write sides of a busy TPI endpoint
+	 * don't contend, and enter a concurrent transport's perimeter
+	 * without its SQLOCK.
+	 */
+	create_putlocks(q, 1);
+
 	tp->tim_provinfo = tpi_findprov(q);
 
 	/*
@@ -55,6 +55,7 @@
 #define	VIRTIO_BLK_F_SCSI	(1<<7)
 #define	VIRTIO_BLK_F_FLUSH	(1<<9)
 #define	VIRTIO_BLK_F_TOPOLOGY	(1<<10)
+#define	VIRTIO_BLK_F_MQ		(1<<12)
 
 /* Configuration registers */
 #define	VIRTIO_BLK_CONFIG_CAPACITY	0 /* 64bit */
@@ -65,6 +66,7 @@
 #define	VIRTIO_BLK_CONFIG_GEOMETRY_S	19 /* 8bit */
 #define	VIRTIO_BLK_CONFIG_BLK_SIZE	20 /* 32bit */
 #define	VIRTIO_BLK_CONFIG_TOPOLOGY	24 /* 32bit */
+#define	VIRTIO_BLK_CONFIG_NUM_QUEUES	34 /* 16bit */
 
 /* Command */
 #define	VIRTIO_BLK_T_IN			0
@@ -93,6 +95,16 @@
  */
 static char vioblk_ident[] = "VirtIO block driver";
 
+/*
+ * With VIRTIO_BLK_F_MQ the device offers several request queues.  We use
+ * up to one per CPU, capped by this and by the MSI-X vectors there are
+ * to give each queue its own interrupt.  blkdev spreads the transfers
+ * over the queues by submitting CPU, so I/O from different CPUs doesn't
+ * meet on a virtqueue lock, and each queue's completions come in on its
+ * own vector.
+ */
+int vioblk_max_queues = 16;
+
 /* Request header structure */
 struct vioblk_req_hdr {
 	uint32_t		type;   /* VIRTIO_BLK_T_* */
@@ -134,17 +146,25 @@ struct vioblk_lstats {
 	unsigned int		nxio_errors;
 };
 
+/* A request virtqueue with its requests, one per descriptor */
+struct vioblk_queue {
+	struct vioblk_softc	*q_sc;
+	struct virtqueue	*q_vq;
+	struct vioblk_req	*q_reqs;
+	struct vioblk_lstats	q_stats;
+};
+
 struct vioblk_softc {
 	dev_info_t		*sc_dev; /* mirrors virtio_softc->sc_dev */
 	struct virtio_softc	sc_virtio;
-	struct virtqueue	*sc_vq;
+	struct vioblk_queue	*sc_queues;
+	int			sc_nqueues;
+	unsigned int		sc_qsize; /* smallest vq_num of the queues */
 	bd_handle_t		bd_h;
-	struct vioblk_req	*sc_reqs;
 	struct vioblk_stats	*ks_data;
 	kstat_t			*sc_intrstat;
 	uint64_t		sc_capacity;
 	uint64_t		sc_nblks;
-	struct vioblk_lstats	sc_stats;
 	short			sc_blkflags;
 	boolean_t		sc_in_poll_mode;
 	boolean_t		sc_readonly;
@@ -251,10 +271,17 @@ static ddi_dma_attr_t vioblk_bd_dma_attr = {
 	0,				/* dma_attr_flags	*/
 };
 
+static struct vioblk_queue *
+vioblk_xfer_queue(struct vioblk_softc *sc, bd_xfer_t *xfer)
+{
+	return (&sc->sc_queues[xfer->x_qnum % sc->sc_nqueues]);
+}
+
 static int
 vioblk_rw(struct vioblk_softc *sc, bd_xfer_t *xfer, int type,
     uint32_t len)
 {
+	struct vioblk_queue *q = vioblk_xfer_queue(sc, xfer);
 	struct vioblk_req *req;
 	struct vq_entry *ve_hdr;
 	int total_cookies, write;
@@ -263,20 +290,26 @@ vioblk_rw(struct vioblk_softc *sc, bd_xfer_t *xfer, int type,
 	    type == VIRTIO_BLK_T_FLUSH_OUT) ? 1 : 0;
 	total_cookies = 2;
 
+	/*
+	 * If blkdev told us more was coming, the requests queued before
+	 * this one may still be waiting for their notify; send it now.
+	 */
 	if ((xfer->x_blkno + xfer->x_nblks) > sc->sc_nblks) {
 		sc->ks_data->sts_rw_badoffset.value.ui64++;
+		virtio_kick_vq(q->q_vq);
 		return (EINVAL);
 	}
 
 	/* allocate top entry */
-	ve_hdr = vq_alloc_entry(sc->sc_vq);
+	ve_hdr = vq_alloc_entry(q->q_vq);
 	if (!ve_hdr) {
 		sc->ks_data->sts_rw_outofmemory.value.ui64++;
+		virtio_kick_vq(q->q_vq);
 		return (ENOMEM);
 	}
 
 	/* getting request */
-	req = &sc->sc_reqs[ve_hdr->qe_index];
+	req = &q->q_reqs[ve_hdr->qe_index];
 	req->hdr.type = type;
 	req->hdr.ioprio = 0;
 	req->hdr.sector = xfer->x_blkno;
@@ -298,15 +331,32 @@ vioblk_rw(struct vioblk_softc *sc, bd_xfer_t *xfer, int type,
 	    req->dmac.dmac_laddress + sizeof (struct vioblk_req_hdr),
 	    sizeof (uint8_t), B_FALSE);
 
-	/* sending the whole chain to the device */
-	virtio_push_chain(ve_hdr, B_TRUE);
+	/*
+	 * sending the whole chain to the device, and letting it know unless
+	 * the next request is right behind us and will do that
+	 */
+	virtio_push_chain(ve_hdr, (xfer->x_flags & BD_XFER_MORE) == 0);
 
-	if (sc->sc_stats.rw_cookiesmax < total_cookies)
-		sc->sc_stats.rw_cookiesmax = total_cookies;
+	if (q->q_stats.rw_cookiesmax < total_cookies)
+		q->q_stats.rw_cookiesmax = total_cookies;
 
 	return (DDI_SUCCESS);
 }
 
+static void
+vioblk_set_poll_mode(struct vioblk_softc *sc, boolean_t poll)
+{
+	int i;
+
+	for (i = 0; i < sc->sc_nqueues; i++) {
+		if (poll)
+			virtio_stop_vq_intr(sc->sc_queues[i].q_vq);
+		else
+			virtio_start_vq_intr(sc->sc_queues[i].q_vq);
+	}
+	sc->sc_in_poll_mode = poll;
+}
+
 /*
  * Now in polling mode. Interrupts are off, so we
  * 1) poll for the already queued requests to complete.
@@ -317,6 +367,7 @@ static int
 vioblk_rw_poll(struct vioblk_softc *sc, bd_xfer_t *xfer,
     int type, uint32_t len)
 {
+	struct vioblk_queue *q = vioblk_xfer_queue(sc, xfer);
 	clock_t tmout;
 	int ret;
 
@@ -326,9 +377,9 @@ vioblk_rw_poll(struct vioblk_softc *sc, bd_xfer_t *xfer,
 	tmout = drv_usectohz(30000000);
 
 	/* Poll for an empty queue */
-	while (vq_num_used(sc->sc_vq)) {
+	while (vq_num_used(q->q_vq)) {
 		/* Check if any pending requests completed. */
-		ret = vioblk_int_handler((caddr_t)&sc->sc_virtio, NULL);
+		ret = vioblk_int_handler((caddr_t)&sc->sc_virtio, (caddr_t)q);
 		if (ret != DDI_INTR_CLAIMED) {
 			drv_usecwait(10);
 			tmout -= 10;
@@ -342,9 +393,9 @@ vioblk_rw_poll(struct vioblk_softc *sc, bd_xfer_t *xfer,
 
 	tmout = drv_usectohz(30000000);
 	/* Poll for an empty queue again. */
-	while (vq_num_used(sc->sc_vq)) {
+	while (vq_num_used(q->q_vq)) {
 		/* Check if any pending requests completed. */
-		ret = vioblk_int_handler((caddr_t)&sc->sc_virtio, NULL);
+		ret = vioblk_int_handler((caddr_t)&sc->sc_virtio, (caddr_t)q);
 		if (ret != DDI_INTR_CLAIMED) {
 			drv_usecwait(10);
 			tmout -= 10;
@@ -362,18 +413,14 @@ vioblk_read(void *arg, bd_xfer_t *xfer)
 	struct vioblk_softc *sc = (void *)arg;
 
 	if (xfer->x_flags & BD_XFER_POLL) {
-		if (!sc->sc_in_poll_mode) {
-			virtio_stop_vq_intr(sc->sc_vq);
-			sc->sc_in_poll_mode = 1;
-		}
+		if (!sc->sc_in_poll_mode)
+			vioblk_set_poll_mode(sc, B_TRUE);
 
 		ret = vioblk_rw_poll(sc, xfer, VIRTIO_BLK_T_IN,
 		    xfer->x_nblks * DEV_BSIZE);
 	} else {
-		if (sc->sc_in_poll_mode) {
-			virtio_start_vq_intr(sc->sc_vq);
-			sc->sc_in_poll_mode = 0;
-		}
+		if (sc->sc_in_poll_mode)
+			vioblk_set_poll_mode(sc, B_FALSE);
 
 		ret = vioblk_rw(sc, xfer, VIRTIO_BLK_T_IN,
 		    xfer->x_nblks * DEV_BSIZE);
@@ -389,18 +436,14 @@ vioblk_write(void *arg, bd_xfer_t *xfer)
 	struct vioblk_softc *sc = (void *)arg;
 
 	if (xfer->x_flags & BD_XFER_POLL) {
-		if (!sc->sc_in_poll_mode) {
-			virtio_stop_vq_intr(sc->sc_vq);
-			sc->sc_in_poll_mode = 1;
-		}
+		if (!sc->sc_in_poll_mode)
+			vioblk_set_poll_mode(sc, B_TRUE);
 
 		ret = vioblk_rw_poll(sc, xfer, VIRTIO_BLK_T_OUT,
 		    xfer->x_nblks * DEV_BSIZE);
 	} else {
-		if (sc->sc_in_poll_mode) {
-			virtio_start_vq_intr(sc->sc_vq);
-			sc->sc_in_poll_mode = 0;
-		}
+		if (sc->sc_in_poll_mode)
+			vioblk_set_poll_mode(sc, B_FALSE);
 
 		ret = vioblk_rw(sc, xfer, VIRTIO_BLK_T_OUT,
 		    xfer->x_nblks * DEV_BSIZE);
@@ -420,7 +463,7 @@ vioblk_flush(void *arg, bd_xfer_t *xfer)
 	    xfer->x_nblks * DEV_BSIZE);
 
 	if (!ret)
-		sc->sc_stats.rw_cacheflush++;
+		vioblk_xfer_queue(sc, xfer)->q_stats.rw_cacheflush++;
 
 	return (ret);
 }
@@ -431,7 +474,8 @@ vioblk_driveinfo(void *arg, bd_drive_t *drive)
 {
 	struct vioblk_softc *sc = (void *)arg;
 
-	drive->d_qsize = sc->sc_vq->vq_num;
+	drive->d_qsize = sc->sc_qsize;
+	drive->d_qcount = sc->sc_nqueues;
 	drive->d_removable = B_FALSE;
 	drive->d_hotpluggable = B_TRUE;
 	drive->d_target = 0;
@@ -566,6 +610,9 @@ vioblk_show_features(struct vioblk_softc *sc, const char *prefix,
 	if (features & VIRTIO_BLK_F_TOPOLOGY)
 		/* LINTED E_PTRDIFF_OVERFLOW */
 		bufp += snprintf(bufp, bufend - bufp, "TOPOLOGY ");
+	if (features & VIRTIO_BLK_F_MQ)
+		/* LINTED E_PTRDIFF_OVERFLOW */
+		bufp += snprintf(bufp, bufend - bufp, "MQ ");
 
 	/* LINTED E_PTRDIFF_OVERFLOW */
 	bufp += snprintf(bufp, bufend - bufp, ")");
@@ -586,7 +633,9 @@ vioblk_dev_features(struct vioblk_softc *sc)
 	    VIRTIO_BLK_F_FLUSH |
 	    VIRTIO_BLK_F_SEG_MAX |
 	    VIRTIO_BLK_F_SIZE_MAX |
-	    VIRTIO_F_RING_INDIRECT_DESC);
+	    VIRTIO_BLK_F_MQ |
+	    VIRTIO_F_RING_INDIRECT_DESC |
+	    VIRTIO_F_RING_EVENT_IDX);
 
 	vioblk_show_features(sc, "Host features: ", host_features);
 	vioblk_show_features(sc, "Negotiated features: ",
@@ -608,12 +657,13 @@ vioblk_int_handler(caddr_t arg1, caddr_t arg2)
 	struct virtio_softc *vsc = (void *)arg1;
 	struct vioblk_softc *sc = container_of(vsc,
 	    struct vioblk_softc, sc_virtio);
+	struct vioblk_queue *q = (void *)arg2;
 	struct vq_entry *ve;
 	uint32_t len;
 	int i = 0, error;
 
-	while ((ve = virtio_pull_chain(sc->sc_vq, &len))) {
-		struct vioblk_req *req = &sc->sc_reqs[ve->qe_index];
+	while ((ve = virtio_pull_chain(q->q_vq, &len))) {
+		struct vioblk_req *req = &q->q_reqs[ve->qe_index];
 		bd_xfer_t *xfer = req->xfer;
 		uint8_t status = req->status;
 		uint32_t type = req->hdr.type;
@@ -636,14 +686,14 @@ vioblk_int_handler(caddr_t arg1, caddr_t arg2)
 				break;
 			case VIRTIO_BLK_S_IOERR:
 				error = EIO;
-				sc->sc_stats.io_errors++;
+				q->q_stats.io_errors++;
 				break;
 			case VIRTIO_BLK_S_UNSUPP:
-				sc->sc_stats.unsupp_errors++;
+				q->q_stats.unsupp_errors++;
 				error = ENOTTY;
 				break;
 			default:
-				sc->sc_stats.nxio_errors++;
+				q->q_stats.nxio_errors++;
 				error = ENXIO;
 				break;
 		}
@@ -660,9 +710,9 @@ vioblk_int_handler(caddr_t arg1, caddr_t arg2)
 	}
 
 	/* update stats */
-	if (sc->sc_stats.intr_queuemax < i)
-		sc->sc_stats.intr_queuemax = i;
-	sc->sc_stats.intr_total++;
+	if (q->q_stats.intr_queuemax < i)
+		q->q_stats.intr_queuemax = i;
+	q->q_stats.intr_total++;
 
 	return (DDI_INTR_CLAIMED);
 }
@@ -674,35 +724,44 @@ vioblk_config_handler(caddr_t arg1, caddr_t arg2)
 	return (DDI_INTR_CLAIMED);
 }
 
+/*
+ * One handler per queue, each handed its queue.  With MSI-X, queue i
+ * gets vector i.
+ */
 static int
 vioblk_register_ints(struct vioblk_softc *sc)
 {
-	int ret;
+	struct virtio_int_handler *vioblk_vq_h;
+	int ret, i;
 
 	struct virtio_int_handler vioblk_conf_h = {
 		vioblk_config_handler
 	};
 
-	struct virtio_int_handler vioblk_vq_h[] = {
-		{ vioblk_int_handler },
-		{ NULL },
-	};
+	vioblk_vq_h = kmem_zalloc(sizeof (struct virtio_int_handler) *
+	    (sc->sc_nqueues + 1), KM_SLEEP);
+	for (i = 0; i < sc->sc_nqueues; i++) {
+		vioblk_vq_h[i].vh_func = vioblk_int_handler;
+		vioblk_vq_h[i].vh_priv = &sc->sc_queues[i];
+	}
 
 	ret = virtio_register_ints(&sc->sc_virtio,
 	    &vioblk_conf_h, vioblk_vq_h);
 
+	kmem_free(vioblk_vq_h, sizeof (struct virtio_int_handler) *
+	    (sc->sc_nqueues + 1));
 	return (ret);
 }
 
 static void
-vioblk_free_reqs(struct vioblk_softc *sc)
+vioblk_free_reqs(struct vioblk_queue *q)
 {
 	int i, qsize;
 
-	qsize = sc->sc_vq->vq_num;
+	qsize = q->q_vq->vq_num;
 
 	for (i = 0; i < qsize; i++) {
-		struct vioblk_req *req = &sc->sc_reqs[i];
+		struct vioblk_req *req = &q->q_reqs[i];
 
 		if (req->ndmac)
 			(void) ddi_dma_unbind_handle(req->dmah);
@@ -711,21 +770,23 @@ vioblk_free_reqs(struct vioblk_softc *sc)
 			ddi_dma_free_handle(&req->dmah);
 	}
 
-	kmem_free(sc->sc_reqs, sizeof (struct vioblk_req) * qsize);
+	kmem_free(q->q_reqs, sizeof (struct vioblk_req) * qsize);
+	q->q_reqs = NULL;
 }
 
 static int
-vioblk_alloc_reqs(struct vioblk_softc *sc)
+vioblk_alloc_reqs(struct vioblk_queue *q)
 {
+	struct vioblk_softc *sc = q->q_sc;
 	int i, qsize;
 	int ret;
 
-	qsize = sc->sc_vq->vq_num;
+	qsize = q->q_vq->vq_num;
 
-	sc->sc_reqs = kmem_zalloc(sizeof (struct vioblk_req) * qsize, KM_SLEEP);
+	q->q_reqs = kmem_zalloc(sizeof (struct vioblk_req) * qsize, KM_SLEEP);
 
 	for (i = 0; i < qsize; i++) {
-		struct vioblk_req *req = &sc->sc_reqs[i];
+		struct vioblk_req *req = &q->q_reqs[i];
 
 		ret = ddi_dma_alloc_handle(sc->sc_dev, &vioblk_req_dma_attr,
 		    DDI_DMA_SLEEP, NULL, &req->dmah);
@@ -752,26 +813,91 @@ vioblk_alloc_reqs(struct vioblk_softc *sc)
 	return (0);
 
 exit:
-	vioblk_free_reqs(sc);
+	vioblk_free_reqs(q);
 	return (ENOMEM);
 }
 
+/*
+ * Set up the request queues; on failure, those that were set up are
+ * torn down again.
+ */
+static int
+vioblk_alloc_queues(struct vioblk_softc *sc)
+{
+	struct vioblk_queue *q;
+	int i;
+
+	sc->sc_qsize = UINT_MAX;
+	for (i = 0; i < sc->sc_nqueues; i++) {
+		q = &sc->sc_queues[i];
+		q->q_sc = sc;
+		q->q_vq = virtio_alloc_vq(&sc->sc_virtio, i, 0,
+		    sc->sc_seg_max, "I/O request");
+		if (q->q_vq == NULL)
+			goto fail;
+		if (vioblk_alloc_reqs(q)) {
+			virtio_free_vq(q->q_vq);
+			goto fail;
+		}
+		sc->sc_qsize = MIN(sc->sc_qsize, q->q_vq->vq_num);
+	}
+	return (0);
+
+fail:
+	while (--i >= 0) {
+		q = &sc->sc_queues[i];
+		vioblk_free_reqs(q);
+		virtio_free_vq(q->q_vq);
+	}
+	return (ENOMEM);
+}
+
+static void
+vioblk_free_queues(struct vioblk_softc *sc)
+{
+	struct vioblk_queue *q;
+	int i;
+
+	for (i = 0; i < sc->sc_nqueues; i++) {
+		q = &sc->sc_queues[i];
+		virtio_stop_vq_intr(q->q_vq);
+		vioblk_free_reqs(q);
+		virtio_free_vq(q->q_vq);
+	}
+}
+
 
 static int
 vioblk_ksupdate(kstat_t *ksp, int rw)
 {
 	struct vioblk_softc *sc = ksp->ks_private;
+	struct vioblk_lstats st;
+	int i;
 
 	if (rw == KSTAT_WRITE)
 		return (EACCES);
 
-	sc->ks_data->sts_rw_cookiesmax.value.ui32 = sc->sc_stats.rw_cookiesmax;
-	sc->ks_data->sts_intr_queuemax.value.ui32 = sc->sc_stats.intr_queuemax;
-	sc->ks_data->sts_unsupp_errors.value.ui32 = sc->sc_stats.unsupp_errors;
-	sc->ks_data->sts_nxio_errors.value.ui32 = sc->sc_stats.nxio_errors;
-	sc->ks_data->sts_io_errors.value.ui32 = sc->sc_stats.io_errors;
-	sc->ks_data->sts_rw_cacheflush.value.ui64 = sc->sc_stats.rw_cacheflush;
-	sc->ks_data->sts_intr_total.value.ui64 = sc->sc_stats.intr_total;
+	/* The queues keep their own, so they don't share a cache line */
+	(void) memset(&st, 0, sizeof (st));
+	for (i = 0; i < sc->sc_nqueues; i++) {
+		struct vioblk_lstats *qs = &sc->sc_queues[i].q_stats;
+
+		st.rw_cookiesmax = MAX(st.rw_cookiesmax, qs->rw_cookiesmax);
+		st.intr_queuemax = MAX(st.intr_queuemax, qs->intr_queuemax);
+		st.unsupp_errors += qs->unsupp_errors;
+		st.nxio_errors += qs->nxio_errors;
+		st.io_errors += qs->io_errors;
+		st.rw_cacheflush += qs->rw_cacheflush;
+		st.intr_total += qs->intr_total;
+	}
+
+	sc->ks_data->sts_rw_cookiesmax.value.ui32 = st.rw_cookiesmax;
+	sc->ks_data->sts_intr_queuemax.value.ui32 = st.intr_queuemax;
+	sc->ks_data->sts_unsupp_errors.value.ui32 = st.unsupp_errors;
+	sc->ks_data->sts_nxio_errors.value.ui32 = st.nxio_errors;
+	sc->ks_data->sts_io_errors.value.ui32 = st.io_errors;
+	sc->ks_data->sts_rw_cacheflush.value.ui64 = st.rw_cacheflush;
+	sc->ks_data->sts_intr_total.value.ui64 = st.intr_total;
 
 
 	return (0);
@@ -866,15 +992,41 @@ vioblk_attach(dev_info_t *devinfo, ddi_attach_cmd_t cmd)
 	virtio_set_status(&sc->sc_virtio, VIRTIO_CONFIG_DEVICE_STATUS_ACK);
 	virtio_set_status(&sc->sc_virtio, VIRTIO_CONFIG_DEVICE_STATUS_DRIVER);
 
+	ret = vioblk_dev_features(sc);
+	if (ret)
+		goto exit_int;
+
+	/*
+	 * The number of queues decides the number of interrupts, so it has
+	 * to be read before they are set up, and with them the layout of
+	 * the device config; until then there is no MSI-X and the config
+	 * is where it is without.
+	 */
+	sc->sc_nqueues = 1;
+	if (sc->sc_virtio.sc_features & VIRTIO_BLK_F_MQ) {
+		int nintrs;
+
+		sc->sc_virtio.sc_config_offset =
+		    VIRTIO_CONFIG_DEVICE_CONFIG_NOMSI;
+		sc->sc_nqueues = virtio_read_device_config_2(&sc->sc_virtio,
+		    VIRTIO_BLK_CONFIG_NUM_QUEUES);
+		sc->sc_nqueues = MIN(sc->sc_nqueues, ncpus);
+		sc->sc_nqueues = MIN(sc->sc_nqueues, vioblk_max_queues);
+		/* One vector for each queue and one for config changes */
+		if (ddi_intr_get_nintrs(devinfo, DDI_INTR_TYPE_MSIX,
+		    &nintrs) == DDI_SUCCESS && nintrs > 1)
+			sc->sc_nqueues = MIN(sc->sc_nqueues, nintrs - 1);
+		sc->sc_nqueues = MAX(sc->sc_nqueues, 1);
+	}
+	sc->sc_virtio.sc_nvqs = sc->sc_nqueues;
+	sc->sc_queues = kmem_zalloc(sizeof (struct vioblk_queue) *
+	    sc->sc_nqueues, KM_SLEEP);
+
 	if (vioblk_register_ints(sc)) {
 		dev_err(devinfo, CE_WARN, "Unable to add interrupt");
 		goto exit_int;
 	}
 
-	ret = vioblk_dev_features(sc);
-	if (ret)
-		goto exit_features;
-
 	if (sc->sc_virtio.sc_features & VIRTIO_BLK_F_RO)
 		sc->sc_readonly = B_TRUE;
 	else
@@ -939,15 +1091,9 @@ vioblk_attach(dev_info_t *devinfo, ddi_attach_cmd_t cmd)
 	    vioblk_bd_dma_attr.dma_attr_maxxfer);
 
 
-	sc->sc_vq = virtio_alloc_vq(&sc->sc_virtio, 0, 0,
-	    sc->sc_seg_max, "I/O request");
-	if (sc->sc_vq == NULL) {
-		goto exit_alloc1;
-	}
-
-	ret = vioblk_alloc_reqs(sc);
+	ret = vioblk_alloc_queues(sc);
 	if (ret) {
-		goto exit_alloc2;
+		goto exit_alloc1;
 	}
 
 	sc->bd_h = bd_alloc_handle(sc, &vioblk_ops, &vioblk_bd_dma_attr,
@@ -956,7 +1102,7 @@ vioblk_attach(dev_info_t *devinfo, ddi_attach_cmd_t cmd)
 
 	virtio_set_status(&sc->sc_virtio,
 	    VIRTIO_CONFIG_DEVICE_STATUS_DRIVER_OK);
-	virtio_start_vq_intr(sc->sc_vq);
+	vioblk_set_poll_mode(sc, B_FALSE);
 
 	ret = virtio_enable_ints(&sc->sc_virtio);
 	if (ret)
@@ -976,19 +1122,19 @@ exit_attach_bd:
 	 * If they ever get split, don't forget to add a call here.
 	 */
 exit_enable_ints:
-	virtio_stop_vq_intr(sc->sc_vq);
 	bd_free_handle(sc->bd_h);
-	vioblk_free_reqs(sc);
-exit_alloc2:
-	virtio_free_vq(sc->sc_vq);
+	vioblk_free_queues(sc);
 exit_alloc1:
-exit_features:
 	virtio_release_ints(&sc->sc_virtio);
 exit_int:
 	virtio_set_status(&sc->sc_virtio, VIRTIO_CONFIG_DEVICE_STATUS_FAILED);
 	ddi_regs_map_free(&sc->sc_virtio.sc_ioh);
 exit_map:
 	kstat_delete(sc->sc_intrstat);
+	if (sc->sc_queues != NULL) {
+		kmem_free(sc->sc_queues,
+		    sizeof (struct vioblk_queue) * sc->sc_nqueues);
+	}
 exit_intrstat:
 	mutex_destroy(&sc->lock_devid);
 	cv_destroy(&sc->cv_devid);
@@ -1016,13 +1162,13 @@ vioblk_detach(dev_info_t *devinfo, ddi_detach_cmd_t cmd)
 	}
 
 	(void) bd_detach_handle(sc->bd_h);
-	virtio_stop_vq_intr(sc->sc_vq);
+	vioblk_set_poll_mode(sc, B_TRUE);
 	virtio_release_ints(&sc->sc_virtio);
-	vioblk_free_reqs(sc);
-	virtio_free_vq(sc->sc_vq);
+	vioblk_free_queues(sc);
 	virtio_device_reset(&sc->sc_virtio);
 	ddi_regs_map_free(&sc->sc_virtio.sc_ioh);
 	kstat_delete(sc->sc_intrstat);
+	kmem_free(sc->sc_queues, sizeof (struct vioblk_queue) * sc->sc_nqueues);
 	kmem_free(sc, sizeof (struct vioblk_softc));
 
 	return (DDI_SUCCESS);
@@ -1033,7 +1179,7 @@ vioblk_quiesce(dev_info_t *devinfo)
 {
 	struct vioblk_softc *sc = ddi_get_driver_private(devinfo);
 
-	virtio_stop_vq_intr(sc->sc_vq);
+	vioblk_set_poll_mode(sc, B_TRUE);
 	virtio_device_reset(&sc->sc_virtio);
 
 	return (DDI_SUCCESS);
@@ -76,6 +76,11 @@
 #define	VIRTQUEUE_ALIGN(n) (((n)+(VIRTIO_PAGE_SIZE-1)) & \
 	    ~(VIRTIO_PAGE_SIZE-1))
 
+/* The event indices, see virtioreg.h */
+#define	VQ_USED_EVENT(vq)	((vq)->vq_avail->ring[(vq)->vq_num])
+#define	VQ_AVAIL_EVENT(vq)	\
+	(*(volatile uint16_t *)&(vq)->vq_used->ring[(vq)->vq_num])
+
 void
 virtio_set_status(struct virtio_softc *sc, unsigned int status)
 {
@@ -131,6 +136,9 @@ virtio_show_features(uint32_t features,
 	if (features & VIRTIO_F_RING_INDIRECT_DESC)
 		/* LINTED E_PTRDIFF_OVERFLOW */
 		buf += snprintf(buf, bufend - buf, "INDIRECT_DESC ");
+	if (features & VIRTIO_F_RING_EVENT_IDX)
+		/* LINTED E_PTRDIFF_OVERFLOW */
+		buf += snprintf(buf, bufend - buf, "EVENT_IDX ");
 
 	/* LINTED E_PTRDIFF_OVERFLOW */
 	buf += snprintf(buf, bufend - buf, ") ");
@@ -239,17 +247,25 @@ virtio_write_device_config_8(struct virtio_softc *sc,
 
 /*
  * Start/stop vq interrupt.  No guarantee.
+ *
+ * With event indices the flag is ignored by the device, so an interrupt
+ * is instead asked for at an index that has just gone by, which won't
+ * come around for another 64K completions.
  */
 void
 virtio_stop_vq_intr(struct virtqueue *vq)
 {
 	vq->vq_avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+	if (vq->vq_event_idx)
+		VQ_USED_EVENT(vq) = vq->vq_used_idx - 1;
 }
 
 void
 virtio_start_vq_intr(struct virtqueue *vq)
 {
 	vq->vq_avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+	if (vq->vq_event_idx)
+		VQ_USED_EVENT(vq) = vq->vq_used_idx;
 }
 
 static ddi_dma_attr_t virtio_vq_dma_attr = {
@@ -455,13 +471,13 @@ virtio_alloc_vq(struct virtio_softc *sc,
 	if (size)
 		vq_size = MIN(vq_size, size);
 
-	/* allocsize1: descriptor table + avail ring + pad */
+	/* allocsize1: descriptor table + avail ring + used_event + pad */
 	allocsize1 = VIRTQUEUE_ALIGN(sizeof (struct vring_desc) * vq_size +
 	    sizeof (struct vring_avail) +
-	    sizeof (uint16_t) * vq_size);
-	/* allocsize2: used ring + pad */
+	    sizeof (uint16_t) * (vq_size + 1));
+	/* allocsize2: used ring + avail_event + pad */
 	allocsize2 = VIRTQUEUE_ALIGN(sizeof (struct vring_used)
-	    + sizeof (struct vring_used_elem) * vq_size);
+	    + sizeof (struct vring_used_elem) * vq_size + sizeof (uint16_t));
 
 	allocsize = allocsize1 + allocsize2;
 
@@ -518,6 +534,7 @@ virtio_alloc_vq(struct virtio_softc *sc,
 	vq->vq_avail = (void *)(((char *)vq->vq_descs) + vq->vq_availoffset);
 	vq->vq_usedoffset = allocsize1;
 	vq->vq_used = (void *)(((char *)vq->vq_descs) + vq->vq_usedoffset);
+	vq->vq_event_idx = virtio_has_feature(sc, VIRTIO_F_RING_EVENT_IDX);
 
 	ASSERT(indirect_num == 0 ||
 	    virtio_has_feature(sc, VIRTIO_F_RING_INDIRECT_DESC));
@@ -686,23 +703,40 @@ virtio_ve_add_cookie(struct vq_entry *qe, ddi_dma_handle_t dma_handle,
 	}
 }
 
+/*
+ * Publish the chains pushed so far and notify the device, unless it has
+ * said it doesn't need to be.  Called with vq_avail_lock held.
+ */
 void
 virtio_sync_vq(struct virtqueue *vq)
 {
 	struct virtio_softc *vsc = vq->vq_owner;
+	uint16_t old, new;
+	boolean_t notify;
+
+	ASSERT(MUTEX_HELD(&vq->vq_avail_lock));
 
 	/* Make sure the avail ring update hit the buffer */
 	membar_producer();
 
-	vq->vq_avail->idx = vq->vq_avail_idx;
+	old = vq->vq_notified_idx;
+	new = vq->vq_avail_idx;
+	vq->vq_avail->idx = new;
+	vq->vq_notified_idx = new;
 
-	/* Make sure the avail idx update hits the buffer */
-	membar_producer();
+	/*
+	 * Make sure the avail idx update hits the buffer before we look
+	 * at whether the device wants to hear about it; otherwise it may
+	 * go to sleep on the old index just as we decide not to wake it.
+	 */
+	membar_enter();
 
-	/* Make sure we see the flags update */
-	membar_consumer();
+	if (vq->vq_event_idx)
+		notify = VRING_NEED_EVENT(VQ_AVAIL_EVENT(vq), new, old);
+	else
+		notify = !(vq->vq_used->flags & VRING_USED_F_NO_NOTIFY);
 
-	if (!(vq->vq_used->flags & VRING_USED_F_NO_NOTIFY))
+	if (notify)
 		ddi_put16(vsc->sc_ioh,
 		    /* LINTED E_BAD_PTR_CAST_ALIGN */
 		    (uint16_t *)(vsc->sc_io_addr +
@@ -766,13 +800,29 @@ virtio_push_chain(struct vq_entry *qe, boolean_t sync)
 	membar_producer();
 	vq->vq_avail->ring[idx % vq->vq_num] = head->qe_index;
 
-	/* Notify the device, if needed. */
+	/*
+	 * Notify the device, if needed.  A caller pushing several chains
+	 * in a row passes sync only for the last, or uses virtio_kick_vq()
+	 * when done.
+	 */
 	if (sync)
 		virtio_sync_vq(vq);
 
 	mutex_exit(&vq->vq_avail_lock);
 }
 
+/*
+ * Notify the device of chains pushed without sync.
+ */
+void
+virtio_kick_vq(struct virtqueue *vq)
+{
+	mutex_enter(&vq->vq_avail_lock);
+	if (vq->vq_notified_idx != vq->vq_avail_idx)
+		virtio_sync_vq(vq);
+	mutex_exit(&vq->vq_avail_lock);
+}
+
 /* Get a chain of descriptors from the used ring, if one is available. */
 struct vq_entry *
 virtio_pull_chain(struct virtqueue *vq, uint32_t *len)
@@ -783,10 +833,24 @@ virtio_pull_chain(struct virtqueue *vq, uint32_t *len)
 
 	mutex_enter(&vq->vq_used_lock);
 
-	/* No used entries? Bye. */
+	/*
+	 * No used entries? Bye.  With event indices, first ask for an
+	 * interrupt when the device uses the next one, and look again in
+	 * case it just did.  Until then the device doesn't interrupt us
+	 * for completions we are going to find here anyway.
+	 */
 	if (vq->vq_used_idx == vq->vq_used->idx) {
-		mutex_exit(&vq->vq_used_lock);
-		return (NULL);
+		if (!vq->vq_event_idx ||
+		    (vq->vq_avail->flags & VRING_AVAIL_F_NO_INTERRUPT)) {
+			mutex_exit(&vq->vq_used_lock);
+			return (NULL);
+		}
+		VQ_USED_EVENT(vq) = vq->vq_used_idx;
+		membar_enter();
+		if (vq->vq_used_idx == vq->vq_used->idx) {
+			mutex_exit(&vq->vq_used_lock);
+			return (NULL);
+		}
 	}
 
 	usedidx = vq->vq_used_idx;
@@ -864,9 +928,14 @@ virtio_register_msi(struct virtio_softc *sc,
 
 	/*
 	 * Those who try to register more handlers then the device
-	 * supports shall suffer.
+	 * supports get fixed interrupts.
 	 */
-	ASSERT(handler_count <= count);
+	if (handler_count > count) {
+		dev_debug(sc->sc_dev, CE_WARN,
+		    "Not enough MSI: need %d, device has %d",
+		    handler_count, count);
+		return (DDI_FAILURE);
+	}
 
 	sc->sc_intr_htable = kmem_zalloc(
 	    sizeof (ddi_intr_handle_t) * handler_count, KM_SLEEP);
@@ -882,6 +951,7 @@ virtio_register_msi(struct virtio_softc *sc,
 		dev_err(sc->sc_dev, CE_WARN,
 		    "Not enough MSI available: need %d, available %d",
 		    handler_count, actual);
+		ret = DDI_FAILURE;
 		goto out_msi_available;
 	}
 
@@ -941,13 +1011,17 @@ virtio_register_msi(struct virtio_softc *sc,
 	if (ret != DDI_SUCCESS)
 		sc->sc_intr_cap = 0;
 
+	return (DDI_SUCCESS);
+
 out_add_handlers:
 out_msi_prio:
 out_msi_available:
 	for (i = 0; i < actual; i++)
 		(void) ddi_intr_free(sc->sc_intr_htable[i]);
 out_msi_alloc:
-	kmem_free(sc->sc_intr_htable, sizeof (ddi_intr_handle_t) * count);
+	kmem_free(sc->sc_intr_htable,
+	    sizeof (ddi_intr_handle_t) * handler_count);
+	sc->sc_intr_htable = NULL;
 
 	return (ret);
 }
@@ -87,6 +87,7 @@
 
 #define	VIRTIO_F_NOTIFY_ON_EMPTY		(1<<24)
 #define	VIRTIO_F_RING_INDIRECT_DESC		(1<<28)
+#define	VIRTIO_F_RING_EVENT_IDX			(1<<29)
 #define	VIRTIO_F_BAD_FEATURE			(1<<30)
 
 #define	VIRTIO_CONFIG_QUEUE_ADDRESS		8 /* 32bit */
@@ -172,6 +173,16 @@ struct vring_used {
 } __attribute__((packed));
 
 
+/*
+ * With VIRTIO_F_RING_EVENT_IDX, each ring is followed by one more index:
+ * after the avail ring, the used index at which the driver wants its
+ * next interrupt (used_event); after the used ring, the avail index at
+ * which the device wants its next notification (avail_event).  The flags
+ * above are then ignored.
+ */
+#define	VRING_NEED_EVENT(event, new, old)	\
+	((uint16_t)((new) - (event) - 1) < (uint16_t)((new) - (old)))
+
 /* Got nothing to do with the system page size, just a confusing name. */
 #define	VIRTIO_PAGE_SIZE	(4096)
 
@@ -123,6 +123,8 @@ struct virtqueue {
 
 	/* enqueue/dequeue status */
 	uint16_t		vq_avail_idx;
+	uint16_t		vq_notified_idx; /* avail idx last published */
+	boolean_t		vq_event_idx;	/* VIRTIO_F_RING_EVENT_IDX */
 	kmutex_t		vq_avail_lock;
 	uint16_t		vq_used_idx;
 	kmutex_t		vq_used_lock;
@@ -199,6 +201,7 @@ void virtio_push_chain(struct vq_entry *qe, boolean_t sync);
 struct vq_entry *virtio_pull_chain(struct virtqueue *vq, uint32_t *len);
 void virtio_free_chain(struct vq_entry *ve);
 void virtio_sync_vq(struct virtqueue *vq);
+void virtio_kick_vq(struct virtqueue *vq);
 
 int virtio_register_ints(struct virtio_softc *sc,
 		struct virtio_int_handler *config_handler,
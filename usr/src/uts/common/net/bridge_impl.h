@@ -67,11 +67,15 @@ typedef struct bridge_ksinst_s {
 	kstat_named_t	bki_count;	/* source addresses known */
 } bridge_ksinst_t;
 
-#define	KSLINK_NAMES	"recv", "xmit", "drops"
+#define	KSLINK_NAMES	"recv", "xmit", "drops", \
+	"forward_direct", "forward_unknown", "forward_mbcast"
 typedef struct bridge_kslink_s {
 	kstat_named_t	bkl_recv;	/* packets received */
 	kstat_named_t	bkl_xmit;	/* packets transmitted */
 	kstat_named_t	bkl_drops;	/* packets dropped */
+	kstat_named_t	bkl_forwards;	/* packets forwarded from link */
+	kstat_named_t	bkl_unknown;	/* ... to unknown destinations */
+	kstat_named_t	bkl_mbcast;	/* ... to multi/broadcast */
 } bridge_kslink_t;
 
 /*
@@ -89,6 +93,24 @@ typedef struct bridge_kslink_s {
 
 struct bridge_mac_s;
 struct bridge_stream_s;
+struct bridge_fwd_s;
+
+/*
+ * The forwarding entries in bi_fwd are also hashed by address, so that
+ * lookups on the data path take only the lock on one bucket rather than
+ * bi_rwlock.  Entries are added to and removed from both the AVL tree and
+ * the hash with bi_rwlock held as writer; the AVL tree is what's used for
+ * listing, aging and flushing.  Buckets are a cache line apiece.
+ */
+#define	BRIDGE_FWD_HASHSZ	256	/* must be a power of 2 */
+#define	BRIDGE_FWD_HASH(addr)	\
+	(((addr)[3] ^ (addr)[4] ^ (addr)[5]) & (BRIDGE_FWD_HASHSZ - 1))
+
+typedef struct bridge_fwd_bucket_s {
+	krwlock_t	bfb_lock;
+	struct bridge_fwd_s *bfb_head;
+	char		bfb_pad[64 - sizeof (krwlock_t) - sizeof (void *)];
+} bridge_fwd_bucket_t;
 
 typedef struct bridge_inst_s {
 	list_node_t	bi_node;
@@ -101,6 +123,7 @@ typedef struct bridge_inst_s {
 	list_t		bi_links;
 	kcondvar_t	bi_linkwait;
 	avl_tree_t	bi_fwd;
+	bridge_fwd_bucket_t *bi_fwdhash;	/* hash of bi_fwd entries */
 	kstat_t		*bi_ksp;
 	struct bridge_stream_s *bi_control;
 	struct bridge_mac_s *bi_mac;
@@ -210,11 +233,12 @@ typedef struct bridge_link_s {
  * This represents a learned forwarding entry.  These are generally created and
  * refreshed on demand as we learn about nodes through source MAC addresses we
  * see.  They're destroyed when they age away.  For forwarding, we look up the
- * destination address in an AVL tree, and the entry found tells us where the
+ * destination address in a hash table, and the entry found tells us where the
  * that source must live.
  */
 typedef struct bridge_fwd_s {
 	avl_node_t	bf_node;
+	struct bridge_fwd_s *bf_hnext;	/* next in bi_fwdhash bucket */
 	uchar_t		bf_dest[ETHERADDRL];
 	uint16_t	bf_trill_nick;	/* destination nickname */
 	clock_t		bf_lastheard;	/* time we last heard from this node */
@@ -81,6 +81,7 @@ struct tcphdr {
 #define	TCPOPT_SACK_PERMITTED	4
 #define	TCPOPT_SACK	5
 #define	TCPOPT_TSTAMP	8
+#define	TCPOPT_FASTOPEN	34
 
 /*
  * Default maximum segment size for TCP.
@@ -129,6 +130,8 @@ struct tcphdr {
 #define	TCP_KEEPIDLE			0x22
 #define	TCP_KEEPCNT			0x23
 #define	TCP_KEEPINTVL			0x24
+#define	TCP_CONGESTION			0x25	/* congestion control algo */
+#define	TCP_FASTOPEN			0x26	/* accept data on SYN */
 
 #ifdef	__cplusplus
 }
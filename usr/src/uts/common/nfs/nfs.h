@@ -881,6 +881,19 @@ void	rfs_srvrfini(void);
 #define	NATIVEPATH	0x02	/* Native path, i.e., via mount protocol */
 #define	SECURITY_QUERY	0x04	/* Security query */
 
+/*
+ * Per mount state for sizing read-ahead, see nfs_ra_depth().
+ */
+typedef struct nfs_rastat {
+	kmutex_t	ra_lock;	/* protects ra_lat thru ra_bytes */
+	hrtime_t	ra_lat;		/* smoothed READ latency (nsec) */
+	uint64_t	ra_rate;	/* smoothed READ rate (bytes/sec) */
+	hrtime_t	ra_start;	/* start of current rate sample */
+	uint64_t	ra_bytes;	/* bytes read in current sample */
+	uint64_t	ra_hits;	/* sequential reads found ready */
+	uint64_t	ra_misses;	/* sequential reads that waited */
+} nfs_rastat_t;
+
 /* index for svstat_ptr */
 enum nfs_svccounts {NFS_CALLS, NFS_BADCALLS, NFS_REFERRALS, NFS_REFERLINKS};
 
@@ -943,6 +956,12 @@ void	nfsauth_fini();
 int	nfs_setopts(vnode_t *vp, model_t model, struct nfs_args *args);
 int	nfs_mount_label_policy(vfs_t *vfsp, struct netbuf *addr,
     struct knetconfig *knconf, cred_t *cr);
+int	nfs_mount_nconnect(vfs_t *vfsp);
+void	nfs_ra_init(nfs_rastat_t *);
+void	nfs_ra_fini(nfs_rastat_t *);
+void	nfs_ra_done(nfs_rastat_t *, hrtime_t, size_t);
+int	nfs_ra_depth(nfs_rastat_t *, uint_t, int);
+void	nfs_ra_account(nfs_rastat_t *, page_t *);
 boolean_t nfs_has_ctty(void);
 void	nfs_srv_stop_all(void);
 void	nfs_srv_quiesce_all(void);
@@ -968,6 +968,8 @@ typedef struct mntinfo4 {
 					/* really write size */
 	int		mi_timeo;	/* inital timeout in 10th sec */
 	int		mi_retrans;	/* times to retry request */
+	int		mi_nconnect;	/* connections to spread calls over */
+	nfs_rastat_t	mi_ra;		/* read-ahead sizing */
 	hrtime_t	mi_acregmin;	/* min time to hold cached file attr */
 	hrtime_t	mi_acregmax;	/* max time to hold cached file attr */
 	hrtime_t	mi_acdirmin;	/* min time to hold cached dir attr */
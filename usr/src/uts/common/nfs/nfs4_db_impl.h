@@ -48,6 +48,12 @@ extern "C" {
  * Tables are in turn made up of a collection of
  * entries. Each table may haveone or more indices
  * associtated with it.
+ *
+ * Searches for existing entries run without locks, inside an SMR
+ * critical section (see rfs4_dbsearch()); the reaper waits for those to
+ * finish before it destroys what it has taken out of the indices.  All
+ * other users of the hash buckets hold dbt_t_lock as reader, and the
+ * reaper holds it as writer to resize the table.
  */
 
 /* Private implementation */
@@ -68,6 +74,7 @@ struct rfs4_dbe {
 	kcondvar_t	dbe_cv[1];
 	rfs4_entry_t	dbe_data;
 	rfs4_table_t	*dbe_table;
+	struct rfs4_dbe	*dbe_reapnext;		/* reaper's list of dead ones */
 	rfs4_link_t	dbe_indices[1];		/* Array of indices for entry */
 };
 
@@ -92,7 +99,6 @@ struct rfs4_table {
 	rfs4_table_t	*dbt_tnext;		/* next table in db */
 	struct rfs4_database *dbt_db;		/* db that holds this table */
 	krwlock_t	dbt_t_lock[1];		/* lock table for resize */
-	kmutex_t	dbt_lock[1];		/* mutex for count and cached */
 	char		*dbt_name;		/* Table name */
 	id_space_t	*dbt_id_space;		/* space for unique entry ids */
 	time_t	dbt_min_cache_time;		/* How long to cache entries */
@@ -100,7 +106,7 @@ struct rfs4_table {
 	uint32_t	dbt_usize;		/* User entry size */
 	uint32_t	dbt_maxentries;		/* max # of entries in table */
 	uint32_t	dbt_len;		/* # of buckets in table */
-	uint32_t	dbt_count;		/* # of entries in table */
+	uint32_t	dbt_count;		/* # of entries; atomic */
 	uint32_t	dbt_idxcnt;		/* # of indices in table */
 	uint32_t	dbt_maxcnt;		/* max # of indices */
 	uint32_t	dbt_ccnt;		/* # of creatable entries */
@@ -139,6 +145,7 @@ struct rfs4_database {
 	(l)->next = (head); \
 	if ((l)->next) \
 	    (l)->next->prev = (l); \
+	membar_producer(); \
 	(head) = (l); \
 }
 
@@ -158,8 +165,8 @@ struct rfs4_database {
 
 #define	ENQUEUE_IDX(bp, l) { \
 	rw_enter((bp)->dbk_lock, RW_WRITER); \
-	ENQUEUE((bp)->dbk_head, l); \
 	VALIDATE_ADDR((l)->entry); \
+	ENQUEUE((bp)->dbk_head, l); \
 	rw_exit((bp)->dbk_lock); \
 }
 
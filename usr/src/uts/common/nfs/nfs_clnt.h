@@ -232,6 +232,11 @@ typedef struct chtab {
 	CLIENT *ch_client;	/* pointer to client handle */
 } chtab_t;
 
+/*
+ * Most connections a mount can ask to spread its calls over.
+ */
+#define	NFS_MAXNCONNECT	16
+
 /*
  * clinfo is a structure which encapsulates data that is needed to
  * obtain a client handle from the cache
@@ -340,6 +345,8 @@ typedef struct mntinfo {
 	uint_t		mi_stsize;	/* max write transfer size (bytes) */
 	int		mi_timeo;	/* inital timeout in 10th sec */
 	int		mi_retrans;	/* times to retry request */
+	int		mi_nconnect;	/* connections to spread calls over */
+	nfs_rastat_t	mi_ra;		/* read-ahead sizing */
 	hrtime_t	mi_acregmin;	/* min time to hold cached file attr */
 	hrtime_t	mi_acregmax;	/* max time to hold cached file attr */
 	hrtime_t	mi_acdirmin;	/* min time to hold cached dir attr */
@@ -492,6 +499,11 @@ struct mntinfo_kstat {
 	uint32_t	mik_failover;
 	uint32_t	mik_remap;
 	char		mik_curserver[SYS_NMLN];
+	int		mik_nconnect;
+	uint32_t	mik_ralat;	/* smoothed READ latency (usec) */
+	uint64_t	mik_rarate;	/* smoothed READ rate (bytes/sec) */
+	uint64_t	mik_rahits;
+	uint64_t	mik_ramisses;
 };
 
 /*
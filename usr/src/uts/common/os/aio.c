@@ -26,7 +26,9 @@
 
 /*
  * Kernel asynchronous I/O.
- * This is only for raw devices now (as of Nov. 1993).
+ * This is for raw devices, which start the I/O themselves through their
+ * aread/awrite entry points, and for regular files, whose I/O is done
+ * by the threads of aio_file_taskq.
  */
 
 #include <sys/types.h>
@@ -51,6 +53,9 @@
 #include <sys/vmsystm.h>
 #include <sys/fs/pxfs_ki.h>
 #include <sys/contract/process_impl.h>
+#include <sys/taskq.h>
+#include <sys/disp.h>
+#include <sys/nbmlock.h>
 
 /*
  * external entry point.
@@ -110,6 +115,8 @@ static int aio_req_setupLF(aio_req_t **, aio_t *, aiocb64_32_t *,
 static int alio32(int, void *, int, void *);
 static int driver_aio_write(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
 static int driver_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
+static int file_aio_write(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
+static int file_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
 
 #ifdef  _SYSCALL32_IMPL
 static void aiocb_LFton(aiocb64_32_t *, aiocb_t *);
@@ -188,13 +195,29 @@ static struct modlinkage modlinkage = {
 	NULL
 };
 
+/*
+ * Requests to regular files are carried out by the threads of
+ * aio_file_taskq, so any number of them can be outstanding without the
+ * process having a thread blocked in each.  Setting aio_file_enable to
+ * zero leaves them to the threads of libc, as before.
+ */
+int	aio_file_enable = 1;
+int	aio_file_nthreads = 64;
+
+static taskq_t	*aio_file_taskq;
+
 int
 _init(void)
 {
 	int retval;
 
-	if ((retval = mod_install(&modlinkage)) != 0)
+	aio_file_taskq = taskq_create("aio_file_taskq", aio_file_nthreads,
+	    minclsyspri, aio_file_nthreads, INT_MAX, TASKQ_PREPOPULATE);
+
+	if ((retval = mod_install(&modlinkage)) != 0) {
+		taskq_destroy(aio_file_taskq);
 		return (retval);
+	}
 
 	return (0);
 }
@@ -204,7 +227,8 @@ _fini(void)
 {
 	int retval;
 
-	retval = mod_remove(&modlinkage);
+	if ((retval = mod_remove(&modlinkage)) == 0)
+		taskq_destroy(aio_file_taskq);
 
 	return (retval);
 }
@@ -2780,7 +2804,18 @@ static int
 	major = getmajor(dev);
 
 	/*
-	 * return NULL for requests to files and STREAMs so
+	 * Regular files are read and written by aio_file_taskq, unless
+	 * they are in a cluster file system or subject to non-blocking
+	 * mandatory locks, which the read and write system calls check.
+	 */
+	if (vp->v_type == VREG) {
+		if (!aio_file_enable || IS_PXFSVP(vp) || nbl_need_check(vp))
+			return (NULL);
+		return ((mode & FREAD) ? file_aio_read : file_aio_write);
+	}
+
+	/*
+	 * return NULL for requests to other files and STREAMs so
 	 * that libaio takes care of them.
 	 */
 	if (vp->v_type == VCHR) {
@@ -2887,6 +2922,134 @@ driver_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p)
 	return ((*cb->cb_aread)(dev, aio, cred_p));
 }
 
+/*
+ * Carry out a request to a regular file on behalf of the process that
+ * made it.  The user's buffer was locked down by file_aio_rw(), and is
+ * mapped into the kernel here; the completion is reported through
+ * aio_done() just as it is for a driver.
+ */
+static void
+file_aio_task(void *arg)
+{
+	aio_req_t	*reqp = arg;
+	struct buf	*bp = &reqp->aio_req_buf;
+	vnode_t		*vp = bp->b_file;
+	cred_t		*cr = reqp->aio_req_cred;
+	struct uio	uio;
+	struct iovec	iov;
+	int		fflag = reqp->aio_req_uio.uio_fmode;
+	int		error;
+
+	bp_mapin(bp);
+	iov.iov_base = bp->b_un.b_addr;
+	iov.iov_len = bp->b_bcount;
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_loffset = reqp->aio_req_uio.uio_loffset;
+	uio.uio_resid = bp->b_bcount;
+	uio.uio_segflg = UIO_SYSSPACE;
+	uio.uio_fmode = fflag;
+	uio.uio_extflg = UIO_COPY_DEFAULT;
+	uio.uio_llimit = reqp->aio_req_uio.uio_llimit;
+
+	if (bp->b_flags & B_READ) {
+		(void) VOP_RWLOCK(vp, V_WRITELOCK_FALSE, NULL);
+		error = VOP_READ(vp, &uio, fflag & (FSYNC | FDSYNC | FRSYNC),
+		    cr, NULL);
+		VOP_RWUNLOCK(vp, V_WRITELOCK_FALSE, NULL);
+	} else {
+		(void) VOP_RWLOCK(vp, V_WRITELOCK_TRUE, NULL);
+		error = VOP_WRITE(vp, &uio, fflag & (FSYNC | FDSYNC), cr,
+		    NULL);
+		VOP_RWUNLOCK(vp, V_WRITELOCK_TRUE, NULL);
+	}
+	crfree(cr);
+	reqp->aio_req_cred = NULL;
+
+	bp->b_resid = uio.uio_resid;
+	if (error != 0) {
+		bp->b_flags |= B_ERROR;
+		bp->b_error = error;
+	}
+	biodone(bp);
+}
+
+/*
+ * Lock down the user's buffer, as aphysio() does, and hand the request
+ * to aio_file_taskq.
+ */
+static int
+file_aio_rw(vnode_t *vp, struct aio_req *aio, cred_t *cred_p, int rw)
+{
+	struct uio	*uio = aio->aio_uio;
+	aio_req_t	*reqp = (aio_req_t *)aio->aio_private;
+	struct buf	*bp = &reqp->aio_req_buf;
+	struct iovec	*iov = uio->uio_iov;
+	struct page	**pplist;
+	file_t		*fp;
+	int		fflag;
+	int		error;
+
+	if (uio->uio_loffset < 0)
+		return (EINVAL);
+
+	/*
+	 * Appending writes must be done in the order they were made,
+	 * which the threads of the taskq do not promise.
+	 */
+	if ((fp = getf(reqp->aio_req_fd)) == NULL)
+		return (EBADF);
+	fflag = fp->f_flag;
+	releasef(reqp->aio_req_fd);
+	if (rw == B_WRITE && (fflag & FAPPEND))
+		return (ENOTSUP);
+
+	sema_init(&bp->b_sem, 0, NULL, SEMA_DEFAULT, NULL);
+	sema_init(&bp->b_io, 0, NULL, SEMA_DEFAULT, NULL);
+
+	bp->b_error = 0;
+	bp->b_flags = B_BUSY | B_PHYS | B_ASYNC | rw;
+	bp->b_iodone = (int (*)()) aio_done;
+	bp->b_forw = (struct buf *)reqp;
+	bp->b_proc = curproc;
+	bp->b_un.b_addr = iov->iov_base;
+	bp->b_bcount = iov->iov_len;
+
+	error = as_pagelock(curproc->p_as, &pplist, iov->iov_base,
+	    iov->iov_len, rw == B_READ ? S_WRITE : S_READ);
+	if (error != 0) {
+		bp->b_flags &= ~(B_BUSY | B_PHYS);
+		return (error);
+	}
+	reqp->aio_req_flags |= AIO_PAGELOCKDONE;
+	bp->b_shadow = pplist;
+	if (pplist != NULL)
+		bp->b_flags |= B_SHADOW;
+	reqp->aio_req_cancel = anocancel;
+
+	uio->uio_fmode = fflag;
+	uio->uio_llimit = curproc->p_fsz_ctl;
+	crhold(cred_p);
+	reqp->aio_req_cred = cred_p;
+
+	(void) taskq_dispatch(aio_file_taskq, file_aio_task, reqp, TQ_SLEEP);
+	return (0);
+}
+
+static int
+file_aio_write(vnode_t *vp, struct aio_req *aio, cred_t *cred_p)
+{
+	ASSERT(vp->v_type == VREG);
+	return (file_aio_rw(vp, aio, cred_p, B_WRITE));
+}
+
+static int
+file_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p)
+{
+	ASSERT(vp->v_type == VREG);
+	return (file_aio_rw(vp, aio, cred_p, B_READ));
+}
+
 /*
  * This routine is called when a largefile call is made by a 32bit
  * process on a ILP32 or LP64 kernel. All 64bit processes are large
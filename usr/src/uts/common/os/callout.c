@@ -53,6 +53,8 @@ static ulong_t callout_counter_low;		/* callout ID increment */
 static ulong_t callout_table_bits;		/* number of table bits in ID */
 static ulong_t callout_table_mask;		/* mask for the table bits */
 static callout_cache_t *callout_caches;		/* linked list of caches */
+static hrtime_t callout_wheel_res;		/* callout wheel slot size */
+hrtime_t callout_wheel_slack = CALLOUT_WHEEL_SLACK; /* coalescing window */
 #pragma align 64(callout_table)
 static callout_table_t *callout_table;		/* global callout table array */
 
@@ -74,6 +76,9 @@ static char *callout_kstat_names[] = {
 	"callout_expirations",
 	"callout_allocations",
 	"callout_cleanups",
+	"callout_timeouts_wheel",
+	"callout_timeouts_heap",
+	"callout_timeouts_queue",
 };
 
 static hrtime_t	callout_heap_process(callout_table_t *, hrtime_t, int);
@@ -507,6 +512,275 @@ callout_queue_process(callout_table_t *ct, hrtime_t delta, int timechange)
 	return (cl->cl_expiration);
 }
 
+/*
+ * Check whether a callout list with the given expiration and flags belongs
+ * in the callout wheel. While nothing on the wheel has expired yet, the
+ * start of the wheel's turn can be moved up to the current time.
+ */
+static int
+callout_wheel_fits(callout_table_t *ct, hrtime_t expiration, int clflags,
+    hrtime_t now)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	if ((cw == NULL) ||
+	    (clflags & (CALLOUT_LIST_FLAG_HRESTIME | CALLOUT_LIST_FLAG_NANO)))
+		return (0);
+
+	if (cw->cw_next > now)
+		cw->cw_base = (now / callout_wheel_res) * callout_wheel_res;
+
+	return ((expiration >= cw->cw_base) && (expiration <
+	    cw->cw_base + CALLOUT_WHEEL_SLOTS * callout_wheel_res));
+}
+
+/*
+ * Find a callout list in the wheel that corresponds to an expiration and
+ * matching flags.
+ */
+static callout_list_t *
+callout_wheel_get(callout_table_t *ct, hrtime_t expiration, int flags)
+{
+	callout_list_t *cl;
+	int slot;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	slot = CALLOUT_WHEEL_SLOT(expiration);
+	for (cl = ct->ct_wheel->cw_slot[slot].ch_head; cl != NULL;
+	    cl = cl->cl_next) {
+		if ((cl->cl_expiration == expiration) &&
+		    ((cl->cl_flags & CALLOUT_LIST_FLAG_ABSOLUTE) ==
+		    (flags & CALLOUT_LIST_FLAG_ABSOLUTE)))
+			return (cl);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Insert a callout list into a callout table's wheel and reprogram the wheel
+ * cyclic if needed.
+ */
+static void
+callout_wheel_insert(callout_table_t *ct, callout_list_t *cl)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	int slot;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	cl->cl_flags |= CALLOUT_LIST_FLAG_WHEELED;
+	slot = CALLOUT_WHEEL_SLOT(cl->cl_expiration);
+	CALLOUT_LIST_APPEND(cw->cw_slot[slot], cl);
+	BT_SET(cw->cw_map, slot);
+
+	/*
+	 * As with the heap, do not reprogram the cyclic during the CPR
+	 * suspend phase.
+	 */
+	if (cl->cl_expiration < cw->cw_next) {
+		cw->cw_next = cl->cl_expiration;
+		if (ct->ct_suspend == 0)
+			(void) cyclic_reprogram(cw->cw_cyclic, cw->cw_next);
+	}
+}
+
+/*
+ * Return the earliest expiration in a callout table's wheel. This is the
+ * earliest one in the first busy slot from the start of the turn.
+ */
+static hrtime_t
+callout_wheel_first(callout_wheel_t *cw)
+{
+	callout_list_t *cl;
+	hrtime_t expiration;
+	int slot, first;
+
+	slot = CALLOUT_WHEEL_SLOT(cw->cw_base);
+	first = bt_getlowbit(cw->cw_map, slot, CALLOUT_WHEEL_MASK);
+	if ((first == -1) && (slot > 0))
+		first = bt_getlowbit(cw->cw_map, 0, slot - 1);
+	if (first == -1)
+		return (CY_INFINITY);
+
+	expiration = CY_INFINITY;
+	for (cl = cw->cw_slot[first].ch_head; cl != NULL; cl = cl->cl_next) {
+		if (cl->cl_expiration < expiration)
+			expiration = cl->cl_expiration;
+	}
+
+	return (expiration);
+}
+
+/*
+ * Return when the wheel's cyclic should fire next. Callout lists that expire
+ * within callout_wheel_slack of the earliest one are made to wait for the
+ * last of them, and for the root of the heap if that is close too, so that
+ * they all get handled by a single firing instead of one each. This keeps
+ * idle CPUs from being woken up over and over for timers that are almost
+ * due at the same time.
+ */
+static hrtime_t
+callout_wheel_when(callout_table_t *ct)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	callout_list_t *cl;
+	hrtime_t when, limit;
+	int i, nslots, slot;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	if ((when = cw->cw_next) == CY_INFINITY)
+		return (CY_INFINITY);
+
+	limit = when + callout_wheel_slack;
+	nslots = (int)MIN(callout_wheel_slack / callout_wheel_res + 2,
+	    CALLOUT_WHEEL_SLOTS);
+	slot = CALLOUT_WHEEL_SLOT(when);
+	for (i = 0; i < nslots; i++, slot = (slot + 1) & CALLOUT_WHEEL_MASK) {
+		if (!BT_TEST(cw->cw_map, slot))
+			continue;
+		for (cl = cw->cw_slot[slot].ch_head; cl != NULL;
+		    cl = cl->cl_next) {
+			if ((cl->cl_expiration > when) &&
+			    (cl->cl_expiration <= limit))
+				when = cl->cl_expiration;
+		}
+	}
+
+	if ((ct->ct_heap_num > 0) && (ct->ct_heap->ch_expiration > when) &&
+	    (ct->ct_heap->ch_expiration <= limit))
+		when = ct->ct_heap->ch_expiration;
+
+	return (when);
+}
+
+/*
+ * Move all the expired callout lists in a callout table's wheel to the
+ * expired list and free the empty ones. Only the slots between the start of
+ * the turn and the current time need to be looked at. Return when the
+ * wheel's cyclic should fire next.
+ */
+static hrtime_t
+callout_wheel_sweep(callout_table_t *ct)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	callout_list_t *cl, *clnext;
+	hrtime_t now, nslots;
+	int i, slot;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	now = gethrtime();
+	if (cw->cw_next > now)
+		return (callout_wheel_when(ct));
+
+	nslots = (now - cw->cw_base) / callout_wheel_res + 1;
+	if (nslots > CALLOUT_WHEEL_SLOTS)
+		nslots = CALLOUT_WHEEL_SLOTS;
+
+	slot = CALLOUT_WHEEL_SLOT(cw->cw_base);
+	for (i = 0; i < nslots; i++, slot = (slot + 1) & CALLOUT_WHEEL_MASK) {
+		if (!BT_TEST(cw->cw_map, slot))
+			continue;
+
+		for (cl = cw->cw_slot[slot].ch_head; cl != NULL; cl = clnext) {
+			clnext = cl->cl_next;
+			if (cl->cl_expiration > now)
+				continue;
+
+			cl->cl_flags &= ~CALLOUT_LIST_FLAG_WHEELED;
+			CALLOUT_LIST_DELETE(cw->cw_slot[slot], cl);
+			if (cl->cl_callouts.ch_head == NULL) {
+				CALLOUT_LIST_FREE(ct, cl);
+			} else {
+				CALLOUT_LIST_APPEND(ct->ct_expired, cl);
+			}
+		}
+
+		if (cw->cw_slot[slot].ch_head == NULL)
+			BT_CLEAR(cw->cw_map, slot);
+	}
+
+	/*
+	 * Whatever is left expires after now, so a new turn can start here.
+	 */
+	cw->cw_base = (now / callout_wheel_res) * callout_wheel_res;
+	cw->cw_next = callout_wheel_first(cw);
+
+	return (callout_wheel_when(ct));
+}
+
+/*
+ * Delete and handle all past expirations in a callout table's wheel.
+ */
+static hrtime_t
+callout_wheel_delete(callout_table_t *ct)
+{
+	hrtime_t expiration;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	expiration = callout_wheel_sweep(ct);
+
+	/*
+	 * If the wheel is empty or callouts have been suspended, just
+	 * return. The cyclic has already been programmed to infinity by the
+	 * cyclic subsystem.
+	 */
+	if ((expiration == CY_INFINITY) || (ct->ct_suspend > 0))
+		return (CY_INFINITY);
+
+	(void) cyclic_reprogram(ct->ct_wheel->cw_cyclic, expiration);
+
+	return (expiration);
+}
+
+/*
+ * The wheel has no hrestime callouts, so there is nothing to do for a time
+ * change other than expiring what is due. Adjustments, however, can move
+ * callout lists out of the current turn of the wheel. As they are rare,
+ * everything is just moved to the callout queue for callout_queue_process()
+ * to adjust, so this must be called before that.
+ */
+static hrtime_t
+callout_wheel_process(callout_table_t *ct, hrtime_t delta)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	callout_list_t *cl;
+	hrtime_t expiration;
+	int slot;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	if (delta != 0) {
+		for (slot = 0; slot < CALLOUT_WHEEL_SLOTS; slot++) {
+			while ((cl = cw->cw_slot[slot].ch_head) != NULL) {
+				cl->cl_flags &= ~CALLOUT_LIST_FLAG_WHEELED;
+				CALLOUT_LIST_DELETE(cw->cw_slot[slot], cl);
+				if (cl->cl_callouts.ch_head == NULL) {
+					CALLOUT_LIST_FREE(ct, cl);
+					continue;
+				}
+				cl->cl_flags |= CALLOUT_LIST_FLAG_QUEUED;
+				(void) callout_queue_add(ct, cl);
+			}
+			BT_CLEAR(cw->cw_map, slot);
+		}
+		cw->cw_next = CY_INFINITY;
+	}
+
+	expiration = callout_wheel_sweep(ct);
+
+	if (ct->ct_expired.ch_head != NULL)
+		return (gethrtime());
+
+	return (expiration);
+}
+
 /*
  * Initialize a callout table's heap, if necessary. Preallocate some free
  * entries so we don't have to check for NULL elsewhere.
@@ -985,7 +1259,7 @@ timeout_generic(int type, void (*func)(void *), void *arg,
 	callout_id_t id;
 	callout_list_t *cl;
 	hrtime_t now, interval;
-	int hash, clflags;
+	int hash, clflags, wheel;
 
 	ASSERT(resolution > 0);
 	ASSERT(func != NULL);
@@ -1103,8 +1377,13 @@ timeout_generic(int type, void (*func)(void *), void *arg,
 again:
 	/*
 	 * Try to see if a callout list already exists for this expiration.
+	 * Short-term callout lists live in the wheel, the rest in the heap.
 	 */
-	cl = callout_list_get(ct, expiration, clflags, hash);
+	wheel = callout_wheel_fits(ct, expiration, clflags, now);
+	if (wheel)
+		cl = callout_wheel_get(ct, expiration, clflags);
+	else
+		cl = callout_list_get(ct, expiration, clflags, hash);
 	if (cl == NULL) {
 		/*
 		 * Check the free list. If we don't find one, we have to
@@ -1127,6 +1406,11 @@ again:
 		cl->cl_expiration = expiration;
 		cl->cl_flags = clflags;
 
+		if (wheel) {
+			callout_wheel_insert(ct, cl);
+			goto out;
+		}
+
 		/*
 		 * Check if we have enough space in the heap to insert one
 		 * expiration. If not, expand the heap.
@@ -1166,10 +1450,12 @@ again:
 	} else {
 		/*
 		 * If the callout list was empty, untimeout_generic() would
-		 * have incremented a reap count. Decrement the reap count
-		 * as we are going to insert a callout into this list.
+		 * have incremented a reap count if it is in the heap.
+		 * Decrement the reap count as we are going to insert a
+		 * callout into this list.
 		 */
-		if (cl->cl_callouts.ch_head == NULL)
+		if ((cl->cl_callouts.ch_head == NULL) &&
+		    (cl->cl_flags & CALLOUT_LIST_FLAG_HEAPED))
 			ct->ct_nreap--;
 	}
 out:
@@ -1178,6 +1464,12 @@ out:
 
 	ct->ct_timeouts++;
 	ct->ct_timeouts_pending++;
+	if (cl->cl_flags & CALLOUT_LIST_FLAG_WHEELED)
+		ct->ct_timeouts_wheel++;
+	else if (cl->cl_flags & CALLOUT_LIST_FLAG_HEAPED)
+		ct->ct_timeouts_heap++;
+	else
+		ct->ct_timeouts_queue++;
 
 	mutex_exit(&ct->ct_mutex);
 
@@ -1322,10 +1614,12 @@ untimeout_generic(callout_id_t id, int nowait)
 			ct->ct_timeouts_pending--;
 
 			/*
-			 * If the callout list has become empty, there are 3
+			 * If the callout list has become empty, there are 4
 			 * possibilities. If it is present:
 			 *	- in the heap, it needs to be cleaned along
 			 *	  with its heap entry. Increment a reap count.
+			 *	- in the wheel, leave it. It is freed when its
+			 *	  slot comes up, which is soon.
 			 *	- in the callout queue, free it.
 			 *	- in the expired list, free it.
 			 */
@@ -1333,6 +1627,8 @@ untimeout_generic(callout_id_t id, int nowait)
 				flags = cl->cl_flags;
 				if (flags & CALLOUT_LIST_FLAG_HEAPED) {
 					ct->ct_nreap++;
+				} else if (flags & CALLOUT_LIST_FLAG_WHEELED) {
+					/* EMPTY */;
 				} else if (flags & CALLOUT_LIST_FLAG_QUEUED) {
 					CALLOUT_LIST_DELETE(ct->ct_queue, cl);
 					CALLOUT_LIST_FREE(ct, cl);
@@ -1572,6 +1868,15 @@ callout_queue_realtime(callout_table_t *ct)
 	mutex_exit(&ct->ct_mutex);
 }
 
+void
+callout_wheel_realtime(callout_table_t *ct)
+{
+	mutex_enter(&ct->ct_mutex);
+	(void) callout_wheel_delete(ct);
+	callout_expire(ct);
+	mutex_exit(&ct->ct_mutex);
+}
+
 void
 callout_execute(callout_table_t *ct)
 {
@@ -1619,6 +1924,24 @@ callout_queue_normal(callout_table_t *ct)
 	}
 }
 
+void
+callout_wheel_normal(callout_table_t *ct)
+{
+	int i, exec;
+	hrtime_t exp;
+
+	mutex_enter(&ct->ct_mutex);
+	exp = callout_wheel_delete(ct);
+	CALLOUT_EXEC_COMPUTE(ct, exp, exec);
+	mutex_exit(&ct->ct_mutex);
+
+	for (i = 0; i < exec; i++) {
+		ASSERT(ct->ct_taskq != NULL);
+		(void) taskq_dispatch(ct->ct_taskq,
+		    (task_func_t *)callout_execute, ct, TQ_NOSLEEP);
+	}
+}
+
 /*
  * Suspend callout processing.
  */
@@ -1651,6 +1974,8 @@ callout_suspend(void)
 				    CY_INFINITY);
 				(void) cyclic_reprogram(ct->ct_qcyclic,
 				    CY_INFINITY);
+				(void) cyclic_reprogram(
+				    ct->ct_wheel->cw_cyclic, CY_INFINITY);
 			}
 			mutex_exit(&ct->ct_mutex);
 		}
@@ -1663,7 +1988,7 @@ callout_suspend(void)
 static void
 callout_resume(hrtime_t delta, int timechange)
 {
-	hrtime_t hexp, qexp;
+	hrtime_t hexp, qexp, wexp;
 	int t, f;
 	callout_table_t *ct;
 
@@ -1691,12 +2016,15 @@ callout_resume(hrtime_t delta, int timechange)
 			 * be there.
 			 */
 			hexp = callout_heap_process(ct, delta, timechange);
+			wexp = callout_wheel_process(ct, delta);
 			qexp = callout_queue_process(ct, delta, timechange);
 
 			ct->ct_suspend--;
 			if (ct->ct_suspend == 0) {
 				(void) cyclic_reprogram(ct->ct_cyclic, hexp);
 				(void) cyclic_reprogram(ct->ct_qcyclic, qexp);
+				(void) cyclic_reprogram(ct->ct_wheel->cw_cyclic,
+				    wexp);
 			}
 
 			mutex_exit(&ct->ct_mutex);
@@ -1822,6 +2150,20 @@ callout_hash_init(callout_table_t *ct)
 	ct->ct_clhash = kmem_zalloc(size, KM_SLEEP);
 }
 
+/*
+ * Create the wheel for this callout table.
+ */
+static void
+callout_wheel_init(callout_table_t *ct)
+{
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+	ASSERT(ct->ct_wheel == NULL);
+
+	ct->ct_wheel = kmem_zalloc(sizeof (callout_wheel_t), KM_SLEEP);
+	ct->ct_wheel->cw_next = CY_INFINITY;
+	ct->ct_wheel->cw_cyclic = CYCLIC_NONE;
+}
+
 /*
  * Create per-callout table kstats.
  */
@@ -1859,7 +2201,7 @@ callout_cyclic_init(callout_table_t *ct)
 	cyc_time_t when;
 	processorid_t seqid;
 	int t;
-	cyclic_id_t cyclic, qcyclic;
+	cyclic_id_t cyclic, qcyclic, wcyclic;
 
 	ASSERT(MUTEX_HELD(&ct->ct_mutex));
 
@@ -1940,9 +2282,17 @@ callout_cyclic_init(callout_table_t *ct)
 
 	qcyclic = cyclic_add(&hdlr, &when);
 
+	if (t == CALLOUT_REALTIME)
+		hdlr.cyh_func = (cyc_func_t)callout_wheel_realtime;
+	else
+		hdlr.cyh_func = (cyc_func_t)callout_wheel_normal;
+
+	wcyclic = cyclic_add(&hdlr, &when);
+
 	mutex_enter(&ct->ct_mutex);
 	ct->ct_cyclic = cyclic;
 	ct->ct_qcyclic = qcyclic;
+	ct->ct_wheel->cw_cyclic = wcyclic;
 }
 
 void
@@ -2007,6 +2357,7 @@ callout_cpu_online(cpu_t *cp)
 		if (ct->ct_heap == NULL) {
 			callout_heap_init(ct);
 			callout_hash_init(ct);
+			callout_wheel_init(ct);
 			callout_kstat_init(ct);
 			callout_cyclic_init(ct);
 		}
@@ -2018,6 +2369,7 @@ callout_cpu_online(cpu_t *cp)
 		 */
 		cyclic_bind(ct->ct_cyclic, cp, NULL);
 		cyclic_bind(ct->ct_qcyclic, cp, NULL);
+		cyclic_bind(ct->ct_wheel->cw_cyclic, cp, NULL);
 	}
 }
 
@@ -2041,6 +2393,7 @@ callout_cpu_offline(cpu_t *cp)
 		 */
 		cyclic_bind(ct->ct_cyclic, NULL, NULL);
 		cyclic_bind(ct->ct_qcyclic, NULL, NULL);
+		cyclic_bind(ct->ct_wheel->cw_cyclic, NULL, NULL);
 	}
 }
 
@@ -2108,6 +2461,8 @@ callout_init(void)
 
 	if (callout_tolerance <= 0)
 		callout_tolerance = CALLOUT_TOLERANCE;
+	if (callout_wheel_res <= 0)
+		callout_wheel_res = CALLOUT_WHEEL_RES;
 	if (callout_threads <= 0)
 		callout_threads = CALLOUT_THREADS;
 	if (callout_chunk <= 0)
@@ -50,7 +50,11 @@
  *			calls are scheduled to multiple CPUs to perform
  *			multi-threaded tick accounting. The CPUs are chosen
  *			on a rotational basis so as to distribute the tick
- *			accounting load evenly across all CPUs.
+ *			accounting load evenly across all CPUs. Sets in
+ *			which every CPU is idle have nothing to be charged
+ *			and are skipped, and the cross call is aimed at a
+ *			busy CPU where there is one, so that idle CPUs are
+ *			left asleep instead of being woken up every tick.
  *
  * Tick execution	Done in clock_tick_execute(). In this phase, tick
  *			accounting is actually performed by softint handlers
@@ -261,6 +265,25 @@ clock_tick_init_post(void)
 	}
 }
 
+/*
+ * Return non-zero if some CPU in the set, other than the clock CPU, is
+ * running something other than its idle thread.
+ */
+static int
+clock_tick_set_busy(clock_tick_set_t *csp)
+{
+	cpu_t	*cp;
+	int	i;
+
+	for (i = csp->ct_start; i < csp->ct_end; i++) {
+		cp = clock_tick_cpus[i];
+		if ((cp != NULL) && (cp != CPU) && !CLOCK_TICK_CPU_IDLE(cp))
+			return (1);
+	}
+
+	return (0);
+}
+
 static void
 clock_tick_schedule_one(clock_tick_set_t *csp, int pending, processorid_t cid)
 {
@@ -425,9 +448,9 @@ void
 clock_tick_schedule(int one_sec)
 {
 	ulong_t			active;
-	int			i, end;
+	int			i, j, end;
 	clock_tick_set_t	*csp;
-	cpu_t			*cp;
+	cpu_t			*cp, *tp;
 
 	if (clock_cpu_id != CPU->cpu_id)
 		clock_cpu_id = CPU->cpu_id;
@@ -504,7 +527,30 @@ clock_tick_schedule(int one_sec)
 		if (csp->ct_scan >= csp->ct_end)
 			csp->ct_scan = csp->ct_start;
 
-		clock_tick_schedule_one(csp, clock_tick_pending, cp->cpu_id);
+		/*
+		 * Idle CPUs are not charged ticks, so a set made up of
+		 * them only can be skipped.
+		 */
+		if (!clock_tick_set_busy(csp)) {
+			cp = cp->cpu_next_onln;
+			continue;
+		}
+
+		/*
+		 * Rather than wake up an idle CPU to do the accounting,
+		 * hand it to the next CPU that is already running
+		 * something.
+		 */
+		tp = cp;
+		for (j = 0; j < clock_tick_total_cpus; j++) {
+			if ((tp != CPU) && !CLOCK_TICK_CPU_IDLE(tp))
+				break;
+			tp = tp->cpu_next_onln;
+		}
+		if (j == clock_tick_total_cpus)
+			tp = cp;
+
+		clock_tick_schedule_one(csp, clock_tick_pending, tp->cpu_id);
 
 		cp = cp->cpu_next_onln;
 	}
@@ -891,7 +891,7 @@ contract_vnode_clear(contract_t *ct, contract_vnode_t *ctv)
 		list_remove(&ct->ct_vnodes, ctv);
 		result = 1;
 	} else {
-		vp->v_count--;
+		VN_RELE_LOCKED(vp);
 		result = 0;
 	}
 	mutex_exit(&vp->v_lock);
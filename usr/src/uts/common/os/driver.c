@@ -363,7 +363,7 @@ dev_lclose(dev_t dev, int flag, int otype, struct cred *cred)
 	mutex_enter(&cvp->v_lock);
 	switch (cvp->v_count) {
 	default:
-		cvp->v_count--;
+		VN_RELE_LOCKED(cvp);
 		break;
 
 	case 0:
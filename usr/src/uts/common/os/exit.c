@@ -72,6 +72,7 @@
 #include <sys/corectl.h>
 #include <sys/brand.h>
 #include <sys/libc_kernel.h>
+#include <sys/vm_usage.h>
 
 /*
  * convert code/data pair into old style wait status
@@ -567,6 +568,9 @@ proc_exit(int why, int what)
 	 * Free address space.
 	 */
 	relvm();
+	mutex_enter(&p->p_lock);
+	vm_rss_uncharge(p);
+	mutex_exit(&p->p_lock);
 
 	if (exec_vp) {
 		/*
@@ -825,6 +825,7 @@
 #include <sys/id32.h>
 #include <sys/zone.h>
 #include <sys/netstack.h>
+#include <sys/lgrp.h>
 #ifdef	DEBUG
 #include <sys/random.h>
 #endif
@@ -861,6 +862,12 @@ struct kmem_cache_kstat {
 	kstat_named_t	kmc_full_magazines;
 	kstat_named_t	kmc_empty_magazines;
 	kstat_named_t	kmc_magazine_size;
+	kstat_named_t	kmc_lgrp_depot_remote; /* full mags from other lgrps */
+	kstat_named_t	kmc_slab_remote_free; /* slab frees from other lgrps */
+	kstat_named_t	kmc_magazine_grow;
+	kstat_named_t	kmc_magazine_shrink;
+	kstat_named_t	kmc_depot_reaped; /* magazines reaped from depot */
+	kstat_named_t	kmc_reap_soon; /* kmem_cache_reap_soon() reaps */
 	kstat_named_t	kmc_reap; /* number of kmem_cache_reap() calls */
 	kstat_named_t	kmc_defrag; /* attempts to defrag all partial slabs */
 	kstat_named_t	kmc_scan; /* attempts to defrag one partial slab */
@@ -900,6 +907,12 @@ struct kmem_cache_kstat {
 	{ "full_magazines",	KSTAT_DATA_UINT64 },
 	{ "empty_magazines",	KSTAT_DATA_UINT64 },
 	{ "magazine_size",	KSTAT_DATA_UINT64 },
+	{ "lgrp_depot_remote",	KSTAT_DATA_UINT64 },
+	{ "slab_remote_free",	KSTAT_DATA_UINT64 },
+	{ "magazine_grow",	KSTAT_DATA_UINT64 },
+	{ "magazine_shrink",	KSTAT_DATA_UINT64 },
+	{ "depot_reaped",	KSTAT_DATA_UINT64 },
+	{ "reap_soon",		KSTAT_DATA_UINT64 },
 	{ "reap",		KSTAT_DATA_UINT64 },
 	{ "defrag",		KSTAT_DATA_UINT64 },
 	{ "scan",		KSTAT_DATA_UINT64 },
@@ -988,6 +1001,8 @@ static uint32_t kmem_reaping_idspace;
  */
 clock_t kmem_reap_interval;	/* cache reaping rate [15 * HZ ticks] */
 int kmem_depot_contention = 3;	/* max failed tryenters per real interval */
+int kmem_depot_quiet = 8;	/* quiet intervals before magazine shrink */
+int kmem_lgrp_depots = 1;	/* per-lgroup full magazine depots */
 pgcnt_t kmem_reapahead = 0;	/* start reaping N pages before pageout */
 int kmem_panic = 1;		/* whether to panic on error */
 int kmem_logging = 1;		/* kmem_log_enter() override */
@@ -1063,6 +1078,12 @@ size_t kmem_frag_denom = KMEM_VOID_FRACTION; /* buffers (denominator) */
  * maintenance interval while the system is not low on memory.
  */
 size_t kmem_reclaim_max_slabs = 1;
+/*
+ * The same, once free memory has fallen below lotsfree.  Emptying slabs
+ * faster then lets metadata caches left fragmented by a large walk give
+ * their memory back while it is wanted.
+ */
+size_t kmem_reclaim_lowmem_max_slabs = 8;
 /*
  * Number of slabs to scan backwards from the end of the partial slab list
  * when searching for buffers to relocate.
@@ -1518,6 +1539,44 @@ kmem_log_event(kmem_log_header_t *lp, kmem_cache_t *cp,
 	KMEM_AUDIT(lp, cp, &bca);
 }
 
+/*
+ * Return the lgroup of the calling CPU, or LGRP_NONE if it isn't in one yet.
+ * Like KMEM_CPU_CACHE(), a stale answer after a context switch costs some
+ * locality but is otherwise harmless.
+ */
+static lgrp_id_t
+kmem_cpu_lgrp(void)
+{
+	lpl_t *lpl = CPU->cpu_lpl;
+
+	if (lpl == NULL || lpl->lpl_lgrpid < 0 ||
+	    lpl->lpl_lgrpid >= NLGRPS_MAX)
+		return (LGRP_NONE);
+	return (lpl->lpl_lgrpid);
+}
+
+/*
+ * Return the lgroup of the memory backing a new slab.  Only the first page
+ * is looked at; slab memory is allocated from the lgroup of the allocating
+ * CPU (see lgrp_kmem_default_policy), so a slab rarely spans lgroups.
+ */
+static uint8_t
+kmem_slab_lgrp(kmem_cache_t *cp, void *slab)
+{
+	pfn_t pfn;
+	lgrp_t *lgrp;
+
+	if (cp->cache_lgrp_depot == NULL ||
+	    (cp->cache_cflags & (KMC_IDENTIFIER | KMC_NOTOUCH)))
+		return (KMEM_SLAB_NOLGRP);
+
+	if ((pfn = hat_getpfnum(kas.a_hat, slab)) == PFN_INVALID ||
+	    (lgrp = lgrp_pfn_to_lgrp(pfn)) == NULL)
+		return (KMEM_SLAB_NOLGRP);
+
+	return ((uint8_t)lgrp->lgrp_id);
+}
+
 /*
  * Create a new slab for cache cp.
  */
@@ -1574,6 +1633,7 @@ kmem_slab_create(kmem_cache_t *cp, int kmflag)
 	sp->slab_stuck_offset = (uint32_t)-1;
 	sp->slab_later_count = 0;
 	sp->slab_flags = 0;
+	sp->slab_lgrpid = kmem_slab_lgrp(cp, slab);
 
 	ASSERT(chunks > 0);
 	while (chunks-- != 0) {
@@ -1835,6 +1895,10 @@ kmem_slab_free(kmem_cache_t *cp, void *buf)
 		return;
 	}
 
+	if (sp->slab_lgrpid != KMEM_SLAB_NOLGRP &&
+	    sp->slab_lgrpid != kmem_cpu_lgrp())
+		cp->cache_slab_remote_free++;
+
 	if (KMEM_SLAB_OFFSET(sp, buf) == sp->slab_stuck_offset) {
 		/*
 		 * If this is the buffer that prevented the consolidator from
@@ -2154,18 +2218,153 @@ kmem_depot_free(kmem_cache_t *cp, kmem_maglist_t *mlp, kmem_magazine_t *mp)
 	mutex_exit(&cp->cache_depot_lock);
 }
 
+/*
+ * Return the full magazine depot of the calling CPU's lgroup, or NULL if
+ * cp doesn't have per-lgroup depots.
+ */
+static kmem_lgrp_depot_t *
+kmem_lgrp_depot(kmem_cache_t *cp)
+{
+	lgrp_id_t lgrpid;
+
+	if (cp->cache_lgrp_depot == NULL ||
+	    (lgrpid = kmem_cpu_lgrp()) == LGRP_NONE ||
+	    lgrpid >= cp->cache_lgrp_ndepot)
+		return (NULL);
+	return (&cp->cache_lgrp_depot[lgrpid]);
+}
+
+/*
+ * Allocate a full magazine from an lgroup depot.
+ */
+static kmem_magazine_t *
+kmem_lgrp_depot_alloc(kmem_cache_t *cp, kmem_lgrp_depot_t *kldp,
+    boolean_t remote)
+{
+	kmem_maglist_t *mlp = &kldp->kld_full;
+	kmem_magazine_t *mp;
+
+	mutex_enter(&kldp->kld_lock);
+	if ((mp = mlp->ml_list) != NULL) {
+		ASSERT(KMEM_MAGAZINE_VALID(cp, mp));
+		mlp->ml_list = mp->mag_next;
+		if (--mlp->ml_total < mlp->ml_min)
+			mlp->ml_min = mlp->ml_total;
+		mlp->ml_alloc++;
+		if (remote)
+			kldp->kld_remote++;
+	}
+	mutex_exit(&kldp->kld_lock);
+
+	return (mp);
+}
+
+/*
+ * Allocate a full magazine: from the calling CPU's lgroup depot if we can,
+ * else from the cache-wide depot, else, rather than go to the slab layer
+ * while full magazines sit idle elsewhere, from another lgroup's depot.
+ */
+static kmem_magazine_t *
+kmem_depot_alloc_full(kmem_cache_t *cp)
+{
+	kmem_lgrp_depot_t *local, *kldp;
+	kmem_magazine_t *mp;
+	int i;
+
+	local = kmem_lgrp_depot(cp);
+	if (local != NULL &&
+	    (mp = kmem_lgrp_depot_alloc(cp, local, B_FALSE)) != NULL)
+		return (mp);
+
+	if ((mp = kmem_depot_alloc(cp, &cp->cache_full)) != NULL)
+		return (mp);
+
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		kldp = &cp->cache_lgrp_depot[i];
+		if (kldp == local || kldp->kld_full.ml_total == 0)
+			continue;
+		if ((mp = kmem_lgrp_depot_alloc(cp, kldp, B_TRUE)) != NULL)
+			return (mp);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Free a full magazine to the calling CPU's lgroup depot, or to the
+ * cache-wide depot if cp doesn't have per-lgroup depots.
+ */
+static void
+kmem_depot_free_full(kmem_cache_t *cp, kmem_magazine_t *mp)
+{
+	kmem_lgrp_depot_t *kldp;
+	kmem_maglist_t *mlp;
+
+	if ((kldp = kmem_lgrp_depot(cp)) == NULL) {
+		kmem_depot_free(cp, &cp->cache_full, mp);
+		return;
+	}
+
+	mlp = &kldp->kld_full;
+	mutex_enter(&kldp->kld_lock);
+	ASSERT(KMEM_MAGAZINE_VALID(cp, mp));
+	mp->mag_next = mlp->ml_list;
+	mlp->ml_list = mp;
+	mlp->ml_total++;
+	mutex_exit(&kldp->kld_lock);
+}
+
 /*
  * Update the working set statistics for cp's depot.
  */
 static void
 kmem_depot_ws_update(kmem_cache_t *cp)
 {
+	int i;
+
 	mutex_enter(&cp->cache_depot_lock);
 	cp->cache_full.ml_reaplimit = cp->cache_full.ml_min;
 	cp->cache_full.ml_min = cp->cache_full.ml_total;
 	cp->cache_empty.ml_reaplimit = cp->cache_empty.ml_min;
 	cp->cache_empty.ml_min = cp->cache_empty.ml_total;
 	mutex_exit(&cp->cache_depot_lock);
+
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		kmem_lgrp_depot_t *kldp = &cp->cache_lgrp_depot[i];
+
+		mutex_enter(&kldp->kld_lock);
+		kldp->kld_full.ml_reaplimit = kldp->kld_full.ml_min;
+		kldp->kld_full.ml_min = kldp->kld_full.ml_total;
+		mutex_exit(&kldp->kld_lock);
+	}
+}
+
+/*
+ * Return the number of full magazines outside the depot's working set.
+ */
+static long
+kmem_depot_full_reapable(kmem_cache_t *cp)
+{
+	long reap;
+	int i;
+
+	mutex_enter(&cp->cache_depot_lock);
+	reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
+	reap = MIN(reap, cp->cache_full.ml_total);
+	mutex_exit(&cp->cache_depot_lock);
+
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		kmem_lgrp_depot_t *kldp = &cp->cache_lgrp_depot[i];
+		long lreap;
+
+		mutex_enter(&kldp->kld_lock);
+		lreap = MIN(kldp->kld_full.ml_reaplimit,
+		    kldp->kld_full.ml_min);
+		reap += MIN(lreap, kldp->kld_full.ml_total);
+		mutex_exit(&kldp->kld_lock);
+	}
+
+	return (reap);
 }
 
 /*
@@ -2176,13 +2375,28 @@ kmem_depot_ws_reap(kmem_cache_t *cp)
 {
 	long reap;
 	kmem_magazine_t *mp;
+	int i;
 
 	ASSERT(!list_link_active(&cp->cache_link) ||
 	    taskq_member(kmem_taskq, curthread));
 
 	reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
-	while (reap-- && (mp = kmem_depot_alloc(cp, &cp->cache_full)) != NULL)
+	while (reap-- && (mp = kmem_depot_alloc(cp, &cp->cache_full)) != NULL) {
 		kmem_magazine_destroy(cp, mp, cp->cache_magtype->mt_magsize);
+		cp->cache_depot_reaped++;
+	}
+
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		kmem_lgrp_depot_t *kldp = &cp->cache_lgrp_depot[i];
+
+		reap = MIN(kldp->kld_full.ml_reaplimit, kldp->kld_full.ml_min);
+		while (reap-- &&
+		    (mp = kmem_lgrp_depot_alloc(cp, kldp, B_FALSE)) != NULL) {
+			kmem_magazine_destroy(cp, mp,
+			    cp->cache_magtype->mt_magsize);
+			cp->cache_depot_reaped++;
+		}
+	}
 
 	reap = MIN(cp->cache_empty.ml_reaplimit, cp->cache_empty.ml_min);
 	while (reap-- && (mp = kmem_depot_alloc(cp, &cp->cache_empty)) != NULL)
@@ -2555,7 +2769,7 @@ kmem_cache_alloc(kmem_cache_t *cp, int kmflag)
 		/*
 		 * Try to get a full magazine from the depot.
 		 */
-		fmp = kmem_depot_alloc(cp, &cp->cache_full);
+		fmp = kmem_depot_alloc_full(cp);
 		if (fmp != NULL) {
 			if (ccp->cc_ploaded != NULL)
 				kmem_depot_free(cp, &cp->cache_empty,
@@ -2665,8 +2879,7 @@ kmem_cpucache_magazine_alloc(kmem_cpu_cache_t *ccp, kmem_cache_t *cp)
 	emp = kmem_depot_alloc(cp, &cp->cache_empty);
 	if (emp != NULL) {
 		if (ccp->cc_ploaded != NULL)
-			kmem_depot_free(cp, &cp->cache_full,
-			    ccp->cc_ploaded);
+			kmem_depot_free_full(cp, ccp->cc_ploaded);
 		kmem_cpu_reload(ccp, emp, 0);
 		return (1);
 	}
@@ -3090,13 +3303,19 @@ kmem_cache_reap(kmem_cache_t *cp)
 	 * callback is just an advisory plea for help.
 	 */
 	if (cp->cache_reclaim != NULL) {
+		kmem_lgrp_depot_t *kldp;
 		long delta;
+		int i;
 
 		/*
 		 * Reclaimed memory should be reapable (not included in the
 		 * depot's working set).
 		 */
 		delta = cp->cache_full.ml_total;
+		for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+			kldp = &cp->cache_lgrp_depot[i];
+			kldp->kld_reclaim = kldp->kld_full.ml_total;
+		}
 		cp->cache_reclaim(cp->cache_private);
 		delta = cp->cache_full.ml_total - delta;
 		if (delta > 0) {
@@ -3105,6 +3324,16 @@ kmem_cache_reap(kmem_cache_t *cp)
 			cp->cache_full.ml_min += delta;
 			mutex_exit(&cp->cache_depot_lock);
 		}
+		for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+			kldp = &cp->cache_lgrp_depot[i];
+			delta = kldp->kld_full.ml_total - kldp->kld_reclaim;
+			if (delta > 0) {
+				mutex_enter(&kldp->kld_lock);
+				kldp->kld_full.ml_reaplimit += delta;
+				kldp->kld_full.ml_min += delta;
+				mutex_exit(&kldp->kld_lock);
+			}
+		}
 	}
 
 	kmem_depot_ws_reap(cp);
@@ -3201,6 +3430,29 @@ kmem_reap_idspace(void)
 	kmem_reap_common(&kmem_reaping_idspace);
 }
 
+static void
+kmem_cache_reap_fast(kmem_cache_t *cp)
+{
+	if (cp->cache_cflags & KMC_FASTREAP)
+		kmem_cache_reap_soon(cp);
+}
+
+/*
+ * Empty the depots of the KMC_FASTREAP caches, the ones known to hold a
+ * lot of idle magazine memory after a burst.  Unlike kmem_reap(), this
+ * is not bound by kmem_reap_interval; each cache has at most one reap
+ * outstanding, which is all the throttling it needs.  Called from the
+ * pageout scanner when memory is short.
+ */
+void
+kmem_reap_fast(void)
+{
+	if (MUTEX_HELD(&kmem_cache_lock) || kmem_taskq == NULL)
+		return;
+
+	kmem_cache_applyall(kmem_cache_reap_fast, NULL, 0);
+}
+
 /*
  * Purge all magazines from a cache and set its magazine limit to zero.
  * All calls are serialized by the kmem_taskq lock, except for the final
@@ -3286,6 +3538,39 @@ kmem_cache_reap_now(kmem_cache_t *cp)
 	taskq_wait(kmem_taskq);
 }
 
+static void
+kmem_cache_reap_soon_task(kmem_cache_t *cp)
+{
+	ASSERT(cp->cache_reap_pending != 0);
+
+	kmem_depot_ws_reap(cp);
+	cp->cache_reap_soon++;
+	membar_producer();
+	cp->cache_reap_pending = 0;
+}
+
+/*
+ * Like kmem_cache_reap_now(), but don't wait for the reap to happen, and
+ * don't queue another one if the last hasn't run yet.  This is safe to
+ * call from the reclaim paths, which must not block behind kmem_taskq.
+ */
+void
+kmem_cache_reap_soon(kmem_cache_t *cp)
+{
+	ASSERT(list_link_active(&cp->cache_link));
+
+	if (kmem_taskq == NULL || cas32(&cp->cache_reap_pending, 0, 1) != 0)
+		return;
+
+	kmem_depot_ws_update(cp);
+	kmem_depot_ws_update(cp);
+
+	/* see kmem_reap_common() for TQ_NOALLOC */
+	if (!taskq_dispatch(kmem_taskq,
+	    (task_func_t *)kmem_cache_reap_soon_task, cp, TQ_NOALLOC))
+		cp->cache_reap_pending = 0;
+}
+
 /*
  * Recompute a cache's magazine size.  The trade-off is that larger magazines
  * provide a higher transfer rate with the depot, while smaller magazines
@@ -3293,25 +3578,52 @@ kmem_cache_reap_now(kmem_cache_t *cp)
  * it should not be done frequently.
  *
  * Changes to the magazine size are serialized by the kmem_taskq lock.
- *
- * Note: at present this only grows the magazine size.  It might be useful
- * to allow shrinkage too.
  */
 static void
-kmem_cache_magazine_resize(kmem_cache_t *cp)
+kmem_cache_magazine_set(kmem_cache_t *cp, kmem_magtype_t *mtp)
+{
+	ASSERT(taskq_member(kmem_taskq, curthread));
+
+	kmem_cache_magazine_purge(cp);
+	mutex_enter(&cp->cache_depot_lock);
+	cp->cache_magtype = mtp;
+	cp->cache_depot_contention_prev =
+	    cp->cache_depot_contention + INT_MAX;
+	cp->cache_depot_quiet = 0;
+	mutex_exit(&cp->cache_depot_lock);
+	kmem_cache_magazine_enable(cp);
+}
+
+/*
+ * A cache may go back to the next smaller magazine type as long as that
+ * one would have been acceptable when the cache was created.
+ */
+static int
+kmem_cache_magazine_shrinkable(kmem_cache_t *cp)
 {
 	kmem_magtype_t *mtp = cp->cache_magtype;
 
-	ASSERT(taskq_member(kmem_taskq, curthread));
+	return (!(cp->cache_flags & KMF_NOMAGAZINE) && mtp > kmem_magtype &&
+	    cp->cache_chunksize > mtp[-1].mt_minbuf);
+}
+
+static void
+kmem_cache_magazine_resize(kmem_cache_t *cp)
+{
+	kmem_magtype_t *mtp = cp->cache_magtype;
 
 	if (cp->cache_chunksize < mtp->mt_maxbuf) {
-		kmem_cache_magazine_purge(cp);
-		mutex_enter(&cp->cache_depot_lock);
-		cp->cache_magtype = ++mtp;
-		cp->cache_depot_contention_prev =
-		    cp->cache_depot_contention + INT_MAX;
-		mutex_exit(&cp->cache_depot_lock);
-		kmem_cache_magazine_enable(cp);
+		kmem_cache_magazine_set(cp, mtp + 1);
+		cp->cache_magazine_grow++;
+	}
+}
+
+static void
+kmem_cache_magazine_shrink(kmem_cache_t *cp)
+{
+	if (kmem_cache_magazine_shrinkable(cp)) {
+		kmem_cache_magazine_set(cp, cp->cache_magtype - 1);
+		cp->cache_magazine_shrink++;
 	}
 }
 
@@ -3375,6 +3687,9 @@ kmem_cache_update(kmem_cache_t *cp)
 {
 	int need_hash_rescale = 0;
 	int need_magazine_resize = 0;
+	int need_magazine_shrink = 0;
+	long idle;
+	int contention;
 
 	ASSERT(MUTEX_HELD(&kmem_cache_lock));
 
@@ -3396,17 +3711,30 @@ kmem_cache_update(kmem_cache_t *cp)
 	 * Update the depot working set statistics.
 	 */
 	kmem_depot_ws_update(cp);
+	idle = kmem_depot_full_reapable(cp);
 
 	/*
-	 * If there's a lot of contention in the depot,
-	 * increase the magazine size.
+	 * If there's a lot of contention in the depot, increase the
+	 * magazine size.  If there has been none for kmem_depot_quiet
+	 * intervals and full magazines are sitting idle outside the
+	 * working set, the magazines are bigger than the cache needs;
+	 * step back down so that bursty caches don't keep holding it all.
 	 */
 	mutex_enter(&cp->cache_depot_lock);
 
+	contention = (int)(cp->cache_depot_contention -
+	    cp->cache_depot_contention_prev);
+	if (contention > 0)
+		cp->cache_depot_quiet = 0;
+	else
+		cp->cache_depot_quiet++;
+
 	if (cp->cache_chunksize < cp->cache_magtype->mt_maxbuf &&
-	    (int)(cp->cache_depot_contention -
-	    cp->cache_depot_contention_prev) > kmem_depot_contention)
+	    contention > kmem_depot_contention)
 		need_magazine_resize = 1;
+	else if (cp->cache_depot_quiet >= kmem_depot_quiet && idle > 0 &&
+	    kmem_cache_magazine_shrinkable(cp))
+		need_magazine_shrink = 1;
 
 	cp->cache_depot_contention_prev = cp->cache_depot_contention;
 
@@ -3419,6 +3747,9 @@ kmem_cache_update(kmem_cache_t *cp)
 	if (need_magazine_resize)
 		(void) taskq_dispatch(kmem_taskq,
 		    (task_func_t *)kmem_cache_magazine_resize, cp, TQ_NOSLEEP);
+	else if (need_magazine_shrink)
+		(void) taskq_dispatch(kmem_taskq,
+		    (task_func_t *)kmem_cache_magazine_shrink, cp, TQ_NOSLEEP);
 
 	if (cp->cache_defrag != NULL)
 		(void) taskq_dispatch(kmem_taskq,
@@ -3456,6 +3787,7 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 	uint64_t buf_avail = 0;
 	int cpu_seqid;
 	long reap;
+	int i;
 
 	ASSERT(MUTEX_HELD(&kmem_cache_kstat_lock));
 
@@ -3469,6 +3801,11 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 	kmcp->kmc_free.value.ui64		= cp->cache_slab_free;
 	kmcp->kmc_slab_alloc.value.ui64		= cp->cache_slab_alloc;
 	kmcp->kmc_slab_free.value.ui64		= cp->cache_slab_free;
+	kmcp->kmc_slab_remote_free.value.ui64	= cp->cache_slab_remote_free;
+	kmcp->kmc_magazine_grow.value.ui64	= cp->cache_magazine_grow;
+	kmcp->kmc_magazine_shrink.value.ui64	= cp->cache_magazine_shrink;
+	kmcp->kmc_depot_reaped.value.ui64	= cp->cache_depot_reaped;
+	kmcp->kmc_reap_soon.value.ui64		= cp->cache_reap_soon;
 
 	for (cpu_seqid = 0; cpu_seqid < max_ncpus; cpu_seqid++) {
 		kmem_cpu_cache_t *ccp = &cp->cache_cpu[cpu_seqid];
@@ -3503,11 +3840,24 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 	kmcp->kmc_free.value.ui64		+= cp->cache_empty.ml_alloc;
 	buf_avail += cp->cache_full.ml_total * cp->cache_magtype->mt_magsize;
 
-	reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
-	reap = MIN(reap, cp->cache_full.ml_total);
-
 	mutex_exit(&cp->cache_depot_lock);
 
+	kmcp->kmc_lgrp_depot_remote.value.ui64 = 0;
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		kmem_lgrp_depot_t *kldp = &cp->cache_lgrp_depot[i];
+
+		mutex_enter(&kldp->kld_lock);
+		kmcp->kmc_depot_alloc.value.ui64 += kldp->kld_full.ml_alloc;
+		kmcp->kmc_full_magazines.value.ui64 += kldp->kld_full.ml_total;
+		kmcp->kmc_lgrp_depot_remote.value.ui64 += kldp->kld_remote;
+		kmcp->kmc_alloc.value.ui64 += kldp->kld_full.ml_alloc;
+		buf_avail += kldp->kld_full.ml_total *
+		    cp->cache_magtype->mt_magsize;
+		mutex_exit(&kldp->kld_lock);
+	}
+
+	reap = kmem_depot_full_reapable(cp);
+
 	kmcp->kmc_buf_size.value.ui64	= cp->cache_bufsize;
 	kmcp->kmc_align.value.ui64	= cp->cache_align;
 	kmcp->kmc_chunk_size.value.ui64	= cp->cache_chunksize;
@@ -3716,11 +4066,12 @@ kmem_cache_create(
 	vmem_t *vmp,		/* vmem source for slab allocation */
 	int cflags)		/* cache creation flags */
 {
-	int cpu_seqid;
+	int cpu_seqid, i;
 	size_t chunksize;
 	kmem_cache_t *cp;
 	kmem_magtype_t *mtp;
-	size_t csize = KMEM_CACHE_SIZE(max_ncpus);
+	int nlgrpdepot = (kmem_lgrp_depots && nlgrpsmax > 1) ? nlgrpsmax : 0;
+	size_t csize = KMEM_CACHE_LGRP_SIZE(max_ncpus, nlgrpdepot);
 
 #ifdef	DEBUG
 	/*
@@ -3748,12 +4099,18 @@ kmem_cache_create(
 	/*
 	 * Get a kmem_cache structure.  We arrange that cp->cache_cpu[]
 	 * is aligned on a KMEM_CPU_CACHE_SIZE boundary to prevent
-	 * false sharing of per-CPU data.
+	 * false sharing of per-CPU data.  The per-lgroup depots, if any,
+	 * follow and inherit that alignment.
 	 */
 	cp = vmem_xalloc(kmem_cache_arena, csize, KMEM_CPU_CACHE_SIZE,
 	    P2NPHASE(csize, KMEM_CPU_CACHE_SIZE), 0, NULL, NULL, VM_SLEEP);
 	bzero(cp, csize);
 	list_link_init(&cp->cache_link);
+	if (nlgrpdepot != 0) {
+		cp->cache_lgrp_depot = (kmem_lgrp_depot_t *)
+		    ((char *)cp + KMEM_CACHE_SIZE(max_ncpus));
+		cp->cache_lgrp_ndepot = nlgrpdepot;
+	}
 
 	if (align == 0)
 		align = KMEM_ALIGN;
@@ -3908,7 +4265,9 @@ kmem_cache_create(
 				bestfit = slabsize;
 			}
 		}
-		if (cflags & KMC_QCACHE)
+		if ((cflags & KMC_QCACHE) && bufsize > vmp->vm_qcache_max)
+			bestfit = VMEM_QCACHE_SLABSIZE(vmp->vm_scache_max);
+		else if (cflags & KMC_QCACHE)
 			bestfit = VMEM_QCACHE_SLABSIZE(vmp->vm_qcache_max);
 		cp->cache_slabsize = bestfit;
 		cp->cache_mincolor = 0;
@@ -3967,6 +4326,10 @@ kmem_cache_create(
 	 * Initialize the depot.
 	 */
 	mutex_init(&cp->cache_depot_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		mutex_init(&cp->cache_lgrp_depot[i].kld_lock, NULL,
+		    MUTEX_DEFAULT, NULL);
+	}
 
 	for (mtp = kmem_magtype; chunksize <= mtp->mt_minbuf; mtp++)
 		continue;
@@ -4107,7 +4470,7 @@ kmem_cache_set_move(kmem_cache_t *cp,
 void
 kmem_cache_destroy(kmem_cache_t *cp)
 {
-	int cpu_seqid;
+	int cpu_seqid, i;
 
 	/*
 	 * Remove the cache from the global cache list so that no one else
@@ -4156,10 +4519,14 @@ kmem_cache_destroy(kmem_cache_t *cp)
 	for (cpu_seqid = 0; cpu_seqid < max_ncpus; cpu_seqid++)
 		mutex_destroy(&cp->cache_cpu[cpu_seqid].cc_lock);
 
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++)
+		mutex_destroy(&cp->cache_lgrp_depot[i].kld_lock);
+
 	mutex_destroy(&cp->cache_depot_lock);
 	mutex_destroy(&cp->cache_lock);
 
-	vmem_free(kmem_cache_arena, cp, KMEM_CACHE_SIZE(max_ncpus));
+	vmem_free(kmem_cache_arena, cp,
+	    KMEM_CACHE_LGRP_SIZE(max_ncpus, cp->cache_lgrp_ndepot));
 }
 
 /*ARGSUSED*/
@@ -4253,7 +4620,7 @@ kmem_cache_init(int pass, int use_large_pages)
 		kmem_va_arena = vmem_create("kmem_va",
 		    NULL, 0, PAGESIZE,
 		    vmem_alloc, vmem_free, heap_arena,
-		    8 * PAGESIZE, VM_SLEEP);
+		    8 * PAGESIZE, VMC_SEGCACHE | VM_SLEEP);
 
 		if (use_large_pages) {
 			kmem_default_arena = vmem_xcreate("kmem_default",
@@ -4684,6 +5051,7 @@ kmem_hunt_mags(kmem_cache_t *cp, void *buf)
 	kmem_cpu_cache_t *ccp;
 	kmem_magazine_t	*m;
 	int cpu_seqid;
+	int i;
 	int n;		/* magazine rounds */
 	void *tbuf;	/* temporary swap buffer */
 
@@ -4717,6 +5085,19 @@ kmem_hunt_mags(kmem_cache_t *cp, void *buf)
 	}
 	mutex_exit(&cp->cache_depot_lock);
 
+	for (i = 0; i < cp->cache_lgrp_ndepot; i++) {
+		kmem_lgrp_depot_t *kldp = &cp->cache_lgrp_depot[i];
+
+		mutex_enter(&kldp->kld_lock);
+		for (m = kldp->kld_full.ml_list; m != NULL; m = m->mag_next) {
+			if (kmem_hunt_mag(cp, m, n, buf, tbuf) != NULL) {
+				mutex_exit(&kldp->kld_lock);
+				return (buf);
+			}
+		}
+		mutex_exit(&kldp->kld_lock);
+	}
+
 	/* Hunt the per-CPU magazines. */
 	for (cpu_seqid = 0; cpu_seqid < max_ncpus; cpu_seqid++) {
 		ccp = &cp->cache_cpu[cpu_seqid];
@@ -5475,12 +5856,7 @@ kmem_cache_is_fragmented(kmem_cache_t *cp, boolean_t *doreap)
 	 * have fallen out of the working set.
 	 */
 	if (!fragmented) {
-		long reap;
-
-		mutex_enter(&cp->cache_depot_lock);
-		reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
-		reap = MIN(reap, cp->cache_full.ml_total);
-		mutex_exit(&cp->cache_depot_lock);
+		long reap = kmem_depot_full_reapable(cp);
 
 		nfree += ((uint64_t)reap * cp->cache_magtype->mt_magsize);
 		if (kmem_cache_frag_threshold(cp, nfree)) {
@@ -5512,6 +5888,9 @@ kmem_cache_scan(kmem_cache_t *cp)
 
 	if (kmem_cache_is_fragmented(cp, &reap)) {
 		size_t slabs_found;
+		size_t max_slabs = (freemem < lotsfree) ?
+		    MAX(kmem_reclaim_lowmem_max_slabs, kmem_reclaim_max_slabs) :
+		    kmem_reclaim_max_slabs;
 
 		/*
 		 * Consolidate reclaimable slabs from the end of the partial
@@ -5526,9 +5905,9 @@ kmem_cache_scan(kmem_cache_t *cp)
 		KMEM_STAT_ADD(kmem_move_stats.kms_scans);
 		kmd->kmd_scans++;
 		slabs_found = kmem_move_buffers(cp, kmem_reclaim_scan_range,
-		    kmem_reclaim_max_slabs, 0);
+		    max_slabs, 0);
 		if (slabs_found >= 0) {
-			kmd->kmd_slabs_sought += kmem_reclaim_max_slabs;
+			kmd->kmd_slabs_sought += max_slabs;
 			kmd->kmd_slabs_found += slabs_found;
 		}
 
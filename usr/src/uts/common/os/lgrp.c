@@ -3612,6 +3612,14 @@ lgrp_shm_policy_get(struct anon_map *amp, ulong_t anon_index, vnode_t *vp,
  */
 lgrp_mem_policy_t	lgrp_segmap_default_policy = LGRP_MEM_POLICY_RANDOM;
 
+/*
+ * Default memory allocation policy for the rest of the kernel's pages, in
+ * particular kmem slabs.  Most kernel threads are homed to the root lgroup,
+ * which would make the default (next touch) policy random; allocate from
+ * the lgroup of the CPU asking instead, which is where the memory is used.
+ */
+lgrp_mem_policy_t	lgrp_kmem_default_policy = LGRP_MEM_POLICY_NEXT_CPU;
+
 /*
  * Return lgroup to use for allocating memory
  * given the segment and address
@@ -3652,6 +3660,8 @@ lgrp_mem_choose(struct seg *seg, caddr_t vaddr, size_t pgsz)
 		if (seg->s_as == &kas) {
 			if (seg == segkmap)
 				policy = lgrp_segmap_default_policy;
+			else
+				policy = lgrp_kmem_default_policy;
 			if (policy == LGRP_MEM_POLICY_RANDOM_PROC ||
 			    policy == LGRP_MEM_POLICY_RANDOM_PSET)
 				policy = LGRP_MEM_POLICY_RANDOM;
@@ -3684,9 +3694,10 @@ lgrp_mem_choose(struct seg *seg, caddr_t vaddr, size_t pgsz)
 
 	/*
 	 * When homing threads on root lgrp, override default memory
-	 * allocation policies with root lgroup memory allocation policy
+	 * allocation policies with root lgroup memory allocation policy,
+	 * except for next CPU, which doesn't depend on the home lgroup.
 	 */
-	if (lgrp == lgrp_root)
+	if (lgrp == lgrp_root && policy != LGRP_MEM_POLICY_NEXT_CPU)
 		policy = lgrp_mem_policy_root;
 
 	/*
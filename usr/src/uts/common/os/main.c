@@ -375,6 +375,7 @@ main(void)
 	extern void	clock_tick_init_pre(void);
 	extern void	clock_tick_init_post(void);
 	extern void	clock_init(void);
+	extern void	smr_init(void);
 	extern void	physio_bufs_init(void);
 	extern void	pm_cfb_setup_intr(void);
 	extern int	pm_adjust_timestamps(dev_info_t *, void *);
@@ -424,6 +425,7 @@ main(void)
 	callout_init();	/* callout table MUST be init'd after cyclics */
 	clock_tick_init_pre();
 	clock_init();
+	smr_init();
 
 #if defined(__x86)
 	/*
@@ -642,6 +644,9 @@ main(void)
 	(void) thread_create(NULL, 0, seg_pasync_thread,
 	    NULL, 0, &p0, TS_RUN, minclsyspri);
 
+	/* idle-time page zeroing, one thread per memory node */
+	page_zero_init();
+
 	pid_setmin();
 
 	/* system is now ready */
@@ -176,6 +176,28 @@
  * Only direct handoff can prevent the thundering herd problem, but as
  * mentioned earlier, that would tend to defeat the adaptive spin logic.
  * In practice, option (3) works well because the blocking case is rare.
+ *
+ * Queued spinning
+ *
+ * On large machines a contended mutex can have dozens of CPUs spinning on
+ * its lock word at once, and the cache line holding it then spends more
+ * time moving between them than the lock spends being held.  So, unless
+ * there are only a few CPUs, a waiter first joins an MCS style queue and
+ * spins on a node of its own CPU until it gets to the head.  Only the head
+ * of the queue looks at the lock; it spins while the owner is running and
+ * hands the head of the queue on, in FIFO order, once it has the lock or
+ * has decided to block.  From there on the usual spin-then-block loop
+ * takes over, so a lock whose owner went to sleep still ends with the
+ * waiters on the turnstile.
+ *
+ * A mutex is only a word, so the queues can't hang off the lock itself.
+ * Instead, the queue tails live in a small hash table keyed by the lock
+ * address; locks that share a bucket share a queue, which costs them some
+ * fairness but nothing else, since the head gives up its place as soon as
+ * it stops spinning.  Waiters hold off preemption while in the queue, as
+ * the queue can't get past a node whose thread is not running.  For the
+ * same reason interrupt threads, which can pin a queued thread, never
+ * join a queue.
  */
 
 /*
@@ -334,6 +356,96 @@ uint_t (*mutex_lock_backoff)(uint_t) = default_lock_backoff;
 void (*mutex_lock_delay)(uint_t) = default_lock_delay;
 void (*mutex_delay)(void) = mutex_delay_default;
 
+/*
+ * Queued spinning; see the Big Theory Statement.  Setting mutex_qspin_ncpus
+ * to a value larger than NCPU turns it off.
+ */
+#define	MUTEX_QHASH_SIZE	256
+#define	MUTEX_QHASH(lp)		\
+	((((uintptr_t)(lp) >> 3) ^ ((uintptr_t)(lp) >> 11)) & \
+	(MUTEX_QHASH_SIZE - 1))
+
+typedef struct mutex_qnode {
+	struct mutex_qnode *volatile	mq_next;	/* next in queue */
+	volatile uint_t			mq_head;	/* at head of queue */
+	char				mq_pad[64 - 2 * sizeof (void *)];
+} mutex_qnode_t;
+
+typedef struct mutex_qtail {
+	mutex_qnode_t *volatile		mqt_tail;	/* last in queue */
+	char				mqt_pad[64 - sizeof (void *)];
+} mutex_qtail_t;
+
+uint_t mutex_qspin_ncpus = 8;	/* min. CPUs online for queued spinning */
+static mutex_qnode_t mutex_qnodes[NCPU];
+static mutex_qtail_t mutex_qtails[MUTEX_QHASH_SIZE];
+
+/*
+ * Wait for our turn in the spin queue of lp, then spin on the lock itself
+ * for as long as its owner is running.  Returns 1 if we got the lock, 0 if
+ * the caller should carry on with the normal spin-then-block loop.
+ */
+static int
+mutex_qspin_enter(mutex_impl_t *lp)
+{
+	volatile mutex_impl_t *vlp = (volatile mutex_impl_t *)lp;
+	mutex_qnode_t	*node, *prev, *next;
+	mutex_qtail_t	*qt;
+	kthread_id_t	owner;
+	hrtime_t	queue_time;
+	int		acquired = 0;
+
+	if (ncpus_online < mutex_qspin_ncpus ||
+	    (curthread->t_flag & T_INTR_THREAD) || panicstr)
+		return (0);
+
+	kpreempt_disable();
+	node = &mutex_qnodes[CPU->cpu_id];
+	node->mq_next = NULL;
+	node->mq_head = 0;
+	qt = &mutex_qtails[MUTEX_QHASH(lp)];
+
+	queue_time = LOCKSTAT_START_TIME(LS_MUTEX_ENTER_QUEUE);
+	membar_producer();
+	if ((prev = atomic_swap_ptr(&qt->mqt_tail, node)) != NULL) {
+		prev->mq_next = node;
+		while (!node->mq_head)
+			SMT_PAUSE();
+		membar_consumer();
+	}
+	LOCKSTAT_RECORD_TIME(LS_MUTEX_ENTER_QUEUE, lp, queue_time);
+
+	for (;;) {
+		if ((owner = MUTEX_OWNER(vlp)) == NULL) {
+			if (mutex_adaptive_tryenter(lp)) {
+				acquired = 1;
+				break;
+			}
+			continue;
+		}
+		if (owner == curthread || panicstr || CPU->cpu_kprunrun)
+			break;
+		if (owner != MUTEX_NO_OWNER && mutex_owner_running(lp) == NULL)
+			break;
+		SMT_PAUSE();
+	}
+
+	/*
+	 * Hand the head of the queue on to the next waiter, if there is one.
+	 */
+	if ((next = node->mq_next) == NULL) {
+		if (atomic_cas_ptr(&qt->mqt_tail, node, NULL) == node)
+			goto out;
+		while ((next = node->mq_next) == NULL)
+			SMT_PAUSE();
+	}
+	membar_producer();
+	next->mq_head = 1;
+out:
+	kpreempt_enable();
+	return (acquired);
+}
+
 /*
  * mutex_vector_enter() is called from the assembly mutex_enter() routine
  * if the lock is held or is not of type MUTEX_ADAPTIVE.
@@ -381,6 +493,9 @@ mutex_vector_enter(mutex_impl_t *lp)
 
 	spin_time = LOCKSTAT_START_TIME(LS_MUTEX_ENTER_SPIN);
 
+	if (mutex_qspin_enter(lp))
+		goto acquired;
+
 	backoff = mutex_lock_backoff(0);	/* set base backoff */
 	for (;;) {
 		mutex_lock_delay(backoff); /* backoff delay */
@@ -454,6 +569,7 @@ mutex_vector_enter(mutex_impl_t *lp)
 		}
 	}
 
+acquired:
 	ASSERT(MUTEX_OWNER(lp) == curthread);
 
 	if (sleep_time != 0) {
@@ -0,0 +1,173 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Per-CPU reader/writer locks.
+ *
+ * A krwlock keeps its reader count in the lock word, so every rw_enter()
+ * and rw_exit() for reader has to own the cache line holding it, even when
+ * nobody ever asks for the lock as writer.  A pcrwlock instead keeps one
+ * reader count per CPU, each in a cache line of its own; a reader only
+ * ever touches the count of the CPU it happens to be running on.  The
+ * price is paid by writers, which have to add up the counts of all CPUs,
+ * and in memory, so pcrwlocks are meant for a small number of global locks
+ * that are read on hot paths and written rarely.
+ *
+ * A reader that migrates while holding the lock decrements a different
+ * count than the one it incremented, so an individual count means
+ * nothing; only the sum over all CPUs is the number of readers.
+ *
+ * Readers and writers synchronize through pcrw_wwant, the number of
+ * writers holding or waiting for the lock:
+ *
+ *	reader				writer
+ *
+ *	increment CPU count		pcrw_wwant++
+ *	membar #StoreLoad		membar #StoreLoad
+ *	check pcrw_wwant		add up the CPU counts
+ *
+ * Either the reader sees the writer and backs out, or the writer sees the
+ * reader in its sum.  A reader that backs out decrements the same count it
+ * incremented, so a writer can never see the decrement without also having
+ * seen the increment, and the sum never drops to zero while a reader that
+ * got in still holds the lock.  Readers leaving while a writer waits wake
+ * it up; they can't tell whether they were the last, but the writer adds
+ * up the counts again.
+ *
+ * As with krwlocks, a waiting writer keeps new readers out, so a thread
+ * must not enter a pcrwlock for reader while already holding it.  Unlike
+ * krwlocks, there is no priority inheritance.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/debug.h>
+#include <sys/kmem.h>
+#include <sys/cpuvar.h>
+#include <sys/atomic.h>
+#include <sys/pcrwlock.h>
+
+void
+pcrw_init(pcrwlock_t *l)
+{
+	mutex_init(&l->pcrw_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&l->pcrw_cv, NULL, CV_DEFAULT, NULL);
+	l->pcrw_writer = NULL;
+	l->pcrw_wwant = 0;
+	l->pcrw_nslots = max_ncpus;
+	l->pcrw_slots = kmem_zalloc(max_ncpus * sizeof (pcrw_slot_t),
+	    KM_SLEEP);
+}
+
+void
+pcrw_destroy(pcrwlock_t *l)
+{
+	ASSERT(l->pcrw_writer == NULL && l->pcrw_wwant == 0);
+	ASSERT(!pcrw_read_held(l));
+
+	kmem_free(l->pcrw_slots, l->pcrw_nslots * sizeof (pcrw_slot_t));
+	cv_destroy(&l->pcrw_cv);
+	mutex_destroy(&l->pcrw_lock);
+}
+
+static ulong_t
+pcrw_readers(pcrwlock_t *l)
+{
+	ulong_t	readers = 0;
+	uint_t	i;
+
+	for (i = 0; i < l->pcrw_nslots; i++)
+		readers += l->pcrw_slots[i].ps_readers;
+
+	return (readers);
+}
+
+static void
+pcrw_leave(pcrwlock_t *l, pcrw_slot_t *ps)
+{
+	atomic_dec_ulong(&ps->ps_readers);
+	membar_enter();
+	if (l->pcrw_wwant != 0) {
+		mutex_enter(&l->pcrw_lock);
+		cv_broadcast(&l->pcrw_cv);
+		mutex_exit(&l->pcrw_lock);
+	}
+}
+
+void
+pcrw_enter(pcrwlock_t *l, krw_t rw)
+{
+	pcrw_slot_t	*ps;
+
+	if (rw == RW_READER) {
+		for (;;) {
+			ps = &l->pcrw_slots[CPU->cpu_seqid];
+			atomic_inc_ulong(&ps->ps_readers);
+			membar_enter();
+			if (l->pcrw_wwant == 0)
+				return;
+
+			/*
+			 * A writer got there first; back out and wait.
+			 */
+			pcrw_leave(l, ps);
+			mutex_enter(&l->pcrw_lock);
+			while (l->pcrw_wwant != 0)
+				cv_wait(&l->pcrw_cv, &l->pcrw_lock);
+			mutex_exit(&l->pcrw_lock);
+		}
+	}
+
+	ASSERT(rw == RW_WRITER);
+	ASSERT(l->pcrw_writer != curthread);
+
+	mutex_enter(&l->pcrw_lock);
+	l->pcrw_wwant++;
+	membar_enter();
+	while (l->pcrw_writer != NULL || pcrw_readers(l) != 0)
+		cv_wait(&l->pcrw_cv, &l->pcrw_lock);
+	l->pcrw_writer = curthread;
+	mutex_exit(&l->pcrw_lock);
+}
+
+void
+pcrw_exit(pcrwlock_t *l)
+{
+	if (l->pcrw_writer != curthread) {
+		ASSERT(pcrw_read_held(l));
+		pcrw_leave(l, &l->pcrw_slots[CPU->cpu_seqid]);
+		return;
+	}
+
+	mutex_enter(&l->pcrw_lock);
+	ASSERT(l->pcrw_wwant > 0);
+	l->pcrw_writer = NULL;
+	l->pcrw_wwant--;
+	cv_broadcast(&l->pcrw_cv);
+	mutex_exit(&l->pcrw_lock);
+}
+
+/*
+ * Like RW_READ_HELD(), this only tells whether anybody holds the lock for
+ * reader, not whether the caller does.
+ */
+int
+pcrw_read_held(pcrwlock_t *l)
+{
+	return (pcrw_readers(l) != 0);
+}
+
+int
+pcrw_write_held(pcrwlock_t *l)
+{
+	return (l->pcrw_writer == curthread);
+}
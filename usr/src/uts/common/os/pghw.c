@@ -163,6 +163,10 @@ kmutex_t		pghw_kstat_lock;
  *   pg_hw_util_rate	Utilization rate, expressed in operations per second.
  *
  *   pg_hw_util_rate_max Maximum observed value of utilization rate.
+ *
+ *   pg_steals		Number of threads an idle CPU took from the run queue
+ *			  of another CPU for which this PG is the closest
+ *			  one they share.
  */
 struct pghw_cu_kstat {
 	kstat_named_t	pg_id;
@@ -176,6 +180,7 @@ struct pghw_cu_kstat {
 	kstat_named_t	pg_hw_util_rate_max;
 	kstat_named_t	pg_cpus;
 	kstat_named_t	pg_relationship;
+	kstat_named_t	pg_steals;
 } pghw_cu_kstat = {
 	{ "pg_id",		KSTAT_DATA_INT32 },
 	{ "parent_pg_id",	KSTAT_DATA_INT32 },
@@ -188,6 +193,7 @@ struct pghw_cu_kstat {
 	{ "hw_util_rate_max",	KSTAT_DATA_UINT64   },
 	{ "cpus",		KSTAT_DATA_STRING   },
 	{ "relationship",	KSTAT_DATA_STRING   },
+	{ "steals",		KSTAT_DATA_UINT64   },
 };
 
 /*
@@ -638,6 +644,8 @@ pghw_cu_kstat_update(kstat_t *ksp, int rw)
 	kstat_named_setstr(&pgsp->pg_relationship,
 	    pghw_type_string(pg->pghw_hw));
 
+	pgsp->pg_steals.value.ui64 = pg->pghw_steals;
+
 	if (has_cpc_privilege) {
 		pgsp->pg_hw_util.value.ui64 = hw_util->pghw_util;
 		pgsp->pg_hw_util_time_running.value.ui64 =
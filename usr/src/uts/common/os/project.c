@@ -38,6 +38,7 @@
 #include <sys/port_kernel.h>
 #include <sys/task.h>
 #include <sys/zone.h>
+#include <sys/vm_usage.h>
 #include <sys/cpucaps.h>
 #include <sys/klpd.h>
 
@@ -125,6 +126,8 @@ project_data_init(kproject_data_t *data)
 	data->kpd_crypto_mem_ctl = UINT64_MAX;
 	data->kpd_lockedmem_kstat = NULL;
 	data->kpd_nprocs_kstat = NULL;
+	data->kpd_rss = 0;
+	data->kpd_rss_kstat = NULL;
 }
 
 /*ARGSUSED*/
@@ -1063,6 +1066,24 @@ project_nprocs_kstat_update(kstat_t *ksp, int rw)
 	return (0);
 }
 
+/*
+ * Approximate rss; see vm_usage.c.  Projects have no cap of their own.
+ */
+static int
+project_rss_kstat_update(kstat_t *ksp, int rw)
+{
+	kproject_t *pj = ksp->ks_private;
+	kproject_kstat_t *kpk = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	vm_rss_sync();
+	kpk->kpk_usage.value.ui64 = ptob(pj->kpj_data.kpd_rss);
+	kpk->kpk_value.value.ui64 = UINT64_MAX;
+	return (0);
+}
+
 static kstat_t *
 project_kstat_create_common(kproject_t *pj, char *name, char *zonename,
     int (*updatefunc) (kstat_t *, int))
@@ -1094,17 +1115,22 @@ project_kstat_create(kproject_t *pj, zone_t *zone)
 {
 	kstat_t *ksp_lockedmem;
 	kstat_t *ksp_nprocs;
+	kstat_t *ksp_rss;
 
 	ksp_lockedmem = project_kstat_create_common(pj, "lockedmem",
 	    zone->zone_name, project_lockedmem_kstat_update);
 	ksp_nprocs = project_kstat_create_common(pj, "nprocs",
 	    zone->zone_name, project_nprocs_kstat_update);
+	ksp_rss = project_kstat_create_common(pj, "rss",
+	    zone->zone_name, project_rss_kstat_update);
 
 	mutex_enter(&project_hash_lock);
 	ASSERT(pj->kpj_data.kpd_lockedmem_kstat == NULL);
 	pj->kpj_data.kpd_lockedmem_kstat = ksp_lockedmem;
 	ASSERT(pj->kpj_data.kpd_nprocs_kstat == NULL);
 	pj->kpj_data.kpd_nprocs_kstat = ksp_nprocs;
+	ASSERT(pj->kpj_data.kpd_rss_kstat == NULL);
+	pj->kpj_data.kpd_rss_kstat = ksp_rss;
 	mutex_exit(&project_hash_lock);
 }
 
@@ -1126,4 +1152,5 @@ project_kstat_delete(kproject_t *pj)
 {
 	project_kstat_delete_common(&pj->kpj_data.kpd_lockedmem_kstat);
 	project_kstat_delete_common(&pj->kpj_data.kpd_nprocs_kstat);
+	project_kstat_delete_common(&pj->kpj_data.kpd_rss_kstat);
 }
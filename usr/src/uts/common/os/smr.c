@@ -0,0 +1,240 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Safe memory reclamation.
+ *
+ * Many lookups take a lock only so that the entry they are looking at is
+ * not freed under them.  SMR lets such readers go without: a reader wraps
+ * its lookup in SMR_ENTER() and SMR_EXIT(), and a writer that has unlinked
+ * an entry hands it to smr_call(), smr_kmem_free() or
+ * smr_kmem_cache_free() instead of freeing it, or waits in
+ * smr_synchronize() before freeing it itself.  The entry is freed once
+ * every reader that might have found it has left its critical section.
+ * Readers still need whatever the data structure requires to see a
+ * consistent entry; SMR only keeps the memory around.
+ *
+ * A read-side critical section is nothing more than a stretch with
+ * preemption disabled, so it costs a couple of loads and stores on the
+ * thread, and a reader must not block inside it.  In exchange, a CPU
+ * that has been seen to switch threads, or to run its idle thread, since
+ * a writer started waiting cannot still be inside a critical section that
+ * began before that; this is the grace period.  smr_synchronize() takes a
+ * snapshot of the number of context switches of every CPU and waits until
+ * each CPU has either switched, gone idle or is the one we run on.  A CPU
+ * that keeps running the same thread for long, which a busy user process
+ * may well do, is made to switch by briefly binding ourselves to it.
+ *
+ * Deferred frees are queued for the smr thread, which waits out one grace
+ * period for a whole batch of them.  Queueing may sleep for memory; a
+ * caller that can't sleep must keep the entry around until later itself.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/debug.h>
+#include <sys/kmem.h>
+#include <sys/cpuvar.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/callb.h>
+#include <sys/atomic.h>
+#include <sys/ddi.h>
+#include <sys/sunddi.h>
+#include <sys/smr.h>
+
+typedef struct smr_node {
+	struct smr_node	*sn_next;
+	smr_func_t	*sn_func;	/* callback, or NULL to free */
+	void		*sn_arg;	/* callback argument or buffer */
+	kmem_cache_t	*sn_cache;	/* cache of buffer, if any */
+	size_t		sn_size;	/* size of buffer, if no cache */
+} smr_node_t;
+
+#define	SMR_NOCPU	((uint64_t)-1)
+
+/* Setable in /etc/system */
+int	smr_force_ticks = 2;		/* wait before forcing a switch */
+
+static kmem_cache_t	*smr_node_cache;
+static kmutex_t		smr_lock;
+static kcondvar_t	smr_cv;
+static smr_node_t	*smr_pending;	/* deferred frees, newest first */
+
+/*
+ * Return B_TRUE if cp cannot still be inside a critical section that
+ * started before its switch count was snapshot.
+ */
+static boolean_t
+smr_cpu_quiesced(cpu_t *cp, uint64_t pswitch)
+{
+	if (pswitch == SMR_NOCPU || cp == CPU)
+		return (B_TRUE);
+	if (cp->cpu_stats.sys.pswitch != pswitch)
+		return (B_TRUE);
+	return (cp->cpu_thread == cp->cpu_idle_thread);
+}
+
+/*
+ * Wait for every critical section in progress to end.
+ */
+void
+smr_synchronize(void)
+{
+	uint64_t	*snap;
+	cpu_t		*cp;
+	clock_t		start;
+	boolean_t	done;
+	int		i;
+
+	ASSERT(curthread->t_preempt == 0);
+
+	snap = kmem_alloc(max_ncpus * sizeof (uint64_t), KM_SLEEP);
+	for (i = 0; i < max_ncpus; i++)
+		snap[i] = SMR_NOCPU;
+
+	/*
+	 * Make sure whatever the caller unlinked is out of sight of new
+	 * readers before looking at what the CPUs are doing.
+	 */
+	membar_enter();
+
+	mutex_enter(&cpu_lock);
+	cp = cpu_list;
+	do {
+		snap[cp->cpu_seqid] = cp->cpu_stats.sys.pswitch;
+	} while ((cp = cp->cpu_next) != cpu_list);
+	mutex_exit(&cpu_lock);
+
+	start = ddi_get_lbolt();
+	for (;;) {
+		done = B_TRUE;
+		mutex_enter(&cpu_lock);
+		cp = cpu_list;
+		do {
+			if (smr_cpu_quiesced(cp, snap[cp->cpu_seqid]))
+				continue;
+			if (ddi_get_lbolt() - start < smr_force_ticks ||
+			    !cpu_is_online(cp)) {
+				done = B_FALSE;
+				continue;
+			}
+			/*
+			 * Run on the CPU for a moment; whatever was running
+			 * there has had to switch out for us.
+			 */
+			thread_affinity_set(curthread, cp->cpu_id);
+			thread_affinity_clear(curthread);
+			snap[cp->cpu_seqid] = SMR_NOCPU;
+		} while ((cp = cp->cpu_next) != cpu_list);
+		mutex_exit(&cpu_lock);
+
+		if (done)
+			break;
+		delay(1);
+	}
+
+	membar_enter();
+	kmem_free(snap, max_ncpus * sizeof (uint64_t));
+}
+
+static void
+smr_queue(smr_func_t *func, void *arg, kmem_cache_t *cache, size_t size)
+{
+	smr_node_t	*sn;
+
+	sn = kmem_cache_alloc(smr_node_cache, KM_SLEEP);
+	sn->sn_func = func;
+	sn->sn_arg = arg;
+	sn->sn_cache = cache;
+	sn->sn_size = size;
+
+	mutex_enter(&smr_lock);
+	if ((sn->sn_next = smr_pending) == NULL)
+		cv_signal(&smr_cv);
+	smr_pending = sn;
+	mutex_exit(&smr_lock);
+}
+
+/*
+ * Call func(arg) once all current readers are done.
+ */
+void
+smr_call(smr_func_t *func, void *arg)
+{
+	smr_queue(func, arg, NULL, 0);
+}
+
+/*
+ * kmem_free(buf, size) once all current readers are done.
+ */
+void
+smr_kmem_free(void *buf, size_t size)
+{
+	smr_queue(NULL, buf, NULL, size);
+}
+
+/*
+ * kmem_cache_free(cache, buf) once all current readers are done.
+ */
+void
+smr_kmem_cache_free(kmem_cache_t *cache, void *buf)
+{
+	smr_queue(NULL, buf, cache, 0);
+}
+
+static void
+smr_thread(void)
+{
+	callb_cpr_t	cprinfo;
+	smr_node_t	*sn, *next;
+
+	CALLB_CPR_INIT(&cprinfo, &smr_lock, callb_generic_cpr, "smr");
+
+	mutex_enter(&smr_lock);
+	for (;;) {
+		while (smr_pending == NULL) {
+			CALLB_CPR_SAFE_BEGIN(&cprinfo);
+			cv_wait(&smr_cv, &smr_lock);
+			CALLB_CPR_SAFE_END(&cprinfo, &smr_lock);
+		}
+		sn = smr_pending;
+		smr_pending = NULL;
+		mutex_exit(&smr_lock);
+
+		smr_synchronize();
+
+		for (; sn != NULL; sn = next) {
+			next = sn->sn_next;
+			if (sn->sn_func != NULL)
+				sn->sn_func(sn->sn_arg);
+			else if (sn->sn_cache != NULL)
+				kmem_cache_free(sn->sn_cache, sn->sn_arg);
+			else
+				kmem_free(sn->sn_arg, sn->sn_size);
+			kmem_cache_free(smr_node_cache, sn);
+		}
+
+		mutex_enter(&smr_lock);
+	}
+}
+
+void
+smr_init(void)
+{
+	mutex_init(&smr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&smr_cv, NULL, CV_DEFAULT, NULL);
+	smr_node_cache = kmem_cache_create("smr_node_cache",
+	    sizeof (smr_node_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	(void) thread_create(NULL, 0, smr_thread, NULL, 0, &p0, TS_RUN,
+	    minclsyspri);
+}
@@ -316,8 +316,10 @@ int	shutdown(int, int, int);
 ssize_t	recv(int, void *, size_t, int);
 ssize_t	recvfrom(int, void *, size_t, int, struct sockaddr *, socklen_t *);
 ssize_t	recvmsg(int, struct nmsghdr *, int);
+int	recvmmsg(int, struct mmsghdr *, uint_t, int, timespec_t *);
 ssize_t	send(int, void *, size_t, int);
 ssize_t	sendmsg(int, struct nmsghdr *, int);
+int	sendmmsg(int, struct mmsghdr *, uint_t, int);
 ssize_t	sendto(int, void *, size_t, int, struct sockaddr *, socklen_t);
 int	getpeername(int, struct sockaddr *, socklen_t *, int);
 int	getsockname(int, struct sockaddr *, socklen_t *, int);
@@ -576,8 +578,8 @@ struct sysent sysent[NSYSCALL] =
 	/* 120 */ SYSENT_CI("fchdir",		fchdir,		1),
 	/* 121 */ SYSENT_CL("readv",		readv,		3),
 	/* 122 */ SYSENT_CL("writev",		writev,		3),
-	/* 123 */ SYSENT_LOADABLE(),			/* (was xstat) */
-	/* 124 */ SYSENT_LOADABLE(),			/* (was lxstat) */
+	/* 123 */ SYSENT_CI("recvmmsg",		recvmmsg,	5),
+	/* 124 */ SYSENT_CI("sendmmsg",		sendmmsg,	4),
 	/* 125 */ SYSENT_LOADABLE(),			/* (was fxstat) */
 	/* 126 */ SYSENT_LOADABLE(),			/* (was xmknod) */
 	/* 127 */ SYSENT_CI("mmapobj",		mmapobjsys,	5),
@@ -941,8 +943,8 @@ struct sysent sysent32[NSYSCALL] =
 	/* 120 */ SYSENT_CI("fchdir",		fchdir,		1),
 	/* 121 */ SYSENT_CI("readv",		readv32,	3),
 	/* 122 */ SYSENT_CI("writev",		writev32,	3),
-	/* 123 */ SYSENT_LOADABLE32(),		/*	was xstat32	*/
-	/* 124 */ SYSENT_LOADABLE32(),		/*	was lxstat32	*/
+	/* 123 */ SYSENT_CI("recvmmsg",		recvmmsg,	5),
+	/* 124 */ SYSENT_CI("sendmmsg",		sendmmsg,	4),
 	/* 125 */ SYSENT_LOADABLE32(),		/*	was fxstat32	*/
 	/* 126 */ SYSENT_LOADABLE32(),		/*	was xmknod	*/
 	/* 127 */ SYSENT_CI("mmapobj",		mmapobjsys,	5),
@@ -124,6 +124,14 @@
  *		supported for DYNAMIC task queues.  This flag is not compatible
  *		with TASKQ_THREADS_CPU_PCT.
  *
+ *	  TASKQ_PERCPU: Keep a separate task list for each CPU instead of a
+ *		single one under tq_lock.  Tasks are still executed by the
+ *		taskq threads, but in no particular order even if nthreads
+ *		is 1, and TQ_FRONT only puts a task in front of those
+ *		dispatched on the same CPU.  Use it for hot task queues whose
+ *		users do not depend on ordering.  This flag is not supported
+ *		for DYNAMIC task queues.
+ *
  *	The 'pri' field specifies the default priority for the threads that
  *	service all scheduled tasks.
  *
@@ -297,6 +305,25 @@
  *	All threads used by task queues mark t_taskq field of the thread to
  *	point to the task queue.
  *
+ * Per-CPU Task Queues ---------------------------------------------------------
+ *
+ * With TASKQ_PERCPU, tq_task stays empty and tasks go on the tq_lanes array
+ * instead, MIN(ncpus, tq_nthreads_max) lanes each with its own lock, task
+ * list and cache of free entries.  taskq_dispatch() appends to the lane of
+ * the current CPU without taking tq_lock and only goes to tq_lock when it
+ * has to allocate an entry or wake an idle thread.  Each thread has a home
+ * lane, (thread_id - 1) % tq_nlanes; it takes tasks from there while it can
+ * and otherwise steals from the other lanes in turn.
+ *
+ * tq_lock still protects the thread management described below and the
+ * transitions to and from idle.  A thread that found nothing to do
+ * increments tq_nidle and then checks every lane under its lock before
+ * going to sleep on tq_dispatch_cv; a dispatcher checks tq_nidle after
+ * dropping the lane lock.  One of the two is bound to see the other, so a
+ * task is never left on a lane with all threads asleep.  Since threads only
+ * leave tq_active while holding tq_lock with all lanes found empty,
+ * taskq_wait() can keep using tq_active.
+ *
  * Taskq Thread Management -----------------------------------------------------
  *
  * Taskq's non-dynamic threads are managed with several variables and flags:
@@ -426,13 +453,14 @@
  *
  *   1) The taskq_t's tq_lock, protecting global task queue state.
  *
- *   2) Each per-CPU bucket has a lock for bucket management.
+ *   2) Each per-CPU bucket has a lock for bucket management, and each
+ *      per-CPU lane of a TASKQ_PERCPU task queue has one for its lists.
  *
  *   3) The global taskq_cpupct_lock, which protects the list of
  *      TASKQ_THREADS_CPU_PCT taskqs.
  *
  *   If both (1) and (2) are needed, tq_lock should be taken *after* the bucket
- *   lock.
+ *   lock, but *before* the lane lock.
  *
  *   If both (1) and (3) are needed, tq_lock should be taken *after*
  *   taskq_cpupct_lock.
@@ -467,6 +495,9 @@
  *	taskq_search_depth	- Maximum # of buckets searched for a free entry
  *				  Default value: 4
  *
+ *	taskq_lane_maxfree	- Maximum # of free entries cached per lane
+ *				  Default value: 32
+ *
  *	taskq_dmtbf		- Mean time between induced dispatch failures
  *				  for dynamic task queues.
  *				  Default value: UINT_MAX (no induced failures)
@@ -553,6 +584,13 @@ int taskq_maxbuckets = TASKQ_MAXBUCKETS;
 #define	TASKQ_SEARCH_DEPTH 4
 int taskq_search_depth = TASKQ_SEARCH_DEPTH;
 
+/*
+ * Number of free entries each lane of a TASKQ_PERCPU task queue keeps for
+ * itself; the rest go back to the task queue's free list.
+ */
+#define	TASKQ_LANE_MAXFREE 32
+uint_t taskq_lane_maxfree = TASKQ_LANE_MAXFREE;
+
 /*
  * Hashing function: mix various bits of x. May be pretty much anything.
  */
@@ -582,6 +620,12 @@ static void taskq_ent_free(taskq_t *, taskq_ent_t *);
 static int taskq_ent_exists(taskq_t *, task_func_t, void *);
 static taskq_ent_t *taskq_bucket_dispatch(taskq_bucket_t *, task_func_t,
     void *);
+static taskq_ent_t *taskq_lane_dispatch(taskq_t *, task_func_t, void *,
+    uint_t, taskq_ent_t *);
+static taskq_ent_t *taskq_lane_get(taskq_t *, uint_t, boolean_t,
+    taskq_lane_t **);
+static void taskq_lane_thread(taskq_t *, taskq_ent_t *, taskq_lane_t *,
+    uint_t);
 
 /*
  * Task queues kstats.
@@ -795,6 +839,7 @@ taskq_destructor(void *buf, void *cdrarg)
 
 	ASSERT(tq->tq_nthreads == 0);
 	ASSERT(tq->tq_buckets == NULL);
+	ASSERT(tq->tq_lanes == NULL);
 	ASSERT(tq->tq_tcreates == 0);
 	ASSERT(tq->tq_tdeaths == 0);
 
@@ -1149,6 +1194,10 @@ taskq_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t flags)
 		 * TQ_NOQUEUE flag can't be used with non-dynamic task queues.
 		 */
 		ASSERT(!(flags & TQ_NOQUEUE));
+
+		if (tq->tq_flags & TASKQ_PERCPU)
+			return ((taskqid_t)taskq_lane_dispatch(tq, func, arg,
+			    flags, NULL));
 		/*
 		 * Enqueue the task to the underlying queue.
 		 */
@@ -1302,6 +1351,11 @@ taskq_dispatch_ent(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
 	 * to ensure that we don't free it later.
 	 */
 	tqe->tqent_un.tqent_flags |= TQENT_FLAG_PREALLOC;
+
+	if (tq->tq_flags & TASKQ_PERCPU) {
+		(void) taskq_lane_dispatch(tq, func, arg, flags, tqe);
+		return;
+	}
 	/*
 	 * Enqueue the task to the underlying queue.
 	 */
@@ -1315,6 +1369,172 @@ taskq_dispatch_ent(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
 	mutex_exit(&tq->tq_lock);
 }
 
+/*
+ * Put a task on the lane of the current CPU of a TASKQ_PERCPU task queue,
+ * using the preallocated entry tqe if there is one.  Returns the entry used,
+ * or NULL if none could be allocated.
+ */
+static taskq_ent_t *
+taskq_lane_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
+    taskq_ent_t *tqe)
+{
+	taskq_lane_t *lane = &tq->tq_lanes[CPU->cpu_seqid % tq->tq_nlanes];
+
+	mutex_enter(&lane->tql_lock);
+	if (tqe == NULL) {
+		if ((tqe = lane->tql_freelist) != NULL) {
+			lane->tql_freelist = tqe->tqent_next;
+			lane->tql_nfree--;
+		} else {
+			mutex_exit(&lane->tql_lock);
+
+			mutex_enter(&tq->tq_lock);
+			TASKQ_S_RANDOM_DISPATCH_FAILURE(tq, flags);
+			tqe = taskq_ent_alloc(tq, flags);
+			mutex_exit(&tq->tq_lock);
+			if (tqe == NULL)
+				return (NULL);
+
+			mutex_enter(&lane->tql_lock);
+		}
+		/* Make sure we start without any flags */
+		tqe->tqent_un.tqent_flags = 0;
+	}
+
+	if (flags & TQ_FRONT) {
+		TQ_PREPEND(lane->tql_task, tqe);
+	} else {
+		TQ_APPEND(lane->tql_task, tqe);
+	}
+	tqe->tqent_func = func;
+	tqe->tqent_arg = arg;
+	lane->tql_tasks++;
+	mutex_exit(&lane->tql_lock);
+	DTRACE_PROBE2(taskq__enqueue, taskq_t *, tq, taskq_ent_t *, tqe);
+
+	/*
+	 * Only bother with tq_lock if a thread may be asleep; see the
+	 * comment at the top of the file for why this is enough.
+	 */
+	if (tq->tq_nidle != 0) {
+		mutex_enter(&tq->tq_lock);
+		cv_signal(&tq->tq_dispatch_cv);
+		mutex_exit(&tq->tq_lock);
+	}
+
+	return (tqe);
+}
+
+/*
+ * Take the next task of a TASKQ_PERCPU task queue, looking at the lane home
+ * first and at the others after it.  Unless locked is set, lanes that look
+ * empty are skipped without taking their lock.  Returns NULL if there is
+ * nothing to do, otherwise the entry and the lane it came from in *lanep.
+ */
+static taskq_ent_t *
+taskq_lane_get(taskq_t *tq, uint_t home, boolean_t locked,
+    taskq_lane_t **lanep)
+{
+	taskq_lane_t *lane;
+	taskq_ent_t *tqe;
+	uint_t i;
+
+	for (i = 0; i < tq->tq_nlanes; i++) {
+		lane = &tq->tq_lanes[(home + i) % tq->tq_nlanes];
+		if (!locked && IS_EMPTY(lane->tql_task))
+			continue;
+
+		mutex_enter(&lane->tql_lock);
+		if ((tqe = lane->tql_task.tqent_next) != &lane->tql_task) {
+			tqe->tqent_prev->tqent_next = tqe->tqent_next;
+			tqe->tqent_next->tqent_prev = tqe->tqent_prev;
+			if (i != 0)
+				lane->tql_steals++;
+			mutex_exit(&lane->tql_lock);
+			*lanep = lane;
+			return (tqe);
+		}
+		mutex_exit(&lane->tql_lock);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Run tqe, taken from lane, and whatever else taskq_lane_get() finds after
+ * it.  Returns to taskq_thread() once there is nothing left or the set of
+ * threads is changing.  Called without tq_lock.
+ */
+static void
+taskq_lane_thread(taskq_t *tq, taskq_ent_t *tqe, taskq_lane_t *lane,
+    uint_t home)
+{
+	hrtime_t start, end;
+	boolean_t freeit;
+
+	ASSERT(!MUTEX_HELD(&tq->tq_lock));
+
+	do {
+		/* See taskq_thread() */
+		if (tqe->tqent_un.tqent_flags & TQENT_FLAG_PREALLOC) {
+			tqe->tqent_next = tqe->tqent_prev = NULL;
+			freeit = B_FALSE;
+		} else {
+			freeit = B_TRUE;
+		}
+
+		rw_enter(&tq->tq_threadlock, RW_READER);
+		start = gethrtime();
+		DTRACE_PROBE2(taskq__exec__start, taskq_t *, tq,
+		    taskq_ent_t *, tqe);
+		tqe->tqent_func(tqe->tqent_arg);
+		DTRACE_PROBE2(taskq__exec__end, taskq_t *, tq,
+		    taskq_ent_t *, tqe);
+		end = gethrtime();
+		rw_exit(&tq->tq_threadlock);
+
+		mutex_enter(&lane->tql_lock);
+		lane->tql_totaltime += end - start;
+		lane->tql_executed++;
+		if (freeit && lane->tql_nfree < taskq_lane_maxfree) {
+			tqe->tqent_next = lane->tql_freelist;
+			lane->tql_freelist = tqe;
+			lane->tql_nfree++;
+			freeit = B_FALSE;
+		}
+		mutex_exit(&lane->tql_lock);
+
+		if (freeit) {
+			mutex_enter(&tq->tq_lock);
+			taskq_ent_free(tq, tqe);
+			mutex_exit(&tq->tq_lock);
+		}
+	} while (!(tq->tq_flags & TASKQ_CHANGING) &&
+	    (tqe = taskq_lane_get(tq, home, B_FALSE, &lane)) != NULL);
+}
+
+/*
+ * Check that nothing is queued on a TASKQ_PERCPU task queue.
+ */
+static boolean_t
+taskq_lanes_empty(taskq_t *tq)
+{
+	taskq_lane_t *lane;
+	boolean_t empty = B_TRUE;
+	uint_t i;
+
+	ASSERT(MUTEX_HELD(&tq->tq_lock));
+
+	for (i = 0; i < tq->tq_nlanes && empty; i++) {
+		lane = &tq->tq_lanes[i];
+		mutex_enter(&lane->tql_lock);
+		empty = IS_EMPTY(lane->tql_task);
+		mutex_exit(&lane->tql_lock);
+	}
+
+	return (empty);
+}
+
 /*
  * Wait for all pending tasks to complete.
  * Calling taskq_wait from a task will cause deadlock.
@@ -1325,7 +1545,8 @@ taskq_wait(taskq_t *tq)
 	ASSERT(tq != curthread->t_taskq);
 
 	mutex_enter(&tq->tq_lock);
-	while (tq->tq_task.tqent_next != &tq->tq_task || tq->tq_active != 0)
+	while (tq->tq_task.tqent_next != &tq->tq_task || tq->tq_active != 0 ||
+	    !taskq_lanes_empty(tq))
 		cv_wait(&tq->tq_wait_cv, &tq->tq_lock);
 	mutex_exit(&tq->tq_lock);
 
@@ -1500,6 +1721,8 @@ taskq_thread(void *arg)
 
 	taskq_t *tq = arg;
 	taskq_ent_t *tqe;
+	taskq_lane_t *lane;
+	uint_t home = 0;
 	callb_cpr_t cprinfo;
 	hrtime_t start, end;
 	boolean_t freeit;
@@ -1525,6 +1748,9 @@ taskq_thread(void *arg)
 
 	VERIFY3S(thread_id, <=, tq->tq_nthreads_max);
 
+	if (tq->tq_flags & TASKQ_PERCPU)
+		home = (thread_id - 1) % tq->tq_nlanes;
+
 	if (tq->tq_nthreads_max == 1)
 		tq->tq_thread = curthread;
 	else
@@ -1576,6 +1802,30 @@ taskq_thread(void *arg)
 				}
 			}
 		}
+		if (tq->tq_flags & TASKQ_PERCPU) {
+			/*
+			 * tq_nidle has to go up before we look at the lanes;
+			 * see "Per-CPU Task Queues" above.
+			 */
+			tq->tq_nidle++;
+			tqe = taskq_lane_get(tq, home, B_TRUE, &lane);
+			if (tqe == NULL) {
+				if (--tq->tq_active == 0)
+					cv_broadcast(&tq->tq_wait_cv);
+				(void) taskq_thread_wait(tq, &tq->tq_lock,
+				    &tq->tq_dispatch_cv, &cprinfo, -1);
+				tq->tq_active++;
+			}
+			tq->tq_nidle--;
+			if (tqe == NULL)
+				continue;
+
+			mutex_exit(&tq->tq_lock);
+			taskq_lane_thread(tq, tqe, lane, home);
+			mutex_enter(&tq->tq_lock);
+			continue;
+		}
+
 		if ((tqe = tq->tq_task.tqent_next) == &tq->tq_task) {
 			if (--tq->tq_active == 0)
 				cv_broadcast(&tq->tq_wait_cv);
@@ -1867,6 +2117,9 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 	IMPLY((flags & TASKQ_DYNAMIC), !(flags & TASKQ_THREADS_CPU_PCT));
 	IMPLY((flags & TASKQ_CPR_SAFE), !(flags & TASKQ_THREADS_CPU_PCT));
 
+	/* Dynamic task queues already spread their work over the CPUs */
+	IMPLY((flags & TASKQ_DYNAMIC), !(flags & TASKQ_PERCPU));
+
 	/* Cannot have DUTY_CYCLE without a non-p0 kernel process */
 	IMPLY((flags & TASKQ_DUTY_CYCLE), proc != &p0);
 
@@ -1938,6 +2191,22 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 		tq->tq_threadlist = kmem_alloc(
 		    sizeof (kthread_t *) * max_nthreads, KM_SLEEP);
 
+	if (flags & TASKQ_PERCPU) {
+		taskq_lane_t *lane;
+		uint_t l_id;
+
+		tq->tq_nlanes = MIN(ncpus, max_nthreads);
+		tq->tq_lanes = kmem_zalloc(sizeof (taskq_lane_t) *
+		    tq->tq_nlanes, KM_SLEEP);
+
+		for (l_id = 0; l_id < tq->tq_nlanes; l_id++) {
+			lane = &tq->tq_lanes[l_id];
+			mutex_init(&lane->tql_lock, NULL, MUTEX_DEFAULT, NULL);
+			lane->tql_task.tqent_next = &lane->tql_task;
+			lane->tql_task.tqent_prev = &lane->tql_task;
+		}
+	}
+
 	mutex_enter(&tq->tq_lock);
 	if (flags & TASKQ_PREPOPULATE) {
 		while (minalloc-- > 0)
@@ -2058,7 +2327,7 @@ taskq_destroy(taskq_t *tq)
 
 	mutex_enter(&tq->tq_lock);
 	ASSERT((tq->tq_task.tqent_next == &tq->tq_task) &&
-	    (tq->tq_active == 0));
+	    (tq->tq_active == 0) && taskq_lanes_empty(tq));
 
 	/* notify all the threads that they need to exit */
 	tq->tq_nthreads_target = 0;
@@ -2074,6 +2343,29 @@ taskq_destroy(taskq_t *tq)
 		kmem_free(tq->tq_threadlist, sizeof (kthread_t *) *
 		    tq->tq_nthreads_max);
 
+	/*
+	 * Give the entries cached on the lanes back to the task queue, so
+	 * that they are freed with the rest below.
+	 */
+	if (tq->tq_lanes != NULL) {
+		taskq_lane_t *lane;
+		taskq_ent_t *tqe;
+		uint_t l_id;
+
+		for (l_id = 0; l_id < tq->tq_nlanes; l_id++) {
+			lane = &tq->tq_lanes[l_id];
+			ASSERT(IS_EMPTY(lane->tql_task));
+			while ((tqe = lane->tql_freelist) != NULL) {
+				lane->tql_freelist = tqe->tqent_next;
+				taskq_ent_free(tq, tqe);
+			}
+			mutex_destroy(&lane->tql_lock);
+		}
+		kmem_free(tq->tq_lanes, sizeof (taskq_lane_t) * tq->tq_nlanes);
+		tq->tq_lanes = NULL;
+		tq->tq_nlanes = 0;
+	}
+
 	tq->tq_minalloc = 0;
 	while (tq->tq_nalloc != 0)
 		taskq_ent_free(tq, taskq_ent_alloc(tq, TQ_SLEEP));
@@ -2217,6 +2509,8 @@ taskq_kstat_update(kstat_t *ksp, int rw)
 {
 	struct taskq_kstat *tqsp = &taskq_kstat;
 	taskq_t *tq = ksp->ks_private;
+	taskq_lane_t *lane;
+	uint_t l_id;
 
 	if (rw == KSTAT_WRITE)
 		return (EACCES);
@@ -2226,6 +2520,12 @@ taskq_kstat_update(kstat_t *ksp, int rw)
 	tqsp->tq_executed.value.ui64 = tq->tq_executed;
 	tqsp->tq_maxtasks.value.ui64 = tq->tq_maxtasks;
 	tqsp->tq_totaltime.value.ui64 = tq->tq_totaltime;
+	for (l_id = 0; l_id < tq->tq_nlanes; l_id++) {
+		lane = &tq->tq_lanes[l_id];
+		tqsp->tq_tasks.value.ui64 += lane->tql_tasks;
+		tqsp->tq_executed.value.ui64 += lane->tql_executed;
+		tqsp->tq_totaltime.value.ui64 += lane->tql_totaltime;
+	}
 	tqsp->tq_nactive.value.ui64 = tq->tq_active;
 	tqsp->tq_nalloc.value.ui64 = tq->tq_nalloc;
 	tqsp->tq_pri.value.ui64 = tq->tq_pri;
@@ -529,6 +529,9 @@ schedpaging(void *arg)
 	if (freemem < lotsfree + needfree + kmem_reapahead)
 		kmem_reap();
 
+	if (freemem < desfree + needfree)
+		kmem_reap_fast();
+
 	if (freemem < lotsfree + needfree)
 		seg_preap();
 
@@ -130,6 +130,11 @@
  * which provides low-latency per-cpu caching.  The qcache_max argument to
  * vmem_create() specifies the largest allocation size to cache.
  *
+ * Arenas created with VMC_SEGCACHE also cache the first VMEM_NSCACHE_MAX
+ * powers of two above qcache_max.  Only those exact sizes are cached, so
+ * that nothing is lost to rounding; they are the sizes that large
+ * consumers such as kmem slabs and ZFS buffers tend to ask for.
+ *
  * 1.9 Relationship to Kernel Memory Allocator
  * -------------------------------------------
  * Every kmem cache has a vmem arena as its slab supplier.  The kernel memory
@@ -1273,6 +1278,10 @@ vmem_alloc(vmem_t *vmp, size_t size, int vmflag)
 		return (kmem_cache_alloc(vmp->vm_qcache[(size - 1) >>
 		    vmp->vm_qshift], vmflag & VM_KMFLAGS));
 
+	if (VMEM_SCACHED(vmp, size))
+		return (kmem_cache_alloc(VMEM_SCACHE(vmp, size),
+		    vmflag & VM_KMFLAGS));
+
 	if ((mtbf = vmem_mtbf | vmp->vm_mtbf) != 0 && gethrtime() % mtbf == 0 &&
 	    (vmflag & (VM_NOSLEEP | VM_PANIC)) == VM_NOSLEEP)
 		return (NULL);
@@ -1322,6 +1331,8 @@ vmem_free(vmem_t *vmp, void *vaddr, size_t size)
 	if (size - 1 < vmp->vm_qcache_max)
 		kmem_cache_free(vmp->vm_qcache[(size - 1) >> vmp->vm_qshift],
 		    vaddr);
+	else if (VMEM_SCACHED(vmp, size))
+		kmem_cache_free(VMEM_SCACHE(vmp, size), vaddr);
 	else
 		vmem_xfree(vmp, vaddr, size);
 }
@@ -1539,6 +1550,28 @@ vmem_create_common(const char *name, void *base, size_t size, size_t quantum,
 		}
 	}
 
+	/*
+	 * Segment caches pick up where the quantum caches leave off.  Their
+	 * slabs are larger than vm_scache_max, so slab creation always goes
+	 * to the arena proper (see kmem_cache_create()).
+	 */
+	if (vmp->vm_cflags & VMC_SEGCACHE) {
+		ASSERT(!(vmflag & VM_NOSLEEP));
+		ASSERT(!(vmp->vm_cflags & VMC_IDENTIFIER));
+		vmp->vm_scache_min = MAX(quantum,
+		    1UL << highbit(vmp->vm_qcache_max));
+		vmp->vm_scache_max =
+		    vmp->vm_scache_min << (VMEM_NSCACHE_MAX - 1);
+		for (i = 0; i < VMEM_NSCACHE_MAX; i++) {
+			char buf[VMEM_NAMELEN + 21];
+			(void) sprintf(buf, "%s_%lu", vmp->vm_name,
+			    vmp->vm_scache_min << i);
+			vmp->vm_scache[i] = kmem_cache_create(buf,
+			    vmp->vm_scache_min << i, quantum, NULL, NULL, NULL,
+			    NULL, vmp, KMC_QCACHE | KMC_NOTOUCH);
+		}
+	}
+
 	if ((vmp->vm_ksp = kstat_create("vmem", vmp->vm_id, vmp->vm_name,
 	    "vmem", KSTAT_TYPE_NAMED, sizeof (vmem_kstat_t) /
 	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL)) != NULL) {
@@ -1616,6 +1649,9 @@ vmem_destroy(vmem_t *vmp)
 	for (i = 0; i < VMEM_NQCACHE_MAX; i++)
 		if (vmp->vm_qcache[i])
 			kmem_cache_destroy(vmp->vm_qcache[i]);
+	for (i = 0; i < VMEM_NSCACHE_MAX; i++)
+		if (vmp->vm_scache[i])
+			kmem_cache_destroy(vmp->vm_scache[i]);
 
 	leaked = vmem_size(vmp, VMEM_ALLOC);
 	if (leaked != 0)
@@ -1732,11 +1768,14 @@ vmem_qcache_reap(vmem_t *vmp)
 	int i;
 
 	/*
-	 * Reap any quantum caches that may be part of this vmem.
+	 * Reap any quantum and segment caches that may be part of this vmem.
 	 */
 	for (i = 0; i < VMEM_NQCACHE_MAX; i++)
 		if (vmp->vm_qcache[i])
 			kmem_cache_reap_now(vmp->vm_qcache[i]);
+	for (i = 0; i < VMEM_NSCACHE_MAX; i++)
+		if (vmp->vm_scache[i])
+			kmem_cache_reap_now(vmp->vm_scache[i]);
 }
 
 /*
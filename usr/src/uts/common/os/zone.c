@@ -248,6 +248,7 @@
 #include <net/if.h>
 #include <sys/cpucaps.h>
 #include <vm/seg.h>
+#include <sys/vm_usage.h>
 #include <sys/mac.h>
 
 /*
@@ -1794,6 +1795,25 @@ zone_swapresv_kstat_update(kstat_t *ksp, int rw)
 	return (0);
 }
 
+/*
+ * Approximate rss (see vm_usage.c) against the physical memory cap.
+ */
+static int
+zone_rss_kstat_update(kstat_t *ksp, int rw)
+{
+	zone_t *zone = ksp->ks_private;
+	zone_kstat_t *zk = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	vm_rss_sync();
+	zk->zk_usage.value.ui64 = ptob(zone->zone_rss);
+	zk->zk_value.value.ui64 = zone->zone_phys_mcap != 0 ?
+	    zone->zone_phys_mcap : UINT64_MAX;
+	return (0);
+}
+
 static kstat_t *
 zone_kstat_create_common(zone_t *zone, char *name,
     int (*updatefunc) (kstat_t *, int))
@@ -1829,6 +1849,8 @@ zone_kstat_create(zone_t *zone)
 	    "swapresv", zone_swapresv_kstat_update);
 	zone->zone_nprocs_kstat = zone_kstat_create_common(zone,
 	    "nprocs", zone_nprocs_kstat_update);
+	zone->zone_rss_kstat = zone_kstat_create_common(zone,
+	    "rss", zone_rss_kstat_update);
 }
 
 static void
@@ -1850,6 +1872,7 @@ zone_kstat_delete(zone_t *zone)
 	zone_kstat_delete_common(&zone->zone_lockedmem_kstat);
 	zone_kstat_delete_common(&zone->zone_swapresv_kstat);
 	zone_kstat_delete_common(&zone->zone_nprocs_kstat);
+	zone_kstat_delete_common(&zone->zone_rss_kstat);
 }
 
 /*
@@ -5688,6 +5711,12 @@ zone_enter(zoneid_t zoneid)
 	zone_proj0->kpj_data.kpd_crypto_mem += pp->p_crypto_mem;
 	mutex_exit(&(zone_proj0->kpj_data.kpd_crypto_lock));
 
+	/*
+	 * rss is charged to the new zone once the process has joined one
+	 * of its projects, too.
+	 */
+	vm_rss_uncharge(pp);
+
 	/* remove lwps and process from proc's old zone and old project */
 	mutex_enter(&pp->p_zone->zone_nlwps_lock);
 	pp->p_zone->zone_nlwps -= pp->p_lwpcnt;
@@ -662,6 +662,8 @@ typedef enum {
 					/* connection setup error	  */
 #define	CLSET_BINDRESVPORT	10005	/* Set preference for reserve port */
 #define	CLGET_BINDRESVPORT	10006	/* Get preference for reserve port */
+#define	CLSET_MAXCONNS		10007	/* Set connections to use */
+#define	CLGET_MAXCONNS		10008	/* Get connections to use */
 #endif
 
 /*
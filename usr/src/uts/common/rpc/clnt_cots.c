@@ -300,6 +300,7 @@ struct cm_xprt {
 	kcondvar_t	x_conn_cv;	/* to signal when connection attempt */
 					/* is complete */
 	kstat_t		*x_ksp;
+	uint64_t	x_calls;	/* calls sent, under connmgr_lock */
 
 	kcondvar_t	x_dis_cv;	/* to signal when disconnect attempt */
 					/* is complete */
@@ -315,6 +316,7 @@ typedef struct cm_kstat_xprt {
 	kstat_named_t	x_state;
 	kstat_named_t	x_ref;
 	kstat_named_t	x_port;
+	kstat_named_t	x_calls;
 } cm_kstat_xprt_t;
 
 static cm_kstat_xprt_t cm_kstat_template = {
@@ -326,6 +328,7 @@ static cm_kstat_xprt_t cm_kstat_template = {
 	{ "status",	KSTAT_DATA_UINT32 },
 	{ "ref_count",	KSTAT_DATA_INT32 },
 	{ "port",	KSTAT_DATA_UINT32 },
+	{ "calls",	KSTAT_DATA_UINT64 },
 };
 
 /*
@@ -370,6 +373,7 @@ typedef struct cku_private_s {
 	bool_t			cku_nodelayonerr;
 						/* for CLSET_NODELAYONERR */
 	int			cku_useresvport; /* Use reserved port */
+	int			cku_maxconns;	/* for CLSET_MAXCONNS */
 	struct rpc_cots_client	*cku_stats;	/* stats for zone */
 } cku_private_t;
 
@@ -398,7 +402,7 @@ static struct cm_xprt *connmgr_wrapget(struct netbuf *, const struct timeval *,
 
 static struct cm_xprt *connmgr_get(struct netbuf *, const struct timeval *,
 	struct netbuf *, int, struct netbuf *, struct rpc_err *, dev_t,
-	bool_t, int, cred_t *);
+	bool_t, int, int, cred_t *);
 
 static void connmgr_cancelconn(struct cm_xprt *);
 static enum clnt_stat connmgr_cwait(struct cm_xprt *, const struct timeval *,
@@ -467,6 +471,15 @@ static const struct rpc_cots_client {
 #define	COTSRCSTAT_INCR(p, x)	\
 	atomic_add_64(&(p)->x.value.ui64, 1)
 
+/*
+ * Calls to one server share up to clnt_max_conns connections.  A single
+ * connection serializes everything on one TCP stream, and on the server
+ * one transport is only ever worked on by a limited number of threads, so
+ * raising this lets a busy mount spread its calls over several streams.
+ * A client handle can ask for more with CLSET_MAXCONNS.
+ * Another connection is only opened when all the existing ones have calls
+ * outstanding; otherwise a call goes out on the least busy of them.
+ */
 #define	CLNT_MAX_CONNS	1	/* concurrent connections between clnt/srvr */
 int clnt_max_conns = CLNT_MAX_CONNS;
 
@@ -628,6 +641,7 @@ clnt_cots_kcreate(dev_t dev, struct netbuf *addr, int family, rpcprog_t prog,
 	bcopy(addr->buf, p->cku_addr.buf, addr->len);
 	p->cku_stats = rpcstat->rpc_cots_client;
 	p->cku_useresvport = -1; /* value is has not been set */
+	p->cku_maxconns = 0;
 
 	*ncl = h;
 	return (0);
@@ -727,6 +741,20 @@ clnt_cots_kcontrol(CLIENT *h, int cmd, char *arg)
 
 		return (TRUE);
 
+	case CLSET_MAXCONNS:
+		if (arg == NULL || *(int *)arg < 0)
+			return (FALSE);
+
+		p->cku_maxconns = *(int *)arg;
+		return (TRUE);
+
+	case CLGET_MAXCONNS:
+		if (arg == NULL)
+			return (FALSE);
+
+		*(int *)arg = p->cku_maxconns;
+		return (TRUE);
+
 	default:
 		return (FALSE);
 	}
@@ -1565,6 +1593,7 @@ clnt_cots_kinit(CLIENT *h, dev_t dev, int family, struct netbuf *addr,
 	p->cku_device = dev;
 	p->cku_addrfmly = family;
 	p->cku_cred = cred;
+	p->cku_maxconns = 0;
 
 	if (p->cku_addr.maxlen < addr->len) {
 		if (p->cku_addr.maxlen != 0 && p->cku_addr.buf != NULL)
@@ -1631,6 +1660,7 @@ conn_kstat_update(kstat_t *ksp, int rw)
 	cm_ksp_data->x_time.value.ui32 = cm_entry->x_time;
 	cm_ksp_data->x_ref.value.ui32 = cm_entry->x_ref;
 	cm_ksp_data->x_state.value.ui32 = cm_entry->x_state_flags;
+	cm_ksp_data->x_calls.value.ui64 = cm_entry->x_calls;
 
 	if (cm_entry->x_server.buf) {
 		fbuf = cm_ksp_data->x_server.value.str.addr.ptr;
@@ -1759,7 +1789,8 @@ connmgr_wrapget(
 
 	cm_entry = connmgr_get(retryaddr, waitp, &p->cku_addr, p->cku_addrfmly,
 	    &p->cku_srcaddr, &p->cku_err, p->cku_device,
-	    p->cku_client.cl_nosignal, p->cku_useresvport, p->cku_cred);
+	    p->cku_client.cl_nosignal, p->cku_useresvport, p->cku_maxconns,
+	    p->cku_cred);
 
 	if (cm_entry == NULL) {
 		/*
@@ -1801,11 +1832,14 @@ connmgr_get(
 	dev_t		device,
 	bool_t		nosignal,
 	int		useresvport,
+	int		maxconns,
 	cred_t		*cr)
 {
 	struct cm_xprt *cm_entry;
 	struct cm_xprt *lru_entry;
 	struct cm_xprt **cmp, **prev;
+	struct cm_xprt **best_prev;
+	int best_ref;
 	queue_t *wq;
 	TIUSER *tiptr;
 	int i;
@@ -1814,6 +1848,14 @@ connmgr_get(
 	bool_t	connected;
 	zoneid_t zoneid = rpc_zoneid();
 
+	/*
+	 * Connections are shared by all handles to the server, so one that
+	 * asks for fewer than there are just picks among them; only the
+	 * global limit gets connections closed.
+	 */
+	if (maxconns <= 0)
+		maxconns = clnt_max_conns;
+
 	/*
 	 * If the call is not a retry, look for a transport entry that
 	 * goes to the server of interest.
@@ -1824,6 +1866,8 @@ connmgr_get(
 use_new_conn:
 		i = 0;
 		cm_entry = lru_entry = NULL;
+		best_prev = NULL;
+		best_ref = 0;
 
 		prev = cmp = &cm_hd;
 		while ((cm_entry = *cmp) != NULL) {
@@ -1901,11 +1945,22 @@ use_new_conn:
 				/* keep track of the last entry */
 				lru_entry = cm_entry;
 				prev = cmp;
+
+				/*
+				 * And of the one with the fewest calls on
+				 * it, preferring the less recently used.
+				 * x_ref is only a hint here.
+				 */
+				if (best_prev == NULL ||
+				    cm_entry->x_ref <= best_ref) {
+					best_prev = cmp;
+					best_ref = cm_entry->x_ref;
+				}
 			}
 			cmp = &cm_entry->x_next;
 		}
 
-		if (i > clnt_max_conns) {
+		if (i > clnt_max_conns && i > maxconns) {
 			RPCLOG(8, "connmgr_get: too many conns, dooming entry"
 			    " %p\n", (void *)lru_entry->x_tiptr);
 			lru_entry->x_doomed = TRUE;
@@ -1914,9 +1969,13 @@ use_new_conn:
 
 		/*
 		 * If we are at the maximum number of connections to
-		 * the server, hand back the least recently used one.
+		 * the server, or one of them is idle, hand back the
+		 * least busy one.
 		 */
-		if (i == clnt_max_conns) {
+		if (i >= maxconns || (i > 0 && best_ref == 0)) {
+			lru_entry = *best_prev;
+			prev = best_prev;
+
 			/*
 			 * Copy into the handle the source address of
 			 * the connection, which we will use in case of
@@ -1935,6 +1994,7 @@ use_new_conn:
 			RPCLOG(2, "connmgr_get: call going out on %p\n",
 			    (void *)lru_entry);
 			lru_entry->x_time = ddi_get_lbolt();
+			lru_entry->x_calls++;
 			CONN_HOLD(lru_entry);
 
 			if ((i > 1) && (prev != &cm_hd)) {
@@ -2087,6 +2147,7 @@ start_retry_loop:
 
 	cm_entry->x_state_flags = X_THREAD;
 	cm_entry->x_ref = 1;
+	cm_entry->x_calls = 1;
 	cm_entry->x_family = addrfmly;
 	cm_entry->x_rdev = device;
 	cm_entry->x_zoneid = zoneid;
@@ -372,7 +372,8 @@ typedef struct mir_s {
 		mir_listen_stream : 1,	/* listen end point */
 		mir_unused : 1,	/* no longer used */
 		mir_timer_call : 1,
-		mir_junk_fill_thru_bit_31 : 21;
+		mir_wsending : 1,	/* server thread is sending replies */
+		mir_junk_fill_thru_bit_31 : 20;
 
 	int	mir_setup_complete;	/* server has initialized everything */
 	timeout_id_t mir_timer_id;	/* Timer for idle checks */
@@ -410,6 +411,8 @@ typedef struct mir_s {
 
 	mblk_t	*mir_svc_pend_mp;	/* Pending T_ORDREL_IND or */
 					/* T_DISCON_IND */
+	mblk_t	*mir_wbatch_head;	/* Replies to go out with the */
+	mblk_t	*mir_wbatch_tail;	/* current sender, see mir_wput */
 
 	/*
 	 * these fields are for both client and server, but for debugging,
@@ -1094,6 +1097,7 @@ static void	mir_clnt_idle_stop(queue_t *, mir_t *);
 static void	mir_clnt_idle_start(queue_t *, mir_t *);
 static void	mir_wput(queue_t *q, mblk_t *mp);
 static void	mir_wput_other(queue_t *q, mblk_t *mp);
+static void	mir_wput_batch(queue_t *q, mir_t *mir);
 static void	mir_wsrv(queue_t *q);
 static	void	mir_disconnect(queue_t *, mir_t *ir);
 static	int	mir_check_len(queue_t *, int32_t, mblk_t *);
@@ -1118,6 +1122,13 @@ uint_t	clnt_max_msg_size = RPC_MAXDATASIZE;
 uint_t	svc_max_msg_size = RPC_MAXDATASIZE;
 uint_t	mir_krpc_cell_null;
 
+/*
+ * Replies that server threads produce while another thread is passing
+ * one downstream are linked into a single message and sent along by
+ * that thread, rather than each thread contending for the stream.
+ */
+int	mir_svc_batch_replies = 1;
+
 static void
 mir_timer_stop(mir_t *mir)
 {
@@ -2455,6 +2466,29 @@ mir_wput(queue_t *q, mblk_t *mp)
 	 * and take other actions depending on mir_type.
 	 */
 	if (!mir->mir_inwservice && MIR_WCANPUTNEXT(mir, q)) {
+		if (mir->mir_type == RPC_SERVER && mir_svc_batch_replies) {
+			if (mir->mir_wsending) {
+				/*
+				 * Some other thread is in putnext(); it
+				 * will take this reply along when done.
+				 */
+				if (mir->mir_wbatch_head == NULL)
+					mir->mir_wbatch_head = mp;
+				else
+					mir->mir_wbatch_tail->b_cont = mp;
+				while (mp->b_cont != NULL)
+					mp = mp->b_cont;
+				mir->mir_wbatch_tail = mp;
+				mutex_exit(&mir->mir_mutex);
+				return;
+			}
+			mir->mir_wsending = 1;
+			mutex_exit(&mir->mir_mutex);
+
+			putnext(q, mp);
+			mir_wput_batch(q, mir);
+			return;
+		}
 		mutex_exit(&mir->mir_mutex);
 
 		/*
@@ -2500,6 +2534,37 @@ mir_wput(queue_t *q, mblk_t *mp)
 	mutex_exit(&mir->mir_mutex);
 }
 
+/*
+ * Send the replies that were batched up while we were in putnext().  The
+ * replies are self-contained records on a byte stream, so they can go
+ * down as one message, and in any order.  If the stream has become flow
+ * controlled in the meantime, hand the batch to the service procedure
+ * like mir_wput() would.  The caller's reference on the stream keeps
+ * close from getting in the way while the batch is drained.
+ */
+static void
+mir_wput_batch(queue_t *q, mir_t *mir)
+{
+	mblk_t	*mp;
+
+	mutex_enter(&mir->mir_mutex);
+	ASSERT(mir->mir_wsending);
+	while ((mp = mir->mir_wbatch_head) != NULL) {
+		mir->mir_wbatch_head = mir->mir_wbatch_tail = NULL;
+		if (mir->mir_inwservice || !MIR_WCANPUTNEXT(mir, q)) {
+			mir->mir_hold_inbound = 1;
+			mir->mir_inwservice = 1;
+			(void) putq(q, mp);
+			break;
+		}
+		mutex_exit(&mir->mir_mutex);
+		putnext(q, mp);
+		mutex_enter(&mir->mir_mutex);
+	}
+	mir->mir_wsending = 0;
+	mutex_exit(&mir->mir_mutex);
+}
+
 static void
 mir_wput_other(queue_t *q, mblk_t *mp)
 {
@@ -122,6 +122,9 @@ struct dupreq {
 	int		dr_status;
 	struct dupreq	*dr_next;
 	struct dupreq	*dr_chain;
+	uint32_t	dr_hash;	/* hash of xid and client address */
+	uint32_t	dr_cksum;	/* checksum of the arguments */
+	clock_t		dr_time;	/* when the request came in */
 };
 
 /*
@@ -55,6 +55,7 @@
 #include <sys/cmn_err.h>
 #include <sys/kstat.h>
 #include <sys/vtrace.h>
+#include <sys/ddi.h>
 
 #include <rpc/types.h>
 #include <rpc/xdr.h>
@@ -79,6 +80,7 @@ static int		svc_cots_kdup(struct svc_req *, caddr_t, int,
 				struct dupreq **, bool_t *);
 static void		svc_cots_kdupdone(struct dupreq *, caddr_t,
 				void (*)(), int, int);
+static uint32_t		svc_cots_cksum(XDR *, struct rpc_msg *);
 static int32_t		*svc_cots_kgetres(SVCXPRT *, int);
 static void		svc_cots_kfreeres(SVCXPRT *);
 static void		svc_cots_kclone_destroy(SVCXPRT *);
@@ -122,6 +124,7 @@ struct cots_master_data {
 typedef struct cots_data {
 	mblk_t	*cd_mp;		/* pre-allocated reply message */
 	mblk_t	*cd_req_mp;	/* request message */
+	uint32_t cd_cksum;	/* checksum of the arguments, for kdup */
 } cots_data_t;
 
 /*
@@ -136,6 +139,9 @@ static const struct rpc_cots_server {
 	kstat_named_t	rsxdrcall;
 	kstat_named_t	rsdupchecks;
 	kstat_named_t	rsdupreqs;
+	kstat_named_t	rsdupinprog;
+	kstat_named_t	rsdupmisses;
+	kstat_named_t	rsdupbadsum;
 } cots_rsstat_tmpl = {
 	{ "calls",	KSTAT_DATA_UINT64 },
 	{ "badcalls",	KSTAT_DATA_UINT64 },
@@ -143,7 +149,10 @@ static const struct rpc_cots_server {
 	{ "badlen",	KSTAT_DATA_UINT64 },
 	{ "xdrcall",	KSTAT_DATA_UINT64 },
 	{ "dupchecks",	KSTAT_DATA_UINT64 },
-	{ "dupreqs",	KSTAT_DATA_UINT64 }
+	{ "dupreqs",	KSTAT_DATA_UINT64 },
+	{ "dupinprogress", KSTAT_DATA_UINT64 },
+	{ "dupmisses",	KSTAT_DATA_UINT64 },
+	{ "dupbadcksum", KSTAT_DATA_UINT64 }
 };
 
 #define	CLONE2STATS(clone_xprt)	\
@@ -382,6 +391,7 @@ svc_cots_krecv(SVCXPRT *clone_xprt, mblk_t *mp, struct rpc_msg *msg)
 
 	clone_xprt->xp_xid = msg->rm_xid;
 	cd->cd_req_mp = mp;
+	cd->cd_cksum = svc_cots_cksum(xdrs, msg);
 
 	TRACE_1(TR_FAC_KRPC, TR_SVC_COTS_KRECV_END,
 	    "svc_cots_krecv_end:(%S)", "good");
@@ -696,41 +706,179 @@ svc_cots_kfreeres(SVCXPRT *clone_xprt)
  * the dup cacheing routines below provide a cache of non-failure
  * transaction id's.  rpc service routines can use this to detect
  * retransmissions and re-send a non-failure response.
+ *
+ * The cache is split into DRC_NSTRIPES stripes, each with its own lock,
+ * hash chains and lru list, and a request goes to the stripe and chain
+ * picked by a hash of its xid and the client's address.  Requests from
+ * many clients, or many requests from one, thus rarely meet on a lock.
+ *
+ * The size of each stripe follows the request rate: an entry is only
+ * recycled once it is cotsdrc_minage seconds old, or the stripe has
+ * reached its share of cotsdrc_maxentries.  Until then new entries are
+ * allocated, so that a busy server still has the reply around when the
+ * first retransmission comes in.  Entries that have not been recycled
+ * for cotsdrc_maxage seconds are freed again, down to the stripe's share
+ * of cotsmaxdupreqs.
+ *
+ * A client that reuses an xid after a reboot, or that simply wraps, would
+ * be handed the reply of an unrelated request.  To avoid that, the first
+ * DRC_CKSUMLEN bytes of the arguments are checksummed and have to match
+ * as well.
  */
 
 /*
- * MAXDUPREQS is the number of cached items.  It should be adjusted
- * to the service load so that there is likely to be a response entry
- * when the first retransmission comes in.
+ * MAXDUPREQS is the number of cached items the cache shrinks back to.
  */
 #define	MAXDUPREQS	1024
 
-/*
- * This should be appropriately scaled to MAXDUPREQS.
- */
-#define	DRHASHSZ	257
-
-#if ((DRHASHSZ & (DRHASHSZ - 1)) == 0)
-#define	XIDHASH(xid)	((xid) & (DRHASHSZ - 1))
-#else
-#define	XIDHASH(xid)	((xid) % DRHASHSZ)
-#endif
-#define	DRHASH(dr)	XIDHASH((dr)->dr_xid)
+#define	DRC_NSTRIPES	64		/* must be a power of 2 */
+#define	DRC_NCHAINS	64		/* per stripe, also a power of 2 */
+#define	DRC_CKSUMLEN	256
+
+#define	DRC_STRIPE(h)	(&cotsdrc[(h) & (DRC_NSTRIPES - 1)])
+#define	DRC_CHAIN(h)	(((h) / DRC_NSTRIPES) & (DRC_NCHAINS - 1))
 #define	REQTOXID(req)	((req)->rq_xprt->xp_xid)
 
-static int	cotsndupreqs = 0;
+typedef struct drc_stripe {
+	kmutex_t	ds_lock;
+	struct dupreq	*ds_mru;	/* ds_mru->dr_next is the lru entry */
+	int		ds_count;
+	struct dupreq	*ds_chain[DRC_NCHAINS];
+} drc_stripe_t;
+
 int	cotsmaxdupreqs = MAXDUPREQS;
-static kmutex_t cotsdupreq_lock;
-static struct dupreq *cotsdrhashtbl[DRHASHSZ];
-static int	cotsdrhashstat[DRHASHSZ];
+int	cotsdrc_maxentries = 64 * MAXDUPREQS;
+int	cotsdrc_minage = 120;		/* seconds */
+int	cotsdrc_maxage = 600;		/* seconds */
+
+static drc_stripe_t cotsdrc[DRC_NSTRIPES];
 
-static void unhash(struct dupreq *);
+static void unhash(drc_stripe_t *, struct dupreq *);
+
+static uint32_t
+svc_cots_drhash(uint32_t xid, struct netbuf *addr)
+{
+	uchar_t *p = (uchar_t *)addr->buf;
+	uint32_t h = xid;
+	uint_t i;
+
+	for (i = 0; i < addr->len; i++)
+		h = h * 31 + p[i];
+	return (h ^ (h >> 16));
+}
 
 /*
- * cotsdrmru points to the head of a circular linked list in lru order.
- * cotsdrmru->dr_next == drlru
+ * Checksum the first DRC_CKSUMLEN bytes of the arguments, which start
+ * where decoding the call header left off.  RPCSEC_GSS puts a sequence
+ * number in front of the arguments that changes with each retransmission,
+ * so those requests go without.
  */
-struct dupreq *cotsdrmru;
+static uint32_t
+svc_cots_cksum(XDR *xdrs, struct rpc_msg *msg)
+{
+	mblk_t *m;
+	uchar_t *p;
+	uint32_t a = 1, b = 0;
+	int left = DRC_CKSUMLEN;
+
+	if (msg->rm_call.cb_cred.oa_flavor == RPCSEC_GSS)
+		return (0);
+
+	/* LINTED pointer alignment */
+	for (m = (mblk_t *)xdrs->x_base; m != NULL && left > 0;
+	    m = m->b_cont) {
+		for (p = m->b_rptr; p < m->b_wptr && left > 0; p++, left--) {
+			a += *p;
+			b += a;
+		}
+	}
+	return ((b << 16) ^ a);
+}
+
+static void
+svc_cots_drfree(struct dupreq *dr)
+{
+	if (dr->dr_resfree != NULL)
+		(*dr->dr_resfree)(dr->dr_resp.buf);
+	if (dr->dr_resp.buf != NULL)
+		kmem_free(dr->dr_resp.buf, dr->dr_resp.maxlen);
+	if (dr->dr_addr.buf != NULL)
+		kmem_free(dr->dr_addr.buf, dr->dr_addr.maxlen);
+	kmem_free(dr, sizeof (*dr));
+}
+
+/*
+ * Find an entry for a new request in stripe ds: the least recently used
+ * one that is done with if it is old enough or the stripe is full, else a
+ * new one.  While at it, let go of an lru entry that has not been used in
+ * a long time.
+ */
+static struct dupreq *
+svc_cots_dralloc(drc_stripe_t *ds, clock_t now)
+{
+	struct dupreq *dr, *lru;
+	int minsize, maxsize;
+
+	ASSERT(MUTEX_HELD(&ds->ds_lock));
+
+	minsize = MAX(cotsmaxdupreqs / DRC_NSTRIPES, 1);
+	maxsize = MAX(cotsdrc_maxentries / DRC_NSTRIPES, minsize);
+
+	if (ds->ds_count > minsize) {
+		lru = ds->ds_mru->dr_next;
+		if (lru != ds->ds_mru && lru->dr_status != DUP_INPROGRESS &&
+		    now - lru->dr_time > SEC_TO_TICK(cotsdrc_maxage)) {
+			ds->ds_mru->dr_next = lru->dr_next;
+			unhash(ds, lru);
+			svc_cots_drfree(lru);
+			ds->ds_count--;
+		}
+	}
+
+	if (ds->ds_count >= minsize) {
+		dr = ds->ds_mru->dr_next;
+		while (dr->dr_status == DUP_INPROGRESS) {
+			dr = dr->dr_next;
+			if (dr == ds->ds_mru->dr_next) {
+				dr = NULL;
+				break;
+			}
+		}
+		if (dr != NULL && (ds->ds_count >= maxsize ||
+		    now - dr->dr_time >= SEC_TO_TICK(cotsdrc_minage))) {
+			unhash(ds, dr);
+			if (dr->dr_resfree) {
+				(*dr->dr_resfree)(dr->dr_resp.buf);
+			}
+			dr->dr_resfree = NULL;
+			ds->ds_mru = dr;
+			return (dr);
+		}
+		if (ds->ds_count >= maxsize) {
+			cmn_err(CE_WARN, "svc_cots_kdup no slots free");
+			return (NULL);
+		}
+	}
+
+	dr = kmem_alloc(sizeof (*dr), KM_NOSLEEP);
+	if (dr == NULL)
+		return (NULL);
+	dr->dr_resp.buf = NULL;
+	dr->dr_resp.maxlen = 0;
+	dr->dr_addr.buf = NULL;
+	dr->dr_addr.maxlen = 0;
+	dr->dr_resfree = NULL;
+	dr->dr_status = DUP_DROP;
+	if (ds->ds_mru) {
+		dr->dr_next = ds->ds_mru->dr_next;
+		ds->ds_mru->dr_next = dr;
+	} else {
+		dr->dr_next = dr;
+	}
+	ds->ds_mru = dr;
+	ds->ds_count++;
+	return (dr);
+}
 
 /*
  * PSARC 2003/523 Contract Private Interface
@@ -754,27 +902,38 @@ svc_cots_kdup(struct svc_req *req, caddr_t res, int size, struct dupreq **drpp,
 	bool_t *dupcachedp)
 {
 	struct rpc_cots_server *stats = CLONE2STATS(req->rq_xprt);
+	cots_data_t *cd = (cots_data_t *)req->rq_xprt->xp_p2buf;
+	struct netbuf *addr = &req->rq_xprt->xp_rtaddr;
+	drc_stripe_t *ds;
 	struct dupreq *dr;
 	uint32_t xid;
 	uint32_t drhash;
 	int status;
 
 	xid = REQTOXID(req);
-	mutex_enter(&cotsdupreq_lock);
+	drhash = svc_cots_drhash(xid, addr);
+	ds = DRC_STRIPE(drhash);
+
 	RSSTAT_INCR(stats, rsdupchecks);
+	mutex_enter(&ds->ds_lock);
 	/*
 	 * Check to see whether an entry already exists in the cache.
 	 */
-	dr = cotsdrhashtbl[XIDHASH(xid)];
+	dr = ds->ds_chain[DRC_CHAIN(drhash)];
 	while (dr != NULL) {
 		if (dr->dr_xid == xid &&
 		    dr->dr_proc == req->rq_proc &&
 		    dr->dr_prog == req->rq_prog &&
 		    dr->dr_vers == req->rq_vers &&
-		    dr->dr_addr.len == req->rq_xprt->xp_rtaddr.len &&
-		    bcmp((caddr_t)dr->dr_addr.buf,
-		    (caddr_t)req->rq_xprt->xp_rtaddr.buf,
+		    dr->dr_addr.len == addr->len &&
+		    bcmp((caddr_t)dr->dr_addr.buf, (caddr_t)addr->buf,
 		    dr->dr_addr.len) == 0) {
+			if (dr->dr_cksum != cd->cd_cksum) {
+				/* Same xid, different request */
+				RSSTAT_INCR(stats, rsdupbadsum);
+				dr = dr->dr_chain;
+				continue;
+			}
 			status = dr->dr_status;
 			if (status == DUP_DONE) {
 				bcopy(dr->dr_resp.buf, res, size);
@@ -783,6 +942,8 @@ svc_cots_kdup(struct svc_req *req, caddr_t res, int size, struct dupreq **drpp,
 				TRACE_0(TR_FAC_KRPC, TR_SVC_COTS_KDUP_DONE,
 				    "svc_cots_kdup: DUP_DONE");
 			} else {
+				if (status == DUP_INPROGRESS)
+					RSSTAT_INCR(stats, rsdupinprog);
 				dr->dr_status = DUP_INPROGRESS;
 				*drpp = dr;
 				TRACE_0(TR_FAC_KRPC,
@@ -790,69 +951,43 @@ svc_cots_kdup(struct svc_req *req, caddr_t res, int size, struct dupreq **drpp,
 				    "svc_cots_kdup: DUP_INPROGRESS");
 			}
 			RSSTAT_INCR(stats, rsdupreqs);
-			mutex_exit(&cotsdupreq_lock);
+			mutex_exit(&ds->ds_lock);
 			return (status);
 		}
 		dr = dr->dr_chain;
 	}
+	RSSTAT_INCR(stats, rsdupmisses);
 
 	/*
 	 * There wasn't an entry, either allocate a new one or recycle
 	 * an old one.
 	 */
-	if (cotsndupreqs < cotsmaxdupreqs) {
-		dr = kmem_alloc(sizeof (*dr), KM_NOSLEEP);
-		if (dr == NULL) {
-			mutex_exit(&cotsdupreq_lock);
-			return (DUP_ERROR);
-		}
-		dr->dr_resp.buf = NULL;
-		dr->dr_resp.maxlen = 0;
-		dr->dr_addr.buf = NULL;
-		dr->dr_addr.maxlen = 0;
-		if (cotsdrmru) {
-			dr->dr_next = cotsdrmru->dr_next;
-			cotsdrmru->dr_next = dr;
-		} else {
-			dr->dr_next = dr;
-		}
-		cotsndupreqs++;
-	} else {
-		dr = cotsdrmru->dr_next;
-		while (dr->dr_status == DUP_INPROGRESS) {
-			dr = dr->dr_next;
-			if (dr == cotsdrmru->dr_next) {
-				cmn_err(CE_WARN, "svc_cots_kdup no slots free");
-				mutex_exit(&cotsdupreq_lock);
-				return (DUP_ERROR);
-			}
-		}
-		unhash(dr);
-		if (dr->dr_resfree) {
-			(*dr->dr_resfree)(dr->dr_resp.buf);
-		}
+	if ((dr = svc_cots_dralloc(ds, ddi_get_lbolt())) == NULL) {
+		mutex_exit(&ds->ds_lock);
+		return (DUP_ERROR);
 	}
-	dr->dr_resfree = NULL;
-	cotsdrmru = dr;
 
-	dr->dr_xid = REQTOXID(req);
+	dr->dr_xid = xid;
 	dr->dr_prog = req->rq_prog;
 	dr->dr_vers = req->rq_vers;
 	dr->dr_proc = req->rq_proc;
-	if (dr->dr_addr.maxlen < req->rq_xprt->xp_rtaddr.len) {
+	dr->dr_hash = drhash;
+	dr->dr_cksum = cd->cd_cksum;
+	dr->dr_time = ddi_get_lbolt();
+	if (dr->dr_addr.maxlen < addr->len) {
 		if (dr->dr_addr.buf != NULL)
 			kmem_free(dr->dr_addr.buf, dr->dr_addr.maxlen);
-		dr->dr_addr.maxlen = req->rq_xprt->xp_rtaddr.len;
+		dr->dr_addr.maxlen = addr->len;
 		dr->dr_addr.buf = kmem_alloc(dr->dr_addr.maxlen, KM_NOSLEEP);
 		if (dr->dr_addr.buf == NULL) {
 			dr->dr_addr.maxlen = 0;
 			dr->dr_status = DUP_DROP;
-			mutex_exit(&cotsdupreq_lock);
+			mutex_exit(&ds->ds_lock);
 			return (DUP_ERROR);
 		}
 	}
-	dr->dr_addr.len = req->rq_xprt->xp_rtaddr.len;
-	bcopy(req->rq_xprt->xp_rtaddr.buf, dr->dr_addr.buf, dr->dr_addr.len);
+	dr->dr_addr.len = addr->len;
+	bcopy(addr->buf, dr->dr_addr.buf, dr->dr_addr.len);
 	if (dr->dr_resp.maxlen < size) {
 		if (dr->dr_resp.buf != NULL)
 			kmem_free(dr->dr_resp.buf, dr->dr_resp.maxlen);
@@ -861,17 +996,15 @@ svc_cots_kdup(struct svc_req *req, caddr_t res, int size, struct dupreq **drpp,
 		if (dr->dr_resp.buf == NULL) {
 			dr->dr_resp.maxlen = 0;
 			dr->dr_status = DUP_DROP;
-			mutex_exit(&cotsdupreq_lock);
+			mutex_exit(&ds->ds_lock);
 			return (DUP_ERROR);
 		}
 	}
 	dr->dr_status = DUP_INPROGRESS;
 
-	drhash = (uint32_t)DRHASH(dr);
-	dr->dr_chain = cotsdrhashtbl[drhash];
-	cotsdrhashtbl[drhash] = dr;
-	cotsdrhashstat[drhash]++;
-	mutex_exit(&cotsdupreq_lock);
+	dr->dr_chain = ds->ds_chain[DRC_CHAIN(drhash)];
+	ds->ds_chain[DRC_CHAIN(drhash)] = dr;
+	mutex_exit(&ds->ds_lock);
 	*drpp = dr;
 	return (DUP_NEW);
 }
@@ -898,24 +1031,23 @@ svc_cots_kdupdone(struct dupreq *dr, caddr_t res, void (*dis_resfree)(),
 }
 
 /*
- * This routine expects that the mutex, cotsdupreq_lock, is already held.
+ * This routine expects that the stripe's mutex is already held.
  */
 static void
-unhash(struct dupreq *dr)
+unhash(drc_stripe_t *ds, struct dupreq *dr)
 {
 	struct dupreq *drt;
 	struct dupreq *drtprev = NULL;
-	uint32_t drhash;
+	uint32_t chain;
 
-	ASSERT(MUTEX_HELD(&cotsdupreq_lock));
+	ASSERT(MUTEX_HELD(&ds->ds_lock));
 
-	drhash = (uint32_t)DRHASH(dr);
-	drt = cotsdrhashtbl[drhash];
+	chain = DRC_CHAIN(dr->dr_hash);
+	drt = ds->ds_chain[chain];
 	while (drt != NULL) {
 		if (drt == dr) {
-			cotsdrhashstat[drhash]--;
 			if (drtprev == NULL) {
-				cotsdrhashtbl[drhash] = drt->dr_chain;
+				ds->ds_chain[chain] = drt->dr_chain;
 			} else {
 				drtprev->dr_chain = drt->dr_chain;
 			}
@@ -944,6 +1076,8 @@ svc_cots_stats_fini(zoneid_t zoneid, struct rpc_cots_server **statsp)
 void
 svc_cots_init(void)
 {
+	int i;
+
 	/*
 	 * Check to make sure that the cots private data will fit into
 	 * the stack buffer allocated by svc_run.  The ASSERT is a safety
@@ -953,5 +1087,6 @@ svc_cots_init(void)
 	ASSERT(sizeof (cots_data_t) <= SVC_P2LEN);
 
 	mutex_init(&cots_kcreate_lock, NULL, MUTEX_DEFAULT, NULL);
-	mutex_init(&cotsdupreq_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < DRC_NSTRIPES; i++)
+		mutex_init(&cotsdrc[i].ds_lock, NULL, MUTEX_DEFAULT, NULL);
 }
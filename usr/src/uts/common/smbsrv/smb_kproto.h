@@ -325,6 +325,7 @@ void smb_net_fini(void);
 void smb_net_txl_constructor(smb_txlst_t *);
 void smb_net_txl_destructor(smb_txlst_t *);
 smb_txreq_t *smb_net_txr_alloc(void);
+void smb_net_txr_reserve(smb_txreq_t *, int);
 void smb_net_txr_free(smb_txreq_t *);
 int smb_net_txr_send(ksocket_t, smb_txlst_t *, smb_txreq_t *);
 
@@ -523,6 +524,7 @@ boolean_t smb_session_isclient(smb_session_t *, const char *);
 void smb_session_correct_keep_alive_values(smb_llist_t *, uint32_t);
 void smb_session_oplock_break(smb_session_t *, uint16_t, uint16_t, uint8_t);
 int smb_session_send(smb_session_t *, uint8_t type, mbuf_chain_t *);
+int smb_session_send_loan(smb_session_t *, mbuf_chain_t *, mblk_t *);
 int smb_session_xprt_gethdr(smb_session_t *, smb_xprt_t *);
 boolean_t smb_session_oplocks_enable(smb_session_t *);
 boolean_t smb_session_levelII_oplocks(smb_session_t *);
@@ -683,6 +685,7 @@ void	smb_idpool_free(smb_idpool_t *pool, uint16_t id);
  * SMB thread function prototypes
  */
 void	smb_session_worker(void *arg);
+void	smb_session_submit(smb_request_t *);
 
 /*
  * SMB locked list function prototypes
@@ -320,6 +320,9 @@ typedef struct {
 	uint32_t	tr_magic;
 	list_node_t	tr_lnd;
 	int		tr_len;
+	int		tr_size;	/* size of tr_data */
+	uint8_t		*tr_data;	/* tr_buf, or larger if need be */
+	mblk_t		*tr_mp;		/* loaned data following tr_data */
 	uint8_t		tr_buf[SMB_XPRT_MAX_SIZE];
 } smb_txreq_t;
 
@@ -932,6 +935,12 @@ typedef struct smb_session {
 	smb_idpool_t		s_uid_pool;
 	smb_txlst_t		s_txlst;
 
+	/* Requests handed to workers, and those waiting for a worker */
+	kmutex_t		s_inflight_mutex;
+	kcondvar_t		s_inflight_cv;
+	uint32_t		s_inflight;
+	list_t			s_backlog;
+
 	volatile uint32_t	s_tree_cnt;
 	volatile uint32_t	s_file_cnt;
 	volatile uint32_t	s_dir_cnt;
@@ -1403,6 +1412,7 @@ typedef struct smb_rw_param {
 	uint32_t rw_total;		/* total bytes (write-raw) */
 	uint16_t rw_dsoff;		/* SMB data offset */
 	uint8_t rw_andx;		/* SMB secondary andx command */
+	boolean_t rw_loan;		/* may read into loaned buffers */
 } smb_rw_param_t;
 
 typedef struct smb_pathname {
@@ -1604,6 +1614,7 @@ typedef struct smb_request {
 	uint32_t		sr_magic;
 	kmutex_t		sr_mutex;
 	list_node_t		sr_session_lnd;
+	list_node_t		sr_backlog_lnd;
 	smb_req_state_t		sr_state;
 	kmem_cache_t		*sr_cache;
 	struct smb_server	*sr_server;
@@ -1623,6 +1634,7 @@ typedef struct smb_request {
 	struct mbuf_chain	command;
 	struct mbuf_chain	reply;
 	struct mbuf_chain	raw_data;
+	mblk_t			*sr_loan;	/* loaned data, after reply */
 	list_t			sr_storage;
 	struct smb_xa		*r_xa;
 	int			andx_prev_wct;
@@ -112,6 +112,8 @@ int smb_vop_open(vnode_t **, int, cred_t *);
 void smb_vop_close(vnode_t *, int, cred_t *);
 int smb_vop_read(vnode_t *, uio_t *, cred_t *);
 int smb_vop_write(vnode_t *, uio_t *, int, uint32_t *, cred_t *);
+int smb_vop_reqzcbuf(vnode_t *, xuio_t *, cred_t *);
+void smb_vop_retzcbuf(vnode_t *, xuio_t *);
 int smb_vop_getattr(vnode_t *, vnode_t *, smb_attr_t *, int, cred_t *);
 int smb_vop_setattr(vnode_t *, vnode_t *, smb_attr_t *, int, cred_t *);
 int smb_vop_access(vnode_t *, int, int, vnode_t *, cred_t *);
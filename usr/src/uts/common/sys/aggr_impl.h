@@ -114,7 +114,6 @@ typedef struct aggr_port_s {
 	mac_client_handle_t lp_mch;
 	const mac_info_t *lp_mip;
 	mac_notify_handle_t lp_mnh;
-	uint_t		lp_tx_idx;		/* idx in group's tx array */
 	uint64_t	lp_ifspeed;
 	link_state_t	lp_link_state;
 	link_duplex_t	lp_link_duplex;
@@ -143,6 +142,21 @@ typedef struct aggr_port_s {
 	void			*lp_tx_notify_mh;
 } aggr_port_t;
 
+/*
+ * The ports of a group which can be used to send, as seen by
+ * aggr_find_tx_ring().  It is read without any lock, so it is never
+ * changed once published: aggr_send_port_enable() and
+ * aggr_send_port_disable() publish a new copy and free the old one
+ * after every CPU has stopped using it.
+ */
+typedef struct aggr_tx_ports_s {
+	uint_t		atp_nports;
+	aggr_port_t	*atp_ports[1];		/* atp_nports entries */
+} aggr_tx_ports_t;
+
+#define	AGGR_TX_PORTS_SIZE(n)	\
+	(offsetof(aggr_tx_ports_t, atp_ports) + (n) * sizeof (aggr_port_t *))
+
 /*
  * A link aggregation group.
  *
@@ -180,10 +194,8 @@ typedef struct aggr_grp_s {
 	mac_handle_t	lg_mh;
 	zoneid_t	lg_zoneid;
 	uint_t		lg_nattached_ports;
-	krwlock_t	lg_tx_lock;
 	uint_t		lg_ntx_ports;
-	aggr_port_t	**lg_tx_ports;		/* array of tx ports */
-	uint_t		lg_tx_ports_size;	/* size of lg_tx_ports */
+	aggr_tx_ports_t	*volatile lg_tx_ports;	/* tx ports, or NULL */
 	uint32_t	lg_tx_policy;		/* outbound policy */
 	uint8_t		lg_mac_tx_policy;
 	uint64_t	lg_ifspeed;
@@ -310,6 +322,8 @@ extern void aggr_recv_cb(void *, mac_resource_handle_t, mblk_t *, boolean_t);
 
 extern void aggr_tx_ring_update(void *, uintptr_t);
 extern void aggr_tx_notify_thread(void *);
+extern void aggr_send_init(void);
+extern void aggr_send_fini(void);
 extern void aggr_send_port_enable(aggr_port_t *);
 extern void aggr_send_port_disable(aggr_port_t *);
 extern void aggr_send_update_policy(aggr_grp_t *, uint32_t);
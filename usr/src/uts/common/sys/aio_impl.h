@@ -95,6 +95,7 @@ typedef struct aio_req_t {
 	} aio_req_iocb;
 	port_kevent_t	*aio_req_portkev;	/* port event structure */
 	int		aio_req_port;		/* port id */
+	cred_t		*aio_req_cred;		/* cred for regular files */
 } aio_req_t;
 
 /*
@@ -85,10 +85,12 @@ extern "C" {
 
 #define	AV_386_2_F16C		0x00001	/* F16C half percision extensions */
 #define	AV_386_2_RDRAND		0x00002	/* RDRAND insn */
+#define	AV_386_2_BMI2		0x00004	/* BMI2 insns (mulx etc.) */
+#define	AV_386_2_ADX		0x00008	/* ADX insns (adcx, adox) */
 
 #define	FMT_AV_386_2							\
 	"\020"								\
-	"\02rdrand\01f16c"
+	"\04adx\03bmi2\02rdrand\01f16c"
 
 #ifdef __cplusplus
 }
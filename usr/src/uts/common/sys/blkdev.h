@@ -48,7 +48,8 @@ extern "C" {
  *
  * 3) Fixed queue depth, for each device.  The adapter driver reports
  *    the queue depth at registration.  We don't have any form of
- *    dynamic flow control.
+ *    dynamic flow control.  A device may have several submission
+ *    queues, each with that depth; see below.
  *
  * 4) Negligible power management support.  The framework does not support
  *    fine grained power management.  If the adapter driver wants to use
@@ -90,10 +91,30 @@ struct bd_xfer {
 	unsigned		x_ndmac;
 	caddr_t			x_kaddr;
 	unsigned		x_flags;
+	unsigned		x_qnum;
 };
 
 #define	BD_XFER_POLL		(1U << 0)	/* no interrupts (dump) */
+#define	BD_XFER_MORE		(1U << 1)	/* more follow (hint) */
 
+/*
+ * BD_XFER_MORE is a hint: the next transfer for the same queue will be
+ * handed to the driver as soon as this one has been accepted, so the
+ * driver may hold off telling the device about this one and let the
+ * next one do it for both.  The last transfer of a run never has it
+ * set.  A driver that holds off must still tell the device about what
+ * it queued if the transfer that follows is then refused.
+ */
+
+/*
+ * A driver whose device has more than one submission queue reports how
+ * many in d_qcount (zero is taken to mean one), and d_qsize is then the
+ * depth of each.  Transfers are spread over the queues by the CPU they
+ * are submitted on, CPU n using queue n % d_qcount, and x_qnum tells the
+ * driver the queue to put a transfer on.  To have completions handled on
+ * the CPU that submitted the transfer, the driver should target each
+ * queue's completion interrupt at the CPUs that use the queue.
+ */
 struct bd_drive {
 	uint32_t		d_qsize;
 	uint32_t		d_maxxfer;
@@ -101,6 +122,7 @@ struct bd_drive {
 	boolean_t		d_hotpluggable;
 	int			d_target;
 	int			d_lun;
+	uint32_t		d_qcount;
 };
 
 struct bd_media {
@@ -124,6 +146,11 @@ struct bd_media {
 #define	BD_INFO_FLAG_HOTPLUGGABLE	(1U << 1)
 #define	BD_INFO_FLAG_READ_ONLY		(1U << 2)
 
+/*
+ * o_free_space, which needs BD_OPS_VERSION_1, tells the device that the
+ * x_nblks blocks at x_blkno no longer hold data (TRIM, UNMAP, deallocate).
+ * The transfer carries no data.
+ */
 struct bd_ops {
 	int	o_version;
 	void	(*o_drive_info)(void *, bd_drive_t *);
@@ -132,9 +159,11 @@ struct bd_ops {
 	int	(*o_sync_cache)(void *, bd_xfer_t *);
 	int	(*o_read)(void *, bd_xfer_t *);
 	int	(*o_write)(void *, bd_xfer_t *);
+	int	(*o_free_space)(void *, bd_xfer_t *);	/* version 1 */
 };
 
 #define	BD_OPS_VERSION_0		0
+#define	BD_OPS_VERSION_1		1
 
 /*
  * Note, one handler *per* address.  Drivers with multiple targets at
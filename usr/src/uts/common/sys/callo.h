@@ -37,6 +37,7 @@
 #include <sys/cyclic.h>
 #include <sys/kstat.h>
 #include <sys/systm.h>
+#include <sys/bitmap.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -230,6 +231,8 @@ typedef struct callout_hash {
  *	Callout list is present in the callout heap.
  * CALLOUT_LIST_FLAG_QUEUED
  *	Callout list is present in the callout queue.
+ * CALLOUT_LIST_FLAG_WHEELED
+ *	Callout list is present in the callout wheel.
  */
 #define	CALLOUT_LIST_FLAG_FREE			0x1
 #define	CALLOUT_LIST_FLAG_ABSOLUTE		0x2
@@ -237,6 +240,7 @@ typedef struct callout_hash {
 #define	CALLOUT_LIST_FLAG_NANO			0x8
 #define	CALLOUT_LIST_FLAG_HEAPED		0x10
 #define	CALLOUT_LIST_FLAG_QUEUED		0x20
+#define	CALLOUT_LIST_FLAG_WHEELED		0x40
 
 struct callout_list {
 	callout_list_t	*cl_next;	/* next in clhash */
@@ -265,6 +269,31 @@ typedef struct callout_heap {
 #endif
 } callout_heap_t;
 
+/*
+ * Callout wheel. Short-term callout lists that are neither hrestime nor
+ * 1-nanosecond resolution ones go into a slot of the wheel instead of the
+ * heap, CALLOUT_WHEEL_SLOTS slots of callout_wheel_res nanoseconds each.
+ * All of them expire within one turn of the wheel from cw_base, so slot
+ * order is expiration order and finding the next expiration only means
+ * finding the next busy slot in cw_map. cw_next is the earliest expiration
+ * on the wheel, which is what the wheel's cyclic is programmed to.
+ */
+#define	CALLOUT_WHEEL_SHIFT	9
+#define	CALLOUT_WHEEL_SLOTS	(1 << CALLOUT_WHEEL_SHIFT)
+#define	CALLOUT_WHEEL_MASK	(CALLOUT_WHEEL_SLOTS - 1)
+#define	CALLOUT_WHEEL_SLOT(x)	\
+		(((x) / callout_wheel_res) & CALLOUT_WHEEL_MASK)
+#define	CALLOUT_WHEEL_RES	CALLOUT_TCP_RESOLUTION
+#define	CALLOUT_WHEEL_SLACK	1000000		/* nanoseconds */
+
+typedef struct callout_wheel {
+	hrtime_t	cw_base;	/* start of the current turn */
+	hrtime_t	cw_next;	/* earliest expiration on the wheel */
+	cyclic_id_t	cw_cyclic;	/* cyclic for the wheel */
+	ulong_t		cw_map[BT_BITOUL(CALLOUT_WHEEL_SLOTS)]; /* busy slots */
+	callout_hash_t	cw_slot[CALLOUT_WHEEL_SLOTS]; /* callout lists */
+} callout_wheel_t;
+
 /*
  * When the heap contains too many empty callout lists, it needs to be
  * cleaned up. The decision to clean up the heap is a function of the
@@ -296,6 +325,12 @@ typedef struct callout_heap {
  *	Number of callout structures allocated.
  * CALLOUT_CLEANUPS
  *	Number of times a callout table is cleaned up.
+ * CALLOUT_TIMEOUTS_WHEEL
+ *	Callouts created since boot that were queued in the wheel.
+ * CALLOUT_TIMEOUTS_HEAP
+ *	Callouts created since boot that were queued in the heap.
+ * CALLOUT_TIMEOUTS_QUEUE
+ *	Callouts created since boot that were queued in the callout queue.
  */
 typedef enum callout_stat_type {
 	CALLOUT_TIMEOUTS,
@@ -306,6 +341,9 @@ typedef enum callout_stat_type {
 	CALLOUT_EXPIRATIONS,
 	CALLOUT_ALLOCATIONS,
 	CALLOUT_CLEANUPS,
+	CALLOUT_TIMEOUTS_WHEEL,
+	CALLOUT_TIMEOUTS_HEAP,
+	CALLOUT_TIMEOUTS_QUEUE,
 	CALLOUT_NUM_STATS
 } callout_stat_type_t;
 
@@ -375,8 +413,11 @@ typedef struct callout_table {
 	int		ct_nreap;	/* # heap entries that need reaping */
 	cyclic_id_t	ct_qcyclic;	/* cyclic for the callout queue */
 	callout_hash_t	ct_queue;	/* overflow queue of callouts */
-#ifndef _LP64
-	char		ct_pad[12];	/* cache alignment */
+	callout_wheel_t	*ct_wheel;	/* wheel of short-term callouts */
+#ifdef _LP64
+	char		ct_pad[56];	/* cache alignment */
+#else
+	char		ct_pad[8];	/* cache alignment */
 #endif
 	/*
 	 * This structure should be aligned to a 64-byte (cache-line)
@@ -404,6 +445,12 @@ typedef struct callout_table {
 		ct_kstat_data[CALLOUT_ALLOCATIONS].value.ui64
 #define	ct_cleanups							\
 		ct_kstat_data[CALLOUT_CLEANUPS].value.ui64
+#define	ct_timeouts_wheel						\
+		ct_kstat_data[CALLOUT_TIMEOUTS_WHEEL].value.ui64
+#define	ct_timeouts_heap						\
+		ct_kstat_data[CALLOUT_TIMEOUTS_HEAP].value.ui64
+#define	ct_timeouts_queue						\
+		ct_kstat_data[CALLOUT_TIMEOUTS_QUEUE].value.ui64
 
 /*
  * CALLOUT_CHUNK is the minimum initial size of each heap, and the amount
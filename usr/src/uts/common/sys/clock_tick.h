@@ -95,6 +95,9 @@ typedef struct clock_tick_set {
 #define	CLOCK_TICK_XCALL_SAFE(cp)	\
 		CPU_IN_SET(clock_tick_online_cpuset, cp->cpu_id)
 
+#define	CLOCK_TICK_CPU_IDLE(cp)		\
+	((cp)->cpu_dispthread == (cp)->cpu_idle_thread)
+
 #define	CLOCK_TICK_PROC_MAX		10
 
 #ifdef	_KERNEL
@@ -101,6 +101,7 @@ typedef struct cmt_lgrp {
 void		pg_cmt_load(cpu_t *, int);
 void		pg_cmt_cpu_startup(cpu_t *);
 int		pg_cmt_can_migrate(cpu_t *, cpu_t *);
+void		pg_cmt_steal(cpu_t *, cpu_t *);
 
 /*
  * CMT platform interfaces
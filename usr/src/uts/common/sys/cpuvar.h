@@ -392,6 +392,7 @@ extern cpu_core_t cpu_core[];
  */
 #define	CPU_DISP_DONTSTEAL	0x01	/* CPU undergoing context swtch */
 #define	CPU_DISP_HALTED		0x02	/* CPU halted waiting for interrupt */
+#define	CPU_DISP_SMTWAIT	0x04	/* CPU idled for SMT sibling */
 
 #endif /* _KERNEL || _KMEMUSER */
 
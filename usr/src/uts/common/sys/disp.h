@@ -79,6 +79,27 @@ typedef struct _disp {
 	hrtime_t	disp_steal;	/* time when threads become stealable */
 } disp_t;
 
+/*
+ * Off-CPU accounting.  When disp_offcpu_enable is set at boot, the time
+ * each thread spends blocked is charged to the kernel stack it blocked
+ * in and the type of synchronization object it blocked on.  The table
+ * is exported as the raw kstat unix:0:offcpu, an array of these; slots
+ * with a zero do_key are unused.
+ */
+#define	DISP_OFFCPU_DEPTH	16	/* frames recorded per stack */
+#define	DISP_OFFCPU_NHIST	40	/* power-of-two ns histogram buckets */
+
+typedef struct disp_offcpu {
+	uint64_t	do_key;		/* hash of stack and type, 0 if free */
+	uint32_t	do_depth;	/* number of frames in do_stack */
+	uint32_t	do_sobj;	/* SOBJ_* type blocked on */
+	uint64_t	do_wchan;	/* most recent wait channel */
+	uint64_t	do_count;	/* number of blocks that ended */
+	uint64_t	do_time;	/* total time blocked (ns) */
+	uint64_t	do_hist[DISP_OFFCPU_NHIST]; /* by highbit(ns) */
+	uint64_t	do_stack[DISP_OFFCPU_DEPTH]; /* innermost frame first */
+} disp_offcpu_t;
+
 #if defined(_KERNEL)
 
 #define	MAXCLSYSPRI	99
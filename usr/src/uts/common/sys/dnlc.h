@@ -76,17 +76,25 @@ extern "C" {
  * storing full names, then we are ok. The space savings are worth it.
  */
 typedef struct ncache {
-	struct ncache *hash_next; 	/* hash chain, MUST BE FIRST */
-	struct ncache *hash_prev;
+	struct ncache *hash_next; 	/* hash chain, NULL terminated */
+	struct ncache *hash_prev;	/* NULL at head, self if unlinked */
+	struct ncache *lru_next;	/* negative LRU or free list */
+	struct ncache *lru_prev;	/* negative LRU */
 	struct vnode *vp;		/* vnode the name refers to */
 	struct vnode *dp;		/* vnode of parent of name */
 	int hash;			/* hash signature */
 	uchar_t namlen;			/* length of name */
+	uchar_t flags;			/* NC_* flags below */
 	char name[1];			/* segment name - null terminated */
 } ncache_t;
 
+#define	NC_REFERENCED	0x01		/* looked up since last aged */
+
 /*
  * Hash table bucket structure of name cache entries for fast lookup.
+ * hash_next is the first entry of the chain and hash_prev the last.
+ * A bucket of a table that has been replaced by a larger one has
+ * hash_prev pointing to the bucket itself.
  */
 typedef struct nc_hash	{
 	ncache_t *hash_next;
@@ -148,6 +156,12 @@ struct nc_stats {
 	kstat_named_t ncs_dir_finipurg;	/* fini purges */
 	kstat_named_t ncs_dir_rec_last;	/* reclaim last */
 	kstat_named_t ncs_dir_recl_any;	/* reclaim any */
+
+	kstat_named_t ncs_lookup_lock;	/* lookups that fell back to locks */
+	kstat_named_t ncs_neg_aged;	/* negative entries aged out */
+	kstat_named_t ncs_resizes;	/* hash table resizes */
+	kstat_named_t ncs_path_walks;	/* multi-component lookups */
+	kstat_named_t ncs_path_comps;	/* components they resolved */
 };
 
 /*
@@ -174,6 +188,8 @@ struct nc_stats {
 #include <sys/vfs.h>
 #include <sys/vnode.h>
 
+struct pathname;
+
 extern int ncsize;		/* set in param_init() # of dnlc entries */
 extern vnode_t negative_cache_vnode;
 #define	DNLC_NO_VNODE &negative_cache_vnode
@@ -182,6 +198,7 @@ void	dnlc_init(void);
 void	dnlc_enter(vnode_t *, const char *, vnode_t *);
 void	dnlc_update(vnode_t *, const char *, vnode_t *);
 vnode_t	*dnlc_lookup(vnode_t *, const char *);
+vnode_t	*dnlc_lookup_path(vnode_t *, struct pathname *);
 void	dnlc_purge(void);
 void	dnlc_purge_vp(vnode_t *);
 int	dnlc_purge_vfsp(vfs_t *, int);
@@ -861,6 +861,9 @@ typedef struct dtrace_difo {
 	uint_t dtdo_krelen;		/* length of krelo table */
 	uint_t dtdo_urelen;		/* length of urelo table */
 	uint_t dtdo_xlmlen;		/* length of translator table */
+#else
+	void *dtdo_jit;			/* native code (optional) */
+	size_t dtdo_jitlen;		/* length of native code */
 #endif
 } dtrace_difo_t;
 
@@ -1112,6 +1115,9 @@ typedef struct dtrace_status {
 	uint64_t dtst_filled;			/* number of filled bufs */
 	uint64_t dtst_stkstroverflows;		/* stack string tab overflows */
 	uint64_t dtst_dblerrors;		/* errors in ERROR probes */
+	uint64_t dtst_aggdrops_scalar;		/* agg drops, integer keys */
+	uint64_t dtst_aggdrops_string;		/* agg drops, string keys */
+	uint64_t dtst_aggdrops_stack;		/* agg drops, stack keys */
 	char dtst_killed;			/* non-zero if killed */
 	char dtst_exiting;			/* non-zero if exit() called */
 	char dtst_pad[6];			/* pad out to 64-bit align */
@@ -245,10 +245,21 @@ typedef struct dtrace_aggregation {
 	dtrace_action_t *dtag_first;		/* first action in tuple */
 	uint32_t dtag_base;			/* base of aggregation */
 	uint8_t dtag_hasarg;			/* boolean:  has argument */
+	uint8_t dtag_keyclass;			/* class of key */
 	uint64_t dtag_initial;			/* initial value */
 	void (*dtag_aggregate)(uint64_t *, uint64_t, uint64_t);
 } dtrace_aggregation_t;
 
+/*
+ * Aggregations are classed by what their keys hold, for the purpose of
+ * accounting for aggregation drops.  A key with a stack is a stack key
+ * whether or not it also holds strings.
+ */
+#define	DTRACE_AGGKEY_SCALAR		0	/* integers only */
+#define	DTRACE_AGGKEY_STRING		1	/* has a string */
+#define	DTRACE_AGGKEY_STACK		2	/* has a stack */
+#define	DTRACE_AGGKEY_NCLASS		3
+
 /*
  * DTrace Buffers
  *
@@ -432,7 +443,8 @@ typedef struct dtrace_buffer {
 #endif
 	uint64_t dtb_switched;			/* time of last switch */
 	uint64_t dtb_interval;			/* observed switch interval */
-	uint64_t dtb_pad2[6];			/* pad to avoid false sharing */
+	uint64_t dtb_aggdrops[DTRACE_AGGKEY_NCLASS]; /* drops by key class */
+	uint64_t dtb_pad2[3];			/* pad to avoid false sharing */
 } dtrace_buffer_t;
 
 /*
@@ -1227,6 +1239,45 @@ typedef struct dtrace_errhash {
 
 #endif	/* DTRACE_ERRDEBUG */
 
+/*
+ * DTrace DIF JIT
+ *
+ * Where the ISA supports it, dtrace_difo_init() has each validated DIF
+ * object translated into native code by dtrace_dif_jit(), and
+ * dtrace_dif_emulate() runs that code instead of interpreting the DIF.
+ * The native code keeps the DIF registers and the tuple stack in a
+ * dtrace_jit_frame_t, and calls the dtrace_jit_*() functions for anything
+ * that must be checked or may fault, so that the checks made are exactly
+ * those of the interpreter.  After each such call it tests for
+ * CPU_DTRACE_FAULT, and on a fault returns zero with djf_pc set to the
+ * faulting instruction.  dtrace_dif_jit() returns NULL for a DIF object it
+ * cannot translate, which is then interpreted as before.
+ */
+typedef struct dtrace_jit_frame {
+	uint64_t djf_regs[DIF_DIR_NREGS];	/* DIF registers */
+	volatile uint16_t *djf_flags;		/* this CPU's DTrace flags */
+	uint_t djf_pc;				/* faulting instruction */
+	uint_t djf_ttop;			/* top of tuple stack */
+	dtrace_mstate_t *djf_mstate;
+	dtrace_vstate_t *djf_vstate;
+	dtrace_state_t *djf_state;
+	dtrace_key_t djf_tupregs[DIF_DTR_NREGS + 2];
+} dtrace_jit_frame_t;
+
+typedef uint64_t dtrace_jit_t(dtrace_jit_frame_t *);
+
+extern dtrace_jit_t *dtrace_dif_jit(dtrace_difo_t *, dtrace_vstate_t *,
+    size_t *);
+extern void dtrace_dif_jit_free(dtrace_jit_t *, size_t);
+
+extern uint64_t dtrace_jit_load(dtrace_jit_frame_t *, uint_t, uint64_t);
+extern void dtrace_jit_store(dtrace_jit_frame_t *, uint_t, uint64_t,
+    uint64_t);
+extern uint64_t dtrace_jit_variable(dtrace_jit_frame_t *, uint_t, uint64_t);
+extern int64_t dtrace_jit_scmp(dtrace_jit_frame_t *, uint64_t, uint64_t);
+extern void dtrace_jit_push(dtrace_jit_frame_t *, dif_instr_t);
+extern void dtrace_jit_call(dtrace_jit_frame_t *, uint_t, uint_t);
+
 /*
  * DTrace Toxic Ranges
  *
@@ -237,7 +237,7 @@ typedef enum {
 #define	SDEV_RELE(dv)	VN_RELE(SDEVTOV(dv))
 #define	SDEV_SIMPLE_RELE(dv)	{	\
 	mutex_enter(&SDEVTOV(dv)->v_lock);	\
-	SDEVTOV(dv)->v_count--;	\
+	VN_RELE_LOCKED(SDEVTOV(dv));	\
 	mutex_exit(&SDEVTOV(dv)->v_lock);	\
 }
 
@@ -104,6 +104,7 @@ extern	void	tdirtrunc(struct tmpnode *);
 extern	void	*tmp_memalloc(size_t, int);
 extern	void	tmp_memfree(void *, size_t);
 extern	int	tmp_resv(struct tmount *, struct tmpnode *, size_t, int);
+extern	void	tmp_unresv(struct tmount *, struct tmpnode *, size_t);
 extern	int	tmp_taccess(void *, int, struct cred *);
 extern	int	tmp_sticky_remove_access(struct tmpnode *, struct tmpnode *,
 	struct cred *);
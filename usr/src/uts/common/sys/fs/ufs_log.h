@@ -406,6 +406,8 @@ typedef struct mt_map {
 	kcondvar_t		mtm_cv_commit;
 	kcondvar_t		mtm_cv_next;
 	kcondvar_t		mtm_cv_eot;
+	long			mtm_syncops;	/* sync ops this transaction */
+	long			mtm_lastsyncops; /* ... the last transaction */
 
 	/*
 	 * mutex that protects all the fields in mt_map except
@@ -534,6 +536,11 @@ struct logstats {
 	kstat_named_t ls_mreads;	/* log master reads */
 	kstat_named_t ls_rreads;	/* log roll reads */
 	kstat_named_t ls_rwrites;	/* log roll writes */
+	kstat_named_t ls_synccommits;	/* commits by sync ops */
+	kstat_named_t ls_syncops;	/* sync ops committed */
+	kstat_named_t ls_syncdelays;	/* commits held for more sync ops */
+	kstat_named_t ls_commitwait;	/* ns sync ops waited for commits */
+	kstat_named_t ls_commitwrite;	/* ns spent writing commits */
 };
 
 #ifdef _KERNEL
@@ -147,6 +147,9 @@ typedef enum {
 	ZFS_PROP_FILESYSTEM_COUNT,
 	ZFS_PROP_SNAPSHOT_COUNT,
 	ZFS_PROP_REDUNDANT_METADATA,
+	ZFS_PROP_PRIMARYCACHE_LIMIT,
+	ZFS_PROP_SPECIAL_SMALL_BLOCKS,
+	ZFS_PROP_DNODESIZE,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
@@ -189,6 +192,7 @@ typedef enum {
 	ZPOOL_PROP_COMMENT,
 	ZPOOL_PROP_EXPANDSZ,
 	ZPOOL_PROP_FREEING,
+	ZPOOL_PROP_AUTOTRIM,
 	ZPOOL_NUM_PROPS
 } zpool_prop_t;
 
@@ -345,6 +349,16 @@ typedef enum {
 	ZFS_REDUNDANT_METADATA_MOST
 } zfs_redundant_metadata_type_t;
 
+typedef enum {
+	ZFS_DNSIZE_LEGACY = 0,
+	ZFS_DNSIZE_AUTO = 1,
+	ZFS_DNSIZE_1K = 1024,
+	ZFS_DNSIZE_2K = 2048,
+	ZFS_DNSIZE_4K = 4096,
+	ZFS_DNSIZE_8K = 8192,
+	ZFS_DNSIZE_16K = 16384
+} zfs_dnsize_type_t;
+
 /*
  * On-disk version number.
  */
@@ -508,6 +522,7 @@ typedef struct zpool_rewind_policy {
 #define	ZPOOL_CONFIG_DTL		"DTL"
 #define	ZPOOL_CONFIG_SCAN_STATS		"scan_stats"	/* not stored on disk */
 #define	ZPOOL_CONFIG_VDEV_STATS		"vdev_stats"	/* not stored on disk */
+#define	ZPOOL_CONFIG_VDEV_QUEUE_STATS	"vdev_queue_stats" /* not on disk */
 #define	ZPOOL_CONFIG_WHOLE_DISK		"whole_disk"
 #define	ZPOOL_CONFIG_ERRCOUNT		"error_count"
 #define	ZPOOL_CONFIG_NOT_PRESENT	"not_present"
@@ -520,6 +535,7 @@ typedef struct zpool_rewind_policy {
 #define	ZPOOL_CONFIG_UNSPARE		"unspare"
 #define	ZPOOL_CONFIG_PHYS_PATH		"phys_path"
 #define	ZPOOL_CONFIG_IS_LOG		"is_log"
+#define	ZPOOL_CONFIG_IS_SPECIAL		"is_special"
 #define	ZPOOL_CONFIG_L2CACHE		"l2cache"
 #define	ZPOOL_CONFIG_HOLE_ARRAY		"hole_array"
 #define	ZPOOL_CONFIG_VDEV_CHILDREN	"vdev_children"
@@ -579,6 +595,7 @@ typedef struct zpool_rewind_policy {
 #define	VDEV_TYPE_HOLE			"hole"
 #define	VDEV_TYPE_SPARE			"spare"
 #define	VDEV_TYPE_LOG			"log"
+#define	VDEV_TYPE_SPECIAL		"special"
 #define	VDEV_TYPE_L2CACHE		"l2cache"
 
 /*
@@ -725,6 +742,29 @@ typedef struct vdev_stat {
 	uint64_t	vs_scan_processed;	/* scan processed bytes	*/
 } vdev_stat_t;
 
+/*
+ * Vdev I/O scheduler statistics, kept per I/O class in the same order as
+ * the kernel's queueable zio priorities: sync read, sync write, async read,
+ * async write, scrub, trim.  Latency histograms are power-of-two buckets of
+ * nanoseconds: bucket b counts I/Os that took [2^b, 2^(b+1)) ns, with the
+ * last bucket also counting anything slower.  The queue histogram measures
+ * time from queueing to issue, the disk histogram time from issue to
+ * completion.  For interior vdevs these are the sums over their leaves.
+ * Note: all fields should be 64-bit because this is passed between kernel
+ * and userland as an nvlist uint64 array.
+ */
+#define	VDEV_QUEUE_CLASSES	6
+#define	VDEV_LAT_HISTO_BUCKETS	37	/* up to 2^37 ns (~137s) */
+
+typedef struct vdev_queue_stat {
+	uint64_t	vqs_active[VDEV_QUEUE_CLASSES];	/* issued i/os */
+	uint64_t	vqs_pending[VDEV_QUEUE_CLASSES]; /* queued i/os */
+	uint64_t	vqs_queue_histo[VDEV_QUEUE_CLASSES]
+	    [VDEV_LAT_HISTO_BUCKETS];
+	uint64_t	vqs_disk_histo[VDEV_QUEUE_CLASSES]
+	    [VDEV_LAT_HISTO_BUCKETS];
+} vdev_queue_stat_t;
+
 /*
  * DDT statistics.  Note: all fields should be 64-bit because this
  * is passed between kernel and userland as an nvlist uint64 array.
@@ -841,6 +881,8 @@ typedef enum zfs_ioc {
 	ZFS_IOC_BOOKMARK,
 	ZFS_IOC_GET_BOOKMARKS,
 	ZFS_IOC_DESTROY_BOOKMARKS,
+	ZFS_IOC_LIST_BATCH,
+	ZFS_IOC_POOL_TRIM,
 	ZFS_IOC_LAST
 } zfs_ioc_t;
 
@@ -84,6 +84,24 @@ typedef struct idm_so_timed_socket_s {
 	int		it_socket_error_code;
 } idm_so_timed_socket_t;
 
+/*
+ * The TX thread gathers the iovecs of up to IDM_SO_TX_BATCH PDUs and
+ * hands them to the socket in a single send.  A PDU takes at most five
+ * iovecs: header, header digest, data, pad and data digest.
+ */
+#define	IDM_SO_TX_BATCH		16
+#define	IDM_SO_TX_PDU_IOVLEN	5
+
+typedef struct idm_so_tx_batch_s {
+	int		tb_npdu;
+	int		tb_iovlen;
+	size_t		tb_len;
+	idm_pdu_t	*tb_pdu[IDM_SO_TX_BATCH];
+	uint32_t	tb_hdr_crc[IDM_SO_TX_BATCH];
+	uint32_t	tb_data_crc[IDM_SO_TX_BATCH];
+	iovec_t		tb_iov[IDM_SO_TX_BATCH * IDM_SO_TX_PDU_IOVLEN];
+} idm_so_tx_batch_t;
+
 /* Socket functions */
 
 ksocket_t
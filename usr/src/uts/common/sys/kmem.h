@@ -80,6 +80,7 @@ extern size_t kmem_dump_finish(char *buf, size_t size);
 #define	KMC_KMEM_ALLOC	0x00200000	/* internal use only */
 #define	KMC_IDENTIFIER	0x00400000	/* internal use only */
 #define	KMC_PREFILL	0x00800000
+#define	KMC_FASTREAP	0x01000000	/* reap when memory low */
 
 struct kmem_cache;		/* cache structure is opaque to kmem clients */
 
@@ -114,6 +115,7 @@ extern void kmem_thread_init(void);
 extern void kmem_mp_init(void);
 extern void kmem_reap(void);
 extern void kmem_reap_idspace(void);
+extern void kmem_reap_fast(void);
 extern int kmem_debugging(void);
 extern size_t kmem_avail(void);
 extern size_t kmem_maxavail(void);
@@ -128,6 +130,7 @@ extern void *kmem_cache_alloc(kmem_cache_t *, int);
 extern void kmem_cache_free(kmem_cache_t *, void *);
 extern uint64_t kmem_cache_stat(kmem_cache_t *, char *);
 extern void kmem_cache_reap_now(kmem_cache_t *);
+extern void kmem_cache_reap_soon(kmem_cache_t *);
 extern void kmem_cache_move_notify(kmem_cache_t *, void *);
 
 #endif	/* _KERNEL */
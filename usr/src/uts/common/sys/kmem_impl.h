@@ -48,7 +48,7 @@ extern "C" {
  * Lock order:
  * 1. cache_lock
  * 2. cc_lock in order by CPU ID
- * 3. cache_depot_lock
+ * 3. cache_depot_lock or kld_lock (never both)
  *
  * Do not call kmem_cache_alloc() or taskq_dispatch() while holding any of the
  * above locks.
@@ -229,9 +229,12 @@ typedef struct kmem_slab {
 	long			slab_chunks;	/* chunks (bufs) in this slab */
 	uint32_t		slab_stuck_offset; /* unmoved buffer offset */
 	uint16_t		slab_later_count; /* cf KMEM_CBRC_LATER */
-	uint16_t		slab_flags;	/* bits to mark the slab */
+	uint8_t			slab_flags;	/* bits to mark the slab */
+	uint8_t			slab_lgrpid;	/* lgroup of slab memory */
 } kmem_slab_t;
 
+#define	KMEM_SLAB_NOLGRP	0xff	/* slab_lgrpid unknown */
+
 #define	KMEM_HASH_INITIAL	64
 
 #define	KMEM_HASH(cp, buf)	\
@@ -261,6 +264,10 @@ typedef struct kmem_magtype {
 #define	KMEM_CACHE_SIZE(ncpus)	\
 	((size_t)(&((kmem_cache_t *)0)->cache_cpu[ncpus]))
 
+/* The per-lgroup depots, if any, follow the per-cpu caches */
+#define	KMEM_CACHE_LGRP_SIZE(ncpus, nlgrps)	\
+	(KMEM_CACHE_SIZE(ncpus) + (nlgrps) * sizeof (kmem_lgrp_depot_t))
+
 /* Offset from kmem_cache->cache_cpu for per cpu caches */
 #define	KMEM_CPU_CACHE_OFFSET(cpuid)					\
 	((size_t)(&((kmem_cache_t *)0)->cache_cpu[cpuid]) -		\
@@ -292,6 +299,20 @@ typedef struct kmem_maglist {
 	uint64_t	ml_alloc;	/* allocations from this list */
 } kmem_maglist_t;
 
+/*
+ * Per-lgroup depot of full magazines.  Full magazines are freed to the
+ * depot of the freeing CPU's lgroup and are reloaded from there first, so
+ * that constructed buffers tend to stay on the socket that last used them.
+ * Empty magazines carry no locality and stay in the cache-wide depot.
+ * On LP64 each depot fills exactly one KMEM_CPU_CACHE_SIZE line.
+ */
+typedef struct kmem_lgrp_depot {
+	kmutex_t	kld_lock;	/* protects this lgroup's depot */
+	kmem_maglist_t	kld_full;	/* full magazines */
+	long		kld_reclaim;	/* kld_full total before reclaim */
+	uint64_t	kld_remote;	/* full magazines taken by other lgrps */
+} kmem_lgrp_depot_t;
+
 typedef struct kmem_defrag {
 	/*
 	 * Statistics
@@ -348,6 +369,11 @@ struct kmem_cache {
 	uint64_t	cache_lookup_depth;	/* hash lookup depth */
 	uint64_t	cache_depot_contention;	/* mutex contention count */
 	uint64_t	cache_depot_contention_prev; /* previous snapshot */
+	uint64_t	cache_slab_remote_free;	/* slab frees from remote lgrp */
+	uint64_t	cache_magazine_grow;	/* magazine size increases */
+	uint64_t	cache_magazine_shrink;	/* magazine size decreases */
+	uint64_t	cache_reap_soon;	/* asynchronous depot reaps */
+	uint64_t	cache_depot_reaped;	/* magazines reaped from depot */
 
 	/*
 	 * Cache properties
@@ -399,6 +425,10 @@ struct kmem_cache {
 	kmem_magtype_t	*cache_magtype;		/* magazine type */
 	kmem_maglist_t	cache_full;		/* full magazines */
 	kmem_maglist_t	cache_empty;		/* empty magazines */
+	kmem_lgrp_depot_t *cache_lgrp_depot;	/* per-lgroup full magazines */
+	int		cache_lgrp_ndepot;	/* number of lgroup depots */
+	int		cache_depot_quiet;	/* intervals w/o contention */
+	uint32_t	cache_reap_pending;	/* reap_soon task queued */
 	void		*cache_dumpfreelist;	/* heap during crash dump */
 	void		*cache_dumplog;		/* log entry during dump */
 
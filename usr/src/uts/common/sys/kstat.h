@@ -50,6 +50,7 @@ typedef int	kid_t;		/* unique kstat id */
 #define	KSTAT_IOC_CHAIN_ID	KSTAT_IOC_BASE | 0x01
 #define	KSTAT_IOC_READ		KSTAT_IOC_BASE | 0x02
 #define	KSTAT_IOC_WRITE		KSTAT_IOC_BASE | 0x03
+#define	KSTAT_IOC_READ_BULK	KSTAT_IOC_BASE | 0x04
 
 /*
  * /dev/kstat ioctl usage (kd denotes /dev/kstat descriptor):
@@ -57,6 +58,13 @@ typedef int	kid_t;		/* unique kstat id */
  *	kcid = ioctl(kd, KSTAT_IOC_CHAIN_ID, NULL);
  *	kcid = ioctl(kd, KSTAT_IOC_READ, kstat_t *);
  *	kcid = ioctl(kd, KSTAT_IOC_WRITE, kstat_t *);
+ *	kcid = ioctl(kd, KSTAT_IOC_READ_BULK, kstat_bulk_t *);
+ *
+ * KSTAT_IOC_READ_BULK does a KSTAT_IOC_READ of each of the kb_count
+ * kstat headers in the array at kb_ksp, in order, in one call.  It stops
+ * at the first one that fails, returning that error; kb_done is set to
+ * the number read successfully, and the failed header has been updated
+ * just as KSTAT_IOC_READ would have (e.g. with the size needed).
  */
 
 #define	KSTAT_STRLEN	31	/* 30 chars + NULL; must be 16 * n - 1 */
@@ -92,6 +100,12 @@ typedef struct kstat {
 	void		*ks_lock;	/* protects this kstat's data */
 } kstat_t;
 
+typedef struct kstat_bulk {
+	uint_t		kb_count;	/* number of kstats to read */
+	uint_t		kb_done;	/* number read (returned) */
+	kstat_t		*kb_ksp;	/* array of kb_count kstat headers */
+} kstat_bulk_t;
+
 #ifdef _SYSCALL32
 
 typedef int32_t kid32_t;
@@ -123,6 +137,12 @@ typedef struct kstat32 {
 	caddr32_t	_ks_lock;
 } kstat32_t;
 
+typedef struct kstat_bulk32 {
+	uint32_t	kb_count;
+	uint32_t	kb_done;
+	caddr32_t	kb_ksp;		/* kstat32_t array */
+} kstat_bulk32_t;
+
 #endif	/* _SYSCALL32 */
 
 /*
@@ -328,6 +328,7 @@ typedef	mblk_t	*(*mac_ring_send_t)(void *, mblk_t *);
 typedef	mblk_t	*(*mac_ring_poll_t)(void *, int);
 
 typedef int	(*mac_ring_stat_t)(mac_ring_driver_t, uint_t, uint64_t *);
+typedef void	(*mac_ring_itr_t)(mac_ring_driver_t, uint_t);
 
 typedef struct mac_ring_info_s {
 	mac_ring_driver_t	mri_driver;
@@ -346,6 +347,13 @@ typedef struct mac_ring_info_s {
 	 * etc.
 	 */
 	uint_t			mri_flags;
+	/*
+	 * Optional for Rx rings: set the minimum interval between the
+	 * ring's interrupts, in microseconds. When provided, the Rx SRS
+	 * adapts the interval to the load; otherwise the driver's own
+	 * fixed interrupt throttling is left alone.
+	 */
+	mac_ring_itr_t		mri_itr;
 } mac_ring_info_s;
 
 #define	mri_tx			mrfunion.send
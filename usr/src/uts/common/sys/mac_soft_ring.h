@@ -109,6 +109,8 @@ struct mac_soft_ring_s {
 	uint32_t	s_ring_total_inpkt;
 	uint32_t	s_ring_total_rbytes;
 	uint32_t	s_ring_drops;
+	uint64_t	s_ring_lro_pkts;	/* merged packets, srs_lock */
+	uint64_t	s_ring_lro_segs;	/* segments merged, srs_lock */
 	struct mac_client_impl_s *s_ring_mcip;
 	kstat_t		*s_ring_ksp;
 
@@ -244,6 +246,12 @@ typedef struct mac_srs_rx_s {
 	uint32_t		sr_drain_finish_intr;
 	/* Polling thread needs to schedule worker wakeup */
 	uint32_t		sr_poll_worker_wakeup;
+
+	/* Adaptive interrupt moderation, see mac_rx_srs_itr() */
+	uint32_t		sr_itr;		/* interval set, usecs */
+	uint32_t		sr_itr_intrs;	/* interrupts this period */
+	uint32_t		sr_itr_pkts;	/* packets this period */
+	clock_t			sr_itr_start;	/* lbolt period started */
 } mac_srs_rx_t;
 
 /*
@@ -86,6 +86,7 @@ extern "C" {
 #define	MNTOPT_WSIZE	"wsize"		/* Max NFS write size (bytes) */
 #define	MNTOPT_TIMEO	"timeo"		/* NFS timeout (1/10 sec) */
 #define	MNTOPT_RETRANS	"retrans"	/* Max retransmissions (soft mnts) */
+#define	MNTOPT_NCONNECT	"nconnect"	/* Connections per NFS server */
 #define	MNTOPT_ACTIMEO	"actimeo"	/* Attr cache timeout (sec) */
 #define	MNTOPT_ACREGMIN	"acregmin"	/* Min attr cache timeout (files) */
 #define	MNTOPT_ACREGMAX	"acregmax"	/* Max attr cache timeout (files) */
@@ -53,10 +53,15 @@ struct i_nvp {
 			i_nvp_t	*_nvi_prev;	/* pointer to prev nvpair */
 		} _nvi;
 	} _nvi_un;
+	union {
+		uint64_t	_nvi_align;	/* ensure alignment */
+		i_nvp_t	*_nvi_hashnext;		/* next nvpair in bucket */
+	} _nvi_hash_un;
 	nvpair_t nvi_nvp;			/* nvpair */
 };
 #define	nvi_next	_nvi_un._nvi._nvi_next
 #define	nvi_prev	_nvi_un._nvi._nvi_prev
+#define	nvi_hashnext	_nvi_hash_un._nvi_hashnext
 
 typedef struct {
 	i_nvp_t		*nvp_list;	/* linked list of nvpairs */
@@ -64,6 +69,9 @@ typedef struct {
 	i_nvp_t		*nvp_curr;	/* current walker nvpair */
 	nv_alloc_t	*nvp_nva;	/* pluggable allocator */
 	uint32_t	nvp_stat;	/* internal state */
+	uint32_t	nvp_nentries;	/* number of nvpairs */
+	i_nvp_t		**nvp_hashtable; /* nvpairs by name, if indexed */
+	uint32_t	nvp_nbuckets;	/* buckets in nvp_hashtable */
 } nvpriv_t;
 
 #ifdef	__cplusplus
@@ -0,0 +1,66 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _SYS_PCRWLOCK_H
+#define	_SYS_PCRWLOCK_H
+
+/*
+ * Per-CPU reader/writer locks, for data that is read far more often than
+ * it is written.  See pcrwlock.c.
+ */
+
+#include <sys/types.h>
+#include <sys/mutex.h>
+#include <sys/condvar.h>
+#include <sys/rwlock.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#if defined(_KERNEL) || defined(_KMEMUSER)
+
+typedef struct pcrw_slot {
+	volatile ulong_t	ps_readers;	/* entries less exits */
+	char			ps_pad[64 - sizeof (ulong_t)];
+} pcrw_slot_t;
+
+typedef struct pcrwlock {
+	kmutex_t		pcrw_lock;	/* protects writer state */
+	kcondvar_t		pcrw_cv;	/* readers and writers wait */
+	kthread_t *volatile	pcrw_writer;	/* owner if write locked */
+	volatile uint_t		pcrw_wwant;	/* writers holding or waiting */
+	uint_t			pcrw_nslots;
+	pcrw_slot_t		*pcrw_slots;	/* one per CPU */
+} pcrwlock_t;
+
+#endif	/* _KERNEL || _KMEMUSER */
+
+#ifdef	_KERNEL
+
+extern void	pcrw_init(pcrwlock_t *);
+extern void	pcrw_destroy(pcrwlock_t *);
+extern void	pcrw_enter(pcrwlock_t *, krw_t);
+extern void	pcrw_exit(pcrwlock_t *);
+extern int	pcrw_read_held(pcrwlock_t *);
+extern int	pcrw_write_held(pcrwlock_t *);
+
+#define	PCRW_READ_HELD(l)	pcrw_read_held(l)
+#define	PCRW_WRITE_HELD(l)	pcrw_write_held(l)
+#define	PCRW_LOCK_HELD(l)	(PCRW_READ_HELD(l) || PCRW_WRITE_HELD(l))
+
+#endif	/* _KERNEL */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_PCRWLOCK_H */
@@ -134,6 +134,7 @@ typedef struct pghw {
 	 */
 	uint_t		pghw_kstat_gen;
 	pghw_util_t	pghw_stats;	/* Utilization data */
+	uint64_t	pghw_steals;	/* threads stolen within the PG */
 } pghw_t;
 
 /*
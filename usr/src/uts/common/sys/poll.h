@@ -71,6 +71,8 @@ typedef unsigned long	nfds_t;
 #define	POLLNVAL	0x0020		/* invalid pollfd entry */
 
 #define	POLLREMOVE	0x0800	/* remove a cached poll fd from /dev/poll */
+#define	POLLONESHOT	0x1000	/* /dev/poll: disarm fd after an event */
+#define	POLLET		0x2000	/* /dev/poll: report only new events */
 
 #ifdef _KERNEL
 
@@ -45,6 +45,9 @@
  * chained onto a device's pollhead, and these are kept in a hash table (7)
  * inside the pcache_t.  The hash table allows efficient conversion of a
  * given fd to its corresponding polldat_t.
+ * A /dev/poll cache also links every polldat_t whose bit is set onto a
+ * ready list (8), so that DP_POLL only visits fds which pollwakeup() has
+ * notified instead of scanning the bitmap of the whole fd space.
  *
  * (1)              (2)
  * +-----------+    +-------------+
@@ -62,7 +65,7 @@
  * polldat hash     +-------------+    (4) bitmap representing fd space
  * [_][_][_][_]<----|             |--->000010010010001010101010101010110
  *  |  |  |  |      | pollcache_t |
- *  .  v  .  .      |             |
+ *  .  v  .  .      |             |--->[polldat_t]->[polldat_t] (8)
  *    [polldat_t]   +-------------+
  *     |
  *    [polldat_t]
@@ -84,6 +87,7 @@
 
 #include <sys/thread.h>
 #include <sys/file.h>
+#include <sys/list.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -160,6 +164,7 @@ typedef struct polldat {
 	int		pd_nsets;	/* num of xref sets, used by poll(2) */
 	xref_t		*pd_ref;	/* ptr to xref info, 1 for each set */
 	struct port_kevent *pd_portev;	/* associated port event struct */
+	list_node_t	pd_rdynode;	/* ready list linkage, devpoll only */
 } polldat_t;
 
 /*
@@ -183,17 +188,24 @@ typedef struct pollcache {
 	kcondvar_t	pc_busy_cv;	/* cv to wait on if ps_busy != 0 */
 	kcondvar_t	pc_cv;		/* cv to wait on if needed */
 	pid_t		pc_pid;		/* for check acc rights, devpoll only */
-	int		pc_mapstart;	/* where search start, devpoll only */
+	list_t		pc_rdylist;	/* notified polldats, devpoll only */
+	int		pc_nready;	/* no. of polldats on pc_rdylist */
 } pollcache_t;
 
 /* pc_flag */
 #define	T_POLLWAKE	0x02	/* pollwakeup() occurred */
+#define	PC_RDYLIST	0x04	/* cache keeps pc_rdylist (/dev/poll) */
+
+/*
+ * /dev/poll event modifiers kept in pd_events, never passed to VOP_POLL
+ */
+#define	POLLDPFLAGS	(POLLONESHOT | POLLET)
 
 #if defined(_KERNEL)
 /*
  * Internal routines.
  */
-extern void pollnotify(pollcache_t *, int);
+extern void pollnotify(pollcache_t *, polldat_t *);
 
 /*
  * public poll head interfaces (see poll.h):
@@ -250,6 +262,8 @@ extern void pcache_destroy(pollcache_t *);
  *  pcache_grow_map	grows the pollcache bitmap
  *  pcache_update_xref	update cross ref (from polldat back to cacheset) info
  *  pcache_clean_entry	cleanup an entry in pcache and more...
+ *  pcache_ready	set an fd's bit and put it on the ready list
+ *  pcache_unready	clear an fd's bit and take it off the ready list
  */
 extern polldat_t *pcache_lookup_fd(pollcache_t *, int);
 extern polldat_t *pcache_alloc_fd(int);
@@ -259,6 +273,8 @@ extern void pcache_grow_hashtbl(pollcache_t *, nfds_t);
 extern void pcache_grow_map(pollcache_t *, int);
 extern void pcache_update_xref(pollcache_t *, int, ssize_t, int);
 extern void pcache_clean_entry(pollstate_t *, int);
+extern void pcache_ready(pollcache_t *, polldat_t *);
+extern void pcache_unready(pollcache_t *, polldat_t *);
 
 /*
  * pcacheset interfaces:
@@ -59,6 +59,12 @@ typedef	struct	port_notify {
 	void		*portnfy_user;	/* user defined */
 } port_notify_t;
 
+typedef struct port_assoc {
+	uintptr_t	pa_object;	/* source specific object */
+	int		pa_events;	/* events to be checked */
+	void		*pa_user;	/* user cookie */
+} port_assoc_t;
+
 
 typedef struct file_obj {
 	timestruc_t	fo_atime;	/* Access time from stat(2) */
@@ -91,6 +97,12 @@ typedef	struct	port_notify32 {
 	caddr32_t 	portnfy_user;	/* user defined */
 } port_notify32_t;
 
+typedef struct port_assoc32 {
+	caddr32_t	pa_object;	/* fd */
+	int		pa_events;	/* events to be checked */
+	caddr32_t	pa_user;	/* user cookie */
+} port_assoc32_t;
+
 #endif /* _SYSCALL32 */
 
 /* port_alert() flags */
@@ -98,6 +110,15 @@ typedef	struct	port_notify32 {
 #define	PORT_ALERT_UPDATE	0x02
 #define	PORT_ALERT_INVALID	(PORT_ALERT_SET | PORT_ALERT_UPDATE)
 
+/*
+ * PORT_SOURCE_FD - association flags
+ *
+ * An association made with PORT_FD_PERSIST set in the events argument
+ * is edge-triggered: it is re-armed as soon as its event is retrieved,
+ * so the fd does not have to be associated again after every event.
+ */
+#define	PORT_FD_PERSIST		0x10000000
+
 /*
  * PORT_SOURCE_FILE - events
  */
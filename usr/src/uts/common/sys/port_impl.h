@@ -61,6 +61,7 @@ extern "C" {
 #define	PORT_GETN	6	/* receive list of objects with events */
 #define	PORT_ALERT	7	/* set port in alert mode */
 #define	PORT_DISPATCH	8	/* dispatch object with events */
+#define	PORT_ASSOCIATEN	9	/* register a list of objects */
 
 #define	PORT_SYS_NOPORT		0x100	/* system call without port-id */
 #define	PORT_SYS_NOSHARE	0x200	/* non shareable event */
@@ -209,8 +210,12 @@ typedef struct portfd {
 	struct portfd	*pfd_next;
 	struct portfd	*pfd_prev;
 	kthread_t	*pfd_thread;
+	int		pfd_flags;	/* protected by portkev_lock */
 } portfd_t;
 
+/* pfd_flags */
+#define	PORTFD_PERSIST	0x01	/* re-arm association on retrieval */
+
 #define	PFTOD(pfd)	(&(pfd)->pfd_pd)
 #define	PDTOF(pdp)	((struct portfd *)(pdp))
 #define	PORT_FD_BUCKET(pcp, fd) \
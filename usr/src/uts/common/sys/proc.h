@@ -354,6 +354,8 @@ typedef struct	proc {
 					/* protected by p_lock */
 	rctl_qty_t	p_crypto_mem;	/* /dev/crypto memory charged to proc */
 					/* protected by p_lock */
+	pgcnt_t		p_rss_charged;	/* rss charged to zone and project */
+					/* protected by p_lock */
 	clock_t	p_ttime;		/* buffered task time */
 
 	/*
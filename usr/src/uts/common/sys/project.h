@@ -54,6 +54,8 @@ typedef struct kproject_data {		/* Datum protected by: */
 	rctl_qty_t	kpd_crypto_mem_ctl; /* kpj_rctls->rcs_lock */
 	kstat_t		*kpd_lockedmem_kstat; /* locked memory kstat */
 	kstat_t		*kpd_nprocs_kstat;
+	uint64_t	kpd_rss;	/* atomic; pages mapped */
+	kstat_t		*kpd_rss_kstat;
 } kproject_data_t;
 
 struct cpucap;
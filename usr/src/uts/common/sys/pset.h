@@ -97,6 +97,7 @@ extern int	pset_getattr();
 
 /* attribute bits */
 #define	PSET_NOESCAPE	0x0001
+#define	PSET_COREXCL	0x0002	/* don't share cores between procs */
 
 #ifdef	__cplusplus
 }
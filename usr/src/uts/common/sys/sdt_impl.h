@@ -64,10 +64,14 @@ typedef struct sdt_probe {
 	sdt_instr_t	*sdp_patchpoint;	/* patch point */
 	sdt_instr_t	sdp_patchval;		/* instruction to patch */
 	sdt_instr_t	sdp_savedval;		/* saved instruction value */
+	int		sdp_flags;		/* SDT_* flags */
 	struct sdt_probe *sdp_next;		/* next probe */
 	struct sdt_probe *sdp_hashnext;		/* next on hash */
 } sdt_probe_t;
 
+#define	SDT_ENABLED	0x1			/* enabled by DTrace */
+#define	SDT_RECORD	0x2			/* in flight recorder */
+
 typedef struct sdt_argdesc {
 	const char *sda_provider;		/* provider for arg */
 	const char *sda_name;			/* name of probe */
@@ -80,6 +84,58 @@ typedef struct sdt_argdesc {
 extern void sdt_getargdesc(void *, dtrace_id_t, void *, dtrace_argdesc_t *);
 extern int sdt_mode(void *, dtrace_id_t, void *);
 
+/*
+ * Flight recorder; see sdt_subr.c.  Each CPU has a ring of records, and
+ * SDTIOC_FRSNAP on /dev/sdt copies out the most recent records in a CPU's
+ * ring, oldest first.
+ */
+typedef struct sdt_frec {
+	hrtime_t	sfr_time;		/* dtrace_gethrtime() */
+	uint64_t	sfr_thread;		/* address of firing thread */
+	uint32_t	sfr_id;			/* DTrace probe ID */
+	uint32_t	sfr_pad;
+	uint64_t	sfr_arg[3];		/* arg0 through arg2 */
+} sdt_frec_t;
+
+typedef struct sdt_frbuf {
+	uint64_t	sfb_written;		/* records ever written */
+	uint32_t	sfb_nrecs;		/* size of ring (power of 2) */
+	uint32_t	sfb_pad;
+	sdt_frec_t	sfb_recs[1];		/* ring of sfb_nrecs records */
+} sdt_frbuf_t;
+
+#define	SDT_FRBUF_SIZE(nrecs)	\
+	(offsetof(sdt_frbuf_t, sfb_recs) + (nrecs) * sizeof (sdt_frec_t))
+
+typedef struct sdt_frinfo {
+	uint32_t	sfi_ncpus;		/* number of rings */
+	uint32_t	sfi_nrecs;		/* records per ring */
+	uint32_t	sfi_nprobes;		/* probe sites recorded */
+	uint32_t	sfi_pad;
+} sdt_frinfo_t;
+
+typedef struct sdt_frsnap {
+	uint32_t	sfs_cpu;		/* CPU whose ring to copy */
+	uint32_t	sfs_nrecs;		/* room at sfs_recs; copied */
+	uint64_t	sfs_written;		/* records ever written */
+	uint64_t	sfs_recs;		/* address of sdt_frec_t array */
+} sdt_frsnap_t;
+
+#define	SDTIOC			(('s' << 24) | ('d' << 16) | ('t' << 8))
+#define	SDTIOC_FRINFO		(SDTIOC | 1)	/* get sdt_frinfo_t */
+#define	SDTIOC_FRSNAP		(SDTIOC | 2)	/* copy out a ring */
+
+#ifdef _KERNEL
+extern sdt_frbuf_t **sdt_fr_bufs;
+extern uint32_t sdt_fr_nprobes;
+
+extern void sdt_fr_init(void);
+extern void sdt_fr_fini(void);
+extern int sdt_fr_match(sdt_probe_t *);
+extern void sdt_fr_record(sdt_probe_t *, uintptr_t, uintptr_t, uintptr_t);
+extern int sdt_fr_ioctl(int, intptr_t, cred_t *);
+#endif
+
 #ifdef	__cplusplus
 }
 #endif
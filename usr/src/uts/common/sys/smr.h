@@ -0,0 +1,50 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _SYS_SMR_H
+#define	_SYS_SMR_H
+
+/*
+ * Safe memory reclamation for lock-free readers.  See smr.c.
+ */
+
+#include <sys/types.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+#include <sys/kmem.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#ifdef	_KERNEL
+
+/*
+ * Read-side critical sections.  They may nest but must not block.
+ */
+#define	SMR_ENTER()	kpreempt_disable()
+#define	SMR_EXIT()	kpreempt_enable()
+
+typedef void	smr_func_t(void *);
+
+extern void	smr_init(void);
+extern void	smr_synchronize(void);
+extern void	smr_call(smr_func_t *, void *);
+extern void	smr_kmem_free(void *, size_t);
+extern void	smr_kmem_cache_free(kmem_cache_t *, void *);
+
+#endif	/* _KERNEL */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_SMR_H */
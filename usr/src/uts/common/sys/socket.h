@@ -187,6 +187,10 @@ struct so_snd_bufinfo {
 #define	SO_EXCLBIND	0x1015		/* exclusive binding */
 #define	SO_MAC_IMPLICIT	0x1016		/* hide mac labels on wire */
 #define	SO_VRRP		0x1017		/* VRRP control socket */
+#define	SO_REUSEPORT	0x1018		/* share local address and port */
+#define	SO_MAX_PACING_RATE 0x1019	/* cap TCP send rate, bytes/sec */
+#define	SO_BUSY_POLL	0x101a		/* recv spin time, usecs */
+#define	SO_TLS_TX	0x101b		/* kernel TLS transmit keys */
 
 #ifdef	_KERNEL
 #define	SO_SRCADDR	0x2001		/* Internal: AF_UNIX source address */
@@ -239,6 +243,26 @@ struct	linger {
 	int	l_linger;		/* linger time */
 };
 
+#if !defined(_XPG4_2) || defined(__EXTENSIONS__)
+/*
+ * Argument to SO_TLS_TX; the session keys negotiated by the application's
+ * TLS handshake.  Once set, every byte written to the socket is framed
+ * into TLS application_data records and encrypted by the kernel.
+ */
+typedef struct so_tls_crypto_info {
+	uint16_t	stc_version;		/* SO_TLS_VERSION_* */
+	uint16_t	stc_cipher;		/* SO_TLS_CIPHER_* */
+	uint8_t		stc_iv[8];		/* initial explicit nonce */
+	uint8_t		stc_key[32];		/* write key */
+	uint8_t		stc_salt[4];		/* implicit nonce */
+	uint8_t		stc_rec_seq[8];		/* next record seq, big-endian */
+} so_tls_crypto_info_t;
+
+#define	SO_TLS_VERSION_1_2		0x0303
+#define	SO_TLS_CIPHER_AES_GCM_128	51	/* 16 byte key */
+#define	SO_TLS_CIPHER_AES_GCM_256	52	/* 32 byte key */
+#endif	/* !defined(_XPG4_2) || defined(__EXTENSIONS__) */
+
 /*
  * Levels for (get/set)sockopt() that don't apply to a specific protocol.
  */
@@ -359,6 +383,16 @@ struct msghdr {
 #endif	/* defined(_XPG4_2) || defined(_KERNEL) */
 };
 
+#if !defined(_XPG4_2) || defined(__EXTENSIONS__)
+/*
+ * Message vector element for recvmmsg and sendmmsg calls.
+ */
+struct mmsghdr {
+	struct msghdr	msg_hdr;		/* message header */
+	unsigned int	msg_len;		/* bytes transferred */
+};
+#endif	/* !defined(_XPG4_2) || defined(__EXTENSIONS__) */
+
 #if	defined(_KERNEL)
 
 /*
@@ -377,6 +411,11 @@ struct omsghdr {
 
 #define	nmsghdr		msghdr
 
+struct ommsghdr {
+	struct omsghdr	msg_hdr;	/* message header */
+	uint_t		msg_len;	/* bytes transferred */
+};
+
 #if defined(_SYSCALL32)
 
 struct omsghdr32 {
@@ -400,6 +439,16 @@ struct msghdr32 {
 
 #define	nmsghdr32	msghdr32
 
+struct ommsghdr32 {
+	struct omsghdr32 msg_hdr;	/* message header */
+	uint32_t	msg_len;	/* bytes transferred */
+};
+
+struct mmsghdr32 {
+	struct msghdr32	msg_hdr;	/* message header */
+	uint32_t	msg_len;	/* bytes transferred */
+};
+
 #endif	/* _SYSCALL32 */
 #endif	/* _KERNEL */
 
@@ -416,6 +465,8 @@ struct msghdr32 {
 /* End of XPGv2 compliance */
 #define	MSG_DONTWAIT	0x80		/* Don't block for this recv */
 #define	MSG_NOTIFICATION 0x100		/* Notification, not data */
+#define	MSG_FASTOPEN	0x1000		/* Connect and send data on SYN */
+#define	MSG_WAITFORONE	0x2000		/* recvmmsg: block for first only */
 #define	MSG_XPG4_2	0x8000		/* Private: XPG4.2 flag */
 
 #define	MSG_MAXIOVLEN	16
@@ -496,6 +547,8 @@ struct cmsghdr {
 #pragma redefine_extname connect __xnet_connect
 #pragma redefine_extname recvmsg __xnet_recvmsg
 #pragma redefine_extname sendmsg __xnet_sendmsg
+#pragma redefine_extname recvmmsg __xnet_recvmmsg
+#pragma redefine_extname sendmmsg __xnet_sendmmsg
 #pragma redefine_extname sendto __xnet_sendto
 #pragma redefine_extname socket __xnet_socket
 #pragma redefine_extname socketpair __xnet_socketpair
@@ -505,6 +558,8 @@ struct cmsghdr {
 #define	connect	__xnet_connect
 #define	recvmsg	__xnet_recvmsg
 #define	sendmsg	__xnet_sendmsg
+#define	recvmmsg	__xnet_recvmmsg
+#define	sendmmsg	__xnet_sendmmsg
 #define	sendto	__xnet_sendto
 #define	socket	__xnet_socket
 #define	socketpair	__xnet_socketpair
@@ -547,6 +602,13 @@ extern int socket(int, int, int);
 #if !defined(_XPG4_2) || defined(_XPG6) || defined(__EXTENSIONS__)
 extern int sockatmark(int);
 #endif /* !defined(_XPG4_2) || defined(_XPG6) || defined(__EXTENSIONS__) */
+
+#if !defined(_XPG4_2) || defined(__EXTENSIONS__)
+struct timespec;
+extern int recvmmsg(int, struct mmsghdr *, unsigned int, int,
+	struct timespec *);
+extern int sendmmsg(int, struct mmsghdr *, unsigned int, int);
+#endif /* !defined(_XPG4_2) || defined(__EXTENSIONS__) */
 #else	/* __STDC__ */
 extern int accept();
 extern int accept4();
@@ -565,6 +627,8 @@ extern int sockatmark();
 extern int socket();
 extern int recvmsg();
 extern int sendmsg();
+extern int recvmmsg();
+extern int sendmmsg();
 extern int shutdown();
 extern int socketpair();
 #endif	/* __STDC__ */
@@ -122,6 +122,8 @@ struct sock_downcalls_s {
 	int	(*sd_ioctl)(sock_lower_handle_t, int, intptr_t, int,
 		    int32_t *, cred_t *);
 	int	(*sd_close)(sock_lower_handle_t, int, cred_t *);
+	/* optional, may be NULL */
+	void	(*sd_busy_poll)(sock_lower_handle_t);
 };
 
 typedef sock_lower_handle_t (*so_proto_create_func_t)(int, int, int,
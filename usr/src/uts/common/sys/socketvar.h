@@ -184,6 +184,7 @@ struct sonode {
 	int	so_xpg_rcvbuf;		/* SO_RCVBUF value for XPG4 socket */
 	clock_t	so_sndtimeo;		/* send timeout */
 	clock_t	so_rcvtimeo;		/* recv timeout */
+	uint32_t so_busy_poll;		/* SO_BUSY_POLL spin time, usecs */
 
 	mblk_t	*so_oobmsg;		/* outofline oob data */
 	ssize_t	so_oobmark;		/* offset of the oob data */
@@ -235,6 +236,9 @@ struct sonode {
 	/* != NULL for sodirect enabled socket */
 	struct sodirect_s	*so_direct;
 
+	/* != NULL once kernel TLS transmit keys are set (SO_TLS_TX) */
+	struct so_ktls_s	*so_ktls;
+
 	/* socket filters */
 	uint_t			so_filter_active;	/* # of active fil */
 	uint_t			so_filter_tx;		/* pending tx ops */
@@ -606,6 +610,7 @@ struct sendfile_stats {
 	uint32_t ss_full_waits;
 	uint32_t ss_empty_waits;
 	uint32_t ss_file_segmap;
+	uint32_t ss_file_loaned;
 };
 
 /*
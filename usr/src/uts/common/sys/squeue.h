@@ -87,6 +87,8 @@ struct conn_s;
 extern int squeue_synch_enter(struct conn_s *, mblk_t *);
 extern void squeue_synch_exit(struct conn_s *);
 
+extern boolean_t squeue_busy_poll(squeue_t *);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -227,6 +227,12 @@ typedef struct scsi_task {
 #define	STMF_IOF_LPORT_DONE		0x0002
 #define	STMF_IOF_STATS_ONLY		0x0004
 
+/*
+ * Poll timeout (in msec) asking stmf_task_poll_lu/lport to make the
+ * call as soon as the worker gets to the task, not a tick later.
+ */
+#define	STMF_POLL_NOW			0xffffffff
+
 /*
  * struct allocation flags
  */
@@ -292,6 +292,8 @@ extern "C" {
 #define	SYS_fchdir	120
 #define	SYS_readv	121
 #define	SYS_writev	122
+#define	SYS_recvmmsg	123
+#define	SYS_sendmmsg	124
 #define	SYS_mmapobj	127
 #define	SYS_setrlimit	128
 #define	SYS_getrlimit	129
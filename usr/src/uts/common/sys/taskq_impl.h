@@ -85,6 +85,26 @@ struct taskq_bucket {
 	tqstat_t	tqbucket_stat;
 };
 
+/*
+ * Per-CPU task list of a TASKQ_PERCPU task queue.  Dispatches go to the
+ * lane of the dispatching CPU; each thread serves its own lane first and
+ * takes work from the others when it runs dry.  Entries freed by the
+ * threads are cached on the lane they were dispatched from.
+ */
+typedef struct taskq_lane {
+	kmutex_t	tql_lock;
+	taskq_ent_t	tql_task;	/* queued tasks */
+	taskq_ent_t	*tql_freelist;	/* cached free entries */
+	uint64_t	tql_tasks;	/* # of tasks posted */
+	uint64_t	tql_executed;	/* # of tasks executed */
+	uint64_t	tql_steals;	/* # executed by another lane */
+	hrtime_t	tql_totaltime;	/* time spent processing tasks */
+	uint_t		tql_nfree;	/* # of entries on tql_freelist */
+	char		tql_pad[128 - sizeof (kmutex_t) -
+	    sizeof (taskq_ent_t) - sizeof (taskq_ent_t *) -
+	    4 * sizeof (uint64_t) - sizeof (uint_t)];
+} taskq_lane_t;
+
 /*
  * Bucket flags.
  */
@@ -127,6 +147,9 @@ struct taskq {
 	taskq_bucket_t	*tq_buckets;	/* Per-cpu array of buckets */
 	int		tq_instance;
 	uint_t		tq_nbuckets;	/* # of buckets	(2^n)	    */
+	taskq_lane_t	*tq_lanes;	/* TASKQ_PERCPU task lists */
+	uint_t		tq_nlanes;	/* # of lanes */
+	volatile uint_t	tq_nidle;	/* # of threads waiting for work */
 	union {
 		kthread_t *_tq_thread;
 		kthread_t **_tq_threadlist;
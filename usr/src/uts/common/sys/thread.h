@@ -344,6 +344,8 @@ typedef struct _kthread {
 	kmutex_t	t_ctx_lock;	/* protects t_ctx in removectx() */
 	struct waitq	*t_waitq;	/* wait queue */
 	kmutex_t	t_wait_mutex;	/* used in CV wait functions */
+	struct disp_offcpu *t_offcpu;	/* off-CPU record while blocked */
+	hrtime_t	t_offcpu_start;	/* unscaled time thread blocked */
 } kthread_t;
 
 /*
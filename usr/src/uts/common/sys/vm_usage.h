@@ -106,8 +106,15 @@ extern int getvmusage(uint_t flags, time_t age, vmusage_t *buf, size_t *nres);
 
 #ifdef	_KERNEL
 
+struct proc;
+struct kproject;
+
 int vm_getusage(uint_t, time_t, vmusage_t *, size_t *, int);
 void vm_usage_init();
+void vm_rss_update(struct proc *);
+void vm_rss_uncharge(struct proc *);
+void vm_rss_move(struct proc *, struct kproject *);
+void vm_rss_sync(void);
 
 #endif	/* _KERNEL */
 
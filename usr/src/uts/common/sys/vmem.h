@@ -76,6 +76,7 @@ extern "C" {
 #define	VMC_NO_QCACHE	0x00020000	/* cannot use quantum caches */
 #define	VMC_IDENTIFIER	0x00040000	/* not backed by memory */
 #define	VMC_DUMPSAFE	0x00200000	/* can use alternate dump memory */
+#define	VMC_SEGCACHE	0x00400000	/* cache large segments too */
 /*
  * internal use only;	the import function uses the vmem_ximport_t interface
  *			and may increase the request size if it so desires.
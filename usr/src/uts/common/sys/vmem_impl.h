@@ -88,9 +88,17 @@ typedef struct vmem_freelist {
 #define	VMEM_QCACHE_SLABSIZE(max) \
 	MAX(1 << highbit(3 * (max)), 64)
 
+#define	VMEM_SCACHED(vmp, size)						\
+	((size) >= (vmp)->vm_scache_min && (size) <= (vmp)->vm_scache_max && \
+	ISP2(size))
+
+#define	VMEM_SCACHE(vmp, size)						\
+	((vmp)->vm_scache[highbit(size) - highbit((vmp)->vm_scache_min)])
+
 #define	VMEM_NAMELEN		30
 #define	VMEM_HASH_INITIAL	16
 #define	VMEM_NQCACHE_MAX	16
+#define	VMEM_NSCACHE_MAX	4
 #define	VMEM_FREELISTS		(sizeof (void *) * 8)
 
 typedef struct vmem_kstat {
@@ -120,6 +128,8 @@ struct vmem {
 	int		vm_qshift;	/* log2(vm_quantum) */
 	size_t		vm_quantum;	/* vmem quantum */
 	size_t		vm_qcache_max;	/* maximum size to front by kmem */
+	size_t		vm_scache_min;	/* smallest segment cache size */
+	size_t		vm_scache_max;	/* largest segment cache size */
 	size_t		vm_min_import;	/* smallest amount to import */
 	void		*(*vm_source_alloc)(vmem_t *, size_t, int);
 	void		(*vm_source_free)(vmem_t *, void *, size_t);
@@ -136,6 +146,7 @@ struct vmem {
 	vmem_seg_t	vm_rotor;	/* rotor for VM_NEXTFIT allocations */
 	vmem_seg_t	*vm_hash0[VMEM_HASH_INITIAL];	/* initial hash table */
 	void		*vm_qcache[VMEM_NQCACHE_MAX];	/* quantum caches */
+	void		*vm_scache[VMEM_NSCACHE_MAX];	/* segment caches */
 	vmem_freelist_t	vm_freelist[VMEM_FREELISTS + 1]; /* power-of-2 flists */
 	vmem_kstat_t	vm_kstat;	/* kstat data */
 };
@@ -53,6 +53,7 @@
 #include <sys/list.h>
 #ifdef	_KERNEL
 #include <sys/buf.h>
+#include <sys/atomic.h>
 #endif	/* _KERNEL */
 
 #ifdef	__cplusplus
@@ -121,6 +122,8 @@ typedef struct vopstats {
 	kstat_named_t	nvnevent;	/* VOP_VNEVENT */
 	kstat_named_t	nreqzcbuf;	/* VOP_REQZCBUF */
 	kstat_named_t	nretzcbuf;	/* VOP_RETZCBUF */
+	kstat_named_t	ndnlchit;	/* dnlc_lookup() hits */
+	kstat_named_t	ndnlcmiss;	/* dnlc_lookup() misses */
 } vopstats_t;
 
 /*
@@ -191,7 +194,7 @@ struct vsd_node {
  * The v_lock protects:
  *   v_flag
  *   v_stream
- *   v_count
+ *   v_count (see below)
  *   v_shrlocks
  *   v_path
  *   v_vsd
@@ -346,6 +349,7 @@ typedef struct vn_vfslocks_entry {
 #define	IS_SWAPFSVP(vp)	(((vp)->v_flag & VISSWAPFS) != 0)
 
 #define	V_SYSATTR	0x40000	/* vnode is a GFS system attribute */
+#define	VSEARCHOK	0x80000	/* dir searchable by all, see dnlc.c */
 
 /*
  * Vnode attributes.  A bit-mask is supplied as part of the
@@ -1328,10 +1332,29 @@ int	vn_vmpss_usepageio(vnode_t *);
  */
 extern uint_t pvn_vmodsort_supported;
 
+/*
+ * v_count is only ever changed atomically, so that taking a hold and
+ * dropping one that isn't the last need not take v_lock.  Dropping what
+ * may be the last hold, which ends up in VOP_INACTIVE(), is still done
+ * under v_lock: code that looks at v_count under v_lock to decide
+ * whether a vnode is going away sees no other decrement, though it may
+ * see an increment from a VN_HOLD() by someone who already has a hold.
+ * Code that changes v_count itself, usually an inactive routine, must
+ * do so under v_lock with VN_HOLD_LOCKED() and VN_RELE_LOCKED().
+ */
 #define	VN_HOLD(vp)	{ \
-	mutex_enter(&(vp)->v_lock); \
-	(vp)->v_count++; \
-	mutex_exit(&(vp)->v_lock); \
+	atomic_inc_uint(&(vp)->v_count); \
+}
+
+#define	VN_HOLD_LOCKED(vp)	{ \
+	ASSERT(MUTEX_HELD(&(vp)->v_lock)); \
+	atomic_inc_uint(&(vp)->v_count); \
+}
+
+#define	VN_RELE_LOCKED(vp)	{ \
+	ASSERT(MUTEX_HELD(&(vp)->v_lock)); \
+	ASSERT((vp)->v_count > 0); \
+	atomic_dec_uint(&(vp)->v_count); \
 }
 
 #define	VN_RELE(vp)	{ \
@@ -538,6 +538,8 @@ typedef struct zone {
 	rctl_qty_t	zone_nprocs_ctl;	/* current limit protected by */
 						/* zone_rctls->rcs_lock */
 	kstat_t		*zone_nprocs_kstat;
+	uint64_t	zone_rss;	/* pages mapped by zone's processes */
+	kstat_t		*zone_rss_kstat;
 
 	/*
 	 * DTrace-private per-zone state
@@ -811,7 +811,7 @@ retry:
 			 * that the failure rate is very very low.
 			 */
 			if (mutex_tryenter(&pcp->pc_lock)) {
-				pollnotify(pcp, pdp->pd_fd);
+				pollnotify(pcp, pdp);
 				mutex_exit(&pcp->pc_lock);
 			} else {
 				/*
@@ -891,15 +891,42 @@ retry:
  * The pollstate lock on the thread should be held on entry.
  */
 void
-pollnotify(pollcache_t *pcp, int fd)
+pollnotify(pollcache_t *pcp, polldat_t *pdp)
 {
-	ASSERT(fd < pcp->pc_mapsize);
+	ASSERT(pdp->pd_fd < pcp->pc_mapsize);
 	ASSERT(MUTEX_HELD(&pcp->pc_lock));
-	BT_SET(pcp->pc_bitmap, fd);
+	pcache_ready(pcp, pdp);
 	pcp->pc_flag |= T_POLLWAKE;
 	cv_signal(&pcp->pc_cv);
 }
 
+/*
+ * Mark a cached fd as having (possibly) pending events. A /dev/poll cache
+ * also queues the polldat on its ready list, which is what DP_POLL walks.
+ */
+void
+pcache_ready(pollcache_t *pcp, polldat_t *pdp)
+{
+	ASSERT(MUTEX_HELD(&pcp->pc_lock));
+	BT_SET(pcp->pc_bitmap, pdp->pd_fd);
+	if ((pcp->pc_flag & PC_RDYLIST) &&
+	    !list_link_active(&pdp->pd_rdynode)) {
+		list_insert_tail(&pcp->pc_rdylist, pdp);
+		pcp->pc_nready++;
+	}
+}
+
+void
+pcache_unready(pollcache_t *pcp, polldat_t *pdp)
+{
+	BT_CLEAR(pcp->pc_bitmap, pdp->pd_fd);
+	if ((pcp->pc_flag & PC_RDYLIST) &&
+	    list_link_active(&pdp->pd_rdynode)) {
+		list_remove(&pcp->pc_rdylist, pdp);
+		pcp->pc_nready--;
+	}
+}
+
 /*
  * add a polldat entry to pollhead ph_list. The polldat struct is used
  * by pollwakeup to wake sleeping pollers when polled events has happened.
@@ -2708,6 +2735,8 @@ pcache_destroy(pollcache_t *pcp)
 			pdp = hashtbl[i];
 			while (pdp != NULL) {
 				pdp2 = pdp->pd_hashnext;
+				if (pcp->pc_flag & PC_RDYLIST)
+					pcache_unready(pcp, pdp);
 				if (pdp->pd_ref != NULL) {
 					kmem_free(pdp->pd_ref, sizeof (xref_t) *
 					    pdp->pd_nsets);
@@ -2719,6 +2748,10 @@ pcache_destroy(pollcache_t *pcp)
 		}
 	}
 	ASSERT(pcp->pc_fdcount == 0);
+	if (pcp->pc_flag & PC_RDYLIST) {
+		ASSERT(pcp->pc_nready == 0);
+		list_destroy(&pcp->pc_rdylist);
+	}
 	kmem_free(pcp->pc_hash, sizeof (polldat_t *) * pcp->pc_hashsize);
 	kmem_free(pcp->pc_bitmap,
 	    sizeof (ulong_t) * (pcp->pc_mapsize/BT_NBIPUL));
@@ -71,7 +71,8 @@ static struct modlinkage modlinkage = {
 	NULL
 };
 
-#define	PSET_BADATTR(attr)	((~PSET_NOESCAPE) & (attr))
+#define	PSET_BADATTR(attr)	\
+	((~(PSET_NOESCAPE | PSET_COREXCL)) & (attr))
 
 int
 _init(void)
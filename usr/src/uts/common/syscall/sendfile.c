@@ -72,6 +72,8 @@ extern int nl7c_sendfilev(struct sonode *, u_offset_t *, struct sendfilevec *,
 		int, ssize_t *);
 extern int snf_segmap(file_t *, vnode_t *, u_offset_t, u_offset_t, ssize_t *,
 		boolean_t);
+extern int snf_loan(file_t *, vnode_t *, u_offset_t, u_offset_t, ssize_t *);
+extern int snf_loan_enable;
 extern sotpi_info_t *sotpi_sototpi(struct sonode *);
 
 #define	SEND_MAX_CHUNK	16
@@ -957,6 +959,30 @@ sendvec_chunk(file_t *fp, u_offset_t *fileoff, struct sendfilevec *sfv,
 				}
 			}
 
+			/*
+			 * Prefer buffers loaned by the file system, which
+			 * need neither a copy nor a page cache mapping.
+			 * Whatever it declines to loan is sent below.
+			 */
+			if (vp->v_type == VSOCK && snf_loan_enable &&
+			    (so->so_filter_active == 0 || maxblk == INFPSZ)) {
+				error = snf_loan(fp, readvp, sfv_off,
+				    (u_offset_t)sfv_len, (ssize_t *)&cnt);
+				ttolwp(curthread)->lwp_ru.ioch += (ulong_t)cnt;
+				*count += cnt;
+				sfv_len -= cnt;
+				sfv_off += cnt;
+				if (error != 0 || sfv_len == 0) {
+					VOP_RWUNLOCK(readvp, V_WRITELOCK_FALSE,
+					    NULL);
+					releasef(sfv->sfv_fd);
+					if (error)
+						return (error);
+					sfv++;
+					continue;
+				}
+			}
+
 			if (segmapit) {
 				boolean_t nowait;
 
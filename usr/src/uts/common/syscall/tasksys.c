@@ -42,6 +42,7 @@
 #include <sys/policy.h>
 #include <sys/zone.h>
 #include <sys/rctl.h>
+#include <sys/vm_usage.h>
 
 /*
  * Limit projlist to 256k projects.
@@ -177,6 +178,7 @@ tasksys_settaskid(projid_t projid, uint_t flags)
 	 * Returns with p_lock held.
 	 */
 	oldtk = task_join(tk, flags);
+	vm_rss_move(p, oldpj);
 	if (curthread != p->p_agenttp)
 		continuelwps(p);
 	mutex_exit(&p->p_lock);
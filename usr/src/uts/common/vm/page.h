@@ -692,6 +692,9 @@ struct lgrp;
 /* called from */
 #define	PG_LIST_ISINIT	0x1000
 
+/* page contents */
+#define	PG_LIST_ZEROED	0x2000	/* page has been zero-filled */
+
 /*
  * Page frame operations.
  */
@@ -725,6 +728,7 @@ void	page_destroy_free(page_t *);
 void	page_rename(page_t *, struct vnode *, u_offset_t);
 int	page_hashin(page_t *, struct vnode *, u_offset_t, kmutex_t *);
 void	page_hashout(page_t *, kmutex_t *);
+pgcnt_t	page_fs_pages(void);
 int	page_num_hashin(pfn_t, struct vnode *, u_offset_t);
 void	page_add(page_t **, page_t *);
 void	page_add_common(page_t **, page_t *);
@@ -732,6 +736,8 @@ void	page_sub(page_t **, page_t *);
 void	page_sub_common(page_t **, page_t *);
 page_t	*page_get_freelist(struct vnode *, u_offset_t, struct seg *,
 		caddr_t, size_t, uint_t, struct lgrp *);
+page_t	*page_get_freelist_batch(struct vnode *, struct seg *, caddr_t,
+		pgcnt_t, uint_t, struct lgrp *);
 
 page_t	*page_get_cachelist(struct vnode *, u_offset_t, struct seg *,
 		caddr_t, uint_t, struct lgrp *);
@@ -784,6 +790,10 @@ void    prefetch_page_r(void *);
 int	ppcopy(page_t *, page_t *);
 void	page_relocate_hash(page_t *, page_t *);
 void	pagezero(page_t *, uint_t, uint_t);
+void	pagezero_fresh(page_t *);
+void	page_zero_large(page_t **, pgcnt_t);
+void	page_zero_clrfree(page_t *);
+void	page_zero_init(void);
 void	pagescrub(page_t *, uint_t, uint_t);
 void	page_io_lock(page_t *);
 void	page_io_unlock(page_t *);
@@ -931,6 +941,7 @@ int	page_szc_user_filtered(size_t);
 #define	P_SWAP		0x10		/* belongs to vnode that is V_ISSWAP */
 #define	P_BOOTPAGES	0x08		/* member of bootpages list */
 #define	P_RAF		0x04		/* page retired at free */
+#define	P_ZEROED	0x02		/* free page known zero-filled */
 
 #define	PP_ISFREE(pp)		((pp)->p_state & P_FREE)
 #define	PP_ISAGED(pp)		(((pp)->p_state & P_FREE) && \
@@ -942,23 +953,32 @@ int	page_szc_user_filtered(size_t);
 #define	PP_ISSWAP(pp)		((pp)->p_state & P_SWAP)
 #define	PP_ISBOOTPAGES(pp)	((pp)->p_state & P_BOOTPAGES)
 #define	PP_ISRAF(pp)		((pp)->p_state & P_RAF)
+#define	PP_ISZEROED(pp)		((pp)->p_state & P_ZEROED)
 
-#define	PP_SETFREE(pp)		((pp)->p_state = ((pp)->p_state & ~P_MIGRATE) \
-				| P_FREE)
+#define	PP_SETFREE(pp)		((pp)->p_state = ((pp)->p_state & \
+				~(P_MIGRATE | P_ZEROED)) | P_FREE)
 #define	PP_SETAGED(pp)		ASSERT(PP_ISAGED(pp))
 #define	PP_SETNORELOC(pp)	((pp)->p_state |= P_NORELOC)
 #define	PP_SETMIGRATE(pp)	((pp)->p_state |= P_MIGRATE)
 #define	PP_SETSWAP(pp)		((pp)->p_state |= P_SWAP)
 #define	PP_SETBOOTPAGES(pp)	((pp)->p_state |= P_BOOTPAGES)
 #define	PP_SETRAF(pp)		((pp)->p_state |= P_RAF)
+#define	PP_SETZEROED(pp)	((pp)->p_state |= P_ZEROED)
 
-#define	PP_CLRFREE(pp)		((pp)->p_state &= ~P_FREE)
+/*
+ * P_ZEROED survives PP_CLRFREE() so that whoever takes the page off the
+ * freelist can skip zeroing it again (see pagezero_fresh()).
+ */
+#define	PP_CLRFREE(pp)		(PP_ISZEROED(pp) ? \
+				page_zero_clrfree(pp) : \
+				(void) ((pp)->p_state &= ~P_FREE))
 #define	PP_CLRAGED(pp)		ASSERT(!PP_ISAGED(pp))
 #define	PP_CLRNORELOC(pp)	((pp)->p_state &= ~P_NORELOC)
 #define	PP_CLRMIGRATE(pp)	((pp)->p_state &= ~P_MIGRATE)
 #define	PP_CLRSWAP(pp)		((pp)->p_state &= ~P_SWAP)
 #define	PP_CLRBOOTPAGES(pp)	((pp)->p_state &= ~P_BOOTPAGES)
 #define	PP_CLRRAF(pp)		((pp)->p_state &= ~P_RAF)
+#define	PP_CLRZEROED(pp)	((pp)->p_state &= ~P_ZEROED)
 
 /*
  * Flags for page_t p_toxic, for tracking memory hardware errors.
@@ -123,7 +123,7 @@ vmem_t *zio_alloc_arena = NULL;	/* arena for allocating zio memory */
 
 /*
  * seg_kmem driver can map part of the kernel heap with large pages.
- * Currently this functionality is implemented for sparc platforms only.
+ * Currently this functionality is implemented for sparc and amd64.
  *
  * The large page size "segkmem_lpsize" for kernel heap is selected in the
  * platform specific code. It can also be modified via /etc/system file.
@@ -136,7 +136,14 @@ vmem_t *zio_alloc_arena = NULL;	/* arena for allocating zio memory */
  * heap_lp_end) is set up as a separate vmem arena - "heap_lp_arena". We also
  * create "kmem_lp_arena" that caches memory already backed up by large
  * pages. kmem_lp_arena imports virtual segments from heap_lp_arena.
+ *
+ * On amd64 the pages stay sharelocked like the rest of seg_kmem's, and
+ * SEGKMEM_LPALIGN is the alignment of the reserved range, so that it can
+ * be mapped by the largest page the MMU may offer.
  */
+#if defined(__amd64)
+#define	SEGKMEM_LPALIGN		(1UL << 30)	/* 1G */
+#endif
 
 size_t	segkmem_lpsize;
 static  uint_t	segkmem_lpshift = PAGESHIFT;
@@ -266,6 +273,23 @@ kernelheap_init(
 	}
 #endif
 
+#if defined(__amd64)
+	/*
+	 * The large page heap is the top quarter of the heap, aligned so that
+	 * it can be mapped with either 2M or 1G pages.
+	 */
+	heap_lp_end = (char *)P2ALIGN((uintptr_t)ekernelheap, SEGKMEM_LPALIGN);
+	heap_lp_base = (char *)P2ROUNDUP((uintptr_t)heap_lp_end -
+	    ((uintptr_t)ekernelheap - (uintptr_t)kernelheap) / 4,
+	    SEGKMEM_LPALIGN);
+	if (heap_lp_base < heap_lp_end) {
+		heap_lp_size = heap_lp_end - heap_lp_base;
+	} else {
+		heap_lp_base = NULL;
+		heap_lp_end = NULL;
+	}
+#endif	/* __amd64 */
+
 	heap_size = (uintptr_t)ekernelheap - (uintptr_t)kernelheap;
 	heap_arena = vmem_init("heap", kernelheap, heap_size, PAGESIZE,
 	    segkmem_alloc, segkmem_free);
@@ -1186,7 +1210,11 @@ segkmem_xalloc_lp(vmem_t *vmp, void *inaddr, size_t size, int vmflag,
 
 		for (--i; i >= 0; --i) {
 			ppa[i]->p_lckcnt = 1;
+#if defined(__x86)
+			page_downgrade(ppa[i]);
+#else
 			page_unlock(ppa[i]);
+#endif
 		}
 	}
 
@@ -1227,7 +1255,18 @@ segkmem_free_one_lp(caddr_t addr, size_t size)
 	hat_unload(kas.a_hat, addr, size, HAT_UNLOAD_UNLOCK);
 
 	for (; pgs_left > 0; addr += PAGESIZE, pgs_left--) {
+#if defined(__x86)
+		pp = page_find(&kvp, (u_offset_t)(uintptr_t)addr);
+		if (pp == NULL)
+			panic("segkmem_free_one_lp: page not found");
+		if (!page_tryupgrade(pp)) {
+			page_unlock(pp);
+			pp = page_lookup(&kvp, (u_offset_t)(uintptr_t)addr,
+			    SE_EXCL);
+		}
+#else
 		pp = page_lookup(&kvp, (u_offset_t)(uintptr_t)addr, SE_EXCL);
+#endif
 		if (pp == NULL)
 			panic("segkmem_free_one_lp: page not found");
 		ASSERT(PAGE_EXCL(pp));
@@ -1449,7 +1488,7 @@ segkmem_lpsetup()
 {
 	int use_large_pages = 0;
 
-#ifdef __sparc
+#if defined(__sparc) || defined(__amd64)
 
 	size_t memtotal = physmem * PAGESIZE;
 
@@ -1523,9 +1562,12 @@ segkmem_zio_init(void *zio_mem_base, size_t zio_mem_size)
 	 * To reduce VA space fragmentation, we set up quantum caches for the
 	 * smaller sizes;  we chose 32k because that translates to 128k VA
 	 * slabs, which matches nicely with the common 128k zio_data bufs.
+	 * The power-of-two sizes above that (up to 512k, for large blocks)
+	 * are segment cached so that they don't all serialize on the arena
+	 * lock.
 	 */
 	zio_arena = vmem_create("zfs_file_data", zio_mem_base, zio_mem_size,
-	    PAGESIZE, NULL, NULL, NULL, 32 * 1024, VM_SLEEP);
+	    PAGESIZE, NULL, NULL, NULL, 32 * 1024, VMC_SEGCACHE | VM_SLEEP);
 
 	zio_alloc_arena = vmem_create("zfs_file_data_buf", NULL, 0, PAGESIZE,
 	    segkmem_zio_alloc, segkmem_zio_free, zio_arena, 0, VM_SLEEP);
@@ -1534,7 +1576,7 @@ segkmem_zio_init(void *zio_mem_base, size_t zio_mem_size)
 	ASSERT(zio_alloc_arena != NULL);
 }
 
-#ifdef __sparc
+#if defined(__sparc) || defined(__amd64)
 
 
 static void *
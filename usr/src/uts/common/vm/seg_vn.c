@@ -56,6 +56,8 @@
 #include <sys/vtrace.h>
 #include <sys/cmn_err.h>
 #include <sys/callb.h>
+#include <sys/kstat.h>
+#include <sys/var.h>
 #include <sys/vm.h>
 #include <sys/dumphdr.h>
 #include <sys/lgrp.h>
@@ -378,6 +380,47 @@ static void segvn_trupdate(void);
 static void segvn_trupdate_seg(struct seg *, segvn_data_t *, svntr_t *,
     ulong_t);
 
+/*
+ * Background large page promotion of anonymous memory.
+ *
+ * Private anon memory only ends up on large pages if its segment had a
+ * large page size when the memory was faulted in, which takes ppgsz(1),
+ * memcntl(2) or mpss.so.1 unless the automatic large page tunables
+ * (max_privmap_lpsize and friends) say so.  segvn_lpd_thread periodically
+ * looks through every process for private anon segments still at szc 0
+ * that contain runs of fully populated, suitably aligned large pages.
+ * Each run has its page size raised with as_setpagesize(), as if the
+ * process had asked for it with memcntl(MC_HAT_ADVISE), and is refaulted
+ * so that anon_map_getpages() relocates the small pages into large ones
+ * and hat_memload_array() maps them.
+ *
+ * The page size is the largest one that the automatic large page policy
+ * for the segment's type (heap, stack or other private memory) allows or,
+ * if segvn_lpd_maxpgsz is set, the largest one up to that size.  Segments
+ * whose page size was chosen explicitly (s_szc != 0) are left alone.
+ */
+int		segvn_lpd_enable = 1;
+size_t		segvn_lpd_maxpgsz = 0;
+int		segvn_lpd_interval = 30;	/* seconds between scans */
+uint_t		segvn_lpd_maxpromote = 128;	/* runs promoted per scan */
+
+static struct segvn_lpd_stats {
+	kstat_named_t	lpd_scans;		/* scans of all processes */
+	kstat_named_t	lpd_candidates;		/* large pages attempted */
+	kstat_named_t	lpd_promoted;		/* ... and now mapped large */
+	kstat_named_t	lpd_setpgsz_fail;	/* as_setpagesize() failed */
+	kstat_named_t	lpd_remap_fail;		/* refault left small pages */
+} segvn_lpd_stats = {
+	{ "scans",		KSTAT_DATA_UINT64 },
+	{ "candidates",		KSTAT_DATA_UINT64 },
+	{ "promoted",		KSTAT_DATA_UINT64 },
+	{ "setpgsz_fail",	KSTAT_DATA_UINT64 },
+	{ "remap_fail",		KSTAT_DATA_UINT64 },
+};
+
+static void segvn_lpd_thread(void);
+static void segvn_lpd_scan(void);
+
 /*
  * Initialize segvn data structures
  */
@@ -469,6 +512,11 @@ segvn_init(void)
 	}
 #endif
 
+	if (segvn_maxpgszc != 0) {
+		(void) thread_create(NULL, 0, segvn_lpd_thread,
+		    NULL, 0, &p0, TS_RUN, minclsyspri);
+	}
+
 	if (!ISP2(segvn_pglock_comb_balign) ||
 	    segvn_pglock_comb_balign < PAGESIZE) {
 		segvn_pglock_comb_balign = 1UL << 16; /* 64K */
@@ -10129,3 +10177,232 @@ segvn_trupdate_seg(struct seg *seg,
 
 	SEGVN_TR_ADDSTAT(asyncrepl);
 }
+
+static void
+segvn_lpd_thread(void)
+{
+	callb_cpr_t cpr_info;
+	kmutex_t cpr_lock;	/* just for CPR stuff */
+	kstat_t *ksp;
+
+	mutex_init(&cpr_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	CALLB_CPR_INIT(&cpr_info, &cpr_lock,
+	    callb_generic_cpr, "segvn_lpd");
+
+	ksp = kstat_create("unix", 0, "segvn_lpd", "vm", KSTAT_TYPE_NAMED,
+	    sizeof (segvn_lpd_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (ksp != NULL) {
+		ksp->ks_data = &segvn_lpd_stats;
+		kstat_install(ksp);
+	}
+
+	for (;;) {
+		mutex_enter(&cpr_lock);
+		CALLB_CPR_SAFE_BEGIN(&cpr_info);
+		mutex_exit(&cpr_lock);
+		delay(MAX(segvn_lpd_interval, 1) * hz);
+		mutex_enter(&cpr_lock);
+		CALLB_CPR_SAFE_END(&cpr_info, &cpr_lock);
+		mutex_exit(&cpr_lock);
+		if (segvn_lpd_enable && !segvn_lpg_disable)
+			segvn_lpd_scan();
+	}
+}
+
+/*
+ * Return the size codes the promotion policy allows for seg.
+ */
+static uint_t
+segvn_lpd_szcvec(proc_t *p, struct seg *seg)
+{
+	caddr_t eaddr = seg->s_base + seg->s_size;
+	uint_t szcvec = 0;
+	uint_t szc;
+	int type;
+
+	if (segvn_lpd_maxpgsz != 0) {
+		for (szc = 1; szc <= segvn_maxpgszc &&
+		    szc < page_num_user_pagesizes(0); szc++) {
+			if (page_get_pagesize(szc) <= segvn_lpd_maxpgsz)
+				szcvec |= 1 << szc;
+		}
+		return (szcvec);
+	}
+
+	if (p->p_brkbase >= seg->s_base && p->p_brkbase < eaddr)
+		type = MAPPGSZC_HEAP;
+	else if (eaddr == p->p_usrstack)
+		type = MAPPGSZC_STACK;
+	else
+		type = MAPPGSZC_PRIVM;
+
+	szcvec = map_pgszcvec(seg->s_base, seg->s_size,
+	    (uintptr_t)seg->s_base, 0, type, 0);
+	return (szcvec & ((2 << segvn_maxpgszc) - 1) & ~1);
+}
+
+/*
+ * Find the first run of fully populated large pages in seg at or above
+ * start.  Returns the run in [*addrp, *eaddrp) and its size code in
+ * *szcp, or 0 if there is none.
+ */
+static int
+segvn_lpd_findrun(proc_t *p, struct seg *seg, caddr_t start,
+    caddr_t *addrp, caddr_t *eaddrp, uint_t *szcp)
+{
+	struct segvn_data *svd = (struct segvn_data *)seg->s_data;
+	struct anon_map *amp;
+	caddr_t a, ra, ea;
+	size_t pgsz;
+	pgcnt_t pgcnt;
+	uint_t szcvec, szc;
+	int full, found = 0;
+
+	if (seg->s_ops != &segvn_ops || seg->s_szc != 0)
+		return (0);
+
+	SEGVN_LOCK_ENTER(seg->s_as, &svd->lock, RW_READER);
+	amp = svd->amp;
+	if (svd->vp != NULL || amp == NULL || svd->type != MAP_PRIVATE ||
+	    (svd->flags & MAP_NORESERVE) || svd->pageprot ||
+	    svd->softlockcnt != 0 || amp->refcnt != 1 ||
+	    (szcvec = segvn_lpd_szcvec(p, seg)) == 0) {
+		SEGVN_LOCK_EXIT(seg->s_as, &svd->lock);
+		return (0);
+	}
+
+	ANON_LOCK_ENTER(&amp->a_rwlock, RW_READER);
+	while (szcvec != 0) {
+		szc = highbit(szcvec) - 1;
+		szcvec &= ~(1 << szc);
+		pgsz = page_get_pagesize(szc);
+		pgcnt = btop(pgsz);
+		a = (caddr_t)P2ROUNDUP((uintptr_t)MAX(start, seg->s_base),
+		    pgsz);
+		ea = (caddr_t)P2ALIGN((uintptr_t)(seg->s_base + seg->s_size),
+		    pgsz);
+		for (ra = NULL; a < ea; a += pgsz) {
+			full = (anon_pages(amp->ahp, svd->anon_index +
+			    seg_page(seg, a), pgcnt) == pgcnt);
+			if (full && ra == NULL)
+				ra = a;
+			else if (!full && ra != NULL)
+				break;
+		}
+		if (ra != NULL) {
+			*addrp = ra;
+			*eaddrp = a;
+			*szcp = szc;
+			found = 1;
+			break;
+		}
+	}
+	ANON_LOCK_EXIT(&amp->a_rwlock);
+	SEGVN_LOCK_EXIT(seg->s_as, &svd->lock);
+
+	return (found);
+}
+
+static void
+segvn_lpd_promote(struct as *as, caddr_t addr, caddr_t eaddr, uint_t szc)
+{
+	size_t pgsz = page_get_pagesize(szc);
+	caddr_t a;
+
+	segvn_lpd_stats.lpd_candidates.value.ui64 += (eaddr - addr) / pgsz;
+
+	if (as_setpagesize(as, addr, eaddr - addr, szc, B_FALSE) != 0) {
+		segvn_lpd_stats.lpd_setpgsz_fail.value.ui64++;
+		return;
+	}
+
+	/*
+	 * The small pages are still mapped; refaulting the range relocates
+	 * them into large pages and maps those in their place.  Whatever
+	 * could not be relocated stays mapped with small pages.
+	 */
+	(void) as_fault(as->a_hat, as, addr, eaddr - addr, F_INVAL, S_READ);
+
+	for (a = addr; a < eaddr; a += pgsz) {
+		if ((size_t)hat_getpagesize(as->a_hat, a) == pgsz)
+			segvn_lpd_stats.lpd_promoted.value.ui64++;
+		else
+			segvn_lpd_stats.lpd_remap_fail.value.ui64++;
+	}
+}
+
+/*
+ * Promote up to budget runs in p's address space.  Returns the number
+ * of runs attempted.
+ */
+static uint_t
+segvn_lpd_proc(proc_t *p, uint_t budget)
+{
+	struct as *as = p->p_as;
+	struct seg *seg;
+	caddr_t next = NULL;
+	caddr_t addr, eaddr;
+	uint_t szc;
+	uint_t n;
+
+	if (as == NULL || as == &kas)
+		return (0);
+
+	for (n = 0; n < budget; n++) {
+		AS_LOCK_ENTER(as, &as->a_lock, RW_READER);
+		seg = (next == NULL) ? AS_SEGFIRST(as) :
+		    as_findseg(as, next, 0);
+		for (; seg != NULL; seg = AS_SEGNEXT(as, seg)) {
+			if (segvn_lpd_findrun(p, seg, next, &addr, &eaddr,
+			    &szc))
+				break;
+		}
+		AS_LOCK_EXIT(as, &as->a_lock);
+
+		if (seg == NULL)
+			break;
+		segvn_lpd_promote(as, addr, eaddr, szc);
+		next = eaddr;
+	}
+	return (n);
+}
+
+/*
+ * Walk the process table as vm_usage does, holding each process with
+ * P_PR_LOCK so that it cannot exit while its address space is examined.
+ * Processes that are already P_PR_LOCK'd are simply skipped.
+ */
+static void
+segvn_lpd_scan(void)
+{
+	uint_t budget = segvn_lpd_maxpromote;
+	proc_t *p;
+	int i;
+
+	segvn_lpd_stats.lpd_scans.value.ui64++;
+
+	mutex_enter(&pidlock);
+	for (i = 0; i < v.v_proc && budget != 0; i++) {
+		if ((p = pid_entry(i)) == NULL)
+			continue;
+
+		mutex_enter(&p->p_lock);
+		mutex_exit(&pidlock);
+
+		if ((p->p_flag & SSYS) || sprtrylock_proc(p) != 0) {
+			mutex_exit(&p->p_lock);
+			mutex_enter(&pidlock);
+			continue;
+		}
+		mutex_exit(&p->p_lock);
+
+		budget -= segvn_lpd_proc(p, budget);
+
+		mutex_enter(&p->p_lock);
+		sprunlock(p);
+		mutex_enter(&pidlock);
+	}
+	mutex_exit(&pidlock);
+}
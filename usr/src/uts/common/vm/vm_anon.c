@@ -2089,6 +2089,13 @@ top:
 
 	VM_STAT_ADD(anonvmstats.getpages[10]);
 
+	/*
+	 * A large page that is about to be zero-filled in its entirety is
+	 * zeroed up front, in parallel if it is big enough.
+	 */
+	if (prealloc && anon_pages(amp->ahp, start_idx, pgcnt) == 0)
+		page_zero_large(ppa, pgcnt);
+
 	an_idx = start_idx;
 	pg_idx = 0;
 	vaddr = addr;
@@ -2202,7 +2209,7 @@ top:
 		 */
 		if (slotcreate) {
 			ASSERT(prealloc);
-			pagezero(pp, 0, PAGESIZE);
+			pagezero_fresh(pp);
 			CPU_STATS_ADD_K(vm, zfod, 1);
 			hat_setrefmod(pp);
 		}
@@ -2775,7 +2782,7 @@ anon_zero(struct seg *seg, caddr_t addr, struct anon **app, struct cred *cred)
 	}
 	pp = anon_pl[0];
 
-	pagezero(pp, 0, PAGESIZE);	/* XXX - should set mod bit */
+	pagezero_fresh(pp);	/* XXX - should set mod bit */
 	page_downgrade(pp);
 	CPU_STATS_ADD_K(vm, zfod, 1);
 	hat_setrefmod(pp);	/* mark as modified so pageout writes back */
@@ -2994,7 +3001,7 @@ anon_map_createpages(
 
 			ASSERT(anon_pl[0] == pp);
 			ASSERT(nreloc == 1);
-			pagezero(pp, 0, PAGESIZE);
+			pagezero_fresh(pp);
 			CPU_STATS_ADD_K(vm, zfod, 1);
 			hat_setrefmod(pp);
 
@@ -324,6 +324,25 @@ struct memseg_stats {
 
 struct memseg *memsegs;		/* list of memory segments */
 
+/*
+ * Count of pages hashed onto vnodes other than swap and kernel vnodes,
+ * that is, the pages fsflush may have to write back.  It is striped by
+ * CPU so that page_do_hashin() and page_do_hashout() don't all update
+ * the same cache line; a stripe may go negative, only the sum matters.
+ */
+#define	PAGE_FSCNT_STRIPES	64
+
+static struct page_fscnt {
+	volatile long	pf_count;
+	char		pf_pad[64 - sizeof (long)];
+} page_fscnt[PAGE_FSCNT_STRIPES];
+
+#define	PAGE_FSCNT_ADD(pp, n) {						\
+	if (!PP_ISSWAP(pp) && !PP_ISKAS(pp))				\
+		atomic_add_long((ulong_t *)&page_fscnt[CPU->cpu_seqid &	\
+		    (PAGE_FSCNT_STRIPES - 1)].pf_count, (n));		\
+}
+
 /*
  * /etc/system tunable to control large page allocation hueristic.
  *
@@ -2261,11 +2280,21 @@ page_create_va_large(vnode_t *vp, u_offset_t off, size_t bytes, uint_t flags,
 	return (rootpp);
 }
 
+/*
+ * Kernel requests of at least page_batch_min pages take their pages off
+ * the freelists up to page_batch_max at a time, rather than one per
+ * trip (see page_get_freelist_batch()).
+ */
+pgcnt_t	page_batch_min = 8;
+pgcnt_t	page_batch_max = 64;
+
 page_t *
 page_create_va(vnode_t *vp, u_offset_t off, size_t bytes, uint_t flags,
     struct seg *seg, caddr_t vaddr)
 {
 	page_t		*plist = NULL;
+	page_t		*pool = NULL;
+	int		batch;
 	pgcnt_t		npages;
 	pgcnt_t		found_on_free = 0;
 	pgcnt_t		pages_req;
@@ -2378,7 +2407,12 @@ page_create_va(vnode_t *vp, u_offset_t off, size_t bytes, uint_t flags,
 	 * getting the hash lock.  This will minimize the hash
 	 * lock hold time, nesting, and the like.  If it turns
 	 * out we don't need the page, we put it back at the end.
+	 *
+	 * Large kernel requests pull their pages off the freelists
+	 * in batches onto pool.  User requests don't, lest the batch
+	 * defeat the lgroup memory allocation policy of the segment.
 	 */
+	batch = (seg->s_as == &kas && npages >= page_batch_min);
 	while (npages--) {
 		page_t		*pp;
 		kmutex_t	*phm = NULL;
@@ -2410,8 +2444,20 @@ top:
 			 * the physical memory
 			 */
 			lgrp = lgrp_mem_choose(seg, vaddr, PAGESIZE);
-			npp = page_get_freelist(vp, off, seg, vaddr, PAGESIZE,
-			    flags | PG_MATCH_COLOR, lgrp);
+			if (pool == NULL && batch) {
+				pool = page_get_freelist_batch(vp, seg, vaddr,
+				    MIN(npages + 1, page_batch_max), flags,
+				    lgrp);
+				if (pool == NULL)
+					batch = 0;
+			}
+			if (pool != NULL) {
+				npp = pool;
+				page_sub(&pool, npp);
+			} else {
+				npp = page_get_freelist(vp, off, seg, vaddr,
+				    PAGESIZE, flags | PG_MATCH_COLOR, lgrp);
+			}
 			if (npp == NULL) {
 				npp = page_get_cachelist(vp, off, seg,
 				    vaddr, flags | PG_MATCH_COLOR, lgrp);
@@ -2559,6 +2605,16 @@ fail:
 		page_unlock(npp);
 
 	}
+	while (pool != NULL) {
+		/*
+		 * Likewise what is left of the batch, which never
+		 * stopped being free.
+		 */
+		npp = pool;
+		page_sub(&pool, npp);
+		page_list_add(npp, PG_FREE_LIST | PG_LIST_TAIL);
+		page_unlock(npp);
+	}
 
 	ASSERT(pages_req >= found_on_free);
 
@@ -3449,6 +3505,7 @@ page_do_hashin(page_t *pp, vnode_t *vp, u_offset_t offset)
 		listp = &vp->v_pages;
 
 	page_vpadd(listp, pp);
+	PAGE_FSCNT_ADD(pp, 1);
 
 	return (1);
 }
@@ -3530,6 +3587,7 @@ page_do_hashout(page_t *pp)
 	 */
 	if (vp->v_pages)
 		page_vpsub(&vp->v_pages, pp);
+	PAGE_FSCNT_ADD(pp, -1);
 
 	pp->p_hash = NULL;
 	page_clr_all_props(pp);
@@ -3539,6 +3597,21 @@ page_do_hashout(page_t *pp)
 	pp->p_fsdata = 0;
 }
 
+/*
+ * Return the number of pages hashed onto vnodes other than swap and kernel
+ * vnodes.  The value is only a snapshot, as pages come and go all the time.
+ */
+pgcnt_t
+page_fs_pages(void)
+{
+	long	total = 0;
+	int	i;
+
+	for (i = 0; i < PAGE_FSCNT_STRIPES; i++)
+		total += page_fscnt[i].pf_count;
+	return (total > 0 ? (pgcnt_t)total : 0);
+}
+
 /*
  * Remove page ``pp'' from the hash and vp chains and remove vp association.
  *
@@ -4566,6 +4639,15 @@ page_do_relocate_hash(page_t *new, page_t *old)
 	if ((new->p_vnode->v_flag & VISSWAP) != 0)
 		PP_SETSWAP(new);
 
+	/*
+	 * The vnode may have become or stopped being swap since old was
+	 * hashed in, so move old's place in the page_fscnt count to new.
+	 */
+	if (PP_ISSWAP(old) != PP_ISSWAP(new)) {
+		PAGE_FSCNT_ADD(old, -1);
+		PAGE_FSCNT_ADD(new, 1);
+	}
+
 	/*
 	 * replace old with new on the vnode's page list
 	 */
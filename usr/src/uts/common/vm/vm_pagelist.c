@@ -64,6 +64,10 @@
 #include <sys/sdt.h>
 #include <sys/dumphdr.h>
 #include <sys/swap.h>
+#include <sys/kstat.h>
+#include <sys/taskq.h>
+#include <sys/cpuvar.h>
+#include <sys/disp.h>
 
 extern uint_t	vac_colors;
 
@@ -1376,9 +1380,49 @@ page_freelist_unlock(int mnode)
 	}
 }
 
+/*
+ * Pre-zeroed free pages.
+ *
+ * Anonymous memory has to be zero-filled before it is handed out, which
+ * the faulting thread does itself.  To take that work off the fault path,
+ * a page_zero_thread per memory node uses otherwise idle time to zero
+ * free pages in place, keeping about page_zero_pct percent of the node's
+ * memory zeroed while free memory is plentiful.  Zeroed pages go back to
+ * the head of their freelist with P_ZEROED set, so they are handed out
+ * first, and pagezero_fresh() does not zero them a second time.  The mark
+ * is dropped whenever a page is freed, so a page that has been in use is
+ * never mistaken for a zeroed one.
+ *
+ * page_zero_large() zeroes the constituents of a large page, spreading
+ * the work over page_zero_taskq when there is enough of it; otherwise a
+ * fault on a large MAP_ANON region zeroes each large page on one CPU.
+ */
+int	page_zero_enable = 1;
+uint_t	page_zero_pct = 5;		/* % of each node to keep zeroed */
+uint_t	page_zero_batch = 1024;		/* pages zeroed per wakeup */
+pgcnt_t	page_zero_parallel_min = 512;	/* for page_zero_large() */
+pgcnt_t	page_zero_chunk = 256;		/* pages per taskq task */
+
+static ulong_t	page_zeroed_cnt[MAX_MEM_NODES];	/* free, zeroed pages */
+static pfn_t	page_zero_cursor[MAX_MEM_NODES];
+static taskq_t	*page_zero_taskq;
+
+static struct page_zero_stats {
+	kstat_named_t	pz_zeroed;	/* by page_zero_thread */
+	kstat_named_t	pz_hits;	/* pagezero_fresh() had nothing to do */
+	kstat_named_t	pz_misses;	/* pagezero_fresh() zeroed the page */
+	kstat_named_t	pz_parallel;	/* zeroed on page_zero_taskq */
+} page_zero_stats = {
+	{ "zeroed",	KSTAT_DATA_UINT64 },
+	{ "hits",	KSTAT_DATA_UINT64 },
+	{ "misses",	KSTAT_DATA_UINT64 },
+	{ "parallel",	KSTAT_DATA_UINT64 },
+};
+
 /*
  * add pp to the specified page list. Defaults to head of the page list
- * unless PG_LIST_TAIL is specified.
+ * unless PG_LIST_TAIL is specified.  PG_LIST_ZEROED marks the page as
+ * zero-filled.
  */
 void
 page_list_add(page_t *pp, int flags)
@@ -1408,6 +1452,11 @@ page_list_add(page_t *pp, int flags)
 	mnode = PP_2_MEM_NODE(pp);
 	mtype = PP_2_MTYPE(pp);
 
+	if ((flags & PG_LIST_ZEROED) && !PP_ISZEROED(pp)) {
+		PP_SETZEROED(pp);
+		atomic_add_long(&page_zeroed_cnt[mnode], 1);
+	}
+
 	if (flags & PG_LIST_ISINIT) {
 		/*
 		 * PG_LIST_ISINIT is set during system startup (ie. single
@@ -3865,6 +3914,130 @@ pgretry:
 	return (NULL);
 }
 
+/*
+ * page_get_freelist_batch() takes up to page_batch_colorrun pages out of
+ * a color bin per hold of the bin lock.
+ */
+pgcnt_t	page_batch_colorrun = 8;
+
+/*
+ * Move up to want free PAGESIZE pages out of bin onto the tail of *plistp,
+ * all under one hold of the bin lock.  Returns the number moved.
+ */
+static pgcnt_t
+page_get_bin_batch(int mnode, uint_t bin, int mtype, pgcnt_t want,
+    page_t **plistp)
+{
+	page_t		**ppp = &PAGE_FREELISTS(mnode, 0, bin, mtype);
+	page_t		*pp, *next;
+	kmutex_t	*pcm;
+	pgcnt_t		n = 0, scan = want * 2;
+
+	if (*ppp == NULL)
+		return (0);
+
+	pcm = PC_BIN_MUTEX(mnode, bin, PG_FREE_LIST);
+	mutex_enter(pcm);
+	pp = *ppp;
+	while (pp != NULL && n < want && scan-- != 0) {
+		next = pp->p_next;
+		if (next == *ppp)	/* pp is the last page on the list */
+			next = NULL;
+
+		ASSERT(PP_ISFREE(pp));
+		ASSERT(PP_ISAGED(pp));
+		ASSERT(pp->p_szc == 0);
+		ASSERT(PFN_2_MEM_NODE(pp->p_pagenum) == mnode);
+
+		if (!IS_DUMP_PAGE(pp) && page_trylock(pp, SE_EXCL)) {
+			ASSERT(mtype == PP_2_MTYPE(pp));
+			page_sub(ppp, pp);
+			page_ctr_sub(mnode, mtype, pp, PG_FREE_LIST);
+#if defined(__sparc)
+			if (PP_ISNORELOC(pp))
+				kcage_freemem_sub(1);
+#endif
+			page_add(plistp, pp);
+			*plistp = (*plistp)->p_next;
+			n++;
+		}
+		pp = next;
+	}
+	mutex_exit(pcm);
+
+	return (n);
+}
+
+/*
+ * Batched page_get_freelist() for callers about to create many PAGESIZE
+ * pages at once.  Takes up to npages pages off the freelists local to
+ * lgrp, visiting the color bins in the order that consecutive virtual
+ * pages starting at vaddr would use them, and pulling up to
+ * page_batch_colorrun pages out of each bin per lock hold; large requests
+ * thus trade some color spread for fewer trips to the freelist locks.
+ *
+ * Unlike page_get_freelist() this never splits or coalesces larger pages
+ * and never goes off-node, so it may well come back with fewer pages than
+ * asked for, or none; the caller gets the rest one at a time.  The pages
+ * are returned as a list in the order they should be used, locked
+ * SE_EXCL and still marked free.
+ */
+page_t *
+page_get_freelist_batch(struct vnode *vp, struct seg *seg, caddr_t vaddr,
+    pgcnt_t npages, uint_t flags, struct lgrp *lgrp)
+{
+	page_t			*plist = NULL;
+	lgrp_mnode_cookie_t	lgrp_cookie;
+	pgcnt_t			n = 0, run;
+	uint_t			bin, sbin, colors;
+	int			mnode, mtype, mt;
+
+	if (!LGRP_EXISTS(lgrp))
+		lgrp = lgrp_home_lgrp();
+
+	/* same cage reserve as page_get_freelist() */
+	if (kcage_on) {
+		if ((flags & (PG_NORELOC | PG_PANIC)) == PG_NORELOC &&
+		    kcage_freemem < kcage_throttlefree + npages &&
+		    curthread != kcage_cageout_thread)
+			return (NULL);
+	} else {
+		flags &= ~PG_NORELOC;
+		flags |= PGI_NOCAGE;
+	}
+
+	/* LINTED */
+	MTYPE_INIT(mtype, vp, vaddr, flags, PAGESIZE);
+	/* LINTED */
+	AS_2_BIN(seg->s_as, seg, vp, vaddr, bin, 0);
+	colors = PAGE_GET_PAGECOLORS(0);
+	ASSERT(ISP2(colors) && bin < colors);
+
+	/* spread the request over as many colors as it can cover */
+	run = MAX(MIN(page_batch_colorrun, howmany(npages, colors)), 1);
+
+	LGRP_MNODE_COOKIE_INIT(lgrp_cookie, lgrp, LGRP_SRCH_LOCAL);
+	while (n < npages && (mnode = lgrp_memnode_choose(&lgrp_cookie)) >= 0) {
+		mt = mtype;
+		MTYPE_START(mnode, mt, flags);
+		while (mt >= 0 && n < npages) {
+			sbin = bin;
+			do {
+				n += page_get_bin_batch(mnode, bin, mt,
+				    MIN(run, npages - n), &plist);
+				bin = (bin + 1) & (colors - 1);
+			} while (n < npages && bin != sbin);
+			MTYPE_NEXT(mnode, mt, flags);
+		}
+	}
+
+	if (n != 0) {
+		DTRACE_PROBE4(page__get__batch, lgrp_t *, lgrp, caddr_t, vaddr,
+		    pgcnt_t, npages, pgcnt_t, n);
+	}
+	return (plist);
+}
+
 /*
  * Find the `best' page on the cachelist for this (vp,off) (as,vaddr) pair.
  *
@@ -4457,3 +4630,246 @@ page_set_colorequiv_arr(void)
 		}
 	}
 }
+
+/*
+ * PP_CLRFREE() for a page that has P_ZEROED set.
+ */
+void
+page_zero_clrfree(page_t *pp)
+{
+	if (PP_ISFREE(pp)) {
+		atomic_add_long(&page_zeroed_cnt[PP_2_MEM_NODE(pp)], -1);
+		pp->p_state &= ~P_FREE;
+	}
+}
+
+/*
+ * Zero-fill a page that was just taken off the freelist, unless that has
+ * already been done while it was free.
+ */
+void
+pagezero_fresh(page_t *pp)
+{
+	ASSERT(PAGE_EXCL(pp));
+	ASSERT(!PP_ISFREE(pp));
+
+	if (PP_ISZEROED(pp)) {
+		PP_CLRZEROED(pp);
+		atomic_inc_64(&page_zero_stats.pz_hits.value.ui64);
+	} else {
+		pagezero(pp, 0, PAGESIZE);
+		atomic_inc_64(&page_zero_stats.pz_misses.value.ui64);
+	}
+}
+
+/*
+ * Zero one free page in place.  Returns 1 if it did.
+ */
+static int
+page_zero_one(page_t *pp)
+{
+	if (!PP_ISAGED(pp) || PP_ISZEROED(pp) || pp->p_szc != 0 ||
+	    PP_ISRAF(pp) || pp->p_toxic != 0)
+		return (0);
+	if (!page_trylock(pp, SE_EXCL))
+		return (0);
+
+	/* recheck now that the page cannot be allocated under us */
+	if (!PP_ISAGED(pp) || PP_ISZEROED(pp) || pp->p_szc != 0 ||
+	    PP_ISRAF(pp) || pp->p_toxic != 0) {
+		page_unlock(pp);
+		return (0);
+	}
+
+	page_list_sub(pp, PG_FREE_LIST);
+	pagezero(pp, 0, PAGESIZE);
+	page_list_add(pp, PG_FREE_LIST | PG_LIST_HEAD | PG_LIST_ZEROED);
+	page_unlock(pp);
+	return (1);
+}
+
+/*
+ * Zero up to page_zero_batch free pages of mnode, continuing where the
+ * previous call left off.  Gives up as soon as anything else wants to run
+ * on this CPU.
+ */
+static pgcnt_t
+page_zero_mnode(int mnode)
+{
+	pfn_t pfn = page_zero_cursor[mnode];
+	pfn_t base = mem_node_config[mnode].physbase;
+	pfn_t max = mem_node_config[mnode].physmax;
+	pgcnt_t scan = (pgcnt_t)page_zero_batch * 16;
+	pgcnt_t n = 0;
+	page_t *pp;
+
+	while (n < page_zero_batch && scan-- != 0) {
+		if (CPU->cpu_disp->disp_nrunnable != 0 || CPU->cpu_runrun)
+			break;
+		if (pfn < base || pfn > max)
+			pfn = base;
+		if ((pp = page_numtopp_nolock(pfn++)) != NULL)
+			n += page_zero_one(pp);
+	}
+	page_zero_cursor[mnode] = pfn;
+
+	atomic_add_64(&page_zero_stats.pz_zeroed.value.ui64, n);
+	return (n);
+}
+
+static void
+page_zero_thread(void *arg)
+{
+	int mnode = (int)(uintptr_t)arg;
+	callb_cpr_t cpr_info;
+	kmutex_t cpr_lock;
+	pgcnt_t target, n = 0;
+
+	mutex_init(&cpr_lock, NULL, MUTEX_DEFAULT, NULL);
+	CALLB_CPR_INIT(&cpr_info, &cpr_lock, callb_generic_cpr, "page_zero");
+
+	for (;;) {
+		mutex_enter(&cpr_lock);
+		CALLB_CPR_SAFE_BEGIN(&cpr_info);
+		mutex_exit(&cpr_lock);
+
+		/* keep going while there is work, else check back later */
+		delay(n == page_zero_batch ? 1 : hz);
+
+		mutex_enter(&cpr_lock);
+		CALLB_CPR_SAFE_END(&cpr_info, &cpr_lock);
+		mutex_exit(&cpr_lock);
+
+		n = 0;
+		if (!page_zero_enable || !mem_node_config[mnode].exists ||
+		    freemem <= lotsfree)
+			continue;
+
+		target = (mem_node_config[mnode].physmax -
+		    mem_node_config[mnode].physbase + 1) / 100 * page_zero_pct;
+		if ((long)page_zeroed_cnt[mnode] < (long)target)
+			n = page_zero_mnode(mnode);
+	}
+}
+
+typedef struct page_zero_job {
+	kmutex_t	pzj_lock;
+	kcondvar_t	pzj_cv;
+	uint_t		pzj_pending;	/* tasks still running */
+} page_zero_job_t;
+
+typedef struct page_zero_task {
+	page_zero_job_t	*pzt_job;
+	page_t		**pzt_ppa;
+	pgcnt_t		pzt_npages;
+} page_zero_task_t;
+
+static void
+page_zero_range(page_t **ppa, pgcnt_t npages)
+{
+	page_t *pp;
+
+	while (npages-- != 0) {
+		pp = *ppa++;
+		ASSERT(PAGE_EXCL(pp));
+		if (!PP_ISZEROED(pp)) {
+			pagezero(pp, 0, PAGESIZE);
+			PP_SETZEROED(pp);
+		}
+	}
+}
+
+static void
+page_zero_task(void *arg)
+{
+	page_zero_task_t *pzt = arg;
+	page_zero_job_t *pzj = pzt->pzt_job;
+
+	page_zero_range(pzt->pzt_ppa, pzt->pzt_npages);
+
+	mutex_enter(&pzj->pzj_lock);
+	if (--pzj->pzj_pending == 0)
+		cv_signal(&pzj->pzj_cv);
+	mutex_exit(&pzj->pzj_lock);
+}
+
+/*
+ * Zero the npages pages in ppa, the constituents of a large page that the
+ * caller has just allocated, and mark them P_ZEROED so that
+ * pagezero_fresh() leaves them alone.
+ */
+void
+page_zero_large(page_t **ppa, pgcnt_t npages)
+{
+	page_zero_job_t pzj;
+	page_zero_task_t *pzt;
+	pgcnt_t chunk = MAX(page_zero_chunk, 1);
+	uint_t i, ntasks;
+
+	if (page_zero_taskq == NULL || npages < page_zero_parallel_min) {
+		page_zero_range(ppa, npages);
+		return;
+	}
+
+	ntasks = howmany(npages, chunk);
+	pzt = kmem_alloc(ntasks * sizeof (*pzt), KM_SLEEP);
+	mutex_init(&pzj.pzj_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&pzj.pzj_cv, NULL, CV_DEFAULT, NULL);
+	pzj.pzj_pending = 0;
+
+	/* the first chunk is ours */
+	for (i = 1; i < ntasks; i++) {
+		pzt[i].pzt_job = &pzj;
+		pzt[i].pzt_ppa = ppa + i * chunk;
+		pzt[i].pzt_npages = MIN(chunk, npages - i * chunk);
+
+		mutex_enter(&pzj.pzj_lock);
+		pzj.pzj_pending++;
+		mutex_exit(&pzj.pzj_lock);
+		if (taskq_dispatch(page_zero_taskq, page_zero_task, &pzt[i],
+		    TQ_NOSLEEP) == NULL) {
+			mutex_enter(&pzj.pzj_lock);
+			pzj.pzj_pending--;
+			mutex_exit(&pzj.pzj_lock);
+			page_zero_range(pzt[i].pzt_ppa, pzt[i].pzt_npages);
+		} else {
+			atomic_add_64(&page_zero_stats.pz_parallel.value.ui64,
+			    pzt[i].pzt_npages);
+		}
+	}
+	page_zero_range(ppa, MIN(chunk, npages));
+
+	mutex_enter(&pzj.pzj_lock);
+	while (pzj.pzj_pending != 0)
+		cv_wait(&pzj.pzj_cv, &pzj.pzj_lock);
+	mutex_exit(&pzj.pzj_lock);
+
+	cv_destroy(&pzj.pzj_cv);
+	mutex_destroy(&pzj.pzj_lock);
+	kmem_free(pzt, ntasks * sizeof (*pzt));
+}
+
+void
+page_zero_init(void)
+{
+	kstat_t *ksp;
+	int mnode;
+
+	if ((ksp = kstat_create("unix", 0, "page_zero", "vm",
+	    KSTAT_TYPE_NAMED, sizeof (page_zero_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL)) != NULL) {
+		ksp->ks_data = &page_zero_stats;
+		kstat_install(ksp);
+	}
+
+	page_zero_taskq = taskq_create("page_zero_taskq", MAX(ncpus / 2, 1),
+	    minclsyspri, 1, INT_MAX, TASKQ_PREPOPULATE);
+
+	for (mnode = 0; mnode < max_mem_nodes; mnode++) {
+		if (!mem_node_config[mnode].exists)
+			continue;
+		page_zero_cursor[mnode] = mem_node_config[mnode].physbase;
+		(void) thread_create(NULL, 0, page_zero_thread,
+		    (void *)(uintptr_t)mnode, 0, &p0, TS_RUN, minclsyspri);
+	}
+}
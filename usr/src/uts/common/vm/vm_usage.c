@@ -131,6 +131,23 @@
  *  Each entity structure tracks which pages have been already visited for
  *  that entity (via previously inspected processes) so that these pages are
  *  not double counted.
+ *
+ * Approximate rss
+ *
+ * The exact calculation above has to look at every page of every segment,
+ * which takes seconds on a large system; too long for a resource capping
+ * daemon or a monitor that wants an answer every second.  So each zone and
+ * project also keeps a running count of the pages mapped by its processes
+ * (zone_rss and kpd_rss), exported through the "rss" zone and project
+ * kstats.  The HAT already keeps the number of pages mapped in each
+ * address space up to date as it loads and unloads translations; each
+ * process remembers how much of that it last charged to its zone and
+ * project (p_rss_charged), and vm_rss_update() folds in the difference.
+ * vm_rss_sync() does that for every process, which costs a pass over the
+ * process table but not a single segment, and is done at most every
+ * vm_rss_sync_interval ticks, when one of the kstats is read.  Pages
+ * mapped by more than one process are counted once per mapping, so the
+ * counts are an upper bound on what getvmusage() would report.
  */
 
 #include <sys/errno.h>
@@ -153,10 +170,12 @@
 #include <sys/zone.h>
 #include <sys/sunddi.h>
 #include <sys/avl.h>
+#include <sys/atomic.h>
 #include <vm/anon.h>
 #include <vm/as.h>
 #include <vm/seg_vn.h>
 #include <vm/seg_spt.h>
+#include <vm/rm.h>
 
 #define	VMUSAGE_HASH_SIZE		512
 
@@ -301,6 +320,10 @@ extern struct seg_ops segvn_ops;
 extern struct seg_ops segspt_shmops;
 
 static vmu_data_t vmu_data;
+
+clock_t vm_rss_sync_interval = 0;	/* ticks; hz if 0 */
+static kmutex_t vm_rss_sync_lock;
+static clock_t vm_rss_sync_time;
 static kmem_cache_t *vmu_bound_cache;
 static kmem_cache_t *vmu_object_cache;
 
@@ -409,6 +432,7 @@ vm_usage_init()
 {
 	mutex_init(&vmu_data.vmu_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&vmu_data.vmu_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&vm_rss_sync_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	vmu_data.vmu_system = NULL;
 	vmu_data.vmu_zones_hash = NULL;
@@ -2030,3 +2054,95 @@ start:
 	vmu_data.vmu_pending_waiters--;
 	goto start;
 }
+
+/*
+ * Bring the rss charged to p's zone and project in line with what its
+ * address space has mapped right now.
+ */
+void
+vm_rss_update(proc_t *p)
+{
+	pgcnt_t rss;
+	int64_t delta;
+
+	ASSERT(MUTEX_HELD(&p->p_lock));
+
+	/* leave processes halfway through zone_enter() alone */
+	if (p->p_task->tk_proj->kpj_zone != p->p_zone)
+		return;
+
+	rss = rm_asrss(p->p_as);
+	if ((delta = (int64_t)rss - (int64_t)p->p_rss_charged) == 0)
+		return;
+	p->p_rss_charged = rss;
+	atomic_add_64(&p->p_zone->zone_rss, delta);
+	atomic_add_64(&p->p_task->tk_proj->kpj_data.kpd_rss, delta);
+}
+
+/*
+ * Take back everything charged to p's zone and project, before p exits or
+ * leaves them.  The next vm_rss_update() charges whatever p then maps to
+ * its new zone and project.
+ */
+void
+vm_rss_uncharge(proc_t *p)
+{
+	ASSERT(MUTEX_HELD(&p->p_lock));
+
+	if (p->p_rss_charged == 0)
+		return;
+	atomic_add_64(&p->p_zone->zone_rss, -(int64_t)p->p_rss_charged);
+	atomic_add_64(&p->p_task->tk_proj->kpj_data.kpd_rss,
+	    -(int64_t)p->p_rss_charged);
+	p->p_rss_charged = 0;
+}
+
+/*
+ * p has just joined a task in another project of the same zone; move what
+ * it was charged over from oldpj.
+ */
+void
+vm_rss_move(proc_t *p, kproject_t *oldpj)
+{
+	ASSERT(MUTEX_HELD(&p->p_lock));
+	ASSERT(oldpj->kpj_zone == p->p_zone);
+
+	if (p->p_rss_charged == 0)
+		return;
+	atomic_add_64(&oldpj->kpj_data.kpd_rss, -(int64_t)p->p_rss_charged);
+	atomic_add_64(&p->p_task->tk_proj->kpj_data.kpd_rss,
+	    p->p_rss_charged);
+}
+
+/*
+ * Update the rss charged by every process.  Readers of the rss kstats call
+ * this every time, so it does nothing if someone else has done it within
+ * the last vm_rss_sync_interval ticks or is doing it now.
+ */
+void
+vm_rss_sync(void)
+{
+	clock_t now = ddi_get_lbolt();
+	clock_t interval = vm_rss_sync_interval;
+	proc_t *p;
+	int i;
+
+	if (interval == 0)
+		interval = hz;
+	if (now - vm_rss_sync_time < interval ||
+	    !mutex_tryenter(&vm_rss_sync_lock))
+		return;
+
+	mutex_enter(&pidlock);
+	for (i = 0; i < v.v_proc; i++) {
+		if ((p = pid_entry(i)) == NULL || p->p_stat == SIDL)
+			continue;
+		mutex_enter(&p->p_lock);
+		vm_rss_update(p);
+		mutex_exit(&p->p_lock);
+	}
+	mutex_exit(&pidlock);
+
+	vm_rss_sync_time = ddi_get_lbolt();
+	mutex_exit(&vm_rss_sync_lock);
+}
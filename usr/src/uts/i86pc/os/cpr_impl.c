@@ -575,8 +575,8 @@ i_cpr_power_down(int sleeptype)
 	PMD(PMD_SX, ("real_mode_platter->rm_pdbr=%lx, getcr3()=%lx\n",
 	    (ulong_t)real_mode_platter->rm_pdbr, getcr3()))
 
-	real_mode_platter->rm_cr4 = getcr4();
-	real_mode_platter->rm_pdbr = getcr3();
+	real_mode_platter->rm_cr4 = getcr4() & ~CR4_PCIDE;
+	real_mode_platter->rm_pdbr = getcr3() & MMU_PAGEMASK;
 
 	rmp_gdt_init(real_mode_platter);
 
@@ -871,9 +871,13 @@ init_real_mode_platter(int cpun, uint32_t offset, uint_t cr4, wc_desctbr_t gdt)
 	 * have identical physical and virtual address in paged mode.
 	 */
 
-	real_mode_platter->rm_pdbr = getcr3();
+	/*
+	 * The real mode code can't turn on PCIDs; the wakeup code restores
+	 * the full %cr4 and %cr3 once in long mode.
+	 */
+	real_mode_platter->rm_pdbr = getcr3() & MMU_PAGEMASK;
 	real_mode_platter->rm_cpu = cpun;
-	real_mode_platter->rm_cr4 = cr4;
+	real_mode_platter->rm_cr4 = cr4 & ~CR4_PCIDE;
 
 	real_mode_platter->rm_gdt_base = gdt.base;
 	real_mode_platter->rm_gdt_lim = gdt.limit;
@@ -166,6 +166,9 @@ static char *x86_feature_names[NUM_X86_FEATURES] = {
 	"f16c",
 	"rdrand",
 	"x2apic",
+	"pcid",
+	"bmi2",
+	"adx",
 };
 
 boolean_t
@@ -1316,6 +1319,9 @@ cpuid_pass1(cpu_t *cpu, uchar_t *featureset)
 	if (cp->cp_ecx & CPUID_INTC_ECX_X2APIC) {
 		add_x86_feature(featureset, X86FSET_X2APIC);
 	}
+	if (cp->cp_ecx & CPUID_INTC_ECX_PCID) {
+		add_x86_feature(featureset, X86FSET_PCID);
+	}
 	if (cp->cp_edx & CPUID_INTC_EDX_DE) {
 		add_x86_feature(featureset, X86FSET_DE);
 	}
@@ -1351,6 +1357,21 @@ cpuid_pass1(cpu_t *cpu, uchar_t *featureset)
 	if (cp->cp_ecx & CPUID_INTC_ECX_RDRAND)
 		add_x86_feature(featureset, X86FSET_RDRAND);
 
+	/*
+	 * Structured extended features are in function 7, sub-leaf 0.
+	 */
+	if (cpi->cpi_maxeax >= 7) {
+		struct cpuid_regs r7;
+
+		bzero(&r7, sizeof (r7));
+		r7.cp_eax = 7;
+		(void) __cpuid_insn(&r7);
+		if (r7.cp_ebx & CPUID_INTC_EBX_7_0_BMI2)
+			add_x86_feature(featureset, X86FSET_BMI2);
+		if (r7.cp_ebx & CPUID_INTC_EBX_7_0_ADX)
+			add_x86_feature(featureset, X86FSET_ADX);
+	}
+
 	/*
 	 * Only need it first time, rest of the cpus would follow suit.
 	 * we only capture this for the bootcpu.
@@ -2690,6 +2711,10 @@ cpuid_pass4(cpu_t *cpu, uint_t *hwcap_out)
 
 		if (*ecx & CPUID_INTC_ECX_RDRAND)
 			hwcap_flags_2 |= AV_386_2_RDRAND;
+		if (is_x86_feature(x86_featureset, X86FSET_BMI2))
+			hwcap_flags_2 |= AV_386_2_BMI2;
+		if (is_x86_feature(x86_featureset, X86FSET_ADX))
+			hwcap_flags_2 |= AV_386_2_ADX;
 	}
 
 	if (cpi->cpi_xmaxeax < 0x80000001)
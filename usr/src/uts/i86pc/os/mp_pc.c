@@ -320,10 +320,11 @@ mach_cpucontext_xalloc(struct cpu *cp, int optype)
 	/*
 	 * For hot-adding CPU at runtime, Machine Check and Performance Counter
 	 * should be disabled. They will be enabled on demand after CPU powers
-	 * on successfully
+	 * on successfully. PCIDs can't be turned on until the CPU is in long
+	 * mode; mp_startup_common() does that.
 	 */
 	rm->rm_cr4 = getcr4();
-	rm->rm_cr4 &= ~(CR4_MCE | CR4_PCE);
+	rm->rm_cr4 &= ~(CR4_MCE | CR4_PCE | CR4_PCIDE);
 
 	rmp_gdt_init(rm);
 
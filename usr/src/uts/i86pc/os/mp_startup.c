@@ -1673,6 +1673,8 @@ mp_startup_common(boolean_t boot)
 	 */
 	if (is_x86_feature(x86_featureset, X86FSET_PAT))
 		pat_sync();
+
+	hat_pcid_cpu_init();
 #endif
 
 	/*
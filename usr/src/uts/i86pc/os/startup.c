@@ -2628,6 +2628,11 @@ kvm_init(void)
 	    ekernelheap - kernelheap, &kvseg);
 	(void) segkmem_create(&kvseg);
 
+#if defined(__amd64)
+	/* at this point we are ready to use large page heap */
+	segkmem_heap_lp_init();
+#endif
+
 	if (core_size > 0) {
 		PRM_POINT("attaching kvseg_core");
 		(void) seg_attach(&kas, (caddr_t)core_base, core_size,
@@ -109,6 +109,9 @@ static x86pte_t *vlp_page;
  */
 static x86pte_t hati_update_pte(htable_t *ht, uint_t entry, x86pte_t expected,
 	x86pte_t new);
+#if !defined(__xpv)
+static void hati_wprot_split(htable_t *ht);
+#endif
 
 /*
  * The kernel address space exists in all HATs. To implement this the
@@ -155,6 +158,36 @@ int	chk_optimal_1gtlb = 1;
 uint_t	map1gcnt;
 #endif
 
+/*
+ * hat_clrattr(PROT_WRITE) over a range covering whole level 0 page tables,
+ * which is what fork does to every private segment, write protects each
+ * table with at least hat_wprot_min valid entries through the entry linking
+ * it to its parent instead of one entry at a time, followed by a single TLB
+ * flush. The protection is pushed down into the table's own entries the
+ * first time anything in it is made writable again. Zero disables this.
+ */
+uint_t	hat_wprot_min = 32;
+
+/*
+ * A TLB shootdown of more than hat_tlb_inval_max pages, however many ranges
+ * they are in, flushes the whole TLB instead of one page at a time.
+ */
+ulong_t	hat_tlb_inval_max = 64;
+
+#if defined(__amd64) && !defined(__xpv)
+/*
+ * Process context identifiers tag TLB entries with the address space they
+ * belong to, so that hat_switch() need not flush them. Each CPU lends its
+ * HAT_PCID_SLOTS PCIDs out to user hats in turn; the kernel hat uses PCID 0.
+ * Every hat_tlb_inval() of a user hat advances its hat_tlbgen. Only the
+ * CPUs running the hat are cross called, as before; any other CPU holding
+ * the hat's PCID flushes it when it next switches to the hat if hat_tlbgen
+ * has moved on since. hat_pcid_enable can be cleared to not use PCIDs.
+ */
+int		hat_pcid_enable = 1;
+static uint64_t	hat_pcid_lastid;
+#endif
+
 
 /*
  * A cpuset for all cpus. This is used for kernel address cross calls, since
@@ -264,6 +297,10 @@ hat_alloc(struct as *as)
 	hat->hat_as = as;
 	mutex_init(&hat->hat_mutex, NULL, MUTEX_DEFAULT, NULL);
 	ASSERT(hat->hat_flags == 0);
+#if defined(__amd64) && !defined(__xpv)
+	hat->hat_pcid_id = atomic_inc_64_nv(&hat_pcid_lastid);
+	hat->hat_tlbgen = 0;
+#endif
 
 #if defined(__xpv)
 	/*
@@ -534,6 +571,17 @@ mmu_init(void)
 	    (getcr4() & CR4_PGE) != 0)
 		mmu.pt_global = PT_GLOBAL;
 
+#if defined(__amd64) && !defined(__xpv)
+	/*
+	 * PCIDs rely on the kernel's mappings being global.
+	 */
+	if (hat_pcid_enable && mmu.pt_global != 0 &&
+	    is_x86_feature(x86_featureset, X86FSET_PCID)) {
+		mmu.pcid = 1;
+		hat_pcid_cpu_init();
+	}
+#endif
+
 	/*
 	 * Detect NX and PAE usage.
 	 */
@@ -974,6 +1022,68 @@ reload_pae32(hat_t *hat, cpu_t *cpu)
 }
 #endif
 
+/*
+ * Turn on PCIDs for the current CPU if the boot CPU uses them. This must
+ * be done in long mode, while %cr3 holds PCID 0.
+ */
+void
+hat_pcid_cpu_init(void)
+{
+#if defined(__amd64) && !defined(__xpv)
+	if (mmu.pcid)
+		setcr4(getcr4() | CR4_PCIDE);
+#endif
+}
+
+#if defined(__amd64) && !defined(__xpv)
+/*
+ * Load newcr3, the page tables for hat, with the right PCID. A user hat
+ * gets back the PCID this CPU last lent it if it still has it, and keeps
+ * its TLB entries unless the hat saw an invalidation since; otherwise it
+ * gets the next PCID in turn, flushed.
+ */
+static void
+hati_pcid_switch(cpu_t *cpu, hat_t *hat, uint64_t newcr3)
+{
+	struct hat_cpu_info	*hci = cpu->cpu_hat_info;
+	hat_pcid_slot_t		*ps;
+	uint64_t		gen;
+	uint_t			s;
+
+	hci->hci_pcid_cur = 0;
+	if (hat == kas.a_hat) {
+		setcr3(newcr3);
+		return;
+	}
+
+	/*
+	 * hat_switch() has already put this CPU in hat_cpus, so any
+	 * hat_tlb_inval() that advances hat_tlbgen past gen cross calls us.
+	 */
+	gen = hat->hat_tlbgen;
+	for (s = 0; s < HAT_PCID_SLOTS; ++s) {
+		if (hci->hci_pcid[s].hps_id == hat->hat_pcid_id)
+			break;
+	}
+	if (s == HAT_PCID_SLOTS) {
+		s = hci->hci_pcid_next;
+		hci->hci_pcid_next = (s + 1) % HAT_PCID_SLOTS;
+		hci->hci_pcid[s].hps_id = hat->hat_pcid_id;
+	} else if (hci->hci_pcid[s].hps_gen == gen) {
+		newcr3 |= CR3_NOFLUSH;
+	}
+	ps = &hci->hci_pcid[s];
+	ps->hps_gen = gen;
+
+	if (newcr3 & CR3_NOFLUSH)
+		HATSTAT_INC(hs_pcid_hits);
+	else
+		HATSTAT_INC(hs_pcid_flushes);
+	setcr3(newcr3 | (s + 1));
+	hci->hci_pcid_cur = s + 1;
+}
+#endif
+
 /*
  * Switch to a new active hat, maintaining bit masks to track active CPUs.
  *
@@ -1049,7 +1159,12 @@ hat_switch(hat_t *hat)
 
 	}
 #else
-	setcr3(newcr3);
+#if defined(__amd64)
+	if (mmu.pcid)
+		hati_pcid_switch(cpu, hat, newcr3);
+	else
+#endif
+		setcr3(newcr3);
 #endif
 	ASSERT(cpu == CPU);
 }
@@ -1478,6 +1593,11 @@ hati_load_common(
 	if (hat == kas.a_hat && va >= kernelbase)
 		PTE_SET(pte, mmu.pt_global);
 
+#if !defined(__xpv)
+	if ((ht->ht_flags & HTABLE_WPROT) && (attr & PROT_WRITE))
+		hati_wprot_split(ht);
+#endif
+
 	/*
 	 * establish the mapping
 	 */
@@ -1917,17 +2037,43 @@ hat_unlock_region(struct hat *hat, caddr_t addr, size_t len,
 	panic("No shared region support on x86");
 }
 
+/*
+ * A range of mappings, all at the same level, being unloaded.
+ */
+typedef struct range_info {
+	uintptr_t	rng_va;
+	ulong_t		rng_cnt;
+	level_t		rng_level;
+} range_info_t;
+
+/*
+ * A TLB shootdown: the hd_cnt ranges at hd_ranges, or everything in the
+ * hat if hd_cnt is 0. With PCIDs, hd_gen is the hat_tlbgen value of the
+ * invalidation.
+ */
+typedef struct hat_demap {
+	range_info_t	*hd_ranges;
+	uint_t		hd_cnt;
+	uint64_t	hd_gen;
+} hat_demap_t;
+
 #if !defined(__xpv)
+static void flush_all_tlb_entries(void);
+
 /*
- * Cross call service routine to demap a virtual page on
- * the current CPU or flush all mappings in TLB.
+ * Cross call service routine to demap a list of virtual address ranges on
+ * the current CPU or flush all mappings in TLB. a2 is the hat_demap_t.
  */
 /*ARGSUSED*/
 static int
 hati_demap_func(xc_arg_t a1, xc_arg_t a2, xc_arg_t a3)
 {
-	hat_t	*hat = (hat_t *)a1;
-	caddr_t	addr = (caddr_t)a2;
+	hat_t		*hat = (hat_t *)a1;
+	hat_demap_t	*hd = (hat_demap_t *)a2;
+	range_info_t	*r;
+	uintptr_t	va;
+	ulong_t		i;
+	uint_t		n;
 
 	/*
 	 * If the target hat isn't the kernel and this CPU isn't operating
@@ -1936,11 +2082,57 @@ hati_demap_func(xc_arg_t a1, xc_arg_t a2, xc_arg_t a3)
 	if (hat != kas.a_hat && hat != CPU->cpu_current_hat)
 		return (0);
 
+#if defined(__amd64)
+	if (mmu.pcid && hat == kas.a_hat) {
+		/*
+		 * Other PCIDs may hold non-global kernel translations, or
+		 * paging structure caches, that INVLPG and a %cr3 reload
+		 * won't reach.
+		 */
+		for (n = 0; n < hd->hd_cnt; n++) {
+			if (hd->hd_ranges[n].rng_va < kernelbase)
+				break;
+		}
+		if (hd->hd_cnt == 0 || n < hd->hd_cnt) {
+			flush_all_tlb_entries();
+			return (0);
+		}
+	} else if (mmu.pcid) {
+		struct hat_cpu_info	*hci = CPU->cpu_hat_info;
+		uint_t			s = hci->hci_pcid_cur;
+
+		/*
+		 * If this was the only invalidation of the hat that the PCID
+		 * had yet to see, it's up to date once we're done.
+		 */
+		if (s != 0 &&
+		    hci->hci_pcid[s - 1].hps_id == hat->hat_pcid_id &&
+		    hci->hci_pcid[s - 1].hps_gen + 1 == hd->hd_gen)
+			hci->hci_pcid[s - 1].hps_gen = hd->hd_gen;
+	}
+#endif
+
+	/*
+	 * For normal addresses, we just flush the page mappings, one for
+	 * each large page.
+	 */
+	if (hd->hd_cnt != 0) {
+		for (n = 0; n < hd->hd_cnt; n++) {
+			r = &hd->hd_ranges[n];
+			va = r->rng_va;
+			for (i = 0; i < r->rng_cnt; i++) {
+				mmu_tlbflush_entry((caddr_t)va);
+				va += LEVEL_SIZE(r->rng_level);
+			}
+		}
+		return (0);
+	}
+
 	/*
-	 * For a normal address, we just flush one page mapping
+	 * Kernel mappings are global, so reloading cr3 won't reach them.
 	 */
-	if ((uintptr_t)addr != DEMAP_ALL_ADDR) {
-		mmu_tlbflush_entry(addr);
+	if (hat == kas.a_hat) {
+		flush_all_tlb_entries();
 		return (0);
 	}
 
@@ -2030,16 +2222,55 @@ tlb_service(void)
 }
 #endif /* !__xpv */
 
+#ifdef __xpv
 /*
- * Internal routine to do cross calls to invalidate a range of pages on
- * all CPUs using a given hat.
+ * Do the hypervisor's equivalent of hati_demap_func() on this CPU, or on
+ * the CPUs in cpus if that's given.
  */
-void
-hat_tlb_inval(hat_t *hat, uintptr_t va)
+static void
+hat_xpv_demap(hat_demap_t *hd, cpuset_t *cpus)
+{
+	range_info_t	*r;
+	uintptr_t	va;
+	ulong_t		i;
+	uint_t		n;
+
+	if (hd->hd_cnt == 0) {
+		if (cpus == NULL)
+			xen_flush_tlb();
+		else
+			xen_gflush_tlb(*cpus);
+		return;
+	}
+
+	for (n = 0; n < hd->hd_cnt; n++) {
+		r = &hd->hd_ranges[n];
+		va = r->rng_va;
+		for (i = 0; i < r->rng_cnt; i++) {
+			if (cpus == NULL)
+				xen_flush_va((caddr_t)va);
+			else
+				xen_gflush_va((caddr_t)va, *cpus);
+			va += LEVEL_SIZE(r->rng_level);
+		}
+	}
+}
+#endif
+
+/*
+ * Internal routine to do cross calls to invalidate a list of ranges of
+ * pages on all CPUs using a given hat. However many ranges there are,
+ * each CPU is only interrupted once. A cnt of 0 invalidates everything.
+ */
+static void
+hat_tlb_inval_ranges(hat_t *hat, range_info_t *r, uint_t cnt)
 {
 	extern int	flushes_require_xcalls;	/* from mp_startup.c */
 	cpuset_t	justme;
 	cpuset_t	cpus_to_shootdown;
+	hat_demap_t	hd;
+	ulong_t		pages = 0;
+	uint_t		n;
 #ifndef __xpv
 	cpuset_t	check_cpus;
 	cpu_t		*cpup;
@@ -2060,20 +2291,42 @@ hat_tlb_inval(hat_t *hat, uintptr_t va)
 	 */
 	if (hat->hat_flags & HAT_SHARED) {
 		hat = kas.a_hat;
-		va = DEMAP_ALL_ADDR;
+		cnt = 0;
+	}
+
+	/*
+	 * Past a point, flushing everything is cheaper than going page by
+	 * page.
+	 */
+	for (n = 0; n < cnt; n++) {
+		if (r[n].rng_va == DEMAP_ALL_ADDR)
+			break;
+		pages += r[n].rng_cnt;
 	}
+	if (n < cnt || pages > hat_tlb_inval_max)
+		cnt = 0;
+
+	hd.hd_ranges = r;
+	hd.hd_cnt = cnt;
+	hd.hd_gen = 0;
+
+#if defined(__amd64) && !defined(__xpv)
+	/*
+	 * CPUs that ran the hat before but aren't running it now learn of
+	 * this from hat_tlbgen when they switch back to it.
+	 */
+	if (mmu.pcid && hat != kas.a_hat)
+		hd.hd_gen = atomic_inc_64_nv(&hat->hat_tlbgen);
+#endif
 
 	/*
 	 * if not running with multiple CPUs, don't use cross calls
 	 */
 	if (panicstr || !flushes_require_xcalls) {
 #ifdef __xpv
-		if (va == DEMAP_ALL_ADDR)
-			xen_flush_tlb();
-		else
-			xen_flush_va((caddr_t)va);
+		hat_xpv_demap(&hd, NULL);
 #else
-		(void) hati_demap_func((xc_arg_t)hat, (xc_arg_t)va, NULL);
+		(void) hati_demap_func((xc_arg_t)hat, (xc_arg_t)&hd, 0);
 #endif
 		return;
 	}
@@ -2124,24 +2377,18 @@ hat_tlb_inval(hat_t *hat, uintptr_t va)
 	    CPUSET_ISEQUAL(cpus_to_shootdown, justme)) {
 
 #ifdef __xpv
-		if (va == DEMAP_ALL_ADDR)
-			xen_flush_tlb();
-		else
-			xen_flush_va((caddr_t)va);
+		hat_xpv_demap(&hd, NULL);
 #else
-		(void) hati_demap_func((xc_arg_t)hat, (xc_arg_t)va, NULL);
+		(void) hati_demap_func((xc_arg_t)hat, (xc_arg_t)&hd, 0);
 #endif
 
 	} else {
 
 		CPUSET_ADD(cpus_to_shootdown, CPU->cpu_id);
 #ifdef __xpv
-		if (va == DEMAP_ALL_ADDR)
-			xen_gflush_tlb(cpus_to_shootdown);
-		else
-			xen_gflush_va((caddr_t)va, cpus_to_shootdown);
+		hat_xpv_demap(&hd, &cpus_to_shootdown);
 #else
-		xc_call((xc_arg_t)hat, (xc_arg_t)va, NULL,
+		xc_call((xc_arg_t)hat, (xc_arg_t)&hd, 0,
 		    CPUSET2BV(cpus_to_shootdown), hati_demap_func);
 #endif
 
@@ -2149,10 +2396,26 @@ hat_tlb_inval(hat_t *hat, uintptr_t va)
 	kpreempt_enable();
 }
 
+/*
+ * Invalidate a single page, or with DEMAP_ALL_ADDR everything, on all CPUs
+ * using a given hat.
+ */
+void
+hat_tlb_inval(hat_t *hat, uintptr_t va)
+{
+	range_info_t	r;
+
+	r.rng_va = va;
+	r.rng_cnt = 1;
+	r.rng_level = 0;
+	hat_tlb_inval_ranges(hat, &r, 1);
+}
+
 /*
  * Interior routine for HAT_UNLOADs from hat_unload_callback(),
  * hat_kmap_unload() OR from hat_steal() code.  This routine doesn't
- * handle releasing of the htables.
+ * handle releasing of the htables. If tlbp is given, the caller does the
+ * TLB invalidation, as x86pte_inval() describes.
  */
 void
 hat_pte_unmap(
@@ -2160,7 +2423,8 @@ hat_pte_unmap(
 	uint_t		entry,
 	uint_t		flags,
 	x86pte_t	old_pte,
-	void		*pte_ptr)
+	void		*pte_ptr,
+	boolean_t	*tlbp)
 {
 	hat_t		*hat = ht->ht_hat;
 	hment_t		*hm = NULL;
@@ -2202,7 +2466,7 @@ hat_pte_unmap(
 			x86_hm_enter(pp);
 		}
 
-		old_pte = x86pte_inval(ht, entry, old_pte, pte_ptr);
+		old_pte = x86pte_inval(ht, entry, old_pte, pte_ptr, tlbp);
 
 		/*
 		 * If the page hadn't changed we've unmapped it and can proceed
@@ -2264,6 +2528,8 @@ hat_kmap_unload(caddr_t addr, size_t len, uint_t flags)
 	uint_t		entry;
 	x86pte_t	*pte_ptr;
 	x86pte_t	old_pte;
+	boolean_t	tlb = B_FALSE;
+	range_info_t	r;
 
 	for (; va < eva; va += MMU_PAGESIZE) {
 		/*
@@ -2283,7 +2549,17 @@ hat_kmap_unload(caddr_t addr, size_t len, uint_t flags)
 		/*
 		 * use mostly common code to unmap it.
 		 */
-		hat_pte_unmap(ht, entry, flags, old_pte, pte_ptr);
+		hat_pte_unmap(ht, entry, flags, old_pte, pte_ptr, &tlb);
+	}
+
+	/*
+	 * Shoot down the whole range at once.
+	 */
+	if (tlb) {
+		r.rng_va = (uintptr_t)addr;
+		r.rng_cnt = mmu_btop(len);
+		r.rng_level = 0;
+		hat_tlb_inval_ranges(kas.a_hat, &r, 1);
 	}
 }
 
@@ -2312,17 +2588,17 @@ hat_unload(hat_t *hat, caddr_t addr, size_t len, uint_t flags)
 }
 
 /*
- * Do the callbacks for ranges being unloaded.
+ * Do the TLB shootdown, if one is needed, and the callbacks for ranges
+ * being unloaded. The TLBs have to be clean before the upper level VM
+ * system may free the pages.
  */
-typedef struct range_info {
-	uintptr_t	rng_va;
-	ulong_t		rng_cnt;
-	level_t		rng_level;
-} range_info_t;
-
 static void
-handle_ranges(hat_callback_t *cb, uint_t cnt, range_info_t *range)
+handle_ranges(hat_t *hat, hat_callback_t *cb, uint_t cnt, range_info_t *range,
+    boolean_t tlb)
 {
+	if (tlb)
+		hat_tlb_inval_ranges(hat, range, cnt);
+
 	/*
 	 * do callbacks to upper level VM system
 	 */
@@ -2362,6 +2638,7 @@ hat_unload_callback(
 	uintptr_t	contig_va = (uintptr_t)-1L;
 	range_info_t	r[MAX_UNLOAD_CNT];
 	uint_t		r_cnt = 0;
+	boolean_t	tlb = B_FALSE;
 	x86pte_t	old_pte;
 
 	XPV_DISALLOW_MIGRATE();
@@ -2377,7 +2654,8 @@ hat_unload_callback(
 		ht = htable_getpte(hat, vaddr, &entry, &old_pte, 0);
 		if (ht != NULL) {
 			if (PTE_ISVALID(old_pte))
-				hat_pte_unmap(ht, entry, flags, old_pte, NULL);
+				hat_pte_unmap(ht, entry, flags, old_pte, NULL,
+				    NULL);
 			htable_release(ht);
 		}
 		XPV_ALLOW_MIGRATE();
@@ -2400,8 +2678,9 @@ hat_unload_callback(
 		if (vaddr != contig_va ||
 		    (r_cnt > 0 && r[r_cnt - 1].rng_level != ht->ht_level)) {
 			if (r_cnt == MAX_UNLOAD_CNT) {
-				handle_ranges(cb, r_cnt, r);
+				handle_ranges(hat, cb, r_cnt, r, tlb);
 				r_cnt = 0;
+				tlb = B_FALSE;
 			}
 			r[r_cnt].rng_va = vaddr;
 			r[r_cnt].rng_cnt = 0;
@@ -2410,10 +2689,11 @@ hat_unload_callback(
 		}
 
 		/*
-		 * Unload one mapping from the page tables.
+		 * Unload one mapping from the page tables, leaving the TLB
+		 * shootdown to handle_ranges().
 		 */
 		entry = htable_va2entry(vaddr, ht);
-		hat_pte_unmap(ht, entry, flags, old_pte, NULL);
+		hat_pte_unmap(ht, entry, flags, old_pte, NULL, &tlb);
 		ASSERT(ht->ht_level <= mmu.max_page_level);
 		vaddr += LEVEL_SIZE(ht->ht_level);
 		contig_va = vaddr;
@@ -2423,10 +2703,10 @@ hat_unload_callback(
 		htable_release(ht);
 
 	/*
-	 * handle last range for callbacks
+	 * handle last range for TLB shootdown and callbacks
 	 */
 	if (r_cnt > 0)
-		handle_ranges(cb, r_cnt, r);
+		handle_ranges(hat, cb, r_cnt, r, tlb);
 	XPV_ALLOW_MIGRATE();
 }
 
@@ -2578,7 +2858,7 @@ hat_getattr(hat_t *hat, caddr_t addr, uint_t *attr)
 	}
 
 	*attr = PROT_READ;
-	if (PTE_GET(pte, PT_WRITABLE))
+	if (PTE_GET(pte, PT_WRITABLE) && !(ht->ht_flags & HTABLE_WPROT))
 		*attr |= PROT_WRITE;
 	if (PTE_GET(pte, PT_USER))
 		*attr |= PROT_USER;
@@ -2597,6 +2877,58 @@ hat_getattr(hat_t *hat, caddr_t addr, uint_t *attr)
 #define	HAT_SET_ATTR		2
 #define	HAT_CLR_ATTR		3
 
+#if !defined(__xpv)
+/*
+ * Can hat_updateattr() write protect all of ht, which must lie within
+ * [addr, eaddr), through its parent entry?
+ */
+static int
+hati_can_wprot(htable_t *ht, uintptr_t addr, uintptr_t eaddr)
+{
+	if (ht->ht_hat == kas.a_hat || ht->ht_level != 0 ||
+	    hat_wprot_min == 0 || ht->ht_valid_cnt < hat_wprot_min ||
+	    ht->ht_lock_cnt != 0)
+		return (0);
+	if ((ht->ht_flags & HTABLE_SHARED_PFN) ||
+	    (ht->ht_parent->ht_flags & HTABLE_VLP))
+		return (0);
+	return (ht->ht_vaddr >= addr && ht->ht_vaddr + LEVEL_SIZE(1) <= eaddr);
+}
+
+/*
+ * Something in ht, which hat_updateattr() write protected as a whole, is
+ * about to become writable. Clear PT_WRITABLE in each of its entries and
+ * then make the parent entry writable again. No TLB flush is needed, as the
+ * parent entry has kept any of the entries from being cached as writable.
+ */
+static void
+hati_wprot_split(htable_t *ht)
+{
+	hat_t		*hat = ht->ht_hat;
+	x86pte_t	oldpte, found;
+	uint_t		entry;
+
+	mutex_enter(&hat->hat_mutex);
+	if (!(ht->ht_flags & HTABLE_WPROT)) {
+		mutex_exit(&hat->hat_mutex);
+		return;
+	}
+	for (entry = 0; entry < HTABLE_NUM_PTES(ht); ++entry) {
+		oldpte = x86pte_get(ht, entry);
+		while (PTE_ISVALID(oldpte) && PTE_GET(oldpte, PT_WRITABLE) &&
+		    PTE_GET(oldpte, PT_SOFTWARE) < PT_NOCONSIST) {
+			found = x86pte_cas(ht, entry, oldpte,
+			    oldpte & ~PT_WRITABLE);
+			if (found == oldpte)
+				break;
+			oldpte = found;
+		}
+	}
+	htable_wprot_clear(ht);
+	mutex_exit(&hat->hat_mutex);
+}
+#endif	/* !__xpv */
+
 static void
 hat_updateattr(hat_t *hat, caddr_t addr, size_t len, uint_t attr, int what)
 {
@@ -2606,6 +2938,7 @@ hat_updateattr(hat_t *hat, caddr_t addr, size_t len, uint_t attr, int what)
 	uint_t		entry;
 	x86pte_t	oldpte, newpte;
 	page_t		*pp;
+	int		wprot = 0;
 
 	XPV_DISALLOW_MIGRATE();
 	ASSERT(IS_PAGEALIGNED(vaddr));
@@ -2617,6 +2950,22 @@ try_again:
 		oldpte = htable_walk(hat, &ht, &vaddr, eaddr);
 		if (ht == NULL)
 			break;
+#if !defined(__xpv)
+		if (what == HAT_CLR_ATTR && attr == PROT_WRITE &&
+		    hati_can_wprot(ht, (uintptr_t)addr, eaddr)) {
+			if (!(ht->ht_flags & HTABLE_WPROT)) {
+				mutex_enter(&hat->hat_mutex);
+				htable_wprot(ht);
+				mutex_exit(&hat->hat_mutex);
+				wprot = 1;
+			}
+			vaddr = ht->ht_vaddr + LEVEL_SIZE(1) - MMU_PAGESIZE;
+			continue;
+		}
+		if (what != HAT_CLR_ATTR && (attr & PROT_WRITE) &&
+		    (ht->ht_flags & HTABLE_WPROT))
+			hati_wprot_split(ht);
+#endif
 		if (PTE_GET(oldpte, PT_SOFTWARE) >= PT_NOCONSIST)
 			continue;
 
@@ -2695,6 +3044,8 @@ try_again:
 	}
 	if (ht)
 		htable_release(ht);
+	if (wprot)
+		hat_tlb_inval(hat, DEMAP_ALL_ADDR);
 	XPV_ALLOW_MIGRATE();
 }
 
@@ -3314,7 +3665,7 @@ hati_page_unmap(page_t *pp, htable_t *ht, uint_t entry)
 	/*
 	 * Invalidate the PTE and remove the hment.
 	 */
-	old_pte = x86pte_inval(ht, entry, 0, NULL);
+	old_pte = x86pte_inval(ht, entry, 0, NULL, NULL);
 	if (PTE2PFN(old_pte, ht->ht_level) != pfn) {
 		panic("x86pte_inval() failure found PTE = " FMT_PTE
 		    " pfn being unmapped is %lx ht=0x%lx entry=0x%x",
@@ -4048,7 +4399,7 @@ clear_boot_mappings(uintptr_t low, uintptr_t high)
 		/*
 		 * Unload the mapping from the page tables.
 		 */
-		(void) x86pte_inval(ht, entry, 0, NULL);
+		(void) x86pte_inval(ht, entry, 0, NULL, NULL);
 		ASSERT(ht->ht_valid_cnt > 0);
 		HTABLE_DEC(ht->ht_valid_cnt);
 		PGCNT_DEC(ht->ht_hat, ht->ht_level);
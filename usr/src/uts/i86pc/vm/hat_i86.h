@@ -94,6 +94,10 @@ struct hat {
 #if defined(__amd64) && defined(__xpv)
 	pfn_t		hat_user_ptable; /* alt top ptable for user mode */
 #endif
+#if defined(__amd64) && !defined(__xpv)
+	uint64_t	hat_pcid_id;	/* never reused, names hat to CPUs */
+	volatile uint64_t hat_tlbgen;	/* count of TLB invalidations */
+#endif
 };
 typedef struct hat hat_t;
 
@@ -152,6 +156,8 @@ struct hatstats {
 	ulong_t	hs_hm_steals;
 	ulong_t	hs_hm_steal_exam;
 	ulong_t hs_tlb_inval_delayed;
+	ulong_t	hs_pcid_hits;		/* hat_switch()es without a flush */
+	ulong_t	hs_pcid_flushes;	/* ... that had to flush the PCID */
 };
 extern struct hatstats hatstat;
 #ifdef DEBUG
@@ -205,6 +211,7 @@ extern uint_t use_boot_reserve;
  */
 extern void hat_cpu_online(struct cpu *);
 extern void hat_cpu_offline(struct cpu *);
+extern void hat_pcid_cpu_init(void);
 extern void setup_vaddr_for_ppcopy(struct cpu *);
 extern void teardown_vaddr_for_ppcopy(struct cpu *);
 extern void clear_boot_mappings(uintptr_t, uintptr_t);
@@ -227,7 +234,7 @@ extern void hat_kern_alloc(caddr_t segmap_base, size_t segmap_size,
 extern void hat_kern_setup(void);
 extern void hat_tlb_inval(struct hat *hat, uintptr_t va);
 extern void hat_pte_unmap(htable_t *ht, uint_t entry, uint_t flags,
-	x86pte_t old_pte, void *pte_ptr);
+	x86pte_t old_pte, void *pte_ptr, boolean_t *tlbp);
 extern void hat_init_finish(void);
 extern caddr_t hat_kpm_pfn2va(pfn_t pfn);
 extern pfn_t hat_kpm_va2pfn(caddr_t);
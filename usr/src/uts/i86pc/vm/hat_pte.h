@@ -160,6 +160,12 @@ typedef	int8_t level_t;
  */
 #define	MAKECR3(pfn)	mmu_ptob(pfn)
 
+/*
+ * With CR4_PCIDE set, the low 12 bits of %cr3 hold the PCID and setting
+ * CR3_NOFLUSH keeps the TLB entries tagged with it.
+ */
+#define	CR3_NOFLUSH	(1ULL << 63)
+
 /*
  * HAT/MMU parameters that depend on kernel mode and/or processor type
  */
@@ -181,6 +187,7 @@ struct hat_mmu_info {
 	uint_t	vlp_hash_cnt;	/* cnt of entries in vlp htable_hash_cache */
 
 	uint_t pae_hat;		/* either 0 or 1 */
+	uint_t pcid;		/* either 0 or 1, CR4_PCIDE is set */
 
 	uintptr_t hole_start;	/* start of VA hole (or -1 if none) */
 	uintptr_t hole_end;	/* end of VA hole (or 0 if none) */
@@ -610,7 +610,8 @@ htable_steal(uint_t cnt)
 						if (!PTE_ISVALID(pte))
 							continue;
 						hat_pte_unmap(ht, e,
-						    HAT_UNLOAD, pte, NULL);
+						    HAT_UNLOAD, pte, NULL,
+						    NULL);
 					}
 
 					/*
@@ -1043,6 +1044,8 @@ unlink_ptp(htable_t *higher, htable_t *old, uintptr_t vaddr)
 	ASSERT(higher->ht_busy > 0);
 	ASSERT(higher->ht_valid_cnt > 0);
 	ASSERT(old->ht_valid_cnt == 0);
+	if (old->ht_flags & HTABLE_WPROT)
+		expect &= ~PT_WRITABLE;
 	found = x86pte_cas(higher, entry, expect, 0);
 #ifdef __xpv
 	/*
@@ -1062,10 +1065,13 @@ unlink_ptp(htable_t *higher, htable_t *old, uintptr_t vaddr)
 	 *
 	 * If we don't need do do that, then we still have to INVLPG against
 	 * an address covered by the inner page table, as the latest processors
-	 * have TLB-like caches for non-leaf page table entries.
+	 * have TLB-like caches for non-leaf page table entries. With PCIDs,
+	 * that only reaches the caches for the current PCID, which for the
+	 * kernel isn't enough.
 	 */
 	if (!(hat->hat_flags & HAT_FREEING)) {
-		hat_tlb_inval(hat, (higher->ht_flags & HTABLE_VLP) ?
+		hat_tlb_inval(hat, ((higher->ht_flags & HTABLE_VLP) ||
+		    (mmu.pcid && hat == kas.a_hat)) ?
 		    DEMAP_ALL_ADDR : old->ht_vaddr);
 	}
 
@@ -1106,6 +1112,53 @@ link_ptp(htable_t *higher, htable_t *new, uintptr_t vaddr)
 		hat_tlb_inval(higher->ht_hat, DEMAP_ALL_ADDR);
 }
 
+/*
+ * Clear PT_WRITABLE in the entry linking the level 0 table ht to its parent,
+ * which write protects all of ht at once. The caller must flush the TLB.
+ */
+void
+htable_wprot(htable_t *ht)
+{
+	htable_t	*higher = ht->ht_parent;
+	uint_t		entry = htable_va2entry(ht->ht_vaddr, higher);
+	x86pte_t	expect = MAKEPTP(ht->ht_pfn, ht->ht_level);
+	x86pte_t	found;
+
+	ASSERT(MUTEX_HELD(&ht->ht_hat->hat_mutex));
+	ASSERT(ht->ht_level == 0);
+	ASSERT(!(ht->ht_flags & (HTABLE_SHARED_PFN | HTABLE_WPROT)));
+	ASSERT(!(higher->ht_flags & HTABLE_VLP));
+
+	found = x86pte_cas(higher, entry, expect, expect & ~PT_WRITABLE);
+	if (found != expect)
+		panic("Bad PTP found=" FMT_PTE ", expected=" FMT_PTE,
+		    found, expect);
+	ht->ht_flags |= HTABLE_WPROT;
+}
+
+/*
+ * Undo htable_wprot(). Since this only adds permission, a stale copy of the
+ * parent entry in some TLB can at worst cost a spurious fault, so no
+ * invalidation is done.
+ */
+void
+htable_wprot_clear(htable_t *ht)
+{
+	htable_t	*higher = ht->ht_parent;
+	uint_t		entry = htable_va2entry(ht->ht_vaddr, higher);
+	x86pte_t	newptp = MAKEPTP(ht->ht_pfn, ht->ht_level);
+	x86pte_t	found;
+
+	ASSERT(MUTEX_HELD(&ht->ht_hat->hat_mutex));
+	ASSERT(ht->ht_flags & HTABLE_WPROT);
+
+	found = x86pte_cas(higher, entry, newptp & ~PT_WRITABLE, newptp);
+	if (found != (newptp & ~PT_WRITABLE))
+		panic("Bad PTP found=" FMT_PTE ", expected=" FMT_PTE,
+		    found, newptp & ~PT_WRITABLE);
+	ht->ht_flags &= ~HTABLE_WPROT;
+}
+
 /*
  * Release of hold on an htable. If this is the last use and the pagetable
  * is empty we may want to free it, then recursively look at the pagetable
@@ -2174,13 +2227,16 @@ x86pte_cas(htable_t *ht, uint_t entry, x86pte_t old, x86pte_t new)
  * matches the value determined by expect.
  *
  * Also invalidates any TLB entries and returns the previous value of the PTE.
+ * If tlbp is given the TLB invalidation is left to the caller, who is told
+ * through *tlbp that it needs one.
  */
 x86pte_t
 x86pte_inval(
 	htable_t *ht,
 	uint_t entry,
 	x86pte_t expect,
-	x86pte_t *pte_ptr)
+	x86pte_t *pte_ptr,
+	boolean_t *tlbp)
 {
 	x86pte_t	*ptep;
 	x86pte_t	oldpte;
@@ -2229,8 +2285,12 @@ x86pte_inval(
 		found = CAS_PTE(ptep, oldpte, 0);
 		XPV_DISALLOW_PAGETABLE_UPDATES();
 	} while (found != oldpte);
-	if (oldpte & (PT_REF | PT_MOD))
-		hat_tlb_inval(ht->ht_hat, htable_e2va(ht, entry));
+	if (oldpte & (PT_REF | PT_MOD)) {
+		if (tlbp != NULL)
+			*tlbp = B_TRUE;
+		else
+			hat_tlb_inval(ht->ht_hat, htable_e2va(ht, entry));
+	}
 
 done:
 	if (pte_ptr == NULL)
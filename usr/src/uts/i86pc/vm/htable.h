@@ -88,9 +88,16 @@ typedef struct htable htable_t;
  *
  * HTABLE_SHARED_PFN - this htable had its PFN assigned from sharing another
  * 	htable. Used by hat_share() for ISM.
+ *
+ * HTABLE_WPROT - the entry linking this level 0 htable to its parent has
+ *	PT_WRITABLE clear, so nothing it maps is writable whatever its own
+ *	entries say. Set by hat_clrattr() when it write protects the whole
+ *	table (typically at fork), cleared under the hat_mutex by pushing the
+ *	protection down into the entries before any of them is made writable.
  */
 #define	HTABLE_VLP		(0x01)
 #define	HTABLE_SHARED_PFN	(0x02)
+#define	HTABLE_WPROT		(0x04)
 
 /*
  * The htable hash table hashing function.  The 28 is so that high
@@ -104,6 +111,18 @@ typedef struct htable htable_t;
 	((((va) >> LEVEL_SHIFT(1)) + ((va) >> 28) + (lvl) +		\
 	((uintptr_t)(hat) >> 4)) & ((hat)->hat_num_hash - 1))
 
+/*
+ * A CPU's PCIDs 1 to HAT_PCID_SLOTS are each lent to one user hat at a time;
+ * hps_gen is the hat's hat_tlbgen as of the last time the CPU's TLB entries
+ * for the PCID were known to be current.
+ */
+#define	HAT_PCID_SLOTS	8
+
+typedef struct hat_pcid_slot {
+	uint64_t	hps_id;		/* hat_pcid_id of the hat using it */
+	uint64_t	hps_gen;
+} hat_pcid_slot_t;
+
 /*
  * Each CPU gets a unique hat_cpu_info structure in cpu_hat_info.
  */
@@ -113,6 +132,9 @@ struct hat_cpu_info {
 	pfn_t	hci_vlp_pfn;		/* pfn of hci_vlp_l3ptes */
 	x86pte_t *hci_vlp_l3ptes;	/* VLP Level==3 pagetable (top) */
 	x86pte_t *hci_vlp_l2ptes;	/* VLP Level==2 pagetable */
+	uint_t	hci_pcid_cur;		/* PCID in %cr3, 0 if none / changing */
+	uint_t	hci_pcid_next;		/* next slot to lend out */
+	hat_pcid_slot_t hci_pcid[HAT_PCID_SLOTS];
 #endif	/* __amd64 */
 };
 
@@ -255,6 +277,12 @@ extern x86pte_t htable_walk(struct hat *hat, htable_t **ht, uintptr_t *va,
 extern uint_t htable_va2entry(uintptr_t va, htable_t *ht);
 extern uintptr_t htable_e2va(htable_t *ht, uint_t entry);
 
+/*
+ * Write protect, or unprotect, a level 0 htable through its parent entry.
+ */
+extern void htable_wprot(htable_t *ht);
+extern void htable_wprot_clear(htable_t *ht);
+
 /*
  * Interfaces that provide access to page table entries via the htable.
  *
@@ -273,7 +301,7 @@ extern x86pte_t	x86pte_get(htable_t *, uint_t entry);
 extern x86pte_t	x86pte_set(htable_t *, uint_t entry, x86pte_t new, void *);
 
 extern x86pte_t x86pte_inval(htable_t *ht, uint_t entry,
-	x86pte_t old, x86pte_t *ptr);
+	x86pte_t old, x86pte_t *ptr, boolean_t *tlbp);
 
 extern x86pte_t x86pte_update(htable_t *ht, uint_t entry,
 	x86pte_t old, x86pte_t new);
@@ -556,6 +556,7 @@ extern page_t *page_freelist_coalesce(int, uchar_t, uint_t, uint_t, int,
 extern void page_freelist_coalesce_all(int);
 extern uint_t page_get_pagecolors(uint_t);
 extern void pfnzero(pfn_t, uint_t, uint_t);
+extern size_t get_segkmem_lpsize(size_t);
 
 #ifdef	__cplusplus
 }
@@ -301,6 +301,12 @@ uint_t mmu_legacy_page_sizes;
 pgcnt_t shm_lpg_min_physmem = 1 << (30 - MMU_PAGESHIFT);
 pgcnt_t privm_lpg_min_physmem = 1 << (30 - MMU_PAGESHIFT);
 
+/*
+ * Minimum physmem required before the kernel heap is mapped with large
+ * pages.  This value can be changed via /etc/system.
+ */
+pgcnt_t segkmem_lpminphysmem = 1 << (30 - MMU_PAGESHIFT);
+
 /*
  * Maximum and default segment size tunables for user private
  * and shared anon memory, and user text and initialized data.
@@ -361,6 +367,31 @@ static kmutex_t	contig_lock;
 
 #define	PFN_16M		(mmu_btop((uint64_t)0x1000000))
 
+/*
+ * Choose the large page size for the kernel heap.  lpsize is the value of
+ * segkmem_lpsize from /etc/system; zero or an unsupported size gets 2M.
+ */
+size_t
+get_segkmem_lpsize(size_t lpsize)
+{
+#if defined(__xpv)
+	return (MMU_PAGESIZE);
+#else
+	uint_t l;
+
+	if (physmem < segkmem_lpminphysmem || mmu_page_sizes < 2)
+		return (MMU_PAGESIZE);
+	if (lpsize != 0 && lpsize <= MMU_PAGESIZE)
+		return (MMU_PAGESIZE);
+
+	for (l = mmu_page_sizes - 1; l > 1; l--) {
+		if (lpsize == LEVEL_SIZE(l))
+			return (lpsize);
+	}
+	return (LEVEL_SIZE(1));
+#endif
+}
+
 /*
  * Return the optimum page size for a given mapping
  */
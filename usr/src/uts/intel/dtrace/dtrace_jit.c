@@ -0,0 +1,631 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * DIF to amd64 translation.  See "DTrace DIF JIT" in <sys/dtrace_impl.h>.
+ *
+ * Each DIF instruction is translated on its own, with the DIF registers
+ * kept in the frame: %rbx holds the frame, %r12 and %r13 the condition
+ * codes and %r14 the address of this CPU's DTrace flags.  After a CMP,
+ * %r12 holds the difference of the operands and %r13 the carry; after a
+ * TST or SCMP, %r12 holds a value of the same sign as the result and %r13
+ * is zero.  As the interpreter never sets the overflow code, the signed
+ * branches then need only test the sign of %r12.
+ *
+ * The validator has already rejected backward branches, so the code is
+ * straight-line with forward jumps only.  It is generated twice: the
+ * first pass, with no buffer, only works out the size of the code and
+ * where each DIF instruction starts; the second emits it.  Every jump has
+ * a 32-bit displacement so that both passes produce the same sizes.
+ */
+
+#include <sys/dtrace_impl.h>
+#include <sys/sysmacros.h>
+
+#if defined(__amd64)
+
+typedef struct dtrace_jit_emit {
+	uint8_t *dje_buf;		/* NULL on the sizing pass */
+	size_t dje_off;			/* offset of next byte */
+	uint32_t *dje_pcoff;		/* offset of each DIF instruction */
+	size_t dje_exit;		/* offset of the zero-returning exit */
+	size_t dje_ret;			/* offset of the epilogue */
+	uint_t dje_pc;			/* DIF instruction being translated */
+} dtrace_jit_emit_t;
+
+#define	DJ_RAX		0
+#define	DJ_RCX		1
+#define	DJ_RDX		2
+#define	DJ_RSI		6
+#define	DJ_RDI		7
+
+#define	DJ_JMP		0x00
+#define	DJ_JZ		0x84
+#define	DJ_JNZ		0x85
+#define	DJ_JL		0x8c
+#define	DJ_JGE		0x8d
+#define	DJ_JLE		0x8e
+#define	DJ_JG		0x8f
+
+#define	DJ_REG(r)	((uint32_t)(offsetof(dtrace_jit_frame_t, djf_regs) + \
+			    (r) * sizeof (uint64_t)))
+#define	DJ_FIELD(f)	((uint32_t)offsetof(dtrace_jit_frame_t, f))
+
+static void
+dtrace_jit_1(dtrace_jit_emit_t *e, uint8_t b)
+{
+	if (e->dje_buf != NULL)
+		e->dje_buf[e->dje_off] = b;
+	e->dje_off++;
+}
+
+static void
+dtrace_jit_n(dtrace_jit_emit_t *e, const uint8_t *b, size_t n)
+{
+	while (n-- != 0)
+		dtrace_jit_1(e, *b++);
+}
+
+static void
+dtrace_jit_4(dtrace_jit_emit_t *e, uint32_t v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++, v >>= 8)
+		dtrace_jit_1(e, v & 0xff);
+}
+
+static void
+dtrace_jit_8(dtrace_jit_emit_t *e, uint64_t v)
+{
+	dtrace_jit_4(e, (uint32_t)v);
+	dtrace_jit_4(e, (uint32_t)(v >> 32));
+}
+
+#define	DJ_EMIT(e, ...)	do {						\
+	static const uint8_t b[] = { __VA_ARGS__ };			\
+	dtrace_jit_n((e), b, sizeof (b));				\
+	_NOTE(CONSTCOND) } while (0)
+
+/*
+ * mov disp32(%rbx), reg (load) or mov reg, disp32(%rbx) (store).
+ */
+static void
+dtrace_jit_mov(dtrace_jit_emit_t *e, uint8_t op, uint_t reg, uint32_t disp)
+{
+	dtrace_jit_1(e, 0x48 | (reg >= 8 ? 0x04 : 0));
+	dtrace_jit_1(e, op);
+	dtrace_jit_1(e, 0x80 | ((reg & 7) << 3) | 3);
+	dtrace_jit_4(e, disp);
+}
+
+static void
+dtrace_jit_ld(dtrace_jit_emit_t *e, uint_t reg, uint_t r)
+{
+	dtrace_jit_mov(e, 0x8b, reg, DJ_REG(r));
+}
+
+static void
+dtrace_jit_st(dtrace_jit_emit_t *e, uint_t reg, uint_t r)
+{
+	dtrace_jit_mov(e, 0x89, reg, DJ_REG(r));
+}
+
+/*
+ * movabs $v, reg
+ */
+static void
+dtrace_jit_imm64(dtrace_jit_emit_t *e, uint_t reg, uint64_t v)
+{
+	dtrace_jit_1(e, 0x48);
+	dtrace_jit_1(e, 0xb8 + reg);
+	dtrace_jit_8(e, v);
+}
+
+/*
+ * mov $v, reg32 (zero-extended)
+ */
+static void
+dtrace_jit_imm32(dtrace_jit_emit_t *e, uint_t reg, uint32_t v)
+{
+	dtrace_jit_1(e, 0xb8 + reg);
+	dtrace_jit_4(e, v);
+}
+
+/*
+ * movl $pc, djf_pc(%rbx): records the instruction that may fault.
+ */
+static void
+dtrace_jit_setpc(dtrace_jit_emit_t *e)
+{
+	DJ_EMIT(e, 0xc7, 0x83);
+	dtrace_jit_4(e, DJ_FIELD(djf_pc));
+	dtrace_jit_4(e, e->dje_pc);
+}
+
+/*
+ * jmp or jcc to an offset, with a 32-bit displacement.
+ */
+static void
+dtrace_jit_jump(dtrace_jit_emit_t *e, uint8_t cc, size_t to)
+{
+	if (cc == DJ_JMP) {
+		dtrace_jit_1(e, 0xe9);
+		dtrace_jit_4(e, (uint32_t)(to - (e->dje_off + 4)));
+	} else {
+		dtrace_jit_1(e, 0x0f);
+		dtrace_jit_1(e, cc);
+		dtrace_jit_4(e, (uint32_t)(to - (e->dje_off + 4)));
+	}
+}
+
+static void
+dtrace_jit_branch(dtrace_jit_emit_t *e, uint8_t cc, uint_t label)
+{
+	dtrace_jit_jump(e, cc, e->dje_pcoff[label]);
+}
+
+/*
+ * Calls one of the dtrace_jit_*() functions with the frame as its first
+ * argument (the others having been loaded by the caller), then leaves
+ * through the exit if it faulted.
+ */
+static void
+dtrace_jit_callout(dtrace_jit_emit_t *e, void *func)
+{
+	dtrace_jit_setpc(e);
+	DJ_EMIT(e, 0x48, 0x89, 0xdf);			/* mov %rbx, %rdi */
+	dtrace_jit_imm64(e, DJ_RAX, (uint64_t)(uintptr_t)func);
+	DJ_EMIT(e, 0xff, 0xd0);				/* call *%rax */
+	DJ_EMIT(e, 0x66, 0x41, 0xf7, 0x06);		/* testw $f, (%r14) */
+	dtrace_jit_1(e, CPU_DTRACE_FAULT & 0xff);
+	dtrace_jit_1(e, CPU_DTRACE_FAULT >> 8);
+	dtrace_jit_jump(e, DJ_JNZ, e->dje_exit);
+}
+
+static void
+dtrace_jit_divide(dtrace_jit_emit_t *e, uint_t op)
+{
+	/*
+	 * A zero divisor is a fault, as in the interpreter.  A divisor of
+	 * -1 is done without idiv, which would trap on INT64_MIN.
+	 */
+	DJ_EMIT(e, 0x48, 0x85, 0xc9);			/* test %rcx, %rcx */
+	DJ_EMIT(e, 0x75, 21);				/* jnz 1f */
+	dtrace_jit_setpc(e);
+	DJ_EMIT(e, 0x66, 0x41, 0x81, 0x0e);		/* orw $f, (%r14) */
+	dtrace_jit_1(e, CPU_DTRACE_DIVZERO & 0xff);
+	dtrace_jit_1(e, CPU_DTRACE_DIVZERO >> 8);
+	dtrace_jit_jump(e, DJ_JMP, e->dje_exit);
+							/* 1: */
+	switch (op) {
+	case DIF_OP_SDIV:
+		DJ_EMIT(e, 0x48, 0x83, 0xf9, 0xff);	/* cmp $-1, %rcx */
+		DJ_EMIT(e, 0x75, 5);			/* jne 2f */
+		DJ_EMIT(e, 0x48, 0xf7, 0xd8);		/* neg %rax */
+		DJ_EMIT(e, 0xeb, 5);			/* jmp 3f */
+		DJ_EMIT(e, 0x48, 0x99);			/* 2: cqo */
+		DJ_EMIT(e, 0x48, 0xf7, 0xf9);		/* idiv %rcx */
+		break;					/* 3: */
+	case DIF_OP_SREM:
+		DJ_EMIT(e, 0x48, 0x83, 0xf9, 0xff);	/* cmp $-1, %rcx */
+		DJ_EMIT(e, 0x75, 4);			/* jne 2f */
+		DJ_EMIT(e, 0x31, 0xc0);			/* xor %eax, %eax */
+		DJ_EMIT(e, 0xeb, 8);			/* jmp 3f */
+		DJ_EMIT(e, 0x48, 0x99);			/* 2: cqo */
+		DJ_EMIT(e, 0x48, 0xf7, 0xf9);		/* idiv %rcx */
+		DJ_EMIT(e, 0x48, 0x89, 0xd0);		/* mov %rdx, %rax */
+		break;					/* 3: */
+	case DIF_OP_UDIV:
+		DJ_EMIT(e, 0x31, 0xd2);			/* xor %edx, %edx */
+		DJ_EMIT(e, 0x48, 0xf7, 0xf1);		/* div %rcx */
+		break;
+	case DIF_OP_UREM:
+		DJ_EMIT(e, 0x31, 0xd2);			/* xor %edx, %edx */
+		DJ_EMIT(e, 0x48, 0xf7, 0xf1);		/* div %rcx */
+		DJ_EMIT(e, 0x48, 0x89, 0xd0);		/* mov %rdx, %rax */
+		break;
+	}
+}
+
+/*
+ * Returns the scalar global that a LDGS or STGS of variable id can access
+ * directly, or NULL if it must be left to the interpreter.
+ */
+static dtrace_statvar_t *
+dtrace_jit_global(dtrace_vstate_t *vstate, uint_t id)
+{
+	dtrace_statvar_t *svar;
+
+	if (id < DIF_VAR_OTHER_UBASE)
+		return (NULL);
+
+	id -= DIF_VAR_OTHER_UBASE;
+
+	if (id >= (uint_t)vstate->dtvs_nglobals ||
+	    (svar = vstate->dtvs_globals[id]) == NULL)
+		return (NULL);
+
+	if (svar->dtsv_var.dtdv_type.dtdt_flags & DIF_TF_BYREF)
+		return (NULL);
+
+	return (svar);
+}
+
+static int
+dtrace_jit_translate(dtrace_jit_emit_t *e, dtrace_difo_t *dp,
+    dtrace_vstate_t *vstate)
+{
+	dtrace_statvar_t *svar;
+	dif_instr_t instr;
+	uint_t pc, op, r1, r2, rd, id;
+
+	e->dje_off = 0;
+
+	DJ_EMIT(e, 0x55);				/* push %rbp */
+	DJ_EMIT(e, 0x48, 0x89, 0xe5);			/* mov %rsp, %rbp */
+	DJ_EMIT(e, 0x53);				/* push %rbx */
+	DJ_EMIT(e, 0x41, 0x54);				/* push %r12 */
+	DJ_EMIT(e, 0x41, 0x55);				/* push %r13 */
+	DJ_EMIT(e, 0x41, 0x56);				/* push %r14 */
+	DJ_EMIT(e, 0x48, 0x89, 0xfb);			/* mov %rdi, %rbx */
+	dtrace_jit_mov(e, 0x8b, 14, DJ_FIELD(djf_flags));
+	DJ_EMIT(e, 0x41, 0xbc, 1, 0, 0, 0);		/* mov $1, %r12d */
+	DJ_EMIT(e, 0x45, 0x31, 0xed);			/* xor %r13d, %r13d */
+
+	for (pc = 0; pc < dp->dtdo_len; pc++) {
+		e->dje_pc = pc;
+		e->dje_pcoff[pc] = (uint32_t)e->dje_off;
+
+		instr = dp->dtdo_buf[pc];
+		op = DIF_INSTR_OP(instr);
+		r1 = DIF_INSTR_R1(instr);
+		r2 = DIF_INSTR_R2(instr);
+		rd = DIF_INSTR_RD(instr);
+
+		switch (op) {
+		case DIF_OP_OR:
+		case DIF_OP_XOR:
+		case DIF_OP_AND:
+		case DIF_OP_SUB:
+		case DIF_OP_ADD:
+		case DIF_OP_MUL:
+		case DIF_OP_SLL:
+		case DIF_OP_SRL:
+		case DIF_OP_SRA:
+		case DIF_OP_SDIV:
+		case DIF_OP_UDIV:
+		case DIF_OP_SREM:
+		case DIF_OP_UREM:
+			dtrace_jit_ld(e, DJ_RAX, r1);
+			dtrace_jit_ld(e, DJ_RCX, r2);
+
+			switch (op) {
+			case DIF_OP_OR:
+				DJ_EMIT(e, 0x48, 0x09, 0xc8);
+				break;
+			case DIF_OP_XOR:
+				DJ_EMIT(e, 0x48, 0x31, 0xc8);
+				break;
+			case DIF_OP_AND:
+				DJ_EMIT(e, 0x48, 0x21, 0xc8);
+				break;
+			case DIF_OP_SUB:
+				DJ_EMIT(e, 0x48, 0x29, 0xc8);
+				break;
+			case DIF_OP_ADD:
+				DJ_EMIT(e, 0x48, 0x01, 0xc8);
+				break;
+			case DIF_OP_MUL:
+				DJ_EMIT(e, 0x48, 0x0f, 0xaf, 0xc1);
+				break;
+			case DIF_OP_SLL:
+				DJ_EMIT(e, 0x48, 0xd3, 0xe0);
+				break;
+			case DIF_OP_SRL:
+				DJ_EMIT(e, 0x48, 0xd3, 0xe8);
+				break;
+			case DIF_OP_SRA:
+				DJ_EMIT(e, 0x48, 0xd3, 0xf8);
+				break;
+			default:
+				dtrace_jit_divide(e, op);
+				break;
+			}
+
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_NOT:
+			dtrace_jit_ld(e, DJ_RAX, r1);
+			DJ_EMIT(e, 0x48, 0xf7, 0xd0);		/* not %rax */
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_MOV:
+			dtrace_jit_ld(e, DJ_RAX, r1);
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_CMP:
+			dtrace_jit_ld(e, DJ_RAX, r1);
+			DJ_EMIT(e, 0x45, 0x31, 0xed);	/* xor %r13d, %r13d */
+			dtrace_jit_mov(e, 0x2b, DJ_RAX, DJ_REG(r2));
+			DJ_EMIT(e, 0x41, 0x0f, 0x92, 0xc5);	/* setb %r13b */
+			DJ_EMIT(e, 0x49, 0x89, 0xc4);	/* mov %rax, %r12 */
+			break;
+
+		case DIF_OP_TST:
+			dtrace_jit_ld(e, DJ_RAX, r1);
+			DJ_EMIT(e, 0x45, 0x31, 0xe4);	/* xor %r12d, %r12d */
+			DJ_EMIT(e, 0x45, 0x31, 0xed);	/* xor %r13d, %r13d */
+			DJ_EMIT(e, 0x48, 0x85, 0xc0);	/* test %rax, %rax */
+			DJ_EMIT(e, 0x41, 0x0f, 0x95, 0xc4); /* setne %r12b */
+			break;
+
+		case DIF_OP_SCMP:
+			dtrace_jit_ld(e, DJ_RSI, r1);
+			dtrace_jit_ld(e, DJ_RDX, r2);
+			dtrace_jit_callout(e, (void *)dtrace_jit_scmp);
+			DJ_EMIT(e, 0x49, 0x89, 0xc4);	/* mov %rax, %r12 */
+			DJ_EMIT(e, 0x45, 0x31, 0xed);	/* xor %r13d, %r13d */
+			break;
+
+		case DIF_OP_BA:
+			dtrace_jit_branch(e, DJ_JMP, DIF_INSTR_LABEL(instr));
+			break;
+
+		case DIF_OP_BE:
+		case DIF_OP_BNE:
+		case DIF_OP_BG:
+		case DIF_OP_BGE:
+		case DIF_OP_BL:
+		case DIF_OP_BLE:
+			DJ_EMIT(e, 0x4d, 0x85, 0xe4);	/* test %r12, %r12 */
+			dtrace_jit_branch(e, op == DIF_OP_BE ? DJ_JZ :
+			    op == DIF_OP_BNE ? DJ_JNZ :
+			    op == DIF_OP_BG ? DJ_JG :
+			    op == DIF_OP_BGE ? DJ_JGE :
+			    op == DIF_OP_BL ? DJ_JL : DJ_JLE,
+			    DIF_INSTR_LABEL(instr));
+			break;
+
+		case DIF_OP_BGU:
+			DJ_EMIT(e, 0x4d, 0x85, 0xed);	/* test %r13, %r13 */
+			DJ_EMIT(e, 0x75, 9);		/* jnz 1f */
+			DJ_EMIT(e, 0x4d, 0x85, 0xe4);	/* test %r12, %r12 */
+			dtrace_jit_branch(e, DJ_JNZ, DIF_INSTR_LABEL(instr));
+			break;					/* 1: */
+
+		case DIF_OP_BGEU:
+		case DIF_OP_BLU:
+			DJ_EMIT(e, 0x4d, 0x85, 0xed);	/* test %r13, %r13 */
+			dtrace_jit_branch(e, op == DIF_OP_BGEU ? DJ_JZ : DJ_JNZ,
+			    DIF_INSTR_LABEL(instr));
+			break;
+
+		case DIF_OP_BLEU:
+			DJ_EMIT(e, 0x4d, 0x85, 0xed);	/* test %r13, %r13 */
+			dtrace_jit_branch(e, DJ_JNZ, DIF_INSTR_LABEL(instr));
+			DJ_EMIT(e, 0x4d, 0x85, 0xe4);	/* test %r12, %r12 */
+			dtrace_jit_branch(e, DJ_JZ, DIF_INSTR_LABEL(instr));
+			break;
+
+		case DIF_OP_RET:
+			dtrace_jit_ld(e, DJ_RAX, rd);
+			dtrace_jit_jump(e, DJ_JMP, e->dje_ret);
+			break;
+
+		case DIF_OP_NOP:
+			break;
+
+		case DIF_OP_SETX:
+			dtrace_jit_imm64(e, DJ_RAX,
+			    dp->dtdo_inttab[DIF_INSTR_INTEGER(instr)]);
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_SETS:
+			dtrace_jit_imm64(e, DJ_RAX, (uint64_t)(uintptr_t)
+			    (dp->dtdo_strtab + DIF_INSTR_STRING(instr)));
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_LDGA:
+			dtrace_jit_imm32(e, DJ_RSI, r1);
+			dtrace_jit_ld(e, DJ_RDX, r2);
+			dtrace_jit_callout(e, (void *)dtrace_jit_variable);
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_LDGS:
+			id = DIF_INSTR_VAR(instr);
+
+			if (id < DIF_VAR_OTHER_UBASE) {
+				dtrace_jit_imm32(e, DJ_RSI, id);
+				DJ_EMIT(e, 0x31, 0xd2);	/* xor %edx, %edx */
+				dtrace_jit_callout(e,
+				    (void *)dtrace_jit_variable);
+				dtrace_jit_st(e, DJ_RAX, rd);
+				break;
+			}
+
+			if ((svar = dtrace_jit_global(vstate, id)) == NULL)
+				return (-1);
+
+			dtrace_jit_imm64(e, DJ_RAX,
+			    (uint64_t)(uintptr_t)&svar->dtsv_data);
+			DJ_EMIT(e, 0x48, 0x8b, 0x00);	/* mov (%rax), %rax */
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_STGS:
+			id = DIF_INSTR_VAR(instr);
+
+			if ((svar = dtrace_jit_global(vstate, id)) == NULL)
+				return (-1);
+
+			dtrace_jit_ld(e, DJ_RCX, rd);
+			dtrace_jit_imm64(e, DJ_RAX,
+			    (uint64_t)(uintptr_t)&svar->dtsv_data);
+			DJ_EMIT(e, 0x48, 0x89, 0x08);	/* mov %rcx, (%rax) */
+			break;
+
+		case DIF_OP_LDSB:
+		case DIF_OP_LDSH:
+		case DIF_OP_LDSW:
+		case DIF_OP_LDUB:
+		case DIF_OP_LDUH:
+		case DIF_OP_LDUW:
+		case DIF_OP_LDX:
+		case DIF_OP_RLDSB:
+		case DIF_OP_RLDSH:
+		case DIF_OP_RLDSW:
+		case DIF_OP_RLDUB:
+		case DIF_OP_RLDUH:
+		case DIF_OP_RLDUW:
+		case DIF_OP_RLDX:
+		case DIF_OP_ULDSB:
+		case DIF_OP_ULDSH:
+		case DIF_OP_ULDSW:
+		case DIF_OP_ULDUB:
+		case DIF_OP_ULDUH:
+		case DIF_OP_ULDUW:
+		case DIF_OP_ULDX:
+			dtrace_jit_imm32(e, DJ_RSI, op);
+			dtrace_jit_ld(e, DJ_RDX, r1);
+			dtrace_jit_callout(e, (void *)dtrace_jit_load);
+			dtrace_jit_st(e, DJ_RAX, rd);
+			break;
+
+		case DIF_OP_STB:
+		case DIF_OP_STH:
+		case DIF_OP_STW:
+		case DIF_OP_STX:
+			dtrace_jit_imm32(e, DJ_RSI, op);
+			dtrace_jit_ld(e, DJ_RDX, rd);
+			dtrace_jit_ld(e, DJ_RCX, r1);
+			dtrace_jit_callout(e, (void *)dtrace_jit_store);
+			break;
+
+		case DIF_OP_PUSHTR:
+		case DIF_OP_PUSHTV:
+			dtrace_jit_imm32(e, DJ_RSI, instr);
+			dtrace_jit_callout(e, (void *)dtrace_jit_push);
+			break;
+
+		case DIF_OP_POPTS:
+			/* subl $1, djf_ttop(%rbx); adcl $0, djf_ttop(%rbx) */
+			DJ_EMIT(e, 0x83, 0xab);
+			dtrace_jit_4(e, DJ_FIELD(djf_ttop));
+			dtrace_jit_1(e, 1);
+			DJ_EMIT(e, 0x83, 0x93);
+			dtrace_jit_4(e, DJ_FIELD(djf_ttop));
+			dtrace_jit_1(e, 0);
+			break;
+
+		case DIF_OP_FLUSHTS:
+			DJ_EMIT(e, 0xc7, 0x83);		/* movl $0, ttop */
+			dtrace_jit_4(e, DJ_FIELD(djf_ttop));
+			dtrace_jit_4(e, 0);
+			break;
+
+		case DIF_OP_CALL:
+			dtrace_jit_imm32(e, DJ_RSI, DIF_INSTR_SUBR(instr));
+			dtrace_jit_imm32(e, DJ_RDX, rd);
+			dtrace_jit_callout(e, (void *)dtrace_jit_call);
+			break;
+
+		default:
+			/*
+			 * Thread-local, clause-local and associative
+			 * variables, string allocation and translators are
+			 * left to the interpreter.
+			 */
+			return (-1);
+		}
+	}
+
+	/*
+	 * Falling off the end, like a fault, returns zero.
+	 */
+	e->dje_exit = e->dje_off;
+	DJ_EMIT(e, 0x31, 0xc0);				/* xor %eax, %eax */
+	e->dje_ret = e->dje_off;
+	DJ_EMIT(e, 0x41, 0x5e);				/* pop %r14 */
+	DJ_EMIT(e, 0x41, 0x5d);				/* pop %r13 */
+	DJ_EMIT(e, 0x41, 0x5c);				/* pop %r12 */
+	DJ_EMIT(e, 0x5b);				/* pop %rbx */
+	DJ_EMIT(e, 0x5d);				/* pop %rbp */
+	DJ_EMIT(e, 0xc3);				/* ret */
+
+	return (0);
+}
+
+dtrace_jit_t *
+dtrace_dif_jit(dtrace_difo_t *dp, dtrace_vstate_t *vstate, size_t *lenp)
+{
+	dtrace_jit_emit_t e;
+	size_t pclen = dp->dtdo_len * sizeof (uint32_t);
+	size_t len = 0;
+	int err;
+
+	if (dp->dtdo_len == 0)
+		return (NULL);
+
+	bzero(&e, sizeof (e));
+	e.dje_pcoff = kmem_zalloc(pclen, KM_SLEEP);
+
+	/*
+	 * The sizing pass sees the exit at offset zero; the second pass
+	 * uses the offsets the first one found.
+	 */
+	if ((err = dtrace_jit_translate(&e, dp, vstate)) == 0) {
+		len = e.dje_off;
+		e.dje_buf = kmem_alloc(len, KM_SLEEP);
+		err = dtrace_jit_translate(&e, dp, vstate);
+		ASSERT(err != 0 || e.dje_off == len);
+	}
+
+	kmem_free(e.dje_pcoff, pclen);
+
+	if (err != 0) {
+		if (e.dje_buf != NULL)
+			kmem_free(e.dje_buf, len);
+		return (NULL);
+	}
+
+	*lenp = len;
+	return ((dtrace_jit_t *)(uintptr_t)e.dje_buf);
+}
+
+void
+dtrace_dif_jit_free(dtrace_jit_t *jit, size_t len)
+{
+	kmem_free((void *)(uintptr_t)jit, len);
+}
+
+#else	/* __amd64 */
+
+/*ARGSUSED*/
+dtrace_jit_t *
+dtrace_dif_jit(dtrace_difo_t *dp, dtrace_vstate_t *vstate, size_t *lenp)
+{
+	return (NULL);
+}
+
+/*ARGSUSED*/
+void
+dtrace_dif_jit_free(dtrace_jit_t *jit, size_t len)
+{
+}
+
+#endif	/* __amd64 */
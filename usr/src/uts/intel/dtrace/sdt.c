@@ -87,8 +87,13 @@ sdt_invop(uintptr_t addr, uintptr_t *stack, uintptr_t eax)
 			DTRACE_CPUFLAG_CLEAR(CPU_DTRACE_NOFAULT |
 			    CPU_DTRACE_BADADDR);
 
-			dtrace_probe(sdt->sdp_id, stack0, stack1,
-			    stack2, stack3, stack4);
+			if (sdt->sdp_flags & SDT_RECORD)
+				sdt_fr_record(sdt, stack0, stack1, stack2);
+
+			if (sdt->sdp_flags & SDT_ENABLED) {
+				dtrace_probe(sdt->sdp_id, stack0, stack1,
+				    stack2, stack3, stack4);
+			}
 
 			return (DTRACE_INVOP_NOP);
 		}
@@ -186,6 +191,17 @@ sdt_provide_module(void *arg, struct modctl *ctl)
 		sdp->sdp_patchval = SDT_PATCHVAL;
 		sdp->sdp_patchpoint = (uint8_t *)sdpd->sdpd_offset;
 		sdp->sdp_savedval = *sdp->sdp_patchpoint;
+
+		/*
+		 * A probe site for the flight recorder is patched from now
+		 * on, and holds its module in place as an enabled one does.
+		 */
+		if (sdt_fr_match(sdp)) {
+			sdp->sdp_flags |= SDT_RECORD;
+			*sdp->sdp_patchpoint = sdp->sdp_patchval;
+			ctl->mod_nenabled++;
+			sdt_fr_nprobes++;
+		}
 	}
 }
 
@@ -206,6 +222,7 @@ sdt_destroy(void *arg, dtrace_id_t id, void *parg)
 
 	while (sdp != NULL) {
 		old = sdp;
+		ASSERT(!(sdp->sdp_flags & SDT_RECORD));
 
 		/*
 		 * Now we need to remove this probe from the sdt_probetab.
@@ -269,6 +286,7 @@ sdt_enable(void *arg, dtrace_id_t id, void *parg)
 	}
 
 	while (sdp != NULL) {
+		sdp->sdp_flags |= SDT_ENABLED;
 		*sdp->sdp_patchpoint = sdp->sdp_patchval;
 		sdp = sdp->sdp_next;
 	}
@@ -289,7 +307,11 @@ sdt_disable(void *arg, dtrace_id_t id, void *parg)
 		goto err;
 
 	while (sdp != NULL) {
-		*sdp->sdp_patchpoint = sdp->sdp_savedval;
+		sdp->sdp_flags &= ~SDT_ENABLED;
+
+		if (!(sdp->sdp_flags & SDT_RECORD))
+			*sdp->sdp_patchpoint = sdp->sdp_savedval;
+
 		sdp = sdp->sdp_next;
 	}
 
@@ -422,6 +444,7 @@ sdt_attach(dev_info_t *devi, ddi_attach_cmd_t cmd)
 	sdt_probetab =
 	    kmem_zalloc(sdt_probetab_size * sizeof (sdt_probe_t *), KM_SLEEP);
 	dtrace_invop_add(sdt_invop);
+	sdt_fr_init();
 
 	for (prov = sdt_providers; prov->sdtp_name != NULL; prov++) {
 		uint32_t priv;
@@ -442,6 +465,27 @@ sdt_attach(dev_info_t *devi, ddi_attach_cmd_t cmd)
 		}
 	}
 
+	/*
+	 * DTrace only asks for probes once it is itself opened, so for the
+	 * flight recorder to start now, we look for them ourselves.  Holding
+	 * mod_lock serializes us with DTrace's own calls.
+	 */
+	if (sdt_fr_bufs != NULL) {
+		struct modctl *ctl;
+
+		mutex_enter(&mod_lock);
+
+		ctl = &modules;
+		do {
+			if (ctl->mod_busy || ctl->mod_mp == NULL)
+				continue;
+
+			sdt_provide_module(NULL, ctl);
+		} while ((ctl = ctl->mod_next) != &modules);
+
+		mutex_exit(&mod_lock);
+	}
+
 	return (DDI_SUCCESS);
 }
 
@@ -462,6 +506,9 @@ sdt_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
 		return (DDI_FAILURE);
 	}
 
+	if (sdt_fr_nprobes != 0)
+		return (DDI_FAILURE);
+
 	for (prov = sdt_providers; prov->sdtp_name != NULL; prov++) {
 		if (prov->sdtp_id != DTRACE_PROVNONE) {
 			if (dtrace_unregister(prov->sdtp_id) != 0)
@@ -473,6 +520,7 @@ sdt_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
 
 	dtrace_invop_remove(sdt_invop);
 	kmem_free(sdt_probetab, sdt_probetab_size * sizeof (sdt_probe_t *));
+	sdt_fr_fini();
 
 	return (DDI_SUCCESS);
 }
@@ -505,6 +553,13 @@ sdt_open(dev_t *devp, int flag, int otyp, cred_t *cred_p)
 	return (0);
 }
 
+/*ARGSUSED*/
+static int
+sdt_ioctl(dev_t dev, int cmd, intptr_t arg, int md, cred_t *cr, int *rv)
+{
+	return (sdt_fr_ioctl(cmd, arg, cr));
+}
+
 static struct cb_ops sdt_cb_ops = {
 	sdt_open,		/* open */
 	nodev,			/* close */
@@ -513,7 +568,7 @@ static struct cb_ops sdt_cb_ops = {
 	nodev,			/* dump */
 	nodev,			/* read */
 	nodev,			/* write */
-	nodev,			/* ioctl */
+	sdt_ioctl,		/* ioctl */
 	nodev,			/* devmap */
 	nodev,			/* mmap */
 	nodev,			/* segmap */
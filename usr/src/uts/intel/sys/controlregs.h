@@ -107,11 +107,12 @@ extern "C" {
 					/* 0x1000 reserved */
 #define	CR4_VMXE	0x2000
 #define	CR4_SMXE	0x4000
+#define	CR4_PCIDE	0x20000		/* process context ids		*/
 #define	CR4_OSXSAVE	0x40000		/* OS xsave/xrestore support	*/
 
 #define	FMT_CR4							\
-	"\20\23osxsav\17smxe\16vmxe\13xmme\12fxsr\11pce\10pge"		\
-	"\7mce\6pae\5pse\4de\3tsd\2pvi\1vme"
+	"\20\23osxsav\22pcide\17smxe\16vmxe\13xmme\12fxsr\11pce"	\
+	"\10pge\7mce\6pae\5pse\4de\3tsd\2pvi\1vme"
 
 /*
  * Enable the SSE-related control bits to explain to the processor that
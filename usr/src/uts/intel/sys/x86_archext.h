@@ -113,7 +113,7 @@ extern "C" {
 #define	CPUID_INTC_ECX_ETPRD	0x00004000	/* extended task pri messages */
 						/* 0x00008000 - reserved */
 						/* 0x00010000 - reserved */
-						/* 0x00020000 - reserved */
+#define	CPUID_INTC_ECX_PCID	0x00020000	/* process context ids */
 #define	CPUID_INTC_ECX_DCA	0x00040000	/* direct cache access */
 #define	CPUID_INTC_ECX_SSE4_1	0x00080000	/* SSE4.1 insns */
 #define	CPUID_INTC_ECX_SSE4_2	0x00100000	/* SSE4.2 insns */
@@ -133,9 +133,16 @@ extern "C" {
 	"\37rdrand\36f16c\35avx\34osxsav\33xsave"		\
 	"\32aes"						\
 	"\30popcnt\27movbe\26x2apic\25sse4.2\24sse4.1\23dca"	\
-	"\20\17etprd\16cx16\13cid\12ssse3\11tm2"		\
+	"\22pcid\20\17etprd\16cx16\13cid\12ssse3\11tm2"		\
 	"\10est\7smx\6vmx\5dscpl\4mon\2pclmulqdq\1sse3"
 
+/*
+ * cpuid instruction feature flags in %ebx (standard function 7, %ecx == 0)
+ */
+
+#define	CPUID_INTC_EBX_7_0_BMI2	0x00000100	/* BMI2 (mulx etc.) */
+#define	CPUID_INTC_EBX_7_0_ADX	0x00080000	/* ADX (adcx, adox) */
+
 /*
  * cpuid instruction feature flags in %edx (extended function 0x80000001)
  */
@@ -382,6 +389,9 @@ extern "C" {
 #define	X86FSET_F16C		38
 #define	X86FSET_RDRAND		39
 #define	X86FSET_X2APIC		40
+#define	X86FSET_PCID		41
+#define	X86FSET_BMI2		42
+#define	X86FSET_ADX		43
 
 /*
  * flags to patch tsc_read routine.
@@ -642,7 +652,7 @@ extern "C" {
 
 #if defined(_KERNEL) || defined(_KMEMUSER)
 
-#define	NUM_X86_FEATURES	41
+#define	NUM_X86_FEATURES	44
 extern uchar_t x86_featureset[];
 
 extern void free_x86_featureset(void *featureset);
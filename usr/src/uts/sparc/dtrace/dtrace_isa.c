@@ -948,3 +948,16 @@ dtrace_getvmreg(uint_t ndx, volatile uint16_t *flags)
 
 	return (0);
 }
+
+/*ARGSUSED*/
+dtrace_jit_t *
+dtrace_dif_jit(dtrace_difo_t *dp, dtrace_vstate_t *vstate, size_t *lenp)
+{
+	return (NULL);
+}
+
+/*ARGSUSED*/
+void
+dtrace_dif_jit_free(dtrace_jit_t *jit, size_t len)
+{
+}